@@ -0,0 +1,155 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "AsynclogFormat.h"
+
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include <folly/Bits.h>
+#include <folly/Format.h>
+#include <folly/io/Compression.h>
+#include <folly/io/IOBuf.h>
+
+#include "mcrouter/lib/fbi/hash.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+const char kBlockMagic[] = "ASB1";
+const size_t kMagicSize = 4;
+const size_t kBlockHeaderSize = kMagicSize + 3 * sizeof(uint32_t);
+
+const folly::io::CodecType kCodecType = folly::io::CodecType::LZ4;
+
+template <class T>
+void appendInt(T value, std::string& out) {
+  value = folly::Endian::little(value);
+  out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void appendString(folly::StringPiece s, std::string& out) {
+  if (s.size() > std::numeric_limits<uint16_t>::max()) {
+    throw std::runtime_error(
+      folly::sformat("asynclog: field of {} bytes is too long", s.size()));
+  }
+  appendInt<uint16_t>(s.size(), out);
+  out.append(s.data(), s.size());
+}
+
+template <class T>
+T readInt(folly::StringPiece& data) {
+  if (data.size() < sizeof(T)) {
+    throw std::runtime_error("asynclog: truncated record");
+  }
+  T value;
+  std::memcpy(&value, data.data(), sizeof(T));
+  data.advance(sizeof(T));
+  return folly::Endian::little(value);
+}
+
+std::string readString(folly::StringPiece& data) {
+  auto size = readInt<uint16_t>(data);
+  if (data.size() < size) {
+    throw std::runtime_error("asynclog: truncated record");
+  }
+  auto s = data.subpiece(0, size).str();
+  data.advance(size);
+  return s;
+}
+
+}  // anonymous namespace
+
+void appendAsynclogRecord(const AsynclogRecord& record, std::string& out) {
+  appendInt(static_cast<uint8_t>(record.op), out);
+  appendInt(record.timestampMs, out);
+  appendInt(record.port, out);
+  appendString(record.host, out);
+  appendString(record.pool, out);
+  appendString(record.key, out);
+}
+
+std::string encodeAsynclogBlock(folly::StringPiece records) {
+  auto codec = folly::io::getCodec(kCodecType);
+  auto input = folly::IOBuf::wrapBuffer(records.data(), records.size());
+  auto compressed = codec->compress(input.get());
+  compressed->coalesce();
+
+  std::string block;
+  block.reserve(kBlockHeaderSize + compressed->length());
+  block.append(kBlockMagic, kMagicSize);
+  appendInt<uint32_t>(records.size(), block);
+  appendInt<uint32_t>(compressed->length(), block);
+  appendInt<uint32_t>(
+    crc32_hash(reinterpret_cast<const char*>(compressed->data()),
+               compressed->length()),
+    block);
+  block.append(reinterpret_cast<const char*>(compressed->data()),
+               compressed->length());
+  return block;
+}
+
+AsynclogBinaryReader::AsynclogBinaryReader(folly::StringPiece data)
+    : data_(data),
+      codec_(folly::io::getCodec(kCodecType)) {
+}
+
+AsynclogBinaryReader::~AsynclogBinaryReader() {
+}
+
+bool AsynclogBinaryReader::next(AsynclogRecord& record) {
+  while (blockLeft_.empty()) {
+    if (data_.empty()) {
+      return false;
+    }
+    readBlock();
+  }
+
+  auto op = readInt<uint8_t>(blockLeft_);
+  if (op != static_cast<uint8_t>(AsynclogOp::Delete)) {
+    throw std::runtime_error(folly::sformat("asynclog: unknown op {}", op));
+  }
+  record.op = static_cast<AsynclogOp>(op);
+  record.timestampMs = readInt<uint64_t>(blockLeft_);
+  record.port = readInt<uint16_t>(blockLeft_);
+  record.host = readString(blockLeft_);
+  record.pool = readString(blockLeft_);
+  record.key = readString(blockLeft_);
+  return true;
+}
+
+void AsynclogBinaryReader::readBlock() {
+  if (data_.size() < kBlockHeaderSize ||
+      std::memcmp(data_.data(), kBlockMagic, kMagicSize) != 0) {
+    throw std::runtime_error("asynclog: bad block header");
+  }
+  data_.advance(kMagicSize);
+  auto uncompressedSize = readInt<uint32_t>(data_);
+  auto compressedSize = readInt<uint32_t>(data_);
+  auto checksum = readInt<uint32_t>(data_);
+  if (data_.size() < compressedSize) {
+    throw std::runtime_error("asynclog: truncated block");
+  }
+  auto compressed = data_.subpiece(0, compressedSize);
+  data_.advance(compressedSize);
+  if (crc32_hash(compressed.data(), compressed.size()) != checksum) {
+    throw std::runtime_error("asynclog: block checksum mismatch");
+  }
+
+  auto input = folly::IOBuf::wrapBuffer(compressed.data(), compressed.size());
+  auto uncompressed = codec_->uncompress(input.get(), uncompressedSize);
+  uncompressed->coalesce();
+  block_.assign(reinterpret_cast<const char*>(uncompressed->data()),
+                uncompressed->length());
+  blockLeft_ = block_;
+}
+
+}}}  // facebook::memcache::mcrouter
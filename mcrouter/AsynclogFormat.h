@@ -0,0 +1,92 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <folly/Range.h>
+
+namespace folly { namespace io {
+class Codec;
+}}  // folly::io
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Binary asynclog spool format (use_asynclog_binary).
+ *
+ * A spool file is a sequence of blocks, one per asynclog write:
+ *   "ASB1" magic, 4 bytes
+ *   uncompressed size, compressed size, crc32 of compressed data:
+ *     uint32 each
+ *   compressed data: LZ4 compressed records
+ *
+ * A record is:
+ *   op: uint8
+ *   timestamp in ms: uint64
+ *   port: uint16
+ *   host, pool, key: uint16 size followed by the bytes, each
+ *
+ * All integers are little endian.
+ */
+
+enum class AsynclogOp : uint8_t {
+  Delete = 1,
+};
+
+struct AsynclogRecord {
+  AsynclogOp op{AsynclogOp::Delete};
+  uint64_t timestampMs{0};
+  std::string host;
+  uint16_t port{0};
+  std::string pool;
+  std::string key;
+};
+
+/**
+ * Serializes record and appends it to out.
+ */
+void appendAsynclogRecord(const AsynclogRecord& record, std::string& out);
+
+/**
+ * @param records  serialized records
+ * @return block with compressed records, ready to be written to a spool
+ */
+std::string encodeAsynclogBlock(folly::StringPiece records);
+
+/**
+ * Reads records from the contents of a binary spool file.
+ */
+class AsynclogBinaryReader {
+ public:
+  explicit AsynclogBinaryReader(folly::StringPiece data);
+  ~AsynclogBinaryReader();
+
+  /**
+   * Reads the next record.
+   *
+   * @return false if there are no more records
+   * @throws std::runtime_error if data is corrupted or truncated
+   */
+  bool next(AsynclogRecord& record);
+
+ private:
+  folly::StringPiece data_;
+  /* Uncompressed records of the current block, and the unread part */
+  std::string block_;
+  folly::StringPiece blockLeft_;
+  std::unique_ptr<folly::io::Codec> codec_;
+
+  void readBlock();
+};
+
+}}}  // facebook::memcache::mcrouter
@@ -12,12 +12,18 @@
 #include <folly/dynamic.h>
 #include <folly/Memory.h>
 
+#include "mcrouter/PoolStats.h"
 #include "mcrouter/ProxyClientCommon.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
-ClientPool::ClientPool(std::string name)
-  : name_(std::move(name)) {
+ClientPool::ClientPool(std::string name,
+                       std::chrono::milliseconds serverTimeout,
+                       bool keepRoutingPrefix)
+  : name_(std::move(name)),
+    statsId_(PoolStats::idFor(name_)),
+    serverTimeout_(serverTimeout),
+    keepRoutingPrefix_(keepRoutingPrefix) {
 }
 
 void ClientPool::setWeights(folly::dynamic weights) {
@@ -9,6 +9,7 @@
  */
 #pragma once
 
+#include <chrono>
 #include <memory>
 #include <string>
 #include <vector>
@@ -26,7 +27,13 @@ namespace facebook { namespace memcache { namespace mcrouter {
  */
 class ClientPool {
  public:
-  explicit ClientPool(std::string name);
+  /**
+   * @param serverTimeout  timeout of the pool's servers
+   * @param keepRoutingPrefix  send keys with their routing prefix
+   */
+  ClientPool(std::string name,
+             std::chrono::milliseconds serverTimeout,
+             bool keepRoutingPrefix);
 
   /**
    * Creates and adds new client to list of clients
@@ -47,6 +54,21 @@ class ClientPool {
     return name_;
   }
 
+  std::chrono::milliseconds serverTimeout() const {
+    return serverTimeout_;
+  }
+
+  bool keepRoutingPrefix() const {
+    return keepRoutingPrefix_;
+  }
+
+  /**
+   * Index of this pool's stats in proxy_t::poolStats, see PoolStats::idFor().
+   */
+  uint32_t statsId() const {
+    return statsId_;
+  }
+
   const std::vector<std::shared_ptr<ProxyClientCommon>>& getClients() const {
     return clients_;
   }
@@ -54,10 +76,26 @@ class ClientPool {
   void setWeights(folly::dynamic weights);
 
   folly::dynamic* getWeights() const;
+
+  /**
+   * Runtime variable overriding the weights, see WeightedCh3HashFunc
+   * (empty if none).
+   */
+  void setWeightsRuntimeVar(std::string name) {
+    weightsRuntimeVar_ = std::move(name);
+  }
+
+  const std::string& getWeightsRuntimeVar() const {
+    return weightsRuntimeVar_;
+  }
  private:
   std::vector<std::shared_ptr<ProxyClientCommon>> clients_;
   std::unique_ptr<folly::dynamic> weights_;
+  std::string weightsRuntimeVar_;
   std::string name_;
+  uint32_t statsId_;
+  std::chrono::milliseconds serverTimeout_;
+  bool keepRoutingPrefix_;
 };
 
 }}}  // facebook::memcache::mcrouter
@@ -0,0 +1,72 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "ConcurrencyLimiter.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+/* Weight of the new limit estimate, smooths out noisy windows */
+const double kSmoothing = 0.2;
+const double kMinGradient = 0.5;
+
+}  // anonymous namespace
+
+constexpr size_t ConcurrencyLimiter::kWindowSize;
+constexpr size_t ConcurrencyLimiter::kNoLoadResetWindows;
+
+ConcurrencyLimiter::ConcurrencyLimiter(size_t minLimit, size_t maxLimit)
+    : minLimit_(minLimit),
+      maxLimit_(maxLimit),
+      limit_(minLimit),
+      publishedLimit_(minLimit) {
+  assert(minLimit > 0);
+  assert(minLimit <= maxLimit);
+}
+
+void ConcurrencyLimiter::onSample(uint64_t latencyUs, size_t inflight) {
+  windowSumUs_ += latencyUs;
+  windowMaxInflight_ = std::max(windowMaxInflight_, inflight);
+  if (++windowSamples_ < kWindowSize) {
+    return;
+  }
+
+  onWindowEnd(static_cast<double>(windowSumUs_) / windowSamples_);
+  windowSumUs_ = 0;
+  windowSamples_ = 0;
+  windowMaxInflight_ = 0;
+}
+
+void ConcurrencyLimiter::onWindowEnd(double avgUs) {
+  if (++windowsSinceReset_ >= kNoLoadResetWindows || noLoadUs_ == 0.0) {
+    noLoadUs_ = avgUs;
+    windowsSinceReset_ = 0;
+  } else {
+    noLoadUs_ = std::min(noLoadUs_, avgUs);
+  }
+
+  double gradient = avgUs > 0.0 ? noLoadUs_ / avgUs : 1.0;
+  gradient = std::max(kMinGradient, std::min(1.0, gradient));
+
+  auto newLimit = limit_ * gradient + std::sqrt(limit_);
+  // Don't grow past what is actually being used.
+  newLimit = std::min(newLimit,
+                      std::max(limit_, 2.0 * windowMaxInflight_));
+  limit_ = (1 - kSmoothing) * limit_ + kSmoothing * newLimit;
+  limit_ = std::max(minLimit_, std::min(maxLimit_, limit_));
+  publishedLimit_.store(static_cast<size_t>(limit_),
+                        std::memory_order_relaxed);
+}
+
+}}}  // facebook::memcache::mcrouter
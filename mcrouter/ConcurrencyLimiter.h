@@ -0,0 +1,84 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Gradient (Vegas style) concurrency limiter.
+ *
+ * Latency samples are averaged over windows of kWindowSize samples.
+ * The lowest window average seen recently is taken as the no-load
+ * latency; at the end of each window the limit is scaled by
+ * noLoad / current (clamped to [0.5, 1]) and a small headroom of
+ * sqrt(limit) is added. So the limit grows while latency stays flat
+ * and shrinks as soon as requests start queueing somewhere.
+ *
+ * The limit never grows beyond twice the inflight count seen during
+ * a window, so that an idle proxy doesn't drift to maxLimit.
+ *
+ * Not thread safe, meant to be used by a single proxy thread; only
+ * limit() may be read from other threads (e.g. by stats).
+ */
+class ConcurrencyLimiter {
+ public:
+  static constexpr size_t kWindowSize = 100;
+  /* The no-load latency is re-learned every this many windows, to follow
+     permanent latency changes (e.g. destinations moving further away). */
+  static constexpr size_t kNoLoadResetWindows = 600;
+
+  /**
+   * @param minLimit  lower bound for the limit, must be positive; also the
+   *                  initial limit.
+   * @param maxLimit  upper bound for the limit, must be >= minLimit.
+   */
+  ConcurrencyLimiter(size_t minLimit, size_t maxLimit);
+
+  /**
+   * Registers a latency sample.
+   *
+   * @param latencyUs  observed request latency.
+   * @param inflight   number of requests in flight when it completed.
+   */
+  void onSample(uint64_t latencyUs, size_t inflight);
+
+  size_t limit() const {
+    return publishedLimit_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Lowest recent window average, 0 if not known yet.
+   */
+  double noLoadLatencyUs() const {
+    return noLoadUs_;
+  }
+
+ private:
+  const double minLimit_;
+  const double maxLimit_;
+  double limit_;
+  /* limit_ rounded down, updated at the end of each window */
+  std::atomic<size_t> publishedLimit_;
+
+  double noLoadUs_{0.0};
+  size_t windowsSinceReset_{0};
+
+  uint64_t windowSumUs_{0};
+  size_t windowSamples_{0};
+  size_t windowMaxInflight_{0};
+
+  void onWindowEnd(double avgUs);
+};
+
+}}}  // facebook::memcache::mcrouter
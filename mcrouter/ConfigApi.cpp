@@ -9,6 +9,13 @@
  */
 #include "ConfigApi.h"
 
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
 #include <boost/filesystem/path.hpp>
 
 #include <folly/dynamic.h>
@@ -29,6 +36,9 @@ const char* const kMcrouterConfigKey = "mcrouter_config";
 const char* const kConfigFile = "config_file";
 const char* const kConfigImport = "config_import";
 const int kConfigReloadInterval = 60;
+/* Wait after the first inotify event before reading the files, see
+   configThreadRun() */
+const std::chrono::seconds kConfigUpdateDelay{1};
 
 const char* const ConfigApi::kAbsoluteFilePrefix = "file:";
 
@@ -39,6 +49,13 @@ ConfigApi::~ConfigApi() {
 ConfigApi::ConfigApi(const McrouterOptions& opts)
     : opts_(opts),
       finish_(false) {
+  auto fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (fd >= 0) {
+    wakeupFd_ = folly::File(fd, /* ownsFd */ true);
+  } else {
+    LOG(ERROR) << "Failed to create eventfd, errno: " << errno
+               << ". Config files will be checked every second.";
+  }
 }
 
 ConfigApi::CallbackHandle ConfigApi::subscribe(Callback callback) {
@@ -58,6 +75,7 @@ void ConfigApi::stopObserving(pid_t pid) {
     finish_ = true;
     finishCV_.notify_one();
   }
+  wakeUp();
   if (configThread_.joinable()) {
     if (getpid() == pid) {
       configThread_.join();
@@ -67,6 +85,56 @@ void ConfigApi::stopObserving(pid_t pid) {
   }
 }
 
+void ConfigApi::wakeUp() {
+  if (wakeupFd_) {
+    uint64_t one = 1;
+    auto written = write(wakeupFd_.fd(), &one, sizeof(one));
+    LOG_IF(ERROR, written < 0) << "Write to eventfd failed";
+  }
+}
+
+bool ConfigApi::waitForFileEvents(std::chrono::milliseconds timeout) {
+  /* Watches may be replaced while we wait, subscribeToTrackedSources()
+     wakes us up to poll the new ones. */
+  std::vector<struct pollfd> fds;
+  {
+    std::lock_guard<std::mutex> lock(fileInfoMutex_);
+    for (const auto& fileIt : fileInfos_) {
+      const auto& provider = fileIt.second.provider;
+      if (provider && provider->fd() >= 0) {
+        fds.push_back({provider->fd(), POLLIN, 0});
+      }
+    }
+  }
+  if (wakeupFd_) {
+    fds.push_back({wakeupFd_.fd(), POLLIN, 0});
+  } else {
+    timeout = std::min(timeout, std::chrono::milliseconds(1000));
+  }
+
+  auto ret = poll(fds.data(), fds.size(), timeout.count());
+  if (ret < 0) {
+    LOG_IF(ERROR, errno != EINTR) << "poll on config files failed, errno: "
+                                  << errno;
+    return false;
+  }
+  size_t numFiles = fds.size();
+  if (wakeupFd_) {
+    --numFiles;
+    if (fds.back().revents & POLLIN) {
+      uint64_t count;
+      auto len = read(wakeupFd_.fd(), &count, sizeof(count));
+      LOG_IF(ERROR, len < 0) << "Read from eventfd failed";
+    }
+  }
+  for (size_t i = 0; i < numFiles; ++i) {
+    if (fds[i].revents != 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
 bool ConfigApi::checkFileUpdate() {
   auto now = nowWallSec();
   bool hasUpdate = false;
@@ -75,9 +143,13 @@ bool ConfigApi::checkFileUpdate() {
     auto& file = fileIt.second;
     // hasUpdate reads events from inotify, so we need to poll all
     // providers to reconfigure only once when multiple files have changed
+    bool changed = false;
     try {
       if (file.provider) {
-        hasUpdate |= file.provider->hasUpdate();
+        changed = file.provider->hasUpdate();
+      } else {
+        // not watched, check with hash once in a while
+        changed = file.lastMd5Check + kConfigReloadInterval < now;
       }
     } catch (const std::exception& e) {
       LOG(ERROR) << "Check " << file.path << " for update failed: "
@@ -85,9 +157,18 @@ bool ConfigApi::checkFileUpdate() {
       // check with hash, if it throws error something is totally wrong,
       // reconfiguration thread will log error and finish.
       file.provider.reset();
-      if (file.lastMd5Check + kConfigReloadInterval < now) {
-        hasUpdate |= file.checkMd5Changed();
-      }
+      changed = file.lastMd5Check + kConfigReloadInterval < now;
+    }
+    if (!changed) {
+      continue;
+    }
+    // Files that were touched, but not changed, don't cause a reload
+    try {
+      hasUpdate |= file.checkMd5Changed();
+    } catch (const std::exception& e) {
+      // e.g. the file is being replaced, let reconfiguration report it
+      LOG(ERROR) << e.what();
+      hasUpdate = true;
     }
   }
   return hasUpdate;
@@ -110,6 +191,35 @@ void ConfigApi::configThreadRun() {
   }
 
   while (!finish_) {
+    // Sleeps until a watched file changes. Files that can't be watched
+    // (and overrides of checkFileUpdate()) are checked every
+    // kConfigReloadInterval seconds.
+    bool hasEvents = waitForFileEvents(
+      std::chrono::seconds(kConfigReloadInterval));
+    if (finish_) {
+      break;
+    }
+
+    if (hasEvents) {
+      // There are a couple of races that can happen here
+      // First, the IN_MODIFY event can be fired before the write is
+      // complete, resulting in a malformed JSON error. Second, text editors
+      // may do some of their own shuffling of the file (e.g. between .swp
+      // and the real thing in Vim) after the write. This may can result in
+      // a file access error router_configure_from_file below. That's just a
+      // theory, but that error does happen. Race 1 can be fixed by changing
+      // the watch for IN_MODIFY to IN_CLOSE_WRITE, but Race 2 has no
+      // apparent elegant solution. The following jankiness fixes both:
+      // events of all the writes in this interval are picked up by one
+      // checkFileUpdate() below.
+      std::unique_lock<std::mutex> lk(finishMutex_);
+      finishCV_.wait_for(lk, kConfigUpdateDelay,
+                         [this] { return finish_.load(); });
+    }
+    if (finish_) {
+      break;
+    }
+
     bool hasUpdate = false;
     try {
       hasUpdate = checkFileUpdate();
@@ -120,29 +230,10 @@ void ConfigApi::configThreadRun() {
       logFailure(memcache::failure::Category::kOther,
                  "Check for config update failed with unknown error");
     }
-    // There are a couple of races that can happen here
-    // First, the IN_MODIFY event can be fired before the write is complete,
-    // resulting in a malformed JSON error. Second, text editors may do
-    // some of their own shuffling of the file (e.g. between .swp and the
-    // real thing in Vim) after the write. This may can result in a file
-    // access error router_configure_from_file below. That's just a theory,
-    // but that error does happen. Race 1 can be fixed by changing the
-    // watch for IN_MODIFY to IN_CLOSE_WRITE, but Race 2 has no apparent
-    // elegant solution. The following jankiness fixes both.
-
-    {
-      std::unique_lock<std::mutex> lk(finishMutex_);
-      finishCV_.wait_for(lk, std::chrono::seconds(1),
-                         [this] { return finish_.load(); });
-
-    }
 
     if (hasUpdate) {
       callbacks_.notify();
     }
-
-    // Otherwise there was nothing to read, so check that we aren't shutting
-    // down, and wait on the FD again.
   }
 }
 
@@ -243,6 +334,8 @@ void ConfigApi::subscribeToTrackedSources() {
 
   fileInfos_ = std::move(trackedFiles_);
   trackedFiles_.clear();
+  // the config thread polls the old set of watches
+  wakeUp();
 }
 
 void ConfigApi::abandonTrackedSources() {
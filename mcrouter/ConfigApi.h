@@ -10,6 +10,7 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <functional>
 #include <mutex>
@@ -17,6 +18,8 @@
 #include <thread>
 #include <unordered_map>
 
+#include <folly/File.h>
+
 #include "mcrouter/CallbackPool.h"
 
 namespace folly {
@@ -119,7 +122,11 @@ class ConfigApi {
   bool isFirstConfig() const;
 
   /**
-   * @return true, if files have update since last call, false otherwise
+   * Only files with inotify events since the last call (or, if they can't
+   * be watched, not hashed for kConfigReloadInterval) are read and hashed.
+   *
+   * @return true, if contents of files changed since last call,
+   *         false otherwise
    */
   virtual bool checkFileUpdate();
 
@@ -144,9 +151,22 @@ class ConfigApi {
   std::condition_variable finishCV_;
   std::atomic<bool> finish_;
 
+  /* eventfd waking up the config thread from waitForFileEvents() */
+  folly::File wakeupFd_;
+
   bool isFirstConfig_{true};
 
   void configThreadRun();
+
+  /**
+   * Blocks until any watched file has inotify events, wakeUp() is called
+   * or timeout expires.
+   *
+   * @return true if there are inotify events to check
+   */
+  bool waitForFileEvents(std::chrono::milliseconds timeout);
+
+  void wakeUp();
 };
 
 }}} // facebook::memcache::mcrouter
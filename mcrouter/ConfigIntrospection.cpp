@@ -0,0 +1,32 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "ConfigIntrospection.h"
+
+#include <folly/json.h>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+ConfigIntrospection::ConfigIntrospection(
+    std::shared_ptr<const folly::dynamic> preprocessedConfig)
+    : preprocessedConfig_(std::move(preprocessedConfig)) {
+}
+
+const std::string& ConfigIntrospection::preprocessedConfigJson() const {
+  std::call_once(renderOnce_, [this]() {
+    folly::json::serialization_opts jsonOpts;
+    jsonOpts.pretty_formatting = true;
+    jsonOpts.sort_keys = true;
+    preprocessedConfigJson_ =
+      folly::json::serialize(*preprocessedConfig_, jsonOpts).toStdString();
+  });
+  return preprocessedConfigJson_;
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,46 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <folly/dynamic.h>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Immutable view of a loaded config for __mcrouter__ commands, built once
+ * per config load and shared by the configs of all proxies.
+ *
+ * JSON is rendered on the first query and kept for the lifetime of the
+ * config, from whatever thread asks: queries never need the proxy
+ * threads or the config files.
+ */
+class ConfigIntrospection {
+ public:
+  explicit ConfigIntrospection(
+    std::shared_ptr<const folly::dynamic> preprocessedConfig);
+
+  /**
+   * Preprocessed config (macros and imports expanded) as pretty JSON
+   * with sorted keys. Thread safe.
+   */
+  const std::string& preprocessedConfigJson() const;
+
+ private:
+  const std::shared_ptr<const folly::dynamic> preprocessedConfig_;
+
+  mutable std::once_flag renderOnce_;
+  mutable std::string preprocessedConfigJson_;
+};
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,78 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <typeindex>
+#include <unordered_map>
+#include <utility>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Immutable objects built from config (hash functions, shard splits, etc.)
+ * that are the same for every proxy. Built once per config and shared
+ * read-only by routes of all proxies.
+ *
+ * Thread safe, configs of proxies may be built in parallel.
+ */
+class ConfigObjectCache {
+ public:
+  /**
+   * @param key  uniquely describes the object among objects of type T,
+   *             e.g. serialized json it is built from.
+   * @param create  called to build the object if there is none for key yet,
+   *                should return std::shared_ptr<T>.
+   */
+  template <class T, class Func>
+  std::shared_ptr<const T> getOrCreate(const std::string& key,
+                                       Func&& create) {
+    std::lock_guard<std::mutex> lg(lock_);
+    auto& objects = objects_[std::type_index(typeid(T))];
+    auto it = objects.find(key);
+    if (it != objects.end()) {
+      return std::static_pointer_cast<const T>(it->second);
+    }
+    std::shared_ptr<const T> obj = create();
+    objects.emplace(key, obj);
+    return obj;
+  }
+
+  /**
+   * Same as getOrCreate(), for objects that routes of all proxies update,
+   * e.g. token buckets of global rate limits. T has to be thread safe.
+   */
+  template <class T, class Func>
+  std::shared_ptr<T> getOrCreateShared(const std::string& key,
+                                       Func&& create) {
+    std::lock_guard<std::mutex> lg(lock_);
+    auto& objects = sharedObjects_[std::type_index(typeid(T))];
+    auto it = objects.find(key);
+    if (it != objects.end()) {
+      return std::static_pointer_cast<T>(it->second);
+    }
+    std::shared_ptr<T> obj = create();
+    objects.emplace(key, obj);
+    return obj;
+  }
+
+ private:
+  std::mutex lock_;
+  std::unordered_map<
+    std::type_index,
+    std::unordered_map<std::string, std::shared_ptr<const void>>> objects_;
+  std::unordered_map<
+    std::type_index,
+    std::unordered_map<std::string, std::shared_ptr<void>>> sharedObjects_;
+};
+
+}}}  // facebook::memcache::mcrouter
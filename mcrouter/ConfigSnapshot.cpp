@@ -0,0 +1,274 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "ConfigSnapshot.h"
+
+#include <unistd.h>
+
+#include <cstring>
+#include <stdexcept>
+
+#include <glog/logging.h>
+
+#include <folly/dynamic.h>
+#include <folly/MemoryMapping.h>
+
+#include "mcrouter/ConfigApi.h"
+#include "mcrouter/lib/fbi/cpp/util.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+const folly::StringPiece kSnapshotMagic = "MCCFGSN1";
+// deeper configs are rejected by ConfigPreprocessor anyway
+const size_t kMaxDepth = 1000;
+
+enum Tag : uint8_t {
+  kNull = 0,
+  kFalse = 1,
+  kTrue = 2,
+  kInt = 3,
+  kDouble = 4,
+  kString = 5,
+  kArray = 6,
+  kObject = 7,
+};
+
+template <class T>
+void appendRaw(std::string& out, T value) {
+  out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void appendSize(std::string& out, uint64_t size) {
+  // varint, 7 bits per byte
+  while (size >= 0x80) {
+    out.push_back(static_cast<char>((size & 0x7f) | 0x80));
+    size >>= 7;
+  }
+  out.push_back(static_cast<char>(size));
+}
+
+void encode(const folly::dynamic& json, std::string& out) {
+  switch (json.type()) {
+    case folly::dynamic::NULLT:
+      out.push_back(kNull);
+      break;
+    case folly::dynamic::BOOL:
+      out.push_back(json.getBool() ? kTrue : kFalse);
+      break;
+    case folly::dynamic::INT64:
+      out.push_back(kInt);
+      appendRaw<int64_t>(out, json.getInt());
+      break;
+    case folly::dynamic::DOUBLE:
+      out.push_back(kDouble);
+      appendRaw<double>(out, json.getDouble());
+      break;
+    case folly::dynamic::STRING: {
+      out.push_back(kString);
+      auto sp = json.stringPiece();
+      appendSize(out, sp.size());
+      out.append(sp.data(), sp.size());
+      break;
+    }
+    case folly::dynamic::ARRAY:
+      out.push_back(kArray);
+      appendSize(out, json.size());
+      for (const auto& it : json) {
+        encode(it, out);
+      }
+      break;
+    case folly::dynamic::OBJECT:
+      out.push_back(kObject);
+      appendSize(out, json.size());
+      for (const auto& it : json.items()) {
+        encode(it.first, out);
+        encode(it.second, out);
+      }
+      break;
+  }
+}
+
+class Decoder {
+ public:
+  explicit Decoder(folly::ByteRange data)
+    : data_(data) {
+  }
+
+  folly::dynamic decode(size_t depth = 0) {
+    checkData(depth < kMaxDepth, "too deep");
+    switch (readRaw<uint8_t>()) {
+      case kNull:
+        return nullptr;
+      case kFalse:
+        return false;
+      case kTrue:
+        return true;
+      case kInt:
+        return readRaw<int64_t>();
+      case kDouble:
+        return readRaw<double>();
+      case kString: {
+        auto size = readSize();
+        auto bytes = readBytes(size);
+        return std::string(reinterpret_cast<const char*>(bytes.data()),
+                           bytes.size());
+      }
+      case kArray: {
+        auto size = readSize();
+        // every element takes at least one byte
+        checkData(size <= data_.size(), "truncated array");
+        folly::dynamic result = {};
+        for (size_t i = 0; i < size; ++i) {
+          result.push_back(decode(depth + 1));
+        }
+        return result;
+      }
+      case kObject: {
+        auto size = readSize();
+        checkData(size <= data_.size(), "truncated object");
+        folly::dynamic result = folly::dynamic::object;
+        for (size_t i = 0; i < size; ++i) {
+          auto key = decode(depth + 1);
+          result.insert(std::move(key), decode(depth + 1));
+        }
+        return result;
+      }
+      default:
+        throw std::runtime_error("Invalid snapshot: unknown tag");
+    }
+  }
+
+  bool empty() const {
+    return data_.empty();
+  }
+
+ private:
+  folly::ByteRange data_;
+
+  static void checkData(bool condition, const char* what) {
+    if (!condition) {
+      throw std::runtime_error(std::string("Invalid snapshot: ") + what);
+    }
+  }
+
+  folly::ByteRange readBytes(size_t size) {
+    checkData(size <= data_.size(), "truncated data");
+    auto result = data_.subpiece(0, size);
+    data_.advance(size);
+    return result;
+  }
+
+  template <class T>
+  T readRaw() {
+    T value;
+    std::memcpy(&value, readBytes(sizeof(T)).data(), sizeof(T));
+    return value;
+  }
+
+  uint64_t readSize() {
+    uint64_t size = 0;
+    for (size_t shift = 0; ; shift += 7) {
+      checkData(shift < 64, "invalid size");
+      auto byte = readRaw<uint8_t>();
+      size |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) {
+        return size;
+      }
+    }
+  }
+};
+
+}  // anonymous namespace
+
+std::string dynamicToBinary(const folly::dynamic& json) {
+  std::string out;
+  encode(json, out);
+  return out;
+}
+
+folly::dynamic dynamicFromBinary(folly::ByteRange data) {
+  Decoder decoder(data);
+  auto result = decoder.decode();
+  if (!decoder.empty()) {
+    throw std::runtime_error("Invalid snapshot: trailing data");
+  }
+  return result;
+}
+
+bool readConfigSnapshot(const std::string& path,
+                        const folly::dynamic& key,
+                        ConfigApi& configApi,
+                        folly::dynamic& config) {
+  if (::access(path.c_str(), R_OK) != 0) {
+    return false;
+  }
+
+  try {
+    folly::MemoryMapping mapping(path.c_str());
+    auto data = mapping.range();
+    if (!folly::StringPiece(data).startsWith(kSnapshotMagic)) {
+      LOG(WARNING) << "Config snapshot " << path << " has unknown format";
+      return false;
+    }
+    data.advance(kSnapshotMagic.size());
+    auto snapshot = dynamicFromBinary(data);
+
+    auto jkey = snapshot.get_ptr("key");
+    auto jimports = snapshot.get_ptr("imports");
+    auto jconfig = snapshot.get_ptr("config");
+    if (!jkey || !jimports || !jimports->isObject() || !jconfig) {
+      LOG(WARNING) << "Config snapshot " << path << " is incomplete";
+      return false;
+    }
+    if (*jkey != key) {
+      VLOG(1) << "Config snapshot " << path << " is for another config";
+      return false;
+    }
+    for (const auto& it : jimports->items()) {
+      auto importPath = it.first.getString().toStdString();
+      std::string contents;
+      if (!configApi.get(ConfigType::ConfigImport, importPath, contents) ||
+          it.second.stringPiece() != folly::StringPiece(Md5Hash(contents))) {
+        VLOG(1) << "Config snapshot " << path << " is outdated: "
+                << importPath << " changed";
+        return false;
+      }
+    }
+    config = std::move(*jconfig);
+    return true;
+  } catch (const std::exception& e) {
+    LOG(WARNING) << "Can not load config snapshot " << path << ": "
+                 << e.what();
+    return false;
+  }
+}
+
+bool writeConfigSnapshot(
+    const std::string& path,
+    const folly::dynamic& key,
+    const std::unordered_map<std::string, std::string>& imports,
+    const folly::dynamic& config) {
+
+  folly::dynamic jimports = folly::dynamic::object;
+  for (const auto& it : imports) {
+    jimports[it.first] = it.second;
+  }
+  auto snapshot = folly::dynamic::object
+    ("key", key)
+    ("imports", std::move(jimports))
+    ("config", config);
+
+  auto contents = kSnapshotMagic.str();
+  contents.append(dynamicToBinary(snapshot));
+  return atomicallyWriteFileToDisk(contents, path);
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,65 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <string>
+#include <unordered_map>
+
+#include <folly/Range.h>
+
+namespace folly {
+class dynamic;
+}
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+class ConfigApi;
+
+/**
+ * Compact binary encoding of a dynamic (numbers in host byte order,
+ * so it's only meant to be read on the same machine).
+ */
+std::string dynamicToBinary(const folly::dynamic& json);
+
+/**
+ * @throws std::runtime_error if data is not a valid encoding.
+ */
+folly::dynamic dynamicFromBinary(folly::ByteRange data);
+
+/**
+ * Loads preprocessed config saved by writeConfigSnapshot.
+ *
+ * The snapshot is used only if it was saved with the same key (e.g. md5 of
+ * the config and preprocessor params) and all files imported by the config
+ * still have the same contents. Imported files are fetched via configApi,
+ * so they are tracked same way as if the config was preprocessed.
+ *
+ * @return true if config was loaded from snapshot, false otherwise.
+ */
+bool readConfigSnapshot(const std::string& path,
+                        const folly::dynamic& key,
+                        ConfigApi& configApi,
+                        folly::dynamic& config);
+
+/**
+ * Saves preprocessed config to a file.
+ *
+ * @param imports  import path => md5 of its contents, for every file
+ *                 imported while preprocessing the config.
+ *
+ * @return true on success, false otherwise
+ */
+bool writeConfigSnapshot(
+  const std::string& path,
+  const folly::dynamic& key,
+  const std::unordered_map<std::string, std::string>& imports,
+  const folly::dynamic& config);
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,392 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "DebugTap.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include <folly/Conv.h>
+#include <folly/Format.h>
+#include <folly/String.h>
+#include <folly/ThreadName.h>
+
+#include "mcrouter/McrouterInstance.h"
+#include "mcrouter/McrouterLogFailure.h"
+#include "mcrouter/mcrouter_config.h"
+#include "mcrouter/proxy.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+/* How often rings are drained while the client keeps up */
+const int kDrainIntervalMs = 10;
+/* A client that doesn't read for this long is disconnected */
+const int kSocketTimeoutMs = 1000;
+const size_t kMaxFilterLineSize = 4096;
+
+bool writeAll(int fd, folly::StringPiece data) {
+  while (!data.empty()) {
+    auto n = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+    if (n <= 0) {
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data.advance(n);
+  }
+  return true;
+}
+
+int bindUnixSocket(const std::string& path) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  if (path.size() >= sizeof(addr.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path, path.data(), path.size());
+
+  int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  /* Left over by a previous instance */
+  ::unlink(path.c_str());
+  /* Taps show keys and destinations: only our user may connect, which takes
+     write permission on the socket file. Done before listen(), so nobody
+     could connect in between. */
+  if (::bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) ||
+      ::chmod(path.c_str(), 0600) ||
+      ::listen(fd, 1)) {
+    int err = errno;
+    ::close(fd);
+    errno = err;
+    return -1;
+  }
+  return fd;
+}
+
+void copyCut(folly::StringPiece s, char* out, uint8_t& size, size_t maxSize) {
+  size = std::min(s.size(), maxSize);
+  memcpy(out, s.data(), size);
+}
+
+int64_t wallTimeUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+}  // anonymous namespace
+
+constexpr size_t DebugTapEntry::kMaxKeySize;
+constexpr size_t DebugTapEntry::kMaxDestinationSize;
+constexpr size_t DebugTapRing::kNumEntries;
+
+DebugTapFilter DebugTapFilter::parse(folly::StringPiece line) {
+  std::vector<folly::StringPiece> fields;
+  folly::split(' ', folly::trimWhitespace(line), fields,
+               /* ignoreEmpty= */ true);
+
+  DebugTapFilter filter;
+  for (auto field : fields) {
+    folly::StringPiece name, value;
+    if (!folly::split('=', field, name, value)) {
+      throw std::invalid_argument(
+        folly::sformat("expected name=value, got '{}'", field));
+    }
+    if (name == "key_prefix") {
+      filter.keyPrefix = value.str();
+    } else if (name == "destination") {
+      filter.destination = value.str();
+    } else if (name == "sample") {
+      auto period = folly::tryTo<size_t>(value);
+      if (!period.hasValue() || period.value() == 0) {
+        throw std::invalid_argument(
+          folly::sformat("sample must be a positive number, got '{}'",
+                         value));
+      }
+      filter.samplePeriod = period.value();
+    } else {
+      throw std::invalid_argument(
+        folly::sformat("unknown filter field '{}'", name));
+    }
+  }
+  return filter;
+}
+
+const DebugTapFilter* DebugTapRing::filter() {
+  auto version = filterVersion_.load(std::memory_order_acquire);
+  if (version != localVersion_) {
+    localFilter_ = filter_.get();
+    localVersion_ = version;
+    sinceLastSample_ = 0;
+  }
+  return localFilter_.get();
+}
+
+void DebugTapRing::push(mc_op_t op, folly::StringPiece key, mc_res_t result,
+                        folly::StringPiece destination, size_t valueSize,
+                        int64_t startTimeUs, int64_t endTimeUs) {
+  auto head = head_.load(std::memory_order_relaxed);
+  if (head - tail_.load(std::memory_order_acquire) >= kNumEntries) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  auto& entry = entries_[head % kNumEntries];
+  entry.timeUs = endTimeUs;
+  entry.latencyUs = std::max<int64_t>(0, endTimeUs - startTimeUs);
+  entry.valueSize = valueSize;
+  entry.op = op;
+  entry.result = result;
+  copyCut(key, entry.key, entry.keySize, DebugTapEntry::kMaxKeySize);
+  copyCut(destination, entry.destination, entry.destinationSize,
+          DebugTapEntry::kMaxDestinationSize);
+  head_.store(head + 1, std::memory_order_release);
+}
+
+void DebugTapRing::attach(std::shared_ptr<const DebugTapFilter> filter) {
+  if (!entries_) {
+    entries_.reset(new DebugTapEntry[kNumEntries]);
+  }
+  /* Entries of a previous client are of no interest to this one */
+  tail_.store(head_.load(std::memory_order_acquire),
+              std::memory_order_release);
+  filter_.set(std::move(filter));
+  filterVersion_.fetch_add(1, std::memory_order_release);
+  active_.store(true, std::memory_order_relaxed);
+}
+
+void DebugTapRing::detach() {
+  active_.store(false, std::memory_order_relaxed);
+  filter_.set(nullptr);
+  filterVersion_.fetch_add(1, std::memory_order_release);
+}
+
+bool DebugTapRing::pop(DebugTapEntry& entry) {
+  auto tail = tail_.load(std::memory_order_relaxed);
+  if (tail == head_.load(std::memory_order_acquire)) {
+    return false;
+  }
+  entry = entries_[tail % kNumEntries];
+  tail_.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+DebugTapServer::DebugTapServer(McrouterInstance* router)
+    : router_(router),
+      pid_(getpid()) {
+}
+
+DebugTapServer::~DebugTapServer() {
+  stop();
+}
+
+bool DebugTapServer::start() {
+  const auto& path = router_->opts().debug_tap_socket;
+  if (running_ || path.empty()) {
+    return false;
+  }
+
+  listenFd_ = bindUnixSocket(path);
+  if (listenFd_ < 0) {
+    logFailure(router_, memcache::failure::Category::kSystemError,
+               "Can not listen on debug tap socket {}: {}",
+               path, strerror(errno));
+    return false;
+  }
+  wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  running_ = true;
+  const std::string threadName = "mcrtr-tap";
+  try {
+    thread_ = std::thread([this]() { run(); });
+    folly::setThreadName(thread_.native_handle(), threadName);
+  } catch (const std::system_error& e) {
+    running_ = false;
+    logFailure(router_, memcache::failure::Category::kSystemError,
+               "Can not start DebugTapServer thread {}: {}",
+               threadName, e.what());
+  }
+
+  return running_;
+}
+
+void DebugTapServer::stop() {
+  if (running_) {
+    running_ = false;
+    uint64_t one = 1;
+    auto rc = ::write(wakeFd_, &one, sizeof(one));
+    (void)rc;
+    if (thread_.joinable()) {
+      if (getpid() == pid_) {
+        thread_.join();
+      } else {
+        thread_.detach();
+      }
+    }
+  }
+  if (listenFd_ >= 0) {
+    ::close(listenFd_);
+    listenFd_ = -1;
+    ::unlink(router_->opts().debug_tap_socket.c_str());
+  }
+  if (wakeFd_ >= 0) {
+    ::close(wakeFd_);
+    wakeFd_ = -1;
+  }
+}
+
+void DebugTapServer::run() {
+  while (running_) {
+    struct pollfd fds[2];
+    fds[0].fd = listenFd_;
+    fds[0].events = POLLIN;
+    fds[1].fd = wakeFd_;
+    fds[1].events = POLLIN;
+    auto rc = ::poll(fds, 2, -1);
+    if (rc > 0 && (fds[0].revents & POLLIN) && running_) {
+      int fd = ::accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+      if (fd >= 0) {
+        serve(fd);
+        ::close(fd);
+      }
+    }
+  }
+}
+
+bool DebugTapServer::setFilter(std::shared_ptr<const DebugTapFilter> filter) {
+  try {
+    router_->startupLock().wait();
+    std::lock_guard<ShutdownLock> lg(router_->shutdownLock());
+    for (size_t i = 0; i < router_->opts().num_proxies; ++i) {
+      auto& ring = router_->getProxy(i)->debugTap;
+      if (filter) {
+        ring.attach(filter);
+      } else {
+        ring.detach();
+      }
+    }
+  } catch (const shutdown_started_exception& e) {
+    return false;
+  }
+  return true;
+}
+
+bool DebugTapServer::drain(std::string& out, uint64_t& dropped) {
+  /* Entry times are steady clock, print them as wall clock */
+  auto wallOffsetUs = wallTimeUs() - nowUs();
+  dropped = 0;
+  DebugTapEntry entry;
+  try {
+    std::lock_guard<ShutdownLock> lg(router_->shutdownLock());
+    for (size_t i = 0; i < router_->opts().num_proxies; ++i) {
+      auto& ring = router_->getProxy(i)->debugTap;
+      while (ring.pop(entry)) {
+        auto timeUs = static_cast<int64_t>(entry.timeUs) + wallOffsetUs;
+        folly::format(&out, "{}.{:06d} {} {} {} {} {} {}\n",
+                      timeUs / 1000000, timeUs % 1000000,
+                      mc_op_to_string(entry.op), entry.keyPiece(),
+                      mc_res_to_string(entry.result),
+                      entry.destinationPiece(), entry.valueSize,
+                      entry.latencyUs);
+      }
+      dropped += ring.dropped();
+    }
+  } catch (const shutdown_started_exception& e) {
+    return false;
+  }
+  return true;
+}
+
+void DebugTapServer::serve(int fd) {
+  struct timeval tv;
+  tv.tv_sec = kSocketTimeoutMs / 1000;
+  tv.tv_usec = (kSocketTimeoutMs % 1000) * 1000;
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+  std::string line;
+  char buf[256];
+  while (line.find('\n') == std::string::npos) {
+    if (line.size() > kMaxFilterLineSize) {
+      return;
+    }
+    auto n = ::recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0) {
+      return;
+    }
+    line.append(buf, n);
+  }
+  line.resize(line.find('\n'));
+
+  std::shared_ptr<const DebugTapFilter> filter;
+  try {
+    filter = std::make_shared<DebugTapFilter>(DebugTapFilter::parse(line));
+  } catch (const std::invalid_argument& e) {
+    writeAll(fd, folly::to<std::string>("ERROR ", e.what(), "\n"));
+    return;
+  }
+
+  /* Only report drops that happen while this client is attached */
+  std::string out;
+  uint64_t reportedDropped;
+  if (!drain(out, reportedDropped) || !setFilter(std::move(filter))) {
+    return;
+  }
+
+  while (running_) {
+    out.clear();
+    uint64_t dropped;
+    if (!drain(out, dropped)) {
+      break;
+    }
+    if (dropped != reportedDropped) {
+      folly::toAppend("dropped ", dropped - reportedDropped, "\n", &out);
+      reportedDropped = dropped;
+    }
+    if (!out.empty() && !writeAll(fd, out)) {
+      break;
+    }
+
+    struct pollfd fds[2];
+    fds[0].fd = fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = wakeFd_;
+    fds[1].events = POLLIN;
+    auto rc = ::poll(fds, 2, kDrainIntervalMs);
+    if (rc > 0 && (fds[0].revents & (POLLIN | POLLHUP | POLLERR))) {
+      /* Anything the client sends after the filter is ignored */
+      auto n = ::recv(fd, buf, sizeof(buf), 0);
+      if (n <= 0) {
+        break;
+      }
+    }
+  }
+
+  setFilter(nullptr);
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,219 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <folly/Range.h>
+
+#include "mcrouter/lib/fbi/cpp/AtomicSharedPtr.h"
+#include "mcrouter/lib/mc/msg.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+class McrouterInstance;
+
+/**
+ * What a debug tap client wants to see, sent as the first line on the
+ * tap socket: space separated
+ *   key_prefix=<prefix>     full keys starting with prefix
+ *   destination=<name>      pool name, or prefix of the host:port
+ *   sample=<N>              one out of N matching replies
+ * All are optional, an empty line taps everything.
+ */
+struct DebugTapFilter {
+  std::string keyPrefix;
+  std::string destination;
+  size_t samplePeriod{1};
+
+  /**
+   * @throws std::invalid_argument on unknown or malformed fields
+   */
+  static DebugTapFilter parse(folly::StringPiece line);
+
+  bool matchesKey(folly::StringPiece key) const {
+    return key.startsWith(keyPrefix);
+  }
+
+  bool matchesDestination(folly::StringPiece poolName,
+                          folly::StringPiece hostPort) const {
+    return destination.empty() || poolName == destination ||
+           hostPort.startsWith(destination);
+  }
+};
+
+/**
+ * One tapped request/reply pair, fixed size so that the ring never
+ * allocates. Keys and destinations are cut to fit.
+ */
+struct DebugTapEntry {
+  static constexpr size_t kMaxKeySize = 250;
+  static constexpr size_t kMaxDestinationSize = 64;
+
+  /* Reply time, same clock as nowUs() */
+  uint64_t timeUs;
+  uint32_t latencyUs;
+  /* Request plus reply value sizes */
+  uint32_t valueSize;
+  mc_op_t op;
+  mc_res_t result;
+  uint8_t keySize;
+  uint8_t destinationSize;
+  char key[kMaxKeySize];
+  char destination[kMaxDestinationSize];
+
+  folly::StringPiece keyPiece() const {
+    return folly::StringPiece(key, keySize);
+  }
+
+  folly::StringPiece destinationPiece() const {
+    return folly::StringPiece(destination, destinationSize);
+  }
+};
+
+/**
+ * Per proxy ring of tapped replies: the proxy thread pushes,
+ * the debug tap server thread pops.
+ *
+ * While no tap client is attached the proxy only does a relaxed load of
+ * active(). Entries are allocated on the first attach and kept, a full
+ * ring drops new entries and counts them in dropped().
+ */
+class DebugTapRing {
+ public:
+  static constexpr size_t kNumEntries = 1024;
+
+  bool active() const {
+    return active_.load(std::memory_order_relaxed);
+  }
+
+  /* Proxy thread only */
+
+  /**
+   * @return  Current filter, nullptr if the tap was detached meanwhile.
+   *          Valid until the next call.
+   */
+  const DebugTapFilter* filter();
+
+  /**
+   * Call for requests passing the filter.
+   *
+   * @return  True if this one is sampled
+   */
+  bool sample(size_t samplePeriod) {
+    if (++sinceLastSample_ < samplePeriod) {
+      return false;
+    }
+    sinceLastSample_ = 0;
+    return true;
+  }
+
+  void push(mc_op_t op, folly::StringPiece key, mc_res_t result,
+            folly::StringPiece destination, size_t valueSize,
+            int64_t startTimeUs, int64_t endTimeUs);
+
+  /* Tap server thread only */
+
+  void attach(std::shared_ptr<const DebugTapFilter> filter);
+  void detach();
+
+  /**
+   * @return  False if the ring is empty
+   */
+  bool pop(DebugTapEntry& entry);
+
+  uint64_t dropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<bool> active_{false};
+  /* Bumped by every attach, after filter_ and entries_ are set */
+  std::atomic<uint64_t> filterVersion_{0};
+  AtomicSharedPtr<DebugTapFilter> filter_{
+    std::shared_ptr<const DebugTapFilter>()};
+  std::unique_ptr<DebugTapEntry[]> entries_;
+
+  /* Written by the proxy thread */
+  std::atomic<uint64_t> head_{0};
+  /* Written by the tap server thread */
+  std::atomic<uint64_t> tail_{0};
+  std::atomic<uint64_t> dropped_{0};
+
+  /* Proxy thread's copy of filter_ */
+  std::shared_ptr<const DebugTapFilter> localFilter_;
+  uint64_t localVersion_{0};
+  size_t sinceLastSample_{0};
+};
+
+/**
+ * Serves the debug tap on the unix socket opts.debug_tap_socket, from a
+ * thread of its own.
+ *
+ * One client at a time: it sends a DebugTapFilter line, then gets a line
+ *   <time> <op> <key> <result> <destination> <value size> <latency us>
+ * per tapped reply until it disconnects, and a "dropped <N>" line whenever
+ * proxies had to drop entries because it didn't read fast enough.
+ * Proxies are only tapped while a client is connected.
+ */
+class DebugTapServer {
+ public:
+  explicit DebugTapServer(McrouterInstance* router);
+
+  ~DebugTapServer();
+
+  /**
+   * Binds the socket and starts the server thread.
+   *
+   * @return True if the server is running, false if opts.debug_tap_socket
+   *         is not set or the socket couldn't be bound.
+   */
+  bool start();
+
+  /**
+   * Stops the server thread and joins it.
+   */
+  void stop();
+
+ private:
+  McrouterInstance* router_;
+  int listenFd_{-1};
+  /* Wakes up the server thread on stop() */
+  int wakeFd_{-1};
+  std::thread thread_;
+  std::atomic<bool> running_{false};
+  pid_t pid_;
+
+  void run();
+
+  /* Taps proxies for the accepted connection fd until it goes away */
+  void serve(int fd);
+
+  /**
+   * Appends formatted entries of all proxy rings to out.
+   *
+   * @return False if the router is shutting down.
+   */
+  bool drain(std::string& out, uint64_t& dropped);
+
+  /* Attaches filter to all proxy rings, or detaches them if it's null */
+  bool setFilter(std::shared_ptr<const DebugTapFilter> filter);
+
+  DebugTapServer(const DebugTapServer&) = delete;
+  DebugTapServer& operator=(const DebugTapServer&) = delete;
+};
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,77 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "DecayingHistogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+DecayingHistogram::DecayingHistogram(size_t window)
+    : decayAt_(static_cast<uint32_t>(std::min<size_t>(
+        std::max<size_t>(window, 1) * 2,
+        std::numeric_limits<uint32_t>::max()))) {
+  std::fill(std::begin(buckets_), std::end(buckets_), 0);
+}
+
+void DecayingHistogram::insertSample(double sample) {
+  auto value = sample > 0 ? static_cast<uint64_t>(sample) : 0;
+  auto& bucket = buckets_[LatencyHistogram::bucketIndex(value)];
+  store(bucket, bucket + 1);
+  store(sum_, sum_ + (sample > 0 ? sample : 0.0));
+  store(count_, count_ + 1);
+  if (count_ >= decayAt_) {
+    decay();
+  }
+}
+
+void DecayingHistogram::decay() {
+  uint32_t count = 0;
+  for (auto& bucket : buckets_) {
+    if (bucket != 0) {
+      store(bucket, bucket / 2);
+      count += bucket;
+    }
+  }
+  store(sum_, sum_ * count / count_);
+  store(count_, count);
+}
+
+double DecayingHistogram::value() const {
+  auto n = load(count_);
+  return n == 0 ? 0.0 : load(sum_) / n;
+}
+
+uint64_t DecayingHistogram::percentile(double p) const {
+  uint32_t counts[LatencyHistogram::kNumBuckets];
+  uint64_t total = 0;
+  for (size_t i = 0; i < LatencyHistogram::kNumBuckets; ++i) {
+    counts[i] = load(buckets_[i]);
+    total += counts[i];
+  }
+  if (total == 0) {
+    return 0;
+  }
+
+  p = std::min(std::max(p, 0.0), 100.0);
+  auto rank = std::max<uint64_t>(
+    1, static_cast<uint64_t>(std::ceil(p / 100.0 * total)));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < LatencyHistogram::kNumBuckets; ++i) {
+    seen += counts[i];
+    if (seen >= rank) {
+      return LatencyHistogram::bucketUpperBound(i);
+    }
+  }
+  return LatencyHistogram::bucketUpperBound(LatencyHistogram::kNumBuckets - 1);
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,76 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "mcrouter/LatencyHistogram.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Mean and percentiles of about the last `window` samples (e.g. latencies
+ * in microseconds), with the buckets of LatencyHistogram.
+ *
+ * Once 2 * window samples are counted, all counts are halved (rounding
+ * down), so older samples fade out in steps: insertSample() is O(1)
+ * amortized, and a latency spike shows up in percentiles as soon as it is
+ * a few percent of the window, instead of being smoothed away like in a
+ * moving average.
+ *
+ * Only the owner thread may insert. Counters are read and written with
+ * relaxed atomic accesses, so other threads can read percentiles
+ * (for stats) while samples are inserted.
+ */
+class DecayingHistogram {
+ public:
+  explicit DecayingHistogram(size_t window);
+
+  void insertSample(double sample);
+
+  bool hasValue() const {
+    return load(count_) != 0;
+  }
+
+  /**
+   * @return  mean of the recent samples, 0 if there are none
+   */
+  double value() const;
+
+  /**
+   * @param p  percentile, in [0, 100].
+   * @return  upper bound of the bucket containing the p-th percentile of
+   *          the recent samples, 0 if there are none.
+   */
+  uint64_t percentile(double p) const;
+
+ private:
+  uint32_t buckets_[LatencyHistogram::kNumBuckets];
+  uint32_t count_{0};
+  uint32_t decayAt_;
+  double sum_{0.0};
+
+  template <class T>
+  static T load(const T& v) {
+    T value;
+    __atomic_load(&v, &value, __ATOMIC_RELAXED);
+    return value;
+  }
+
+  template <class T>
+  static void store(T& v, T value) {
+    __atomic_store(&v, &value, __ATOMIC_RELAXED);
+  }
+
+  void decay();
+};
+
+}}}  // facebook::memcache::mcrouter
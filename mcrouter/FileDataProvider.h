@@ -42,6 +42,15 @@ class FileDataProvider {
    * @throw runtime_error if inotify watch can not be checked or recreated
    */
   bool hasUpdate();
+
+  /**
+   * @return inotify descriptor, readable once there's an update to be
+   *         picked up by hasUpdate(), or -1. Changes on every
+   *         hasUpdate() that returns true.
+   */
+  int fd() const {
+    return inotify_ ? inotify_.fd() : -1;
+  }
  private:
   const std::string filePath_;
   folly::File inotify_;
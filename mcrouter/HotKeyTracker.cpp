@@ -0,0 +1,147 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "HotKeyTracker.h"
+
+#include <algorithm>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+void sortByCount(std::vector<HotKeyTracker::Entry>& entries) {
+  std::sort(entries.begin(), entries.end(),
+            [](const HotKeyTracker::Entry& a, const HotKeyTracker::Entry& b) {
+              if (a.count != b.count) {
+                return a.count > b.count;
+              }
+              return a.key < b.key;
+            });
+}
+
+}  // anonymous namespace
+
+constexpr uint64_t HotKeyTracker::kDecaySamples;
+
+HotKeyTracker::HotKeyTracker(size_t capacity, uint64_t samplePeriod)
+    : capacity_(capacity),
+      samplePeriod_(capacity == 0 ? 0 : samplePeriod),
+      untilSample_(samplePeriod_) {
+  entries_.reserve(capacity_);
+  index_.reserve(capacity_);
+}
+
+void HotKeyTracker::sample(folly::StringPiece key) {
+  std::lock_guard<std::mutex> lock(lock_);
+
+  if (++samples_ >= kDecaySamples) {
+    decay();
+  }
+
+  auto keyStr = key.str();
+  auto it = index_.find(keyStr);
+  if (it != index_.end()) {
+    ++entries_[it->second].count;
+    return;
+  }
+
+  if (entries_.size() < capacity_) {
+    index_.emplace(keyStr, entries_.size());
+    entries_.emplace_back();
+    entries_.back().key = std::move(keyStr);
+    entries_.back().count = 1;
+    return;
+  }
+
+  /* Space-Saving: the new key takes over the least counted entry */
+  size_t minIdx = 0;
+  for (size_t i = 1; i < entries_.size(); ++i) {
+    if (entries_[i].count < entries_[minIdx].count) {
+      minIdx = i;
+    }
+  }
+  auto& entry = entries_[minIdx];
+  index_.erase(entry.key);
+  index_.emplace(keyStr, minIdx);
+  entry.key = std::move(keyStr);
+  entry.error = entry.count;
+  ++entry.count;
+}
+
+void HotKeyTracker::decay() {
+  samples_ = 0;
+  size_t i = 0;
+  while (i < entries_.size()) {
+    auto& entry = entries_[i];
+    entry.count /= 2;
+    entry.error /= 2;
+    if (entry.count > 0) {
+      ++i;
+      continue;
+    }
+    /* Not seen recently, free the entry */
+    index_.erase(entry.key);
+    if (i + 1 != entries_.size()) {
+      entry = std::move(entries_.back());
+      index_[entry.key] = i;
+    }
+    entries_.pop_back();
+  }
+}
+
+std::vector<HotKeyTracker::Entry> HotKeyTracker::top() const {
+  std::vector<Entry> result;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    result = entries_;
+  }
+  for (auto& entry : result) {
+    entry.count *= samplePeriod_;
+    entry.error *= samplePeriod_;
+  }
+  sortByCount(result);
+  return result;
+}
+
+std::vector<HotKeyTracker::Entry> HotKeyTracker::merge(
+    const std::vector<std::vector<Entry>>& tops, size_t maxKeys) {
+  std::unordered_map<std::string, Entry> merged;
+  for (const auto& top : tops) {
+    for (const auto& entry : top) {
+      auto& m = merged[entry.key];
+      m.count += entry.count;
+      m.error += entry.error;
+    }
+  }
+
+  std::vector<Entry> result;
+  result.reserve(merged.size());
+  for (auto& it : merged) {
+    it.second.key = it.first;
+    result.push_back(std::move(it.second));
+  }
+  sortByCount(result);
+  if (result.size() > maxKeys) {
+    result.resize(maxKeys);
+  }
+  return result;
+}
+
+folly::dynamic HotKeyTracker::toDynamic(const std::vector<Entry>& entries) {
+  folly::dynamic result = {};
+  for (const auto& entry : entries) {
+    result.push_back(folly::dynamic::object
+      ("key", entry.key)
+      ("count", entry.count)
+      ("error", entry.error));
+  }
+  return result;
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,102 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/dynamic.h>
+#include <folly/Range.h>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Finds the most requested keys (heavy hitters) from a sample of requests.
+ *
+ * One in samplePeriod recorded keys is counted with the Space-Saving
+ * algorithm over `capacity` entries: a key that isn't tracked replaces the
+ * entry with the lowest count and inherits that count as its error, so
+ * any key seen more than (samples / capacity) times is always tracked.
+ * All counts are halved every kDecaySamples samples, so the top reflects
+ * recent traffic.
+ *
+ * record() may only be called from a single thread, the owner (e.g. proxy
+ * thread). Requests that aren't sampled only decrement a counter; the lock
+ * is taken for sampled requests and by readers on other threads. The cost
+ * of a sampled request is bounded by O(capacity).
+ */
+class HotKeyTracker {
+ public:
+  /* Counts are halved after this many samples */
+  static constexpr uint64_t kDecaySamples = 10000;
+
+  struct Entry {
+    std::string key;
+    /* Estimated number of requests, never below the real number */
+    uint64_t count{0};
+    /* count is at most this much above the real number */
+    uint64_t error{0};
+  };
+
+  /**
+   * @param capacity  number of tracked keys.
+   * @param samplePeriod  one in this many keys is counted,
+   *                      0 disables tracking.
+   */
+  HotKeyTracker(size_t capacity, uint64_t samplePeriod);
+
+  void record(folly::StringPiece key) {
+    if (samplePeriod_ == 0 || --untilSample_ != 0) {
+      return;
+    }
+    untilSample_ = samplePeriod_;
+    sample(key);
+  }
+
+  bool enabled() const {
+    return samplePeriod_ != 0 && capacity_ != 0;
+  }
+
+  /**
+   * Tracked keys with counts scaled by the sample period (i.e. estimated
+   * number of requests), in decreasing order of count. Thread safe.
+   */
+  std::vector<Entry> top() const;
+
+  /**
+   * Sums the counts of the same keys from several trackers and
+   * returns at most maxKeys entries with the highest counts.
+   */
+  static std::vector<Entry> merge(
+    const std::vector<std::vector<Entry>>& tops, size_t maxKeys);
+
+  /**
+   * [{"key": ..., "count": ..., "error": ...}, ...]
+   */
+  static folly::dynamic toDynamic(const std::vector<Entry>& entries);
+
+ private:
+  const size_t capacity_;
+  const uint64_t samplePeriod_;
+  /* Only touched by the owner thread */
+  uint64_t untilSample_;
+
+  std::vector<Entry> entries_;
+  std::unordered_map<std::string, size_t> index_;
+  uint64_t samples_{0};
+  mutable std::mutex lock_;
+
+  void sample(folly::StringPiece key);
+  void decay();
+};
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,225 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "HousekeepingExecutor.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <folly/Conv.h>
+#include <folly/String.h>
+#include <folly/ThreadName.h>
+
+#include "mcrouter/lib/fbi/debug.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+/* Set on the workers: the executor they belong to and the running task */
+thread_local const HousekeepingExecutor* currentExecutor = nullptr;
+thread_local HousekeepingExecutor::TaskId currentTask = 0;
+
+void pinToCpus(const std::vector<int>& cpus) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (auto cpu : cpus) {
+    CPU_SET(cpu, &set);
+  }
+  auto rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (rc != 0) {
+    LOG(WARNING) << "Can't pin housekeeping thread to CPUs: "
+                 << folly::errnoStr(rc);
+  }
+}
+
+}  // anonymous namespace
+
+std::shared_ptr<HousekeepingExecutor>
+HousekeepingExecutor::get(const Options& opts) {
+  static std::mutex instanceLock;
+  static std::weak_ptr<HousekeepingExecutor> instance;
+
+  std::lock_guard<std::mutex> lg(instanceLock);
+  auto executor = instance.lock();
+  if (!executor || executor->pid_ != getpid()) {
+    executor = std::make_shared<HousekeepingExecutor>(opts);
+    instance = executor;
+  }
+  return executor;
+}
+
+HousekeepingExecutor::HousekeepingExecutor(const Options& opts)
+    : pid_(getpid()) {
+  std::vector<int> cpus;
+  if (!opts.cpus.empty()) {
+    try {
+      cpus = parseCpuList(opts.cpus);
+    } catch (const std::invalid_argument& e) {
+      LOG(ERROR) << "Invalid housekeeping CPU list '" << opts.cpus
+                 << "', not pinning: " << e.what();
+    }
+  }
+
+  auto numThreads = std::max<size_t>(opts.numThreads, 1);
+  for (size_t i = 0; i < numThreads; ++i) {
+    threads_.emplace_back([this, i, cpus]() {
+      workerRun(i, cpus);
+    });
+  }
+}
+
+HousekeepingExecutor::~HousekeepingExecutor() {
+  {
+    std::lock_guard<std::mutex> lg(lock_);
+    stopping_ = true;
+  }
+  wakeup_.notify_all();
+
+  /* The workers don't exist in a forked child, and a worker can't join
+     itself (if the last reference is dropped by a task) */
+  bool join = getpid() == pid_ && !onWorkerThread();
+  for (auto& thread : threads_) {
+    if (join) {
+      thread.join();
+    } else {
+      thread.detach();
+    }
+  }
+}
+
+HousekeepingExecutor::TaskId HousekeepingExecutor::schedule(
+    std::chrono::milliseconds period,
+    std::function<void()> func,
+    std::chrono::milliseconds firstDelay) {
+  auto task = std::make_shared<Task>();
+  task->func = std::move(func);
+  task->period = period;
+
+  TaskId id;
+  {
+    std::lock_guard<std::mutex> lg(lock_);
+    id = nextId_++;
+    tasks_.emplace(id, std::move(task));
+    due_.push({Clock::now() + firstDelay, id});
+  }
+  /* The new task may be due before the one the workers wait for */
+  wakeup_.notify_all();
+  return id;
+}
+
+void HousekeepingExecutor::cancel(TaskId id) {
+  std::unique_lock<std::mutex> lock(lock_);
+  auto it = tasks_.find(id);
+  if (it == tasks_.end()) {
+    return;
+  }
+  auto task = std::move(it->second);
+  tasks_.erase(it);
+
+  if ((currentExecutor == this && currentTask == id) || getpid() != pid_) {
+    return;
+  }
+  done_.wait(lock, [&task]() { return !task->running; });
+}
+
+bool HousekeepingExecutor::onWorkerThread() const {
+  return currentExecutor == this;
+}
+
+void HousekeepingExecutor::workerRun(size_t index,
+                                     const std::vector<int>& cpus) {
+  folly::setThreadName(folly::to<std::string>("mcrtr-hk-", index));
+  if (!cpus.empty()) {
+    pinToCpus(cpus);
+  }
+  currentExecutor = this;
+
+  std::unique_lock<std::mutex> lock(lock_);
+  while (!stopping_) {
+    if (due_.empty()) {
+      wakeup_.wait(lock);
+      continue;
+    }
+    auto next = due_.top();
+    if (next.when > Clock::now()) {
+      wakeup_.wait_until(lock, next.when);
+      continue;
+    }
+    due_.pop();
+
+    auto it = tasks_.find(next.id);
+    if (it == tasks_.end()) {
+      /* Cancelled */
+      continue;
+    }
+    auto task = it->second;
+    task->running = true;
+
+    lock.unlock();
+    bool failed = true;
+    currentTask = next.id;
+    try {
+      task->func();
+      failed = false;
+    } catch (const std::exception& e) {
+      LOG(ERROR) << "Error while executing housekeeping task: " << e.what();
+    } catch (...) {
+      LOG(ERROR) << "Unknown error while executing housekeeping task";
+    }
+    currentTask = 0;
+    lock.lock();
+
+    task->running = false;
+    it = tasks_.find(next.id);
+    if (it != tasks_.end()) {
+      if (failed || task->period.count() == 0) {
+        tasks_.erase(it);
+      } else {
+        due_.push({Clock::now() + task->period, next.id});
+        /* Another worker may be waiting for a later task */
+        wakeup_.notify_one();
+      }
+    }
+    done_.notify_all();
+  }
+}
+
+std::vector<int> HousekeepingExecutor::parseCpuList(folly::StringPiece list) {
+  std::vector<int> cpus;
+  std::vector<folly::StringPiece> ranges;
+  folly::split(',', list, ranges);
+  for (auto range : ranges) {
+    range = folly::trimWhitespace(range);
+    folly::StringPiece from, to;
+    if (!folly::split('-', range, from, to)) {
+      from = to = range;
+    }
+    int first, last;
+    try {
+      first = folly::to<int>(folly::trimWhitespace(from));
+      last = folly::to<int>(folly::trimWhitespace(to));
+    } catch (const std::range_error& e) {
+      throw std::invalid_argument("invalid CPU range '" + range.str() + "'");
+    }
+    if (first < 0 || last < first || last >= CPU_SETSIZE) {
+      throw std::invalid_argument("invalid CPU range '" + range.str() + "'");
+    }
+    for (auto cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+}}}  // facebook::memcache::mcrouter
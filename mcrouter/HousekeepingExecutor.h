@@ -0,0 +1,134 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/Range.h>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * A few threads running all timer driven housekeeping of the process
+ * (stat windows, stats logging, file observers), instead of a thread
+ * per task sleeping most of the time.
+ *
+ * Tasks are kept in a heap by their next run time; an idle worker sleeps
+ * until the earliest one is due. A periodic task is rescheduled `period`
+ * after its run is over, so it never runs concurrently with itself.
+ * Tasks should be short: a task blocking for long holds one of the
+ * workers.
+ */
+class HousekeepingExecutor {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using TaskId = uint64_t;
+
+  struct Options {
+    size_t numThreads{2};
+    /* CPUs to pin the workers to, e.g. "0-1,8". Empty: no pinning */
+    std::string cpus;
+  };
+
+  /**
+   * The executor shared by all mcrouter instances of the process, created
+   * with `opts` by the first caller (later callers get it as is). A new
+   * one is created in a forked child.
+   */
+  static std::shared_ptr<HousekeepingExecutor> get(const Options& opts);
+
+  explicit HousekeepingExecutor(const Options& opts);
+
+  /* Waits for the running tasks, the others are dropped */
+  ~HousekeepingExecutor();
+
+  /**
+   * Runs `func` after `firstDelay`, then every `period` after the end of
+   * the previous run. A zero period runs it once.
+   * A task that throws is logged and not run anymore.
+   *
+   * @return id to cancel the task with, never 0.
+   */
+  TaskId schedule(std::chrono::milliseconds period,
+                  std::function<void()> func,
+                  std::chrono::milliseconds firstDelay);
+
+  TaskId schedule(std::chrono::milliseconds period,
+                  std::function<void()> func) {
+    return schedule(period, std::move(func), period);
+  }
+
+  /**
+   * The task won't run anymore. If it's running, waits for it to finish
+   * (unless called from the task itself, or in a forked child where the
+   * workers are gone). Unknown or finished ids are ignored.
+   */
+  void cancel(TaskId id);
+
+  size_t numThreads() const {
+    return threads_.size();
+  }
+
+  /**
+   * Parses a list of CPUs like "0-3,8,10-11".
+   * @throws std::invalid_argument
+   */
+  static std::vector<int> parseCpuList(folly::StringPiece list);
+
+ private:
+  struct Task {
+    std::function<void()> func;
+    std::chrono::milliseconds period;
+    bool running{false};
+  };
+
+  struct Due {
+    Clock::time_point when;
+    TaskId id;
+
+    bool operator>(const Due& other) const {
+      return when > other.when;
+    }
+  };
+
+  std::mutex lock_;
+  /* Workers wait for the next due task */
+  std::condition_variable wakeup_;
+  /* cancel() waits for a running task */
+  std::condition_variable done_;
+  /* May contain ids of cancelled tasks, skipped when due */
+  std::priority_queue<Due, std::vector<Due>, std::greater<Due>> due_;
+  std::unordered_map<TaskId, std::shared_ptr<Task>> tasks_;
+  TaskId nextId_{1};
+  bool stopping_{false};
+
+  const pid_t pid_;
+  std::vector<std::thread> threads_;
+
+  void workerRun(size_t index, const std::vector<int>& cpus);
+  bool onWorkerThread() const;
+
+  HousekeepingExecutor(const HousekeepingExecutor&) = delete;
+  HousekeepingExecutor& operator=(const HousekeepingExecutor&) = delete;
+};
+
+}}}  // facebook::memcache::mcrouter
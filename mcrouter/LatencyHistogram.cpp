@@ -0,0 +1,148 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <folly/Bits.h>
+#include <folly/Memory.h>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+constexpr size_t LatencyHistogram::kSubBucketBits;
+constexpr size_t LatencyHistogram::kSubBuckets;
+constexpr size_t LatencyHistogram::kMaxValueBits;
+constexpr uint64_t LatencyHistogram::kMaxValue;
+constexpr size_t LatencyHistogram::kNumBuckets;
+
+constexpr size_t LatencyHistogramMap::kMaxNames;
+const char* const LatencyHistogramMap::kOtherName = "[other]";
+
+LatencyHistogram::LatencyHistogram() {
+  for (auto& bucket : buckets_) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+}
+
+size_t LatencyHistogram::bucketIndex(uint64_t value) {
+  value = std::min(value, kMaxValue);
+  if (value < kSubBuckets) {
+    return value;
+  }
+  // Keep the kSubBucketBits bits right after the most significant one.
+  size_t shift = folly::findLastSet(value) - 1 - kSubBucketBits;
+  return (shift + 1) * kSubBuckets + ((value >> shift) - kSubBuckets);
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(size_t index) {
+  auto group = index / kSubBuckets;
+  auto sub = index % kSubBuckets;
+  if (group == 0) {
+    return sub;
+  }
+  return ((kSubBuckets + sub + 1) << (group - 1)) - 1;
+}
+
+void LatencyHistogram::record(uint64_t value) {
+  buckets_[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(value, std::memory_order_relaxed);
+  updateMax(value);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+  for (size_t i = 0; i < kNumBuckets; ++i) {
+    auto n = other.buckets_[i].load(std::memory_order_relaxed);
+    if (n != 0) {
+      buckets_[i].fetch_add(n, std::memory_order_relaxed);
+    }
+  }
+  count_.fetch_add(other.count(), std::memory_order_relaxed);
+  sum_.fetch_add(other.sum_.load(std::memory_order_relaxed),
+                 std::memory_order_relaxed);
+  updateMax(other.max());
+}
+
+void LatencyHistogram::updateMax(uint64_t value) {
+  auto cur = max_.load(std::memory_order_relaxed);
+  while (value > cur &&
+         !max_.compare_exchange_weak(cur, value, std::memory_order_relaxed)) {
+  }
+}
+
+double LatencyHistogram::mean() const {
+  auto n = count();
+  return n == 0 ? 0.0 : sum_.load(std::memory_order_relaxed) /
+                          static_cast<double>(n);
+}
+
+uint64_t LatencyHistogram::percentile(double p) const {
+  uint64_t counts[kNumBuckets];
+  uint64_t total = 0;
+  for (size_t i = 0; i < kNumBuckets; ++i) {
+    counts[i] = buckets_[i].load(std::memory_order_relaxed);
+    total += counts[i];
+  }
+  if (total == 0) {
+    return 0;
+  }
+
+  p = std::min(std::max(p, 0.0), 100.0);
+  auto rank = std::max<uint64_t>(
+    1, static_cast<uint64_t>(std::ceil(p / 100.0 * total)));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kNumBuckets; ++i) {
+    seen += counts[i];
+    if (seen >= rank) {
+      return std::min(bucketUpperBound(i), max());
+    }
+  }
+  return max();
+}
+
+folly::dynamic LatencyHistogram::toDynamic() const {
+  return folly::dynamic::object
+    ("count", static_cast<int64_t>(count()))
+    ("mean", mean())
+    ("p50", static_cast<int64_t>(percentile(50)))
+    ("p90", static_cast<int64_t>(percentile(90)))
+    ("p99", static_cast<int64_t>(percentile(99)))
+    ("p999", static_cast<int64_t>(percentile(99.9)))
+    ("max", static_cast<int64_t>(max()));
+}
+
+void LatencyHistogramMap::record(folly::StringPiece name, uint64_t value) {
+  if (last_ == nullptr || name != lastName_) {
+    last_ = &getOrCreate(name);
+    lastName_ = name.str();
+  }
+  last_->record(value);
+}
+
+LatencyHistogram& LatencyHistogramMap::getOrCreate(folly::StringPiece name) {
+  // Only the owner thread modifies the map, so it can look up without a lock.
+  auto it = histograms_.find(name.str());
+  if (it != histograms_.end()) {
+    return *it->second;
+  }
+
+  std::lock_guard<std::mutex> lock(lock_);
+  if (histograms_.size() >= kMaxNames) {
+    name = kOtherName;
+  }
+  auto& histogram = histograms_[name.str()];
+  if (!histogram) {
+    histogram = folly::make_unique<LatencyHistogram>();
+  }
+  return *histogram;
+}
+
+}}}  // facebook::memcache::mcrouter
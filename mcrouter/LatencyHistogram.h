@@ -0,0 +1,133 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <folly/dynamic.h>
+#include <folly/Range.h>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Log-linear histogram of latencies (in microseconds), HDR style.
+ *
+ * Values are grouped by their most significant bit, each group is split
+ * into kSubBuckets equal buckets, so the relative error of any reported
+ * percentile is at most 1 / kSubBuckets. Values above kMaxValue are
+ * counted in the last bucket.
+ *
+ * All counters are relaxed atomics: record() is lock-free and may be
+ * called concurrently with readers (and with merge() into another
+ * histogram) from any thread. Readers see a slightly inconsistent view
+ * while samples are being recorded, which is fine for stats.
+ */
+class LatencyHistogram {
+ public:
+  static constexpr size_t kSubBucketBits = 3;
+  static constexpr size_t kSubBuckets = 1 << kSubBucketBits;
+  static constexpr size_t kMaxValueBits = 32;
+  static constexpr uint64_t kMaxValue = (1ULL << kMaxValueBits) - 1;
+  static constexpr size_t kNumBuckets =
+    (kMaxValueBits - kSubBucketBits + 1) * kSubBuckets;
+
+  LatencyHistogram();
+
+  void record(uint64_t value);
+
+  /**
+   * Adds all samples from other to this histogram.
+   */
+  void merge(const LatencyHistogram& other);
+
+  uint64_t count() const {
+    return count_.load(std::memory_order_relaxed);
+  }
+
+  uint64_t max() const {
+    return max_.load(std::memory_order_relaxed);
+  }
+
+  double mean() const;
+
+  /**
+   * @param p  percentile, in [0, 100].
+   * @return  upper bound of the bucket containing the p-th percentile
+   *          (never above max()), 0 if there are no samples.
+   */
+  uint64_t percentile(double p) const;
+
+  /**
+   * count, mean, max and the usual percentiles (p50, p90, p99, p999).
+   */
+  folly::dynamic toDynamic() const;
+
+  static size_t bucketIndex(uint64_t value);
+  static uint64_t bucketUpperBound(size_t index);
+
+ private:
+  std::atomic<uint64_t> buckets_[kNumBuckets];
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> sum_{0};
+  std::atomic<uint64_t> max_{0};
+
+  void updateMax(uint64_t value);
+
+  LatencyHistogram(const LatencyHistogram&) = delete;
+  LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+};
+
+/**
+ * Latency histograms keyed by name (e.g. routing prefix).
+ *
+ * record() may only be called from a single thread, the owner (e.g. proxy
+ * thread). Lookups on that thread take no lock; the lock is only taken
+ * to add a new name and by readers on other threads.
+ */
+class LatencyHistogramMap {
+ public:
+  /**
+   * At most this many names are tracked, samples for any other names
+   * go to kOtherName.
+   */
+  static constexpr size_t kMaxNames = 256;
+  static const char* const kOtherName;
+
+  void record(folly::StringPiece name, uint64_t value);
+
+  /**
+   * Calls f(const std::string& name, const LatencyHistogram&) for each
+   * histogram. Thread safe, the map is locked during the call.
+   */
+  template <typename Func>
+  void foreachSynced(Func&& f) const {
+    std::lock_guard<std::mutex> lock(lock_);
+    for (const auto& it : histograms_) {
+      f(it.first, *it.second);
+    }
+  }
+
+ private:
+  std::unordered_map<std::string, std::unique_ptr<LatencyHistogram>>
+    histograms_;
+  mutable std::mutex lock_;
+
+  // Consecutive requests usually go to the same route.
+  std::string lastName_;
+  LatencyHistogram* last_{nullptr};
+
+  LatencyHistogram& getOrCreate(folly::StringPiece name);
+};
+
+}}}  // facebook::memcache::mcrouter
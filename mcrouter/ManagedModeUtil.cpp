@@ -11,7 +11,12 @@
 
 #include <signal.h>
 #include <sys/eventfd.h>
+#include <sys/socket.h>
 #include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <thread>
 
 #include <glog/logging.h>
 
@@ -27,7 +32,12 @@ const unsigned int TermSignalTimeout{3000000}; // microseconds
 
 // Globals
 std::atomic<pid_t> childPid{-1}; // PID of the current child process.
+std::atomic<pid_t> standbyPid{-1}; // PID of the standby child process.
 std::atomic<bool> running{true};
+/* Parent: its end of the socket to the standby child, a byte sent on it
+   makes the standby child active. Standby child: the other end. */
+int standbyFd{-1};
+bool standbyChild{false};
 
 bool waitpidTimeout(int pid, unsigned int timeout) {
   // Exponential sleep.
@@ -52,17 +62,22 @@ bool waitpidTimeout(int pid, unsigned int timeout) {
 }
 
 void termSignalHandler(int signal) {
-  if (childPid > 0) {
+  if (childPid > 0 || standbyPid > 0) {
     running = false;
 
     // Asures the above sets are done before going on.
     std::atomic_signal_fence(std::memory_order_seq_cst);
 
-    kill(childPid, signal);
+    if (childPid > 0) {
+      kill(childPid, signal);
+    }
+    if (standbyPid > 0) {
+      kill(standbyPid, signal);
+    }
   }
 }
 
-void installSignalHandlers() {
+void installSignalHandlers(bool standby) {
   struct sigaction act;
   memset(&act, 0, sizeof(struct sigaction));
 
@@ -72,8 +87,9 @@ void installSignalHandlers() {
     CHECK(!sigaction(sig, &act, nullptr));
   }
 
-  // Child signal
-  signal(SIGCHLD, SIG_IGN);
+  // Child signal. With two children, we need to know which one exited,
+  // so they can't be reaped automatically.
+  signal(SIGCHLD, standby ? SIG_DFL : SIG_IGN);
 }
 
 void uninstallSignalHandlers() {
@@ -82,52 +98,195 @@ void uninstallSignalHandlers() {
   }
 }
 
-} // anonymous namsepace
+void closeStandbyFd() {
+  if (standbyFd >= 0) {
+    close(standbyFd);
+    standbyFd = -1;
+  }
+}
+
+/**
+ * Forks off the active or the standby child.
+ *
+ * @return true in the child.
+ */
+bool forkChild(bool standby) {
+  int fds[2];
+  if (standby && socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+    logFailure(failure::Category::kSystemError,
+        "Can't create socket for standby child process, sleeping");
+    std::this_thread::sleep_for(std::chrono::seconds(SpawnWait));
+    return false;
+  }
 
-void spawnManagedChild() {
-  installSignalHandlers();
+  pid_t pid = fork();
+  switch (pid) {
+  case -1:
+    // error
+    logFailure(failure::Category::kSystemError,
+        "Can't spawn {} process, sleeping",
+        standby ? "standby child" : "child");
+    if (standby) {
+      close(fds[0]);
+      close(fds[1]);
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(SpawnWait));
+    return false;
 
-  // Loops forever to make sure the parent process never leaves.
+  case 0:
+    // child process. cleanup and continue with the startup logic.
+    uninstallSignalHandlers();
+    closeStandbyFd();
+    childPid = 0;
+    standbyPid = -1;
+    if (standby) {
+      close(fds[0]);
+      standbyFd = fds[1];
+      standbyChild = true;
+    }
+    return true;
+
+  default:
+    // parent process.
+    if (standby) {
+      close(fds[1]);
+      standbyFd = fds[0];
+      standbyPid = pid;
+      LOG(INFO) << "Spawned standby child process " << pid;
+    } else {
+      childPid = pid;
+      LOG(INFO) << "Spawned child process " << pid;
+    }
+    return false;
+  }
+}
+
+void promoteStandby() {
+  char active = 1;
+  if (send(standbyFd, &active, 1, MSG_NOSIGNAL) == 1) {
+    LOG(INFO) << "Standby child process " << standbyPid << " takes over";
+  }
+  // Otherwise it's exiting too, and will be waited for as the active child
+  closeStandbyFd();
+  childPid = standbyPid.load();
+  standbyPid = -1;
+}
+
+/**
+ * Waits for a child to exit. A standby child that exited is respawned no
+ * sooner than respawnStandby, so until then we poll and return early.
+ */
+void waitForChild(bool standby,
+                  std::chrono::steady_clock::time_point respawnStandby) {
+  pid_t rv;
   while (true) {
-    switch (childPid = fork()) {
-    case -1:
-      // error
-      logFailure(failure::Category::kSystemError,
-          "Can't spawn child process, sleeping");
-      std::this_thread::sleep_for(std::chrono::seconds(SpawnWait));
+    bool poll = standby && standbyPid <= 0 &&
+      std::chrono::steady_clock::now() < respawnStandby;
+    rv = waitpid(-1, nullptr, poll ? WNOHANG : 0);
+    if (rv == 0) {
+      if (!running) {
+        break;
+      }
+      if (std::chrono::steady_clock::now() >= respawnStandby) {
+        // Time to spawn the standby child again
+        return;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      continue;
+    }
+    if (rv > 0 || errno == ECHILD || !running) {
       break;
+    }
+  }
 
-    case 0:
-      // child process. cleanup and continue with the startup logic.
-      uninstallSignalHandlers();
-      return;
+  if (!running) {
+    // Child was killed. Shutdown parent.
+    for (pid_t pid : {childPid.load(), standbyPid.load()}) {
+      if (pid > 0 && !waitpidTimeout(pid, TermSignalTimeout)) {
+        logFailure(failure::Category::kSystemError,
+            "Child process did not exit in {} microseconds. Sending SIGKILL.",
+            TermSignalTimeout);
+        kill(pid, SIGKILL);
+      }
+    }
+    exit(0);
+  }
+
+  if (rv > 0 && rv == standbyPid) {
+    LOG(INFO) << "Standby child process " << rv << " exited";
+    closeStandbyFd();
+    standbyPid = -1;
+    return;
+  }
+  if (rv == -1 || rv == childPid) {
+    // Child died accidentally. Cleanup and restart.
+    LOG(INFO) << "Child process " << childPid << " exited";
+    waitpid(childPid, nullptr, 0);
+    childPid = -1;
+  }
+  if (rv == -1 && standbyPid > 0) {
+    // No children left at all
+    closeStandbyFd();
+    standbyPid = -1;
+  }
+}
+
+} // anonymous namsepace
+
+void spawnManagedChild(bool standby) {
+  installSignalHandlers(standby);
+  auto respawnStandby = std::chrono::steady_clock::now();
 
-    default:
-      // parent process.
-      LOG(INFO) << "Spawned child process " << childPid;
-
-      int rv;
-      do {
-        rv = wait(nullptr);
-      } while (rv == -1 && errno != ECHILD && running);
-
-      if (running) {
-        // Child died accidentally. Cleanup and restart.
-        LOG(INFO) << "Child process " << childPid << " exited";
-        waitpid(childPid, nullptr, 0);
-      } else {
-        // Child was killed. Shutdown parent.
-        if (!waitpidTimeout(childPid, TermSignalTimeout)) {
-          logFailure(failure::Category::kSystemError,
-              "Child process did not exit in {} microseconds. Sending SIGKILL.",
-              TermSignalTimeout);
-          kill(childPid, SIGKILL);
-        }
-        exit(0);
+  // Loops forever to make sure the parent process never leaves.
+  while (true) {
+    if (childPid <= 0 && standbyPid > 0) {
+      promoteStandby();
+    }
+    if (childPid <= 0 && forkChild(/* standby= */ false)) {
+      return;
+    }
+    if (standby && standbyPid <= 0 && childPid > 0 &&
+        std::chrono::steady_clock::now() >= respawnStandby) {
+      if (forkChild(/* standby= */ true)) {
+        return;
       }
-      break;
     }
+    if (childPid <= 0) {
+      continue;
+    }
+
+    bool hadStandby = standbyPid > 0;
+    waitForChild(standby, respawnStandby);
+    if (hadStandby && standbyPid <= 0 && childPid > 0) {
+      // Standby died on its own (e.g. bad config), don't spin on it
+      respawnStandby = std::chrono::steady_clock::now() +
+        std::chrono::seconds(SpawnWait);
+    }
+  }
+}
+
+bool isStandbyChild() {
+  return standbyChild;
+}
+
+void waitUntilActive() {
+  if (!standbyChild) {
+    return;
   }
+
+  char active;
+  ssize_t rv;
+  do {
+    rv = read(standbyFd, &active, 1);
+  } while (rv == -1 && errno == EINTR);
+  if (rv != 1) {
+    LOG(INFO) << "Parent process exited, standby child process exits";
+    _exit(0);
+  }
+
+  closeStandbyFd();
+  standbyChild = false;
+  LOG(INFO) << "Standby child process " << getpid() << " is active now";
 }
 
 bool shutdownFromChild() {
@@ -17,8 +17,19 @@ namespace facebook { namespace memcache { namespace mcrouter {
 typedef std::function<void()> ChildCleanupFn;
 
 /* Forks off child process and watches for its death if we're running in
-   managed mode. */
-void spawnManagedChild();
+   managed mode.
+   With standby, a second child is kept ready ahead of time, and takes over
+   as soon as the active one dies. Returns in both children: the standby one
+   should prepare to serve (e.g. load its config), then call
+   waitUntilActive(). */
+void spawnManagedChild(bool standby = false);
+
+/* Is this the standby child (until waitUntilActive() returns)? */
+bool isStandbyChild();
+
+/* Blocks the standby child until the active one dies.
+ * Exits if the parent goes away in the meantime. */
+void waitUntilActive();
 
 /* Shutdown parent and child process'.
  * Can only be called after spawnManagedChild(). */
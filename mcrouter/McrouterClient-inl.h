@@ -0,0 +1,75 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "mcrouter/ProxyRequestContext.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+template <class Callback>
+void McrouterClient::sendInline(McMsgRef req, Callback&& callback) {
+  using CallbackT = typename std::decay<Callback>::type;
+
+  /* The context keeps the callback until the reply is sent,
+     every context is replied to exactly once */
+  std::unique_ptr<CallbackT> cb(
+    new CallbackT(std::forward<Callback>(callback)));
+  auto preq = ProxyRequestContext::create(
+    *proxy_,
+    std::move(req),
+    &McrouterClient::onInlineReply<CallbackT>,
+    cb.get());
+  cb.release();
+  dispatchInline(std::move(preq));
+}
+
+template <class Callback>
+void McrouterClient::send(McRequest req, mc_op_t op, Callback&& callback,
+                          std::shared_ptr<McReplyStream> replyStream) {
+  using CallbackT = typename std::decay<Callback>::type;
+
+  std::unique_ptr<CallbackT> cb(
+    new CallbackT(std::forward<Callback>(callback)));
+  auto preq = ProxyRequestContext::create(
+    *proxy_,
+    std::move(req),
+    op,
+    &McrouterClient::onTypedReply<CallbackT>,
+    cb.get());
+  cb.release();
+  preq->replyStream_ = std::move(replyStream);
+  sendRequest(std::move(preq));
+}
+
+template <class Callback>
+void McrouterClient::onInlineReply(ProxyRequestContext& preq) {
+  std::unique_ptr<Callback> callback(static_cast<Callback*>(preq.context_));
+  preq.context_ = nullptr;
+
+  auto client = preq.requester_;
+  client->countReply(preq);
+  (*callback)(preq.origReq(), std::move(preq.reply_.value()));
+  client->replyDone();
+}
+
+template <class Callback>
+void McrouterClient::onTypedReply(ProxyRequestContext& preq) {
+  std::unique_ptr<Callback> callback(static_cast<Callback*>(preq.context_));
+  preq.context_ = nullptr;
+
+  auto client = preq.requester_;
+  client->countReply(preq);
+  (*callback)(std::move(preq.reply_.value()));
+  client->replyDone();
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -9,7 +9,8 @@
  */
 #include "McrouterClient.h"
 
-#include "mcrouter/lib/fbi/asox_queue.h"
+#include <folly/io/async/EventBase.h>
+
 #include "mcrouter/McrouterInstance.h"
 #include "mcrouter/proxy.h"
 #include "mcrouter/ProxyRequestContext.h"
@@ -63,54 +64,46 @@ size_t McrouterClient::send(const mcrouter_msg_t* requests, size_t nreqs) {
   }
   assert(!isZombie_);
 
-  asox_queue_entry_t scratch[100];
-  asox_queue_entry_t* entries;
-
-  if (nreqs <= sizeof(scratch)/sizeof(scratch[0])) {
-    entries = scratch;
-  } else {
-    entries = (asox_queue_entry_t*)malloc(sizeof(entries[0]) * nreqs);
-    if (entries == nullptr) {
-      // errno is ENOMEM
-      return 0;
-    }
-  }
-
-  __sync_fetch_and_add(&stats_.nreq, nreqs);
-  for (size_t i = 0; i < nreqs; i++) {
-    auto preq = ProxyRequestContext::create(
-      *proxy_,
-      McMsgRef::cloneRef(requests[i].req),
-      [] (ProxyRequestContext& prq) {
-        prq.requester_->onReply(prq);
-      },
-      requests[i].context);
-    preq->requester_ = incref();
+  uint32_t firstIndex = __sync_fetch_and_add(&stats_.nreq, nreqs);
+  auto makePreq = [this, requests, firstIndex](size_t i) {
+    auto onReply = [] (ProxyRequestContext& prq) {
+      prq.requester_->onReply(prq);
+    };
+    std::unique_ptr<ProxyRequestContext> preq;
     if (requests[i].saved_request.hasValue()) {
-      preq->savedRequest_.emplace(
-        std::move(*requests[i].saved_request));
+      /* The saved copy is what gets routed, requests[i].req only
+         references the caller's one */
+      preq = ProxyRequestContext::create(
+        *proxy_,
+        requests[i].saved_request->clone(),
+        requests[i].req->op,
+        onReply,
+        requests[i].context);
+    } else {
+      preq = ProxyRequestContext::create(
+        *proxy_,
+        McMsgRef::cloneRef(requests[i].req),
+        onReply,
+        requests[i].context);
     }
+    preq->requester_ = incref();
 
-    __sync_fetch_and_add(&stats_.op_count[requests[i].req->op], 1);
-    __sync_fetch_and_add(&stats_.op_value_bytes[requests[i].req->op],
-                         requests[i].req->value.len);
-    __sync_fetch_and_add(&stats_.op_key_bytes[requests[i].req->op],
-                         requests[i].req->key.len);
+    countRequest(*requests[i].req);
+    samplePhases(*preq, firstIndex + i);
 
-    entries[i].data = preq.release();
-    entries[i].nbytes = sizeof(ProxyRequestContext*);
-    entries[i].priority = 0;
-    entries[i].type = request_type_request;
-  }
+    return preq.release();
+  };
 
   if (router_->opts().standalone) {
     /*
-     * Skip the extra asox queue hop and directly call the queue callback,
+     * Skip the extra message queue hop and directly call the queue callback,
      * since we're standalone and thus staying in the same thread
      */
+    assert(proxy_->eventBase->isInEventBaseThread());
     if (maxOutstanding_ == 0) {
-      for (int i = 0; i < nreqs; i++) {
-        requestReady(proxy_->request_queue, &entries[i], proxy_);
+      for (size_t i = 0; i < nreqs; i++) {
+        requestReady(*proxy_,
+                     ProxyMessage(request_type_request, makePreq(i)));
       }
     } else {
       size_t i = 0;
@@ -122,31 +115,31 @@ size_t McrouterClient::send(const mcrouter_msg_t* requests, size_t nreqs) {
         }
         n += counting_sem_lazy_wait(&outstandingReqsSem_, nreqs - n);
 
-        for (int j = i; j < n; j++) {
-          requestReady(proxy_->request_queue, &entries[j], proxy_);
+        for (size_t j = i; j < n; j++) {
+          requestReady(*proxy_,
+                       ProxyMessage(request_type_request, makePreq(j)));
         }
 
         i = n;
       }
     }
   } else if (maxOutstanding_ == 0) {
-    asox_queue_multi_enqueue(proxy_->request_queue, entries, nreqs);
+    for (size_t i = 0; i < nreqs; i++) {
+      proxy_->sendMessage(request_type_request, makePreq(i));
+    }
   } else {
     size_t i = 0;
     size_t n = 0;
 
     while (i < nreqs) {
       n += counting_sem_lazy_wait(&outstandingReqsSem_, nreqs - n);
-      asox_queue_multi_enqueue(proxy_->request_queue, &entries[i],
-                               n - i);
+      for (size_t j = i; j < n; j++) {
+        proxy_->sendMessage(request_type_request, makePreq(j));
+      }
       i = n;
     }
   }
 
-  if (entries != scratch) {
-    free(entries);
-  }
-
   return nreqs;
 }
 
@@ -181,16 +174,12 @@ McrouterClient::McrouterClient(
     router_->clientList_.push_front(*this);
   }
 
-  {
-    std::lock_guard<std::mutex> guard(router_->nextProxyMutex_);
-    assert(router_->nextProxy_ < router_->opts().num_proxies);
-    proxy_ = router_->getProxy(router_->nextProxy_);
-    router_->nextProxy_ =
-      (router_->nextProxy_ + 1) % router_->opts().num_proxies;
-  }
+  proxy_ = router_->pickProxyForClient();
 }
 
 void McrouterClient::onReply(ProxyRequestContext& preq) {
+  countReply(preq);
+
   mcrouter_msg_t router_reply;
 
   // Don't increment refcounts, because these are transient stack
@@ -200,14 +189,6 @@ void McrouterClient::onReply(ProxyRequestContext& preq) {
   router_reply.reply = std::move(preq.reply_.value());
   router_reply.context = preq.context_;
 
-  if (router_reply.reply.result() == mc_res_timeout ||
-      router_reply.reply.result() == mc_res_connect_timeout) {
-    __sync_fetch_and_add(&stats_.ntmo, 1);
-  }
-
-  __sync_fetch_and_add(&stats_.op_value_bytes[preq.origReq()->op],
-                       router_reply.reply.value().length());
-
   if (LIKELY(callbacks_.on_reply && !disconnected_)) {
       callbacks_.on_reply(&router_reply, arg_);
   } else if (callbacks_.on_cancel && disconnected_) {
@@ -216,25 +197,90 @@ void McrouterClient::onReply(ProxyRequestContext& preq) {
     callbacks_.on_cancel(preq.context_, arg_);
   }
 
+  replyDone();
+}
+
+void McrouterClient::countRequest(const mc_msg_t& req) {
+  __sync_fetch_and_add(&stats_.op_count[req.op], 1);
+  __sync_fetch_and_add(&stats_.op_value_bytes[req.op], req.value.len);
+  __sync_fetch_and_add(&stats_.op_key_bytes[req.op], req.key.len);
+}
+
+void McrouterClient::samplePhases(ProxyRequestContext& preq,
+                                  uint32_t index) {
+  auto period = router_->opts().request_phases_sample_period;
+  if (period != 0 && index % period == 0) {
+    preq.startPhases();
+  }
+  auto cpuPeriod = router_->opts().route_cpu_sample_period;
+  if (cpuPeriod != 0 && index % cpuPeriod == 0) {
+    preq.startRouteCpu();
+  }
+}
+
+void McrouterClient::countReply(const ProxyRequestContext& preq) {
+  const auto& reply = preq.reply_.value();
+  if (reply.result() == mc_res_timeout ||
+      reply.result() == mc_res_connect_timeout) {
+    __sync_fetch_and_add(&stats_.ntmo, 1);
+  }
+
+  __sync_fetch_and_add(&stats_.op_value_bytes[preq.origReq()->op],
+                       reply.value().length());
+}
+
+void McrouterClient::replyDone() {
   numPending_--;
   if (numPending_ == 0 && disconnected_) {
     cleanup();
   }
 }
 
+void McrouterClient::dispatchInline(
+    std::unique_ptr<ProxyRequestContext> preq) {
+  assert(!isZombie_);
+  assert(proxy_->eventBase->isInEventBaseThread());
+
+  if (maxOutstanding_ != 0) {
+    while (counting_sem_value(&outstandingReqsSem_) == 0) {
+      mcrouterLoopOnce(proxy_->eventBase);
+    }
+    counting_sem_lazy_wait(&outstandingReqsSem_, 1);
+  }
+
+  uint32_t index = __sync_fetch_and_add(&stats_.nreq, 1);
+  countRequest(*preq->origReq());
+  samplePhases(*preq, index);
+  preq->requester_ = incref();
+  processRequest(*proxy_, std::move(preq));
+}
+
+void McrouterClient::sendRequest(std::unique_ptr<ProxyRequestContext> preq) {
+  if (router_->opts().standalone) {
+    dispatchInline(std::move(preq));
+    return;
+  }
+  assert(!isZombie_);
+
+  if (maxOutstanding_ != 0) {
+    counting_sem_lazy_wait(&outstandingReqsSem_, 1);
+  }
+
+  uint32_t index = __sync_fetch_and_add(&stats_.nreq, 1);
+  countRequest(*preq->origReq());
+  samplePhases(*preq, index);
+  preq->requester_ = incref();
+  proxy_->sendMessage(request_type_request, preq.release());
+}
+
 void McrouterClient::disconnect() {
   if (isZombie_) {
     return;
   }
-  asox_queue_entry_t entry;
-  entry.type = request_type_disconnect;
-  // the libevent priority for disconnect must be greater than or equal to
-  // normal request to avoid race condition. (In libevent,
-  // higher priority value means lower priority)
-  entry.priority = 0;
-  entry.data = this;
-  entry.nbytes = sizeof(*this);
-  asox_queue_enqueue(proxy_->request_queue, &entry);
+  // the disconnect message must go through the same queue as normal
+  // requests to avoid race condition: everything sent before disconnect()
+  // is guaranteed to be seen by the proxy first.
+  proxy_->sendMessage(request_type_disconnect, this);
 }
 
 void McrouterClient::cleanup() {
@@ -291,50 +337,61 @@ McrouterClient::getStatsHelper(bool clear) {
   return ret;
 }
 
-void McrouterClient::requestReady(asox_queue_t q,
-                                  asox_queue_entry_t* entry,
-                                  void* arg) {
-  switch(entry->type)
+void McrouterClient::processRequest(
+    proxy_t& proxy, std::unique_ptr<ProxyRequestContext> preq) {
+  if (preq->phasesSampled()) {
+    preq->endPhase(RequestPhase::PROXY_QUEUE);
+  }
+  preq->requester_->numPending_++;
+
+  if (precheckRequest(*preq)) {
+    return;
+  }
+
+  if (proxy.being_destroyed) {
+    /* We can't process this, since 1) we destroyed the config already,
+       and 2) the clients are winding down, so we wouldn't get any
+       meaningful response back anyway. */
+    LOG(ERROR) << "Outstanding request on a proxy that's being destroyed";
+    preq->sendReply(McReply(mc_res_unknown));
+    return;
+  }
+  proxy.dispatchRequest(std::move(preq));
+}
+
+void McrouterClient::requestReady(proxy_t& proxy, ProxyMessage&& message) {
+  switch(message.type)
   {
 
   case request_type_request:
   {
-    proxy_t* proxy = (proxy_t*)arg;
-    auto preq =
+    processRequest(
+      proxy,
       std::unique_ptr<ProxyRequestContext>(
-        reinterpret_cast<ProxyRequestContext*>(entry->data));
-    auto client = preq->requester_;
-
-    client->numPending_++;
-
-    if (precheckRequest(*preq)) {
-      return;
-    }
-
-    if (proxy->being_destroyed) {
-      /* We can't process this, since 1) we destroyed the config already,
-         and 2) the clients are winding down, so we wouldn't get any
-         meaningful response back anyway. */
-      LOG(ERROR) << "Outstanding request on a proxy that's being destroyed";
-      preq->sendReply(McReply(mc_res_unknown));
-      return;
-    }
-    proxy->dispatchRequest(std::move(preq));
+        reinterpret_cast<ProxyRequestContext*>(message.data)));
     break;
   }
   case request_type_old_config:
   {
-    auto oldConfig = (old_config_req_t*) entry->data;
+    auto oldConfig = (old_config_req_t*) message.data;
+    /* config_ already points to the new config */
+    proxy.onConfigSwapped();
     delete oldConfig;
     break;
   }
   case request_type_disconnect:
   {
-    auto client = (McrouterClient*) entry->data;
+    auto client = (McrouterClient*) message.data;
     client->disconnected_ = true;
     if (client->numPending_ == 0) client->cleanup();
     break;
   }
+  case request_type_stolen_request:
+    proxy.routeStolenRequest(static_cast<StolenRequest*>(message.data));
+    break;
+  case request_type_stolen_reply:
+    proxy.onStolenReply(static_cast<StolenRequest*>(message.data));
+    break;
   case request_type_router_shutdown:
     /*
      * No-op. We just wanted to wake this event base up so that
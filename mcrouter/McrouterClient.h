@@ -17,11 +17,7 @@
 #include "mcrouter/lib/mc/msg.h"
 #include "mcrouter/lib/McReply.h"
 #include "mcrouter/lib/McRequest.h"
-
-class asox_queue_s;
-using asox_queue_t = asox_queue_s*;
-class asox_queue_entry_s;
-using asox_queue_entry_t = asox_queue_entry_s;
+#include "mcrouter/lib/network/McReplyStream.h"
 
 namespace folly {
 class EventBase;
@@ -42,6 +38,7 @@ struct mcrouter_client_stats_t {
 class McrouterClient;
 class McrouterInstance;
 class proxy_t;
+struct ProxyMessage;
 class ProxyRequestContext;
 
 struct mcrouter_msg_t {
@@ -93,6 +90,36 @@ class McrouterClient {
    */
   size_t send(const mcrouter_msg_t* requests, size_t nreqs);
 
+  /**
+   * Route a request from the thread running this client's proxy event base,
+   * for C++ code that runs libmcrouter on its own event base.
+   *
+   * The request skips the proxy message queue and goes straight to routing.
+   * callback(const McMsgRef& req, McReply&& reply) is called instead of
+   * the C callbacks, on the same thread, possibly before sendInline()
+   * returns. If maximum_outstanding is set, this runs the event base
+   * until a slot frees up, like send() in standalone mode.
+   */
+  template <class Callback>
+  void sendInline(McMsgRef req, Callback&& callback);
+
+  /**
+   * Asynchronously send a request without building a mc_msg_t copy of it:
+   * the key and value stay in req, which is kept alive until the request
+   * completes.
+   *
+   * callback(McReply&& reply) is called on the proxy thread, even after
+   * the client is disconnected, so it's safe for the callback to own
+   * the caller's request state. It may be move-only.
+   *
+   * @param replyStream  if set, get hits are offered to it while they're
+   *                     being read from destinations (see
+   *                     ProxyRequestContext::replyStream()).
+   */
+  template <class Callback>
+  void send(McRequest req, mc_op_t op, Callback&& callback,
+            std::shared_ptr<McReplyStream> replyStream = nullptr);
+
   /**
    * Returns the mcrouter managed event base that runs the callbacks.
    * Returns nullptr in sync or standalone mode, as mcrouter doesn't create
@@ -136,6 +163,19 @@ class McrouterClient {
     return clientId_;
   }
 
+  /**
+   * Share of outstanding-limited destinations this client gets relative to
+   * other clients waiting for them (see OutstandingLimitRoute), 1 by
+   * default. Set before sending requests.
+   */
+  void setFairShareWeight(uint32_t weight) {
+    fairShareWeight_ = weight > 0 ? weight : 1;
+  }
+
+  uint32_t fairShareWeight() const {
+    return fairShareWeight_;
+  }
+
   /**
    * Override default proxy assignment.
    */
@@ -173,6 +213,8 @@ class McrouterClient {
    */
   uint64_t clientId_;
 
+  uint32_t fairShareWeight_{1};
+
   std::atomic<size_t> FOLLY_ALIGN_TO_AVOID_FALSE_SHARING refcount_{1};
 
   McrouterClient(
@@ -182,6 +224,32 @@ class McrouterClient {
     size_t maximum_outstanding);
 
   void onReply(ProxyRequestContext& preq);
+
+  template <class Callback>
+  static void onInlineReply(ProxyRequestContext& preq);
+
+  template <class Callback>
+  static void onTypedReply(ProxyRequestContext& preq);
+
+  void dispatchInline(std::unique_ptr<ProxyRequestContext> preq);
+
+  /* Routes preq from the calling thread in standalone mode,
+     through the proxy message queue otherwise */
+  void sendRequest(std::unique_ptr<ProxyRequestContext> preq);
+
+  /* Stats of a request sent through this client */
+  void countRequest(const mc_msg_t& req);
+
+  /* Starts timing phases of every request_phases_sample_period'th request
+     and profiling routes of every route_cpu_sample_period'th one,
+     index is the request's number in stats_.nreq */
+  void samplePhases(ProxyRequestContext& preq, uint32_t index);
+
+  /* Stats of a reply, before it's passed to the callback */
+  void countReply(const ProxyRequestContext& preq);
+
+  /* The reply was passed to the callback, cleans up after disconnect */
+  void replyDone();
   void disconnect();
   void cleanup();
   McrouterClient* incref();
@@ -191,9 +259,11 @@ class McrouterClient {
  public:
   /* Note: this is only public due to legacy code in proxy.cpp.
      Will fix. */
-  static void requestReady(asox_queue_t q,
-                           asox_queue_entry_t *entry,
-                           void *arg);
+  static void requestReady(proxy_t& proxy, ProxyMessage&& message);
+
+ private:
+  static void processRequest(proxy_t& proxy,
+                             std::unique_ptr<ProxyRequestContext> preq);
 
  private:
   McrouterClient(const McrouterClient&) = delete;
@@ -206,3 +276,5 @@ class McrouterClient {
 };
 
 }}} // facebook::memcache::mcrouter
+
+#include "McrouterClient-inl.h"
@@ -9,6 +9,17 @@
  */
 #include "McrouterInstance.h"
 
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <system_error>
+#include <thread>
+#include <vector>
+
 #include <boost/filesystem/operations.hpp>
 
 #include <folly/DynamicConverter.h>
@@ -17,17 +28,24 @@
 #include <folly/MapUtil.h>
 
 #include "mcrouter/awriter.h"
+#include "mcrouter/DebugTap.h"
 #include "mcrouter/FileObserver.h"
 #include "mcrouter/lib/fbi/cpp/LogFailure.h"
 #include "mcrouter/lib/fbi/timer.h"
+#include "mcrouter/lib/network/HostResolver.h"
+#include "mcrouter/lib/network/HugePageArena.h"
 #include "mcrouter/McrouterLogFailure.h"
 #include "mcrouter/McrouterLogger.h"
+#include "mcrouter/MetricsServer.h"
 #include "mcrouter/proxy.h"
+#include "mcrouter/ProxyClientCommon.h"
 #include "mcrouter/ProxyConfig.h"
 #include "mcrouter/ProxyConfigBuilder.h"
+#include "mcrouter/ProxyLoopMonitor.h"
 #include "mcrouter/ProxyThread.h"
+#include "mcrouter/routes/McImportResolver.h"
 #include "mcrouter/RuntimeVarsData.h"
-#include "mcrouter/ThreadUtil.h"
+#include "mcrouter/TrafficCapture.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
@@ -81,6 +99,9 @@ namespace {
 
 folly::Singleton<McrouterManager> gMcrouterManager;
 
+/* Service info commands queued at a time, later ones are refused */
+const size_t kMaxPendingServiceInfoCommands = 64;
+
 bool isValidRouterName(folly::StringPiece name) {
   if (name.empty()) {
     return false;
@@ -99,6 +120,128 @@ bool isValidRouterName(folly::StringPiece name) {
   return true;
 }
 
+/**
+ * @return  resident set size of this process in bytes, 0 on error.
+ */
+uint64_t currentRss() {
+  FILE* statm = fopen("/proc/self/statm", "r");
+  if (statm == nullptr) {
+    return 0;
+  }
+  unsigned long size;
+  unsigned long residentPages;
+  int count = fscanf(statm, "%lu %lu", &size, &residentPages);
+  fclose(statm);
+  if (count != 2) {
+    return 0;
+  }
+  return static_cast<uint64_t>(residentPages) * sysconf(_SC_PAGESIZE);
+}
+
+uint64_t threadCpuTimeUs() {
+  timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+    return 0;
+  }
+  return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/**
+ * Builds the configs of proxies [1, num_proxies) on up to numThreads
+ * threads. configs[0] should be built already: that parses all pools and
+ * fills the object cache, so that the other builds mostly look them up.
+ *
+ * @param cpuTimeUs  incremented by the CPU time spent in the build threads.
+ * @throw  the first exception thrown by a build, once all threads are done.
+ */
+void buildRemainingConfigs(const McrouterInstance& router,
+                           const ProxyConfigBuilder& builder,
+                           std::vector<std::shared_ptr<ProxyConfig>>& configs,
+                           size_t numThreads,
+                           uint64_t& cpuTimeUs) {
+  std::atomic<size_t> next{1};
+  std::atomic<uint64_t> cpuTime{0};
+  std::mutex errorLock;
+  std::exception_ptr error;
+
+  auto build = [&]() {
+    auto start = threadCpuTimeUs();
+    for (size_t i = next++; i < configs.size(); i = next++) {
+      try {
+        configs[i] = builder.buildConfig(router.getProxy(i));
+      } catch (...) {
+        std::lock_guard<std::mutex> lg(errorLock);
+        if (!error) {
+          error = std::current_exception();
+        }
+        // no point in building the rest
+        next = configs.size();
+      }
+    }
+    cpuTime += threadCpuTimeUs() - start;
+  };
+
+  numThreads = std::min(numThreads, configs.size() - 1);
+  std::vector<std::thread> threads;
+  threads.reserve(numThreads > 0 ? numThreads - 1 : 0);
+  for (size_t i = 1; i < numThreads; ++i) {
+    try {
+      threads.emplace_back(build);
+    } catch (const std::system_error& e) {
+      // fewer threads just take longer
+      LOG(WARNING) << "Can not start config build thread: " << e.what();
+      break;
+    }
+  }
+  // the calling thread is one of the build threads
+  build();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  cpuTimeUs += cpuTime;
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+HousekeepingExecutor::Options housekeepingOptions(
+    const McrouterOptions& opts) {
+  HousekeepingExecutor::Options housekeepingOpts;
+  housekeepingOpts.numThreads = opts.housekeeping_threads;
+  housekeepingOpts.cpus = opts.housekeeping_cpus;
+  return housekeepingOpts;
+}
+
+/* Resolves the server hostnames of config, so that connects find them
+   in the cache */
+void prefetchHostnames(const ProxyConfigIf& config, size_t maxThreads) {
+  std::vector<std::string> hosts;
+  for (const auto& client : config.getClients()) {
+    if (!client->ap.isUnixDomainSocket()) {
+      hosts.push_back(client->ap.getHost().str());
+    }
+  }
+  HostResolver::instance().prefetch(hosts, maxThreads);
+}
+
+void enableHugePageBuffers(const McrouterOptions& opts) {
+  HugePageArena::Mode mode;
+  if (opts.huge_page_buffers == "transparent") {
+    mode = HugePageArena::Mode::TRANSPARENT;
+  } else if (opts.huge_page_buffers == "explicit") {
+    mode = HugePageArena::Mode::EXPLICIT;
+  } else {
+    LOG(ERROR) << "Unknown huge-page-buffers: " << opts.huge_page_buffers;
+    return;
+  }
+  if (!HugePageArena::enable(mode, opts.huge_page_buffers_max_mb << 20) &&
+      HugePageArena::stats().reservedBytes == 0) {
+    /* Not enabled by another instance either */
+    LOG(ERROR) << "Failed to reserve huge page buffers";
+  }
+}
+
 }  // anonymous namespace
 
 McrouterInstance* McrouterInstance::init(folly::StringPiece persistence_id,
@@ -171,6 +314,20 @@ McrouterClient::Pointer McrouterInstance::createClient(
 }
 
 bool McrouterInstance::spinUp(bool spawnProxyThreads) {
+  if (!opts_.huge_page_buffers.empty()) {
+    enableHugePageBuffers(opts_);
+  }
+
+  if (!opts_.traffic_capture_file.empty() &&
+      opts_.traffic_capture_sample_period > 0) {
+    try {
+      trafficCaptureFile_ = std::make_shared<TrafficCaptureFile>(
+        opts_.traffic_capture_file, opts_.traffic_capture_max_mb << 20);
+    } catch (const std::exception& e) {
+      LOG(ERROR) << "Traffic capture disabled: " << e.what();
+    }
+  }
+
   for (size_t i = 0; i < opts_.num_proxies; i++) {
     try {
       auto proxy =
@@ -199,8 +356,10 @@ bool McrouterInstance::spinUp(bool spawnProxyThreads) {
    * Specifically, we'll run them under proxy servers in main()
    */
   if (!opts_.standalone && spawnProxyThreads) {
-    for (auto& pt : proxyThreads_) {
-      auto rc = pt->spawn();
+    const auto& cpus = opts_.proxy_thread_cpus;
+    for (size_t i = 0; i < proxyThreads_.size(); ++i) {
+      auto rc = proxyThreads_[i]->spawn(
+        cpus.empty() ? -1 : cpus[i % cpus.size()]);
       if (!rc) {
         LOG(ERROR) << "Failed to start proxy thread";
         return false;
@@ -273,6 +432,23 @@ proxy_t* McrouterInstance::getProxy(size_t index) const {
   }
 }
 
+proxy_t* McrouterInstance::pickProxyForClient() {
+  auto numProxies = opts_.num_proxies;
+  auto index = nextProxy_.fetch_add(1, std::memory_order_relaxed) % numProxies;
+  auto proxy = getProxy(index);
+  if (!opts_.assign_clients_least_queued || numProxies == 1) {
+    return proxy;
+  }
+
+  /* Queue sizes are approximate, good enough to avoid a busy proxy */
+  auto next = getProxy((index + 1) % numProxies);
+  if (proxy->messageQueue && next->messageQueue &&
+      next->messageQueue->size() < proxy->messageQueue->size()) {
+    return next;
+  }
+  return proxy;
+}
+
 std::string McrouterInstance::routerName() const {
   return "libmcrouter." + opts_.service_name + "." + opts_.router_name;
 }
@@ -303,6 +479,12 @@ void McrouterInstance::tearDown() {
 
   shutdownAndJoinAuxiliaryThreads();
 
+  // Proxies hand requests over to each other until they all left their
+  // loops (see proxy_t::finishStolenRequests()), only then is it safe to
+  // destroy any of them.
+  for (auto& pt : proxyThreads_) {
+    pt->stopLoop();
+  }
   for (auto& pt : proxyThreads_) {
     pt->stopAndJoin();
   }
@@ -322,13 +504,20 @@ McrouterInstance::McrouterInstance(const McrouterOptions& input_options) :
     opts_(options::substituteTemplates(input_options)),
     pid_(getpid()),
     configApi_(createConfigApi(opts_)),
+    importCache_(folly::make_unique<McImportCache>()),
     startupLock_(opts_.num_proxies + 1),
     asyncWriter_(folly::make_unique<AsyncWriter>()),
     statsLogWriter_(folly::make_unique<AsyncWriter>(
-                      opts_.stats_async_queue_length)) {
+                      opts_.stats_async_queue_length)),
+    serviceInfoWriter_(folly::make_unique<AsyncWriter>(
+                         kMaxPendingServiceInfoCommands)),
+    housekeeping_(HousekeepingExecutor::get(housekeepingOptions(opts_))),
+    taskScheduler_(housekeeping_) {
   fb_timer_set_cycle_timer_func(
     []() -> uint64_t { return nowUs(); },
     1.0);
+  HostResolver::instance().setTtl(
+    std::chrono::milliseconds(opts_.dns_cache_ttl_ms));
 }
 
 /* Needed here for forward declared unique_ptr destruction */
@@ -351,8 +540,19 @@ void McrouterInstance::subscribeToConfigUpdate() {
 void McrouterInstance::spawnAuxiliaryThreads() {
   startAwriterThreads();
   startObservingRuntimeVarsFile();
-  spawnStatUpdaterThread();
-  spawnStatLoggerThread();
+  startStatUpdater();
+  startHostnameRefresher();
+  startTkoLogFlusher();
+  /* A standby process would overwrite the stats of the serving one */
+  if (!opts_.standby) {
+    spawnStatLoggerThread();
+  }
+}
+
+void McrouterInstance::leaveStandby() {
+  if (opts_.standby && mcrouterLogger_ == nullptr) {
+    spawnStatLoggerThread();
+  }
 }
 
 void McrouterInstance::startAwriterThreads() {
@@ -365,6 +565,10 @@ void McrouterInstance::startAwriterThreads() {
   if (!statsLogWriter_->start("mcrtr-statsw")) {
     throw std::runtime_error("failed to spawn mcrouter stats writer thread");
   }
+
+  if (!serviceInfoWriter_->start("mcrtr-svcinfo")) {
+    throw std::runtime_error("failed to spawn mcrouter service info thread");
+  }
 }
 
 void McrouterInstance::startObservingRuntimeVarsFile() {
@@ -388,81 +592,70 @@ void McrouterInstance::startObservingRuntimeVarsFile() {
   );
 }
 
-void* McrouterInstance::statUpdaterThreadRun(void* arg) {
-  auto router = reinterpret_cast<McrouterInstance*>(arg);
-  if (router->opts_.num_proxies == 0) {
-    return nullptr;
-  }
-
-  // the idx of the oldest bin
-  int idx = 0;
+void McrouterInstance::updateStatsWindow() {
   static const int BIN_NUM = (MOVING_AVERAGE_WINDOW_SIZE_IN_SECOND /
                             MOVING_AVERAGE_BIN_SIZE_IN_SECOND);
 
-  while (true) {
-    {
-      /* Wait for the full timeout unless shutdown is started */
-      std::unique_lock<std::mutex> lock(router->statUpdaterCvMutex_);
-      if (router->statUpdaterCv_.wait_for(
-            lock,
-            std::chrono::seconds(MOVING_AVERAGE_BIN_SIZE_IN_SECOND),
-            [router]() { return router->shutdownStarted(); })) {
-        /* Shutdown was initiated, so we stop this thread */
-        break;
-      }
-    }
-
-    // to avoid inconsistence among proxies, we lock all mutexes together
-    for (size_t i = 0; i < router->opts_.num_proxies; ++i) {
-      router->getProxy(i)->stats_lock.lock();
-    }
-
-    for (size_t i = 0; i < router->opts_.num_proxies; ++i) {
-      auto proxy = router->getProxy(i);
-      if (proxy->num_bins_used < BIN_NUM) {
-        ++proxy->num_bins_used;
-      }
-
-      for(int j = 0; j < num_stats; ++j) {
-        if (proxy->stats[j].group & rate_stats) {
-          proxy->stats_num_within_window[j] -= proxy->stats_bin[j][idx];
-          proxy->stats_bin[j][idx] = proxy->stats[j].data.uint64;
-          proxy->stats_num_within_window[j] += proxy->stats_bin[j][idx];
-          proxy->stats[j].data.uint64 = 0;
-        }
-      }
-    }
+  // Proxies keep counting while we roll the window: we only read
+  // stats[], and readers of the window retry on stats_window_seq.
+  for (size_t i = 0; i < opts_.num_proxies; ++i) {
+    stats_window_update(getProxy(i), statsWindowIdx_);
+  }
 
-    for (size_t i = 0; i < router->opts_.num_proxies; ++i) {
-      router->getProxy(i)->stats_lock.unlock();
-    }
+  statsWindowIdx_ = (statsWindowIdx_ + 1) % BIN_NUM;
+}
 
-    idx = (idx + 1) % BIN_NUM;
+void McrouterInstance::startStatUpdater() {
+  if (opts_.num_proxies == 0) {
+    return;
   }
-  return nullptr;
+  statUpdaterTask_ = housekeeping_->schedule(
+    std::chrono::seconds(MOVING_AVERAGE_BIN_SIZE_IN_SECOND),
+    [this]() { updateStatsWindow(); });
 }
 
-void McrouterInstance::spawnStatUpdaterThread() {
-  auto rc = spawnThread(&statUpdaterThreadHandle_,
-                        &statUpdaterThreadStack_,
-                        &McrouterInstance::statUpdaterThreadRun,
-                        this, wantRealtimeThreads());
-  if (!rc) {
-    throw std::runtime_error("failed to spawn mcrouter stat updater thread");
+void McrouterInstance::startHostnameRefresher() {
+  if (opts_.dns_cache_ttl_ms == 0 || opts_.num_proxies == 0) {
+    return;
   }
+  hostnameRefresherTask_ = housekeeping_->schedule(
+    std::chrono::milliseconds(opts_.dns_cache_ttl_ms),
+    [this]() {
+      if (auto config = getProxy(0)->getConfig()) {
+        prefetchHostnames(*config, opts_.dns_resolve_threads);
+      }
+    });
+}
 
-  mcrouterSetThreadName(statUpdaterThreadHandle_, opts_, "stats");
+void McrouterInstance::startTkoLogFlusher() {
+  if (opts_.tko_log_interval_ms == 0) {
+    return;
+  }
+  tkoLogFlusherTask_ = housekeeping_->schedule(
+    std::chrono::milliseconds(opts_.tko_log_interval_ms),
+    [this]() { tkoLogQueue_.flush(); });
 }
 
 void McrouterInstance::spawnStatLoggerThread() {
   mcrouterLogger_ = createMcrouterLogger(this);
   mcrouterLogger_->start();
+  if (opts_.metrics_port > 0) {
+    metricsServer_ = folly::make_unique<MetricsServer>(this);
+    metricsServer_->start();
+  }
+  if (!opts_.debug_tap_socket.empty()) {
+    debugTapServer_ = folly::make_unique<DebugTapServer>(this);
+    debugTapServer_->start();
+  }
+  if (opts_.proxy_stall_threshold_ms > 0) {
+    stallWatchdog_ = folly::make_unique<ProxyStallWatchdog>(this);
+    stallWatchdog_->start();
+  }
 }
 
 void McrouterInstance::shutdownAndJoinAuxiliaryThreads() {
   shutdownLock_.shutdownOnce(
     [this]() {
-      statUpdaterCv_.notify_all();
       joinAuxiliaryThreads();
     });
 }
@@ -473,20 +666,27 @@ void McrouterInstance::joinAuxiliaryThreads() {
      the full copy of the stack which we must cleanup. */
   if (getpid() == pid_) {
     taskScheduler_.shutdownAllTasks();
-    if (statUpdaterThreadHandle_) {
-      pthread_join(statUpdaterThreadHandle_, nullptr);
-    }
   } else {
     taskScheduler_.forkWorkAround();
   }
+  /* Doesn't wait in a forked child */
+  housekeeping_->cancel(statUpdaterTask_);
+  housekeeping_->cancel(hostnameRefresherTask_);
+  housekeeping_->cancel(tkoLogFlusherTask_);
+  /* Events of destinations that went down (or away) while shutting down */
+  tkoLogQueue_.flush();
 
   if (mcrouterLogger_) {
     mcrouterLogger_->stop();
   }
-
-  if (statUpdaterThreadStack_) {
-    free(statUpdaterThreadStack_);
-    statUpdaterThreadStack_ = nullptr;
+  if (metricsServer_) {
+    metricsServer_->stop();
+  }
+  if (debugTapServer_) {
+    debugTapServer_->stop();
+  }
+  if (stallWatchdog_) {
+    stallWatchdog_->stop();
   }
 
   stopAwriterThreads();
@@ -495,6 +695,9 @@ void McrouterInstance::joinAuxiliaryThreads() {
 void McrouterInstance::stopAwriterThreads() {
   asyncWriter_->stop();
   statsLogWriter_->stop();
+  /* Runs what is queued: the commands use the router's state, and the
+     proxies wait for their replies */
+  serviceInfoWriter_->stop();
 }
 
 bool McrouterInstance::reconfigure() {
@@ -528,27 +731,77 @@ bool McrouterInstance::reconfigure() {
 }
 
 bool McrouterInstance::configure(folly::StringPiece input) {
-  std::vector<std::shared_ptr<ProxyConfig>> newConfigs;
+  std::vector<std::shared_ptr<ProxyConfig>> newConfigs(opts_.num_proxies);
+  // proxies [0, swapped) already have the new config
+  size_t swapped = 0;
+  auto peakRss = currentRss();
   try {
     // assume default_route, default_region and default_cluster are same for
     // each proxy
+    auto previous = std::dynamic_pointer_cast<ProxyConfig>(
+      getProxy(0)->getConfig());
     ProxyConfigBuilder builder(
       opts_,
       configApi_.get(),
-      input);
-
-    for (size_t i = 0; i < opts_.num_proxies; i++) {
-      newConfigs.push_back(builder.buildConfig(getProxy(i)));
+      input,
+      previous.get(),
+      importCache_.get());
+    previous.reset();
+
+    auto startTime = std::chrono::steady_clock::now();
+    auto cpuTimeUs = threadCpuTimeUs();
+    newConfigs[0] = builder.buildConfig(getProxy(0));
+    cpuTimeUs = threadCpuTimeUs() - cpuTimeUs;
+    peakRss = std::max(peakRss, currentRss());
+
+    // Connects to the new destinations shouldn't wait for the resolver
+    prefetchHostnames(*newConfigs[0], opts_.dns_resolve_threads);
+
+    if (opts_.staged_config_swap) {
+      // The first build validated the config. Swap proxies one at a time,
+      // so that the old config of a proxy can be released while the next
+      // one is being built.
+      for (; swapped < opts_.num_proxies; ++swapped) {
+        if (swapped > 0) {
+          auto buildStart = threadCpuTimeUs();
+          newConfigs[swapped] = builder.buildConfig(getProxy(swapped));
+          cpuTimeUs += threadCpuTimeUs() - buildStart;
+          peakRss = std::max(peakRss, currentRss());
+        }
+        proxy_config_swap(getProxy(swapped), newConfigs[swapped]);
+      }
+    } else {
+      auto numThreads = opts_.config_build_threads;
+      if (numThreads == 0) {
+        numThreads = std::max(std::thread::hardware_concurrency(), 1U);
+      }
+      buildRemainingConfigs(*this, builder, newConfigs, numThreads,
+                            cpuTimeUs);
+      peakRss = std::max(peakRss, currentRss());
     }
+
+    lastConfigBuildTimeUs_ =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - startTime).count();
+    lastConfigBuildCpuTimeUs_ = cpuTimeUs;
+    builder.saveSnapshot();
   } catch (const std::exception& e) {
-    logFailure(this, failure::Category::kInvalidConfig,
-               "Failed to reconfigure: {}", e.what());
+    if (swapped > 0) {
+      logFailure(this, failure::Category::kInvalidConfig,
+                 "Failed to reconfigure (after {} of {} proxies): {}",
+                 swapped, opts_.num_proxies, e.what());
+    } else {
+      logFailure(this, failure::Category::kInvalidConfig,
+                 "Failed to reconfigure: {}", e.what());
+    }
+    lastConfigReloadPeakRss_ = peakRss;
     return false;
   }
 
-  for (size_t i = 0; i < opts_.num_proxies; i++) {
+  for (size_t i = swapped; i < opts_.num_proxies; i++) {
     proxy_config_swap(getProxy(i), newConfigs[i]);
   }
+  lastConfigReloadPeakRss_ = peakRss;
 
   VLOG_IF(0, !opts_.constantly_reload_configs) <<
       "reconfigured " << opts_.num_proxies << " proxies with " <<
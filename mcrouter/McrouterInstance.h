@@ -9,6 +9,7 @@
  */
 #pragma once
 
+#include <atomic>
 #include <condition_variable>
 #include <mutex>
 #include <unordered_map>
@@ -17,20 +18,27 @@
 
 #include "mcrouter/CallbackPool.h"
 #include "mcrouter/ConfigApi.h"
+#include "mcrouter/HousekeepingExecutor.h"
 #include "mcrouter/lib/fbi/cpp/ShutdownLock.h"
 #include "mcrouter/lib/fbi/cpp/StartupLock.h"
 #include "mcrouter/McrouterClient.h"
 #include "mcrouter/Observable.h"
 #include "mcrouter/options.h"
 #include "mcrouter/PeriodicTaskScheduler.h"
+#include "mcrouter/TkoLog.h"
 #include "mcrouter/TkoTracker.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
 class AsyncWriter;
+class DebugTapServer;
+class McImportCache;
 class McrouterManager;
+class MetricsServer;
+class ProxyStallWatchdog;
 class ProxyThread;
 class RuntimeVarsData;
+class TrafficCaptureFile;
 using ObservableRuntimeVars =
   Observable<std::shared_ptr<const RuntimeVarsData>>;
 
@@ -101,6 +109,12 @@ class McrouterInstance {
 
   std::string routerName() const;
 
+  /**
+   * Starts logging and serving stats, held off by opts.standby
+   * until this process is actually serving. Safe to call more than once.
+   */
+  void leaveStandby();
+
   bool shutdownStarted() {
     return shutdownLock_.shutdownStarted();
   }
@@ -109,6 +123,11 @@ class McrouterInstance {
     return shutdownLock_;
   }
 
+  /* Runs the timer driven background tasks (stats logging etc.) */
+  HousekeepingExecutor& housekeeping() {
+    return *housekeeping_;
+  }
+
   /**
    * @return  True if we want to run with realtime threads, that is if we're
    *   running as both standalone and with realtime requested.
@@ -123,6 +142,14 @@ class McrouterInstance {
    */
   proxy_t* getProxy(size_t index) const;
 
+  /**
+   * Picks the proxy a new client will send its requests to.
+   * Lock free: proxies are assigned round robin, and with
+   * assign_clients_least_queued the next proxy in order is taken
+   * instead if its message queue is shorter.
+   */
+  proxy_t* pickProxyForClient();
+
   pid_t pid() const {
     return pid_;
   }
@@ -146,10 +173,37 @@ class McrouterInstance {
     return configFailures_;
   }
 
+  /**
+   * Wall and CPU time (summed over all build threads) it took to build
+   * the configs of all proxies on the last successful reload.
+   */
+  uint64_t lastConfigBuildTimeUs() const {
+    return lastConfigBuildTimeUs_;
+  }
+
+  uint64_t lastConfigBuildCpuTimeUs() const {
+    return lastConfigBuildCpuTimeUs_;
+  }
+
+  /**
+   * Highest resident set size (in bytes) sampled while building and
+   * swapping configs on the last reload.
+   */
+  uint64_t lastConfigReloadPeakRss() const {
+    return lastConfigReloadPeakRss_;
+  }
+
   TkoTrackerMap& tkoTrackerMap() {
     return tkoTrackerMap_;
   }
 
+  /**
+   * TKO events of destinations, flushed every opts.tko_log_interval_ms.
+   */
+  TkoLogQueue& tkoLogQueue() {
+    return tkoLogQueue_;
+  }
+
   ObservableRuntimeVars& rtVarsData() {
     return rtVarsData_;
   }
@@ -168,31 +222,54 @@ class McrouterInstance {
     return *statsLogWriter_;
   }
 
+  /**
+   * Renders the replies of slow service info commands (see ServiceInfo)
+   * off the proxy threads. Drained and stopped on shutdown, before any
+   * proxy goes away.
+   */
+  AsyncWriter& serviceInfoWriter() {
+    assert(serviceInfoWriter_.get() != nullptr);
+    return *serviceInfoWriter_;
+  }
+
+  /**
+   * @return  nullptr unless traffic capture is enabled
+   */
+  const std::shared_ptr<TrafficCaptureFile>& trafficCaptureFile() const {
+    return trafficCaptureFile_;
+  }
+
  private:
   const McrouterOptions opts_;
 
   pid_t pid_;
 
-  std::mutex nextProxyMutex_;
-  unsigned int nextProxy_{0};
+  /* Round robin counter for assigning new clients to proxies */
+  std::atomic<unsigned int> nextProxy_{0};
 
   std::unique_ptr<ConfigApi> configApi_;
+  // parsed @import files, kept across reloads
+  std::unique_ptr<McImportCache> importCache_;
   CallbackPool<> onReconfigureSuccess_;
 
   // These next three fields are used for stats
   uint64_t startTime_{0};
   time_t lastConfigAttempt_{0};
   size_t configFailures_{0};
+  uint64_t lastConfigBuildTimeUs_{0};
+  uint64_t lastConfigBuildCpuTimeUs_{0};
+  uint64_t lastConfigReloadPeakRss_{0};
 
   // Lock to get before regenerating config structure
   std::mutex configReconfigLock_;
 
-  // Stat updater thread updates rate stat windows for each proxy
-  pthread_t statUpdaterThreadHandle_{0};
-  void* statUpdaterThreadStack_{nullptr};
+  // Stat updater task updates rate stat windows for each proxy
+  HousekeepingExecutor::TaskId statUpdaterTask_{0};
+  // the idx of the oldest bin
+  int statsWindowIdx_{0};
 
-  std::mutex statUpdaterCvMutex_;
-  std::condition_variable statUpdaterCv_;
+  // Refreshes the cached resolutions of the config's server hostnames
+  HousekeepingExecutor::TaskId hostnameRefresherTask_{0};
 
   std::mutex clientListLock_;
 
@@ -214,6 +291,10 @@ class McrouterInstance {
 
   TkoTrackerMap tkoTrackerMap_;
 
+  // Only holds events of tkoTrackerMap_'s destinations, declared after it
+  TkoLogQueue tkoLogQueue_;
+  HousekeepingExecutor::TaskId tkoLogFlusherTask_{0};
+
   // Stores data for runtime variables.
   ObservableRuntimeVars rtVarsData_;
 
@@ -225,6 +306,21 @@ class McrouterInstance {
    */
   std::unique_ptr<McrouterLogger> mcrouterLogger_;
 
+  /**
+   * Serves stats over HTTP if opts->metrics_port is set
+   */
+  std::unique_ptr<MetricsServer> metricsServer_;
+
+  /**
+   * Reports stalled proxies if opts->proxy_stall_threshold_ms is set
+   */
+  std::unique_ptr<ProxyStallWatchdog> stallWatchdog_;
+
+  /**
+   * Serves the debug tap if opts->debug_tap_socket is set
+   */
+  std::unique_ptr<DebugTapServer> debugTapServer_;
+
   /*
    * Asynchronous writer.
    */
@@ -232,10 +328,18 @@ class McrouterInstance {
 
   std::unique_ptr<AsyncWriter> statsLogWriter_;
 
+  std::unique_ptr<AsyncWriter> serviceInfoWriter_;
+
+  /* Shared by all proxies, see opts.traffic_capture_file */
+  std::shared_ptr<TrafficCaptureFile> trafficCaptureFile_;
+
   std::function<void(size_t, proxy_t*)> onDestroyProxy_;
 
   ShutdownLock shutdownLock_;
 
+  // Runs the periodic tasks of mcrouter, shared within the process.
+  std::shared_ptr<HousekeepingExecutor> housekeeping_;
+
   // Used to shedule periodic tasks for mcrouter.
   PeriodicTaskScheduler taskScheduler_;
 
@@ -282,8 +386,10 @@ class McrouterInstance {
 
   void subscribeToConfigUpdate();
 
-  static void* statUpdaterThreadRun(void* arg);
-  void spawnStatUpdaterThread();
+  void updateStatsWindow();
+  void startStatUpdater();
+  void startHostnameRefresher();
+  void startTkoLogFlusher();
   void spawnStatLoggerThread();
   void startObservingRuntimeVarsFile();
   void onClientDestroyed();
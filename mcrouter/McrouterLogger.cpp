@@ -13,20 +13,21 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <cmath>
 #include <string>
 
 #include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/path.hpp>
 
+#include <folly/Conv.h>
 #include <folly/DynamicConverter.h>
 #include <folly/json.h>
-#include <folly/ThreadName.h>
 
 #include "mcrouter/lib/fbi/asox_timer.h"
 #include "mcrouter/lib/fbi/cpp/util.h"
 #include "mcrouter/lib/fbi/debug.h"
 #include "mcrouter/McrouterInstance.h"
-#include "mcrouter/McrouterLogFailure.h"
+#include "mcrouter/SlowRequestLog.h"
 #include "mcrouter/stats.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
@@ -35,6 +36,8 @@ namespace {
 
 const char* kStatsSfx = "stats";
 const char* kStatsStartupOptionsSfx = "startup_options";
+const char* kHotKeysSfx = "hot_keys";
+const char* kSlowRequestsSfx = "slow_requests";
 const char* kConfigSourcesInfoFileName = "config_sources_info";
 
 bool ensure_dir_exists_and_writeable(const std::string& path) {
@@ -80,7 +83,7 @@ std::string stats_file_path(const McrouterOptions& opts,
  */
 void write_file(const McrouterOptions& opts,
                 const std::string& suffix,
-                const std::string& str) {
+                folly::StringPiece str) {
   try {
     // In case the dir was deleted some time after mcrouter started
     if (!ensure_dir_exists_and_writeable(opts.stats_root)) {
@@ -106,11 +109,78 @@ void write_stats_file(const McrouterOptions& opts,
   write_file(opts, suffix, statsString);
 }
 
+/**
+ * Writes a flat json object of numbers, formatted like toPrettyJson(),
+ * straight into a string. Saves building a folly::dynamic with thousands
+ * of keys every interval.
+ */
+class FlatJsonWriter {
+ public:
+  explicit FlatJsonWriter(folly::fbstring& out)
+      : out_(out) {
+    out_.clear();
+    out_.push_back('{');
+  }
+
+  template <class... Keys>
+  void add(uint64_t value, const Keys&... keys) {
+    addKey(keys...);
+    folly::toAppend(value, &out_);
+  }
+
+  template <class... Keys>
+  void add(int64_t value, const Keys&... keys) {
+    addKey(keys...);
+    folly::toAppend(value, &out_);
+  }
+
+  template <class... Keys>
+  void add(double value, const Keys&... keys) {
+    if (!std::isfinite(value)) {
+      /* Not representable in json */
+      return;
+    }
+    addKey(keys...);
+    folly::toAppend(value, &out_);
+  }
+
+  template <class... Keys>
+  void add(const folly::dynamic& value, const Keys&... keys) {
+    if (value.isInt()) {
+      add(static_cast<int64_t>(value.asInt()), keys...);
+    } else if (value.isDouble()) {
+      add(value.asDouble(), keys...);
+    }
+  }
+
+  folly::StringPiece finish() {
+    out_.append(empty_ ? "}\n" : "\n}\n");
+    return out_;
+  }
+
+ private:
+  folly::fbstring& out_;
+  bool empty_{true};
+  std::string key_;
+
+  template <class... Keys>
+  void addKey(const Keys&... keys) {
+    out_.append(empty_ ? "\n  " : ",\n  ");
+    empty_ = false;
+    key_.clear();
+    folly::toAppend(keys..., &key_);
+    folly::json::escapeString(key_, out_, folly::json::serialization_opts());
+    out_.append(" : ");
+  }
+};
+
 void write_stats_to_disk(const McrouterOptions& opts,
-                         const std::vector<stat_t>& stats) {
+                         const std::vector<stat_t>& stats,
+                         const folly::dynamic& histograms,
+                         folly::fbstring& buf) {
   try {
     std::string prefix = get_stats_key(opts) + ".";
-    folly::dynamic jstats = folly::dynamic::object;
+    FlatJsonWriter jstats(buf);
 
     for (size_t i = 0; i < stats.size(); ++i) {
       if (opts.logging_rtt_outlier_threshold_us == 0 &&
@@ -119,19 +189,17 @@ void write_stats_to_disk(const McrouterOptions& opts,
         continue;
       }
       if (stats[i].group & ods_stats) {
-        auto key = prefix + stats[i].name.str();
-
         switch (stats[i].type) {
           case stat_uint64:
-            jstats[key] = stats[i].data.uint64;
+            jstats.add(stats[i].data.uint64, prefix, stats[i].name);
             break;
 
           case stat_int64:
-            jstats[key] = stats[i].data.int64;
+            jstats.add(stats[i].data.int64, prefix, stats[i].name);
             break;
 
           case stat_double:
-            jstats[key] = stats[i].data.dbl;
+            jstats.add(stats[i].data.dbl, prefix, stats[i].name);
             break;
 
           default:
@@ -140,21 +208,52 @@ void write_stats_to_disk(const McrouterOptions& opts,
       }
     }
 
-    write_stats_file(opts, kStatsSfx, jstats);
+    // Per server histograms are only available via __mcrouter__.histograms,
+    // there are too many of them for the stats file.
+    for (const char* kind : {"routes", "pools"}) {
+      for (const auto& histogram : histograms[kind].items()) {
+        for (const auto& field : histogram.second.items()) {
+          jstats.add(field.second, prefix, "latency.", kind, ".",
+                     histogram.first.stringPiece(), ".",
+                     field.first.stringPiece());
+        }
+      }
+    }
+
+    write_file(opts, kStatsSfx, jstats.finish());
   } catch (...) {
     // Do nothing
   }
 }
 
-void write_config_sources_info_to_disk(McrouterInstance* router) {
+/**
+ * Writes json to the file with the given suffix, unless it's the same as
+ * lastWritten (the contents of the previous write).
+ */
+void write_file_if_changed(const McrouterOptions& opts,
+                           const std::string& suffix,
+                           const folly::dynamic& json,
+                           std::string& lastWritten) {
+  auto str = folly::toPrettyJson(json).toStdString() + "\n";
+  if (str != lastWritten) {
+    write_file(opts, suffix, str);
+    lastWritten = std::move(str);
+  }
+}
+
+void write_config_sources_info_to_disk(McrouterInstance* router,
+                                       std::string& lastWritten) {
   auto config_info_json = router->configApi().getConfigSourcesInfo();
 
   try {
+    auto str = folly::toPrettyJson(config_info_json).toStdString();
+    if (str == lastWritten) {
+      return;
+    }
     boost::filesystem::path path(router->opts().stats_root);
     path /= get_stats_key(router->opts()) + "." + kConfigSourcesInfoFileName;
-    atomicallyWriteFileToDisk(
-      folly::toPrettyJson(config_info_json).toStdString(),
-      path.string());
+    atomicallyWriteFileToDisk(str, path.string());
+    lastWritten = std::move(str);
   } catch (...) {
     LOG(ERROR) << "Error occured while writing configuration info to disk";
   }
@@ -166,7 +265,7 @@ McrouterLogger::McrouterLogger(McrouterInstance* router,
   std::unique_ptr<AdditionalLoggerIf> additionalLogger)
     : router_(router),
       additionalLogger_(std::move(additionalLogger)),
-      pid_(getpid()) {
+      slowRequestsDumpGeneration_(SlowRequestLog::dumpGeneration()) {
 }
 
 McrouterLogger::~McrouterLogger() {
@@ -191,17 +290,11 @@ bool McrouterLogger::start() {
   }
 
   running_ = true;
-  const std::string threadName = "mcrtr-stats-logger";
-  try {
-    loggerThread_ = std::thread(
-        std::bind(&McrouterLogger::loggerThreadRun, this));
-    folly::setThreadName(loggerThread_.native_handle(), threadName);
-  } catch (const std::system_error& e) {
-    running_ = false;
-    logFailure(router_, memcache::failure::Category::kSystemError,
-               "Can not start McrouterLogger thread {}: {}",
-               threadName, e.what());
-  }
+  startupOptionsLogged_ = false;
+  loggerTask_ = router_->housekeeping().schedule(
+    std::chrono::milliseconds(router_->opts().stats_logging_interval),
+    [this]() { loggerTaskRun(); },
+    std::chrono::milliseconds(0));
 
   return running_;
 }
@@ -212,36 +305,23 @@ void McrouterLogger::stop() {
   }
 
   running_ = false;
-  loggerThreadCv_.notify_all();
-  if (loggerThread_.joinable()) {
-    if (getpid() == pid_) {
-      loggerThread_.join();
-    } else {
-      loggerThread_.detach();
-    }
-  }
+  /* Waits for a running log(), except in a forked child */
+  router_->housekeeping().cancel(loggerTask_);
+  loggerTask_ = 0;
 }
 
 bool McrouterLogger::running() const {
   return running_;
 }
 
-void McrouterLogger::loggerThreadRun() {
-  logStartupOptions();
-  loggerThreadSleep();
-
-  while (running_) {
-    log();
-    loggerThreadSleep();
+void McrouterLogger::loggerTaskRun() {
+  /* Startup options right away, then stats every interval */
+  if (!startupOptionsLogged_) {
+    logStartupOptions();
+    startupOptionsLogged_ = true;
+    return;
   }
-}
-
-void McrouterLogger::loggerThreadSleep() {
-  std::unique_lock<std::mutex> lock(loggerThreadMutex_);
-  loggerThreadCv_.wait_for(
-    lock,
-    std::chrono::milliseconds(router_->opts().stats_logging_interval),
-    [this]() { return !running_; });
+  log();
 }
 
 void McrouterLogger::logStartupOptions() {
@@ -251,12 +331,23 @@ void McrouterLogger::logStartupOptions() {
 }
 
 void McrouterLogger::log() {
-  std::vector<stat_t> stats(num_stats);
+  auto& stats = stats_;
+  stats.resize(num_stats);
+  folly::dynamic histograms = folly::dynamic::object;
+  folly::dynamic hotKeys = {};
+  folly::dynamic slowRequests = nullptr;
+  auto dumpGeneration = SlowRequestLog::dumpGeneration();
+  bool dumpSlowRequests = dumpGeneration != slowRequestsDumpGeneration_;
   try {
     router_->startupLock().wait();
     std::lock_guard<ShutdownLock> lg(router_->shutdownLock());
 
     prepare_stats(router_, stats.data());
+    histograms = latency_histograms(router_);
+    hotKeys = hot_keys(router_);
+    if (dumpSlowRequests) {
+      slowRequests = slow_requests(router_);
+    }
   } catch (const shutdown_started_exception& e) {
     return;
   }
@@ -268,8 +359,18 @@ void McrouterLogger::log() {
     }
   }
 
-  write_stats_to_disk(router_->opts(), stats);
-  write_config_sources_info_to_disk(router_);
+  write_stats_to_disk(router_->opts(), stats, histograms, statsBuf_);
+  // Keys are arbitrary strings, so they go to a file of their own
+  // rather than the flat stats file.
+  if (router_->opts().hot_keys_sample_period != 0) {
+    write_file_if_changed(router_->opts(), kHotKeysSfx, hotKeys,
+                          lastHotKeys_);
+  }
+  write_config_sources_info_to_disk(router_, lastConfigSourcesInfo_);
+  if (dumpSlowRequests) {
+    write_stats_file(router_->opts(), kSlowRequestsSfx, slowRequests);
+    slowRequestsDumpGeneration_ = dumpGeneration;
+  }
 
   for (const auto& filepath : touchStatsFilepaths_) {
     touchFile(filepath);
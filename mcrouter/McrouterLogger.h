@@ -10,22 +10,27 @@
 #pragma once
 
 #include <atomic>
-#include <condition_variable>
 #include <memory>
-#include <mutex>
 #include <string>
-#include <thread>
 #include <vector>
 
+#include <folly/FBString.h>
+
+#include "mcrouter/HousekeepingExecutor.h"
+#include "mcrouter/stats.h"
+
 namespace facebook { namespace memcache { namespace mcrouter {
 
 class McrouterInstance;
-class stat_t;
 
 class AdditionalLoggerIf {
 public:
   virtual ~AdditionalLoggerIf() {}
 
+  /**
+   * @param stats  aggregated stats, only valid during the call
+   *               (the buffer is reused for the next interval)
+   */
   virtual void log(const std::vector<stat_t>& stats) = 0;
 };
 
@@ -45,21 +50,21 @@ class McrouterLogger {
   ~McrouterLogger();
 
   /**
-   * Starts the logger thread.
+   * Starts logging, on the router's housekeeping executor.
    *
-   * @return True if logger thread was successfully started, false otherwise.
+   * @return True if logging was successfully started, false otherwise.
    */
   bool start();
 
   /**
-   * Tells whether the logger thread is running.
+   * Tells whether the logger is running.
    *
-   * @return True if logger thread is running, false otherwise.
+   * @return True if logger is running, false otherwise.
    */
   bool running() const;
 
   /**
-   * Stops the logger thread and join it.
+   * Stops logging, waiting for a log in progress.
    * Note: this is a blocking call.
    */
   void stop();
@@ -74,13 +79,19 @@ class McrouterLogger {
    */
   std::vector<std::string> touchStatsFilepaths_;
 
-  pid_t pid_;
-  std::thread loggerThread_;
-  std::mutex loggerThreadMutex_;
-  std::condition_variable loggerThreadCv_;
+  /* Reused across intervals, see log() */
+  std::vector<stat_t> stats_;
+  folly::fbstring statsBuf_;
+  /* Files rewritten only when their contents change */
+  std::string lastHotKeys_;
+  std::string lastConfigSourcesInfo_;
+  /* SlowRequestLog::dumpGeneration() of the last slow requests dump */
+  uint64_t slowRequestsDumpGeneration_;
+
+  HousekeepingExecutor::TaskId loggerTask_{0};
+  bool startupOptionsLogged_{false};
   std::atomic<bool> running_{false};
-  void loggerThreadRun();
-  void loggerThreadSleep();
+  void loggerTaskRun();
 
   /**
    * Writes router's logs.
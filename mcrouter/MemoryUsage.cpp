@@ -0,0 +1,98 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "MemoryUsage.h"
+
+#include <folly/dynamic.h>
+
+#include "mcrouter/async.h"
+#include "mcrouter/lib/network/McServerMemoryTracker.h"
+#include "mcrouter/McrouterInstance.h"
+#include "mcrouter/proxy.h"
+#include "mcrouter/ProxyDestination.h"
+#include "mcrouter/ProxyDestinationMap.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+folly::dynamic ownerToDynamic(const MemoryUsage::Owner& owner) {
+  return folly::dynamic::object
+    ("bytes", static_cast<int64_t>(owner.bytes))
+    ("objects", static_cast<int64_t>(owner.objects));
+}
+
+}  // anonymous namespace
+
+MemoryCounter& routeHandleMemory() {
+  /* Leaked: route handles may be destroyed during static destruction */
+  static auto counter = new MemoryCounter();
+  return *counter;
+}
+
+MemoryCounter& routingTableMemory() {
+  static auto counter = new MemoryCounter();
+  return *counter;
+}
+
+MemoryUsage MemoryUsage::collect(McrouterInstance& router) {
+  MemoryUsage usage;
+  usage.routeHandles.bytes = routeHandleMemory().bytes();
+  usage.routeHandles.objects = routeHandleMemory().objects();
+  usage.routingTables.bytes = routingTableMemory().bytes();
+  usage.routingTables.objects = routingTableMemory().objects();
+  usage.serverBuffers.bytes = McServerMemoryTracker::processBytes();
+  usage.asynclogQueue.objects = router.asyncWriter().queueSize();
+
+  for (size_t i = 0; i < router.opts().num_proxies; ++i) {
+    auto proxy = router.getProxy(i);
+    proxy->destinationMap->foreachDestinationSynced(
+      [&usage](const ProxyDestination& destination) {
+        usage.destinations.bytes += destination.getObjectBytes();
+        ++usage.destinations.objects;
+        usage.clientBuffers.bytes += destination.getBufferedBytes();
+        usage.clientBuffers.objects += destination.getPendingRequestCount() +
+                                       destination.getInflightRequestCount();
+      }
+    );
+
+    auto fibers = proxy->fiberManager.fibersAllocated();
+    usage.fiberStacks.bytes += fibers * proxy->opts.fibers_stack_size;
+    usage.fiberStacks.objects += fibers;
+
+    usage.asynclogQueue.bytes +=
+      proxy->async_batch.pendingBytes.load(std::memory_order_relaxed);
+
+    usage.waitingRequests.bytes += proxy->waitingRequestBytes();
+    usage.waitingRequests.objects +=
+      proxy->stats[proxy_reqs_waiting_stat].data.uint64;
+  }
+  return usage;
+}
+
+size_t MemoryUsage::totalBytes() const {
+  return routeHandles.bytes + routingTables.bytes + destinations.bytes +
+         clientBuffers.bytes + serverBuffers.bytes + fiberStacks.bytes +
+         asynclogQueue.bytes + waitingRequests.bytes;
+}
+
+folly::dynamic MemoryUsage::toDynamic() const {
+  return folly::dynamic::object
+    ("total_bytes", static_cast<int64_t>(totalBytes()))
+    ("route_handles", ownerToDynamic(routeHandles))
+    ("routing_tables", ownerToDynamic(routingTables))
+    ("destinations", ownerToDynamic(destinations))
+    ("client_buffers", ownerToDynamic(clientBuffers))
+    ("server_buffers", ownerToDynamic(serverBuffers))
+    ("fiber_stacks", ownerToDynamic(fiberStacks))
+    ("asynclog_queue", ownerToDynamic(asynclogQueue))
+    ("waiting_requests", ownerToDynamic(waitingRequests));
+}
+
+}}}  // facebook::memcache::mcrouter
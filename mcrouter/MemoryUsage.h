@@ -0,0 +1,107 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+namespace folly {
+class dynamic;
+}
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+class McrouterInstance;
+
+/**
+ * Bytes held by some kind of long lived objects, process wide. The objects
+ * count themselves in when built and out when destroyed, so reading is free.
+ * Thread safe.
+ */
+class MemoryCounter {
+ public:
+  void add(size_t bytes) noexcept {
+    bytes_.fetch_add(bytes, std::memory_order_relaxed);
+    objects_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void remove(size_t bytes) noexcept {
+    bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+    objects_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  size_t bytes() const noexcept {
+    return bytes_.load(std::memory_order_relaxed);
+  }
+
+  size_t objects() const noexcept {
+    return objects_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<size_t> bytes_{0};
+  std::atomic<size_t> objects_{0};
+};
+
+/* Route handles of all configs, by object size (see McrouterRouteHandle) */
+MemoryCounter& routeHandleMemory();
+
+/* Prefix tries of all configs (see PrefixRouteSelector, RoutePolicyMap) */
+MemoryCounter& routingTableMemory();
+
+/**
+ * Memory held by the major owners in an mcrouter instance, see
+ * __mcrouter__.memory. Sizes come from counters and object sizes, not from
+ * the allocator: they leave out allocator overhead and memory that owners
+ * reference but don't track (e.g. strings inside routes), so they don't add
+ * up to RSS. They are meant for attributing growth, not for exact totals.
+ */
+struct MemoryUsage {
+  struct Owner {
+    size_t bytes{0};
+    /* Number of objects holding the bytes, 0 if not tracked */
+    size_t objects{0};
+  };
+
+  /* Route handle objects of all proxies' configs */
+  Owner routeHandles;
+  /* Routing prefix and key prefix tries of all configs */
+  Owner routingTables;
+  /* ProxyDestinations and the clients of their connections */
+  Owner destinations;
+  /* Read buffers and unwritten requests of destination connections,
+     objects are requests queued or in flight */
+  Owner clientBuffers;
+  /* Request values and replies buffered by server sessions
+     (see McServerMemoryTracker), 0 when not running as a server */
+  Owner serverBuffers;
+  /* Fiber stacks reserved by proxies' fiber managers */
+  Owner fiberStacks;
+  /* Asynclog lines batched but not written yet,
+     objects are requests queued to the awriter thread */
+  Owner asynclogQueue;
+  /* Requests throttled by proxies (proxy_t::waitingRequests_) */
+  Owner waitingRequests;
+
+  /**
+   * Reads all counters. Must be called while proxies are alive
+   * (e.g. under the router's shutdown lock).
+   */
+  static MemoryUsage collect(McrouterInstance& router);
+
+  size_t totalBytes() const;
+
+  /**
+   * {"total_bytes": ..., <owner>: {"bytes": ..., "objects": ...}, ...}
+   */
+  folly::dynamic toDynamic() const;
+};
+
+}}}  // facebook::memcache::mcrouter
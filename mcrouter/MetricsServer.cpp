@@ -0,0 +1,401 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "MetricsServer.h"
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include <folly/Conv.h>
+#include <folly/dynamic.h>
+#include <folly/ThreadName.h>
+
+#include "mcrouter/McrouterInstance.h"
+#include "mcrouter/McrouterLogFailure.h"
+#include "mcrouter/proxy.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+const char* kMetricPrefix = "mcrouter_";
+const char* kContentType =
+  "application/openmetrics-text; version=1.0.0; charset=utf-8";
+/* Scrapers are expected to be quick, don't let one hold up the thread */
+const int kSocketTimeoutMs = 1000;
+
+void appendLabelValue(std::string& out, folly::StringPiece value) {
+  out.push_back('"');
+  for (char c : value) {
+    switch (c) {
+      case '\\':
+        out.append("\\\\");
+        break;
+      case '"':
+        out.append("\\\"");
+        break;
+      case '\n':
+        out.append("\\n");
+        break;
+      default:
+        out.push_back(c);
+    }
+  }
+  out.push_back('"');
+}
+
+void appendValue(std::string& out, const folly::dynamic& value) {
+  if (value.isInt()) {
+    folly::toAppend(value.asInt(), &out);
+  } else if (value.isDouble() && std::isfinite(value.asDouble())) {
+    folly::toAppend(value.asDouble(), &out);
+  } else {
+    out.push_back('0');
+  }
+}
+
+void appendType(std::string& out, folly::StringPiece name,
+                folly::StringPiece type) {
+  folly::toAppend("# TYPE ", kMetricPrefix, name, ' ', type, '\n', &out);
+}
+
+void appendStats(std::string& out, const std::vector<stat_t>& stats) {
+  for (const auto& stat : stats) {
+    if (!(stat.group & ods_stats)) {
+      continue;
+    }
+    if (stat.group & rate_stats) {
+      /* Totals: rates are for the scraper to compute */
+      appendType(out, stat.name, "counter");
+      folly::toAppend(kMetricPrefix, stat.name, "_total ", stat.data.uint64,
+                      '\n', &out);
+      continue;
+    }
+    switch (stat.type) {
+      case stat_uint64:
+        appendType(out, stat.name, "gauge");
+        folly::toAppend(kMetricPrefix, stat.name, ' ', stat.data.uint64, '\n',
+                        &out);
+        break;
+      case stat_int64:
+        appendType(out, stat.name, "gauge");
+        folly::toAppend(kMetricPrefix, stat.name, ' ', stat.data.int64, '\n',
+                        &out);
+        break;
+      case stat_double:
+        if (std::isfinite(stat.data.dbl)) {
+          appendType(out, stat.name, "gauge");
+          folly::toAppend(kMetricPrefix, stat.name, ' ', stat.data.dbl, '\n',
+                          &out);
+        }
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+/**
+ * Histograms of LatencyHistogram::toDynamic() as a summary family,
+ * labelled by label => histogram name.
+ */
+void appendLatencies(std::string& out, folly::StringPiece name,
+                     folly::StringPiece label,
+                     const folly::dynamic& histograms) {
+  static const std::pair<const char*, const char*> kQuantiles[] = {
+    {"p50", "0.5"},
+    {"p90", "0.9"},
+    {"p99", "0.99"},
+    {"p999", "0.999"},
+  };
+
+  if (histograms.empty()) {
+    return;
+  }
+  appendType(out, name, "summary");
+  for (const auto& it : histograms.items()) {
+    const auto& histogram = it.second;
+    auto appendLabels = [&out, &label, &it](const char* quantile) {
+      folly::toAppend('{', label, '=', &out);
+      appendLabelValue(out, it.first.stringPiece());
+      if (quantile) {
+        folly::toAppend(",quantile=\"", quantile, '"', &out);
+      }
+      out.append("} ");
+    };
+    for (const auto& q : kQuantiles) {
+      folly::toAppend(kMetricPrefix, name, &out);
+      appendLabels(q.second);
+      appendValue(out, histogram[q.first]);
+      out.push_back('\n');
+    }
+    auto count = histogram["count"].asInt();
+    folly::toAppend(kMetricPrefix, name, "_count", &out);
+    appendLabels(nullptr);
+    folly::toAppend(count, '\n', &out);
+    folly::toAppend(kMetricPrefix, name, "_sum", &out);
+    appendLabels(nullptr);
+    appendValue(out, histogram["mean"].asDouble() * count);
+    out.push_back('\n');
+  }
+}
+
+void appendDestinations(std::string& out, const folly::dynamic& destinations) {
+  static const std::pair<const char*, const char*> kGauges[] = {
+    {"pending_reqs", "destination_pending_requests"},
+    {"inflight_reqs", "destination_inflight_requests"},
+    {"avg_batch_size", "destination_batch_size"},
+    {"avg_write_cork_us", "destination_write_cork_us"},
+    {"avg_latency_us", "destination_latency_us"},
+  };
+
+  if (destinations.empty()) {
+    return;
+  }
+  auto appendLabels = [&out](const folly::dynamic::const_item_iterator& it) {
+    out.append("{destination=");
+    appendLabelValue(out, it->first.stringPiece());
+    out.append(",pool=");
+    appendLabelValue(out, it->second["pool"].stringPiece());
+    out.append("} ");
+  };
+  for (const auto& gauge : kGauges) {
+    appendType(out, gauge.second, "gauge");
+    for (auto it = destinations.items().begin();
+         it != destinations.items().end(); ++it) {
+      folly::toAppend(kMetricPrefix, gauge.second, &out);
+      appendLabels(it);
+      appendValue(out, it->second[gauge.first]);
+      out.push_back('\n');
+    }
+  }
+  /* 0: none, 1: soft, 2: hard TKO */
+  appendType(out, "destination_tko", "gauge");
+  for (auto it = destinations.items().begin();
+       it != destinations.items().end(); ++it) {
+    folly::toAppend(kMetricPrefix, "destination_tko", &out);
+    appendLabels(it);
+    auto tko = it->second["tko"].stringPiece();
+    out.append(tko == "hard" ? "2\n" : tko == "soft" ? "1\n" : "0\n");
+  }
+}
+
+bool writeAll(int fd, folly::StringPiece data) {
+  while (!data.empty()) {
+    auto n = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+    if (n <= 0) {
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data.advance(n);
+  }
+  return true;
+}
+
+int bindListenSocket(uint16_t port) {
+  int fd = ::socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  int on = 1;
+  ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+  struct sockaddr_in6 addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin6_family = AF_INET6;
+  addr.sin6_addr = in6addr_any;
+  addr.sin6_port = htons(port);
+  if (::bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) ||
+      ::listen(fd, SOMAXCONN)) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+}  // anonymous namespace
+
+MetricsServer::MetricsServer(McrouterInstance* router)
+    : router_(router),
+      pid_(getpid()) {
+}
+
+MetricsServer::~MetricsServer() {
+  stop();
+}
+
+bool MetricsServer::start() {
+  const auto& opts = router_->opts();
+  if (running_ || opts.metrics_port <= 0) {
+    return false;
+  }
+
+  listenFd_ = bindListenSocket(opts.metrics_port);
+  if (listenFd_ < 0) {
+    logFailure(router_, memcache::failure::Category::kSystemError,
+               "Can not listen on metrics port {}: {}",
+               opts.metrics_port, strerror(errno));
+    return false;
+  }
+  wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  running_ = true;
+  const std::string threadName = "mcrtr-metrics";
+  try {
+    thread_ = std::thread([this]() { run(); });
+    folly::setThreadName(thread_.native_handle(), threadName);
+  } catch (const std::system_error& e) {
+    running_ = false;
+    logFailure(router_, memcache::failure::Category::kSystemError,
+               "Can not start MetricsServer thread {}: {}",
+               threadName, e.what());
+  }
+
+  return running_;
+}
+
+void MetricsServer::stop() {
+  if (running_) {
+    running_ = false;
+    uint64_t one = 1;
+    auto rc = ::write(wakeFd_, &one, sizeof(one));
+    (void)rc;
+    if (thread_.joinable()) {
+      if (getpid() == pid_) {
+        thread_.join();
+      } else {
+        thread_.detach();
+      }
+    }
+  }
+  if (listenFd_ >= 0) {
+    ::close(listenFd_);
+    listenFd_ = -1;
+  }
+  if (wakeFd_ >= 0) {
+    ::close(wakeFd_);
+    wakeFd_ = -1;
+  }
+}
+
+void MetricsServer::run() {
+  using Clock = std::chrono::steady_clock;
+  std::chrono::milliseconds interval(
+    std::max(1u, router_->opts().metrics_render_interval_ms));
+  /* Nothing to serve until the first render */
+  current_ = "# EOF\n";
+  auto nextRender = Clock::now();
+
+  while (running_) {
+    auto now = Clock::now();
+    if (now >= nextRender) {
+      if (render(next_)) {
+        current_.swap(next_);
+      }
+      nextRender = now + interval;
+    }
+
+    struct pollfd fds[2];
+    fds[0].fd = listenFd_;
+    fds[0].events = POLLIN;
+    fds[1].fd = wakeFd_;
+    fds[1].events = POLLIN;
+    auto timeoutMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+      nextRender - Clock::now()).count();
+    auto rc = ::poll(fds, 2, std::max<int64_t>(timeoutMs, 0));
+    if (rc > 0 && (fds[0].revents & POLLIN) && running_) {
+      int fd = ::accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+      if (fd >= 0) {
+        serve(fd);
+        ::close(fd);
+      }
+    }
+  }
+}
+
+bool MetricsServer::render(std::string& out) {
+  stats_.resize(num_stats);
+  folly::dynamic histograms = folly::dynamic::object;
+  folly::dynamic dests = folly::dynamic::object;
+  try {
+    router_->startupLock().wait();
+    std::lock_guard<ShutdownLock> lg(router_->shutdownLock());
+
+    prepare_stats(router_, stats_.data());
+    /* prepare_stats() leaves rate stats to be computed from windows,
+       we export the raw totals instead */
+    for (int i = 0; i < num_stats; ++i) {
+      if (stats_[i].group & rate_stats) {
+        for (size_t j = 0; j < router_->opts().num_proxies; ++j) {
+          stats_[i].data.uint64 += __atomic_load_n(
+            &router_->getProxy(j)->stats[i].data.uint64, __ATOMIC_RELAXED);
+        }
+      }
+    }
+    histograms = latency_histograms(router_);
+    dests = destinations(router_);
+  } catch (const shutdown_started_exception& e) {
+    return false;
+  }
+
+  out.clear();
+  appendStats(out, stats_);
+  appendLatencies(out, "route_latency_us", "route",
+                  histograms["routes"]);
+  appendLatencies(out, "pool_latency_us", "pool", histograms["pools"]);
+  appendDestinations(out, dests);
+  out.append("# EOF\n");
+  return true;
+}
+
+void MetricsServer::serve(int fd) {
+  struct timeval tv;
+  tv.tv_sec = kSocketTimeoutMs / 1000;
+  tv.tv_usec = (kSocketTimeoutMs % 1000) * 1000;
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+  /* Any request gets the metrics, we only wait for the request line and
+     headers so that the client doesn't see a reset */
+  char buf[4096];
+  size_t len = 0;
+  while (len < sizeof(buf)) {
+    auto n = ::recv(fd, buf + len, sizeof(buf) - len, 0);
+    if (n <= 0) {
+      return;
+    }
+    len += n;
+    if (folly::StringPiece(buf, len).find("\r\n\r\n") != std::string::npos) {
+      break;
+    }
+  }
+
+  auto header = folly::to<std::string>(
+    "HTTP/1.0 200 OK\r\n"
+    "Content-Type: ", kContentType, "\r\n"
+    "Content-Length: ", current_.size(), "\r\n"
+    "Connection: close\r\n\r\n");
+  if (writeAll(fd, header)) {
+    writeAll(fd, current_);
+  }
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,85 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mcrouter/stats.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+class McrouterInstance;
+
+/**
+ * Serves router stats in the OpenMetrics text format over HTTP on
+ * opts.metrics_port, from a thread of its own.
+ *
+ * The text is rendered once every opts.metrics_render_interval_ms from the
+ * same lock-free reads as the stats file (see McrouterLogger): aggregated
+ * stats, route and pool latency histograms and per destination gauges.
+ * Scrapes only copy the last rendered buffer to the socket, so they never
+ * touch proxies, however often they come.
+ */
+class MetricsServer {
+ public:
+  explicit MetricsServer(McrouterInstance* router);
+
+  ~MetricsServer();
+
+  /**
+   * Binds the port and starts the server thread.
+   *
+   * @return True if the server is running, false if opts.metrics_port
+   *         is not set or the port couldn't be bound.
+   */
+  bool start();
+
+  /**
+   * Stops the server thread and joins it.
+   */
+  void stop();
+
+ private:
+  McrouterInstance* router_;
+  int listenFd_{-1};
+  /* Wakes up the server thread on stop() */
+  int wakeFd_{-1};
+  std::thread thread_;
+  std::atomic<bool> running_{false};
+  pid_t pid_;
+
+  /* Double buffer: scrapes are served from current_, next_ is rendered
+     into and swapped in, so buffers are reused. */
+  std::string current_;
+  std::string next_;
+  std::vector<stat_t> stats_;
+
+  void run();
+
+  /**
+   * Renders router's stats as OpenMetrics text into out (cleared first).
+   *
+   * @return False if the router is shutting down, out is unspecified then.
+   */
+  bool render(std::string& out);
+
+  /* Answers one scrape on the accepted connection fd */
+  void serve(int fd);
+
+  MetricsServer(const MetricsServer&) = delete;
+  MetricsServer& operator=(const MetricsServer&) = delete;
+};
+
+}}}  // facebook::memcache::mcrouter
@@ -9,61 +9,59 @@
  */
 #include "PeriodicTaskScheduler.h"
 
-#include <folly/Memory.h>
-#include <folly/ThreadName.h>
-
-#include "mcrouter/lib/fbi/debug.h"
+#include <stdexcept>
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
-PeriodicTaskScheduler::TaskThread::TaskThread(
-    PeriodicTaskScheduler& scheduler,
-    int32_t timeoutMs,
-    std::function<void(PeriodicTaskScheduler&)> fn)
-  :  tmoMs(timeoutMs),
-     func(std::move(fn)),
-     t{[this, &scheduler] () {
-       folly::setThreadName("mcrtr-periodic");
-       scheduler.schedulerThreadRun(*this);
-      }} {}
+PeriodicTaskScheduler::PeriodicTaskScheduler(
+    std::shared_ptr<HousekeepingExecutor> executor)
+  : executor_(executor ? std::move(executor) :
+              HousekeepingExecutor::get(HousekeepingExecutor::Options())),
+    shutdown_(false) {}
+
+PeriodicTaskScheduler::~PeriodicTaskScheduler() {
+  if (!shutdown_.exchange(true)) {
+    cv_.notify_all();
+    cancelAllTasks();
+  }
+}
 
 void PeriodicTaskScheduler::scheduleTask(
     int32_t tmoMs,
     std::function<void(PeriodicTaskScheduler&)> func) {
-  tasks_.push_back(
-      folly::make_unique<TaskThread>(*this, tmoMs, std::move(func)));
+  auto id = executor_->schedule(
+    std::chrono::milliseconds(tmoMs),
+    [this, func]() {
+      if (!shutdown_) {
+        func(*this);
+      }
+    });
+  std::lock_guard<std::mutex> lg(tasksLock_);
+  tasks_.push_back(id);
 }
 
-PeriodicTaskScheduler::PeriodicTaskScheduler()
-  : shutdown_(false) {}
-
 void PeriodicTaskScheduler::shutdownAllTasks() {
   if (shutdown_.exchange(true)) {
     throw std::runtime_error("Received a second call on shutdownAllTasks.");
   }
   cv_.notify_all();
-  for (auto& task: tasks_) {
-    task->t.join();
-  }
+  cancelAllTasks();
 }
 
 void PeriodicTaskScheduler::forkWorkAround() {
-  for (auto& task: tasks_) {
-    task->t.detach();
-  }
+  shutdown_ = true;
+  /* cancel() doesn't wait in a forked child */
+  cancelAllTasks();
 }
 
-void PeriodicTaskScheduler::schedulerThreadRun(TaskThread& task) {
-  while (sleepThread(task.tmoMs)) {
-    try {
-      task.func(*this);
-    } catch (const std::exception& ex) {
-      LOG(ERROR) << "Error while executing periodic function: " << ex.what();
-      break;
-    } catch (...) {
-      LOG(ERROR) << "Unknown error occured while executing periodic function";
-      break;
-    }
+void PeriodicTaskScheduler::cancelAllTasks() {
+  std::vector<HousekeepingExecutor::TaskId> tasks;
+  {
+    std::lock_guard<std::mutex> lg(tasksLock_);
+    tasks.swap(tasks_);
+  }
+  for (auto id : tasks) {
+    executor_->cancel(id);
   }
 }
 
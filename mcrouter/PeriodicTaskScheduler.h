@@ -13,20 +13,29 @@
 #include <condition_variable>
 #include <memory>
 #include <mutex>
-#include <thread>
 #include <vector>
 
+#include "mcrouter/HousekeepingExecutor.h"
+
 namespace facebook { namespace memcache { namespace mcrouter {
 
-/* Class to shedule periodic tasks. */
+/* Class to shedule periodic tasks, on a HousekeepingExecutor. */
 class PeriodicTaskScheduler {
  public:
-  PeriodicTaskScheduler();
+  /**
+   * @param executor  runs the tasks; nullptr means the process' shared one
+   *                  (with default options).
+   */
+  explicit PeriodicTaskScheduler(
+    std::shared_ptr<HousekeepingExecutor> executor = nullptr);
+
+  /* Cancels the tasks, if shutdownAllTasks() wasn't called */
+  ~PeriodicTaskScheduler();
 
   /**
-   * Creates a new thread that will run the func every tmo_ms miliseconds.
+   * Schedules func to run every tmo_ms miliseconds on the executor.
    * The scheduler first waits for tmo_ms miliseconds and then runs the
-   * function for the first time.
+   * function for the first time. A func that throws isn't run anymore.
    *
    * @param tmo_ms freq in milliseconds with which to run the function.
    * @param func the function to execute periodically.
@@ -35,17 +44,16 @@ class PeriodicTaskScheduler {
                     std::function<void(PeriodicTaskScheduler&)> func);
 
   /**
-   * Notifies all threads to shutdown and joins them.
-   * Can only be called once. Upon exit all threads are guaranteed
-   * to have been shutdown. Throws if called more than once.
+   * Interrupts sleepThread() calls and cancels all tasks.
+   * Can only be called once. Upon exit no task is running and none will
+   * run anymore. Throws if called more than once.
    */
   void shutdownAllTasks();
 
   /**
-   * Detaches all the threads.
-   * Called from the child of the forked process. The threads don't exist
-   * anymore, but std::thread's destructor will throw unless we pretend
-   * they were detached. This is broken and wrong,
+   * Drops all the tasks without waiting for them.
+   * Called from the child of the forked process, where the executor's
+   * threads don't exist anymore. This is broken and wrong,
    * but so is forking() a multithreaded process.
    */
   void forkWorkAround();
@@ -58,18 +66,14 @@ class PeriodicTaskScheduler {
    */
   bool sleepThread(int32_t tmoMs);
  private:
-  struct TaskThread {
-    TaskThread(PeriodicTaskScheduler& scheduler, int32_t timeoutMs,
-               std::function<void(PeriodicTaskScheduler&)> fn);
-    int32_t tmoMs;
-    std::function<void(PeriodicTaskScheduler&)> func;
-    std::thread t;
-  };
+  std::shared_ptr<HousekeepingExecutor> executor_;
   std::mutex cvMutex_;
   std::condition_variable cv_;
   std::atomic_bool shutdown_;
-  std::vector<std::unique_ptr<TaskThread>> tasks_;
-  void schedulerThreadRun(TaskThread& task);
+  std::mutex tasksLock_;
+  std::vector<HousekeepingExecutor::TaskId> tasks_;
+
+  void cancelAllTasks();
 };
 
 }}} // namespace
@@ -40,6 +40,8 @@ mc_protocol_t parseProtocol(const folly::dynamic& obj, mc_protocol_t def) {
       return mc_ascii_protocol;
     } else if (equalStr("umbrella", str, folly::asciiCaseInsensitive)) {
       return mc_umbrella_protocol;
+    } else if (equalStr("meta", str, folly::asciiCaseInsensitive)) {
+      return mc_meta_protocol;
     } else {
       logFailure(memcache::failure::Category::kInvalidConfig,
                  "Unknown protocol '{}'", str);
@@ -52,10 +54,15 @@ mc_protocol_t parseProtocol(const folly::dynamic& obj, mc_protocol_t def) {
 
 PoolFactory::PoolFactory(const folly::dynamic& config,
                          ConfigApi& configApi,
-                         const McrouterOptions& opts)
+                         const McrouterOptions& opts,
+                         const PoolFactory* previous)
   : configApi_(configApi),
     opts_(opts) {
 
+  if (previous) {
+    previousPools_ = previous->pools_;
+  }
+
   checkLogic(config.isObject(), "config is not an object");
   if (auto jpools = config.get_ptr("pools")) {
     checkLogic(jpools->isObject(), "config: 'pools' is not an object");
@@ -68,6 +75,7 @@ PoolFactory::PoolFactory(const folly::dynamic& config,
 
 std::shared_ptr<ClientPool>
 PoolFactory::parsePool(const folly::dynamic& json) {
+  std::lock_guard<std::mutex> lg(lock_);
   checkLogic(json.isString() || json.isObject(),
              "Pool should be a string (name of pool) or an object");
   if (json.isString()) {
@@ -83,7 +91,7 @@ std::shared_ptr<ClientPool>
 PoolFactory::parsePool(const std::string& name, const folly::dynamic& json) {
   auto seenPoolIt = pools_.find(name);
   if (seenPoolIt != pools_.end()) {
-    return seenPoolIt->second;
+    return seenPoolIt->second.pool;
   }
 
   if (json.isString()) {
@@ -110,6 +118,16 @@ PoolFactory::parsePool(const std::string& name, const folly::dynamic& json) {
     }
   }
 
+  auto prevIt = previousPools_.find(name);
+  if (prevIt != previousPools_.end() && *prevIt->second.json == json) {
+    auto parsed = prevIt->second;
+    const auto& clients = parsed.pool->getClients();
+    clients_.insert(clients_.end(), clients.begin(), clients.end());
+    pools_.emplace(name, parsed);
+    ++reusedPools_;
+    return parsed.pool;
+  }
+
   // pool_locality
   std::chrono::milliseconds timeout{opts_.server_timeout_ms};
   if (auto jlocality = json.get_ptr("pool_locality")) {
@@ -207,7 +225,8 @@ PoolFactory::parsePool(const std::string& name, const folly::dynamic& json) {
   auto jservers = json.get_ptr("servers");
   checkLogic(jservers, "Pool {}: servers not found", name);
   checkLogic(jservers->isArray(), "Pool {}: servers is not an array", name);
-  auto clientPool = std::make_shared<ClientPool>(name);
+  auto clientPool = std::make_shared<ClientPool>(name, timeout,
+                                                 keep_routing_prefix);
   for (size_t i = 0; i < jservers->size(); ++i) {
     const auto& server = jservers->at(i);
     AccessPoint ap;
@@ -247,11 +266,10 @@ PoolFactory::parsePool(const std::string& name, const folly::dynamic& json) {
     }
 
     auto client = clientPool->emplaceClient(
-      timeout,
       std::move(ap),
-      keep_routing_prefix,
       serverUseSsl,
-      serverQos);
+      serverQos,
+      /* includeTimeoutInKey= */ !opts_.same_connection_any_timeout);
 
     clients_.push_back(std::move(client));
   } // servers
@@ -260,8 +278,16 @@ PoolFactory::parsePool(const std::string& name, const folly::dynamic& json) {
   if (auto jweights = json.get_ptr("weights")) {
     clientPool->setWeights(*jweights);
   }
+  if (auto jvar = json.get_ptr("weights_runtime_var")) {
+    checkLogic(jvar->isString(), "Pool {}: weights_runtime_var is not string",
+               name);
+    checkLogic(clientPool->getWeights() != nullptr,
+               "Pool {}: weights_runtime_var without weights", name);
+    clientPool->setWeightsRuntimeVar(jvar->stringPiece().str());
+  }
 
-  pools_.emplace(name, clientPool);
+  pools_.emplace(name, ParsedPool{
+    clientPool, std::make_shared<const folly::dynamic>(json) });
   return clientPool;
 }
 
@@ -10,6 +10,7 @@
 #pragma once
 
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -38,12 +39,18 @@ class PoolFactory {
    * @param configApi API to fetch pools from files. Should be
    *                  reference once we'll remove 'routerless' mode.
    * @param mcOpts mcrouter options for parsing.
+   * @param previous PoolFactory of the config being replaced, if any.
+   *                 Pools with exactly the same definition are taken from it
+   *                 instead of being created again, so that routes built
+   *                 for them can be reused too.
    */
   PoolFactory(const folly::dynamic& config, ConfigApi& configApi,
-              const McrouterOptions& opts);
+              const McrouterOptions& opts,
+              const PoolFactory* previous = nullptr);
 
   /**
    * Parses a single pool from given json blob.
+   * Thread safe, routes of proxies may be built in parallel.
    *
    * @param jpool should be the pool object.
    */
@@ -56,11 +63,36 @@ class PoolFactory {
     return clients_;
   }
 
+  /**
+   * @return Number of pools taken from the previous PoolFactory.
+   */
+  size_t reusedPools() const {
+    return reusedPools_;
+  }
+
+  /**
+   * Drops references to pools of the previous PoolFactory.
+   * Should be called once all pools were parsed.
+   */
+  void releasePrevious() {
+    previousPools_.clear();
+  }
+
  private:
-  std::unordered_map<std::string, std::shared_ptr<ClientPool>> pools_;
+  struct ParsedPool {
+    std::shared_ptr<ClientPool> pool;
+    // definition the pool was created from
+    std::shared_ptr<const folly::dynamic> json;
+  };
+
+  // protects pools_ and clients_ in parsePool()
+  std::mutex lock_;
+  std::unordered_map<std::string, ParsedPool> pools_;
+  std::unordered_map<std::string, ParsedPool> previousPools_;
   std::vector<std::shared_ptr<const ProxyClientCommon>> clients_;
   ConfigApi& configApi_;
   const McrouterOptions& opts_;
+  size_t reusedPools_{0};
 
   std::shared_ptr<ClientPool>
   parsePool(const std::string& name, const folly::dynamic& jpool);
@@ -0,0 +1,104 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "PoolStats.h"
+
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+struct PoolIds {
+  std::mutex lock;
+  std::unordered_map<std::string, uint32_t> ids;
+  std::vector<std::string> names;
+};
+
+PoolIds& poolIds() {
+  /* Leaked: pools may be parsed during static destruction */
+  static auto ids = new PoolIds();
+  return *ids;
+}
+
+}  // anonymous namespace
+
+constexpr size_t PoolStats::kMaxPools;
+const char* const PoolStats::kOtherName = "[other]";
+
+PoolStatsEntry::PoolStatsEntry() {
+  for (auto& result : results) {
+    result.store(0, std::memory_order_relaxed);
+  }
+}
+
+uint32_t PoolStats::idFor(folly::StringPiece poolName) {
+  auto& ids = poolIds();
+  std::lock_guard<std::mutex> lock(ids.lock);
+  auto it = ids.ids.find(poolName.str());
+  if (it != ids.ids.end()) {
+    return it->second;
+  }
+  /* The last id is shared by all pools past the limit */
+  if (ids.names.size() == kMaxPools - 1) {
+    return kMaxPools - 1;
+  }
+  uint32_t id = ids.names.size();
+  ids.names.push_back(poolName.str());
+  ids.ids.emplace(poolName.str(), id);
+  return id;
+}
+
+std::string PoolStats::nameOf(uint32_t id) {
+  auto& ids = poolIds();
+  std::lock_guard<std::mutex> lock(ids.lock);
+  return id < ids.names.size() ? ids.names[id] : kOtherName;
+}
+
+PoolStats::PoolStats() {
+  for (auto& entry : entries_) {
+    entry.store(nullptr, std::memory_order_relaxed);
+  }
+}
+
+PoolStats::~PoolStats() {
+  for (auto& entry : entries_) {
+    delete entry.load(std::memory_order_relaxed);
+  }
+}
+
+PoolStatsEntry& PoolStats::get(uint32_t id) {
+  auto& slot = entries_[std::min<size_t>(id, kMaxPools - 1)];
+  auto entry = slot.load(std::memory_order_relaxed);
+  if (entry == nullptr) {
+    entry = new PoolStatsEntry();
+    slot.store(entry, std::memory_order_release);
+  }
+  return *entry;
+}
+
+void PoolStats::onReply(uint32_t id, mc_res_t result, uint64_t latencyUs,
+                        size_t keyBytes, size_t valueBytes) {
+  auto& entry = get(id);
+  entry.replies.fetch_add(1, std::memory_order_relaxed);
+  entry.results[result].fetch_add(1, std::memory_order_relaxed);
+  entry.latency.record(latencyUs);
+  entry.sizes.record(keyBytes, valueBytes);
+}
+
+void PoolStats::onRefused(uint32_t id, mc_res_t result) {
+  auto& entry = get(id);
+  entry.refused.fetch_add(1, std::memory_order_relaxed);
+  entry.results[result].fetch_add(1, std::memory_order_relaxed);
+}
+
+}}}  // facebook::memcache::mcrouter
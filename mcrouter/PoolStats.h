@@ -0,0 +1,101 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include <folly/Range.h>
+
+#include "mcrouter/LatencyHistogram.h"
+#include "mcrouter/lib/mc/msg.h"
+#include "mcrouter/SizeStats.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Request counters and latencies of one pool on one proxy.
+ * Written by the proxy thread only, read from any thread.
+ */
+struct PoolStatsEntry {
+  /* Replies received from the pool's destinations */
+  std::atomic<uint64_t> replies{0};
+  /* Requests refused before being sent (TKO, saturation, deadline...) */
+  std::atomic<uint64_t> refused{0};
+  /* Replies and refusals, by result */
+  std::atomic<uint64_t> results[mc_nres];
+  /* Of replies received */
+  LatencyHistogram latency;
+  /* Of requests that got a reply, see SizeHistograms */
+  SizeHistograms sizes;
+
+  PoolStatsEntry();
+};
+
+/**
+ * Per proxy stats of all pools, indexed by pool id.
+ *
+ * Pool ids are resolved once per pool name when the config is parsed
+ * (see ClientPool::statsId()) and are the same across reconfigurations,
+ * so requests only index an array. Entries are allocated on the first
+ * request to a pool.
+ */
+class PoolStats {
+ public:
+  /**
+   * At most this many pools are tracked, requests of any other pools
+   * are counted under kOtherName.
+   */
+  static constexpr size_t kMaxPools = 256;
+  static const char* const kOtherName;
+
+  /**
+   * @return  Process wide id of the pool name, stable across configs.
+   *          Thread safe.
+   */
+  static uint32_t idFor(folly::StringPiece poolName);
+
+  /**
+   * @return  Pool name of an id returned by idFor(). Thread safe.
+   */
+  static std::string nameOf(uint32_t id);
+
+  PoolStats();
+  ~PoolStats();
+
+  /* Proxy thread only */
+  void onReply(uint32_t id, mc_res_t result, uint64_t latencyUs,
+               size_t keyBytes, size_t valueBytes);
+  void onRefused(uint32_t id, mc_res_t result);
+
+  /**
+   * Calls f(uint32_t id, const PoolStatsEntry&) for each pool that got
+   * any requests. Thread safe.
+   */
+  template <typename Func>
+  void foreach(Func&& f) const {
+    for (uint32_t id = 0; id < kMaxPools; ++id) {
+      if (auto entry = entries_[id].load(std::memory_order_acquire)) {
+        f(id, *entry);
+      }
+    }
+  }
+
+ private:
+  std::atomic<PoolStatsEntry*> entries_[kMaxPools];
+
+  PoolStatsEntry& get(uint32_t id);
+
+  PoolStats(const PoolStats&) = delete;
+  PoolStats& operator=(const PoolStats&) = delete;
+};
+
+}}}  // facebook::memcache::mcrouter
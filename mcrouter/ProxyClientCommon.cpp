@@ -9,6 +9,9 @@
  */
 #include "ProxyClientCommon.h"
 
+#include <mutex>
+#include <unordered_map>
+
 #include <folly/Format.h>
 
 #include "mcrouter/ClientPool.h"
@@ -16,28 +19,53 @@
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
+namespace {
+
+std::string genDestinationKey(const AccessPoint& ap,
+                              std::chrono::milliseconds timeout,
+                              bool includeTimeout) {
+  if (includeTimeout) {
+    return folly::sformat("{}-{}", ap.toString(), timeout.count());
+  } else {
+    return ap.toString();
+  }
+}
+
+/* Entries (and references to them) stay valid: nothing is ever erased */
+const std::pair<const std::string, uint32_t>&
+internDestinationKey(const std::string& key) {
+  static std::mutex lock;
+  static std::unordered_map<std::string, uint32_t> ids;
+
+  std::lock_guard<std::mutex> lck(lock);
+  return *ids.emplace(key, static_cast<uint32_t>(ids.size())).first;
+}
+
+const AccessPoint& internAccessPoint(AccessPoint ap) {
+  static std::mutex lock;
+  static std::unordered_map<std::string, AccessPoint> accessPoints;
+
+  auto key = ap.toString();
+  std::lock_guard<std::mutex> lck(lock);
+  return accessPoints.emplace(std::move(key), std::move(ap)).first->second;
+}
+
+}  // anonymous namespace
+
 ProxyClientCommon::ProxyClientCommon(const ClientPool& pool_,
-                                     std::chrono::milliseconds timeout,
                                      AccessPoint ap_,
-                                     int keep_routing_prefix_,
                                      bool useSsl_,
-                                     uint64_t qos_)
+                                     uint64_t qos_,
+                                     bool includeTimeoutInKey)
     : pool(pool_),
-      ap(std::move(ap_)),
-      keep_routing_prefix(keep_routing_prefix_),
-      server_timeout(std::move(timeout)),
+      ap(internAccessPoint(std::move(ap_))),
       indexInPool(pool.getClients().size()),
-      useSsl(useSsl_),
-      qos(qos_) {
-}
-
-std::string ProxyClientCommon::genProxyDestinationKey(
-    bool include_timeout) const {
-  if (include_timeout || ap.getProtocol() == mc_ascii_protocol) {
-    return folly::sformat("{}-{}", ap.toString(), server_timeout.count());
-  } else {
-    return ap.toString();
-  }
+      qos(qos_),
+      destinationKey(internDestinationKey(
+          genDestinationKey(ap, pool.serverTimeout(),
+                            includeTimeoutInKey)).first),
+      destinationId(internDestinationKey(destinationKey).second),
+      useSsl(useSsl_) {
 }
 
 }}}  // facebook::memcache::mcrouter
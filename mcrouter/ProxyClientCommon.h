@@ -18,27 +18,43 @@ namespace facebook { namespace memcache { namespace mcrouter {
 
 class ClientPool;
 
+/**
+ * A server of a pool, shared by the proxies (one per config). Kept small,
+ * there may be one per server per pool: strings are interned for the
+ * lifetime of the process and members are ordered to pack.
+ */
 struct ProxyClientCommon {
+  /* Settings shared by the pool's servers (timeout etc.) live there */
   const ClientPool& pool;
-  const AccessPoint ap;
-
-  const int keep_routing_prefix;
-  const std::chrono::milliseconds server_timeout;
+  /* Interned: clients with the same AccessPoint share one */
+  const AccessPoint& ap;
 
   const size_t indexInPool;
-  const bool useSsl;
 
   const uint64_t qos;
 
-  std::string genProxyDestinationKey(bool include_timeout) const;
+  /**
+   * Clients with the same key share a ProxyDestination in each proxy,
+   * consists of ap and, unless same_connection_any_timeout, the pool's
+   * server timeout.
+   * Interned as well.
+   */
+  const std::string& destinationKey;
+
+  /**
+   * destinationKey interned once at config load: equal keys get
+   * the same small id for the lifetime of the process.
+   */
+  const uint32_t destinationId;
+
+  const bool useSsl;
 
  private:
   ProxyClientCommon(const ClientPool& pool,
-                    std::chrono::milliseconds timeout,
                     AccessPoint ap,
-                    int keep_routing_prefix,
                     bool useSsl,
-                    uint64_t qos);
+                    uint64_t qos,
+                    bool includeTimeoutInKey);
 
   friend class ClientPool;
 };
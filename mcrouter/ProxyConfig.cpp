@@ -9,6 +9,8 @@
  */
 #include "ProxyConfig.h"
 
+#include <functional>
+
 #include <folly/Conv.h>
 #include <folly/dynamic.h>
 #include <folly/json.h>
@@ -17,6 +19,8 @@
 #include "mcrouter/proxy.h"
 #include "mcrouter/routes/McRouteHandleProvider.h"
 #include "mcrouter/PoolFactory.h"
+#include "mcrouter/routes/InlinedRoute.h"
+#include "mcrouter/routes/LazyRoute.h"
 #include "mcrouter/routes/PrefixRouteSelector.h"
 #include "mcrouter/routes/ProxyRoute.h"
 #include "mcrouter/routes/RouteSelectorMap.h"
@@ -26,12 +30,16 @@ namespace facebook { namespace memcache { namespace mcrouter {
 
 namespace {
 
+using CreateRoute =
+  std::function<McrouterRouteHandlePtr(const folly::dynamic&)>;
+
 void addRouteSelector(const folly::dynamic& aliases,
                       const folly::dynamic& route,
-                      RouteHandleFactory<McrouterRouteHandleIf>& factory,
+                      const CreateRoute& createRoute,
                       RouteSelectorMap& routeSelectors) {
 
-  auto routeSelector = std::make_shared<PrefixRouteSelector>(factory, route);
+  auto routeSelector = std::make_shared<PrefixRouteSelector>(route,
+                                                             createRoute);
   for (const auto& alias : aliases) {
     checkLogic(alias.isString(), "Alias is not string");
     auto key = alias.asString().toStdString();
@@ -48,19 +56,45 @@ void addRouteSelector(const folly::dynamic& aliases,
 ProxyConfig::ProxyConfig(proxy_t* proxy,
                          const folly::dynamic& json,
                          std::string configMd5Digest,
-                         std::shared_ptr<PoolFactory> poolFactory)
+                         std::shared_ptr<PoolFactory> poolFactory,
+                         std::shared_ptr<const ConfigIntrospection>
+                           introspection,
+                         const ProxyConfig* previous,
+                         ConfigObjectCache* objectCache,
+                         std::shared_ptr<const folly::dynamic> lazyJson)
   : poolFactory_(std::move(poolFactory)),
     configMd5Digest_(std::move(configMd5Digest)) {
 
-  McRouteHandleProvider provider(proxy, *proxy->destinationMap, *poolFactory_);
+  McRouteHandleProvider provider(proxy, *proxy->destinationMap, *poolFactory_,
+                                 previous ? &previous->pools_ : nullptr,
+                                 objectCache);
   RouteHandleFactory<McrouterRouteHandleIf> factory(provider);
+  CreateRoute createRoute;
+  if (lazyJson) {
+    assert(lazyJson.get() == &json);
+    lazyRoutes_ = std::make_shared<LazyRouteFactory>(proxy, poolFactory_,
+                                                     std::move(lazyJson));
+    auto lazyRoutes = lazyRoutes_.get();
+    createRoute = [lazyRoutes](const folly::dynamic& route) {
+      return lazyRoutes->create(route);
+    };
+  } else {
+    createRoute = [&factory, proxy](const folly::dynamic& route) {
+      auto rh = factory.create(route);
+      return proxy->opts.inline_routes ? makeInlinedRoute(std::move(rh)) : rh;
+    };
+  }
 
   checkLogic(json.isObject(), "Config is not an object");
 
   if (json.count("named_handles")) {
     checkLogic(json["named_handles"].isArray(), "named_handles is not array");
-    for (const auto& it : json["named_handles"]) {
-      factory.create(it);
+    if (lazyRoutes_) {
+      lazyRoutes_->createNamedHandles(json["named_handles"]);
+    } else {
+      for (const auto& it : json["named_handles"]) {
+        factory.create(it);
+      }
     }
   }
 
@@ -71,7 +105,7 @@ ProxyConfig::ProxyConfig(proxy_t* proxy,
 
   if (json.count("route")) {
     addRouteSelector({ proxy->opts.default_route.str() },
-                     json["route"], factory, routeSelectors);
+                     json["route"], createRoute, routeSelectors);
   } else if (json.count("routes")) {
     checkLogic(json["routes"].isArray(), "Config: routes is not array");
     for (const auto& it : json["routes"]) {
@@ -80,7 +114,7 @@ ProxyConfig::ProxyConfig(proxy_t* proxy,
       checkLogic(it.count("aliases"), "RoutePolicy has no aliases");
       const auto& aliases = it["aliases"];
       checkLogic(aliases.isArray(), "RoutePolicy aliases is not array");
-      addRouteSelector(aliases, it["route"], factory, routeSelectors);
+      addRouteSelector(aliases, it["route"], createRoute, routeSelectors);
     }
   } else {
     throw std::logic_error("No route/routes in config");
@@ -88,13 +122,26 @@ ProxyConfig::ProxyConfig(proxy_t* proxy,
 
 
   asyncLogRoutes_ = provider.releaseAsyncLogRoutes();
+  pools_ = provider.releasePools();
+  dedupedRoutes_ = factory.dedupedRoutes();
   proxyRoute_ = std::make_shared<ProxyRoute>(proxy, routeSelectors);
-  serviceInfo_ = std::make_shared<ServiceInfo>(proxy, *this);
+  serviceInfo_ = std::make_shared<ServiceInfo>(proxy, *this,
+                                               std::move(introspection));
 }
 
 McrouterRouteHandlePtr
 ProxyConfig::getRouteHandleForAsyncLog(const std::string& asyncLogName) const {
-  return tryGet(asyncLogRoutes_, asyncLogName);
+  auto route = tryGet(asyncLogRoutes_, asyncLogName);
+  if (!route && lazyRoutes_) {
+    route = lazyRoutes_->getAsyncLogRoute(asyncLogName);
+  }
+  return route;
+}
+
+void ProxyConfig::warmUpLazyRoutes(folly::EventBase& evb) {
+  if (lazyRoutes_) {
+    lazyRoutes_->warmUp(evb);
+  }
 }
 
 const std::vector<std::shared_ptr<const ProxyClientCommon>>&
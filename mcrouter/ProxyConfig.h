@@ -16,14 +16,19 @@
 #include <folly/Range.h>
 
 #include "mcrouter/ProxyConfigIf.h"
+#include "mcrouter/routes/McRouteHandleProvider.h"
 #include "mcrouter/routes/McrouterRouteHandle.h"
 
 namespace folly {
 class dynamic;
+class EventBase;
 }
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
+class ConfigIntrospection;
+class ConfigObjectCache;
+class LazyRouteFactory;
 class PoolFactory;
 class ProxyClientCommon;
 class ProxyGenericPool;
@@ -54,22 +59,53 @@ class ProxyConfig : public ProxyConfigIf {
   McrouterRouteHandlePtr
   getRouteHandleForAsyncLog(const std::string& asyncLogName) const override;
 
+  /**
+   * With opts.lazy_routes, starts building all routes in evb's thread
+   * (the proxy's), a few per loop iteration.
+   */
+  void warmUpLazyRoutes(folly::EventBase& evb);
+
+  /**
+   * @return  number of anonymous route subtrees that share the routes of
+   *          an identical subtree (not counting lazily built routes)
+   */
+  size_t dedupedRoutes() const {
+    return dedupedRoutes_;
+  }
+
  private:
   std::shared_ptr<ProxyRoute> proxyRoute_;
   std::shared_ptr<ServiceInfo> serviceInfo_;
   std::shared_ptr<PoolFactory> poolFactory_;
   std::string configMd5Digest_;
   std::unordered_map<std::string, McrouterRouteHandlePtr> asyncLogRoutes_;
+  // Routes to destinations of every pool, reused by the next config.
+  // Doesn't include pools of lazyRoutes_.
+  McRouteHandleProvider::PoolDestinations pools_;
+  std::shared_ptr<LazyRouteFactory> lazyRoutes_;
+  size_t dedupedRoutes_{0};
 
   /**
    * Parses config and creates ProxyRoute
    *
    * @param jsonC config in format of JSON with comments and templates
+   * @param introspection  snapshot of the config for ServiceInfo, shared
+   *                       with configs of other proxies.
+   * @param previous config of the same proxy being replaced, if any.
+   * @param objectCache immutable route objects shared with configs of
+   *                    other proxies.
+   * @param lazyJson  if set, the same object as json: routes of routing
+   *                  prefixes are built on their first request,
+   *                  see LazyRouteFactory.
    */
   ProxyConfig(proxy_t* proxy,
               const folly::dynamic& json,
               std::string configMd5Digest,
-              std::shared_ptr<PoolFactory> poolFactory);
+              std::shared_ptr<PoolFactory> poolFactory,
+              std::shared_ptr<const ConfigIntrospection> introspection,
+              const ProxyConfig* previous = nullptr,
+              ConfigObjectCache* objectCache = nullptr,
+              std::shared_ptr<const folly::dynamic> lazyJson = nullptr);
 
   friend class ProxyConfigBuilder;
 };
@@ -9,9 +9,15 @@
  */
 #include "ProxyConfigBuilder.h"
 
+#include <glog/logging.h>
+
 #include <folly/json.h>
+#include <folly/Memory.h>
 
 #include "mcrouter/ConfigApi.h"
+#include "mcrouter/ConfigIntrospection.h"
+#include "mcrouter/ConfigObjectCache.h"
+#include "mcrouter/ConfigSnapshot.h"
 #include "mcrouter/lib/config/ConfigPreprocessor.h"
 #include "mcrouter/lib/fbi/cpp/globals.h"
 #include "mcrouter/lib/fbi/cpp/util.h"
@@ -25,33 +31,89 @@ namespace facebook { namespace memcache { namespace mcrouter {
 
 ProxyConfigBuilder::ProxyConfigBuilder(const McrouterOptions& opts,
                                        ConfigApi* configApi,
-                                       folly::StringPiece jsonC)
-    : json_(nullptr) {
-
-  McImportResolver importResolver(configApi);
-  json_ = ConfigPreprocessor::getConfigWithoutMacros(
-    jsonC,
-    importResolver,
-    {
-      { "default-route", opts.default_route.str() },
-      { "default-region", opts.default_route.getRegion().str() },
-      { "default-cluster", opts.default_route.getCluster().str() },
-      { "hostid", globals::hostid() },
-    });
-
-  poolFactory_ = std::make_shared<PoolFactory>(json_, *configApi, opts);
+                                       folly::StringPiece jsonC,
+                                       const ProxyConfig* previous,
+                                       McImportCache* importCache)
+    : snapshotKey_(nullptr),
+      snapshotFile_(opts.config_snapshot_file),
+      objectCache_(folly::make_unique<ConfigObjectCache>()),
+      lazyRoutes_(opts.lazy_routes) {
 
+  std::unordered_map<std::string, folly::dynamic> globalParams{
+    { "default-route", opts.default_route.str() },
+    { "default-region", opts.default_route.getRegion().str() },
+    { "default-cluster", opts.default_route.getCluster().str() },
+    { "hostid", globals::hostid() },
+  };
   configMd5Digest_ = Md5Hash(jsonC);
+
+  folly::dynamic json = nullptr;
+  bool fromSnapshot = false;
+  if (!snapshotFile_.empty()) {
+    folly::dynamic jparams = folly::dynamic::object;
+    for (const auto& it : globalParams) {
+      jparams[it.first] = it.second;
+    }
+    snapshotKey_ = folly::dynamic::object
+      ("config_md5", configMd5Digest_)
+      ("params", std::move(jparams));
+    fromSnapshot = readConfigSnapshot(snapshotFile_, snapshotKey_,
+                                      *configApi, json);
+  }
+
+  if (fromSnapshot) {
+    // already up to date
+    snapshotFile_.clear();
+  } else {
+    McImportResolver importResolver(configApi, importCache);
+    json = ConfigPreprocessor::getConfigWithoutMacros(
+      jsonC, importResolver, std::move(globalParams));
+    imports_ = importResolver.imports();
+    if (importCache) {
+      importCache->retain(imports_);
+    }
+  }
+  json_ = std::make_shared<const folly::dynamic>(std::move(json));
+  introspection_ = std::make_shared<const ConfigIntrospection>(json_);
+
+  poolFactory_ = std::make_shared<PoolFactory>(
+    *json_, *configApi, opts,
+    previous ? previous->poolFactory_.get() : nullptr);
+}
+
+ProxyConfigBuilder::~ProxyConfigBuilder() {
+  poolFactory_->releasePrevious();
+}
+
+void ProxyConfigBuilder::saveSnapshot() const {
+  if (snapshotFile_.empty()) {
+    return;
+  }
+  if (!writeConfigSnapshot(snapshotFile_, snapshotKey_, imports_, *json_)) {
+    LOG(ERROR) << "Failed to write config snapshot to " << snapshotFile_;
+  }
 }
 
 folly::dynamic ProxyConfigBuilder::preprocessedConfig() const {
-  return json_;
+  return *json_;
 }
 
 std::shared_ptr<ProxyConfig>
 ProxyConfigBuilder::buildConfig(proxy_t* proxy) const {
-  return std::shared_ptr<ProxyConfig>(
-    new ProxyConfig(proxy, json_, configMd5Digest_, poolFactory_));
+  auto previous = std::dynamic_pointer_cast<ProxyConfig>(proxy->getConfig());
+  if (lazyJson_) {
+    return std::shared_ptr<ProxyConfig>(
+      new ProxyConfig(proxy, *lazyJson_, configMd5Digest_, poolFactory_,
+                      introspection_, previous.get(), objectCache_.get(),
+                      lazyJson_));
+  }
+  auto config = std::shared_ptr<ProxyConfig>(
+    new ProxyConfig(proxy, *json_, configMd5Digest_, poolFactory_,
+                    introspection_, previous.get(), objectCache_.get()));
+  if (lazyRoutes_) {
+    lazyJson_ = json_;
+  }
+  return config;
 }
 
 }}} // facebook::memcache::mcrouter
@@ -21,6 +21,9 @@
 namespace facebook { namespace memcache { namespace mcrouter {
 
 class ConfigApi;
+class ConfigIntrospection;
+class ConfigObjectCache;
+class McImportCache;
 class McrouterInstance;
 class PoolFactory;
 class ProxyConfig;
@@ -28,17 +31,58 @@ class proxy_t;
 
 class ProxyConfigBuilder {
  public:
+  /**
+   * @param previous  config being replaced, if any. Pools (and per proxy
+   *                  routes to their destinations) that didn't change are
+   *                  taken from it instead of being built again.
+   * @param importCache  if not null, imported files that didn't change
+   *                     since they were cached are not parsed again.
+   */
   ProxyConfigBuilder(const McrouterOptions& opts,
                      ConfigApi* configApi,
-                     folly::StringPiece jsonC);
+                     folly::StringPiece jsonC,
+                     const ProxyConfig* previous = nullptr,
+                     McImportCache* importCache = nullptr);
 
+  /**
+   * Releases pools of the previous config that weren't reused.
+   */
+  ~ProxyConfigBuilder();
+
+  /**
+   * Builds config for given proxy, reusing routes from proxy's current
+   * config where possible. Immutable parts of routes (hash functions,
+   * shard splits) are shared between configs built by this builder.
+   *
+   * With opts.lazy_routes, only the first config is built (and validated)
+   * in full, routes of the others are built on first use.
+   */
   std::shared_ptr<ProxyConfig> buildConfig(proxy_t* proxy) const;
 
+  /**
+   * Saves preprocessed config to opts.config_snapshot_file (if set), so that
+   * the next builder for the same config doesn't need to preprocess it.
+   * Should be called once configs were built successfully.
+   */
+  void saveSnapshot() const;
+
   folly::dynamic preprocessedConfig() const;
  private:
-  folly::dynamic json_;
+  // shared with lazily built configs instead of being copied for them
+  std::shared_ptr<const folly::dynamic> json_;
+  // shared by all configs built, see ServiceInfo
+  std::shared_ptr<const ConfigIntrospection> introspection_;
+  folly::dynamic snapshotKey_;
+  // empty if snapshot is disabled or json_ was loaded from it
+  std::string snapshotFile_;
+  // path => md5 of files imported while preprocessing
+  std::unordered_map<std::string, std::string> imports_;
   std::shared_ptr<PoolFactory> poolFactory_;
+  std::unique_ptr<ConfigObjectCache> objectCache_;
   std::string configMd5Digest_;
+  // json_ once a config was built in full, if routes are built lazily
+  mutable std::shared_ptr<const folly::dynamic> lazyJson_;
+  const bool lazyRoutes_;
 };
 
 }}} // facebook::memcache::mcrouter
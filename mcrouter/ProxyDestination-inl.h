@@ -7,21 +7,123 @@
  *  of patent rights can be found in the PATENTS file in the same directory.
  *
  */
+#include <atomic>
+#include <memory>
+
+#include <folly/experimental/fibers/Baton.h>
+
 #include "mcrouter/config-impl.h"
 #include "mcrouter/proxy.h"
 #include "mcrouter/ProxyDestinationMap.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
+namespace detail {
+
+/* Shared by the sending fiber and the owner proxy, either may finish first */
+template <class Request, class Reply>
+struct SharedSendState {
+  Request request;
+  folly::Optional<Reply> reply;
+  folly::fibers::Baton baton;
+  /* Set once the sending fiber gave up waiting, the owner must not send */
+  std::atomic<bool> abandoned{false};
+
+  explicit SharedSendState(Request req) : request(std::move(req)) {}
+};
+
+}  // detail
+
 template <int Op, class Request>
 typename ReplyType<McOperation<Op>, Request>::type
 ProxyDestination::send(const Request& request, McOperation<Op>,
                        DestinationRequestCtx& req_ctx,
                        std::chrono::milliseconds timeout) {
+  if (auto owner = sharedConnectionOwner()) {
+    auto reply = sendShared(*owner, request, McOperation<Op>(), req_ctx,
+                            timeout);
+    if (reply.hasValue()) {
+      return std::move(reply.value());
+    }
+  }
+  return sendLocal(request, McOperation<Op>(), req_ctx, timeout);
+}
+
+template <int Op, class Request>
+folly::Optional<typename ReplyType<McOperation<Op>, Request>::type>
+ProxyDestination::sendShared(proxy_t& owner, const Request& request,
+                             McOperation<Op>, DestinationRequestCtx& req_ctx,
+                             std::chrono::milliseconds timeout) {
+  using Reply = typename ReplyType<McOperation<Op>, Request>::type;
+  using State = detail::SharedSendState<Request, Reply>;
+
+  auto state = std::make_shared<State>(request.clone());
+  auto id = destinationId;
+  auto posted = owner.eventBase->runInEventBaseThread(
+    [&owner, state, id, timeout] () {
+      owner.fiberManager.addTask([&owner, state, id, timeout] () {
+        if (state->abandoned.load(std::memory_order_acquire)) {
+          return;
+        }
+        // Owner's destination for the same key, unless its config differs
+        if (auto dest = owner.destinationMap->find(id)) {
+          DestinationRequestCtx ctx;
+          state->reply = dest->sendLocal(state->request, McOperation<Op>(),
+                                         ctx, timeout);
+        }
+        state->baton.post();
+      });
+    });
+  if (!posted) {
+    return folly::none;
+  }
+
+  // The owner's send times out by itself, this only guards against
+  // an owner that stopped processing (e.g. stalled or shutting down).
+  // The request is dropped unless the owner got to send it already:
+  // a timeout must not be followed by the update being applied.
+  if (!state->baton.timed_wait(2 * timeout)) {
+    state->abandoned.store(true, std::memory_order_release);
+    Reply reply(mc_res_timeout);
+    onSharedReply(reply, req_ctx);
+    return std::move(reply);
+  }
+  if (state->reply.hasValue()) {
+    onSharedReply(state->reply.value(), req_ctx);
+  }
+  return std::move(state->reply);
+}
+
+template <int Op, class Request>
+typename ReplyType<McOperation<Op>, Request>::type
+ProxyDestination::sendLocal(const Request& request, McOperation<Op>,
+                            DestinationRequestCtx& req_ctx,
+                            std::chrono::milliseconds timeout) {
   proxy->destinationMap->markAsActive(*this);
-  auto reply = getAsyncMcClient().sendSync(request, McOperation<Op>(), timeout);
+  auto large = largeLane_ && isLargeRequest(request);
+  auto reply = getAsyncMcClient(large).sendSync(
+    request, McOperation<Op>(), timeout,
+    req_ctx.traceWrite ? &req_ctx.writtenTime : nullptr,
+    req_ctx.replyStream,
+    stats_.phases ? &req_ctx.timestamps : nullptr);
   onReply(reply, req_ctx);
+  if (largeLane_ && !reply.isError()) {
+    updateLargeKeyHint(request.routingKeyHash(),
+                       request.value().computeChainDataLength() +
+                       reply.value().computeChainDataLength());
+  }
   return reply;
 }
 
+template <class Request>
+bool ProxyDestination::isLargeRequest(const Request& request) {
+  if (request.value().computeChainDataLength() >=
+      proxy->opts.large_request_lane_min_bytes) {
+    return true;
+  }
+  auto hash = request.routingKeyHash();
+  return hash != 0 &&
+         largeKeyHints_[hash % largeKeyHints_.size()] == hash;
+}
+
 }}}  // facebook::memcache::mcrouter
@@ -9,15 +9,18 @@
  */
 #include "ProxyDestination.h"
 
+#include <algorithm>
+#include <limits>
+
 #include <folly/Memory.h>
 #include <folly/experimental/fibers/Fiber.h>
 
 #include "mcrouter/config-impl.h"
 #include "mcrouter/config.h"
-#include "mcrouter/lib/fbi/asox_timer.h"
 #include "mcrouter/lib/McMsgRef.h"
 #include "mcrouter/lib/network/AsyncMcClient.h"
 #include "mcrouter/lib/network/ThreadLocalSSLContextProvider.h"
+#include "mcrouter/McrouterInstance.h"
 #include "mcrouter/ProxyClientCommon.h"
 #include "mcrouter/routes/DestinationRoute.h"
 #include "mcrouter/stats.h"
@@ -73,24 +76,12 @@ void ProxyDestination::schedule_next_probe() {
   uint64_t delay_us = (double)delay_ms * 1000 * (1.0 + tmo_jitter_pct);
   assert(delay_us > 0);
 
-  timeval_t delay;
-  delay.tv_sec = (delay_us / 1000000);
-  delay.tv_usec = (delay_us % 1000000);
-
-  assert(probe_timer == nullptr);
-  probe_timer = asox_add_timer(
-    proxy->eventBase->getLibeventBase(),
-    delay,
-    [](const asox_timer_t timer, void* arg) {
-      reinterpret_cast<ProxyDestination*>(arg)->on_timer(timer);
-    }, this);
+  assert(!probeTimer_.isScheduled());
+  proxy->probeTimer->scheduleTimeout(
+    &probeTimer_, std::chrono::milliseconds(delay_us / 1000));
 }
 
-void ProxyDestination::on_timer(const asox_timer_t timer) {
-  // This assert checks for use-after-free
-  assert(timer == probe_timer);
-  asox_remove_timer(timer);
-  probe_timer = nullptr;
+void ProxyDestination::on_timer() {
   // Note that the previous probe might still be in flight
   if (!probe_req) {
     auto mutReq = createMcMsgRef();
@@ -123,10 +114,7 @@ void ProxyDestination::start_sending_probes() {
 
 void ProxyDestination::stop_sending_probes() {
   stats_.probesSent = 0;
-  if (probe_timer) {
-    asox_remove_timer(probe_timer);
-    probe_timer = nullptr;
-  }
+  probeTimer_.cancelTimeout();
 }
 
 void ProxyDestination::handle_tko(const McReply& reply, bool is_probe_req) {
@@ -160,6 +148,40 @@ void ProxyDestination::handle_tko(const McReply& reply, bool is_probe_req) {
   tracker->recordSuccess(this);
 }
 
+folly::Optional<double>
+ProxyDestination::latencySinceLastCheck(size_t minSamples) {
+  auto samples = stats_.latency.count();
+  if (samples - latencyCheckSamples_ < minSamples) {
+    return folly::none;
+  }
+  latencyCheckSamples_ = samples;
+  return stats_.avgLatency.value();
+}
+
+bool ProxyDestination::markLatencyOutlier() {
+  if (proxy->opts.disable_tko_tracking || !tracker ||
+      !tracker->markSoftTko(this)) {
+    return false;
+  }
+  onTkoEvent(TkoLogEvent::MarkLatencyTko, mc_res_ok);
+  start_sending_probes();
+  return true;
+}
+
+bool ProxyDestination::markInheritedTko(bool hard) {
+  if (proxy->opts.disable_tko_tracking || !tracker) {
+    return false;
+  }
+  if (hard ? !tracker->recordHardFailure(this) :
+             !tracker->markSoftTko(this)) {
+    return false;
+  }
+  onTkoEvent(hard ? TkoLogEvent::MarkHardTko : TkoLogEvent::MarkSoftTko,
+             mc_res_ok);
+  start_sending_probes();
+  return true;
+}
+
 void ProxyDestination::onReply(const McReply& reply,
                                DestinationRequestCtx& destreqCtx) {
   handle_tko(reply, false);
@@ -167,29 +189,184 @@ void ProxyDestination::onReply(const McReply& reply,
   stats_.results[reply.result()]++;
   destreqCtx.endTime = nowUs();
 
-  int64_t latency = destreqCtx.endTime - destreqCtx.startTime;
-  stats_.avgLatency.insertSample(latency);
+  recordLatency(destreqCtx.endTime - destreqCtx.startTime);
+  if (stats_.phases) {
+    recordPhases(destreqCtx);
+  }
+}
+
+void ProxyDestination::onSharedReply(const McReply& reply,
+                                     DestinationRequestCtx& destreqCtx) {
+  stats_.results[reply.result()]++;
+  destreqCtx.endTime = nowUs();
+
+  recordLatency(destreqCtx.endTime - destreqCtx.startTime);
+}
+
+void ProxyDestination::recordLatency(int64_t latencyUs) {
+  stats_.avgLatency.insertSample(latencyUs);
+  stats_.latency.record(latencyUs);
+
+  if (!recentLatency_) {
+    return;
+  }
+  recentLatency_->insertSample(latencyUs);
+  const auto& opts = proxy->opts;
+  if (++adaptiveTimeoutSamples_ < opts.adaptive_timeout_window) {
+    return;
+  }
+  // percentile() walks all buckets, so don't do it on every reply
+  adaptiveTimeoutSamples_ -=
+    std::max<size_t>(1, opts.adaptive_timeout_window / 8);
+
+  auto p99Us = recentLatency_->percentile(99);
+  auto timeoutMs = static_cast<int64_t>(
+    (p99Us * opts.adaptive_timeout_p99_percent / 100 + 999) / 1000);
+  timeoutMs = std::max<int64_t>(timeoutMs, opts.adaptive_timeout_min_ms);
+  if (opts.adaptive_timeout_max_ms != 0) {
+    timeoutMs = std::min<int64_t>(timeoutMs, opts.adaptive_timeout_max_ms);
+  }
+  adaptiveTimeoutMs_.store(std::max<int64_t>(timeoutMs, 1),
+                           std::memory_order_relaxed);
+}
+
+void ProxyDestination::recordPhases(const DestinationRequestCtx& destreqCtx) {
+  const auto& ts = destreqCtx.timestamps;
+  if (ts.kernelTxUs == 0 || ts.readUs == 0) {
+    // Not sent by a timestamped connection, or failed before a reply
+    return;
+  }
+  // Clamped, the times come from different clocks
+  stats_.phases->queue.record(
+    std::max<int64_t>(0, ts.kernelTxUs - destreqCtx.startTime));
+  stats_.phases->wire.record(std::max<int64_t>(0, ts.readUs - ts.kernelTxUs));
+  stats_.phases->processing.record(
+    std::max<int64_t>(0, destreqCtx.endTime - ts.readUs));
+}
+
+std::chrono::milliseconds ProxyDestination::requestTimeout(
+    std::chrono::milliseconds configured) const {
+  auto adaptive = adaptiveTimeout();
+  if (adaptive.count() == 0) {
+    return configured;
+  }
+  // Without an explicit upper bound, only ever tighten the configured one
+  if (proxy->opts.adaptive_timeout_max_ms == 0 && configured.count() != 0) {
+    return std::min(adaptive, configured);
+  }
+  return adaptive;
+}
+
+proxy_t* ProxyDestination::sharedConnectionOwner() {
+  auto maxQps = proxy->opts.shared_connection_max_qps;
+  if (maxQps == 0 || proxy->router == nullptr ||
+      proxy->opts.num_proxies < 2) {
+    return nullptr;
+  }
+
+  static constexpr int64_t kQpsWindowUs = 1000000;
+  auto now = nowUs();
+  auto elapsed = now - qpsWindowStartUs_;
+  if (elapsed >= kQpsWindowUs) {
+    hot_ = static_cast<int64_t>(qpsWindowRequests_) * kQpsWindowUs >=
+           static_cast<int64_t>(maxQps) * elapsed;
+    qpsWindowStartUs_ = now;
+    qpsWindowRequests_ = 0;
+  }
+  ++qpsWindowRequests_;
+  if (hot_) {
+    return nullptr;
+  }
+
+  auto ownerId = destinationId % proxy->opts.num_proxies;
+  auto owner = proxy->router->getProxy(ownerId);
+  return owner == proxy ? nullptr : owner;
 }
 
 size_t ProxyDestination::getPendingRequestCount() const {
-  return client_ ? client_->getPendingRequestCount() : 0;
+  size_t count = 0;
+  for (const auto& conn : connections_) {
+    if (conn.client) {
+      count += conn.client->getPendingRequestCount();
+    }
+  }
+  return count;
+}
+
+size_t ProxyDestination::getPendingRequestCount(
+    RequestPriority priority) const {
+  size_t count = 0;
+  for (const auto& conn : connections_) {
+    if (conn.client) {
+      count += conn.client->getPendingRequestCount(priority);
+    }
+  }
+  return count;
 }
 
 size_t ProxyDestination::getInflightRequestCount() const {
-  return client_ ? client_->getInflightRequestCount() : 0;
+  size_t count = 0;
+  for (const auto& conn : connections_) {
+    if (conn.client) {
+      count += conn.client->getInflightRequestCount();
+    }
+  }
+  return count;
+}
+
+size_t ProxyDestination::getBufferedBytes() const {
+  size_t bytes = 0;
+  for (const auto& conn : connections_) {
+    if (conn.client) {
+      bytes += conn.client->getBufferedBytes();
+    }
+  }
+  return bytes;
+}
+
+size_t ProxyDestination::getObjectBytes() const {
+  size_t bytes = sizeof(*this) + connections_.capacity() * sizeof(Connection);
+  if (recentLatency_) {
+    bytes += sizeof(DecayingHistogram);
+  }
+  for (const auto& conn : connections_) {
+    if (conn.client) {
+      bytes += sizeof(AsyncMcClient) + sizeof(AsyncMcClientImpl);
+    }
+  }
+  return bytes;
 }
 
 std::pair<uint64_t, uint64_t> ProxyDestination::getBatchingStat() const {
-  return client_ ? client_->getBatchingStat() : std::make_pair(0UL, 0UL);
+  auto stat = std::make_pair(0UL, 0UL);
+  for (const auto& conn : connections_) {
+    if (conn.client) {
+      auto connStat = conn.client->getBatchingStat();
+      stat.first += connStat.first;
+      stat.second += connStat.second;
+    }
+  }
+  return stat;
+}
+
+std::pair<uint64_t, uint64_t> ProxyDestination::getWriteCorkStat() const {
+  auto stat = std::make_pair(0UL, 0UL);
+  for (const auto& conn : connections_) {
+    if (conn.client) {
+      auto connStat = conn.client->getWriteCorkStat();
+      stat.first += connStat.first;
+      stat.second += connStat.second;
+    }
+  }
+  return stat;
 }
 
 std::shared_ptr<ProxyDestination> ProxyDestination::create(
     proxy_t* proxy,
-    const ProxyClientCommon& ro,
-    std::string pdstnKey) {
+    const ProxyClientCommon& ro) {
 
   auto ptr = std::shared_ptr<ProxyDestination>(
-    new ProxyDestination(proxy, ro, std::move(pdstnKey)));
+    new ProxyDestination(proxy, ro));
   ptr->selfPtr_ = ptr;
   return ptr;
 }
@@ -204,9 +381,11 @@ ProxyDestination::~ProxyDestination() {
     proxy->destinationMap->removeDestination(*this);
   }
 
-  if (client_) {
-    client_->setStatusCallbacks(nullptr, nullptr);
-    client_->closeNow();
+  for (auto& conn : connections_) {
+    if (conn.client) {
+      conn.client->setStatusCallbacks(nullptr, nullptr);
+      conn.client->closeNow();
+    }
   }
 
   stat_decr(proxy->stats, getStatName(stats_.state), 1);
@@ -214,17 +393,30 @@ ProxyDestination::~ProxyDestination() {
 }
 
 ProxyDestination::ProxyDestination(proxy_t* proxy_,
-                                   const ProxyClientCommon& ro_,
-                                   std::string pdstnKey_)
+                                   const ProxyClientCommon& ro_)
   : proxy(proxy_),
     accessPoint(ro_.ap),
-    pdstnKey(std::move(pdstnKey_)),
-    shortestTimeout_(ro_.server_timeout),
+    pdstnKey(ro_.destinationKey),
+    destinationId(ro_.destinationId),
+    largeLane_(proxy_->opts.large_request_lane_min_bytes > 0 &&
+               ro_.ap.getProtocol() == mc_ascii_protocol),
+    shortestTimeout_(ro_.pool.serverTimeout()),
     useSsl_(ro_.useSsl),
     qos_(ro_.qos),
     stats_(proxy_->opts),
     poolName_(ro_.pool.getName()) {
 
+  connections_.resize(
+    std::max<size_t>(1, proxy->opts.connections_per_destination) +
+    (largeLane_ ? 1 : 0));
+  if (largeLane_) {
+    largeKeyHints_.resize(std::max<size_t>(1, proxy->opts.large_key_hints));
+  }
+  if (proxy->opts.adaptive_timeout_p99_percent > 0) {
+    recentLatency_ = folly::make_unique<DecayingHistogram>(
+      std::max<size_t>(1, proxy->opts.adaptive_timeout_window));
+  }
+
   static uint64_t next_magic = 0x12345678900000LL;
   magic_ = __sync_fetch_and_add(&next_magic, 1);
   stat_incr(proxy->stats, num_servers_new_stat, 1);
@@ -234,26 +426,52 @@ bool ProxyDestination::may_send() const {
   return !tracker->isTko();
 }
 
+bool ProxyDestination::saturated() const {
+  auto limit = proxy->opts.target_saturated_pending_requests;
+  return limit != 0 && getPendingRequestCount() >= limit;
+}
+
 void ProxyDestination::resetInactive() {
-  // No need to reset non-existing client.
-  if (client_) {
-    client_->closeNow();
-    client_.reset();
+  for (auto& conn : connections_) {
+    // No need to reset non-existing client.
+    if (conn.client) {
+      conn.client->closeNow();
+      conn.client.reset();
+    }
   }
 }
 
-void ProxyDestination::initializeAsyncMcClient() {
+void ProxyDestination::initializeAsyncMcClient(size_t idx) {
   CHECK(proxy->eventBase);
-  assert(!client_);
+  auto& client = connections_[idx].client;
+  assert(!client);
 
   ConnectionOptions options(accessPoint);
   auto& opts = proxy->opts;
   options.noNetwork = opts.no_network;
   options.useNewAsciiParser = opts.new_ascii_parser;
+  options.useAsciiReplyFastPath = opts.ascii_reply_fast_path;
+  options.umbrellaBatching = opts.umbrella_batching;
+  options.writeCorkMaxDelay =
+    std::chrono::microseconds(opts.write_cork_max_delay_us);
+  options.writeCorkMaxRequests = opts.write_cork_max_requests;
+  options.writeCorkMaxBytes = opts.write_cork_max_bytes;
+  options.supersedePendingUpdates = opts.supersede_pending_updates;
+  options.priorityLanes = opts.destination_priority_lanes;
+  options.repliesPerRead = opts.replies_per_read;
+  options.maxReadBufferSize = std::max(options.minReadBufferSize,
+                                       opts.max_read_buffer_size);
   options.tcpKeepAliveCount = opts.keepalive_cnt;
   options.tcpKeepAliveIdle = opts.keepalive_idle_s;
   options.tcpKeepAliveInterval = opts.keepalive_interval_s;
+  options.busyPollUs = opts.proxy_busy_poll_us;
+  options.enableKernelTimestamps = opts.destination_kernel_timestamps;
   options.writeTimeout = shortestTimeout_;
+  options.connectThrottle = proxy->connectThrottle;
+  options.reconnectBackoffInitial =
+    std::chrono::milliseconds(opts.target_reconnect_backoff_initial_ms);
+  options.reconnectBackoffMax =
+    std::chrono::milliseconds(opts.target_reconnect_backoff_max_ms);
   if (proxy->opts.enable_qos) {
     options.enableQoS = true;
     options.qos = qos_;
@@ -268,71 +486,123 @@ void ProxyDestination::initializeAsyncMcClient() {
       return getSSLContext(opts.pem_cert_path, opts.pem_key_path,
                            opts.pem_ca_path);
     };
+    options.sslSessionResumption = opts.ssl_session_resumption;
   }
 
-  client_ = folly::make_unique<AsyncMcClient>(*proxy->eventBase,
-                                              std::move(options));
+  client = folly::make_unique<AsyncMcClient>(*proxy->eventBase,
+                                             std::move(options));
 
-  client_->setStatusCallbacks(
-    [this] () mutable {
-      setState(State::kUp);
+  client->setStatusCallbacks(
+    [this, idx] () mutable {
+      onConnectionUp(idx);
     },
-    [this] (bool aborting) mutable {
-      if (aborting) {
-        setState(State::kClosed);
-      } else {
-        setState(State::kDown);
-        handle_tko(McReply(mc_res_connect_error), /* is_probe_req= */ false);
-      }
+    [this, idx] (bool aborting) mutable {
+      onConnectionDown(idx, aborting);
     });
 
   if (opts.target_max_inflight_requests > 0) {
-    client_->setThrottle(opts.target_max_inflight_requests,
-                         opts.target_max_pending_requests);
+    client->setThrottle(opts.target_max_inflight_requests,
+                        opts.target_max_pending_requests);
   }
 }
 
-AsyncMcClient& ProxyDestination::getAsyncMcClient() {
-  if (!client_) {
-    initializeAsyncMcClient();
+void ProxyDestination::onConnectionUp(size_t idx) {
+  connections_[idx].up = true;
+  setState(State::kUp);
+}
+
+void ProxyDestination::onConnectionDown(size_t idx, bool aborting) {
+  connections_[idx].up = false;
+  // TKO tracking and state are per destination: losing one connection
+  // while others are still up is not a failure of the destination.
+  for (const auto& conn : connections_) {
+    if (conn.up) {
+      return;
+    }
+  }
+  if (aborting) {
+    setState(State::kClosed);
+  } else {
+    setState(State::kDown);
+    handle_tko(McReply(mc_res_connect_error), /* is_probe_req= */ false);
   }
-  return *client_;
 }
 
-void ProxyDestination::onTkoEvent(TkoLogEvent event, mc_res_t result) const {
-  auto logUtil = [this, result](folly::StringPiece eventStr) {
-    VLOG(1) << accessPoint.toHostPortString() << " (" << poolName_ << ") "
-            << eventStr << ". Total hard TKOs: "
-            << tracker->globalTkos().hardTkos << "; soft TKOs: "
-            << tracker->globalTkos().softTkos << ". Reply: "
-            << mc_res_to_string(result);
-  };
+size_t ProxyDestination::pickConnection() {
+  auto numConnections = numRegularConnections();
+  if (numConnections == 1) {
+    return 0;
+  }
+  if (proxy->opts.connection_round_robin) {
+    auto idx = nextConnection_;
+    nextConnection_ = (nextConnection_ + 1) % numConnections;
+    return idx;
+  }
+  size_t best = 0;
+  size_t bestInflight = std::numeric_limits<size_t>::max();
+  for (size_t i = 0; i < numConnections; ++i) {
+    const auto& client = connections_[i].client;
+    // A connection that was not created yet has nothing in flight.
+    auto inflight = client ? client->getInflightRequestCount() +
+                               client->getPendingRequestCount()
+                           : 0;
+    if (inflight < bestInflight) {
+      best = i;
+      bestInflight = inflight;
+      if (inflight == 0) {
+        break;
+      }
+    }
+  }
+  return best;
+}
 
-  switch (event) {
-    case TkoLogEvent::MarkHardTko:
-      logUtil("marked hard TKO");
-      break;
-    case TkoLogEvent::MarkSoftTko:
-      logUtil("marked soft TKO");
-      break;
-    case TkoLogEvent::UnMarkTko:
-      logUtil("unmarked TKO");
-      break;
-    case TkoLogEvent::RemoveFromConfig:
-      logUtil("was TKO, removed from config");
-      break;
+void ProxyDestination::connect() {
+  for (size_t idx = 0; idx < connections_.size(); ++idx) {
+    if (!connections_[idx].client) {
+      initializeAsyncMcClient(idx);
+    }
+    connections_[idx].client->connect();
   }
+}
+
+AsyncMcClient& ProxyDestination::getAsyncMcClient(bool large) {
+  auto idx = large ? connections_.size() - 1 : pickConnection();
+  if (!connections_[idx].client) {
+    initializeAsyncMcClient(idx);
+  }
+  return *connections_[idx].client;
+}
 
-  TkoLog tkoLog(accessPoint, tracker->globalTkos());
-  tkoLog.event = event;
-  tkoLog.isHardTko = tracker->isHardTko();
-  tkoLog.isSoftTko = tracker->isSoftTko();
-  tkoLog.avgLatency = stats_.avgLatency.value();
-  tkoLog.probesSent = stats_.probesSent;
-  tkoLog.poolName = poolName_;
-  tkoLog.result = result;
+void ProxyDestination::updateLargeKeyHint(uint32_t keyHash,
+                                          size_t valueBytes) {
+  auto& hint = largeKeyHints_[keyHash % largeKeyHints_.size()];
+  if (valueBytes >= proxy->opts.large_request_lane_min_bytes) {
+    hint = keyHash;
+  } else if (hint == keyHash) {
+    hint = 0;
+  }
+}
 
-  logTkoEvent(proxy, tkoLog);
+void ProxyDestination::onTkoEvent(TkoLogEvent event, mc_res_t result) const {
+  auto tkoLog = folly::make_unique<TkoLog>(accessPoint,
+                                           tracker->globalTkos());
+  tkoLog->event = event;
+  tkoLog->isHardTko = tracker->isHardTko();
+  tkoLog->isSoftTko = tracker->isSoftTko();
+  tkoLog->avgLatency = stats_.avgLatency.value();
+  tkoLog->probesSent = stats_.probesSent;
+  tkoLog->poolName = poolName_;
+  tkoLog->result = result;
+
+  if (proxy->opts.tko_log_interval_ms == 0) {
+    TkoLogQueue::logNow(proxy, *tkoLog);
+    return;
+  }
+  /* Logged in batches off the proxy thread, see TkoLogQueue */
+  if (!proxy->router->tkoLogQueue().push(proxy, std::move(tkoLog))) {
+    stat_incr(proxy->stats, tko_events_dropped_stat, 1);
+  }
 }
 
 void ProxyDestination::setState(State new_st) {
@@ -376,14 +646,19 @@ void ProxyDestination::updateShortestTimeout(
   }
   if (shortestTimeout_.count() == 0 || shortestTimeout_ > timeout) {
     shortestTimeout_ = timeout;
-    if (client_) {
-      client_->updateWriteTimeout(shortestTimeout_);
+    for (auto& conn : connections_) {
+      if (conn.client) {
+        conn.client->updateWriteTimeout(shortestTimeout_);
+      }
     }
   }
 }
 
 ProxyDestination::Stats::Stats(const McrouterOptions& opts)
-  : avgLatency(1.0 / opts.latency_window_size) {
+  : avgLatency(opts.latency_window_size) {
+  if (opts.destination_kernel_timestamps) {
+    phases = folly::make_unique<Phases>();
+  }
 }
 
 }}}  // facebook::memcache::mcrouter
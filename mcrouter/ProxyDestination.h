@@ -9,20 +9,25 @@
  */
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <folly/IntrusiveList.h>
+#include <folly/Optional.h>
+#include <folly/io/async/HHWheelTimer.h>
 
 #include "mcrouter/lib/network/AccessPoint.h"
 #include "mcrouter/lib/network/AsyncMcClient.h"
+#include "mcrouter/lib/network/McClientTimestamps.h"
 #include "mcrouter/config.h"
-#include "mcrouter/ExponentialSmoothData.h"
+#include "mcrouter/DecayingHistogram.h"
+#include "mcrouter/LatencyHistogram.h"
 #include "mcrouter/lib/McOperation.h"
 #include "mcrouter/TkoLog.h"
 
-using asox_timer_t = void*;
-
 namespace facebook { namespace memcache {
 
 class McReply;
@@ -30,12 +35,26 @@ class McRequest;
 
 namespace mcrouter {
 
-class DestinationRequestCtx;
 class ProxyClientCommon;
 class ProxyDestinationMap;
 class TkoTracker;
 class proxy_t;
 
+struct DestinationRequestCtx {
+  int64_t startTime{0};
+  int64_t endTime{0};
+  /* Set if traceWrite is true and the request was written to the socket */
+  int64_t writtenTime{0};
+  bool traceWrite{false};
+  /* If set, offered the hit while it's being read */
+  McReplyStream* replyStream{nullptr};
+  /* Filled with opts.destination_kernel_timestamps */
+  McClientTimestamps timestamps;
+
+  DestinationRequestCtx() : startTime(nowUs()) {
+  }
+};
+
 class ProxyDestination {
  public:
   enum class State {
@@ -48,26 +67,43 @@ class ProxyDestination {
 
   struct Stats {
     State state{State::kNew};
-    ExponentialSmoothData avgLatency;
+    // Recent latencies (opts.latency_window_size samples).
+    DecayingHistogram avgLatency;
+    // Written by the proxy thread, readable from any thread.
+    LatencyHistogram latency;
     uint64_t results[mc_nres] = {0};
     size_t probesSent{0};
 
+    // Reply latencies split by McClientTimestamps, nullptr unless
+    // opts.destination_kernel_timestamps. queue: from send to the kernel
+    // handing the request to the device, wire: from there until the reply
+    // is read (network and server), processing: from the read until the
+    // reply reaches the destination.
+    struct Phases {
+      LatencyHistogram queue;
+      LatencyHistogram wire;
+      LatencyHistogram processing;
+    };
+    std::unique_ptr<Phases> phases;
+
     explicit Stats(const McrouterOptions& opts);
   };
 
   proxy_t* proxy{nullptr}; ///< for convenience
-  const AccessPoint accessPoint;
-  const std::string pdstnKey;///< consists of ap, server_timeout
+  const AccessPoint& accessPoint;///< interned ProxyClientCommon::ap
+  const std::string& pdstnKey;///< interned ProxyClientCommon::destinationKey
+  const uint32_t destinationId;///< interned pdstnKey
 
   std::shared_ptr<TkoTracker> tracker;
 
   static std::shared_ptr<ProxyDestination> create(proxy_t* proxy,
-                                                  const ProxyClientCommon& ro,
-                                                  std::string pdstnKey);
+                                                  const ProxyClientCommon& ro);
 
   ~ProxyDestination();
 
   // This is a blocking call that will return reply, once it's ready.
+  // With opts.shared_connection_max_qps, requests of a cold destination
+  // go through the connection of the same destination in its owner proxy.
   template <int Op, class Request>
   typename ReplyType<McOperation<Op>, Request>::type
   send(const Request& request, McOperation<Op>, DestinationRequestCtx& req_ctx,
@@ -75,6 +111,13 @@ class ProxyDestination {
   // returns true if okay to send req using this client
   bool may_send() const;
 
+  /**
+   * True iff opts.target_saturated_pending_requests or more requests are
+   * waiting to be written, i.e. a new request would only add queueing
+   * delay (typically with target_max_inflight_requests throttling).
+   */
+  bool saturated() const;
+
   /**
    * @return stats for ProxyDestination
    */
@@ -84,9 +127,48 @@ class ProxyDestination {
 
   void resetInactive();
 
+  /**
+   * Opens all connections to this destination now, instead of
+   * on the first request. Must be called from the proxy thread.
+   */
+  void connect();
+
+  /**
+   * Smoothed latency (in us) of the latest replies, if there were at least
+   * minSamples replies since the previous call. Proxy thread only.
+   */
+  folly::Optional<double> latencySinceLastCheck(size_t minSamples);
+
+  /**
+   * Marks this destination soft TKO for being much slower than its peers
+   * and starts sending probes; a successful probe unmarks it.
+   * @return false if it's already TKO or no more soft TKOs are allowed
+   */
+  bool markLatencyOutlier();
+
+  /**
+   * Marks this destination TKO as the mcrouter we took over from had it
+   * (see TakeoverState) and starts sending probes. Proxy thread only.
+   * @return false if it's already TKO or no more soft TKOs are allowed
+   */
+  bool markInheritedTko(bool hard);
+
   size_t getPendingRequestCount() const;
+  size_t getPendingRequestCount(RequestPriority priority) const;
   size_t getInflightRequestCount() const;
 
+  /**
+   * Bytes buffered by the clients of this destination's connections,
+   * see AsyncMcClient::getBufferedBytes().
+   */
+  size_t getBufferedBytes() const;
+
+  /**
+   * Bytes of this object and of its connections' clients, not including
+   * what getBufferedBytes() reports.
+   */
+  size_t getObjectBytes() const;
+
   /**
    * Get average request batch size that is sent over network in one write.
    *
@@ -94,16 +176,64 @@ class ProxyDestination {
    */
   std::pair<uint64_t, uint64_t> getBatchingStat() const;
 
+  /**
+   * Get average time writes were held, see AsyncMcClient::getWriteCorkStat.
+   */
+  std::pair<uint64_t, uint64_t> getWriteCorkStat() const;
+
   void updateShortestTimeout(std::chrono::milliseconds timeout);
 
+  /**
+   * Timeout of a request to this destination, given the configured one
+   * (ProxyClientCommon::server_timeout). With
+   * opts.adaptive_timeout_p99_percent this is the adaptive timeout once
+   * there is one, see adaptiveTimeout().
+   */
+  std::chrono::milliseconds requestTimeout(
+      std::chrono::milliseconds configured) const;
+
+  /**
+   * opts.adaptive_timeout_p99_percent of the p99 latency of recent replies,
+   * clamped to opts.adaptive_timeout_min_ms/max_ms. 0 if adaptive timeouts
+   * are disabled or there were fewer than opts.adaptive_timeout_window
+   * replies yet. Readable from any thread.
+   */
+  std::chrono::milliseconds adaptiveTimeout() const {
+    return std::chrono::milliseconds(
+      adaptiveTimeoutMs_.load(std::memory_order_relaxed));
+  }
+
   void updatePoolName(std::string poolName) {
     poolName_ = std::move(poolName);
   }
 
+  /**
+   * Name of the pool this destination was last fetched for.
+   * Other threads may only call this under ProxyDestinationMap's lock
+   * (e.g. from foreachDestinationSynced).
+   */
+  const std::string& poolName() const {
+    return poolName_;
+  }
+
  private:
   static const uint64_t kDeadBeef = 0xdeadbeefdeadbeefULL;
 
-  std::unique_ptr<AsyncMcClient> client_;
+  struct Connection {
+    // Created lazily, on the first request routed to this connection.
+    std::unique_ptr<AsyncMcClient> client;
+    bool up{false};
+  };
+
+  // opts.connections_per_destination connections; the destination is up
+  // if any of them is up. With largeLane_, one more connection at the end
+  // is only used by large requests.
+  std::vector<Connection> connections_;
+  size_t nextConnection_{0};
+  const bool largeLane_{false};
+  // Routing key hashes of keys whose latest value was large, indexed by
+  // hash % size (0 if none). Only used with largeLane_.
+  std::vector<uint32_t> largeKeyHints_;
 
   // Shortest timeout among all ProxyClientCommon's using this destination
   std::chrono::milliseconds shortestTimeout_{0};
@@ -113,9 +243,33 @@ class ProxyDestination {
 
   Stats stats_;
 
+  class ProbeTimer : public folly::HHWheelTimer::Callback {
+   public:
+    explicit ProbeTimer(ProxyDestination& pdstn)
+      : pdstn_(pdstn) {
+    }
+
+    void timeoutExpired() noexcept override {
+      pdstn_.on_timer();
+    }
+
+   private:
+    ProxyDestination& pdstn_;
+  };
+
+  // stats_.latency.count() at the last latencySinceLastCheck()
+  uint64_t latencyCheckSamples_{0};
+
+  // With opts.adaptive_timeout_p99_percent: latencies of recent replies,
+  // replies until adaptiveTimeoutMs_ is recomputed and its current value
+  std::unique_ptr<DecayingHistogram> recentLatency_;
+  size_t adaptiveTimeoutSamples_{0};
+  std::atomic<int64_t> adaptiveTimeoutMs_{0};
+
   int probe_delay_next_ms{0};
   std::unique_ptr<McRequest> probe_req;
-  asox_timer_t probe_timer{nullptr};
+  // scheduled on proxy's probeTimer wheel while we're sending probes
+  ProbeTimer probeTimer_{*this};
   std::string poolName_;
 
   void setState(State st);
@@ -128,17 +282,73 @@ class ProxyDestination {
   void handle_tko(const McReply& reply, bool is_probe_req);
 
   // on probe timer
-  void on_timer(const asox_timer_t timer);
+  void on_timer();
 
   // Process tko, stats and duration timer.
   void onReply(const McReply& reply, DestinationRequestCtx& destreqCtx);
 
-  AsyncMcClient& getAsyncMcClient();
-  void initializeAsyncMcClient();
+  // Records latency of a reply, recomputes the adaptive timeout every
+  // 1/8 of opts.adaptive_timeout_window replies.
+  void recordLatency(int64_t latencyUs);
+  void recordPhases(const DestinationRequestCtx& destreqCtx);
+
+  /**
+   * Picks the connection for the next request (least inflight requests or
+   * round robin), connecting it if needed.
+   */
+  AsyncMcClient& getAsyncMcClient(bool large = false);
+  size_t pickConnection();
+  size_t numRegularConnections() const {
+    return connections_.size() - (largeLane_ ? 1 : 0);
+  }
+
+  /**
+   * True if the request should go through the large request lane:
+   * it has a large value, or its key had one the last time we saw it.
+   */
+  template <class Request>
+  bool isLargeRequest(const Request& request);
+
+  /**
+   * Remembers whether the key of a request that succeeded with
+   * valueBytes bytes of request and reply values is large.
+   */
+  void updateLargeKeyHint(uint32_t keyHash, size_t valueBytes);
+  void initializeAsyncMcClient(size_t idx);
+
+  void onConnectionUp(size_t idx);
+  void onConnectionDown(size_t idx, bool aborting);
+
+  template <int Op, class Request>
+  typename ReplyType<McOperation<Op>, Request>::type
+  sendLocal(const Request& request, McOperation<Op>,
+            DestinationRequestCtx& req_ctx,
+            std::chrono::milliseconds timeout);
+
+  template <int Op, class Request>
+  folly::Optional<typename ReplyType<McOperation<Op>, Request>::type>
+  sendShared(proxy_t& owner, const Request& request, McOperation<Op>,
+             DestinationRequestCtx& req_ctx,
+             std::chrono::milliseconds timeout);
+
+  /**
+   * Counts a request and decides where it goes.
+   * @return  proxy owning the shared connection to this destination,
+   *          or nullptr to send through our own connection
+   */
+  proxy_t* sharedConnectionOwner();
+
+  // Stats of a reply received through the owner's connection, TKOs are
+  // tracked by the owner.
+  void onSharedReply(const McReply& reply, DestinationRequestCtx& destreqCtx);
+
+  // Requests since qpsWindowStartUs_, see sharedConnectionOwner()
+  int64_t qpsWindowStartUs_{0};
+  size_t qpsWindowRequests_{0};
+  bool hot_{false};
 
   ProxyDestination(proxy_t* proxy,
-                   const ProxyClientCommon& ro,
-                   std::string pdstnKey);
+                   const ProxyClientCommon& ro);
 
   void onTkoEvent(TkoLogEvent event, mc_res_t result) const;
 
@@ -9,6 +9,11 @@
  */
 #include "ProxyDestinationMap.h"
 
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
 #include <folly/io/async/EventBase.h>
 #include <folly/Memory.h>
 
@@ -19,6 +24,7 @@
 #include "mcrouter/proxy.h"
 #include "mcrouter/ProxyClientCommon.h"
 #include "mcrouter/ProxyDestination.h"
+#include "mcrouter/TkoTracker.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
@@ -29,6 +35,16 @@ void onResetTimer(const asox_timer_t timer, void* arg) {
   map->resetAllInactive();
 }
 
+void onPreconnectTimer(const asox_timer_t timer, void* arg) {
+  auto map = reinterpret_cast<ProxyDestinationMap*>(arg);
+  map->preconnectQueued();
+}
+
+void onLatencyOutlierTimer(const asox_timer_t timer, void* arg) {
+  auto map = reinterpret_cast<ProxyDestinationMap*>(arg);
+  map->ejectLatencyOutliers();
+}
+
 } // namespace
 
 struct ProxyDestinationMap::StateList {
@@ -41,33 +57,46 @@ ProxyDestinationMap::ProxyDestinationMap(proxy_t* proxy)
   : proxy_(proxy),
     active_(folly::make_unique<StateList>()),
     inactive_(folly::make_unique<StateList>()),
-    resetTimer_(nullptr) {
+    resetting_(folly::make_unique<StateList>()),
+    resetTimer_(nullptr),
+    preconnectTimer_(nullptr),
+    latencyOutlierTimer_(nullptr) {
 }
 
 std::shared_ptr<ProxyDestination>
 ProxyDestinationMap::fetch(const ProxyClientCommon& client) {
-  auto key = client.genProxyDestinationKey(
-    !proxy_->router->opts().same_connection_any_timeout);
+  auto id = client.destinationId;
   std::shared_ptr<ProxyDestination> destination;
+  bool created = false;
   {
-    std::lock_guard<std::mutex> lck(destinationsLock_);
+    auto& bucket = bucketFor(id);
+    std::lock_guard<std::mutex> lck(bucket.lock);
 
-    auto it = destinations_.find(key);
-    if (it != destinations_.end()) {
-      destination = it->second.lock();
+    auto index = indexInBucket(id);
+    if (index >= bucket.destinations.size()) {
+      bucket.destinations.resize(index + 1);
     }
+    destination = bucket.destinations[index].lock();
     if (!destination) {
-      destination = ProxyDestination::create(proxy_, client, key);
-      destinations_[std::move(key)] = destination;
+      destination = ProxyDestination::create(proxy_, client);
+      bucket.destinations[index] = destination;
+      created = true;
     } else {
       destination->updatePoolName(client.pool.getName());
-      destination->updateShortestTimeout(client.server_timeout);
+      destination->updateShortestTimeout(client.pool.serverTimeout());
     }
   }
 
+  if (created && proxy_->opts.preconnect_destinations) {
+    std::lock_guard<std::mutex> lck(preconnectLock_);
+    preconnectQueue_.push_back(destination);
+  }
+
   // Update shared area of ProxyDestinations with same key from different
   // threads. This shared area is represented with ProxyClientShared class.
-  if (proxy_->router != nullptr) {
+  // The tracker is keyed by the access point, which existing destinations
+  // keep, so only new ones need to look it up.
+  if (created && proxy_->router != nullptr) {
     proxy_->router->tkoTrackerMap().updateTracker(
         *destination,
         proxy_->router->opts().failures_until_tko,
@@ -77,15 +106,31 @@ ProxyDestinationMap::fetch(const ProxyClientCommon& client) {
   return destination;
 }
 
+std::shared_ptr<ProxyDestination>
+ProxyDestinationMap::find(uint32_t destinationId) {
+  auto& bucket = bucketFor(destinationId);
+  std::lock_guard<std::mutex> lck(bucket.lock);
+  auto index = indexInBucket(destinationId);
+  return index < bucket.destinations.size()
+    ? bucket.destinations[index].lock()
+    : nullptr;
+}
+
 void ProxyDestinationMap::removeDestination(ProxyDestination& destination) {
-  if (destination.stateList_ == active_.get()) {
-    active_->list.erase(StateList::List::s_iterator_to(destination));
-  } else if (destination.stateList_ == inactive_.get()) {
-    inactive_->list.erase(StateList::List::s_iterator_to(destination));
+  for (auto stateList : {active_.get(), inactive_.get(), resetting_.get()}) {
+    if (destination.stateList_ == stateList) {
+      stateList->list.erase(StateList::List::s_iterator_to(destination));
+      break;
+    }
   }
   {
-    std::lock_guard<std::mutex> lck(destinationsLock_);
-    destinations_.erase(destination.pdstnKey);
+    auto& bucket = bucketFor(destination.destinationId);
+    std::lock_guard<std::mutex> lck(bucket.lock);
+    auto& slot = bucket.destinations[indexInBucket(destination.destinationId)];
+    /* Might already hold a new destination with the same id */
+    if (slot.expired()) {
+      slot.reset();
+    }
   }
 }
 
@@ -95,6 +140,8 @@ void ProxyDestinationMap::markAsActive(ProxyDestination& destination) {
   }
   if (destination.stateList_ == inactive_.get()) {
     inactive_->list.erase(StateList::List::s_iterator_to(destination));
+  } else if (destination.stateList_ == resetting_.get()) {
+    resetting_->list.erase(StateList::List::s_iterator_to(destination));
   }
   active_->list.push_back(destination);
   destination.stateList_ = active_.get();
@@ -102,11 +149,27 @@ void ProxyDestinationMap::markAsActive(ProxyDestination& destination) {
 
 void ProxyDestinationMap::resetAllInactive() {
   for (auto& it : inactive_->list) {
-    it.resetInactive();
-    it.stateList_ = nullptr;
+    it.stateList_ = resetting_.get();
   }
-  inactive_->list.clear();
+  resetting_->list.splice(resetting_->list.end(), inactive_->list);
   active_.swap(inactive_);
+
+  if (!resetting_->list.empty() &&
+      !resetCallback_.isLoopCallbackScheduled()) {
+    proxy_->eventBase->runInLoop(&resetCallback_);
+  }
+}
+
+void ProxyDestinationMap::resetSome() {
+  for (size_t i = 0; i < kResetBatchSize && !resetting_->list.empty(); ++i) {
+    auto& destination = resetting_->list.front();
+    resetting_->list.pop_front();
+    destination.stateList_ = nullptr;
+    destination.resetInactive();
+  }
+  if (!resetting_->list.empty()) {
+    proxy_->eventBase->runInLoop(&resetCallback_);
+  }
 }
 
 void ProxyDestinationMap::setResetTimer(std::chrono::milliseconds interval) {
@@ -116,10 +179,139 @@ void ProxyDestinationMap::setResetTimer(std::chrono::milliseconds interval) {
                                onResetTimer, this);
 }
 
+void ProxyDestinationMap::setPreconnectTimer(
+    std::chrono::milliseconds interval) {
+  assert(interval.count() > 0);
+  auto delay = to<timeval_t>((unsigned int)interval.count());
+  preconnectTimer_ = asox_add_timer(proxy_->eventBase->getLibeventBase(),
+                                    delay, onPreconnectTimer, this);
+}
+
+void ProxyDestinationMap::preconnectQueued() {
+  std::vector<std::shared_ptr<ProxyDestination>> batch;
+  {
+    std::lock_guard<std::mutex> lck(preconnectLock_);
+    while (!preconnectQueue_.empty() &&
+           batch.size() < proxy_->opts.preconnect_batch_size) {
+      /* Destinations already gone with their config are skipped */
+      if (auto destination = preconnectQueue_.front().lock()) {
+        batch.push_back(std::move(destination));
+      }
+      preconnectQueue_.pop_front();
+    }
+  }
+  for (auto& destination : batch) {
+    destination->connect();
+  }
+}
+
+void ProxyDestinationMap::setLatencyOutlierTimer(
+    std::chrono::milliseconds interval) {
+  assert(interval.count() > 0);
+  auto delay = to<timeval_t>((unsigned int)interval.count());
+  latencyOutlierTimer_ = asox_add_timer(proxy_->eventBase->getLibeventBase(),
+                                        delay, onLatencyOutlierTimer, this);
+}
+
+void ProxyDestinationMap::ejectLatencyOutliers() {
+  auto factor = proxy_->opts.latency_outlier_factor;
+  if (factor == 0 || proxy_->opts.disable_tko_tracking) {
+    return;
+  }
+
+  std::unordered_map<std::string,
+                     std::vector<std::shared_ptr<ProxyDestination>>> pools;
+  for (auto& bucket : buckets_) {
+    std::lock_guard<std::mutex> lock(bucket.lock);
+    for (auto& it : bucket.destinations) {
+      auto destination = it.lock();
+      if (destination && destination->tracker &&
+          !destination->poolName().empty()) {
+        pools[destination->poolName()].push_back(std::move(destination));
+      }
+    }
+  }
+
+  std::vector<std::pair<double, ProxyDestination*>> latencies;
+  std::vector<double> sorted;
+  for (auto& pool : pools) {
+    auto& destinations = pool.second;
+    size_t tkos = 0;
+    latencies.clear();
+    for (auto& destination : destinations) {
+      if (destination->tracker->isTko()) {
+        ++tkos;
+      } else if (auto latency =
+                   destination->latencySinceLastCheck(kMinLatencySamples)) {
+        latencies.emplace_back(*latency, destination.get());
+      }
+    }
+    auto maxTkos =
+      destinations.size() * proxy_->opts.latency_outlier_max_percent / 100;
+    if (latencies.size() < kMinLatencyPeers || tkos >= maxTkos) {
+      continue;
+    }
+
+    sorted.clear();
+    for (const auto& it : latencies) {
+      sorted.push_back(it.first);
+    }
+    auto mid = sorted.begin() + sorted.size() / 2;
+    std::nth_element(sorted.begin(), mid, sorted.end());
+    auto threshold = *mid * factor;
+
+    std::sort(latencies.begin(), latencies.end(),
+              [](const std::pair<double, ProxyDestination*>& a,
+                 const std::pair<double, ProxyDestination*>& b) {
+                return a.first > b.first;
+              });
+    for (const auto& it : latencies) {
+      if (tkos >= maxTkos || it.first <= threshold) {
+        break;
+      }
+      if (it.second->markLatencyOutlier()) {
+        ++tkos;
+      }
+    }
+  }
+}
+
+void ProxyDestinationMap::markInheritedTkos(
+    const std::unordered_map<std::string, bool>& tkos) {
+  if (tkos.empty()) {
+    return;
+  }
+  std::vector<std::pair<std::shared_ptr<ProxyDestination>, bool>> marked;
+  for (auto& bucket : buckets_) {
+    std::lock_guard<std::mutex> lock(bucket.lock);
+    for (auto& it : bucket.destinations) {
+      auto destination = it.lock();
+      if (!destination) {
+        continue;
+      }
+      auto tko = tkos.find(destination->accessPoint.toHostPortString());
+      if (tko != tkos.end()) {
+        marked.emplace_back(std::move(destination), tko->second);
+      }
+    }
+  }
+  /* Not under bucket locks: marking logs and schedules probes */
+  for (auto& it : marked) {
+    it.first->markInheritedTko(it.second);
+  }
+}
+
 ProxyDestinationMap::~ProxyDestinationMap() {
+  resetCallback_.cancelLoopCallback();
   if (resetTimer_ != nullptr) {
     asox_remove_timer(resetTimer_);
   }
+  if (preconnectTimer_ != nullptr) {
+    asox_remove_timer(preconnectTimer_);
+  }
+  if (latencyOutlierTimer_ != nullptr) {
+    asox_remove_timer(latencyOutlierTimer_);
+  }
 }
 
 }}} // facebook::memcache::mcrouter
@@ -9,11 +9,16 @@
  */
 #pragma once
 
+#include <array>
 #include <chrono>
+#include <deque>
 #include <memory>
 #include <mutex>
 #include <string>
 #include <unordered_map>
+#include <vector>
+
+#include <folly/io/async/EventBase.h>
 
 using asox_timer_t = void*;
 
@@ -36,6 +41,11 @@ class proxy_t;
  * opened connection to this destination and there were requests during last
  * reset_inactive_connection_interval ms routed to this destination.
  * 'Inactive' means there were no requests and connection may be closed.
+ *
+ * Destinations are split over kNumBuckets independently locked buckets,
+ * so that walking them (e.g. for stats) holds off lookups only briefly.
+ * Each bucket is a flat vector indexed by interned destination id,
+ * config loads don't build or hash destination key strings.
  */
 class ProxyDestinationMap {
  public:
@@ -47,6 +57,13 @@ class ProxyDestinationMap {
    */
   std::shared_ptr<ProxyDestination> fetch(const ProxyClientCommon& client);
 
+  /**
+   * @return  destination with this ProxyClientCommon::destinationId
+   *          or nullptr. Only the proxy thread may release the returned
+   *          pointer.
+   */
+  std::shared_ptr<ProxyDestination> find(uint32_t destinationId);
+
   /**
    * Remove destination from both active and inactive lists
    */
@@ -61,6 +78,9 @@ class ProxyDestinationMap {
   /**
    * Close all 'inactive' destinations i.e. destinations which weren't marked
    * 'active' after last removeAllInactive call.
+   * They are closed kResetBatchSize per event loop iteration, so that a lot
+   * of them don't stall the proxy thread. Destinations marked active in the
+   * meantime are kept open.
    */
   void resetAllInactive();
 
@@ -70,18 +90,65 @@ class ProxyDestinationMap {
    */
   void setResetTimer(std::chrono::milliseconds interval);
 
+  /**
+   * Set timer which connects destinations created since the last run,
+   * at most opts.preconnect_batch_size of them per run.
+   * Destinations are only queued for it with opts.preconnect_destinations.
+   * @param interval timer interval, should be greater than zero.
+   */
+  void setPreconnectTimer(std::chrono::milliseconds interval);
+
+  /**
+   * Starts connecting up to opts.preconnect_batch_size queued destinations.
+   */
+  void preconnectQueued();
+
+  /**
+   * Set timer which marks latency outliers soft TKO,
+   * see ejectLatencyOutliers().
+   * @param interval timer interval, should be greater than zero.
+   */
+  void setLatencyOutlierTimer(std::chrono::milliseconds interval);
+
+  /**
+   * Compares the recent latencies of destinations within each pool and
+   * marks the ones over opts.latency_outlier_factor times the pool median
+   * soft TKO, slowest first, until opts.latency_outlier_max_percent of
+   * the pool is TKO. Pools with fewer than kMinLatencyPeers measured
+   * destinations are skipped.
+   */
+  void ejectLatencyOutliers();
+
+  /**
+   * Marks destinations TKO as the mcrouter we took over from had them.
+   * Only one proxy gets to mark (and probe) each of them, so every proxy
+   * can be given the same tkos.
+   *
+   * @param tkos  host:port => is it hard TKO
+   */
+  void markInheritedTkos(const std::unordered_map<std::string, bool>& tkos);
+
   /**
    * Calls f(const ProxyDestination&) for each destination stored
-   * in ProxyDestinationMap. The whole map is locked during the call.
+   * in ProxyDestinationMap. Each bucket is only locked while its
+   * destinations are copied, so f never blocks the proxy thread
+   * adding or removing destinations.
    *
    * TODO: replace with getStats()
    */
   template <typename Func>
   void foreachDestinationSynced(Func&& f) {
-    std::lock_guard<std::mutex> lock(destinationsLock_);
-    for (auto& it : destinations_) {
-      if (std::shared_ptr<const ProxyDestination> d = it.second.lock()) {
-        f(*d);
+    std::vector<std::weak_ptr<ProxyDestination>> snapshot;
+    for (auto& bucket : buckets_) {
+      {
+        std::lock_guard<std::mutex> lock(bucket.lock);
+        snapshot.assign(bucket.destinations.begin(),
+                        bucket.destinations.end());
+      }
+      for (auto& it : snapshot) {
+        if (std::shared_ptr<const ProxyDestination> d = it.lock()) {
+          f(*d);
+        }
       }
     }
   }
@@ -91,15 +158,57 @@ class ProxyDestinationMap {
  private:
   struct StateList;
 
+  static constexpr size_t kNumBuckets = 64;
+  static constexpr size_t kResetBatchSize = 100;
+  static constexpr size_t kMinLatencyPeers = 3;
+  /* Replies since the last check needed to compare a destination */
+  static constexpr size_t kMinLatencySamples = 10;
+
+  struct Bucket {
+    /* Indexed by destinationId / kNumBuckets */
+    std::vector<std::weak_ptr<ProxyDestination>> destinations;
+    std::mutex lock;
+  };
+
+  class ResetCallback : public folly::EventBase::LoopCallback {
+   public:
+    explicit ResetCallback(ProxyDestinationMap& map) : map_(map) {}
+
+    void runLoopCallback() noexcept override {
+      map_.resetSome();
+    }
+
+   private:
+    ProxyDestinationMap& map_;
+  };
+
   proxy_t* proxy_;
-  std::unordered_map<std::string, std::weak_ptr<ProxyDestination>>
-    destinations_;
-  std::mutex destinationsLock_;
+  std::array<Bucket, kNumBuckets> buckets_;
+
+  /* New destinations to connect */
+  std::deque<std::weak_ptr<ProxyDestination>> preconnectQueue_;
+  std::mutex preconnectLock_;
 
   std::unique_ptr<StateList> active_;
   std::unique_ptr<StateList> inactive_;
+  /* Inactive destinations still to be closed by resetSome() */
+  std::unique_ptr<StateList> resetting_;
+  ResetCallback resetCallback_{*this};
 
   asox_timer_t resetTimer_;
+  asox_timer_t preconnectTimer_;
+  asox_timer_t latencyOutlierTimer_;
+
+  Bucket& bucketFor(uint32_t destinationId) {
+    return buckets_[destinationId % kNumBuckets];
+  }
+
+  static size_t indexInBucket(uint32_t destinationId) {
+    return destinationId / kNumBuckets;
+  }
+
+  /* Closes up to kResetBatchSize destinations from resetting_ */
+  void resetSome();
 };
 
 }}} // facebook::memcache::mcrouter
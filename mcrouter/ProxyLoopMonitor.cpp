@@ -0,0 +1,235 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "ProxyLoopMonitor.h"
+
+#include <execinfo.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <mutex>
+
+#include <glog/logging.h>
+
+#include <folly/io/async/EventBase.h>
+#include <folly/ThreadName.h>
+
+#include "mcrouter/config.h"
+#include "mcrouter/lib/fbi/asox_timer.h"
+#include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/McrouterInstance.h"
+#include "mcrouter/McrouterLogFailure.h"
+#include "mcrouter/proxy.h"
+#include "mcrouter/stats.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+/* Sent to a stalled proxy thread to dump its stack */
+const int kStackSignal = SIGURG;
+const int kMaxStackFrames = 64;
+
+/* Handler of the application we're embedded in, see onStackSignal() */
+struct sigaction gPrevStackAction;
+std::once_flag gStackActionInstalled;
+/* Signals sent by watchdogs that no handler has taken yet */
+std::atomic<int> gStackDumpsRequested{0};
+
+void dumpStack() {
+  /* Async signal safe, except for the first backtrace() call which
+     ProxyStallWatchdog::start() makes upfront */
+  static const char kHeader[] = "mcrouter: stalled proxy thread stack:\n";
+  auto rc = ::write(STDERR_FILENO, kHeader, sizeof(kHeader) - 1);
+  (void)rc;
+  void* frames[kMaxStackFrames];
+  auto n = backtrace(frames, kMaxStackFrames);
+  backtrace_symbols_fd(frames, n, STDERR_FILENO);
+}
+
+/**
+ * SIGURG is also the application's (out of band socket data, or its own
+ * use): only signals a watchdog sent to a thread of ours dump the stack,
+ * all others go to the handler installed before us.
+ */
+void onStackSignal(int sig, siginfo_t* info, void* context) {
+  if (info != nullptr && info->si_code == SI_TKILL &&
+      info->si_pid == getpid()) {
+    auto requested = gStackDumpsRequested.load();
+    while (requested > 0) {
+      if (gStackDumpsRequested.compare_exchange_weak(requested,
+                                                     requested - 1)) {
+        dumpStack();
+        return;
+      }
+    }
+  }
+
+  if (gPrevStackAction.sa_flags & SA_SIGINFO) {
+    if (gPrevStackAction.sa_sigaction != nullptr) {
+      gPrevStackAction.sa_sigaction(sig, info, context);
+    }
+  } else if (gPrevStackAction.sa_handler != SIG_DFL &&
+             gPrevStackAction.sa_handler != SIG_IGN) {
+    /* SIGURG is ignored by default */
+    gPrevStackAction.sa_handler(sig);
+  }
+}
+
+void installStackAction() {
+  /* backtrace() may allocate on its first call, not in a signal handler */
+  void* frame;
+  backtrace(&frame, 1);
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_sigaction = onStackSignal;
+  sa.sa_flags = SA_RESTART | SA_SIGINFO;
+  sigemptyset(&sa.sa_mask);
+  if (sigaction(kStackSignal, &sa, &gPrevStackAction) != 0) {
+    PLOG(ERROR) << "Can not install the stalled proxy stack dump handler";
+  }
+}
+
+}  // anonymous namespace
+
+constexpr std::chrono::milliseconds ProxyLoopMonitor::kTickInterval;
+
+ProxyLoopMonitor::ProxyLoopMonitor(proxy_t& proxy)
+    : proxy_(proxy) {
+}
+
+ProxyLoopMonitor::~ProxyLoopMonitor() {
+  if (timer_ != nullptr) {
+    asox_remove_timer(timer_);
+  }
+}
+
+void ProxyLoopMonitor::start() {
+  assert(timer_ == nullptr);
+  auto delay = to<timeval_t>((unsigned int)kTickInterval.count());
+  timer_ = asox_add_timer(proxy_.eventBase->getLibeventBase(), delay,
+                          onTick, this);
+}
+
+void ProxyLoopMonitor::onTick(void* timer, void* arg) {
+  auto& monitor = *reinterpret_cast<ProxyLoopMonitor*>(arg);
+  auto now = nowUs();
+  auto last = monitor.heartbeatUs_.load(std::memory_order_relaxed);
+  if (last == 0) {
+    monitor.thread_ = pthread_self();
+  } else {
+    auto intervalUs = kTickInterval.count() * 1000;
+    monitor.loopLagUs.record(std::max<int64_t>(0, now - last - intervalUs));
+  }
+  monitor.heartbeatUs_.store(now, std::memory_order_release);
+}
+
+ProxyStallWatchdog::ProxyStallWatchdog(McrouterInstance* router)
+    : router_(router),
+      pid_(getpid()) {
+}
+
+ProxyStallWatchdog::~ProxyStallWatchdog() {
+  stop();
+}
+
+bool ProxyStallWatchdog::start() {
+  if (running_ || router_->opts().proxy_stall_threshold_ms == 0) {
+    return false;
+  }
+
+  /* Once per process: every router shares it, and it chains to the
+     application's handler, so it's never uninstalled */
+  std::call_once(gStackActionInstalled, installStackAction);
+
+  reported_.assign(router_->opts().num_proxies, 0);
+  running_ = true;
+  const std::string threadName = "mcrtr-watchdog";
+  try {
+    thread_ = std::thread([this]() { run(); });
+    folly::setThreadName(thread_.native_handle(), threadName);
+  } catch (const std::system_error& e) {
+    running_ = false;
+    logFailure(router_, memcache::failure::Category::kSystemError,
+               "Can not start ProxyStallWatchdog thread {}: {}",
+               threadName, e.what());
+  }
+
+  return running_;
+}
+
+void ProxyStallWatchdog::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_) {
+      return;
+    }
+    running_ = false;
+  }
+  cv_.notify_all();
+  if (thread_.joinable()) {
+    if (getpid() == pid_) {
+      thread_.join();
+    } else {
+      thread_.detach();
+    }
+  }
+}
+
+void ProxyStallWatchdog::run() {
+  router_->startupLock().wait();
+  std::chrono::milliseconds interval(
+    std::max(1u, router_->opts().proxy_stall_threshold_ms / 2));
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (running_) {
+    cv_.wait_for(lock, interval);
+    if (!running_) {
+      break;
+    }
+    lock.unlock();
+    check();
+    lock.lock();
+  }
+}
+
+void ProxyStallWatchdog::check() {
+  int64_t thresholdUs = router_->opts().proxy_stall_threshold_ms * 1000LL;
+  int64_t tickUs = ProxyLoopMonitor::kTickInterval.count() * 1000;
+  try {
+    std::lock_guard<ShutdownLock> lg(router_->shutdownLock());
+    auto now = nowUs();
+    for (size_t i = 0; i < reported_.size(); ++i) {
+      auto proxy = router_->getProxy(i);
+      const auto& monitor = proxy->loopMonitor;
+      auto heartbeatUs = monitor.heartbeatUs();
+      /* Report each stall once, while it's still going on so that
+         the stack shows what the thread is stuck on */
+      if (heartbeatUs == 0 || reported_[i] == heartbeatUs ||
+          now - heartbeatUs - tickUs < thresholdUs) {
+        continue;
+      }
+      reported_[i] = heartbeatUs;
+      stat_incr_safe(proxy->stats, proxy_stalls_stat);
+      LOG(WARNING) << "Proxy " << i << " event loop stalled for "
+                   << (now - heartbeatUs) / 1000 << "ms, stack follows";
+      ++gStackDumpsRequested;
+      if (pthread_kill(monitor.thread(), kStackSignal) != 0) {
+        --gStackDumpsRequested;
+      }
+    }
+  } catch (const shutdown_started_exception& e) {
+  }
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,122 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "mcrouter/LatencyHistogram.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+class McrouterInstance;
+class proxy_t;
+
+/**
+ * Measures how long a proxy thread keeps work waiting:
+ *   loopLagUs: lateness of a timer firing every kTickInterval, i.e. how
+ *     long event loop iterations kept the thread from its timers;
+ *   queueWaitUs: time messages spent in proxy_t::messageQueue;
+ *   fiberWaitUs: time request fibers waited to be started by
+ *     proxy_t::fiberManager.
+ * Histograms are written by the proxy thread, read from any thread.
+ */
+class ProxyLoopMonitor {
+ public:
+  static constexpr std::chrono::milliseconds kTickInterval{10};
+
+  LatencyHistogram loopLagUs;
+  LatencyHistogram queueWaitUs;
+  LatencyHistogram fiberWaitUs;
+
+  explicit ProxyLoopMonitor(proxy_t& proxy);
+  ~ProxyLoopMonitor();
+
+  /**
+   * Starts the tick timer on the proxy's event base.
+   */
+  void start();
+
+  /**
+   * @return  Last time (as in nowUs()) the proxy thread ran the tick timer,
+   *          0 if it never did.
+   */
+  int64_t heartbeatUs() const {
+    return heartbeatUs_.load(std::memory_order_acquire);
+  }
+
+  /**
+   * Proxy thread, valid once heartbeatUs() is not 0.
+   */
+  pthread_t thread() const {
+    return thread_;
+  }
+
+ private:
+  proxy_t& proxy_;
+  void* timer_{nullptr};
+  pthread_t thread_;
+  std::atomic<int64_t> heartbeatUs_{0};
+
+  static void onTick(void* timer, void* arg);
+
+  ProxyLoopMonitor(const ProxyLoopMonitor&) = delete;
+  ProxyLoopMonitor& operator=(const ProxyLoopMonitor&) = delete;
+};
+
+/**
+ * Watches all proxies' heartbeats from a thread of its own and logs proxy
+ * threads that didn't run their event loop for more than
+ * opts.proxy_stall_threshold_ms, along with their stack: the stalled
+ * thread is sent SIGURG, which writes its backtrace to stderr. Other
+ * SIGURGs still go to the handler the application had installed.
+ */
+class ProxyStallWatchdog {
+ public:
+  explicit ProxyStallWatchdog(McrouterInstance* router);
+
+  ~ProxyStallWatchdog();
+
+  /**
+   * @return True if the watchdog is running, false if
+   *         opts.proxy_stall_threshold_ms is not set.
+   */
+  bool start();
+
+  /**
+   * Stops the watchdog thread and joins it.
+   */
+  void stop();
+
+ private:
+  McrouterInstance* router_;
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool running_{false};
+  pid_t pid_;
+  /* Per proxy: heartbeat of the stall that was last reported */
+  std::vector<int64_t> reported_;
+
+  void run();
+  void check();
+
+  ProxyStallWatchdog(const ProxyStallWatchdog&) = delete;
+  ProxyStallWatchdog& operator=(const ProxyStallWatchdog&) = delete;
+};
+
+}}}  // facebook::memcache::mcrouter
@@ -9,9 +9,11 @@
  */
 #include "ProxyRequestContext.h"
 
+#include <folly/Conv.h>
 #include <folly/Memory.h>
 
 #include "mcrouter/config.h"
+#include "mcrouter/lib/routes/WarmUpFillQueue.h"
 #include "mcrouter/McrouterClient.h"
 #include "mcrouter/proxy.h"
 
@@ -27,7 +29,25 @@ ProxyRequestContext::ProxyRequestContext(
       context_(context),
       enqueueReply_(enqReply),
       reqComplete_(reqComplete) {
+  init(std::move(req));
+}
+
+ProxyRequestContext::ProxyRequestContext(
+  proxy_t& pr,
+  McRequest req,
+  mc_op_t op,
+  void (*enqReply)(ProxyRequestContext& preq),
+  void* context)
+    : proxy_(pr),
+      savedRequest_(std::move(req)),
+      context_(context),
+      enqueueReply_(enqReply) {
+  /* The msg must reference the request at its final place,
+     since short keys are stored inside the request */
+  init(savedRequest_->dependentMsg(op));
+}
 
+void ProxyRequestContext::init(McMsgRef req) {
   logger_.emplace(&proxy_);
   additionalLogger_.emplace(&proxy_);
 
@@ -46,9 +66,33 @@ ProxyRequestContext::ProxyRequestContext(
     origReq_ = std::move(req);
   }
 
+  if (proxy_.opts.request_deadline_ms != 0) {
+    deadlineUs_ = nowUs() + proxy_.opts.request_deadline_ms * 1000LL;
+  }
+
   stat_incr_safe(proxy_.stats, proxy_request_num_outstanding_stat);
 }
 
+void ProxyRequestContext::onRetryDenied() {
+  stat_incr(proxy_.stats, retry_budget_denied_stat, 1);
+}
+
+void ProxyRequestContext::onWarmUpFill(WarmUpFillEvent event) {
+  switch (event) {
+    case WarmUpFillEvent::Queued:
+      break;
+    case WarmUpFillEvent::Sent:
+      stat_incr(proxy_.stats, warmup_fills_stat, 1);
+      break;
+    case WarmUpFillEvent::Deduplicated:
+      stat_incr(proxy_.stats, warmup_fills_deduplicated_stat, 1);
+      break;
+    case WarmUpFillEvent::Dropped:
+      stat_incr(proxy_.stats, warmup_fills_dropped_stat, 1);
+      break;
+  }
+}
+
 ProxyRequestContext::~ProxyRequestContext() {
   if (recording_) {
     recordingState_.~unique_ptr<RecordingState>();
@@ -61,8 +105,12 @@ ProxyRequestContext::~ProxyRequestContext() {
   }
 
   if (processing_) {
+    if (tenant_ >= 0) {
+      --proxy_.tenants_[tenant_]->inflight;
+    }
     --proxy_.numRequestsProcessing_;
     stat_decr(proxy_.stats, proxy_reqs_processing_stat, 1);
+    proxy_.publishLoad();
     proxy_.pump();
   }
 
@@ -76,6 +124,20 @@ ProxyRequestContext::~ProxyRequestContext() {
   stat_decr_safe(proxy_.stats, proxy_request_num_outstanding_stat);
 }
 
+void* ProxyRequestContext::operator new(size_t size) {
+  assert(size == sizeof(ProxyRequestContext));
+  return ThreadLocalObjectPool<ProxyRequestContext>::allocate();
+}
+
+void ProxyRequestContext::operator delete(void* ptr) {
+  ThreadLocalObjectPool<ProxyRequestContext>::deallocate(
+    static_cast<ProxyRequestContext*>(ptr));
+}
+
+std::pair<size_t, size_t> ProxyRequestContext::poolStats() {
+  return ThreadLocalObjectPool<ProxyRequestContext>::numAllocationsAndReuses();
+}
+
 uint64_t ProxyRequestContext::senderId() const {
   uint64_t id = 0;
   if (requester_) {
@@ -91,13 +153,31 @@ void ProxyRequestContext::setSenderIdForTest(uint64_t id) {
   senderIdForTest_ = id;
 }
 
-void ProxyRequestContext::onRequestRefused(const ProxyMcRequest& request,
-                                           const ProxyMcReply& reply) {
-  if (recording_) {
+uint32_t ProxyRequestContext::senderWeight() const {
+  return requester_ ? requester_->fairShareWeight() : senderWeightForTest_;
+}
+
+void ProxyRequestContext::setSenderWeightForTest(uint32_t weight) {
+  senderWeightForTest_ = weight;
+}
+
+void ProxyRequestContext::startRouteCpu() {
+  routeCpu_ = &proxy_.routeCpu;
+}
+
+void ProxyRequestContext::endPhase(RequestPhase phase) {
+  if (!phasesSampled()) {
     return;
   }
-  assert(logger_.hasValue());
-  logger_->logError(request, reply);
+  auto now = nowUs();
+  proxy_.requestPhases.record(phase, now - phaseTimeUs_);
+  phaseTimeUs_ = now;
+}
+
+void ProxyRequestContext::recordPhase(RequestPhase phase, int64_t durationUs) {
+  if (phasesSampled()) {
+    proxy_.requestPhases.record(phase, durationUs);
+  }
 }
 
 void ProxyRequestContext::sendReply(McReply newReply) {
@@ -108,9 +188,19 @@ void ProxyRequestContext::sendReply(McReply newReply) {
   if (replied_) {
     return;
   }
+  if (phasesSampled()) {
+    endPhase(RequestPhase::ROUTE);
+  }
   reply_ = std::move(newReply);
   replied_ = true;
 
+  /* Before the reply is handed off to the requester */
+  if (proxy_.topSenders.sampleNext()) {
+    proxy_.topSenders.add(folly::to<std::string>(senderId()),
+                          origReq_->key.len + origReq_->value.len,
+                          reply_->value().computeChainDataLength());
+  }
+
   if (LIKELY(enqueueReply_ != nullptr)) {
     enqueueReply_(*this);
   }
@@ -126,34 +216,41 @@ void ProxyRequestContext::sendReply(McReply newReply) {
   }
 }
 
-std::shared_ptr<ProxyRequestContext> ProxyRequestContext::createRecording(
+ProxyRequestContext::Ptr ProxyRequestContext::createRecording(
   proxy_t& proxy,
   ClientCallback clientCallback,
   ShardSplitCallback shardSplitCallback) {
 
-  return std::shared_ptr<ProxyRequestContext>(
-    new ProxyRequestContext(Recording,
-                            proxy,
-                            std::move(clientCallback),
-                            std::move(shardSplitCallback))
-  );
+  return Ptr(new ProxyRequestContext(Recording,
+                                     proxy,
+                                     std::move(clientCallback),
+                                     std::move(shardSplitCallback)));
 }
 
-std::shared_ptr<ProxyRequestContext> ProxyRequestContext::createRecordingNotify(
+ProxyRequestContext::Ptr ProxyRequestContext::createRecordingNotify(
   proxy_t& proxy,
   folly::fibers::Baton& baton,
   ClientCallback clientCallback,
   ShardSplitCallback shardSplitCallback) {
 
-  return std::shared_ptr<ProxyRequestContext>(
-    new ProxyRequestContext(Recording,
-                            proxy,
-                            std::move(clientCallback),
-                            std::move(shardSplitCallback)),
-    [&baton] (ProxyRequestContext* ctx) {
-      delete ctx;
-      baton.post();
-    });
+  auto ctx = new ProxyRequestContext(Recording,
+                                     proxy,
+                                     std::move(clientCallback),
+                                     std::move(shardSplitCallback));
+  ctx->destroyedBaton_ = &baton;
+  return Ptr(ctx);
+}
+
+void ProxyRequestContext::onLastRef() {
+  auto baton = destroyedBaton_;
+  /* Note: we want to delete on main context here since the destructor
+     can do complicated things, like finalize stats entry and
+     destroy a stale config.  There might not be enough stack space
+     for these operations. */
+  folly::fibers::runInMainContext([this]{ delete this; });
+  if (baton) {
+    baton->post();
+  }
 }
 
 ProxyRequestContext::ProxyRequestContext(
@@ -9,14 +9,28 @@
  */
 #pragma once
 
+#include <algorithm>
+#include <chrono>
 #include <memory>
 
+#include <folly/Likely.h>
+
 #include "mcrouter/config.h"
 #include "mcrouter/config-impl.h"
+#include "mcrouter/lib/fbi/cpp/LocalRefPtr.h"
+#include "mcrouter/lib/fbi/cpp/ObjectPool.h"
+#include "mcrouter/lib/network/McReplyStream.h"
+#include "mcrouter/lib/RequestArena.h"
 #include "mcrouter/ProxyConfigIf.h"
 #include "mcrouter/ProxyRequestLogger.h"
+#include "mcrouter/RequestPhaseStats.h"
+#include "mcrouter/RouteCpuProfiler.h"
+
+namespace facebook { namespace memcache {
 
-namespace facebook { namespace memcache { namespace mcrouter {
+enum class WarmUpFillEvent;
+
+namespace mcrouter {
 
 class ProxyClientCommon;
 class ProxyMcReply;
@@ -32,10 +46,15 @@ class ProxyRoute;
  * we save the current configuration and convert it to shared
  * ownership.
  *
+ * Shared ownership is confined to the proxy thread routing the request,
+ * so Ptr copies (one per subrequest fiber) use a non-atomic reference count.
+ *
  * Records collected stats on destruction.
  */
-class ProxyRequestContext {
+class ProxyRequestContext : public LocalRefCounted<ProxyRequestContext> {
 public:
+  using Ptr = LocalRefPtr<ProxyRequestContext>;
+
   /**
    * Creates a new context
    */
@@ -51,21 +70,26 @@ public:
    * ownership is changed to shared so that all subrequests
    * keep track of this context.
    */
-  static std::shared_ptr<ProxyRequestContext> process(
+  static Ptr process(
     std::unique_ptr<ProxyRequestContext> preq,
     std::shared_ptr<const ProxyConfigIf> config) {
     preq->config_ = std::move(config);
-    return std::shared_ptr<ProxyRequestContext>(
-      preq.release(),
-      /* Note: we want to delete on main context here since the destructor
-         can do complicated things, like finalize stats entry and
-         destroy a stale config.  There might not be enough stack space
-         for these operations. */
-      [] (ProxyRequestContext* ctx) {
-        folly::fibers::runInMainContext([ctx]{ delete ctx; });
-      });
+    return Ptr(preq.release());
   }
 
+  /**
+   * Contexts are created and destroyed for every request, so their storage
+   * comes from a per-thread pool instead of malloc.
+   */
+  static void* operator new(size_t size);
+  static void operator delete(void* ptr);
+
+  /**
+   * @return  (number of contexts allocated with malloc,
+   *           number of contexts allocated from the pool) over all threads
+   */
+  static std::pair<size_t, size_t> poolStats();
+
   using ClientCallback = std::function<void(const ProxyClientCommon&)>;
   using ShardSplitCallback = std::function<void(const ShardSplitter&)>;
 
@@ -78,7 +102,7 @@ public:
    * @param shardSplitCallback  If non-nullptr, called by ShardSplitRoute
    *   in couldRouteTo() with itself as the argument.
    */
-  static std::shared_ptr<ProxyRequestContext> createRecording(
+  static Ptr createRecording(
     proxy_t& proxy,
     ClientCallback clientCallback,
     ShardSplitCallback shardSplitCallback = nullptr);
@@ -88,7 +112,7 @@ public:
    * when this context is destroyed (i.e. all requests referencing it
    * finish executing).
    */
-  static std::shared_ptr<ProxyRequestContext> createRecordingNotify(
+  static Ptr createRecordingNotify(
     proxy_t& proxy,
     folly::fibers::Baton& baton,
     ClientCallback clientCallback,
@@ -120,6 +144,13 @@ public:
 
   void setSenderIdForTest(uint64_t id);
 
+  /**
+   * Fair share weight of the sender, see McrouterClient::setFairShareWeight.
+   */
+  uint32_t senderWeight() const;
+
+  void setSenderWeightForTest(uint32_t weight);
+
   ProxyRoute& proxyRoute() const {
     assert(!recording_);
     return config_->proxyRoute();
@@ -149,7 +180,10 @@ public:
     }
 
     assert(logger_.hasValue());
-    logger_->log(request, reply, startTimeUs, endTimeUs, Operation());
+    logger_->log(
+      pclient, request, reply, startTimeUs, endTimeUs, Operation());
+    logger_->tap(
+      pclient, request, reply, startTimeUs, endTimeUs, Operation());
     assert(additionalLogger_.hasValue());
     additionalLogger_->log(
       pclient, request, reply, startTimeUs, endTimeUs, Operation());
@@ -158,13 +192,149 @@ public:
   /**
    * Called once a request is refused due to rate limiting/TKO logic
    */
-  void onRequestRefused(const ProxyMcRequest& request,
-                        const ProxyMcReply& reply);
+  template <class Operation>
+  void onRequestRefused(const ProxyClientCommon& pclient,
+                        const ProxyMcRequest& request,
+                        const ProxyMcReply& reply,
+                        Operation) {
+    if (recording_) {
+      return;
+    }
+
+    assert(logger_.hasValue());
+    logger_->logRefused(pclient, request, reply);
+    auto now = nowUs();
+    logger_->tap(pclient, request, reply, now, now, Operation());
+  }
 
   const McMsgRef& origReq() const {
     return origReq_;
   }
 
+  /**
+   * Starts timing the phases of this request, see RequestPhaseStats.
+   * Only done for one in opts.request_phases_sample_period requests.
+   */
+  void startPhases() {
+    phaseTimeUs_ = nowUs();
+  }
+
+  bool phasesSampled() const noexcept {
+    return phaseTimeUs_ != 0;
+  }
+
+  /**
+   * Profiles the CPU cost of routes for this request, see RouteCpuProfiler.
+   * Only done for one in opts.route_cpu_sample_period requests.
+   */
+  void startRouteCpu();
+
+  /**
+   * @return  Profiler of the proxy if this request is profiled,
+   *          nullptr otherwise.
+   */
+  RouteCpuProfiler* routeCpu() const noexcept {
+    return routeCpu_;
+  }
+
+  /**
+   * Called around each route() call of a route handle (see RouteHandle).
+   */
+  template <class Handle>
+  static RouteCpuScope routeScope(const Ptr& ctx, const Handle& handle) {
+    if (LIKELY(!ctx || ctx->routeCpu_ == nullptr)) {
+      return RouteCpuScope();
+    }
+    return RouteCpuScope(ctx->routeCpu_, handle, ctx.get());
+  }
+
+  /**
+   * If phases are sampled, records the time since the end of the previous
+   * phase as `phase`.
+   */
+  void endPhase(RequestPhase phase);
+
+  /**
+   * If phases are sampled, records a phase timed by the caller.
+   */
+  void recordPhase(RequestPhase phase, int64_t durationUs);
+
+  /**
+   * Absolute time (as in nowUs()) by which the requester needs a reply,
+   * 0 if there is none. Set from opts.request_deadline_ms when the
+   * request is received, requesters may set their own.
+   */
+  int64_t deadlineUs() const noexcept {
+    return deadlineUs_;
+  }
+
+  void setDeadlineUs(int64_t deadlineUs) noexcept {
+    deadlineUs_ = deadlineUs;
+  }
+
+  /**
+   * Failover and retries are skipped once this is true: the requester
+   * already gave up on the reply.
+   */
+  bool deadlineExceeded() const {
+    return deadlineUs_ != 0 && nowUs() >= deadlineUs_;
+  }
+
+  /**
+   * Called by routes when a RetryBudget denied a retry.
+   */
+  void onRetryDenied();
+
+  /**
+   * Called by WarmUpRoute for the cold fill of a warm hit, see
+   * WarmUpFillQueue.
+   */
+  void onWarmUpFill(WarmUpFillEvent event);
+
+  /**
+   * @param timeout  destination timeout, 0 means none.
+   * @return  timeout clamped to the time left until the deadline (rounded
+   *          up to whole ms), 0 if the deadline passed.
+   */
+  std::chrono::milliseconds
+  timeoutBeforeDeadline(std::chrono::milliseconds timeout) const {
+    if (deadlineUs_ == 0) {
+      return timeout;
+    }
+    auto leftUs = deadlineUs_ - nowUs();
+    if (leftUs <= 0) {
+      return std::chrono::milliseconds(0);
+    }
+    std::chrono::milliseconds left((leftUs + 999) / 1000);
+    return timeout.count() == 0 ? left : std::min(timeout, left);
+  }
+
+  /**
+   * Offered the get hits of destinations while they're being read, so they
+   * can be written out before the reply is complete. nullptr if the
+   * requester didn't ask for it, or a route disabled it.
+   */
+  McReplyStream* replyStream() const {
+    return replyStreamDisabled_ ? nullptr : replyStream_.get();
+  }
+
+  /**
+   * Called by routes that change the values of get hits (or combine several
+   * of them): those can't be written out before the route is done.
+   */
+  void disableReplyStream() {
+    replyStreamDisabled_ = true;
+  }
+
+  /**
+   * Temporaries of routes, freed all at once with this context (see
+   * requestArena()). The first kArenaInlineSize bytes come with the
+   * (pooled) context, so most requests never malloc for them.
+   */
+  Arena& arena() {
+    return arena_;
+  }
+
   /**
    * Sets the reply for this proxy request and sends it out
    * @param newReply the message that we are sending out as the reply
@@ -184,6 +354,10 @@ public:
       we want to notify we're done on destruction. */
   bool processing_{false};
 
+  /** Index of the request's tenant in the proxy, -1 if none,
+      see proxy_t::tenantOf() */
+  int tenant_{-1};
+
   bool recording_{false};
 
   McrouterClient* requester_{nullptr};
@@ -216,6 +390,26 @@ public:
   folly::Optional<AdditionalProxyRequestLogger> additionalLogger_;
 
   uint64_t senderIdForTest_{0};
+  uint32_t senderWeightForTest_{1};
+
+  /* End of the last timed phase, 0 if phases are not sampled */
+  int64_t phaseTimeUs_{0};
+
+  /* See deadlineUs() */
+  int64_t deadlineUs_{0};
+
+  /* See routeCpu() */
+  RouteCpuProfiler* routeCpu_{nullptr};
+
+  /* Posted once this context is destroyed, see createRecordingNotify() */
+  folly::fibers::Baton* destroyedBaton_{nullptr};
+
+  /* Kept until all destination requests are done, they may reference it */
+  std::shared_ptr<McReplyStream> replyStream_;
+  bool replyStreamDisabled_{false};
+
+  static constexpr size_t kArenaInlineSize = 1024;
+  InlineArena<kArenaInlineSize> arena_;
 
   ProxyRequestContext(
     proxy_t& pr,
@@ -224,6 +418,18 @@ public:
     void* context,
     void (*reqComplete)(ProxyRequestContext& preq) = nullptr);
 
+  /**
+   * Keeps req as the saved request, origReq() is its dependent msg.
+   */
+  ProxyRequestContext(
+    proxy_t& pr,
+    McRequest req,
+    mc_op_t op,
+    void (*enqReply)(ProxyRequestContext& preq),
+    void* context);
+
+  void init(McMsgRef req);
+
   enum RecordingT { Recording };
   ProxyRequestContext(
     RecordingT,
@@ -231,6 +437,11 @@ public:
     ClientCallback clientCallback,
     ShardSplitCallback shardSplitCallback);
 
+  /**
+   * Called by the last Ptr to us going away.
+   */
+  void onLastRef();
+
   ProxyRequestContext(const ProxyRequestContext&) = delete;
   ProxyRequestContext(ProxyRequestContext&&) noexcept = delete;
   ProxyRequestContext& operator=(const ProxyRequestContext&) = delete;
@@ -255,6 +466,7 @@ public:
   };
 
 private:
+  friend class LocalRefCounted<ProxyRequestContext>;
   friend class McrouterClient;
   friend class proxy_t;
 };
@@ -7,8 +7,12 @@
  *  of patent rights can be found in the PATENTS file in the same directory.
  *
  */
+#include <folly/Likely.h>
+
+#include "mcrouter/ClientPool.h"
 #include "mcrouter/lib/McOperation.h"
 #include "mcrouter/proxy.h"
+#include "mcrouter/ProxyClientCommon.h"
 #include "mcrouter/ProxyMcReply.h"
 #include "mcrouter/ProxyMcRequest.h"
 #include "mcrouter/stats.h"
@@ -153,8 +157,16 @@ void ProxyRequestLogger::logError(const ProxyMcRequest& req,
   }
 }
 
+void ProxyRequestLogger::logRefused(const ProxyClientCommon& pclient,
+                                    const ProxyMcRequest& request,
+                                    const McReplyBase& reply) {
+  logError(request, reply);
+  proxy_->poolStats.onRefused(pclient.pool.statsId(), reply.result());
+}
+
 template <class Operation>
-void ProxyRequestLogger::log(const ProxyMcRequest& request,
+void ProxyRequestLogger::log(const ProxyClientCommon& pclient,
+                             const ProxyMcRequest& request,
                              const ProxyMcReply& reply,
                              const int64_t startTimeUs,
                              const int64_t endTimeUs,
@@ -166,11 +178,53 @@ void ProxyRequestLogger::log(const ProxyMcRequest& request,
 
   logError(request, reply);
   logRequestClass(*proxy_, Operation(), request.getRequestClass());
-  proxy_->durationUs.insertSample(durationUs);
+  proxy_->onRequestLatency(durationUs);
+  auto keyBytes = request.fullKey().size();
+  auto valueBytes = request.value().computeChainDataLength() +
+                    reply.value().computeChainDataLength();
+  proxy_->opSizes.record(Operation::mc_op, keyBytes, valueBytes);
+  proxy_->poolStats.onReply(pclient.pool.statsId(), reply.result(),
+                            durationUs, keyBytes, valueBytes);
 
   if (isOutlier) {
     logOutlier(*proxy_, Operation(), request.getRequestClass());
   }
 }
 
+template <class Operation>
+void ProxyRequestLogger::tap(const ProxyClientCommon& pclient,
+                             const ProxyMcRequest& request,
+                             const ProxyMcReply& reply,
+                             const int64_t startTimeUs,
+                             const int64_t endTimeUs,
+                             Operation) {
+  if (LIKELY(!proxy_->debugTap.active())) {
+    return;
+  }
+  tapSlow(pclient, request, reply, startTimeUs, endTimeUs, Operation());
+}
+
+template <class Operation>
+void ProxyRequestLogger::tapSlow(const ProxyClientCommon& pclient,
+                                 const ProxyMcRequest& request,
+                                 const ProxyMcReply& reply,
+                                 const int64_t startTimeUs,
+                                 const int64_t endTimeUs,
+                                 Operation) {
+  auto& ring = proxy_->debugTap;
+  auto filter = ring.filter();
+  if (filter == nullptr || !filter->matchesKey(request.fullKey())) {
+    return;
+  }
+  auto hostPort = pclient.ap.toHostPortString();
+  if (!filter->matchesDestination(pclient.pool.getName(), hostPort) ||
+      !ring.sample(filter->samplePeriod)) {
+    return;
+  }
+  ring.push(Operation::mc_op, request.fullKey(), reply.result(), hostPort,
+            request.value().computeChainDataLength() +
+            reply.value().computeChainDataLength(),
+            startTimeUs, endTimeUs);
+}
+
 }}}  // facebook::memcache::mcrouter
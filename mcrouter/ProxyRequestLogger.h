@@ -12,6 +12,7 @@
 namespace facebook { namespace memcache { namespace mcrouter {
 
 class proxy_t;
+class ProxyClientCommon;
 class ProxyMcReply;
 class ProxyMcRequest;
 
@@ -22,7 +23,8 @@ class ProxyRequestLogger {
   }
 
   template <class Operation>
-  void log(const ProxyMcRequest& request,
+  void log(const ProxyClientCommon& pclient,
+           const ProxyMcRequest& request,
            const ProxyMcReply& reply,
            const int64_t startTimeUs,
            const int64_t endTimeUs,
@@ -30,6 +32,35 @@ class ProxyRequestLogger {
 
   inline void logError(const ProxyMcRequest& request, const McReplyBase& reply);
 
+  /**
+   * Request refused before being sent to pclient (TKO, rate limiting...)
+   */
+  inline void logRefused(const ProxyClientCommon& pclient,
+                         const ProxyMcRequest& request,
+                         const McReplyBase& reply);
+
+  /**
+   * Copies the pair into the proxy's DebugTapRing if a debug tap client
+   * is connected and the pair passes its filter.
+   * Only a relaxed load otherwise.
+   */
+  template <class Operation>
+  void tap(const ProxyClientCommon& pclient,
+           const ProxyMcRequest& request,
+           const ProxyMcReply& reply,
+           const int64_t startTimeUs,
+           const int64_t endTimeUs,
+           Operation);
+
+ private:
+  template <class Operation>
+  void tapSlow(const ProxyClientCommon& pclient,
+               const ProxyMcRequest& request,
+               const ProxyMcReply& reply,
+               const int64_t startTimeUs,
+               const int64_t endTimeUs,
+               Operation);
+
  protected:
   proxy_t* proxy_;
 };
@@ -9,9 +9,12 @@
  */
 #include "ProxyThread.h"
 
+#include <chrono>
+
 #include <folly/io/async/EventBase.h>
 
 #include "mcrouter/config.h"
+#include "mcrouter/lib/fbi/fb_cpu_util.h"
 #include "mcrouter/McrouterInstance.h"
 #include "mcrouter/proxy.h"
 #include "mcrouter/ThreadUtil.h"
@@ -27,24 +30,31 @@ ProxyThread::ProxyThread(std::unique_ptr<proxy_t> pr)
   proxy_->attachEventBase(&evb_);
 }
 
-bool ProxyThread::spawn() {
+bool ProxyThread::spawn(int cpu) {
+  cpu_ = cpu;
   return spawnThread(&thread_handle,
                      &thread_stack,
                      proxyThreadRunHandler, this,
                      proxy_->router->wantRealtimeThreads());
 }
 
+void ProxyThread::stopLoop() {
+  if (thread_handle && proxy_->router->pid() == getpid()) {
+    proxy_->sendMessage(request_type_router_shutdown, nullptr);
+    std::unique_lock<std::mutex> lk(mux);
+    cv.wait(lk, [this]() { return loopExited_; });
+  }
+}
+
 void ProxyThread::stopAndJoin() {
   if (thread_handle && proxy_->router->pid() == getpid()) {
-    CHECK(proxy_->request_queue != nullptr);
-    asox_queue_entry_t entry;
-    entry.type = request_type_router_shutdown;
-    entry.priority = 0;
-    entry.data = nullptr;
-    entry.nbytes = 0;
-    asox_queue_enqueue(proxy_->request_queue, &entry);
     {
       std::unique_lock<std::mutex> lk(mux);
+      if (!loopExited_) {
+        lk.unlock();
+        proxy_->sendMessage(request_type_router_shutdown, nullptr);
+        lk.lock();
+      }
       isSafeToDeleteProxy = true;
     }
     cv.notify_all();
@@ -58,18 +68,30 @@ void ProxyThread::stopAndJoin() {
 void ProxyThread::proxyThreadRun() {
   CHECK(proxy_->router != nullptr);
   mcrouterSetThreadName(pthread_self(), proxy_->router->opts(), "mcrpxy");
+  if (cpu_ >= 0) {
+    /* Before the loop, so that everything the proxy allocates from here
+       on is local to the CPU */
+    bind_thread_to_cpu(cpu_);
+    stat_set_uint64(proxy_->stats, proxy_threads_pinned_stat, 1);
+  }
 
+  auto busyPollUs = proxy_->router->opts().proxy_busy_poll_us;
   while (!proxy_->router->shutdownStarted()) {
+    if (busyPollUs > 0) {
+      proxyBusyPoll(*proxy_, evb_, std::chrono::microseconds(busyPollUs));
+    }
     mcrouterLoopOnce(proxy_->eventBase);
   }
 
-  while (proxy_->fiberManager.hasTasks()) {
+  while (proxy_->fiberManager.hasTasks() || proxy_->finishStolenRequests()) {
     mcrouterLoopOnce(proxy_->eventBase);
   }
 
   // Delete the proxy from the proxy thread so that the clients get
   // deleted from the same thread where they were created.
   std::unique_lock<std::mutex> lk(mux);
+  loopExited_ = true;
+  cv.notify_all();
   // This is to avoid a race condition where proxy is deleted
   // before the call to stopAndJoin is made.
   cv.wait(lk,
@@ -81,6 +103,25 @@ void ProxyThread::proxyThreadRun() {
   proxy_.reset();
 }
 
+void proxyBusyPoll(proxy_t& proxy, folly::EventBase& evb,
+                   std::chrono::microseconds idleTimeout) {
+  auto& queue = *proxy.messageQueue;
+  queue.startSpinning();
+  auto deadline = std::chrono::steady_clock::now() + idleTimeout;
+  while (!proxy.router->shutdownStarted()) {
+    bool busy = queue.size() > 0 || proxy.fiberManager.hasTasks();
+    queue.drain();
+    evb.loopOnce(EVLOOP_NONBLOCK);
+    auto now = std::chrono::steady_clock::now();
+    if (busy) {
+      deadline = now + idleTimeout;
+    } else if (now >= deadline) {
+      break;
+    }
+  }
+  queue.stopSpinning();
+}
+
 void *ProxyThread::proxyThreadRunHandler(void *arg) {
   auto proxyThread = reinterpret_cast<ProxyThread*>(arg);
   proxyThread->proxyThreadRun();
@@ -9,6 +9,7 @@
  */
 #pragma once
 
+#include <chrono>
 #include <condition_variable>
 #include <memory>
 #include <mutex>
@@ -23,6 +24,12 @@ class ProxyThread {
  public:
   explicit ProxyThread(std::unique_ptr<proxy_t> pr);
 
+  /**
+   * Wakes up the proxy thread and waits until it left its event loop,
+   * once the router's shutdown started. The proxy is still alive then.
+   */
+  void stopLoop();
+
   /**
    * Stops the underlyting proxy thread and joins it.
    */
@@ -30,8 +37,12 @@ class ProxyThread {
 
   /**
    * Spawns a new proxy thread for execution.
+   *
+   * @param cpu  CPU to pin the thread to, or -1 to let it run anywhere.
+   *             Memory the proxy first touches from its thread (fiber
+   *             stacks, connections) then comes from the CPU's NUMA node.
    */
-  bool spawn();
+  bool spawn(int cpu = -1);
 
   proxy_t& proxy() { return *proxy_; }
   folly::EventBase& eventBase() { return evb_; }
@@ -44,11 +55,21 @@ class ProxyThread {
   std::mutex mux;
   std::condition_variable cv;
   bool isSafeToDeleteProxy;
+  bool loopExited_{false};
+  int cpu_{-1};
 
   void stopAwriterThreads();
   void proxyThreadRun();
   static void *proxyThreadRunHandler(void *arg);
 };
 
+/**
+ * Runs the proxy's event base with non-blocking iterations, draining its
+ * message queue without eventfd wakeups, instead of waiting in epoll;
+ * returns once there was no work for idleTimeout (opts.proxy_busy_poll_us).
+ * Thread running evb only.
+ */
+void proxyBusyPoll(proxy_t& proxy, folly::EventBase& evb,
+                   std::chrono::microseconds idleTimeout);
 
 }}}  // facebook::memcache::mcrouter
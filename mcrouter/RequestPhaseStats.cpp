@@ -0,0 +1,49 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "RequestPhaseStats.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+constexpr size_t RequestPhaseStats::kNumPhases;
+
+const char* RequestPhaseStats::phaseName(RequestPhase phase) {
+  switch (phase) {
+    case RequestPhase::PROXY_QUEUE:
+      return "proxy_queue";
+    case RequestPhase::THROTTLE_QUEUE:
+      return "throttle_queue";
+    case RequestPhase::ROUTE:
+      return "route";
+    case RequestPhase::DESTINATION_QUEUE:
+      return "destination_queue";
+    case RequestPhase::DESTINATION_RTT:
+      return "destination_rtt";
+    case RequestPhase::NUM_PHASES:
+      break;
+  }
+  return "unknown";
+}
+
+void RequestPhaseStats::merge(const RequestPhaseStats& other) {
+  for (size_t i = 0; i < kNumPhases; ++i) {
+    histograms_[i].merge(other.histograms_[i]);
+  }
+}
+
+folly::dynamic RequestPhaseStats::toDynamic() const {
+  folly::dynamic result = folly::dynamic::object;
+  for (size_t i = 0; i < kNumPhases; ++i) {
+    result[phaseName(static_cast<RequestPhase>(i))] =
+      histograms_[i].toDynamic();
+  }
+  return result;
+}
+
+}}}  // facebook::memcache::mcrouter
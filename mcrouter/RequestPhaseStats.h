@@ -0,0 +1,77 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <folly/dynamic.h>
+
+#include "mcrouter/LatencyHistogram.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Phases of a request's life in mcrouter, timed for sampled requests
+ * (see opts.request_phases_sample_period).
+ */
+enum class RequestPhase {
+  /* McrouterClient got the request -> proxy thread picked it up */
+  PROXY_QUEUE,
+  /* Time spent throttled in the proxy's waiting queues, only recorded
+     for requests that were throttled */
+  THROTTLE_QUEUE,
+  /* Proxy started processing the request -> reply was sent,
+     includes the destination phases below */
+  ROUTE,
+  /* Request queued in the destination's client -> written into the socket,
+     once per request sent to a destination */
+  DESTINATION_QUEUE,
+  /* Request written into the socket -> reply received */
+  DESTINATION_RTT,
+
+  NUM_PHASES
+};
+
+/**
+ * Latency histograms (in microseconds), one per RequestPhase.
+ * Same thread safety as LatencyHistogram.
+ */
+class RequestPhaseStats {
+ public:
+  static constexpr size_t kNumPhases =
+    static_cast<size_t>(RequestPhase::NUM_PHASES);
+
+  static const char* phaseName(RequestPhase phase);
+
+  /**
+   * Negative durations (e.g. from mixing clocks) are recorded as 0.
+   */
+  void record(RequestPhase phase, int64_t durationUs) {
+    histograms_[static_cast<size_t>(phase)].record(
+      durationUs > 0 ? durationUs : 0);
+  }
+
+  const LatencyHistogram& histogram(RequestPhase phase) const {
+    return histograms_[static_cast<size_t>(phase)];
+  }
+
+  void merge(const RequestPhaseStats& other);
+
+  /**
+   * @return  {<phase name>: LatencyHistogram::toDynamic(), ...}
+   */
+  folly::dynamic toDynamic() const;
+
+ private:
+  LatencyHistogram histograms_[kNumPhases];
+};
+
+}}}  // facebook::memcache::mcrouter
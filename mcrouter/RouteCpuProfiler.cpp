@@ -0,0 +1,165 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "RouteCpuProfiler.h"
+
+#include <algorithm>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+constexpr size_t RouteCpuProfiler::kMaxNodes;
+constexpr size_t RouteCpuProfiler::kMaxOpen;
+const char* const RouteCpuProfiler::kOtherPath = "[other]";
+
+RouteCpuProfiler::RouteCpuProfiler(size_t stackSize)
+    : stackSize_(stackSize) {
+}
+
+uint64_t RouteCpuProfiler::enter(const void* handle, NameFn nameOf,
+                                 const void* request, const void* frame) {
+  charge(cpuCycles());
+  if (open_.size() >= kMaxOpen) {
+    return 0;
+  }
+
+  auto parent = find(current_ != 0 ? current_ : parent_);
+  if (parent != nullptr && parent->request != request) {
+    parent = nullptr;
+  }
+  auto node = resolve(parent ? parent->node : nullptr, handle, nameOf);
+  auto token = nextToken_++;
+  open_.push_back({token, parent ? parent->token : 0, request, frame, node,
+                   0});
+  current_ = token;
+  /* Don't charge our own bookkeeping */
+  lastCycles_ = cpuCycles();
+  return token;
+}
+
+void RouteCpuProfiler::exit(uint64_t token) {
+  charge(cpuCycles());
+  auto it = std::find_if(open_.begin(), open_.end(),
+                         [token](const Frame& f) { return f.token == token; });
+  if (token == 0 || it == open_.end()) {
+    lastCycles_ = cpuCycles();
+    return;
+  }
+
+  it->node->calls.fetch_add(1, std::memory_order_relaxed);
+  it->node->selfCycles.fetch_add(it->selfCycles, std::memory_order_relaxed);
+  auto parentToken = it->parent;
+  auto frame = it->frame;
+  open_.erase(it);
+
+  /* Back in the parent if it's on this fiber, otherwise this fiber is done
+     and the parent's fiber will go on whenever it's scheduled */
+  auto parent = find(parentToken);
+  if (parent != nullptr && sameFiber(parent->frame, frame)) {
+    current_ = parentToken;
+  } else {
+    current_ = 0;
+    parent_ = parentToken;
+  }
+  lastCycles_ = cpuCycles();
+}
+
+uint64_t RouteCpuProfiler::pause() {
+  charge(cpuCycles());
+  auto token = current_;
+  /* Fibers started during the wait are children of the frame that started
+     this fiber */
+  auto frame = find(token);
+  while (frame != nullptr) {
+    auto parent = find(frame->parent);
+    if (parent == nullptr || !sameFiber(parent->frame, frame->frame)) {
+      parent_ = frame->parent;
+      break;
+    }
+    frame = parent;
+  }
+  current_ = 0;
+  return token;
+}
+
+void RouteCpuProfiler::resume(uint64_t token) {
+  current_ = find(token) != nullptr ? token : 0;
+  lastCycles_ = cpuCycles();
+}
+
+void RouteCpuProfiler::onConfigSwapped() {
+  resolved_.clear();
+}
+
+void RouteCpuProfiler::charge(uint64_t now) {
+  if (current_ != 0) {
+    if (auto frame = find(current_)) {
+      frame->selfCycles += now - lastCycles_;
+    }
+  }
+  lastCycles_ = now;
+}
+
+RouteCpuProfiler::Frame* RouteCpuProfiler::find(uint64_t token) {
+  if (token == 0) {
+    return nullptr;
+  }
+  /* Most lookups are for the innermost frames */
+  for (auto it = open_.rbegin(); it != open_.rend(); ++it) {
+    if (it->token == token) {
+      return &*it;
+    }
+  }
+  return nullptr;
+}
+
+bool RouteCpuProfiler::sameFiber(const void* a, const void* b) const {
+  auto x = reinterpret_cast<uintptr_t>(a);
+  auto y = reinterpret_cast<uintptr_t>(b);
+  return (x > y ? x - y : y - x) < stackSize_;
+}
+
+RouteCpuNode* RouteCpuProfiler::resolve(const RouteCpuNode* parent,
+                                        const void* handle, NameFn nameOf) {
+  NodeKey key{parent, handle};
+  auto it = resolved_.find(key);
+  if (it != resolved_.end()) {
+    return it->second;
+  }
+
+  auto name = nameOf(handle);
+  auto result = node(parent ? parent->path + "/" + name : std::move(name));
+  resolved_.emplace(key, result);
+  return result;
+}
+
+RouteCpuNode* RouteCpuProfiler::node(std::string path) {
+  auto it = byPath_.find(path);
+  if (it != byPath_.end()) {
+    return it->second;
+  }
+  /* The last node is shared by all paths past the limit */
+  if (nodes_.size() >= kMaxNodes - 1) {
+    path = kOtherPath;
+    it = byPath_.find(path);
+    if (it != byPath_.end()) {
+      return it->second;
+    }
+  }
+
+  std::unique_ptr<RouteCpuNode> newNode(new RouteCpuNode(path));
+  auto result = newNode.get();
+  {
+    std::lock_guard<std::mutex> lock(nodesLock_);
+    nodes_.push_back(std::move(newNode));
+  }
+  byPath_.emplace(std::move(path), result);
+  return result;
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,268 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * @return  Cheap, monotonic cycle count of this CPU (TSC), or steady clock
+ *          nanoseconds where there's no TSC.
+ */
+inline uint64_t cpuCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+/**
+ * CPU cost of a route at one place in the route tree, on one proxy.
+ * Written by the proxy thread only, read from any thread.
+ */
+struct RouteCpuNode {
+  /* Route names from the root, e.g. "proxy/all-sync/host|pool=A|..." */
+  const std::string path;
+  std::atomic<uint64_t> calls{0};
+  /* Cycles spent in the route itself, not in its children or waiting */
+  std::atomic<uint64_t> selfCycles{0};
+
+  explicit RouteCpuNode(std::string p)
+      : path(std::move(p)) {
+  }
+};
+
+/**
+ * Attributes the proxy thread's cycles to the route handles of sampled
+ * requests (see opts.route_cpu_sample_period).
+ *
+ * Every route() call of a sampled request enters a frame on the way in and
+ * exits it on the way out (see RouteCpuScope). Cycles between two such
+ * events are charged to the frame that is current, so each route only pays
+ * for its own code, not for its children's. Waits (see RouteCpuWait) leave
+ * no frame current: neither the wait nor whatever the thread does meanwhile
+ * is charged.
+ *
+ * Fibers interleave frames, so frames are kept by token, not as a stack.
+ * A frame that is far (more than a fiber stack) from its parent's frame is
+ * assumed to run on a fiber of its own (fan out); once it's done or waits,
+ * nothing is charged until its parent's fiber runs another route.
+ */
+class RouteCpuProfiler {
+ public:
+  /**
+   * At most this many tree positions are tracked per proxy, any others
+   * are charged to kOtherPath.
+   */
+  static constexpr size_t kMaxNodes = 4096;
+  /* Frames entered while this many are open are not profiled */
+  static constexpr size_t kMaxOpen = 256;
+  static const char* const kOtherPath;
+
+  /**
+   * @param stackSize  Fiber stack size: frames on the same fiber are
+   *                   less than this far apart.
+   */
+  explicit RouteCpuProfiler(size_t stackSize);
+
+  /**
+   * Proxy thread only.
+   *
+   * @param handle   Route handle being called, defines routeName().
+   * @param request  Identifies the request, frames are only parented to
+   *                 frames of the same request.
+   * @param frame    Some address on the caller's stack.
+   *
+   * @return  Token to pass to exit(), 0 if the frame is not profiled.
+   */
+  template <class Handle>
+  uint64_t enter(const Handle& handle, const void* request,
+                 const void* frame) {
+    return enter(static_cast<const void*>(&handle), &nameOf<Handle>,
+                 request, frame);
+  }
+
+  /* Proxy thread only */
+  void exit(uint64_t token);
+
+  /**
+   * The current frame is about to wait, stop charging it.
+   * Proxy thread only.
+   *
+   * @return  Token to pass to resume().
+   */
+  uint64_t pause();
+
+  /* Proxy thread only */
+  void resume(uint64_t token);
+
+  /**
+   * Route handles of the old config may be destroyed and their addresses
+   * reused, forget them. Proxy thread only.
+   */
+  void onConfigSwapped();
+
+  /**
+   * Calls f(const RouteCpuNode&) for each tracked position. Thread safe.
+   */
+  template <typename Func>
+  void foreach(Func&& f) const {
+    std::lock_guard<std::mutex> lock(nodesLock_);
+    for (const auto& node : nodes_) {
+      f(*node);
+    }
+  }
+
+ private:
+  using NameFn = std::string (*)(const void*);
+
+  struct Frame {
+    uint64_t token;
+    uint64_t parent;
+    const void* request;
+    const void* frame;
+    RouteCpuNode* node;
+    uint64_t selfCycles;
+  };
+
+  struct NodeKey {
+    const RouteCpuNode* parent;
+    const void* handle;
+
+    bool operator==(const NodeKey& other) const {
+      return parent == other.parent && handle == other.handle;
+    }
+  };
+
+  struct NodeKeyHash {
+    size_t operator()(const NodeKey& key) const {
+      return std::hash<const void*>()(key.parent) * 31 +
+             std::hash<const void*>()(key.handle);
+    }
+  };
+
+  const size_t stackSize_;
+
+  std::vector<Frame> open_;
+  /* Frame being charged, 0 if none */
+  uint64_t current_{0};
+  /* Parent of frames entered while none is current */
+  uint64_t parent_{0};
+  uint64_t nextToken_{1};
+  uint64_t lastCycles_{0};
+
+  /* Resolved positions of handles, proxy thread only */
+  std::unordered_map<NodeKey, RouteCpuNode*, NodeKeyHash> resolved_;
+  /* Positions by path, proxy thread only */
+  std::unordered_map<std::string, RouteCpuNode*> byPath_;
+
+  /* Only changed by the proxy thread under nodesLock_ */
+  mutable std::mutex nodesLock_;
+  std::vector<std::unique_ptr<RouteCpuNode>> nodes_;
+
+  template <class Handle>
+  static std::string nameOf(const void* handle) {
+    return static_cast<const Handle*>(handle)->routeName();
+  }
+
+  uint64_t enter(const void* handle, NameFn nameOf, const void* request,
+                 const void* frame);
+  void charge(uint64_t now);
+  Frame* find(uint64_t token);
+  bool sameFiber(const void* a, const void* b) const;
+  RouteCpuNode* resolve(const RouteCpuNode* parent, const void* handle,
+                        NameFn nameOf);
+  RouteCpuNode* node(std::string path);
+
+  RouteCpuProfiler(const RouteCpuProfiler&) = delete;
+  RouteCpuProfiler& operator=(const RouteCpuProfiler&) = delete;
+};
+
+/**
+ * Profiles a route() call for as long as it's alive, if profiler is not
+ * nullptr.
+ */
+class RouteCpuScope {
+ public:
+  RouteCpuScope() = default;
+
+  template <class Handle>
+  RouteCpuScope(RouteCpuProfiler* profiler, const Handle& handle,
+                const void* request)
+      : profiler_(profiler) {
+    if (profiler_ != nullptr) {
+      token_ = profiler_->enter(handle, request, this);
+    }
+  }
+
+  RouteCpuScope(RouteCpuScope&& other) noexcept
+      : profiler_(other.profiler_),
+        token_(other.token_) {
+    other.profiler_ = nullptr;
+  }
+
+  ~RouteCpuScope() {
+    if (profiler_ != nullptr) {
+      profiler_->exit(token_);
+    }
+  }
+
+ private:
+  RouteCpuProfiler* profiler_{nullptr};
+  uint64_t token_{0};
+
+  RouteCpuScope(const RouteCpuScope&) = delete;
+  RouteCpuScope& operator=(const RouteCpuScope&) = delete;
+  RouteCpuScope& operator=(RouteCpuScope&&) = delete;
+};
+
+/**
+ * Excludes a wait (e.g. for a destination's reply) from the route's cost
+ * for as long as it's alive, if profiler is not nullptr.
+ */
+class RouteCpuWait {
+ public:
+  explicit RouteCpuWait(RouteCpuProfiler* profiler)
+      : profiler_(profiler) {
+    if (profiler_ != nullptr) {
+      token_ = profiler_->pause();
+    }
+  }
+
+  ~RouteCpuWait() {
+    if (profiler_ != nullptr) {
+      profiler_->resume(token_);
+    }
+  }
+
+ private:
+  RouteCpuProfiler* profiler_;
+  uint64_t token_{0};
+
+  RouteCpuWait(const RouteCpuWait&) = delete;
+  RouteCpuWait& operator=(const RouteCpuWait&) = delete;
+};
+
+}}}  // facebook::memcache::mcrouter
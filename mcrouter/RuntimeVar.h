@@ -0,0 +1,119 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+#include <glog/logging.h>
+
+#include <folly/dynamic.h>
+
+#include "mcrouter/Observable.h"
+#include "mcrouter/RuntimeVarsData.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+typedef Observable<std::shared_ptr<const RuntimeVarsData>>
+  ObservableRuntimeVars;
+
+/**
+ * Typed handle of a runtime variable, resolved by name once (e.g. when
+ * the config is loaded) instead of on every use.
+ *
+ * The value is parsed from RuntimeVarsData every time the runtime vars
+ * file changes, by the thread loading it; get() is a relaxed atomic load.
+ * If the variable is missing from the file or parse throws, the previous
+ * value is kept.
+ *
+ * T is stored in std::atomic, so it must be arithmetic (a range can be
+ * packed into uint64_t).
+ */
+template <class T>
+class RuntimeVar {
+  static_assert(std::is_arithmetic<T>::value,
+                "RuntimeVar value must be arithmetic");
+ public:
+  using Parser = std::function<T(const folly::dynamic&)>;
+
+  /**
+   * Value that is never updated from runtime vars.
+   */
+  explicit RuntimeVar(T initial)
+    : value_(initial) {
+  }
+
+  /**
+   * @param initial  value until the variable is set in runtime vars
+   * @param vars  runtime vars to subscribe to; nothing is subscribed
+   *              if nullptr or name is empty
+   * @param parse  converts and validates the variable's value
+   */
+  RuntimeVar(T initial, ObservableRuntimeVars* vars, std::string name,
+             Parser parse)
+    : value_(initial),
+      name_(std::move(name)),
+      parse_(std::move(parse)) {
+    if (vars == nullptr || name_.empty()) {
+      return;
+    }
+    handle_ = vars->subscribeAndCall(
+      [this](std::shared_ptr<const RuntimeVarsData> oldVars,
+             std::shared_ptr<const RuntimeVarsData> newVars) {
+        if (newVars) {
+          update(*newVars);
+        }
+      });
+  }
+
+  T get() const {
+    return value_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Overrides the value until the variable changes in runtime vars.
+   */
+  void set(T value) {
+    value_.store(value, std::memory_order_relaxed);
+  }
+
+  const std::string& name() const {
+    return name_;
+  }
+
+ private:
+  std::atomic<T> value_;
+  const std::string name_;
+  const Parser parse_;
+  /* Last member, so that we unsubscribe before anything else is destroyed */
+  ObservableRuntimeVars::CallbackHandle handle_;
+
+  void update(const RuntimeVarsData& vars) {
+    auto json = vars.getVariableByName(name_);
+    if (json.isNull()) {
+      return;
+    }
+    try {
+      set(parse_(json));
+    } catch (const std::exception& e) {
+      LOG(ERROR) << "Invalid value of runtime variable " << name_ << ": "
+                 << e.what();
+    }
+  }
+
+  RuntimeVar(const RuntimeVar&) = delete;
+  RuntimeVar& operator=(const RuntimeVar&) = delete;
+};
+
+}}} // facebook::memcache::mcrouter
@@ -0,0 +1,66 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Credits a proxy grants to the server worker feeding it (see
+ * server-proxy-credits): the worker may keep reading requests while the
+ * proxy has fewer than `credits` requests routing or waiting, counting
+ * the ones handed over by siblings. Once they are used up the worker
+ * should pause its reads; credits are granted again once the proxy has
+ * drained to half of them, so that reads don't flap on every reply.
+ *
+ * Not thread safe, meant to be used by the thread of the proxy and worker.
+ */
+class ServerCredits {
+ public:
+  /**
+   * @param credits  0 means unlimited, reads are never paused.
+   */
+  explicit ServerCredits(size_t credits)
+      : credits_(credits),
+        resumeDepth_(credits / 2) {
+  }
+
+  /**
+   * Updates the state with the requests currently in the proxy.
+   *
+   * @return  true iff it changed, see exhausted().
+   */
+  bool update(size_t proxyDepth) {
+    if (credits_ == 0) {
+      return false;
+    }
+    if (!exhausted_ && proxyDepth >= credits_) {
+      exhausted_ = true;
+      return true;
+    }
+    if (exhausted_ && proxyDepth <= resumeDepth_) {
+      exhausted_ = false;
+      return true;
+    }
+    return false;
+  }
+
+  bool exhausted() const {
+    return exhausted_;
+  }
+
+ private:
+  const size_t credits_;
+  const size_t resumeDepth_;
+  bool exhausted_{false};
+};
+
+}}}  // facebook::memcache::mcrouter
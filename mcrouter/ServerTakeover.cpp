@@ -0,0 +1,404 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "ServerTakeover.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include <glog/logging.h>
+
+#include <folly/dynamic.h>
+#include <folly/FileUtil.h>
+#include <folly/Range.h>
+#include <folly/ThreadName.h>
+
+#include "mcrouter/ConfigSnapshot.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+const char kTakeoverMagic[8] = {'M', 'C', 'T', 'K', 'O', 'V', 'R', '1'};
+/* Within what a single SCM_RIGHTS message can carry */
+const size_t kMaxSockets = 128;
+/* The state is sent right after connecting, only the ack takes a while */
+const int kSocketTimeoutMs = 10000;
+
+struct Header {
+  char magic[sizeof(kTakeoverMagic)];
+  uint32_t numSockets;
+  uint32_t numSslSockets;
+  uint64_t dataLength;
+};
+
+void setTimeouts(int fd) {
+  struct timeval tv;
+  tv.tv_sec = kSocketTimeoutMs / 1000;
+  tv.tv_usec = (kSocketTimeoutMs % 1000) * 1000;
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+bool toSockaddr(const std::string& path, struct sockaddr_un& addr) {
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+    return false;
+  }
+  memcpy(addr.sun_path, path.data(), path.size());
+  return true;
+}
+
+bool writeAll(int fd, folly::StringPiece data) {
+  while (!data.empty()) {
+    auto n = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+    if (n <= 0) {
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data.advance(n);
+  }
+  return true;
+}
+
+/**
+ * Header, with all sockets attached, then the rest of the state
+ * as a binary dynamic (same machine, see dynamicToBinary()).
+ */
+bool sendState(int fd, const TakeoverState& state) {
+  if (state.sockets.size() + state.sslSockets.size() > kMaxSockets) {
+    LOG(ERROR) << "Can not hand over more than " << kMaxSockets
+               << " listening sockets";
+    return false;
+  }
+
+  folly::dynamic tkos = folly::dynamic::object;
+  for (const auto& it : state.tkos) {
+    tkos[it.first] = it.second;
+  }
+  auto data = dynamicToBinary(folly::dynamic::object
+    ("tkos", std::move(tkos))
+    ("config_snapshot", state.configSnapshot));
+
+  Header header;
+  memcpy(header.magic, kTakeoverMagic, sizeof(kTakeoverMagic));
+  header.numSockets = state.sockets.size();
+  header.numSslSockets = state.sslSockets.size();
+  header.dataLength = data.size();
+
+  std::vector<int> fds(state.sockets);
+  fds.insert(fds.end(), state.sslSockets.begin(), state.sslSockets.end());
+
+  struct iovec iov;
+  iov.iov_base = &header;
+  iov.iov_len = sizeof(header);
+  char control[CMSG_SPACE(sizeof(int) * kMaxSockets)];
+  memset(control, 0, sizeof(control));
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  if (!fds.empty()) {
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+    auto cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+    memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+  }
+
+  ssize_t n;
+  do {
+    n = ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+  } while (n < 0 && errno == EINTR);
+  if (n != static_cast<ssize_t>(sizeof(header))) {
+    return false;
+  }
+  return writeAll(fd, data);
+}
+
+void receiveState(int fd, TakeoverState& state) {
+  Header header;
+  struct iovec iov;
+  iov.iov_base = &header;
+  iov.iov_len = sizeof(header);
+  char control[CMSG_SPACE(sizeof(int) * kMaxSockets)];
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t n;
+  do {
+    n = ::recvmsg(fd, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    throw std::runtime_error(std::string("Can not receive takeover: ") +
+                             strerror(errno));
+  }
+
+  /* Take ownership of whatever was passed before validating anything */
+  std::vector<int> fds;
+  for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+       cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      auto num = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      auto begin = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+      fds.insert(fds.end(), begin, begin + num);
+    }
+  }
+  auto closeAll = [&fds]() {
+    for (auto sock : fds) {
+      ::close(sock);
+    }
+  };
+
+  if (n != static_cast<ssize_t>(sizeof(header)) ||
+      memcmp(header.magic, kTakeoverMagic, sizeof(kTakeoverMagic)) != 0 ||
+      (msg.msg_flags & MSG_CTRUNC) ||
+      fds.size() != size_t(header.numSockets) + header.numSslSockets) {
+    closeAll();
+    throw std::runtime_error("Invalid takeover header");
+  }
+
+  std::string data(header.dataLength, '\0');
+  if (folly::readFull(fd, &data[0], data.size()) !=
+        static_cast<ssize_t>(data.size())) {
+    closeAll();
+    throw std::runtime_error("Can not receive takeover state");
+  }
+
+  try {
+    auto json = dynamicFromBinary(folly::ByteRange(folly::StringPiece(data)));
+    for (const auto& it : json["tkos"].items()) {
+      state.tkos.emplace(it.first.asString().toStdString(),
+                         it.second.asBool());
+    }
+    state.configSnapshot =
+      json["config_snapshot"].asString().toStdString();
+  } catch (const std::exception& e) {
+    closeAll();
+    throw std::runtime_error(std::string("Invalid takeover state: ") +
+                             e.what());
+  }
+
+  state.sockets.assign(fds.begin(), fds.begin() + header.numSockets);
+  state.sslSockets.assign(fds.begin() + header.numSockets, fds.end());
+}
+
+}  // anonymous namespace
+
+int receiveTakeover(const std::string& path, TakeoverState& state) {
+  struct sockaddr_un addr;
+  if (!toSockaddr(path, addr)) {
+    throw std::runtime_error("Invalid takeover socket path: " + path);
+  }
+
+  int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    throw std::runtime_error(std::string("Can not create socket: ") +
+                             strerror(errno));
+  }
+  if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr),
+                sizeof(addr)) != 0) {
+    auto err = errno;
+    ::close(fd);
+    /* Nobody to take over from (or a stale path) */
+    if (err == ENOENT || err == ECONNREFUSED) {
+      return -1;
+    }
+    throw std::runtime_error("Can not connect to " + path + ": " +
+                             strerror(err));
+  }
+
+  setTimeouts(fd);
+  try {
+    receiveState(fd, state);
+  } catch (...) {
+    ::close(fd);
+    throw;
+  }
+  return fd;
+}
+
+bool ackTakeover(int fd) {
+  bool acked = writeAll(fd, folly::StringPiece(kTakeoverMagic,
+                                               sizeof(kTakeoverMagic)));
+  ::close(fd);
+  return acked;
+}
+
+TakeoverListener::TakeoverListener(std::string path,
+                                   std::function<TakeoverState()> getState,
+                                   std::function<void()> onTakenOver)
+    : path_(std::move(path)),
+      getState_(std::move(getState)),
+      onTakenOver_(std::move(onTakenOver)),
+      pid_(getpid()) {
+}
+
+TakeoverListener::~TakeoverListener() {
+  stop();
+}
+
+bool TakeoverListener::start() {
+  if (running_) {
+    return false;
+  }
+
+  struct sockaddr_un addr;
+  if (!toSockaddr(path_, addr)) {
+    LOG(ERROR) << "Invalid takeover socket path: " << path_;
+    return false;
+  }
+  listenFd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listenFd_ < 0) {
+    PLOG(ERROR) << "Can not create takeover socket";
+    return false;
+  }
+  /* Left by the process we took over from, or by a crashed one */
+  ::unlink(path_.c_str());
+  if (::bind(listenFd_, reinterpret_cast<struct sockaddr*>(&addr),
+             sizeof(addr)) ||
+      ::listen(listenFd_, 1)) {
+    PLOG(ERROR) << "Can not listen on takeover socket " << path_;
+    ::close(listenFd_);
+    listenFd_ = -1;
+    return false;
+  }
+  wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  running_ = true;
+  const std::string threadName = "mcrtr-takeover";
+  try {
+    thread_ = std::thread([this]() { run(); });
+    folly::setThreadName(thread_.native_handle(), threadName);
+  } catch (const std::system_error& e) {
+    running_ = false;
+    LOG(ERROR) << "Can not start TakeoverListener thread " << threadName
+               << ": " << e.what();
+  }
+
+  return running_;
+}
+
+void TakeoverListener::stop() {
+  if (running_) {
+    running_ = false;
+    uint64_t one = 1;
+    auto rc = ::write(wakeFd_, &one, sizeof(one));
+    (void)rc;
+  }
+  if (thread_.joinable()) {
+    if (getpid() == pid_) {
+      thread_.join();
+    } else {
+      thread_.detach();
+    }
+  }
+  if (listenFd_ >= 0) {
+    ::close(listenFd_);
+    listenFd_ = -1;
+    if (!takenOver_) {
+      ::unlink(path_.c_str());
+    }
+  }
+  if (wakeFd_ >= 0) {
+    ::close(wakeFd_);
+    wakeFd_ = -1;
+  }
+}
+
+void TakeoverListener::run() {
+  while (running_) {
+    struct pollfd fds[2];
+    fds[0].fd = listenFd_;
+    fds[0].events = POLLIN;
+    fds[1].fd = wakeFd_;
+    fds[1].events = POLLIN;
+    auto rc = ::poll(fds, 2, -1);
+    if (rc <= 0 || !(fds[0].revents & POLLIN) || !running_) {
+      continue;
+    }
+    int fd = ::accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+      continue;
+    }
+    bool acked = handOver(fd);
+    ::close(fd);
+    if (acked) {
+      LOG(INFO) << "Taken over through " << path_;
+      takenOver_ = true;
+      running_ = false;
+      onTakenOver_();
+    }
+  }
+}
+
+bool TakeoverListener::handOver(int fd) {
+  setTimeouts(fd);
+  try {
+    if (!sendState(fd, getState_())) {
+      LOG(WARNING) << "Can not hand over state through " << path_;
+      return false;
+    }
+  } catch (const std::exception& e) {
+    LOG(WARNING) << "Can not hand over state through " << path_ << ": "
+                 << e.what();
+    return false;
+  }
+
+  /* The new process is loading its config and starting to serve,
+     that's not bounded by the socket timeout */
+  struct pollfd fds[2];
+  fds[0].fd = fd;
+  fds[0].events = POLLIN;
+  fds[1].fd = wakeFd_;
+  fds[1].events = POLLIN;
+  while (running_) {
+    auto rc = ::poll(fds, 2, -1);
+    if (rc < 0 && errno == EINTR) {
+      continue;
+    }
+    if (rc <= 0 || !running_) {
+      return false;
+    }
+    if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+      char ack[sizeof(kTakeoverMagic)];
+      if (folly::readFull(fd, ack, sizeof(ack)) !=
+            static_cast<ssize_t>(sizeof(ack)) ||
+          memcmp(ack, kTakeoverMagic, sizeof(ack)) != 0) {
+        LOG(WARNING) << "Process taking over through " << path_
+                     << " went away";
+        return false;
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+}}}  // facebook::memcache::mcrouter
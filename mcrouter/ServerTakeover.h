@@ -0,0 +1,110 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * What a running mcrouter hands over to the one replacing it.
+ */
+struct TakeoverState {
+  /* Listening sockets, owned by the receiving process once received */
+  std::vector<int> sockets;
+  std::vector<int> sslSockets;
+  /* host:port => is it hard TKO, for every destination marked TKO */
+  std::unordered_map<std::string, bool> tkos;
+  /* Contents of opts.config_snapshot_file, empty if there's none */
+  std::string configSnapshot;
+};
+
+/**
+ * Connects to the mcrouter waiting for takeovers on the unix socket path
+ * (see TakeoverListener) and receives its state. That mcrouter keeps
+ * serving until ackTakeover() is called on the returned connection, or
+ * the connection is closed.
+ *
+ * @return  connection fd, or -1 if no mcrouter is waiting on path.
+ * @throws std::runtime_error  if the state couldn't be received.
+ */
+int receiveTakeover(const std::string& path, TakeoverState& state);
+
+/**
+ * Tells the mcrouter we took over from that we're serving now, so it
+ * starts draining. Closes fd.
+ *
+ * @return false if that mcrouter went away in the meantime.
+ */
+bool ackTakeover(int fd);
+
+/**
+ * Waits for a takeover on a unix socket from a thread of its own.
+ *
+ * A connecting process is sent the state returned by getState(), which is
+ * called on the listener thread. Once the process acknowledges it is
+ * serving, onTakenOver() is called (again on the listener thread) and the
+ * listener stops. If the process disconnects first, its sockets are just
+ * duplicates to us, we keep serving and waiting for another takeover.
+ */
+class TakeoverListener {
+ public:
+  TakeoverListener(std::string path,
+                   std::function<TakeoverState()> getState,
+                   std::function<void()> onTakenOver);
+
+  ~TakeoverListener();
+
+  /**
+   * Binds the socket path (replacing a previous one) and starts the thread.
+   *
+   * @return False if the path couldn't be bound or the thread started.
+   */
+  bool start();
+
+  /**
+   * Stops the thread and joins it. The socket path is removed,
+   * unless we were taken over and it belongs to our successor now.
+   */
+  void stop();
+
+ private:
+  const std::string path_;
+  std::function<TakeoverState()> getState_;
+  std::function<void()> onTakenOver_;
+  int listenFd_{-1};
+  /* Wakes up the listener thread on stop() */
+  int wakeFd_{-1};
+  std::thread thread_;
+  std::atomic<bool> running_{false};
+  std::atomic<bool> takenOver_{false};
+  pid_t pid_;
+
+  void run();
+
+  /**
+   * Sends our state on the accepted connection fd and waits for the ack.
+   *
+   * @return True if acknowledged.
+   */
+  bool handOver(int fd);
+
+  TakeoverListener(const TakeoverListener&) = delete;
+  TakeoverListener& operator=(const TakeoverListener&) = delete;
+};
+
+}}}  // facebook::memcache::mcrouter
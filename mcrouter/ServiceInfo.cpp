@@ -10,10 +10,13 @@
 #include "ServiceInfo.h"
 
 #include <functional>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include <folly/Conv.h>
+#include <folly/experimental/fibers/Baton.h>
 #include <folly/Format.h>
 #include <folly/json.h>
 #include <folly/Memory.h>
@@ -21,55 +24,84 @@
 
 #include "mcrouter/config-impl.h"
 #include "mcrouter/config.h"
+#include "mcrouter/ConfigIntrospection.h"
 #include "mcrouter/lib/fbi/cpp/globals.h"
 #include "mcrouter/McrouterInstance.h"
+#include "mcrouter/MemoryUsage.h"
 #include "mcrouter/options.h"
 #include "mcrouter/proxy.h"
 #include "mcrouter/ProxyClientCommon.h"
-#include "mcrouter/ProxyConfigBuilder.h"
 #include "mcrouter/ProxyConfigIf.h"
 #include "mcrouter/ProxyMcRequest.h"
 #include "mcrouter/ProxyRequestContext.h"
 #include "mcrouter/routes/McOpList.h"
 #include "mcrouter/routes/ProxyRoute.h"
+#include "mcrouter/stats.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
+namespace {
+
+std::string trimReply(std::string reply) {
+  if (!reply.empty() && reply.back() == '\n') {
+    reply.pop_back();
+  }
+  return reply;
+}
+
+}  // anonymous namespace
+
 struct ServiceInfo::ServiceInfoImpl {
+  /* Run on the router's serviceInfoWriter(): may only use immutable or
+     thread safe data, which must outlive the config */
+  using AsyncCommand =
+    std::function<std::string(const std::vector<std::string>& args)>;
+
   proxy_t* proxy_;
   ProxyRoute& proxyRoute_;
+  std::shared_ptr<const ConfigIntrospection> introspection_;
   std::unordered_map<
     std::string,
     std::function<std::string(const std::vector<folly::StringPiece>& args)>>
   commands_;
+  std::unordered_map<std::string, AsyncCommand> asyncCommands_;
+
+  ServiceInfoImpl(proxy_t* proxy, const ProxyConfigIf& config,
+                  std::shared_ptr<const ConfigIntrospection> introspection);
 
-  ServiceInfoImpl(proxy_t* proxy, const ProxyConfigIf& config);
+  void handleRouteCommand(const ProxyRequestContext::Ptr& ctx,
+                          const std::vector<folly::StringPiece>& args) const;
 
-  void handleRouteCommand(const std::shared_ptr<ProxyRequestContext>& ctx,
+  /**
+   * Runs command on the router's serviceInfoWriter(), the reply is sent
+   * from the proxy thread once it's done.
+   */
+  void handleAsyncCommand(const ProxyRequestContext::Ptr& ctx,
+                          const AsyncCommand& command,
                           const std::vector<folly::StringPiece>& args) const;
 
   template <typename Operation>
-  void handleRouteCommandForOp(const std::shared_ptr<ProxyRequestContext>& ctx,
+  void handleRouteCommandForOp(const ProxyRequestContext::Ptr& ctx,
                                std::string keyStr,
                                Operation) const;
 
   void routeCommandHelper(
     folly::StringPiece op,
     folly::StringPiece key,
-    const std::shared_ptr<ProxyRequestContext>& ctx,
+    const ProxyRequestContext::Ptr& ctx,
     McOpList::Item<0>) const;
 
   template <int op_id>
   void routeCommandHelper(
     folly::StringPiece op,
     folly::StringPiece key,
-    const std::shared_ptr<ProxyRequestContext>& ctx,
+    const ProxyRequestContext::Ptr& ctx,
     McOpList::Item<op_id>) const;
 };
 
 template <typename Operation>
 void ServiceInfo::ServiceInfoImpl::handleRouteCommandForOp(
-  const std::shared_ptr<ProxyRequestContext>& ctx,
+  const ProxyRequestContext::Ptr& ctx,
   std::string keyStr,
   Operation) const {
 #ifdef __clang__
@@ -120,7 +152,7 @@ inline void dumpTree(std::string& tree,
                      int level,
                      const RouteHandle& rh,
                      const ProxyMcRequest& req,
-                     const std::shared_ptr<ProxyRequestContext>& ctx,
+                     const ProxyRequestContext::Ptr& ctx,
                      Operation) {
   tree.append(std::string(level, ' ') + rh.routeName() + '\n');
   auto targets = rh.couldRouteTo(req, Operation(), ctx);
@@ -134,7 +166,7 @@ template <int op_id>
 inline std::string routeHandlesCommandHelper(
   folly::StringPiece op,
   const ProxyMcRequest& req,
-  const std::shared_ptr<ProxyRequestContext>& ctx,
+  const ProxyRequestContext::Ptr& ctx,
   const ProxyRoute& proxyRoute,
   McOpList::Item<op_id>) {
 
@@ -152,7 +184,7 @@ inline std::string routeHandlesCommandHelper(
 inline std::string routeHandlesCommandHelper(
   folly::StringPiece op,
   const ProxyMcRequest& req,
-  const std::shared_ptr<ProxyRequestContext>& ctx,
+  const ProxyRequestContext::Ptr& ctx,
   const ProxyRoute& proxyRoute,
   McOpList::Item<0>) {
 
@@ -162,7 +194,7 @@ inline std::string routeHandlesCommandHelper(
 void ServiceInfo::ServiceInfoImpl::routeCommandHelper(
   folly::StringPiece op,
   folly::StringPiece key,
-  const std::shared_ptr<ProxyRequestContext>& ctx,
+  const ProxyRequestContext::Ptr& ctx,
   McOpList::Item<0>) const {
 
   throw std::runtime_error("route: unknown op " + op.str());
@@ -172,7 +204,7 @@ template <int op_id>
 void ServiceInfo::ServiceInfoImpl::routeCommandHelper(
   folly::StringPiece op,
   folly::StringPiece key,
-  const std::shared_ptr<ProxyRequestContext>& ctx,
+  const ProxyRequestContext::Ptr& ctx,
   McOpList::Item<op_id>) const {
 
   if (op == mc_op_to_string(McOpList::Item<op_id>::op::mc_op)) {
@@ -190,14 +222,19 @@ void ServiceInfo::ServiceInfoImpl::routeCommandHelper(
 ServiceInfo::~ServiceInfo() {
 }
 
-ServiceInfo::ServiceInfo(proxy_t* proxy, const ProxyConfigIf& config)
-    : impl_(folly::make_unique<ServiceInfoImpl>(proxy, config)) {
+ServiceInfo::ServiceInfo(
+    proxy_t* proxy, const ProxyConfigIf& config,
+    std::shared_ptr<const ConfigIntrospection> introspection)
+    : impl_(folly::make_unique<ServiceInfoImpl>(proxy, config,
+                                                std::move(introspection))) {
 }
 
-ServiceInfo::ServiceInfoImpl::ServiceInfoImpl(proxy_t* proxy,
-                                              const ProxyConfigIf& config)
+ServiceInfo::ServiceInfoImpl::ServiceInfoImpl(
+    proxy_t* proxy, const ProxyConfigIf& config,
+    std::shared_ptr<const ConfigIntrospection> introspection)
     : proxy_(proxy),
-      proxyRoute_(config.proxyRoute()) {
+      proxyRoute_(config.proxyRoute()),
+      introspection_(std::move(introspection)) {
 
   commands_.emplace("version",
     [] (const std::vector<folly::StringPiece>& args) {
@@ -205,13 +242,15 @@ ServiceInfo::ServiceInfoImpl::ServiceInfoImpl(proxy_t* proxy,
     }
   );
 
-  commands_.emplace("config",
-    [this] (const std::vector<folly::StringPiece>& args) {
-      if (proxy_->opts.config_str.empty()) {
+  /* Options belong to the router, they outlive its configs */
+  const auto& opts = proxy_->opts;
+  asyncCommands_.emplace("config",
+    [&opts] (const std::vector<std::string>& args) {
+      if (opts.config_str.empty()) {
         return std::string(
           R"({"error": "config is loaded from file and not available"})");
       }
-      return std::string(proxy_->opts.config_str);
+      return std::string(opts.config_str);
     }
   );
 
@@ -295,27 +334,136 @@ ServiceInfo::ServiceInfoImpl::ServiceInfoImpl(proxy_t* proxy,
     }
   );
 
-  commands_.emplace("config_sources_info",
-    [this] (const std::vector<folly::StringPiece>& args) {
-      auto configInfo = proxy_->router->configApi().getConfigSourcesInfo();
+  /* Thread safe, and owned by the router too */
+  auto& configApi = proxy_->router->configApi();
+  asyncCommands_.emplace("config_sources_info",
+    [&configApi] (const std::vector<std::string>& args) {
+      auto configInfo = configApi.getConfigSourcesInfo();
       return folly::toPrettyJson(configInfo).toStdString();
     }
   );
 
-  commands_.emplace("preprocessed_config",
+  /* The config as loaded, not the config file as it is now */
+  auto snapshot = introspection_;
+  asyncCommands_.emplace("preprocessed_config",
+    [snapshot] (const std::vector<std::string>& args) {
+      return snapshot->preprocessedConfigJson();
+    }
+  );
+
+  commands_.emplace("histograms",
+    [this] (const std::vector<folly::StringPiece>& args) {
+      if (args.size() > 1) {
+        throw std::runtime_error("histograms: 0 or 1 args expected");
+      }
+      auto histograms = latency_histograms(proxy_->router);
+      if (args.size() == 1) {
+        auto it = histograms.find(args[0].str());
+        if (it == histograms.items().end()) {
+          throw std::runtime_error("histograms: expected one of "
+                                   "routes, pools, servers, proxy_loop");
+        }
+        return folly::toPrettyJson(it->second).toStdString();
+      }
+      return folly::toPrettyJson(histograms).toStdString();
+    }
+  );
+
+  commands_.emplace("destinations",
+    [this] (const std::vector<folly::StringPiece>& args) {
+      if (args.size() > 1) {
+        throw std::runtime_error("destinations: 0 or 1 args expected");
+      }
+      auto result = destinations(proxy_->router,
+                                 args.empty() ? "" : args[0]);
+      return folly::toPrettyJson(result).toStdString();
+    }
+  );
+
+  commands_.emplace("pool_stats",
+    [this] (const std::vector<folly::StringPiece>& args) {
+      if (args.size() > 1) {
+        throw std::runtime_error("pool_stats: 0 or 1 args expected");
+      }
+      auto stats = pool_stats(proxy_->router);
+      if (args.size() == 1) {
+        auto it = stats.find(args[0].str());
+        if (it == stats.items().end()) {
+          throw std::runtime_error("pool_stats: no requests to pool " +
+                                   args[0].str());
+        }
+        return folly::toPrettyJson(it->second).toStdString();
+      }
+      return folly::toPrettyJson(stats).toStdString();
+    }
+  );
+
+  commands_.emplace("op_sizes",
+    [this] (const std::vector<folly::StringPiece>& args) {
+      return folly::toPrettyJson(op_sizes(proxy_->router)).toStdString();
+    }
+  );
+
+  commands_.emplace("memory",
     [this] (const std::vector<folly::StringPiece>& args) {
-      std::string confFile;
-      if (!proxy_->router->configApi().getConfigFile(confFile)) {
-        throw std::runtime_error("can not load config");
+      if (!args.empty()) {
+        throw std::runtime_error("memory: no args expected");
       }
-      ProxyConfigBuilder builder(proxy_->opts,
-                                 &proxy_->router->configApi(),
-                                 confFile);
-      folly::json::serialization_opts jsonOpts;
-      jsonOpts.pretty_formatting = true;
-      jsonOpts.sort_keys = true;
-      return folly::json::serialize(builder.preprocessedConfig(),
-                                    jsonOpts).toStdString();
+      auto usage = MemoryUsage::collect(*proxy_->router);
+      return folly::toPrettyJson(usage.toDynamic()).toStdString();
+    }
+  );
+
+  commands_.emplace("route_cpu",
+    [this] (const std::vector<folly::StringPiece>& args) {
+      if (!args.empty()) {
+        throw std::runtime_error("route_cpu: no args expected");
+      }
+      return folly::toPrettyJson(route_cpu(proxy_->router)).toStdString();
+    }
+  );
+
+  commands_.emplace("preconnect",
+    [this] (const std::vector<folly::StringPiece>& args) {
+      return folly::toPrettyJson(
+        preconnect_status(proxy_->router)).toStdString();
+    }
+  );
+
+  commands_.emplace("request_phases",
+    [this] (const std::vector<folly::StringPiece>& args) {
+      if (args.size() > 1) {
+        throw std::runtime_error("request_phases: 0 or 1 args expected");
+      }
+      auto phases = request_phases(proxy_->router);
+      if (args.size() == 1) {
+        auto it = phases.find(args[0].str());
+        if (it == phases.items().end()) {
+          throw std::runtime_error("request_phases: unknown phase " +
+                                   args[0].str());
+        }
+        return folly::toPrettyJson(it->second).toStdString();
+      }
+      return folly::toPrettyJson(phases).toStdString();
+    }
+  );
+
+  commands_.emplace("hot_keys",
+    [this] (const std::vector<folly::StringPiece>& args) {
+      return folly::toPrettyJson(hot_keys(proxy_->router)).toStdString();
+    }
+  );
+
+  commands_.emplace("top_clients",
+    [this] (const std::vector<folly::StringPiece>& args) {
+      return folly::toPrettyJson(top_clients(proxy_->router)).toStdString();
+    }
+  );
+
+  commands_.emplace("slow_requests",
+    [this] (const std::vector<folly::StringPiece>& args) {
+      return folly::toPrettyJson(
+        slow_requests(proxy_->router)).toStdString();
     }
   );
 
@@ -341,7 +489,7 @@ ServiceInfo::ServiceInfoImpl::ServiceInfoImpl(proxy_t* proxy,
 }
 
 void ServiceInfo::ServiceInfoImpl::handleRouteCommand(
-  const std::shared_ptr<ProxyRequestContext>& ctx,
+  const ProxyRequestContext::Ptr& ctx,
   const std::vector<folly::StringPiece>& args) const {
 
   if (args.size() != 2) {
@@ -353,9 +501,49 @@ void ServiceInfo::ServiceInfoImpl::handleRouteCommand(
   routeCommandHelper(op, key, ctx, McOpList::LastItem());
 }
 
+void ServiceInfo::ServiceInfoImpl::handleAsyncCommand(
+  const ProxyRequestContext::Ptr& ctx,
+  const AsyncCommand& command,
+  const std::vector<folly::StringPiece>& args) const {
+
+  /* What the worker and the fiber waiting for it share */
+  struct Result {
+    folly::fibers::Baton baton;
+    std::string reply;
+  };
+  auto result = std::make_shared<Result>();
+  std::vector<std::string> argsCopy;
+  for (auto arg : args) {
+    argsCopy.push_back(arg.str());
+  }
+  auto task = [command, argsCopy, result]() {
+    try {
+      result->reply = trimReply(command(argsCopy));
+    } catch (const std::exception& e) {
+      result->reply = std::string("ERROR: ") + e.what();
+    }
+    result->baton.post();
+  };
+
+  /* The fiber keeps the proxy running on shutdown until the worker is
+     done with it, and replies on the proxy thread in any case: contexts
+     are refcounted non-atomically */
+  auto& worker = proxy_->router->serviceInfoWriter();
+  proxy_->fiberManager.addTask([ctx, result, task, &worker]() {
+    if (!worker.run(task)) {
+      /* Queue is full, or the router is shutting down */
+      ctx->sendReply(McReply(mc_res_found,
+                             "ERROR: too many pending commands"));
+      return;
+    }
+    result->baton.wait();
+    ctx->sendReply(McReply(mc_res_found, result->reply));
+  });
+}
+
 void ServiceInfo::handleRequest(
     const ProxyMcRequest& req,
-    const std::shared_ptr<ProxyRequestContext>& ctx) const {
+    const ProxyRequestContext::Ptr& ctx) const {
   auto key = req.keyWithoutRoute();
   auto p = key.find('(');
   auto cmd = key;
@@ -380,14 +568,17 @@ void ServiceInfo::handleRequest(
       return;
     }
 
+    auto asyncIt = impl_->asyncCommands_.find(cmd.str());
+    if (asyncIt != impl_->asyncCommands_.end()) {
+      impl_->handleAsyncCommand(ctx, asyncIt->second, args);
+      return;
+    }
+
     auto it = impl_->commands_.find(cmd.str());
     if (it == impl_->commands_.end()) {
       throw std::runtime_error("unknown command: " + cmd.str());
     }
-    replyStr = it->second(args);
-    if (!replyStr.empty() && replyStr.back() == '\n') {
-      replyStr = replyStr.substr(0, replyStr.size() - 1);
-    }
+    replyStr = trimReply(it->second(args));
   } catch (const std::exception& e) {
     replyStr = std::string("ERROR: ") + e.what();
   }
@@ -11,8 +11,11 @@
 
 #include <memory>
 
+#include "mcrouter/lib/fbi/cpp/LocalRefPtr.h"
+
 namespace facebook { namespace memcache { namespace mcrouter {
 
+class ConfigIntrospection;
 class ProxyConfigIf;
 class ProxyMcRequest;
 class ProxyRequestContext;
@@ -21,13 +24,20 @@ class proxy_t;
 /**
  * Answers mc_op_get_service_info requests of the form
  * __mcrouter__.commands(args,...)
+ *
+ * Commands that render large JSON (config, preprocessed_config,
+ * config_sources_info) are answered from immutable data (see
+ * ConfigIntrospection) on the router's serviceInfoWriter(), so they don't
+ * hold up the proxy's requests. route_handles has to walk the proxy's
+ * routes on its thread.
  */
 class ServiceInfo {
  public:
-  ServiceInfo(proxy_t* proxy, const ProxyConfigIf& config);
+  ServiceInfo(proxy_t* proxy, const ProxyConfigIf& config,
+              std::shared_ptr<const ConfigIntrospection> introspection);
 
   void handleRequest(const ProxyMcRequest& req,
-                     const std::shared_ptr<ProxyRequestContext>& ctx) const;
+                     const LocalRefPtr<ProxyRequestContext>& ctx) const;
 
   ~ServiceInfo();
 
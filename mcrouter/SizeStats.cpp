@@ -0,0 +1,45 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "SizeStats.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+folly::dynamic SizeHistograms::toDynamic() const {
+  return folly::dynamic::object
+    ("key_size", keySize.toDynamic())
+    ("value_size", valueSize.toDynamic());
+}
+
+OpSizeStats::OpSizeStats() {
+  for (auto& entry : entries_) {
+    entry.store(nullptr, std::memory_order_relaxed);
+  }
+}
+
+OpSizeStats::~OpSizeStats() {
+  for (auto& entry : entries_) {
+    delete entry.load(std::memory_order_relaxed);
+  }
+}
+
+void OpSizeStats::record(mc_op_t op, size_t keyBytes, size_t valueBytes) {
+  if (static_cast<int>(op) >= mc_nops) {
+    op = mc_op_unknown;
+  }
+  auto& slot = entries_[op];
+  auto entry = slot.load(std::memory_order_relaxed);
+  if (entry == nullptr) {
+    entry = new SizeHistograms();
+    slot.store(entry, std::memory_order_release);
+  }
+  entry->record(keyBytes, valueBytes);
+}
+
+}}}  // facebook::memcache::mcrouter
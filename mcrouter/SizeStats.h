@@ -0,0 +1,85 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+#include <folly/dynamic.h>
+
+#include "mcrouter/LatencyHistogram.h"
+#include "mcrouter/lib/mc/msg.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Key and value sizes (in bytes) of requests to destinations, to size
+ * slabs, big values and buffers.
+ *
+ * The value size is the one of the request plus the one of the reply:
+ * updates carry a value, gets get one back, and hardly any request has
+ * both. Histograms are log-linear (see LatencyHistogram), so a record
+ * doesn't allocate and costs a few relaxed atomics.
+ */
+struct SizeHistograms {
+  LatencyHistogram keySize;
+  LatencyHistogram valueSize;
+
+  void record(size_t keyBytes, size_t valueBytes) {
+    keySize.record(keyBytes);
+    valueSize.record(valueBytes);
+  }
+
+  void merge(const SizeHistograms& other) {
+    keySize.merge(other.keySize);
+    valueSize.merge(other.valueSize);
+  }
+
+  /**
+   * {"key_size": {...}, "value_size": {...}}
+   * see LatencyHistogram::toDynamic().
+   */
+  folly::dynamic toDynamic() const;
+};
+
+/**
+ * Per proxy size histograms of all operations, indexed by mc_op_t.
+ * Entries are allocated on the first request of an operation.
+ * Written by the proxy thread only, read from any thread.
+ */
+class OpSizeStats {
+ public:
+  OpSizeStats();
+  ~OpSizeStats();
+
+  /* Proxy thread only */
+  void record(mc_op_t op, size_t keyBytes, size_t valueBytes);
+
+  /**
+   * Calls f(mc_op_t op, const SizeHistograms&) for each operation that got
+   * any requests. Thread safe.
+   */
+  template <typename Func>
+  void foreach(Func&& f) const {
+    for (int op = 0; op < mc_nops; ++op) {
+      if (auto entry = entries_[op].load(std::memory_order_acquire)) {
+        f(static_cast<mc_op_t>(op), *entry);
+      }
+    }
+  }
+
+ private:
+  std::atomic<SizeHistograms*> entries_[mc_nops];
+
+  OpSizeStats(const OpSizeStats&) = delete;
+  OpSizeStats& operator=(const OpSizeStats&) = delete;
+};
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,242 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "SlowRequestLog.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <string>
+
+#include <folly/experimental/fibers/FiberManager.h>
+
+#include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/proxy.h"
+#include "mcrouter/ProxyClientCommon.h"
+#include "mcrouter/ProxyDestination.h"
+#include "mcrouter/ProxyMcReply.h"
+#include "mcrouter/ProxyMcRequest.h"
+#include "mcrouter/ProxyRequestContext.h"
+#include "mcrouter/routes/McOpList.h"
+#include "mcrouter/routes/McrouterRouteHandle.h"
+#include "mcrouter/routes/ProxyRoute.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+std::atomic<uint64_t> gDumpGeneration{0};
+
+/* Bounds the work of finding a route path in huge trees */
+const size_t kMaxRouteNodes = 1024;
+
+void copyTruncated(char* to, size_t size, folly::StringPiece from) {
+  auto len = std::min(from.size(), size - 1);
+  std::memcpy(to, from.data(), len);
+  to[len] = '\0';
+}
+
+struct RoutePathFinder {
+  const ProxyClientCommon* client;
+  std::vector<std::string> names;
+  std::string path;
+  size_t nodesLeft{kMaxRouteNodes};
+
+  void onDestination(const ProxyClientCommon& destination) {
+    if (&destination != client || !path.empty()) {
+      return;
+    }
+    for (const auto& name : names) {
+      if (!path.empty()) {
+        path.append(" -> ");
+      }
+      path.append(name);
+    }
+  }
+};
+
+template <class Operation>
+void findRoutePath(RoutePathFinder& finder,
+                   const McrouterRouteHandleIf& rh,
+                   const ProxyMcRequest& req,
+                   const ProxyRequestContext::Ptr& ctx,
+                   Operation) {
+  if (!finder.path.empty() || finder.nodesLeft == 0) {
+    return;
+  }
+  --finder.nodesLeft;
+  finder.names.push_back(rh.routeName());
+  /* Calls back into finder if rh is the destination */
+  auto targets = rh.couldRouteTo(req, Operation(), ctx);
+  for (const auto& target : targets) {
+    findRoutePath(finder, *target, req, ctx, Operation());
+  }
+  finder.names.pop_back();
+}
+
+std::string routePathHelper(RoutePathFinder& finder,
+                            const ProxyRoute& proxyRoute,
+                            const ProxyMcRequest& req,
+                            const ProxyRequestContext::Ptr& ctx,
+                            mc_op_t op,
+                            McOpList::Item<0>) {
+  return "";
+}
+
+template <int op_id>
+std::string routePathHelper(RoutePathFinder& finder,
+                            const ProxyRoute& proxyRoute,
+                            const ProxyMcRequest& req,
+                            const ProxyRequestContext::Ptr& ctx,
+                            mc_op_t op,
+                            McOpList::Item<op_id>) {
+  using Operation = typename McOpList::Item<op_id>::op;
+  if (op != Operation::mc_op) {
+    return routePathHelper(finder, proxyRoute, req, ctx, op,
+                           McOpList::Item<op_id - 1>());
+  }
+  for (const auto& target : proxyRoute.couldRouteTo(req, Operation(), ctx)) {
+    findRoutePath(finder, *target, req, ctx, Operation());
+  }
+  return std::move(finder.path);
+}
+
+/**
+ * @return  names of the routes leading from proxyRoute to client for req,
+ *          empty if client can't be found.
+ */
+std::string routePath(proxy_t& proxy,
+                      const ProxyRoute& proxyRoute,
+                      const ProxyClientCommon& client,
+                      const ProxyMcRequest& req,
+                      mc_op_t op) {
+  RoutePathFinder finder;
+  finder.client = &client;
+  /* Routes only report destinations to recording contexts */
+  auto ctx = ProxyRequestContext::createRecording(
+    proxy,
+    [&finder](const ProxyClientCommon& destination) {
+      finder.onDestination(destination);
+    });
+  return routePathHelper(finder, proxyRoute, req, ctx, op,
+                         McOpList::LastItem());
+}
+
+}  // anonymous namespace
+
+constexpr size_t SlowRequestLog::kMaxDestinationLength;
+constexpr size_t SlowRequestLog::kMaxRouteLength;
+
+SlowRequestLog::Entry::Entry() {
+  destination[0] = '\0';
+  route[0] = '\0';
+}
+
+void SlowRequestLog::Entry::setDestination(folly::StringPiece str) {
+  copyTruncated(destination, sizeof(destination), str);
+}
+
+void SlowRequestLog::Entry::setRoute(folly::StringPiece str) {
+  copyTruncated(route, sizeof(route), str);
+}
+
+folly::dynamic SlowRequestLog::Entry::toDynamic() const {
+  return folly::dynamic::object
+    ("time_us", timeUs)
+    ("duration_us", durationUs)
+    ("queue_us", queueUs)
+    ("rtt_us", rttUs)
+    ("key_hash", static_cast<int64_t>(keyHash))
+    ("op", mc_op_to_string(op))
+    ("result", mc_res_to_string(result))
+    ("destination", destination)
+    ("route", route);
+}
+
+SlowRequestLog::SlowRequestLog(int64_t thresholdUs, size_t capacity)
+    : thresholdUs_(thresholdUs > 0 && capacity > 0
+                   ? thresholdUs
+                   : std::numeric_limits<int64_t>::max()),
+      capacity_(capacity),
+      slots_(capacity > 0 ? new Slot[capacity] : nullptr) {
+}
+
+void SlowRequestLog::record(const Entry& entry) {
+  if (capacity_ == 0) {
+    return;
+  }
+  auto index = next_.load(std::memory_order_relaxed);
+  auto& slot = slots_[index % capacity_];
+  auto seq = slot.seq.load(std::memory_order_relaxed);
+  slot.seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.entry = entry;
+  slot.seq.store(seq + 2, std::memory_order_release);
+  next_.store(index + 1, std::memory_order_release);
+}
+
+std::vector<SlowRequestLog::Entry> SlowRequestLog::entries() const {
+  std::vector<Entry> result;
+  auto end = next_.load(std::memory_order_acquire);
+  auto begin = end > capacity_ ? end - capacity_ : 0;
+  result.reserve(end - begin);
+  for (auto i = begin; i < end; ++i) {
+    const auto& slot = slots_[i % capacity_];
+    auto seq = slot.seq.load(std::memory_order_acquire);
+    if (seq & 1) {
+      continue;
+    }
+    Entry entry = slot.entry;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.seq.load(std::memory_order_relaxed) != seq) {
+      continue;
+    }
+    result.push_back(entry);
+  }
+  return result;
+}
+
+void SlowRequestLog::requestDump() {
+  gDumpGeneration.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t SlowRequestLog::dumpGeneration() {
+  return gDumpGeneration.load(std::memory_order_relaxed);
+}
+
+void recordSlowRequest(const ProxyRequestContext::Ptr& ctx,
+                       const ProxyClientCommon& client,
+                       const ProxyMcRequest& req,
+                       const ProxyMcReply& reply,
+                       mc_op_t op,
+                       const DestinationRequestCtx& dctx) {
+  auto& proxy = ctx->proxy();
+
+  SlowRequestLog::Entry entry;
+  entry.timeUs = nowUs();
+  entry.durationUs = dctx.endTime - dctx.startTime;
+  if (dctx.writtenTime != 0) {
+    entry.queueUs = dctx.writtenTime - dctx.startTime;
+    entry.rttUs = dctx.endTime - dctx.writtenTime;
+  }
+  entry.keyHash = req.routingKeyHash();
+  entry.op = op;
+  entry.result = reply.result();
+  entry.setDestination(client.ap.toString());
+
+  /* Deep route trees shouldn't be walked on the fiber stack */
+  auto path = folly::fibers::runInMainContext([&]() {
+    return routePath(proxy, ctx->proxyRoute(), client, req, op);
+  });
+  entry.setRoute(path);
+
+  proxy.slowRequests.record(entry);
+}
+
+}}}  // facebook::memcache::mcrouter
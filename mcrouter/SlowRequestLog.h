@@ -0,0 +1,131 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <folly/dynamic.h>
+#include <folly/Range.h>
+
+#include "mcrouter/lib/fbi/cpp/LocalRefPtr.h"
+#include "mcrouter/lib/mc/msg.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+class ProxyClientCommon;
+class ProxyMcReply;
+class ProxyMcRequest;
+class ProxyRequestContext;
+struct DestinationRequestCtx;
+
+/**
+ * Flight recorder of the last requests to destinations that took at least
+ * opts.slow_request_threshold_us, see __mcrouter__.slow_requests.
+ *
+ * Entries live in a fixed ring. Only the owner thread (proxy thread)
+ * records; other threads read the ring without locks, every slot is
+ * guarded by a sequence number and slots overwritten while being read are
+ * skipped. Requests that aren't slow cost a single compare against
+ * thresholdUs() in DestinationRoute.
+ */
+class SlowRequestLog {
+ public:
+  static constexpr size_t kMaxDestinationLength = 64;
+  static constexpr size_t kMaxRouteLength = 256;
+
+  struct Entry {
+    /* Reply received, in microseconds since epoch */
+    int64_t timeUs{0};
+    /* Request sent to the destination -> reply received */
+    int64_t durationUs{0};
+    /* Destination queue and round trip phases of durationUs,
+       -1 unless the request's phases were sampled */
+    int64_t queueUs{-1};
+    int64_t rttUs{-1};
+    uint32_t keyHash{0};
+    mc_op_t op{mc_op_unknown};
+    mc_res_t result{mc_res_unknown};
+    char destination[kMaxDestinationLength];
+    /* Route names from couldRouteTo() down to the destination */
+    char route[kMaxRouteLength];
+
+    Entry();
+
+    void setDestination(folly::StringPiece str);
+    void setRoute(folly::StringPiece str);
+
+    folly::dynamic toDynamic() const;
+  };
+
+  /**
+   * @param thresholdUs  requests at least this slow are recorded,
+   *                     0 disables recording.
+   * @param capacity  number of entries kept.
+   */
+  SlowRequestLog(int64_t thresholdUs, size_t capacity);
+
+  /**
+   * Requests with a duration >= this are slow, never true if disabled.
+   */
+  int64_t thresholdUs() const {
+    return thresholdUs_;
+  }
+
+  /**
+   * Owner thread only.
+   */
+  void record(const Entry& entry);
+
+  /**
+   * Recorded entries, oldest first. Thread safe.
+   */
+  std::vector<Entry> entries() const;
+
+  /**
+   * Asks McrouterLogger threads to write the slow requests of their router
+   * to disk with the next stats. Async signal safe.
+   */
+  static void requestDump();
+
+  /**
+   * Incremented by every requestDump().
+   */
+  static uint64_t dumpGeneration();
+
+ private:
+  struct Slot {
+    /* Odd while the entry is being written */
+    std::atomic<uint64_t> seq{0};
+    Entry entry;
+  };
+
+  const int64_t thresholdUs_;
+  const size_t capacity_;
+  std::unique_ptr<Slot[]> slots_;
+  /* Number of entries recorded so far */
+  std::atomic<uint64_t> next_{0};
+};
+
+/**
+ * Records a request that took at least proxy's slow request threshold,
+ * with the route path leading to client. Proxy thread only.
+ */
+void recordSlowRequest(const LocalRefPtr<ProxyRequestContext>& ctx,
+                       const ProxyClientCommon& client,
+                       const ProxyMcRequest& req,
+                       const ProxyMcReply& reply,
+                       mc_op_t op,
+                       const DestinationRequestCtx& dctx);
+
+}}}  // facebook::memcache::mcrouter
@@ -9,10 +9,36 @@
  */
 #include "TkoLog.h"
 
-#include "mcrouter/lib/network/AccessPoint.h"
+#include <map>
+#include <utility>
+
+#include <glog/logging.h>
+
+#include "mcrouter/config.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
+namespace {
+
+const char* describe(TkoLogEvent event) {
+  switch (event) {
+    case TkoLogEvent::MarkHardTko:
+      return "marked hard TKO";
+    case TkoLogEvent::MarkSoftTko:
+      return "marked soft TKO";
+    case TkoLogEvent::MarkLatencyTko:
+      return "marked soft TKO as a latency outlier";
+    case TkoLogEvent::UnMarkTko:
+      return "unmarked TKO";
+    case TkoLogEvent::RemoveFromConfig:
+      return "was TKO, removed from config";
+    default:
+      return "unknown TKO event";
+  }
+}
+
+}  // anonymous namespace
+
 TkoLog::TkoLog(const AccessPoint& ap, const TkoCounters& gt)
   : accessPoint(ap),
     globalTkos(gt) {
@@ -24,6 +50,8 @@ std::string TkoLog::eventName() const {
       return "mark_hard_tko";
     case TkoLogEvent::MarkSoftTko:
       return "mark_soft_tko";
+    case TkoLogEvent::MarkLatencyTko:
+      return "mark_latency_tko";
     case TkoLogEvent::RemoveFromConfig:
       return "remove_from_config";
     case TkoLogEvent::UnMarkTko:
@@ -33,4 +61,51 @@ std::string TkoLog::eventName() const {
   }
 }
 
+constexpr size_t TkoLogQueue::kDefaultCapacity;
+
+TkoLogQueue::TkoLogQueue(size_t capacity)
+    : queue_(capacity) {
+}
+
+bool TkoLogQueue::push(proxy_t* proxy, std::unique_ptr<TkoLog> log) {
+  Entry entry;
+  entry.proxy = proxy;
+  entry.log = std::move(log);
+  return queue_.write(std::move(entry));
+}
+
+void TkoLogQueue::logNow(proxy_t* proxy, const TkoLog& log) {
+  VLOG(1) << log.accessPoint.toHostPortString() << " (" << log.poolName
+          << ") " << describe(log.event) << ". Total hard TKOs: "
+          << log.globalTkos.hardTkos << "; soft TKOs: "
+          << log.globalTkos.softTkos << ". Reply: "
+          << mc_res_to_string(log.result);
+  logTkoEvent(proxy, log);
+}
+
+size_t TkoLogQueue::flush() {
+  /* (pool name, event) -> number of destinations */
+  std::map<std::pair<std::string, TkoLogEvent>, size_t> counts;
+  const TkoCounters* globalTkos = nullptr;
+  size_t logged = 0;
+
+  Entry entry;
+  while (queue_.read(entry)) {
+    logNow(entry.proxy, *entry.log);
+    ++counts[std::make_pair(entry.log->poolName, entry.log->event)];
+    globalTkos = &entry.log->globalTkos;
+    ++logged;
+  }
+
+  for (const auto& it : counts) {
+    LOG(INFO) << it.second
+              << (it.second == 1 ? " destination" : " destinations")
+              << " in pool " << it.first.first << " "
+              << describe(it.first.second) << ". Total hard TKOs: "
+              << globalTkos->hardTkos << "; soft TKOs: "
+              << globalTkos->softTkos;
+  }
+  return logged;
+}
+
 }}}  // facebook::memcache::mcrouter
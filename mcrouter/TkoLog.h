@@ -9,26 +9,33 @@
  */
 #pragma once
 
+#include <memory>
 #include <string>
 
+#include <folly/MPMCQueue.h>
 #include <folly/Range.h>
 
 #include "mcrouter/lib/mc/msg.h"
+#include "mcrouter/lib/network/AccessPoint.h"
 #include "mcrouter/TkoCounters.h"
 
-namespace facebook { namespace memcache {
+namespace facebook { namespace memcache { namespace mcrouter {
 
-class AccessPoint;
-
-namespace mcrouter {
+class proxy_t;
 
 enum class TkoLogEvent {
   MarkHardTko,
   MarkSoftTko,
+  MarkLatencyTko,
   RemoveFromConfig,
   UnMarkTko
 };
 
+/**
+ * A TKO event of a destination. Self-contained (but for globalTkos,
+ * which belongs to the router), so that it can be logged after the
+ * destination is gone, see TkoLogQueue.
+ */
 struct TkoLog {
   TkoLog(const AccessPoint& ap, const TkoCounters& gt);
 
@@ -41,9 +48,56 @@ struct TkoLog {
   mc_res_t result;
   size_t probesSent{0};
   double avgLatency{0.0};
-  const AccessPoint& accessPoint;
+  AccessPoint accessPoint;
   const TkoCounters& globalTkos;
-  folly::StringPiece poolName;
+  std::string poolName;
+};
+
+/**
+ * TKO events of all proxies of a router, logged in batches off the
+ * proxy threads.
+ *
+ * When a rack goes down, hundreds of destinations go TKO on every proxy
+ * at once; logging each of them from the proxy thread stalls the proxies.
+ * Proxies only push events into a lock-free ring instead, and flush()
+ * (on a housekeeping thread, every opts.tko_log_interval_ms) hands them
+ * to logTkoEvent() and logs one summary line per pool and event, e.g.
+ * "37 destinations in pool A marked hard TKO".
+ */
+class TkoLogQueue {
+ public:
+  /* Enough for every destination of a large config to change state at
+     once between two flushes */
+  static constexpr size_t kDefaultCapacity = 16384;
+
+  explicit TkoLogQueue(size_t capacity = kDefaultCapacity);
+
+  /**
+   * Any thread, never blocks.
+   *
+   * @return  false if the queue is full, the event is dropped.
+   */
+  bool push(proxy_t* proxy, std::unique_ptr<TkoLog> log);
+
+  /**
+   * Logs all events queued so far. Single thread at a time.
+   *
+   * @return  Number of events logged.
+   */
+  size_t flush();
+
+  /**
+   * Logs a single event right away, as flush() does for queued ones.
+   */
+  static void logNow(proxy_t* proxy, const TkoLog& log);
+
+ private:
+  struct Entry {
+    proxy_t* proxy{nullptr};
+    std::unique_ptr<TkoLog> log;
+  };
+
+  folly::MPMCQueue<Entry> queue_;
 };
 
 }}}  // facebook::memcache::mcrouter
@@ -24,19 +24,19 @@ TkoTracker::TkoTracker(std::string key,
                        size_t tkoThreshold,
                        size_t maxSoftTkos,
                        TkoTrackerMap& trackerMap)
-  : key_(std::move(key)),
-    tkoThreshold_(tkoThreshold),
+  : tkoThreshold_(tkoThreshold),
+    key_(std::move(key)),
     maxSoftTkos_(maxSoftTkos),
     trackerMap_(trackerMap) {
 }
 
 bool TkoTracker::isHardTko() const {
-  uintptr_t curSumFailures = sumFailures_;
+  uintptr_t curSumFailures = sumFailures_.load(std::memory_order_relaxed);
   return (curSumFailures > tkoThreshold_ && curSumFailures % 2 == 1);
 }
 
 bool TkoTracker::isSoftTko() const {
-  uintptr_t curSumFailures = sumFailures_;
+  uintptr_t curSumFailures = sumFailures_.load(std::memory_order_relaxed);
   return (curSumFailures > tkoThreshold_ && curSumFailures % 2 == 0);
 }
 
@@ -145,6 +145,18 @@ bool TkoTracker::recordHardFailure(ProxyDestination* pdstn) {
   return success;
 }
 
+bool TkoTracker::markSoftTko(ProxyDestination* pdstn) {
+  if (isTko() || !incrementSoftTkoCount()) {
+    return false;
+  }
+  if (!setSumFailures(reinterpret_cast<uintptr_t>(pdstn))) {
+    /* Someone else marked it TKO in the meantime */
+    decrementSoftTkoCount();
+    return false;
+  }
+  return true;
+}
+
 bool TkoTracker::isResponsible(ProxyDestination* pdstn) const {
   return (sumFailures_ & ~1) == reinterpret_cast<uintptr_t>(pdstn);
 }
@@ -214,6 +226,19 @@ TkoTrackerMap::getSuspectServers() {
   return result;
 }
 
+std::unordered_map<std::string, bool> TkoTrackerMap::getTkoServers() {
+  std::unordered_map<std::string, bool> result;
+  std::lock_guard<std::mutex> lock(mx_);
+  for (const auto& it : trackers_) {
+    if (auto tracker = it.second.lock()) {
+      if (tracker->isTko()) {
+        result.emplace(it.first, tracker->isHardTko());
+      }
+    }
+  }
+  return result;
+}
+
 std::weak_ptr<TkoTracker> TkoTrackerMap::getTracker(const std::string& key) {
   std::lock_guard<std::mutex> lock(mx_);
   return folly::get_default(trackers_, key);
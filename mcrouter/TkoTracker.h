@@ -16,6 +16,8 @@
 #include <unordered_map>
 #include <utility>
 
+#include <folly/detail/CacheLocality.h>
+
 #include "mcrouter/TkoCounters.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
@@ -38,7 +40,8 @@ class TkoTrackerMap;
  * be unmarked.
  *
  * Perf implications: recordSuccess() with no previous failures and isTko()
- * are lock-free, so the common (no error results) path is fast.
+ * are lock-free, so the common (no error results) path is fast. isTko() is
+ * a single relaxed load from a cache line that only changes on failures.
  *
  * Races are not a big issue: it's OK to miss a few events. What's of critical
  * importance is that once a destination is marked TKO, only the responsible
@@ -62,7 +65,7 @@ class TkoTracker {
    * @return Is the destination currently marked TKO?
    */
   bool isTko() const {
-    return sumFailures_ > tkoThreshold_;
+    return sumFailures_.load(std::memory_order_relaxed) > tkoThreshold_;
   }
 
   /**
@@ -71,7 +74,7 @@ class TkoTracker {
    *         calls after last recordSuccess.
    */
   size_t consecutiveFailureCount() const {
-    return consecutiveFailureCount_;
+    return consecutiveFailureCount_.load(std::memory_order_relaxed);
   }
 
   /**
@@ -111,6 +114,21 @@ class TkoTracker {
    */
   bool recordHardFailure(ProxyDestination* pdstn);
 
+  /**
+   * Can be called from any proxy thread.
+   * Marks the host soft TKO right away, regardless of the number of failures
+   * (e.g. it's much slower than its peers). Will not TKO a host if
+   * currentSoftTkos would exceed maxSoftTkos.
+   *
+   * @param pdstn  a pointer to the calling proxydestination for tracking
+   *               responsibility.
+   *
+   * @return true if the host was marked TKO by this call. In this case, the
+   *         calling proxy is responsible for sending probes and calling
+   *         recordSuccess() once a probe is successful.
+   */
+  bool markSoftTko(ProxyDestination* pdstn);
+
   /**
    * Resets all consecutive failures accumulated so far
    * (unmarking any TKO status).
@@ -131,11 +149,6 @@ class TkoTracker {
 
   ~TkoTracker();
  private:
-  std::string key_;
-  const size_t tkoThreshold_;
-  const size_t maxSoftTkos_;
-  TkoTrackerMap& trackerMap_;
-
   /* sumFailures_ is used for a few things depending on the state of the
      destination. For a destination that is not TKO, it tracks the number of
      consecutive soft failures to a destination.
@@ -145,10 +158,19 @@ class TkoTracker {
      but with the LSB set to 1 instead of 0.
      In summary, allowed values are:
        0, 1, .., tkoThreshold_ - 1, pdstn, pdstn | 0x1, where pdstn is the
-       address of any of the proxy threads for this destination. */
-  std::atomic<uintptr_t> sumFailures_{0};
+       address of any of the proxy threads for this destination.
+     Read by every request to the destination from every proxy, so it
+     shares its cache line only with tkoThreshold_. */
+  std::atomic<uintptr_t> FOLLY_ALIGN_TO_AVOID_FALSE_SHARING sumFailures_{0};
+  const size_t tkoThreshold_;
 
-  std::atomic<size_t> consecutiveFailureCount_{0};
+  /* Written on every failure */
+  std::atomic<size_t> FOLLY_ALIGN_TO_AVOID_FALSE_SHARING
+    consecutiveFailureCount_{0};
+
+  std::string key_;
+  const size_t maxSoftTkos_;
+  TkoTrackerMap& trackerMap_;
 
   /* Decrement the global counter of current soft TKOs. */
   void decrementSoftTkoCount();
@@ -204,6 +226,14 @@ class TkoTrackerMap {
    */
   std::unordered_map<std::string, std::pair<bool, size_t>> getSuspectServers();
 
+  /**
+   * @return  servers currently marked TKO.
+   *   Format: {
+   *     server ip => is server marked as hard TKO?
+   *   }
+   */
+  std::unordered_map<std::string, bool> getTkoServers();
+
   const TkoCounters& globalTkos() const {
     return globalTkos_;
   }
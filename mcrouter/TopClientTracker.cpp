@@ -0,0 +1,170 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "TopClientTracker.h"
+
+#include <algorithm>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+void sortByCost(std::vector<TopClientTracker::Entry>& entries) {
+  std::sort(entries.begin(), entries.end(),
+            [](const TopClientTracker::Entry& a,
+               const TopClientTracker::Entry& b) {
+              if (a.cost != b.cost) {
+                return a.cost > b.cost;
+              }
+              return a.client < b.client;
+            });
+}
+
+}  // anonymous namespace
+
+constexpr uint64_t TopClientTracker::kDecaySamples;
+
+TopClientTracker::TopClientTracker(size_t capacity, uint64_t samplePeriod,
+                                   uint64_t requestCost)
+    : capacity_(capacity),
+      samplePeriod_(capacity == 0 ? 0 : samplePeriod),
+      requestCost_(requestCost),
+      untilSample_(samplePeriod_) {
+  entries_.reserve(capacity_);
+  index_.reserve(capacity_);
+}
+
+void TopClientTracker::add(folly::StringPiece client, uint64_t bytesIn,
+                           uint64_t bytesOut) {
+  auto cost = requestCost_ + bytesIn + bytesOut;
+
+  std::lock_guard<std::mutex> lock(lock_);
+
+  if (++samples_ >= kDecaySamples) {
+    decay();
+  }
+
+  auto clientStr = client.str();
+  auto it = index_.find(clientStr);
+  Entry* entry;
+  if (it != index_.end()) {
+    entry = &entries_[it->second];
+  } else if (entries_.size() < capacity_) {
+    index_.emplace(clientStr, entries_.size());
+    entries_.emplace_back();
+    entry = &entries_.back();
+    entry->client = std::move(clientStr);
+  } else {
+    /* Space-Saving: the new client takes over the least costly entry */
+    size_t minIdx = 0;
+    for (size_t i = 1; i < entries_.size(); ++i) {
+      if (entries_[i].cost < entries_[minIdx].cost) {
+        minIdx = i;
+      }
+    }
+    entry = &entries_[minIdx];
+    index_.erase(entry->client);
+    index_.emplace(clientStr, minIdx);
+    entry->client = std::move(clientStr);
+    entry->error = entry->cost;
+    /* Only the cost is inherited, the other totals are the client's own */
+    entry->requests = 0;
+    entry->bytesIn = 0;
+    entry->bytesOut = 0;
+  }
+
+  ++entry->requests;
+  entry->bytesIn += bytesIn;
+  entry->bytesOut += bytesOut;
+  entry->cost += cost;
+}
+
+void TopClientTracker::decay() {
+  samples_ = 0;
+  size_t i = 0;
+  while (i < entries_.size()) {
+    auto& entry = entries_[i];
+    entry.requests /= 2;
+    entry.bytesIn /= 2;
+    entry.bytesOut /= 2;
+    entry.cost /= 2;
+    entry.error /= 2;
+    if (entry.requests > 0) {
+      ++i;
+      continue;
+    }
+    /* Not seen recently, free the entry */
+    index_.erase(entry.client);
+    if (i + 1 != entries_.size()) {
+      entry = std::move(entries_.back());
+      index_[entry.client] = i;
+    }
+    entries_.pop_back();
+  }
+}
+
+std::vector<TopClientTracker::Entry> TopClientTracker::top() const {
+  std::vector<Entry> result;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    result = entries_;
+  }
+  for (auto& entry : result) {
+    entry.requests *= samplePeriod_;
+    entry.bytesIn *= samplePeriod_;
+    entry.bytesOut *= samplePeriod_;
+    entry.cost *= samplePeriod_;
+    entry.error *= samplePeriod_;
+  }
+  sortByCost(result);
+  return result;
+}
+
+std::vector<TopClientTracker::Entry> TopClientTracker::merge(
+    const std::vector<std::vector<Entry>>& tops, size_t maxClients) {
+  std::unordered_map<std::string, Entry> merged;
+  for (const auto& top : tops) {
+    for (const auto& entry : top) {
+      auto& m = merged[entry.client];
+      m.requests += entry.requests;
+      m.bytesIn += entry.bytesIn;
+      m.bytesOut += entry.bytesOut;
+      m.cost += entry.cost;
+      m.error += entry.error;
+    }
+  }
+
+  std::vector<Entry> result;
+  result.reserve(merged.size());
+  for (auto& it : merged) {
+    it.second.client = it.first;
+    result.push_back(std::move(it.second));
+  }
+  sortByCost(result);
+  if (result.size() > maxClients) {
+    result.resize(maxClients);
+  }
+  return result;
+}
+
+folly::dynamic TopClientTracker::toDynamic(const std::vector<Entry>& entries) {
+  folly::dynamic result = {};
+  for (const auto& entry : entries) {
+    result.push_back(folly::dynamic::object
+      ("client", entry.client)
+      ("requests", entry.requests)
+      ("bytes_in", entry.bytesIn)
+      ("bytes_out", entry.bytesOut)
+      ("cost", entry.cost)
+      ("error", entry.error));
+  }
+  return result;
+}
+
+}}}  // facebook::memcache::mcrouter
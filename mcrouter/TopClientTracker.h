@@ -0,0 +1,117 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/dynamic.h>
+#include <folly/Range.h>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Finds the clients (connections or senders) that cost the most, from a
+ * sample of their requests.
+ *
+ * The cost of a request estimates the proxy CPU it takes: a fixed
+ * requestCost for parsing, routing and bookkeeping, plus one per byte in
+ * and out (copies, checksums, serialization). Clients are tracked with the
+ * weighted Space-Saving algorithm over `capacity` entries, ranked by cost:
+ * a client that isn't tracked replaces the entry with the lowest cost and
+ * inherits it as its error. Same as HotKeyTracker, all totals are halved
+ * every kDecaySamples samples so the top reflects recent traffic.
+ *
+ * sampleNext() and add() may only be called from a single thread, the
+ * owner (e.g. proxy thread). Requests that aren't sampled only decrement
+ * a counter, so tracking can be left on.
+ */
+class TopClientTracker {
+ public:
+  /* Totals are halved after this many samples */
+  static constexpr uint64_t kDecaySamples = 10000;
+
+  struct Entry {
+    std::string client;
+    uint64_t requests{0};
+    uint64_t bytesIn{0};
+    uint64_t bytesOut{0};
+    /* Estimated cost, never below the real one */
+    uint64_t cost{0};
+    /* cost is at most this much above the real one */
+    uint64_t error{0};
+  };
+
+  /**
+   * @param capacity  number of tracked clients.
+   * @param samplePeriod  one in this many requests is accounted,
+   *                      0 disables tracking.
+   * @param requestCost  cost of a request on top of its bytes.
+   */
+  TopClientTracker(size_t capacity, uint64_t samplePeriod,
+                   uint64_t requestCost);
+
+  /**
+   * @return  true if the next request should be accounted with add().
+   */
+  bool sampleNext() {
+    if (samplePeriod_ == 0 || --untilSample_ != 0) {
+      return false;
+    }
+    untilSample_ = samplePeriod_;
+    return true;
+  }
+
+  /**
+   * Accounts a sampled request of client.
+   */
+  void add(folly::StringPiece client, uint64_t bytesIn, uint64_t bytesOut);
+
+  bool enabled() const {
+    return samplePeriod_ != 0;
+  }
+
+  /**
+   * Tracked clients with totals scaled by the sample period, in decreasing
+   * order of cost. Thread safe.
+   */
+  std::vector<Entry> top() const;
+
+  /**
+   * Sums the totals of the same clients from several trackers and
+   * returns at most maxClients entries with the highest costs.
+   */
+  static std::vector<Entry> merge(
+    const std::vector<std::vector<Entry>>& tops, size_t maxClients);
+
+  /**
+   * [{"client": ..., "requests": ..., "bytes_in": ..., "bytes_out": ...,
+   *   "cost": ..., "error": ...}, ...]
+   */
+  static folly::dynamic toDynamic(const std::vector<Entry>& entries);
+
+ private:
+  const size_t capacity_;
+  const uint64_t samplePeriod_;
+  const uint64_t requestCost_;
+  /* Only touched by the owner thread */
+  uint64_t untilSample_;
+
+  std::vector<Entry> entries_;
+  std::unordered_map<std::string, size_t> index_;
+  uint64_t samples_{0};
+  mutable std::mutex lock_;
+
+  void decay();
+};
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,234 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "TrafficCapture.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include <glog/logging.h>
+
+#include <folly/Bits.h>
+#include <folly/Exception.h>
+#include <folly/FileUtil.h>
+#include <folly/Format.h>
+
+#include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/lib/fbi/hash.h"
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/mcrouter_config.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+const char kBlockMagic[] = "MCT1";
+const size_t kMagicSize = 4;
+const size_t kBlockHeaderSize =
+  kMagicSize + 2 * sizeof(uint64_t) + 2 * sizeof(uint32_t);
+/* Longer strings are cut, so that any record fits into a block */
+const size_t kMaxStringSize = 16 * 1024;
+
+template <class T>
+void appendInt(T value, std::string& out) {
+  value = folly::Endian::little(value);
+  out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void appendString(folly::StringPiece s, std::string& out) {
+  auto size = std::min(s.size(), kMaxStringSize);
+  appendInt<uint16_t>(size, out);
+  out.append(s.data(), size);
+}
+
+template <class T>
+T readInt(folly::StringPiece& data) {
+  if (data.size() < sizeof(T)) {
+    throw std::runtime_error("traffic capture: truncated record");
+  }
+  T value;
+  std::memcpy(&value, data.data(), sizeof(T));
+  data.advance(sizeof(T));
+  return folly::Endian::little(value);
+}
+
+std::string readString(folly::StringPiece& data) {
+  auto size = readInt<uint16_t>(data);
+  if (data.size() < size) {
+    throw std::runtime_error("traffic capture: truncated record");
+  }
+  auto s = data.subpiece(0, size).str();
+  data.advance(size);
+  return s;
+}
+
+}  // anonymous namespace
+
+void appendCaptureRecord(const CaptureRecord& record, uint64_t prevTimeUs,
+                         std::string& out) {
+  auto delta = record.timeUs > prevTimeUs ? record.timeUs - prevTimeUs : 0;
+  appendInt<uint8_t>(record.op, out);
+  appendInt<uint32_t>(
+    std::min<uint64_t>(delta, std::numeric_limits<uint32_t>::max()), out);
+  appendInt(record.valueSize, out);
+  appendInt(record.keyHash, out);
+  appendString(record.routingPrefix, out);
+  appendString(record.key, out);
+}
+
+size_t captureBlockHeaderSize() {
+  return kBlockHeaderSize;
+}
+
+std::string encodeCaptureBlock(uint64_t seq, uint64_t startUs,
+                               folly::StringPiece records, size_t blockSize) {
+  assert(kBlockHeaderSize + records.size() <= blockSize);
+  std::string block;
+  block.reserve(blockSize);
+  block.append(kBlockMagic, kMagicSize);
+  appendInt(seq, block);
+  appendInt(startUs, block);
+  appendInt<uint32_t>(records.size(), block);
+  appendInt<uint32_t>(crc32_hash(records.data(), records.size()), block);
+  block.append(records.data(), records.size());
+  block.resize(blockSize, '\0');
+  return block;
+}
+
+TrafficCaptureFile::TrafficCaptureFile(const std::string& path,
+                                       size_t maxBytes)
+    : numSlots_(std::max<size_t>(1, maxBytes / kCaptureBlockSize)) {
+  /* Blocks of an older capture would look newer than ours */
+  fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  folly::checkUnixError(fd_, "Can't open traffic capture file ", path);
+}
+
+TrafficCaptureFile::~TrafficCaptureFile() {
+  ::close(fd_);
+}
+
+void TrafficCaptureFile::write(folly::StringPiece records, uint64_t startUs) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto block = encodeCaptureBlock(nextSeq_, startUs, records);
+  auto offset = (nextSeq_ % numSlots_) * kCaptureBlockSize;
+  ++nextSeq_;
+  if (folly::pwriteFull(fd_, block.data(), block.size(), offset) < 0) {
+    PLOG(ERROR) << "Can't write traffic capture block";
+  }
+}
+
+TrafficCaptureWriter::TrafficCaptureWriter(
+    std::shared_ptr<TrafficCaptureFile> file, size_t samplePeriod,
+    bool withKeys)
+    : file_(std::move(file)),
+      samplePeriod_(std::max<size_t>(1, samplePeriod)),
+      withKeys_(withKeys) {
+  records_.reserve(kCaptureBlockSize);
+}
+
+TrafficCaptureWriter::~TrafficCaptureWriter() {
+  flush();
+}
+
+void TrafficCaptureWriter::record(const mc_msg_t& req) {
+  folly::StringPiece key(req.key.str, req.key.len);
+  auto keys = McRequest::splitRoutingKey(key);
+
+  CaptureRecord record;
+  record.op = req.op;
+  record.timeUs = nowUs();
+  record.valueSize = req.value.len;
+  record.keyHash = getMemcacheKeyHashValue(keys.second);
+  record.routingPrefix = keys.first.str();
+  if (withKeys_) {
+    record.key = key.str();
+  }
+
+  auto prevSize = records_.size();
+  if (records_.empty()) {
+    blockStartUs_ = lastRecordUs_ = record.timeUs;
+  }
+  appendCaptureRecord(record, lastRecordUs_, records_);
+  if (kBlockHeaderSize + records_.size() > kCaptureBlockSize) {
+    /* Doesn't fit, it goes first into the next block */
+    records_.resize(prevSize);
+    flush();
+    blockStartUs_ = record.timeUs;
+    appendCaptureRecord(record, blockStartUs_, records_);
+  }
+  lastRecordUs_ = record.timeUs;
+}
+
+void TrafficCaptureWriter::flush() {
+  if (records_.empty()) {
+    return;
+  }
+  file_->write(records_, blockStartUs_);
+  records_.clear();
+}
+
+TrafficCaptureReader::TrafficCaptureReader(folly::StringPiece data,
+                                           size_t blockSize) {
+  while (data.size() >= blockSize) {
+    auto slot = data.subpiece(0, blockSize);
+    data.advance(blockSize);
+    if (std::memcmp(slot.data(), kBlockMagic, kMagicSize) != 0) {
+      continue;
+    }
+    slot.advance(kMagicSize);
+    Block block;
+    block.seq = readInt<uint64_t>(slot);
+    block.startUs = readInt<uint64_t>(slot);
+    auto size = readInt<uint32_t>(slot);
+    auto checksum = readInt<uint32_t>(slot);
+    if (size > slot.size()) {
+      continue;
+    }
+    block.records = slot.subpiece(0, size);
+    if (crc32_hash(block.records.data(), block.records.size()) != checksum) {
+      continue;
+    }
+    blocks_.push_back(block);
+  }
+  std::sort(blocks_.begin(), blocks_.end(),
+            [](const Block& a, const Block& b) { return a.seq < b.seq; });
+}
+
+bool TrafficCaptureReader::next(CaptureRecord& record) {
+  while (blockLeft_.empty()) {
+    if (nextBlock_ == blocks_.size()) {
+      return false;
+    }
+    const auto& block = blocks_[nextBlock_++];
+    blockLeft_ = block.records;
+    lastRecordUs_ = block.startUs;
+  }
+
+  record.op = static_cast<mc_op_t>(readInt<uint8_t>(blockLeft_));
+  if (record.op >= mc_nops) {
+    throw std::runtime_error(
+      folly::sformat("traffic capture: unknown op {}",
+                     static_cast<int>(record.op)));
+  }
+  lastRecordUs_ += readInt<uint32_t>(blockLeft_);
+  record.timeUs = lastRecordUs_;
+  record.valueSize = readInt<uint32_t>(blockLeft_);
+  record.keyHash = readInt<uint32_t>(blockLeft_);
+  record.routingPrefix = readString(blockLeft_);
+  record.key = readString(blockLeft_);
+  return true;
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,177 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <folly/Range.h>
+
+#include "mcrouter/lib/mc/msg.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Traffic capture ring file (traffic_capture_file), read by
+ * mcrouter_traffic_replay.
+ *
+ * The file is made of kCaptureBlockSize slots, used as a ring: block seq
+ * goes to slot seq % number of slots, so the file keeps the latest
+ * traffic_capture_max_mb of requests. A block is:
+ *   "MCT1" magic, 4 bytes
+ *   seq: uint64
+ *   time of its first record in us: uint64
+ *   records size, crc32 of records: uint32 each
+ *   records, then zero padding up to the end of the slot
+ *
+ * A record is:
+ *   op: uint8
+ *   time since the previous record of the block in us: uint32
+ *   value size: uint32
+ *   routing key hash: uint32
+ *   routing prefix, key (empty unless traffic_capture_keys):
+ *     uint16 size followed by the bytes, each
+ *
+ * All integers are little endian. Each block is written by one proxy,
+ * blocks of different proxies overlap in time.
+ */
+
+constexpr size_t kCaptureBlockSize = 64 * 1024;
+
+struct CaptureRecord {
+  mc_op_t op{mc_op_unknown};
+  /* Same clock as nowUs() */
+  uint64_t timeUs{0};
+  uint32_t valueSize{0};
+  uint32_t keyHash{0};
+  std::string routingPrefix;
+  /* Full key, including the routing prefix */
+  std::string key;
+};
+
+/**
+ * Serializes record and appends it to out.
+ *
+ * @param prevTimeUs  time of the previous record of the block
+ */
+void appendCaptureRecord(const CaptureRecord& record, uint64_t prevTimeUs,
+                         std::string& out);
+
+/**
+ * @param records  serialized records, at most
+ *                 kCaptureBlockSize - captureBlockHeaderSize() bytes
+ * @return block ready to be written to a slot, blockSize bytes
+ */
+std::string encodeCaptureBlock(uint64_t seq, uint64_t startUs,
+                               folly::StringPiece records,
+                               size_t blockSize = kCaptureBlockSize);
+
+size_t captureBlockHeaderSize();
+
+/**
+ * The ring file, shared by all proxies.
+ */
+class TrafficCaptureFile {
+ public:
+  /**
+   * @throws std::runtime_error if the file can't be opened
+   */
+  TrafficCaptureFile(const std::string& path, size_t maxBytes);
+  ~TrafficCaptureFile();
+
+  /**
+   * Writes records as the next block, overwriting the oldest one once
+   * the file is full. Thread safe.
+   */
+  void write(folly::StringPiece records, uint64_t startUs);
+
+ private:
+  int fd_{-1};
+  size_t numSlots_;
+  std::mutex mutex_;
+  uint64_t nextSeq_{0};
+};
+
+/**
+ * Per proxy capture: samples requests and buffers them
+ * into blocks of the shared file.
+ */
+class TrafficCaptureWriter {
+ public:
+  /**
+   * @param samplePeriod  record one request out of this many
+   * @param withKeys  record full keys, not only their hashes
+   */
+  TrafficCaptureWriter(std::shared_ptr<TrafficCaptureFile> file,
+                       size_t samplePeriod, bool withKeys);
+
+  /**
+   * Writes what's buffered.
+   */
+  ~TrafficCaptureWriter();
+
+  void maybeRecord(const mc_msg_t& req) {
+    if (++sinceLastSample_ < samplePeriod_) {
+      return;
+    }
+    sinceLastSample_ = 0;
+    record(req);
+  }
+
+  void flush();
+
+ private:
+  std::shared_ptr<TrafficCaptureFile> file_;
+  const size_t samplePeriod_;
+  const bool withKeys_;
+  size_t sinceLastSample_{0};
+
+  std::string records_;
+  uint64_t blockStartUs_{0};
+  uint64_t lastRecordUs_{0};
+
+  void record(const mc_msg_t& req);
+};
+
+/**
+ * Reads records from the contents of a capture file,
+ * in the order they were written.
+ */
+class TrafficCaptureReader {
+ public:
+  /**
+   * Slots that were never written, or were being written when the
+   * file was copied, are skipped.
+   */
+  explicit TrafficCaptureReader(folly::StringPiece data,
+                                size_t blockSize = kCaptureBlockSize);
+
+  /**
+   * @return false if there are no more records
+   * @throws std::runtime_error if a record is corrupted
+   */
+  bool next(CaptureRecord& record);
+
+ private:
+  struct Block {
+    uint64_t seq;
+    uint64_t startUs;
+    folly::StringPiece records;
+  };
+  std::vector<Block> blocks_;
+  size_t nextBlock_{0};
+  folly::StringPiece blockLeft_;
+  uint64_t lastRecordUs_{0};
+};
+
+}}}  // facebook::memcache::mcrouter
@@ -27,6 +27,9 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <vector>
+
 #include <folly/Conv.h>
 #include <folly/File.h>
 #include <folly/FileUtil.h>
@@ -34,6 +37,7 @@
 #include <folly/ThreadName.h>
 #include <folly/experimental/fibers/EventBaseLoopController.h>
 
+#include "mcrouter/AsynclogFormat.h"
 #include "mcrouter/awriter.h"
 #include "mcrouter/lib/fbi/cpp/util.h"
 #include "mcrouter/McrouterInstance.h"
@@ -127,6 +131,8 @@ bool AsyncWriter::run(std::function<void()> f) {
         return false;
       }
     } while (!queueSize_.compare_exchange_weak(size, size + 1));
+  } else {
+    ++queueSize_;
   }
 
 #ifdef __clang__
@@ -135,9 +141,7 @@ bool AsyncWriter::run(std::function<void()> f) {
 #endif
   fiberManager_.addTaskRemote([this, f_ = std::move(f)]() {
       fiberManager_.runInMainContext(std::move(f_));
-      if (maxQueueSize_ != 0) {
-        --queueSize_;
-      }
+      --queueSize_;
   });
 #ifdef __clang__
 #pragma clang diagnostic pop
@@ -215,7 +219,8 @@ static std::shared_ptr<folly::File> asynclog_open(proxy_t *proxy) {
     }
   }
 
-  if (snprintf(path, PATH_MAX, "%s/%04d%02d%02dT%02d%02d%02d-%lld-%s-%s-t%d-%p",
+  if (snprintf(path, PATH_MAX,
+               "%s/%04d%02d%02dT%02d%02d%02d-%lld-%s-%s-t%d-%p%s",
                hour_path,
                date.tm_year + 1900,
                date.tm_mon + 1,
@@ -229,7 +234,8 @@ static std::shared_ptr<folly::File> asynclog_open(proxy_t *proxy) {
                (proxy->router ? proxy->router->opts().router_name.c_str() :
                 "unknown"),
                tid,
-               proxy) > PATH_MAX) {
+               proxy,
+               proxy->opts.use_asynclog_binary ? ".bin" : "") > PATH_MAX) {
     path[PATH_MAX] = '\0';
     LOG(ERROR) << "async log path is too long: " << path;
     goto epilogue;
@@ -291,15 +297,13 @@ epilogue:
   return proxy->async_fd;
 }
 
-/** Adds an asynchronous request to the event log. */
-void asynclog_delete(proxy_t* proxy,
-                     std::shared_ptr<const ProxyClientCommon> pclient,
-                     folly::StringPiece key,
-                     folly::StringPiece poolName) {
+static std::string asynclogJsonLine(proxy_t* proxy,
+                                    const std::string& host,
+                                    uint16_t port,
+                                    folly::StringPiece key,
+                                    folly::StringPiece poolName,
+                                    int64_t timestamp_ms) {
   dynamic json = {};
-  const auto& host = pclient->ap.getHost();
-  const auto& port = pclient->ap.getPort();
-
   if (proxy->opts.use_asynclog_version2) {
     json = dynamic::object;
     json["f"] = proxy->opts.router_name;
@@ -313,14 +317,6 @@ void asynclog_delete(proxy_t* proxy,
     json.push_back(folly::sformat("delete {}\r\n", key));
   }
 
-  auto fd = asynclog_open(proxy);
-  if (!fd) {
-    logFailure(proxy->router, memcache::failure::Category::kSystemError,
-               "asynclog_open() failed (key {}, pool {})",
-               key, poolName);
-    return;
-  }
-
   // ["AS1.0", 1289416829.836, "C", ["10.0.0.1", 11302, "delete foo\r\n"]]
   // OR ["AS2.0", 1289416829.836, "C", {"f":"flavor","h":"[10.0.0.1]:11302",
   //                                    "p":"pool_name","k":"foo\r\n"}]
@@ -331,24 +327,139 @@ void asynclog_delete(proxy_t* proxy,
     jsonOut.push_back(ASYNCLOG_MAGIC);
   }
 
+  jsonOut.push_back(1e-3 * timestamp_ms);
+  jsonOut.push_back(std::string("C"));
+
+  jsonOut.push_back(json);
+
+  return folly::toJson(jsonOut) + "\n";
+}
+
+/** Adds an asynchronous request to the event log. */
+void asynclog_delete(proxy_t* proxy,
+                     std::shared_ptr<const ProxyClientCommon> pclient,
+                     folly::StringPiece key,
+                     folly::StringPiece poolName,
+                     std::function<void(bool)> done) {
+  const auto& host = pclient->ap.getHost();
+  const auto& port = pclient->ap.getPort();
+
   struct timeval timestamp;
   CHECK(gettimeofday(&timestamp, nullptr) == 0);
 
   auto timestamp_ms =
     facebook::memcache::to<std::chrono::milliseconds>(timestamp).count();
 
-  jsonOut.push_back(1e-3 * timestamp_ms);
-  jsonOut.push_back(std::string("C"));
+  std::string line;
+  if (proxy->opts.use_asynclog_binary) {
+    AsynclogRecord record;
+    record.timestampMs = timestamp_ms;
+    record.host = host;
+    record.port = port;
+    record.pool = poolName.str();
+    record.key = key.str();
+    try {
+      appendAsynclogRecord(record, line);
+    } catch (const std::exception& e) {
+      logFailure(proxy->router, memcache::failure::Category::kOther,
+                 "Can't write asynclog record (key {}, pool {}): {}",
+                 key, poolName, e.what());
+      done(false);
+      return;
+    }
+  } else {
+    line = asynclogJsonLine(proxy, host, port, key, poolName, timestamp_ms);
+  }
 
-  jsonOut.push_back(json);
+  auto& batch = proxy->async_batch;
+  batch.pendingBytes += line.size();
+  batch.pending.emplace_back();
+  batch.pending.back().line = std::move(line);
+  batch.pending.back().done = std::move(done);
+
+  if (batch.pending.size() >= proxy->opts.asynclog_max_batch_size) {
+    asynclog_flush(proxy);
+  } else if (batch.pending.size() == 1) {
+    /* Runs after the requests already queued to awriter, so that their
+       entries are written together */
+    folly::fibers::addTask([proxy]() { asynclog_flush(proxy); });
+  }
+}
 
-  auto jstr = folly::toJson(jsonOut) + "\n";
+void asynclog_flush(proxy_t* proxy) {
+  auto& batch = proxy->async_batch;
+  if (batch.pending.empty()) {
+    return;
+  }
+  std::vector<AsynclogBatch::Entry> entries;
+  entries.swap(batch.pending);
+  batch.pendingBytes = 0;
+  ++batch.numBatches;
+  batch.numEntries += entries.size();
 
-  ssize_t size = folly::writeFull(fd->fd(), jstr.data(), jstr.size());
-  if (size == -1 || size_t(size) < jstr.size()) {
+  auto fd = asynclog_open(proxy);
+  if (!fd) {
     logFailure(proxy->router, memcache::failure::Category::kSystemError,
-               "Error fully writing asynclog request (key {}, pool {})",
-               key, poolName);
+               "asynclog_open() failed ({} entries)", entries.size());
+    for (auto& entry : entries) {
+      entry.done(false);
+    }
+    return;
+  }
+
+  /* Text entries are written as they are, binary ones as one
+     compressed block */
+  std::string block;
+  std::vector<folly::StringPiece> chunks;
+  if (proxy->opts.use_asynclog_binary) {
+    std::string records;
+    for (const auto& entry : entries) {
+      records.append(entry.line);
+    }
+    block = encodeAsynclogBlock(records);
+    chunks.push_back(block);
+  } else {
+    chunks.reserve(entries.size());
+    for (const auto& entry : entries) {
+      chunks.push_back(entry.line);
+    }
+  }
+
+  bool success = true;
+  std::vector<iovec> iov;
+  iov.reserve(std::min<size_t>(chunks.size(), IOV_MAX));
+  for (size_t i = 0; i < chunks.size() && success; i += iov.size()) {
+    iov.clear();
+    size_t total = 0;
+    for (size_t j = i; j < chunks.size() && iov.size() < IOV_MAX; ++j) {
+      iovec v;
+      v.iov_base = const_cast<char*>(chunks[j].data());
+      v.iov_len = chunks[j].size();
+      iov.push_back(v);
+      total += v.iov_len;
+    }
+    ssize_t size = folly::writevFull(fd->fd(), iov.data(), iov.size());
+    if (size == -1 || size_t(size) < total) {
+      logFailure(proxy->router, memcache::failure::Category::kSystemError,
+                 "Error fully writing {} asynclog requests", entries.size());
+      success = false;
+    }
+  }
+
+  if (success && proxy->opts.asynclog_fsync_interval_ms > 0) {
+    auto now = std::chrono::steady_clock::now();
+    if (now - batch.lastSync >= std::chrono::milliseconds(
+          proxy->opts.asynclog_fsync_interval_ms)) {
+      batch.lastSync = now;
+      if (fdatasync(fd->fd()) != 0) {
+        logFailure(proxy->router, memcache::failure::Category::kSystemError,
+                   "Error syncing asynclog: {}", strerror(errno));
+      }
+    }
+  }
+
+  for (auto& entry : entries) {
+    entry.done(success);
   }
 }
 
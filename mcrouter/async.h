@@ -9,7 +9,12 @@
  */
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include <folly/Range.h>
 
@@ -18,14 +23,47 @@ namespace facebook { namespace memcache { namespace mcrouter {
 class proxy_t;
 class ProxyClientCommon;
 
+/**
+ * Asynclog entries of one proxy waiting to be written together
+ * ("group commit").
+ */
+struct AsynclogBatch {
+  struct Entry {
+    std::string line;
+    /* Called with true once the line is written, false on error */
+    std::function<void(bool)> done;
+  };
+
+  /* Only accessed by the awriter thread */
+  std::vector<Entry> pending;
+  /* Bytes of lines in pending, for stats */
+  std::atomic<size_t> pendingBytes{0};
+  std::chrono::steady_clock::time_point lastSync;
+
+  /* Written batches and entries in them, for stats */
+  std::atomic<uint64_t> numBatches{0};
+  std::atomic<uint64_t> numEntries{0};
+};
+
 /**
  * Appends a 'delete' request entry to the asynclog.
- * This call blocks until the entry is written to the file
- * or an error occurs.
+ * Must be called on the awriter thread.
+ *
+ * Entries are buffered and written to the file with a single writev()
+ * by asynclog_flush(), which runs after other queued awriter requests
+ * or once asynclog_max_batch_size entries are buffered. done is called
+ * after that.
  */
 void asynclog_delete(proxy_t* proxy,
                      std::shared_ptr<const ProxyClientCommon> pclient,
                      folly::StringPiece key,
-                     folly::StringPiece poolName);
+                     folly::StringPiece poolName,
+                     std::function<void(bool)> done);
+
+/**
+ * Writes all entries buffered by asynclog_delete() for this proxy.
+ * Must be called on the awriter thread.
+ */
+void asynclog_flush(proxy_t* proxy);
 
 }}} // facebook::memcache::mcrouter
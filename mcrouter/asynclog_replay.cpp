@@ -0,0 +1,219 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <folly/Conv.h>
+#include <folly/FileUtil.h>
+#include <folly/Hash.h>
+#include <folly/Memory.h>
+#include <folly/experimental/fibers/Baton.h>
+#include <folly/experimental/fibers/EventBaseLoopController.h>
+#include <folly/experimental/fibers/FiberManager.h>
+#include <folly/io/async/EventBase.h>
+
+#include "mcrouter/AsynclogFormat.h"
+#include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/network/AsyncMcClient.h"
+#include "mcrouter/TokenBucket.h"
+
+/**
+ * Replays deletes from binary asynclog spool files (use_asynclog_binary).
+ *
+ * Records are spread over threads by destination, each thread keeps one
+ * connection per destination and sends up to max_outstanding deletes
+ * at once, so they are pipelined. The total rate is limited to rate
+ * deletes per second.
+ */
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+namespace {
+
+struct ReplayOptions {
+  size_t numThreads{4};
+  double rate{10000};
+  size_t maxOutstanding{100};
+  std::chrono::milliseconds timeout{1000};
+};
+
+std::atomic<uint64_t> gDeleted{0};
+std::atomic<uint64_t> gFailed{0};
+
+double nowSeconds() {
+  return std::chrono::duration<double>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class ReplayThread {
+ public:
+  ReplayThread(const ReplayOptions& opts,
+               std::vector<const AsynclogRecord*> records)
+      : opts_(opts),
+        records_(std::move(records)),
+        fm_(folly::make_unique<folly::fibers::EventBaseLoopController>()),
+        tokenBucket_(opts.rate, std::max(1.0, opts.rate / 100), nowSeconds()) {
+    dynamic_cast<folly::fibers::EventBaseLoopController&>(
+      fm_.loopController()).attachEventBase(eventBase_);
+  }
+
+  void run() {
+    auto workers = std::min(opts_.maxOutstanding, records_.size());
+    auto remaining = std::make_shared<size_t>(workers);
+    for (size_t i = 0; i < workers; ++i) {
+      fm_.addTask([this, remaining]() {
+        while (next_ < records_.size()) {
+          replay(*records_[next_++]);
+        }
+        if (--*remaining == 0) {
+          eventBase_.terminateLoopSoon();
+        }
+      });
+    }
+    if (workers > 0) {
+      eventBase_.loopForever();
+    }
+  }
+
+ private:
+  const ReplayOptions& opts_;
+  std::vector<const AsynclogRecord*> records_;
+  size_t next_{0};
+  folly::EventBase eventBase_;
+  folly::fibers::FiberManager fm_;
+  TokenBucket tokenBucket_;
+  std::unordered_map<std::string, std::unique_ptr<AsyncMcClient>> clients_;
+
+  AsyncMcClient& getClient(const AsynclogRecord& record) {
+    auto name = folly::to<std::string>(record.host, ":", record.port);
+    auto& client = clients_[name];
+    if (!client) {
+      ConnectionOptions options(record.host, record.port, mc_ascii_protocol);
+      options.writeTimeout = opts_.timeout;
+      client = folly::make_unique<AsyncMcClient>(eventBase_,
+                                                 std::move(options));
+    }
+    return *client;
+  }
+
+  void replay(const AsynclogRecord& record) {
+    while (!tokenBucket_.consume(1.0, nowSeconds())) {
+      folly::fibers::Baton baton;
+      baton.timed_wait(std::chrono::milliseconds(1));
+    }
+
+    McRequest req(record.key);
+    auto reply = getClient(record).sendSync(
+      req, McOperation<mc_op_delete>(), opts_.timeout);
+    if (reply.result() == mc_res_deleted ||
+        reply.result() == mc_res_notfound) {
+      ++gDeleted;
+    } else {
+      ++gFailed;
+      LOG(WARNING) << "Failed to delete " << record.key << " from "
+                   << record.host << ":" << record.port << ": "
+                   << mc_res_to_string(reply.result());
+    }
+  }
+};
+
+void usage(char** argv) {
+  fprintf(stderr,
+          "Usage: %s [-t threads] [-r deletes_per_second] "
+          "[-o max_outstanding_per_thread] [-T timeout_ms] file...\n",
+          argv[0]);
+  exit(1);
+}
+
+}  // anonymous namespace
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+
+  ReplayOptions opts;
+  int c;
+  while ((c = getopt(argc, argv, "t:r:o:T:h")) >= 0) {
+    switch (c) {
+      case 't':
+        opts.numThreads = std::max(1, folly::to<int>(optarg));
+        break;
+      case 'r':
+        opts.rate = folly::to<double>(optarg);
+        break;
+      case 'o':
+        opts.maxOutstanding = std::max(1, folly::to<int>(optarg));
+        break;
+      case 'T':
+        opts.timeout = std::chrono::milliseconds(folly::to<int>(optarg));
+        break;
+      default:
+        usage(argv);
+    }
+  }
+  if (optind >= argc || opts.rate <= 0) {
+    usage(argv);
+  }
+
+  std::vector<AsynclogRecord> records;
+  for (int i = optind; i < argc; ++i) {
+    std::string data;
+    if (!folly::readFile(argv[i], data)) {
+      LOG(ERROR) << "Can't read " << argv[i];
+      return 1;
+    }
+    try {
+      AsynclogBinaryReader reader(data);
+      AsynclogRecord record;
+      while (reader.next(record)) {
+        records.push_back(record);
+      }
+    } catch (const std::exception& e) {
+      /* Keep the records read so far, the rest of the file is lost */
+      LOG(ERROR) << "Error reading " << argv[i] << ": " << e.what();
+    }
+  }
+
+  /* All deletes for one destination go through the same thread to share
+     connections */
+  std::vector<std::vector<const AsynclogRecord*>> perThread(opts.numThreads);
+  for (const auto& record : records) {
+    auto dest = folly::hash::hash_combine(record.host, record.port);
+    perThread[dest % opts.numThreads].push_back(&record);
+  }
+
+  auto threadOpts = opts;
+  threadOpts.rate = opts.rate / opts.numThreads;
+  std::vector<std::unique_ptr<ReplayThread>> replayThreads;
+  std::vector<std::thread> threads;
+  for (auto& threadRecords : perThread) {
+    replayThreads.push_back(
+      folly::make_unique<ReplayThread>(threadOpts, std::move(threadRecords)));
+    auto replayThread = replayThreads.back().get();
+    threads.emplace_back([replayThread]() { replayThread->run(); });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  LOG(INFO) << "Replayed " << records.size() << " deletes: "
+            << gDeleted.load() << " deleted, " << gFailed.load() << " failed";
+  return gFailed.load() == 0 ? 0 : 2;
+}
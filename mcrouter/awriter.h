@@ -79,6 +79,13 @@ class AsyncWriter {
    */
   bool run(std::function<void()> f);
 
+  /**
+   * @return number of functions queued and not completed yet.
+   */
+  size_t queueSize() const {
+    return queueSize_.load(std::memory_order_relaxed);
+  }
+
   /**
    * Waits for all the functions to complete
    */
@@ -0,0 +1,108 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace facebook { namespace memcache {
+
+/**
+ * Count-min sketch of how often each hash was seen recently.
+ *
+ * Estimates are never below the real count, and above it by at most
+ * 2 * total / width with high probability. All counters are halved every
+ * `window` increments, so the counts reflect recent traffic.
+ *
+ * Takes already computed 32 bit hashes (e.g. routingKeyHash()), the
+ * row hashes are derived from it.
+ */
+class CountMinSketch {
+ public:
+  static constexpr size_t kDepth = 4;
+
+  /**
+   * @param width  number of counters per row, rounded up to a power of two.
+   * @param window  counters are halved after this many increments.
+   */
+  CountMinSketch(size_t width, uint64_t window)
+      : window_(window) {
+    assert(window_ > 0);
+    size_t w = 1;
+    while (w < width) {
+      w *= 2;
+    }
+    mask_ = w - 1;
+    counters_.resize(kDepth * w);
+  }
+
+  /**
+   * Counts one more occurrence of hash.
+   * @return estimated count, including this occurrence.
+   */
+  uint32_t increment(uint32_t hash) {
+    if (++increments_ >= window_) {
+      age();
+    }
+    uint32_t estimate = std::numeric_limits<uint32_t>::max();
+    for (size_t row = 0; row < kDepth; ++row) {
+      auto& counter = counters_[index(row, hash)];
+      if (counter < std::numeric_limits<uint32_t>::max()) {
+        ++counter;
+      }
+      estimate = std::min(estimate, counter);
+    }
+    return estimate;
+  }
+
+  uint32_t estimate(uint32_t hash) const {
+    uint32_t estimate = std::numeric_limits<uint32_t>::max();
+    for (size_t row = 0; row < kDepth; ++row) {
+      estimate = std::min(estimate, counters_[index(row, hash)]);
+    }
+    return estimate;
+  }
+
+  /**
+   * Halves all counters, as done every window increments.
+   */
+  void age() {
+    for (auto& counter : counters_) {
+      counter /= 2;
+    }
+    increments_ = 0;
+  }
+
+  void clear() {
+    std::fill(counters_.begin(), counters_.end(), 0);
+    increments_ = 0;
+  }
+
+ private:
+  std::vector<uint32_t> counters_;
+  size_t mask_;
+  uint64_t window_;
+  uint64_t increments_{0};
+
+  size_t index(size_t row, uint32_t hash) const {
+    static const uint32_t kSeeds[kDepth] = {
+      0x9e3779b1, 0x85ebca77, 0xc2b2ae3d, 0x27d4eb2f
+    };
+    /* multiplicative hashing with the high bits folded in */
+    uint32_t h = (hash ^ (hash >> 16)) * kSeeds[row];
+    h ^= h >> 15;
+    return row * (mask_ + 1) + (h & mask_);
+  }
+};
+
+}}  // facebook::memcache
@@ -33,6 +33,16 @@ class Crc32HashFunc {
     return (res & 0x7fffffff) % n_;
   }
 
+  /**
+   * Same as operator() on req.routingKey(), with the crc32 memoized
+   * by the request.
+   */
+  template <class Request>
+  auto hashRequest(const Request& req) const
+    -> decltype(size_t(req.routingKeyCrc32())) {
+    return (req.routingKeyCrc32() & 0x7fffffff) % n_;
+  }
+
   static std::string type() {
     return "Crc32";
   }
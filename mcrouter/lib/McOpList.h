@@ -41,5 +41,6 @@ MC_OP(McOperation<mc_op_get_count>)
 MC_OP(McOperation<mc_op_bump_count>)
 MC_OP(McOperation<mc_op_get_unique_count>)
 MC_OP(McOperation<mc_op_bump_unique_count>)
+MC_OP(McOperation<mc_op_touch>)
 
 #undef MC_OP
@@ -21,6 +21,7 @@ inline int awfulness(mc_res_t result) {
     case mc_res_stalestored:
     case mc_res_exists:
     case mc_res_deleted:
+    case mc_res_touched:
     case mc_res_found:
       return 1;
 
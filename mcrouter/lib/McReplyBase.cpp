@@ -115,16 +115,22 @@ McReplyBase::McReplyBase(mc_res_t res, McMsgRef&& msg)
 }
 
 void McReplyBase::dependentMsg(mc_op_t op, mc_msg_t* out) const {
+  dependentMsgWithoutValue(op, out);
+
+  auto value = valueRangeSlow();
+  out->value.str = const_cast<char*>(value.begin());
+  out->value.len = value.size();
+}
+
+void McReplyBase::dependentMsgWithoutValue(mc_op_t op, mc_msg_t* out) const {
   if (msg_.get() != nullptr) {
     mc_msg_shallow_copy(out, msg_.get());
   }
 
-  auto value = valueRangeSlow();
-
   out->key.str = nullptr;
   out->key.len = 0;
-  out->value.str = const_cast<char*>(value.begin());
-  out->value.len = value.size();
+  out->value.str = nullptr;
+  out->value.len = 0;
   out->op = op;
   out->result = result_;
   out->flags = flags_;
@@ -149,7 +149,8 @@ class McReplyBase {
    * Was the data found?
    */
   bool isHit() const {
-    return result_ == mc_res_deleted || result_ == mc_res_found;
+    return result_ == mc_res_deleted || result_ == mc_res_found ||
+      result_ == mc_res_touched;
   }
 
   /**
@@ -271,6 +272,12 @@ class McReplyBase {
    */
   void dependentMsg(mc_op_t op, mc_msg_t* out) const;
 
+  /**
+   * Same as dependentMsg(), but leaves out->value empty, so that a chained
+   * value is not coalesced. For callers that write value() out themselves.
+   */
+  void dependentMsgWithoutValue(mc_op_t op, mc_msg_t* out) const;
+
   /**
    * Returns a self-contained mc_msg_t representing this McReplyBase
    * for the given op.
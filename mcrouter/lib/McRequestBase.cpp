@@ -9,6 +9,8 @@
  */
 #include "McRequestBase.h"
 
+#include <cstring>
+
 #include <folly/io/IOBuf.h>
 #include <folly/Memory.h>
 #include <folly/Range.h>
@@ -17,12 +19,15 @@
 
 namespace facebook { namespace memcache {
 
+constexpr size_t McRequestBase::kMaxInlineKeySize;
+
 McRequestBase::McRequestBase(McMsgRef&& msg)
     : msg_(std::move(msg)),
       keyData_(makeMsgKeyIOBufStack(msg_)),
       valueData_(makeMsgValueIOBufStack(msg_)),
       keys_(getRange(keyData_)),
       exptime_(msg_->exptime),
+      number_(msg_->number),
       flags_(msg_->flags),
       delta_(msg_->delta),
       leaseToken_(msg_->lease_id),
@@ -34,22 +39,97 @@ McRequestBase::McRequestBase(McMsgRef&& msg)
 {
 }
 
-McRequestBase::McRequestBase(folly::StringPiece key)
-    : keyData_(folly::IOBuf(folly::IOBuf::COPY_BUFFER, key)) {
-  keyData_.coalesce();
-  keys_.update(getRange(keyData_));
-  auto msg = createMcMsgRef();
-  msg->key = to<nstring_t>(getRange(keyData_));
-  msg_ = std::move(msg);
+McRequestBase::McRequestBase(folly::StringPiece key) {
+  setKey(key);
 }
 
 McRequestBase::McRequestBase(folly::IOBuf keyData)
     : keyData_(std::move(keyData)) {
   keyData_.coalesce();
   keys_.update(getRange(keyData_));
-  auto msg = createMcMsgRef();
-  msg->key = to<nstring_t>(getRange(keyData_));
-  msg_ = std::move(msg);
+}
+
+McRequestBase::McRequestBase(McRequestBase&& other) noexcept
+    : McRequestBase() {
+  *this = std::move(other);
+}
+
+McRequestBase& McRequestBase::operator=(McRequestBase&& other) noexcept {
+  if (this == &other) {
+    return *this;
+  }
+  msg_ = std::move(other.msg_);
+  auto keyData = std::move(other.keyData_);
+  takeKeyFrom(other, std::move(keyData));
+  valueData_ = std::move(other.valueData_);
+  exptime_ = other.exptime_;
+  number_ = other.number_;
+  flags_ = other.flags_;
+  delta_ = other.delta_;
+  leaseToken_ = other.leaseToken_;
+  cas_ = other.cas_;
+  priority_ = other.priority_;
+#ifndef LIBMC_FBTRACE_DISABLE
+  fbtraceInfo_ = std::move(other.fbtraceInfo_);
+#endif
+  return *this;
+}
+
+void McRequestBase::setKey(folly::StringPiece k) {
+  if (k.size() <= kMaxInlineKeySize) {
+    /* k might point into the current key */
+    std::memmove(keyInline_, k.data(), k.size());
+    keyData_ = folly::IOBuf(folly::IOBuf::WRAP_BUFFER, keyInline_, k.size());
+  } else {
+    keyData_ = folly::IOBuf(folly::IOBuf::COPY_BUFFER, k);
+  }
+  keys_.update(getRange(keyData_));
+}
+
+void McRequestBase::setKeyFromParts(
+    std::initializer_list<folly::StringPiece> parts) {
+  size_t size = 0;
+  for (auto part : parts) {
+    size += part.size();
+  }
+
+  if (size <= kMaxInlineKeySize) {
+    /* Parts might point into keyInline_, join them aside first */
+    char key[kMaxInlineKeySize];
+    char* dst = key;
+    for (auto part : parts) {
+      std::memcpy(dst, part.data(), part.size());
+      dst += part.size();
+    }
+    std::memcpy(keyInline_, key, size);
+    keyData_ = folly::IOBuf(folly::IOBuf::WRAP_BUFFER, keyInline_, size);
+  } else {
+    folly::IOBuf keyData(folly::IOBuf::CREATE, size);
+    for (auto part : parts) {
+      std::memcpy(keyData.writableTail(), part.data(), part.size());
+      keyData.append(part.size());
+    }
+    keyData_ = std::move(keyData);
+  }
+  keys_.update(getRange(keyData_));
+}
+
+void McRequestBase::takeKeyFrom(const McRequestBase& other,
+                                folly::IOBuf keyData) {
+  auto otherInline = reinterpret_cast<const uint8_t*>(other.keyInline_);
+  if (keyData.buffer() != otherInline) {
+    keyData_ = std::move(keyData);
+    keys_ = other.keys_;
+    return;
+  }
+
+  size_t offset = keyData.data() - otherInline;
+  size_t size = offset + keyData.length();
+  std::memcpy(keyInline_, other.keyInline_, size);
+  keyData_ = folly::IOBuf(folly::IOBuf::WRAP_BUFFER, keyInline_, size);
+  keyData_.trimStart(offset);
+  keys_ = other.keys_;
+  keys_.rebase(other.keyInline_, keyInline_);
 }
 
 bool McRequestBase::setKeyFrom(const folly::IOBuf& source,
@@ -74,6 +154,7 @@ void McRequestBase::dependentHelper(mc_op_t op, folly::StringPiece key,
   }
   into->op = op;
   into->exptime = exptime_;
+  into->number = number_;
   into->flags = flags_;
   into->delta = delta_;
   into->lease_id = leaseToken_;
@@ -107,6 +188,7 @@ McMsgRef McRequestBase::dependentMsg(mc_op_t op) const {
 
   if (msg_->op == op &&
       msg_->exptime == exptime_ &&
+      msg_->number == number_ &&
       msg_->flags == flags_ &&
       msg_->delta == delta_ &&
       msg_->lease_id == leaseToken_ &&
@@ -142,6 +224,7 @@ McMsgRef McRequestBase::dependentMsgStripRoutingPrefix(mc_op_t op) const {
 
   if (msg_->op == op &&
       msg_->exptime == exptime_ &&
+      msg_->number == number_ &&
       msg_->flags == flags_ &&
       msg_->delta == delta_ &&
       msg_->lease_id == leaseToken_ &&
@@ -182,46 +265,46 @@ McRequestBase::Keys::Keys(folly::StringPiece key) noexcept {
   update(key);
 }
 
-void McRequestBase::Keys::update(folly::StringPiece key) {
-  keyWithoutRoute = key;
-  if (!key.empty()) {
-    if (*key.begin() == '/') {
-      size_t pos = 1;
-      for (int i = 0; i < 2; ++i) {
-        pos = key.find('/', pos);
-        if (pos == std::string::npos) {
-          break;
-        }
-        ++pos;
-      }
-      if (pos != std::string::npos) {
-        keyWithoutRoute.advance(pos);
-        routingPrefix.reset(key.begin(), pos);
-      }
+void McRequestBase::Keys::rebase(const char* oldBase, const char* newBase) {
+  for (auto piece : {&keyWithoutRoute, &routingPrefix, &routingKey}) {
+    if (piece->begin() != nullptr) {
+      piece->reset(newBase + (piece->begin() - oldBase), piece->size());
     }
   }
-  routingKey = keyWithoutRoute;
-  size_t pos = keyWithoutRoute.find("|#|");
-  if (pos != std::string::npos) {
-    routingKey.reset(keyWithoutRoute.begin(), pos);
-  }
+}
+
+void McRequestBase::Keys::update(folly::StringPiece key) {
+  /* One pass validates the key and finds both boundaries */
+  auto scan = mc_key_scan(to<nstring_t>(key));
+  keyError = scan.err;
+  routingPrefix.reset(key.begin(), scan.routing_prefix_len);
+  keyWithoutRoute.reset(key.begin() + scan.routing_prefix_len,
+                        key.size() - scan.routing_prefix_len);
+  routingKey.reset(keyWithoutRoute.begin(),
+                   scan.hash_stop - scan.routing_prefix_len);
 
-  routingKeyHash = getMemcacheKeyHashValue(routingKey);
+  hasRoutingKeyHash = false;
+  hasRoutingKeyCrc32 = false;
 }
 
 McRequestBase::McRequestBase(const McRequestBase& other)
     : exptime_(other.exptime_),
+      number_(other.number_),
       flags_(other.flags_),
       delta_(other.delta_),
       leaseToken_(other.leaseToken_),
-      cas_(other.cas_) {
+      cas_(other.cas_),
+      priority_(other.priority_) {
   // Key is always a single piece, so it's safe to do cloneOneInto.
-  other.keyData_.cloneOneInto(keyData_);
-  keys_ = Keys(getRange(keyData_));
+  folly::IOBuf keyData;
+  other.keyData_.cloneOneInto(keyData);
+  takeKeyFrom(other, std::move(keyData));
   other.valueData_.cloneInto(valueData_);
 
-  if (hasSameMemoryRegion(keyData_, other.keyData_) &&
-      hasSameMemoryRegion(valueData_, other.valueData_)) {
+  if (!other.msg_.get()) {
+    /* Nothing to share, a msg will be created on demand */
+  } else if (hasSameMemoryRegion(keyData_, other.keyData_) &&
+             hasSameMemoryRegion(valueData_, other.valueData_)) {
 
     msg_ = other.msg_.clone();
   } else {
@@ -9,11 +9,15 @@
  */
 #pragma once
 
+#include <initializer_list>
 #include <memory>
+#include <utility>
 
 #include <folly/io/IOBuf.h>
 #include <folly/Range.h>
 
+#include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/lib/fbi/hash.h"
 #include "mcrouter/lib/IOBufUtil.h"
 #include "mcrouter/lib/mc/msg.h"
 #include "mcrouter/lib/McMsgRef.h"
@@ -25,23 +29,48 @@
 namespace facebook { namespace memcache {
 class McRequest;
 
+/**
+ * Order in which a destination connection sends its pending requests
+ * (see ConnectionOptions::priorityLanes): all pending NORMAL requests
+ * go before LOW ones. Routes sending requests nobody waits for
+ * (async, shadow, cache fills) mark them LOW.
+ */
+enum class RequestPriority : uint8_t {
+  NORMAL,
+  LOW,
+};
+
+constexpr size_t kNumRequestPriorities = 2;
+
 /**
  * As far as the routing module is concerned, a Request has
  * a routingKey() and an optional routingPrefix(),
  * potentially with other opaque fields.
  * A Reply is similarly opaque.
  *
- * The concrete implementation below uses mc_msg_t as the backing storage
- * level for Requests/Replies.  We also minimize the number of times
- * we have to copy/allocate new mc_msg_ts
+ * The concrete implementation below keeps all request fields in its own
+ * members. A mc_msg_t is only created when one is asked for
+ * (dependentMsg()), or kept when the request was constructed from one,
+ * so that it can be handed out again without a copy.
  */
 class McRequestBase {
  public:
 
   /* Request interface */
 
-  McRequestBase(McRequestBase&& other) noexcept = default;
-  McRequestBase& operator=(McRequestBase&& other) = default;
+  /**
+   * Keys up to this size are stored inside the request object
+   * instead of a separately allocated buffer.
+   */
+  static constexpr size_t kMaxInlineKeySize = 64;
+
+  /**
+   * Note: an inline key moves with the request, so pieces of the key
+   * (routingKey() etc.) and dependent msgs of a request are not valid
+   * after the request is moved.
+   */
+  McRequestBase(McRequestBase&& other) noexcept;
+  McRequestBase& operator=(McRequestBase&& other) noexcept;
 
   /**
    * The routing prefix.
@@ -59,14 +88,42 @@ class McRequestBase {
     return keys_.routingKey;
   }
 
+  /**
+   * Splits a full key into (routing prefix, routing key) like a request
+   * with that key would, without building one.
+   */
+  static std::pair<folly::StringPiece, folly::StringPiece>
+  splitRoutingKey(folly::StringPiece key) {
+    Keys keys(key);
+    return std::make_pair(keys.routingPrefix, keys.routingKey);
+  }
+
   /**
    * Hashes the routing part of the key (using SpookyHashV2).
    * Used for probabilistic decisions, like stats sampling or shadowing.
+   * Computed once per key, clones keep it.
    */
   uint32_t routingKeyHash() const {
+    if (!keys_.hasRoutingKeyHash) {
+      keys_.routingKeyHash = getMemcacheKeyHashValue(keys_.routingKey);
+      keys_.hasRoutingKeyHash = true;
+    }
     return keys_.routingKeyHash;
   }
 
+  /**
+   * crc32_hash() of the routing part of the key, as used by Crc32HashFunc.
+   * Computed once per key, clones keep it.
+   */
+  uint32_t routingKeyCrc32() const {
+    if (!keys_.hasRoutingKeyCrc32) {
+      keys_.routingKeyCrc32 = crc32_hash(keys_.routingKey.data(),
+                                         keys_.routingKey.size());
+      keys_.hasRoutingKeyCrc32 = true;
+    }
+    return keys_.routingKeyCrc32;
+  }
+
   /**
    * @return true if "|#|" is present
    */
@@ -80,11 +137,12 @@ class McRequestBase {
   void setExptime(uint32_t expt) {
     exptime_ = expt;
   }
-  void setKey(folly::StringPiece k) {
-    keyData_ = folly::IOBuf(folly::IOBuf::COPY_BUFFER, k);
-    keyData_.coalesce();
-    keys_.update(getRange(keyData_));
-  }
+  void setKey(folly::StringPiece k);
+  /**
+   * Sets the key to the concatenation of parts (which may point into
+   * the current key), without building it elsewhere first.
+   */
+  void setKeyFromParts(std::initializer_list<folly::StringPiece> parts);
   void setKey(folly::IOBuf keyData) {
     keyData_ = std::move(keyData);
     keyData_.coalesce();
@@ -157,7 +215,11 @@ class McRequestBase {
    * Access flush_all delay interval.
    */
   uint32_t number() const {
-    return msg_.get() ? msg_->number : 0;
+    return number_;
+  }
+
+  void setNumber(uint32_t num) {
+    number_ = num;
   }
 
   /**
@@ -192,6 +254,14 @@ class McRequestBase {
     cas_ = c;
   }
 
+  RequestPriority priority() const {
+    return priority_;
+  }
+
+  void setPriority(RequestPriority priority) {
+    priority_ = priority;
+  }
+
   /**
    * @return Full key, including the routing prefix and
    *         non-hashable parts if present
@@ -200,6 +270,13 @@ class McRequestBase {
     return getRange(keyData_);
   }
 
+  /**
+   * mc_client_req_key_check() of fullKey(), found while parsing the key.
+   */
+  mc_req_err_t keyError() const {
+    return keys_.keyError;
+  }
+
   const folly::IOBuf& value() const {
     return valueData_;
   }
@@ -208,6 +285,22 @@ class McRequestBase {
     return folly::StringPiece(valueData_.coalesce());
   }
 
+  /**
+   * Makes a chained value a single buffer. Copies of the request made
+   * after this share that buffer, so fanning a request out to many
+   * destinations coalesces it once, instead of every destination's copy
+   * doing it when it is serialized.
+   */
+  void coalesceValue() const {
+    if (valueData_.isChained()) {
+      valueData_.coalesce();
+    }
+  }
+
+  /**
+   * Note: doesn't own the memory of an inline key, so clones of it
+   * must not outlive the request.
+   */
   const folly::IOBuf& key() const {
     return keyData_;
   }
@@ -228,8 +321,9 @@ class McRequestBase {
  private:
   McMsgRef msg_;
 
-  /* Always stored unchained */
+  /* Always stored unchained, wraps keyInline_ for short keys */
   folly::IOBuf keyData_;
+  char keyInline_[kMaxInlineKeySize];
 
   /* May be chained */
   mutable folly::IOBuf valueData_;
@@ -247,19 +341,30 @@ class McRequestBase {
     folly::StringPiece keyWithoutRoute;
     folly::StringPiece routingPrefix;
     folly::StringPiece routingKey;
+    /* mc_client_req_key_check() of the whole key */
+    mc_req_err_t keyError{mc_req_err_no_key};
 
-    uint32_t routingKeyHash;
+    /* Hashes of routingKey, computed on first use */
+    mutable uint32_t routingKeyHash{0};
+    mutable uint32_t routingKeyCrc32{0};
+    mutable bool hasRoutingKeyHash{false};
+    mutable bool hasRoutingKeyCrc32{false};
 
     Keys() {}
     explicit Keys(folly::StringPiece key) noexcept;
     void update(folly::StringPiece key);
+
+    /* Points all pieces at the same offsets from newBase */
+    void rebase(const char* oldBase, const char* newBase);
   } keys_;
 
   uint32_t exptime_{0};
+  uint32_t number_{0};
   uint64_t flags_{0};
   uint64_t delta_{0};
   uint64_t leaseToken_{0};
   uint64_t cas_{0};
+  RequestPriority priority_{RequestPriority::NORMAL};
 
 #ifndef LIBMC_FBTRACE_DISABLE
   struct McFbtraceRefPolicy {
@@ -289,6 +394,7 @@ class McRequestBase {
                                         const uint8_t*, size_t,
                                         const uint8_t*, size_t,
                                         mc_op_t&, uint64_t&);
+  friend class McServerAsciiParser;
   /**
    * Clone the key from the subregion of source [begin, begin + size).
    * @return false If the subregion is empty or not valid (i.e. not contained
@@ -314,6 +420,16 @@ class McRequestBase {
 
   void ensureMsgExists(mc_op_t op) const;
 
+  bool keyIsInline() const {
+    return keyData_.buffer() == reinterpret_cast<const uint8_t*>(keyInline_);
+  }
+
+  /**
+   * Takes over the key of other, copying it over if it's inline
+   * (trimmed routing prefix included, so keys_ offsets stay valid).
+   */
+  void takeKeyFrom(const McRequestBase& other, folly::IOBuf keyData);
+
  protected:
   /**
    * Useful for incremental construction, i.e. during parsing.
@@ -0,0 +1,204 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <event.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <functional>
+
+#include <glog/logging.h>
+
+#include <folly/detail/CacheLocality.h>
+#include <folly/MPMCQueue.h>
+
+namespace facebook { namespace memcache {
+
+/**
+ * A bounded multi-producer/single-consumer message queue.
+ *
+ * Producers write into a lock-free ring (folly::MPMCQueue, ticket based
+ * with cache-line padded slots) from any thread. The consumer is a
+ * libevent base: messages are delivered to onMessage on the thread
+ * running that event base.
+ *
+ * Wakeups are coalesced: a producer only writes to the eventfd if the
+ * consumer is not already scheduled to run, and the consumer drains
+ * every available message on each wakeup. So a burst of N messages
+ * typically costs a single eventfd write/read pair.
+ *
+ * On destruction all remaining messages are swept through onMessage,
+ * so the consumer always sees every message that was written.
+ *
+ * T must be default constructible and nothrow movable.
+ */
+template <class T>
+class MessageQueue {
+ public:
+  /**
+   * @param capacity   Maximum number of queued messages. Writers block
+   *                   while the queue is full.
+   * @param onMessage  Called on the consumer thread for every message.
+   */
+  MessageQueue(size_t capacity, std::function<void(T&&)> onMessage)
+      : queue_(capacity),
+        onMessage_(std::move(onMessage)) {
+    efd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    PCHECK(efd_ >= 0) << "eventfd() failed";
+  }
+
+  ~MessageQueue() {
+    if (eventAdded_) {
+      event_del(&event_);
+    }
+    drain();
+    ::close(efd_);
+  }
+
+  /**
+   * Start delivering messages on the given event base.
+   * Must be called exactly once before the consumer starts looping.
+   *
+   * @param priority  libevent priority of the wakeup event;
+   *                  less than 0 leaves the default priority.
+   */
+  void attachEventBase(struct event_base* base, int priority) {
+    CHECK(!eventAdded_);
+    event_set(&event_, efd_, EV_READ | EV_PERSIST,
+              &MessageQueue::onEvent, this);
+    event_base_set(base, &event_);
+    if (priority >= 0) {
+      event_priority_set(&event_, priority);
+    }
+    CHECK(event_add(&event_, nullptr) == 0);
+    eventAdded_ = true;
+  }
+
+  /**
+   * Enqueue a message constructed from args. Thread safe.
+   * Blocks if the queue is full.
+   *
+   * Never call this from a proxy or any other event base thread: the
+   * queue is bounded, so a consumer thread blocked here can wait forever
+   * on a consumer that is itself blocked writing to it.
+   */
+  template <class... Args>
+  void blockingWrite(Args&&... args) {
+    queue_.blockingWrite(std::forward<Args>(args)...);
+    notify();
+  }
+
+  /**
+   * Enqueue a message constructed from args unless the queue is full.
+   * Thread safe, never blocks.
+   *
+   * @return  false if the queue is full; args are left untouched then.
+   */
+  template <class... Args>
+  bool write(Args&&... args) {
+    if (!queue_.write(std::forward<Args>(args)...)) {
+      return false;
+    }
+    notify();
+    return true;
+  }
+
+  /**
+   * Process all messages currently in the queue.
+   * May only be called on the consumer thread.
+   */
+  void drain() {
+    T msg;
+    while (queue_.read(msg)) {
+      onMessage_(std::move(msg));
+    }
+  }
+
+  /**
+   * Busy polling: between startSpinning() and stopSpinning() producers
+   * don't signal the eventfd, the consumer is expected to call drain()
+   * itself. Consumer thread only.
+   */
+  void startSpinning() {
+    notified_.store(true);
+  }
+
+  /**
+   * Ends busy polling, draining messages written before producers
+   * could see that they must signal again.
+   */
+  void stopSpinning() {
+    notified_.store(false);
+    /* See onSignal() */
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    drain();
+  }
+
+  /**
+   * Approximate number of queued messages. Thread safe.
+   */
+  size_t size() const {
+    auto s = queue_.size();
+    return s > 0 ? static_cast<size_t>(s) : 0;
+  }
+
+ private:
+  folly::MPMCQueue<T> queue_;
+  std::function<void(T&&)> onMessage_;
+  int efd_{-1};
+  struct event event_;
+  bool eventAdded_{false};
+
+  /**
+   * True if the consumer was signalled and has not started draining yet.
+   * Kept on its own cache line since every producer reads it.
+   */
+  std::atomic<bool> FOLLY_ALIGN_TO_AVOID_FALSE_SHARING notified_{false};
+
+  void notify() {
+    /* Orders the slot store of the write before the load of notified_.
+       Otherwise the load may be served before the (release) store is
+       visible: we see true while the consumer resets it and drains
+       without our message, and nobody signals again. Pairs with the
+       fence in onSignal(). */
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    /* The plain load keeps the line shared between producers in the common
+       case where a wakeup is already pending. */
+    if (notified_.load() || notified_.exchange(true)) {
+      return;
+    }
+    uint64_t one = 1;
+    auto rc = ::write(efd_, &one, sizeof(one));
+    PLOG_IF(ERROR, rc != sizeof(one)) << "MessageQueue: eventfd write failed";
+  }
+
+  void onSignal() {
+    uint64_t cnt;
+    auto rc = ::read(efd_, &cnt, sizeof(cnt));
+    (void)rc;
+    /* Reset before draining: any write that misses this drain will
+       see notified_ == false and signal us again. */
+    notified_.store(false);
+    /* Orders the reset before the reads of drain(), see notify() */
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    drain();
+  }
+
+  static void onEvent(int fd, short events, void* arg) {
+    reinterpret_cast<MessageQueue*>(arg)->onSignal();
+  }
+
+  MessageQueue(const MessageQueue&) = delete;
+  MessageQueue& operator=(const MessageQueue&) = delete;
+};
+
+}}  // facebook::memcache
@@ -0,0 +1,237 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace facebook { namespace memcache {
+
+/**
+ * Bump allocator for the temporaries of one request: an allocation takes
+ * the next bytes of the current block, nothing is freed one by one, all
+ * blocks are freed with the arena. Blocks double in size, from
+ * kMinBlockSize. An optional first block may be provided by the owner
+ * (see InlineArena), so that small requests don't malloc at all.
+ *
+ * Objects must be destroyed before the arena. Not thread safe.
+ */
+class Arena {
+ public:
+  static constexpr size_t kMinBlockSize = 4096;
+  static constexpr size_t kMaxBlockSize = 1 << 20;
+
+  Arena() = default;
+
+  /**
+   * @param buf  first block, must outlive the arena.
+   */
+  Arena(void* buf, size_t size) noexcept
+      : cur_(static_cast<char*>(buf)),
+        end_(static_cast<char*>(buf) + size) {
+  }
+
+  ~Arena() {
+    while (blocks_) {
+      auto next = blocks_->next;
+      std::free(blocks_);
+      blocks_ = next;
+    }
+  }
+
+  /**
+   * @param align  power of 2
+   * @throws std::bad_alloc
+   */
+  void* allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+    auto p = alignUp(cur_, align);
+    if (p <= end_ && size <= static_cast<size_t>(end_ - p)) {
+      cur_ = p + size;
+      bytesUsed_ += size;
+      return p;
+    }
+    return allocateSlow(size, align);
+  }
+
+  /* Bytes handed out */
+  size_t bytesUsed() const noexcept {
+    return bytesUsed_;
+  }
+
+  /* Bytes of blocks malloc'ed so far */
+  size_t bytesMalloced() const noexcept {
+    return bytesMalloced_;
+  }
+
+ private:
+  struct Block {
+    Block* next;
+  };
+
+  char* cur_{nullptr};
+  char* end_{nullptr};
+  Block* blocks_{nullptr};
+  size_t nextBlockSize_{kMinBlockSize};
+  size_t bytesUsed_{0};
+  size_t bytesMalloced_{0};
+
+  static char* alignUp(char* p, size_t align) noexcept {
+    auto i = reinterpret_cast<uintptr_t>(p);
+    return reinterpret_cast<char*>((i + align - 1) & ~(uintptr_t(align) - 1));
+  }
+
+  void* allocateSlow(size_t size, size_t align) {
+    if (size > std::numeric_limits<size_t>::max() - sizeof(Block) - align) {
+      throw std::bad_alloc();
+    }
+    auto blockSize = std::max(nextBlockSize_,
+                              sizeof(Block) + size + align);
+    auto block = static_cast<Block*>(std::malloc(blockSize));
+    if (block == nullptr) {
+      throw std::bad_alloc();
+    }
+    block->next = blocks_;
+    blocks_ = block;
+    bytesMalloced_ += blockSize;
+    nextBlockSize_ = std::min(nextBlockSize_ * 2, size_t{kMaxBlockSize});
+
+    cur_ = reinterpret_cast<char*>(block) + sizeof(Block);
+    end_ = reinterpret_cast<char*>(block) + blockSize;
+    return allocate(size, align);
+  }
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+};
+
+/**
+ * Arena with its first Size bytes inline (e.g. in a pooled request
+ * context).
+ */
+template <size_t Size>
+class InlineArena : public Arena {
+ public:
+  InlineArena() noexcept : Arena(&buf_, Size) {
+  }
+
+ private:
+  typename std::aligned_storage<Size, alignof(std::max_align_t)>::type buf_;
+};
+
+/**
+ * STL allocator from an Arena: deallocate() is a no-op, memory goes away
+ * with the arena. A default constructed one (no arena) is std::allocator.
+ */
+template <class T>
+class ArenaAllocator {
+ public:
+  using value_type = T;
+  using propagate_on_container_copy_assignment = std::true_type;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+
+  template <class U>
+  struct rebind {
+    using other = ArenaAllocator<U>;
+  };
+
+  ArenaAllocator() noexcept = default;
+
+  /* nullptr means std::allocator */
+  /* implicit */ ArenaAllocator(Arena* arena) noexcept
+      : arena_(arena) {
+  }
+
+  template <class U>
+  /* implicit */ ArenaAllocator(const ArenaAllocator<U>& other) noexcept
+      : arena_(other.arena()) {
+  }
+
+  T* allocate(size_t n) {
+    if (arena_ == nullptr) {
+      return std::allocator<T>().allocate(n);
+    }
+    if (n > std::numeric_limits<size_t>::max() / sizeof(T)) {
+      throw std::bad_alloc();
+    }
+    return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T* p, size_t n) noexcept {
+    if (arena_ == nullptr) {
+      std::allocator<T>().deallocate(p, n);
+    }
+  }
+
+  Arena* arena() const noexcept {
+    return arena_;
+  }
+
+ private:
+  Arena* arena_{nullptr};
+};
+
+template <class T, class U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+  return a.arena() == b.arena();
+}
+
+template <class T, class U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+  return !(a == b);
+}
+
+template <class T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+/**
+ * @param arena  may be nullptr, then the vector uses std::allocator.
+ * @param capacity  reserved right away.
+ */
+template <class T>
+ArenaVector<T> makeArenaVector(Arena* arena, size_t capacity = 0) {
+  ArenaVector<T> v((ArenaAllocator<T>(arena)));
+  v.reserve(capacity);
+  return v;
+}
+
+namespace detail {
+
+/* Context defines Arena& arena(), use it */
+template <class Context>
+auto contextArena(Context& ctx, int) -> decltype(&ctx.arena()) {
+  return &ctx.arena();
+}
+
+template <class Context>
+Arena* contextArena(Context& ctx, long) {
+  return nullptr;
+}
+
+}  // detail
+
+/**
+ * Arena of the request (if the context defines `Arena& arena()`), freed
+ * when the request is done: temporaries of routes which don't outlive
+ * ctx may be allocated from it. nullptr if there is none.
+ */
+template <class ContextPtr>
+Arena* requestArena(const ContextPtr& ctx) {
+  return ctx ? detail::contextArena(*ctx, 0) : nullptr;
+}
+
+}}  // facebook::memcache
@@ -0,0 +1,159 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <folly/Optional.h>
+#include <folly/experimental/fibers/WhenN.h>
+
+#include "mcrouter/lib/Operation.h"
+#include "mcrouter/lib/RequestArena.h"
+
+namespace facebook { namespace memcache {
+
+/**
+ * Helpers for RouteHandleIf::routeBatch().
+ *
+ * A batch is a list of requests routed together with the same context,
+ * e.g. keys of one multiget. Replies are returned in the order of requests.
+ * Routes that don't define routeBatch() route each request of the batch
+ * in its own fiber (routeBatchEach), routes that do can group
+ * requests going to the same child (routeBatchGroups) so that only one
+ * fiber per child is needed.
+ */
+
+/**
+ * Group of requests of a batch that go to the same route handle.
+ */
+template <class RouteHandle>
+struct RouteBatchGroup {
+  RouteHandle* rh;
+  /* Indexes into the batch */
+  std::vector<size_t> indexes;
+};
+
+/**
+ * Routes every request of the batch through rh.route(), concurrently.
+ */
+template <class RouteHandle, class Operation, class Request, class ContextPtr>
+std::vector<typename ReplyType<Operation, Request>::type>
+routeBatchEach(RouteHandle& rh,
+               const std::vector<const Request*>& reqs,
+               Operation,
+               const ContextPtr& ctx) {
+  using Reply = typename ReplyType<Operation, Request>::type;
+
+  std::vector<Reply> replies;
+  replies.reserve(reqs.size());
+  if (reqs.size() == 1) {
+    replies.push_back(rh.route(*reqs[0], Operation(), ctx));
+    return replies;
+  }
+
+  auto arena = requestArena(ctx);
+  auto fs = makeArenaVector<std::function<Reply()>>(arena, reqs.size());
+  for (auto req : reqs) {
+    fs.emplace_back(
+      [&rh, req, &ctx]() {
+        return rh.route(*req, Operation(), ctx);
+      }
+    );
+  }
+
+  auto results = makeArenaVector<folly::Optional<Reply>>(arena);
+  results.resize(reqs.size());
+  folly::fibers::forEach(fs.begin(), fs.end(),
+                         [&results] (size_t id, Reply reply) {
+    results[id] = std::move(reply);
+  });
+  for (auto& result : results) {
+    replies.push_back(std::move(result.value()));
+  }
+  return replies;
+}
+
+/**
+ * Sends each group of requests to its route handle with routeBatch().
+ * Groups are routed concurrently, one fiber per group.
+ *
+ * @return replies in the order of reqs, every request must be in
+ *         exactly one group.
+ */
+template <class RouteHandle, class Operation, class Request, class ContextPtr>
+std::vector<typename ReplyType<Operation, Request>::type>
+routeBatchGroups(const std::vector<RouteBatchGroup<RouteHandle>>& groups,
+                 const std::vector<const Request*>& reqs,
+                 Operation,
+                 const ContextPtr& ctx) {
+  using Reply = typename ReplyType<Operation, Request>::type;
+
+  auto arena = requestArena(ctx);
+  auto results = makeArenaVector<folly::Optional<Reply>>(arena);
+  results.resize(reqs.size());
+  auto routeGroup = [&reqs, &ctx, &results](
+      const RouteBatchGroup<RouteHandle>& group) {
+    std::vector<const Request*> groupReqs;
+    groupReqs.reserve(group.indexes.size());
+    for (auto i : group.indexes) {
+      groupReqs.push_back(reqs[i]);
+    }
+    auto groupReplies = group.rh->routeBatch(groupReqs, Operation(), ctx);
+    for (size_t i = 0; i < group.indexes.size(); ++i) {
+      results[group.indexes[i]] = std::move(groupReplies[i]);
+    }
+  };
+
+  if (groups.size() == 1) {
+    routeGroup(groups[0]);
+  } else {
+    auto fs = makeArenaVector<std::function<void()>>(arena, groups.size());
+    for (const auto& group : groups) {
+      fs.emplace_back([&routeGroup, &group]() { routeGroup(group); });
+    }
+    folly::fibers::forEach(fs.begin(), fs.end(), [] (size_t id) {});
+  }
+
+  std::vector<Reply> replies;
+  replies.reserve(reqs.size());
+  for (auto& result : results) {
+    replies.push_back(std::move(result.value()));
+  }
+  return replies;
+}
+
+namespace detail {
+
+/* Route defines routeBatch(), use it */
+template <class Route, class RouteHandle, class Operation, class Request,
+          class ContextPtr>
+auto callRouteBatch(Route& route, RouteHandle& rh,
+                    const std::vector<const Request*>& reqs,
+                    Operation, const ContextPtr& ctx, int)
+  -> decltype(route.routeBatch(reqs, Operation(), ctx)) {
+  return route.routeBatch(reqs, Operation(), ctx);
+}
+
+/* Otherwise route each request on its own */
+template <class Route, class RouteHandle, class Operation, class Request,
+          class ContextPtr>
+std::vector<typename ReplyType<Operation, Request>::type>
+callRouteBatch(Route& route, RouteHandle& rh,
+               const std::vector<const Request*>& reqs,
+               Operation, const ContextPtr& ctx, long) {
+  return routeBatchEach(rh, reqs, Operation(), ctx);
+}
+
+}  // detail
+
+}}  // facebook::memcache
@@ -10,11 +10,90 @@
 #pragma once
 
 #include <memory>
+#include <type_traits>
+#include <vector>
 
 #include "mcrouter/lib/fbi/cpp/TypeList.h"
+#include "mcrouter/lib/RouteBatch.h"
 
 namespace facebook { namespace memcache {
 
+namespace detail {
+
+/* Route defines completesInline(), use it */
+template <class Route>
+auto routeCompletesInline(const Route& route, int)
+  -> decltype(route.completesInline()) {
+  return route.completesInline();
+}
+
+/* Otherwise assume the route may block */
+template <class Route>
+bool routeCompletesInline(const Route& route, long) {
+  return false;
+}
+
+/* Context defines deadlineExceeded(), use it */
+template <class Context>
+auto contextDeadlineExceeded(const Context& ctx, int)
+  -> decltype(ctx.deadlineExceeded()) {
+  return ctx.deadlineExceeded();
+}
+
+/* Otherwise requests have no deadline */
+template <class Context>
+bool contextDeadlineExceeded(const Context& ctx, long) {
+  return false;
+}
+
+/* Context defines a static routeScope(ctx, handle), hold its result */
+template <class Context, class ContextPtr, class Handle>
+auto contextRouteScope(const ContextPtr& ctx, const Handle& handle, int)
+  -> decltype(Context::routeScope(ctx, handle)) {
+  return Context::routeScope(ctx, handle);
+}
+
+/* Otherwise there's nothing to do around route() calls */
+template <class Context, class ContextPtr, class Handle>
+int contextRouteScope(const ContextPtr& ctx, const Handle& handle, long) {
+  return 0;
+}
+
+template <class T>
+struct VoidType {
+  using type = void;
+};
+
+template <class Context, class Enable = void>
+struct ContextPtrOf {
+  using type = std::shared_ptr<Context>;
+};
+
+template <class Context>
+struct ContextPtrOf<Context, typename VoidType<typename Context::Ptr>::type> {
+  using type = typename Context::Ptr;
+};
+
+}  // detail
+
+/**
+ * Handle routes pass the request context around with: Context::Ptr if
+ * Context defines one (e.g. a non-atomic intrusive pointer), otherwise
+ * std::shared_ptr<Context>.
+ */
+template <class Context>
+using ContextPtrType = typename detail::ContextPtrOf<Context>::type;
+
+/**
+ * @return  true if the request's deadline passed, for contexts that define
+ *          `bool deadlineExceeded() const`. Routes skip failover (and other
+ *          extra attempts) then: the requester already gave up.
+ */
+template <class ContextPtr>
+bool deadlineExceeded(const ContextPtr& ctx) {
+  return ctx && detail::contextDeadlineExceeded(*ctx, 0);
+}
+
 /**
  * We need the wrapper class below since we can't have templated
  * virtual methods.
@@ -68,6 +147,22 @@ class RouteHandle<Route, RouteHandleIf, Context, List<>, OpList, op_id> :
     return name + (name_.empty() ? "" : ":" + name_);
   }
 
+  bool completesInline() const {
+    return detail::routeCompletesInline(route_, 0);
+  }
+
+  /**
+   * Route wrapped by this handle, e.g. to call it without virtual dispatch
+   * when its type is known.
+   */
+  Route& routeImpl() {
+    return route_;
+  }
+
+  const Route& routeImpl() const {
+    return route_;
+  }
+
  protected:
   std::string name_;
   Route route_;
@@ -114,6 +209,12 @@ class RouteHandle<Route,
                     List<Requests...>,
                     OpList,
                     OpList::kLastItemId>::route;
+  using RouteHandle<Route,
+                    RouteHandleIf,
+                    Context,
+                    List<Requests...>,
+                    OpList,
+                    OpList::kLastItemId>::routeBatch;
 };
 
 template<typename Route,
@@ -158,21 +259,40 @@ class RouteHandle<Route,
                     List<Request, Requests...>,
                     OpList,
                     op_id-1>::route;
+  using RouteHandle<Route,
+                    RouteHandleIf,
+                    Context,
+                    List<Request, Requests...>,
+                    OpList,
+                    op_id-1>::routeBatch;
 
   std::vector<std::shared_ptr<RouteHandleIf>>
   couldRouteTo(const Request& req, typename OpList::template Item<op_id>::op,
-               const std::shared_ptr<Context>& ctx) const {
+               const ContextPtrType<Context>& ctx) const {
     return this->route_.couldRouteTo(
       req, typename OpList::template Item<op_id>::op(), ctx);
   }
 
   typename ReplyType<typename OpList::template Item<op_id>::op, Request>::type
   route(const Request& req, typename OpList::template Item<op_id>::op,
-        const std::shared_ptr<Context>& ctx) {
+        const ContextPtrType<Context>& ctx) {
+    /* Lets the context observe each route() call, e.g. to profile it */
+    auto scope = detail::contextRouteScope<Context>(ctx, *this, 0);
+    (void)scope;
     return this->route_.route(req,
                               typename OpList::template Item<op_id>::op(),
                               ctx);
   }
+
+  std::vector<typename ReplyType<typename OpList::template Item<op_id>::op,
+                                 Request>::type>
+  routeBatch(const std::vector<const Request*>& reqs,
+             typename OpList::template Item<op_id>::op,
+             const ContextPtrType<Context>& ctx) {
+    return detail::callRouteBatch(this->route_, *this, reqs,
+                                  typename OpList::template Item<op_id>::op(),
+                                  ctx, 0);
+  }
 };
 
 template <typename RouteHandleIf_,
@@ -188,7 +308,7 @@ template <typename RouteHandleIf_,
           typename OpList>
 class RouteHandleIf<RouteHandleIf_, Context, List<Request>, OpList, 1> {
  public:
-  using ContextPtr = std::shared_ptr<Context>;
+  using ContextPtr = ContextPtrType<Context>;
 
   template <class Route>
   using Impl = RouteHandle<Route,
@@ -202,13 +322,20 @@ class RouteHandleIf<RouteHandleIf_, Context, List<Request>, OpList, 1> {
    */
   virtual std::string routeName() const = 0;
 
+  /**
+   * Returns true if route() always completes without waiting on anything,
+   * so it can be called outside of a fiber. Routes opt in by defining
+   * `bool completesInline() const`.
+   */
+  virtual bool completesInline() const = 0;
+
   /**
    * Returns a list of all possible route handles this route handle could
    * send a request to
    */
   virtual std::vector<std::shared_ptr<RouteHandleIf_>> couldRouteTo(
     const Request& req, typename OpList::template Item<1>::op,
-    const std::shared_ptr<Context>& ctx) const = 0;
+    const ContextPtrType<Context>& ctx) const = 0;
 
   /**
    * Routes the request through this route handle
@@ -217,7 +344,17 @@ class RouteHandleIf<RouteHandleIf_, Context, List<Request>, OpList, 1> {
                              Request>::type
   route(const Request& req,
         typename OpList::template Item<1>::op,
-        const std::shared_ptr<Context>& ctx) = 0;
+        const ContextPtrType<Context>& ctx) = 0;
+
+  /**
+   * Routes a batch of requests sharing the same context through this
+   * route handle, see RouteBatch.h. Replies are in the order of reqs.
+   */
+  virtual std::vector<typename ReplyType<
+    typename OpList::template Item<1>::op, Request>::type>
+  routeBatch(const std::vector<const Request*>& reqs,
+             typename OpList::template Item<1>::op,
+             const ContextPtrType<Context>& ctx) = 0;
 
   virtual ~RouteHandleIf() {}
 };
@@ -239,7 +376,7 @@ class RouteHandleIf<RouteHandleIf_,
                            OpList::kLastItemId> {
 
  public:
-  using ContextPtr = std::shared_ptr<Context>;
+  using ContextPtr = ContextPtrType<Context>;
 
   using RouteHandleIf<RouteHandleIf_,
                       Context,
@@ -251,6 +388,11 @@ class RouteHandleIf<RouteHandleIf_,
                       List<Requests...>,
                       OpList,
                       OpList::kLastItemId>::route;
+  using RouteHandleIf<RouteHandleIf_,
+                      Context,
+                      List<Requests...>,
+                      OpList,
+                      OpList::kLastItemId>::routeBatch;
 };
 
 template <typename RouteHandleIf_,
@@ -270,7 +412,7 @@ class RouteHandleIf<RouteHandleIf_,
                            OpList,
                            op_id-1> {
  public:
-  using ContextPtr = std::shared_ptr<Context>;
+  using ContextPtr = ContextPtrType<Context>;
 
   template <class Route>
   using Impl = RouteHandle<Route,
@@ -290,6 +432,11 @@ class RouteHandleIf<RouteHandleIf_,
                       List<Request, Requests...>,
                       OpList,
                       op_id-1>::route;
+  using RouteHandleIf<RouteHandleIf_,
+                      Context,
+                      List<Request, Requests...>,
+                      OpList,
+                      op_id-1>::routeBatch;
 
   /**
    * Returns a list of all possible route handles this route handle could
@@ -297,7 +444,7 @@ class RouteHandleIf<RouteHandleIf_,
    */
   virtual std::vector<std::shared_ptr<RouteHandleIf_>> couldRouteTo(
     const Request& req, typename OpList::template Item<op_id>::op,
-    const std::shared_ptr<Context>& ctx) const = 0;
+    const ContextPtrType<Context>& ctx) const = 0;
 
   /**
    * Routes the request through this route handle
@@ -306,7 +453,17 @@ class RouteHandleIf<RouteHandleIf_,
                              Request>::type
   route(const Request& req,
         typename OpList::template Item<op_id>::op,
-        const std::shared_ptr<Context>& ctx) = 0;
+        const ContextPtrType<Context>& ctx) = 0;
+
+  /**
+   * Routes a batch of requests sharing the same context through this
+   * route handle, see RouteBatch.h. Replies are in the order of reqs.
+   */
+  virtual std::vector<typename ReplyType<
+    typename OpList::template Item<op_id>::op, Request>::type>
+  routeBatch(const std::vector<const Request*>& reqs,
+             typename OpList::template Item<op_id>::op,
+             const ContextPtrType<Context>& ctx) = 0;
 };
 
 }}  // facebook::memcache
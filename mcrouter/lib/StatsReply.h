@@ -10,25 +10,55 @@
 #pragma once
 
 #include <string>
-#include <vector>
 
 #include <folly/Conv.h>
+#include <folly/Range.h>
 
 namespace facebook { namespace memcache {
 
 class McReply;
 
+/**
+ * Builds the reply to a stats command.
+ *
+ * Stats are formatted right away as "STAT <name> <value>\r\n" lines into a
+ * single buffer, which becomes the value of the reply: no per stat strings
+ * and no nstring array in a mc_msg_t, the protocol layer writes the value
+ * out as is.
+ */
 class StatsReply {
  public:
+  /**
+   * @param sizeHint  expected size of the formatted stats, in bytes.
+   */
+  explicit StatsReply(size_t sizeHint = 0) {
+    buf_.reserve(sizeHint);
+  }
+
   template <typename V>
-  void addStat(folly::StringPiece name, V value) {
-    stats_.push_back(make_pair(name.str(), folly::to<std::string>(value)));
+  void addStat(folly::StringPiece name, const V& value) {
+    buf_.append("STAT");
+    if (!name.empty()) {
+      buf_.push_back(' ');
+      buf_.append(name.data(), name.size());
+    }
+    auto valueStart = buf_.size() + 1;
+    buf_.push_back(' ');
+    folly::toAppend(value, &buf_);
+    if (buf_.size() == valueStart) {
+      /* empty value, no separator */
+      buf_.pop_back();
+    }
+    buf_.append("\r\n");
   }
 
+  /**
+   * Builds the reply from all stats added so far. Leaves this object empty.
+   */
   McReply getMcReply();
 
  private:
-  std::vector<std::pair<std::string, std::string>> stats_;
+  std::string buf_;
 };
 
 }}  // facebook::memcache
@@ -9,6 +9,9 @@
  */
 #include "WeightedCh3HashFunc.h"
 
+#include <cassert>
+#include <limits>
+
 #include <folly/dynamic.h>
 #include <folly/SpookyHashV2.h>
 
@@ -22,12 +25,30 @@ const size_t kNumTries = 32;
 const uint32_t kHashSeed = 0xface2014;
 }  // anonymous namespace
 
+WeightedCh3HashFunc::Data::Data(std::vector<double> w)
+    : weights(std::move(w)) {
+  thresholds.reserve(weights.size());
+  for (auto weight : weights) {
+    assert(0 <= weight && weight <= 1.0);
+    thresholds.push_back(weight * std::numeric_limits<uint32_t>::max());
+  }
+}
+
+void WeightedCh3HashFunc::State::set(std::vector<double> weights) {
+  std::unique_ptr<const Data> newData(new Data(std::move(weights)));
+  std::lock_guard<std::mutex> lg(lock);
+  data.store(newData.get(), std::memory_order_release);
+  versions.push_back(std::move(newData));
+}
+
 WeightedCh3HashFunc::WeightedCh3HashFunc(
   std::vector<double> weights)
-    : weights_(std::move(weights)) {
+    : state_(std::make_shared<State>()) {
+  state_->set(std::move(weights));
 }
 
-WeightedCh3HashFunc::WeightedCh3HashFunc(const folly::dynamic& json, size_t n) {
+WeightedCh3HashFunc::WeightedCh3HashFunc(const folly::dynamic& json, size_t n)
+    : state_(std::make_shared<State>()) {
   checkLogic(json.isObject() && json.count("weights"),
              "WeightedCh3HashFunc: not an object or no weights");
   checkLogic(json["weights"].isArray(),
@@ -37,16 +58,49 @@ WeightedCh3HashFunc::WeightedCh3HashFunc(const folly::dynamic& json, size_t n) {
     << "WeightedCh3HashFunc: CONFIG IS BROKEN!!! number of weights ("
     << jWeights.size() << ") is smaller than number of servers (" << n
     << "). Missing weights are set to 0.5";
+  std::vector<double> weights;
   for (size_t i = 0; i < std::min(n, jWeights.size()); ++i) {
     const auto& weight = jWeights[i];
     checkLogic(weight.isNumber(), "WeightedCh3HashFunc: weight is not number");
-    weights_.push_back(weight.asDouble());
+    weights.push_back(weight.asDouble());
+  }
+  weights.resize(n, 0.5);
+  state_->set(std::move(weights));
+}
+
+void WeightedCh3HashFunc::State::replace(std::vector<double> weights) {
+  auto n = data.load(std::memory_order_acquire)->weights.size();
+  checkLogic(weights.size() == n,
+             "WeightedCh3HashFunc: {} weights for {} servers",
+             weights.size(), n);
+  for (auto weight : weights) {
+    checkLogic(0 <= weight && weight <= 1.0,
+               "WeightedCh3HashFunc: weight {} is not in [0, 1]", weight);
   }
-  weights_.resize(n, 0.5);
+  set(std::move(weights));
+}
+
+void WeightedCh3HashFunc::setWeights(std::vector<double> weights) const {
+  state_->replace(std::move(weights));
+}
+
+std::function<void(std::vector<double>)>
+WeightedCh3HashFunc::weightsSetter() const {
+  auto state = state_.get();
+  return [state](std::vector<double> weights) {
+    state->replace(std::move(weights));
+  };
+}
+
+void WeightedCh3HashFunc::attach(std::shared_ptr<void> obj) const {
+  std::lock_guard<std::mutex> lg(state_->lock);
+  state_->attached.push_back(std::move(obj));
 }
 
 size_t WeightedCh3HashFunc::operator()(folly::StringPiece key) const {
-  auto n = weights_.size();
+  const auto& thresholds =
+    state_->data.load(std::memory_order_acquire)->thresholds;
+  auto n = thresholds.size();
   checkLogic(n && n <= furc_maximum_pool_size(), "Invalid pool size: {}", n);
   size_t salt = 0;
   size_t index = 0;
@@ -56,20 +110,26 @@ size_t WeightedCh3HashFunc::operator()(folly::StringPiece key) const {
     index = furc_hash(key.data(), key.size(), n);
 
     /* Use 32-bit hash, but store in 64-bit ints so that
-       we don't have to deal with overflows */
-    uint64_t p = folly::hash::SpookyHashV2::Hash32(key.data(), key.size(),
-                                                   kHashSeed);
-    assert(0 <= weights_[index] && weights_[index] <= 1.0);
-    uint64_t w = weights_[index] * std::numeric_limits<uint32_t>::max();
-
-    /* Rehash only if p is out of range */
-    if (LIKELY(p < w)) {
-      return index;
+       we don't have to deal with overflows.
+       p < 0 never holds, so skip hashing for servers with zero weight */
+    uint64_t w = thresholds[index];
+    if (LIKELY(w != 0)) {
+      uint64_t p = folly::hash::SpookyHashV2::Hash32(key.data(), key.size(),
+                                                     kHashSeed);
+      /* Rehash only if p is out of range */
+      if (LIKELY(p < w)) {
+        return index;
+      }
     }
 
-    /* Change the key to rehash */
+    /* Change the key to rehash, reusing the buffer between tries */
     auto s = salt++;
-    saltedKey = originalKey.str();
+    if (saltedKey.empty()) {
+      saltedKey.reserve(originalKey.size() + 8);
+      saltedKey.assign(originalKey.data(), originalKey.size());
+    } else {
+      saltedKey.resize(originalKey.size());
+    }
     do {
       saltedKey.push_back(char(s % 10) + '0');
       s /= 10;
@@ -9,7 +9,14 @@
  */
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 #include <folly/Range.h>
 
@@ -43,6 +50,9 @@ namespace facebook { namespace memcache {
  * The algorithm is consistent both with respect to n and to individual weights,
  * i.e. reducing any single weight slightly will only spread out
  * a small fraction of the load from that server to all other servers.
+ *
+ * Weights are shared between copies of the function. They may be replaced
+ * at runtime (see setWeights()), for all copies at once.
  */
 class WeightedCh3HashFunc {
  public:
@@ -57,18 +67,64 @@ class WeightedCh3HashFunc {
   size_t operator()(folly::StringPiece key) const;
 
   /**
-   * @return Saved weights.
+   * @return Current weights. Valid for the function's lifetime, even once
+   *         weights were replaced.
    */
   const std::vector<double>& weights() const {
-    return weights_;
+    return state_->data.load(std::memory_order_acquire)->weights;
   }
 
+  /**
+   * Atomically replaces weights of this function and all its copies,
+   * lookups already in progress finish with the old ones. Thread safe.
+   *
+   * @param weights  New weights, each in [0.0, 1.0], one per server.
+   */
+  void setWeights(std::vector<double> weights) const;
+
+  /**
+   * @return  Calls setWeights(), without holding a reference to the
+   *          function: must only be called while the function, one of its
+   *          copies or an object attached to it is alive.
+   */
+  std::function<void(std::vector<double>)> weightsSetter() const;
+
+  /**
+   * Keeps obj alive for as long as the function or one of its copies is,
+   * e.g. a subscription calling weightsSetter(). obj must not hold a copy of
+   * the function, it is destroyed before the weights.
+   */
+  void attach(std::shared_ptr<void> obj) const;
+
   static std::string type() {
     return "WeightedCh3";
   }
 
  private:
-  std::vector<double> weights_;
+  struct Data {
+    std::vector<double> weights;
+    /* weights scaled to [0, uint32_max], precomputed on construction
+       so that lookups only compare integers */
+    std::vector<uint64_t> thresholds;
+
+    explicit Data(std::vector<double> w);
+  };
+
+  struct State {
+    std::atomic<const Data*> data{nullptr};
+    std::mutex lock;
+    /* Every version of the weights. Lookups don't hold a reference to
+       the data they use, so replaced versions are only freed with the
+       function; weights change rarely and are small */
+    std::vector<std::unique_ptr<const Data>> versions;
+    /* Last member, destroyed first */
+    std::vector<std::shared_ptr<void>> attached;
+
+    void set(std::vector<double> weights);
+    /* set(), once weights are validated against the current ones */
+    void replace(std::vector<double> weights);
+  };
+  std::shared_ptr<State> state_;
 };
 
 }}  // facebook::memcache
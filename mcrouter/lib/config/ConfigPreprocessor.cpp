@@ -9,9 +9,11 @@
  */
 #include "ConfigPreprocessor.h"
 
+#include <algorithm>
 #include <random>
 #include <unordered_set>
 
+#include <folly/Conv.h>
 #include <folly/Format.h>
 #include <folly/json.h>
 #include <folly/Memory.h>
@@ -46,6 +48,46 @@ class NestedLimitGuard {
   size_t& nestedLimit_;
 };
 
+/**
+ * Appends paths of @import macros in json that don't depend on parameters
+ * or other macros: "@import(path)" strings and { "type": "import" } objects.
+ */
+void collectImports(const dynamic& json, vector<string>& paths) {
+  auto isLiteral = [](StringPiece path) {
+    return !path.empty() &&
+      path.find_first_of("%@(),") == StringPiece::npos;
+  };
+  if (json.isString()) {
+    auto str = json.stringPiece();
+    if (str.removePrefix("@import(") && str.removeSuffix(")") &&
+        isLiteral(str)) {
+      paths.push_back(str.str());
+    }
+  } else if (json.isObject()) {
+    auto jtype = json.get_ptr("type");
+    auto jpath = json.get_ptr("path");
+    if (jtype && jtype->isString() && jtype->stringPiece() == "import" &&
+        jpath && jpath->isString() && isLiteral(jpath->stringPiece())) {
+      paths.push_back(jpath->stringPiece().str());
+    }
+    for (const auto& it : json.values()) {
+      collectImports(it, paths);
+    }
+  } else if (json.isArray()) {
+    for (const auto& it : json) {
+      collectImports(it, paths);
+    }
+  }
+}
+
+void prefetchImports(const dynamic& json, ImportResolverIf& importResolver) {
+  vector<string> paths;
+  collectImports(json, paths);
+  if (!paths.empty()) {
+    importResolver.prefetch(paths);
+  }
+}
+
 string asString(const dynamic& obj, StringPiece objName) {
   checkLogic(obj.isString(), "{} is {}, string expected",
              objName, obj.typeName());
@@ -159,6 +201,61 @@ size_t unescapeUntil(StringPiece from, string& to, char c) {
   return string::npos;
 }
 
+/**
+ * Appends representation of json to out, that is equal for equal json values
+ * (regardless of order of object keys) and differs otherwise. Unlike
+ * serialized json, it distinguishes e.g. 1 and 1.0.
+ */
+void appendCacheKey(const dynamic& json, string& out) {
+  switch (json.type()) {
+    case dynamic::NULLT:
+      out.push_back('n');
+      break;
+    case dynamic::BOOL:
+      out.push_back(json.getBool() ? 't' : 'f');
+      break;
+    case dynamic::INT64:
+      out.push_back('i');
+      folly::toAppend(json.getInt(), ';', &out);
+      break;
+    case dynamic::DOUBLE:
+      out.push_back('d');
+      folly::toAppend(json.getDouble(), ';', &out);
+      break;
+    case dynamic::STRING: {
+      auto sp = json.stringPiece();
+      folly::toAppend('s', sp.size(), ':', sp, &out);
+      break;
+    }
+    case dynamic::ARRAY:
+      folly::toAppend('a', json.size(), ':', &out);
+      for (const auto& it : json) {
+        appendCacheKey(it, out);
+      }
+      break;
+    case dynamic::OBJECT: {
+      vector<std::pair<string, const dynamic*>> items;
+      items.reserve(json.size());
+      for (const auto& it : json.items()) {
+        string key;
+        appendCacheKey(it.first, key);
+        items.emplace_back(std::move(key), &it.second);
+      }
+      std::sort(items.begin(), items.end(),
+                [] (const std::pair<string, const dynamic*>& a,
+                    const std::pair<string, const dynamic*>& b) {
+                  return a.first < b.first;
+                });
+      folly::toAppend('o', items.size(), ':', &out);
+      for (const auto& it : items) {
+        out.append(it.first);
+        appendCacheKey(*it.second, out);
+      }
+      break;
+    }
+  }
+}
+
 } // namespace
 
 const ConfigPreprocessor::Context ConfigPreprocessor::emptyContext_;
@@ -303,9 +400,10 @@ class ConfigPreprocessor::BuiltIns {
     }
     dynamic result = nullptr;
     try {
-      auto jsonC = importResolver.import(path);
-      // result may contain comments, macros, etc.
-      result = p->expandMacros(parseJsonString(stripComments(jsonC)),
+      // result may contain macros, etc.
+      auto json = importResolver.importJson(path);
+      prefetchImports(json, importResolver);
+      result = p->expandMacros(std::move(json),
                                ConfigPreprocessor::emptyContext_);
     } catch (const std::exception& e) {
       throw std::logic_error("Import '" + path + "':\n" + e.what());
@@ -427,7 +525,8 @@ class ConfigPreprocessor::BuiltIns {
    *
    * Returns list or object with randomly shuffled items.
    */
-  static dynamic shuffleMacro(Context ctx) {
+  static dynamic shuffleMacro(ConfigPreprocessor* p, Context ctx) {
+    ++p->randomCalls_;
     auto& dictionary = ctx.at("dictionary");
 
     checkLogic(dictionary.isObject() || dictionary.isArray(),
@@ -1232,7 +1331,8 @@ ConfigPreprocessor::ConfigPreprocessor(ImportResolverIf& importResolver,
 
   addBuiltInMacro("select", { "dictionary", "key" }, &BuiltIns::selectMacro);
 
-  addBuiltInMacro("shuffle", { "dictionary" }, &BuiltIns::shuffleMacro);
+  addBuiltInMacro("shuffle", { "dictionary" },
+    std::bind(&BuiltIns::shuffleMacro, this, _1));
 
   addBuiltInMacro("slice", { "dictionary", "from", "to" },
                   &BuiltIns::sliceMacro);
@@ -1430,6 +1530,38 @@ dynamic ConfigPreprocessor::expandStringMacro(StringPiece str,
   }
 }
 
+dynamic ConfigPreprocessor::expandMacroDef(const string& name,
+                                           const dynamic& result,
+                                           const Context& params) const {
+  // params of the same macro always have the same names
+  vector<Context::const_iterator> sorted;
+  sorted.reserve(params.size());
+  for (auto it = params.begin(); it != params.end(); ++it) {
+    sorted.push_back(it);
+  }
+  std::sort(sorted.begin(), sorted.end(),
+            [] (Context::const_iterator a, Context::const_iterator b) {
+              return a->first < b->first;
+            });
+  auto key = name;
+  key.push_back('\0');
+  for (const auto& it : sorted) {
+    appendCacheKey(it->second, key);
+  }
+
+  auto cachedIt = macroCache_.find(key);
+  if (cachedIt != macroCache_.end()) {
+    return cachedIt->second;
+  }
+
+  auto randomCalls = randomCalls_;
+  auto expanded = expandMacros(result, params);
+  if (randomCalls == randomCalls_) {
+    macroCache_.emplace(std::move(key), expanded);
+  }
+  return expanded;
+}
+
 dynamic ConfigPreprocessor::expandMacros(dynamic json,
                                          const Context& context) const {
   NestedLimitGuard nestedGuard(nestedLimit_);
@@ -1542,8 +1674,8 @@ void ConfigPreprocessor::parseMacroDef(const dynamic& jkey,
         params.push_back(paramObj);
       }
     }
-    auto f = [res, this](const Context& ctx) {
-      return expandMacros(res, ctx);
+    auto f = [res, key, this](const Context& ctx) {
+      return expandMacroDef(key, res, ctx);
     };
     macros_.emplace(key, make_unique<Macro>(key, params, std::move(f)));
   } else if (objType == "constDef") {
@@ -1579,6 +1711,7 @@ dynamic ConfigPreprocessor::getConfigWithoutMacros(
 
   auto config = parseJsonString(stripComments(jsonC));
   checkLogic(config.isObject(), "config is not an object");
+  prefetchImports(config, importResolver);
 
   ConfigPreprocessor prep(importResolver, std::move(globalParams), nestedLimit);
 
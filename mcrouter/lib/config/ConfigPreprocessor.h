@@ -71,6 +71,11 @@ class ConfigPreprocessor {
     std::function<folly::dynamic(const folly::dynamic&, const Context&)>
   > builtInCalls_;
 
+  // result of macroDef calls by macro name and params, see expandMacroDef
+  mutable std::unordered_map<std::string, folly::dynamic> macroCache_;
+  // number of calls with random results (@shuffle) made so far
+  mutable size_t randomCalls_{0};
+
   mutable size_t nestedLimit_;
 
   static const Context emptyContext_;
@@ -122,6 +127,16 @@ class ConfigPreprocessor {
   folly::dynamic
   expandStringMacro(folly::StringPiece str, const Context& params) const;
 
+  /**
+   * Expands result of macroDef 'name' with given params. Result depends
+   * only on params (consts and macros don't change once parsed), so it is
+   * expanded once for each distinct set of params. Results of calls that
+   * used random built-ins (e.g. @shuffle) are not cached.
+   */
+  folly::dynamic expandMacroDef(const std::string& name,
+                                const folly::dynamic& result,
+                                const Context& params) const;
+
   void addBuiltInMacro(std::string name, std::vector<folly::dynamic> params,
                        std::function<folly::dynamic(Context)> func);
 
@@ -10,9 +10,14 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
+#include <folly/dynamic.h>
+#include <folly/json.h>
 #include <folly/Range.h>
 
+#include "mcrouter/lib/fbi/cpp/util.h"
+
 namespace facebook { namespace memcache {
 
 /**
@@ -28,6 +33,23 @@ class ImportResolverIf {
    */
   virtual std::string import(folly::StringPiece path) = 0;
 
+  /**
+   * @param path parameter passed to @import macro
+   *
+   * @return JSON with macros, parsed. Implementations may cache it
+   *         instead of parsing the same contents again.
+   */
+  virtual folly::dynamic importJson(folly::StringPiece path) {
+    return parseJsonString(folly::json::stripComments(import(path)));
+  }
+
+  /**
+   * Called with paths of @import macros found before they are expanded,
+   * so that implementations can start loading them in parallel.
+   * Errors should be left for import()/importJson() to report.
+   */
+  virtual void prefetch(const std::vector<std::string>& paths) {}
+
   virtual ~ImportResolverIf() {}
 };
 
@@ -8,6 +8,7 @@
  *
  */
 #include <folly/dynamic.h>
+#include <folly/json.h>
 
 #include "mcrouter/lib/config/RouteHandleProviderIf.h"
 #include "mcrouter/lib/fbi/cpp/util.h"
@@ -63,9 +64,28 @@ RouteHandleFactory<RouteHandleIf>::createList(const folly::dynamic& json) {
       auto ret = provider_.create(*this, type, json);
       seen_.emplace(name, ret);
       return ret;
-    } else {
-      return provider_.create(*this, type, json);
     }
+
+    // Identical anonymous subtrees (e.g. expanded from the same macro)
+    // share RouteHandles, unless some node in the subtree is unshareable.
+    folly::json::serialization_opts opts;
+    opts.sort_keys = true;
+    auto key = folly::json::serialize(json, opts).toStdString();
+    auto it = seenJson_.find(key);
+    if (it != seenJson_.end()) {
+      ++dedupedRoutes_;
+      return it->second;
+    }
+
+    auto numUnshareable = numUnshareable_;
+    if (!provider_.isShareable(type)) {
+      ++numUnshareable_;
+    }
+    auto ret = provider_.create(*this, type, json);
+    if (numUnshareable == numUnshareable_) {
+      seenJson_.emplace(std::move(key), ret);
+    }
+    return ret;
   } else if (json.isString()) {
     if (json.empty()) {
       // useful for routes with optional children
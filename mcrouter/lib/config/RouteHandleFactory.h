@@ -53,6 +53,15 @@ class RouteHandleFactory {
    */
   std::vector<std::shared_ptr<RouteHandleIf>>
   createList(const folly::dynamic& json);
+
+  /**
+   * @return  number of anonymous subtrees that reused a RouteHandle created
+   *          for an identical subtree, instead of creating a new one.
+   */
+  size_t dedupedRoutes() const {
+    return dedupedRoutes_;
+  }
+
  private:
   RouteHandleProviderIf<RouteHandleIf>& provider_;
 
@@ -60,6 +69,15 @@ class RouteHandleFactory {
   std::unordered_map<std::string,
                      std::vector<std::shared_ptr<RouteHandleIf>>> seen_;
 
+  /// Anonymous objects we've already parsed, by JSON with sorted keys
+  std::unordered_map<std::string,
+                     std::vector<std::shared_ptr<RouteHandleIf>>> seenJson_;
+
+  /// Number of unshareable RouteHandles created so far
+  size_t numUnshareable_{0};
+
+  size_t dedupedRoutes_{0};
+
 };
 
 }} // facebook::memcache
@@ -43,6 +43,16 @@ class RouteHandleProviderIf {
   create(RouteHandleFactory<RouteHandleIf>& factory, folly::StringPiece type,
          const folly::dynamic& json) = 0;
 
+  /**
+   * Whether a RouteHandle of given type may be shared by identical
+   * (same JSON) anonymous subtrees of the config. Should return false for
+   * RouteHandles keeping per-instance state that changes behavior (e.g.
+   * limits, caches).
+   */
+  virtual bool isShareable(folly::StringPiece type) const {
+    return true;
+  }
+
   virtual ~RouteHandleProviderIf() {};
 };
 
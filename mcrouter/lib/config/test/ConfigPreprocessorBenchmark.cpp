@@ -0,0 +1,121 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <string>
+#include <unordered_map>
+
+#include <gflags/gflags.h>
+
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+#include <folly/dynamic.h>
+#include <folly/json.h>
+
+#include "mcrouter/lib/config/ConfigPreprocessor.h"
+#include "mcrouter/lib/config/ImportResolverIf.h"
+
+using facebook::memcache::ConfigPreprocessor;
+using facebook::memcache::ImportResolverIf;
+
+namespace {
+
+class EmptyImportResolver : public ImportResolverIf {
+  std::string import(folly::StringPiece path) override {
+    return "{}";
+  }
+};
+
+const std::unordered_map<std::string, folly::dynamic> kGlobalParams = {
+  { "region", "west" }
+};
+
+/**
+ * Config with numPools pools and a route for each of them. Servers of
+ * a pool are generated by a macro; pools in the same cluster share
+ * the same server list, as they usually do in real configs.
+ */
+std::string makeConfig(size_t numPools, size_t numClusters,
+                       size_t numServers) {
+  auto macros = folly::dynamic::object
+    ("servers", folly::dynamic::object
+      ("type", "macroDef")
+      ("params", { "cluster" })
+      ("result", folly::dynamic::object
+        ("type", "transform")
+        ("dictionary",
+         folly::to<std::string>("@range(@int(1), @int(", numServers, "))"))
+        ("itemTransform", folly::dynamic::object
+          ("host", "%cluster%.%region%")
+          ("index", "%item%"))))
+    ("pool", folly::dynamic::object
+      ("type", "macroDef")
+      ("params", { "name", "cluster" })
+      ("result", folly::dynamic::object
+        ("servers", "@servers(%cluster%)")
+        ("protocol", "ascii")
+        ("keep_routing_prefix", false)));
+
+  auto pools = folly::dynamic::object;
+  auto routes = folly::dynamic::object;
+  for (size_t i = 0; i < numPools; ++i) {
+    auto name = folly::to<std::string>("pool", i);
+    pools[name] = folly::dynamic::object
+      ("type", "pool")
+      ("name", name)
+      ("cluster", folly::to<std::string>("c", i % numClusters));
+    routes[folly::to<std::string>("/%region%/", name, "/")] =
+      folly::to<std::string>("PoolRoute|", name);
+  }
+
+  return folly::toJson(folly::dynamic::object
+    ("macros", macros)
+    ("pools", pools)
+    ("routes", routes)).toStdString();
+}
+
+void runExpand(size_t iters, const std::string& config) {
+  EmptyImportResolver resolver;
+  for (size_t i = 0; i < iters; ++i) {
+    auto json = ConfigPreprocessor::getConfigWithoutMacros(
+      config, resolver, kGlobalParams);
+    folly::doNotOptimizeAway(json);
+  }
+}
+
+}  // anonymous namespace
+
+BENCHMARK(ConfigPreprocessor_100Pools, iters) {
+  std::string config;
+  BENCHMARK_SUSPEND {
+    config = makeConfig(100, 10, 100);
+  }
+  runExpand(iters, config);
+}
+
+BENCHMARK(ConfigPreprocessor_10000Pools_SharedServers, iters) {
+  std::string config;
+  BENCHMARK_SUSPEND {
+    config = makeConfig(10000, 100, 100);
+  }
+  runExpand(iters, config);
+}
+
+BENCHMARK(ConfigPreprocessor_10000Pools_UniqueServers, iters) {
+  std::string config;
+  BENCHMARK_SUSPEND {
+    config = makeConfig(10000, 10000, 100);
+  }
+  runExpand(iters, config);
+}
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  folly::runBenchmarks();
+  return 0;
+}
@@ -7,6 +7,7 @@
  *  of patent rights can be found in the PATENTS file in the same directory.
  *
  */
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -155,3 +156,41 @@ TEST(ConfigPreprocessorTest, comments) {
 
   EXPECT_EQ(orig, expand);
 }
+
+namespace {
+
+class PrefetchRecorder : public ImportResolverIf {
+ public:
+  std::vector<std::string> prefetched;
+
+  std::string import(folly::StringPiece path) override {
+    if (path == "outer") {
+      return "{ \"inner\": \"@import(inner)\" }";
+    }
+    return "\"" + path.str() + "\"";
+  }
+
+  void prefetch(const std::vector<std::string>& paths) override {
+    prefetched.insert(prefetched.end(), paths.begin(), paths.end());
+  }
+};
+
+}  // anonymous namespace
+
+TEST(ConfigPreprocessorTest, prefetchImports) {
+  PrefetchRecorder resolver;
+
+  auto json = ConfigPreprocessor::getConfigWithoutMacros(
+    "{ \"a\": \"@import(outer)\","
+    "  \"b\": { \"type\": \"import\", \"path\": \"other\" },"
+    "  \"c\": \"@import(%testGlobal%)\" }",
+    resolver, kGlobalParams);
+
+  EXPECT_EQ("inner", json["a"]["inner"].asString());
+  EXPECT_EQ("other", json["b"].asString());
+  EXPECT_EQ("test", json["c"].asString());
+  // parametrized paths are not prefetched, nested ones once found
+  std::vector<std::string> expected{"inner", "other", "outer"};
+  std::sort(resolver.prefetched.begin(), resolver.prefetched.end());
+  EXPECT_EQ(expected, resolver.prefetched);
+}
@@ -10,6 +10,8 @@
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 
+#include <folly/json.h>
+
 #include "mcrouter/lib/config/RouteHandleFactory.h"
 #include "mcrouter/lib/config/test/TestRouteHandleProvider.h"
 #include "mcrouter/lib/test/RouteHandleTestUtil.h"
@@ -17,6 +19,17 @@
 
 using namespace facebook::memcache;
 
+namespace {
+
+class UnshareableHashProvider : public RouteHandleProvider<TestRouteHandleIf> {
+ public:
+  bool isShareable(folly::StringPiece type) const override {
+    return type != "HashRoute";
+  }
+};
+
+}  // anonymous namespace
+
 TEST(RouteHandleFactoryTest, sanity) {
   TestFiberManager fm;
 
@@ -101,3 +114,42 @@ TEST(RouteHandleFactoryTest, sanity) {
     EXPECT_TRUE(reply.isError());
   });
 }
+
+TEST(RouteHandleFactoryTest, dedup) {
+  auto json = folly::parseJson(R"([
+    {"type": "HashRoute", "children": ["NullRoute", "ErrorRoute"]},
+    {"children": ["NullRoute", "ErrorRoute"], "type": "HashRoute"},
+    {"type": "HashRoute", "children": ["ErrorRoute", "NullRoute"]},
+    {
+      "type": "FailoverRoute",
+      "children": [
+        {"type": "HashRoute", "children": ["NullRoute", "ErrorRoute"]}
+      ]
+    },
+    {
+      "type": "FailoverRoute",
+      "children": [
+        {"type": "HashRoute", "children": ["NullRoute", "ErrorRoute"]}
+      ]
+    }
+  ])");
+
+  RouteHandleProvider<TestRouteHandleIf> provider;
+  RouteHandleFactory<TestRouteHandleIf> factory(provider);
+  auto list = factory.createList(json);
+  ASSERT_EQ(5, list.size());
+  EXPECT_EQ(list[0], list[1]);
+  EXPECT_NE(list[0], list[2]);
+  EXPECT_EQ(list[3], list[4]);
+  // list[1], HashRoute of list[3] and list[4]
+  EXPECT_EQ(3, factory.dedupedRoutes());
+
+  UnshareableHashProvider unshareable;
+  RouteHandleFactory<TestRouteHandleIf> unshareableFactory(unshareable);
+  list = unshareableFactory.createList(json);
+  ASSERT_EQ(5, list.size());
+  EXPECT_NE(list[0], list[1]);
+  // FailoverRoutes contain an unshareable route
+  EXPECT_NE(list[3], list[4]);
+  EXPECT_EQ(0, unshareableFactory.dedupedRoutes());
+}
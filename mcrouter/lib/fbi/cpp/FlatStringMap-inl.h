@@ -0,0 +1,77 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <cassert>
+
+#include "mcrouter/lib/fbi/cpp/util.h"
+
+namespace facebook { namespace memcache {
+
+template<class Value>
+template<class Container>
+FlatStringMap<Value>::FlatStringMap(const Container& items) {
+  for (const auto& it : items) {
+    values_.emplace_back(std::string(it.first.data(), it.first.size()),
+                         it.second);
+  }
+  if (values_.empty()) {
+    return;
+  }
+  assert(values_.size() < kEmpty);
+
+  size_t numSlots = 1;
+  while (numSlots < 2 * values_.size()) {
+    numSlots <<= 1;
+  }
+  slots_.resize(numSlots);
+  auto mask = numSlots - 1;
+  for (uint32_t i = 0; i < values_.size(); ++i) {
+    auto hash = getMemcacheKeyHashValue(values_[i].first);
+    auto pos = hash & mask;
+    while (slots_[pos].value != kEmpty) {
+      assert(values_[slots_[pos].value].first != values_[i].first);
+      pos = (pos + 1) & mask;
+    }
+    slots_[pos].hash = hash;
+    slots_[pos].value = i;
+  }
+}
+
+template<class Value>
+uint32_t FlatStringMap<Value>::findImpl(folly::StringPiece key) const {
+  if (slots_.empty()) {
+    return kEmpty;
+  }
+  auto hash = getMemcacheKeyHashValue(key);
+  auto mask = slots_.size() - 1;
+  for (auto pos = hash & mask; slots_[pos].value != kEmpty;
+       pos = (pos + 1) & mask) {
+    if (slots_[pos].hash == hash &&
+        folly::StringPiece(values_[slots_[pos].value].first) == key) {
+      return slots_[pos].value;
+    }
+  }
+  return kEmpty;
+}
+
+template<class Value>
+typename FlatStringMap<Value>::const_iterator
+FlatStringMap<Value>::find(folly::StringPiece key) const {
+  auto idx = findImpl(key);
+  return idx == kEmpty ? end() : begin() + idx;
+}
+
+template<class Value>
+typename FlatStringMap<Value>::iterator
+FlatStringMap<Value>::find(folly::StringPiece key) {
+  auto idx = findImpl(key);
+  return idx == kEmpty ? end() : begin() + idx;
+}
+
+}} // facebook::memcache
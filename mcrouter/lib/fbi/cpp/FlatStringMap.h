@@ -0,0 +1,103 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <folly/Range.h>
+
+namespace facebook { namespace memcache {
+
+/**
+ * Immutable hash map with string keys, with the lookup interface of
+ * folly::StringKeyedUnorderedMap.
+ *
+ * Meant for maps that are built once (e.g. on config load) and then
+ * queried on every request. Values are stored in one array; the table is
+ * an open addressing (linear probing) array of (hash, value index) slots,
+ * at most half full, so a lookup hashes the key once and usually reads one
+ * slot and the one value it points to, instead of walking a bucket's
+ * nodes.
+ *
+ * @param Value type of stored value.
+ */
+template<class Value>
+class FlatStringMap {
+ public:
+  typedef std::pair<const std::string, Value> value_type;
+  typedef Value mapped_type;
+  typedef typename std::vector<value_type>::const_iterator const_iterator;
+  typedef typename std::vector<value_type>::iterator iterator;
+
+  FlatStringMap() = default;
+
+  /**
+   * Build from a container of (key, value) pairs with unique keys,
+   * e.g. a folly::StringKeyedUnorderedMap or a std::map.
+   */
+  template<class Container>
+  explicit FlatStringMap(const Container& items);
+
+  FlatStringMap(const FlatStringMap& other) = default;
+  FlatStringMap(FlatStringMap&& other) = default;
+  FlatStringMap& operator=(const FlatStringMap& other) = default;
+  FlatStringMap& operator=(FlatStringMap&& other) = default;
+
+  /**
+   * @return end() if no key found, iterator for given key otherwise
+   */
+  const_iterator find(folly::StringPiece key) const;
+
+  iterator find(folly::StringPiece key);
+
+  size_t count(folly::StringPiece key) const {
+    return find(key) == end() ? 0 : 1;
+  }
+
+  const_iterator begin() const { return values_.begin(); }
+  iterator begin() { return values_.begin(); }
+  const_iterator end() const { return values_.end(); }
+  iterator end() { return values_.end(); }
+
+  size_t size() const { return values_.size(); }
+  bool empty() const { return values_.empty(); }
+
+  /**
+   * @return  bytes of this map's slots and values, not including heap
+   *          memory owned by keys or values
+   */
+  size_t memoryUsage() const {
+    return sizeof(*this) + slots_.capacity() * sizeof(Slot) +
+           values_.capacity() * sizeof(value_type);
+  }
+
+ private:
+  static constexpr uint32_t kEmpty = static_cast<uint32_t>(-1);
+
+  struct Slot {
+    uint32_t hash{0};
+    // index in values_ or kEmpty
+    uint32_t value{kEmpty};
+  };
+
+  // size is a power of two (or 0 if there are no values)
+  std::vector<Slot> slots_;
+  std::vector<value_type> values_;
+
+  // index in values_ or kEmpty
+  uint32_t findImpl(folly::StringPiece key) const;
+};
+
+}} // facebook::memcache
+
+#include "FlatStringMap-inl.h"
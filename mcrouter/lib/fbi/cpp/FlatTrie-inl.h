@@ -0,0 +1,158 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace facebook { namespace memcache {
+
+template<class Value>
+FlatTrie<Value>::FlatTrie() {
+  nodes_.emplace_back();
+  labels_.push_back('\0');
+}
+
+template<class Value>
+template<class Container>
+FlatTrie<Value>::FlatTrie(const Container& items) {
+  std::vector<std::pair<std::string, Value>> sorted;
+  for (const auto& it : items) {
+    sorted.emplace_back(it.first, it.second);
+  }
+  build(std::move(sorted));
+}
+
+template<class Value>
+void FlatTrie<Value>::build(std::vector<std::pair<std::string, Value>> items) {
+  std::sort(items.begin(), items.end(),
+            [] (const std::pair<std::string, Value>& a,
+                const std::pair<std::string, Value>& b) {
+              return a.first < b.first;
+            });
+
+  nodes_.emplace_back();
+  labels_.push_back('\0');
+
+  // Breadth first, so that children of every node are laid out next
+  // to each other. Each node covers a range of items that share
+  // the first 'depth' characters.
+  struct Range {
+    size_t begin;
+    size_t end;
+    size_t depth;
+    uint32_t node;
+  };
+  std::vector<Range> queue;
+  queue.push_back({0, items.size(), 0, 0});
+  for (size_t head = 0; head < queue.size(); ++head) {
+    auto range = queue[head];
+    auto pos = range.begin;
+    // keys are unique and sorted, so the key equal to the node's prefix
+    // (if any) comes first
+    if (pos < range.end && items[pos].first.size() == range.depth) {
+      nodes_[range.node].value = pos;
+      ++pos;
+    }
+    nodes_[range.node].firstChild = nodes_.size();
+    while (pos < range.end) {
+      auto c = items[pos].first[range.depth];
+      auto next = pos + 1;
+      while (next < range.end && items[next].first[range.depth] == c) {
+        ++next;
+      }
+      uint32_t child = nodes_.size();
+      nodes_.emplace_back();
+      labels_.push_back(c);
+      ++nodes_[range.node].numChildren;
+      queue.push_back({pos, next, range.depth + 1, child});
+      pos = next;
+    }
+  }
+
+  values_.reserve(items.size());
+  for (auto& it : items) {
+    values_.emplace_back(std::move(it.first), std::move(it.second));
+  }
+}
+
+template<class Value>
+uint32_t FlatTrie<Value>::getChild(const Node& node, char c) const {
+  auto labels = labels_.data() + node.firstChild;
+  // Fan-out is small for most nodes, memchr pays off for wide ones.
+  if (node.numChildren <= 8) {
+    for (uint32_t i = 0; i < node.numChildren; ++i) {
+      if (labels[i] == c) {
+        return node.firstChild + i;
+      }
+    }
+    return 0;
+  }
+  auto found = static_cast<const char*>(
+    std::memchr(labels, c, node.numChildren));
+  return found ? node.firstChild + (found - labels) : 0;
+}
+
+template<class Value>
+uint32_t FlatTrie<Value>::findImpl(folly::StringPiece key) const {
+  uint32_t node = 0;
+  for (auto c : key) {
+    node = getChild(nodes_[node], c);
+    if (node == 0) {
+      return kNoValue;
+    }
+  }
+  return nodes_[node].value;
+}
+
+template<class Value>
+uint32_t FlatTrie<Value>::findPrefixImpl(folly::StringPiece key) const {
+  uint32_t node = 0;
+  auto result = nodes_[0].value;
+  for (auto c : key) {
+    node = getChild(nodes_[node], c);
+    if (node == 0) {
+      break;
+    }
+    if (nodes_[node].value != kNoValue) {
+      result = nodes_[node].value;
+    }
+  }
+  return result;
+}
+
+template<class Value>
+typename FlatTrie<Value>::const_iterator
+FlatTrie<Value>::find(folly::StringPiece key) const {
+  auto idx = findImpl(key);
+  return idx == kNoValue ? end() : begin() + idx;
+}
+
+template<class Value>
+typename FlatTrie<Value>::iterator
+FlatTrie<Value>::find(folly::StringPiece key) {
+  auto idx = findImpl(key);
+  return idx == kNoValue ? end() : begin() + idx;
+}
+
+template<class Value>
+typename FlatTrie<Value>::const_iterator
+FlatTrie<Value>::findPrefix(folly::StringPiece key) const {
+  auto idx = findPrefixImpl(key);
+  return idx == kNoValue ? end() : begin() + idx;
+}
+
+template<class Value>
+typename FlatTrie<Value>::iterator
+FlatTrie<Value>::findPrefix(folly::StringPiece key) {
+  auto idx = findPrefixImpl(key);
+  return idx == kNoValue ? end() : begin() + idx;
+}
+
+}} // facebook::memcache
@@ -0,0 +1,125 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <folly/Range.h>
+
+namespace facebook { namespace memcache {
+
+/**
+ * Immutable, compact trie with the same lookup interface as Trie.
+ *
+ * Meant for maps that are built once (e.g. on config load) and then
+ * queried on every request. All nodes live in one array, children of
+ * a node are stored next to each other and their labels are kept in
+ * a separate byte array, so a lookup step is a scan over a few
+ * contiguous bytes instead of a jump through a pointer table of
+ * kNumChars entries. Values are stored in one array in lexicographic
+ * order of keys.
+ *
+ * Any characters may be used in keys.
+ *
+ * @param Value type of stored value.
+ */
+template<class Value>
+class FlatTrie {
+ public:
+  typedef std::pair<const std::string, Value> value_type;
+  typedef Value mapped_type;
+  typedef typename std::vector<value_type>::const_iterator const_iterator;
+  typedef typename std::vector<value_type>::iterator iterator;
+
+  FlatTrie();
+
+  /**
+   * Build from a container of (key, value) pairs with unique keys,
+   * e.g. a Trie or a std::map.
+   */
+  template<class Container>
+  explicit FlatTrie(const Container& items);
+
+  FlatTrie(const FlatTrie& other) = default;
+  FlatTrie(FlatTrie&& other) = default;
+  FlatTrie& operator=(const FlatTrie& other) = default;
+  FlatTrie& operator=(FlatTrie&& other) = default;
+
+  /**
+   * Return iterator for given key
+   *
+   * @return end() if no key found, iterator for given key otherwise
+   */
+  const_iterator find(folly::StringPiece key) const;
+
+  iterator find(folly::StringPiece key);
+
+  /**
+   * Get value of longest prefix stored in FlatTrie
+   *
+   * @return end() if no prefix found, iterator for the longest prefix
+   *         otherwise
+   */
+  const_iterator findPrefix(folly::StringPiece key) const;
+
+  iterator findPrefix(folly::StringPiece key);
+
+  const_iterator begin() const { return values_.begin(); }
+  iterator begin() { return values_.begin(); }
+  const_iterator end() const { return values_.end(); }
+  iterator end() { return values_.end(); }
+  const_iterator cbegin() const { return values_.cbegin(); }
+  const_iterator cend() const { return values_.cend(); }
+
+  size_t size() const { return values_.size(); }
+  bool empty() const { return values_.empty(); }
+
+  /**
+   * @return  bytes of this trie's nodes and value slots, not including
+   *          heap memory owned by keys or values
+   */
+  size_t memoryUsage() const {
+    return sizeof(*this) + nodes_.capacity() * sizeof(Node) +
+           labels_.capacity() + values_.capacity() * sizeof(value_type);
+  }
+
+ private:
+  static constexpr uint32_t kNoValue = static_cast<uint32_t>(-1);
+
+  struct Node {
+    // index of the first child in nodes_/labels_
+    uint32_t firstChild{0};
+    uint32_t numChildren{0};
+    // index in values_ or kNoValue
+    uint32_t value{kNoValue};
+  };
+
+  // nodes_[0] is the root
+  std::vector<Node> nodes_;
+  // labels_[i] is the character on the edge leading into nodes_[i]
+  std::vector<char> labels_;
+  std::vector<value_type> values_;
+
+  // index of child of node with label c, or 0 if there is none
+  inline uint32_t getChild(const Node& node, char c) const;
+
+  // index in values_ or kNoValue
+  uint32_t findImpl(folly::StringPiece key) const;
+  uint32_t findPrefixImpl(folly::StringPiece key) const;
+
+  void build(std::vector<std::pair<std::string, Value>> items);
+};
+
+}} // facebook::memcache
+
+#include "FlatTrie-inl.h"
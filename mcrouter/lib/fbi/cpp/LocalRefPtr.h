@@ -0,0 +1,156 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#ifndef NDEBUG
+#include <thread>
+#endif
+
+namespace facebook { namespace memcache {
+
+/**
+ * Intrusive smart pointer to an object used by a single thread only,
+ * so that copies don't pay for atomic reference counting.
+ *
+ * T must provide incRef() and decRef(), decRef() releasing the object once
+ * the last reference is gone; deriving from LocalRefCounted provides the
+ * counting.
+ */
+template <class T>
+class LocalRefPtr {
+ public:
+  LocalRefPtr() noexcept = default;
+
+  /* implicit */ LocalRefPtr(std::nullptr_t) noexcept {
+  }
+
+  /**
+   * Takes a new reference to ptr (may be nullptr).
+   */
+  explicit LocalRefPtr(T* ptr) noexcept
+      : ptr_(ptr) {
+    if (ptr_) {
+      ptr_->incRef();
+    }
+  }
+
+  LocalRefPtr(const LocalRefPtr& other) noexcept
+      : LocalRefPtr(other.ptr_) {
+  }
+
+  LocalRefPtr(LocalRefPtr&& other) noexcept
+      : ptr_(other.ptr_) {
+    other.ptr_ = nullptr;
+  }
+
+  LocalRefPtr& operator=(LocalRefPtr other) noexcept {
+    std::swap(ptr_, other.ptr_);
+    return *this;
+  }
+
+  ~LocalRefPtr() {
+    reset();
+  }
+
+  void reset() noexcept {
+    if (ptr_) {
+      auto ptr = ptr_;
+      ptr_ = nullptr;
+      ptr->decRef();
+    }
+  }
+
+  T* get() const noexcept {
+    return ptr_;
+  }
+
+  T& operator*() const noexcept {
+    assert(ptr_ != nullptr);
+    return *ptr_;
+  }
+
+  T* operator->() const noexcept {
+    assert(ptr_ != nullptr);
+    return ptr_;
+  }
+
+  explicit operator bool() const noexcept {
+    return ptr_ != nullptr;
+  }
+
+ private:
+  T* ptr_{nullptr};
+};
+
+template <class T>
+bool operator==(const LocalRefPtr<T>& a, const LocalRefPtr<T>& b) {
+  return a.get() == b.get();
+}
+
+template <class T>
+bool operator!=(const LocalRefPtr<T>& a, const LocalRefPtr<T>& b) {
+  return a.get() != b.get();
+}
+
+template <class T>
+bool operator==(const LocalRefPtr<T>& a, std::nullptr_t) {
+  return a.get() == nullptr;
+}
+
+template <class T>
+bool operator!=(const LocalRefPtr<T>& a, std::nullptr_t) {
+  return a.get() != nullptr;
+}
+
+/**
+ * Non-atomic reference count for LocalRefPtr<Derived>. Derived is released
+ * with Derived::onLastRef() once the count drops to zero.
+ *
+ * In debug builds every reference is checked to be taken and dropped by the
+ * thread that took the first one.
+ */
+template <class Derived>
+class LocalRefCounted {
+ public:
+  void incRef() noexcept {
+#ifndef NDEBUG
+    if (refCount_ == 0) {
+      ownerThread_ = std::this_thread::get_id();
+    }
+    assert(ownerThread_ == std::this_thread::get_id());
+#endif
+    ++refCount_;
+  }
+
+  void decRef() {
+    assert(refCount_ > 0);
+    assert(ownerThread_ == std::this_thread::get_id());
+    if (--refCount_ == 0) {
+      static_cast<Derived*>(this)->onLastRef();
+    }
+  }
+
+ protected:
+  LocalRefCounted() = default;
+  ~LocalRefCounted() = default;
+
+ private:
+  uint32_t refCount_{0};
+#ifndef NDEBUG
+  std::thread::id ownerThread_;
+#endif
+};
+
+}}  // facebook::memcache
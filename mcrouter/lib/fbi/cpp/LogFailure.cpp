@@ -11,10 +11,14 @@
 
 #include <unistd.h>
 
+#include <atomic>
+#include <condition_variable>
 #include <ctime>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -23,6 +27,9 @@
 
 #include <folly/experimental/Singleton.h>
 #include <folly/Format.h>
+#include <folly/Memory.h>
+#include <folly/MPMCQueue.h>
+#include <folly/ThreadName.h>
 
 #include "mcrouter/lib/fbi/cpp/util.h"
 
@@ -30,12 +37,23 @@ namespace facebook { namespace memcache { namespace failure {
 
 namespace {
 
+/* Where and when a failure was logged */
+struct Origin {
+  time_t time{0};
+  std::string threadName;
+};
+
+/* Set on the logging thread while it runs handlers of a queued failure */
+thread_local const Origin* queuedOrigin = nullptr;
+
 std::string createMessage(folly::StringPiece service,
                           folly::StringPiece category,
                           folly::StringPiece msg,
                           const std::map<std::string, std::string>& contexts) {
+  auto when = queuedOrigin ? queuedOrigin->time : time(nullptr);
+  auto thread = queuedOrigin ? queuedOrigin->threadName : getThreadName();
   auto result = folly::format("{} {} [{}] [{}] [{}] {}\n",
-    time(nullptr), getpid(), service, category, getThreadName(), msg).str();
+    when, getpid(), service, category, thread, msg).str();
 
   auto contextIt = contexts.find(service.str());
   if (contextIt != contexts.end()) {
@@ -71,6 +89,114 @@ void throwErrorImpl(folly::StringPiece service,
   throw Error(createMessage(service, category, msg, contexts));
 }
 
+struct QueuedFailure {
+  std::string service;
+  std::string category;
+  std::string msg;
+  Origin origin;
+  /* Tells the logging thread to exit */
+  bool stop{false};
+};
+
+struct StaticContainer;
+
+void runHandlers(StaticContainer& container,
+                 folly::StringPiece service,
+                 folly::StringPiece category,
+                 folly::StringPiece msg);
+
+/**
+ * Logging thread, handles failures queued by any thread in order.
+ */
+class FailureQueue {
+ public:
+  FailureQueue(StaticContainer& container, size_t size)
+      : container_(container),
+        queue_(size),
+        thread_([this]() { run(); }) {
+  }
+
+  /* Never blocks, false if the queue is full */
+  bool write(QueuedFailure&& failure) {
+    if (!queue_.write(std::move(failure))) {
+      return false;
+    }
+    written_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  void flush() {
+    auto target = written_.load(std::memory_order_relaxed);
+    std::unique_lock<std::mutex> lock(handledLock_);
+    handledCond_.wait(lock, [this, target]() { return handled_ >= target; });
+  }
+
+  /* Handles what's queued and joins the thread, idempotent */
+  void stop() {
+    if (!thread_.joinable()) {
+      return;
+    }
+    QueuedFailure failure;
+    failure.stop = true;
+    queue_.blockingWrite(std::move(failure));
+    thread_.join();
+  }
+
+  ~FailureQueue() {
+    stop();
+  }
+
+ private:
+  StaticContainer& container_;
+  folly::MPMCQueue<QueuedFailure> queue_;
+  std::atomic<uint64_t> written_{0};
+  std::mutex handledLock_;
+  std::condition_variable handledCond_;
+  uint64_t handled_{0};
+  std::thread thread_;
+
+  void run() {
+    folly::setThreadName("mcrtr-failures");
+    while (true) {
+      QueuedFailure failure;
+      queue_.blockingRead(failure);
+      if (failure.stop) {
+        return;
+      }
+      queuedOrigin = &failure.origin;
+      try {
+        runHandlers(container_, failure.service, failure.category,
+                    failure.msg);
+      } catch (const std::exception& e) {
+        LOG(ERROR) << "Failure handler threw: " << e.what();
+      }
+      queuedOrigin = nullptr;
+      {
+        std::lock_guard<std::mutex> lock(handledLock_);
+        ++handled_;
+      }
+      handledCond_.notify_all();
+    }
+  }
+};
+
+/* Rate limit of the services and categories hashing to one slot */
+struct RateSlot {
+  /* (second << 32) | failures logged in that second */
+  std::atomic<uint64_t> window{0};
+  std::atomic<uint64_t> suppressed{0};
+};
+
+constexpr size_t kRateSlots = 256;
+
+/* Plain statics, so that logging never waits for a lock to check them */
+RateSlot rateSlots[kRateSlots];
+std::atomic<size_t> maxPerSecond{0};
+std::atomic<FailureQueue*> currentQueue{nullptr};
+std::atomic<uint64_t> loggedCount{0};
+std::atomic<uint64_t> suppressedCount{0};
+std::atomic<uint64_t> droppedCount{0};
+
 struct StaticContainer {
   std::mutex lock;
 
@@ -81,8 +207,37 @@ struct StaticContainer {
   std::vector<std::pair<std::string, HandlerFunc>> handlers = {
     handlers::verboseLogToStdError()
   };
+
+  /* Serializes setOptions() */
+  std::mutex optionsLock;
+  /* Every queue ever started, stopped ones are kept for log() calls that
+     may still be writing to them */
+  std::vector<std::unique_ptr<FailureQueue>> queues;
+
+  ~StaticContainer() {
+    currentQueue.store(nullptr);
+    for (auto& queue : queues) {
+      queue->stop();
+    }
+  }
 };
 
+void runHandlers(StaticContainer& container,
+                 folly::StringPiece service,
+                 folly::StringPiece category,
+                 folly::StringPiece msg) {
+  std::map<std::string, std::string> contexts;
+  std::vector<std::pair<std::string, HandlerFunc>> handlers;
+  {
+    std::lock_guard<std::mutex> lock(container.lock);
+    contexts = container.contexts;
+    handlers = container.handlers;
+  }
+  for (auto& handler : handlers) {
+    handler.second(service, category, msg, contexts);
+  }
+}
+
 folly::Singleton<StaticContainer> containerSingleton;
 
 }  // anonymous namespace
@@ -150,18 +305,105 @@ void setServiceContext(folly::StringPiece service, std::string context) {
   }
 }
 
+void setOptions(Options opts) {
+  maxPerSecond.store(opts.maxPerSecond, std::memory_order_relaxed);
+  if (auto container = containerSingleton.get_weak().lock()) {
+    std::lock_guard<std::mutex> lock(container->optionsLock);
+    if (auto old = currentQueue.exchange(nullptr)) {
+      old->stop();
+    }
+    if (opts.queueSize > 0) {
+      container->queues.push_back(
+        folly::make_unique<FailureQueue>(*container, opts.queueSize));
+      currentQueue.store(container->queues.back().get());
+    }
+  }
+}
+
+Stats getStats() {
+  Stats stats;
+  stats.logged = loggedCount.load(std::memory_order_relaxed);
+  stats.suppressed = suppressedCount.load(std::memory_order_relaxed);
+  stats.dropped = droppedCount.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void flush() {
+  if (auto queue = currentQueue.load()) {
+    queue->flush();
+  }
+}
+
+namespace detail {
+
+bool admit(folly::StringPiece service, folly::StringPiece category,
+           uint64_t& suppressed) {
+  suppressed = 0;
+  auto limit = maxPerSecond.load(std::memory_order_relaxed);
+  if (limit == 0) {
+    return true;
+  }
+
+  auto hash = getMemcacheKeyHashValue(service) * 31 +
+    getMemcacheKeyHashValue(category);
+  auto& slot = rateSlots[hash % kRateSlots];
+  uint64_t second = static_cast<uint32_t>(time(nullptr));
+  auto window = slot.window.load(std::memory_order_relaxed);
+  while (true) {
+    uint64_t next;
+    if ((window >> 32) != second) {
+      next = (second << 32) | 1;
+    } else if ((window & 0xffffffff) >= limit) {
+      slot.suppressed.fetch_add(1, std::memory_order_relaxed);
+      suppressedCount.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    } else {
+      next = window + 1;
+    }
+    if (slot.window.compare_exchange_weak(window, next,
+                                          std::memory_order_relaxed)) {
+      break;
+    }
+  }
+  suppressed = slot.suppressed.exchange(0, std::memory_order_relaxed);
+  return true;
+}
+
+void dispatch(folly::StringPiece service, folly::StringPiece category,
+              std::string msg, uint64_t suppressed) {
+  if (suppressed > 0) {
+    msg += folly::format(" ({} similar failures suppressed)",
+                         suppressed).str();
+  }
+  if (auto queue = currentQueue.load()) {
+    QueuedFailure failure;
+    failure.service = service.str();
+    failure.category = category.str();
+    failure.msg = std::move(msg);
+    failure.origin.time = time(nullptr);
+    failure.origin.threadName = getThreadName();
+    if (queue->write(std::move(failure))) {
+      loggedCount.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      droppedCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    return;
+  }
+
+  loggedCount.fetch_add(1, std::memory_order_relaxed);
+  if (auto container = containerSingleton.get_weak().lock()) {
+    runHandlers(*container, service, category, msg);
+  }
+}
+
+}  // detail
+
 void log(folly::StringPiece service,
          folly::StringPiece category,
          folly::StringPiece msg) {
-  std::map<std::string, std::string> contexts;
-  std::vector<std::pair<std::string, HandlerFunc>> handlers;
-  if (auto container = containerSingleton.get_weak().lock()) {
-    std::lock_guard<std::mutex> lock(container->lock);
-    contexts = container->contexts;
-    handlers = container->handlers;
-  }
-  for (auto& handler : handlers) {
-    handler.second(service, category, msg, contexts);
+  uint64_t suppressed;
+  if (detail::admit(service, category, suppressed)) {
+    detail::dispatch(service, category, msg.str(), suppressed);
   }
 }
 
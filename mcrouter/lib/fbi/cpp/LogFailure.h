@@ -9,6 +9,7 @@
  */
 #pragma once
 
+#include <cstdint>
 #include <functional>
 #include <map>
 #include <string>
@@ -106,6 +107,66 @@ bool setHandler(std::pair<std::string, HandlerFunc> handler);
  */
 void setServiceContext(folly::StringPiece service, std::string context);
 
+/**
+ * How failures are logged, see setOptions().
+ */
+struct Options {
+  /**
+   * Failures waiting to be handled by the logging thread, in a bounded
+   * lock-free queue; failures logged while it's full are dropped (and
+   * counted). 0 runs the handlers synchronously in log(), which handlers
+   * that throw (throwLogicError) need.
+   */
+  size_t queueSize{0};
+  /**
+   * Failures logged per second per service and category, 0 means no limit.
+   * The ones over it are counted, and the next one logged says how many
+   * were suppressed.
+   */
+  size_t maxPerSecond{0};
+};
+
+/**
+ * Meant for startup: a failure logged while the options change may be
+ * lost. Starts the logging thread if queueSize > 0 (so call it after
+ * fork()ing), the previous one handles what's queued and exits.
+ */
+void setOptions(Options opts);
+
+struct Stats {
+  /* Passed to handlers (or queued for them) */
+  uint64_t logged{0};
+  /* Over Options::maxPerSecond */
+  uint64_t suppressed{0};
+  /* The queue was full */
+  uint64_t dropped{0};
+};
+
+Stats getStats();
+
+/**
+ * Waits until the failures queued so far are handled.
+ */
+void flush();
+
+namespace detail {
+
+/**
+ * Applies Options::maxPerSecond.
+ *
+ * @param suppressed  set to the number of failures of this service and
+ *                    category suppressed since the last logged one.
+ * @return  false if the failure should be dropped.
+ */
+bool admit(folly::StringPiece service, folly::StringPiece category,
+           uint64_t& suppressed);
+
+/* Runs or queues the handlers of an admitted failure */
+void dispatch(folly::StringPiece service, folly::StringPiece category,
+              std::string msg, uint64_t suppressed);
+
+}  // detail
+
 /**
  * Log failure according to action for given category (see @setCategoryAction).
  * If no special action is provided, default constructed one will be used.
@@ -115,15 +176,21 @@ void log(folly::StringPiece service,
          folly::StringPiece msg);
 
 /**
- * log overload to format messages automatically.
+ * log overload to format messages automatically (unless the failure is
+ * suppressed).
  */
 template <typename... Args>
 void log(folly::StringPiece service,
          folly::StringPiece category,
          folly::StringPiece msgFormat,
          Args&&... args) {
-  log(service, category,
-      folly::format(msgFormat, std::forward<Args>(args)...).str());
+  uint64_t suppressed;
+  if (!detail::admit(service, category, suppressed)) {
+    return;
+  }
+  detail::dispatch(
+    service, category,
+    folly::format(msgFormat, std::forward<Args>(args)...).str(), suppressed);
 }
 
 }}}  // facebook::memcache::failure
@@ -9,16 +9,20 @@
  */
 #pragma once
 
+#include <atomic>
 #include <cassert>
+#include <cstdint>
 #include <exception>
 #include <limits>
 #include <memory>
 #include <mutex>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 #include <boost/noncopyable.hpp>
 
+#include <folly/ThreadLocal.h>
 #include <glog/logging.h>
 
 namespace facebook { namespace memcache {
@@ -55,16 +59,7 @@ class ObjectPool : boost::noncopyable {
   ///                       allocating the object
   template<typename... Args>
   T* alloc(Args&&... args) {
-
-    // First check the free list
-    auto* obj = getFromFreeList();
-    if (obj == nullptr) {
-      obj = std::allocator_traits<Allocator>::allocate(allocator_, 1);
-    }
-
-    if (obj == nullptr) {
-      throw std::bad_alloc();
-    }
+    auto* obj = allocate();
 
     try {
       std::allocator_traits<Allocator>::construct(
@@ -100,6 +95,42 @@ class ObjectPool : boost::noncopyable {
     addToFreeList(obj);
   }
 
+  /// Get uninitialized storage for one object, from the free list if
+  /// possible. The caller is responsible for constructing the object.
+  ///
+  /// @throws               std::bad_alloc
+  T* allocate() {
+    // First check the free list
+    auto* obj = getFromFreeList();
+    if (obj == nullptr) {
+      obj = std::allocator_traits<Allocator>::allocate(allocator_, 1);
+      ++numAllocations_;
+    } else {
+      ++numReuses_;
+    }
+
+    if (obj == nullptr) {
+      throw std::bad_alloc();
+    }
+    return obj;
+  }
+
+  /// Return storage obtained from allocate(). The object must already
+  /// be destroyed. If obj == nullptr it's a NOOP.
+  void deallocate(T* obj) noexcept {
+    addToFreeList(obj);
+  }
+
+  /// Number of times storage had to be obtained from the Allocator
+  size_t numAllocations() const noexcept {
+    return numAllocations_;
+  }
+
+  /// Number of times storage was served from the free list
+  size_t numReuses() const noexcept {
+    return numReuses_;
+  }
+
   ~ObjectPool() {
     for (auto* p : freeList_) {
       std::allocator_traits<Allocator>::deallocate(allocator_, p, 1);
@@ -155,6 +186,9 @@ class ObjectPool : boost::noncopyable {
 
   const size_t maxCapacity_;            // Maximum number of objects that can be
                                         // stored within the pool
+
+  size_t numAllocations_{0};            // Allocations done by allocator_
+  size_t numReuses_{0};                 // Allocations served by freeList_
 };
 
 /// ThreadSafeObjectPool, as the name suggests, is a thread safe version of
@@ -202,4 +236,246 @@ class ThreadSafeObjectPool {
   std::mutex mtx;                       // Mutex for mutual exclusion
 };
 
+/// ThreadLocalObjectPool keeps a pool of storage for T per thread.
+/// It is meant to back class specific operator new/delete (or
+/// ObjectPoolAllocator) for objects that are created and destroyed at
+/// a high rate, e.g. per request state on proxy threads.
+///
+/// Storage freed on a thread other than the one it was allocated on goes
+/// back to the allocating thread, through a lock free list that thread
+/// takes from once its own free list runs out: objects created by client
+/// threads and destroyed by proxy threads get reused by the client threads.
+/// Each thread caches at most kMaxFreeObjects objects.
+template<typename T>
+class ThreadLocalObjectPool {
+ public:
+  static constexpr size_t kMaxFreeObjects = 4096;
+
+  static T* allocate() {
+    return pools()->allocate();
+  }
+
+  static void deallocate(T* obj) noexcept {
+    if (obj == nullptr) {
+      return;
+    }
+    auto slot = reinterpret_cast<Slot*>(obj);
+    auto& pool = *pools();
+    if (slot->owner == pool.owner()) {
+      pool.deallocate(slot);
+    } else {
+      deallocateRemote(slot);
+    }
+  }
+
+  /// Allocation counters summed over all live threads.
+  /// The values are approximate, since pools are updated concurrently.
+  static std::pair<size_t, size_t> numAllocationsAndReuses() {
+    std::pair<size_t, size_t> result{0, 0};
+    for (const auto& pool : pools().accessAllThreads()) {
+      result.first += pool.owner()->numAllocations.load(
+        std::memory_order_relaxed);
+      result.second += pool.owner()->numReuses.load(
+        std::memory_order_relaxed);
+    }
+    return result;
+  }
+
+ private:
+  struct Tag {};
+  struct Owner;
+
+  struct Slot {
+    /* First, so that T* and Slot* convert to each other */
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    Owner* owner;
+    /* In Owner::remoteFree */
+    Slot* next;
+  };
+
+  /* Shared by a thread's Pool and the threads freeing its storage. */
+  struct Owner {
+    /* Storage freed by other threads, pushed there, taken all at once */
+    std::atomic<Slot*> remoteFree{nullptr};
+    /*
+     * kBias minus the slots freed by other threads while the thread is
+     * running. Once it's gone, the slots still out: the last one freed
+     * deletes the Owner.
+     */
+    std::atomic<uint64_t> remaining{kBias};
+    /* Written by the thread only, read by numAllocationsAndReuses() */
+    std::atomic<size_t> numAllocations{0};
+    std::atomic<size_t> numReuses{0};
+  };
+
+  static constexpr uint64_t kBias = uint64_t(1) << 62;
+
+  class Pool {
+   public:
+    Pool() : owner_(new Owner) {}
+
+    ~Pool() {
+      freeChain(takeRemote());
+      for (auto slot : freeList_) {
+        freeSlot(slot);
+      }
+      /* Slots still out are freed remotely from now on */
+      auto bias = kBias - live_;
+      if (owner_->remaining.fetch_sub(bias, std::memory_order_acq_rel) ==
+          bias) {
+        freeChain(takeRemote());
+        delete owner_;
+      }
+    }
+
+    Owner* owner() const {
+      return owner_;
+    }
+
+    T* allocate() {
+      if (freeList_.empty()) {
+        takeRemoteIntoFreeList();
+      }
+      Slot* slot;
+      if (!freeList_.empty()) {
+        slot = freeList_.back();
+        freeList_.pop_back();
+        increment(owner_->numReuses);
+      } else {
+        slot = std::allocator<Slot>().allocate(1);
+        slot->owner = owner_;
+        increment(owner_->numAllocations);
+      }
+      ++live_;
+      return reinterpret_cast<T*>(&slot->storage);
+    }
+
+    void deallocate(Slot* slot) noexcept {
+      --live_;
+      addToFreeList(slot);
+    }
+
+   private:
+    Owner* owner_;
+    std::vector<Slot*> freeList_;
+    /* Slots allocated minus those freed on this thread: modulo 2^64, it's
+       what remaining has to drop by for the slots still out */
+    uint64_t live_{0};
+
+    Slot* takeRemote() noexcept {
+      if (owner_->remoteFree.load(std::memory_order_relaxed) == nullptr) {
+        return nullptr;
+      }
+      return owner_->remoteFree.exchange(nullptr, std::memory_order_acquire);
+    }
+
+    void takeRemoteIntoFreeList() noexcept {
+      auto slot = takeRemote();
+      while (slot != nullptr) {
+        auto next = slot->next;
+        addToFreeList(slot);
+        slot = next;
+      }
+    }
+
+    void addToFreeList(Slot* slot) noexcept {
+      if (freeList_.size() < kMaxFreeObjects) {
+        try {
+          freeList_.push_back(slot);
+          return;
+        } catch (...) {
+          LOG(ERROR) << "Failed while adding to free list";
+        }
+      }
+      freeSlot(slot);
+    }
+
+    static void increment(std::atomic<size_t>& counter) noexcept {
+      counter.store(counter.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_relaxed);
+    }
+  };
+
+  static void deallocateRemote(Slot* slot) noexcept {
+    auto owner = slot->owner;
+    auto head = owner->remoteFree.load(std::memory_order_relaxed);
+    do {
+      slot->next = head;
+    } while (!owner->remoteFree.compare_exchange_weak(
+               head, slot, std::memory_order_release,
+               std::memory_order_relaxed));
+    /* Its thread is gone, and this was the last slot out */
+    if (owner->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      freeChain(owner->remoteFree.exchange(nullptr,
+                                           std::memory_order_acquire));
+      delete owner;
+    }
+  }
+
+  static void freeSlot(Slot* slot) noexcept {
+    std::allocator<Slot>().deallocate(slot, 1);
+  }
+
+  static void freeChain(Slot* slot) noexcept {
+    while (slot != nullptr) {
+      auto next = slot->next;
+      freeSlot(slot);
+      slot = next;
+    }
+  }
+
+  static folly::ThreadLocal<Pool, Tag>& pools() {
+    static folly::ThreadLocal<Pool, Tag> pools_;
+    return pools_;
+  }
+};
+
+template<typename T>
+constexpr size_t ThreadLocalObjectPool<T>::kMaxFreeObjects;
+
+template<typename T>
+constexpr uint64_t ThreadLocalObjectPool<T>::kBias;
+
+/// Standard allocator that takes single objects from ThreadLocalObjectPool.
+/// Useful for node based containers and shared_ptr control blocks.
+template<typename T>
+struct ObjectPoolAllocator {
+  typedef T value_type;
+
+  ObjectPoolAllocator() = default;
+
+  template<typename U>
+  /* implicit */ ObjectPoolAllocator(const ObjectPoolAllocator<U>&) noexcept {}
+
+  T* allocate(size_t n) {
+    if (n == 1) {
+      return ThreadLocalObjectPool<T>::allocate();
+    }
+    return std::allocator<T>().allocate(n);
+  }
+
+  void deallocate(T* p, size_t n) noexcept {
+    if (n == 1) {
+      ThreadLocalObjectPool<T>::deallocate(p);
+    } else {
+      std::allocator<T>().deallocate(p, n);
+    }
+  }
+
+  template<typename U>
+  struct rebind {
+    typedef ObjectPoolAllocator<U> other;
+  };
+
+  template<typename U>
+  bool operator==(const ObjectPoolAllocator<U>&) const noexcept {
+    return true;
+  }
+
+  template<typename U>
+  bool operator!=(const ObjectPoolAllocator<U>&) const noexcept {
+    return false;
+  }
+};
+
 }}
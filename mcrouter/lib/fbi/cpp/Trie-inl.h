@@ -199,6 +199,20 @@ void Trie<Value, MinChar, MaxChar>::clear() {
   }
 }
 
+template<class Value, char MinChar, char MaxChar>
+size_t Trie<Value, MinChar, MaxChar>::memoryUsage() const {
+  size_t bytes = sizeof(*this);
+  if (value_) {
+    bytes += value_->first.capacity();
+  }
+  for (const auto& edge : next_) {
+    if (edge) {
+      bytes += edge->memoryUsage();
+    }
+  }
+  return bytes;
+}
+
 /* iterator_base */
 
 template <class Value, char MinChar, char MaxChar>
@@ -107,6 +107,12 @@ class Trie {
 
   void clear();
 
+  /**
+   * @return  bytes of the nodes of this trie and of the keys stored in it,
+   *          not including heap memory owned by values
+   */
+  size_t memoryUsage() const;
+
  private:
   // total number of characters in one node
   static size_t const kNumChars = (size_t)(MaxChar - MinChar) + 1;
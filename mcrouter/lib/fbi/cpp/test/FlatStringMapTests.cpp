@@ -0,0 +1,84 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <map>
+#include <string>
+#include <unordered_map>
+
+#include <gtest/gtest.h>
+
+#include <folly/experimental/StringKeyedUnorderedMap.h>
+
+#include "mcrouter/lib/fbi/cpp/FlatStringMap.h"
+#include "mcrouter/lib/fbi/cpp/util.h"
+
+using facebook::memcache::FlatStringMap;
+
+TEST(FlatStringMap, Empty) {
+  FlatStringMap<int> map;
+  EXPECT_TRUE(map.find("") == map.end());
+  EXPECT_TRUE(map.find("abc") == map.end());
+  EXPECT_TRUE(map.begin() == map.end());
+  EXPECT_TRUE(map.empty());
+
+  FlatStringMap<int> fromEmpty(std::map<std::string, int>{});
+  EXPECT_TRUE(fromEmpty.find("abc") == fromEmpty.end());
+}
+
+TEST(FlatStringMap, SanityTest) {
+  std::map<std::string, int> items = {
+    {"hello", 1},
+    {"world", 2},
+    {"", 3},
+    {"hell", 4},
+  };
+  FlatStringMap<int> map(items);
+  EXPECT_EQ(items.size(), map.size());
+  for (const auto& it : items) {
+    auto found = map.find(it.first);
+    ASSERT_TRUE(found != map.end());
+    EXPECT_EQ(it.first, found->first);
+    EXPECT_EQ(it.second, found->second);
+  }
+  EXPECT_TRUE(map.find("hel") == map.end());
+  EXPECT_TRUE(map.find("hello!") == map.end());
+  EXPECT_EQ(1, map.count("world"));
+  EXPECT_EQ(0, map.count("word"));
+
+  map.find("hello")->second = 10;
+  EXPECT_EQ(10, map.find("hello")->second);
+}
+
+TEST(FlatStringMap, StringKeyedUnorderedMap) {
+  folly::StringKeyedUnorderedMap<int> items;
+  items.emplace("a", 1);
+  items.emplace("b", 2);
+  FlatStringMap<int> map(items);
+  EXPECT_EQ(1, map.find("a")->second);
+  EXPECT_EQ(2, map.find("b")->second);
+}
+
+TEST(FlatStringMap, RandomKeys) {
+  std::unordered_map<std::string, int> items;
+  srand(1234);
+  for (int i = 0; i < 10000; ++i) {
+    items.emplace(facebook::memcache::randomString(1, 20), i);
+  }
+  FlatStringMap<int> map(items);
+  EXPECT_EQ(items.size(), map.size());
+  for (const auto& it : items) {
+    auto found = map.find(it.first);
+    ASSERT_TRUE(found != map.end());
+    EXPECT_EQ(it.second, found->second);
+  }
+  /* Longer than any key */
+  EXPECT_TRUE(map.find(std::string(21, 'a')) == map.end());
+  EXPECT_LE(sizeof(map) + items.size() * sizeof(FlatStringMap<int>::value_type),
+            map.memoryUsage());
+}
@@ -0,0 +1,97 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "mcrouter/lib/fbi/cpp/LocalRefPtr.h"
+
+#include <utility>
+
+#include <gtest/gtest.h>
+
+using namespace facebook::memcache;
+
+namespace {
+
+class Counted : public LocalRefCounted<Counted> {
+ public:
+  explicit Counted(int& released) : released_(released) {}
+
+  void onLastRef() {
+    ++released_;
+    delete this;
+  }
+
+ private:
+  int& released_;
+};
+
+}  // anonymous namespace
+
+TEST(LocalRefPtr, null) {
+  LocalRefPtr<Counted> a;
+  LocalRefPtr<Counted> b = nullptr;
+  EXPECT_FALSE(a);
+  EXPECT_TRUE(a == nullptr);
+  EXPECT_TRUE(a == b);
+  b.reset();
+  EXPECT_EQ(nullptr, b.get());
+}
+
+TEST(LocalRefPtr, releasedWithLastRef) {
+  int released = 0;
+  {
+    LocalRefPtr<Counted> a(new Counted(released));
+    EXPECT_TRUE(a);
+    {
+      auto b = a;
+      EXPECT_TRUE(a == b);
+      LocalRefPtr<Counted> c;
+      c = b;
+      EXPECT_EQ(a.get(), c.get());
+    }
+    EXPECT_EQ(0, released);
+  }
+  EXPECT_EQ(1, released);
+}
+
+TEST(LocalRefPtr, move) {
+  int released = 0;
+  LocalRefPtr<Counted> a(new Counted(released));
+  auto raw = a.get();
+
+  LocalRefPtr<Counted> b(std::move(a));
+  EXPECT_FALSE(a);
+  EXPECT_EQ(raw, b.get());
+
+  a = std::move(b);
+  EXPECT_FALSE(b);
+  EXPECT_EQ(raw, a.get());
+  EXPECT_EQ(0, released);
+
+  a.reset();
+  EXPECT_EQ(1, released);
+}
+
+TEST(LocalRefPtr, reassignReleasesOld) {
+  int releasedA = 0;
+  int releasedB = 0;
+  LocalRefPtr<Counted> a(new Counted(releasedA));
+  LocalRefPtr<Counted> b(new Counted(releasedB));
+
+  a = b;
+  EXPECT_EQ(1, releasedA);
+  EXPECT_EQ(0, releasedB);
+
+  /* Self assignment keeps the object alive */
+  a = a;
+  EXPECT_EQ(0, releasedB);
+
+  a.reset();
+  b.reset();
+  EXPECT_EQ(1, releasedB);
+}
@@ -9,6 +9,8 @@
  */
 #include "mcrouter/lib/fbi/cpp/ObjectPool.h"
 
+#include <thread>
+
 #include <gtest/gtest.h>
 
 using namespace facebook::memcache;
@@ -126,3 +128,75 @@ TEST(ObjectPool, ThrowingType) {
   EXPECT_EQ(TestAllocator<TestTypeThrowing>::nAllocations, 1);
   EXPECT_EQ(TestAllocator<TestTypeThrowing>::nDeAllocations, 0);
 }
+
+TEST(ObjectPool, Counters) {
+  ObjectPool<TestType> pool(1);
+
+  auto* vala = pool.alloc();
+  auto* valb = pool.alloc();
+  EXPECT_EQ(2, pool.numAllocations());
+  EXPECT_EQ(0, pool.numReuses());
+
+  pool.free(vala);
+  pool.free(valb);
+  vala = pool.alloc();
+  EXPECT_EQ(2, pool.numAllocations());
+  EXPECT_EQ(1, pool.numReuses());
+
+  auto* raw = pool.allocate();
+  EXPECT_EQ(3, pool.numAllocations());
+  pool.deallocate(raw);
+  pool.free(vala);
+}
+
+TEST(ObjectPool, ThreadLocal) {
+  struct Obj {
+    char data[64];
+  };
+  using Pool = ThreadLocalObjectPool<Obj>;
+
+  auto before = Pool::numAllocationsAndReuses();
+  auto* a = Pool::allocate();
+  Pool::deallocate(a);
+  auto* b = Pool::allocate();
+  EXPECT_EQ(a, b);
+  Pool::deallocate(b);
+
+  std::thread([before] {
+    // Every thread has its own free list.
+    auto* c = Pool::allocate();
+    EXPECT_EQ(before.first + 2, Pool::numAllocationsAndReuses().first);
+    Pool::deallocate(c);
+  }).join();
+
+  auto after = Pool::numAllocationsAndReuses();
+  EXPECT_EQ(before.first + 1, after.first);
+  EXPECT_EQ(before.second + 1, after.second);
+}
+
+TEST(ObjectPool, ThreadLocalFreedElsewhere) {
+  struct Obj {
+    char data[64];
+  };
+  using Pool = ThreadLocalObjectPool<Obj>;
+
+  /* Freed on another thread, comes back to this one */
+  auto* a = Pool::allocate();
+  std::thread([a] {
+    Pool::deallocate(a);
+  }).join();
+  auto before = Pool::numAllocationsAndReuses();
+  auto* b = Pool::allocate();
+  EXPECT_EQ(a, b);
+  auto after = Pool::numAllocationsAndReuses();
+  EXPECT_EQ(before.first, after.first);
+  EXPECT_EQ(before.second + 1, after.second);
+
+  /* Freed after the thread that allocated it is gone */
+  Obj* c = nullptr;
+  std::thread([&c] {
+    c = Pool::allocate();
+  }).join();
+  Pool::deallocate(c);
+  Pool::deallocate(b);
+}
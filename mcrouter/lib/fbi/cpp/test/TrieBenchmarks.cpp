@@ -9,12 +9,16 @@
  */
 #include <iostream>
 #include <string>
+#include <vector>
 
 #include <gtest/gtest.h>
 
 #include "folly/Benchmark.h"
+#include "mcrouter/lib/fbi/cpp/FlatTrie.h"
 #include "mcrouter/lib/fbi/cpp/Trie.h"
+#include "mcrouter/lib/fbi/cpp/util.h"
 
+using facebook::memcache::FlatTrie;
 using facebook::memcache::Trie;
 
 static int const kNumGetKeys = 7;
@@ -28,8 +32,16 @@ static std::string keysToGet[kNumGetKeys] = {
   "abd",
 };
 static Trie<long> randTrie;
+static FlatTrie<long> randFlatTrie;
 static long x = 0;
 
+/* Config-like prefix set: "<service>:<table>:" for 10k+ keys */
+static int const kNumPrefixes = 16384;
+static int const kNumPrefixKeys = 1024;
+static Trie<long> prefixTrie;
+static FlatTrie<long> prefixFlatTrie;
+static std::vector<std::string> prefixKeys;
+
 static void prepareRand() {
   static std::string keys[] = {
     "abacaba",
@@ -42,6 +54,32 @@ static void prepareRand() {
   for (long i = 0; i < numKeys; ++i) {
     randTrie.emplace(keys[i], i + 1);
   }
+  randFlatTrie = FlatTrie<long>(randTrie);
+}
+
+static void preparePrefixes() {
+  srand(4321);
+  std::vector<std::string> services;
+  for (int i = 0; i < 64; ++i) {
+    services.push_back(facebook::memcache::randomString(4, 12) + ":");
+  }
+  std::vector<std::string> prefixes;
+  for (long i = 0; i < kNumPrefixes; ++i) {
+    prefixes.push_back(services[rand() % services.size()] +
+                       facebook::memcache::randomString(3, 16) + ":");
+    prefixTrie.emplace(prefixes.back(), i + 1);
+  }
+  prefixFlatTrie = FlatTrie<long>(prefixTrie);
+
+  for (int i = 0; i < kNumPrefixKeys; ++i) {
+    if (i % 4 == 0) {
+      // miss
+      prefixKeys.push_back(facebook::memcache::randomString(20, 40));
+    } else {
+      prefixKeys.push_back(prefixes[rand() % prefixes.size()] +
+                           facebook::memcache::randomString(10, 30));
+    }
+  }
 }
 
 BENCHMARK(Trie_get) {
@@ -51,6 +89,13 @@ BENCHMARK(Trie_get) {
   }
 }
 
+BENCHMARK_RELATIVE(FlatTrie_get) {
+  for (int i = 0; i < kNumGetKeys; ++i) {
+    auto r = randFlatTrie.find(keysToGet[i]);
+    x += r == randFlatTrie.end() ? 0 : r->second;
+  }
+}
+
 BENCHMARK(Trie_get_prefix) {
   for (int i = 0; i < kNumGetKeys; ++i) {
     auto r = randTrie.findPrefix(keysToGet[i]);
@@ -58,10 +103,36 @@ BENCHMARK(Trie_get_prefix) {
   }
 }
 
+BENCHMARK_RELATIVE(FlatTrie_get_prefix) {
+  for (int i = 0; i < kNumGetKeys; ++i) {
+    auto r = randFlatTrie.findPrefix(keysToGet[i]);
+    x += r == randFlatTrie.end() ? 0 : r->second;
+  }
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(Trie_16k_prefixes, iters) {
+  for (size_t it = 0; it < iters; ++it) {
+    auto& key = prefixKeys[it % kNumPrefixKeys];
+    auto r = prefixTrie.findPrefix(key);
+    x += r == prefixTrie.end() ? 0 : 1;
+  }
+}
+
+BENCHMARK_RELATIVE(FlatTrie_16k_prefixes, iters) {
+  for (size_t it = 0; it < iters; ++it) {
+    auto& key = prefixKeys[it % kNumPrefixKeys];
+    auto r = prefixFlatTrie.findPrefix(key);
+    x += r == prefixFlatTrie.end() ? 0 : 1;
+  }
+}
+
 int main(int argc, char **argv){
   prepareRand();
+  preparePrefixes();
   google::ParseCommandLineFlags(&argc, &argv, true);
   folly::runBenchmarksOnFlag();
-  std::cout << "check (should be num of iters*12): " << x << std::endl;
+  std::cout << "check: " << x << std::endl;
   return 0;
 }
@@ -15,9 +15,11 @@
 
 #include <gtest/gtest.h>
 
+#include "mcrouter/lib/fbi/cpp/FlatTrie.h"
 #include "mcrouter/lib/fbi/cpp/Trie.h"
 #include "mcrouter/lib/fbi/cpp/util.h"
 
+using facebook::memcache::FlatTrie;
 using facebook::memcache::Trie;
 using facebook::memcache::to;
 
@@ -310,6 +312,102 @@ TEST(Trie, Const) {
   EXPECT_TRUE(trie.cbegin()->second == 1);
 }
 
+TEST(Trie, MemoryUsage) {
+  Trie<int> t;
+  auto empty = t.memoryUsage();
+  EXPECT_EQ(sizeof(t), empty);
+  t.emplace("ab", 1);
+  /* One node per character */
+  EXPECT_LE(3 * empty, t.memoryUsage());
+  auto two = t.memoryUsage();
+  t.emplace("a", 2);
+  EXPECT_LE(two, t.memoryUsage());
+  t.clear();
+  EXPECT_EQ(empty, t.memoryUsage());
+}
+
+TEST(FlatTrie, MemoryUsage) {
+  std::map<std::string, int> map = {{"ab", 1}, {"b", 2}};
+  FlatTrie<int> empty;
+  FlatTrie<int> trie(map);
+  EXPECT_LT(empty.memoryUsage(), trie.memoryUsage());
+  EXPECT_LE(sizeof(trie) + map.size() * sizeof(FlatTrie<int>::value_type),
+            trie.memoryUsage());
+}
+
+TEST(FlatTrie, Empty) {
+  FlatTrie<int> trie;
+  EXPECT_TRUE(trie.find("") == trie.end());
+  EXPECT_TRUE(trie.findPrefix("abc") == trie.end());
+  EXPECT_TRUE(trie.begin() == trie.end());
+}
+
+TEST(FlatTrie, SanityTest) {
+  std::map<std::string, int> map = {
+    {"hello", 1},
+    {"world", 2},
+    {"!helloo~", 3},
+    {"", 4},
+    {"hell", 5},
+    {"with space\t", 6},
+  };
+  FlatTrie<int> trie(map);
+  EXPECT_EQ(map.size(), trie.size());
+
+  for (auto& it : map) {
+    EXPECT_EQ(it.second, trie.find(it.first)->second);
+    EXPECT_EQ(it.first, trie.find(it.first)->first);
+  }
+  EXPECT_TRUE(trie.find("hel") == trie.end());
+  EXPECT_TRUE(trie.find("helloo") == trie.end());
+  EXPECT_TRUE(trie.find("worlds") == trie.end());
+
+  EXPECT_EQ(5, trie.findPrefix("hellx")->second);
+  EXPECT_EQ(1, trie.findPrefix("hello, world")->second);
+  EXPECT_EQ(4, trie.findPrefix("hel")->second);
+  EXPECT_EQ(4, trie.findPrefix("")->second);
+
+  auto itMap = map.begin();
+  for (auto& it : trie) {
+    EXPECT_TRUE(*itMap == it);
+    ++itMap;
+  }
+}
+
+TEST(FlatTrie, WideNodes) {
+  // every character as a child of one node, and of the root
+  std::map<std::string, int> map;
+  for (int c = 1; c < 256; ++c) {
+    map.emplace(std::string(1, (char)c), c);
+    map.emplace(std::string("x") + (char)c, c + 1000);
+  }
+  FlatTrie<int> trie(map);
+  for (auto& it : map) {
+    ASSERT_EQ(it.second, trie.find(it.first)->second);
+  }
+  EXPECT_EQ((int)'x' + 1000, trie.findPrefix("xx!")->second);
+  EXPECT_EQ((int)'y', trie.findPrefix("yy")->second);
+}
+
+TEST(FlatTrie, RandTest) {
+  FlatTrie<int> trie(randTrie);
+  for (long i = 0; i < kNumRandKeys; ++i) {
+    auto it = trie.find(keys[i]);
+    ASSERT_TRUE(it != trie.end());
+    EXPECT_EQ(randTrie.find(keys[i])->second, it->second);
+
+    auto prefix = keys[i].substr(0, keys[i].size() / 2);
+    auto expected = randTrie.findPrefix(prefix);
+    auto got = trie.findPrefix(prefix);
+    if (expected == randTrie.end()) {
+      EXPECT_TRUE(got == trie.end());
+    } else {
+      ASSERT_TRUE(got != trie.end());
+      EXPECT_EQ(expected->second, got->second);
+    }
+  }
+}
+
 int main(int argc, char **argv){
   prepareRand();
   testing::InitGoogleTest(&argc, argv);
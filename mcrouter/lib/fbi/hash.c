@@ -8,6 +8,7 @@
  *
  */
 #include <assert.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <signal.h>
 #include <sys/time.h>
@@ -17,6 +18,13 @@
 
 #include "hash.h"
 
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__GNUC__) && defined(__aarch64__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#endif
+
 /**
  * FurcHash -- a consistent hash function using a binary decision tree.
  * Based on an algorithm by Mark Rabkin with two changes:
@@ -49,6 +57,13 @@
 /* Size of cache for hash values; should be > MAXTRIES * (FURCSHIFT + 1) */
 #define FURC_CACHE_SIZE 1024
 
+/* Number of keys hashed in parallel by furc_hash_array() */
+#define FURC_LANES 4
+
+/* Cache entries needed by the first try for the largest pool */
+#define FURC_FIRST_TRY_SIZE \
+    (((FURC_SHIFT + (FURC_SHIFT - 1) * FURC_SHIFT) >> 6) + 1)
+
 /**
  * MurmurHash2, 64-bit versions, by Austin Appleby
  *
@@ -148,25 +163,31 @@ static uint32_t furc_get_bit(const char* const key, const size_t len,
     return (hash[ord] >> (idx&0x3f)) & 0x1;
 }
 
-uint32_t furc_hash(const char* const key, const size_t len, const uint32_t m) {
+/* Number of cache entries read by the first try for a pool of 2^d */
+static int32_t furc_first_try_ord(const uint32_t d) {
+    return (d + (d - 1) * FURC_SHIFT) >> 6;
+}
+
+static uint32_t furc_depth(const uint32_t m) {
+    uint32_t d;
+    for (d = 0; m > (1ul << d); d++)
+        ;
+    return d;
+}
+
+/**
+ * furc_hash() with hash[0..old_ord] already filled in by the caller.
+ */
+static uint32_t furc_hash_cached(const char* const key, const size_t len,
+                                 const uint32_t m, uint64_t* hash,
+                                 int32_t old_ord) {
     uint32_t try;
     uint32_t d;
     uint32_t num;
     uint32_t i;
     uint32_t a;
-    uint64_t hash[FURC_CACHE_SIZE];
-    int32_t old_ord;
-
-    assert(m <= furc_maximum_pool_size());
-
-    if (m <= 1) {
-        return 0;
-    }
-
-    furc_get_bit(NULL, 0, 0, hash, &old_ord);
-    for (d = 0; m > (1ul << d); d++)
-        ;
 
+    d = furc_depth(m);
     a = d;
     for (try = 0; try < MAX_TRIES; try++) {
         while (!furc_get_bit(key, len, a, hash, &old_ord)) {
@@ -190,6 +211,70 @@ uint32_t furc_hash(const char* const key, const size_t len, const uint32_t m) {
     return 0;
 }
 
+uint32_t furc_hash(const char* const key, const size_t len, const uint32_t m) {
+    uint64_t hash[FURC_CACHE_SIZE];
+
+    assert(m <= furc_maximum_pool_size());
+
+    if (m <= 1) {
+        return 0;
+    }
+
+    return furc_hash_cached(key, len, m, hash, -1);
+}
+
+void furc_hash_array(const char* const* keys, const size_t* lens,
+                     const size_t num_keys, const uint32_t m,
+                     uint32_t* results) {
+    uint64_t hash[FURC_CACHE_SIZE];
+    uint64_t lanes[FURC_LANES][FURC_FIRST_TRY_SIZE];
+    size_t base;
+    size_t num_lanes;
+    size_t l;
+    int32_t ord;
+    int32_t n;
+
+    assert(m <= furc_maximum_pool_size());
+
+    if (m <= 1) {
+        for (base = 0; base < num_keys; base++) {
+            results[base] = 0;
+        }
+        return;
+    }
+
+    ord = furc_first_try_ord(furc_depth(m));
+    if (ord == 0) {
+        /* Small pools: one round per key, nothing to interleave */
+        for (base = 0; base < num_keys; base++) {
+            results[base] = furc_hash_cached(keys[base], lens[base], m, hash,
+                                             -1);
+        }
+        return;
+    }
+
+    for (base = 0; base < num_keys; base += FURC_LANES) {
+        num_lanes = num_keys - base < FURC_LANES ? num_keys - base : FURC_LANES;
+
+        for (l = 0; l < num_lanes; l++) {
+            lanes[l][0] = murmur_hash_64A(keys[base + l], lens[base + l], SEED);
+        }
+        /* Rehash rounds of all lanes are independent of each other, so
+           they can be computed in parallel (by the CPU or vectorized). */
+        for (n = 1; n <= ord; n++) {
+            for (l = 0; l < num_lanes; l++) {
+                lanes[l][n] = murmur_rehash_64A(lanes[l][n - 1]);
+            }
+        }
+
+        for (l = 0; l < num_lanes; l++) {
+            memcpy(hash, lanes[l], (ord + 1) * sizeof(uint64_t));
+            results[base + l] = furc_hash_cached(keys[base + l], lens[base + l],
+                                                 m, hash, ord);
+        }
+    }
+}
+
 inline uint32_t furc_maximum_pool_size(void) {
     return (1 << FURC_SHIFT);
 }
@@ -273,13 +358,219 @@ static const unsigned int crc32tab[256] = {
     0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d,
 };
 
+/* crc32tab extended for slicing-by-8: crc32tabs[k][i] is the crc of byte i
+   followed by k zero bytes. Filled once, on the first call. */
+static uint32_t crc32tabs[8][256];
+static pthread_once_t crc32tabs_once = PTHREAD_ONCE_INIT;
+
+/* CRC instructions detected at runtime. Both compute the same CRC-32
+   (polynomial 0xedb88320) as crc32tab; SSE4.2's crc32 instruction is
+   CRC32C and can't be used here. */
+#if defined(__GNUC__) && defined(__x86_64__)
+#define CRC32_PCLMUL 1
+#elif defined(__GNUC__) && defined(__aarch64__)
+#define CRC32_ARMV8 1
+#endif
+#ifdef CRC32_PCLMUL
+static int crc32_has_pclmul = 0;
+#endif
+#ifdef CRC32_ARMV8
+static int crc32_has_armv8 = 0;
+#endif
+
+static void crc32tabs_init(void) {
+  int i, k;
+  for (i = 0; i < 256; i++) {
+    crc32tabs[0][i] = crc32tab[i];
+  }
+  for (k = 1; k < 8; k++) {
+    for (i = 0; i < 256; i++) {
+      uint32_t prev = crc32tabs[k - 1][i];
+      crc32tabs[k][i] = (prev >> 8) ^ crc32tab[prev & 0xff];
+    }
+  }
+#ifdef CRC32_PCLMUL
+  __builtin_cpu_init();
+  crc32_has_pclmul = __builtin_cpu_supports("pclmul") &&
+                     __builtin_cpu_supports("sse4.1");
+#endif
+#ifdef CRC32_ARMV8
+  crc32_has_armv8 = (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#endif
+}
+
+#ifdef CRC32_PCLMUL
+/* Minimum length for crc32_pclmul(); shorter keys (most of them) are not
+   worth the setup cost. */
+#define CRC32_PCLMUL_MIN_LEN 64
+
+/**
+ * Folds 64 bytes per step with carry-less multiplication, then reduces
+ * to 32 bits (Barrett). See "Fast CRC Computation for Generic Polynomials
+ * Using PCLMULQDQ Instruction", Intel, 2009; constants are for the
+ * bit-reflected CRC-32 polynomial.
+ *
+ * @param len  at least CRC32_PCLMUL_MIN_LEN, multiple of 16.
+ * @param crc  crc register (not inverted).
+ */
+__attribute__((target("sse4.1,pclmul")))
+static uint32_t crc32_pclmul(const char* buf, size_t len, uint32_t crc) {
+  static const uint64_t __attribute__((aligned(16))) k1k2[] =
+    { 0x0154442bd4, 0x01c6e41596 };
+  static const uint64_t __attribute__((aligned(16))) k3k4[] =
+    { 0x01751997d0, 0x00ccaa009e };
+  static const uint64_t __attribute__((aligned(16))) k5k0[] =
+    { 0x0163cd6124, 0x0000000000 };
+  static const uint64_t __attribute__((aligned(16))) poly[] =
+    { 0x01db710641, 0x01f7011641 };
+
+  __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+  x1 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+  x2 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+  x3 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+  x4 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+
+  x0 = _mm_load_si128((const __m128i*)k1k2);
+
+  buf += 64;
+  len -= 64;
+
+  /* Fold 4 x 128 bits in parallel */
+  while (len >= 64) {
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+    x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+    y5 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+    y6 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+    y7 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+    y8 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+    buf += 64;
+    len -= 64;
+  }
+
+  /* Fold into 128 bits */
+  x0 = _mm_load_si128((const __m128i*)k3k4);
+
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+  /* Single folds of the remaining 16 byte blocks */
+  while (len >= 16) {
+    x2 = _mm_loadu_si128((const __m128i*)buf);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    buf += 16;
+    len -= 16;
+  }
+
+  /* Fold 128 bits to 64 bits */
+  x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+  x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+  x1 = _mm_srli_si128(x1, 8);
+  x1 = _mm_xor_si128(x1, x2);
+
+  x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, x3);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  /* Barrett reduction to 32 bits */
+  x0 = _mm_load_si128((const __m128i*)poly);
+
+  x2 = _mm_and_si128(x1, x3);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+  x2 = _mm_and_si128(x2, x3);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  return _mm_extract_epi32(x1, 1);
+}
+#endif
+
+#ifdef CRC32_ARMV8
+__attribute__((target("+crc")))
+static uint32_t crc32_armv8(const char* buf, size_t len, uint32_t crc) {
+  for (; len >= 8; buf += 8, len -= 8) {
+    uint64_t v;
+    memcpy(&v, buf, 8);
+    crc = __crc32d(crc, v);
+  }
+  for (; len > 0; ++buf, --len) {
+    crc = __crc32b(crc, *buf);
+  }
+  return crc;
+}
+#endif
+
 uint32_t crc32_hash(const char* const key, const size_t len) {
 	uint32_t crc;
-	unsigned int i;
+	size_t i = 0;
 
 	crc = ~0;
 
-	for (i = 0; i < len; i++) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  if (len >= 8) {
+    pthread_once(&crc32tabs_once, crc32tabs_init);
+#ifdef CRC32_ARMV8
+    if (crc32_has_armv8) {
+      return ~crc32_armv8(key, len, crc);
+    }
+#endif
+#ifdef CRC32_PCLMUL
+    if (crc32_has_pclmul && len >= CRC32_PCLMUL_MIN_LEN) {
+      i = len & ~(size_t)15;
+      crc = crc32_pclmul(key, i, crc);
+    }
+#endif
+    /* Same result as the bytewise loop below, 8 bytes per step */
+    for (; i + 8 <= len; i += 8) {
+      uint32_t one, two;
+      memcpy(&one, key + i, 4);
+      memcpy(&two, key + i + 4, 4);
+      one ^= crc;
+      crc = crc32tabs[7][one & 0xff] ^
+            crc32tabs[6][(one >> 8) & 0xff] ^
+            crc32tabs[5][(one >> 16) & 0xff] ^
+            crc32tabs[4][one >> 24] ^
+            crc32tabs[3][two & 0xff] ^
+            crc32tabs[2][(two >> 8) & 0xff] ^
+            crc32tabs[1][(two >> 16) & 0xff] ^
+            crc32tabs[0][two >> 24];
+    }
+  }
+#endif
+
+	for (; i < len; i++) {
         crc = (crc >> 8) ^ crc32tab[(crc ^ (key[i])) & 0xff];
     }
 
@@ -47,6 +47,18 @@ __BEGIN_DECLS
 uint32_t furc_hash(const char* const key, const size_t len,
                    const uint32_t m);
 
+/**
+ * Same as calling furc_hash() for each of |num_keys| keys, with the same
+ * |m|; results[i] is the hash of keys[i] (of length lens[i]).
+ *
+ * The MurmurHash64A rounds needed by the first try of every key are
+ * computed for several keys at once, interleaved, so that they don't wait
+ * on each other. Results are identical to furc_hash().
+ */
+void furc_hash_array(const char* const* keys, const size_t* lens,
+                     const size_t num_keys, const uint32_t m,
+                     uint32_t* results);
+
 uint32_t furc_maximum_pool_size(void);
 
 /**
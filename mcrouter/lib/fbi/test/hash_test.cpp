@@ -10,6 +10,7 @@
 #include <sys/time.h>
 
 #include <cmath>
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -210,6 +211,42 @@ TEST(ch3, verify_correctness) {
   }
 }
 
+/**
+ * furc_hash_array() must return exactly what furc_hash() does.
+ */
+TEST(ch3, hash_array) {
+  const size_t kNumKeys = 1001; /* not a multiple of the number of lanes */
+  std::vector<std::vector<char>> buffers(kNumKeys,
+                                         std::vector<char>(MAX_KEY_LENGTH + 1));
+  std::vector<const char*> keys;
+  std::vector<size_t> lens;
+  std::vector<uint32_t> results(kNumKeys);
+
+  srand(time(nullptr));
+  for (auto& buffer : buffers) {
+    make_random_key(buffer.data(), MAX_KEY_LENGTH);
+    keys.push_back(buffer.data());
+    lens.push_back(strlen(buffer.data()));
+  }
+
+  std::vector<uint32_t> sizes;
+  for (uint32_t m = 1; m < 1000; ++m) {
+    sizes.push_back(m);
+  }
+  for (uint32_t m = 1000; m < furc_maximum_pool_size(); m = m * 1.5 + 1) {
+    sizes.push_back(m);
+  }
+  sizes.push_back(furc_maximum_pool_size());
+
+  for (auto m : sizes) {
+    furc_hash_array(keys.data(), lens.data(), kNumKeys, m, results.data());
+    for (size_t i = 0; i < kNumKeys; ++i) {
+      ASSERT_EQ(furc_hash(keys[i], lens[i], m), results[i])
+        << "pool size " << m << ", key " << keys[i];
+    }
+  }
+}
+
 static uint32_t __attribute__ ((__noinline__))
   inconsistent_hashing_lookup(uint32_t hash_value,
                               uint32_t pool_size) {
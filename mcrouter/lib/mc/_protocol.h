@@ -72,6 +72,7 @@ static inline size_t mc_ascii_req_max_hdr_len(const mc_msg_t* req) {
     [mc_op_lease_get] = 12  /* lease-get <key>\r\n */,
     [mc_op_lease_set] = 47 /* lease-set <key> <flags> <exptime> <size>\r\n<value>\r\n */,
     [mc_op_gets] = 7 /* gets <key>\r\n */,
+    [mc_op_touch] = 19 /* touch <key> <exptime>\r\n */,
   };
 
   size_t fixed_len = fixed_lens[req->op <= mc_nops ?
@@ -105,6 +106,7 @@ static inline size_t mc_ascii_req_max_hdr_len(const mc_msg_t* req) {
     break;
 
   case mc_op_delete:
+  case mc_op_touch:
   case mc_op_incr:
   case mc_op_decr:
   case mc_op_flushre:
@@ -220,6 +220,7 @@ not_stored = 'NOT_STORED' @{ parser->msg->result = mc_res_notstored; };
 exists = 'EXISTS' @{ parser->msg->result = mc_res_exists; };
 not_found = 'NOT_FOUND' @{ parser->msg->result = mc_res_notfound; };
 deleted = 'DELETED' @{ parser->msg->result = mc_res_deleted; };
+touched = 'TOUCHED' @{ parser->msg->result = mc_res_touched; };
 
 storage_reply = stored | stale_stored | not_stored | exists | not_found | deleted;
 storage = storage_reply fin;
@@ -341,6 +342,7 @@ reply_append = storage;
 reply_prepend = storage;
 reply_cas = storage;
 delete_reply = deleted | not_found;
+touch_reply = touched fin;
 
 stat_name = (any+ -- (cntrl | space)) >start_token %finish_token
 %{
@@ -409,7 +411,7 @@ version_reply = ('VERSION ' (any* -- ('\r' | '\n')) >start_token %finish_token
 reply := get_reply | lease_get | metaget_reply |
         reply_set | reply_add | reply_replace | reply_lease_set |
         reply_append | reply_prepend | reply_cas | delete_reply |
-        arithmetic_reply |
+        touch_reply | arithmetic_reply |
         stats_reply | ok | version_reply | error;
 
 # requests
@@ -425,6 +427,8 @@ set_op = set | add | replace | append | prepend;
 
 delete_op = 'delete' @ { parser->msg->op = mc_op_delete; };
 
+touch_op = 'touch' @ { parser->msg->op = mc_op_touch; };
+
 get_op = 'get' @ { parser->msg->op = mc_op_get; } |
          'gets' @ {parser->msg->op = mc_op_gets; } |
          'lease-get' @ { parser->msg->op = mc_op_lease_get; } |
@@ -463,6 +467,8 @@ arithmetic = arithmetic_op ' '+ key ' '+ delta (' '+ noreply)? ' '* fin;
 
 delete = delete_op ' '+ key (' '+ exptime)? (' '+ noreply)? ' '* fin;
 
+touch = touch_op ' '+ key ' '+ exptime (' '+ noreply)? ' '* fin;
+
 quit = quit_op ' '* fin;
 
 version = version_op ' '* fin;
@@ -477,15 +483,15 @@ flush_all = flush_all_op (' '+ number)? ' '* fin;
 
 flush_regex = flush_regex_op ' ' key ' '* fin;
 
-request := get | store | cas | delete | arithmetic
+request := get | store | cas | delete | touch | arithmetic
   | quit | version | stats | shutdown | flush_all | flush_regex | exec;
 
-request_reply := get | store | cas | delete | arithmetic
+request_reply := get | store | cas | delete | touch | arithmetic
   | quit | version | stats | shutdown | flush_all | flush_regex | exec |
   get_reply | lease_get | metaget_reply |
   reply_set | reply_add | reply_replace | reply_lease_set |
   reply_append | reply_prepend | reply_cas | delete_reply |
-  arithmetic_reply |
+  touch_reply | arithmetic_reply |
   stats_reply | ok | version_reply | error;
 
 
@@ -63,6 +63,7 @@ static inline const char* mc_res_to_response_string(const mc_res_t result) {
     [mc_res_ok] = "OK\r\n",
     [mc_res_stored] = "STORED\r\n",
     [mc_res_exists] = "EXISTS\r\n",
+    [mc_res_touched] = "TOUCHED\r\n",
     /* soft errors -- */
     /* this shouldn't happen as we don't support UDP yet, and when we do
        hopefully we can be more intelligent than this. */
@@ -233,6 +234,18 @@ size_t mc_ascii_response_write_iovs(mc_ascii_response_buf_t* buf,
 
       break;
 
+    case mc_op_touch:
+      switch (reply->result) {
+        case mc_res_touched:
+        case mc_res_notfound:
+          IOV_WRITE_STR(mc_res_to_response_string(reply->result));
+          break;
+        default:
+          goto UNEXPECTED;
+      }
+
+      break;
+
     case mc_op_get:
     case mc_op_lease_get:
     case mc_op_gets:
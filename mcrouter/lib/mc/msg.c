@@ -9,12 +9,15 @@
  */
 #include "msg.h"
 
-#include <ctype.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <zlib.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "mcrouter/lib/fbi/nstring.h"
 #include "mcrouter/lib/mc/protocol.h"
 
@@ -551,23 +554,127 @@ mc_req_err_t mc_client_req_check(const mc_msg_t* req) {
 }
 
 mc_req_err_t mc_client_req_key_check(nstring_t key) {
-  size_t i;
+  return mc_key_scan(key).err;
+}
 
-  if (key.len < 1) {
-    return mc_req_err_no_key;
+/* Spaces and control characters, same as iscntrl() || isspace() in the C
+   locale (bytes >= 0x80 are allowed) */
+static inline int mc_key_byte_invalid(unsigned char c) {
+  return c <= ' ' || c == 0x7f;
+}
+
+/* State of mc_key_scan() between bytes (or blocks) of the key */
+typedef struct mc_key_scanner_s {
+  const char* str;
+  size_t len;
+  int invalid;
+  /* Slashes still to see before the routing prefix ends */
+  int slashes_left;
+  size_t prefix_len;
+  /* First "|#|" anywhere, and first one after the prefix */
+  size_t first_stop;
+  size_t stop_after_prefix;
+} mc_key_scanner_t;
+
+static inline void mc_key_scan_slash(mc_key_scanner_t* s, size_t pos) {
+  if (s->slashes_left > 0 && pos > 0 && --s->slashes_left == 0) {
+    s->prefix_len = pos + 1;
   }
+}
 
-  if (key.len > MC_KEY_MAX_LEN) {
-    return mc_req_err_key_too_long;
+static inline void mc_key_scan_pipe(mc_key_scanner_t* s, size_t pos) {
+  if (pos + 2 >= s->len || s->str[pos + 1] != '#' || s->str[pos + 2] != '|') {
+    return;
+  }
+  if (s->first_stop == s->len) {
+    s->first_stop = pos;
   }
+  if (s->slashes_left == 0 && s->stop_after_prefix == s->len &&
+      pos >= s->prefix_len) {
+    s->stop_after_prefix = pos;
+  }
+}
 
-  for (i = 0; i < key.len; ++i) {
-    if (iscntrl(key.str[i]) || isspace(key.str[i])) {
-      return mc_req_err_space_or_ctrl;
+static inline void mc_key_scan_byte(mc_key_scanner_t* s, size_t pos) {
+  unsigned char c = s->str[pos];
+  s->invalid |= mc_key_byte_invalid(c);
+  if (c == '/') {
+    mc_key_scan_slash(s, pos);
+  } else if (c == '|') {
+    mc_key_scan_pipe(s, pos);
+  }
+}
+
+mc_key_scan_t mc_key_scan(nstring_t key) {
+  mc_key_scan_t result;
+  mc_key_scanner_t s;
+  size_t i = 0;
+
+  s.str = key.str;
+  s.len = key.len;
+  s.invalid = 0;
+  /* "/region/cluster/": two more slashes after the first byte */
+  s.slashes_left = key.len > 0 && key.str[0] == '/' ? 2 : 0;
+  s.prefix_len = 0;
+  s.first_stop = key.len;
+  s.stop_after_prefix = key.len;
+
+#if defined(__SSE2__)
+  {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i del = _mm_set1_epi8(0x7f);
+    const __m128i slash = _mm_set1_epi8('/');
+    const __m128i pipe = _mm_set1_epi8('|');
+    __m128i invalid = _mm_setzero_si128();
+
+    for (; i + 16 <= key.len; i += 16) {
+      __m128i v = _mm_loadu_si128((const __m128i*)(key.str + i));
+      unsigned slashes, pipes;
+
+      /* Unsigned v <= ' ' is min(v, ' ') == v */
+      invalid = _mm_or_si128(invalid,
+        _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(v, space), v),
+                     _mm_cmpeq_epi8(v, del)));
+
+      /* Slashes go first: a hash stop only counts after the prefix */
+      slashes = s.slashes_left > 0 ?
+        (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, slash)) : 0;
+      while (slashes != 0) {
+        mc_key_scan_slash(&s, i + __builtin_ctz(slashes));
+        slashes &= slashes - 1;
+      }
+      pipes = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, pipe));
+      while (pipes != 0) {
+        mc_key_scan_pipe(&s, i + __builtin_ctz(pipes));
+        pipes &= pipes - 1;
+      }
     }
+    s.invalid = _mm_movemask_epi8(invalid) != 0;
+  }
+#endif
+
+  for (; i < key.len; ++i) {
+    mc_key_scan_byte(&s, i);
   }
 
-  return mc_req_err_valid;
+  if (key.len < 1) {
+    result.err = mc_req_err_no_key;
+  } else if (key.len > MC_KEY_MAX_LEN) {
+    result.err = mc_req_err_key_too_long;
+  } else if (s.invalid) {
+    result.err = mc_req_err_space_or_ctrl;
+  } else {
+    result.err = mc_req_err_valid;
+  }
+
+  if (s.slashes_left == 0 && s.prefix_len > 0) {
+    result.routing_prefix_len = s.prefix_len;
+    result.hash_stop = s.stop_after_prefix;
+  } else {
+    result.routing_prefix_len = 0;
+    result.hash_stop = s.first_stop;
+  }
+  return result;
 }
 
 const char* mc_req_err_to_string(const mc_req_err_t err) {
@@ -61,6 +61,7 @@ typedef enum mc_op_e {
   mc_op_bump_count,
   mc_op_get_unique_count,
   mc_op_bump_unique_count,
+  mc_op_touch, ///< Updates exptime of an existing item
   mc_nops // placeholder
 } mc_op_t;
 
@@ -98,6 +99,7 @@ static inline const char* mc_op_to_string(const mc_op_t op) {
     "bump-count",
     "get-unique-count",
     "bump-unique-count",
+    "touch",
     };
 
   return strings[op < mc_nops ? op : mc_op_unknown];
@@ -120,6 +122,7 @@ typedef enum mc_res_e {
   mc_res_ok,
   mc_res_stored,
   mc_res_exists,
+  mc_res_touched,
   /* soft errors -- */
   mc_res_ooo, /* out of order (UDP) */
   mc_res_timeout, /* request timeout (connection was already established) */
@@ -164,6 +167,7 @@ static inline const char* mc_res_to_string(const mc_res_t result) {
     "mc_res_ok",
     "mc_res_stored",
     "mc_res_exists",
+    "mc_res_touched",
     /* soft errors -- */
     "mc_res_ooo",
     "mc_res_timeout",
@@ -201,6 +205,8 @@ enum mc_msg_flags_t {
     MC_MSG_FLAG_SNAPPY_COMPRESSED = 0x4000,
     MC_MSG_FLAG_BIG_VALUE = 0X8000,
     MC_MSG_FLAG_NEGATIVE_CACHE = 0x10000,
+    /* Value compressed by mcrouter's CompressionRoute */
+    MC_MSG_FLAG_MCROUTER_COMPRESSED = 0x20000,
     /* Bits reserved for application-specific extension flags: */
     MC_MSG_FLAG_USER_1 = 0x100000000LL,
     MC_MSG_FLAG_USER_2 = 0x200000000LL,
@@ -296,6 +302,7 @@ static inline int mc_op_has_key(mc_op_t op) {
     case mc_op_bump_count:
     case mc_op_get_unique_count:
     case mc_op_bump_unique_count:
+    case mc_op_touch:
       return 1;
 
     default:
@@ -447,6 +454,29 @@ mc_req_err_t mc_client_req_check(const mc_msg_t* req);
  */
 mc_req_err_t mc_client_req_key_check(nstring_t key);
 
+/**
+ * Everything a request needs to know about its key, found in one pass by
+ * mc_key_scan().
+ *
+ *   /region/cluster/foo:key|#|etc
+ *   ^^^^^^^^^^^^^^^^               routing_prefix_len
+ *   ^^^^^^^^^^^^^^^^^^^^^^^        hash_stop
+ */
+typedef struct mc_key_scan_s {
+  /* Same as mc_client_req_key_check() */
+  mc_req_err_t err;
+  /* Length of the /region/cluster/ prefix, 0 if there is none */
+  size_t routing_prefix_len;
+  /* Offset of the first "|#|" after the routing prefix, key length if none */
+  size_t hash_stop;
+} mc_key_scan_t;
+
+/**
+ * Validates the key and finds its routing prefix and hash stop, 16 bytes at
+ * a time where SSE2 is available.
+ */
+mc_key_scan_t mc_key_scan(nstring_t key);
+
 __END_DECLS
 
 #endif
@@ -112,6 +112,15 @@ static ssize_t mc_ascii_delete_req_to_hdr(const mc_msg_t* req,
   return size >= (ssize_t)nbuf ? -size : size;
 }
 
+static ssize_t mc_ascii_touch_req_to_hdr(const mc_msg_t* req,
+                                         char* buf, size_t nbuf) {
+  ssize_t size = snprintf((char*)buf, nbuf, "touch %.*s %u\r\n",
+                          nstring_len_for_printf(&req->key),
+                          req->key.str,
+                          req->exptime);
+  return size >= (ssize_t)nbuf ? -size : size;
+}
+
 #define MCASCII_NUM_REQ_TO_HDR(nr, op)                                   \
   static ssize_t mc_ascii_##nr##_req_to_hdr(const mc_msg_t* req,         \
                                             char* buf, size_t nbuf) {    \
@@ -173,6 +182,7 @@ ssize_t mc_ascii_req_to_hdr(const mc_msg_t* req,
     [mc_op_lease_get] = mc_ascii_lease_get_req_to_hdr,
     [mc_op_lease_set] = mc_ascii_lease_set_req_to_hdr,
     [mc_op_gets] = mc_ascii_gets_req_to_hdr,
+    [mc_op_touch] = mc_ascii_touch_req_to_hdr,
   };
 
   ssize_t (*func)(const mc_msg_t*, char*, size_t);
@@ -52,6 +52,7 @@ UM_OP(mc_op_get_count,         28)
 UM_OP(mc_op_bump_count,        29)
 UM_OP(mc_op_get_unique_count,  30)
 UM_OP(mc_op_bump_unique_count, 31)
+UM_OP(mc_op_touch,             32)
 
 UM_RES(mc_res_unknown,          0)
 UM_RES(mc_res_deleted,          1)
@@ -84,6 +85,7 @@ UM_RES(mc_res_try_again,       27)
 UM_RES(mc_res_foundstale,      28)
 UM_RES(mc_res_notfoundhot,     29)
 UM_RES(mc_res_shutdown,        30)
+UM_RES(mc_res_touched,         31)
 
 #undef UM_OP
 #undef UM_RES
@@ -88,6 +88,7 @@ typedef struct _parse_info_s {
   [mc_op_lease_set] = store_req | msg_lease_id,              \
   [mc_op_shutdown] = OPT(msg_number),                        \
   [mc_op_end] = 0,                                           \
+  [mc_op_touch] = msg_key | msg_exptime,                     \
   [mc_nops] = -1,                                            \
 }
 
@@ -123,6 +124,7 @@ typedef struct _parse_info_s {
   [mc_op_lease_set] = store_rsp,                                    \
   [mc_op_shutdown] = msg_result,                                    \
   [mc_op_end] = 0,                                                  \
+  [mc_op_touch] = store_rsp,                                        \
   [mc_nops] = -1,                                                   \
 }
 
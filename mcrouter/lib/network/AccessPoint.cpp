@@ -16,6 +16,10 @@
 
 namespace facebook { namespace memcache {
 
+namespace {
+const folly::StringPiece kUnixPrefix = "unix:";
+}
+
 AccessPoint::AccessPoint(folly::StringPiece host, uint16_t port,
                          mc_protocol_t protocol)
     : host_(host.str()),
@@ -31,6 +35,29 @@ bool AccessPoint::create(folly::StringPiece host_port_protocol,
     return false;
   }
 
+  if (host_port_protocol.startsWith(kUnixPrefix)) {
+    host_port_protocol.advance(kUnixPrefix.size());
+    // protocol is optional, paths may contain ':' themselves
+    ap.protocol_ = default_protocol;
+    auto colon = host_port_protocol.rfind(':');
+    if (colon != std::string::npos) {
+      auto protocol = mc_string_to_protocol(
+        host_port_protocol.subpiece(colon + 1).str().c_str());
+      if (protocol != mc_unknown_protocol) {
+        ap.protocol_ = protocol;
+        host_port_protocol = host_port_protocol.subpiece(0, colon);
+      }
+    }
+    if (host_port_protocol.empty()) {
+      return false;
+    }
+    ap.host_ = host_port_protocol.str();
+    ap.port_ = 0;
+    ap.isUnix_ = true;
+    ap.isV6_ = false;
+    return true;
+  }
+
   if (host_port_protocol[0] == '[') {
     // IPv6
     auto closing = host_port_protocol.find(']');
@@ -84,6 +111,9 @@ bool AccessPoint::create(folly::StringPiece host_port_protocol,
 }
 
 std::string AccessPoint::toHostPortString() const {
+  if (isUnix_) {
+    return folly::to<std::string>(kUnixPrefix, host_);
+  }
   if (isV6_) {
     return folly::to<std::string>("[", host_, "]:", port_);
   }
@@ -91,6 +121,7 @@ std::string AccessPoint::toHostPortString() const {
 }
 
 void AccessPoint::initialize() {
+  isUnix_ = false;
   isV6_ = false;
   try {
     folly::IPAddress ip(host_);
@@ -103,7 +134,8 @@ void AccessPoint::initialize() {
 
 std::string AccessPoint::toString() const {
   assert(protocol_ != mc_unknown_protocol);
-  return folly::to<std::string>(toHostPortString(), ":TCP:",
+  return folly::to<std::string>(toHostPortString(),
+                                isUnix_ ? ":UNIX:" : ":TCP:",
                                 mc_protocol_to_string(protocol_));
 }
 
@@ -22,14 +22,24 @@ struct AccessPoint {
                        uint16_t port = 0,
                        mc_protocol_t protocol = mc_unknown_protocol);
 
+  /**
+   * Parses host:port[:protocol], [ipv6]:port[:protocol], or
+   * unix:path[:protocol] for a unix domain socket.
+   */
   static bool create(folly::StringPiece host_port_protocol,
                      mc_protocol_t default_protocol,
                      AccessPoint& ap);
 
+  /**
+   * Socket path for unix domain sockets.
+   */
   const folly::StringPiece getHost() const {
     return host_;
   }
 
+  /**
+   * 0 for unix domain sockets.
+   */
   uint16_t getPort() const {
     return port_;
   }
@@ -38,8 +48,13 @@ struct AccessPoint {
     return protocol_;
   }
 
+  bool isUnixDomainSocket() const {
+    return isUnix_;
+  }
+
   /**
-   * @return [host]:port if address is IPv6, host:port otherwise
+   * @return [host]:port if address is IPv6, unix:path for unix domain
+   *         sockets, host:port otherwise
    */
   std::string toHostPortString() const;
 
@@ -53,6 +68,7 @@ struct AccessPoint {
   uint16_t port_;
   mc_protocol_t protocol_;
   bool isV6_;
+  bool isUnix_{false};
 
   void initialize();
 };
@@ -25,16 +25,33 @@ void AsciiSerializedRequest::addString(folly::StringPiece str) {
   addString(folly::ByteRange(str));
 }
 
+template <class Request>
+void AsciiSerializedRequest::addValue(const Request& request) {
+  const auto& value = request.value();
+  // One iovec is reserved for the trailing "\r\n".
+  if (!value.isChained() ||
+      value.countChainElements() >= kMaxIovs - iovsCount_) {
+    addString(request.valueRangeSlow());
+    return;
+  }
+  for (auto piece : value) {
+    if (!piece.empty()) {
+      addString(piece);
+    }
+  }
+}
+
 template <class Request>
 void AsciiSerializedRequest::keyValueRequestCommon(folly::StringPiece prefix,
                                                    const Request& request) {
-  auto value = request.valueRangeSlow();
+  auto valueSize = request.value().computeChainDataLength();
   auto len = snprintf(printBuffer_, kMaxBufferLength, " %lu %u %zd\r\n",
-                      request.flags(), request.exptime(), value.size());
+                      request.flags(), request.exptime(), valueSize);
   assert(len > 0 && len < kMaxBufferLength);
   addStrings(prefix, request.fullKey(),
-             folly::StringPiece(printBuffer_, static_cast<size_t>(len)),
-             value, "\r\n");
+             folly::StringPiece(printBuffer_, static_cast<size_t>(len)));
+  addValue(request);
+  addString("\r\n");
 }
 
 // Get-like ops.
@@ -88,26 +105,28 @@ void AsciiSerializedRequest::prepareImpl(const McRequest& request,
 
 void AsciiSerializedRequest::prepareImpl(const McRequest& request,
                                          McOperation<mc_op_cas>) {
-  auto value = request.valueRangeSlow();
+  auto valueSize = request.value().computeChainDataLength();
   auto len = snprintf(printBuffer_, kMaxBufferLength, " %lu %u %zd %lu\r\n",
-                      request.flags(), request.exptime(), value.size(),
+                      request.flags(), request.exptime(), valueSize,
                       request.cas());
   assert(len > 0 && len < kMaxBufferLength);
   addStrings("cas ", request.fullKey(),
-             folly::StringPiece(printBuffer_, static_cast<size_t>(len)), value,
-             "\r\n");
+             folly::StringPiece(printBuffer_, static_cast<size_t>(len)));
+  addValue(request);
+  addString("\r\n");
 }
 
 void AsciiSerializedRequest::prepareImpl(const McRequest& request,
                                          McOperation<mc_op_lease_set>) {
-  auto value = request.valueRangeSlow();
+  auto valueSize = request.value().computeChainDataLength();
   auto len = snprintf(printBuffer_, kMaxBufferLength, " %lu %lu %u %zd\r\n",
                       request.leaseToken(), request.flags(), request.exptime(),
-                      value.size());
+                      valueSize);
   assert(len > 0 && len < kMaxBufferLength);
   addStrings("lease-set ", request.fullKey(),
-             folly::StringPiece(printBuffer_, static_cast<size_t>(len)), value,
-             "\r\n");
+             folly::StringPiece(printBuffer_, static_cast<size_t>(len)));
+  addValue(request);
+  addString("\r\n");
 }
 
 // Arithmetic ops.
@@ -141,6 +160,17 @@ void AsciiSerializedRequest::prepareImpl(const McRequest& request,
              folly::StringPiece(printBuffer_, static_cast<size_t>(len)));
 }
 
+// Touch op.
+
+void AsciiSerializedRequest::prepareImpl(const McRequest& request,
+                                         McOperation<mc_op_touch>) {
+  auto len = snprintf(printBuffer_, kMaxBufferLength, " %u\r\n",
+                      request.exptime());
+  assert(len > 0 && len < kMaxBufferLength);
+  addStrings("touch ", request.fullKey(),
+             folly::StringPiece(printBuffer_, static_cast<size_t>(len)));
+}
+
 // Version op.
 
 void AsciiSerializedRequest::prepareImpl(const McRequest& request,
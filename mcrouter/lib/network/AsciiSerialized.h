@@ -41,9 +41,9 @@ class AsciiSerializedRequest {
   bool prepare(const Request& request, Operation,
                struct iovec*& iovOut, size_t& niovOut);
  private:
-  // We need at most 5 iovecs (lease-set):
-  //   command + key + printBuffer + value + "\r\n"
-  static constexpr size_t kMaxIovs = 8;
+  // We need at most 4 iovecs (lease-set) plus one per value piece:
+  //   command + key + printBuffer + value... + "\r\n"
+  static constexpr size_t kMaxIovs = 16;
   // The longest print buffer we need is for lease-set/cas operations.
   // It requires 2 uint64, 2 uint32 + 4 spaces + "\r\n" + '\0' = 67 chars.
   static constexpr size_t kMaxBufferLength = 80;
@@ -60,6 +60,14 @@ class AsciiSerializedRequest {
   template <class Arg, class... Args>
   void addStrings(Arg&& arg, Args&&... args);
 
+  /**
+   * Reference every non-empty piece of the value chain directly, so that
+   * values received from the network are written out without a copy.
+   * Chains too long to fit into iovs_ are coalesced.
+   */
+  template <class Request>
+  void addValue(const Request& request);
+
   template <class Request>
   void keyValueRequestCommon(folly::StringPiece prefix, const Request& request);
 
@@ -81,6 +89,8 @@ class AsciiSerializedRequest {
   void prepareImpl(const McRequest& request, McOperation<mc_op_decr>);
   // Delete op.
   void prepareImpl(const McRequest& request, McOperation<mc_op_delete>);
+  // Touch op.
+  void prepareImpl(const McRequest& request, McOperation<mc_op_touch>);
   // Version op.
   void prepareImpl(const McRequest& request, McOperation<mc_op_version>);
   // FlushAll op.
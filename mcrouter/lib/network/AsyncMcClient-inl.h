@@ -22,6 +22,10 @@ inline void AsyncMcClient::closeNow() {
   base_->closeNow();
 }
 
+inline void AsyncMcClient::connect() {
+  base_->connect();
+}
+
 inline void AsyncMcClient::setStatusCallbacks(
     std::function<void()> onUp,
     std::function<void(bool)> onDown) {
@@ -31,8 +35,12 @@ inline void AsyncMcClient::setStatusCallbacks(
 template <class Operation, class Request>
 typename ReplyType<Operation, Request>::type
 AsyncMcClient::sendSync(const Request& request, Operation,
-                        std::chrono::milliseconds timeout) {
-  return base_->sendSync(request, Operation(), timeout);
+                        std::chrono::milliseconds timeout,
+                        int64_t* writtenTimeUs,
+                        McReplyStream* replyStream,
+                        McClientTimestamps* timestamps) {
+  return base_->sendSync(request, Operation(), timeout, writtenTimeUs,
+                         replyStream, timestamps);
 }
 
 inline void AsyncMcClient::setThrottle(size_t maxInflight, size_t maxPending) {
@@ -43,14 +51,27 @@ inline size_t AsyncMcClient::getPendingRequestCount() const {
   return base_->getPendingRequestCount();
 }
 
+inline size_t AsyncMcClient::getPendingRequestCount(
+    RequestPriority priority) const {
+  return base_->getPendingRequestCount(priority);
+}
+
 inline size_t AsyncMcClient::getInflightRequestCount() const {
   return base_->getInflightRequestCount();
 }
 
+inline size_t AsyncMcClient::getBufferedBytes() const {
+  return base_->getBufferedBytes();
+}
+
 inline std::pair<uint64_t, uint64_t> AsyncMcClient::getBatchingStat() const {
   return base_->getBatchingStat();
 }
 
+inline std::pair<uint64_t, uint64_t> AsyncMcClient::getWriteCorkStat() const {
+  return base_->getWriteCorkStat();
+}
+
 inline void AsyncMcClient::updateWriteTimeout(
     std::chrono::milliseconds timeout) {
   base_->updateWriteTimeout(timeout);
@@ -12,6 +12,8 @@
 #include "mcrouter/lib/McReply.h"
 #include "mcrouter/lib/McRequest.h"
 #include "mcrouter/lib/network/ConnectionOptions.h"
+#include "mcrouter/lib/network/McClientTimestamps.h"
+#include "mcrouter/lib/network/McReplyStream.h"
 
 namespace facebook { namespace memcache {
 
@@ -37,6 +39,12 @@ class AsyncMcClient {
    */
   void closeNow();
 
+  /**
+   * Start connecting if the connection is down, e.g. to have it up before
+   * the first request. Requests don't need it, they connect on demand.
+   */
+  void connect();
+
   /**
    * Set status callbacks for the underlying connection.
    *
@@ -58,11 +66,27 @@ class AsyncMcClient {
    * Send request synchronously (i.e. blocking call).
    * Note: it must be called only from fiber context. It will block the current
    *       stack and will send request only when we loop EventBase.
+   *
+   * @param writtenTimeUs  if not nullptr, set to the time (steady_clock,
+   *                       in microseconds) when the request was written
+   *                       into the socket. Left untouched if it never was.
+   * @param replyStream  if not nullptr, offered the value of a hit while
+   *                     it's being read. Only values read straight into
+   *                     their own buffer (ASCII protocol with
+   *                     useNewAsciiParser) are offered. Must stay alive
+   *                     until this call returns.
+   * @param timestamps  if not nullptr and
+   *                    ConnectionOptions::enableKernelTimestamps is set,
+   *                    receives the times the request was written, sent
+   *                    by the kernel and its reply read.
    */
   template <class Operation, class Request>
   typename ReplyType<Operation, Request>::type
   sendSync(const Request& request, Operation,
-           std::chrono::milliseconds timeout);
+           std::chrono::milliseconds timeout,
+           int64_t* writtenTimeUs = nullptr,
+           McReplyStream* replyStream = nullptr,
+           McClientTimestamps* timestamps = nullptr);
 
   /**
    * Set throttling options.
@@ -91,6 +115,12 @@ class AsyncMcClient {
    */
   size_t getPendingRequestCount() const;
 
+  /**
+   * Pending requests of the given priority, see
+   * ConnectionOptions::priorityLanes.
+   */
+  size_t getPendingRequestCount(RequestPriority priority) const;
+
   /**
    * Get the number of requests in inflight queue. This amounts for requests
    * that are currently been written to the socket and requests that were
@@ -108,6 +138,20 @@ class AsyncMcClient {
    */
   std::pair<uint64_t, uint64_t> getBatchingStat() const;
 
+  /**
+   * Get write corking statistics (see ConnectionOptions::writeCorkMaxDelay)
+   * over the same window of batches as getBatchingStat.
+   * The value returned is a fraction microseconds_held / batches_count.
+   */
+  std::pair<uint64_t, uint64_t> getWriteCorkStat() const;
+
+  /**
+   * Get the number of bytes buffered by this client: its read buffer and
+   * requests held back by write corking. Doesn't include requests the
+   * client only references (owned by their senders).
+   */
+  size_t getBufferedBytes() const;
+
   /**
    * Update send and connect timeout. If new value is larger than current
    * it is ignored.
@@ -19,7 +19,10 @@ namespace facebook { namespace memcache {
 template <class Operation, class Request>
 typename ReplyType<Operation, Request>::type
 AsyncMcClientImpl::sendSync(const Request& request, Operation,
-                            std::chrono::milliseconds timeout) {
+                            std::chrono::milliseconds timeout,
+                            int64_t* writtenTimeUs,
+                            McReplyStream* replyStream,
+                            McClientTimestamps* timestamps) {
   auto selfPtr = selfPtr_.lock();
   // shouldn't happen.
   assert(selfPtr);
@@ -40,6 +43,11 @@ AsyncMcClientImpl::sendSync(const Request& request, Operation,
     queue_, [] (ParserT& parser) {
       parser.expectNext<Operation, Request>();
     });
+  ctx.writtenTimeUs = writtenTimeUs;
+  ctx.replyStream = replyStream;
+  if (connectionOptions_.enableKernelTimestamps) {
+    ctx.timestamps = timestamps;
+  }
   sendCommon(ctx);
 
   // Wait for the reply.
@@ -51,6 +59,12 @@ void AsyncMcClientImpl::replyReady(Reply&& r, uint64_t reqId) {
   assert(connectionState_ == ConnectionState::UP);
   DestructorGuard dg(this);
 
+  if (connectionOptions_.enableKernelTimestamps) {
+    auto req = queue_.findRequestForReply(reqId);
+    if (req != nullptr && req->timestamps != nullptr) {
+      setReplyTimestamps(*req->timestamps);
+    }
+  }
   queue_.reply(reqId, std::move(r));
 }
 
@@ -9,19 +9,36 @@
  */
 #include "AsyncMcClientImpl.h"
 
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <time.h>
+
+// After time.h, for struct timespec
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <system_error>
+
 #include <folly/io/async/EventBase.h>
 #include <folly/Memory.h>
 #include <folly/io/async/AsyncSSLSocket.h>
+#include <folly/Random.h>
 
 #include "mcrouter/lib/fbi/cpp/LogFailure.h"
 #include "mcrouter/lib/McReply.h"
 #include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/network/ConnectThrottle.h"
+#include "mcrouter/lib/network/HostResolver.h"
 #include "mcrouter/lib/network/MockMcClientTransport.h"
+#include "mcrouter/lib/network/ShmRing.h"
+#include "mcrouter/lib/network/ShmRingTransport.h"
+#include "mcrouter/lib/network/ThreadLocalSSLContextProvider.h"
 
 namespace facebook { namespace memcache {
 
-constexpr size_t kReadBufferSizeMin = 256;
-constexpr size_t kReadBufferSizeMax = 4096;
 constexpr uint16_t kBatchSizeStatWindow = 1024;
 
 namespace detail {
@@ -63,10 +80,14 @@ AsyncMcClientImpl::AsyncMcClientImpl(
       connectionOptions_(std::move(options)),
       outOfOrder_(connectionOptions_.accessPoint.getProtocol() ==
                   mc_umbrella_protocol),
-      queue_(outOfOrder_),
+      queue_(outOfOrder_, connectionOptions_.supersedePendingUpdates,
+             connectionOptions_.priorityLanes),
       writer_(folly::make_unique<WriterLoop>(*this)),
+      corkDelay_(connectionOptions_.writeCorkMaxDelay),
       eventBaseDestructionCallback_(
         folly::make_unique<detail::OnEventBaseDestructionCallback>(*this)) {
+  evtimer_set(&corkEvent_, &AsyncMcClientImpl::onCorkTimeout, this);
+  event_base_set(eventBase_.getLibeventBase(), &corkEvent_);
   eventBase_.runOnDestruction(eventBaseDestructionCallback_.get());
 }
 
@@ -78,6 +99,16 @@ std::shared_ptr<AsyncMcClientImpl> AsyncMcClientImpl::create(
     throw std::logic_error("No network mode is not supported for umbrella "
                            "protocol yet!");
   }
+  if (options.accessPoint.getProtocol() == mc_meta_protocol &&
+      options.noNetwork) {
+    throw std::logic_error("No network mode is not supported for meta "
+                           "protocol!");
+  }
+  if (!options.shmChannelPath.empty() &&
+      options.accessPoint.getProtocol() != mc_umbrella_protocol) {
+    throw std::logic_error("Shared memory channels are supported for "
+                           "umbrella protocol only!");
+  }
 
   auto client = std::shared_ptr<AsyncMcClientImpl>(
     new AsyncMcClientImpl(eventBase, std::move(options)), Destructor());
@@ -97,6 +128,14 @@ void AsyncMcClientImpl::closeNow() {
   }
 }
 
+void AsyncMcClientImpl::connect() {
+  DestructorGuard dg(this);
+
+  if (connectionState_ == ConnectionState::DOWN) {
+    attemptConnection();
+  }
+}
+
 void AsyncMcClientImpl::setStatusCallbacks(
     std::function<void()> onUp,
     std::function<void(bool)> onDown) {
@@ -120,6 +159,9 @@ AsyncMcClientImpl::~AsyncMcClientImpl() {
     // readEOF and connectError, before we exit destructor.
     socket_->closeNow();
   }
+  if (corkScheduled_) {
+    evtimer_del(&corkEvent_);
+  }
   eventBaseDestructionCallback_.reset();
 }
 
@@ -127,15 +169,29 @@ size_t AsyncMcClientImpl::getPendingRequestCount() const {
   return queue_.getPendingRequestCount();
 }
 
+size_t AsyncMcClientImpl::getPendingRequestCount(
+    RequestPriority priority) const {
+  return queue_.getPendingRequestCount(priority);
+}
+
 size_t AsyncMcClientImpl::getInflightRequestCount() const {
   return queue_.getInflightRequestCount();
 }
 
+size_t AsyncMcClientImpl::getBufferedBytes() const {
+  return (parser_ ? parser_->bufferedBytes() : 0) + corkBytes_;
+}
+
 std::pair<uint64_t, uint64_t> AsyncMcClientImpl::getBatchingStat() const {
   return { batchStatPrevious.first + batchStatCurrent.first,
            batchStatPrevious.second + batchStatCurrent.second };
 }
 
+std::pair<uint64_t, uint64_t> AsyncMcClientImpl::getWriteCorkStat() const {
+  return { corkStatPrevious.first + corkStatCurrent.first,
+           corkStatPrevious.second + corkStatCurrent.second };
+}
+
 void AsyncMcClientImpl::setThrottle(size_t maxInflight, size_t maxPending) {
   maxInflight_ = maxInflight;
   maxPending_ = maxPending;
@@ -146,6 +202,12 @@ void AsyncMcClientImpl::sendCommon(McClientRequestContextBase& req) {
     case McSerializedRequest::Result::OK:
       incMsgId(nextMsgId_);
 
+      if (connectionOptions_.writeCorkMaxDelay.count() > 0) {
+        auto iovs = req.reqContext.getIovs();
+        for (size_t i = 0; i < req.reqContext.getIovsCount(); ++i) {
+          corkBytes_ += iovs[i].iov_len;
+        }
+      }
       queue_.markAsPending(req);
       scheduleNextWriterLoop();
       if (connectionState_ == ConnectionState::DOWN) {
@@ -166,16 +228,73 @@ void AsyncMcClientImpl::sendCommon(McClientRequestContextBase& req) {
 }
 
 void AsyncMcClientImpl::scheduleNextWriterLoop() {
-  if (connectionState_ == ConnectionState::UP && !writeScheduled_ &&
-      getPendingRequestCount() != 0) {
-    writeScheduled_ = true;
-    eventBase_.runInLoop(writer_.get());
+  if (connectionState_ != ConnectionState::UP || writeScheduled_ ||
+      getPendingRequestCount() == 0) {
+    return;
+  }
+
+  if (corkDelay_.count() > 0 && !corkLimitReached()) {
+    // Hold the write, more requests may come in the meantime.
+    if (!corkScheduled_) {
+      corkScheduled_ = true;
+      corkHeld_ = true;
+      corkStart_ = std::chrono::steady_clock::now();
+      timeval delay;
+      delay.tv_sec = corkDelay_.count() / 1000000;
+      delay.tv_usec = corkDelay_.count() % 1000000;
+      evtimer_add(&corkEvent_, &delay);
+    }
+    return;
+  }
+
+  if (corkScheduled_) {
+    corkScheduled_ = false;
+    evtimer_del(&corkEvent_);
   }
+  writeScheduled_ = true;
+  eventBase_.runInLoop(writer_.get());
 }
 
 void AsyncMcClientImpl::cancelWriterCallback() {
   writeScheduled_ = false;
   writer_->cancelLoopCallback();
+  if (corkScheduled_) {
+    corkScheduled_ = false;
+    evtimer_del(&corkEvent_);
+  }
+  corkHeld_ = false;
+}
+
+bool AsyncMcClientImpl::corkLimitReached() const {
+  const auto maxRequests = connectionOptions_.writeCorkMaxRequests;
+  const auto maxBytes = connectionOptions_.writeCorkMaxBytes;
+  return (maxRequests != 0 && getPendingRequestCount() >= maxRequests) ||
+         (maxBytes != 0 && corkBytes_ >= maxBytes);
+}
+
+void AsyncMcClientImpl::updateCorkDelay(size_t batchSize, bool timedOut) {
+  const auto maxDelay = connectionOptions_.writeCorkMaxDelay;
+  const auto minDelay = std::max(maxDelay / 16, std::chrono::microseconds(1));
+  if (timedOut) {
+    if (batchSize <= 1) {
+      // Holding gathered nothing, it only added latency.
+      corkDelay_ /= 2;
+      if (corkDelay_ < minDelay) {
+        corkDelay_ = std::chrono::microseconds(0);
+      }
+    }
+  } else if (batchSize > 1) {
+    // Requests come in faster than we hold them, holding pays off.
+    corkDelay_ = std::min(maxDelay, std::max(corkDelay_ * 2, minDelay));
+  }
+}
+
+void AsyncMcClientImpl::onCorkTimeout(int fd, short events, void* arg) {
+  auto& client = *static_cast<AsyncMcClientImpl*>(arg);
+  client.corkScheduled_ = false;
+  if (client.connectionState_ == ConnectionState::UP) {
+    client.pushMessages();
+  }
 }
 
 void AsyncMcClientImpl::pushMessages() {
@@ -191,29 +310,115 @@ void AsyncMcClientImpl::pushMessages() {
                            maxInflight_ - getInflightRequestCount());
     }
   }
+  if (connectionOptions_.writeCorkMaxDelay.count() > 0) {
+    bool timedOut = false;
+    if (corkHeld_) {
+      corkHeld_ = false;
+      timedOut = !corkLimitReached();
+      corkStatCurrent.first +=
+        std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - corkStart_).count();
+    }
+    ++corkStatCurrent.second;
+    updateCorkDelay(numToSend, timedOut);
+    corkBytes_ = 0;
+  }
+
   // Record current batch size.
   batchStatCurrent.first += numToSend;
   ++batchStatCurrent.second;
   if (batchStatCurrent.second == kBatchSizeStatWindow) {
     batchStatPrevious = batchStatCurrent;
     batchStatCurrent = {0, 0};
+    corkStatPrevious = corkStatCurrent;
+    corkStatCurrent = {0, 0};
   }
 
+  const bool umbrellaBatching = connectionOptions_.umbrellaBatching &&
+    connectionOptions_.accessPoint.getProtocol() == mc_umbrella_protocol;
   while (getPendingRequestCount() != 0 && numToSend > 0 &&
          /* we might be already not UP, because of failed writev */
          connectionState_ == ConnectionState::UP) {
-    auto& req = queue_.markNextAsSending();
+    writeIovs_.clear();
+    if (umbrellaBatching) {
+      // Placeholder for the batch header
+      writeIovs_.emplace_back();
+    }
+    size_t batchSize = 0;
+    size_t batchBytes = 0;
+    while (getPendingRequestCount() != 0 && numToSend > 0 &&
+           writeIovs_.size() < kMaxIovsPerWrite) {
+      auto& req = queue_.markNextAsSending();
+      auto iovs = req.reqContext.getIovs();
+      auto niovs = req.reqContext.getIovsCount();
+      if (umbrellaBatching) {
+        for (size_t i = 0; i < niovs; ++i) {
+          batchBytes += iovs[i].iov_len;
+        }
+      }
+      writeIovs_.insert(writeIovs_.end(), iovs, iovs + niovs);
+      ++batchSize;
+      --numToSend;
+    }
 
-    socket_->writev(this, req.reqContext.getIovs(),
-                    req.reqContext.getIovsCount(),
-                    numToSend == 1 ? folly::WriteFlags::NONE
+    // writev may complete (and call writeSuccess) synchronously.
+    writeBatches_.emplace_back();
+    auto& batch = writeBatches_.back();
+    batch.numRequests = batchSize;
+    if (umbrellaBatching) {
+      if (batchSize > 1 &&
+          umbrellaPrepareBatchHeader(batch.umbrellaHeader, batchSize,
+                                     batchBytes)) {
+        writeIovs_[0].iov_base = &batch.umbrellaHeader;
+        writeIovs_[0].iov_len = sizeof(entry_list_msg_t);
+      } else {
+        writeIovs_.erase(writeIovs_.begin());
+      }
+    }
+    if (kernelTimestamps_) {
+      for (const auto& iov : writeIovs_) {
+        streamBytes_ += iov.iov_len;
+      }
+      batch.streamEnd = streamBytes_;
+    }
+    socket_->writev(this, writeIovs_.data(), writeIovs_.size(),
+                    numToSend == 0 ? folly::WriteFlags::NONE
                     : folly::WriteFlags::CORK);
-    --numToSend;
   }
   writeScheduled_ = false;
   scheduleNextWriterLoop();
 }
 
+void AsyncMcClientImpl::markNextBatchAsSent() {
+  assert(!writeBatches_.empty());
+  auto batchSize = writeBatches_.front().numRequests;
+  auto streamEnd = kernelTimestamps_ ? writeBatches_.front().streamEnd : 0;
+  writeBatches_.pop_front();
+  int64_t writtenTimeUs = 0;
+  for (size_t i = 0; i < batchSize; ++i) {
+    auto& req = queue_.markNextAsSent();
+
+    if (req.writtenTimeUs != nullptr || req.timestamps != nullptr) {
+      if (writtenTimeUs == 0) {
+        writtenTimeUs = std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now().time_since_epoch()).count();
+      }
+      if (req.writtenTimeUs != nullptr) {
+        *req.writtenTimeUs = writtenTimeUs;
+      }
+      if (req.timestamps != nullptr) {
+        req.timestamps->writtenUs = writtenTimeUs;
+        req.timestamps->streamEnd = streamEnd;
+      }
+    }
+
+    // In case of no-network we need to provide fake reply.
+    if (connectionOptions_.noNetwork) {
+      sendFakeReply(req);
+    }
+  }
+}
+
 namespace {
 
 void createTCPKeepAliveOptions(
@@ -305,6 +510,10 @@ folly::AsyncSocket::OptionMap createSocketOptions(
     const folly::SocketAddress& address,
     const ConnectionOptions& connectionOptions) {
   folly::AsyncSocket::OptionMap options;
+  if (address.getFamily() == AF_UNIX) {
+    /* None of these apply to unix domain sockets */
+    return options;
+  }
 
   createTCPKeepAliveOptions(options,
     connectionOptions.tcpKeepAliveCount, connectionOptions.tcpKeepAliveIdle,
@@ -312,6 +521,14 @@ folly::AsyncSocket::OptionMap createSocketOptions(
   if (connectionOptions.enableQoS) {
     createQoSClassOption(options, address.getFamily(), connectionOptions.qos);
   }
+#ifdef SO_BUSY_POLL
+  if (connectionOptions.busyPollUs > 0) {
+    folly::AsyncSocket::OptionMap::key_type key;
+    key.level = SOL_SOCKET;
+    key.optname = SO_BUSY_POLL;
+    options[key] = connectionOptions.busyPollUs;
+  }
+#endif // SO_BUSY_POLL
 
   return std::move(options);
 }
@@ -321,14 +538,58 @@ folly::AsyncSocket::OptionMap createSocketOptions(
 void AsyncMcClientImpl::attemptConnection() {
   assert(connectionState_ == ConnectionState::DOWN);
 
+  if (reconnectBackoff_.count() > 0 &&
+      std::chrono::steady_clock::now() < reconnectAfter_) {
+    // Still backing off after a failed connect.
+    queue_.failAllPending(mc_res_connect_error);
+    return;
+  }
+
   connectionState_ = ConnectionState::CONNECTING;
 
+  auto& throttle = connectionOptions_.connectThrottle;
+  if (throttle && !throttle->tryStart()) {
+    // Stays CONNECTING (without a socket) until it's our turn.
+    std::weak_ptr<AsyncMcClientImpl> weakSelf = selfPtr_;
+    throttle->wait([weakSelf]() {
+      auto client = weakSelf.lock();
+      if (!client || client->connectionState_ != ConnectionState::CONNECTING) {
+        return false;
+      }
+      client->connectNow();
+      return true;
+    });
+    return;
+  }
+  connectNow();
+}
+
+void AsyncMcClientImpl::connectNow() {
+  assert(connectionState_ == ConnectionState::CONNECTING);
+  connectThrottled_ = connectionOptions_.connectThrottle != nullptr;
+  connectStart_ = std::chrono::steady_clock::now();
+
   if (connectionOptions_.noNetwork) {
     socket_.reset(new MockMcClientTransport(eventBase_));
     connectSuccess();
     return;
   }
 
+  if (!connectionOptions_.shmChannelPath.empty()) {
+    std::shared_ptr<ShmChannel> channel;
+    try {
+      channel = ShmChannel::attach(connectionOptions_.shmChannelPath);
+    } catch (const std::exception& e) {
+      connectErr(folly::AsyncSocketException(
+                   folly::AsyncSocketException::NOT_OPEN, e.what()));
+      return;
+    }
+    socket_.reset(new ShmRingTransport(eventBase_, std::move(channel),
+                                       ShmRingTransport::Side::CLIENT));
+    connectSuccess();
+    return;
+  }
+
   if (connectionOptions_.sslContextProvider) {
     auto sslContext = connectionOptions_.sslContextProvider();
     if (!sslContext) {
@@ -340,18 +601,34 @@ void AsyncMcClientImpl::attemptConnection() {
                    folly::AsyncSocketException::SSL_ERROR, ""));
       return;
     }
-    socket_.reset(new folly::AsyncSSLSocket(
-      sslContext, &eventBase_));
+    auto sslSocket = new folly::AsyncSSLSocket(sslContext, &eventBase_);
+    socket_.reset(sslSocket);
+    if (connectionOptions_.sslSessionResumption) {
+      if (auto session = getCachedSSLSession(
+            connectionOptions_.accessPoint.toHostPortString())) {
+        sslSocket->setSSLSession(session, /* takeOwnership */ false);
+      }
+    }
   } else {
     socket_.reset(new folly::AsyncSocket(&eventBase_));
   }
 
   auto& socket = dynamic_cast<folly::AsyncSocket&>(*socket_);
 
-  auto address = folly::SocketAddress(
-    connectionOptions_.accessPoint.getHost().str(),
-    connectionOptions_.accessPoint.getPort(),
-    /* allowNameLookup */ true);
+  folly::SocketAddress address;
+  if (connectionOptions_.accessPoint.isUnixDomainSocket()) {
+    address.setFromPath(connectionOptions_.accessPoint.getHost());
+  } else {
+    try {
+      address = HostResolver::instance().resolve(
+        connectionOptions_.accessPoint.getHost(),
+        connectionOptions_.accessPoint.getPort());
+    } catch (const std::system_error& e) {
+      connectErr(folly::AsyncSocketException(
+                   folly::AsyncSocketException::NOT_OPEN, e.what()));
+      return;
+    }
+  }
 
   auto socketOptions = createSocketOptions(address, connectionOptions_);
 
@@ -359,7 +636,7 @@ void AsyncMcClientImpl::attemptConnection() {
   socket.connect(this, address, connectionOptions_.writeTimeout.count(),
                  socketOptions);
 
-  if (connectionOptions_.enableQoS) {
+  if (connectionOptions_.enableQoS && address.getFamily() != AF_UNIX) {
     checkWhetherQoSIsApplied(address, socket.getFd(), connectionOptions_);
   }
 }
@@ -369,6 +646,18 @@ void AsyncMcClientImpl::connectSuccess() noexcept {
   DestructorGuard dg(this);
   connectionState_ = ConnectionState::UP;
 
+  if (connectionOptions_.sslSessionResumption) {
+    if (auto sslSocket = dynamic_cast<folly::AsyncSSLSocket*>(socket_.get())) {
+      if (!sslSocket->getSSLSessionReused()) {
+        cacheSSLSession(connectionOptions_.accessPoint.toHostPortString(),
+                        sslSocket->getSSLSession());
+      }
+    }
+  }
+
+  kernelTimestamps_ = connectionOptions_.enableKernelTimestamps &&
+    enableKernelTimestamps();
+
   if (statusCallbacks_.onUp) {
     statusCallbacks_.onUp();
   }
@@ -377,10 +666,17 @@ void AsyncMcClientImpl::connectSuccess() noexcept {
   assert(queue_.getParserInitializer() == nullptr);
 
   scheduleNextWriterLoop();
-  parser_ = folly::make_unique<ParserT>(*this, 0, kReadBufferSizeMin,
-                                        kReadBufferSizeMax,
-                                        connectionOptions_.useNewAsciiParser);
+  parser_ = folly::make_unique<ParserT>(
+    *this,
+    connectionOptions_.repliesPerRead,
+    connectionOptions_.minReadBufferSize,
+    connectionOptions_.maxReadBufferSize,
+    connectionOptions_.useNewAsciiParser,
+    connectionOptions_.useAsciiReplyFastPath,
+    connectionOptions_.accessPoint.getProtocol() == mc_meta_protocol);
   socket_->setReadCB(this);
+
+  connectFinished(true);
 }
 
 void AsyncMcClientImpl::connectErr(
@@ -398,6 +694,13 @@ void AsyncMcClientImpl::connectErr(
     error = mc_res_connect_error;
   }
 
+  if (connectionOptions_.sslSessionResumption &&
+      ex.getType() == folly::AsyncSocketException::SSL_ERROR) {
+    // The server may have rejected the session, next attempt starts afresh.
+    cacheSSLSession(connectionOptions_.accessPoint.toHostPortString(),
+                    nullptr);
+  }
+
   assert(getInflightRequestCount() == 0);
   queue_.failAllPending(error);
   connectionState_ = ConnectionState::DOWN;
@@ -407,13 +710,39 @@ void AsyncMcClientImpl::connectErr(
   if (statusCallbacks_.onDown) {
     statusCallbacks_.onDown(isAborting_);
   }
+
+  connectFinished(false);
+}
+
+void AsyncMcClientImpl::connectFinished(bool success) {
+  if (connectThrottled_) {
+    connectThrottled_ = false;
+    connectionOptions_.connectThrottle->finished(
+      success,
+      std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - connectStart_));
+  }
+
+  const auto initialBackoff = connectionOptions_.reconnectBackoffInitial;
+  if (success || isAborting_ || initialBackoff.count() == 0) {
+    reconnectBackoff_ = std::chrono::milliseconds(0);
+    return;
+  }
+  reconnectBackoff_ = reconnectBackoff_.count() == 0
+    ? initialBackoff
+    : std::min(connectionOptions_.reconnectBackoffMax, reconnectBackoff_ * 2);
+  // Jitter, so that clients failing together don't retry together.
+  auto half = reconnectBackoff_.count() / 2;
+  reconnectAfter_ = std::chrono::steady_clock::now() +
+    std::chrono::milliseconds(half + folly::Random::rand64(
+                                reconnectBackoff_.count() - half + 1));
 }
 
 void AsyncMcClientImpl::processShutdown() {
   DestructorGuard dg(this);
   switch (connectionState_) {
     case ConnectionState::UP: // on error, UP always transitions to ERROR state
-      if (writeScheduled_) {
+      if (writeScheduled_ || corkScheduled_) {
         // Cancel loop callback, or otherwise we might attempt to write
         // something while processing error state.
         cancelWriterCallback();
@@ -459,7 +788,120 @@ void AsyncMcClientImpl::processShutdown() {
   }
 }
 
+bool AsyncMcClientImpl::enableKernelTimestamps() {
+  streamBytes_ = 0;
+  txTimestamps_.clear();
+#ifdef SOF_TIMESTAMPING_OPT_TSONLY
+  // Offsets in the stream are those of the requests only without SSL
+  auto socket = dynamic_cast<folly::AsyncSocket*>(socket_.get());
+  if (socket == nullptr ||
+      dynamic_cast<folly::AsyncSSLSocket*>(socket_.get()) != nullptr ||
+      connectionOptions_.accessPoint.isUnixDomainSocket()) {
+    return false;
+  }
+  // OPT_ID numbers the timestamps by byte offset since now, so it must be
+  // set on the connected socket before anything is written.
+  int flags = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE |
+    SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+  if (setsockopt(socket->getFd(), SOL_SOCKET, SO_TIMESTAMPING,
+                 &flags, sizeof(flags)) != 0) {
+    VLOG(1) << "Failed to enable kernel timestamps for \""
+            << connectionOptions_.accessPoint.toString()
+            << "\": " << strerror(errno);
+    return false;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+void AsyncMcClientImpl::readTxTimestamps() {
+#ifdef SOF_TIMESTAMPING_OPT_TSONLY
+  auto fd = dynamic_cast<folly::AsyncSocket&>(*socket_).getFd();
+  // Kernel timestamps are CLOCK_REALTIME
+  int64_t realtimeToSteadyUs = 0;
+  char control[256];
+  while (true) {
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+      // EAGAIN: nothing left
+      return;
+    }
+
+    const scm_timestamping* tss = nullptr;
+    const sock_extended_err* err = nullptr;
+    for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (cmsg->cmsg_level == SOL_SOCKET &&
+          cmsg->cmsg_type == SCM_TIMESTAMPING) {
+        tss = reinterpret_cast<const scm_timestamping*>(CMSG_DATA(cmsg));
+      } else if ((cmsg->cmsg_level == SOL_IP &&
+                  cmsg->cmsg_type == IP_RECVERR) ||
+                 (cmsg->cmsg_level == SOL_IPV6 &&
+                  cmsg->cmsg_type == IPV6_RECVERR)) {
+        err = reinterpret_cast<const sock_extended_err*>(CMSG_DATA(cmsg));
+      }
+    }
+    if (tss == nullptr || err == nullptr ||
+        err->ee_origin != SO_EE_ORIGIN_TIMESTAMPING) {
+      continue;
+    }
+
+    if (realtimeToSteadyUs == 0) {
+      using std::chrono::microseconds;
+      realtimeToSteadyUs =
+        std::chrono::duration_cast<microseconds>(
+          std::chrono::system_clock::now().time_since_epoch()).count() -
+        std::chrono::duration_cast<microseconds>(
+          std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    int64_t txUs = static_cast<int64_t>(tss->ts[0].tv_sec) * 1000000 +
+      tss->ts[0].tv_nsec / 1000;
+    txTimestamps_.emplace_back(err->ee_data, txUs - realtimeToSteadyUs);
+    if (txTimestamps_.size() > kMaxTxTimestamps) {
+      txTimestamps_.pop_front();
+    }
+  }
+#endif
+}
+
+int64_t AsyncMcClientImpl::findTxTimestamp(uint64_t streamEnd) {
+  // The kernel numbers a write by the offset of its last byte. The first
+  // write ending at or after the request's last byte is the one that
+  // completed sending it.
+  auto lastByte = static_cast<uint32_t>(streamEnd - 1);
+  auto it = txTimestamps_.begin();
+  while (it != txTimestamps_.end() &&
+         static_cast<int32_t>(it->first - lastByte) < 0) {
+    ++it;
+  }
+  if (it == txTimestamps_.end()) {
+    return 0;
+  }
+  auto txUs = it->second;
+  if (!outOfOrder_) {
+    // Earlier requests were already replied to
+    txTimestamps_.erase(txTimestamps_.begin(), it);
+  }
+  return txUs;
+}
+
+void AsyncMcClientImpl::setReplyTimestamps(McClientTimestamps& timestamps) {
+  timestamps.readUs = lastReadUs_;
+  if (kernelTimestamps_ && timestamps.streamEnd != 0) {
+    timestamps.kernelTxUs = findTxTimestamp(timestamps.streamEnd);
+  }
+}
+
 void AsyncMcClientImpl::getReadBuffer(void** bufReturn, size_t* lenReturn) {
+  // Called before every read, also when woken up by the error queue only
+  if (kernelTimestamps_) {
+    readTxTimestamps();
+  }
   auto prealloc = parser_->getReadBuffer();
   *bufReturn = prealloc.first;
   *lenReturn = prealloc.second;
@@ -467,7 +909,50 @@ void AsyncMcClientImpl::getReadBuffer(void** bufReturn, size_t* lenReturn) {
 
 void AsyncMcClientImpl::readDataAvailable(size_t len) noexcept {
   DestructorGuard dg(this);
+  if (connectionOptions_.enableKernelTimestamps) {
+    lastReadUs_ = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+  bool readingValue = parser_->readingValue();
   parser_->readDataAvailable(len);
+  if (readingValue) {
+    streamValueData();
+  }
+}
+
+void AsyncMcClientImpl::streamValueData() {
+  auto req = queue_.getReplyingRequest();
+  if (req == nullptr || req->replyStream == nullptr) {
+    return;
+  }
+
+  const auto& reply = parser_->partialReply();
+  const auto& value = reply.value();
+  if (req->streamedBytes == 0) {
+    auto length = value.computeChainDataLength() +
+      parser_->remainingValueLength();
+    if (reply.result() != mc_res_found ||
+        !req->replyStream->start(reply.flags(), length)) {
+      req->replyStream = nullptr;
+      return;
+    }
+  }
+
+  /* Clones of what was read since the last call, the parser only appends
+     past the end of those */
+  size_t offset = 0;
+  auto piece = &value;
+  do {
+    auto end = offset + piece->length();
+    if (end > req->streamedBytes) {
+      auto chunk = piece->cloneOne();
+      chunk->trimStart(req->streamedBytes - offset);
+      req->streamedBytes = end;
+      req->replyStream->data(std::move(chunk));
+    }
+    offset = end;
+    piece = piece->next();
+  } while (piece != &value);
 }
 
 void AsyncMcClientImpl::readEOF() noexcept {
@@ -487,12 +972,7 @@ void AsyncMcClientImpl::readErr(
 void AsyncMcClientImpl::writeSuccess() noexcept {
   assert(connectionState_ == ConnectionState::UP);
   DestructorGuard dg(this);
-  auto& req = queue_.markNextAsSent();
-
-  // In case of no-network we need to provide fake reply.
-  if (connectionOptions_.noNetwork) {
-    sendFakeReply(req);
-  }
+  markNextBatchAsSent();
 }
 
 void AsyncMcClientImpl::writeErr(
@@ -508,7 +988,12 @@ void AsyncMcClientImpl::writeErr(
 
   // We're already in an error state, so all requests in pendingReplyQueue_ will
   // be replied with an error.
-  queue_.markNextAsSent();
+  assert(!writeBatches_.empty());
+  auto batchSize = writeBatches_.front().numRequests;
+  writeBatches_.pop_front();
+  for (size_t i = 0; i < batchSize; ++i) {
+    queue_.markNextAsSent();
+  }
   processShutdown();
 }
 
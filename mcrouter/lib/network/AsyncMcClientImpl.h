@@ -9,8 +9,12 @@
  */
 #pragma once
 
+#include <event.h>
+
 #include <chrono>
+#include <deque>
 #include <string>
+#include <vector>
 
 #include <folly/experimental/fibers/Baton.h>
 #include <folly/io/IOBufQueue.h>
@@ -21,6 +25,7 @@
 #include "mcrouter/lib/network/ConnectionOptions.h"
 #include "mcrouter/lib/network/McClientRequestContext.h"
 #include "mcrouter/lib/network/ClientMcParser.h"
+#include "mcrouter/lib/network/UmbrellaProtocol.h"
 
 namespace facebook { namespace memcache {
 
@@ -55,6 +60,9 @@ class AsyncMcClientImpl :
   // Fail all requests and close connection.
   void closeNow();
 
+  // Connect now, if not connected or connecting.
+  void connect();
+
   void setStatusCallbacks(
     std::function<void()> onUp,
     std::function<void(bool)> onDown);
@@ -62,13 +70,19 @@ class AsyncMcClientImpl :
   template <class Operation, class Request>
   typename ReplyType<Operation, Request>::type
   sendSync(const Request& request, Operation,
-           std::chrono::milliseconds timeout);
+           std::chrono::milliseconds timeout,
+           int64_t* writtenTimeUs = nullptr,
+           McReplyStream* replyStream = nullptr,
+           McClientTimestamps* timestamps = nullptr);
 
   void setThrottle(size_t maxInflight, size_t maxPending);
 
   size_t getPendingRequestCount() const;
+  size_t getPendingRequestCount(RequestPriority priority) const;
   size_t getInflightRequestCount() const;
   std::pair<uint64_t, uint64_t> getBatchingStat() const;
+  std::pair<uint64_t, uint64_t> getWriteCorkStat() const;
+  size_t getBufferedBytes() const;
 
   void updateWriteTimeout(std::chrono::milliseconds timeout);
  private:
@@ -94,6 +108,9 @@ class AsyncMcClientImpl :
   // Stats.
   std::pair<uint64_t, uint16_t> batchStatPrevious{0, 0};
   std::pair<uint64_t, uint16_t> batchStatCurrent{0, 0};
+  // Microseconds writes were held, per writer loop run (same window).
+  std::pair<uint64_t, uint16_t> corkStatPrevious{0, 0};
+  std::pair<uint64_t, uint16_t> corkStatCurrent{0, 0};
 
   folly::EventBase& eventBase_;
   std::unique_ptr<ParserT> parser_;
@@ -119,6 +136,51 @@ class AsyncMcClientImpl :
   bool writeScheduled_{false};
   std::unique_ptr<WriterLoop> writer_;
 
+  // Requests sent by one writer loop iteration are gathered into a single
+  // writev. writeBatches_ holds every write that hasn't completed yet,
+  // in the order they were issued.
+  static constexpr size_t kMaxIovsPerWrite = 128;
+  std::vector<struct iovec> writeIovs_;
+  struct WriteBatch {
+    size_t numRequests;
+    // streamBytes_ once written, if kernelTimestamps_
+    uint64_t streamEnd;
+    // Written before the requests if they were sent as one Umbrella BATCH
+    // frame (see ConnectionOptions::umbrellaBatching).
+    entry_list_msg_t umbrellaHeader;
+  };
+  std::deque<WriteBatch> writeBatches_;
+
+  // Write corking (see ConnectionOptions::writeCorkMaxDelay).
+  // corkDelay_ is the current, load adapted, hold time.
+  std::chrono::microseconds corkDelay_{0};
+  struct event corkEvent_;
+  bool corkScheduled_{false};
+  // A hold started at corkStart_, and its requests aren't written yet.
+  bool corkHeld_{false};
+  std::chrono::steady_clock::time_point corkStart_;
+  // Bytes of requests queued since the last write.
+  size_t corkBytes_{0};
+
+  // Reconnect backoff (see ConnectionOptions::reconnectBackoffInitial).
+  std::chrono::milliseconds reconnectBackoff_{0};
+  std::chrono::steady_clock::time_point reconnectAfter_;
+  std::chrono::steady_clock::time_point connectStart_;
+  // This connect is counted by connectionOptions_.connectThrottle.
+  bool connectThrottled_{false};
+
+  // Kernel TX timestamps (see ConnectionOptions::enableKernelTimestamps)
+  // are on for this connection.
+  bool kernelTimestamps_{false};
+  // Bytes written into this connection so far, if kernelTimestamps_
+  uint64_t streamBytes_{0};
+  // Timestamps from the error queue by the offset of the last byte of
+  // the write (mod 2^32, as reported by the kernel), oldest first.
+  static constexpr size_t kMaxTxTimestamps = 4096;
+  std::deque<std::pair<uint32_t, int64_t>> txTimestamps_;
+  // Time of the last read, if connectionOptions_.enableKernelTimestamps
+  int64_t lastReadUs_{0};
+
   bool isAborting_{false};
   std::unique_ptr<detail::OnEventBaseDestructionCallback>
     eventBaseDestructionCallback_;
@@ -133,11 +195,32 @@ class AsyncMcClientImpl :
   // Write some requests from sendQueue_ to the socket, until max inflight limit
   // is reached or queue is empty.
   void pushMessages();
+
+  // Turns on kernel timestamps for the new connection, false if they
+  // aren't available for it.
+  bool enableKernelTimestamps();
+  // Moves the kernel timestamps from the socket error queue to
+  // txTimestamps_.
+  void readTxTimestamps();
+  // 0 if there's no kernel timestamp for the write that ended at streamEnd.
+  int64_t findTxTimestamp(uint64_t streamEnd);
+  void setReplyTimestamps(McClientTimestamps& timestamps);
+  // Mark all requests from the oldest outstanding write as sent.
+  void markNextBatchAsSent();
   // Schedule next writer loop if it's not scheduled.
   void scheduleNextWriterLoop();
   void cancelWriterCallback();
+  // True iff enough is pending to write without holding any longer.
+  bool corkLimitReached() const;
+  // Adapts corkDelay_ after a write of batchSize requests.
+  void updateCorkDelay(size_t batchSize, bool timedOut);
+  static void onCorkTimeout(int fd, short events, void* arg);
 
   void attemptConnection();
+  // Part of attemptConnection() once the throttle lets it connect.
+  void connectNow();
+  // Connect stats, throttle and backoff bookkeeping of a finished connect.
+  void connectFinished(bool success);
 
   // TAsyncSocket::ConnectCallback overrides
   void connectSuccess() noexcept override;
@@ -158,6 +241,10 @@ class AsyncMcClientImpl :
   void writeErr(size_t bytesWritten,
                 const folly::AsyncSocketException& ex) noexcept override;
 
+  // Hands the value bytes read into the reply being parsed to its request's
+  // replyStream, if any.
+  void streamValueData();
+
   // Callbacks for McParser.
   template <class Reply>
   void replyReady(Reply&& reply, uint64_t reqId);
@@ -9,19 +9,33 @@
  */
 #include "AsyncMcServer.h"
 
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 #include <chrono>
+#include <cstring>
 #include <condition_variable>
 #include <mutex>
 #include <thread>
+#include <unordered_map>
 
+#include <folly/Exception.h>
+#include <folly/io/async/AsyncServerSocket.h>
+#include <folly/io/async/AsyncSSLSocket.h>
 #include <folly/io/async/EventBase.h>
 #include <folly/io/async/SSLContext.h>
 #include <folly/Memory.h>
-#include <folly/io/async/AsyncServerSocket.h>
 
+#include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/lib/fbi/fb_cpu_util.h"
 #include "mcrouter/lib/network/AsyncMcServerWorker.h"
+#include "mcrouter/lib/network/McSSLUtil.h"
+#include "mcrouter/lib/network/ShmRing.h"
+#include "mcrouter/lib/network/ShmRingTransport.h"
 #include "mcrouter/lib/network/ThreadLocalSSLContextProvider.h"
 
 namespace facebook { namespace memcache {
@@ -29,6 +43,38 @@ namespace facebook { namespace memcache {
 namespace {
 /* Global pointer to the server for signal handlers */
 facebook::memcache::AsyncMcServer* gServer;
+
+/**
+ * @return  unix domain socket bound to path, throws on failure.
+ */
+int bindUnixSocket(const std::string& path) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  checkLogic(!path.empty() && path.size() < sizeof(addr.sun_path),
+             "Invalid unix socket path '{}'", path);
+  memcpy(addr.sun_path, path.data(), path.size());
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  folly::checkUnixError(fd, "socket(AF_UNIX) failed");
+  /* A stale socket file would make bind() fail with EADDRINUSE */
+  unlink(path.c_str());
+  if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+    int err = errno;
+    close(fd);
+    folly::throwSystemErrorExplicit(err, "bind() failed for ", path);
+  }
+  return fd;
+}
+
+void setDeferAccept(folly::AsyncServerSocket& socket, int secs) {
+  for (auto fd : socket.getSockets()) {
+    if (setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT,
+                   &secs, sizeof(secs)) != 0) {
+      PLOG(WARNING) << "Failed to set TCP_DEFER_ACCEPT";
+    }
+  }
+}
 }
 
 
@@ -59,6 +105,128 @@ public:
   }
 };
 
+/**
+ * Runs TLS server handshakes off the server threads. Once a handshake
+ * completes, the socket is moved to the worker that accepted it.
+ */
+class McHandshakeThread {
+ public:
+  McHandshakeThread()
+      : thread_([this] () {
+          evb_.loopForever();
+          // Abandoned handshakes, their sockets must die on this thread
+          pending_.clear();
+        }) {
+  }
+
+  /**
+   * Starts the handshake of an accepted fd. On success the socket is
+   * attached to workerEvb and added to worker, unless it's shut down.
+   *
+   * Safe to call from other threads
+   */
+  void accept(int fd,
+              std::shared_ptr<folly::SSLContext> context,
+              AsyncMcServerWorker& worker,
+              folly::EventBase& workerEvb) {
+    auto result = evb_.runInEventBaseThread(
+      [this, fd, context, &worker, &workerEvb] () {
+        folly::AsyncSSLSocket::UniquePtr socket(
+          new folly::AsyncSSLSocket(context, &evb_, fd, /* server = */ true));
+        auto handshake = folly::make_unique<Handshake>(
+          *this, std::move(socket), worker, workerEvb);
+        auto& ref = *handshake;
+        pending_.emplace(&ref, std::move(handshake));
+        ref.start();
+      });
+    if (!result) {
+      ::close(fd);
+    }
+  }
+
+  /* Safe to call from other threads, but not concurrently */
+  void stop() {
+    if (thread_.joinable()) {
+      evb_.terminateLoopSoon();
+      thread_.join();
+    }
+  }
+
+  ~McHandshakeThread() {
+    stop();
+  }
+
+ private:
+  class Handshake : public folly::AsyncSSLSocket::HandshakeCB {
+   public:
+    Handshake(McHandshakeThread& thread,
+              folly::AsyncSSLSocket::UniquePtr socket,
+              AsyncMcServerWorker& worker,
+              folly::EventBase& workerEvb)
+        : thread_(thread),
+          socket_(std::move(socket)),
+          worker_(worker),
+          workerEvb_(workerEvb) {
+    }
+
+    void start() {
+      socket_->sslAccept(this, /* timeout = */ 0);
+    }
+
+    bool handshakeVer(folly::AsyncSSLSocket* sock,
+                      bool preverifyOk,
+                      X509_STORE_CTX* ctx) noexcept override {
+      return verifySSLClientCert(preverifyOk, ctx);
+    }
+
+    void handshakeSuc(folly::AsyncSSLSocket* sock) noexcept override {
+      // The socket isn't detachable until it's done processing the
+      // handshake, so move it from the next loop iteration.
+      auto& thread = thread_;
+      thread.evb_.runInLoop([&thread, handshake = this] () {
+        auto it = thread.pending_.find(handshake);
+        if (it == thread.pending_.end()) {
+          // Abandoned on stop()
+          return;
+        }
+        handshake->handOff();
+        thread.pending_.erase(it);
+      });
+    }
+
+    void handshakeErr(
+        folly::AsyncSSLSocket* sock,
+        const folly::AsyncSocketException& ex) noexcept override {
+      thread_.pending_.erase(this);
+    }
+
+   private:
+    McHandshakeThread& thread_;
+    folly::AsyncSSLSocket::UniquePtr socket_;
+    AsyncMcServerWorker& worker_;
+    folly::EventBase& workerEvb_;
+
+    void handOff() {
+      socket_->detachEventBase();
+      auto socket = socket_.release();
+      auto& worker = worker_;
+      auto& workerEvb = workerEvb_;
+      workerEvb.runInEventBaseThread([socket, &worker, &workerEvb] () {
+        folly::AsyncSocket::UniquePtr socketPtr(socket);
+        socketPtr->attachEventBase(&workerEvb);
+        if (worker.isAlive()) {
+          worker.addClientSocket(std::move(socketPtr));
+        }
+      });
+    }
+  };
+
+  /* Outlives evb_, whose destructor may still run loop callbacks */
+  std::unordered_map<Handshake*, std::unique_ptr<Handshake>> pending_;
+  folly::EventBase evb_;
+  std::thread thread_;
+};
+
 class McServerThread {
  public:
   explicit McServerThread(AsyncMcServer& server)
@@ -70,22 +238,51 @@ class McServerThread {
 
   enum AcceptorT { Acceptor };
 
+  /**
+   * @param handlesSignals  If true, this thread is the one that gets woken
+   *                        up by shutdownFromSignalHandler().
+   */
   McServerThread(
     AcceptorT,
-    AsyncMcServer& server)
+    AsyncMcServer& server,
+    bool handlesSignals)
       : server_(server),
         evb_(/* enableTimeMeasurement */ false),
         worker_(server.opts_.worker, evb_),
         acceptCallback_(this, false),
         sslAcceptCallback_(this, true),
-        accepting_(true),
-        shutdownPipe_(folly::make_unique<ShutdownPipe>(server, evb_)) {
+        accepting_(true) {
+    if (handlesSignals) {
+      shutdownPipe_ = folly::make_unique<ShutdownPipe>(server, evb_);
+    }
   }
 
   folly::EventBase& eventBase() {
     return evb_;
   }
 
+  /* Before spawn() only */
+  void addShmChannel(std::shared_ptr<ShmChannel> channel) {
+    shmChannels_.push_back(std::move(channel));
+  }
+
+  /* Only valid once the acceptor is setup, until shutdown */
+  void listeningSockets(std::vector<int>& sockets,
+                        std::vector<int>& sslSockets) const {
+    if (socket_) {
+      auto fds = socket_->getSockets();
+      sockets.insert(sockets.end(), fds.begin(), fds.end());
+    }
+    if (unixSocket_) {
+      auto fds = unixSocket_->getSockets();
+      sockets.insert(sockets.end(), fds.begin(), fds.end());
+    }
+    if (sslSocket_) {
+      auto fds = sslSocket_->getSockets();
+      sslSockets.insert(sslSockets.end(), fds.begin(), fds.end());
+    }
+  }
+
   void waitForAcceptor() {
     std::unique_lock<std::mutex> lock(acceptorLock_);
     acceptorCv_.wait(lock, [this] () { return acceptorSetup_; });
@@ -103,6 +300,11 @@ class McServerThread {
 
     thread_ = std::thread{
       [fn, threadId, this] (){
+        const auto& cpus = server_.opts_.threadCpus;
+        if (!cpus.empty()) {
+          bind_thread_to_cpu(cpus[threadId % cpus.size()]);
+        }
+
         if (accepting_) {
           startAccepting();
 
@@ -111,6 +313,10 @@ class McServerThread {
           }
         }
 
+        for (auto& channel : shmChannels_) {
+          serveShmChannel(channel);
+        }
+
         fn(threadId, evb_, worker_);
 
         // Detach the server sockets from the acceptor thread.
@@ -119,6 +325,7 @@ class McServerThread {
         // socket destructor runs after the threads' destructors.
         if (accepting_) {
           socket_.reset();
+          unixSocket_.reset();
           sslSocket_.reset();
         }
       }};
@@ -130,6 +337,7 @@ class McServerThread {
       [&] () {
         if (accepting_) {
           socket_.reset();
+          unixSocket_.reset();
           sslSocket_.reset();
         }
         if (shutdownPipe_) {
@@ -161,14 +369,35 @@ class McServerThread {
     void connectionAccepted(
         int fd,
         const folly::SocketAddress& clientAddr) noexcept override {
+      mcServerThread_->worker_.admitConnection(fd, [this, fd] () {
+        startSession(fd);
+      });
+    }
+    void acceptError(const std::exception& ex) noexcept override {
+      LOG(ERROR) << "Connection accept error: " << ex.what();
+    }
+   private:
+    McServerThread* mcServerThread_{nullptr};
+    bool secure_{false};
+
+    void startSession(int fd) {
       if (secure_) {
         auto& opts = mcServerThread_->server_.opts_;
         auto sslCtx = getSSLContext(opts.pemCertPath, opts.pemKeyPath,
                                     opts.pemCaPath);
+        auto& handshakeThreads = mcServerThread_->server_.handshakeThreads_;
         if (sslCtx) {
           sslCtx->setVerificationOption(
             folly::SSLContext::SSLVerifyPeerEnum::VERIFY_REQ_CLIENT_CERT);
-          mcServerThread_->worker_.addSecureClientSocket(fd, std::move(sslCtx));
+          if (!handshakeThreads.empty()) {
+            auto id = mcServerThread_->nextHandshakeThread_++;
+            handshakeThreads[id % handshakeThreads.size()]->accept(
+              fd, std::move(sslCtx), mcServerThread_->worker_,
+              mcServerThread_->evb_);
+          } else {
+            mcServerThread_->worker_.addSecureClientSocket(
+              fd, std::move(sslCtx));
+          }
         } else {
           ::close(fd);
         }
@@ -176,12 +405,6 @@ class McServerThread {
         mcServerThread_->worker_.addClientSocket(fd);
       }
     }
-    void acceptError(const std::exception& ex) noexcept override {
-      LOG(ERROR) << "Connection accept error: " << ex.what();
-    }
-   private:
-    McServerThread* mcServerThread_{nullptr};
-    bool secure_{false};
   };
 
   AsyncMcServer& server_;
@@ -192,6 +415,8 @@ class McServerThread {
   AcceptCallback sslAcceptCallback_;
 
   bool accepting_{false};
+  /* Round robin over server_.handshakeThreads_ */
+  size_t nextHandshakeThread_{0};
 
   std::mutex acceptorLock_;
   std::condition_variable acceptorCv_;
@@ -200,9 +425,30 @@ class McServerThread {
   std::exception_ptr spawnException_;
 
   folly::AsyncServerSocket::UniquePtr socket_;
+  /* AsyncServerSocket binds addresses of a single family only */
+  folly::AsyncServerSocket::UniquePtr unixSocket_;
   folly::AsyncServerSocket::UniquePtr sslSocket_;
   std::unique_ptr<ShutdownPipe> shutdownPipe_;
 
+  std::vector<std::shared_ptr<ShmChannel>> shmChannels_;
+
+  /* One session at a time per channel, a new one once it's gone */
+  void serveShmChannel(std::shared_ptr<ShmChannel> channel) {
+    if (!worker_.isAlive()) {
+      return;
+    }
+    ShmRingTransport::UniquePtr transport(
+      new ShmRingTransport(evb_, channel, ShmRingTransport::Side::SERVER));
+    transport->setOnDestroyed([this, channel] () {
+      if (worker_.isAlive()) {
+        evb_.runInLoop([this, channel] () {
+          serveShmChannel(channel);
+        });
+      }
+    });
+    worker_.addClientTransport(std::move(transport));
+  }
+
   void startAccepting() {
     CHECK(accepting_);
     try {
@@ -211,6 +457,8 @@ class McServerThread {
       if (opts.existingSocketFd != -1) {
         checkLogic(opts.ports.empty() && opts.sslPorts.empty(),
                    "Can't use ports if using existing socket");
+        checkLogic(!opts.reusePort,
+                   "Can't use reusePort if using existing socket");
         if (!opts.pemCertPath.empty() || !opts.pemKeyPath.empty() ||
             !opts.pemCaPath.empty()) {
           checkLogic(
@@ -225,12 +473,35 @@ class McServerThread {
           socket_.reset(new folly::AsyncServerSocket());
           socket_->useExistingSocket(opts.existingSocketFd);
         }
+      } else if (!opts.existingSockets.empty() ||
+                 !opts.existingSslSockets.empty()) {
+        checkLogic(opts.ports.empty() && opts.sslPorts.empty() &&
+                   opts.unixSockets.empty(),
+                   "Can't use ports if using existing sockets");
+        checkLogic(!opts.reusePort,
+                   "Can't use reusePort if using existing sockets");
+        if (!opts.existingSockets.empty()) {
+          socket_.reset(new folly::AsyncServerSocket());
+          socket_->useExistingSockets(opts.existingSockets);
+        }
+        if (!opts.existingSslSockets.empty()) {
+          checkLogic(!opts.pemCertPath.empty() && !opts.pemKeyPath.empty() &&
+                     !opts.pemCaPath.empty(),
+                     "All of pemCertPath, pemKeyPath, pemCaPath required"
+                     " with existingSslSockets");
+
+          sslSocket_.reset(new folly::AsyncServerSocket());
+          sslSocket_->useExistingSockets(opts.existingSslSockets);
+        }
       } else {
         checkLogic(!server_.opts_.ports.empty() ||
-                   !server_.opts_.sslPorts.empty(),
-                   "At least one port (plain or SSL) must be speicified");
+                   !server_.opts_.sslPorts.empty() ||
+                   !server_.opts_.unixSockets.empty(),
+                   "At least one port (plain or SSL) or unix socket must be "
+                   "specified");
         if (!server_.opts_.ports.empty()) {
           socket_.reset(new folly::AsyncServerSocket());
+          socket_->setReusePortEnabled(server_.opts_.reusePort);
           for (auto port : server_.opts_.ports) {
             socket_->bind(port);
           }
@@ -243,29 +514,64 @@ class McServerThread {
                      " with sslPorts");
 
           sslSocket_.reset(new folly::AsyncServerSocket());
+          sslSocket_->setReusePortEnabled(server_.opts_.reusePort);
           for (auto sslPort : server_.opts_.sslPorts) {
             sslSocket_->bind(sslPort);
           }
         }
       }
 
+      if (!opts.unixSockets.empty()) {
+        checkLogic(!opts.reusePort, "Can't use reusePort with unix sockets");
+        std::vector<int> fds;
+        for (const auto& path : opts.unixSockets) {
+          fds.push_back(bindUnixSocket(path));
+        }
+        unixSocket_.reset(new folly::AsyncServerSocket());
+        unixSocket_->useExistingSockets(fds);
+      }
+
       if (socket_) {
-        socket_->listen(SOMAXCONN);
+        if (opts.tcpDeferAcceptSecs > 0) {
+          setDeferAccept(*socket_, opts.tcpDeferAcceptSecs);
+        }
+        socket_->listen(opts.listenBacklog);
         socket_->startAccepting();
         socket_->attachEventBase(&evb_);
       }
+      if (unixSocket_) {
+        unixSocket_->listen(opts.listenBacklog);
+        unixSocket_->startAccepting();
+        unixSocket_->attachEventBase(&evb_);
+      }
       if (sslSocket_) {
-        sslSocket_->listen(SOMAXCONN);
+        if (opts.tcpDeferAcceptSecs > 0) {
+          setDeferAccept(*sslSocket_, opts.tcpDeferAcceptSecs);
+        }
+        sslSocket_->listen(opts.listenBacklog);
         sslSocket_->startAccepting();
         sslSocket_->attachEventBase(&evb_);
       }
 
-      for (auto& t : server_.threads_) {
+      if (opts.reusePort) {
+        // Connections accepted by this thread are handled by it, inline.
         if (socket_ != nullptr) {
-          socket_->addAcceptCallback(&t->acceptCallback_, &t->evb_);
+          socket_->addAcceptCallback(&acceptCallback_, nullptr);
         }
         if (sslSocket_ != nullptr) {
-          sslSocket_->addAcceptCallback(&t->sslAcceptCallback_, &t->evb_);
+          sslSocket_->addAcceptCallback(&sslAcceptCallback_, nullptr);
+        }
+      } else {
+        for (auto& t : server_.threads_) {
+          if (socket_ != nullptr) {
+            socket_->addAcceptCallback(&t->acceptCallback_, &t->evb_);
+          }
+          if (unixSocket_ != nullptr) {
+            unixSocket_->addAcceptCallback(&t->acceptCallback_, &t->evb_);
+          }
+          if (sslSocket_ != nullptr) {
+            sslSocket_->addAcceptCallback(&t->sslAcceptCallback_, &t->evb_);
+          }
         }
       }
     } catch (...) {
@@ -290,24 +596,56 @@ AsyncMcServer::~AsyncMcServer() {
 
   /* In case some signal handlers are still registered */
   gServer = nullptr;
+
+  stopHandshakeThreads();
 }
 
 void AsyncMcServer::spawn(LoopFn fn) {
   CHECK(opts_.numThreads > 0);
 
+  /* Must be running before any SSL connection is accepted */
+  for (size_t i = 0; i < opts_.numHandshakeThreads; ++i) {
+    handshakeThreads_.emplace_back(folly::make_unique<McHandshakeThread>());
+  }
+
   threads_.emplace_back(folly::make_unique<McServerThread>(
-                          McServerThread::Acceptor, *this));
+                          McServerThread::Acceptor, *this,
+                          /* handlesSignals= */ true));
   for (size_t i = 1; i < opts_.numThreads; ++i) {
-    threads_.emplace_back(folly::make_unique<McServerThread>(*this));
+    if (opts_.reusePort) {
+      threads_.emplace_back(folly::make_unique<McServerThread>(
+                              McServerThread::Acceptor, *this,
+                              /* handlesSignals= */ false));
+    } else {
+      threads_.emplace_back(folly::make_unique<McServerThread>(*this));
+    }
+  }
+
+  for (size_t i = 0; i < opts_.shmChannels.size(); ++i) {
+    threads_[i % threads_.size()]->addShmChannel(
+      ShmChannel::create(opts_.shmChannels[i], opts_.shmRingCapacity));
   }
 
-  /* We need to make sure we register all acceptor callbacks before
-     running spawn() on other threads. This is so that eventBase.loop()
-     never exits immediately on non-acceptor threads. */
-  threads_[0]->spawn(fn, 0);
-  threads_[0]->waitForAcceptor();
-  for (size_t id = 1; id < threads_.size(); ++id) {
-    threads_[id]->spawn(fn, id);
+  if (opts_.reusePort) {
+    /* Every thread listens on its own sockets; wait for each one so that
+       bind errors are reported from here. */
+    for (size_t id = 0; id < threads_.size(); ++id) {
+      threads_[id]->spawn(fn, id);
+      threads_[id]->waitForAcceptor();
+    }
+  } else {
+    /* We need to make sure we register all acceptor callbacks before
+       running spawn() on other threads. This is so that eventBase.loop()
+       never exits immediately on non-acceptor threads. */
+    threads_[0]->spawn(fn, 0);
+    threads_[0]->waitForAcceptor();
+    {
+      std::lock_guard<std::mutex> lock(shutdownLock_);
+      threads_[0]->listeningSockets(sockets_, sslSockets_);
+    }
+    for (size_t id = 1; id < threads_.size(); ++id) {
+      threads_[id]->spawn(fn, id);
+    }
   }
 
   /* We atomically attempt to change the state STARTUP -> SPAWNED.
@@ -325,6 +663,16 @@ void AsyncMcServer::spawn(LoopFn fn) {
              SignalShutdownState::SPAWNED));
 }
 
+void AsyncMcServer::listeningSockets(std::vector<int>& sockets,
+                                     std::vector<int>& sslSockets) {
+  checkLogic(!opts_.reusePort,
+             "Can't hand over listening sockets with reusePort");
+  std::lock_guard<std::mutex> lock(shutdownLock_);
+  checkLogic(alive_, "Server is shutting down");
+  sockets = sockets_;
+  sslSockets = sslSockets_;
+}
+
 void AsyncMcServer::shutdown() {
   std::lock_guard<std::mutex> lock(shutdownLock_);
   if (!alive_) {
@@ -334,9 +682,17 @@ void AsyncMcServer::shutdown() {
   for (auto& thread : threads_) {
     thread->shutdown();
   }
+  /* Handshakes that complete from now on are dropped by the workers */
+  stopHandshakeThreads();
   alive_ = false;
 }
 
+void AsyncMcServer::stopHandshakeThreads() {
+  for (auto& thread : handshakeThreads_) {
+    thread->stop();
+  }
+}
+
 void AsyncMcServer::installShutdownHandler(const std::vector<int>& signals) {
   gServer = this;
 
@@ -9,6 +9,8 @@
  */
 #pragma once
 
+#include <sys/socket.h>
+
 #include <atomic>
 #include <cstdint>
 #include <memory>
@@ -25,6 +27,7 @@ class EventBase;
 namespace facebook { namespace memcache {
 
 class AsyncMcServerWorker;
+class McHandshakeThread;
 class McServerThread;
 
 /**
@@ -45,6 +48,15 @@ class AsyncMcServer {
      */
     int existingSocketFd{-1};
 
+    /**
+     * Take over listening sockets of another server
+     * (see listeningSockets()), plain and SSL ones.
+     * If these are used, ports, sslPorts and existingSocketFd must be
+     * unset, and all of pem* paths must be set for existingSslSockets.
+     */
+    std::vector<int> existingSockets;
+    std::vector<int> existingSslSockets;
+
     /**
      * The list of ports to listen on.
      * If this is used, existingSocketFd must be unset (-1).
@@ -57,6 +69,28 @@ class AsyncMcServer {
      */
     std::vector<uint16_t> sslPorts;
 
+    /**
+     * Paths of unix domain sockets to listen on, in addition to ports
+     * (plain connections only). A file left at the path by a previous
+     * server is removed first.
+     * Can't be used with existingSockets (they include unix sockets of the
+     * server taken over) or reusePort.
+     */
+    std::vector<std::string> unixSockets;
+
+    /**
+     * Paths of shared memory channels (see ShmChannel) to create, each
+     * serving one local client process at a time over the umbrella
+     * protocol. Channel i is served by thread i mod numThreads, which
+     * polls it on every loop iteration while it's busy.
+     */
+    std::vector<std::string> shmChannels;
+
+    /**
+     * Bytes in each direction of a shared memory channel.
+     */
+    size_t shmRingCapacity{1 << 20};
+
     /**
      * SSL cert/key/CA paths.
      * If sslPorts is non-empty, these must also be nonempty.
@@ -70,6 +104,44 @@ class AsyncMcServer {
      */
     size_t numThreads{1};
 
+    /**
+     * If true, every thread binds its own listening sockets to all of
+     * ports/sslPorts with SO_REUSEPORT and accepts connections itself,
+     * so the kernel spreads connections across threads and there is
+     * no handoff from a single acceptor thread.
+     * Can't be used with existingSocketFd.
+     */
+    bool reusePort{false};
+
+    /**
+     * If not empty, thread i is pinned to CPU threadCpus[i % size],
+     * e.g. to keep each thread next to its NIC queue.
+     */
+    std::vector<int> threadCpus;
+
+    /**
+     * If positive, TLS handshakes of connections accepted on SSL ports
+     * run on this many dedicated threads, and only established sessions
+     * are handed to the server threads. Keeps reconnect storms from
+     * stalling request processing.
+     */
+    size_t numHandshakeThreads{0};
+
+    /**
+     * listen() backlog of the listening sockets. A short backlog makes
+     * the kernel drop connections over it (clients retry their SYNs
+     * later) instead of queueing them, spreading a reconnect storm.
+     */
+    int listenBacklog{SOMAXCONN};
+
+    /**
+     * If positive, TCP_DEFER_ACCEPT is set on the listening TCP sockets:
+     * the kernel only hands over connections once the client sent some
+     * data (or this many seconds passed), so idle connects cost no
+     * accept and session setup.
+     */
+    int tcpDeferAcceptSecs{0};
+
     /**
      * Worker-specific options
      */
@@ -97,6 +169,17 @@ class AsyncMcServer {
    */
   void spawn(LoopFn fn);
 
+  /**
+   * Listening sockets of the running server, e.g. to be handed over to
+   * Options::existingSockets of another process. They are still owned,
+   * and closed on shutdown, by this server.
+   * Can only be called after spawn(), not supported with reusePort.
+   *
+   * @throws std::logic_error  If called after shutdown() or with reusePort.
+   */
+  void listeningSockets(std::vector<int>& sockets,
+                        std::vector<int>& sslSockets);
+
   /**
    * Start shutting down all processing gracefully.  Will ensure that any
    * pending requests are replied, and any writes on the sockets complete.
@@ -132,9 +215,14 @@ class AsyncMcServer {
  private:
   Options opts_;
   std::vector<std::unique_ptr<McServerThread>> threads_;
+  /* Declared after threads_: must stop before server threads go away */
+  std::vector<std::unique_ptr<McHandshakeThread>> handshakeThreads_;
 
   bool alive_{true};
   std::mutex shutdownLock_;
+  /* Set by spawn(), guarded by shutdownLock_ */
+  std::vector<int> sockets_;
+  std::vector<int> sslSockets_;
 
   enum class SignalShutdownState : uint64_t {
     STARTUP,
@@ -147,6 +235,8 @@ class AsyncMcServer {
   AsyncMcServer(const AsyncMcServer&) = delete;
   AsyncMcServer& operator=(const AsyncMcServer&) = delete;
 
+  void stopHandshakeThreads();
+
   friend class McServerThread;
 };
 
@@ -9,6 +9,10 @@
  */
 #include "AsyncMcServerWorker.h"
 
+#include <unistd.h>
+
+#include <vector>
+
 #include <folly/io/async/EventBase.h>
 #include <folly/Memory.h>
 #include <folly/io/async/AsyncSocket.h>
@@ -16,6 +20,7 @@
 #include <folly/io/async/SSLContext.h>
 
 #include "mcrouter/lib/network/McServerSession.h"
+#include "mcrouter/lib/network/McSSLUtil.h"
 
 namespace facebook { namespace memcache {
 namespace {
@@ -26,34 +31,7 @@ class SimpleHandshakeCallback : public AsyncSSLSocket::HandshakeCB {
   bool handshakeVer(AsyncSSLSocket* sock,
                     bool preverifyOk,
                     X509_STORE_CTX* ctx) noexcept override {
-    if (!preverifyOk) {
-      return false;
-    }
-    // XXX I'm assuming that this will be the case as a result of
-    // preverifyOk being true
-    DCHECK(X509_STORE_CTX_get_error(ctx) == X509_V_OK);
-
-    // So the interesting thing is that this always returns the depth of
-    // the cert it's asking you to verify, and the error_ assumes to be
-    // just a poorly named function.
-    auto certDepth = X509_STORE_CTX_get_error_depth(ctx);
-
-    // Depth is numbered from the peer cert going up.  For anything in the
-    // chain, let's just leave it to openssl to figure out it's validity.
-    // We may want to limit the chain depth later though.
-    if (certDepth != 0) {
-      return preverifyOk;
-    }
-
-    auto cert = X509_STORE_CTX_get_current_cert(ctx);
-    sockaddr_storage addrStorage;
-    socklen_t addrLen = 0;
-    if (!folly::OpenSSLUtils::getPeerAddressFromX509StoreCtx(
-            ctx, &addrStorage, &addrLen)) {
-      return false;
-    }
-    return folly::OpenSSLUtils::validatePeerCertNames(
-        cert, reinterpret_cast<sockaddr*>(&addrStorage), addrLen);
+    return verifySSLClientCert(preverifyOk, ctx);
   }
   void handshakeSuc(AsyncSSLSocket *sock) noexcept override { }
   void handshakeErr(
@@ -67,7 +45,18 @@ SimpleHandshakeCallback simpleHandshakeCallback;
 AsyncMcServerWorker::AsyncMcServerWorker(AsyncMcServerWorkerOptions opts,
                                          folly::EventBase& eventBase)
     : opts_(std::move(opts)),
-      eventBase_(eventBase) {
+      eventBase_(eventBase),
+      memoryTracker_(opts_, eventBase_, sessions_),
+      admission_(opts_, eventBase_, sessions_) {
+}
+
+void AsyncMcServerWorker::admitConnection(int fd,
+                                          std::function<void()> start) {
+  if (!isAlive_) {
+    ::close(fd);
+    return;
+  }
+  admission_.admit(fd, std::move(start));
 }
 
 void AsyncMcServerWorker::addSecureClientSocket(
@@ -90,6 +79,16 @@ void AsyncMcServerWorker::addClientSocket(int fd, void* userCtxt) {
 void AsyncMcServerWorker::addClientSocket(
     folly::AsyncSocket::UniquePtr&& socket,
     void* userCtxt) {
+  socket->setSendTimeout(opts_.sendTimeout.count());
+  socket->setMaxReadsPerEvent(opts_.maxReadsPerEvent);
+  socket->setNoDelay(true);
+
+  addClientTransport(std::move(socket), userCtxt);
+}
+
+void AsyncMcServerWorker::addClientTransport(
+    folly::AsyncTransportWrapper::UniquePtr&& transport,
+    void* userCtxt) {
   if (!onRequest_) {
     throw std::logic_error("can't add a socket without onRequest callback");
   }
@@ -98,13 +97,9 @@ void AsyncMcServerWorker::addClientSocket(
     onAccepted_();
   }
 
-  socket->setSendTimeout(opts_.sendTimeout.count());
-  socket->setMaxReadsPerEvent(opts_.maxReadsPerEvent);
-  socket->setNoDelay(true);
-
-  sessions_.push_back(
+  auto& session =
     McServerSession::create(
-      std::move(socket),
+      std::move(transport),
       onRequest_,
       onWriteQuiescence_,
       [this] (McServerSession& session) {
@@ -115,8 +110,40 @@ void AsyncMcServerWorker::addClientSocket(
       },
       onShutdown_,
       opts_,
-      userCtxt
-    ));
+      userCtxt,
+      &writeStats_,
+      &memoryTracker_
+    );
+  sessions_.push_back(session);
+  if (readsPaused_) {
+    session.pause(McServerSession::PAUSE_CREDITS);
+  }
+}
+
+void AsyncMcServerWorker::pauseReads() {
+  if (readsPaused_) {
+    return;
+  }
+  readsPaused_ = true;
+  ++numReadPauses_;
+  for (auto& session : sessions_) {
+    session.pause(McServerSession::PAUSE_CREDITS);
+  }
+}
+
+void AsyncMcServerWorker::resumeReads() {
+  if (!readsPaused_) {
+    return;
+  }
+  readsPaused_ = false;
+  /* Resuming reads might close sessions, removing them from sessions_ */
+  std::vector<McServerSession*> paused;
+  for (auto& session : sessions_) {
+    paused.push_back(&session);
+  }
+  for (auto session : paused) {
+    session->resume(McServerSession::PAUSE_CREDITS);
+  }
 }
 
 void AsyncMcServerWorker::shutdown() {
@@ -125,6 +152,7 @@ void AsyncMcServerWorker::shutdown() {
   }
 
   isAlive_ = false;
+  admission_.closeDeferred();
   /* Closing a session might cause it to remove itself from sessions_,
      so we should be careful with the iterator */
   auto it = sessions_.begin();
@@ -10,13 +10,16 @@
 #pragma once
 
 #include <chrono>
+#include <functional>
 #include <memory>
 #include <unordered_set>
 
 #include <folly/io/async/AsyncSocket.h>
 
 #include "mcrouter/lib/network/AsyncMcServerWorkerOptions.h"
+#include "mcrouter/lib/network/McServerAdmission.h"
 #include "mcrouter/lib/network/McServerRequestContext.h"
+#include "mcrouter/lib/network/McServerMemoryTracker.h"
 #include "mcrouter/lib/network/McServerSession.h"
 
 namespace folly {
@@ -54,6 +57,23 @@ class AsyncMcServerWorker {
       const std::shared_ptr<folly::SSLContext>& context,
       void* userCtxt = nullptr);
 
+  /**
+   * Moves in ownership of a set up socket, e.g. an AsyncSSLSocket that
+   * finished its handshake elsewhere. The socket must be attached
+   * to this worker's eventBase.
+   */
+  void addClientSocket(
+      folly::AsyncSocket::UniquePtr&& socket,
+      void* userCtxt = nullptr);
+
+  /**
+   * Moves in ownership of a transport other than a socket, e.g.
+   * a ShmRingTransport. It must be attached to this worker's eventBase.
+   */
+  void addClientTransport(
+      folly::AsyncTransportWrapper::UniquePtr&& transport,
+      void* userCtxt = nullptr);
+
   /**
    * Install onRequest callback to call for all new connections.
    *
@@ -137,11 +157,56 @@ class AsyncMcServerWorker {
    */
   bool writesPending() const;
 
- private:
-  void addClientSocket(
-      folly::AsyncSocket::UniquePtr&& socket,
-      void* userCtxt);
+  /**
+   * Writes done by all sessions of this worker so far.
+   */
+  const McServerWriteStats& writeStats() const {
+    return writeStats_;
+  }
+
+  /**
+   * Bytes buffered by the sessions of this worker and reads paused
+   * because of them.
+   */
+  const McServerMemoryTracker& memoryTracker() const {
+    return memoryTracker_;
+  }
 
+  /**
+   * Admission control of accepted connections (see
+   * AsyncMcServerWorkerOptions::maxConnections and maxAcceptsPerSecond):
+   * calls start, which adds fd to this worker, right away or later,
+   * or closes fd.
+   */
+  void admitConnection(int fd, std::function<void()> start);
+
+  const McServerAdmission& admission() const {
+    return admission_;
+  }
+
+  /**
+   * Flow control from the application (e.g. when it is out of capacity
+   * for new requests): stops reading from all sessions of this worker,
+   * including the ones added before resumeReads(), so that clients are
+   * pushed back through their TCP windows rather than queued for.
+   * Requests already read are still delivered. Both are no-ops if reads
+   * are already in the requested state.
+   */
+  void pauseReads();
+  void resumeReads();
+
+  bool readsPaused() const {
+    return readsPaused_;
+  }
+
+  /**
+   * Number of times pauseReads() paused the reads.
+   */
+  uint64_t numReadPauses() const {
+    return numReadPauses_;
+  }
+
+ private:
   AsyncMcServerWorkerOptions opts_;
   folly::EventBase& eventBase_;
   std::shared_ptr<McServerOnRequest> onRequest_;
@@ -152,9 +217,18 @@ class AsyncMcServerWorker {
 
   bool isAlive_{true};
 
+  bool readsPaused_{false};
+  uint64_t numReadPauses_{0};
+
+  McServerWriteStats writeStats_;
+
   /* Open sessions and closing sessions that still have pending writes */
   McServerSession::Queue sessions_;
 
+  McServerMemoryTracker memoryTracker_;
+
+  McServerAdmission admission_;
+
   AsyncMcServerWorker(const AsyncMcServerWorker&) = delete;
   AsyncMcServerWorker& operator=(const AsyncMcServerWorker&) = delete;
 
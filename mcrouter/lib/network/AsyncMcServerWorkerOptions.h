@@ -71,6 +71,12 @@ struct AsyncMcServerWorkerOptions {
    */
   size_t maxBufferSize{4096};
 
+  /**
+   * If true, ASCII requests are parsed by McServerAsciiParser instead of
+   * the legacy mc_parser.
+   */
+  bool useNewAsciiParser{false};
+
   /**
    * If true, we attempt to write every reply to the socket
    * immediately.  If the write cannot be fully completed (i.e. not
@@ -78,6 +84,63 @@ struct AsyncMcServerWorkerOptions {
    * is completed.
    */
   bool singleWrite{false};
+
+  /**
+   * Has no effect if singleWrite is set.
+   *
+   * If 0, replies are written in a single writev() at the end of the event
+   * loop iteration they were produced in. Otherwise replies are
+   * accumulated for up to this long after the first unwritten reply,
+   * so that replies produced in later loop iterations go into the same
+   * writev(). The event loop doesn't block while replies are waiting,
+   * so this should be small (tens of microseconds).
+   */
+  std::chrono::microseconds writeFlushDelay{0};
+
+  /**
+   * Has no effect if singleWrite is set.
+   *
+   * If non-zero, accumulated replies are written out as soon as they
+   * take at least this many bytes.
+   */
+  size_t writeFlushBytes{0};
+
+  /**
+   * If non-zero, once the sessions of a worker buffer more than this many
+   * bytes (request values not replied yet, replies not written yet),
+   * reads are paused on the sessions buffering the most, see
+   * McServerMemoryTracker.
+   */
+  size_t memoryHighWatermark{0};
+
+  /**
+   * Reads paused because of memoryHighWatermark resume once the worker's
+   * sessions buffer less than this. If 0, 3/4 of memoryHighWatermark.
+   */
+  size_t memoryLowWatermark{0};
+
+  /**
+   * Same as memoryHighWatermark and memoryLowWatermark, for the bytes
+   * buffered by all workers of the process.
+   */
+  size_t processMemoryHighWatermark{0};
+  size_t processMemoryLowWatermark{0};
+
+  /**
+   * If non-zero, connections accepted while the worker has this many
+   * sessions are closed right away.
+   */
+  size_t maxConnections{0};
+
+  /**
+   * If non-zero, at most this many new sessions are started per second,
+   * so that a flood of new connections (e.g. a client fleet restarting)
+   * doesn't starve requests on established ones. Connections over the rate
+   * wait to be started, up to maxDeferredAccepts of them; further ones are
+   * closed. See McServerAdmission.
+   */
+  size_t maxAcceptsPerSecond{0};
+  size_t maxDeferredAccepts{1024};
 };
 
 }}  // facebook::memcache
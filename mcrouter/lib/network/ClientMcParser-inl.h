@@ -16,11 +16,16 @@ ClientMcParser<Callback>::ClientMcParser(Callback& cb,
                                          size_t requestsPerRead,
                                          size_t minBufferSize,
                                          size_t maxBufferSize,
-                                         bool useNewAsciiParser)
+                                         bool useNewAsciiParser,
+                                         bool useAsciiReplyFastPath,
+                                         bool metaProtocol)
   : parser_(*this, requestsPerRead, minBufferSize, maxBufferSize),
-    useNewParser_(useNewAsciiParser),
+    metaProtocol_(metaProtocol),
+    useNewParser_(useNewAsciiParser || metaProtocol),
     callback_(cb) {
-  if (!useNewParser_) {
+  if (useNewParser_) {
+    asciiParser_.setFastPathEnabled(useAsciiReplyFastPath);
+  } else {
     mc_parser_init(&mcParser_,
                    reply_parser,
                    &parserMsgReady,
@@ -38,7 +43,8 @@ ClientMcParser<Callback>::~ClientMcParser() {
 
 template <class Callback>
 std::pair<void*, size_t> ClientMcParser<Callback>::getReadBuffer() {
-  if (useNewParser_ && parser_.protocol() == mc_ascii_protocol &&
+  if (useNewParser_ && !metaProtocol_ &&
+      parser_.protocol() == mc_ascii_protocol &&
       asciiParser_.hasReadBuffer()) {
     return asciiParser_.getReadBuffer();
   } else {
@@ -48,7 +54,8 @@ std::pair<void*, size_t> ClientMcParser<Callback>::getReadBuffer() {
 
 template <class Callback>
 bool ClientMcParser<Callback>::readDataAvailable(size_t len) {
-  if (useNewParser_ && parser_.protocol() == mc_ascii_protocol &&
+  if (useNewParser_ && !metaProtocol_ &&
+      parser_.protocol() == mc_ascii_protocol &&
       asciiParser_.hasReadBuffer()) {
     asciiParser_.readDataAvailable(len);
     return true;
@@ -60,7 +67,10 @@ bool ClientMcParser<Callback>::readDataAvailable(size_t len) {
 template <class Callback>
 template <class Operation, class Request>
 void ClientMcParser<Callback>::expectNext() {
-  if (useNewParser_ && parser_.protocol() == mc_ascii_protocol) {
+  if (metaProtocol_) {
+    metaParser_.initializeReplyParser<Operation, Request>();
+    replyForwarder_ = &ClientMcParser<Callback>::forwardMetaReply;
+  } else if (useNewParser_ && parser_.protocol() == mc_ascii_protocol) {
     asciiParser_.initializeReplyParser<Operation, Request>();
     replyForwarder_ =
       &ClientMcParser<Callback>::forwardAsciiReply<Operation, Request>;
@@ -84,34 +94,42 @@ void ClientMcParser<Callback>::forwardAsciiReply() {
   replyForwarder_ = nullptr;
 }
 
+template <class Callback>
+void ClientMcParser<Callback>::forwardMetaReply() {
+  parser_.reportMsgRead();
+  callback_.replyReady(metaParser_.getReply(), 0 /* reqId */);
+  replyForwarder_ = nullptr;
+}
+
 template <class Callback>
 bool ClientMcParser<Callback>::umMessageReady(const UmbrellaMessageInfo& info,
                                               const uint8_t* header,
                                               const uint8_t* body,
                                               const folly::IOBuf& bodyBuffer) {
-  auto mutMsg = createMcMsgRef();
+  /* Parsed on the stack, most replies don't need a mc_msg_t at all */
+  mc_msg_t msg;
+  mc_msg_init_not_refcounted(&msg);
   uint64_t reqid;
   auto st = um_consume_no_copy(header, info.headerSize, body, info.bodySize,
-                               &reqid, mutMsg.get());
+                               &reqid, &msg);
   if (st != um_ok) {
+    /* Releases whatever was parsed so far */
+    umbrellaReplyFromMsg(msg);
     callback_.parseError(mc_res_remote_error, "Error parsing Umbrella message");
     return false;
   }
 
   folly::IOBuf value;
-  if (mutMsg->value.len != 0) {
+  if (msg.value.len != 0) {
     if (!cloneInto(value, bodyBuffer,
-                   reinterpret_cast<uint8_t*>(mutMsg->value.str),
-                   mutMsg->value.len)) {
+                   reinterpret_cast<uint8_t*>(msg.value.str),
+                   msg.value.len)) {
+      umbrellaReplyFromMsg(msg);
       callback_.parseError(mc_res_remote_error, "Error parsing Umbrella value");
       return false;
     }
-    // Reset msg->value, or it will confuse McReply::releasedMsg
-    mutMsg->value.str = nullptr;
-    mutMsg->value.len = 0;
   }
-  McMsgRef msg(std::move(mutMsg));
-  auto reply = McReply(msg->result, msg.clone());
+  auto reply = umbrellaReplyFromMsg(msg);
   if (value.length() != 0) {
     reply.setValue(std::move(value));
   }
@@ -121,7 +139,9 @@ bool ClientMcParser<Callback>::umMessageReady(const UmbrellaMessageInfo& info,
 
 template <class Callback>
 void ClientMcParser<Callback>::handleAscii(folly::IOBuf& readBuffer) {
-  if (useNewParser_) {
+  if (metaProtocol_) {
+    handleMeta(readBuffer);
+  } else if (useNewParser_) {
     while (readBuffer.length()) {
       if (asciiParser_.getCurrentState() == McAsciiParser::State::UNINIT) {
         // Ask the client to initialize parser.
@@ -168,6 +188,36 @@ void ClientMcParser<Callback>::handleAscii(folly::IOBuf& readBuffer) {
   }
 }
 
+template <class Callback>
+void ClientMcParser<Callback>::handleMeta(folly::IOBuf& readBuffer) {
+  while (readBuffer.length()) {
+    if (metaParser_.getCurrentState() == McMetaParser::State::UNINIT) {
+      // Ask the client to initialize parser.
+      if (!callback_.nextReplyAvailable(0 /* reqId */)) {
+        callback_.parseError(mc_res_local_error,
+                             "Received unexpected meta protocol data");
+        return;
+      }
+    }
+    switch (metaParser_.consume(readBuffer)) {
+      case McMetaParser::State::COMPLETE:
+        (this->*replyForwarder_)();
+        break;
+      case McMetaParser::State::ERROR:
+        callback_.parseError(mc_res_local_error,
+                             "Error parsing meta protocol");
+        return;
+      case McMetaParser::State::PARTIAL:
+        // Buffer was completely consumed.
+        break;
+      case McMetaParser::State::UNINIT:
+        callback_.parseError(mc_res_local_error,
+                             "Internal meta protocol parser error.");
+        return;
+    }
+  }
+}
+
 template <class Callback>
 void ClientMcParser<Callback>::parseError(mc_res_t result,
                                           folly::StringPiece reason) {
@@ -11,6 +11,7 @@
 
 #include "mcrouter/lib/network/McParser.h"
 #include "mcrouter/lib/network/McAsciiParser.h"
+#include "mcrouter/lib/network/McMetaParser.h"
 
 namespace facebook { namespace memcache {
 
@@ -21,7 +22,9 @@ class ClientMcParser : private McParser::ParserCallback {
                  size_t requestsPerRead,
                  size_t minBufferSize,
                  size_t maxBufferSize,
-                 bool useNewAsciiParser);
+                 bool useNewAsciiParser,
+                 bool useAsciiReplyFastPath,
+                 bool metaProtocol = false);
 
   ~ClientMcParser() override;
 
@@ -51,9 +54,41 @@ class ClientMcParser : private McParser::ParserCallback {
    */
   template <class Operation, class Request>
   void expectNext();
+
+  /**
+   * True iff the next read goes straight into the value of the reply
+   * being parsed (new ASCII parser only).
+   */
+  bool readingValue() {
+    return useNewParser_ && !metaProtocol_ &&
+      parser_.protocol() == mc_ascii_protocol &&
+      asciiParser_.hasReadBuffer();
+  }
+
+  /**
+   * After a read into a value (see readingValue()): the reply being parsed
+   * with the part of the value read so far, and the number of value bytes
+   * left to read.
+   */
+  const McReply& partialReply() const {
+    return asciiParser_.partialReply();
+  }
+  size_t remainingValueLength() const {
+    return asciiParser_.remainingValueLength();
+  }
+
+  /**
+   * Bytes of the read buffer currently held, see McParser.
+   */
+  size_t bufferedBytes() const {
+    return parser_.bufferedBytes();
+  }
  private:
   McParser parser_;
   McAsciiParser asciiParser_;
+  /* Used instead of the ASCII parsers for meta protocol replies */
+  McMetaParser metaParser_;
+  bool metaProtocol_{false};
   mc_parser_t mcParser_;
   void (ClientMcParser<Callback>::*replyForwarder_)(){nullptr};
   bool useNewParser_{false};
@@ -65,6 +100,9 @@ class ClientMcParser : private McParser::ParserCallback {
   template <class Operation, class Request>
   void forwardAsciiReply();
 
+  void forwardMetaReply();
+  void handleMeta(folly::IOBuf& readBuffer);
+
   /* McParser callbacks */
   bool umMessageReady(const UmbrellaMessageInfo& info,
                       const uint8_t* header,
@@ -0,0 +1,58 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "ConnectThrottle.h"
+
+#include <cassert>
+
+namespace facebook { namespace memcache {
+
+bool ConnectThrottle::tryStart() {
+  /* Waiting connects go first */
+  if (!waiting_.empty() || !belowLimit()) {
+    return false;
+  }
+  ++connecting_;
+  return true;
+}
+
+void ConnectThrottle::wait(std::function<bool()> connect) {
+  stats_.delayed.fetch_add(1, std::memory_order_relaxed);
+  waiting_.push_back(std::move(connect));
+  startWaiting();
+}
+
+void ConnectThrottle::finished(bool success,
+                               std::chrono::microseconds latency) {
+  assert(connecting_ > 0);
+  --connecting_;
+  auto& counter = success ? stats_.connects : stats_.failures;
+  counter.fetch_add(1, std::memory_order_relaxed);
+  stats_.latencyUs.fetch_add(latency.count(), std::memory_order_relaxed);
+  startWaiting();
+}
+
+void ConnectThrottle::startWaiting() {
+  if (starting_) {
+    /* The loop below picks up the freed slot */
+    return;
+  }
+  starting_ = true;
+  while (!waiting_.empty() && belowLimit()) {
+    auto connect = std::move(waiting_.front());
+    waiting_.pop_front();
+    ++connecting_;
+    if (!connect()) {
+      --connecting_;
+    }
+  }
+  starting_ = false;
+}
+
+}}  // facebook::memcache
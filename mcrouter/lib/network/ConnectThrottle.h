@@ -0,0 +1,100 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+namespace facebook { namespace memcache {
+
+/**
+ * Shared by the clients of one event base (e.g. all destinations of a proxy
+ * thread): limits how many of them connect at once, so that after a fleet
+ * wide restart reconnects are spread over time instead of all being
+ * attempted together. Also keeps connect stats for those clients.
+ *
+ * Not thread safe, meant to be used from the event base thread only.
+ * Only stats() may be read from other threads.
+ */
+class ConnectThrottle {
+ public:
+  struct Stats {
+    // Connect attempts that succeeded and failed.
+    std::atomic<uint64_t> connects{0};
+    std::atomic<uint64_t> failures{0};
+    // Total time of those attempts, in microseconds.
+    std::atomic<uint64_t> latencyUs{0};
+    // Attempts that had to wait for another connect to finish.
+    std::atomic<uint64_t> delayed{0};
+  };
+
+  /**
+   * @param maxConnecting  connects allowed in progress at once, 0 means no
+   *                       limit (then only stats are kept).
+   */
+  explicit ConnectThrottle(size_t maxConnecting = 0)
+      : maxConnecting_(maxConnecting) {
+  }
+
+  ConnectThrottle(const ConnectThrottle&) = delete;
+  ConnectThrottle& operator=(const ConnectThrottle&) = delete;
+
+  /**
+   * @return  true iff a connect may start right away. It's then counted
+   *          as in progress until finished() is called for it.
+   */
+  bool tryStart();
+
+  /**
+   * Queues a connect that couldn't start. It is called once another connect
+   * finishes, and should return false if it doesn't connect after all
+   * (e.g. its client is gone), passing the turn on to the next one.
+   * Each connect that returned true must be followed by finished().
+   */
+  void wait(std::function<bool()> connect);
+
+  /**
+   * Ends a connect in progress, letting the next waiting one start.
+   */
+  void finished(bool success, std::chrono::microseconds latency);
+
+  size_t connecting() const {
+    return connecting_;
+  }
+
+  size_t waiting() const {
+    return waiting_.size();
+  }
+
+  const Stats& stats() const {
+    return stats_;
+  }
+
+ private:
+  const size_t maxConnecting_;
+  size_t connecting_{0};
+  std::deque<std::function<bool()>> waiting_;
+  // Set while startWaiting() runs connects, which may finish (and call
+  // finished()) right away.
+  bool starting_{false};
+  Stats stats_;
+
+  bool belowLimit() const {
+    return maxConnecting_ == 0 || connecting_ < maxConnecting_;
+  }
+
+  void startWaiting();
+};
+
+}}  // facebook::memcache
@@ -10,6 +10,8 @@
 #pragma once
 
 #include <chrono>
+#include <memory>
+#include <string>
 
 #include <folly/io/async/AsyncSocket.h>
 
@@ -22,6 +24,8 @@ class SSLContext;
 
 namespace facebook { namespace memcache {
 
+class ConnectThrottle;
+
 /**
  * A struct for storing all connection related options.
  */
@@ -46,12 +50,88 @@ struct ConnectionOptions {
    */
   bool noNetwork{false};
 
+  /**
+   * If not empty, requests go through the shared memory channel at this
+   * path (see AsyncMcServer::Options::shmChannels) instead of a socket,
+   * to a server on the same host. Umbrella protocol only. The access point
+   * still names the destination, e.g. for logging.
+   */
+  std::string shmChannelPath;
+
   /**
    * Temporary field for rolling out a new ASCII parser.
    * If true, the new ASCII protocol parser will be used.
    */
   bool useNewAsciiParser{false};
 
+  /**
+   * If true, the new ASCII parser tries a fast path for get and gets
+   * replies before running the state machine.
+   * Has no effect unless useNewAsciiParser is set.
+   */
+  bool useAsciiReplyFastPath{false};
+
+  /**
+   * If true and the protocol is umbrella, requests written together are
+   * framed as one Umbrella BATCH message. The server must support batch
+   * frames; it will then batch its replies as well.
+   */
+  bool umbrellaBatching{false};
+
+  /**
+   * If non-zero, writes are held for up to this long to gather more
+   * requests into a single writev. A write goes out right away once
+   * writeCorkMaxRequests requests or writeCorkMaxBytes bytes are pending.
+   *
+   * The time actually held adapts to load: it shrinks while holding gathers
+   * no more than one request, and grows back while writes carry several.
+   */
+  std::chrono::microseconds writeCorkMaxDelay{0};
+
+  /**
+   * If true, a set (or delete) of a key replaces a set (delete) of the same
+   * key that is still waiting to be written, and the replaced request gets
+   * the reply of the one that replaced it. Any other request for the key
+   * in between keeps both. Cuts useless writes of write-hot keys.
+   */
+  bool supersedePendingUpdates{false};
+
+  /**
+   * If true, pending requests are sent in order of Request::priority()
+   * (all NORMAL ones before LOW ones), instead of strictly in the order
+   * they were sent in. Requests of different priorities may be reordered.
+   */
+  bool priorityLanes{false};
+
+  /**
+   * Pending requests that end a write hold. 0 means no limit.
+   */
+  size_t writeCorkMaxRequests{32};
+
+  /**
+   * Pending request bytes that end a write hold. 0 means no limit.
+   */
+  size_t writeCorkMaxBytes{64 * 1024};
+
+  /**
+   * If non-zero, the read buffer size will be dynamically adjusted
+   * to contain roughly this many replies, within min/max limits below.
+   *
+   * If 0, buffer size is always maxReadBufferSize.
+   */
+  size_t repliesPerRead{0};
+
+  /**
+   * Smallest allowed read buffer size.
+   */
+  size_t minReadBufferSize{256};
+
+  /**
+   * Largest allowed read buffer size. Larger buffers need fewer read()
+   * calls for big values and pipelined replies.
+   */
+  size_t maxReadBufferSize{4096};
+
   /**
    * Access point of the destination.
    */
@@ -75,6 +155,37 @@ struct ConnectionOptions {
    */
   int tcpKeepAliveInterval{0};
 
+  /**
+   * If positive, SO_BUSY_POLL is set to this many microseconds: reads on
+   * the socket busy poll the device queue instead of waiting for an
+   * interrupt. Only useful if the reading thread spins anyway.
+   */
+  int busyPollUs{0};
+
+  /**
+   * If set, requests and replies passed McClientTimestamps are timestamped.
+   * On TCP connections without SSL the kernel also timestamps requests as
+   * it hands them to the device (SO_TIMESTAMPING, software TX timestamps
+   * read from the socket error queue).
+   */
+  bool enableKernelTimestamps{false};
+
+  /**
+   * If set, connects count against the limit this client shares with the
+   * other clients of the throttle, and connect stats are kept there.
+   */
+  std::shared_ptr<ConnectThrottle> connectThrottle;
+
+  /**
+   * If non-zero, after a failed connect requests fail right away with
+   * mc_res_connect_error instead of reconnecting, for a random time between
+   * half of the backoff and all of it. The backoff starts at this value,
+   * doubles with every failed connect up to reconnectBackoffMax, and is
+   * reset by a successful one.
+   */
+  std::chrono::milliseconds reconnectBackoffInitial{0};
+  std::chrono::milliseconds reconnectBackoffMax{1000};
+
   /**
    * Send timeout in ms. Shoud be used only for async (non-fiber) mode.
    */
@@ -102,6 +213,12 @@ struct ConnectionOptions {
    */
   std::function<std::shared_ptr<folly::SSLContext>()>
     sslContextProvider;
+
+  /**
+   * If true, TLS sessions are cached per thread by destination and resumed
+   * on reconnect, avoiding a full handshake.
+   */
+  bool sslSessionResumption{false};
 };
 
 }} // facebook::memcache
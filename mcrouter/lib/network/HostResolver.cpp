@@ -0,0 +1,143 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "HostResolver.h"
+
+#include <algorithm>
+#include <system_error>
+#include <thread>
+
+#include "mcrouter/lib/fbi/cpp/LogFailure.h"
+
+namespace facebook { namespace memcache {
+
+HostResolver& HostResolver::instance() {
+  static HostResolver resolver;
+  return resolver;
+}
+
+HostResolver::HostResolver(std::chrono::milliseconds ttl)
+    : ttl_(ttl) {
+}
+
+void HostResolver::setTtl(std::chrono::milliseconds ttl) {
+  std::lock_guard<std::mutex> lg(lock_);
+  ttl_ = ttl;
+  if (ttl_.count() == 0) {
+    cache_.clear();
+  }
+}
+
+size_t HostResolver::prefetch(const std::vector<std::string>& hosts,
+                              size_t maxThreads) {
+  auto start = Clock::now();
+  std::vector<const std::string*> toResolve;
+  {
+    std::lock_guard<std::mutex> lg(lock_);
+    if (ttl_.count() == 0) {
+      return 0;
+    }
+    for (const auto& host : hosts) {
+      if (folly::IPAddress::validate(host)) {
+        continue;
+      }
+      auto it = cache_.find(host);
+      if (it == cache_.end() || it->second.expires <= start) {
+        toResolve.push_back(&host);
+      }
+    }
+  }
+  std::sort(toResolve.begin(), toResolve.end(),
+            [](const std::string* a, const std::string* b) {
+              return *a < *b;
+            });
+  toResolve.erase(std::unique(toResolve.begin(), toResolve.end(),
+                              [](const std::string* a, const std::string* b) {
+                                return *a == *b;
+                              }),
+                  toResolve.end());
+
+  std::atomic<size_t> next{0};
+  std::atomic<size_t> failed{0};
+  auto resolveNext = [this, &toResolve, &next, &failed]() {
+    size_t i;
+    while ((i = next++) < toResolve.size()) {
+      try {
+        lookup(*toResolve[i]);
+      } catch (const std::system_error& e) {
+        ++failed;
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  auto numThreads = std::min(std::max<size_t>(maxThreads, 1),
+                             toResolve.size());
+  for (size_t i = 1; i < numThreads; ++i) {
+    try {
+      threads.emplace_back(resolveNext);
+    } catch (const std::system_error& e) {
+      // fewer threads just take longer
+      break;
+    }
+  }
+  // the calling thread is one of the resolving threads
+  resolveNext();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  stats_.lastPrefetchTimeUs =
+    std::chrono::duration_cast<std::chrono::microseconds>(
+      Clock::now() - start).count();
+  if (failed > 0) {
+    failure::log("HostResolver", failure::Category::kBadEnvironment,
+                 "Can not resolve {} of {} hostnames", failed.load(),
+                 toResolve.size());
+  }
+  return failed;
+}
+
+folly::SocketAddress HostResolver::resolve(folly::StringPiece host,
+                                           uint16_t port) {
+  if (folly::IPAddress::validate(host)) {
+    return folly::SocketAddress(host.str(), port);
+  }
+
+  auto hostStr = host.str();
+  {
+    std::lock_guard<std::mutex> lg(lock_);
+    auto it = cache_.find(hostStr);
+    if (it != cache_.end()) {
+      return folly::SocketAddress(it->second.address, port);
+    }
+  }
+  ++stats_.misses;
+  return folly::SocketAddress(lookup(hostStr), port);
+}
+
+folly::IPAddress HostResolver::lookup(const std::string& host) {
+  ++stats_.resolutions;
+  folly::SocketAddress address;
+  try {
+    address.setFromHostPort(host, 0);
+  } catch (const std::system_error& e) {
+    ++stats_.failures;
+    throw;
+  }
+  auto ip = address.getIPAddress();
+
+  std::lock_guard<std::mutex> lg(lock_);
+  if (ttl_.count() > 0) {
+    cache_[host] = Entry{ip, Clock::now() + ttl_};
+  }
+  return ip;
+}
+
+}}  // facebook::memcache
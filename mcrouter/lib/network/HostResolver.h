@@ -0,0 +1,101 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/IPAddress.h>
+#include <folly/Range.h>
+#include <folly/SocketAddress.h>
+
+namespace facebook { namespace memcache {
+
+/**
+ * Process wide cache of hostname resolutions, so that connecting to a
+ * destination listed by hostname doesn't block its event base on
+ * getaddrinfo(): the hostnames of a new config are resolved in parallel
+ * (prefetch()) before the config is swapped in, connects then find them
+ * in the cache (resolve()).
+ *
+ * An expired entry is still used by resolve(), until the next prefetch()
+ * refreshes it. Only hostnames missing from the cache (e.g. their
+ * resolution failed) are resolved in line.
+ *
+ * Thread safe.
+ */
+class HostResolver {
+ public:
+  struct Stats {
+    // getaddrinfo() calls and the ones that failed
+    std::atomic<uint64_t> resolutions{0};
+    std::atomic<uint64_t> failures{0};
+    // Wall time of the last prefetch(), in microseconds
+    std::atomic<uint64_t> lastPrefetchTimeUs{0};
+    // resolve() calls that had to resolve in line
+    std::atomic<uint64_t> misses{0};
+  };
+
+  static HostResolver& instance();
+
+  /**
+   * @param ttl  how long a resolution is fresh, 0 disables the cache
+   *             (resolve() always resolves in line, prefetch() is a no-op).
+   */
+  explicit HostResolver(
+    std::chrono::milliseconds ttl = std::chrono::minutes(5));
+
+  HostResolver(const HostResolver&) = delete;
+  HostResolver& operator=(const HostResolver&) = delete;
+
+  void setTtl(std::chrono::milliseconds ttl);
+
+  /**
+   * Resolves the hostnames that are not in the cache or expired (IP
+   * literals are skipped), with up to maxThreads of them at once.
+   * Blocks until all are done.
+   *
+   * @return  number of hostnames that couldn't be resolved.
+   */
+  size_t prefetch(const std::vector<std::string>& hosts, size_t maxThreads);
+
+  /**
+   * @return  address of host:port, from the cache for hostnames.
+   * @throws std::system_error  if host can't be resolved.
+   */
+  folly::SocketAddress resolve(folly::StringPiece host, uint16_t port);
+
+  const Stats& stats() const {
+    return stats_;
+  }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Entry {
+    folly::IPAddress address;
+    Clock::time_point expires;
+  };
+
+  std::mutex lock_;
+  std::unordered_map<std::string, Entry> cache_;
+  std::chrono::milliseconds ttl_;
+  Stats stats_;
+
+  /* getaddrinfo(), caches the result. @throws std::system_error */
+  folly::IPAddress lookup(const std::string& host);
+};
+
+}}  // facebook::memcache
@@ -0,0 +1,224 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "HugePageArena.h"
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include <folly/Bits.h>
+
+namespace facebook { namespace memcache {
+
+constexpr size_t HugePageArena::kHugePageSize;
+constexpr size_t HugePageArena::kMaxBlockSize;
+
+namespace {
+
+/* Blocks of 64 bytes up to kMaxBlockSize */
+constexpr size_t kMinBlockShift = 6;
+constexpr size_t kMaxBlockShift = 18;
+constexpr size_t kNumSizeClasses = kMaxBlockShift - kMinBlockShift + 1;
+static_assert(HugePageArena::kMaxBlockSize == 1 << kMaxBlockShift,
+              "kMaxBlockShift doesn't match kMaxBlockSize");
+
+struct FreeBlock {
+  FreeBlock* next;
+};
+
+struct SizeClass {
+  std::mutex lock;
+  FreeBlock* freeList{nullptr};
+  /* Not yet used part of the last huge page of this class */
+  char* next{nullptr};
+  char* end{nullptr};
+};
+
+struct Arena {
+  /* Set once by enable(): end is published after begin */
+  std::atomic<uintptr_t> begin{0};
+  std::atomic<uintptr_t> end{0};
+  HugePageArena::Mode mode;
+
+  std::mutex pagesLock;
+  size_t numPages{0};
+  size_t mappedPages{0};
+  /* Size class of each mapped huge page, for deallocate() */
+  std::vector<uint8_t> pageClass;
+
+  SizeClass classes[kNumSizeClasses];
+
+  std::atomic<size_t> reservedBytes{0};
+  std::atomic<size_t> mappedBytes{0};
+  std::atomic<size_t> explicitBytes{0};
+  std::atomic<size_t> usedBytes{0};
+  std::atomic<size_t> explicitFailures{0};
+
+  char* base() const {
+    return reinterpret_cast<char*>(begin.load(std::memory_order_relaxed));
+  }
+
+  /**
+   * Maps the next huge page of the arena for the given size class.
+   *
+   * @return  nullptr if the arena is full or mapping failed.
+   */
+  char* mapPage(size_t sizeClass) {
+    std::lock_guard<std::mutex> guard(pagesLock);
+    if (mappedPages == numPages) {
+      return nullptr;
+    }
+    auto page = base() + mappedPages * HugePageArena::kHugePageSize;
+    bool mapped = false;
+#ifdef MAP_HUGETLB
+    if (mode == HugePageArena::Mode::EXPLICIT) {
+      mapped = mmap(page, HugePageArena::kHugePageSize, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB,
+                    -1, 0) != MAP_FAILED;
+      if (mapped) {
+        explicitBytes += HugePageArena::kHugePageSize;
+      } else {
+        ++explicitFailures;
+      }
+    }
+#endif
+    if (!mapped) {
+      /* A failed MAP_FIXED may have dropped the reservation, map it again */
+      if (mmap(page, HugePageArena::kHugePageSize, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED) {
+        return nullptr;
+      }
+#ifdef MADV_HUGEPAGE
+      madvise(page, HugePageArena::kHugePageSize, MADV_HUGEPAGE);
+#endif
+    }
+    pageClass[mappedPages++] = sizeClass;
+    mappedBytes += HugePageArena::kHugePageSize;
+    return page;
+  }
+};
+
+Arena& arena() {
+  /* Leaked: blocks may be freed by static destructors of other objects */
+  static Arena* a = new Arena();
+  return *a;
+}
+
+size_t sizeClassOf(size_t size) {
+  size_t shift = size <= 1 ? 0 : folly::findLastSet(size - 1);
+  return std::max(shift, kMinBlockShift) - kMinBlockShift;
+}
+
+size_t blockSize(size_t sizeClass) {
+  return size_t{1} << (sizeClass + kMinBlockShift);
+}
+
+}  // anonymous namespace
+
+bool HugePageArena::enable(Mode mode, size_t maxBytes) {
+  static std::once_flag once;
+  bool enabled = false;
+  std::call_once(once, [&]() {
+    auto& a = arena();
+    size_t numPages = std::max<size_t>(
+      (maxBytes + kHugePageSize - 1) / kHugePageSize, 1);
+    size_t size = numPages * kHugePageSize;
+    /* One more page of slack, to align the start */
+    auto p = mmap(nullptr, size + kHugePageSize, PROT_NONE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) {
+      return;
+    }
+    auto raw = reinterpret_cast<uintptr_t>(p);
+    auto begin = (raw + kHugePageSize - 1) & ~(kHugePageSize - 1);
+    if (begin != raw) {
+      munmap(p, begin - raw);
+    }
+    auto slackEnd = raw + size + kHugePageSize;
+    if (slackEnd != begin + size) {
+      munmap(reinterpret_cast<void*>(begin + size), slackEnd - begin - size);
+    }
+
+    a.mode = mode;
+    a.numPages = numPages;
+    a.pageClass.resize(numPages);
+    a.reservedBytes = size;
+    a.begin.store(begin, std::memory_order_relaxed);
+    a.end.store(begin + size, std::memory_order_release);
+    enabled = true;
+  });
+  return enabled;
+}
+
+void* HugePageArena::allocate(size_t size) noexcept {
+  auto& a = arena();
+  if (size > kMaxBlockSize || a.end.load(std::memory_order_acquire) == 0) {
+    return nullptr;
+  }
+  auto sizeClass = sizeClassOf(size);
+  auto& cls = a.classes[sizeClass];
+  std::lock_guard<std::mutex> guard(cls.lock);
+  a.usedBytes += blockSize(sizeClass);
+  if (cls.freeList != nullptr) {
+    auto block = cls.freeList;
+    cls.freeList = block->next;
+    return block;
+  }
+  if (cls.next == cls.end) {
+    auto page = a.mapPage(sizeClass);
+    if (page == nullptr) {
+      a.usedBytes -= blockSize(sizeClass);
+      return nullptr;
+    }
+    cls.next = page;
+    cls.end = page + kHugePageSize;
+  }
+  auto block = cls.next;
+  cls.next += blockSize(sizeClass);
+  return block;
+}
+
+void HugePageArena::deallocate(void* p) noexcept {
+  assert(owns(p));
+  auto& a = arena();
+  auto page = (static_cast<char*>(p) - a.base()) / kHugePageSize;
+  auto sizeClass = a.pageClass[page];
+  auto& cls = a.classes[sizeClass];
+  auto block = static_cast<FreeBlock*>(p);
+  std::lock_guard<std::mutex> guard(cls.lock);
+  block->next = cls.freeList;
+  cls.freeList = block;
+  a.usedBytes -= blockSize(sizeClass);
+}
+
+bool HugePageArena::owns(const void* p) noexcept {
+  auto& a = arena();
+  auto addr = reinterpret_cast<uintptr_t>(p);
+  auto end = a.end.load(std::memory_order_acquire);
+  return addr < end && addr >= a.begin.load(std::memory_order_relaxed);
+}
+
+HugePageArena::Stats HugePageArena::stats() noexcept {
+  auto& a = arena();
+  Stats stats;
+  stats.reservedBytes = a.reservedBytes.load();
+  stats.mappedBytes = a.mappedBytes.load();
+  stats.explicitBytes = a.explicitBytes.load();
+  stats.usedBytes = a.usedBytes.load();
+  stats.explicitFailures = a.explicitFailures.load();
+  return stats;
+}
+
+}}  // facebook::memcache
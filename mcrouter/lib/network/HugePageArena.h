@@ -0,0 +1,86 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+
+namespace facebook { namespace memcache {
+
+/**
+ * Process wide arena for network buffers (McParser read buffers and
+ * WriteBuffers), backed by 2MB huge pages to cut TLB misses.
+ *
+ * enable() reserves the address space of the whole arena once, which is
+ * then mapped one huge page at a time. Each huge page is cut into blocks
+ * of one power of two size. Freed blocks are kept on a free list of their
+ * size for reuse, memory is never given back to the system.
+ *
+ * Thread safe, a block may be freed on any thread. Every allocation takes
+ * a lock, so callers are expected to keep pools of buffers on top of it.
+ */
+class HugePageArena {
+ public:
+  enum class Mode {
+    /* madvise(MADV_HUGEPAGE), needs transparent huge pages enabled
+       ("madvise" or "always") */
+    TRANSPARENT,
+    /* MAP_HUGETLB, needs pages reserved in /proc/sys/vm/nr_hugepages.
+       Falls back to TRANSPARENT once none is left. */
+    EXPLICIT,
+  };
+
+  static constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+
+  /* Larger requests aren't served by the arena */
+  static constexpr size_t kMaxBlockSize = 256 * 1024;
+
+  struct Stats {
+    /* Address space of the arena */
+    size_t reservedBytes{0};
+    /* Huge pages mapped so far (explicit or transparent) */
+    size_t mappedBytes{0};
+    /* Part of mappedBytes that got explicit huge pages */
+    size_t explicitBytes{0};
+    /* Bytes of the blocks currently allocated */
+    size_t usedBytes{0};
+    /* Explicit huge pages that couldn't be mapped */
+    size_t explicitFailures{0};
+  };
+
+  /**
+   * Reserves maxBytes (rounded up to huge pages) of address space.
+   * Only the first call in a process has any effect.
+   *
+   * @return  false if the arena was already enabled before, or if the
+   *          address space couldn't be reserved.
+   */
+  static bool enable(Mode mode, size_t maxBytes);
+
+  /**
+   * @return  block of at least size bytes, nullptr if the arena is not
+   *          enabled, size is over kMaxBlockSize or the arena is full.
+   */
+  static void* allocate(size_t size) noexcept;
+
+  /**
+   * @param p  block returned by allocate().
+   */
+  static void deallocate(void* p) noexcept;
+
+  /**
+   * @return  true iff p points into the arena. Lock free, pointers
+   *          allocated elsewhere (or before enable()) give false.
+   */
+  static bool owns(const void* p) noexcept;
+
+  static Stats stats() noexcept;
+};
+
+}}  // facebook::memcache
@@ -0,0 +1,142 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace facebook { namespace memcache {
+
+/**
+ * Map from request id to value, for ids that are allocated sequentially
+ * (like AsyncMcClient's message ids) and live for a short time.
+ *
+ * Entries are stored in a power of two ring indexed by the low bits
+ * of the id, and each entry keeps the full id to tell it from the ids
+ * that map to the same slot. Lookup, insertion and removal are a single
+ * array access. The ring grows (doubling) when it's half full or when
+ * a new id collides with a live one, i.e. when the ids of live entries
+ * span more than the ring size.
+ *
+ * @param Value  default constructed Value is returned for missing ids
+ *               (e.g. nullptr for pointers). Move-only values can only
+ *               be read with take().
+ */
+template <class Value>
+class IdRingMap {
+ public:
+  explicit IdRingMap(size_t initialCapacity = kMinCapacity) {
+    size_t capacity = kMinCapacity;
+    while (capacity < initialCapacity) {
+      capacity *= 2;
+    }
+    entries_.resize(capacity);
+  }
+
+  /**
+   * @param id  non zero id, not present in the map.
+   */
+  void insert(uint64_t id, Value value) {
+    assert(id != 0);
+    if ((size_ + 1) * 2 > entries_.size()) {
+      grow();
+    }
+    while (entries_[slot(id)].id != 0) {
+      assert(entries_[slot(id)].id != id);
+      grow();
+    }
+    auto& entry = entries_[slot(id)];
+    entry.id = id;
+    entry.value = std::move(value);
+    ++size_;
+  }
+
+  /**
+   * @return value for id, or Value() if there's none.
+   */
+  Value find(uint64_t id) const {
+    const auto& entry = entries_[slot(id)];
+    return entry.id == id && id != 0 ? entry.value : Value();
+  }
+
+  /**
+   * Removes the value for id.
+   *
+   * @return removed value, or Value() if there's none.
+   */
+  Value take(uint64_t id) {
+    auto& entry = entries_[slot(id)];
+    if (entry.id != id || id == 0) {
+      return Value();
+    }
+    entry.id = 0;
+    auto value = std::move(entry.value);
+    entry.value = Value();
+    --size_;
+    return value;
+  }
+
+  /**
+   * @return true if id was removed, false if there was none.
+   */
+  bool erase(uint64_t id) {
+    auto& entry = entries_[slot(id)];
+    if (entry.id != id || id == 0) {
+      return false;
+    }
+    entry.id = 0;
+    entry.value = Value();
+    --size_;
+    return true;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  size_t capacity() const {
+    return entries_.size();
+  }
+
+ private:
+  static constexpr size_t kMinCapacity = 64;
+
+  struct Entry {
+    uint64_t id{0};
+    Value value{};
+  };
+
+  std::vector<Entry> entries_;
+  size_t size_{0};
+
+  size_t slot(uint64_t id) const {
+    return id & (entries_.size() - 1);
+  }
+
+  void grow() {
+    std::vector<Entry> old(entries_.size() * 2);
+    old.swap(entries_);
+    // live ids with distinct slots in the old ring also have distinct
+    // slots in the bigger one
+    for (auto& entry : old) {
+      if (entry.id != 0) {
+        entries_[slot(entry.id)] = std::move(entry);
+      }
+    }
+  }
+};
+
+}}  // facebook::memcache
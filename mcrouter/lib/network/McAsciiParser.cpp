@@ -9,6 +9,8 @@
  */
 #include "mcrouter/lib/network/McAsciiParser.h"
 
+#include <cstring>
+
 #include <folly/String.h>
 
 #include "mcrouter/lib/fbi/cpp/LogFailure.h"
@@ -18,6 +20,45 @@ namespace facebook { namespace memcache {
 
 constexpr size_t kProtocolTailContextLength = 128;
 
+namespace {
+
+// Longest decimal number the fast path parses, always fits into uint64_t.
+constexpr size_t kMaxUIntDigits = 19;
+
+const folly::StringPiece kValuePrefix("VALUE ");
+const folly::StringPiece kValueSuffix("\r\nEND\r\n");
+
+/**
+ * Parses unsigned decimal number starting at p.
+ *
+ * @return  pointer past the last digit, or nullptr if there are no digits
+ *          or the number is too long.
+ */
+const char* parseUInt(const char* p, const char* end, uint64_t& value) {
+  auto start = p;
+  uint64_t result = 0;
+  while (p != end && static_cast<unsigned char>(*p - '0') < 10) {
+    result = result * 10 + (*p - '0');
+    ++p;
+  }
+  if (p == start || static_cast<size_t>(p - start) > kMaxUIntDigits) {
+    return nullptr;
+  }
+  value = result;
+  return p;
+}
+
+/**
+ * Same set of characters as skip_key in McAsciiParser.rl: anything except
+ * control characters and spaces.
+ */
+inline bool isKeyChar(char c) {
+  auto uc = static_cast<unsigned char>(c);
+  return uc > ' ' && uc != 0x7f;
+}
+
+}  // anonymous
+
 McAsciiParser::McAsciiParser() : state_(State::UNINIT) {
 }
 
@@ -28,10 +69,14 @@ McAsciiParser::State McAsciiParser::consume(folly::IOBuf& buffer) {
   pe_ = p_ + buffer.length();
   eof_ = nullptr;
 
-  (this->*consumer_)(buffer);
+  auto fastConsumer = fastConsumer_;
+  fastConsumer_ = nullptr;
+  if (fastConsumer == nullptr || !(this->*fastConsumer)(buffer)) {
+    (this->*consumer_)(buffer);
 
-  if (savedCs_ == errorCs_) {
-    handleError(buffer);
+    if (savedCs_ == errorCs_) {
+      handleError(buffer);
+    }
   }
 
   buffer.trimStart(p_ - reinterpret_cast<const char*>(buffer.data()));
@@ -60,6 +105,90 @@ void McAsciiParser::readDataAvailable(size_t length) {
   }
 }
 
+bool McAsciiParser::consumeGetReplyFast(folly::IOBuf& buffer) {
+  return consumeValueReplyFast(buffer, false);
+}
+
+bool McAsciiParser::consumeGetsReplyFast(folly::IOBuf& buffer) {
+  return consumeValueReplyFast(buffer, true);
+}
+
+bool McAsciiParser::consumeValueReplyFast(folly::IOBuf& buffer,
+                                          bool withCas) {
+  // memchr is vectorized, so finding the end of the first line is cheap,
+  // and all the field parsing below stays within that line.
+  auto lineEnd = static_cast<const char*>(std::memchr(p_, '\n', pe_ - p_));
+  if (lineEnd == nullptr || lineEnd == p_ || lineEnd[-1] != '\r') {
+    return false;
+  }
+  folly::StringPiece line(p_, lineEnd - 1);
+  auto& reply = currentMessage_.get<McReply>();
+
+  if (line == "END") {
+    reply.setResult(mc_res_notfound);
+    p_ = lineEnd + 1;
+    state_ = State::COMPLETE;
+    return true;
+  }
+
+  // VALUE <key> <flags> <bytes>[ <cas>]
+  if (!line.startsWith(kValuePrefix)) {
+    return false;
+  }
+  auto p = line.begin() + kValuePrefix.size();
+  auto keyBegin = p;
+  while (p != line.end() && isKeyChar(*p)) {
+    ++p;
+  }
+  if (p == keyBegin || p == line.end() || *p != ' ') {
+    return false;
+  }
+
+  uint64_t flags;
+  uint64_t valueLength;
+  uint64_t cas = 0;
+  p = parseUInt(p + 1, line.end(), flags);
+  if (p == nullptr || p == line.end() || *p != ' ') {
+    return false;
+  }
+  p = parseUInt(p + 1, line.end(), valueLength);
+  if (p != nullptr && withCas) {
+    if (p == line.end() || *p != ' ') {
+      return false;
+    }
+    p = parseUInt(p + 1, line.end(), cas);
+  }
+  if (p != line.end()) {
+    return false;
+  }
+
+  // The value and the rest of the reply have to be in this buffer,
+  // otherwise let the state machine deal with it.
+  auto value = lineEnd + 1;
+  if (static_cast<uint64_t>(pe_ - value) < valueLength + kValueSuffix.size() ||
+      folly::StringPiece(value + valueLength, kValueSuffix.size()) !=
+        kValueSuffix) {
+    return false;
+  }
+
+  reply.setResult(mc_res_found);
+  reply.setFlags(flags);
+  if (withCas) {
+    reply.setCas(cas);
+  }
+  reply.valueData_.emplace();
+  if (valueLength) {
+    size_t offset = value - reinterpret_cast<const char*>(buffer.data());
+    buffer.cloneOneInto(reply.valueData_.value());
+    reply.valueData_->trimStart(offset);
+    reply.valueData_->trimEnd(buffer.length() - offset - valueLength);
+  }
+
+  p_ = value + valueLength + kValueSuffix.size();
+  state_ = State::COMPLETE;
+  return true;
+}
+
 void McAsciiParser::appendCurrentCharTo(folly::IOBuf& from, folly::IOBuf& to) {
   // If it is just a next char in the same memory chunk, just append it.
   // Otherwise we need to append new IOBuf.
@@ -70,6 +70,16 @@ class McAsciiParser {
 
   State getCurrentState() { return state_; }
 
+  /**
+   * Enables the fast path for get and gets replies.
+   *
+   * If a complete reply of the common form (single spaces, CRLF line
+   * endings) is available at the start of the buffer, it is parsed without
+   * going through the state machine. Anything else falls back to the state
+   * machine. Takes effect on the next initializeReplyParser() call.
+   */
+  void setFastPathEnabled(bool enabled) { fastPathEnabled_ = enabled; }
+
   /**
    * Check if McAsciiParser already has its own buffer.
    * @return  true iff we already have our own buffer that we can read into.
@@ -79,6 +89,22 @@ class McAsciiParser {
   std::pair<void*, size_t> getReadBuffer();
 
   void readDataAvailable(size_t length);
+
+  /**
+   * The reply being parsed, its value holding the bytes read so far.
+   * Only meaningful while a value is read into our own buffer, or right
+   * after its last bytes were (see hasReadBuffer()).
+   */
+  const McReply& partialReply() const {
+    return currentMessage_.get<McReply>();
+  }
+
+  /**
+   * Number of value bytes still to be read into our own buffer.
+   */
+  size_t remainingValueLength() const {
+    return remainingIOBufLength_;
+  }
  private:
   void appendCurrentCharTo(folly::IOBuf& from, folly::IOBuf& to);
   void handleError(folly::IOBuf& buffer);
@@ -94,6 +120,17 @@ class McAsciiParser {
   template<class Msg, class Op>
   void consumeMessage(folly::IOBuf& buffer);
 
+  /**
+   * Fast path consumers. Look only at the beginning of a message.
+   *
+   * @return  true iff the whole reply was parsed, in which case state_ is
+   *          State::COMPLETE and p_ points past the reply. Otherwise nothing
+   *          is modified.
+   */
+  bool consumeGetReplyFast(folly::IOBuf& buffer);
+  bool consumeGetsReplyFast(folly::IOBuf& buffer);
+  bool consumeValueReplyFast(folly::IOBuf& buffer, bool withCas);
+
   uint64_t currentUInt_{0};
   folly::IOBuf* currentIOBuf_{nullptr};
   size_t remainingIOBufLength_{0};
@@ -113,6 +150,11 @@ class McAsciiParser {
 
   using ConsumerFunPtr = void (McAsciiParser::*)(folly::IOBuf&);
   ConsumerFunPtr consumer_{nullptr};
+
+  using FastConsumerFunPtr = bool (McAsciiParser::*)(folly::IOBuf&);
+  // Tried once, on the first consume() call for a message.
+  FastConsumerFunPtr fastConsumer_{nullptr};
+  bool fastPathEnabled_{false};
 };
 
 template<class T>
@@ -164,6 +206,10 @@ template<>
 void McAsciiParser::initializeReplyParser<McOperation<mc_op_delete>,
                                           McRequest>();
 
+template<>
+void McAsciiParser::initializeReplyParser<McOperation<mc_op_touch>,
+                                          McRequest>();
+
 template<>
 void McAsciiParser::initializeReplyParser<McOperation<mc_op_metaget>,
                                           McRequest>();
@@ -342,6 +342,29 @@ void McAsciiParser::consumeMessage<McReply, McOperation<mc_op_delete>>(
   }%%
 }
 
+// McTouch reply.
+%%{
+machine mc_ascii_touch_reply;
+include mc_ascii_common;
+
+touched = 'TOUCHED' @{ reply.setResult(mc_res_touched); };
+touch = touched | not_found;
+touch_reply := (touch | error) msg_end;
+
+write data;
+}%%
+
+template<>
+void McAsciiParser::consumeMessage<McReply, McOperation<mc_op_touch>>(
+    folly::IOBuf& buffer) {
+  McReply& reply = currentMessage_.get<McReply>();
+  %%{
+    machine mc_ascii_touch_reply;
+    write init nocs;
+    write exec;
+  }%%
+}
+
 //McMetaget reply.
 %%{
 machine mc_ascii_metaget_reply;
@@ -424,6 +447,9 @@ void McAsciiParser::initializeReplyParser<McOperation<mc_op_get>, McRequest>() {
   savedCs_ = mc_ascii_get_reply_en_get_reply;
   errorCs_ = mc_ascii_get_reply_error;
   consumer_ = &McAsciiParser::consumeMessage<McReply, McOperation<mc_op_get>>;
+  if (fastPathEnabled_) {
+    fastConsumer_ = &McAsciiParser::consumeGetReplyFast;
+  }
 }
 
 template<>
@@ -432,6 +458,9 @@ void McAsciiParser::initializeReplyParser<McOperation<mc_op_gets>, McRequest>()
   savedCs_ = mc_ascii_gets_reply_en_gets_reply;
   errorCs_ = mc_ascii_gets_reply_error;
   consumer_ = &McAsciiParser::consumeMessage<McReply, McOperation<mc_op_gets>>;
+  if (fastPathEnabled_) {
+    fastConsumer_ = &McAsciiParser::consumeGetsReplyFast;
+  }
 }
 
 template<>
@@ -496,6 +525,15 @@ void McAsciiParser::initializeReplyParser<McOperation<mc_op_delete>, McRequest>(
                                              McOperation<mc_op_delete>>;
 }
 
+template<>
+void McAsciiParser::initializeReplyParser<McOperation<mc_op_touch>, McRequest>() {
+  initializeCommon();
+  savedCs_ = mc_ascii_touch_reply_en_touch_reply;
+  errorCs_ = mc_ascii_touch_reply_error;
+  consumer_ = &McAsciiParser::consumeMessage<McReply,
+                                             McOperation<mc_op_touch>>;
+}
+
 template<>
 void McAsciiParser::initializeReplyParser<McOperation<mc_op_metaget>, McRequest>() {
   initializeCommon();
@@ -539,6 +577,7 @@ void McAsciiParser::initializeCommon() {
   currentUInt_ = 0;
   currentIOBuf_ = nullptr;
   remainingIOBufLength_ = 0;
+  fastConsumer_ = nullptr;
   state_ = State::PARTIAL;
 
   currentMessage_.emplace<McReply>();
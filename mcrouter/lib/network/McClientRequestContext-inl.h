@@ -29,6 +29,23 @@ inline getFbTraceInfo(const Request& request) {
 }
 
 #endif
+
+/* Operations whose pending request may be replaced by a later one */
+template <class Operation>
+struct SupersedeOp {
+  static constexpr mc_op_t value = mc_op_unknown;
+};
+
+template <>
+struct SupersedeOp<McOperation<mc_op_set>> {
+  static constexpr mc_op_t value = mc_op_set;
+};
+
+template <>
+struct SupersedeOp<McOperation<mc_op_delete>> {
+  static constexpr mc_op_t value = mc_op_delete;
+};
+
 }
 
 template <class Reply>
@@ -63,7 +80,10 @@ McClientRequestContextBase::McClientRequestContextBase(
     client_(std::move(client)),
     replyType_(typeid(typename ReplyType<Operation, Request>::type)),
     replyStorage_(reinterpret_cast<void*>(&replyStorage)),
-    initializer_(std::move(initializer)) {
+    initializer_(std::move(initializer)),
+    key_(request.fullKey()),
+    supersedeOp_(SupersedeOp<Operation>::value),
+    priority_(request.priority()) {
 }
 
 template <class Operation, class Request>
@@ -86,6 +106,16 @@ template <class Operation, class Request>
 typename McClientRequestContext<Operation, Request>::Reply
 McClientRequestContext<Operation, Request>::waitForReply(
     std::chrono::milliseconds timeout) {
+  auto reply = waitForReplyImpl(timeout);
+  // Requests we superseded share our fate, whatever it is
+  completeSuperseded(reply.result());
+  return reply;
+}
+
+template <class Operation, class Request>
+typename McClientRequestContext<Operation, Request>::Reply
+McClientRequestContext<Operation, Request>::waitForReplyImpl(
+    std::chrono::milliseconds timeout) {
 
   if (timeout.count()) {
     baton_.timed_wait(timeout);
@@ -93,31 +123,48 @@ McClientRequestContext<Operation, Request>::waitForReply(
     baton_.wait();
   }
 
-  switch (state_) {
-    case ReqState::WRITE_QUEUE:
-      // Request is being written into socket, we need to wait for it to be
-      // completely written, then reply with timeout.
-      state_ = ReqState::WRITE_QUEUE_CANCELED;
-      baton_.reset();
-      baton_.wait();
-      return Reply(mc_res_timeout);
-    case ReqState::PENDING_QUEUE:
-      // Request wasn't sent to the network yet, reply with timeout.
-      queue_.removePending(*this);
-      return Reply(mc_res_timeout);
-    case ReqState::PENDING_REPLY_QUEUE:
-      // Request was sent to the network, but wasn't replied yet,
-      // reply with timeout.
-      queue_.removePendingReply(*this);
-      return Reply(mc_res_timeout);
-    case ReqState::COMPLETE:
-      assert(replyStorage_.hasValue());
-      return std::move(replyStorage_.value());
-    case ReqState::WRITE_QUEUE_CANCELED:
-    case ReqState::NONE:
-      failure::log("AsyncMcClient", failure::Category::kBrokenLogic,
-                   "Unexpected state of request: {}!",
-                   static_cast<uint64_t>(state_));
+  bool writeCanceled = false;
+  while (true) {
+    switch (state_) {
+      case ReqState::WRITE_QUEUE:
+        // Request is being written into socket, we need to wait for it to be
+        // completely written, then reply with timeout.
+        state_ = ReqState::WRITE_QUEUE_CANCELED;
+        writeCanceled = true;
+        baton_.reset();
+        baton_.wait();
+        continue;
+      case ReqState::PENDING_QUEUE:
+        // Request wasn't sent to the network yet, reply with timeout.
+        queue_.removePending(*this);
+        return Reply(mc_res_timeout);
+      case ReqState::PENDING_REPLY_QUEUE:
+        // Request was sent to the network, but wasn't replied yet,
+        // reply with timeout. With in order protocol, its reply is still
+        // expected after those of the requests before it, and dropped.
+        queue_.removePendingReply(*this);
+        return Reply(mc_res_timeout);
+      case ReqState::SUPERSEDED:
+        // The request that superseded us wasn't replied in time.
+        unlinkSuperseded();
+        state_ = ReqState::NONE;
+        return Reply(mc_res_timeout);
+      case ReqState::COMPLETE:
+        assert(replyStorage_.hasValue());
+        return std::move(replyStorage_.value());
+      case ReqState::NONE:
+        // Canceled after being written
+        if (writeCanceled) {
+          return Reply(mc_res_timeout);
+        }
+        // fallthrough
+      case ReqState::WRITE_QUEUE_CANCELED:
+        failure::log("AsyncMcClient", failure::Category::kBrokenLogic,
+                     "Unexpected state of request: {}!",
+                     static_cast<uint64_t>(state_));
+        break;
+    }
+    break;
   }
   return Reply(mc_res_local_error);
 }
@@ -148,12 +195,11 @@ void McClientRequestContextQueue::reply(uint64_t id, Reply&& r) {
   // Get the context and erase it from the queue and map.
   McClientRequestContextBase* ctx{nullptr};
   if (outOfOrder_) {
-    auto iter = idMap_.find(id);
-    if (iter != idMap_.end()) {
-      ctx = iter->second;
+    ctx = idMap_.find(id);
+    if (ctx) {
       assert(ctx->state_ == State::PENDING_REPLY_QUEUE);
-      pendingReplyQueue_.erase(pendingReplyQueue_.iterator_to(*iter->second));
-      idMap_.erase(iter);
+      pendingReplyQueue_.erase(pendingReplyQueue_.iterator_to(*ctx));
+      idMap_.erase(id);
     }
   } else {
     // First we're going to receive replies for timed out requests.
@@ -162,6 +208,7 @@ void McClientRequestContextQueue::reply(uint64_t id, Reply&& r) {
     } else if (!pendingReplyQueue_.empty()) {
       ctx = &pendingReplyQueue_.front();
       pendingReplyQueue_.pop_front();
+      pushTimedOutAfter(*ctx);
     }
     // With old mc_parser it's possible to receive unexpected replies, we need
     // to ignore them.
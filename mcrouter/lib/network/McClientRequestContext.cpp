@@ -9,6 +9,9 @@
  */
 #include "McClientRequestContext.h"
 
+#include <algorithm>
+#include <iterator>
+
 namespace facebook { namespace memcache {
 
 void McClientRequestContextBase::canceled() {
@@ -18,14 +21,43 @@ void McClientRequestContextBase::canceled() {
 
 McClientRequestContextBase::~McClientRequestContextBase() {
   assert(state_ == ReqState::NONE || state_ == ReqState::COMPLETE);
+  assert(supersededNext_ == this);
+}
+
+void McClientRequestContextBase::completeSuperseded(mc_res_t result) {
+  while (supersededNext_ != this) {
+    auto& req = *supersededNext_;
+    assert(req.state_ == ReqState::SUPERSEDED);
+    req.unlinkSuperseded();
+    req.state_ = ReqState::NONE;
+    req.replyError(result);
+  }
+}
+
+void McClientRequestContextBase::unlinkSuperseded() {
+  supersededPrev_->supersededNext_ = supersededNext_;
+  supersededNext_->supersededPrev_ = supersededPrev_;
+  supersededPrev_ = supersededNext_ = this;
 }
 
 McClientRequestContextQueue::McClientRequestContextQueue(
-  bool outOfOrder) noexcept : outOfOrder_(outOfOrder) {
+  bool outOfOrder, bool supersedeUpdates, bool priorityLanes) noexcept
+    : outOfOrder_(outOfOrder),
+      supersedeUpdates_(supersedeUpdates),
+      priorityLanes_(priorityLanes) {
 }
 
 size_t McClientRequestContextQueue::getPendingRequestCount() const noexcept {
-  return pendingQueue_.size();
+  size_t count = 0;
+  for (const auto& queue : pendingQueues_) {
+    count += queue.size();
+  }
+  return count;
+}
+
+size_t McClientRequestContextQueue::getPendingRequestCount(
+    RequestPriority priority) const noexcept {
+  return pendingQueues_[static_cast<size_t>(priority)].size();
 }
 
 size_t McClientRequestContextQueue::getInflightRequestCount() const noexcept {
@@ -40,7 +72,10 @@ void McClientRequestContextQueue::failAllSent(mc_res_t error) {
 void McClientRequestContextQueue::failAllPending(mc_res_t error) {
   assert(pendingReplyQueue_.empty());
   assert(writeQueue_.empty());
-  failQueue(pendingQueue_, error);
+  latestPending_.clear();
+  for (auto& queue : pendingQueues_) {
+    failQueue(queue, error);
+  }
 }
 
 void McClientRequestContextQueue::clearStoredInitializers() {
@@ -51,24 +86,83 @@ void McClientRequestContextQueue::clearStoredInitializers() {
 
 size_t McClientRequestContextQueue::getFirstId() const {
   assert(getPendingRequestCount());
-  return pendingQueue_.front().id;
+  for (const auto& queue : pendingQueues_) {
+    if (!queue.empty()) {
+      return queue.front().id;
+    }
+  }
+  return 0;
 }
 
 void McClientRequestContextQueue::markAsPending(
     McClientRequestContextBase& req) {
   assert(req.state_ == State::NONE);
+  if (supersedeUpdates_ && !req.key_.empty()) {
+    supersedePending(req);
+  }
   req.state_ = State::PENDING_QUEUE;
-  pendingQueue_.push_back(req);
+  pendingQueueOf(req).push_back(req);
 
   if (outOfOrder_) {
-    idMap_[req.id] = &req;
+    idMap_.insert(req.id, &req);
+  }
+}
+
+void McClientRequestContextQueue::supersedePending(
+    McClientRequestContextBase& req) {
+  auto it = latestPending_.find(req.key_);
+  if (it == latestPending_.end()) {
+    latestPending_.emplace(req.key_, &req);
+    return;
+  }
+
+  auto& prev = *it->second;
+  // The key in the map points into prev's request
+  latestPending_.erase(it);
+  latestPending_.emplace(req.key_, &req);
+  if (req.supersedeOp_ == mc_op_unknown ||
+      prev.supersedeOp_ != req.supersedeOp_ ||
+      prev.replyType_ != req.replyType_) {
+    return;
+  }
+
+  assert(prev.state_ == State::PENDING_QUEUE);
+  removeFromMap(prev.id);
+  auto& prevQueue = pendingQueueOf(prev);
+  prevQueue.erase(prevQueue.iterator_to(prev));
+  prev.state_ = State::SUPERSEDED;
+  // prev's caller waits for req now, don't send it later than prev would be
+  req.priority_ = std::min(req.priority_, prev.priority_);
+  // Merge prev's ring (prev and what it superseded) into req's
+  auto prevNext = prev.supersededNext_;
+  auto reqNext = req.supersededNext_;
+  prev.supersededNext_ = reqNext;
+  reqNext->supersededPrev_ = &prev;
+  req.supersededNext_ = prevNext;
+  prevNext->supersededPrev_ = &req;
+}
+
+void McClientRequestContextQueue::removeLatestPending(
+    McClientRequestContextBase& req) {
+  if (!supersedeUpdates_ || req.key_.empty()) {
+    return;
+  }
+  auto it = latestPending_.find(req.key_);
+  if (it != latestPending_.end() && it->second == &req) {
+    latestPending_.erase(it);
   }
 }
 
 McClientRequestContextBase& McClientRequestContextQueue::markNextAsSending() {
-  auto& req = pendingQueue_.front();
-  pendingQueue_.pop_front();
+  auto queue = &pendingQueues_[0];
+  while (queue->empty()) {
+    ++queue;
+    assert(queue < pendingQueues_ + kNumRequestPriorities);
+  }
+  auto& req = queue->front();
+  queue->pop_front();
   assert(req.state_ == State::PENDING_QUEUE);
+  removeLatestPending(req);
   req.state_ = State::WRITE_QUEUE;
   writeQueue_.push_back(req);
   return req;
@@ -81,7 +175,12 @@ McClientRequestContextBase& McClientRequestContextQueue::markNextAsSent() {
     removeFromMap(req.id);
     // We already sent this request, so we're going to get a reply in future.
     if (!outOfOrder_) {
-      timedOutInitializers_.push(req.initializer_);
+      if (pendingReplyQueue_.empty()) {
+        timedOutInitializers_.push(req.initializer_);
+      } else {
+        // After the replies of requests sent before it
+        pendingReplyQueue_.back().timedOutAfter_.push_back(req.initializer_);
+      }
     }
     req.canceled();
   } else {
@@ -113,29 +212,50 @@ void McClientRequestContextQueue::removePending(
     McClientRequestContextBase& req) {
   assert(req.state_ == State::PENDING_QUEUE);
   removeFromMap(req.id);
-  pendingQueue_.erase(pendingQueue_.iterator_to(req));
+  removeLatestPending(req);
+  auto& queue = pendingQueueOf(req);
+  queue.erase(queue.iterator_to(req));
   req.state_ = State::NONE;
 }
 
 void McClientRequestContextQueue::removePendingReply(
     McClientRequestContextBase& req) {
   assert(req.state_ == State::PENDING_REPLY_QUEUE);
-  assert(&req == &pendingReplyQueue_.front());
   removeFromMap(req.id);
-  pendingReplyQueue_.erase(pendingReplyQueue_.iterator_to(req));
-  req.state_ = State::NONE;
+  auto it = pendingReplyQueue_.iterator_to(req);
   // We need timedOutInitializers_ only for in order protocol.
   if (!outOfOrder_) {
-    timedOutInitializers_.push(req.initializer_);
+    if (it == pendingReplyQueue_.begin()) {
+      timedOutInitializers_.push(req.initializer_);
+      pushTimedOutAfter(req);
+    } else {
+      // Replies can't be skipped: the request sent before it drops ours
+      // (and those it had to) once replied to
+      auto& prev = *std::prev(it);
+      prev.timedOutAfter_.push_back(req.initializer_);
+      prev.timedOutAfter_.insert(prev.timedOutAfter_.end(),
+                                 req.timedOutAfter_.begin(),
+                                 req.timedOutAfter_.end());
+      req.timedOutAfter_.clear();
+    }
   }
+  pendingReplyQueue_.erase(it);
+  req.state_ = State::NONE;
+}
+
+void McClientRequestContextQueue::pushTimedOutAfter(
+    McClientRequestContextBase& req) {
+  for (auto initializer : req.timedOutAfter_) {
+    timedOutInitializers_.push(initializer);
+  }
+  req.timedOutAfter_.clear();
 }
 
 McClientRequestContextBase::InitializerFuncPtr
 McClientRequestContextQueue::getParserInitializer(uint64_t reqId) {
   if (outOfOrder_) {
-    auto it = idMap_.find(reqId);
-    if (it != idMap_.end()) {
-      return it->second->initializer_;
+    if (auto req = idMap_.find(reqId)) {
+      return req->initializer_;
     }
   } else {
     // In inorder protocol we expect to receive timedout requests first.
@@ -148,4 +268,24 @@ McClientRequestContextQueue::getParserInitializer(uint64_t reqId) {
   return nullptr;
 }
 
+McClientRequestContextBase*
+McClientRequestContextQueue::findRequestForReply(uint64_t id) {
+  if (outOfOrder_) {
+    return idMap_.find(id);
+  }
+  if (!timedOutInitializers_.empty() || pendingReplyQueue_.empty()) {
+    return nullptr;
+  }
+  return &pendingReplyQueue_.front();
+}
+
+McClientRequestContextBase*
+McClientRequestContextQueue::getReplyingRequest() {
+  if (outOfOrder_ || !timedOutInitializers_.empty() ||
+      pendingReplyQueue_.empty()) {
+    return nullptr;
+  }
+  return &pendingReplyQueue_.front();
+}
+
 }}  // facebook::memcache
@@ -10,13 +10,20 @@
 #pragma once
 
 #include <typeindex>
+#include <unordered_map>
+#include <vector>
 
 #include <folly/IntrusiveList.h>
+#include <folly/Range.h>
 #include <folly/experimental/fibers/Baton.h>
 
 #include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/McRequestBase.h"
 #include "mcrouter/lib/network/FBTrace.h"
 #include "mcrouter/lib/network/ClientMcParser.h"
+#include "mcrouter/lib/network/IdRingMap.h"
+#include "mcrouter/lib/network/McClientTimestamps.h"
+#include "mcrouter/lib/network/McReplyStream.h"
 #include "mcrouter/lib/network/McSerializedRequest.h"
 
 namespace facebook { namespace memcache {
@@ -35,6 +42,14 @@ class McClientRequestContextBase {
 
   McSerializedRequest reqContext;
   uint64_t id;
+  /* If set, receives the time the request was written into the socket */
+  int64_t* writtenTimeUs{nullptr};
+  /* If set, receives the times of ConnectionOptions::enableKernelTimestamps */
+  McClientTimestamps* timestamps{nullptr};
+  /* If set, offered the value of a hit while it's being read */
+  McReplyStream* replyStream{nullptr};
+  /* Value bytes already handed to replyStream */
+  size_t streamedBytes{0};
 
   McClientRequestContextBase(const McClientRequestContextBase&) = delete;
   McClientRequestContextBase& operator=(const McClientRequestContextBase& other)
@@ -63,6 +78,7 @@ class McClientRequestContextBase {
     WRITE_QUEUE,
     WRITE_QUEUE_CANCELED,
     PENDING_REPLY_QUEUE,
+    SUPERSEDED,
     COMPLETE,
   };
 
@@ -90,9 +106,36 @@ class McClientRequestContextBase {
   folly::SafeIntrusiveListHook hook_;
   void* replyStorage_;
   InitializerFuncPtr initializer_;
+  /*
+   * In order protocol: parser initializers of the requests sent right
+   * after this one that timed out already. Their replies come after ours,
+   * and are dropped.
+   */
+  std::vector<InitializerFuncPtr> timedOutAfter_;
+
+  /* Key of the request, and its operation if it may supersede another */
+  folly::StringPiece key_;
+  mc_op_t supersedeOp_;
+  RequestPriority priority_;
+  /*
+   * Ring of this request and the ones it superseded (if it's live), or of
+   * the request that superseded this one and the others it did.
+   */
+  McClientRequestContextBase* supersededPrev_{this};
+  McClientRequestContextBase* supersededNext_{this};
 
   void cancelAndWait();
 
+  /**
+   * Replies to all requests this one superseded with the given result.
+   */
+  void completeSuperseded(mc_res_t result);
+
+  /**
+   * Removes this request from the ring it's in.
+   */
+  void unlinkSuperseded();
+
   /**
    * Notify context that request was canceled in AsyncMcClientImpl
    */
@@ -127,10 +170,24 @@ class McClientRequestContext : public McClientRequestContextBase {
   void replyError(mc_res_t result) override;
   const char* fakeReply() const override;
 
+  /**
+   * Blocks the fiber until the reply arrives or timeout expires.
+   *
+   * The timeout is registered with the FiberManager's TimeoutController,
+   * which keeps one FIFO list per distinct duration and a single event
+   * loop timer for the earliest expiration. Registering is an append and
+   * cancelling on reply is O(1), so passing the same timeout for all
+   * requests of a connection (as ProxyDestination does) keeps them in one
+   * bucket.
+   *
+   * @param timeout  0 means wait forever.
+   */
   Reply waitForReply(std::chrono::milliseconds timeout);
  private:
   folly::Optional<Reply> replyStorage_;
 
+  Reply waitForReplyImpl(std::chrono::milliseconds timeout);
+
 #ifndef LIBMC_FBTRACE_DISABLE
   const mc_fbtrace_info_s* fbtraceInfo_;
 #endif
@@ -139,7 +196,13 @@ class McClientRequestContext : public McClientRequestContextBase {
 
 class McClientRequestContextQueue {
  public:
-  explicit McClientRequestContextQueue(bool outOfOrder) noexcept;
+  /**
+   * @param supersedeUpdates  see ConnectionOptions::supersedePendingUpdates
+   * @param priorityLanes  see ConnectionOptions::priorityLanes
+   */
+  explicit McClientRequestContextQueue(bool outOfOrder,
+                                       bool supersedeUpdates = false,
+                                       bool priorityLanes = false) noexcept;
 
   McClientRequestContextQueue(const McClientRequestContextQueue&) = delete;
   McClientRequestContextQueue& operator=(
@@ -151,6 +214,12 @@ class McClientRequestContextQueue {
   size_t getPendingRequestCount() const noexcept;
   size_t getInflightRequestCount() const noexcept;
 
+  /**
+   * Pending requests of the given priority (all are NORMAL without
+   * priority lanes).
+   */
+  size_t getPendingRequestCount(RequestPriority priority) const noexcept;
+
   /**
    * Fails all requests that were already sent (i.e. pending reply) with a given
    * error code.
@@ -172,12 +241,14 @@ class McClientRequestContextQueue {
   size_t getFirstId() const;
 
   /**
-   * Adds request into pending queue.
+   * Adds request into pending queue. With supersedeUpdates, it may take the
+   * place of a pending request for the same key instead.
    */
   void markAsPending(McClientRequestContextBase& req);
 
   /**
-   * Moves the first request from pending queue into sending queue.
+   * Moves the first request from pending queue (of the highest priority
+   * having any) into sending queue.
    *
    * @return a reference to the request that was marked as sending.
    */
@@ -203,6 +274,12 @@ class McClientRequestContextQueue {
   template <class Reply>
   void reply(uint64_t id, Reply&& reply);
 
+  /**
+   * @return  the request that the next call to reply(id, ...) goes to,
+   *          nullptr if there's none.
+   */
+  McClientRequestContextBase* findRequestForReply(uint64_t id);
+
   /**
    * Obtain a function that should be used to initialize parser for given
    * request.
@@ -215,6 +292,14 @@ class McClientRequestContextQueue {
   McClientRequestContextBase::InitializerFuncPtr
   getParserInitializer(uint64_t reqId = 0);
 
+  /**
+   * In order protocol only: the request whose reply is being parsed.
+   *
+   * @return  nullptr for out of order protocol, or if that request
+   *          timed out.
+   */
+  McClientRequestContextBase* getReplyingRequest();
+
  private:
   // Friend to allow access to remove* mothods.
   template<class Operation, class Request>
@@ -223,22 +308,50 @@ class McClientRequestContextQueue {
   using State = McClientRequestContextBase::ReqState;
 
   bool outOfOrder_{false};
-  // Queue of requests, that are queued to be sent.
-  McClientRequestContextBase::Queue pendingQueue_;
+  // Queues of requests, that are queued to be sent, one per priority.
+  // Only pendingQueues_[NORMAL] is used without priorityLanes_.
+  McClientRequestContextBase::Queue pendingQueues_[kNumRequestPriorities];
   // Queue of requests, that are currently being written to the socket.
   McClientRequestContextBase::Queue writeQueue_;
   // Queue of requests, that are already sent and are waiting for replies.
   McClientRequestContextBase::Queue pendingReplyQueue_;
   // Id to request map. Used only in case of out-of-order protocol for fast
   // request lookup.
-  std::unordered_map<uint64_t, McClientRequestContextBase*> idMap_;
+  IdRingMap<McClientRequestContextBase*> idMap_;
 
   // Storage for parser initializers for timed out requests.
   std::queue<McClientRequestContextBase::InitializerFuncPtr>
   timedOutInitializers_;
 
+  bool supersedeUpdates_{false};
+  bool priorityLanes_{false};
+  // With supersedeUpdates_: the latest pending request for each key.
+  std::unordered_map<folly::StringPiece, McClientRequestContextBase*,
+                     folly::StringPieceHash> latestPending_;
+
+  /**
+   * With supersedeUpdates_, makes req the latest pending request for its
+   * key, superseding the previous one if they are the same kind of update.
+   */
+  void supersedePending(McClientRequestContextBase& req);
+
+  /**
+   * Forgets req as the latest pending request for its key, if it is.
+   */
+  void removeLatestPending(McClientRequestContextBase& req);
+
   void failQueue(McClientRequestContextBase::Queue& queue, mc_res_t error);
 
+  /**
+   * The pending queue req is (or goes) in.
+   */
+  McClientRequestContextBase::Queue& pendingQueueOf(
+      const McClientRequestContextBase& req) {
+    return priorityLanes_
+      ? pendingQueues_[static_cast<size_t>(req.priority_)]
+      : pendingQueues_[static_cast<size_t>(RequestPriority::NORMAL)];
+  }
+
   void removeFromMap(uint64_t id);
 
   /**
@@ -250,10 +363,17 @@ class McClientRequestContextQueue {
    * Removes given request from pending reply queue and from id map.
    *
    * Calling this method indicates that this request wasn't replied, but
-   * we should expect a reply from network.
+   * we should expect a reply from network. With in order protocol, that
+   * reply is dropped once the requests before it are replied to.
    */
   void removePendingReply(McClientRequestContextBase& req);
 
+  /**
+   * In order protocol: req is done with, the next replies to expect are
+   * those of req.timedOutAfter_.
+   */
+  void pushTimedOutAfter(McClientRequestContextBase& req);
+
   /**
    * Should be called whenever the network communication channel gets closed.
    */
@@ -0,0 +1,33 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+
+namespace facebook { namespace memcache {
+
+/**
+ * When a request went through the client and the kernel, in steady_clock
+ * microseconds (see AsyncMcClient::sendSync()). 0 means unknown.
+ */
+struct McClientTimestamps {
+  /* The request was written into the socket */
+  int64_t writtenUs{0};
+  /* The kernel handed the request's last byte to the device, needs
+     ConnectionOptions::enableKernelTimestamps */
+  int64_t kernelTxUs{0};
+  /* The reply was read from the socket */
+  int64_t readUs{0};
+  /* Set by the client: bytes written into the connection up to and
+     including the request */
+  uint64_t streamEnd{0};
+};
+
+}}  // facebook::memcache
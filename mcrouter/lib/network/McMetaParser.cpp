@@ -0,0 +1,308 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "McMetaParser.h"
+
+#include <cstring>
+
+namespace facebook { namespace memcache {
+
+constexpr size_t McMetaParser::kMaxLineLength;
+
+namespace {
+
+bool parseUInt(folly::StringPiece token, uint64_t& value) {
+  uint64_t result = 0;
+  for (auto c : token) {
+    auto digit = static_cast<unsigned char>(c - '0');
+    if (digit >= 10 || result > (UINT64_MAX - digit) / 10) {
+      return false;
+    }
+    result = result * 10 + digit;
+  }
+  value = result;
+  return !token.empty();
+}
+
+/**
+ * Splits off the first space separated token of line.
+ */
+folly::StringPiece nextToken(folly::StringPiece& line) {
+  while (!line.empty() && line.front() == ' ') {
+    line.advance(1);
+  }
+  auto end = line.find(' ');
+  if (end == std::string::npos) {
+    end = line.size();
+  }
+  auto token = line.subpiece(0, end);
+  line.advance(end);
+  return token;
+}
+
+bool isStorage(mc_op_t op) {
+  switch (op) {
+    case mc_op_set:
+    case mc_op_add:
+    case mc_op_replace:
+    case mc_op_append:
+    case mc_op_prepend:
+    case mc_op_cas:
+    case mc_op_lease_set:
+      return true;
+    default:
+      return false;
+  }
+}
+
+}  // anonymous namespace
+
+void McMetaParser::initialize(mc_op_t operation) {
+  assert(state_ == State::UNINIT);
+  state_ = State::PARTIAL;
+  operation_ = operation;
+  reply_ = McReply();
+  valueLength_ = 0;
+  valueRemaining_ = 0;
+  value_.reset();
+  cas_ = 0;
+  win_ = false;
+  won_ = false;
+}
+
+McReply McMetaParser::getReply() {
+  assert(state_ == State::COMPLETE);
+  state_ = State::UNINIT;
+  return std::move(reply_);
+}
+
+McMetaParser::State McMetaParser::consume(folly::IOBuf& buffer) {
+  assert(state_ == State::PARTIAL);
+  if (valueRemaining_ > 0) {
+    return consumeValue(buffer);
+  }
+  return consumeLine(buffer);
+}
+
+McMetaParser::State McMetaParser::consumeLine(folly::IOBuf& buffer) {
+  auto data = reinterpret_cast<const char*>(buffer.data());
+  auto length = buffer.length();
+  auto lineEnd = static_cast<const char*>(std::memchr(data, '\n', length));
+  if (lineEnd == nullptr) {
+    if (line_.size() + length > kMaxLineLength) {
+      return error();
+    }
+    line_.append(data, length);
+    buffer.trimStart(length);
+    return State::PARTIAL;
+  }
+
+  folly::StringPiece line(data, lineEnd);
+  if (!line_.empty()) {
+    line_.append(data, lineEnd);
+    line = line_;
+  }
+  if (!line.empty() && line.back() == '\r') {
+    line.pop_back();
+  }
+  bool parsed = parseLine(line);
+  line_.clear();
+  buffer.trimStart(lineEnd + 1 - data);
+  if (!parsed) {
+    return error();
+  }
+
+  if (valueRemaining_ > 0) {
+    return consumeValue(buffer);
+  }
+  return finish();
+}
+
+McMetaParser::State McMetaParser::consumeValue(folly::IOBuf& buffer) {
+  if (!value_ && buffer.length() >= valueRemaining_) {
+    /* The whole value is in the buffer, no need for a copy */
+    auto value = buffer.cloneOne();
+    value->trimEnd(value->length() - valueLength_);
+    buffer.trimStart(valueRemaining_);
+    valueRemaining_ = 0;
+    reply_.setValue(std::move(*value));
+    return finish();
+  }
+
+  if (!value_) {
+    value_ = folly::IOBuf::create(valueLength_);
+  }
+  auto length = std::min(buffer.length(), valueRemaining_);
+  /* The trailing "\r\n" isn't part of the value */
+  auto valueLeft = valueLength_ - value_->length();
+  auto valueBytes = std::min(length, valueLeft);
+  std::memcpy(value_->writableTail(), buffer.data(), valueBytes);
+  value_->append(valueBytes);
+  buffer.trimStart(length);
+  valueRemaining_ -= length;
+  if (valueRemaining_ > 0) {
+    return State::PARTIAL;
+  }
+  reply_.setValue(std::move(*value_));
+  value_.reset();
+  return finish();
+}
+
+bool McMetaParser::parseLine(folly::StringPiece line) {
+  auto code = nextToken(line);
+
+  if (code == "VA") {
+    switch (operation_) {
+      case mc_op_get:
+      case mc_op_gets:
+      case mc_op_lease_get:
+      case mc_op_incr:
+      case mc_op_decr:
+        break;
+      default:
+        return false;
+    }
+    uint64_t size;
+    if (!parseUInt(nextToken(line), size)) {
+      return false;
+    }
+    reply_.setResult(mc_res_found);
+    valueLength_ = size;
+    valueRemaining_ = size + 2;
+    return parseFlags(line);
+  }
+  if (code == "HD") {
+    if (isStorage(operation_)) {
+      reply_.setResult(mc_res_stored);
+    } else if (operation_ == mc_op_delete) {
+      reply_.setResult(mc_res_deleted);
+    } else if (operation_ == mc_op_touch) {
+      reply_.setResult(mc_res_touched);
+    } else {
+      return false;
+    }
+    return parseFlags(line);
+  }
+  if (code == "EN" || code == "NF") {
+    reply_.setResult(operation_ == mc_op_lease_set ? mc_res_notstored
+                                                   : mc_res_notfound);
+    return parseFlags(line);
+  }
+  if (code == "NS") {
+    reply_.setResult(mc_res_notstored);
+    return parseFlags(line);
+  }
+  if (code == "EX") {
+    reply_.setResult(operation_ == mc_op_lease_set ? mc_res_notstored
+                                                   : mc_res_exists);
+    return parseFlags(line);
+  }
+  if (code == "VERSION") {
+    if (operation_ != mc_op_version) {
+      return false;
+    }
+    reply_.setResult(mc_res_ok);
+    reply_.setValue(line.subpiece(line.empty() ? 0 : 1));
+    return true;
+  }
+  if (code == "SERVER_ERROR" || code == "CLIENT_ERROR") {
+    if (!line.empty()) {
+      line.advance(1);
+    }
+    if (code == "CLIENT_ERROR") {
+      reply_.setResult(mc_res_client_error);
+    } else if (line.startsWith("307 ")) {
+      reply_.setAppSpecificErrorCode(SERVER_ERROR_BUSY);
+      reply_.setResult(mc_res_busy);
+    } else {
+      reply_.setResult(mc_res_remote_error);
+    }
+    reply_.setValue(line);
+    return true;
+  }
+  /* ERROR (unknown command) and anything else */
+  return false;
+}
+
+bool McMetaParser::parseFlags(folly::StringPiece flags) {
+  while (true) {
+    auto token = nextToken(flags);
+    if (token.empty()) {
+      return true;
+    }
+    auto flag = token.front();
+    token.advance(1);
+    uint64_t number;
+    switch (flag) {
+      case 'f':
+        if (!parseUInt(token, number)) {
+          return false;
+        }
+        reply_.setFlags(number);
+        break;
+      case 'c':
+        if (!parseUInt(token, cas_)) {
+          return false;
+        }
+        break;
+      case 'W':
+        win_ = true;
+        break;
+      case 'Z':
+        won_ = true;
+        break;
+      default:
+        /* Flags we didn't ask for (opaque, key, ttl, stale...) */
+        break;
+    }
+  }
+}
+
+McMetaParser::State McMetaParser::finish() {
+  switch (operation_) {
+    case mc_op_gets:
+      reply_.setCas(cas_);
+      break;
+    case mc_op_lease_get:
+      /* Same results as the classic lease-get: a miss with the token
+         if we should fill the item, or with token 1 if somebody else
+         does (the stale value, if any, is returned) */
+      if (win_) {
+        reply_.setResult(mc_res_notfound);
+        reply_.setLeaseToken(cas_);
+      } else if (won_) {
+        reply_.setResult(mc_res_notfound);
+        reply_.setLeaseToken(1);
+      }
+      break;
+    case mc_op_incr:
+    case mc_op_decr:
+      if (reply_.result() == mc_res_found) {
+        uint64_t delta;
+        if (!parseUInt(reply_.valueRangeSlow(), delta)) {
+          return error();
+        }
+        reply_.setResult(mc_res_stored);
+        reply_.setDelta(delta);
+        reply_.setValue(folly::StringPiece());
+      }
+      break;
+    default:
+      break;
+  }
+  state_ = State::COMPLETE;
+  return state_;
+}
+
+McMetaParser::State McMetaParser::error() {
+  state_ = State::ERROR;
+  return state_;
+}
+
+}}  // facebook::memcache
@@ -0,0 +1,114 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <folly/io/IOBuf.h>
+#include <folly/Range.h>
+
+#include "mcrouter/lib/mc/msg.h"
+#include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/McReply.h"
+
+namespace facebook { namespace memcache {
+
+/**
+ * Client side parser of meta protocol replies (see MetaSerializedRequest).
+ *
+ * Replies come in the order of requests, the parser is told what to expect
+ * before each one with initializeReplyParser(). Reply lines are parsed
+ * once complete, values are cloned from the read buffer when it holds
+ * them completely, and copied otherwise.
+ */
+class McMetaParser {
+ public:
+  enum class State {
+    // The parser is not initialized to parse any messages.
+    UNINIT,
+    // Have partial message, and need more data to complete it.
+    PARTIAL,
+    // There was an error on the protocol level.
+    ERROR,
+    // Complete message had been parsed and ready to be returned.
+    COMPLETE,
+  };
+
+  /**
+   * Reply lines longer than this are an error.
+   */
+  static constexpr size_t kMaxLineLength = 4096;
+
+  McMetaParser() = default;
+
+  McMetaParser(const McMetaParser&) = delete;
+  McMetaParser& operator=(const McMetaParser&) = delete;
+
+  /**
+   * Consumes data from the beginning of the buffer, up to the end of
+   * the reply (or all of it for a partial reply).
+   *
+   * @return  new parser state.
+   */
+  State consume(folly::IOBuf& buffer);
+
+  /**
+   * Prepares parser for parsing reply for given request type and operation.
+   */
+  template <class Operation, class Request>
+  void initializeReplyParser() {
+    initialize(Operation::mc_op);
+  }
+
+  /**
+   * Obtain the reply after consume() returned State::COMPLETE.
+   */
+  McReply getReply();
+
+  State getCurrentState() const {
+    return state_;
+  }
+
+ private:
+  State state_{State::UNINIT};
+  mc_op_t operation_{mc_op_unknown};
+  McReply reply_;
+
+  /* Beginning of a reply line split between reads */
+  std::string line_;
+
+  /* Value being read: its length, and bytes left with the trailing "\r\n" */
+  size_t valueLength_{0};
+  size_t valueRemaining_{0};
+  std::unique_ptr<folly::IOBuf> value_;
+
+  /* Return flags of the reply line */
+  uint64_t cas_{0};
+  bool win_{false};
+  bool won_{false};
+
+  void initialize(mc_op_t operation);
+
+  State consumeLine(folly::IOBuf& buffer);
+  State consumeValue(folly::IOBuf& buffer);
+
+  /**
+   * Parses a complete reply line without its line end.
+   * @return  false on malformed or unexpected replies.
+   */
+  bool parseLine(folly::StringPiece line);
+  bool parseFlags(folly::StringPiece flags);
+
+  State finish();
+  State error();
+};
+
+}}  // facebook::memcache
@@ -9,9 +9,13 @@
  */
 #include "McParser.h"
 
+#include <vector>
+
 #include <folly/Bits.h>
 #include <folly/Memory.h>
+#include <folly/ThreadLocal.h>
 
+#include "mcrouter/lib/network/HugePageArena.h"
 #include "mcrouter/lib/network/UmbrellaProtocol.h"
 
 namespace facebook { namespace memcache {
@@ -19,8 +23,38 @@ namespace facebook { namespace memcache {
 /* Adjust buffer size after this many requests */
 const size_t kAdjustBufferSizeInterval = 10000;
 
-/* Decay previous bytes per request value with this constant */
-const double kBprDecay = 0.9;
+/* Buffer is sized to fit messagesPerRead messages of the size that
+   this fraction of all bytes read comes in */
+const double kCoveredBytesFraction = 0.9;
+
+namespace {
+
+/* Every EventBase runs on its own thread, so this is
+   effectively a per-EventBase pool */
+std::vector<folly::IOBuf>& bufferPool() {
+  static folly::ThreadLocal<std::vector<folly::IOBuf>> pool;
+  return *pool;
+}
+
+void freeHugePageBuffer(void* buf, void* /* userData */) {
+  HugePageArena::deallocate(buf);
+}
+
+/**
+ * Read buffer of the given capacity, from HugePageArena if it's enabled.
+ */
+folly::IOBuf createReadBuffer(size_t size) {
+  if (auto buf = HugePageArena::allocate(size)) {
+    return folly::IOBuf(folly::IOBuf::TAKE_OWNERSHIP, buf, size,
+                        /* length= */ 0, freeHugePageBuffer);
+  }
+  return folly::IOBuf(folly::IOBuf::CREATE, size);
+}
+
+}  // anonymous namespace
+
+constexpr size_t McParser::kMaxPooledBuffers;
+constexpr size_t McParser::kNumSizeBuckets;
 
 McParser::McParser(ParserCallback& callback,
                    size_t requestsPerRead,
@@ -30,8 +64,7 @@ McParser::McParser(ParserCallback& callback,
       messagesPerRead_(requestsPerRead),
       minBufferSize_(minBufferSize),
       maxBufferSize_(maxBufferSize),
-      bufferSize_(maxBufferSize),
-      readBuffer_(folly::IOBuf::CREATE, bufferSize_) {
+      bufferSize_(maxBufferSize) {
 }
 
 McParser::~McParser() {
@@ -39,7 +72,7 @@ McParser::~McParser() {
 
 void McParser::shrinkBuffers() {
   if (readBuffer_.length() == 0 && bufferShrinkRequired_) {
-    readBuffer_ = folly::IOBuf(folly::IOBuf::CREATE, bufferSize_);
+    readBuffer_ = createReadBuffer(bufferSize_);
     bufferShrinkRequired_ = false;
   }
 }
@@ -51,6 +84,9 @@ std::pair<void*, size_t> McParser::getReadBuffer() {
     return std::make_pair(umBodyBuffer_->writableTail(),
                           umMsgInfo_.bodySize - umBodyBuffer_->length());
   } else {
+    if (readBuffer_.capacity() == 0) {
+      acquireReadBuffer();
+    }
     readBuffer_.unshare();
     if (!readBuffer_.length() && readBuffer_.capacity() > 0) {
       /* If we read everything, reset pointers to 0 and re-use the buffer */
@@ -68,23 +104,123 @@ std::pair<void*, size_t> McParser::getReadBuffer() {
   }
 }
 
+void McParser::acquireReadBuffer() {
+  auto& pool = bufferPool();
+  for (auto it = pool.rbegin(); it != pool.rend(); ++it) {
+    if (it->capacity() >= bufferSize_) {
+      std::swap(*it, pool.back());
+      readBuffer_ = std::move(pool.back());
+      pool.pop_back();
+      return;
+    }
+  }
+  readBuffer_ = createReadBuffer(bufferSize_);
+}
+
+void McParser::releaseReadBuffer() {
+  if (readBuffer_.capacity() == 0 || readBuffer_.length() != 0 ||
+      umBodyBuffer_) {
+    return;
+  }
+  if (readBuffer_.isShared()) {
+    /* Parsed messages still reference the data. Let them own it instead of
+       copying it on the next read (see unshare() in getReadBuffer()). */
+    readBuffer_ = folly::IOBuf();
+    bufferShrinkRequired_ = false;
+    return;
+  }
+  if (bufferShrinkRequired_) {
+    /* Grown beyond bufferSize_, don't keep it around */
+    readBuffer_ = folly::IOBuf();
+    bufferShrinkRequired_ = false;
+    return;
+  }
+  auto& pool = bufferPool();
+  if (pool.size() < kMaxPooledBuffers) {
+    readBuffer_.clear();
+    pool.push_back(std::move(readBuffer_));
+    readBuffer_ = folly::IOBuf();
+  }
+}
+
 void McParser::recalculateBufferSize(size_t read) {
-  readBytes_ += read;
+  bytesSinceMessage_ += read;
+  auto newMessages = parsedMessages_ - lastParsedMessages_;
+  lastParsedMessages_ = parsedMessages_;
+  if (newMessages > 0) {
+    /* Bytes of a partially read message at the end are attributed to
+       the messages parsed so far, which is close enough for sizing. */
+    size_t bucket = std::min<size_t>(
+      folly::findLastSet(bytesSinceMessage_ / newMessages),
+      kNumSizeBuckets - 1);
+    sizeHistogram_[bucket] += newMessages;
+    bytesSinceMessage_ = 0;
+  }
+
   if (LIKELY(parsedMessages_ < kAdjustBufferSizeInterval)) {
     return;
   }
 
-  double bpr = (double)readBytes_ / parsedMessages_;
-  if (UNLIKELY(bytesPerRequest_ == 0.0)) {
-    bytesPerRequest_ = bpr;
-  } else {
-    bytesPerRequest_ = bytesPerRequest_ * kBprDecay + bpr * (1.0 - kBprDecay);
+  /* Bucket i holds messages smaller than 2^i bytes */
+  double totalBytes = 0.0;
+  for (size_t i = 0; i < kNumSizeBuckets; ++i) {
+    totalBytes += static_cast<double>(sizeHistogram_[i]) * (1ULL << i);
+  }
+  double coveredBytes = 0.0;
+  size_t bucket = 0;
+  for (; bucket < kNumSizeBuckets - 1; ++bucket) {
+    coveredBytes += static_cast<double>(sizeHistogram_[bucket]) *
+      (1ULL << bucket);
+    if (coveredBytes >= totalBytes * kCoveredBytesFraction) {
+      break;
+    }
   }
+  size_t messageSize = 1ULL << bucket;
+
   bufferSize_ = std::max(
     minBufferSize_,
-    std::min((size_t)bytesPerRequest_ * messagesPerRead_, maxBufferSize_));
+    std::min(messageSize * messagesPerRead_, maxBufferSize_));
+
+  /* Decay, so that the histogram follows changes in the traffic */
+  for (auto& count : sizeHistogram_) {
+    count /= 2;
+  }
   parsedMessages_ = 0;
-  readBytes_ = 0;
+  lastParsedMessages_ = 0;
+}
+
+bool McParser::umFrameReady(const uint8_t* header,
+                            const uint8_t* body,
+                            const folly::IOBuf& bodyBuffer) {
+  if (umMsgInfo_.version != UmbrellaVersion::BATCH) {
+    return callback_.umMessageReady(umMsgInfo_, header, body, bodyBuffer);
+  }
+
+  umbrellaBatches_ = true;
+  auto remaining = umMsgInfo_.bodySize;
+  for (size_t i = 0; i < umMsgInfo_.numMessages; ++i) {
+    UmbrellaMessageInfo info;
+    auto st = umbrellaParseHeader(body, remaining, info);
+    if (st != UmbrellaParseStatus::OK ||
+        info.version == UmbrellaVersion::BATCH ||
+        info.headerSize + info.bodySize > remaining) {
+      callback_.parseError(mc_res_remote_error,
+                           "Error parsing Umbrella batch");
+      return false;
+    }
+    if (!callback_.umMessageReady(info, body, body + info.headerSize,
+                                  bodyBuffer)) {
+      return false;
+    }
+    body += info.headerSize + info.bodySize;
+    remaining -= info.headerSize + info.bodySize;
+  }
+  if (remaining != 0) {
+    callback_.parseError(mc_res_remote_error,
+                         "Error parsing Umbrella batch: trailing data");
+    return false;
+  }
+  return true;
 }
 
 bool McParser::readUmbrellaData() {
@@ -106,11 +242,9 @@ bool McParser::readUmbrellaData() {
     auto messageSize = umMsgInfo_.headerSize + umMsgInfo_.bodySize;
     if (readBuffer_.length() >= messageSize) {
       /* 1) we already have the entire message */
-      if (!callback_.umMessageReady(
-            umMsgInfo_,
-            readBuffer_.data(),
-            readBuffer_.data() + umMsgInfo_.headerSize,
-            readBuffer_)) {
+      if (!umFrameReady(readBuffer_.data(),
+                        readBuffer_.data() + umMsgInfo_.headerSize,
+                        readBuffer_)) {
         readBuffer_.clear();
         return false;
       }
@@ -143,15 +277,15 @@ bool McParser::readDataAvailable(size_t len) {
     if (messagesPerRead_ > 0) {
       recalculateBufferSize(len);
     }
+    releaseReadBuffer();
   };
 
   if (umBodyBuffer_) {
     umBodyBuffer_->append(len);
     if (umBodyBuffer_->length() == umMsgInfo_.bodySize) {
-      auto res = callback_.umMessageReady(umMsgInfo_,
-                                          readBuffer_.data(),
-                                          umBodyBuffer_->data(),
-                                          *umBodyBuffer_);
+      auto res = umFrameReady(readBuffer_.data(),
+                              umBodyBuffer_->data(),
+                              *umBodyBuffer_);
       readBuffer_.clear();
       umBodyBuffer_.reset();
       return res;
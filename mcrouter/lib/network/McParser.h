@@ -9,6 +9,8 @@
  */
 #pragma once
 
+#include <array>
+
 #include <folly/io/IOBufQueue.h>
 
 #include "mcrouter/lib/mc/parser.h"
@@ -73,6 +75,21 @@ class McParser {
     return outOfOrder_;
   }
 
+  /**
+   * True once the peer sent an Umbrella BATCH frame, i.e. it can also
+   * parse them.
+   */
+  bool umbrellaBatches() const {
+    return umbrellaBatches_;
+  }
+
+  /**
+   * Bytes of the read buffer currently held, 0 while idle.
+   */
+  size_t bufferedBytes() const {
+    return readBuffer_.capacity();
+  }
+
   /**
    * TAsyncTransport-style getReadBuffer().
    *
@@ -93,9 +110,15 @@ class McParser {
   void reportMsgRead() {
     ++parsedMessages_;
   }
+
+  /**
+   * Max number of idle read buffers kept per thread for reuse.
+   */
+  static constexpr size_t kMaxPooledBuffers = 64;
  private:
   bool seenFirstByte_{false};
   bool outOfOrder_{false};
+  bool umbrellaBatches_{false};
 
   /* We shrink the read buffer if we grow it beyond bufferSize_ */
   bool bufferShrinkRequired_{false};
@@ -108,10 +131,28 @@ class McParser {
   size_t maxBufferSize_{4096};
   size_t bufferSize_{4096};
 
-  size_t readBytes_{0};
+  /* Message sizes are bucketed by powers of two, messages of
+     2^(kNumSizeBuckets - 1) bytes or more share the last bucket */
+  static constexpr size_t kNumSizeBuckets = 21;
+
+  /**
+   * Decayed number of messages seen in each size bucket, used to pick
+   * the buffer size. Unlike a plain average this isn't skewed by a mix of
+   * small and large messages.
+   */
+  std::array<uint32_t, kNumSizeBuckets> sizeHistogram_{};
+
+  /* Bytes read since the last fully parsed message */
+  size_t bytesSinceMessage_{0};
+  /* Messages parsed since the last buffer size adjustment */
   size_t parsedMessages_{0};
-  double bytesPerRequest_{0.0};
+  /* Messages parsed as of the previous read */
+  size_t lastParsedMessages_{0};
 
+  /**
+   * Allocated on first read, returned to the thread's pool whenever it's
+   * fully consumed, so idle connections don't hold on to buffers.
+   */
   folly::IOBuf readBuffer_;
 
   /**
@@ -127,8 +168,31 @@ class McParser {
 
   bool readUmbrellaData();
 
+  /**
+   * A complete Umbrella frame described by umMsgInfo_ was read.
+   * Passes its message, or every message of a BATCH frame, to the callback.
+   *
+   * @return  false on any parse error.
+   */
+  bool umFrameReady(const uint8_t* header,
+                    const uint8_t* body,
+                    const folly::IOBuf& bodyBuffer);
+
   void recalculateBufferSize(size_t read);
 
+  /**
+   * Take a buffer of at least bufferSize_ from the thread's pool,
+   * or allocate a new one.
+   */
+  void acquireReadBuffer();
+
+  /**
+   * Called after every read. If the read buffer is empty, gives it back
+   * to the thread's pool (or drops it if parsed messages still reference
+   * it), so only connections with partially read messages keep a buffer.
+   */
+  void releaseReadBuffer();
+
   /**
    * Shrink all buffers used if possible to reduce memory footprint.
    */
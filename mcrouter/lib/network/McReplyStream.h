@@ -0,0 +1,46 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include <folly/io/IOBuf.h>
+
+namespace facebook { namespace memcache {
+
+/**
+ * Receives the value of a get hit while it's still being read from the
+ * network, so that it can be forwarded before the whole reply is in
+ * (see AsyncMcClient::sendSync()).
+ *
+ * The complete reply is still returned as usual once read, its value made
+ * of the same buffers as the streamed chunks.
+ */
+class McReplyStream {
+ public:
+  virtual ~McReplyStream() {}
+
+  /**
+   * A hit with a value of valueLength bytes started being read.
+   *
+   * @return  true to receive the value through data() as it is read,
+   *          false to only get the complete reply.
+   */
+  virtual bool start(uint64_t flags, size_t valueLength) = 0;
+
+  /**
+   * Next bytes of the value accepted by start(), in order.
+   */
+  virtual void data(std::unique_ptr<folly::IOBuf> chunk) = 0;
+};
+
+}}  // facebook::memcache
@@ -0,0 +1,49 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "McSSLUtil.h"
+
+#include <glog/logging.h>
+
+#include <folly/io/async/AsyncSSLSocket.h>
+
+namespace facebook { namespace memcache {
+
+bool verifySSLClientCert(bool preverifyOk, X509_STORE_CTX* ctx) noexcept {
+  if (!preverifyOk) {
+    return false;
+  }
+  // XXX I'm assuming that this will be the case as a result of
+  // preverifyOk being true
+  DCHECK(X509_STORE_CTX_get_error(ctx) == X509_V_OK);
+
+  // So the interesting thing is that this always returns the depth of
+  // the cert it's asking you to verify, and the error_ assumes to be
+  // just a poorly named function.
+  auto certDepth = X509_STORE_CTX_get_error_depth(ctx);
+
+  // Depth is numbered from the peer cert going up.  For anything in the
+  // chain, let's just leave it to openssl to figure out it's validity.
+  // We may want to limit the chain depth later though.
+  if (certDepth != 0) {
+    return preverifyOk;
+  }
+
+  auto cert = X509_STORE_CTX_get_current_cert(ctx);
+  sockaddr_storage addrStorage;
+  socklen_t addrLen = 0;
+  if (!folly::OpenSSLUtils::getPeerAddressFromX509StoreCtx(
+          ctx, &addrStorage, &addrLen)) {
+    return false;
+  }
+  return folly::OpenSSLUtils::validatePeerCertNames(
+      cert, reinterpret_cast<sockaddr*>(&addrStorage), addrLen);
+}
+
+}}  // facebook::memcache
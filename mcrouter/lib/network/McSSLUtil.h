@@ -0,0 +1,24 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <openssl/x509.h>
+
+namespace facebook { namespace memcache {
+
+/**
+ * Certificate verification for server side handshakes: the chain is left
+ * to OpenSSL, the peer certificate must also name the peer's address.
+ *
+ * Meant to be called from AsyncSSLSocket::HandshakeCB::handshakeVer().
+ */
+bool verifySSLClientCert(bool preverifyOk, X509_STORE_CTX* ctx) noexcept;
+
+}}  // facebook::memcache
@@ -27,6 +27,17 @@ McSerializedRequest::McSerializedRequest(const McRequest& req,
         result_ = Result::ERROR;
       }
       break;
+    case mc_meta_protocol:
+      new (&metaRequest_) MetaSerializedRequest();
+      if (req.key().length() > MC_KEY_MAX_LEN_ASCII) {
+        result_ = Result::BAD_KEY;
+        return;
+      }
+      if (!metaRequest_.prepare(req, McOperation<Op>(), iovsBegin_,
+                                iovsCount_)) {
+        result_ = Result::ERROR;
+      }
+      break;
     case mc_umbrella_protocol:
       new (&umbrellaMessage_) UmbrellaSerializedMessage();
       if (!umbrellaMessage_.prepare(req, McOperation<Op>(), reqId, iovsBegin_,
@@ -19,6 +19,9 @@ McSerializedRequest::~McSerializedRequest() {
     case mc_ascii_protocol:
       asciiRequest_.~AsciiSerializedRequest();
       break;
+    case mc_meta_protocol:
+      metaRequest_.~MetaSerializedRequest();
+      break;
     case mc_umbrella_protocol:
       umbrellaMessage_.~UmbrellaSerializedMessage();
       break;
@@ -15,6 +15,7 @@
 #include "mcrouter/lib/mc/protocol.h"
 #include "mcrouter/lib/McMsgRef.h"
 #include "mcrouter/lib/network/AsciiSerialized.h"
+#include "mcrouter/lib/network/MetaSerialized.h"
 #include "mcrouter/lib/network/UmbrellaProtocol.h"
 
 namespace facebook { namespace memcache {
@@ -55,6 +56,7 @@ class McSerializedRequest {
 
   union {
     AsciiSerializedRequest asciiRequest_;
+    MetaSerializedRequest metaRequest_;
     UmbrellaSerializedMessage umbrellaMessage_;
   };
 
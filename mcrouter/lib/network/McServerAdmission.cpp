@@ -0,0 +1,113 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "McServerAdmission.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include <folly/io/async/EventBase.h>
+
+namespace facebook { namespace memcache {
+
+constexpr uint32_t McServerAdmission::kBurstMs;
+
+McServerAdmission::McServerAdmission(
+  const AsyncMcServerWorkerOptions& opts,
+  folly::EventBase& eventBase,
+  const McServerSession::Queue& sessions)
+    : folly::AsyncTimeout(&eventBase),
+      maxConnections_(opts.maxConnections),
+      acceptsPerMs_(opts.maxAcceptsPerSecond / 1000.0),
+      burst_(std::max(1.0, acceptsPerMs_ * kBurstMs)),
+      maxDeferred_(opts.maxDeferredAccepts),
+      sessions_(sessions),
+      tokens_(burst_),
+      lastRefill_(std::chrono::steady_clock::now()) {
+}
+
+McServerAdmission::~McServerAdmission() {
+  closeDeferred();
+}
+
+void McServerAdmission::admit(int fd, std::function<void()> start) {
+  if (maxConnections_ != 0 &&
+      sessions_.size() + deferred_.size() >= maxConnections_) {
+    ++numRejected_;
+    ::close(fd);
+    return;
+  }
+
+  /* Deferred connections go first */
+  if (deferred_.empty() && takeToken()) {
+    start();
+    return;
+  }
+
+  if (deferred_.size() >= maxDeferred_) {
+    ++numRejected_;
+    ::close(fd);
+    return;
+  }
+  ++numDeferred_;
+  deferred_.push_back(Deferred{fd, std::move(start)});
+  if (!isScheduled()) {
+    scheduleNext();
+  }
+}
+
+void McServerAdmission::closeDeferred() {
+  cancelTimeout();
+  for (auto& d : deferred_) {
+    ::close(d.fd);
+  }
+  deferred_.clear();
+}
+
+bool McServerAdmission::takeToken() {
+  if (acceptsPerMs_ == 0) {
+    return true;
+  }
+  refill();
+  if (tokens_ < 1.0) {
+    return false;
+  }
+  tokens_ -= 1.0;
+  return true;
+}
+
+void McServerAdmission::refill() {
+  auto now = std::chrono::steady_clock::now();
+  auto elapsedMs = std::chrono::duration<double, std::milli>(
+    now - lastRefill_).count();
+  lastRefill_ = now;
+  tokens_ = std::min(burst_, tokens_ + elapsedMs * acceptsPerMs_);
+}
+
+void McServerAdmission::scheduleNext() {
+  refill();
+  auto waitMs = tokens_ >= 1.0 ? 0.0 : (1.0 - tokens_) / acceptsPerMs_;
+  scheduleTimeout(std::max<uint32_t>(1, std::ceil(waitMs)));
+}
+
+void McServerAdmission::timeoutExpired() noexcept {
+  /* One burst at most, established sessions get served in between */
+  while (!deferred_.empty() && takeToken()) {
+    auto d = std::move(deferred_.front());
+    deferred_.pop_front();
+    d.start();
+  }
+  if (!deferred_.empty()) {
+    scheduleNext();
+  }
+}
+
+}}  // facebook::memcache
@@ -0,0 +1,114 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+#include <folly/io/async/AsyncTimeout.h>
+
+#include "mcrouter/lib/network/AsyncMcServerWorkerOptions.h"
+#include "mcrouter/lib/network/McServerSession.h"
+
+namespace folly {
+class EventBase;
+}
+
+namespace facebook { namespace memcache {
+
+/**
+ * Admission control for the connections accepted for one worker.
+ *
+ * Connections accepted while the worker has opts.maxConnections sessions
+ * (deferred connections included) are closed right away. With
+ * opts.maxAcceptsPerSecond, new sessions are started at that rate at most,
+ * in bursts of up to kBurstMs worth of it; connections over the rate wait
+ * (sitting in the kernel's socket buffers only), up to
+ * opts.maxDeferredAccepts of them, and further ones are closed. Deferred
+ * connections are started from a timeout, a burst at a time, so requests
+ * on established sessions keep being served in between.
+ *
+ * Worker thread only.
+ */
+class McServerAdmission : private folly::AsyncTimeout {
+ public:
+  static constexpr uint32_t kBurstMs = 100;
+
+  /**
+   * @param sessions  sessions of the worker, must outlive this.
+   */
+  McServerAdmission(const AsyncMcServerWorkerOptions& opts,
+                    folly::EventBase& eventBase,
+                    const McServerSession::Queue& sessions);
+
+  ~McServerAdmission();
+
+  /**
+   * Calls start (which takes over fd) right away or once the rate allows,
+   * or closes fd.
+   */
+  void admit(int fd, std::function<void()> start);
+
+  /**
+   * Closes all deferred connections, e.g. on worker shutdown.
+   */
+  void closeDeferred();
+
+  /**
+   * Connections waiting to be started.
+   */
+  size_t deferred() const {
+    return deferred_.size();
+  }
+
+  /**
+   * Number of connections that were closed right away, and that waited.
+   */
+  uint64_t numRejected() const {
+    return numRejected_;
+  }
+
+  uint64_t numDeferred() const {
+    return numDeferred_;
+  }
+
+ private:
+  struct Deferred {
+    int fd;
+    std::function<void()> start;
+  };
+
+  const size_t maxConnections_;
+  const double acceptsPerMs_;
+  const double burst_;
+  const size_t maxDeferred_;
+  const McServerSession::Queue& sessions_;
+
+  std::deque<Deferred> deferred_;
+  double tokens_;
+  std::chrono::steady_clock::time_point lastRefill_;
+
+  uint64_t numRejected_{0};
+  uint64_t numDeferred_{0};
+
+  /**
+   * @return  true iff a session may start now, taking its token.
+   */
+  bool takeToken();
+  void refill();
+  void scheduleNext();
+
+  void timeoutExpired() noexcept override;
+};
+
+}}  // facebook::memcache
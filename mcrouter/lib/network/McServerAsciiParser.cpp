@@ -0,0 +1,550 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "mcrouter/lib/network/McServerAsciiParser.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <cstring>
+#include <new>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <folly/Bits.h>
+
+#include "mcrouter/lib/mc/protocol.h"
+
+namespace facebook { namespace memcache {
+
+constexpr size_t McServerAsciiParser::kMaxLineLength;
+
+namespace {
+
+const char* const kMalformedRequest = "malformed request";
+const char* const kOutOfMemory = "out of memory";
+
+/**
+ * Same set of characters as key in mc/ascii_client.rl: anything except
+ * control characters and spaces.
+ */
+inline bool isTokenChar(char c) {
+  auto uc = static_cast<unsigned char>(c);
+  return uc > ' ' && uc != 0x7f;
+}
+
+/**
+ * @return  the first character in [begin, end) that can't be part of
+ *          a token (a space, CR, LF or another control character),
+ *          or end if there's none.
+ */
+const char* findTokenEnd(const char* begin, const char* end) {
+#ifdef __SSE2__
+  const auto space = _mm_set1_epi8(' ');
+  const auto del = _mm_set1_epi8(0x7f);
+  while (end - begin >= 16) {
+    auto chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+    /* Unsigned c <= ' ' is min(c, ' ') == c */
+    auto delimiters = _mm_or_si128(
+      _mm_cmpeq_epi8(_mm_min_epu8(chars, space), chars),
+      _mm_cmpeq_epi8(chars, del));
+    auto mask = _mm_movemask_epi8(delimiters);
+    if (mask != 0) {
+      return begin + folly::findFirstSet(mask) - 1;
+    }
+    begin += 16;
+  }
+#endif
+  while (begin != end && isTokenChar(*begin)) {
+    ++begin;
+  }
+  return begin;
+}
+
+/**
+ * Parses an unsigned decimal number, the whole token.
+ * @return  false if it's not a number or it doesn't fit into uint64_t.
+ */
+bool parseUInt(folly::StringPiece token, uint64_t& value) {
+  uint64_t result = 0;
+  for (auto c : token) {
+    auto digit = static_cast<unsigned char>(c - '0');
+    if (digit >= 10 || result > (UINT64_MAX - digit) / 10) {
+      return false;
+    }
+    result = result * 10 + digit;
+  }
+  value = result;
+  return !token.empty();
+}
+
+}  // anonymous namespace
+
+McServerAsciiParser::State McServerAsciiParser::consume(folly::IOBuf& buffer) {
+  switch (stage_) {
+    case Stage::COMMAND:
+      return consumeCommand(buffer);
+    case Stage::GET_KEYS:
+      return consumeGetKey(buffer);
+    case Stage::VALUE:
+      return consumeValue(buffer);
+    case Stage::VALUE_END:
+      return consumeValueEnd(buffer);
+  }
+  return error(kMalformedRequest);
+}
+
+std::pair<void*, size_t> McServerAsciiParser::getReadBuffer() {
+  assert(stage_ == Stage::VALUE);
+  return std::make_pair(valueBuffer_->writableTail(), valueRemaining_);
+}
+
+void McServerAsciiParser::readDataAvailable(size_t length) {
+  assert(stage_ == Stage::VALUE && length <= valueRemaining_);
+  valueBuffer_->append(length);
+  valueRemaining_ -= length;
+  if (valueRemaining_ == 0) {
+    request_.setValue(std::move(*valueBuffer_));
+    valueBuffer_.reset();
+    stage_ = Stage::VALUE_END;
+  }
+}
+
+McServerAsciiParser::State
+McServerAsciiParser::consumeCommand(folly::IOBuf& buffer) {
+  auto data = reinterpret_cast<const char*>(buffer.data());
+  auto length = buffer.length();
+
+  /* memchr is vectorized; remember how far we looked, so that a long line
+     read in many pieces is only scanned once */
+  auto lineEnd = static_cast<const char*>(
+    std::memchr(data + lineScanned_, '\n', length - lineScanned_));
+  if (lineEnd == nullptr) {
+    lineScanned_ = length;
+    if (length > kMaxLineLength) {
+      return error(kMalformedRequest);
+    }
+    return State::PARTIAL;
+  }
+  lineScanned_ = 0;
+  size_t lineLength = lineEnd + 1 - data;
+
+  p_ = findTokenEnd(data, lineEnd);
+  lineEnd_ = lineEnd;
+  folly::StringPiece command(data, p_);
+
+  mc_op_t getOp = mc_op_unknown;
+  if (command == "get") {
+    getOp = mc_op_get;
+  } else if (command == "gets") {
+    getOp = mc_op_gets;
+  } else if (command == "lease-get") {
+    getOp = mc_op_lease_get;
+  } else if (command == "metaget") {
+    getOp = mc_op_metaget;
+  }
+  if (getOp != mc_op_unknown) {
+    /* Keys are returned one per consume() call */
+    getOperation_ = getOp;
+    getLineHasKeys_ = false;
+    getLineRemaining_ = lineLength - command.size();
+    buffer.trimStart(command.size());
+    stage_ = Stage::GET_KEYS;
+    return consumeGetKey(buffer);
+  }
+
+  mc_op_t op = mc_op_unknown;
+  if (command == "set") {
+    op = mc_op_set;
+  } else if (command == "add") {
+    op = mc_op_add;
+  } else if (command == "replace") {
+    op = mc_op_replace;
+  } else if (command == "append") {
+    op = mc_op_append;
+  } else if (command == "prepend") {
+    op = mc_op_prepend;
+  } else if (command == "lease-set") {
+    op = mc_op_lease_set;
+  } else if (command == "cas") {
+    op = mc_op_cas;
+  } else if (command == "delete") {
+    op = mc_op_delete;
+  } else if (command == "touch") {
+    op = mc_op_touch;
+  } else if (command == "incr") {
+    op = mc_op_incr;
+  } else if (command == "decr") {
+    op = mc_op_decr;
+  } else if (command == "version") {
+    op = mc_op_version;
+  } else if (command == "quit") {
+    op = mc_op_quit;
+  } else if (command == "stats") {
+    op = mc_op_stats;
+  } else if (command == "exec" || command == "admin") {
+    op = mc_op_exec;
+  } else if (command == "shutdown") {
+    op = mc_op_shutdown;
+  } else if (command == "flush_all") {
+    op = mc_op_flushall;
+  } else if (command == "flush_regex") {
+    op = mc_op_flushre;
+  } else {
+    return error(kMalformedRequest);
+  }
+  resetRequest(op);
+
+  bool parsed = false;
+  size_t valueLength = 0;
+  bool hasValue = false;
+  switch (op) {
+    case mc_op_set:
+    case mc_op_add:
+    case mc_op_replace:
+    case mc_op_append:
+    case mc_op_prepend:
+    case mc_op_lease_set:
+    case mc_op_cas:
+      parsed = parseStorage(buffer, valueLength);
+      hasValue = true;
+      break;
+    case mc_op_delete:
+      parsed = parseDelete(buffer);
+      break;
+    case mc_op_touch:
+      parsed = parseTouch(buffer);
+      break;
+    case mc_op_incr:
+    case mc_op_decr:
+      parsed = parseArithmetic(buffer);
+      break;
+    case mc_op_quit:
+      noreply_ = true;
+      /* fallthrough */
+    case mc_op_version:
+      parsed = atLineEnd();
+      break;
+    case mc_op_stats:
+      parsed = parseMultiToken(/* required= */ false);
+      break;
+    case mc_op_exec:
+      parsed = parseMultiToken(/* required= */ true);
+      break;
+    case mc_op_shutdown:
+    case mc_op_flushall:
+      parsed = parseOptionalNumber();
+      break;
+    case mc_op_flushre: {
+      folly::StringPiece key;
+      parsed = readToken(key) && atLineEnd();
+      if (parsed) {
+        setKey(buffer, key);
+      }
+      break;
+    }
+    default:
+      break;
+  }
+  if (!parsed) {
+    return error(kMalformedRequest);
+  }
+
+  buffer.trimStart(lineLength);
+  if (hasValue) {
+    return startValue(buffer, valueLength);
+  }
+  return State::COMPLETE;
+}
+
+McServerAsciiParser::State
+McServerAsciiParser::consumeGetKey(folly::IOBuf& buffer) {
+  auto data = reinterpret_cast<const char*>(buffer.data());
+  p_ = data;
+  lineEnd_ = data + getLineRemaining_ - 1;
+
+  folly::StringPiece key;
+  if (readToken(key)) {
+    resetRequest(getOperation_);
+    setKey(buffer, key);
+    getLineHasKeys_ = true;
+  } else {
+    if (!getLineHasKeys_ || !atLineEnd()) {
+      return error(kMalformedRequest);
+    }
+    resetRequest(mc_op_end);
+    p_ = lineEnd_ + 1;
+    stage_ = Stage::COMMAND;
+  }
+
+  size_t consumed = p_ - data;
+  getLineRemaining_ -= consumed;
+  buffer.trimStart(consumed);
+  return State::COMPLETE;
+}
+
+McServerAsciiParser::State
+McServerAsciiParser::consumeValue(folly::IOBuf& buffer) {
+  /* Only if the data wasn't read through getReadBuffer() */
+  auto length = std::min(valueRemaining_, buffer.length());
+  std::memcpy(valueBuffer_->writableTail(), buffer.data(), length);
+  buffer.trimStart(length);
+  readDataAvailable(length);
+  if (stage_ == Stage::VALUE) {
+    return State::PARTIAL;
+  }
+  return consumeValueEnd(buffer);
+}
+
+McServerAsciiParser::State
+McServerAsciiParser::consumeValueEnd(folly::IOBuf& buffer) {
+  auto data = reinterpret_cast<const char*>(buffer.data());
+  auto length = buffer.length();
+  if (length == 0) {
+    return State::PARTIAL;
+  }
+
+  size_t consumed = 1;
+  if (data[0] == '\r') {
+    if (length < 2) {
+      return State::PARTIAL;
+    }
+    consumed = 2;
+  }
+  if (data[consumed - 1] != '\n') {
+    return error(kMalformedRequest);
+  }
+
+  buffer.trimStart(consumed);
+  stage_ = Stage::COMMAND;
+  return State::COMPLETE;
+}
+
+bool McServerAsciiParser::parseStorage(const folly::IOBuf& buffer,
+                                       size_t& valueLength) {
+  folly::StringPiece key;
+  uint64_t flags;
+  uint64_t exptime;
+  uint64_t bytes;
+  if (!readToken(key)) {
+    return false;
+  }
+  setKey(buffer, key);
+
+  if (operation_ == mc_op_lease_set) {
+    folly::StringPiece token;
+    if (!readToken(token)) {
+      return false;
+    }
+    bool negative = token.startsWith('-');
+    if (negative) {
+      token.advance(1);
+    }
+    uint64_t leaseToken;
+    if (!parseUInt(token, leaseToken)) {
+      return false;
+    }
+    request_.setLeaseToken(negative ? -leaseToken : leaseToken);
+  }
+
+  if (!readNumber(flags) || !readNumber(exptime) || !readNumber(bytes)) {
+    return false;
+  }
+  request_.setFlags(flags);
+  request_.setExptime(exptime);
+  valueLength = bytes;
+
+  if (operation_ == mc_op_cas) {
+    uint64_t cas;
+    if (!readNumber(cas)) {
+      return false;
+    }
+    request_.setCas(cas);
+    return atLineEnd();
+  }
+  return readNoreply() && atLineEnd();
+}
+
+bool McServerAsciiParser::parseArithmetic(const folly::IOBuf& buffer) {
+  folly::StringPiece key;
+  uint64_t delta;
+  if (!readToken(key) || !readNumber(delta)) {
+    return false;
+  }
+  setKey(buffer, key);
+  request_.setDelta(delta);
+  return readNoreply() && atLineEnd();
+}
+
+bool McServerAsciiParser::parseDelete(const folly::IOBuf& buffer) {
+  folly::StringPiece key;
+  if (!readToken(key)) {
+    return false;
+  }
+  setKey(buffer, key);
+
+  /* Optional exptime, then optional noreply */
+  auto exptimeStart = p_;
+  folly::StringPiece token;
+  if (readToken(token) && token != "noreply") {
+    uint64_t exptime;
+    if (!parseUInt(token, exptime)) {
+      return false;
+    }
+    request_.setExptime(exptime);
+  } else {
+    p_ = exptimeStart;
+  }
+  return readNoreply() && atLineEnd();
+}
+
+bool McServerAsciiParser::parseTouch(const folly::IOBuf& buffer) {
+  folly::StringPiece key;
+  uint64_t exptime;
+  if (!readToken(key) || !readNumber(exptime)) {
+    return false;
+  }
+  setKey(buffer, key);
+  request_.setExptime(exptime);
+  return readNoreply() && atLineEnd();
+}
+
+bool McServerAsciiParser::parseOptionalNumber() {
+  auto start = p_;
+  uint64_t number;
+  if (readNumber(number)) {
+    request_.setNumber(number);
+  } else {
+    p_ = start;
+  }
+  return atLineEnd();
+}
+
+bool McServerAsciiParser::parseMultiToken(bool required) {
+  /* Everything up to the line end, spaces included */
+  auto end = lineEnd_;
+  if (end != p_ && end[-1] == '\r') {
+    --end;
+  }
+  if (p_ != end && *p_ != ' ') {
+    return false;
+  }
+  while (p_ != end && *p_ == ' ') {
+    ++p_;
+  }
+  while (end != p_ && end[-1] == ' ') {
+    --end;
+  }
+  if (p_ == end) {
+    return !required;
+  }
+  for (auto c = p_; c != end; ++c) {
+    if (!std::isprint(static_cast<unsigned char>(*c))) {
+      return false;
+    }
+  }
+  request_.setKey(folly::StringPiece(p_, end));
+  p_ = lineEnd_;
+  return true;
+}
+
+bool McServerAsciiParser::readToken(folly::StringPiece& token) {
+  if (*p_ != ' ') {
+    return false;
+  }
+  /* *lineEnd_ is '\n', so these stop at the line end */
+  do {
+    ++p_;
+  } while (*p_ == ' ');
+  auto end = findTokenEnd(p_, lineEnd_);
+  if (end == p_ || (*end != ' ' && *end != '\r' && *end != '\n')) {
+    return false;
+  }
+  token = folly::StringPiece(p_, end);
+  p_ = end;
+  return true;
+}
+
+bool McServerAsciiParser::readNumber(uint64_t& value) {
+  folly::StringPiece token;
+  return readToken(token) && parseUInt(token, value);
+}
+
+bool McServerAsciiParser::readNoreply() {
+  auto start = p_;
+  folly::StringPiece token;
+  if (!readToken(token)) {
+    p_ = start;
+    return true;
+  }
+  noreply_ = true;
+  return token == "noreply";
+}
+
+bool McServerAsciiParser::atLineEnd() {
+  while (*p_ == ' ') {
+    ++p_;
+  }
+  return p_ == lineEnd_ || (*p_ == '\r' && p_ + 1 == lineEnd_);
+}
+
+void McServerAsciiParser::setKey(const folly::IOBuf& buffer,
+                                 folly::StringPiece key) {
+  if (key.size() > MC_KEY_MAX_LEN_ASCII) {
+    result_ = mc_res_bad_key;
+  } else if (key.size() <= McRequest::kMaxInlineKeySize) {
+    request_.setKey(key);
+  } else {
+    request_.setKeyFrom(buffer,
+                        reinterpret_cast<const uint8_t*>(key.begin()),
+                        key.size());
+  }
+}
+
+McServerAsciiParser::State
+McServerAsciiParser::startValue(folly::IOBuf& buffer, size_t valueLength) {
+  auto length = buffer.length();
+  if (length >= valueLength) {
+    request_.setValueFrom(buffer, buffer.data(), valueLength);
+    buffer.trimStart(valueLength);
+    stage_ = Stage::VALUE_END;
+    return consumeValueEnd(buffer);
+  }
+
+  try {
+    valueBuffer_ = folly::IOBuf::create(valueLength);
+  } catch (const std::bad_alloc&) {
+    return error(kOutOfMemory);
+  }
+  std::memcpy(valueBuffer_->writableTail(), buffer.data(), length);
+  valueBuffer_->append(length);
+  valueRemaining_ = valueLength - length;
+  buffer.trimStart(length);
+  stage_ = Stage::VALUE;
+  return State::PARTIAL;
+}
+
+McServerAsciiParser::State McServerAsciiParser::error(const char* reason) {
+  errorReason_ = reason;
+  stage_ = Stage::COMMAND;
+  lineScanned_ = 0;
+  valueBuffer_.reset();
+  return State::ERROR;
+}
+
+void McServerAsciiParser::resetRequest(mc_op_t operation) {
+  request_ = McRequest();
+  operation_ = operation;
+  result_ = mc_res_unknown;
+  noreply_ = false;
+}
+
+}}  // facebook::memcache
@@ -0,0 +1,196 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <utility>
+
+#include <folly/io/IOBuf.h>
+#include <folly/Range.h>
+
+#include "mcrouter/lib/mc/msg.h"
+#include "mcrouter/lib/McRequest.h"
+
+namespace facebook { namespace memcache {
+
+/**
+ * Server side ASCII request parser, builds McRequests directly.
+ *
+ * Accepts the same requests as the legacy request_parser in
+ * mc/ascii_client.rl and produces the same sequence of requests: a multiget
+ * line gives one request per key with the get operation, followed by one
+ * with mc_op_end. Keys that are too long give a request with an empty key
+ * and mc_res_bad_key.
+ *
+ * Command lines are parsed once complete, scanning for token ends 16 bytes
+ * at a time. Keys up to McRequest::kMaxInlineKeySize are stored inline,
+ * longer keys and values reference the read buffer. Values that aren't
+ * read completely with their command line are read into a buffer of their
+ * own (see hasReadBuffer()).
+ */
+class McServerAsciiParser {
+ public:
+  enum class State {
+    // Need more data to complete the request.
+    PARTIAL,
+    // There was an error on the protocol level.
+    ERROR,
+    // A request was parsed and is ready to be returned.
+    COMPLETE,
+  };
+
+  /**
+   * Command lines longer than this are an error.
+   */
+  static constexpr size_t kMaxLineLength = 1 << 20;
+
+  McServerAsciiParser() = default;
+
+  McServerAsciiParser(const McServerAsciiParser&) = delete;
+  McServerAsciiParser& operator=(const McServerAsciiParser&) = delete;
+
+  /**
+   * Consumes data from the beginning of the buffer, up to the end of
+   * the next request. A partial command line is left in the buffer,
+   * to be consumed again once more data is appended.
+   *
+   * Should be called only in case hasReadBuffer() returned false.
+   *
+   * @return  new parser state.
+   */
+  State consume(folly::IOBuf& buffer);
+
+  /**
+   * Obtain the request that was parsed, after consume() returned
+   * State::COMPLETE.
+   */
+  McRequest getRequest() {
+    return std::move(request_);
+  }
+
+  mc_op_t operation() const {
+    return operation_;
+  }
+
+  /**
+   * mc_res_bad_key for a key that is too long, mc_res_unknown otherwise.
+   */
+  mc_res_t result() const {
+    return result_;
+  }
+
+  bool noreply() const {
+    return noreply_;
+  }
+
+  /**
+   * Reason for the last State::ERROR.
+   */
+  folly::StringPiece errorReason() const {
+    return errorReason_;
+  }
+
+  /**
+   * Check if we're reading a value into our own buffer.
+   * @return  true iff the value buffer can be read into directly.
+   */
+  bool hasReadBuffer() const {
+    return stage_ == Stage::VALUE;
+  }
+
+  std::pair<void*, size_t> getReadBuffer();
+
+  void readDataAvailable(size_t length);
+
+ private:
+  enum class Stage {
+    // At the beginning of a request.
+    COMMAND,
+    // Returning the keys of a complete multiget line.
+    GET_KEYS,
+    // Reading a value into valueBuffer_.
+    VALUE,
+    // Value read, expecting the line end after it.
+    VALUE_END,
+  };
+
+  Stage stage_{Stage::COMMAND};
+
+  McRequest request_;
+  mc_op_t operation_{mc_op_unknown};
+  mc_res_t result_{mc_res_unknown};
+  bool noreply_{false};
+  const char* errorReason_{""};
+
+  /* Operation of the multiget being returned */
+  mc_op_t getOperation_{mc_op_unknown};
+  /* Bytes left on the multiget line, its line end included */
+  size_t getLineRemaining_{0};
+  bool getLineHasKeys_{false};
+
+  /* Bytes at the beginning of the buffer known not to contain a line end */
+  size_t lineScanned_{0};
+
+  std::unique_ptr<folly::IOBuf> valueBuffer_;
+  size_t valueRemaining_{0};
+
+  // Line being parsed, valid only within consume().
+  const char* p_{nullptr};
+  const char* lineEnd_{nullptr};
+
+  State consumeCommand(folly::IOBuf& buffer);
+  State consumeGetKey(folly::IOBuf& buffer);
+  State consumeValue(folly::IOBuf& buffer);
+  State consumeValueEnd(folly::IOBuf& buffer);
+
+  /**
+   * Parse the rest of the command line [p_, lineEnd_) after the command,
+   * setting the fields of request_.
+   * @return  false on malformed lines.
+   */
+  bool parseStorage(const folly::IOBuf& buffer, size_t& valueLength);
+  bool parseArithmetic(const folly::IOBuf& buffer);
+  bool parseDelete(const folly::IOBuf& buffer);
+  bool parseTouch(const folly::IOBuf& buffer);
+  bool parseOptionalNumber();
+  bool parseMultiToken(bool required);
+
+  /**
+   * Skips one or more spaces and reads the token after them.
+   * @return  false if there's no token before the end of the line.
+   */
+  bool readToken(folly::StringPiece& token);
+  bool readNumber(uint64_t& value);
+
+  /**
+   * Reads an optional trailing "noreply".
+   * @return  false if there's another token instead.
+   */
+  bool readNoreply();
+
+  /**
+   * Skips spaces.
+   * @return  true iff only an optional CR is left on the line.
+   */
+  bool atLineEnd();
+
+  void setKey(const folly::IOBuf& buffer, folly::StringPiece key);
+
+  /**
+   * Starts reading a value of valueLength bytes after the command line
+   * (consumed already).
+   */
+  State startValue(folly::IOBuf& buffer, size_t valueLength);
+
+  State error(const char* reason);
+  void resetRequest(mc_op_t operation);
+};
+
+}}  // facebook::memcache
@@ -0,0 +1,165 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "McServerMemoryTracker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <vector>
+
+#include <folly/io/async/EventBase.h>
+
+namespace facebook { namespace memcache {
+
+namespace {
+
+std::atomic<size_t> gProcessBytes{0};
+
+/* Low watermark defaults to 3/4 of the high one */
+size_t lowWatermark(size_t high, size_t low) {
+  return low != 0 ? std::min(low, high) : high / 4 * 3;
+}
+
+}  // anonymous namespace
+
+constexpr uint32_t McServerMemoryTracker::kCheckIntervalMs;
+
+McServerMemoryTracker::McServerMemoryTracker(
+  const AsyncMcServerWorkerOptions& opts,
+  folly::EventBase& eventBase,
+  McServerSession::Queue& sessions)
+    : folly::AsyncTimeout(&eventBase),
+      highWatermark_(opts.memoryHighWatermark),
+      lowWatermark_(lowWatermark(opts.memoryHighWatermark,
+                                 opts.memoryLowWatermark)),
+      processHighWatermark_(opts.processMemoryHighWatermark),
+      processLowWatermark_(lowWatermark(opts.processMemoryHighWatermark,
+                                        opts.processMemoryLowWatermark)),
+      sessions_(sessions) {
+}
+
+McServerMemoryTracker::~McServerMemoryTracker() {
+  /* Bytes of sessions that outlived the worker aren't accounted anymore */
+  gProcessBytes.fetch_sub(bytes_, std::memory_order_relaxed);
+}
+
+size_t McServerMemoryTracker::processBytes() {
+  return gProcessBytes.load(std::memory_order_relaxed);
+}
+
+void McServerMemoryTracker::add(size_t bytes) {
+  bytes_ += bytes;
+  gProcessBytes.fetch_add(bytes, std::memory_order_relaxed);
+
+  /* While sessions are paused, the timeout pauses more if needed */
+  if (pausedSessions_ == 0 && overHighWatermark()) {
+    pauseLargestSessions();
+  }
+}
+
+void McServerMemoryTracker::remove(size_t bytes) {
+  assert(bytes_ >= bytes);
+  bytes_ -= bytes;
+  gProcessBytes.fetch_sub(bytes, std::memory_order_relaxed);
+
+  if (pausedSessions_ > 0 && belowLowWatermark()) {
+    resumeSessions();
+  }
+}
+
+void McServerMemoryTracker::onPausedSessionClosed() {
+  assert(pausedSessions_ > 0);
+  if (--pausedSessions_ == 0) {
+    cancelTimeout();
+  }
+}
+
+bool McServerMemoryTracker::overHighWatermark() const {
+  return (highWatermark_ > 0 && bytes_ > highWatermark_) ||
+    (processHighWatermark_ > 0 && processBytes() > processHighWatermark_);
+}
+
+bool McServerMemoryTracker::belowLowWatermark() const {
+  return (highWatermark_ == 0 || bytes_ < lowWatermark_) &&
+    (processHighWatermark_ == 0 || processBytes() < processLowWatermark_);
+}
+
+void McServerMemoryTracker::pauseLargestSessions() {
+  /* Bytes that should stop growing: what's over the low watermarks,
+     only this worker's bytes can be paused here */
+  size_t excess = 0;
+  if (highWatermark_ > 0 && bytes_ > lowWatermark_) {
+    excess = bytes_ - lowWatermark_;
+  }
+  auto process = processBytes();
+  if (processHighWatermark_ > 0 && process > processLowWatermark_) {
+    excess = std::max(excess, process - processLowWatermark_);
+  }
+  excess = std::min(excess, bytes_);
+
+  std::vector<McServerSession*> candidates;
+  for (auto& session : sessions_) {
+    if (session.pauseState_ & McServerSession::PAUSE_MEMORY) {
+      excess -= std::min(excess, session.bufferedBytes_);
+    } else if (session.bufferedBytes_ > 0 &&
+               session.state_ == McServerSession::STREAMING) {
+      candidates.push_back(&session);
+    }
+  }
+  std::sort(candidates.begin(), candidates.end(),
+            [](const McServerSession* a, const McServerSession* b) {
+              return a->bufferedBytes_ > b->bufferedBytes_;
+            });
+
+  for (auto session : candidates) {
+    if (excess == 0) {
+      break;
+    }
+    excess -= std::min(excess, session->bufferedBytes_);
+    session->pause(McServerSession::PAUSE_MEMORY);
+    ++pausedSessions_;
+    ++numPauses_;
+  }
+
+  if (pausedSessions_ > 0 && !isScheduled()) {
+    scheduleTimeout(kCheckIntervalMs);
+  }
+}
+
+void McServerMemoryTracker::resumeSessions() {
+  cancelTimeout();
+  pausedSessions_ = 0;
+
+  /* Resuming might call back into us through the sessions' reads */
+  std::vector<McServerSession*> paused;
+  for (auto& session : sessions_) {
+    if (session.pauseState_ & McServerSession::PAUSE_MEMORY) {
+      paused.push_back(&session);
+    }
+  }
+  for (auto session : paused) {
+    session->resume(McServerSession::PAUSE_MEMORY);
+  }
+}
+
+void McServerMemoryTracker::timeoutExpired() noexcept {
+  if (belowLowWatermark()) {
+    resumeSessions();
+    return;
+  }
+  if (overHighWatermark()) {
+    pauseLargestSessions();
+  }
+  if (pausedSessions_ > 0 && !isScheduled()) {
+    scheduleTimeout(kCheckIntervalMs);
+  }
+}
+
+}}  // facebook::memcache
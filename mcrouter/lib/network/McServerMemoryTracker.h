@@ -0,0 +1,116 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <folly/io/async/AsyncTimeout.h>
+
+#include "mcrouter/lib/network/AsyncMcServerWorkerOptions.h"
+#include "mcrouter/lib/network/McServerSession.h"
+
+namespace folly {
+class EventBase;
+}
+
+namespace facebook { namespace memcache {
+
+/**
+ * Accounts the bytes buffered by the sessions of one worker (values of
+ * requests not replied yet, replies not written out yet), and the total
+ * over all workers of the process.
+ *
+ * Once the worker's bytes go over opts.memoryHighWatermark or the process'
+ * bytes go over opts.processMemoryHighWatermark, reads are paused on the
+ * sessions holding the most bytes, until the paused sessions hold what's
+ * over the low watermark. Their requests still complete and free their
+ * bytes; reads resume on all of them once both totals are below their low
+ * watermarks. While sessions are paused, the totals are rechecked every
+ * kCheckIntervalMs, since the process total may drop because of other
+ * workers only.
+ *
+ * Worker thread only, except processBytes().
+ */
+class McServerMemoryTracker : private folly::AsyncTimeout {
+ public:
+  static constexpr uint32_t kCheckIntervalMs = 10;
+
+  /**
+   * @param sessions  sessions of the worker, must outlive the tracker.
+   */
+  McServerMemoryTracker(const AsyncMcServerWorkerOptions& opts,
+                        folly::EventBase& eventBase,
+                        McServerSession::Queue& sessions);
+
+  ~McServerMemoryTracker();
+
+  /**
+   * Called by sessions when they start or stop holding bytes.
+   */
+  void add(size_t bytes);
+  void remove(size_t bytes);
+
+  /**
+   * Called by a session paused by us that is being terminated.
+   */
+  void onPausedSessionClosed();
+
+  /**
+   * Bytes buffered by the sessions of this worker.
+   */
+  size_t bytes() const {
+    return bytes_;
+  }
+
+  /**
+   * Bytes buffered by the sessions of all workers. Thread safe.
+   */
+  static size_t processBytes();
+
+  /**
+   * Number of sessions currently paused because of memory.
+   */
+  size_t pausedSessions() const {
+    return pausedSessions_;
+  }
+
+  /**
+   * Number of times a session was paused because of memory.
+   */
+  uint64_t numPauses() const {
+    return numPauses_;
+  }
+
+ private:
+  const size_t highWatermark_;
+  const size_t lowWatermark_;
+  const size_t processHighWatermark_;
+  const size_t processLowWatermark_;
+  McServerSession::Queue& sessions_;
+
+  size_t bytes_{0};
+  size_t pausedSessions_{0};
+  uint64_t numPauses_{0};
+
+  bool overHighWatermark() const;
+  bool belowLowWatermark() const;
+
+  /**
+   * Pauses the sessions holding the most bytes, see class comment.
+   */
+  void pauseLargestSessions();
+
+  void resumeSessions();
+
+  void timeoutExpired() noexcept override;
+};
+
+}}  // facebook::memcache
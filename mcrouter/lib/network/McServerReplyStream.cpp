@@ -0,0 +1,42 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "McServerReplyStream.h"
+
+#include "mcrouter/lib/network/McServerSession.h"
+
+namespace facebook { namespace memcache {
+
+McServerReplyStream::McServerReplyStream(McServerRequestContext&& ctx,
+                                         size_t minValueBytes)
+    : ctx_(std::move(ctx)),
+      minValueBytes_(minValueBytes) {
+}
+
+bool McServerReplyStream::start(uint64_t flags, size_t valueLength) {
+  if (!ctx_.hasValue() || started_ || valueLength < minValueBytes_) {
+    return false;
+  }
+  started_ = ctx_->session().startValueStream(*ctx_, flags, valueLength);
+  return started_;
+}
+
+void McServerReplyStream::data(std::unique_ptr<folly::IOBuf> chunk) {
+  if (ctx_.hasValue() && started_) {
+    ctx_->session().writeValueStream(*ctx_, std::move(chunk));
+  }
+}
+
+void McServerReplyStream::reply(McReply&& reply) {
+  assert(ctx_.hasValue());
+  McServerRequestContext::reply(std::move(ctx_.value()), std::move(reply));
+  ctx_.clear();
+}
+
+}}  // facebook::memcache
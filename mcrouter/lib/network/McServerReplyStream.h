@@ -0,0 +1,57 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Optional.h>
+
+#include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/network/McReplyStream.h"
+#include "mcrouter/lib/network/McServerRequestContext.h"
+
+namespace facebook { namespace memcache {
+
+/**
+ * Writes the value of a get hit to the client while it's still being read
+ * (cut-through), instead of once the whole reply is in.
+ *
+ * Only the first hit offered is streamed, and only for single key gets of
+ * in order (ASCII) clients, once all earlier replies are written since
+ * replies can't be interleaved on the wire. Otherwise the reply is written
+ * as usual.
+ *
+ * Once a value started streaming, the reply must be that same hit: any
+ * other reply (an error while reading the value, a route replacing the
+ * value) closes the connection, part of the hit being already written.
+ */
+class McServerReplyStream : public McReplyStream {
+ public:
+  /**
+   * Takes over ctx until reply() is called.
+   *
+   * @param minValueBytes  smaller values are not streamed.
+   */
+  McServerReplyStream(McServerRequestContext&& ctx, size_t minValueBytes);
+
+  bool start(uint64_t flags, size_t valueLength) override;
+  void data(std::unique_ptr<folly::IOBuf> chunk) override;
+
+  /**
+   * Replies through the context, see McServerRequestContext::reply().
+   * Anything offered to the stream afterwards is ignored.
+   */
+  void reply(McReply&& reply);
+
+ private:
+  folly::Optional<McServerRequestContext> ctx_;
+  const size_t minValueBytes_;
+  bool started_{false};
+};
+
+}}  // facebook::memcache
@@ -53,9 +53,15 @@ bool McServerRequestContext::noReply(const McReply& reply) const {
             operation_ == mc_op_lease_get));
 }
 
+McServerRequestContext::AsciiState::AsciiState() {
+}
+
+McServerRequestContext::AsciiState::~AsciiState() {
+}
+
 McServerRequestContext::McServerRequestContext(
   McServerSession& s, mc_op_t op, uint64_t r, bool nr,
-  std::shared_ptr<MultiOpParent> parent)
+  MultiOpParent* parent)
     : session_(&s),
       operation_(op),
       noReply_(nr),
@@ -63,8 +69,8 @@ McServerRequestContext::McServerRequestContext(
 
   if (parent) {
     asciiState_ = folly::make_unique<AsciiState>();
-    asciiState_->parent_ = std::move(parent);
-    asciiState_->parent_->recordRequest();
+    asciiState_->parent_ = LocalRefPtr<MultiOpParent>(parent);
+    parent->recordRequest();
   }
 
   session_->onTransactionStarted(hasParent() || operation_ == mc_op_end);
@@ -77,6 +83,7 @@ McServerRequestContext::McServerRequestContext(
       noReply_(other.noReply_),
       replied_(other.replied_),
       reqid_(other.reqid_),
+      requestBytes_(other.requestBytes_),
       asciiState_(std::move(other.asciiState_)) {
   other.session_ = nullptr;
 }
@@ -89,6 +96,7 @@ McServerRequestContext& McServerRequestContext::operator=(
   reqid_ = other.reqid_;
   noReply_ = other.noReply_;
   replied_ = other.replied_;
+  requestBytes_ = other.requestBytes_;
   asciiState_ = std::move(other.asciiState_);
   other.session_ = nullptr;
 
@@ -11,6 +11,7 @@
 
 #include <utility>
 
+#include "mcrouter/lib/fbi/cpp/LocalRefPtr.h"
 #include "mcrouter/lib/McReply.h"
 #include "mcrouter/lib/McRequest.h"
 
@@ -56,9 +57,15 @@ class McServerRequestContext {
   bool replied_{false};
 
   uint64_t reqid_;
+  /* Request bytes accounted as buffered by the session until replied */
+  size_t requestBytes_{0};
   struct AsciiState {
-    std::shared_ptr<MultiOpParent> parent_;
+    LocalRefPtr<MultiOpParent> parent_;
     folly::Optional<folly::IOBuf> key_;
+
+    /* Out of line, where MultiOpParent is complete */
+    AsciiState();
+    ~AsciiState();
   };
   std::unique_ptr<AsciiState> asciiState_;
 
@@ -88,7 +95,7 @@ class McServerRequestContext {
   friend class WriteBuffer;
   McServerRequestContext(McServerSession& s, mc_op_t op, uint64_t r,
                          bool nr = false,
-                         std::shared_ptr<MultiOpParent> parent = nullptr);
+                         MultiOpParent* parent = nullptr);
 };
 
 /**
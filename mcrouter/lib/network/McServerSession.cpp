@@ -9,16 +9,23 @@
  */
 #include "McServerSession.h"
 
+#include <climits>
 #include <memory>
 
+#include <folly/Conv.h>
 #include <folly/Memory.h>
+#include <folly/SocketAddress.h>
 
+#include "mcrouter/lib/network/McServerMemoryTracker.h"
 #include "mcrouter/lib/network/MultiOpParent.h"
 
 namespace facebook { namespace memcache {
 
 namespace {
 
+/* Don't put more than this many iovecs in a single writev() */
+const size_t kMaxIovsPerWrite = IOV_MAX;
+
 /**
  * @return true  If this incoming request is a part of a multiget request.
  */
@@ -37,6 +44,15 @@ bool isPartOfMultiget(mc_protocol_t protocol, mc_op_t operation) {
   return false;
 }
 
+const uint8_t* firstByte(const folly::IOBuf& buf) {
+  for (auto piece : buf) {
+    if (!piece.empty()) {
+      return piece.begin();
+    }
+  }
+  return nullptr;
+}
+
 }  // namespace
 
 McServerSession& McServerSession::create(
@@ -46,7 +62,9 @@ McServerSession& McServerSession::create(
   std::function<void(McServerSession&)> onTerminated,
   std::function<void()> onShutdown,
   AsyncMcServerWorkerOptions options,
-  void* userCtxt) {
+  void* userCtxt,
+  McServerWriteStats* writeStats,
+  McServerMemoryTracker* memoryTracker) {
 
   auto ptr = new McServerSession(
     std::move(transport),
@@ -55,7 +73,9 @@ McServerSession& McServerSession::create(
     std::move(onTerminated),
     std::move(onShutdown),
     std::move(options),
-    userCtxt
+    userCtxt,
+    writeStats,
+    memoryTracker
   );
 
   return *ptr;
@@ -68,7 +88,9 @@ McServerSession::McServerSession(
   std::function<void(McServerSession&)> onTerminated,
   std::function<void()> onShutdown,
   AsyncMcServerWorkerOptions options,
-  void* userCtxt)
+  void* userCtxt,
+  McServerWriteStats* writeStats,
+  McServerMemoryTracker* memoryTracker)
     : transport_(std::move(transport)),
       onRequest_(std::move(cb)),
       onWriteQuiescence_(std::move(onWriteQuiescence)),
@@ -76,15 +98,37 @@ McServerSession::McServerSession(
       onShutdown_(std::move(onShutdown)),
       options_(std::move(options)),
       userCtxt_(userCtxt),
+      writeStats_(writeStats),
+      memoryTracker_(memoryTracker),
       parser_(*this,
               options_.requestsPerRead,
               options_.minBufferSize,
-              options_.maxBufferSize),
+              options_.maxBufferSize,
+              options_.useNewAsciiParser),
       sendWritesCallback_(*this) {
 
   transport_->setReadCB(this);
 }
 
+const std::string& McServerSession::peerName() {
+  if (!peerName_.empty()) {
+    return peerName_;
+  }
+  if (transport_) {
+    try {
+      folly::SocketAddress address;
+      transport_->getPeerAddress(&address);
+      peerName_ = address.describe();
+    } catch (const std::exception&) {
+      /* Not connected anymore */
+    }
+  }
+  if (peerName_.empty()) {
+    peerName_ = "unknown";
+  }
+  return peerName_;
+}
+
 void McServerSession::pause(PauseReason reason) {
   pauseState_ |= static_cast<uint64_t>(reason);
 
@@ -103,6 +147,21 @@ void McServerSession::resume(PauseReason reason) {
   }
 }
 
+void McServerSession::addBufferedBytes(size_t bytes) {
+  bufferedBytes_ += bytes;
+  if (memoryTracker_) {
+    memoryTracker_->add(bytes);
+  }
+}
+
+void McServerSession::removeBufferedBytes(size_t bytes) {
+  assert(bufferedBytes_ >= bytes);
+  bufferedBytes_ -= bytes;
+  if (memoryTracker_) {
+    memoryTracker_->remove(bytes);
+  }
+}
+
 void McServerSession::onTransactionStarted(bool isSubRequest) {
   DestructorGuard dg(this);
 
@@ -119,7 +178,7 @@ void McServerSession::onTransactionStarted(bool isSubRequest) {
 
 void McServerSession::checkClosed() {
   if (!inFlight_) {
-    assert(pendingWrites_.empty());
+    assert(pendingIovs_.empty());
 
     if (state_ == CLOSING) {
       /* It's possible to call close() more than once from the same stack.
@@ -130,6 +189,10 @@ void McServerSession::checkClosed() {
         transport_->setReadCB(nullptr);
         transport_.reset();
       }
+      assert(bufferedBytes_ == 0);
+      if ((pauseState_ & PAUSE_MEMORY) && memoryTracker_) {
+        memoryTracker_->onPausedSessionClosed();
+      }
       if (onTerminated_) {
         onTerminated_(*this);
       }
@@ -159,6 +222,11 @@ void McServerSession::onTransactionCompleted(bool isSubRequest) {
 void McServerSession::reply(McServerRequestContext&& ctx, McReply&& reply) {
   DestructorGuard dg(this);
 
+  if (ctx.requestBytes_ != 0) {
+    removeBufferedBytes(ctx.requestBytes_);
+    ctx.requestBytes_ = 0;
+  }
+
   if (parser_.outOfOrder()) {
     queueWrite(std::move(ctx), std::move(reply));
   } else {
@@ -166,15 +234,18 @@ void McServerSession::reply(McServerRequestContext&& ctx, McReply&& reply) {
     if (reqid == headReqid_) {
       /* head of line reply, write it and all contiguous blocked replies */
       queueWrite(std::move(ctx), std::move(reply));
-      auto it = blockedReplies_.find(++headReqid_);
-      while (it != blockedReplies_.end()) {
-        queueWrite(std::move(it->second.first), std::move(it->second.second));
-        blockedReplies_.erase(it);
-        it = blockedReplies_.find(++headReqid_);
+      ++headReqid_;
+      while (!blockedReplies_.empty()) {
+        auto blocked = blockedReplies_.take(headReqid_);
+        if (!blocked) {
+          break;
+        }
+        queueWrite(std::move(blocked->first), std::move(blocked->second));
+        ++headReqid_;
       }
     } else {
       /* can't write this reply now, save for later */
-      blockedReplies_.emplace(
+      blockedReplies_.insert(
         reqid,
         std::make_pair(std::move(ctx), std::move(reply)));
     }
@@ -239,7 +310,8 @@ void McServerSession::requestReady(McRequest&& req,
   if (!parser_.outOfOrder()) {
     if (isPartOfMultiget(parser_.protocol(), operation) &&
         !currentMultiop_) {
-      currentMultiop_ = std::make_shared<MultiOpParent>(*this, tailReqid_++);
+      currentMultiop_ = LocalRefPtr<MultiOpParent>(
+        new MultiOpParent(*this, tailReqid_++));
     }
 
     if (operation == mc_op_end) {
@@ -250,7 +322,11 @@ void McServerSession::requestReady(McRequest&& req,
     reqid = tailReqid_++;
   }
 
-  McServerRequestContext ctx(*this, operation, reqid, noreply, currentMultiop_);
+  McServerRequestContext ctx(*this, operation, reqid, noreply,
+                             currentMultiop_.get());
+  ctx.requestBytes_ = req.fullKey().size() +
+    req.value().computeChainDataLength();
+  addBufferedBytes(ctx.requestBytes_);
 
   if (parser_.protocol() == mc_ascii_protocol) {
     ctx.asciiKey().emplace();
@@ -322,6 +398,11 @@ void McServerSession::queueWrite(McServerRequestContext&& ctx,
                                  McReply&& reply) {
   DestructorGuard dg(this);
 
+  if (streamReqid_ != 0 && ctx.reqid_ == streamReqid_) {
+    finishValueStream(std::move(ctx), std::move(reply));
+    return;
+  }
+
   if (ctx.noReply(reply)) {
     return;
   }
@@ -338,6 +419,14 @@ void McServerSession::queueWrite(McServerRequestContext&& ctx,
       transport_->close();
       return;
     }
+    writeBatches_.emplace_back();
+    auto& batch = writeBatches_.back();
+    batch.numReplies = 1;
+    batch.bytes = 0;
+    for (size_t k = 0; k < n; ++k) {
+      batch.bytes += i[k].iov_len;
+    }
+    addBufferedBytes(batch.bytes);
     transport_->writev(this, i, n);
     if (!writeBufs_->empty()) {
       /* We only need to pause if the sendmsg() call didn't write everything
@@ -345,60 +434,236 @@ void McServerSession::queueWrite(McServerRequestContext&& ctx,
       pause(PAUSE_WRITE);
     }
   } else {
-    pendingWrites_.emplace_back(std::move(ctx), std::move(reply));
+    struct iovec* i;
+    size_t n;
+    if (!ensureWriteBufs()) {
+      close();
+      return;
+    }
+    auto& wb = writeBufs_->push();
+    if (!wb.prepare(std::move(ctx), std::move(reply), i, n)) {
+      close();
+      return;
+    }
 
-    if (!writeScheduled_) {
-      auto eventBase = transport_->getEventBase();
-      CHECK(eventBase != nullptr);
-      eventBase->runInLoop(&sendWritesCallback_, /* thisIteration= */ true);
-      writeScheduled_ = true;
+    /* One iovec is kept for an Umbrella batch header */
+    if (pendingIovs_.size() + n + 1 > kMaxIovsPerWrite) {
+      sendWrites();
+    }
+    if (pendingReplies_ == 0 && options_.writeFlushDelay.count() > 0) {
+      firstPendingWrite_ = std::chrono::steady_clock::now();
     }
+    pendingIovs_.insert(pendingIovs_.end(), i, i + n);
+    ++pendingReplies_;
+    size_t bytes = 0;
+    for (size_t k = 0; k < n; ++k) {
+      bytes += i[k].iov_len;
+    }
+    pendingBytes_ += bytes;
+    addBufferedBytes(bytes);
+
+    if (options_.writeFlushBytes > 0 &&
+        pendingBytes_ >= options_.writeFlushBytes) {
+      sendWrites();
+    } else if (!writeScheduled_) {
+      scheduleSendWrites(/* thisIteration= */ true);
+    }
+  }
+}
+
+bool McServerSession::startValueStream(const McServerRequestContext& ctx,
+                                       uint64_t flags,
+                                       size_t valueLength) {
+  /* Only the reply right after its multi-op block, i.e. all earlier
+     replies are written and no other key can turn it into an error */
+  if (state_ != STREAMING || streamReqid_ != 0 || parser_.outOfOrder() ||
+      ctx.operation_ != mc_op_get || !ctx.hasParent() ||
+      !ctx.parent().singleRequest() || ctx.reqid_ != headReqid_ + 1 ||
+      !ctx.asciiState_->key_.hasValue() || !transport_->good() ||
+      !ensureWriteBufs()) {
+    return false;
   }
+
+  /* Replies queued before this one go first */
+  sendWrites();
+
+  /* Same as the header mc_ascii_response_write_iovs() writes */
+  const auto& key = ctx.asciiState_->key_.value();
+  auto header = folly::IOBuf::copyBuffer(folly::to<std::string>(
+    "VALUE ",
+    folly::StringPiece(reinterpret_cast<const char*>(key.data()),
+                       key.length()),
+    ' ', flags, ' ', valueLength, "\r\n"));
+
+  streamReqid_ = ctx.reqid_;
+  streamFlags_ = flags;
+  streamValueLength_ = valueLength;
+  streamValueData_ = nullptr;
+  streamValueBytes_ = 0;
+  streamedBytes_ = header->length();
+  if (writeStats_) {
+    ++writeStats_->numStreamedReplies;
+  }
+  writeStreamChunk(std::move(header));
+  return true;
+}
+
+void McServerSession::writeValueStream(const McServerRequestContext& ctx,
+                                       std::unique_ptr<folly::IOBuf> chunk) {
+  if (ctx.reqid_ != streamReqid_ || chunk->empty()) {
+    return;
+  }
+
+  if (streamValueData_ == nullptr) {
+    streamValueData_ = chunk->data();
+  }
+  streamValueBytes_ += chunk->length();
+  streamedBytes_ += chunk->length();
+  writeStreamChunk(std::move(chunk));
+}
+
+void McServerSession::finishValueStream(McServerRequestContext&& ctx,
+                                        McReply&& reply) {
+  streamReqid_ = 0;
+
+  const auto& value = reply.value();
+  if (reply.result() != mc_res_found || reply.flags() != streamFlags_ ||
+      streamValueBytes_ != streamValueLength_ ||
+      value.computeChainDataLength() != streamValueLength_ ||
+      firstByte(value) != streamValueData_) {
+    /* Part of a hit is already on the wire, the client can't be told
+       this reply anymore */
+    if (writeStats_) {
+      ++writeStats_->numBrokenStreams;
+    }
+    transport_->closeNow();
+    close();
+    return;
+  }
+
+  struct iovec* iovs;
+  size_t n;
+  auto& wb = writeBufs_->push();
+  if (!wb.prepare(std::move(ctx), std::move(reply), iovs, n)) {
+    transport_->closeNow();
+    close();
+    return;
+  }
+
+  /* Skip the header and value, only their trailer is left to write */
+  auto skip = streamedBytes_;
+  while (n > 0 && skip >= iovs->iov_len) {
+    skip -= iovs->iov_len;
+    ++iovs;
+    --n;
+  }
+  assert(n > 0 && skip == 0);
+
+  writeBatches_.emplace_back();
+  auto& batch = writeBatches_.back();
+  batch.numReplies = 1;
+  batch.bytes = 0;
+  for (size_t k = 0; k < n; ++k) {
+    batch.bytes += iovs[k].iov_len;
+  }
+  addBufferedBytes(batch.bytes);
+  if (writeStats_) {
+    ++writeStats_->numWrites;
+    writeStats_->numIovs += n;
+    writeStats_->numBytes += batch.bytes;
+  }
+  transport_->writev(this, iovs, n);
+}
+
+void McServerSession::writeStreamChunk(std::unique_ptr<folly::IOBuf> chunk) {
+  writeBatches_.emplace_back();
+  auto& batch = writeBatches_.back();
+  batch.numReplies = 0;
+  batch.bytes = chunk->length();
+  addBufferedBytes(batch.bytes);
+  if (writeStats_) {
+    ++writeStats_->numWrites;
+    ++writeStats_->numIovs;
+    writeStats_->numBytes += batch.bytes;
+  }
+  transport_->writeChain(this, std::move(chunk));
+}
+
+void McServerSession::scheduleSendWrites(bool thisIteration) {
+  auto eventBase = transport_->getEventBase();
+  CHECK(eventBase != nullptr);
+  eventBase->runInLoop(&sendWritesCallback_, thisIteration);
+  writeScheduled_ = true;
 }
 
 void McServerSession::SendWritesCallback::runLoopCallback() noexcept {
-  session_.sendWrites();
+  session_.sendWritesIfDue();
+}
+
+void McServerSession::sendWritesIfDue() {
+  writeScheduled_ = false;
+  if (options_.writeFlushDelay.count() > 0 && pendingReplies_ > 0 &&
+      std::chrono::steady_clock::now() <
+      firstPendingWrite_ + options_.writeFlushDelay) {
+    /* Let replies from the next loop iterations join this write */
+    scheduleSendWrites(/* thisIteration= */ false);
+    return;
+  }
+  sendWrites();
 }
 
 void McServerSession::sendWrites() {
   DestructorGuard dg(this);
 
-  writeScheduled_ = false;
+  if (writeScheduled_) {
+    sendWritesCallback_.cancelLoopCallback();
+    writeScheduled_ = false;
+  }
+  if (pendingReplies_ == 0) {
+    return;
+  }
+
+  writeBatches_.emplace_back();
+  auto& batch = writeBatches_.back();
+  batch.numReplies = pendingReplies_;
+  batch.bytes = pendingBytes_;
 
+  /* writev() may call back into the session and queue more writes */
   std::vector<struct iovec> iovs;
-  size_t count = 0;
-  while (!pendingWrites_.empty()) {
-    auto& pw = pendingWrites_.front();
-    struct iovec* i;
-    size_t n;
-    if (!ensureWriteBufs()) {
-      close();
-      return;
-    }
-    auto& wb = writeBufs_->push();
+  iovs.swap(pendingIovs_);
+
+  if (pendingReplies_ > 1 && parser_.umbrellaBatches() &&
+      umbrellaPrepareBatchHeader(batch.umbrellaHeader, pendingReplies_,
+                                 pendingBytes_)) {
+    struct iovec header;
+    header.iov_base = &batch.umbrellaHeader;
+    header.iov_len = sizeof(entry_list_msg_t);
+    iovs.insert(iovs.begin(), header);
+    pendingBytes_ += sizeof(entry_list_msg_t);
+  }
 
-    if (!wb.prepare(std::move(pw.first), std::move(pw.second), i, n)) {
-      close();
-      return;
-    }
-    pendingWrites_.pop_front();
-    ++count;
-    iovs.insert(iovs.end(), i, i + n);
+  if (writeStats_) {
+    ++writeStats_->numWrites;
+    writeStats_->numIovs += iovs.size();
+    writeStats_->numBytes += pendingBytes_;
   }
-  writeBatches_.push_back(count);
+  pendingReplies_ = 0;
+  pendingBytes_ = 0;
 
   transport_->writev(this, iovs.data(), iovs.size());
+
+  if (pendingIovs_.empty()) {
+    /* Keep the allocated capacity for the next batch */
+    iovs.clear();
+    pendingIovs_.swap(iovs);
+  }
 }
 
 void McServerSession::completeWrite() {
-  size_t count;
-  if (options_.singleWrite) {
-    count = 1;
-  } else {
-    assert(!writeBatches_.empty());
-    count = writeBatches_.front();
-    writeBatches_.pop_front();
-  }
+  assert(!writeBatches_.empty());
+  auto count = writeBatches_.front().numReplies;
+  removeBufferedBytes(writeBatches_.front().bytes);
+  writeBatches_.pop_front();
 
   while (count-- > 0) {
     assert(!writeBufs_->empty());
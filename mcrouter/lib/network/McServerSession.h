@@ -9,20 +9,54 @@
  */
 #pragma once
 
+#include <chrono>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include <folly/IntrusiveList.h>
 #include <folly/io/async/AsyncTransport.h>
 #include <folly/io/async/DelayedDestruction.h>
 #include <folly/io/async/EventBase.h>
+#include <folly/Optional.h>
 
+#include "mcrouter/lib/fbi/cpp/LocalRefPtr.h"
 #include "mcrouter/lib/network/AsyncMcServerWorkerOptions.h"
+#include "mcrouter/lib/network/IdRingMap.h"
 #include "mcrouter/lib/network/ServerMcParser.h"
 #include "mcrouter/lib/network/McServerRequestContext.h"
+#include "mcrouter/lib/network/MultiOpParent.h"
+#include "mcrouter/lib/network/UmbrellaProtocol.h"
 #include "mcrouter/lib/network/WriteBuffer.h"
 
 namespace facebook { namespace memcache {
 
+class McServerMemoryTracker;
 class McServerOnRequest;
 
+/**
+ * Counters of writev() calls made by sessions, to tune the write
+ * flush policy (see AsyncMcServerWorkerOptions).
+ */
+struct McServerWriteStats {
+  uint64_t numWrites{0};
+  uint64_t numIovs{0};
+  uint64_t numBytes{0};
+  /* Hits written while being read, see McServerReplyStream */
+  uint64_t numStreamedReplies{0};
+  /* Streamed hits that didn't end up as the reply, closing the connection */
+  uint64_t numBrokenStreams{0};
+
+  double avgIovsPerWrite() const {
+    return numWrites == 0 ? 0.0 : static_cast<double>(numIovs) / numWrites;
+  }
+
+  double avgBytesPerWrite() const {
+    return numWrites == 0 ? 0.0 : static_cast<double>(numBytes) / numWrites;
+  }
+};
+
 /**
  * A session owns a single transport, and processes the request/reply stream.
  */
@@ -58,6 +92,11 @@ class McServerSession :
    *
    * @param transport  Connected transport; transfers ownership inside
    *                   this session.
+   * @param writeStats  If not null, writes are accounted there.
+   *                    Must outlive the session.
+   * @param memoryTracker  If not null, buffered request and reply bytes are
+   *                       accounted there, and it may pause reads.
+   *                       Must outlive the session.
    */
   static McServerSession& create(
     folly::AsyncTransportWrapper::UniquePtr transport,
@@ -66,7 +105,9 @@ class McServerSession :
     std::function<void(McServerSession&)> onTerminated,
     std::function<void()> onShutdown,
     AsyncMcServerWorkerOptions options,
-    void* userCtxt);
+    void* userCtxt,
+    McServerWriteStats* writeStats = nullptr,
+    McServerMemoryTracker* memoryTracker = nullptr);
 
   /**
    * Eventually closes the transport. All pending writes will still be drained.
@@ -99,6 +140,12 @@ class McServerSession :
     return userCtxt_;
   }
 
+  /**
+   * Address of the client ("ip:port"), "unknown" if it can't be told.
+   * Looked up on the first call only.
+   */
+  const std::string& peerName();
+
  private:
   folly::AsyncTransportWrapper::UniquePtr transport_;
   std::shared_ptr<McServerOnRequest> onRequest_;
@@ -107,6 +154,14 @@ class McServerSession :
   std::function<void()> onShutdown_;
   AsyncMcServerWorkerOptions options_;
   void* userCtxt_{nullptr};
+  McServerWriteStats* writeStats_{nullptr};
+  McServerMemoryTracker* memoryTracker_{nullptr};
+
+  /* Values of unreplied requests and unwritten replies, in bytes */
+  size_t bufferedBytes_{0};
+
+  /* See peerName(), empty until looked up */
+  std::string peerName_;
 
   enum State {
     STREAMING,  /* close() was not called */
@@ -124,29 +179,55 @@ class McServerSession :
 
   /* headReqid_ <= tailReqid_.  Since we must output replies sequentially,
      headReqid_ tracks the last reply id we're allowed to sent out.
-     Out of order replies are stalled in the blockedReplies_ queue. */
-  uint64_t headReqid_{0}; /**< Id of next unblocked reply */
-  uint64_t tailReqid_{0}; /**< Id to assign to next request */
-  std::unordered_map<
-    uint64_t,
-    std::pair<McServerRequestContext, McReply>> blockedReplies_;
+     Out of order replies are stalled in the blockedReplies_ ring.
+     Ids start at 1, IdRingMap reserves 0. */
+  uint64_t headReqid_{1}; /**< Id of next unblocked reply */
+  uint64_t tailReqid_{1}; /**< Id to assign to next request */
+  IdRingMap<folly::Optional<
+    std::pair<McServerRequestContext, McReply>>> blockedReplies_;
 
   /* If non-null, a multi-op operation is being parsed.*/
-  std::shared_ptr<MultiOpParent> currentMultiop_;
+  LocalRefPtr<MultiOpParent> currentMultiop_;
+
+  /* Streamed reply state (see McServerReplyStream), at most one at a time
+     since it must be the head of line reply */
+  uint64_t streamReqid_{0}; /**< Id of the streamed reply, 0 if none */
+  uint64_t streamFlags_{0};
+  size_t streamValueLength_{0};
+  /* First value byte written, to check the reply is the streamed one */
+  const uint8_t* streamValueData_{nullptr};
+  size_t streamValueBytes_{0}; /**< Value bytes written */
+  size_t streamedBytes_{0}; /**< Header and value bytes written */
 
 
   /* Batch writing state */
 
   /**
-   * All writes to be written at the end of the loop in a single batch.
+   * Serialized replies to be written in a single batch.
+   * They point into the back of writeBufs_.
    */
-  std::deque<std::pair<McServerRequestContext, McReply>> pendingWrites_;
+  std::vector<struct iovec> pendingIovs_;
+  size_t pendingReplies_{0};
+  size_t pendingBytes_{0};
 
   /**
-   * Each entry contains the count of requests with replies already written
-   * to the transport, waiting on write success.
+   * When the first of the pending replies was queued.
+   * Only tracked if options_.writeFlushDelay is set.
    */
-  std::deque<size_t> writeBatches_;
+  std::chrono::steady_clock::time_point firstPendingWrite_;
+
+  struct WriteBatch {
+    /* Count of requests with replies already written to the transport,
+       waiting on write success */
+    size_t numReplies;
+    /* Buffered bytes of the replies */
+    size_t bytes;
+    /* Written before the replies if they were sent as one Umbrella
+       BATCH frame (only once the client sent us one) */
+    entry_list_msg_t umbrellaHeader;
+  };
+
+  std::deque<WriteBatch> writeBatches_;
 
   /**
    * Queue of write buffers.
@@ -185,6 +266,10 @@ class McServerSession :
     PAUSE_THROTTLED = 1 << 0,
     PAUSE_WRITE = 1 << 1,
     PAUSE_USER = 1 << 2,
+    /* See McServerMemoryTracker */
+    PAUSE_MEMORY = 1 << 3,
+    /* See AsyncMcServerWorker::pauseReads() */
+    PAUSE_CREDITS = 1 << 4,
   };
 
   /* Reads are enabled iff pauseState_ == 0 */
@@ -205,6 +290,14 @@ class McServerSession :
    */
   void sendWrites();
 
+  /**
+   * Called from SendWritesCallback, flushes pending writes
+   * once options_.writeFlushDelay has passed.
+   */
+  void sendWritesIfDue();
+
+  void scheduleSendWrites(bool thisIteration);
+
   /**
    * Check if no outstanding transactions, and close socket and
    * call onTerminated() if so.
@@ -247,6 +340,29 @@ class McServerSession :
 
   void queueWrite(McServerRequestContext&& ctx, McReply&& reply);
 
+  /**
+   * Writes the header of ctx's get hit if it can be streamed now.
+   *
+   * @return  false if the hit must be replied to as usual.
+   */
+  bool startValueStream(const McServerRequestContext& ctx,
+                        uint64_t flags,
+                        size_t valueLength);
+
+  /**
+   * Writes the next value bytes of a hit started by startValueStream().
+   */
+  void writeValueStream(const McServerRequestContext& ctx,
+                        std::unique_ptr<folly::IOBuf> chunk);
+
+  /**
+   * Writes what's left of a streamed reply after its value, or closes the
+   * connection if reply is not the streamed hit.
+   */
+  void finishValueStream(McServerRequestContext&& ctx, McReply&& reply);
+
+  void writeStreamChunk(std::unique_ptr<folly::IOBuf> chunk);
+
   void completeWrite();
 
   /* TAsyncTransport's writeCallback */
@@ -255,6 +371,9 @@ class McServerSession :
                 const folly::AsyncSocketException& ex)
     noexcept override;
 
+  void addBufferedBytes(size_t bytes);
+  void removeBufferedBytes(size_t bytes);
+
   void onTransactionStarted(bool isSubRequest);
   void onTransactionCompleted(bool isSubRequest);
 
@@ -265,11 +384,16 @@ class McServerSession :
     std::function<void(McServerSession&)> onTerminated,
     std::function<void()> onShutdown,
     AsyncMcServerWorkerOptions options,
-    void* userCtxt);
+    void* userCtxt,
+    McServerWriteStats* writeStats,
+    McServerMemoryTracker* memoryTracker);
 
   McServerSession(const McServerSession&) = delete;
   McServerSession& operator=(const McServerSession&) = delete;
 
+  friend class AsyncMcServerWorker;
+  friend class McServerMemoryTracker;
+  friend class McServerReplyStream;
   friend class McServerRequestContext;
   friend class ServerMcParser<McServerSession>;
 };
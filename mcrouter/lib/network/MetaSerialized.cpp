@@ -0,0 +1,174 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "MetaSerialized.h"
+
+#include "mcrouter/lib/McRequest.h"
+
+namespace facebook { namespace memcache {
+
+constexpr uint32_t MetaSerializedRequest::kLeaseVivifyExptime;
+
+void MetaSerializedRequest::addString(folly::ByteRange range) {
+  assert(iovsCount_ < kMaxIovs);
+  iovs_[iovsCount_].iov_base = const_cast<unsigned char*>(range.begin());
+  iovs_[iovsCount_].iov_len = range.size();
+  ++iovsCount_;
+}
+
+void MetaSerializedRequest::addString(folly::StringPiece str) {
+  // cause implicit conversion.
+  addString(folly::ByteRange(str));
+}
+
+void MetaSerializedRequest::addValue(const McRequest& request) {
+  const auto& value = request.value();
+  // One iovec is reserved for the trailing "\r\n".
+  if (!value.isChained() ||
+      value.countChainElements() >= kMaxIovs - iovsCount_) {
+    addString(request.valueRangeSlow());
+    return;
+  }
+  for (auto piece : value) {
+    if (!piece.empty()) {
+      addString(piece);
+    }
+  }
+}
+
+void MetaSerializedRequest::storageRequestCommon(const McRequest& request,
+                                                 folly::StringPiece mode,
+                                                 uint64_t cas) {
+  auto valueSize = request.value().computeChainDataLength();
+  int len;
+  if (cas != 0) {
+    len = snprintf(printBuffer_, kMaxBufferLength,
+                   " %zd T%u F%lu C%lu%.*s\r\n",
+                   valueSize, request.exptime(), request.flags(), cas,
+                   static_cast<int>(mode.size()), mode.data());
+  } else {
+    len = snprintf(printBuffer_, kMaxBufferLength,
+                   " %zd T%u F%lu%.*s\r\n",
+                   valueSize, request.exptime(), request.flags(),
+                   static_cast<int>(mode.size()), mode.data());
+  }
+  assert(len > 0 && static_cast<size_t>(len) < kMaxBufferLength);
+  addStrings("ms ", request.fullKey(),
+             folly::StringPiece(printBuffer_, static_cast<size_t>(len)));
+  addValue(request);
+  addString("\r\n");
+}
+
+void MetaSerializedRequest::arithRequestCommon(const McRequest& request,
+                                               folly::StringPiece mode) {
+  auto len = snprintf(printBuffer_, kMaxBufferLength, " v D%lu%.*s\r\n",
+                      request.delta(),
+                      static_cast<int>(mode.size()), mode.data());
+  assert(len > 0 && static_cast<size_t>(len) < kMaxBufferLength);
+  addStrings("ma ", request.fullKey(),
+             folly::StringPiece(printBuffer_, static_cast<size_t>(len)));
+}
+
+// Get-like ops.
+
+void MetaSerializedRequest::prepareImpl(const McRequest& request,
+                                        McOperation<mc_op_get>) {
+  addStrings("mg ", request.fullKey(), " v f\r\n");
+}
+
+void MetaSerializedRequest::prepareImpl(const McRequest& request,
+                                        McOperation<mc_op_gets>) {
+  addStrings("mg ", request.fullKey(), " v f c\r\n");
+}
+
+void MetaSerializedRequest::prepareImpl(const McRequest& request,
+                                        McOperation<mc_op_lease_get>) {
+  auto len = snprintf(printBuffer_, kMaxBufferLength, " v f c N%u\r\n",
+                      kLeaseVivifyExptime);
+  assert(len > 0 && static_cast<size_t>(len) < kMaxBufferLength);
+  addStrings("mg ", request.fullKey(),
+             folly::StringPiece(printBuffer_, static_cast<size_t>(len)));
+}
+
+// Update-like ops.
+
+void MetaSerializedRequest::prepareImpl(const McRequest& request,
+                                        McOperation<mc_op_set>) {
+  storageRequestCommon(request, "", 0);
+}
+
+void MetaSerializedRequest::prepareImpl(const McRequest& request,
+                                        McOperation<mc_op_add>) {
+  storageRequestCommon(request, " ME", 0);
+}
+
+void MetaSerializedRequest::prepareImpl(const McRequest& request,
+                                        McOperation<mc_op_replace>) {
+  storageRequestCommon(request, " MR", 0);
+}
+
+void MetaSerializedRequest::prepareImpl(const McRequest& request,
+                                        McOperation<mc_op_append>) {
+  storageRequestCommon(request, " MA", 0);
+}
+
+void MetaSerializedRequest::prepareImpl(const McRequest& request,
+                                        McOperation<mc_op_prepend>) {
+  storageRequestCommon(request, " MP", 0);
+}
+
+void MetaSerializedRequest::prepareImpl(const McRequest& request,
+                                        McOperation<mc_op_cas>) {
+  storageRequestCommon(request, "", request.cas());
+}
+
+void MetaSerializedRequest::prepareImpl(const McRequest& request,
+                                        McOperation<mc_op_lease_set>) {
+  /* The lease token is the cas of the item vivified by lease-get */
+  storageRequestCommon(request, "", request.leaseToken());
+}
+
+// Arithmetic ops.
+
+void MetaSerializedRequest::prepareImpl(const McRequest& request,
+                                        McOperation<mc_op_incr>) {
+  arithRequestCommon(request, "");
+}
+
+void MetaSerializedRequest::prepareImpl(const McRequest& request,
+                                        McOperation<mc_op_decr>) {
+  arithRequestCommon(request, " MD");
+}
+
+// Delete op.
+
+void MetaSerializedRequest::prepareImpl(const McRequest& request,
+                                        McOperation<mc_op_delete>) {
+  addStrings("md ", request.fullKey(), "\r\n");
+}
+
+// Touch op.
+
+void MetaSerializedRequest::prepareImpl(const McRequest& request,
+                                        McOperation<mc_op_touch>) {
+  auto len = snprintf(printBuffer_, kMaxBufferLength, " T%u\r\n",
+                      request.exptime());
+  assert(len > 0 && static_cast<size_t>(len) < kMaxBufferLength);
+  addStrings("mg ", request.fullKey(),
+             folly::StringPiece(printBuffer_, static_cast<size_t>(len)));
+}
+
+// Version op.
+
+void MetaSerializedRequest::prepareImpl(const McRequest& request,
+                                        McOperation<mc_op_version>) {
+  addString("version\r\n");
+}
+
+}} // facebook::memcache
@@ -0,0 +1,117 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <sys/uio.h>
+
+#include <folly/Range.h>
+
+#include "mcrouter/lib/McOperation.h"
+
+namespace facebook { namespace memcache {
+
+class McRequest;
+
+/**
+ * Meta protocol (mg/ms/md/ma) serialized request.
+ *
+ * Replies to meta commands don't echo the key and carry only the
+ * requested flags. Lease-get is mapped to mg with vivify-on-miss, the
+ * lease token being the cas of the vivified item.
+ */
+class MetaSerializedRequest {
+ public:
+  /**
+   * Exptime of the placeholder item created by a lease-get miss.
+   */
+  static constexpr uint32_t kLeaseVivifyExptime = 30;
+
+  MetaSerializedRequest() = default;
+
+  MetaSerializedRequest(const MetaSerializedRequest&) = delete;
+  MetaSerializedRequest& operator=(const MetaSerializedRequest&) = delete;
+  MetaSerializedRequest(MetaSerializedRequest&&) = delete;
+  MetaSerializedRequest& operator=(MetaSerializedRequest&&) = delete;
+
+  /**
+   * Prepare buffers for given Request/Operation pair.
+   *
+   * @param request
+   * @param op
+   * @param iovOut  will be set to the beginning of array of ivecs that
+   *                reference serialized data.
+   * @param niovOut  number of valid iovecs referenced by iovOut.
+   * @return true iff message was successfully prepared.
+   */
+  template <class Operation, class Request>
+  bool prepare(const Request& request, Operation,
+               struct iovec*& iovOut, size_t& niovOut);
+ private:
+  // command + key + printBuffer + value... + "\r\n"
+  static constexpr size_t kMaxIovs = 16;
+  // The longest print buffer we need is for cas/lease-set:
+  // " <size> T<exptime> F<flags> C<cas> M<mode>\r\n" fits easily.
+  static constexpr size_t kMaxBufferLength = 96;
+
+  struct iovec iovs_[kMaxIovs];
+  size_t iovsCount_{0};
+  char printBuffer_[kMaxBufferLength];
+
+  void addString(folly::ByteRange range);
+  void addString(folly::StringPiece str);
+
+  template <class Arg1, class Arg2>
+  void addStrings(Arg1&& arg1, Arg2&& arg2);
+  template <class Arg, class... Args>
+  void addStrings(Arg&& arg, Args&&... args);
+
+  void addValue(const McRequest& request);
+
+  /**
+   * ms command with the given mode flag (may be empty) and cas
+   * (0 for none).
+   */
+  void storageRequestCommon(const McRequest& request, folly::StringPiece mode,
+                            uint64_t cas);
+
+  void arithRequestCommon(const McRequest& request, folly::StringPiece mode);
+
+  // Get-like ops.
+  void prepareImpl(const McRequest& request, McOperation<mc_op_get>);
+  void prepareImpl(const McRequest& request, McOperation<mc_op_gets>);
+  void prepareImpl(const McRequest& request, McOperation<mc_op_lease_get>);
+  // Update-like ops.
+  void prepareImpl(const McRequest& request, McOperation<mc_op_set>);
+  void prepareImpl(const McRequest& request, McOperation<mc_op_add>);
+  void prepareImpl(const McRequest& request, McOperation<mc_op_replace>);
+  void prepareImpl(const McRequest& request, McOperation<mc_op_append>);
+  void prepareImpl(const McRequest& request, McOperation<mc_op_prepend>);
+  void prepareImpl(const McRequest& request, McOperation<mc_op_cas>);
+  void prepareImpl(const McRequest& request, McOperation<mc_op_lease_set>);
+  // Arithmetic ops.
+  void prepareImpl(const McRequest& request, McOperation<mc_op_incr>);
+  void prepareImpl(const McRequest& request, McOperation<mc_op_decr>);
+  // Delete op.
+  void prepareImpl(const McRequest& request, McOperation<mc_op_delete>);
+  // Touch op.
+  void prepareImpl(const McRequest& request, McOperation<mc_op_touch>);
+  // Version op.
+  void prepareImpl(const McRequest& request, McOperation<mc_op_version>);
+
+  // Everything else is false.
+  template <class Request, class Operation>
+  std::false_type prepareImpl(const Request& request, Operation);
+
+  struct PrepareImplWrapper;
+};
+
+}} // facebook::memcache
+
+#include "MetaSerialized-inl.h"
@@ -11,6 +11,7 @@
 
 #include <folly/Optional.h>
 
+#include "mcrouter/lib/fbi/cpp/LocalRefPtr.h"
 #include "mcrouter/lib/McReply.h"
 #include "mcrouter/lib/network/McServerRequestContext.h"
 
@@ -42,8 +43,11 @@ class McServerSession;
  * write anything to the transport (same as if 'noreply' was set).
  *
  * Finally the end context will write out the stored error reply.
+ *
+ * The parent is shared by the session (while parsing) and the sub-request
+ * contexts with a non-atomic intrusive count, all on the session's thread.
  */
-class MultiOpParent {
+class MultiOpParent : public LocalRefCounted<MultiOpParent> {
  public:
   MultiOpParent(McServerSession& session, uint64_t blockReqid);
 
@@ -59,6 +63,7 @@ class MultiOpParent {
    */
   void recordRequest() {
     ++waiting_;
+    ++requests_;
   }
 
   /**
@@ -74,8 +79,17 @@ class MultiOpParent {
     return error_;
   }
 
+  /**
+   * @return true if the mc_op_end was seen after a single sub-request,
+   *         and no error was observed so far
+   */
+  bool singleRequest() const {
+    return end_.hasValue() && requests_ == 1 && !error_;
+  }
+
  private:
   size_t waiting_{0};
+  size_t requests_{0};
   folly::Optional<McReply> reply_;
   bool error_{false};
 
@@ -84,6 +98,12 @@ class MultiOpParent {
   folly::Optional<McServerRequestContext> end_;
 
   void release();
+
+  void onLastRef() {
+    delete this;
+  }
+
+  friend class LocalRefCounted<MultiOpParent>;
 };
 
 }}  // facebook::memcache
@@ -17,28 +17,43 @@ template <class Callback>
 ServerMcParser<Callback>::ServerMcParser(Callback& cb,
                                          size_t requestsPerRead,
                                          size_t minBufferSize,
-                                         size_t maxBufferSize)
+                                         size_t maxBufferSize,
+                                         bool useNewAsciiParser)
   : parser_(*this, requestsPerRead, minBufferSize, maxBufferSize),
+    useNewParser_(useNewAsciiParser),
     callback_(cb) {
-  mc_parser_init(&mcParser_,
-                 request_parser,
-                 &parserMsgReady,
-                 &parserParseError,
-                 this);
+  if (!useNewParser_) {
+    mc_parser_init(&mcParser_,
+                   request_parser,
+                   &parserMsgReady,
+                   &parserParseError,
+                   this);
+  }
 }
 
 template <class Callback>
 ServerMcParser<Callback>::~ServerMcParser() {
-  mc_parser_reset(&mcParser_);
+  if (!useNewParser_) {
+    mc_parser_reset(&mcParser_);
+  }
 }
 
 template <class Callback>
 std::pair<void*, size_t> ServerMcParser<Callback>::getReadBuffer() {
+  if (useNewParser_ && parser_.protocol() == mc_ascii_protocol &&
+      asciiParser_.hasReadBuffer()) {
+    return asciiParser_.getReadBuffer();
+  }
   return parser_.getReadBuffer();
 }
 
 template <class Callback>
 bool ServerMcParser<Callback>::readDataAvailable(size_t len) {
+  if (useNewParser_ && parser_.protocol() == mc_ascii_protocol &&
+      asciiParser_.hasReadBuffer()) {
+    asciiParser_.readDataAvailable(len);
+    return true;
+  }
   return parser_.readDataAvailable(len);
 }
 
@@ -92,10 +107,32 @@ bool ServerMcParser<Callback>::umMessageReady(const UmbrellaMessageInfo& info,
 
 template <class Callback>
 void ServerMcParser<Callback>::handleAscii(folly::IOBuf& readBuffer) {
-  /* mc_parser only works with contiguous blocks */
-  auto bytes = readBuffer.coalesce();
-  mc_parser_parse(&mcParser_, bytes.begin(), bytes.size());
-  readBuffer.clear();
+  if (useNewParser_) {
+    /* A partial command line stays in readBuffer until more is read */
+    while (readBuffer.length()) {
+      switch (asciiParser_.consume(readBuffer)) {
+        case McServerAsciiParser::State::COMPLETE:
+          requestReadyHelper(asciiParser_.getRequest(),
+                             asciiParser_.operation(),
+                             /* reqid= */ 0,
+                             asciiParser_.result(),
+                             asciiParser_.noreply());
+          break;
+        case McServerAsciiParser::State::ERROR:
+          readBuffer.clear();
+          callback_.parseError(mc_res_client_error,
+                               asciiParser_.errorReason());
+          return;
+        case McServerAsciiParser::State::PARTIAL:
+          return;
+      }
+    }
+  } else {
+    /* mc_parser only works with contiguous blocks */
+    auto bytes = readBuffer.coalesce();
+    mc_parser_parse(&mcParser_, bytes.begin(), bytes.size());
+    readBuffer.clear();
+  }
 }
 
 template <class Callback>
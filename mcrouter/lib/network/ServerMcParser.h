@@ -10,6 +10,7 @@
 #pragma once
 
 #include "mcrouter/lib/network/McParser.h"
+#include "mcrouter/lib/network/McServerAsciiParser.h"
 
 namespace facebook { namespace memcache {
 
@@ -19,7 +20,8 @@ class ServerMcParser : private McParser::ParserCallback {
   ServerMcParser(Callback& cb,
                  size_t requestsPerRead,
                  size_t minBufferSize,
-                 size_t maxBufferSize);
+                 size_t maxBufferSize,
+                 bool useNewAsciiParser = false);
 
   ~ServerMcParser();
 
@@ -48,9 +50,15 @@ class ServerMcParser : private McParser::ParserCallback {
     return parser_.outOfOrder();
   }
 
+  bool umbrellaBatches() const {
+    return parser_.umbrellaBatches();
+  }
+
  private:
   McParser parser_;
+  McServerAsciiParser asciiParser_;
   mc_parser_t mcParser_;
+  bool useNewParser_{false};
 
   Callback& callback_;
 
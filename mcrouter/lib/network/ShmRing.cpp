@@ -0,0 +1,305 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "ShmRing.h"
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#include <folly/Bits.h>
+#include <folly/Exception.h>
+
+namespace facebook { namespace memcache {
+
+namespace {
+
+constexpr uint64_t kChannelMagic = 0x4d43534852494e47;  // "MCSHRING"
+
+int futex(std::atomic<uint32_t>* addr, int op, uint32_t value,
+          const struct timespec* timeout) {
+  /* Not FUTEX_PRIVATE_FLAG: the ring is shared between processes */
+  return syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), op, value,
+                 timeout, nullptr, 0);
+}
+
+size_t roundUp(size_t size, size_t alignment) {
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+}  // anonymous namespace
+
+ShmRing::ShmRing(Header& header, uint8_t* data, size_t capacity)
+    : header_(header),
+      data_(data),
+      capacity_(capacity) {
+  assert(capacity_ > 0 && (capacity_ & (capacity_ - 1)) == 0);
+}
+
+size_t ShmRing::used(uint64_t head, uint64_t tail) {
+  /* The header is writable by the other process, which we don't trust:
+     copying more than capacity_ bytes would overrun the buffer. Tail
+     past head wraps around to a huge count too. */
+  if (head - tail > capacity_) {
+    broken_ = true;
+    return capacity_;
+  }
+  return head - tail;
+}
+
+size_t ShmRing::write(const void* buf, size_t len) {
+  if (broken_) {
+    return 0;
+  }
+  auto head = header_.head.load(std::memory_order_relaxed);
+  auto tail = header_.tail.load(std::memory_order_acquire);
+  auto n = std::min<size_t>(len, capacity_ - used(head, tail));
+  if (n == 0) {
+    return 0;
+  }
+
+  auto pos = head & (capacity_ - 1);
+  auto first = std::min<size_t>(n, capacity_ - pos);
+  auto src = static_cast<const uint8_t*>(buf);
+  std::memcpy(data_ + pos, src, first);
+  std::memcpy(data_, src + first, n - first);
+  header_.head.store(head + n, std::memory_order_release);
+
+  wake();
+  return n;
+}
+
+void ShmRing::wake() {
+  /* Pairs with the fence in wait(): either we see the consumer sleeping,
+     or it sees what we published before going to sleep */
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (header_.sleeping.load(std::memory_order_relaxed)) {
+    header_.wakeups.fetch_add(1, std::memory_order_relaxed);
+    futex(&header_.wakeups, FUTEX_WAKE, INT_MAX, nullptr);
+  }
+}
+
+size_t ShmRing::read(void* buf, size_t len) {
+  if (broken_) {
+    return 0;
+  }
+  auto tail = header_.tail.load(std::memory_order_relaxed);
+  auto head = header_.head.load(std::memory_order_acquire);
+  auto n = std::min<size_t>(len, used(head, tail));
+  if (broken_ || n == 0) {
+    return 0;
+  }
+
+  auto pos = tail & (capacity_ - 1);
+  auto first = std::min<size_t>(n, capacity_ - pos);
+  auto dst = static_cast<uint8_t*>(buf);
+  std::memcpy(dst, data_ + pos, first);
+  std::memcpy(dst + first, data_, n - first);
+  header_.tail.store(tail + n, std::memory_order_release);
+  return n;
+}
+
+bool ShmRing::empty() const {
+  return header_.head.load(std::memory_order_acquire) ==
+         header_.tail.load(std::memory_order_relaxed);
+}
+
+void ShmRing::wait(std::chrono::milliseconds timeout) {
+  auto wakeups = header_.wakeups.load(std::memory_order_relaxed);
+  header_.sleeping.store(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (empty()) {
+    struct timespec ts;
+    ts.tv_sec = timeout.count() / 1000;
+    ts.tv_nsec = (timeout.count() % 1000) * 1000000;
+    /* EAGAIN if woken up in between, EINTR/ETIMEDOUT are fine too */
+    futex(&header_.wakeups, FUTEX_WAIT, wakeups, &ts);
+  }
+  header_.sleeping.store(0, std::memory_order_relaxed);
+}
+
+void ShmRing::reset() {
+  header_.head.store(0, std::memory_order_relaxed);
+  header_.tail.store(0, std::memory_order_relaxed);
+  broken_ = false;
+}
+
+namespace {
+
+/* Beginning of the mapping, followed by both ring headers and buffers */
+struct ChannelHeader {
+  uint64_t magic;
+  uint64_t ringCapacity;
+  std::atomic<uint32_t> state;
+  std::atomic<int32_t> clientPid;
+};
+
+size_t ringsOffset() {
+  return roundUp(sizeof(ChannelHeader), 64);
+}
+
+size_t dataOffset() {
+  return ringsOffset() + 2 * sizeof(ShmRing::Header);
+}
+
+size_t mappingSize(size_t ringCapacity) {
+  return dataOffset() + 2 * ringCapacity;
+}
+
+void* mapFile(int fd, size_t size) {
+  auto mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      fd, 0);
+  if (mapping == MAP_FAILED) {
+    int err = errno;
+    close(fd);
+    folly::throwSystemErrorExplicit(err, "mmap() of shm channel failed");
+  }
+  close(fd);
+  return mapping;
+}
+
+}  // anonymous namespace
+
+struct ShmChannel::Header : public ChannelHeader {
+};
+
+ShmChannel::ShmChannel(void* mapping, size_t mappingSize, bool isClient)
+    : mapping_(mapping),
+      mappingSize_(mappingSize),
+      header_(static_cast<Header*>(mapping)),
+      isClient_(isClient) {
+  auto base = static_cast<uint8_t*>(mapping);
+  auto rings = reinterpret_cast<ShmRing::Header*>(base + ringsOffset());
+  auto capacity = header_->ringCapacity;
+  requests_ = std::unique_ptr<ShmRing>(
+    new ShmRing(rings[0], base + dataOffset(), capacity));
+  replies_ = std::unique_ptr<ShmRing>(
+    new ShmRing(rings[1], base + dataOffset() + capacity, capacity));
+}
+
+std::shared_ptr<ShmChannel> ShmChannel::create(const std::string& path,
+                                               size_t ringCapacity) {
+  ringCapacity = folly::nextPowTwo(std::max<size_t>(ringCapacity, 4096));
+  auto size = mappingSize(ringCapacity);
+
+  /* Clients of a previous server keep the old file */
+  unlink(path.c_str());
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0660);
+  folly::checkUnixError(fd, "Can't create shm channel ", path);
+  if (ftruncate(fd, size) != 0) {
+    int err = errno;
+    close(fd);
+    folly::throwSystemErrorExplicit(err, "ftruncate() failed for ", path);
+  }
+  auto mapping = mapFile(fd, size);
+
+  /* The file is zero filled, which is how the rings start out */
+  auto header = new (mapping) Header;
+  header->ringCapacity = ringCapacity;
+  header->state.store(static_cast<uint32_t>(State::FREE));
+  header->clientPid.store(0);
+  auto rings = reinterpret_cast<ShmRing::Header*>(
+    static_cast<uint8_t*>(mapping) + ringsOffset());
+  new (&rings[0]) ShmRing::Header();
+  new (&rings[1]) ShmRing::Header();
+  std::atomic_thread_fence(std::memory_order_release);
+  header->magic = kChannelMagic;
+
+  return std::shared_ptr<ShmChannel>(new ShmChannel(mapping, size, false));
+}
+
+std::shared_ptr<ShmChannel> ShmChannel::attach(const std::string& path) {
+  int fd = open(path.c_str(), O_RDWR);
+  folly::checkUnixError(fd, "Can't open shm channel ", path);
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < dataOffset()) {
+    close(fd);
+    throw std::runtime_error("Not a shm channel: " + path);
+  }
+  size_t size = st.st_size;
+  auto mapping = mapFile(fd, size);
+
+  auto header = static_cast<Header*>(mapping);
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (header->magic != kChannelMagic ||
+      mappingSize(header->ringCapacity) != size) {
+    munmap(mapping, size);
+    throw std::runtime_error("Not a shm channel: " + path);
+  }
+  auto expected = static_cast<uint32_t>(State::FREE);
+  if (!header->state.compare_exchange_strong(
+        expected, static_cast<uint32_t>(State::ATTACHED))) {
+    munmap(mapping, size);
+    throw std::runtime_error("Shm channel is not free: " + path);
+  }
+  header->clientPid.store(getpid());
+
+  return std::shared_ptr<ShmChannel>(new ShmChannel(mapping, size, true));
+}
+
+ShmChannel::~ShmChannel() {
+  if (isClient_) {
+    detachClient();
+  }
+  munmap(mapping_, mappingSize_);
+}
+
+ShmChannel::State ShmChannel::state() const {
+  return static_cast<State>(header_->state.load(std::memory_order_acquire));
+}
+
+void ShmChannel::detachClient() {
+  assert(isClient_);
+  auto gone = static_cast<uint32_t>(State::CLIENT_GONE);
+  if (header_->state.exchange(gone, std::memory_order_acq_rel) != gone) {
+    requests_->wake();
+  }
+}
+
+void ShmChannel::closeServer() {
+  assert(!isClient_);
+  auto state = header_->state.load(std::memory_order_acquire);
+  while (state != static_cast<uint32_t>(State::CLIENT_GONE) &&
+         state != static_cast<uint32_t>(State::SERVER_GONE)) {
+    if (header_->state.compare_exchange_weak(
+          state, static_cast<uint32_t>(State::SERVER_GONE))) {
+      replies_->wake();
+      return;
+    }
+  }
+}
+
+void ShmChannel::release() {
+  assert(!isClient_);
+  requests_->reset();
+  replies_->reset();
+  header_->clientPid.store(0, std::memory_order_relaxed);
+  header_->state.store(static_cast<uint32_t>(State::FREE),
+                       std::memory_order_release);
+}
+
+bool ShmChannel::clientAlive() const {
+  auto pid = header_->clientPid.load(std::memory_order_relaxed);
+  return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+}}  // facebook::memcache
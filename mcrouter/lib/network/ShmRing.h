@@ -0,0 +1,200 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace facebook { namespace memcache {
+
+/**
+ * Single producer single consumer byte ring in shared memory.
+ *
+ * The producer and the consumer may live in different processes. The ring
+ * is lock free, and the futex the consumer sleeps on in wait() is part of
+ * the ring, so the producer makes a syscall only if the consumer went
+ * to sleep on an empty ring.
+ */
+class ShmRing {
+ public:
+  struct Header {
+    /* Bytes ever written and read, positions are taken modulo capacity */
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    alignas(64) std::atomic<uint32_t> sleeping;
+    std::atomic<uint32_t> wakeups;
+  };
+
+  /**
+   * @param header  shared ring header
+   * @param data    shared buffer of capacity bytes, capacity must be
+   *                a power of two
+   */
+  ShmRing(Header& header, uint8_t* data, size_t capacity);
+
+  size_t capacity() const {
+    return capacity_;
+  }
+
+  /**
+   * Producer: copies as much of buf as there is room for, and wakes
+   * a sleeping consumer.
+   *
+   * @return  number of bytes written, 0 as well once broken().
+   */
+  size_t write(const void* buf, size_t len);
+
+  /**
+   * Wakes the consumer if it sleeps in wait(), e.g. after the other side
+   * changed some state the consumer looks at.
+   */
+  void wake();
+
+  /**
+   * Consumer: copies up to len bytes out of the ring.
+   *
+   * @return  number of bytes read, 0 as well once broken().
+   */
+  size_t read(void* buf, size_t len);
+
+  bool empty() const;
+
+  /**
+   * True once read() or write() found head and tail more than capacity
+   * apart: the other side wrote garbage into the header. The ring is
+   * unusable until reset(), the channel has to be closed.
+   */
+  bool broken() const {
+    return broken_;
+  }
+
+  /**
+   * Consumer: sleeps until wake() is called (writes do that), for at most
+   * timeout. Returns right away if the ring isn't empty.
+   */
+  void wait(std::chrono::milliseconds timeout);
+
+  /**
+   * Drops all data and clears broken(). Only safe while neither side
+   * uses the ring.
+   */
+  void reset();
+
+ private:
+  Header& header_;
+  uint8_t* data_;
+  size_t capacity_;
+  /* Local: the other side can't clear it */
+  bool broken_{false};
+
+  /**
+   * Bytes in the ring given head and tail read from the header; never
+   * more than capacity_, sets broken_ if they say otherwise.
+   */
+  size_t used(uint64_t head, uint64_t tail);
+};
+
+/**
+ * Two ShmRings in a shared file mapping (e.g. under /dev/shm) connecting
+ * one client process to a server: requests go through one ring, replies
+ * through the other.
+ *
+ * The server creates the channel, and a client attaches to it as long as
+ * no other client is attached. Either side going away is signalled through
+ * the channel state, so the other one can tell a quiet channel from a
+ * closed one.
+ */
+class ShmChannel {
+ public:
+  enum class State : uint32_t {
+    // Waiting for a client to attach.
+    FREE,
+    // A client is attached.
+    ATTACHED,
+    // The client detached, the server has to release() the channel.
+    CLIENT_GONE,
+    // The server closed the channel (or shut down).
+    SERVER_GONE,
+  };
+
+  /**
+   * Creates the channel file at path, replacing any file there (clients
+   * of a previous server keep their mapping of the old one).
+   * Throws on failure.
+   *
+   * @param ringCapacity  bytes in each ring, rounded up to a power of two.
+   */
+  static std::shared_ptr<ShmChannel> create(const std::string& path,
+                                            size_t ringCapacity);
+
+  /**
+   * Maps the channel at path and attaches to it as the client.
+   * Throws if it's not a channel, or another client is attached.
+   */
+  static std::shared_ptr<ShmChannel> attach(const std::string& path);
+
+  ~ShmChannel();
+
+  ShmChannel(const ShmChannel&) = delete;
+  ShmChannel& operator=(const ShmChannel&) = delete;
+
+  ShmRing& requests() {
+    return *requests_;
+  }
+
+  ShmRing& replies() {
+    return *replies_;
+  }
+
+  State state() const;
+
+  /**
+   * Client: marks the channel CLIENT_GONE and wakes the server.
+   * Does nothing if already done.
+   */
+  void detachClient();
+
+  /**
+   * Server: marks the channel SERVER_GONE (if it isn't CLIENT_GONE) and
+   * wakes the client.
+   */
+  void closeServer();
+
+  /**
+   * Server: drops whatever is left in the rings and lets a new client
+   * attach. Only safe once the previous client is gone.
+   */
+  void release();
+
+  /**
+   * Server: true iff the process that attached last is still running.
+   */
+  bool clientAlive() const;
+
+ private:
+  struct Header;
+
+  void* mapping_{nullptr};
+  size_t mappingSize_{0};
+  Header* header_{nullptr};
+  std::unique_ptr<ShmRing> requests_;
+  std::unique_ptr<ShmRing> replies_;
+  bool isClient_{false};
+
+  ShmChannel(void* mapping, size_t mappingSize, bool isClient);
+};
+
+}}  // facebook::memcache
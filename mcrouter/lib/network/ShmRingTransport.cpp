@@ -0,0 +1,406 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "ShmRingTransport.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include <glog/logging.h>
+
+#include <folly/io/async/AsyncSocketException.h>
+
+#include "mcrouter/lib/network/ShmRing.h"
+
+namespace facebook { namespace memcache {
+
+constexpr size_t ShmRingTransport::kIdlePolls;
+constexpr std::chrono::milliseconds ShmRingTransport::kIdleWait;
+
+ShmRingTransport::ShmRingTransport(folly::EventBase& eventBase,
+                                   std::shared_ptr<ShmChannel> channel,
+                                   Side side)
+    : eventBase_(eventBase),
+      channel_(std::move(channel)),
+      side_(side),
+      inbound_(side == Side::SERVER ? channel_->requests()
+                                    : channel_->replies()),
+      outbound_(side == Side::SERVER ? channel_->replies()
+                                     : channel_->requests()),
+      alive_(std::make_shared<bool>(true)) {
+  std::weak_ptr<bool> alive = alive_;
+  waiter_ = std::thread([this, alive] () {
+    std::unique_lock<std::mutex> lock(waiterLock_);
+    while (true) {
+      waiterCv_.wait(lock, [this] () { return idle_ || stopping_; });
+      if (stopping_) {
+        return;
+      }
+      lock.unlock();
+      inbound_.wait(kIdleWait);
+      lock.lock();
+      if (stopping_) {
+        return;
+      }
+      idle_ = false;
+      eventBase_.runInEventBaseThread([this, alive] () {
+        if (alive.lock()) {
+          schedulePoll();
+        }
+      });
+    }
+  });
+  schedulePoll();
+}
+
+ShmRingTransport::~ShmRingTransport() {
+  {
+    std::lock_guard<std::mutex> lock(waiterLock_);
+    stopping_ = true;
+  }
+  waiterCv_.notify_one();
+  /* Cuts the wait short unless the waiter is just about to sleep,
+     then it takes up to kIdleWait */
+  inbound_.wake();
+  waiter_.join();
+
+  if (pollScheduled_) {
+    cancelLoopCallback();
+  }
+  if (!closed_) {
+    closed_ = true;
+    if (side_ == Side::CLIENT) {
+      channel_->detachClient();
+    } else {
+      channel_->closeServer();
+    }
+  }
+
+  if (onDestroyed_) {
+    onDestroyed_();
+  }
+}
+
+void ShmRingTransport::schedulePoll() {
+  idlePolls_ = 0;
+  if (!pollScheduled_ && !closed_ && !eof_) {
+    pollScheduled_ = true;
+    eventBase_.runInLoop(this);
+  }
+}
+
+void ShmRingTransport::runLoopCallback() noexcept {
+  pollScheduled_ = false;
+  if (closed_ || eof_) {
+    return;
+  }
+  DestructorGuard dg(this);
+
+  bool busy = flushWrites();
+  if (side_ == Side::SERVER && !peerAttached_) {
+    checkPeer(false);
+  }
+  if (side_ == Side::CLIENT || peerAttached_) {
+    busy = readInbound() || busy;
+  }
+  if (closed_) {
+    return;
+  }
+  if (inbound_.broken() || outbound_.broken()) {
+    /* The other side corrupted the channel, talking to it is pointless */
+    LOG(ERROR) << "Shm ring of the channel is broken, closing it";
+    closeNow();
+    return;
+  }
+
+  if (busy) {
+    idlePolls_ = 0;
+  } else if (checkPeer(false)) {
+    reportEOF();
+    return;
+  } else {
+    ++idlePolls_;
+  }
+
+  if (idlePolls_ < kIdlePolls || !pendingWrites_.empty()) {
+    pollScheduled_ = true;
+    eventBase_.runInLoop(this);
+  } else {
+    goIdle();
+  }
+}
+
+void ShmRingTransport::goIdle() {
+  /* The other side may have died without telling us */
+  if (checkPeer(true)) {
+    reportEOF();
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(waiterLock_);
+    idle_ = true;
+  }
+  waiterCv_.notify_one();
+}
+
+bool ShmRingTransport::checkPeer(bool checkAlive) {
+  auto state = channel_->state();
+  if (side_ == Side::CLIENT) {
+    return state == ShmChannel::State::SERVER_GONE && inbound_.empty();
+  }
+
+  if (!peerAttached_) {
+    if (state == ShmChannel::State::ATTACHED) {
+      peerAttached_ = true;
+    } else if (state == ShmChannel::State::CLIENT_GONE ||
+               (state == ShmChannel::State::SERVER_GONE &&
+                !channel_->clientAlive())) {
+      /* Left behind by the previous session */
+      channel_->release();
+    }
+    return false;
+  }
+
+  bool gone = state != ShmChannel::State::ATTACHED ||
+              (checkAlive && !channel_->clientAlive());
+  return gone && inbound_.empty();
+}
+
+bool ShmRingTransport::readInbound() {
+  bool moved = false;
+  while (readCallback_ != nullptr && !inbound_.empty()) {
+    void* buf = nullptr;
+    size_t size = 0;
+    readCallback_->getReadBuffer(&buf, &size);
+    auto n = inbound_.read(buf, size);
+    if (n == 0) {
+      break;
+    }
+    bytesReceived_ += n;
+    moved = true;
+    readCallback_->readDataAvailable(n);
+  }
+  return moved;
+}
+
+bool ShmRingTransport::flushWrites() {
+  bool moved = false;
+  while (!pendingWrites_.empty()) {
+    auto& pending = pendingWrites_.front();
+    auto n = outbound_.write(pending.data->data(), pending.data->length());
+    if (n > 0) {
+      moved = true;
+      bytesWritten_ += n;
+      pending.data->trimStart(n);
+    }
+    if (!pending.data->empty()) {
+      break;
+    }
+    auto callback = pending.callback;
+    pendingWrites_.pop_front();
+    if (callback) {
+      callback->writeSuccess();
+    }
+  }
+  return moved;
+}
+
+void ShmRingTransport::reportEOF() {
+  eof_ = true;
+  if (auto callback = readCallback_) {
+    readCallback_ = nullptr;
+    callback->readEOF();
+  }
+}
+
+void ShmRingTransport::failWrites() {
+  while (!pendingWrites_.empty()) {
+    auto callback = pendingWrites_.front().callback;
+    pendingWrites_.pop_front();
+    if (callback) {
+      callback->writeErr(0, folly::AsyncSocketException(
+                              folly::AsyncSocketException::NOT_OPEN,
+                              "Shm transport closed"));
+    }
+  }
+}
+
+void ShmRingTransport::setReadCB(ReadCallback* callback) {
+  readCallback_ = callback;
+  if (readCallback_ != nullptr) {
+    schedulePoll();
+  }
+}
+
+ShmRingTransport::ReadCallback* ShmRingTransport::getReadCallback() const {
+  return readCallback_;
+}
+
+void ShmRingTransport::write(WriteCallback* callback, const void* buf,
+                             size_t bytes, WriteFlags flags) {
+  iovec vec;
+  vec.iov_base = const_cast<void*>(buf);
+  vec.iov_len = bytes;
+  writev(callback, &vec, 1, flags);
+}
+
+void ShmRingTransport::writev(WriteCallback* callback, const iovec* vec,
+                              size_t count, WriteFlags flags) {
+  if (closed_) {
+    if (callback) {
+      callback->writeErr(0, folly::AsyncSocketException(
+                              folly::AsyncSocketException::NOT_OPEN,
+                              "Shm transport closed"));
+    }
+    return;
+  }
+
+  /* The other side is likely to answer soon, poll for it */
+  schedulePoll();
+
+  size_t i = 0;
+  size_t offset = 0;
+  if (pendingWrites_.empty()) {
+    for (; i < count; ++i) {
+      auto n = outbound_.write(vec[i].iov_base, vec[i].iov_len);
+      bytesWritten_ += n;
+      if (n < vec[i].iov_len) {
+        offset = n;
+        break;
+      }
+    }
+    if (i == count) {
+      if (callback) {
+        callback->writeSuccess();
+      }
+      return;
+    }
+  }
+
+  /* Out of room: copy the rest, it's written as the other side reads */
+  size_t left = 0;
+  for (size_t j = i; j < count; ++j) {
+    left += vec[j].iov_len;
+  }
+  left -= offset;
+  auto data = folly::IOBuf::create(left);
+  for (size_t j = i; j < count; ++j) {
+    auto skip = j == i ? offset : 0;
+    std::memcpy(data->writableTail(),
+                static_cast<const uint8_t*>(vec[j].iov_base) + skip,
+                vec[j].iov_len - skip);
+    data->append(vec[j].iov_len - skip);
+  }
+  pendingWrites_.push_back(PendingWrite{std::move(data), callback});
+}
+
+void ShmRingTransport::writeChain(WriteCallback* callback,
+                                  std::unique_ptr<folly::IOBuf>&& buf,
+                                  WriteFlags flags) {
+  auto vec = buf->getIov();
+  writev(callback, vec.data(), vec.size(), flags);
+}
+
+void ShmRingTransport::close() {
+  closeNow();
+}
+
+void ShmRingTransport::closeNow() {
+  if (closed_) {
+    return;
+  }
+  DestructorGuard dg(this);
+  closed_ = true;
+  if (side_ == Side::CLIENT) {
+    channel_->detachClient();
+  } else {
+    channel_->closeServer();
+  }
+  failWrites();
+  if (auto callback = readCallback_) {
+    readCallback_ = nullptr;
+    callback->readEOF();
+  }
+}
+
+void ShmRingTransport::shutdownWrite() {
+}
+
+void ShmRingTransport::shutdownWriteNow() {
+}
+
+bool ShmRingTransport::good() const {
+  return !closed_ && !eof_;
+}
+
+bool ShmRingTransport::readable() const {
+  return !eof_ && !inbound_.empty();
+}
+
+bool ShmRingTransport::connecting() const {
+  return false;
+}
+
+bool ShmRingTransport::error() const {
+  return false;
+}
+
+void ShmRingTransport::attachEventBase(folly::EventBase*) {
+  throw std::logic_error("Unsupported function call.");
+}
+
+void ShmRingTransport::detachEventBase() {
+  throw std::logic_error("Unsupported function call.");
+}
+
+bool ShmRingTransport::isDetachable() const {
+  return false;
+}
+
+folly::EventBase* ShmRingTransport::getEventBase() const {
+  return &eventBase_;
+}
+
+void ShmRingTransport::setSendTimeout(uint32_t) {
+}
+
+uint32_t ShmRingTransport::getSendTimeout() const {
+  return 0;
+}
+
+void ShmRingTransport::getLocalAddress(folly::SocketAddress*) const {
+}
+
+void ShmRingTransport::getPeerAddress(folly::SocketAddress*) const {
+}
+
+bool ShmRingTransport::isEorTrackingEnabled() const {
+  return false;
+}
+
+void ShmRingTransport::setEorTracking(bool) {
+}
+
+size_t ShmRingTransport::getAppBytesWritten() const {
+  return bytesWritten_;
+}
+
+size_t ShmRingTransport::getRawBytesWritten() const {
+  return bytesWritten_;
+}
+
+size_t ShmRingTransport::getAppBytesReceived() const {
+  return bytesReceived_;
+}
+
+size_t ShmRingTransport::getRawBytesReceived() const {
+  return bytesReceived_;
+}
+
+}}  // facebook::memcache
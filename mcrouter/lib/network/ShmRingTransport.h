@@ -0,0 +1,170 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <folly/io/async/AsyncTransport.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/io/IOBuf.h>
+
+namespace facebook { namespace memcache {
+
+class ShmChannel;
+class ShmRing;
+
+/**
+ * Transport over one side of a ShmChannel, for McServerSession on the
+ * server side and AsyncMcClient on the client side. Meant for the umbrella
+ * protocol, which needs no parsing beyond its compact binary headers.
+ *
+ * While there's traffic, the inbound ring is polled on every event base
+ * loop iteration with no syscalls at all. After kIdlePolls polls in a row
+ * find nothing to do, the transport goes idle: a waiter thread sleeps on
+ * the ring's futex, and resumes polling in the event base once the other
+ * side writes (or kIdleWait passes, at which point liveness of the other
+ * side is checked).
+ */
+class ShmRingTransport : public folly::AsyncTransportWrapper,
+                         private folly::EventBase::LoopCallback {
+ public:
+  using WriteFlags = folly::WriteFlags;
+
+  typedef std::unique_ptr<ShmRingTransport,
+                          folly::DelayedDestruction::Destructor> UniquePtr;
+
+  enum class Side {
+    CLIENT,
+    SERVER,
+  };
+
+  static constexpr size_t kIdlePolls = 1000;
+  static constexpr std::chrono::milliseconds kIdleWait{100};
+
+  /**
+   * A client transport requires a channel returned by ShmChannel::attach().
+   * A server transport waits for a client to attach, and reports EOF once
+   * it is gone.
+   */
+  ShmRingTransport(folly::EventBase& eventBase,
+                   std::shared_ptr<ShmChannel> channel,
+                   Side side);
+
+  /**
+   * Called from the destructor, e.g. to serve the channel again once
+   * the session using this transport is gone.
+   */
+  void setOnDestroyed(std::function<void()> cb) {
+    onDestroyed_ = std::move(cb);
+  }
+
+  // folly::AsyncTransportWrapper overrides
+
+  void setReadCB(ReadCallback* callback) override;
+  ReadCallback* getReadCallback() const override;
+
+  void write(WriteCallback* callback, const void* buf, size_t bytes,
+             WriteFlags flags = WriteFlags::NONE) override;
+  void writev(WriteCallback* callback, const iovec* vec, size_t count,
+              WriteFlags flags = WriteFlags::NONE) override;
+  void writeChain(WriteCallback* callback, std::unique_ptr<folly::IOBuf>&& buf,
+                  WriteFlags flags = WriteFlags::NONE) override;
+
+  // folly::AsyncTransport overrides
+
+  void close() override;
+  void closeNow() override;
+  void shutdownWrite() override;
+  void shutdownWriteNow() override;
+  bool good() const override;
+  bool readable() const override;
+  bool connecting() const override;
+  bool error() const override;
+  void attachEventBase(folly::EventBase*) override;
+  void detachEventBase() override;
+  bool isDetachable() const override;
+  folly::EventBase* getEventBase() const override;
+  void setSendTimeout(uint32_t) override;
+  uint32_t getSendTimeout() const override;
+  void getLocalAddress(folly::SocketAddress*) const override;
+  void getPeerAddress(folly::SocketAddress*) const override;
+  bool isEorTrackingEnabled() const override;
+  void setEorTracking(bool) override;
+  size_t getAppBytesWritten() const override;
+  size_t getRawBytesWritten() const override;
+  size_t getAppBytesReceived() const override;
+  size_t getRawBytesReceived() const override;
+
+ protected:
+  ~ShmRingTransport();
+
+ private:
+  struct PendingWrite {
+    std::unique_ptr<folly::IOBuf> data;
+    WriteCallback* callback;
+  };
+
+  folly::EventBase& eventBase_;
+  std::shared_ptr<ShmChannel> channel_;
+  const Side side_;
+  ShmRing& inbound_;
+  ShmRing& outbound_;
+
+  ReadCallback* readCallback_{nullptr};
+  std::deque<PendingWrite> pendingWrites_;
+  std::function<void()> onDestroyed_;
+
+  /* Server side: a client is attached to the channel */
+  bool peerAttached_{false};
+  bool closed_{false};
+  bool eof_{false};
+  bool pollScheduled_{false};
+  size_t idlePolls_{0};
+
+  size_t bytesWritten_{0};
+  size_t bytesReceived_{0};
+
+  /* Wakeups posted to the event base check this is still alive */
+  std::shared_ptr<bool> alive_;
+
+  std::thread waiter_;
+  std::mutex waiterLock_;
+  std::condition_variable waiterCv_;
+  /* Protected by waiterLock_ */
+  bool idle_{false};
+  bool stopping_{false};
+
+  void runLoopCallback() noexcept override;
+  void schedulePoll();
+  void goIdle();
+
+  /**
+   * @return  true iff any data was moved.
+   */
+  bool flushWrites();
+  bool readInbound();
+
+  /**
+   * Server side: tracks clients attaching and leaving.
+   * @return  true iff the client is gone and EOF should be reported.
+   */
+  bool checkPeer(bool checkAlive);
+
+  void failWrites();
+  void reportEOF();
+};
+
+}}  // facebook::memcache
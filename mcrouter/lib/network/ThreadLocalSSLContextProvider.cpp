@@ -9,9 +9,12 @@
  */
 #include "ThreadLocalSSLContextProvider.h"
 
-#include <folly/io/async/SSLContext.h>
 #include <unordered_map>
 
+#include <openssl/rand.h>
+
+#include <folly/io/async/SSLContext.h>
+
 using folly::SSLContext;
 
 namespace facebook { namespace memcache {
@@ -37,6 +40,43 @@ struct ContextInfo {
   std::chrono::time_point<std::chrono::steady_clock> lastLoadTime;
 };
 
+namespace {
+
+struct SSLSessionDeleter {
+  void operator()(SSL_SESSION* session) const {
+    SSL_SESSION_free(session);
+  }
+};
+
+using SSLSessionPtr = std::unique_ptr<SSL_SESSION, SSLSessionDeleter>;
+
+/* Bounds memory used by sessions of destinations we no longer talk to */
+constexpr size_t kMaxCachedSessions = 10000;
+
+std::unordered_map<std::string, SSLSessionPtr>& localSessions() {
+  thread_local std::unordered_map<std::string, SSLSessionPtr> sessions;
+  return sessions;
+}
+
+void setSharedTicketKeys(SSLContext& context) {
+#ifdef SSL_CTRL_SET_TLSEXT_TICKET_KEYS
+  /* name, HMAC secret and AES key, generated once per process */
+  static struct TicketKeys {
+    unsigned char keys[48];
+    bool valid;
+    TicketKeys() {
+      valid = RAND_bytes(keys, sizeof(keys)) == 1;
+    }
+  } ticketKeys;
+  if (ticketKeys.valid) {
+    SSL_CTX_set_tlsext_ticket_keys(context.getSSLCtx(), ticketKeys.keys,
+                                   sizeof(ticketKeys.keys));
+  }
+#endif
+}
+
+}  // anonymous namespace
+
 struct CertPathsHasher {
   size_t operator()(const CertPaths& paths) const {
     return folly::hash::hash_combine_generic<folly::hash::StdHasher>(
@@ -86,6 +126,9 @@ std::shared_ptr<SSLContext> getSSLContext(folly::StringPiece pemCertPath,
 #ifdef SSL_OP_NO_COMPRESSION
       sslContext->setOptions(SSL_OP_NO_COMPRESSION);
 #endif
+      // Servers accept resumption of sessions created by any thread's context.
+      sslContext->setSessionCacheContext("mcrouter");
+      setSharedTicketKeys(*sslContext);
       contextInfo.lastLoadTime = now;
       contextInfo.context = std::move(sslContext);
     } catch (const std::exception& ex) {
@@ -95,4 +138,23 @@ std::shared_ptr<SSLContext> getSSLContext(folly::StringPiece pemCertPath,
   return contextInfo.context;
 }
 
+SSL_SESSION* getCachedSSLSession(folly::StringPiece destination) {
+  auto& sessions = localSessions();
+  auto it = sessions.find(destination.str());
+  return it == sessions.end() ? nullptr : it->second.get();
+}
+
+void cacheSSLSession(folly::StringPiece destination, SSL_SESSION* session) {
+  SSLSessionPtr sessionPtr(session);
+  auto& sessions = localSessions();
+  if (!sessionPtr) {
+    sessions.erase(destination.str());
+    return;
+  }
+  if (sessions.size() >= kMaxCachedSessions) {
+    sessions.clear();
+  }
+  sessions[destination.str()] = std::move(sessionPtr);
+}
+
 }}  // facebook::memcache
@@ -9,6 +9,10 @@
  */
 #pragma once
 
+#include <memory>
+
+#include <openssl/ssl.h>
+
 #include <folly/Range.h>
 
 namespace folly {
@@ -21,10 +25,28 @@ namespace facebook { namespace memcache {
  * Manages sets of certificates on per thread basis.
  * Each set will be loaded only once per thread and will be reloaded if it's
  * older than 5 minutes.
+ * All contexts share the session ticket keys, so sessions established
+ * with one thread (or before a reload) can be resumed with another.
  */
 std::shared_ptr<folly::SSLContext> getSSLContext(
   folly::StringPiece pemCertPath,
   folly::StringPiece pemKeyPath,
   folly::StringPiece pemCaPath);
 
+/**
+ * Per thread cache of client TLS sessions, by destination, so that
+ * reconnects resume the session instead of doing a full handshake.
+ *
+ * @return  cached session or nullptr. The cache keeps its reference,
+ *          the session is valid until the next cacheSSLSession() call
+ *          on this thread.
+ */
+SSL_SESSION* getCachedSSLSession(folly::StringPiece destination);
+
+/**
+ * Takes over the reference to session, replacing the cached one.
+ * nullptr drops the cached session.
+ */
+void cacheSSLSession(folly::StringPiece destination, SSL_SESSION* session);
+
 }}  // facebook::memcache
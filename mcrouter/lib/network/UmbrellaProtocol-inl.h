@@ -7,6 +7,7 @@
  *  of patent rights can be found in the PATENTS file in the same directory.
  *
  */
+#include "mcrouter/lib/McOperationTraits.h"
 #include "mcrouter/lib/McRequest.h"
 
 namespace facebook { namespace memcache {
@@ -42,11 +43,19 @@ bool UmbrellaSerializedMessage::prepare(const McRequest& request,
                  key.size());
   }
 
-  auto valueRange = request.valueRangeSlow();
-  if (valueRange.begin() != nullptr) {
-    appendString(msg_value,
-                 reinterpret_cast<const uint8_t*>(valueRange.begin()),
-                 valueRange.size());
+  /* Get-like requests never carry a value */
+  if (!GetLike<McOperation<Op>>::value) {
+    const auto& value = request.value();
+    if (value.isChained()) {
+      if (!appendIOBuf(msg_value, value)) {
+        auto valueRange = request.valueRangeSlow();
+        appendString(msg_value,
+                     reinterpret_cast<const uint8_t*>(valueRange.begin()),
+                     valueRange.size());
+      }
+    } else if (value.data() != nullptr) {
+      appendString(msg_value, value.data(), value.length());
+    }
   }
 
 #ifndef LIBMC_FBTRACE_DISABLE
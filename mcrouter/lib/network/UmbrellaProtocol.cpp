@@ -9,6 +9,9 @@
  */
 #include "UmbrellaProtocol.h"
 
+#include <cstring>
+#include <limits>
+
 #include <folly/Bits.h>
 
 #include "mcrouter/lib/McReply.h"
@@ -59,6 +62,18 @@ UmbrellaParseStatus umbrellaParseHeader(const uint8_t* buf, size_t nbuf,
       return UmbrellaParseStatus::MESSAGE_PARSE_ERROR;
     }
     infoOut.bodySize = messageSize - infoOut.headerSize;
+  } else if (infoOut.version == UmbrellaVersion::BATCH) {
+    /* Batch layout:
+         }2NNSSSS, <message>*N
+       Where N is the number of messages and S is frame size, both big
+       endian */
+    size_t messageSize = folly::Endian::big<uint32_t>(header->total_size);
+    infoOut.numMessages = folly::Endian::big<uint16_t>(header->nentries);
+    infoOut.headerSize = sizeof(entry_list_msg_t);
+    if (infoOut.headerSize > messageSize) {
+      return UmbrellaParseStatus::MESSAGE_PARSE_ERROR;
+    }
+    infoOut.bodySize = messageSize - infoOut.headerSize;
   } else {
     return UmbrellaParseStatus::MESSAGE_PARSE_ERROR;
   }
@@ -66,6 +81,85 @@ UmbrellaParseStatus umbrellaParseHeader(const uint8_t* buf, size_t nbuf,
   return UmbrellaParseStatus::OK;
 }
 
+bool umbrellaPrepareBatchHeader(entry_list_msg_t& header,
+                                size_t numMessages,
+                                size_t messagesSize) {
+  size_t frameSize = sizeof(entry_list_msg_t) + messagesSize;
+  if (numMessages > kUmbrellaMaxBatchMessages ||
+      frameSize > std::numeric_limits<uint32_t>::max()) {
+    return false;
+  }
+  header.msg_header.magic_byte = ENTRY_LIST_MAGIC_BYTE;
+  header.msg_header.version = static_cast<uint8_t>(UmbrellaVersion::BATCH);
+  header.nentries = folly::Endian::big((uint16_t)numMessages);
+  header.total_size = folly::Endian::big((uint32_t)frameSize);
+  return true;
+}
+
+namespace {
+
+/* Request fields umbrellaParseRequest() knows about */
+enum class RequestField : uint8_t {
+  UNKNOWN,
+  OP,
+  REQID,
+  FLAGS,
+  EXPTIME,
+  NUMBER,
+  DELTA,
+  LEASE_ID,
+  CAS,
+  FBTRACE,
+  KEY,
+  VALUE,
+};
+
+constexpr RequestField requestFieldForTag(uint32_t tag) {
+  return
+    tag == msg_op ? RequestField::OP :
+    tag == msg_reqid ? RequestField::REQID :
+    tag == msg_flags ? RequestField::FLAGS :
+    tag == msg_exptime ? RequestField::EXPTIME :
+    tag == msg_number ? RequestField::NUMBER :
+    tag == msg_delta ? RequestField::DELTA :
+    tag == msg_lease_id ? RequestField::LEASE_ID :
+    tag == msg_cas ? RequestField::CAS :
+#ifndef LIBMC_FBTRACE_DISABLE
+    tag == msg_fbtrace ? RequestField::FBTRACE :
+#endif
+    tag == msg_key ? RequestField::KEY :
+    tag == msg_value ? RequestField::VALUE :
+    RequestField::UNKNOWN;
+}
+
+/* Tags are single bits, so they're looked up by bit position
+   instead of comparing against every tag */
+constexpr size_t kNumTagBits = 16;
+constexpr RequestField kRequestFields[kNumTagBits] = {
+  requestFieldForTag(1 << 0), requestFieldForTag(1 << 1),
+  requestFieldForTag(1 << 2), requestFieldForTag(1 << 3),
+  requestFieldForTag(1 << 4), requestFieldForTag(1 << 5),
+  requestFieldForTag(1 << 6), requestFieldForTag(1 << 7),
+  requestFieldForTag(1 << 8), requestFieldForTag(1 << 9),
+  requestFieldForTag(1 << 10), requestFieldForTag(1 << 11),
+  requestFieldForTag(1 << 12), requestFieldForTag(1 << 13),
+  requestFieldForTag(1 << 14), requestFieldForTag(1 << 15),
+};
+
+static_assert(kRequestFields[0] == RequestField::OP &&
+              kRequestFields[13] == RequestField::KEY &&
+              kRequestFields[14] == RequestField::VALUE,
+              "Unexpected umbrella tag values");
+
+inline RequestField requestField(uint16_t tag) {
+  if (tag == 0 || (tag & (tag - 1)) != 0) {
+    return RequestField::UNKNOWN;
+  }
+  return kRequestFields[folly::findFirstSet(tag) - 1];
+}
+
+}  // anonymous namespace
+
 McRequest umbrellaParseRequest(const folly::IOBuf& source,
                                const uint8_t* header, size_t nheader,
                                const uint8_t* body, size_t nbody,
@@ -82,44 +176,48 @@ McRequest umbrellaParseRequest(const folly::IOBuf& source,
   }
   for (size_t i = 0; i < nentries; ++i) {
     auto& entry = msg->entries[i];
-    size_t tag = folly::Endian::big((uint16_t)entry.tag);
-    size_t val = folly::Endian::big((uint64_t)entry.data.val);
-    switch (tag) {
-      case msg_op:
+    auto tag = folly::Endian::big((uint16_t)entry.tag);
+    uint64_t val = folly::Endian::big((uint64_t)entry.data.val);
+    switch (requestField(tag)) {
+      case RequestField::OP:
         if (val >= UM_NOPS) {
           throw std::runtime_error("op out of range");
         }
         opOut = static_cast<mc_op_t>(umbrella_op_to_mc[val]);
         break;
 
-      case msg_reqid:
+      case RequestField::REQID:
         if (val == 0) {
           throw std::runtime_error("invalid reqid");
         }
         reqidOut = val;
         break;
 
-      case msg_flags:
+      case RequestField::FLAGS:
         req.setFlags(val);
         break;
 
-      case msg_exptime:
+      case RequestField::EXPTIME:
         req.setExptime(val);
         break;
 
-      case msg_delta:
+      case RequestField::NUMBER:
+        req.setNumber(val);
+        break;
+
+      case RequestField::DELTA:
         req.setDelta(val);
         break;
 
-      case msg_cas:
+      case RequestField::CAS:
         req.setCas(val);
         break;
 
-      case msg_lease_id:
+      case RequestField::LEASE_ID:
         req.setLeaseToken(val);
         break;
 
-      case msg_key:
+      case RequestField::KEY:
         if (!req.setKeyFrom(
               source, body +
               folly::Endian::big((uint32_t)entry.data.str.offset),
@@ -128,7 +226,7 @@ McRequest umbrellaParseRequest(const folly::IOBuf& source,
         }
         break;
 
-      case msg_value:
+      case RequestField::VALUE:
         if (!req.setValueFrom(
               source, body +
               folly::Endian::big((uint32_t)entry.data.str.offset),
@@ -137,8 +235,8 @@ McRequest umbrellaParseRequest(const folly::IOBuf& source,
         }
         break;
 
+      case RequestField::FBTRACE:
 #ifndef LIBMC_FBTRACE_DISABLE
-      case msg_fbtrace:
       {
         auto off = folly::Endian::big((uint32_t)entry.data.str.offset);
         auto len = folly::Endian::big((uint32_t)entry.data.str.len) - 1;
@@ -152,11 +250,11 @@ McRequest umbrellaParseRequest(const folly::IOBuf& source,
         auto fbtraceInfo = new_mc_fbtrace_info(0);
         memcpy(fbtraceInfo->metadata, body + off, len);
         req.setFbtraceInfo(fbtraceInfo);
-        break;
       }
 #endif
+        break;
 
-      default:
+      case RequestField::UNKNOWN:
         /* Ignore unknown tags silently */
         break;
     }
@@ -173,19 +271,51 @@ McRequest umbrellaParseRequest(const folly::IOBuf& source,
   return req;
 }
 
+McReply umbrellaReplyFromMsg(mc_msg_t& msg) {
+  msg.key.str = nullptr;
+  msg.key.len = 0;
+  msg.value.str = nullptr;
+  msg.value.len = 0;
+
+  bool flat = msg.exptime == 0 && msg.number == 0 &&
+    msg.lowval == 0 && msg.highval == 0 && msg.ipv == 0 &&
+    msg.stats == nullptr;
+#ifndef LIBMC_FBTRACE_DISABLE
+  flat = flat && msg.fbtrace_info == nullptr;
+#endif
+
+  if (!flat) {
+    auto copy = createMcMsgRef();
+    mc_msg_shallow_copy(copy.get(), &msg);
+#ifndef LIBMC_FBTRACE_DISABLE
+    /* shallow copy made its own copy */
+    if (msg.fbtrace_info) {
+      mc_fbtrace_info_decref(msg.fbtrace_info);
+      msg.fbtrace_info = nullptr;
+    }
+#endif
+    return McReply(msg.result, McMsgRef(std::move(copy)));
+  }
+
+  McReply reply(msg.result);
+  reply.setFlags(msg.flags);
+  reply.setLeaseToken(msg.lease_id);
+  reply.setDelta(msg.delta);
+  reply.setCas(msg.cas);
+  reply.setAppSpecificErrorCode(msg.err_code);
+  return reply;
+}
+
 UmbrellaSerializedMessage::UmbrellaSerializedMessage() {
   /* These will not change from message to message */
-  msg_.msg_header.magic_byte = ENTRY_LIST_MAGIC_BYTE;
-  msg_.msg_header.version = UMBRELLA_VERSION_BASIC;
+  header().msg_header.magic_byte = ENTRY_LIST_MAGIC_BYTE;
+  header().msg_header.version = UMBRELLA_VERSION_BASIC;
 
-  iovs_[0].iov_base = &msg_;
-  iovs_[0].iov_len = sizeof(msg_);
-
-  iovs_[1].iov_base = entries_;
+  iovs_[0].iov_base = scratch_;
 }
 
 void UmbrellaSerializedMessage::clear() {
-  nEntries_ = nStrings_ = offset_ = 0;
+  nEntries_ = nStrings_ = nCopiedStrings_ = copiedBytes_ = offset_ = 0;
   error_ = false;
 }
 
@@ -223,9 +353,7 @@ bool UmbrellaSerializedMessage::prepare(const McReply& reply, mc_op_t op,
     appendDouble(reply.highValue());
   }
 
-  /* TODO: if we intend to pass chained IOBufs as values,
-     we can optimize this to write multiple iovs directly */
-  if (reply.hasValue()) {
+  if (reply.hasValue() && !appendIOBuf(msg_value, reply.value())) {
     auto valueRange = reply.valueRangeSlow();
     appendString(msg_value,
                  reinterpret_cast<const uint8_t*>(valueRange.begin()),
@@ -250,7 +378,7 @@ void UmbrellaSerializedMessage::appendInt(
     return;
   }
 
-  um_elist_entry_t& entry = entries_[nEntries_++];
+  um_elist_entry_t& entry = nextEntry();
   entry.type = folly::Endian::big((uint16_t)type);
   entry.tag = folly::Endian::big((uint16_t)tag);
   entry.data.val = folly::Endian::big((uint64_t)val);
@@ -262,7 +390,7 @@ void UmbrellaSerializedMessage::appendDouble(double val) {
     return;
   }
 
-  um_elist_entry_t& entry = entries_[nEntries_++];
+  um_elist_entry_t& entry = nextEntry();
   entry.type = folly::Endian::big((uint16_t)DOUBLE);
   entry.tag = folly::Endian::big((uint16_t)msg_double);
   uint64_t doubleBits;
@@ -274,14 +402,21 @@ void UmbrellaSerializedMessage::appendDouble(double val) {
 void UmbrellaSerializedMessage::appendString(
   int32_t tag, const uint8_t* data, size_t len, entry_type_t type) {
 
-  if (nStrings_ >= kInlineStrings) {
+  if (nEntries_ >= kInlineEntries || nStrings_ >= kInlineStrings) {
     error_ = true;
     return;
   }
 
+  /* Copied strings must come first in the body */
+  if (nCopiedStrings_ == nStrings_ &&
+      copiedBytes_ + len + 1 <= kMaxCopiedBytes) {
+    ++nCopiedStrings_;
+    copiedBytes_ += len + 1;
+  }
+  stringEnds_[nStrings_] = true;
   strings_[nStrings_++] = folly::StringPiece((const char*)data, len);
 
-  um_elist_entry_t& entry = entries_[nEntries_++];
+  um_elist_entry_t& entry = nextEntry();
   entry.type = folly::Endian::big((uint16_t)type);
   entry.tag = folly::Endian::big((uint16_t)tag);
   entry.data.str.offset = folly::Endian::big((uint32_t)offset_);
@@ -289,6 +424,46 @@ void UmbrellaSerializedMessage::appendString(
   offset_ += len + 1;
 }
 
+bool UmbrellaSerializedMessage::appendIOBuf(int32_t tag,
+                                            const folly::IOBuf& buf) {
+  if (nEntries_ >= kInlineEntries) {
+    error_ = true;
+    return true;
+  }
+
+  size_t nPieces = 0;
+  for (auto piece : buf) {
+    if (!piece.empty()) {
+      ++nPieces;
+    }
+  }
+  if (nPieces == 0) {
+    appendString(tag, buf.data(), 0);
+    return true;
+  }
+  if (nStrings_ + nPieces > kInlineStrings) {
+    return false;
+  }
+
+  size_t len = 0;
+  for (auto piece : buf) {
+    if (!piece.empty()) {
+      stringEnds_[nStrings_] = false;
+      strings_[nStrings_++] = folly::StringPiece(piece);
+      len += piece.size();
+    }
+  }
+  stringEnds_[nStrings_ - 1] = true;
+
+  um_elist_entry_t& entry = nextEntry();
+  entry.type = folly::Endian::big((uint16_t)BSTRING);
+  entry.tag = folly::Endian::big((uint16_t)tag);
+  entry.data.str.offset = folly::Endian::big((uint32_t)offset_);
+  entry.data.str.len = folly::Endian::big((uint32_t)(len + 1));
+  offset_ += len + 1;
+  return true;
+}
+
 size_t UmbrellaSerializedMessage::finalizeMessage() {
   static char nul = '\0';
 
@@ -296,20 +471,31 @@ size_t UmbrellaSerializedMessage::finalizeMessage() {
     sizeof(um_elist_entry_t) * nEntries_ +
     offset_;
 
-  msg_.total_size = folly::Endian::big((uint32_t)size);
-  msg_.nentries = folly::Endian::big((uint16_t)nEntries_);
+  header().total_size = folly::Endian::big((uint32_t)size);
+  header().nentries = folly::Endian::big((uint16_t)nEntries_);
 
-  iovs_[1].iov_len = sizeof(um_elist_entry_t) * nEntries_;
-  size_t niovOut = 2;
+  auto pos = scratch_ + sizeof(entry_list_msg_t) +
+    sizeof(um_elist_entry_t) * nEntries_;
+  for (size_t i = 0; i < nCopiedStrings_; i++) {
+    if (!strings_[i].empty()) {
+      memcpy(pos, strings_[i].begin(), strings_[i].size());
+      pos += strings_[i].size();
+    }
+    *pos++ = '\0';
+  }
+  iovs_[0].iov_len = pos - scratch_;
+  size_t niovOut = 1;
 
-  for (size_t i = 0; i < nStrings_; i++) {
+  for (size_t i = nCopiedStrings_; i < nStrings_; i++) {
     iovs_[niovOut].iov_base = (char *)strings_[i].begin();
     iovs_[niovOut].iov_len = strings_[i].size();
     niovOut++;
 
-    iovs_[niovOut].iov_base = &nul;
-    iovs_[niovOut].iov_len = 1;
-    niovOut++;
+    if (stringEnds_[i]) {
+      iovs_[niovOut].iov_base = &nul;
+      iovs_[niovOut].iov_len = 1;
+      niovOut++;
+    }
   }
   return niovOut;
 }
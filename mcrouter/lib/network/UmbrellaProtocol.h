@@ -27,6 +27,9 @@ class McRequest;
 enum class UmbrellaVersion : uint8_t {
   BASIC = 0,
   TYPED_REQUEST = 1,
+  /* Frame carrying several BASIC or TYPED_REQUEST messages,
+     see umbrellaPrepareBatchHeader() */
+  BATCH = 2,
 };
 
 struct UmbrellaMessageInfo {
@@ -34,6 +37,8 @@ struct UmbrellaMessageInfo {
   size_t bodySize;
   UmbrellaVersion version;
   size_t typeId;
+  /* Number of messages in the body of a BATCH frame */
+  size_t numMessages;
 };
 
 enum class UmbrellaParseStatus {
@@ -45,6 +50,24 @@ enum class UmbrellaParseStatus {
 UmbrellaParseStatus umbrellaParseHeader(const uint8_t* buf, size_t nbuf,
                                         UmbrellaMessageInfo& infoOut);
 
+/**
+ * Max number of messages in one BATCH frame.
+ */
+constexpr size_t kUmbrellaMaxBatchMessages = 65535;
+
+/**
+ * Fills the header of a BATCH frame. The frame is the header followed by
+ * numMessages complete (non-batch) messages, back to back, so a pipelined
+ * write of N messages is parsed as a single frame.
+ *
+ * @param messagesSize  total size of the messages in bytes
+ * @return  false if the messages don't fit in one frame,
+ *          header is unchanged in that case.
+ */
+bool umbrellaPrepareBatchHeader(entry_list_msg_t& header,
+                                size_t numMessages,
+                                size_t messagesSize);
+
 /**
  * Parse an on-the-wire Umbrella request.
  *
@@ -64,6 +87,16 @@ McRequest umbrellaParseRequest(const folly::IOBuf& source,
                                const uint8_t* body, size_t nbody,
                                mc_op_t& opOut, uint64_t& reqidOut);
 
+/**
+ * Builds a reply from msg filled by um_consume_no_copy(), without its key
+ * and value. Fields McReply stores itself are copied into it, so a
+ * mc_msg_t is only allocated for replies that carry anything else
+ * (e.g. metaget or fbtrace fields).
+ *
+ * Takes over msg.fbtrace_info, msg can be discarded after this call.
+ */
+McReply umbrellaReplyFromMsg(mc_msg_t& msg);
+
 class UmbrellaSerializedMessage {
  public:
   UmbrellaSerializedMessage();
@@ -76,29 +109,64 @@ class UmbrellaSerializedMessage {
                struct iovec*& iovOut, size_t& niovOut);
 
  private:
-  static constexpr size_t kMaxIovs = 16;
-  struct iovec iovs_[kMaxIovs];
-
-  entry_list_msg_t msg_;
   static constexpr size_t kInlineEntries = 16;
   size_t nEntries_{0};
-  um_elist_entry_t entries_[kInlineEntries];
 
+  /* Strings are referenced, not copied, until finalizeMessage().
+     A string entry may be split into several pieces (chained IOBuf values).
+     Only the last piece of each entry is followed by '\0'. */
   static constexpr size_t kInlineStrings = 16;
   size_t nStrings_{0};
   folly::StringPiece strings_[kInlineStrings];
+  bool stringEnds_[kInlineStrings];
+
+  /* The first nCopiedStrings_ strings (e.g. keys and small values) are
+     copied right after the entries in scratch_, the rest are sent from
+     where they are. */
+  static constexpr size_t kMaxCopiedBytes = 512;
+  size_t nCopiedStrings_{0};
+  size_t copiedBytes_{0};
+
+  /**
+   * Message header, entries and copied strings, laid out as on the wire,
+   * so they are sent with a single iovec.
+   */
+  uint8_t scratch_[sizeof(entry_list_msg_t) +
+                   kInlineEntries * sizeof(um_elist_entry_t) +
+                   kMaxCopiedBytes];
+
+  /* scratch_, then a piece and a '\0' per string that wasn't copied. */
+  static constexpr size_t kMaxIovs = 1 + 2 * kInlineStrings;
+  struct iovec iovs_[kMaxIovs];
 
   size_t offset_{0};
 
   bool error_{false};
 
+  entry_list_msg_t& header() {
+    return *reinterpret_cast<entry_list_msg_t*>(scratch_);
+  }
+
+  um_elist_entry_t& nextEntry() {
+    return reinterpret_cast<entry_list_msg_t*>(scratch_)->entries[nEntries_++];
+  }
+
   void appendInt(entry_type_t type, int32_t tag, uint64_t val);
   void appendDouble(double val);
   void appendString(int32_t tag, const uint8_t* data, size_t len,
                     entry_type_t type = BSTRING);
 
   /**
-   * Put message header and all added entries/strings into iovecs.
+   * Append a string entry referencing every piece of buf without copying.
+   *
+   * @return false if buf has too many pieces to be referenced directly;
+   *         nothing is appended in that case.
+   */
+  bool appendIOBuf(int32_t tag, const folly::IOBuf& buf);
+
+  /**
+   * Fill in the message header, copy what fits of the strings next to the
+   * entries and put everything into iovecs.
    *
    * @return  number of iovecs that contain a complete message.
    */
@@ -9,7 +9,11 @@
  */
 #include "WriteBuffer.h"
 
+#include <cstring>
+#include <new>
+
 #include "mcrouter/lib/mc/protocol.h"
+#include "mcrouter/lib/network/HugePageArena.h"
 
 namespace facebook { namespace memcache {
 
@@ -29,6 +33,21 @@ WriteBuffer::WriteBuffer(mc_protocol_t protocol)
   }
 }
 
+void* WriteBuffer::operator new(size_t size) {
+  if (auto p = HugePageArena::allocate(size)) {
+    return p;
+  }
+  return ::operator new(size);
+}
+
+void WriteBuffer::operator delete(void* p) {
+  if (HugePageArena::owns(p)) {
+    HugePageArena::deallocate(p);
+  } else {
+    ::operator delete(p);
+  }
+}
+
 WriteBuffer::~WriteBuffer() {
   switch (protocol_) {
     case mc_ascii_protocol:
@@ -104,9 +123,23 @@ bool AsciiSerializedReply::prepare(const McReply& reply,
                                    mc_op_t operation,
                                    const folly::Optional<folly::IOBuf>& key,
                                    struct iovec*& iovOut, size_t& niovOut) {
+  /* Never dereferenced, only used to find the value iovec. */
+  static char valueMarker;
+
   mc_msg_t replyMsg;
   mc_msg_init_not_refcounted(&replyMsg);
-  reply.dependentMsg(operation, &replyMsg);
+  const auto& value = reply.value();
+  bool splice = value.isChained() &&
+    value.countChainElements() <= kMaxValuePieces;
+  if (splice) {
+    /* Let mc_ascii_response_write_iovs() format everything around
+       the value, and then put the value pieces in place of the marker. */
+    reply.dependentMsgWithoutValue(operation, &replyMsg);
+    replyMsg.value.str = &valueMarker;
+    replyMsg.value.len = value.computeChainDataLength();
+  } else {
+    reply.dependentMsg(operation, &replyMsg);
+  }
 
   nstring_t k;
   if (key.hasValue()) {
@@ -123,8 +156,41 @@ bool AsciiSerializedReply::prepare(const McReply& reply,
     &replyMsg,
     iovs_,
     kMaxIovs);
+  if (splice && niovOut != 0) {
+    spliceValue(value, &valueMarker, niovOut);
+  }
   iovOut = iovs_;
   return niovOut != 0;
 }
 
+void AsciiSerializedReply::spliceValue(const folly::IOBuf& value,
+                                       const char* valueMarker,
+                                       size_t& niov) {
+  for (size_t i = 0; i < niov; ++i) {
+    if (iovs_[i].iov_base != valueMarker) {
+      continue;
+    }
+
+    size_t nPieces = 0;
+    for (auto piece : value) {
+      if (!piece.empty()) {
+        ++nPieces;
+      }
+    }
+    assert(nPieces <= kMaxValuePieces);
+
+    std::memmove(&iovs_[i + nPieces], &iovs_[i + 1],
+                 (niov - i - 1) * sizeof(struct iovec));
+    for (auto piece : value) {
+      if (!piece.empty()) {
+        iovs_[i].iov_base = const_cast<unsigned char*>(piece.begin());
+        iovs_[i].iov_len = piece.size();
+        ++i;
+      }
+    }
+    niov = niov + nPieces - 1;
+    return;
+  }
+}
+
 }}  // facebook::memcache
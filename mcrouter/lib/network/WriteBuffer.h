@@ -36,9 +36,17 @@ class AsciiSerializedReply {
 
  private:
   static const size_t kMaxIovs = 16;
-  struct iovec iovs_[kMaxIovs];
+  // Chained values are written by reference, one iovec per piece.
+  static const size_t kMaxValuePieces = 8;
+  struct iovec iovs_[kMaxIovs + kMaxValuePieces];
   mc_ascii_response_buf_t asciiResponse_;
 
+  /**
+   * Replace the iovec referencing valueMarker with the pieces of value.
+   */
+  void spliceValue(const folly::IOBuf& value, const char* valueMarker,
+                   size_t& niov);
+
   AsciiSerializedReply(const AsciiSerializedReply&) = delete;
   AsciiSerializedReply& operator=(const AsciiSerializedReply&) = delete;
   AsciiSerializedReply(AsciiSerializedReply&&) noexcept = delete;
@@ -56,6 +64,10 @@ class WriteBuffer {
   explicit WriteBuffer(mc_protocol_t protocol);
   ~WriteBuffer();
 
+  /* Taken from HugePageArena if it's enabled */
+  static void* operator new(size_t size);
+  static void operator delete(void* p);
+
   /**
    * Allows using this buffer again without doing a complete
    * re-initialization
@@ -61,4 +61,26 @@ TEST(AccessPoint, host_port_proto) {
   EXPECT_FALSE(AccessPoint::create("[::1]", proto, ap));
 }
 
+TEST(AccessPoint, unix_socket) {
+  AccessPoint ap;
+  auto proto = mc_ascii_protocol;
+  EXPECT_TRUE(AccessPoint::create("unix:/tmp/mc.sock", proto, ap));
+  EXPECT_TRUE(ap.isUnixDomainSocket());
+  EXPECT_EQ(ap.getHost(), "/tmp/mc.sock");
+  EXPECT_EQ(ap.getPort(), 0);
+  EXPECT_EQ(ap.getProtocol(), proto);
+  EXPECT_EQ(ap.toHostPortString(), "unix:/tmp/mc.sock");
+  EXPECT_EQ(ap.toString(), "unix:/tmp/mc.sock:UNIX:ascii");
+  EXPECT_TRUE(AccessPoint::create("unix:/tmp/mc.sock:umbrella", proto, ap));
+  EXPECT_EQ(ap.getHost(), "/tmp/mc.sock");
+  EXPECT_EQ(ap.getProtocol(), mc_umbrella_protocol);
+  EXPECT_TRUE(AccessPoint::create("unix:/tmp/a:b", proto, ap));
+  EXPECT_EQ(ap.getHost(), "/tmp/a:b");
+  EXPECT_EQ(ap.getProtocol(), proto);
+  EXPECT_FALSE(AccessPoint::create("unix:", proto, ap));
+  EXPECT_FALSE(AccessPoint::create("unix::ascii", proto, ap));
+  EXPECT_TRUE(AccessPoint::create("127.0.0.1:1", proto, ap));
+  EXPECT_FALSE(ap.isUnixDomainSocket());
+}
+
 } // namespace
@@ -7,6 +7,8 @@
  *  of patent rights can be found in the PATENTS file in the same directory.
  *
  */
+#include <chrono>
+
 #include <gtest/gtest.h>
 
 #include <folly/experimental/fibers/EventBaseLoopController.h>
@@ -28,6 +30,7 @@ namespace {
 
 struct CommonStats {
   std::atomic<int> accepted{0};
+  std::atomic<int> sets{0};
 };
 
 const char* kPemKeyPath = "mcrouter/lib/network/test/test_key.pem";
@@ -37,9 +40,11 @@ const char* kPemCaPath = "mcrouter/lib/network/test/ca_cert.pem";
 class ServerOnRequest {
  public:
   ServerOnRequest(bool& shutdown,
-                  bool outOfOrder) :
+                  bool outOfOrder,
+                  CommonStats* stats = nullptr) :
       shutdown_(shutdown),
-      outOfOrder_(outOfOrder) {
+      outOfOrder_(outOfOrder),
+      stats_(stats) {
   }
 
   void onRequest(McServerRequestContext&& ctx,
@@ -70,6 +75,9 @@ class ServerOnRequest {
   void onRequest(McServerRequestContext&& ctx,
                  McRequest&& req,
                  McOperation<mc_op_set>) {
+    if (stats_) {
+      ++stats_->sets;
+    }
     processReply(std::move(ctx), McReply(mc_res_stored));
   }
 
@@ -102,13 +110,15 @@ class ServerOnRequest {
  private:
   bool& shutdown_;
   bool outOfOrder_;
+  CommonStats* stats_;
   std::vector<std::pair<McServerRequestContext, McReply>> waitingReplies_;
 };
 
 class TestServer {
  public:
   TestServer(bool outOfOrder, bool useSsl,
-             int maxInflight = 10, int timeoutMs = 250) :
+             int maxInflight = 10, int timeoutMs = 250,
+             size_t numHandshakeThreads = 0) :
       outOfOrder_(outOfOrder) {
     socketFd_ = createListenSocket();
     opts_.existingSocketFd = socketFd_;
@@ -119,6 +129,7 @@ class TestServer {
       opts_.pemKeyPath = kPemKeyPath;
       opts_.pemCertPath = kPemCertPath;
       opts_.pemCaPath = kPemCaPath;
+      opts_.numHandshakeThreads = numHandshakeThreads;
     }
     EXPECT_TRUE(run());
     // allow server some time to startup
@@ -140,7 +151,7 @@ class TestServer {
                 AsyncMcServerWorker& worker) {
 
           bool shutdown = false;
-          worker.setOnRequest(ServerOnRequest(shutdown, outOfOrder_));
+          worker.setOnRequest(ServerOnRequest(shutdown, outOfOrder_, &stats_));
           worker.setOnConnectionAccepted([this] () {
             ++stats_.accepted;
           });
@@ -185,7 +196,12 @@ class TestClient {
                std::shared_ptr<folly::SSLContext>()
              > contextProvider = nullptr,
              bool enableQoS = false,
-             uint64_t qos = 0) :
+             uint64_t qos = 0,
+             std::chrono::microseconds writeCorkMaxDelay =
+               std::chrono::microseconds(0),
+             bool supersedePendingUpdates = false,
+             bool enableKernelTimestamps = false,
+             bool priorityLanes = false) :
       fm_(folly::make_unique<folly::fibers::EventBaseLoopController>()) {
     dynamic_cast<folly::fibers::EventBaseLoopController&>(fm_.loopController()).
       attachEventBase(eventBase_);
@@ -198,11 +214,16 @@ class TestClient {
       opts.sslContextProvider = contextProvider
         ? contextProvider
         : defaultContextProvider;
+      opts.sslSessionResumption = true;
     }
     if (enableQoS) {
       opts.enableQoS = true;
       opts.qos = qos;
     }
+    opts.writeCorkMaxDelay = writeCorkMaxDelay;
+    opts.supersedePendingUpdates = supersedePendingUpdates;
+    opts.enableKernelTimestamps = enableKernelTimestamps;
+    opts.priorityLanes = priorityLanes;
     client_ = folly::make_unique<AsyncMcClient>(eventBase_, opts);
     client_->setStatusCallbacks([] { LOG(INFO) << "Client UP."; },
                                 [] (bool) { LOG(INFO) << "Client DOWN."; });
@@ -212,16 +233,22 @@ class TestClient {
     client_->setThrottle(maxInflight, maxOutstanding);
   }
 
-  void sendGet(const char* key, mc_res_t expectedResult) {
+  std::pair<uint64_t, uint64_t> getWriteCorkStat() const {
+    return client_->getWriteCorkStat();
+  }
+
+  void sendGet(const char* key, mc_res_t expectedResult,
+               std::chrono::milliseconds timeout =
+                 std::chrono::milliseconds(200)) {
     inflight_++;
     std::string K(key);
-    fm_.addTask([K, expectedResult, this]() {
+    fm_.addTask([K, expectedResult, timeout, this]() {
         auto msg = createMcMsgRef(K.c_str());
         msg->op = mc_op_get;
         McRequest req{std::move(msg)};
         try {
           auto reply = client_->sendSync(req, McOperation<mc_op_get>(),
-                                         std::chrono::milliseconds(200));
+                                         timeout);
           if (reply.result() == mc_res_found) {
             if (req.fullKey() == "empty") {
               EXPECT_TRUE(reply.hasValue());
@@ -240,6 +267,42 @@ class TestClient {
       });
   }
 
+  /**
+   * Sends a get with the timestamps requested, they are filled in
+   * once the reply is received.
+   */
+  void sendGetWithTimestamps(const char* key, McClientTimestamps& timestamps) {
+    inflight_++;
+    std::string K(key);
+    fm_.addTask([K, &timestamps, this]() {
+        McRequest req(K);
+        auto reply = client_->sendSync(req, McOperation<mc_op_get>(),
+                                       std::chrono::milliseconds(200),
+                                       &timestamps);
+        EXPECT_EQ(mc_res_found, reply.result());
+        inflight_--;
+      });
+  }
+
+  /**
+   * Sends a get with the given priority, appends the key to replied
+   * once the reply is received.
+   */
+  void sendGetWithPriority(const char* key, RequestPriority priority,
+                           std::vector<std::string>& replied) {
+    inflight_++;
+    std::string K(key);
+    fm_.addTask([K, priority, &replied, this]() {
+        McRequest req(K);
+        req.setPriority(priority);
+        auto reply = client_->sendSync(req, McOperation<mc_op_get>(),
+                                       std::chrono::milliseconds(200));
+        EXPECT_EQ(mc_res_found, reply.result());
+        replied.push_back(K);
+        inflight_--;
+      });
+  }
+
   void sendSet(const char* key, const char* value, mc_res_t expectedResult) {
     inflight_++;
     std::string K(key);
@@ -311,6 +374,38 @@ TEST(AsyncMcClient, serverShutdownSsl) {
   serverShutdownTest(true);
 }
 
+TEST(AsyncMcClient, sslHandshakeThreads) {
+  TestServer server(false, true, 10, 250, /* numHandshakeThreads */ 2);
+  TestClient client("localhost", server.getListenPort(), 200,
+                    mc_ascii_protocol, true);
+  client.sendGet("test", mc_res_found);
+  client.sendGet("shutdown", mc_res_notfound);
+  client.waitForReplies();
+  server.join();
+  EXPECT_EQ(server.getStats().accepted.load(), 1);
+}
+
+TEST(AsyncMcClient, sslSessionCached) {
+  TestServer server(false, true);
+  AccessPoint ap("localhost", server.getListenPort(), mc_ascii_protocol);
+  cacheSSLSession(ap.toHostPortString(), nullptr);
+
+  TestClient client("localhost", server.getListenPort(), 200,
+                    mc_ascii_protocol, true);
+  client.sendGet("test", mc_res_found);
+  client.waitForReplies();
+  EXPECT_NE(nullptr, getCachedSSLSession(ap.toHostPortString()));
+
+  /* A new connection resumes the cached session */
+  TestClient client2("localhost", server.getListenPort(), 200,
+                     mc_ascii_protocol, true);
+  client2.sendGet("test", mc_res_found);
+  client2.sendGet("shutdown", mc_res_notfound);
+  client2.waitForReplies();
+  server.join();
+  EXPECT_NE(nullptr, getCachedSSLSession(ap.toHostPortString()));
+}
+
 void simpleAsciiTimeoutTest(bool useSsl = false) {
   TestServer server(false, useSsl);
   TestClient client("localhost", server.getListenPort(), 200,
@@ -333,6 +428,27 @@ TEST(AsyncMcClient, simpleAsciiTimeoutSsl) {
   simpleAsciiTimeoutTest(true);
 }
 
+TEST(AsyncMcClient, asciiTimeoutBehindSlowerRequest) {
+  TestServer server(false, false);
+  TestClient client("localhost", server.getListenPort(), 200,
+                    mc_ascii_protocol);
+  client.sendGet("hold", mc_res_found, std::chrono::milliseconds(2000));
+  client.sendGet("nohold1", mc_res_timeout, std::chrono::milliseconds(50));
+  /* Times out on time, while the reply to "hold" is still held */
+  auto start = std::chrono::steady_clock::now();
+  client.waitForReplies(1);
+  EXPECT_LT(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(1000));
+  /* Replies to "hold", then the dropped one of "nohold1", then "flush" */
+  client.sendGet("flush", mc_res_found, std::chrono::milliseconds(2000));
+  client.waitForReplies();
+  client.sendGet("nohold2", mc_res_found);
+  client.sendGet("shutdown", mc_res_notfound);
+  client.waitForReplies();
+  server.join();
+  EXPECT_EQ(server.getStats().accepted.load(), 1);
+}
+
 void simpleUmbrellaTimeoutTest(bool useSsl = false) {
   TestServer server(true, useSsl);
   TestClient client("localhost", server.getListenPort(), 200,
@@ -517,6 +633,94 @@ void basicTest(mc_protocol_e protocol = mc_ascii_protocol,
   EXPECT_EQ(server.getStats().accepted.load(), 1);
 }
 
+TEST(AsyncMcClient, supersedePendingUpdates) {
+  TestServer server(false, false);
+  TestClient client("localhost", server.getListenPort(), 200,
+                    mc_ascii_protocol, false, nullptr, false, 0,
+                    std::chrono::microseconds(0),
+                    /* supersedePendingUpdates= */ true);
+  /* All pending while connecting */
+  client.sendSet("key", "a", mc_res_stored);
+  client.sendSet("key", "b", mc_res_stored);
+  client.sendSet("test", "a", mc_res_stored);
+  client.sendGet("test", mc_res_found);
+  client.sendSet("test", "b", mc_res_stored);
+  client.sendSet("key", "c", mc_res_stored);
+  client.waitForReplies();
+  /* Only the last set of "key" was written, the get kept both of "test" */
+  EXPECT_EQ(3, server.getStats().sets.load());
+  client.sendGet("shutdown", mc_res_notfound);
+  client.waitForReplies();
+  server.join();
+  EXPECT_EQ(server.getStats().accepted.load(), 1);
+}
+
+TEST(AsyncMcClient, priorityLanes) {
+  TestServer server(false, false);
+  TestClient client("localhost", server.getListenPort(), 200,
+                    mc_ascii_protocol, false, nullptr, false, 0,
+                    std::chrono::microseconds(0), false, false,
+                    /* priorityLanes */ true);
+  std::vector<std::string> replied;
+  /* All pending while connecting */
+  client.sendGetWithPriority("low1", RequestPriority::LOW, replied);
+  client.sendGetWithPriority("low2", RequestPriority::LOW, replied);
+  client.sendGetWithPriority("normal", RequestPriority::NORMAL, replied);
+  client.waitForReplies();
+  /* Normal one was written (and replied) first, low ones kept their order */
+  EXPECT_EQ((std::vector<std::string>{"normal", "low1", "low2"}), replied);
+  client.sendGet("shutdown", mc_res_notfound);
+  client.waitForReplies();
+  server.join();
+  EXPECT_EQ(server.getStats().accepted.load(), 1);
+}
+
+TEST(AsyncMcClient, writeCork) {
+  TestServer server(true, false);
+  TestClient client("localhost", server.getListenPort(), 200,
+                    mc_ascii_protocol, false, nullptr, false, 0,
+                    std::chrono::microseconds(500));
+  for (size_t i = 0; i < 10; ++i) {
+    client.sendGet("test", mc_res_found);
+  }
+  client.waitForReplies();
+  /* Writes were held, for no longer than the limit */
+  auto stat = client.getWriteCorkStat();
+  EXPECT_GT(stat.second, 0);
+  EXPECT_LE(stat.first, stat.second * 100000);
+  client.sendGet("shutdown", mc_res_notfound);
+  client.waitForReplies();
+  server.join();
+  EXPECT_EQ(server.getStats().accepted.load(), 1);
+}
+
+TEST(AsyncMcClient, kernelTimestamps) {
+  TestServer server(true, false);
+  TestClient client("localhost", server.getListenPort(), 200,
+                    mc_ascii_protocol, false, nullptr, false, 0,
+                    std::chrono::microseconds(0), false,
+                    /* enableKernelTimestamps */ true);
+  std::vector<McClientTimestamps> timestamps(10);
+  for (auto& ts : timestamps) {
+    client.sendGetWithTimestamps("test", ts);
+  }
+  client.waitForReplies();
+  for (const auto& ts : timestamps) {
+    EXPECT_GT(ts.writtenUs, 0);
+    EXPECT_GT(ts.readUs, 0);
+    EXPECT_LE(ts.writtenUs, ts.readUs);
+    /* TX timestamps depend on kernel support, but are ordered if present */
+    if (ts.kernelTxUs != 0) {
+      EXPECT_GT(ts.streamEnd, 0);
+      EXPECT_LE(ts.kernelTxUs, ts.readUs);
+    }
+  }
+  client.sendGet("shutdown", mc_res_notfound);
+  client.waitForReplies();
+  server.join();
+  EXPECT_EQ(server.getStats().accepted.load(), 1);
+}
+
 void umbrellaTest(bool useSsl = false) {
   basicTest(mc_umbrella_protocol, useSsl);
 }
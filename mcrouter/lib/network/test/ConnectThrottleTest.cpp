@@ -0,0 +1,89 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <chrono>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/network/ConnectThrottle.h"
+
+using namespace facebook::memcache;
+
+using std::chrono::microseconds;
+
+TEST(ConnectThrottle, limit) {
+  ConnectThrottle throttle(2);
+  EXPECT_TRUE(throttle.tryStart());
+  EXPECT_TRUE(throttle.tryStart());
+  EXPECT_FALSE(throttle.tryStart());
+
+  std::vector<int> started;
+  throttle.wait([&started]() { started.push_back(1); return true; });
+  throttle.wait([&started]() { started.push_back(2); return true; });
+  EXPECT_EQ(2, throttle.waiting());
+  /* Others can't jump the queue */
+  EXPECT_FALSE(throttle.tryStart());
+
+  throttle.finished(true, microseconds(100));
+  EXPECT_EQ(std::vector<int>({1}), started);
+  EXPECT_EQ(2, throttle.connecting());
+
+  throttle.finished(false, microseconds(300));
+  EXPECT_EQ(std::vector<int>({1, 2}), started);
+  EXPECT_EQ(0, throttle.waiting());
+
+  throttle.finished(true, microseconds(0));
+  throttle.finished(true, microseconds(0));
+  EXPECT_EQ(0, throttle.connecting());
+
+  EXPECT_EQ(3, throttle.stats().connects.load());
+  EXPECT_EQ(1, throttle.stats().failures.load());
+  EXPECT_EQ(400, throttle.stats().latencyUs.load());
+  EXPECT_EQ(2, throttle.stats().delayed.load());
+}
+
+TEST(ConnectThrottle, skipsGone) {
+  ConnectThrottle throttle(1);
+  EXPECT_TRUE(throttle.tryStart());
+
+  bool started = false;
+  throttle.wait([]() { return false; });
+  throttle.wait([&started]() { started = true; return true; });
+  throttle.finished(true, microseconds(0));
+  EXPECT_TRUE(started);
+  EXPECT_EQ(1, throttle.connecting());
+}
+
+TEST(ConnectThrottle, finishedRightAway) {
+  ConnectThrottle throttle(1);
+  EXPECT_TRUE(throttle.tryStart());
+
+  /* Connects failing right away start the next one from the same loop */
+  size_t started = 0;
+  for (size_t i = 0; i < 3; ++i) {
+    throttle.wait([&throttle, &started]() {
+      ++started;
+      throttle.finished(false, microseconds(0));
+      return true;
+    });
+  }
+  throttle.finished(false, microseconds(0));
+  EXPECT_EQ(3, started);
+  EXPECT_EQ(0, throttle.connecting());
+  EXPECT_TRUE(throttle.tryStart());
+}
+
+TEST(ConnectThrottle, noLimit) {
+  ConnectThrottle throttle;
+  for (size_t i = 0; i < 100; ++i) {
+    EXPECT_TRUE(throttle.tryStart());
+  }
+  EXPECT_EQ(100, throttle.connecting());
+}
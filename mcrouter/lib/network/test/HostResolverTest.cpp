@@ -0,0 +1,70 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <chrono>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/network/HostResolver.h"
+
+using namespace facebook::memcache;
+
+TEST(HostResolver, ipLiterals) {
+  HostResolver resolver;
+  EXPECT_EQ(0, resolver.prefetch({"127.0.0.1", "::1"}, 4));
+  EXPECT_EQ(0, resolver.stats().resolutions);
+
+  auto address = resolver.resolve("127.0.0.1", 11211);
+  EXPECT_EQ("127.0.0.1", address.getAddressStr());
+  EXPECT_EQ(11211, address.getPort());
+  EXPECT_EQ(0, resolver.stats().misses);
+}
+
+TEST(HostResolver, prefetch) {
+  HostResolver resolver;
+  std::vector<std::string> hosts(10, "localhost");
+  EXPECT_EQ(0, resolver.prefetch(hosts, 4));
+  /* Duplicates are resolved once */
+  EXPECT_EQ(1, resolver.stats().resolutions);
+
+  auto address = resolver.resolve("localhost", 5000);
+  EXPECT_TRUE(address.isLoopbackAddress());
+  EXPECT_EQ(5000, address.getPort());
+  EXPECT_EQ(0, resolver.stats().misses);
+
+  /* Still fresh */
+  EXPECT_EQ(0, resolver.prefetch(hosts, 4));
+  EXPECT_EQ(1, resolver.stats().resolutions);
+}
+
+TEST(HostResolver, failures) {
+  HostResolver resolver;
+  EXPECT_EQ(1, resolver.prefetch({"localhost", "nonexistent.invalid"}, 2));
+  EXPECT_EQ(1, resolver.stats().failures);
+
+  /* Not cached, resolved in line */
+  EXPECT_THROW(resolver.resolve("nonexistent.invalid", 5000),
+               std::system_error);
+  EXPECT_EQ(1, resolver.stats().misses);
+  EXPECT_EQ(2, resolver.stats().failures);
+}
+
+TEST(HostResolver, noCache) {
+  HostResolver resolver(std::chrono::milliseconds(0));
+  EXPECT_EQ(0, resolver.prefetch({"localhost"}, 1));
+  EXPECT_EQ(0, resolver.stats().resolutions);
+
+  resolver.resolve("localhost", 5000);
+  resolver.resolve("localhost", 5000);
+  EXPECT_EQ(2, resolver.stats().misses);
+  EXPECT_EQ(2, resolver.stats().resolutions);
+}
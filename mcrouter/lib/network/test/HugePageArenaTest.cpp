@@ -0,0 +1,73 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <folly/Memory.h>
+
+#include "mcrouter/lib/network/HugePageArena.h"
+
+using namespace facebook::memcache;
+
+/* The arena is process wide, so one test covers its whole life */
+TEST(HugePageArena, allocate) {
+  auto before = HugePageArena::allocate(100);
+  EXPECT_EQ(nullptr, before);
+  auto heap = folly::make_unique<char>();
+  EXPECT_FALSE(HugePageArena::owns(heap.get()));
+
+  ASSERT_TRUE(HugePageArena::enable(HugePageArena::Mode::TRANSPARENT,
+                                    4 * HugePageArena::kHugePageSize));
+  EXPECT_FALSE(HugePageArena::enable(HugePageArena::Mode::EXPLICIT, 1));
+  EXPECT_EQ(4 * HugePageArena::kHugePageSize,
+            HugePageArena::stats().reservedBytes);
+  EXPECT_FALSE(HugePageArena::owns(heap.get()));
+
+  /* Rounded up to powers of two */
+  auto a = HugePageArena::allocate(100);
+  auto b = HugePageArena::allocate(128);
+  ASSERT_NE(nullptr, a);
+  ASSERT_NE(nullptr, b);
+  EXPECT_TRUE(HugePageArena::owns(a));
+  EXPECT_EQ(128, static_cast<char*>(b) - static_cast<char*>(a));
+  memset(a, 'a', 128);
+  memset(b, 'b', 128);
+  EXPECT_EQ(256, HugePageArena::stats().usedBytes);
+  EXPECT_EQ(HugePageArena::kHugePageSize,
+            HugePageArena::stats().mappedBytes);
+
+  EXPECT_EQ(nullptr,
+            HugePageArena::allocate(HugePageArena::kMaxBlockSize + 1));
+
+  /* Freed blocks are reused */
+  HugePageArena::deallocate(a);
+  EXPECT_EQ(a, HugePageArena::allocate(120));
+  HugePageArena::deallocate(a);
+  HugePageArena::deallocate(b);
+  EXPECT_EQ(0, HugePageArena::stats().usedBytes);
+
+  /* Other sizes take pages of their own, until the arena is full */
+  std::vector<void*> blocks;
+  while (auto p = HugePageArena::allocate(HugePageArena::kMaxBlockSize)) {
+    memset(p, 0, HugePageArena::kMaxBlockSize);
+    blocks.push_back(p);
+  }
+  EXPECT_EQ(3 * HugePageArena::kHugePageSize / HugePageArena::kMaxBlockSize,
+            blocks.size());
+  EXPECT_EQ(4 * HugePageArena::kHugePageSize,
+            HugePageArena::stats().mappedBytes);
+  for (auto p : blocks) {
+    HugePageArena::deallocate(p);
+  }
+  EXPECT_EQ(0, HugePageArena::stats().usedBytes);
+}
@@ -0,0 +1,84 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <unordered_map>
+#include <vector>
+
+#include <gflags/gflags.h>
+
+#include <folly/Benchmark.h>
+
+#include "mcrouter/lib/network/IdRingMap.h"
+
+/**
+ * Reply dispatch as done by McClientRequestContextQueue for out of order
+ * protocols: with kInflight requests outstanding, every reply looks up and
+ * removes the oldest request and a new request is added.
+ */
+
+using namespace facebook::memcache;
+
+namespace {
+
+const size_t kInflight = 10000;
+
+struct Ctx {
+  uint64_t id;
+};
+
+std::vector<Ctx> contexts(kInflight);
+
+}  // anonymous namespace
+
+BENCHMARK(UnorderedMap_Dispatch, iters) {
+  std::unordered_map<uint64_t, Ctx*> map;
+  uint64_t nextId = 1;
+  size_t sum = 0;
+  BENCHMARK_SUSPEND {
+    for (auto& ctx : contexts) {
+      ctx.id = nextId++;
+      map[ctx.id] = &ctx;
+    }
+  }
+  for (size_t i = 0; i < iters; ++i) {
+    auto& ctx = contexts[i % kInflight];
+    auto it = map.find(ctx.id);
+    sum += it->second->id;
+    map.erase(it);
+    ctx.id = nextId++;
+    map[ctx.id] = &ctx;
+  }
+  folly::doNotOptimizeAway(sum);
+}
+
+BENCHMARK_RELATIVE(IdRingMap_Dispatch, iters) {
+  IdRingMap<Ctx*> map;
+  uint64_t nextId = 1;
+  size_t sum = 0;
+  BENCHMARK_SUSPEND {
+    for (auto& ctx : contexts) {
+      ctx.id = nextId++;
+      map.insert(ctx.id, &ctx);
+    }
+  }
+  for (size_t i = 0; i < iters; ++i) {
+    auto& ctx = contexts[i % kInflight];
+    sum += map.find(ctx.id)->id;
+    map.erase(ctx.id);
+    ctx.id = nextId++;
+    map.insert(ctx.id, &ctx);
+  }
+  folly::doNotOptimizeAway(sum);
+}
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  folly::runBenchmarks();
+  return 0;
+}
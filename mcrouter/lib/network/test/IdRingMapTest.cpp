@@ -0,0 +1,96 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/network/IdRingMap.h"
+
+using namespace facebook::memcache;
+
+TEST(IdRingMap, basic) {
+  IdRingMap<int*> map;
+  int a = 1, b = 2;
+
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(nullptr, map.find(1));
+  EXPECT_EQ(nullptr, map.find(0));
+
+  map.insert(1, &a);
+  map.insert(2, &b);
+  EXPECT_EQ(2, map.size());
+  EXPECT_EQ(&a, map.find(1));
+  EXPECT_EQ(&b, map.find(2));
+  // same slot, different id
+  EXPECT_EQ(nullptr, map.find(1 + map.capacity()));
+
+  EXPECT_TRUE(map.erase(1));
+  EXPECT_FALSE(map.erase(1));
+  EXPECT_FALSE(map.erase(0));
+  EXPECT_EQ(nullptr, map.find(1));
+  EXPECT_EQ(&b, map.find(2));
+  EXPECT_EQ(1, map.size());
+}
+
+TEST(IdRingMap, slidingWindow) {
+  IdRingMap<size_t> map;
+  const size_t kWindow = 1000;
+
+  for (size_t id = 1; id < 100000; ++id) {
+    map.insert(id, id);
+    if (id > kWindow) {
+      EXPECT_EQ(id - kWindow, map.find(id - kWindow));
+      EXPECT_TRUE(map.erase(id - kWindow));
+    }
+  }
+  EXPECT_EQ(kWindow, map.size());
+  // only grows to fit the window
+  EXPECT_GE(4 * kWindow, map.capacity());
+}
+
+TEST(IdRingMap, collisionGrows) {
+  IdRingMap<size_t> map;
+  auto capacity = map.capacity();
+
+  map.insert(1, 1);
+  // maps to the same slot as the live id 1
+  map.insert(1 + capacity, 2);
+  EXPECT_LT(capacity, map.capacity());
+  EXPECT_EQ(1, map.find(1));
+  EXPECT_EQ(2, map.find(1 + capacity));
+
+  // a long lived request and many short lived ones after it
+  for (size_t id = 2 + capacity; id < 10 * capacity; ++id) {
+    map.insert(id, id);
+    EXPECT_TRUE(map.erase(id));
+  }
+  EXPECT_EQ(1, map.find(1));
+  EXPECT_EQ(2, map.size());
+}
+
+TEST(IdRingMap, take) {
+  IdRingMap<std::unique_ptr<int>> map;
+
+  map.insert(1, std::unique_ptr<int>(new int(1)));
+  map.insert(2, std::unique_ptr<int>(new int(2)));
+  // grows with move-only values
+  map.insert(2 + map.capacity(), std::unique_ptr<int>(new int(3)));
+
+  EXPECT_EQ(nullptr, map.take(0));
+  EXPECT_EQ(nullptr, map.take(3));
+  auto two = map.take(2);
+  ASSERT_NE(nullptr, two);
+  EXPECT_EQ(2, *two);
+  EXPECT_EQ(nullptr, map.take(2));
+  EXPECT_EQ(2, map.size());
+  EXPECT_EQ(1, *map.take(1));
+  EXPECT_EQ(1, map.size());
+}
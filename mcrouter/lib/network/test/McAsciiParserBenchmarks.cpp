@@ -0,0 +1,136 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <folly/Benchmark.h>
+
+#include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/network/ClientMcParser.h"
+
+/**
+ * Reply parsing with the new ASCII parser, with and without the fast path
+ * for get/gets replies. Inputs are the ones from McAsciiParserTest,
+ * repeated to fill a batch of replies as they'd come from one read.
+ */
+
+using namespace facebook::memcache;
+
+namespace {
+
+size_t x = 0;
+
+constexpr size_t kRepliesPerBatch = 64;
+
+template <int Op>
+class ReplyCounter {
+ public:
+  using ParserT = ClientMcParser<ReplyCounter<Op>>;
+
+  explicit ReplyCounter(bool fastPath)
+    : parser_(*this, 0, 4096, 1 << 20, true, fastPath) {
+  }
+
+  void feed(const std::string& data) {
+    folly::StringPiece range(data);
+    while (!range.empty()) {
+      auto buffer = parser_.getReadBuffer();
+      auto readLen = std::min(buffer.second, range.size());
+      memcpy(buffer.first, range.begin(), readLen);
+      parser_.readDataAvailable(readLen);
+      range.advance(readLen);
+    }
+  }
+
+  bool nextReplyAvailable(uint64_t reqId) {
+    parser_.template expectNext<McOperation<Op>, McRequest>();
+    return true;
+  }
+
+  void replyReady(McReply&& reply, uint64_t reqId) {
+    x += reply.result();
+  }
+
+  void parseError(mc_res_t result, folly::StringPiece reason) {
+    LOG(FATAL) << "Parse error: " << reason;
+  }
+
+ private:
+  ParserT parser_;
+};
+
+template <int Op>
+void runParse(int iters, const std::string& reply, bool fastPath) {
+  folly::BenchmarkSuspender braces;
+  std::string data;
+  for (size_t i = 0; i < kRepliesPerBatch; ++i) {
+    data += reply;
+  }
+  ReplyCounter<Op> counter(fastPath);
+  braces.dismiss();
+
+  for (int i = 0; i < iters; ++i) {
+    counter.feed(data);
+  }
+}
+
+const std::string kGetHit = "VALUE t 10 2\r\nte\r\nEND\r\n";
+const std::string kGetMiss = "END\r\n";
+const std::string kGetsHit = "VALUE test 1120 10 573\r\ntest test \r\nEND\r\n";
+const std::string kGetHit1K =
+  "VALUE test:key 17 1024\r\n" + std::string(1024, 'v') + "\r\nEND\r\n";
+
+}  // anonymous
+
+BENCHMARK(get_hit_ragel, iters) {
+  runParse<mc_op_get>(iters, kGetHit, false);
+}
+
+BENCHMARK_RELATIVE(get_hit_fast_path, iters) {
+  runParse<mc_op_get>(iters, kGetHit, true);
+}
+
+BENCHMARK(get_miss_ragel, iters) {
+  runParse<mc_op_get>(iters, kGetMiss, false);
+}
+
+BENCHMARK_RELATIVE(get_miss_fast_path, iters) {
+  runParse<mc_op_get>(iters, kGetMiss, true);
+}
+
+BENCHMARK(gets_hit_ragel, iters) {
+  runParse<mc_op_gets>(iters, kGetsHit, false);
+}
+
+BENCHMARK_RELATIVE(gets_hit_fast_path, iters) {
+  runParse<mc_op_gets>(iters, kGetsHit, true);
+}
+
+BENCHMARK(get_hit_1K_ragel, iters) {
+  runParse<mc_op_get>(iters, kGetHit1K, false);
+}
+
+BENCHMARK_RELATIVE(get_hit_1K_fast_path, iters) {
+  runParse<mc_op_get>(iters, kGetHit1K, true);
+}
+
+int main(int argc, char **argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  folly::runBenchmarksOnFlag();
+  std::cout << "check: " << x << std::endl;
+  return 0;
+}
@@ -7,6 +7,7 @@
  *  of patent rights can be found in the PATENTS file in the same directory.
  *
  */
+#include <string>
 #include <typeindex>
 
 #include <arpa/inet.h>
@@ -156,9 +157,17 @@ class McAsciiParserHarness {
   }
 
   void runTestImpl() {
+    // Every input is checked both with and without the reply fast path,
+    // results should be identical.
+    runTestImpl(false);
+    runTestImpl(true);
+  }
+
+  void runTestImpl(bool fastPath) {
     currentId_ = 0;
     errorState_ = false;
-    parser_ = folly::make_unique<ParserT>(*this, 0, 1024, 4096, true);
+    parser_ = folly::make_unique<ParserT>(*this, 0, 1024, 4096, true,
+                                          fastPath);
     for (auto range : data_) {
       while (range.size() > 0 && !errorState_) {
         auto buffer = parser_->getReadBuffer();
@@ -295,6 +304,34 @@ TEST(McAsciiParserHarness, GetHit_Error) {
   h.runTest(1);
 }
 
+TEST(McAsciiParserHarness, GetHit_NoCarriageReturn) {
+  McAsciiParserHarness h("VALUE t 10 2\nte\nEND\n");
+  h.expectNext<McOperation<mc_op_get>, McRequest>(
+    setFlags(McReply(mc_res_found, "te"), 10));
+  h.runTest(2);
+}
+
+TEST(McAsciiParserHarness, GetHit_ControlCharInKey) {
+  McAsciiParserHarness h("VALUE t\x01t 10 2\r\nte\r\nEND\r\n");
+  h.expectNext<McOperation<mc_op_get>, McRequest>(McReply(), true);
+  h.runTest(-1);
+}
+
+TEST(McAsciiParserHarness, GetHit_ExtraField) {
+  McAsciiParserHarness h("VALUE t 10 2 3\r\nte\r\nEND\r\n");
+  h.expectNext<McOperation<mc_op_get>, McRequest>(McReply(), true);
+  h.runTest(-1);
+}
+
+TEST(McAsciiParserHarness, GetHit_LongValue) {
+  std::string value(8192, 'v');
+  auto reply = "VALUE test 1 8192\r\n" + value + "\r\nEND\r\n";
+  McAsciiParserHarness h(reply.c_str());
+  h.expectNext<McOperation<mc_op_get>, McRequest>(
+    setFlags(McReply(mc_res_found, value), 1));
+  h.runTest(-1);
+}
+
 TEST(McAsciiParserHarness, GetMiss) {
   McAsciiParserHarness h("END\r\n");
   h.expectNext<McOperation<mc_op_get>, McRequest>(McReply(mc_res_notfound));
@@ -461,6 +498,18 @@ TEST(McAsciiParserHarness, DeleteNotFound) {
   h.runTest(0);
 }
 
+TEST(McAsciiParserHarness, TouchTouched) {
+  McAsciiParserHarness h("TOUCHED\r\n");
+  h.expectNext<McOperation<mc_op_touch>, McRequest>(McReply(mc_res_touched));
+  h.runTest(0);
+}
+
+TEST(McAsciiParserHarness, TouchNotFound) {
+  McAsciiParserHarness h("NOT_FOUND\r\n");
+  h.expectNext<McOperation<mc_op_touch>, McRequest>(McReply(mc_res_notfound));
+  h.runTest(0);
+}
+
 TEST(McAsciiParserHarness, MetagetMiss) {
   McAsciiParserHarness h("END\r\n");
   h.expectNext<McOperation<mc_op_metaget>, McRequest>(McReply(mc_res_notfound));
@@ -0,0 +1,131 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <cstring>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include <folly/io/IOBuf.h>
+
+#include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/network/McMetaParser.h"
+
+using namespace facebook::memcache;
+
+namespace {
+
+/**
+ * Parses a single reply to Operation, feeding data in reads of at most
+ * readSize bytes.
+ */
+template <class Operation>
+McReply parse(const std::string& data, size_t readSize,
+              McMetaParser::State expectedState =
+                McMetaParser::State::COMPLETE) {
+  McMetaParser parser;
+  parser.initializeReplyParser<Operation, McRequest>();
+  auto state = McMetaParser::State::PARTIAL;
+  size_t offset = 0;
+  while (state == McMetaParser::State::PARTIAL && offset < data.size()) {
+    auto len = std::min(readSize, data.size() - offset);
+    auto buffer = folly::IOBuf::copyBuffer(data.data() + offset, len);
+    state = parser.consume(*buffer);
+    offset += len - buffer->length();
+    EXPECT_TRUE(state != McMetaParser::State::PARTIAL || buffer->empty());
+  }
+  EXPECT_EQ(expectedState, state) << data;
+  EXPECT_EQ(data.size(), offset) << data;
+  if (state != McMetaParser::State::COMPLETE) {
+    return McReply();
+  }
+  return parser.getReply();
+}
+
+/**
+ * Checks the reply is the same however the data is split into reads.
+ */
+template <class Operation>
+McReply parseAllSplits(const std::string& data) {
+  auto reply = parse<Operation>(data, data.size());
+  for (size_t readSize = 1; readSize < data.size(); ++readSize) {
+    auto other = parse<Operation>(data, readSize);
+    EXPECT_EQ(reply.result(), other.result()) << readSize;
+    EXPECT_EQ(reply.valueRangeSlow(), other.valueRangeSlow()) << readSize;
+    EXPECT_EQ(reply.flags(), other.flags()) << readSize;
+    EXPECT_EQ(reply.cas(), other.cas()) << readSize;
+    EXPECT_EQ(reply.leaseToken(), other.leaseToken()) << readSize;
+  }
+  return reply;
+}
+
+}  // anonymous namespace
+
+TEST(McMetaParser, get) {
+  auto reply = parseAllSplits<McOperation<mc_op_get>>("VA 5 f17\r\nvalue\r\n");
+  EXPECT_EQ(mc_res_found, reply.result());
+  EXPECT_EQ("value", reply.valueRangeSlow());
+  EXPECT_EQ(17, reply.flags());
+
+  reply = parseAllSplits<McOperation<mc_op_get>>("EN\r\n");
+  EXPECT_EQ(mc_res_notfound, reply.result());
+
+  reply = parseAllSplits<McOperation<mc_op_gets>>("VA 1 f0 c42\r\nv\r\n");
+  EXPECT_EQ(mc_res_found, reply.result());
+  EXPECT_EQ(42, reply.cas());
+}
+
+TEST(McMetaParser, leaseGet) {
+  auto reply = parseAllSplits<McOperation<mc_op_lease_get>>(
+    "VA 0 f0 c123 W\r\n\r\n");
+  EXPECT_EQ(mc_res_notfound, reply.result());
+  EXPECT_EQ(123, reply.leaseToken());
+
+  reply = parseAllSplits<McOperation<mc_op_lease_get>>("VA 0 f0 c123 Z\r\n\r\n");
+  EXPECT_EQ(mc_res_notfound, reply.result());
+  EXPECT_EQ(1, reply.leaseToken());
+
+  reply = parseAllSplits<McOperation<mc_op_lease_get>>("VA 1 f0 c123\r\nv\r\n");
+  EXPECT_EQ(mc_res_found, reply.result());
+  EXPECT_EQ("v", reply.valueRangeSlow());
+}
+
+TEST(McMetaParser, other) {
+  EXPECT_EQ(mc_res_stored,
+            parseAllSplits<McOperation<mc_op_set>>("HD\r\n").result());
+  EXPECT_EQ(mc_res_notstored,
+            parseAllSplits<McOperation<mc_op_add>>("NS\r\n").result());
+  EXPECT_EQ(mc_res_exists,
+            parseAllSplits<McOperation<mc_op_cas>>("EX\r\n").result());
+  EXPECT_EQ(mc_res_deleted,
+            parseAllSplits<McOperation<mc_op_delete>>("HD\r\n").result());
+  EXPECT_EQ(mc_res_touched,
+            parseAllSplits<McOperation<mc_op_touch>>("HD\r\n").result());
+
+  auto reply = parseAllSplits<McOperation<mc_op_incr>>("VA 2\r\n10\r\n");
+  EXPECT_EQ(mc_res_stored, reply.result());
+  EXPECT_EQ(10, reply.delta());
+
+  reply = parseAllSplits<McOperation<mc_op_version>>("VERSION 1.6.0\r\n");
+  EXPECT_EQ(mc_res_ok, reply.result());
+  EXPECT_EQ("1.6.0", reply.valueRangeSlow());
+
+  reply = parseAllSplits<McOperation<mc_op_get>>(
+    "SERVER_ERROR 307 busy\r\n");
+  EXPECT_EQ(mc_res_busy, reply.result());
+}
+
+TEST(McMetaParser, errors) {
+  parse<McOperation<mc_op_get>>("ERROR\r\n", 7, McMetaParser::State::ERROR);
+  parse<McOperation<mc_op_get>>("HD\r\n", 4, McMetaParser::State::ERROR);
+  parse<McOperation<mc_op_get>>("VA x\r\n", 6, McMetaParser::State::ERROR);
+  parse<McOperation<mc_op_incr>>("VA 1\r\nx\r\n", 9,
+                                 McMetaParser::State::ERROR);
+}
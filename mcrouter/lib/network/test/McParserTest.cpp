@@ -0,0 +1,239 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <folly/io/IOBuf.h>
+
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/network/McParser.h"
+#include "mcrouter/lib/network/UmbrellaProtocol.h"
+
+using namespace facebook::memcache;
+
+namespace {
+
+/**
+ * Treats every '\n' terminated line as a message.
+ */
+class LineCallback : public McParser::ParserCallback {
+ public:
+  McParser* parser{nullptr};
+  bool holdBuffer{false};
+  std::unique_ptr<folly::IOBuf> held;
+
+  bool umMessageReady(const UmbrellaMessageInfo& info,
+                      const uint8_t* header,
+                      const uint8_t* body,
+                      const folly::IOBuf& bodyBuffer) override {
+    return false;
+  }
+
+  void handleAscii(folly::IOBuf& readBuffer) override {
+    auto data = reinterpret_cast<const char*>(readBuffer.data());
+    auto lines = std::count(data, data + readBuffer.length(), '\n');
+    for (decltype(lines) i = 0; i < lines; ++i) {
+      parser->reportMsgRead();
+    }
+    if (holdBuffer) {
+      held = readBuffer.clone();
+    }
+    readBuffer.trimStart(readBuffer.length());
+  }
+
+  void parseError(mc_res_t result, folly::StringPiece reason) override {
+    FAIL() << reason;
+  }
+};
+
+/**
+ * Parses umbrella requests, records their ids.
+ */
+class UmbrellaCallback : public McParser::ParserCallback {
+ public:
+  std::vector<uint64_t> reqids;
+  std::vector<std::string> values;
+  size_t errors{0};
+
+  bool umMessageReady(const UmbrellaMessageInfo& info,
+                      const uint8_t* header,
+                      const uint8_t* body,
+                      const folly::IOBuf& bodyBuffer) override {
+    mc_op_t op;
+    uint64_t reqid;
+    auto req = umbrellaParseRequest(bodyBuffer, header, info.headerSize,
+                                    body, info.bodySize, op, reqid);
+    reqids.push_back(reqid);
+    values.push_back(req.valueRangeSlow().str());
+    return true;
+  }
+
+  void handleAscii(folly::IOBuf& readBuffer) override {
+    FAIL() << "unexpected ascii data";
+  }
+
+  void parseError(mc_res_t result, folly::StringPiece reason) override {
+    ++errors;
+  }
+};
+
+std::string serializeUmbrella(const std::string& value, uint64_t reqid) {
+  McRequest req("key");
+  req.setValue(folly::IOBuf(folly::IOBuf::COPY_BUFFER, value));
+  UmbrellaSerializedMessage msg;
+  struct iovec* iovs;
+  size_t niovs;
+  EXPECT_TRUE(msg.prepare(req, McOperation<mc_op_set>(), reqid, iovs, niovs));
+  std::string result;
+  for (size_t i = 0; i < niovs; ++i) {
+    result.append(static_cast<const char*>(iovs[i].iov_base),
+                  iovs[i].iov_len);
+  }
+  return result;
+}
+
+std::string umbrellaBatch(const std::vector<std::string>& messages,
+                          size_t numMessages) {
+  std::string body;
+  for (const auto& message : messages) {
+    body += message;
+  }
+  entry_list_msg_t header;
+  EXPECT_TRUE(umbrellaPrepareBatchHeader(header, numMessages, body.size()));
+  return std::string(reinterpret_cast<const char*>(&header),
+                     sizeof(header)) + body;
+}
+
+void feed(McParser& parser, const std::string& data) {
+  size_t offset = 0;
+  while (offset < data.size()) {
+    auto buf = parser.getReadBuffer();
+    auto len = std::min(buf.second, data.size() - offset);
+    std::memcpy(buf.first, data.data() + offset, len);
+    ASSERT_TRUE(parser.readDataAvailable(len));
+    offset += len;
+  }
+}
+
+void feedMessages(McParser& parser, size_t count, size_t size) {
+  std::string message(size - 1, 'a');
+  message.push_back('\n');
+  for (size_t i = 0; i < count; ++i) {
+    feed(parser, message);
+  }
+}
+
+}  // anonymous namespace
+
+TEST(McParser, reuseIdleBuffer) {
+  LineCallback cb1;
+  LineCallback cb2;
+  McParser parser1(cb1, 0, 256, 4096);
+  McParser parser2(cb2, 0, 256, 4096);
+  cb1.parser = &parser1;
+  cb2.parser = &parser2;
+
+  auto buf = parser1.getReadBuffer();
+  feed(parser1, "get a\n");
+  // parser1 is idle, its buffer goes to parser2
+  EXPECT_EQ(buf.first, parser2.getReadBuffer().first);
+}
+
+TEST(McParser, keepReferencedBuffer) {
+  LineCallback cb1;
+  LineCallback cb2;
+  McParser parser1(cb1, 0, 256, 4096);
+  McParser parser2(cb2, 0, 256, 4096);
+  cb1.parser = &parser1;
+  cb2.parser = &parser2;
+  cb1.holdBuffer = true;
+
+  auto buf = parser1.getReadBuffer();
+  feed(parser1, "get a\n");
+  EXPECT_NE(buf.first, parser2.getReadBuffer().first);
+}
+
+TEST(McParser, dropReferencedBuffer) {
+  LineCallback cb1;
+  LineCallback cb2;
+  McParser parser1(cb1, 0, 256, 4096);
+  McParser parser2(cb2, 0, 256, 4096);
+  cb1.parser = &parser1;
+  cb2.parser = &parser2;
+  cb1.holdBuffer = true;
+
+  auto held = parser1.getReadBuffer();
+  feed(parser1, "get a\n");
+  auto idle = parser2.getReadBuffer();
+  feed(parser2, "get b\n");
+
+  // parser1 doesn't copy the data still held by the callback,
+  // it reads into the pooled buffer
+  auto buf = parser1.getReadBuffer();
+  EXPECT_NE(held.first, buf.first);
+  EXPECT_EQ(idle.first, buf.first);
+  EXPECT_EQ(0, std::memcmp(cb1.held->data(), "get a\n", 6));
+}
+
+TEST(McParser, bufferSize) {
+  LineCallback cb;
+  McParser parser(cb, 4, 256, 65536);
+  cb.parser = &parser;
+
+  feedMessages(parser, 10000, 100);
+  EXPECT_EQ(512, parser.getReadBuffer().second);
+
+  // most of the bytes come in large messages
+  for (size_t i = 0; i < 2000; ++i) {
+    feedMessages(parser, 9, 100);
+    feedMessages(parser, 1, 10000);
+  }
+  EXPECT_EQ(65536, parser.getReadBuffer().second);
+
+  feedMessages(parser, 100000, 100);
+  EXPECT_EQ(512, parser.getReadBuffer().second);
+}
+
+TEST(McParser, umbrellaBatch) {
+  UmbrellaCallback cb;
+  McParser parser(cb, 0, 256, 4096);
+
+  feed(parser, serializeUmbrella("a", 1));
+  EXPECT_FALSE(parser.umbrellaBatches());
+
+  std::string large(3000, 'l');
+  feed(parser, umbrellaBatch({serializeUmbrella("b", 2),
+                              serializeUmbrella(large, 3),
+                              serializeUmbrella("c", 4)}, 3));
+  feed(parser, serializeUmbrella("d", 5));
+
+  EXPECT_TRUE(parser.umbrellaBatches());
+  EXPECT_EQ(0, cb.errors);
+  EXPECT_EQ(std::vector<uint64_t>({1, 2, 3, 4, 5}), cb.reqids);
+  EXPECT_EQ(std::vector<std::string>({"a", "b", large, "c", "d"}), cb.values);
+}
+
+TEST(McParser, umbrellaBatchBadCount) {
+  UmbrellaCallback cb;
+  McParser parser(cb, 0, 256, 4096);
+
+  auto batch = umbrellaBatch({serializeUmbrella("a", 1),
+                              serializeUmbrella("b", 2)}, 1);
+  auto buf = parser.getReadBuffer();
+  ASSERT_LE(batch.size(), buf.second);
+  std::memcpy(buf.first, batch.data(), batch.size());
+  EXPECT_FALSE(parser.readDataAvailable(batch.size()));
+  EXPECT_EQ(1, cb.errors);
+}
@@ -0,0 +1,119 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+#include <gflags/gflags.h>
+
+#include <folly/Benchmark.h>
+#include <folly/io/IOBuf.h>
+
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/network/McSerializedRequest.h"
+
+/**
+ * Serialization cost of large sets as seen by AsyncMcClient.
+ *
+ * Values are built as a chain of four pieces, like a value assembled
+ * from several read buffers. The *_copy variants coalesce the value first
+ * to show the cost of the copy that serialization used to do.
+ */
+
+using namespace facebook::memcache;
+
+static size_t x = 0;
+
+static McRequest makeRequest(size_t valueSize, size_t pieceSize) {
+  McRequest req("test:large:value:key");
+  std::unique_ptr<folly::IOBuf> head;
+  for (size_t off = 0; off < valueSize; off += pieceSize) {
+    auto piece = folly::IOBuf::create(pieceSize);
+    memset(piece->writableData(), 'a', pieceSize);
+    piece->append(std::min(pieceSize, valueSize - off));
+    if (head) {
+      head->prependChain(std::move(piece));
+    } else {
+      head = std::move(piece);
+    }
+  }
+  req.setValue(std::move(*head));
+  return req;
+}
+
+template <int Op>
+static void serialize(const McRequest& req, mc_protocol_t protocol) {
+  McSerializedRequest serialized(req, McOperation<Op>(), 1, protocol);
+  x += serialized.getIovsCount();
+}
+
+static void runZeroCopy(int iters, size_t valueSize, mc_protocol_t protocol) {
+  folly::BenchmarkSuspender braces;
+  auto req = makeRequest(valueSize, valueSize / 4);
+  braces.dismiss();
+
+  for (int i = 0; i < iters; ++i) {
+    serialize<mc_op_set>(req, protocol);
+  }
+}
+
+static void runCopy(int iters, size_t valueSize, mc_protocol_t protocol) {
+  folly::BenchmarkSuspender braces;
+  auto req = makeRequest(valueSize, valueSize / 4);
+  braces.dismiss();
+
+  for (int i = 0; i < iters; ++i) {
+    auto copy = req.clone();
+    copy.valueRangeSlow();
+    serialize<mc_op_set>(copy, protocol);
+  }
+}
+
+BENCHMARK(ascii_set_1M_copy, iters) {
+  runCopy(iters, 1 << 20, mc_ascii_protocol);
+}
+
+BENCHMARK_RELATIVE(ascii_set_1M_zero_copy, iters) {
+  runZeroCopy(iters, 1 << 20, mc_ascii_protocol);
+}
+
+BENCHMARK(umbrella_set_1M_copy, iters) {
+  runCopy(iters, 1 << 20, mc_umbrella_protocol);
+}
+
+BENCHMARK_RELATIVE(umbrella_set_1M_zero_copy, iters) {
+  runZeroCopy(iters, 1 << 20, mc_umbrella_protocol);
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(ascii_set_256K_copy, iters) {
+  runCopy(iters, 256 * 1024, mc_ascii_protocol);
+}
+
+BENCHMARK_RELATIVE(ascii_set_256K_zero_copy, iters) {
+  runZeroCopy(iters, 256 * 1024, mc_ascii_protocol);
+}
+
+BENCHMARK(umbrella_set_256K_copy, iters) {
+  runCopy(iters, 256 * 1024, mc_umbrella_protocol);
+}
+
+BENCHMARK_RELATIVE(umbrella_set_256K_zero_copy, iters) {
+  runZeroCopy(iters, 256 * 1024, mc_umbrella_protocol);
+}
+
+int main(int argc, char **argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  folly::runBenchmarksOnFlag();
+  std::cout << "check: " << x << std::endl;
+  return 0;
+}
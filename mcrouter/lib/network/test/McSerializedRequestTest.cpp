@@ -0,0 +1,160 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <folly/io/IOBuf.h>
+
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/network/McSerializedRequest.h"
+#include "mcrouter/lib/network/UmbrellaProtocol.h"
+
+using namespace facebook::memcache;
+
+namespace {
+
+std::string flatten(McSerializedRequest& serialized) {
+  std::string out;
+  auto iovs = serialized.getIovs();
+  for (size_t i = 0; i < serialized.getIovsCount(); ++i) {
+    out.append(reinterpret_cast<const char*>(iovs[i].iov_base),
+               iovs[i].iov_len);
+  }
+  return out;
+}
+
+folly::IOBuf makeChain(const std::vector<std::string>& pieces) {
+  auto head = folly::IOBuf::copyBuffer(pieces[0]);
+  for (size_t i = 1; i < pieces.size(); ++i) {
+    head->prependChain(folly::IOBuf::copyBuffer(pieces[i]));
+  }
+  return std::move(*head);
+}
+
+template <int Op>
+void checkChainedValue(const std::vector<std::string>& pieces,
+                       mc_protocol_t protocol) {
+  std::string flat;
+  for (const auto& p : pieces) {
+    flat += p;
+  }
+
+  McRequest flatReq("key");
+  flatReq.setValue(folly::IOBuf(folly::IOBuf::COPY_BUFFER, flat));
+  McSerializedRequest flatSerialized(flatReq, McOperation<Op>(), 1, protocol);
+  ASSERT_EQ(McSerializedRequest::Result::OK,
+            flatSerialized.serializationResult());
+
+  McRequest chainedReq("key");
+  chainedReq.setValue(makeChain(pieces));
+  McSerializedRequest chainedSerialized(chainedReq, McOperation<Op>(), 1,
+                                        protocol);
+  ASSERT_EQ(McSerializedRequest::Result::OK,
+            chainedSerialized.serializationResult());
+
+  EXPECT_EQ(flatten(flatSerialized), flatten(chainedSerialized));
+}
+
+template <int Op>
+void checkUmbrellaRoundTrip(const std::string& value, size_t expectedIovs) {
+  McRequest req("some:key");
+  if (!value.empty()) {
+    req.setValue(folly::IOBuf(folly::IOBuf::COPY_BUFFER, value));
+  }
+  McSerializedRequest serialized(req, McOperation<Op>(), 7,
+                                 mc_umbrella_protocol);
+  ASSERT_EQ(McSerializedRequest::Result::OK, serialized.serializationResult());
+  EXPECT_EQ(expectedIovs, serialized.getIovsCount());
+
+  auto buf = folly::IOBuf::copyBuffer(flatten(serialized));
+  UmbrellaMessageInfo info;
+  ASSERT_EQ(UmbrellaParseStatus::OK,
+            umbrellaParseHeader(buf->data(), buf->length(), info));
+  ASSERT_EQ(buf->length(), info.headerSize + info.bodySize);
+  mc_op_t op;
+  uint64_t reqid;
+  auto parsed = umbrellaParseRequest(*buf, buf->data(), info.headerSize,
+                                     buf->data() + info.headerSize,
+                                     info.bodySize, op, reqid);
+  EXPECT_EQ(Op, op);
+  EXPECT_EQ(7, reqid);
+  EXPECT_EQ("some:key", parsed.fullKey().str());
+  EXPECT_EQ(value, parsed.valueRangeSlow().str());
+}
+
+}  // namespace
+
+TEST(McSerializedRequest, asciiChainedValue) {
+  std::vector<std::string> pieces = {"abc", "", "defgh", "ijk"};
+  checkChainedValue<mc_op_set>(pieces, mc_ascii_protocol);
+  checkChainedValue<mc_op_cas>(pieces, mc_ascii_protocol);
+  checkChainedValue<mc_op_lease_set>(pieces, mc_ascii_protocol);
+}
+
+TEST(McSerializedRequest, umbrellaChainedValue) {
+  std::vector<std::string> pieces = {"abc", "", "defgh", "ijk"};
+  checkChainedValue<mc_op_set>(pieces, mc_umbrella_protocol);
+}
+
+TEST(McSerializedRequest, longChainIsCoalesced) {
+  std::vector<std::string> pieces(64, "x");
+  checkChainedValue<mc_op_set>(pieces, mc_ascii_protocol);
+  checkChainedValue<mc_op_set>(pieces, mc_umbrella_protocol);
+}
+
+TEST(McSerializedRequest, umbrellaCopiesSmallStrings) {
+  /* Header, entries, key and small values go out in one iovec */
+  checkUmbrellaRoundTrip<mc_op_get>("", 1);
+  checkUmbrellaRoundTrip<mc_op_set>("value", 1);
+  /* Large values are referenced: value and its '\0' */
+  checkUmbrellaRoundTrip<mc_op_set>(std::string(4096, 'v'), 3);
+}
+
+TEST(McSerializedRequest, umbrellaParseRequestFields) {
+  McRequest req(std::string(100, 'k'));
+  req.setValue(folly::IOBuf(folly::IOBuf::COPY_BUFFER, "value"));
+  req.setFlags(1);
+  req.setExptime(2);
+  req.setDelta(3);
+  req.setLeaseToken(4);
+  req.setCas(5);
+  McSerializedRequest serialized(req, McOperation<mc_op_cas>(), 9,
+                                 mc_umbrella_protocol);
+  ASSERT_EQ(McSerializedRequest::Result::OK, serialized.serializationResult());
+
+  auto buf = folly::IOBuf::copyBuffer(flatten(serialized));
+  UmbrellaMessageInfo info;
+  ASSERT_EQ(UmbrellaParseStatus::OK,
+            umbrellaParseHeader(buf->data(), buf->length(), info));
+  mc_op_t op;
+  uint64_t reqid;
+  auto parsed = umbrellaParseRequest(*buf, buf->data(), info.headerSize,
+                                     buf->data() + info.headerSize,
+                                     info.bodySize, op, reqid);
+  EXPECT_EQ(mc_op_cas, op);
+  EXPECT_EQ(9, reqid);
+  EXPECT_EQ(req.fullKey(), parsed.fullKey());
+  EXPECT_EQ("value", parsed.valueRangeSlow().str());
+  EXPECT_EQ(1, parsed.flags());
+  EXPECT_EQ(2, parsed.exptime());
+  EXPECT_EQ(3, parsed.delta());
+  EXPECT_EQ(4, parsed.leaseToken());
+  EXPECT_EQ(5, parsed.cas());
+
+  /* Key and value are slices of the read buffer, not copies */
+  auto inBuffer = [&buf](const void* p) {
+    auto bytes = static_cast<const uint8_t*>(p);
+    return bytes >= buf->data() && bytes < buf->tail();
+  };
+  EXPECT_TRUE(inBuffer(parsed.fullKey().begin()));
+  EXPECT_TRUE(inBuffer(parsed.value().data()));
+}
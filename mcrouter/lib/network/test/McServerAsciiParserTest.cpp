@@ -0,0 +1,150 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <folly/Conv.h>
+#include <folly/Range.h>
+
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/network/ServerMcParser.h"
+
+using namespace facebook::memcache;
+
+namespace {
+
+/**
+ * Records every request (or error) as a string of its fields.
+ */
+class RequestRecorder {
+ public:
+  std::vector<std::string> requests;
+
+  explicit RequestRecorder(bool newAsciiParser)
+    : parser_(*this, 0, 256, 4096, newAsciiParser) {
+  }
+
+  /**
+   * Feeds data in reads of at most readSize bytes.
+   */
+  void feed(folly::StringPiece data, size_t readSize) {
+    while (!data.empty() && !failed_) {
+      auto buffer = parser_.getReadBuffer();
+      auto len = std::min({buffer.second, data.size(), readSize});
+      std::memcpy(buffer.first, data.begin(), len);
+      parser_.readDataAvailable(len);
+      data.advance(len);
+    }
+  }
+
+  void requestReady(McRequest&& req, mc_op_t operation, uint64_t reqid,
+                    mc_res_t result, bool noreply) {
+    requests.push_back(folly::to<std::string>(
+      mc_op_to_string(operation), " key=", req.fullKey(),
+      " value=", req.valueRangeSlow(),
+      " flags=", req.flags(), " exptime=", req.exptime(),
+      " number=", req.number(), " delta=", req.delta(),
+      " lease=", req.leaseToken(), " cas=", req.cas(),
+      " result=", mc_res_to_string(result), " noreply=", noreply));
+  }
+
+  void typedRequestReady(uint64_t typeId, const folly::IOBuf& reqBody,
+                         uint64_t reqid) {
+    requests.push_back("typed request");
+  }
+
+  void parseError(mc_res_t result, folly::StringPiece reason) {
+    requests.push_back(folly::to<std::string>(
+      "error ", mc_res_to_string(result), " ", reason));
+    failed_ = true;
+  }
+
+ private:
+  ServerMcParser<RequestRecorder> parser_;
+  bool failed_{false};
+};
+
+/**
+ * Both parsers should give the same requests, however the data is split
+ * into reads.
+ */
+void checkSameAsLegacy(const std::string& data) {
+  RequestRecorder legacy(false);
+  legacy.feed(data, data.size());
+  ASSERT_FALSE(legacy.requests.empty()) << data;
+
+  for (size_t readSize = 1; readSize <= data.size(); ++readSize) {
+    RequestRecorder recorder(true);
+    recorder.feed(data, readSize);
+    ASSERT_EQ(legacy.requests, recorder.requests)
+      << "read size " << readSize << " data '" << data << "'";
+  }
+}
+
+}  // anonymous namespace
+
+TEST(McServerAsciiParser, get) {
+  checkSameAsLegacy("get key\r\n");
+  checkSameAsLegacy("gets key\r\n");
+  checkSameAsLegacy("lease-get key\r\n");
+  checkSameAsLegacy("metaget key\r\n");
+  checkSameAsLegacy("get key\n");
+}
+
+TEST(McServerAsciiParser, multiget) {
+  checkSameAsLegacy("get a bb  ccc \r\nget d\r\n");
+  checkSameAsLegacy("gets a b\r\nlease-get c d\r\n");
+}
+
+TEST(McServerAsciiParser, longKeys) {
+  // Not inline, and too long
+  checkSameAsLegacy("get " + std::string(100, 'a') + "\r\n");
+  checkSameAsLegacy("get " + std::string(251, 'a') + " b\r\n");
+  checkSameAsLegacy("set " + std::string(251, 'a') + " 0 0 1\r\nv\r\n");
+}
+
+TEST(McServerAsciiParser, storage) {
+  checkSameAsLegacy("set key 1 2 5\r\nvalue\r\n");
+  checkSameAsLegacy("add key 1 2 5 noreply\r\nvalue\r\n");
+  checkSameAsLegacy("replace key 1 2 0\r\n\r\n");
+  checkSameAsLegacy("append key  1  2  5 \r\nvalue\r\n");
+  checkSameAsLegacy("prepend key 1 2 5\nvalue\n");
+  checkSameAsLegacy("lease-set key -123 1 2 5\r\nvalue\r\n");
+  checkSameAsLegacy("cas key 1 2 5 1234\r\nvalue\r\n");
+  checkSameAsLegacy("set key 0 0 2048\r\n" + std::string(2048, 'v') + "\r\n");
+}
+
+TEST(McServerAsciiParser, other) {
+  checkSameAsLegacy("incr key 10\r\ndecr key 20 noreply\r\n");
+  checkSameAsLegacy("delete key\r\ndelete key 10\r\n");
+  checkSameAsLegacy("delete key noreply\r\ndelete key 10 noreply\r\n");
+  checkSameAsLegacy("touch key 10\r\ntouch key 10 noreply\r\n");
+  checkSameAsLegacy("version\r\nstats\r\nstats detailed  slabs \r\n");
+  checkSameAsLegacy("exec some command\r\nadmin other\r\n");
+  checkSameAsLegacy("shutdown\r\nshutdown 10\r\n");
+  checkSameAsLegacy("flush_all\r\nflush_all 10\r\nflush_regex ^a.*\r\n");
+  checkSameAsLegacy("quit\r\n");
+}
+
+TEST(McServerAsciiParser, errors) {
+  checkSameAsLegacy("get\r\n");
+  checkSameAsLegacy("get a\tb\r\n");
+  checkSameAsLegacy("bogus key\r\n");
+  checkSameAsLegacy("set key 1 2\r\n");
+  checkSameAsLegacy("set key 1 2 3 yesreply\r\nabc\r\n");
+  checkSameAsLegacy("set key 1 2 3\r\nabcd\r\n");
+  checkSameAsLegacy("incr key abc\r\n");
+  checkSameAsLegacy("touch key\r\n");
+  checkSameAsLegacy("exec\r\n");
+}
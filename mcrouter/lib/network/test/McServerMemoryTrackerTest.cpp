@@ -0,0 +1,181 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include <folly/io/async/EventBase.h>
+
+#include "mcrouter/lib/network/AsyncMcServerWorkerOptions.h"
+#include "mcrouter/lib/network/McServerMemoryTracker.h"
+#include "mcrouter/lib/network/McServerSession.h"
+#include "mcrouter/lib/network/test/SessionTestHarness.h"
+
+using namespace facebook::memcache;
+
+namespace {
+
+/* Holds 1 + valueSize bytes until replied */
+std::string setRequest(size_t valueSize) {
+  return "set k 0 0 " + std::to_string(valueSize) + "\r\n" +
+    std::string(valueSize, 'v') + "\r\n";
+}
+
+/* The sessions of one worker, and its tracker */
+struct Worker {
+  folly::EventBase eventBase;
+  McServerSession::Queue sessions;
+  McServerMemoryTracker tracker;
+
+  explicit Worker(const AsyncMcServerWorkerOptions& opts)
+      : tracker(opts, eventBase, sessions) {
+  }
+};
+
+AsyncMcServerWorkerOptions watermarks(size_t high, size_t low) {
+  AsyncMcServerWorkerOptions opts;
+  opts.memoryHighWatermark = high;
+  opts.memoryLowWatermark = low;
+  return opts;
+}
+
+}  // anonymous namespace
+
+TEST(McServerMemoryTracker, pausesLargestSessions) {
+  auto opts = watermarks(1000, 750);
+  Worker worker(opts);
+  SessionTestHarness a(opts, nullptr, nullptr, &worker.tracker,
+                       &worker.sessions);
+  SessionTestHarness b(opts, nullptr, nullptr, &worker.tracker,
+                       &worker.sessions);
+  SessionTestHarness c(opts, nullptr, nullptr, &worker.tracker,
+                       &worker.sessions);
+  a.pause();
+  b.pause();
+  c.pause();
+
+  a.inputPackets(setRequest(100));
+  b.inputPackets(setRequest(300));
+  c.inputPackets(setRequest(400));
+  EXPECT_EQ(803, worker.tracker.bytes());
+  EXPECT_EQ(0, worker.tracker.pausedSessions());
+
+  /* 1054 bytes: pausing b (552) is enough to cover what's over 750 */
+  b.inputPackets(setRequest(250));
+  EXPECT_EQ(1054, worker.tracker.bytes());
+  EXPECT_EQ(1, worker.tracker.pausedSessions());
+  EXPECT_EQ(1, worker.tracker.numPauses());
+  EXPECT_TRUE(b.readsPaused());
+  EXPECT_FALSE(a.readsPaused());
+  EXPECT_FALSE(c.readsPaused());
+}
+
+TEST(McServerMemoryTracker, resumesBelowLowWatermark) {
+  auto opts = watermarks(1000, 750);
+  Worker worker(opts);
+  SessionTestHarness a(opts, nullptr, nullptr, &worker.tracker,
+                       &worker.sessions);
+  SessionTestHarness b(opts, nullptr, nullptr, &worker.tracker,
+                       &worker.sessions);
+  a.pause();
+  b.pause();
+
+  a.inputPackets(setRequest(500));
+  b.inputPackets(setRequest(300), setRequest(250));
+  EXPECT_TRUE(b.readsPaused());
+  EXPECT_FALSE(a.readsPaused());
+
+  /* 752 bytes: below the high watermark, not below the low one */
+  b.resume(1);
+  EXPECT_EQ(752, worker.tracker.bytes());
+  EXPECT_TRUE(b.readsPaused());
+  EXPECT_EQ(1, worker.tracker.pausedSessions());
+
+  b.resume();
+  EXPECT_EQ(501, worker.tracker.bytes());
+  EXPECT_FALSE(b.readsPaused());
+  EXPECT_EQ(0, worker.tracker.pausedSessions());
+  /* No reason to pause again */
+  b.inputPackets(setRequest(100));
+  EXPECT_FALSE(b.readsPaused());
+  EXPECT_EQ(1, worker.tracker.numPauses());
+}
+
+TEST(McServerMemoryTracker, rechecksProcessBytes) {
+  AsyncMcServerWorkerOptions opts;
+  opts.processMemoryHighWatermark = 1000;
+  opts.processMemoryLowWatermark = 750;
+  Worker worker(opts);
+  /* Another worker of the process, without watermarks of its own */
+  AsyncMcServerWorkerOptions otherOpts;
+  Worker other(otherOpts);
+
+  SessionTestHarness busy(otherOpts, nullptr, nullptr, &other.tracker,
+                          &other.sessions);
+  SessionTestHarness t(opts, nullptr, nullptr, &worker.tracker,
+                       &worker.sessions);
+  busy.pause();
+  t.pause();
+
+  busy.inputPackets(setRequest(900));
+  EXPECT_FALSE(busy.readsPaused());
+  /* Over the process watermark: only our own session can be paused */
+  t.inputPackets(setRequest(200));
+  EXPECT_EQ(1102, McServerMemoryTracker::processBytes());
+  EXPECT_TRUE(t.readsPaused());
+
+  /* The other worker's bytes go away without us hearing about it... */
+  busy.resume();
+  EXPECT_EQ(201, McServerMemoryTracker::processBytes());
+  EXPECT_TRUE(t.readsPaused());
+
+  /* ... until the check every kCheckIntervalMs */
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+  while (t.readsPaused() && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(
+      std::chrono::milliseconds(McServerMemoryTracker::kCheckIntervalMs));
+    worker.eventBase.loopOnce(EVLOOP_NONBLOCK);
+  }
+  EXPECT_FALSE(t.readsPaused());
+  EXPECT_EQ(0, worker.tracker.pausedSessions());
+}
+
+TEST(McServerMemoryTracker, closePausedSession) {
+  auto opts = watermarks(1000, 100);
+  Worker worker(opts);
+  SessionTestHarness a(opts, nullptr, nullptr, &worker.tracker,
+                       &worker.sessions);
+  SessionTestHarness b(opts, nullptr, nullptr, &worker.tracker,
+                       &worker.sessions);
+  a.pause();
+  b.pause();
+
+  a.inputPackets(setRequest(600));
+  b.inputPackets(setRequest(500));
+  /* Both needed to cover what's over 100 */
+  EXPECT_TRUE(a.readsPaused());
+  EXPECT_TRUE(b.readsPaused());
+  EXPECT_EQ(2, worker.tracker.pausedSessions());
+
+  /* a goes away while b still holds more than the low watermark */
+  a.closeSession();
+  a.resume();
+  EXPECT_EQ(1, worker.sessions.size());
+  EXPECT_EQ(501, worker.tracker.bytes());
+  EXPECT_EQ(1, worker.tracker.pausedSessions());
+  EXPECT_TRUE(b.readsPaused());
+
+  b.resume();
+  EXPECT_EQ(0, worker.tracker.bytes());
+  EXPECT_EQ(0, worker.tracker.pausedSessions());
+  EXPECT_FALSE(b.readsPaused());
+}
@@ -9,6 +9,8 @@
  */
 #include "MockMc.h"
 
+#include <atomic>
+
 #include <folly/io/IOBuf.h>
 
 #include "mcrouter/lib/McRequest.h"
@@ -16,12 +18,13 @@
 namespace facebook { namespace memcache {
 
 void MockMc::CacheItem::updateLeaseToken() {
-  static uint64_t leaseCounter = 100;
+  /* Shared by the stripes of StripedMockMc */
+  static std::atomic<uint64_t> leaseCounter{100};
   leaseToken = leaseCounter++;
 }
 
 void MockMc::CacheItem::updateCasToken() {
-  static uint64_t casCounter = 100;
+  static std::atomic<uint64_t> casCounter{100};
   casToken = casCounter++;
 }
 
@@ -83,6 +86,15 @@ std::pair<bool, int64_t> MockMc::arith(folly::StringPiece key, int64_t delta) {
   return std::make_pair(true, oldval + delta);
 }
 
+bool MockMc::touch(folly::StringPiece key, uint32_t exptime) {
+  auto it = findUnexpired(key);
+  if (it == citems_.end() || it->second.state != CacheItem::CACHE) {
+    return false;
+  }
+  it->second.item.exptime = exptime > 0 ? exptime + time(nullptr) : 0;
+  return true;
+}
+
 bool MockMc::del(folly::StringPiece key) {
   auto it = findUnexpired(key);
   if (it != citems_.end()) {
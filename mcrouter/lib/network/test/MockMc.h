@@ -25,7 +25,7 @@ class McRequest;
 
 /**
  * Mock Memcached hash table implementation.
- * Not thread-safe.
+ * Not thread-safe, see StripedMockMc.
  */
 class MockMc {
  public:
@@ -76,6 +76,13 @@ class MockMc {
    */
   bool del(folly::StringPiece key);
 
+  /**
+   * Update the expiration time of the item with the given key.
+   *
+   * @return  true iff the item exists in the cache.
+   */
+  bool touch(folly::StringPiece key, uint32_t exptime);
+
   /**
    * Leases
    */
@@ -0,0 +1,148 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "MockMcBehavior.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include <folly/Conv.h>
+#include <folly/io/async/EventBase.h>
+
+namespace facebook { namespace memcache {
+
+namespace {
+
+/* Earliest first for std::*_heap */
+struct LaterDue {
+  template <class T>
+  bool operator()(const T& a, const T& b) const {
+    return a.due != b.due ? a.due > b.due : a.seq > b.seq;
+  }
+};
+
+}  // anonymous namespace
+
+void MockMcBehavior::parseLatency(folly::StringPiece spec) {
+  auto pos = spec.find(':');
+  auto mean = spec;
+  distribution = Latency::CONSTANT;
+  if (pos != std::string::npos) {
+    auto name = spec.subpiece(0, pos);
+    mean = spec.subpiece(pos + 1);
+    if (name == "constant") {
+      distribution = Latency::CONSTANT;
+    } else if (name == "uniform") {
+      distribution = Latency::UNIFORM;
+    } else if (name == "exponential") {
+      distribution = Latency::EXPONENTIAL;
+    } else {
+      throw std::invalid_argument("Unknown latency distribution: " +
+                                  name.str());
+    }
+  }
+  try {
+    latency = std::chrono::microseconds(folly::to<uint64_t>(mean));
+  } catch (const std::range_error& e) {
+    throw std::invalid_argument("Invalid latency: " + spec.str());
+  }
+}
+
+MockMcReplyDelayer::MockMcReplyDelayer(folly::EventBase& eventBase,
+                                       const MockMcBehavior& behavior)
+    : folly::AsyncTimeout(&eventBase),
+      behavior_(behavior),
+      rng_(std::random_device()()) {
+}
+
+MockMcReplyDelayer::~MockMcReplyDelayer() {
+  cancelTimeout();
+  auto heap = std::move(heap_);
+  for (auto& delayed : heap) {
+    McServerRequestContext::reply(std::move(delayed.ctx),
+                                  std::move(delayed.reply));
+  }
+}
+
+MockMcReplyDelayer::Clock::time_point
+MockMcReplyDelayer::dueTime(Clock::time_point now) {
+  auto mean = static_cast<double>(behavior_.latency.count());
+  double us = 0;
+  if (mean > 0) {
+    switch (behavior_.distribution) {
+      case MockMcBehavior::Latency::CONSTANT:
+        us = mean;
+        break;
+      case MockMcBehavior::Latency::UNIFORM:
+        us = std::uniform_real_distribution<double>(0, 2 * mean)(rng_);
+        break;
+      case MockMcBehavior::Latency::EXPONENTIAL:
+        us = std::exponential_distribution<double>(1 / mean)(rng_);
+        break;
+    }
+  }
+  auto due = now + std::chrono::microseconds(static_cast<int64_t>(us));
+
+  const auto& period = behavior_.tkoPeriod;
+  const auto& duration = behavior_.tkoDuration;
+  if (period.count() > 0 && duration.count() > 0) {
+    /* Windows are aligned to the clock, so all workers agree on them */
+    auto sinceEpoch = std::chrono::duration_cast<std::chrono::microseconds>(
+      due.time_since_epoch());
+    auto phase = sinceEpoch % period;
+    if (phase < duration) {
+      due += duration - phase;
+    }
+  }
+  return due;
+}
+
+void MockMcReplyDelayer::reply(McServerRequestContext&& ctx,
+                               McReply&& reply) {
+  auto now = Clock::now();
+  auto due = dueTime(now);
+  if (due <= now) {
+    McServerRequestContext::reply(std::move(ctx), std::move(reply));
+    return;
+  }
+  auto seq = nextSeq_++;
+  heap_.emplace_back(due, seq, std::move(ctx), std::move(reply));
+  std::push_heap(heap_.begin(), heap_.end(), LaterDue());
+  /* Reschedule if it's the new earliest */
+  if (heap_.front().seq == seq || !isScheduled()) {
+    scheduleNext(now);
+  }
+}
+
+void MockMcReplyDelayer::scheduleNext(Clock::time_point now) {
+  if (heap_.empty()) {
+    cancelTimeout();
+    return;
+  }
+  auto wait = heap_.front().due - now;
+  /* Rounded up, so that replies are never early */
+  auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+    wait + std::chrono::milliseconds(1) - std::chrono::nanoseconds(1));
+  scheduleTimeout(static_cast<uint32_t>(std::max<int64_t>(ms.count(), 0)));
+}
+
+void MockMcReplyDelayer::timeoutExpired() noexcept {
+  auto now = Clock::now();
+  while (!heap_.empty() && heap_.front().due <= now) {
+    std::pop_heap(heap_.begin(), heap_.end(), LaterDue());
+    auto delayed = std::move(heap_.back());
+    heap_.pop_back();
+    McServerRequestContext::reply(std::move(delayed.ctx),
+                                  std::move(delayed.reply));
+  }
+  scheduleNext(now);
+}
+
+}}  // facebook::memcache
@@ -0,0 +1,115 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <folly/io/async/AsyncTimeout.h>
+#include <folly/Range.h>
+
+#include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/network/McServerRequestContext.h"
+
+namespace folly {
+class EventBase;
+}
+
+namespace facebook { namespace memcache {
+
+/**
+ * Artificial latency and failures of a mock server, see MockMcOnRequest.
+ * The defaults reply to everything as soon as possible.
+ */
+struct MockMcBehavior {
+  enum class Latency {
+    CONSTANT,
+    /* Between 0 and twice the mean */
+    UNIFORM,
+    EXPONENTIAL,
+  };
+
+  /* Mean latency added to replies */
+  std::chrono::microseconds latency{0};
+  Latency distribution{Latency::CONSTANT};
+
+  /* Fraction of requests replied to with a remote error without being
+     processed */
+  double errorRate{0};
+
+  /* Every tkoPeriod, replies are held for tkoDuration and sent once it
+     ends, so that clients time out and mark the server TKO */
+  std::chrono::milliseconds tkoPeriod{0};
+  std::chrono::milliseconds tkoDuration{0};
+
+  bool delaysReplies() const {
+    return latency.count() > 0 ||
+      (tkoPeriod.count() > 0 && tkoDuration.count() > 0);
+  }
+
+  /**
+   * Parses "<mean us>" or "<distribution>:<mean us>", distribution being
+   * one of constant, uniform, exponential.
+   *
+   * @throw std::invalid_argument
+   */
+  void parseLatency(folly::StringPiece spec);
+};
+
+/**
+ * Sends the replies of one worker according to MockMcBehavior: replies
+ * that have to wait are kept in a heap by due time under a single
+ * timeout. Latencies are rounded up to the EventBase timer resolution
+ * (1ms). Replies still held on destruction are sent right away.
+ *
+ * Worker thread only.
+ */
+class MockMcReplyDelayer : private folly::AsyncTimeout {
+ public:
+  MockMcReplyDelayer(folly::EventBase& eventBase,
+                     const MockMcBehavior& behavior);
+
+  ~MockMcReplyDelayer();
+
+  void reply(McServerRequestContext&& ctx, McReply&& reply);
+
+  size_t numDelayed() const {
+    return heap_.size();
+  }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Delayed {
+    Clock::time_point due;
+    /* Keeps replies due at the same time in order */
+    uint64_t seq;
+    McServerRequestContext ctx;
+    McReply reply;
+
+    Delayed(Clock::time_point d, uint64_t s,
+            McServerRequestContext&& c, McReply&& r)
+        : due(d), seq(s), ctx(std::move(c)), reply(std::move(r)) {
+    }
+  };
+
+  const MockMcBehavior behavior_;
+  std::mt19937_64 rng_;
+  std::vector<Delayed> heap_;
+  uint64_t nextSeq_{0};
+
+  Clock::time_point dueTime(Clock::time_point now);
+  void scheduleNext(Clock::time_point now);
+  void timeoutExpired() noexcept override;
+};
+
+}}  // facebook::memcache
@@ -0,0 +1,359 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <arpa/inet.h>
+
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+
+#include <folly/Conv.h>
+
+#include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/network/McServerRequestContext.h"
+#include "mcrouter/lib/network/test/MockMc.h"
+#include "mcrouter/lib/network/test/MockMcBehavior.h"
+#include "mcrouter/lib/network/test/StripedMockMc.h"
+
+namespace facebook { namespace memcache {
+
+/**
+ * AsyncMcServerWorker onRequest handler with the semantics of our
+ * Memcached fork, backed by MockMc.
+ *
+ * Used by MockMcServer and by anything that needs an in-process
+ * memcached mock (e.g. benchmarks). Handlers of all workers of a server
+ * can share one StripedMockMc, and add latency and failures to replies
+ * (see MockMcBehavior).
+ *
+ * Certain keys with __mockmc__. prefix provide extra functionality
+ * useful for testing.
+ */
+class MockMcOnRequest {
+ public:
+  /**
+   * Items of this handler only, replies are sent right away.
+   */
+  MockMcOnRequest()
+      : mc_(std::make_shared<StripedMockMc>()) {
+  }
+
+  /**
+   * @param mc         items, may be shared with handlers of other workers.
+   * @param eventBase  of the worker, delays replies if behavior says so.
+   */
+  MockMcOnRequest(std::shared_ptr<StripedMockMc> mc,
+                  const MockMcBehavior& behavior,
+                  folly::EventBase& eventBase)
+      : mc_(std::move(mc)),
+        errorRate_(behavior.errorRate),
+        rng_(std::random_device()()) {
+    if (behavior.delaysReplies()) {
+      delayer_ = std::make_shared<MockMcReplyDelayer>(eventBase, behavior);
+    }
+  }
+
+  template <class Operation>
+  void onRequest(McServerRequestContext&& ctx,
+                 McRequest&& req,
+                 Operation op) {
+    if (errorRate_ > 0 && std::bernoulli_distribution(errorRate_)(rng_)) {
+      sendReply(std::move(ctx),
+                McReply(mc_res_remote_error, "mockmc injected error"));
+      return;
+    }
+    handle(std::move(ctx), std::move(req), op);
+  }
+
+ private:
+  std::shared_ptr<StripedMockMc> mc_;
+  double errorRate_{0};
+  std::mt19937_64 rng_;
+  /* nullptr if replies are sent right away */
+  std::shared_ptr<MockMcReplyDelayer> delayer_;
+
+  void sendReply(McServerRequestContext&& ctx, McReply&& reply) {
+    if (delayer_) {
+      delayer_->reply(std::move(ctx), std::move(reply));
+    } else {
+      McServerRequestContext::reply(std::move(ctx), std::move(reply));
+    }
+  }
+
+  template <class Operation>
+  void handle(McServerRequestContext&& ctx,
+              McRequest&& req,
+              Operation) {
+    sendReply(std::move(ctx), McReply(mc_res_remote_error));
+  }
+
+  void handle(McServerRequestContext&& ctx,
+              McRequest&& req,
+              McOperation<mc_op_metaget>) {
+    auto key = req.fullKey().str();
+
+    auto reply = mc_->withKey(key, [&key](MockMc& mc) -> McReply {
+      auto item = mc.get(key);
+      if (!item) {
+        return McReply(mc_res_notfound);
+      }
+
+      auto msg = createMcMsgRef();
+      msg->result = mc_res_found;
+      msg->flags = item->flags;
+      msg->exptime = item->exptime;
+      msg->number = 123; // FIXME: For now, testing age is set to be a constant
+      inet_pton(AF_INET, "127.0.0.1", &msg->ip_addr); // FIXME
+      msg->ipv = 4;
+      return McReply(mc_res_found, std::move(msg));
+    });
+    sendReply(std::move(ctx), std::move(reply));
+  }
+
+  void handle(McServerRequestContext&& ctx,
+              McRequest&& req,
+              McOperation<mc_op_get>) {
+    auto key = req.fullKey();
+
+    if (key == "__mockmc__.want_busy") {
+      auto msg = createMcMsgRef();
+      msg->result = mc_res_busy;
+      msg->err_code = SERVER_ERROR_BUSY;
+      sendReply(std::move(ctx), McReply(mc_res_busy, std::move(msg)));
+      return;
+    } else if (key == "__mockmc__.want_try_again") {
+      sendReply(std::move(ctx), McReply(mc_res_try_again));
+      return;
+    } else if (key.startsWith("__mockmc__.want_timeout")) {
+      size_t timeout = 500;
+      auto argStart = key.find('(');
+      if (argStart != std::string::npos) {
+        timeout = folly::to<size_t>(key.subpiece(argStart + 1,
+                                                 key.size() - argStart - 2));
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(timeout));
+      sendReply(std::move(ctx), McReply(mc_res_timeout));
+      return;
+    }
+
+    auto reply = mc_->withKey(key, [key](MockMc& mc) -> McReply {
+      auto item = mc.get(key);
+      if (!item) {
+        return McReply(mc_res_notfound);
+      }
+      McReply reply(mc_res_found);
+      folly::IOBuf cloned;
+      item->value->cloneInto(cloned);
+      reply.setValue(std::move(cloned));
+      reply.setFlags(item->flags);
+      return reply;
+    });
+    sendReply(std::move(ctx), std::move(reply));
+  }
+
+  void handle(McServerRequestContext&& ctx,
+              McRequest&& req,
+              McOperation<mc_op_lease_get>) {
+    auto key = req.fullKey().str();
+
+    auto reply = mc_->withKey(key, [&key](MockMc& mc) -> McReply {
+      auto out = mc.leaseGet(key);
+      McReply reply(mc_res_found);
+      folly::IOBuf cloned;
+      out.first->value->cloneInto(cloned);
+      reply.setValue(std::move(cloned));
+      reply.setLeaseToken(out.second);
+      if (out.second) {
+        reply.setResult(mc_res_notfound);
+      }
+      return reply;
+    });
+    sendReply(std::move(ctx), std::move(reply));
+  }
+
+  void handle(McServerRequestContext&& ctx,
+              McRequest&& req,
+              McOperation<mc_op_lease_set>) {
+    auto key = req.fullKey().str();
+
+    auto result = mc_->withKey(key, [&key, &req](MockMc& mc) {
+      return mc.leaseSet(key, MockMc::Item(req), req.leaseToken());
+    });
+    switch (result) {
+      case MockMc::LeaseSetResult::NOT_STORED:
+        sendReply(std::move(ctx), McReply(mc_res_notstored));
+        return;
+
+      case MockMc::LeaseSetResult::STORED:
+        sendReply(std::move(ctx), McReply(mc_res_stored));
+        return;
+
+      case MockMc::LeaseSetResult::STALE_STORED:
+        sendReply(std::move(ctx), McReply(mc_res_stalestored));
+        return;
+    }
+  }
+
+  void handle(McServerRequestContext&& ctx,
+              McRequest&& req,
+              McOperation<mc_op_set>) {
+    auto key = req.fullKey().str();
+
+    if (key == "__mockmc__.trigger_server_error") {
+      sendReply(std::move(ctx),
+        McReply(mc_res_remote_error,
+                "returned error msg with binary data \xdd\xab"));
+      return;
+    }
+
+    mc_->withKey(key, [&key, &req](MockMc& mc) {
+      mc.set(key, MockMc::Item(req));
+    });
+    sendReply(std::move(ctx), McReply(mc_res_stored));
+  }
+
+  void handle(McServerRequestContext&& ctx,
+              McRequest&& req,
+              McOperation<mc_op_add>) {
+    auto key = req.fullKey().str();
+
+    if (mc_->withKey(key, [&key, &req](MockMc& mc) {
+          return mc.add(key, MockMc::Item(req));
+        })) {
+      sendReply(std::move(ctx), McReply(mc_res_stored));
+    } else {
+      sendReply(std::move(ctx), McReply(mc_res_notstored));
+    }
+  }
+
+  void handle(McServerRequestContext&& ctx,
+              McRequest&& req,
+              McOperation<mc_op_replace>) {
+    auto key = req.fullKey().str();
+
+    if (mc_->withKey(key, [&key, &req](MockMc& mc) {
+          return mc.replace(key, MockMc::Item(req));
+        })) {
+      sendReply(std::move(ctx), McReply(mc_res_stored));
+    } else {
+      sendReply(std::move(ctx), McReply(mc_res_notstored));
+    }
+  }
+
+  void handle(McServerRequestContext&& ctx,
+              McRequest&& req,
+              McOperation<mc_op_delete>) {
+    auto key = req.fullKey().str();
+
+    if (mc_->withKey(key, [&key](MockMc& mc) { return mc.del(key); })) {
+      sendReply(std::move(ctx), McReply(mc_res_deleted));
+    } else {
+      sendReply(std::move(ctx), McReply(mc_res_notfound));
+    }
+  }
+
+  void handle(McServerRequestContext&& ctx,
+              McRequest&& req,
+              McOperation<mc_op_touch>) {
+    auto key = req.fullKey().str();
+
+    if (mc_->withKey(key, [&key, &req](MockMc& mc) {
+          return mc.touch(key, req.exptime());
+        })) {
+      sendReply(std::move(ctx), McReply(mc_res_touched));
+    } else {
+      sendReply(std::move(ctx), McReply(mc_res_notfound));
+    }
+  }
+
+  void arith(McServerRequestContext&& ctx, folly::StringPiece key,
+             int64_t delta) {
+    auto p = mc_->withKey(key, [key, delta](MockMc& mc) {
+      return mc.arith(key, delta);
+    });
+    if (!p.first) {
+      sendReply(std::move(ctx), McReply(mc_res_notfound));
+    } else {
+      McReply reply(mc_res_stored);
+      reply.setDelta(p.second);
+      sendReply(std::move(ctx), std::move(reply));
+    }
+  }
+
+  void handle(McServerRequestContext&& ctx,
+              McRequest&& req,
+              McOperation<mc_op_incr>) {
+    auto key = req.fullKey().str();
+    arith(std::move(ctx), key, req.delta());
+  }
+
+  void handle(McServerRequestContext&& ctx,
+              McRequest&& req,
+              McOperation<mc_op_decr>) {
+    auto key = req.fullKey().str();
+    arith(std::move(ctx), key, -req.delta());
+  }
+
+  void handle(McServerRequestContext&& ctx,
+              McRequest&& req,
+              McOperation<mc_op_flushall>) {
+    std::this_thread::sleep_for(std::chrono::seconds(req.number()));
+    mc_->flushAll();
+    McReply reply(mc_res_ok);
+    sendReply(std::move(ctx), std::move(reply));
+  }
+
+  void handle(McServerRequestContext&& ctx,
+              McRequest&& req,
+              McOperation<mc_op_gets>) {
+    auto key = req.fullKey().str();
+    auto reply = mc_->withKey(key, [&key](MockMc& mc) -> McReply {
+      auto p = mc.gets(key);
+      if (!p.first) {
+        return McReply(mc_res_notfound);
+      }
+      McReply reply(mc_res_found);
+      folly::IOBuf cloned;
+      p.first->value->cloneInto(cloned);
+      reply.setValue(std::move(cloned));
+      reply.setFlags(p.first->flags);
+      reply.setCas(p.second);
+      return reply;
+    });
+    sendReply(std::move(ctx), std::move(reply));
+  }
+
+  void handle(McServerRequestContext&& ctx,
+              McRequest&& req,
+              McOperation<mc_op_cas>) {
+    auto key = req.fullKey().str();
+    auto ret = mc_->withKey(key, [&key, &req](MockMc& mc) {
+      return mc.cas(key, MockMc::Item(req), req.cas());
+    });
+    switch (ret) {
+      case MockMc::CasResult::NOT_FOUND:
+        sendReply(std::move(ctx), McReply(mc_res_notfound));
+        break;
+      case MockMc::CasResult::EXISTS:
+        sendReply(std::move(ctx), McReply(mc_res_exists));
+        break;
+      case MockMc::CasResult::STORED:
+        sendReply(std::move(ctx), McReply(mc_res_stored));
+        break;
+    }
+  }
+};
+
+}}  // facebook::memcache
@@ -9,17 +9,19 @@
  */
 #include <signal.h>
 
+#include <memory>
 #include <thread>
 
 #include <glog/logging.h>
 
-#include "mcrouter/lib/McOperation.h"
-#include "mcrouter/lib/McReply.h"
-#include "mcrouter/lib/McRequest.h"
+#include <folly/Conv.h>
+#include <folly/String.h>
+
 #include "mcrouter/lib/network/AsyncMcServer.h"
 #include "mcrouter/lib/network/AsyncMcServerWorker.h"
-#include "mcrouter/lib/network/McServerRequestContext.h"
-#include "mcrouter/lib/network/test/MockMc.h"
+#include "mcrouter/lib/network/test/MockMcBehavior.h"
+#include "mcrouter/lib/network/test/MockMcOnRequest.h"
+#include "mcrouter/lib/network/test/StripedMockMc.h"
 
 /**
  * Mock Memcached implementation.
@@ -34,264 +36,16 @@
  *
  * The intention is to have the same semantics as our Memcached fork.
  *
- * Certain keys with __mockmc__. prefix provide extra functionality
- * useful for testing.
+ * The request handling itself lives in MockMcOnRequest. All worker
+ * threads share one lock-striped store, so it can also serve as a fast
+ * backend for benchmarks, with artificial latency, errors and TKO periods.
  */
 
 using facebook::memcache::AsyncMcServer;
 using facebook::memcache::AsyncMcServerWorker;
-using facebook::memcache::McOperation;
-using facebook::memcache::McReply;
-using facebook::memcache::McRequest;
-using facebook::memcache::McServerRequestContext;
-using facebook::memcache::MockMc;
-using facebook::memcache::createMcMsgRef;
-
-class MockMcOnRequest {
- public:
-  template <class Operation>
-  void onRequest(McServerRequestContext&& ctx,
-                 McRequest&& req,
-                 Operation) {
-    McServerRequestContext::reply(std::move(ctx), McReply(mc_res_remote_error));
-  }
-
-  void onRequest(McServerRequestContext&& ctx,
-                 McRequest&& req,
-                 McOperation<mc_op_metaget>) {
-    auto key = req.fullKey().str();
-
-    auto item = mc_.get(key);
-    if (!item) {
-      McServerRequestContext::reply(std::move(ctx), McReply(mc_res_notfound));
-      return;
-    }
-
-    auto msg = createMcMsgRef();
-    msg->result = mc_res_found;
-    msg->flags = item->flags;
-    msg->exptime = item->exptime;
-    msg->number = 123; // FIXME: For now, testing age is set to be a constant
-    inet_pton(AF_INET, "127.0.0.1", &msg->ip_addr); // FIXME
-    msg->ipv = 4;
-
-    McServerRequestContext::reply(std::move(ctx),
-                                  McReply(mc_res_found, std::move(msg)));
-  }
-
-  void onRequest(McServerRequestContext&& ctx,
-                 McRequest&& req,
-                 McOperation<mc_op_get>) {
-    auto key = req.fullKey();
-
-    if (key == "__mockmc__.want_busy") {
-      auto msg = createMcMsgRef();
-      msg->result = mc_res_busy;
-      msg->err_code = SERVER_ERROR_BUSY;
-      McServerRequestContext::reply(std::move(ctx),
-                                    McReply(mc_res_busy, std::move(msg)));
-      return;
-    } else if (key == "__mockmc__.want_try_again") {
-      McServerRequestContext::reply(std::move(ctx), McReply(mc_res_try_again));
-      return;
-    } else if (key.startsWith("__mockmc__.want_timeout")) {
-      size_t timeout = 500;
-      auto argStart = key.find('(');
-      if (argStart != std::string::npos) {
-        timeout = folly::to<size_t>(key.subpiece(argStart + 1,
-                                                 key.size() - argStart - 2));
-      }
-      std::this_thread::sleep_for(std::chrono::milliseconds(timeout));
-      McServerRequestContext::reply(std::move(ctx), McReply(mc_res_timeout));
-      return;
-    }
-
-    auto item = mc_.get(key);
-    if (!item) {
-      McServerRequestContext::reply(std::move(ctx), McReply(mc_res_notfound));
-    } else {
-      McReply reply(mc_res_found);
-      folly::IOBuf cloned;
-      item->value->cloneInto(cloned);
-      reply.setValue(std::move(cloned));
-      reply.setFlags(item->flags);
-      McServerRequestContext::reply(std::move(ctx), std::move(reply));
-    }
-  }
-
-  void onRequest(McServerRequestContext&& ctx,
-                 McRequest&& req,
-                 McOperation<mc_op_lease_get>) {
-    auto key = req.fullKey().str();
-
-    auto out = mc_.leaseGet(key);
-    McReply reply(mc_res_found);
-    folly::IOBuf cloned;
-    out.first->value->cloneInto(cloned);
-    reply.setValue(std::move(cloned));
-    reply.setLeaseToken(out.second);
-    if (out.second) {
-      reply.setResult(mc_res_notfound);
-    }
-    McServerRequestContext::reply(std::move(ctx), std::move(reply));
-  }
-
-  void onRequest(McServerRequestContext&& ctx,
-                 McRequest&& req,
-                 McOperation<mc_op_lease_set>) {
-    auto key = req.fullKey().str();
-
-    switch (mc_.leaseSet(key, MockMc::Item(req), req.leaseToken())) {
-      case MockMc::LeaseSetResult::NOT_STORED:
-        McServerRequestContext::reply(std::move(ctx),
-                                      McReply(mc_res_notstored));
-        return;
-
-      case MockMc::LeaseSetResult::STORED:
-        McServerRequestContext::reply(std::move(ctx), McReply(mc_res_stored));
-        return;
-
-      case MockMc::LeaseSetResult::STALE_STORED:
-        McServerRequestContext::reply(std::move(ctx),
-                                      McReply(mc_res_stalestored));
-        return;
-    }
-  }
-
-  void onRequest(McServerRequestContext&& ctx,
-                 McRequest&& req,
-                 McOperation<mc_op_set>) {
-    auto key = req.fullKey().str();
-
-    if (key == "__mockmc__.trigger_server_error") {
-      McServerRequestContext::reply(std::move(ctx),
-        McReply(mc_res_remote_error,
-                "returned error msg with binary data \xdd\xab"));
-      return;
-    }
-
-    mc_.set(key, MockMc::Item(req));
-    McServerRequestContext::reply(std::move(ctx), McReply(mc_res_stored));
-  }
-
-  void onRequest(McServerRequestContext&& ctx,
-                 McRequest&& req,
-                 McOperation<mc_op_add>) {
-    auto key = req.fullKey().str();
-
-    if (mc_.add(key, MockMc::Item(req))) {
-      McServerRequestContext::reply(std::move(ctx), McReply(mc_res_stored));
-    } else {
-      McServerRequestContext::reply(std::move(ctx), McReply(mc_res_notstored));
-    }
-  }
-
-  void onRequest(McServerRequestContext&& ctx,
-                 McRequest&& req,
-                 McOperation<mc_op_replace>) {
-    auto key = req.fullKey().str();
-
-    if (mc_.replace(key, MockMc::Item(req))) {
-      McServerRequestContext::reply(std::move(ctx), McReply(mc_res_stored));
-    } else {
-      McServerRequestContext::reply(std::move(ctx), McReply(mc_res_notstored));
-    }
-  }
-
-  void onRequest(McServerRequestContext&& ctx,
-                 McRequest&& req,
-                 McOperation<mc_op_delete>) {
-    auto key = req.fullKey().str();
-
-    if (mc_.del(key)) {
-      McServerRequestContext::reply(std::move(ctx), McReply(mc_res_deleted));
-    } else {
-      McServerRequestContext::reply(std::move(ctx), McReply(mc_res_notfound));
-    }
-  }
-
-  void onRequest(McServerRequestContext&& ctx,
-                 McRequest&& req,
-                 McOperation<mc_op_incr>) {
-    auto key = req.fullKey().str();
-    auto p = mc_.arith(key, req.delta());
-    if (!p.first) {
-      McServerRequestContext::reply(std::move(ctx), McReply(mc_res_notfound));
-    } else {
-      McReply reply(mc_res_stored);
-      reply.setDelta(p.second);
-      McServerRequestContext::reply(std::move(ctx), std::move(reply));
-    }
-  }
-
-  void onRequest(McServerRequestContext&& ctx,
-                 McRequest&& req,
-                 McOperation<mc_op_decr>) {
-    auto key = req.fullKey().str();
-    auto p = mc_.arith(key, -req.delta());
-    if (!p.first) {
-      McServerRequestContext::reply(std::move(ctx), McReply(mc_res_notfound));
-    } else {
-      McReply reply(mc_res_stored);
-      reply.setDelta(p.second);
-      McServerRequestContext::reply(std::move(ctx), std::move(reply));
-    }
-  }
-
-  void onRequest(McServerRequestContext&& ctx,
-                 McRequest&& req,
-                 McOperation<mc_op_flushall>) {
-    std::this_thread::sleep_for(std::chrono::seconds(req.number()));
-    mc_.flushAll();
-    McReply reply(mc_res_ok);
-    McServerRequestContext::reply(std::move(ctx), std::move(reply));
-  }
-
-  void onRequest(McServerRequestContext&& ctx,
-                 McRequest&& req,
-                 McOperation<mc_op_gets>) {
-    auto key = req.fullKey().str();
-    auto p = mc_.gets(key);
-    if (!p.first) {
-      McServerRequestContext::reply(std::move(ctx), McReply(mc_res_notfound));
-    } else {
-      McReply reply(mc_res_found);
-      folly::IOBuf cloned;
-      p.first->value->cloneInto(cloned);
-      reply.setValue(std::move(cloned));
-      reply.setFlags(p.first->flags);
-      reply.setCas(p.second);
-      McServerRequestContext::reply(std::move(ctx), std::move(reply));
-    }
-  }
-
-  void onRequest(McServerRequestContext&& ctx,
-                 McRequest&& req,
-                 McOperation<mc_op_cas>) {
-    auto key = req.fullKey().str();
-    auto ret = mc_.cas(key, MockMc::Item(req), req.cas());
-    switch (ret) {
-      case MockMc::CasResult::NOT_FOUND:
-        McServerRequestContext::reply(std::move(ctx), McReply(mc_res_notfound));
-        break;
-      case MockMc::CasResult::EXISTS:
-        McServerRequestContext::reply(std::move(ctx), McReply(mc_res_exists));
-        break;
-      case MockMc::CasResult::STORED:
-        McServerRequestContext::reply(std::move(ctx), McReply(mc_res_stored));
-        break;
-    }
-  }
-
- private:
-  MockMc mc_;
-};
-
-void serverLoop(size_t threadId, folly::EventBase& evb,
-                AsyncMcServerWorker& worker) {
-  worker.setOnRequest(MockMcOnRequest());
-  evb.loop();
-}
+using facebook::memcache::MockMcBehavior;
+using facebook::memcache::MockMcOnRequest;
+using facebook::memcache::StripedMockMc;
 
 void usage(char** argv) {
   std::cerr <<
@@ -299,11 +53,29 @@ void usage(char** argv) {
     "  -P <port>      TCP port on which to listen\n"
     "  -t <fd>        TCP listen sock fd\n"
     "  -s             Use ssl\n"
+    "  -T <threads>   Number of worker threads (default 1)\n"
+    "  -S <stripes>   Number of lock stripes of the store (default 1)\n"
+    "  -l <latency>   Latency added to replies, [<dist>:]<mean us>,\n"
+    "                 dist is constant (default), uniform or exponential\n"
+    "  -e <rate>      Fraction of requests failed with a remote error\n"
+    "  -k <ms>:<ms>   Every first ms, hold replies for the second ms\n"
     "Usage:\n"
     "  $ " << argv[0] << " -p 15213\n";
   exit(1);
 }
 
+void parseTko(folly::StringPiece spec, MockMcBehavior& behavior) {
+  folly::StringPiece period;
+  folly::StringPiece duration;
+  if (!folly::split(':', spec, period, duration)) {
+    throw std::invalid_argument("TKO spec must be <period ms>:<duration ms>");
+  }
+  behavior.tkoPeriod = std::chrono::milliseconds(
+    folly::to<uint32_t>(period));
+  behavior.tkoDuration = std::chrono::milliseconds(
+    folly::to<uint32_t>(duration));
+}
+
 int main(int argc, char** argv) {
   google::InitGoogleLogging(argv[0]);
 
@@ -312,22 +84,47 @@ int main(int argc, char** argv) {
 
   bool ssl = false;
   uint16_t port = 0;
+  size_t numStripes = 1;
+  MockMcBehavior behavior;
 
   int c;
-  while ((c = getopt(argc, argv, "P:t:sh")) >= 0) {
-    switch (c) {
-      case 's':
-        ssl = true;
-        break;
-      case 'P':
-        port = folly::to<uint16_t>(optarg);
-        break;
-      case 't':
-        opts.existingSocketFd = folly::to<int>(optarg);
-        break;
-      default:
-        usage(argv);
+  try {
+    while ((c = getopt(argc, argv, "P:t:sT:S:l:e:k:h")) >= 0) {
+      switch (c) {
+        case 's':
+          ssl = true;
+          break;
+        case 'P':
+          port = folly::to<uint16_t>(optarg);
+          break;
+        case 't':
+          opts.existingSocketFd = folly::to<int>(optarg);
+          break;
+        case 'T':
+          opts.numThreads = folly::to<size_t>(optarg);
+          break;
+        case 'S':
+          numStripes = folly::to<size_t>(optarg);
+          break;
+        case 'l':
+          behavior.parseLatency(optarg);
+          break;
+        case 'e':
+          behavior.errorRate = folly::to<double>(optarg);
+          break;
+        case 'k':
+          parseTko(optarg, behavior);
+          break;
+        default:
+          usage(argv);
+      }
     }
+  } catch (const std::exception& e) {
+    std::cerr << "-" << static_cast<char>(c) << ": " << e.what() << "\n";
+    usage(argv);
+  }
+  if (opts.numThreads == 0 || numStripes == 0) {
+    usage(argv);
   }
 
   if (ssl) {
@@ -347,7 +144,12 @@ int main(int argc, char** argv) {
     LOG(INFO) << "Starting server";
     AsyncMcServer server(opts);
     server.installShutdownHandler({SIGINT, SIGTERM});
-    server.spawn(&serverLoop);
+    auto mc = std::make_shared<StripedMockMc>(numStripes);
+    server.spawn([mc, behavior](size_t threadId, folly::EventBase& evb,
+                                AsyncMcServerWorker& worker) {
+      worker.setOnRequest(MockMcOnRequest(mc, behavior, evb));
+      evb.loop();
+    });
     server.join();
     LOG(INFO) << "Shutting down";
   } catch (const std::exception& e) {
@@ -0,0 +1,430 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+#include <folly/io/IOBuf.h>
+#include <folly/Optional.h>
+
+#include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/network/ClientMcParser.h"
+#include "mcrouter/lib/network/McSerializedRequest.h"
+#include "mcrouter/lib/network/ServerMcParser.h"
+#include "mcrouter/lib/network/UmbrellaProtocol.h"
+#include "mcrouter/lib/network/WriteBuffer.h"
+
+/**
+ * Parse and serialize cost of both protocols, one iteration is one message.
+ *
+ * Parsers are fed batches of messages as they'd come from one read:
+ *   requests (server side): McServerAsciiParser, the legacy mc_parser
+ *     and umbrellaParseRequest, for small gets and sets, 32 key multigets
+ *     and 64K sets;
+ *   replies (client side): McAsciiParser, the legacy mc_parser and
+ *     umbrella, for small hits, misses and 64K hits.
+ * Serializers produce one message per iteration: McSerializedRequest
+ * for requests, AsciiSerializedReply and UmbrellaSerializedMessage for
+ * replies. Values are referenced by the serializers, so serialize
+ * numbers don't include copying them.
+ *
+ * Wire data is produced by our own serializers, so both sides always
+ * agree on the format. After the timings, messages/s and GB/s of each
+ * benchmark are printed.
+ */
+
+using namespace facebook::memcache;
+
+namespace {
+
+size_t x = 0;
+
+constexpr size_t kMessagesPerBatch = 64;
+constexpr size_t kLargeMessagesPerBatch = 4;
+constexpr size_t kMultigetKeys = 32;
+constexpr size_t kSmallValue = 100;
+constexpr size_t kLargeValue = 64 * 1024;
+
+std::string flatten(const struct iovec* iovs, size_t niovs) {
+  std::string out;
+  for (size_t i = 0; i < niovs; ++i) {
+    out.append(static_cast<const char*>(iovs[i].iov_base), iovs[i].iov_len);
+  }
+  return out;
+}
+
+std::string makeKey(size_t i) {
+  return folly::to<std::string>("test:benchmark:key:", i);
+}
+
+McRequest makeRequest(size_t i, size_t valueSize) {
+  McRequest req(makeKey(i));
+  if (valueSize) {
+    req.setValue(folly::IOBuf(folly::IOBuf::COPY_BUFFER,
+                              std::string(valueSize, 'v')));
+    req.setFlags(17);
+  }
+  return req;
+}
+
+McReply makeReply(mc_res_t result, size_t valueSize) {
+  McReply reply(result);
+  if (valueSize) {
+    reply.setValue(folly::IOBuf(folly::IOBuf::COPY_BUFFER,
+                                std::string(valueSize, 'v')));
+    reply.setFlags(17);
+  }
+  return reply;
+}
+
+template <int Op>
+std::string serializeRequest(const McRequest& req, mc_protocol_t protocol,
+                             uint64_t reqid) {
+  McSerializedRequest serialized(req, McOperation<Op>(), reqid, protocol);
+  CHECK(serialized.serializationResult() == McSerializedRequest::Result::OK);
+  return flatten(serialized.getIovs(), serialized.getIovsCount());
+}
+
+std::string serializeReply(const McReply& reply, mc_op_t op, size_t i,
+                           mc_protocol_t protocol) {
+  struct iovec* iovs;
+  size_t niovs;
+  if (protocol == mc_ascii_protocol) {
+    AsciiSerializedReply serialized;
+    folly::Optional<folly::IOBuf> key(
+      folly::IOBuf(folly::IOBuf::COPY_BUFFER, makeKey(i)));
+    /* A get miss is empty, the caller adds END */
+    if (!serialized.prepare(reply, op, key, iovs, niovs)) {
+      return std::string();
+    }
+    return flatten(iovs, niovs);
+  }
+  UmbrellaSerializedMessage serialized;
+  CHECK(serialized.prepare(reply, op, i + 1, iovs, niovs));
+  return flatten(iovs, niovs);
+}
+
+template <class Parser>
+void feed(Parser& parser, folly::StringPiece range) {
+  while (!range.empty()) {
+    auto buffer = parser.getReadBuffer();
+    auto readLen = std::min(buffer.second, range.size());
+    memcpy(buffer.first, range.begin(), readLen);
+    parser.readDataAvailable(readLen);
+    range.advance(readLen);
+  }
+}
+
+class RequestCounter {
+ public:
+  explicit RequestCounter(bool newAsciiParser)
+    : parser_(*this, 0, 4096, 1 << 20, newAsciiParser) {
+  }
+
+  void feed(folly::StringPiece data) {
+    ::feed(parser_, data);
+  }
+
+  void requestReady(McRequest&& req, mc_op_t operation, uint64_t reqid,
+                    mc_res_t result, bool noreply) {
+    x += req.fullKey().size();
+  }
+
+  void typedRequestReady(uint64_t typeId, const folly::IOBuf& reqBody,
+                         uint64_t reqid) {
+    LOG(FATAL) << "Unexpected typed request";
+  }
+
+  void parseError(mc_res_t result, folly::StringPiece reason) {
+    LOG(FATAL) << "Parse error: " << reason;
+  }
+
+ private:
+  ServerMcParser<RequestCounter> parser_;
+};
+
+template <int Op>
+class ReplyCounter {
+ public:
+  explicit ReplyCounter(bool newAsciiParser)
+    : parser_(*this, 0, 4096, 1 << 20, newAsciiParser, newAsciiParser) {
+  }
+
+  void feed(folly::StringPiece data) {
+    ::feed(parser_, data);
+  }
+
+  bool nextReplyAvailable(uint64_t reqId) {
+    parser_.template expectNext<McOperation<Op>, McRequest>();
+    return true;
+  }
+
+  void replyReady(McReply&& reply, uint64_t reqId) {
+    x += reply.result();
+  }
+
+  void parseError(mc_res_t result, folly::StringPiece reason) {
+    LOG(FATAL) << "Parse error: " << reason;
+  }
+
+ private:
+  ClientMcParser<ReplyCounter<Op>> parser_;
+};
+
+/**
+ * One benchmark: run(iters) handles at least iters messages of
+ * bytesPerMessage bytes each.
+ */
+struct Case {
+  const char* name;
+  std::function<void(size_t)> run;
+  double bytesPerMessage;
+};
+
+std::vector<Case>& cases() {
+  static std::vector<Case> cases;
+  return cases;
+}
+
+void addCase(const char* name, std::function<void(size_t)> run,
+             double bytesPerMessage) {
+  cases().push_back({name, run, bytesPerMessage});
+  folly::addBenchmark(__FILE__, name, [run](unsigned iters) {
+    run(iters);
+    return iters;
+  });
+}
+
+/* Parsers loop over the batch, so the last batch may overshoot iters */
+template <class Counter>
+void addParseCase(const char* name, std::function<Counter*()> makeCounter,
+                  std::string batch, size_t messagesPerBatch) {
+  auto run = [makeCounter, batch, messagesPerBatch](size_t iters) {
+    folly::BenchmarkSuspender braces;
+    std::unique_ptr<Counter> counter(makeCounter());
+    braces.dismiss();
+    for (size_t done = 0; done < iters; done += messagesPerBatch) {
+      counter->feed(batch);
+    }
+  };
+  addCase(name, run, static_cast<double>(batch.size()) / messagesPerBatch);
+}
+
+template <int Op>
+void addRequestParseCase(const char* name, mc_protocol_t protocol,
+                         bool newAsciiParser, size_t valueSize,
+                         size_t messages) {
+  std::string batch;
+  for (size_t i = 0; i < messages; ++i) {
+    batch += serializeRequest<Op>(makeRequest(i, valueSize), protocol, i + 1);
+  }
+  addParseCase<RequestCounter>(
+    name, [newAsciiParser]() { return new RequestCounter(newAsciiParser); },
+    std::move(batch), messages);
+}
+
+void addAsciiMultigetParseCase(const char* name, bool newAsciiParser) {
+  std::string batch;
+  for (size_t i = 0; i < kMessagesPerBatch / kMultigetKeys; ++i) {
+    batch += "get";
+    for (size_t k = 0; k < kMultigetKeys; ++k) {
+      batch += " " + makeKey(i * kMultigetKeys + k);
+    }
+    batch += "\r\n";
+  }
+  addParseCase<RequestCounter>(
+    name, [newAsciiParser]() { return new RequestCounter(newAsciiParser); },
+    std::move(batch), kMessagesPerBatch);
+}
+
+template <int Op>
+void addReplyParseCase(const char* name, mc_protocol_t protocol,
+                       bool newAsciiParser, const McReply& reply,
+                       size_t messages) {
+  std::string batch;
+  for (size_t i = 0; i < messages; ++i) {
+    batch += serializeReply(reply, static_cast<mc_op_t>(Op), i, protocol);
+    if (protocol == mc_ascii_protocol &&
+        (Op == mc_op_get || Op == mc_op_gets)) {
+      batch += "END\r\n";
+    }
+  }
+  addParseCase<ReplyCounter<Op>>(
+    name, [newAsciiParser]() { return new ReplyCounter<Op>(newAsciiParser); },
+    std::move(batch), messages);
+}
+
+template <int Op>
+void addRequestSerializeCase(const char* name, mc_protocol_t protocol,
+                             size_t valueSize) {
+  auto req = std::make_shared<McRequest>(makeRequest(0, valueSize));
+  auto bytes = serializeRequest<Op>(*req, protocol, 1).size();
+  addCase(name, [req, protocol](size_t iters) {
+    for (size_t i = 0; i < iters; ++i) {
+      McSerializedRequest serialized(*req, McOperation<Op>(), i, protocol);
+      x += serialized.getIovsCount();
+    }
+  }, bytes);
+}
+
+void addReplySerializeCase(const char* name, mc_protocol_t protocol,
+                           size_t valueSize) {
+  auto reply = std::make_shared<McReply>(makeReply(mc_res_found, valueSize));
+  auto bytes = serializeReply(*reply, mc_op_get, 0, protocol).size();
+  if (protocol == mc_ascii_protocol) {
+    addCase(name, [reply](size_t iters) {
+      folly::Optional<folly::IOBuf> key(
+        folly::IOBuf(folly::IOBuf::COPY_BUFFER, makeKey(0)));
+      AsciiSerializedReply serialized;
+      for (size_t i = 0; i < iters; ++i) {
+        struct iovec* iovs;
+        size_t niovs;
+        serialized.prepare(*reply, mc_op_get, key, iovs, niovs);
+        x += niovs;
+        serialized.clear();
+      }
+    }, bytes);
+  } else {
+    addCase(name, [reply](size_t iters) {
+      UmbrellaSerializedMessage serialized;
+      for (size_t i = 0; i < iters; ++i) {
+        struct iovec* iovs;
+        size_t niovs;
+        serialized.prepare(*reply, mc_op_get, i, iovs, niovs);
+        x += niovs;
+        serialized.clear();
+      }
+    }, bytes);
+  }
+}
+
+void addCases() {
+  auto ascii = mc_ascii_protocol;
+  auto umbrella = mc_umbrella_protocol;
+
+  addRequestParseCase<mc_op_get>(
+    "parse_request_ascii_get", ascii, true, 0, kMessagesPerBatch);
+  addRequestParseCase<mc_op_get>(
+    "parse_request_ascii_legacy_get", ascii, false, 0, kMessagesPerBatch);
+  addRequestParseCase<mc_op_get>(
+    "parse_request_umbrella_get", umbrella, true, 0, kMessagesPerBatch);
+  addAsciiMultigetParseCase("parse_request_ascii_multiget", true);
+  addAsciiMultigetParseCase("parse_request_ascii_legacy_multiget", false);
+  addRequestParseCase<mc_op_set>(
+    "parse_request_ascii_set", ascii, true, kSmallValue, kMessagesPerBatch);
+  addRequestParseCase<mc_op_set>(
+    "parse_request_ascii_legacy_set", ascii, false, kSmallValue,
+    kMessagesPerBatch);
+  addRequestParseCase<mc_op_set>(
+    "parse_request_umbrella_set", umbrella, true, kSmallValue,
+    kMessagesPerBatch);
+  addRequestParseCase<mc_op_set>(
+    "parse_request_ascii_set_64K", ascii, true, kLargeValue,
+    kLargeMessagesPerBatch);
+  addRequestParseCase<mc_op_set>(
+    "parse_request_ascii_legacy_set_64K", ascii, false, kLargeValue,
+    kLargeMessagesPerBatch);
+  addRequestParseCase<mc_op_set>(
+    "parse_request_umbrella_set_64K", umbrella, true, kLargeValue,
+    kLargeMessagesPerBatch);
+
+  auto hit = makeReply(mc_res_found, kSmallValue);
+  auto miss = makeReply(mc_res_notfound, 0);
+  auto largeHit = makeReply(mc_res_found, kLargeValue);
+  addReplyParseCase<mc_op_get>(
+    "parse_reply_ascii_hit", ascii, true, hit, kMessagesPerBatch);
+  addReplyParseCase<mc_op_get>(
+    "parse_reply_ascii_legacy_hit", ascii, false, hit, kMessagesPerBatch);
+  addReplyParseCase<mc_op_get>(
+    "parse_reply_umbrella_hit", umbrella, true, hit, kMessagesPerBatch);
+  addReplyParseCase<mc_op_get>(
+    "parse_reply_ascii_miss", ascii, true, miss, kMessagesPerBatch);
+  addReplyParseCase<mc_op_get>(
+    "parse_reply_ascii_legacy_miss", ascii, false, miss, kMessagesPerBatch);
+  addReplyParseCase<mc_op_get>(
+    "parse_reply_umbrella_miss", umbrella, true, miss, kMessagesPerBatch);
+  addReplyParseCase<mc_op_get>(
+    "parse_reply_ascii_hit_64K", ascii, true, largeHit,
+    kLargeMessagesPerBatch);
+  addReplyParseCase<mc_op_get>(
+    "parse_reply_ascii_legacy_hit_64K", ascii, false, largeHit,
+    kLargeMessagesPerBatch);
+  addReplyParseCase<mc_op_get>(
+    "parse_reply_umbrella_hit_64K", umbrella, true, largeHit,
+    kLargeMessagesPerBatch);
+
+  addRequestSerializeCase<mc_op_get>("serialize_request_ascii_get", ascii, 0);
+  addRequestSerializeCase<mc_op_get>(
+    "serialize_request_umbrella_get", umbrella, 0);
+  addRequestSerializeCase<mc_op_set>(
+    "serialize_request_ascii_set", ascii, kSmallValue);
+  addRequestSerializeCase<mc_op_set>(
+    "serialize_request_umbrella_set", umbrella, kSmallValue);
+  addRequestSerializeCase<mc_op_set>(
+    "serialize_request_ascii_set_64K", ascii, kLargeValue);
+  addRequestSerializeCase<mc_op_set>(
+    "serialize_request_umbrella_set_64K", umbrella, kLargeValue);
+
+  addReplySerializeCase("serialize_reply_ascii_hit", ascii, kSmallValue);
+  addReplySerializeCase("serialize_reply_umbrella_hit", umbrella, kSmallValue);
+  addReplySerializeCase("serialize_reply_ascii_hit_64K", ascii, kLargeValue);
+  addReplySerializeCase(
+    "serialize_reply_umbrella_hit_64K", umbrella, kLargeValue);
+}
+
+void printThroughput() {
+  using Clock = std::chrono::steady_clock;
+  const std::chrono::milliseconds kMinTime(200);
+
+  printf("%-40s %14s %10s\n", "throughput", "msgs/s", "GB/s");
+  for (const auto& c : cases()) {
+    size_t iters = 1;
+    double seconds = 0;
+    while (true) {
+      auto start = Clock::now();
+      c.run(iters);
+      auto elapsed = Clock::now() - start;
+      if (elapsed >= kMinTime) {
+        seconds = std::chrono::duration<double>(elapsed).count();
+        break;
+      }
+      iters *= 2;
+    }
+    auto msgs = iters / seconds;
+    printf("%-40s %14.0f %10.3f\n", c.name, msgs,
+           msgs * c.bytesPerMessage / 1e9);
+  }
+}
+
+}  // anonymous namespace
+
+int main(int argc, char **argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  addCases();
+  folly::runBenchmarks();
+  printThroughput();
+  std::cout << "check: " << x << std::endl;
+  return 0;
+}
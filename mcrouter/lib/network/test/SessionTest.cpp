@@ -12,6 +12,8 @@
 
 #include <gtest/gtest.h>
 
+#include <folly/Conv.h>
+
 #include "mcrouter/lib/network/AsyncMcServerWorkerOptions.h"
 #include "mcrouter/lib/network/test/SessionTestHarness.h"
 
@@ -34,6 +36,21 @@ TEST(Session, basic) {
     t.flushWrites());
 }
 
+TEST(Session, writeFlushBytes) {
+  AsyncMcServerWorkerOptions opts;
+  opts.writeFlushBytes = 1;
+  SessionTestHarness t(opts);
+  t.inputPackets(
+    "get key1\r\n",
+    "get key2\r\n");
+
+  /* Every reply is big enough to be written out immediately */
+  EXPECT_EQ(
+    vector<string>({"VALUE key1 0 10\r\nkey1_value\r\nEND\r\n",
+                    "VALUE key2 0 10\r\nkey2_value\r\nEND\r\n"}),
+    t.flushWrites());
+}
+
 TEST(Session, throttle) {
   AsyncMcServerWorkerOptions opts;
   opts.maxInFlight = 2;
@@ -122,6 +139,37 @@ TEST(Session, throttleBigPacket) {
   EXPECT_TRUE(t.pausedKeys().empty());
 }
 
+TEST(Session, outOfOrderReplies) {
+  AsyncMcServerWorkerOptions opts;
+  SessionTestHarness t(opts);
+
+  /* Many more blocked replies than the initial reorder ring size,
+     with a multiget in the middle */
+  const size_t kNumRequests = 300;
+  t.pause();
+  string expected;
+  for (size_t i = 0; i < kNumRequests; ++i) {
+    auto key = "key" + folly::to<string>(i);
+    if (i == kNumRequests / 2) {
+      t.inputPackets("get a " + key + "\r\n");
+      expected += "VALUE a 0 7\r\na_value\r\n";
+    } else {
+      t.inputPackets("get " + key + "\r\n");
+    }
+    expected += "VALUE " + key + " 0 " + folly::to<string>(key.size() + 6) +
+      "\r\n" + key + "_value\r\nEND\r\n";
+  }
+  EXPECT_TRUE(t.flushWrites().empty());
+
+  /* Replied newest first, written in request order */
+  t.resumeReversed();
+  string written;
+  for (const auto& w : t.flushWrites()) {
+    written += w;
+  }
+  EXPECT_EQ(expected, written);
+}
+
 TEST(Session, quit) {
   AsyncMcServerWorkerOptions opts;
   SessionTestHarness t(opts);
@@ -116,17 +116,32 @@ class MockAsyncSocket : public folly::AsyncTransportWrapper {
 SessionTestHarness::SessionTestHarness(
     AsyncMcServerWorkerOptions opts,
     std::function<void(McServerSession&)> onWriteQuiescence,
-    std::function<void(McServerSession&)> onTerminate)
+    std::function<void(McServerSession&)> onTerminate,
+    McServerMemoryTracker* memoryTracker,
+    McServerSession::Queue* sessions)
     : session_(McServerSession::create(
           folly::AsyncTransportWrapper::UniquePtr(
               new MockAsyncSocket(*this)),
           std::make_shared<McServerOnRequestWrapper<OnRequest>>(
               OnRequest(*this)),
           std::move(onWriteQuiescence),
-          std::move(onTerminate),
+          [onTerminate, sessions] (McServerSession& session) {
+            if (onTerminate) {
+              onTerminate(session);
+            }
+            if (sessions) {
+              sessions->erase(sessions->iterator_to(session));
+            }
+          },
           nullptr,
           std::move(opts),
-          nullptr)) {}
+          nullptr,
+          nullptr,
+          memoryTracker)) {
+  if (sessions) {
+    sessions->push_back(session_);
+  }
+}
 
 void SessionTestHarness::inputPacket(folly::StringPiece p) {
   savedInputs_.push_back(p.str());
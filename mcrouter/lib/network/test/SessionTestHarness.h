@@ -16,11 +16,12 @@
 #include <folly/io/async/AsyncTransport.h>
 
 #include "mcrouter/lib/network/AsyncMcServerWorker.h"
+#include "mcrouter/lib/network/McServerMemoryTracker.h"
 #include "mcrouter/lib/network/McServerRequestContext.h"
+#include "mcrouter/lib/network/McServerSession.h"
 
 namespace facebook { namespace memcache {
 
-class McServerSession;
 class MockAsyncSocket;
 
 class SessionTestHarness {
@@ -33,13 +34,19 @@ class SessionTestHarness {
    *                            closed.
    * @param onWriteQuiescence   The callback to be invoked when all pending
    *                            writes are flushed out.
+   * @param memoryTracker       If not null, accounts the session's bytes,
+   *                            as the tracker of a worker would.
+   * @param sessions            If not null, the session is in it until it's
+   *                            terminated, as in the sessions of a worker.
    *
    * NOTE: Look at McServerSession.h for info about the above callbacks
    */
   explicit SessionTestHarness(
       AsyncMcServerWorkerOptions opts = AsyncMcServerWorkerOptions(),
       std::function<void(McServerSession&)> onWriteQuiescence = nullptr,
-      std::function<void(McServerSession&)> onTerminated = nullptr);
+      std::function<void(McServerSession&)> onTerminated = nullptr,
+      McServerMemoryTracker* memoryTracker = nullptr,
+      McServerSession::Queue* sessions = nullptr);
 
   /**
    * Input packets in order into the socket.
@@ -96,6 +103,28 @@ class SessionTestHarness {
     flushSavedInputs();
   }
 
+  /**
+   * Reply to all accumulated requests, newest first; stays paused.
+   */
+  void resumeReversed() {
+    while (!transactions_.empty()) {
+      auto& t = transactions_.back();
+      McServerRequestContext::reply(std::move(t.ctx), std::move(t.reply));
+      transactions_.pop_back();
+    }
+
+    /* flush writes on the socket */
+    eventBase_.loopOnce();
+  }
+
+  /**
+   * True while the session doesn't read from the socket, whatever
+   * it's paused for.
+   */
+  bool readsPaused() const {
+    return read_ == nullptr;
+  }
+
   /**
    * Initiate session close
    */
@@ -0,0 +1,148 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/network/ShmRing.h"
+
+using namespace facebook::memcache;
+
+namespace {
+
+std::string channelPath() {
+  return "/tmp/mcrouter_shm_ring_test." + std::to_string(getpid());
+}
+
+}  // anonymous namespace
+
+TEST(ShmRing, readWrite) {
+  auto path = channelPath();
+  auto server = ShmChannel::create(path, 4096);
+  auto& ring = server->requests();
+  EXPECT_EQ(4096, ring.capacity());
+  EXPECT_TRUE(ring.empty());
+
+  /* Wraps around the end of the buffer several times */
+  std::string data(1000, 'x');
+  std::string out(1000, '\0');
+  for (int i = 0; i < 20; ++i) {
+    data[0] = 'a' + (i % 26);
+    EXPECT_EQ(data.size(), ring.write(data.data(), data.size()));
+    EXPECT_FALSE(ring.empty());
+    EXPECT_EQ(out.size(), ring.read(&out[0], out.size()));
+    EXPECT_EQ(data, out);
+    EXPECT_TRUE(ring.empty());
+  }
+
+  /* Writes only as much as fits */
+  std::string big(5000, 'y');
+  EXPECT_EQ(4096, ring.write(big.data(), big.size()));
+  EXPECT_EQ(0, ring.write(big.data(), big.size()));
+  EXPECT_EQ(100, ring.read(&out[0], 100));
+  EXPECT_EQ(100, ring.write(big.data(), big.size()));
+
+  unlink(path.c_str());
+}
+
+TEST(ShmRing, corruptHeader) {
+  /* The header stands in for one the other process scribbled over */
+  ShmRing::Header header;
+  header.head = 0;
+  header.tail = 0;
+  header.sleeping = 0;
+  header.wakeups = 0;
+  std::vector<uint8_t> data(4096);
+  ShmRing ring(header, data.data(), data.size());
+  std::string out(8192, '\0');
+
+  /* More than capacity in the ring: nothing is read past the buffer */
+  header.head = 5000;
+  EXPECT_EQ(0, ring.read(&out[0], out.size()));
+  EXPECT_TRUE(ring.broken());
+  /* ... and the ring stays unusable */
+  header.head = 10;
+  EXPECT_EQ(0, ring.read(&out[0], out.size()));
+  EXPECT_EQ(0, ring.write("x", 1));
+
+  ring.reset();
+  EXPECT_FALSE(ring.broken());
+  EXPECT_EQ(1, ring.write("x", 1));
+  EXPECT_EQ(1, ring.read(&out[0], out.size()));
+
+  /* Tail past head: no room to write could be computed from it */
+  header.tail = 100;
+  std::string big(8192, 'y');
+  EXPECT_EQ(0, ring.write(big.data(), big.size()));
+  EXPECT_TRUE(ring.broken());
+}
+
+TEST(ShmRing, waitWake) {
+  auto path = channelPath();
+  auto server = ShmChannel::create(path, 4096);
+  auto client = ShmChannel::attach(path);
+
+  std::atomic<bool> woken{false};
+  std::thread consumer([&] () {
+    auto& ring = server->requests();
+    while (ring.empty()) {
+      ring.wait(std::chrono::milliseconds(10000));
+    }
+    woken = true;
+  });
+
+  /* Let the consumer go to sleep first */
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  client->requests().write("x", 1);
+  consumer.join();
+  EXPECT_TRUE(woken);
+
+  unlink(path.c_str());
+}
+
+TEST(ShmChannel, attach) {
+  auto path = channelPath();
+  auto server = ShmChannel::create(path, 4096);
+  EXPECT_EQ(ShmChannel::State::FREE, server->state());
+
+  auto client = ShmChannel::attach(path);
+  EXPECT_EQ(ShmChannel::State::ATTACHED, server->state());
+  EXPECT_TRUE(server->clientAlive());
+  /* One client at a time */
+  EXPECT_THROW(ShmChannel::attach(path), std::runtime_error);
+
+  /* Both rings are shared */
+  client->requests().write("req", 3);
+  server->replies().write("reply", 5);
+  char buf[16];
+  EXPECT_EQ(3, server->requests().read(buf, sizeof(buf)));
+  EXPECT_EQ("req", std::string(buf, 3));
+  EXPECT_EQ(5, client->replies().read(buf, sizeof(buf)));
+  EXPECT_EQ("reply", std::string(buf, 5));
+
+  client.reset();
+  EXPECT_EQ(ShmChannel::State::CLIENT_GONE, server->state());
+  EXPECT_THROW(ShmChannel::attach(path), std::runtime_error);
+
+  server->release();
+  EXPECT_EQ(ShmChannel::State::FREE, server->state());
+  client = ShmChannel::attach(path);
+
+  server->closeServer();
+  EXPECT_EQ(ShmChannel::State::SERVER_GONE, client->state());
+
+  unlink(path.c_str());
+}
@@ -0,0 +1,76 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <folly/Hash.h>
+#include <folly/Range.h>
+
+#include "mcrouter/lib/network/test/MockMc.h"
+
+namespace facebook { namespace memcache {
+
+/**
+ * MockMc split by key hash into stripes that are locked independently,
+ * so that all workers of a multi-threaded mock server can share one set
+ * of items.
+ *
+ * Thread safe.
+ */
+class StripedMockMc {
+ public:
+  explicit StripedMockMc(size_t numStripes = 1) {
+    numStripes = std::max<size_t>(numStripes, 1);
+    stripes_.reserve(numStripes);
+    for (size_t i = 0; i < numStripes; ++i) {
+      /* Separate allocations keep the locks on separate cache lines */
+      stripes_.emplace_back(new Stripe());
+    }
+  }
+
+  /**
+   * Calls f(MockMc&) with the stripe of key locked and returns its result.
+   * f must not keep pointers to items after it returns; item values
+   * should be cloned (IOBuf clones are safe to use from any thread).
+   */
+  template <class F>
+  auto withKey(folly::StringPiece key, F&& f)
+      -> decltype(f(std::declval<MockMc&>())) {
+    auto& stripe = *stripes_[
+      folly::hash::fnv64_buf(key.data(), key.size()) % stripes_.size()];
+    std::lock_guard<std::mutex> lock(stripe.lock);
+    return f(stripe.mc);
+  }
+
+  void flushAll() {
+    for (auto& stripe : stripes_) {
+      std::lock_guard<std::mutex> lock(stripe->lock);
+      stripe->mc.flushAll();
+    }
+  }
+
+  size_t numStripes() const {
+    return stripes_.size();
+  }
+
+ private:
+  struct Stripe {
+    std::mutex lock;
+    MockMc mc;
+  };
+  std::vector<std::unique_ptr<Stripe>> stripes_;
+};
+
+}}  // facebook::memcache
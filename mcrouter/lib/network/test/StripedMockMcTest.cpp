@@ -0,0 +1,101 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <folly/io/IOBuf.h>
+
+#include "mcrouter/lib/network/test/MockMcBehavior.h"
+#include "mcrouter/lib/network/test/StripedMockMc.h"
+
+using namespace facebook::memcache;
+
+namespace {
+
+MockMc::Item itemOf(folly::StringPiece value) {
+  return MockMc::Item(folly::IOBuf::copyBuffer(value));
+}
+
+}  // anonymous namespace
+
+TEST(StripedMockMc, basic) {
+  StripedMockMc mc(8);
+  EXPECT_EQ(8, mc.numStripes());
+
+  for (size_t i = 0; i < 100; ++i) {
+    auto key = "key" + std::to_string(i);
+    mc.withKey(key, [&key](MockMc& stripe) {
+      stripe.set(key, itemOf(key));
+    });
+  }
+  for (size_t i = 0; i < 100; ++i) {
+    auto key = "key" + std::to_string(i);
+    auto value = mc.withKey(key, [&key](MockMc& stripe) -> std::string {
+      auto item = stripe.get(key);
+      return item ? item->value->clone()->moveToFbString().toStdString() : "";
+    });
+    EXPECT_EQ(key, value);
+  }
+
+  mc.flushAll();
+  EXPECT_EQ(nullptr, mc.withKey("key0", [](MockMc& stripe) {
+    return stripe.get("key0");
+  }));
+}
+
+TEST(StripedMockMc, concurrentArith) {
+  StripedMockMc mc(4);
+  mc.withKey("counter", [](MockMc& stripe) {
+    stripe.set("counter", itemOf("0"));
+  });
+
+  const size_t kThreads = 4;
+  const size_t kIncrements = 1000;
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < kThreads; ++i) {
+    threads.emplace_back([&mc, kIncrements]() {
+      for (size_t j = 0; j < kIncrements; ++j) {
+        mc.withKey("counter", [](MockMc& stripe) {
+          stripe.arith("counter", 1);
+        });
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  auto result = mc.withKey("counter", [](MockMc& stripe) {
+    return stripe.arith("counter", 0);
+  });
+  EXPECT_TRUE(result.first);
+  EXPECT_EQ(static_cast<int64_t>(kThreads * kIncrements), result.second);
+}
+
+TEST(MockMcBehavior, parseLatency) {
+  MockMcBehavior behavior;
+  EXPECT_FALSE(behavior.delaysReplies());
+
+  behavior.parseLatency("250");
+  EXPECT_EQ(250, behavior.latency.count());
+  EXPECT_TRUE(behavior.distribution == MockMcBehavior::Latency::CONSTANT);
+  EXPECT_TRUE(behavior.delaysReplies());
+
+  behavior.parseLatency("exponential:1000");
+  EXPECT_EQ(1000, behavior.latency.count());
+  EXPECT_TRUE(behavior.distribution == MockMcBehavior::Latency::EXPONENTIAL);
+
+  EXPECT_THROW(behavior.parseLatency("normal:10"), std::invalid_argument);
+  EXPECT_THROW(behavior.parseLatency("uniform:abc"), std::invalid_argument);
+}
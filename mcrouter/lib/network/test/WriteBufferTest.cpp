@@ -0,0 +1,85 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <folly/io/IOBuf.h>
+
+#include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/network/WriteBuffer.h"
+
+using namespace facebook::memcache;
+
+namespace {
+
+std::string flatten(const struct iovec* iovs, size_t niovs) {
+  std::string out;
+  for (size_t i = 0; i < niovs; ++i) {
+    out.append(reinterpret_cast<const char*>(iovs[i].iov_base),
+               iovs[i].iov_len);
+  }
+  return out;
+}
+
+McReply makeReply(const std::vector<std::string>& pieces) {
+  auto head = folly::IOBuf::copyBuffer(pieces[0]);
+  for (size_t i = 1; i < pieces.size(); ++i) {
+    head->prependChain(folly::IOBuf::copyBuffer(pieces[i]));
+  }
+  McReply reply(mc_res_found);
+  reply.setValue(std::move(*head));
+  reply.setFlags(123);
+  return reply;
+}
+
+std::string asciiReply(const McReply& reply, mc_op_t op) {
+  AsciiSerializedReply serialized;
+  auto key = folly::Optional<folly::IOBuf>(
+    folly::IOBuf(folly::IOBuf::COPY_BUFFER, "key"));
+  struct iovec* iovs;
+  size_t niovs;
+  EXPECT_TRUE(serialized.prepare(reply, op, key, iovs, niovs));
+  return flatten(iovs, niovs);
+}
+
+std::string umbrellaReply(const McReply& reply, mc_op_t op) {
+  UmbrellaSerializedMessage serialized;
+  struct iovec* iovs;
+  size_t niovs;
+  EXPECT_TRUE(serialized.prepare(reply, op, 1, iovs, niovs));
+  return flatten(iovs, niovs);
+}
+
+}  // namespace
+
+TEST(WriteBuffer, asciiChainedValue) {
+  auto reply = makeReply({"abc", "", "defgh", "ijk"});
+  EXPECT_EQ("VALUE key 123 11\r\nabcdefghijk\r\n",
+            asciiReply(reply, mc_op_get));
+  /* The value was referenced, not coalesced */
+  EXPECT_TRUE(reply.value().isChained());
+}
+
+TEST(WriteBuffer, asciiLongChainIsCoalesced) {
+  std::vector<std::string> pieces(64, "x");
+  auto reply = makeReply(pieces);
+  EXPECT_EQ("VALUE key 123 64\r\n" + std::string(64, 'x') + "\r\n",
+            asciiReply(reply, mc_op_get));
+}
+
+TEST(WriteBuffer, umbrellaChainedValue) {
+  auto flat = makeReply({"abcdefghijk"});
+  auto chained = makeReply({"abc", "", "defgh", "ijk"});
+  EXPECT_EQ(umbrellaReply(flat, mc_op_get),
+            umbrellaReply(chained, mc_op_get));
+  EXPECT_TRUE(chained.value().isChained());
+}
@@ -17,12 +17,13 @@
 #include <folly/experimental/fibers/FiberManager.h>
 
 #include "mcrouter/lib/config/RouteHandleFactory.h"
+#include "mcrouter/lib/McRequestBase.h"
 #include "mcrouter/lib/routes/NullRoute.h"
 
 namespace facebook { namespace memcache {
 
 /**
- * Sends the same request to all child route handles.
+ * Sends the same request to all child route handles, with low priority.
  * Does not wait for response.
  */
 template <class RouteHandleIf>
@@ -59,7 +60,9 @@ class AllAsyncRoute {
     const Request& req, Operation, const ContextPtr& ctx) const {
 
     if (!children_.empty()) {
+      req.coalesceValue();
       auto reqCopy = std::make_shared<Request>(req.clone());
+      reqCopy->setPriority(RequestPriority::LOW);
       for (auto& rh : children_) {
         folly::fibers::addTask(
           [rh, reqCopy, ctx]() {
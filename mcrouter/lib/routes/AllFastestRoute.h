@@ -71,6 +71,7 @@ class AllFastestRoute {
 
     std::vector<std::function<Reply()>> funcs;
     funcs.reserve(children_.size());
+    req.coalesceValue();
     auto reqCopy = std::make_shared<Request>(req.clone());
     for (auto& rh : children_) {
       funcs.push_back(
@@ -102,6 +102,7 @@ class AllInitialRoute {
 
     /* Process all children except first asynchronously */
     if (asyncRoute_) {
+      req.coalesceValue();
       asyncRoute_->route(req, Operation(), ctx);
     }
 
@@ -19,13 +19,15 @@
 #include "mcrouter/lib/config/RouteHandleFactory.h"
 #include "mcrouter/lib/mc/msg.h"
 #include "mcrouter/lib/Reply.h"
+#include "mcrouter/lib/RequestArena.h"
 #include "mcrouter/lib/routes/NullRoute.h"
 
 namespace facebook { namespace memcache {
 
 /**
  * Sends the same request to all child route handles.
- * Collects replies until some result appears (half + 1) times
+ * Collects replies until some result appears (half + 1) times, or until
+ * no other result can reach the count of the most common one
  * (or all results if that never happens).
  * Responds with one of the replies with the most common result.
  * Ties are broken using Reply::reduce().
@@ -73,8 +75,9 @@ class AllMajorityRoute {
       return children_.back()->route(req, Operation(), ctx);
     }
 
-    std::vector<std::function<Reply()>> funcs;
-    funcs.reserve(children_.size());
+    auto funcs = makeArenaVector<std::function<Reply()>>(requestArena(ctx),
+                                                         children_.size());
+    req.coalesceValue();
     auto reqCopy = std::make_shared<Request>(req.clone());
     for (auto& rh : children_) {
       funcs.push_back(
@@ -87,22 +90,30 @@ class AllMajorityRoute {
     size_t counts[mc_nres];
     std::fill(counts, counts + mc_nres, 0);
     size_t majorityCount = 0;
+    mc_res_t majorityResult = mc_res_unknown;
     Reply majorityReply = Reply(DefaultReply, Operation());
 
     auto taskIt = folly::fibers::addTasks(funcs.begin(), funcs.end());
     taskIt.reserve(children_.size() / 2 + 1);
+    size_t remaining = children_.size();
     while (taskIt.hasNext() &&
            majorityCount < children_.size() / 2 + 1) {
 
       auto reply = taskIt.awaitNext();
       auto result = reply.result();
+      --remaining;
 
       ++counts[result];
       if ((counts[result] == majorityCount && reply.worseThan(majorityReply)) ||
           (counts[result] > majorityCount)) {
         majorityReply = std::move(reply);
+        majorityResult = result;
         majorityCount = counts[result];
       }
+
+      if (outcomeKnown(counts, majorityResult, majorityCount, remaining)) {
+        break;
+      }
     }
 
     return majorityReply;
@@ -110,6 +121,24 @@ class AllMajorityRoute {
 
  private:
   std::vector<std::shared_ptr<RouteHandleIf>> children_;
+
+  /**
+   * True if no result can catch up with (or tie) the current majority
+   * result even if all remaining replies have that result. This lets us
+   * return before getting half + 1 equal replies if results are mixed.
+   */
+  static bool outcomeKnown(const size_t* counts,
+                           mc_res_t majorityResult,
+                           size_t majorityCount,
+                           size_t remaining) {
+    for (size_t result = 0; result < mc_nres; ++result) {
+      if (result != majorityResult &&
+          counts[result] + remaining >= majorityCount) {
+        return false;
+      }
+    }
+    return true;
+  }
 };
 
 }}
@@ -18,6 +18,7 @@
 #include <folly/experimental/fibers/WhenN.h>
 
 #include "mcrouter/lib/config/RouteHandleFactory.h"
+#include "mcrouter/lib/RequestArena.h"
 #include "mcrouter/lib/routes/NullRoute.h"
 
 namespace facebook { namespace memcache {
@@ -70,8 +71,9 @@ class AllSyncRoute {
       return children_.back()->route(req, Operation(), ctx);
     }
 
-    std::vector<std::function<Reply()>> fs;
-    fs.reserve(children_.size());
+    req.coalesceValue();
+    auto fs = makeArenaVector<std::function<Reply()>>(requestArena(ctx),
+                                                      children_.size());
     for (auto& rh : children_) {
       // no need to copy the child and request, we will not return from method
       // until we get replies
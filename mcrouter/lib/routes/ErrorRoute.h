@@ -32,6 +32,10 @@ struct ErrorRoute {
     return "error";
   }
 
+  static bool completesInline() {
+    return true;
+  }
+
   template <class Operation, class Request>
   static std::vector<std::shared_ptr<RouteHandleIf>> couldRouteTo(
     const Request& req, Operation, const ContextPtr& ctx) {
@@ -17,14 +17,18 @@
 
 #include "mcrouter/lib/config/RouteHandleFactory.h"
 #include "mcrouter/lib/Operation.h"
+#include "mcrouter/lib/RouteHandleIf.h"
 #include "mcrouter/lib/routes/NullRoute.h"
+#include "mcrouter/lib/routes/RetryBudget.h"
 
 namespace facebook { namespace memcache {
 
 /**
  * Sends the same request sequentially to each destination in the list in order,
  * until the first non-error reply.  If all replies result in errors, returns
- * the last destination's reply.
+ * the last destination's reply. Stops early (with the last error) once the
+ * request's deadline passed, see deadlineExceeded(), or once the optional
+ * "retry_budget" (see RetryBudget) is used up.
  */
 template <class RouteHandleIf>
 class FailoverRoute {
@@ -42,8 +46,10 @@ class FailoverRoute {
 
   FailoverRoute() = default;
 
-  explicit FailoverRoute(std::vector<std::shared_ptr<RouteHandleIf>> targets)
-      : targets_(std::move(targets)) {
+  explicit FailoverRoute(std::vector<std::shared_ptr<RouteHandleIf>> targets,
+                         std::shared_ptr<RetryBudget> retryBudget = nullptr)
+      : targets_(std::move(targets)),
+        retryBudget_(std::move(retryBudget)) {
   }
 
   FailoverRoute(RouteHandleFactory<RouteHandleIf>& factory,
@@ -52,11 +58,18 @@ class FailoverRoute {
       if (json.count("children")) {
         targets_ = factory.createList(json["children"]);
       }
+      if (auto jbudget = json.get_ptr("retry_budget")) {
+        retryBudget_ = std::make_shared<RetryBudget>(*jbudget);
+      }
     } else {
       targets_ = factory.createList(json);
     }
   }
 
+  const std::vector<std::shared_ptr<RouteHandleIf>>& children() const {
+    return targets_;
+  }
+
   template <class Operation, class Request>
   typename ReplyType<Operation, Request>::type route(
     const Request& req, Operation, const ContextPtr& ctx) const {
@@ -65,9 +78,13 @@ class FailoverRoute {
       return NullRoute<RouteHandleIf>::route(req, Operation(), ctx);
     }
 
+    if (retryBudget_) {
+      retryBudget_->onRequest();
+    }
     for (size_t i = 0; i + 1 < targets_.size(); ++i) {
       auto reply = targets_[i]->route(req, Operation(), ctx);
-      if (!reply.isFailoverError()) {
+      if (!reply.isFailoverError() || deadlineExceeded(ctx) ||
+          !allowRetry(ctx)) {
         return reply;
       }
     }
@@ -75,8 +92,63 @@ class FailoverRoute {
     return targets_.back()->route(req, Operation(), ctx);
   }
 
+  /**
+   * Same as route() for each request, but requests that fail on a
+   * destination are sent to the next one together.
+   */
+  template <class Operation, class Request>
+  std::vector<typename ReplyType<Operation, Request>::type> routeBatch(
+    const std::vector<const Request*>& reqs, Operation,
+    const ContextPtr& ctx) const {
+
+    if (targets_.empty()) {
+      std::vector<typename ReplyType<Operation, Request>::type> replies;
+      replies.reserve(reqs.size());
+      for (auto req : reqs) {
+        replies.push_back(
+          NullRoute<RouteHandleIf>::route(*req, Operation(), ctx));
+      }
+      return replies;
+    }
+
+    if (retryBudget_) {
+      for (size_t j = 0; j < reqs.size(); ++j) {
+        retryBudget_->onRequest();
+      }
+    }
+    auto replies = targets_[0]->routeBatch(reqs, Operation(), ctx);
+    for (size_t i = 1; i < targets_.size() && !deadlineExceeded(ctx); ++i) {
+      std::vector<size_t> failed;
+      std::vector<const Request*> retryReqs;
+      for (size_t j = 0; j < replies.size(); ++j) {
+        if (replies[j].isFailoverError() && allowRetry(ctx)) {
+          failed.push_back(j);
+          retryReqs.push_back(reqs[j]);
+        }
+      }
+      if (failed.empty()) {
+        break;
+      }
+      auto retryReplies = targets_[i]->routeBatch(retryReqs, Operation(), ctx);
+      for (size_t j = 0; j < failed.size(); ++j) {
+        replies[failed[j]] = std::move(retryReplies[j]);
+      }
+    }
+    return replies;
+  }
+
  private:
   std::vector<std::shared_ptr<RouteHandleIf>> targets_;
+  // Mutable state, the route is only used by its proxy's thread
+  std::shared_ptr<RetryBudget> retryBudget_;
+
+  bool allowRetry(const ContextPtr& ctx) const {
+    if (!retryBudget_ || retryBudget_->tryRetry()) {
+      return true;
+    }
+    onRetryDenied(ctx);
+    return false;
+  }
 };
 
 }}
@@ -11,6 +11,7 @@
 
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <folly/Range.h>
@@ -19,10 +20,28 @@
 
 #include "mcrouter/lib/fbi/cpp/util.h"
 #include "mcrouter/lib/Operation.h"
+#include "mcrouter/lib/RouteBatch.h"
 #include "mcrouter/lib/routes/NullRoute.h"
 
 namespace facebook { namespace memcache {
 
+namespace detail {
+
+/* HashFunc can reuse hashes memoized in the request */
+template <class HashFunc, class Request>
+auto hashRoutingKey(const HashFunc& hashFunc, const Request& req, int)
+  -> decltype(hashFunc.hashRequest(req)) {
+  return hashFunc.hashRequest(req);
+}
+
+/* Otherwise hash the routing key */
+template <class HashFunc, class Request>
+size_t hashRoutingKey(const HashFunc& hashFunc, const Request& req, long) {
+  return hashFunc(req.routingKey());
+}
+
+}  // detail
+
 /**
  * Hashes routing_key using provided function and routes to the destination
  */
@@ -45,11 +64,19 @@ class HashRoute {
             std::vector<std::shared_ptr<RouteHandleIf>> children)
     : rh_(std::move(children)),
       hashFunc_(json, rh_.size()) {
+    parseSalt(json);
+  }
 
-    if (json.isObject() && json.count("salt")) {
-      checkLogic(json["salt"].isString(), "HashRoute salt is not a string");
-      salt_ = json["salt"].getString().toStdString();
-    }
+  /**
+   * Same as above, but with hash function built by the caller
+   * (e.g. shared with other routes).
+   */
+  HashRoute(const folly::dynamic& json,
+            std::vector<std::shared_ptr<RouteHandleIf>> children,
+            HashFunc hashFunc)
+    : rh_(std::move(children)),
+      hashFunc_(std::move(hashFunc)) {
+    parseSalt(json);
   }
 
   template <class Operation, class Request>
@@ -59,6 +86,26 @@ class HashRoute {
     return {rh_[pick(req)]};
   }
 
+  const std::vector<std::shared_ptr<RouteHandleIf>>& children() const {
+    return rh_;
+  }
+
+  const std::string& salt() const {
+    return salt_;
+  }
+
+  const HashFunc& hashFunc() const {
+    return hashFunc_;
+  }
+
+  /**
+   * @return index in children() of the child req hashes to.
+   */
+  template <class Request>
+  size_t childIndex(const Request& req) const {
+    return pickInMainContext(req);
+  }
+
   template <class Operation, class Request>
   typename ReplyType<Operation, Request>::type route(
     const Request& req, Operation, const ContextPtr& ctx) const {
@@ -70,17 +117,58 @@ class HashRoute {
     }
   }
 
+  /**
+   * Requests hashing to the same child are sent to it as one batch.
+   */
+  template <class Operation, class Request>
+  std::vector<typename ReplyType<Operation, Request>::type> routeBatch(
+    const std::vector<const Request*>& reqs, Operation,
+    const ContextPtr& ctx) const {
+
+    if (rh_.empty()) {
+      std::vector<typename ReplyType<Operation, Request>::type> replies;
+      replies.reserve(reqs.size());
+      for (auto req : reqs) {
+        replies.push_back(
+          NullRoute<RouteHandleIf>::route(*req, Operation(), ctx));
+      }
+      return replies;
+    }
+
+    std::vector<RouteBatchGroup<RouteHandleIf>> groups;
+    folly::fibers::runInMainContext([this, &reqs, &groups] () {
+        std::unordered_map<size_t, size_t> childToGroup;
+        for (size_t i = 0; i < reqs.size(); ++i) {
+          auto child = this->pick(*reqs[i]);
+          auto it = childToGroup.emplace(child, groups.size()).first;
+          if (it->second == groups.size()) {
+            groups.push_back({rh_[child].get(), {}});
+          }
+          groups[it->second].indexes.push_back(i);
+        }
+      }
+    );
+    return routeBatchGroups(groups, reqs, Operation(), ctx);
+  }
+
  private:
   static const size_t kMaxKeySaltSize = 512;
   const std::vector<std::shared_ptr<RouteHandleIf>> rh_;
   std::string salt_;
   HashFunc hashFunc_;
 
+  void parseSalt(const folly::dynamic& json) {
+    if (json.isObject() && json.count("salt")) {
+      checkLogic(json["salt"].isString(), "HashRoute salt is not a string");
+      salt_ = json["salt"].getString().toStdString();
+    }
+  }
+
   template <class Request>
   size_t pick(const Request& req) const {
     size_t n = 0;
     if (salt_.empty()) {
-      n = hashFunc_(req.routingKey());
+      n = detail::hashRoutingKey(hashFunc_, req, 0);
     } else {
       // fast string concatenation
       char c[kMaxKeySaltSize];
@@ -9,20 +9,25 @@
  */
 #pragma once
 
+#include <chrono>
 #include <memory>
 #include <string>
 
 #include <folly/dynamic.h>
+#include <folly/experimental/fibers/Baton.h>
 #include <folly/experimental/fibers/FiberManager.h>
 #include <folly/io/IOBuf.h>
+#include <folly/Memory.h>
 
 #include "mcrouter/lib/config/RouteHandleFactory.h"
 #include "mcrouter/lib/fbi/cpp/util.h"
 #include "mcrouter/lib/mc/msg.h"
 #include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/McRequestBase.h"
 #include "mcrouter/lib/Operation.h"
 #include "mcrouter/lib/OperationTraits.h"
 #include "mcrouter/lib/Reply.h"
+#include "mcrouter/lib/routes/NegativeKeyCache.h"
 
 namespace facebook { namespace memcache {
 
@@ -35,9 +40,24 @@ namespace facebook { namespace memcache {
  * will be stored in L1 as a special "ncache" value with "NEGATIVE_CACHE" flag
  * and ncacheExptime expiration time.
  * If we try to fetch "ncache" value from L1 we'll return a miss and refill
- * L1 from L2 every ncacheUpdatePeriod "ncache" requests.
+ * L1 from L2 every ncacheUpdatePeriod "ncache" requests. If L2 still misses,
+ * the "ncache" entry TTL is bumped with 'touch' when l1SupportsTouch is set
+ * (a value stored in L1 meanwhile is not overwritten), or with 'set'.
  *
- * NOTE: Doesn't work with lease get, gets and metaget.
+ * For 'lease-get' only the lease holder goes to L2: on a miss from L1 with
+ * a lease token the value is fetched from L2 with a simple 'get' and stored
+ * in L1 with 'lease-set'. Requests that get a hot miss from L1 (somebody else
+ * holds the lease) retry L1 up to hotMissRetries times, hotMissRetryDelayMs
+ * apart, instead of going to L2. Combined with request collapsing this keeps
+ * a hot key from stampeding L2. Negative caching is not used for lease gets,
+ * the L1 miss with the lease token is returned so that the client can fill it.
+ *
+ * With localNcacheSize > 0, keys that missed in L2 (or are "ncache" in L1)
+ * are also remembered by this proxy for localNcacheTtlMs: gets for them
+ * return a miss without going to L1. Any other request for the key
+ * (e.g. a set) passing through this route forgets it.
+ *
+ * NOTE: Doesn't work with gets and metaget.
  * Always overrides expiration time for L2 -> L1 update request.
  * Client is responsible for L2 consistency, sets and deletes are forwarded
  * only to L1 cache.
@@ -60,16 +80,28 @@ class L1L2CacheRoute {
                  std::shared_ptr<RouteHandleIf> l2,
                  uint32_t upgradingL1Exptime,
                  size_t ncacheExptime,
-                 size_t ncacheUpdatePeriod)
+                 size_t ncacheUpdatePeriod,
+                 size_t hotMissRetries = 3,
+                 std::chrono::milliseconds hotMissRetryDelay =
+                   std::chrono::milliseconds(10),
+                 size_t localNcacheSize = 0,
+                 std::chrono::milliseconds localNcacheTtl =
+                   std::chrono::milliseconds(1000))
   : l1_(std::move(l1)),
     l2_(std::move(l2)),
     upgradingL1Exptime_(upgradingL1Exptime),
     ncacheExptime_(ncacheExptime),
     ncacheUpdatePeriod_(ncacheUpdatePeriod),
-    ncacheUpdateCounter_(ncacheUpdatePeriod) {
+    ncacheUpdateCounter_(ncacheUpdatePeriod),
+    hotMissRetries_(hotMissRetries),
+    hotMissRetryDelay_(hotMissRetryDelay) {
 
     assert(l1_ != nullptr);
     assert(l2_ != nullptr);
+    if (localNcacheSize > 0) {
+      localNcache_ = folly::make_unique<NegativeKeyCache>(localNcacheSize,
+                                                          localNcacheTtl);
+    }
   }
 
   L1L2CacheRoute(RouteHandleFactory<RouteHandleIf>& factory,
@@ -97,6 +129,48 @@ class L1L2CacheRoute {
       ncacheUpdateCounter_ = ncacheUpdatePeriod_;
     }
 
+    if (json.count("hotMissRetries")) {
+      checkLogic(json["hotMissRetries"].isInt() &&
+                 json["hotMissRetries"].getInt() >= 0,
+                 "L1L2CacheRoute: hotMissRetries is not "
+                 "a non-negative integer");
+      hotMissRetries_ = json["hotMissRetries"].getInt();
+    }
+
+    if (json.count("hotMissRetryDelayMs")) {
+      checkLogic(json["hotMissRetryDelayMs"].isInt() &&
+                 json["hotMissRetryDelayMs"].getInt() >= 0,
+                 "L1L2CacheRoute: hotMissRetryDelayMs is not "
+                 "a non-negative integer");
+      hotMissRetryDelay_ =
+        std::chrono::milliseconds(json["hotMissRetryDelayMs"].getInt());
+    }
+
+    if (json.count("l1SupportsTouch")) {
+      checkLogic(json["l1SupportsTouch"].isBool(),
+                 "L1L2CacheRoute: l1SupportsTouch is not a boolean");
+      l1SupportsTouch_ = json["l1SupportsTouch"].getBool();
+    }
+
+    if (json.count("localNcacheSize")) {
+      checkLogic(json["localNcacheSize"].isInt() &&
+                 json["localNcacheSize"].getInt() >= 0,
+                 "L1L2CacheRoute: localNcacheSize is not "
+                 "a non-negative integer");
+      auto ttl = std::chrono::milliseconds(1000);
+      if (json.count("localNcacheTtlMs")) {
+        checkLogic(json["localNcacheTtlMs"].isInt() &&
+                   json["localNcacheTtlMs"].getInt() > 0,
+                   "L1L2CacheRoute: localNcacheTtlMs is not "
+                   "a positive integer");
+        ttl = std::chrono::milliseconds(json["localNcacheTtlMs"].getInt());
+      }
+      if (json["localNcacheSize"].getInt() > 0) {
+        localNcache_ = folly::make_unique<NegativeKeyCache>(
+          json["localNcacheSize"].getInt(), ttl);
+      }
+    }
+
     l1_ = factory.create(json["l1"]);
     l2_ = factory.create(json["l2"]);
   }
@@ -108,9 +182,16 @@ class L1L2CacheRoute {
 
     using Reply = typename ReplyType<Operation, Request>::type;
 
+    if (localNcache_ && localNcache_->contains(req.fullKey())) {
+      return Reply(DefaultReply, Operation());
+    }
+
     auto l1Reply = l1_->route(req, Operation(), ctx);
     if (l1Reply.isHit()) {
       if (l1Reply.flags() & MC_MSG_FLAG_NEGATIVE_CACHE) {
+        if (localNcache_) {
+          localNcache_->insert(req.fullKey());
+        }
         if (ncacheUpdatePeriod_) {
           if (ncacheUpdateCounter_ == 1) {
             updateL1Ncache(req, Operation(), ctx);
@@ -128,6 +209,9 @@ class L1L2CacheRoute {
 
     /* else */
     auto l2Reply = l2_->route(req, Operation(), ctx);
+    if (localNcache_ && l2Reply.isMiss()) {
+      localNcache_->insert(req.fullKey());
+    }
 #ifdef __clang__
 #pragma clang diagnostic push // ignore generalized lambda capture warning
 #pragma clang diagnostic ignored "-Wc++1y-extensions"
@@ -152,11 +236,69 @@ class L1L2CacheRoute {
     return l2Reply;
   }
 
+  template <class Request>
+  typename ReplyType<McOperation<mc_op_lease_get>, Request>::type
+  route(const Request& req, McOperation<mc_op_lease_get> op,
+        const ContextPtr& ctx) {
+
+    using Reply = typename ReplyType<McOperation<mc_op_lease_get>,
+                                     Request>::type;
+
+    auto l1Reply = l1_->route(req, op, ctx);
+    for (size_t retry = 0;
+         l1Reply.result() == mc_res_notfoundhot && retry < hotMissRetries_;
+         ++retry) {
+      /* somebody else is filling L1, give it a moment */
+      folly::fibers::Baton baton;
+      baton.timed_wait(hotMissRetryDelay_);
+      l1Reply = l1_->route(req, op, ctx);
+    }
+
+    if (l1Reply.isHit()) {
+      if (l1Reply.flags() & MC_MSG_FLAG_NEGATIVE_CACHE) {
+        return Reply(DefaultReply, op);
+      }
+      return l1Reply;
+    }
+    if (l1Reply.isHotMiss()) {
+      return l1Reply;
+    }
+
+    /* miss with a lease token or error: send simple get to L2 */
+    auto l2Reply = l2_->route(req, McOperation<mc_op_get>(), ctx);
+    if (!l2Reply.isHit()) {
+      return l1Reply.isMiss() ? std::move(l1Reply) : std::move(l2Reply);
+    }
+
+#ifdef __clang__
+#pragma clang diagnostic push // ignore generalized lambda capture warning
+#pragma clang diagnostic ignored "-Wc++1y-extensions"
+#endif
+    auto setReq = l1UpdateFromL2(req, l2Reply, upgradingL1Exptime_);
+    if (l1Reply.isMiss() && l1Reply.leaseToken() > 1) {
+      setReq.setLeaseToken(l1Reply.leaseToken());
+      folly::fibers::addTask([l1 = l1_, setReq = std::move(setReq), ctx]() {
+        l1->route(setReq, McOperation<mc_op_lease_set>(), ctx);
+      });
+    } else {
+      folly::fibers::addTask([l1 = l1_, addReq = std::move(setReq), ctx]() {
+        l1->route(addReq, McOperation<mc_op_add>(), ctx);
+      });
+    }
+#ifdef __clang__
+#pragma clang diagnostic pop
+#endif
+    return l2Reply;
+  }
+
   template <class Operation, class Request>
   typename ReplyType<Operation, Request>::type route(
     const Request& req, Operation, const ContextPtr& ctx,
-    OtherThanT(Operation, GetLike<>) = 0) const {
+    OtherThanT(Operation, GetLike<>) = 0) {
 
+    if (localNcache_) {
+      localNcache_->erase(req.fullKey());
+    }
     return l1_->route(req, Operation(), ctx);
   }
 
@@ -167,6 +309,11 @@ class L1L2CacheRoute {
   size_t ncacheExptime_{0};
   size_t ncacheUpdatePeriod_{0};
   size_t ncacheUpdateCounter_{0};
+  size_t hotMissRetries_{3};
+  std::chrono::milliseconds hotMissRetryDelay_{10};
+  bool l1SupportsTouch_{false};
+  /* nullptr unless localNcacheSize > 0 */
+  std::unique_ptr<NegativeKeyCache> localNcache_;
 
   template <class Request, class Reply>
   static Request l1UpdateFromL2(const Request& origReq,
@@ -178,6 +325,7 @@ class L1L2CacheRoute {
     req.setValue(std::move(cloned));
     req.setFlags(reply.flags());
     req.setExptime(upgradingL1Exptime);
+    req.setPriority(RequestPriority::LOW);
     return std::move(req);
   }
 
@@ -187,6 +335,7 @@ class L1L2CacheRoute {
     req.setValue(folly::IOBuf(folly::IOBuf::COPY_BUFFER, "ncache"));
     req.setFlags(MC_MSG_FLAG_NEGATIVE_CACHE);
     req.setExptime(ncacheExptime);
+    req.setPriority(RequestPriority::LOW);
     return std::move(req);
   }
 
@@ -200,12 +349,23 @@ class L1L2CacheRoute {
       [l1 = l1_, l2 = l2_, creq = Request(req.clone()),
        upgradingL1Exptime = upgradingL1Exptime_,
        ncacheExptime = ncacheExptime_,
+       l1SupportsTouch = l1SupportsTouch_,
        ctx]() {
         auto l2Reply = l2->route(creq, Operation(), ctx);
         if (l2Reply.isHit()) {
           l1->route(l1UpdateFromL2(creq, l2Reply, upgradingL1Exptime),
                     McOperation<mc_op_set>(), ctx);
         } else {
+          if (l1SupportsTouch) {
+            /* bump TTL on the ncache entry in place */
+            auto touchReq = creq.clone();
+            touchReq.setExptime(ncacheExptime);
+            auto touchReply = l1->route(touchReq, McOperation<mc_op_touch>(),
+                                        ctx);
+            if (touchReply.isHit()) {
+              return;
+            }
+          }
           /* bump TTL on the ncache entry */
           l1->route(l1Ncache(creq, ncacheExptime), McOperation<mc_op_set>(),
                     ctx);
@@ -9,7 +9,10 @@
  */
 #pragma once
 
+#include <algorithm>
+#include <chrono>
 #include <memory>
+#include <random>
 #include <string>
 #include <vector>
 
@@ -19,6 +22,7 @@
 #include "mcrouter/lib/fbi/cpp/globals.h"
 #include "mcrouter/lib/fbi/cpp/util.h"
 #include "mcrouter/lib/Operation.h"
+#include "mcrouter/lib/RouteHandleIf.h"
 #include "mcrouter/lib/routes/FailoverRoute.h"
 
 namespace facebook { namespace memcache {
@@ -29,6 +33,14 @@ namespace facebook { namespace memcache {
  *
  * Creates a FailoverRoute with at most failoverCount destinations chosen
  * pseudo-randomly based on hostid.
+ *
+ * With "latency_aware", the chosen destinations are instead tried in order
+ * of the smoothed latency of their successful replies, so that far (e.g.
+ * cross-datacenter) replicas are only used when the near ones fail. The
+ * order is recomputed every "latency_reorder_requests" requests: targets
+ * within "latency_near_factor" of the fastest one (or without samples yet)
+ * are shuffled first, so proxies don't all herd on the same replica, and
+ * the rest follow, fastest first.
  */
 template <class RouteHandleIf>
 class LatestRoute {
@@ -52,26 +64,132 @@ class LatestRoute {
               std::vector<std::shared_ptr<RouteHandleIf>> targets) {
 
     size_t failoverCount = 5;
+    bool latencyAware = false;
     if (json.isObject()) {
       if (json.count("failover_count")) {
         checkLogic(json["failover_count"].isInt(),
                    "LatestRoute: failover_count is not an integer");
         failoverCount = json["failover_count"].asInt();
       }
+      if (auto jaware = json.get_ptr("latency_aware")) {
+        checkLogic(jaware->isBool(),
+                   "LatestRoute: latency_aware is not a boolean");
+        latencyAware = jaware->getBool();
+      }
+      if (auto jreorder = json.get_ptr("latency_reorder_requests")) {
+        checkLogic(jreorder->isInt() && jreorder->getInt() > 0,
+                   "LatestRoute: latency_reorder_requests is not "
+                   "a positive integer");
+        reorderRequests_ = jreorder->getInt();
+      }
+      if (auto jnear = json.get_ptr("latency_near_factor")) {
+        checkLogic(jnear->isNumber() && jnear->asDouble() >= 1,
+                   "LatestRoute: latency_near_factor is not a number >= 1");
+        nearFactor_ = jnear->asDouble();
+      }
     }
 
     commonInit(std::move(targets), failoverCount);
+    if (latencyAware) {
+      latencies_.resize(route_.children().size());
+      for (size_t i = 0; i < latencies_.size(); ++i) {
+        order_.push_back(i);
+      }
+      gen_.seed(globals::hostid());
+    }
   }
 
   template <class Operation, class Request>
   typename ReplyType<Operation, Request>::type
   route(const Request& req, Operation, const ContextPtr& ctx) {
-    return route_.route(req, Operation(), ctx);
+    if (order_.empty()) {
+      return route_.route(req, Operation(), ctx);
+    }
+
+    if (++requestsSinceReorder_ >= reorderRequests_) {
+      reorder();
+    }
+    const auto& targets = route_.children();
+    /* Copy, the order may change while we wait for replies */
+    auto order = order_;
+    for (size_t i = 0; ; ++i) {
+      auto start = std::chrono::steady_clock::now();
+      auto reply = targets[order[i]]->route(req, Operation(), ctx);
+      if (!reply.isError()) {
+        recordLatency(order[i], std::chrono::duration_cast<
+          std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count());
+      }
+      if (i + 1 == order.size() || !reply.isFailoverError() ||
+          deadlineExceeded(ctx)) {
+        return reply;
+      }
+    }
+  }
+
+  /**
+   * Smoothed latency (us) of the i-th chosen target, 0 if it had no
+   * successful replies yet or latency_aware is off.
+   */
+  double latency(size_t i) const {
+    return i < latencies_.size() ? latencies_[i] : 0;
+  }
+
+  /**
+   * Chosen targets in the order they are currently tried.
+   */
+  std::vector<std::shared_ptr<RouteHandleIf>> targetsInOrder() const {
+    if (order_.empty()) {
+      return route_.children();
+    }
+    std::vector<std::shared_ptr<RouteHandleIf>> ret;
+    for (auto i : order_) {
+      ret.push_back(route_.children()[i]);
+    }
+    return ret;
   }
 
  private:
+  /* Weight of a new sample in the smoothed latency */
+  static constexpr double kLatencyDecay = 0.1;
+
   FailoverRoute<RouteHandleIf> route_;
 
+  /* Only with latency_aware: */
+  std::vector<double> latencies_;
+  std::vector<size_t> order_;
+  size_t reorderRequests_{1000};
+  size_t requestsSinceReorder_{0};
+  double nearFactor_{2.0};
+  std::ranlux24_base gen_;
+
+  void recordLatency(size_t i, int64_t latencyUs) {
+    auto& latency = latencies_[i];
+    if (latency == 0) {
+      latency = std::max<int64_t>(latencyUs, 1);
+    } else {
+      latency += (latencyUs - latency) * kLatencyDecay;
+    }
+  }
+
+  void reorder() {
+    requestsSinceReorder_ = 0;
+    double fastest = 0;
+    for (auto latency : latencies_) {
+      if (latency != 0 && (fastest == 0 || latency < fastest)) {
+        fastest = latency;
+      }
+    }
+    auto isNear = [this, fastest](size_t i) {
+      return latencies_[i] == 0 || latencies_[i] <= fastest * nearFactor_;
+    };
+    auto far = std::stable_partition(order_.begin(), order_.end(), isNear);
+    std::shuffle(order_.begin(), far, gen_);
+    std::sort(far, order_.end(), [this](size_t a, size_t b) {
+      return latencies_[a] < latencies_[b];
+    });
+  }
+
   void commonInit(std::vector<std::shared_ptr<RouteHandleIf>> targets,
                   size_t failoverCount) {
     checkLogic(!targets.empty(), "LatestRoute children is empty");
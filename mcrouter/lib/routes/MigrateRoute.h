@@ -22,6 +22,7 @@
 #include "mcrouter/lib/fbi/cpp/util.h"
 #include "mcrouter/lib/Operation.h"
 #include "mcrouter/lib/OperationTraits.h"
+#include "mcrouter/lib/routes/WarmUpRoute.h"
 
 namespace facebook { namespace memcache {
 
@@ -38,6 +39,22 @@ namespace facebook { namespace memcache {
  * to both from_ and to_ route handle. For delete requests, returns
  * reply from worst among two replies.
  * 4. After (start_time + 2*interval), sends all requests to to_ route handle.
+ *
+ * With "ramp" (seconds), keys move to to_ gradually instead, so that to_
+ * doesn't get all the misses at once:
+ * 1. Before start_time, sends all requests to from_.
+ * 2. Between start_time and (start_time + ramp), a growing fraction of keys
+ * (by routingKeyHash(), from 0 to all of them) is migrated. Requests for
+ * migrated keys go to to_, warmed up from from_ like in WarmUpRoute (misses
+ * are read from from_ and added to to_). Requests for other keys go to
+ * from_.
+ * 3. Between (start_time + ramp) and (start_time + ramp + interval), all keys
+ * are migrated.
+ * In 2. and 3., deletes go to both from_ and to_ (the worst reply wins).
+ * 4. After (start_time + ramp + interval), sends all requests to to_.
+ * Fills of to_ use "warm_exptime" if set (otherwise the exptime is fetched
+ * from from_ with a metaget), and are batched like WarmUpRoute's with a
+ * "fill" object.
  */
 template <class RouteHandleIf, typename TimeProvider>
 class MigrateRoute {
@@ -65,15 +82,22 @@ class MigrateRoute {
                std::shared_ptr<RouteHandleIf> th,
                time_t start_time_sec,
                time_t interval_sec,
-               TimeProvider tp)
+               TimeProvider tp,
+               time_t ramp_sec = 0,
+               folly::Optional<uint32_t> warm_exptime = folly::none)
       : from_(std::move(fh)),
         to_(std::move(th)),
         startTimeSec_(start_time_sec),
         intervalSec_(interval_sec),
+        rampSec_(ramp_sec),
         tp_(tp) {
 
     assert(from_ != nullptr);
     assert(to_ != nullptr);
+    if (rampSec_ > 0) {
+      warmUp_ = std::make_shared<WarmUpRoute<RouteHandleIf>>(
+        from_, to_, warm_exptime);
+    }
   }
 
   MigrateRoute(RouteHandleFactory<RouteHandleIf>& factory,
@@ -100,6 +124,26 @@ class MigrateRoute {
 
     assert(from_ != nullptr);
     assert(to_ != nullptr);
+
+    if (auto jramp = json.get_ptr("ramp")) {
+      checkLogic(jramp->isInt() && jramp->asInt() >= 0,
+                 "MigrateRoute ramp is not a non-negative integer");
+      rampSec_ = jramp->asInt();
+    }
+    if (rampSec_ > 0) {
+      folly::Optional<uint32_t> warmExptime;
+      if (auto jexptime = json.get_ptr("warm_exptime")) {
+        checkLogic(jexptime->isInt(),
+                   "MigrateRoute warm_exptime is not integer");
+        warmExptime = static_cast<uint32_t>(jexptime->asInt());
+      }
+      std::shared_ptr<WarmUpFillQueue> fillQueue;
+      if (auto jfill = json.get_ptr("fill")) {
+        fillQueue = std::make_shared<WarmUpFillQueue>(*jfill);
+      }
+      warmUp_ = std::make_shared<WarmUpRoute<RouteHandleIf>>(
+        from_, to_, warmExptime, std::move(fillQueue));
+    }
   }
 
   template <class Operation, class Request>
@@ -113,6 +157,7 @@ class MigrateRoute {
     switch (mask) {
       case kFromMask: return from_->route(req, Operation(), ctx);
       case kToMask: return to_->route(req, Operation(), ctx);
+      case kWarmUpMask: return warmUp_->route(req, Operation(), ctx);
       default: {
         auto& from = from_;
         auto& to = to_;
@@ -139,12 +184,28 @@ class MigrateRoute {
  private:
   static constexpr int kFromMask = 1;
   static constexpr int kToMask = 2;
+  /* to_, warmed up from from_ */
+  static constexpr int kWarmUpMask = kFromMask | kToMask | 4;
 
   std::shared_ptr<RouteHandleIf> from_;
   std::shared_ptr<RouteHandleIf> to_;
   time_t startTimeSec_;
   time_t intervalSec_;
+  time_t rampSec_{0};
   const TimeProvider tp_;
+  /* Only with rampSec_ */
+  std::shared_ptr<WarmUpRoute<RouteHandleIf>> warmUp_;
+
+  /* With rampSec_: is the key migrated at time curr (after start time)? */
+  template <class Request>
+  bool migrated(const Request& req, time_t curr) const {
+    if (curr >= startTimeSec_ + rampSec_) {
+      return true;
+    }
+    auto threshold = (static_cast<uint64_t>(curr - startTimeSec_) << 32) /
+      static_cast<uint64_t>(rampSec_);
+    return req.routingKeyHash() < threshold;
+  }
 
   template <class Operation, class Request>
   int routeMask(
@@ -158,6 +219,11 @@ class MigrateRoute {
       return kFromMask;
     }
 
+    if (rampSec_ > 0) {
+      return curr < startTimeSec_ + rampSec_ + intervalSec_ ?
+        kFromMask | kToMask : kToMask;
+    }
+
     if (curr < (startTimeSec_ + 2*intervalSec_)) {
       return kFromMask | kToMask;
     }
@@ -174,6 +240,16 @@ class MigrateRoute {
     const auto& creq = req;
     time_t curr = tp_(creq);
 
+    if (rampSec_ > 0) {
+      if (curr < startTimeSec_) {
+        return kFromMask;
+      }
+      if (curr >= startTimeSec_ + rampSec_ + intervalSec_) {
+        return kToMask;
+      }
+      return migrated(creq, curr) ? kWarmUpMask : kFromMask;
+    }
+
     if (curr < (startTimeSec_ + intervalSec_)) {
       return kFromMask;
     } else {
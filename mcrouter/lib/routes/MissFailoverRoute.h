@@ -19,6 +19,7 @@
 #include "mcrouter/lib/Operation.h"
 #include "mcrouter/lib/OperationTraits.h"
 #include "mcrouter/lib/routes/NullRoute.h"
+#include "mcrouter/lib/routes/RetryBudget.h"
 
 namespace facebook { namespace memcache {
 
@@ -26,7 +27,8 @@ namespace facebook { namespace memcache {
  * For get-like requests, sends the same request sequentially
  * to each destination in the list in order until the first hit reply.
  * If all replies result in errors/misses, returns the reply from the
- * last destination in the list.
+ * last destination in the list. With "retry_budget" (see RetryBudget),
+ * stops early once it is used up.
  */
 template <class RouteHandleIf>
 class MissFailoverRoute {
@@ -53,6 +55,9 @@ class MissFailoverRoute {
       if (json.count("children")) {
         targets_ = factory.createList(json["children"]);
       }
+      if (auto jbudget = json.get_ptr("retry_budget")) {
+        retryBudget_ = std::make_shared<RetryBudget>(*jbudget);
+      }
     } else {
       targets_ = factory.createList(json);
     }
@@ -66,9 +71,12 @@ class MissFailoverRoute {
       return NullRoute<RouteHandleIf>::route(req, Operation(), ctx);
     }
 
+    if (retryBudget_) {
+      retryBudget_->onRequest();
+    }
     for (size_t i = 0; i < targets_.size() - 1; ++i) {
       auto reply = targets_[i]->route(req, Operation(), ctx);
-      if (reply.isHit()) {
+      if (reply.isHit() || !allowRetry(ctx)) {
         return reply;
       }
     }
@@ -106,6 +114,16 @@ class MissFailoverRoute {
 
  private:
   std::vector<std::shared_ptr<RouteHandleIf>> targets_;
+  // Mutable state, the route is only used by its proxy's thread
+  std::shared_ptr<RetryBudget> retryBudget_;
+
+  bool allowRetry(const ContextPtr& ctx) const {
+    if (!retryBudget_ || retryBudget_->tryRetry()) {
+      return true;
+    }
+    onRetryDenied(ctx);
+    return false;
+  }
 };
 
 }}
@@ -0,0 +1,113 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include <folly/Range.h>
+#include <folly/SpookyHashV2.h>
+
+namespace facebook { namespace memcache {
+
+/**
+ * Keys recently known not to exist, for ttl: a fixed size table of 64 bit
+ * key hashes (16 bytes per entry), kWays entries per bucket. When a
+ * bucket is full the entry closest to expiry is replaced. A hash collision
+ * makes an existing key look missing until the entry expires or the key
+ * is erased, ttl should be short.
+ *
+ * Not thread safe, meant to be owned by a route of one proxy.
+ */
+class NegativeKeyCache {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr size_t kWays = 4;
+
+  /**
+   * @param capacity  max number of keys, rounded up to a multiple of kWays
+   */
+  NegativeKeyCache(size_t capacity, std::chrono::milliseconds ttl)
+      : numBuckets_(std::max<size_t>((capacity + kWays - 1) / kWays, 1)),
+        slots_(numBuckets_ * kWays),
+        ttl_(ttl) {
+  }
+
+  bool contains(folly::StringPiece key, Clock::time_point now = Clock::now()) {
+    auto hash = hashOf(key);
+    auto slot = find(hash);
+    if (slot == nullptr) {
+      return false;
+    }
+    if (slot->expires <= now) {
+      slot->hash = 0;
+      return false;
+    }
+    return true;
+  }
+
+  void insert(folly::StringPiece key, Clock::time_point now = Clock::now()) {
+    auto hash = hashOf(key);
+    auto slot = find(hash);
+    if (slot == nullptr) {
+      /* A free one, else the one closest to (or past) expiry */
+      auto bucket = &slots_[(hash % numBuckets_) * kWays];
+      slot = bucket;
+      for (size_t i = 0; i < kWays && slot->hash != 0; ++i) {
+        if (bucket[i].hash == 0 || bucket[i].expires < slot->expires) {
+          slot = &bucket[i];
+        }
+      }
+    }
+    slot->hash = hash;
+    slot->expires = now + ttl_;
+  }
+
+  void erase(folly::StringPiece key) {
+    if (auto slot = find(hashOf(key))) {
+      slot->hash = 0;
+    }
+  }
+
+  size_t capacity() const {
+    return slots_.size();
+  }
+
+ private:
+  struct Slot {
+    /* 0 means free */
+    uint64_t hash{0};
+    Clock::time_point expires;
+  };
+
+  const size_t numBuckets_;
+  std::vector<Slot> slots_;
+  const std::chrono::milliseconds ttl_;
+
+  static uint64_t hashOf(folly::StringPiece key) {
+    return folly::hash::SpookyHashV2::Hash64(key.data(), key.size(),
+                                             /* seed= */ 0) | 1;
+  }
+
+  Slot* find(uint64_t hash) {
+    auto bucket = &slots_[(hash % numBuckets_) * kWays];
+    for (size_t i = 0; i < kWays; ++i) {
+      if (bucket[i].hash == hash) {
+        return &bucket[i];
+      }
+    }
+    return nullptr;
+  }
+};
+
+}}  // facebook::memcache
@@ -29,6 +29,10 @@ struct NullRoute {
     return "null";
   }
 
+  static bool completesInline() {
+    return true;
+  }
+
   template <class Operation, class Request>
   static std::vector<std::shared_ptr<RouteHandleIf>> couldRouteTo(
     const Request& req, Operation, const ContextPtr& ctx) {
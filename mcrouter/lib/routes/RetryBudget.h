@@ -0,0 +1,112 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <algorithm>
+
+#include <folly/dynamic.h>
+
+#include "mcrouter/lib/fbi/cpp/util.h"
+
+namespace facebook { namespace memcache {
+
+/**
+ * Allows retries (e.g. failover to the next destination) as a fraction of
+ * primary requests: every primary request adds `ratio` tokens to a bucket
+ * of up to `maxTokens`, and every retry takes one. When many destinations
+ * fail at once, this keeps retries from multiplying the load on the
+ * remaining ones.
+ *
+ * The bucket fills per request rather than per second, so the budget
+ * follows the primary request rate. Not thread safe, routes are per proxy.
+ */
+class RetryBudget {
+ public:
+  /**
+   * @param ratio  tokens added per primary request.
+   * @param maxTokens  bucket size, the bucket starts full.
+   */
+  RetryBudget(double ratio, double maxTokens)
+      : ratio_(ratio),
+        maxTokens_(maxTokens),
+        tokens_(maxTokens) {
+  }
+
+  /**
+   * @param json  { "ratio": double, "max_tokens": double (default 10) }
+   */
+  explicit RetryBudget(const folly::dynamic& json) {
+    checkLogic(json.isObject(), "retry_budget is not an object");
+    auto jratio = json.get_ptr("ratio");
+    checkLogic(jratio && jratio->isNumber(),
+               "retry_budget: 'ratio' is not a number");
+    ratio_ = jratio->asDouble();
+    checkLogic(ratio_ >= 0, "retry_budget: 'ratio' is negative");
+    maxTokens_ = 10;
+    if (auto jmax = json.get_ptr("max_tokens")) {
+      checkLogic(jmax->isNumber(),
+                 "retry_budget: 'max_tokens' is not a number");
+      maxTokens_ = jmax->asDouble();
+    }
+    checkLogic(maxTokens_ >= 1, "retry_budget: 'max_tokens' is less than 1");
+    tokens_ = maxTokens_;
+  }
+
+  void onRequest() {
+    tokens_ = std::min(maxTokens_, tokens_ + ratio_);
+  }
+
+  /**
+   * @return  true if the retry is allowed (and takes a token).
+   */
+  bool tryRetry() {
+    if (tokens_ < 1) {
+      return false;
+    }
+    tokens_ -= 1;
+    return true;
+  }
+
+  double available() const {
+    return tokens_;
+  }
+
+ private:
+  double ratio_;
+  double maxTokens_;
+  double tokens_;
+};
+
+namespace detail {
+
+/* Context defines onRetryDenied(), use it */
+template <class Context>
+auto contextOnRetryDenied(Context& ctx, int) -> decltype(ctx.onRetryDenied()) {
+  return ctx.onRetryDenied();
+}
+
+template <class Context>
+void contextOnRetryDenied(Context& ctx, long) {
+}
+
+}  // detail
+
+/**
+ * Tells the request context (if it defines `void onRetryDenied()`,
+ * e.g. to count it) that a retry was denied by a RetryBudget.
+ */
+template <class ContextPtr>
+void onRetryDenied(const ContextPtr& ctx) {
+  if (ctx) {
+    detail::contextOnRetryDenied(*ctx, 0);
+  }
+}
+
+}}  // facebook::memcache
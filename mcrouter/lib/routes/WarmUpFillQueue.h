@@ -0,0 +1,293 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <folly/dynamic.h>
+#include <folly/experimental/fibers/Baton.h>
+#include <folly/experimental/fibers/FiberManager.h>
+#include <folly/experimental/fibers/WhenN.h>
+
+#include "mcrouter/lib/fbi/cpp/util.h"
+
+namespace facebook { namespace memcache {
+
+enum class WarmUpFillEvent {
+  /* Waiting to be sent */
+  Queued,
+  /* Sent to the cold route */
+  Sent,
+  /* The key was queued or sent less than dedup_ms ago */
+  Deduplicated,
+  /* max_queued fills were already waiting */
+  Dropped,
+};
+
+/**
+ * Cold fills of a WarmUpRoute ("fill" in its config), sent in the
+ * background by one fiber instead of one fiber per warm hit:
+ *
+ *  - fills are sent in batches of up to batch_size at once, so that fills
+ *    to the same destination are pipelined on its connections, and the
+ *    next batch waits for the previous one;
+ *  - at most rate fills per second are sent (token bucket of burst
+ *    fills), the others wait;
+ *  - a fill for a key that was queued or sent less than dedup_ms ago is
+ *    dropped (a queued one is replaced, the latest value wins);
+ *  - hot keys go first: each batch takes the queued fills with the most
+ *    warm hits since they were queued;
+ *  - once max_queued fills are waiting, fills of new keys are dropped.
+ *
+ * Not thread safe, routes are per proxy.
+ */
+class WarmUpFillQueue {
+ public:
+  struct Options {
+    /* Fills per second, 0 means no limit */
+    double rate{0};
+    double burst{32};
+    size_t batchSize{32};
+    std::chrono::milliseconds dedupWindow{1000};
+    size_t maxQueued{1000};
+  };
+
+  struct Stats {
+    size_t sent{0};
+    size_t deduplicated{0};
+    size_t dropped{0};
+  };
+
+  /* At most this many recently sent keys are remembered for dedup_ms */
+  static constexpr size_t kMaxRecentKeys = 100000;
+
+  explicit WarmUpFillQueue(Options opts)
+      : state_(std::make_shared<State>(std::move(opts))) {
+  }
+
+  /**
+   * @param json  {"rate": number, "burst": number, "batch_size": int,
+   *               "dedup_ms": int, "max_queued": int}, all optional
+   */
+  explicit WarmUpFillQueue(const folly::dynamic& json)
+      : WarmUpFillQueue(parseOptions(json)) {
+  }
+
+  /**
+   * Queues a fill of key (unless it's deduplicated or dropped), starting
+   * the sending fiber if needed. Fiber context only.
+   *
+   * @return  Queued, Deduplicated or Dropped.
+   */
+  WarmUpFillEvent add(std::string key, std::function<void()> fill) {
+    auto& state = *state_;
+    auto now = nowUs();
+    state.expireRecent(now);
+
+    auto it = state.queued.find(key);
+    if (it != state.queued.end()) {
+      it->second.fill = std::move(fill);
+      ++it->second.hits;
+      ++state.stats.deduplicated;
+      return WarmUpFillEvent::Deduplicated;
+    }
+    if (state.recentKeys.count(key)) {
+      ++state.stats.deduplicated;
+      return WarmUpFillEvent::Deduplicated;
+    }
+    /* New keys have the fewest hits, so they are the ones to drop */
+    if (state.queued.size() >= state.opts.maxQueued) {
+      ++state.stats.dropped;
+      return WarmUpFillEvent::Dropped;
+    }
+
+    state.queued.emplace(std::move(key), Entry{std::move(fill), 1});
+    if (!state.sending) {
+      state.sending = true;
+      auto statePtr = state_;
+      folly::fibers::addTask([statePtr]() {
+        send(*statePtr);
+      });
+    }
+    return WarmUpFillEvent::Queued;
+  }
+
+  size_t queued() const {
+    return state_->queued.size();
+  }
+
+  const Stats& stats() const {
+    return state_->stats;
+  }
+
+ private:
+  struct Entry {
+    std::function<void()> fill;
+    /* Warm hits since the fill was queued */
+    size_t hits;
+  };
+
+  /* Shared with the sending fiber, which may outlive the route */
+  struct State {
+    const Options opts;
+    std::unordered_map<std::string, Entry> queued;
+    /* Keys sent within dedupWindow, and when, oldest first */
+    std::deque<std::pair<int64_t, std::string>> recent;
+    std::unordered_map<std::string, int64_t> recentKeys;
+    double tokens;
+    int64_t lastRefillUs;
+    /* True while the sending fiber runs */
+    bool sending{false};
+    Stats stats;
+
+    explicit State(Options o)
+        : opts(std::move(o)),
+          tokens(opts.burst),
+          lastRefillUs(nowUs()) {
+    }
+
+    void expireRecent(int64_t now) {
+      auto windowUs = opts.dedupWindow.count() * 1000;
+      while (!recent.empty() &&
+             (now - recent.front().first >= windowUs ||
+              recent.size() > kMaxRecentKeys)) {
+        auto it = recentKeys.find(recent.front().second);
+        /* The key may have been sent again since */
+        if (it != recentKeys.end() && it->second == recent.front().first) {
+          recentKeys.erase(it);
+        }
+        recent.pop_front();
+      }
+    }
+  };
+
+  std::shared_ptr<State> state_;
+
+  static int64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  static Options parseOptions(const folly::dynamic& json) {
+    checkLogic(json.isObject(), "WarmUpRoute: fill is not an object");
+    Options opts;
+    auto getInt = [&json](const char* name, size_t defaultValue) -> size_t {
+      auto jvalue = json.get_ptr(name);
+      if (!jvalue) {
+        return defaultValue;
+      }
+      checkLogic(jvalue->isInt() && jvalue->getInt() > 0,
+                 "WarmUpRoute: fill.{} is not a positive int", name);
+      return jvalue->getInt();
+    };
+    opts.batchSize = getInt("batch_size", opts.batchSize);
+    opts.dedupWindow = std::chrono::milliseconds(
+      getInt("dedup_ms", opts.dedupWindow.count()));
+    opts.maxQueued = getInt("max_queued", opts.maxQueued);
+    if (auto jrate = json.get_ptr("rate")) {
+      checkLogic(jrate->isNumber() && jrate->asDouble() >= 0,
+                 "WarmUpRoute: fill.rate is not a non-negative number");
+      opts.rate = jrate->asDouble();
+    }
+    opts.burst = opts.batchSize;
+    if (auto jburst = json.get_ptr("burst")) {
+      checkLogic(jburst->isNumber() && jburst->asDouble() >= 1,
+                 "WarmUpRoute: fill.burst is not a number >= 1");
+      opts.burst = jburst->asDouble();
+    }
+    return opts;
+  }
+
+  static void send(State& state) {
+    while (!state.queued.empty()) {
+      auto count = std::min(state.queued.size(), state.opts.batchSize);
+      if (state.opts.rate > 0) {
+        auto now = nowUs();
+        state.tokens = std::min(
+          state.opts.burst,
+          state.tokens + (now - state.lastRefillUs) * state.opts.rate / 1e6);
+        state.lastRefillUs = now;
+        if (state.tokens < 1) {
+          folly::fibers::Baton baton;
+          baton.timed_wait(std::chrono::microseconds(static_cast<int64_t>(
+            (1 - state.tokens) * 1e6 / state.opts.rate) + 1));
+          continue;
+        }
+        count = std::min(count, static_cast<size_t>(state.tokens));
+        state.tokens -= count;
+      }
+
+      /* The count hottest fills */
+      std::vector<decltype(state.queued)::iterator> its;
+      its.reserve(state.queued.size());
+      for (auto it = state.queued.begin(); it != state.queued.end(); ++it) {
+        its.push_back(it);
+      }
+      std::nth_element(its.begin(), its.begin() + (count - 1), its.end(),
+                       [](decltype(its)::const_reference a,
+                          decltype(its)::const_reference b) {
+                         return a->second.hits > b->second.hits;
+                       });
+
+      auto now = nowUs();
+      std::vector<std::function<void()>> batch;
+      batch.reserve(count);
+      for (size_t i = 0; i < count; ++i) {
+        batch.push_back(std::move(its[i]->second.fill));
+        state.recent.emplace_back(now, its[i]->first);
+        state.recentKeys[its[i]->first] = now;
+        state.queued.erase(its[i]);
+      }
+      state.expireRecent(now);
+      state.stats.sent += batch.size();
+
+      /* Send the whole batch at once, so it's pipelined on the connections */
+      folly::fibers::forEach(batch.begin(), batch.end(), [] (size_t id) {});
+    }
+    state.sending = false;
+  }
+};
+
+namespace detail {
+
+/* Context defines onWarmUpFill(WarmUpFillEvent), use it */
+template <class Context>
+auto contextOnWarmUpFill(Context& ctx, WarmUpFillEvent event, int)
+    -> decltype(ctx.onWarmUpFill(event)) {
+  return ctx.onWarmUpFill(event);
+}
+
+template <class Context>
+void contextOnWarmUpFill(Context& ctx, WarmUpFillEvent event, long) {
+}
+
+}  // detail
+
+/**
+ * Tells the request context (if it defines
+ * `void onWarmUpFill(WarmUpFillEvent)`, e.g. to count it) what happened
+ * to the cold fill of its warm hit.
+ */
+template <class ContextPtr>
+void onWarmUpFill(const ContextPtr& ctx, WarmUpFillEvent event) {
+  if (ctx) {
+    detail::contextOnWarmUpFill(*ctx, event, 0);
+  }
+}
+
+}}  // facebook::memcache
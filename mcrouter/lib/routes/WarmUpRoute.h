@@ -12,6 +12,7 @@
 #include <memory>
 #include <string>
 
+#include <folly/Optional.h>
 #include <folly/dynamic.h>
 #include <folly/experimental/fibers/FiberManager.h>
 #include <folly/io/IOBuf.h>
@@ -20,9 +21,11 @@
 #include "mcrouter/lib/fbi/cpp/util.h"
 #include "mcrouter/lib/mc/msg.h"
 #include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/McRequestBase.h"
 #include "mcrouter/lib/Operation.h"
 #include "mcrouter/lib/OperationTraits.h"
 #include "mcrouter/lib/Reply.h"
+#include "mcrouter/lib/routes/WarmUpFillQueue.h"
 
 namespace facebook { namespace memcache {
 
@@ -54,6 +57,11 @@ namespace facebook { namespace memcache {
  * fetched from "warm" on every update operation with additional 'metaget'
  * request.
  * NOTE: Make sure memcached supports 'metaget' before omitting "exptime" field.
+ *
+ * With a "fill" object, the asynchronous updates of "cold" (add and lease
+ * set) are batched, rate limited and deduplicated by key, see
+ * WarmUpFillQueue. That keeps a new cold pool from getting a fill for
+ * every warm hit while it's being brought online.
  */
 template <class RouteHandleIf>
 class WarmUpRoute {
@@ -69,12 +77,18 @@ class WarmUpRoute {
     return {cold_, warm_};
   }
 
+  /**
+   * @param exptime  of cold updates, none to fetch it from warm (metaget)
+   * @param fillQueue  batches cold updates if not nullptr, see "fill"
+   */
   WarmUpRoute(std::shared_ptr<RouteHandleIf> warm,
               std::shared_ptr<RouteHandleIf> cold,
-              uint32_t exptime)
+              folly::Optional<uint32_t> exptime,
+              std::shared_ptr<WarmUpFillQueue> fillQueue = nullptr)
   : warm_(std::move(warm)),
     cold_(std::move(cold)),
-    exptime_(exptime) {
+    exptime_(exptime),
+    fillQueue_(std::move(fillQueue)) {
 
     assert(warm_ != nullptr);
     assert(cold_ != nullptr);
@@ -91,6 +105,9 @@ class WarmUpRoute {
                  "WarmUpRoute: exptime is not an integer");
       exptime_ = json["exptime"].getInt();
     }
+    if (auto jfill = json.get_ptr("fill")) {
+      fillQueue_ = std::make_shared<WarmUpFillQueue>(*jfill);
+    }
 
     cold_ = factory.create(json["cold"]);
     warm_ = factory.create(json["warm"]);
@@ -113,12 +130,17 @@ class WarmUpRoute {
 #endif
     uint32_t exptime;
     if (warmReply.isHit() && getExptimeForCold(req, exptime, ctx)) {
-      folly::fibers::addTask([
-          cold = cold_,
-          addReq = coldUpdateFromWarm(req, warmReply, exptime),
-          ctx]() {
-        cold->route(addReq, McOperation<mc_op_add>(), ctx);
-      });
+      if (fillQueue_) {
+        queueFill(req, coldUpdateFromWarm(req, warmReply, exptime),
+                  McOperation<mc_op_add>(), ctx);
+      } else {
+        folly::fibers::addTask([
+            cold = cold_,
+            addReq = coldUpdateFromWarm(req, warmReply, exptime),
+            ctx]() {
+          cold->route(addReq, McOperation<mc_op_add>(), ctx);
+        });
+      }
     }
 #ifdef __clang__
 #pragma clang diagnostic pop
@@ -161,9 +183,14 @@ class WarmUpRoute {
       auto setReq = coldUpdateFromWarm(req, warmReply, exptime);
       setReq.setLeaseToken(coldReply.leaseToken());
 
-      folly::fibers::addTask([cold = cold_, req = std::move(setReq), ctx]() {
-        cold->route(req, McOperation<mc_op_lease_set>(), ctx);
-      });
+      if (fillQueue_) {
+        queueFill(req, std::move(setReq), McOperation<mc_op_lease_set>(),
+                  ctx);
+      } else {
+        folly::fibers::addTask([cold = cold_, req = std::move(setReq), ctx]() {
+          cold->route(req, McOperation<mc_op_lease_set>(), ctx);
+        });
+      }
       return warmReply;
     }
 #ifdef __clang__
@@ -208,6 +235,21 @@ class WarmUpRoute {
   std::shared_ptr<RouteHandleIf> warm_;
   std::shared_ptr<RouteHandleIf> cold_;
   folly::Optional<uint32_t> exptime_;
+  std::shared_ptr<WarmUpFillQueue> fillQueue_;
+
+  template <class Operation, class Request>
+  void queueFill(const Request& origReq, Request fillReq, Operation,
+                 const ContextPtr& ctx) {
+    auto cold = cold_;
+    auto reqPtr = std::make_shared<Request>(std::move(fillReq));
+    auto event = fillQueue_->add(
+      origReq.fullKey().str(),
+      [cold, reqPtr, ctx]() {
+        onWarmUpFill(ctx, WarmUpFillEvent::Sent);
+        cold->route(*reqPtr, Operation(), ctx);
+      });
+    onWarmUpFill(ctx, event);
+  }
 
   template <class Request, class Reply>
   static Request coldUpdateFromWarm(const Request& origReq,
@@ -219,6 +261,7 @@ class WarmUpRoute {
     req.setValue(std::move(cloned));
     req.setFlags(reply.flags());
     req.setExptime(exptime);
+    req.setPriority(RequestPriority::LOW);
     return std::move(req);
   }
 
@@ -0,0 +1,40 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/CountMinSketch.h"
+
+using facebook::memcache::CountMinSketch;
+
+TEST(CountMinSketch, counts) {
+  CountMinSketch sketch(1024, 1000000);
+
+  for (uint32_t i = 0; i < 100; ++i) {
+    EXPECT_EQ(i + 1, sketch.increment(42));
+  }
+  for (uint32_t hash = 1000; hash < 2000; ++hash) {
+    sketch.increment(hash);
+  }
+  /* Never underestimates */
+  EXPECT_LE(100, sketch.estimate(42));
+  EXPECT_GT(110, sketch.estimate(42));
+  EXPECT_GE(3, sketch.estimate(7));
+}
+
+TEST(CountMinSketch, aging) {
+  CountMinSketch sketch(1024, 100);
+
+  for (size_t i = 0; i < 99; ++i) {
+    sketch.increment(42);
+  }
+  EXPECT_EQ(99, sketch.estimate(42));
+  /* 100th increment halves all counters first */
+  EXPECT_EQ(50, sketch.increment(42));
+}
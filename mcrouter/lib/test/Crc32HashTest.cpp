@@ -45,3 +45,31 @@ TEST(Crc32Func, basic) {
   std::reverse(test_max_key.begin(), test_max_key.end());
   EXPECT_EQ(97630, func_99999(test_max_key));
 }
+
+namespace {
+
+/* Bitwise CRC-32, independent of the table-driven and hardware paths */
+uint32_t referenceCrc32(const std::string& s) {
+  uint32_t crc = ~0u;
+  for (unsigned char c : s) {
+    crc ^= c;
+    for (int k = 0; k < 8; ++k) {
+      crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+}  // anonymous namespace
+
+TEST(Crc32Func, allLengths) {
+  EXPECT_EQ(0xcbf43926, crc32_hash("123456789", 9));
+
+  /* Cover the bytewise, slicing-by-8 and folding paths, and their tails */
+  std::string key;
+  for (int i = 0; i < 300; ++i) {
+    EXPECT_EQ(referenceCrc32(key), crc32_hash(key.data(), key.size()))
+      << "length " << key.size();
+    key.push_back(static_cast<char>(i * 37 + 11));
+  }
+}
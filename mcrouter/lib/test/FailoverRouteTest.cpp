@@ -8,6 +8,7 @@
  *
  */
 #include <memory>
+#include <string>
 #include <vector>
 
 #include <gtest/gtest.h>
@@ -82,3 +83,71 @@ TEST(failoverRouteTest, fail) {
   /* Will return the last reply when ran out of targets */
   EXPECT_EQ(toString(reply.value()), "c");
 }
+
+TEST(failoverRouteTest, batch) {
+  vector<std::shared_ptr<TestHandle>> test_handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_timeout, "a")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "b")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "c"))
+  };
+
+  TestRouteHandle<FailoverRoute<TestRouteHandleIf>> rh(
+    get_route_handles(test_handles));
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    vector<McRequest> reqs;
+    reqs.emplace_back("0");
+    reqs.emplace_back("1");
+    vector<const McRequest*> batch{&reqs[0], &reqs[1]};
+    auto replies = rh.routeBatch(batch, McOperation<mc_op_get>(), nullptr);
+    ASSERT_EQ(2, replies.size());
+    EXPECT_EQ("b", toString(replies[0].value()));
+    EXPECT_EQ("b", toString(replies[1].value()));
+  });
+
+  /* Both failed requests were retried on the second destination only */
+  EXPECT_EQ((vector<std::string>{"0", "1"}), test_handles[0]->saw_keys);
+  EXPECT_EQ((vector<std::string>{"0", "1"}), test_handles[1]->saw_keys);
+  EXPECT_TRUE(test_handles[2]->saw_keys.empty());
+}
+
+TEST(failoverRouteTest, deadlineExceeded) {
+  vector<std::shared_ptr<TestHandle>> test_handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_timeout, "a")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "b"))
+  };
+
+  TestRouteHandle<FailoverRoute<TestRouteHandleIf>> rh(
+    get_route_handles(test_handles));
+
+  auto ctx = make_shared<TestContext>();
+  ctx->setDeadlineExceeded(true);
+  auto reply = rh.route(McRequest("0"), McOperation<mc_op_get>(), ctx);
+
+  /* No failover once the requester gave up */
+  EXPECT_EQ(mc_res_timeout, reply.result());
+  EXPECT_TRUE(test_handles[1]->saw_keys.empty());
+}
+
+TEST(failoverRouteTest, retryBudget) {
+  vector<std::shared_ptr<TestHandle>> test_handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_timeout, "a")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "b"))
+  };
+
+  /* One retry saved up, half a retry per request */
+  TestRouteHandle<FailoverRoute<TestRouteHandleIf>> rh(
+    get_route_handles(test_handles), make_shared<RetryBudget>(0.5, 1));
+
+  auto ctx = make_shared<TestContext>();
+  vector<std::string> values;
+  for (size_t i = 0; i < 4; ++i) {
+    auto reply = rh.route(McRequest("0"), McOperation<mc_op_get>(), ctx);
+    values.push_back(toString(reply.value()));
+  }
+
+  EXPECT_EQ((vector<std::string>{"b", "a", "b", "a"}), values);
+  EXPECT_EQ(2, ctx->retriesDenied);
+  EXPECT_EQ(2, test_handles[1]->saw_keys.size());
+}
@@ -0,0 +1,90 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+
+#include "mcrouter/lib/fbi/hash.h"
+
+/**
+ * furc_hash() of one key at a time vs furc_hash_array() of kBatch keys,
+ * for pool sizes from 1 to 131071. Times are per key.
+ */
+
+namespace {
+
+const size_t kNumKeys = 1024;
+const size_t kBatch = 16;
+
+std::vector<std::string> keys;
+std::vector<const char*> keyPtrs;
+std::vector<size_t> keyLens;
+
+void prepareKeys() {
+  for (size_t i = 0; i < kNumKeys; ++i) {
+    keys.push_back("tao:assoc:" + folly::to<std::string>(i * 7919));
+  }
+  for (const auto& key : keys) {
+    keyPtrs.push_back(key.data());
+    keyLens.push_back(key.size());
+  }
+}
+
+void runScalar(uint32_t m, size_t iters) {
+  size_t sum = 0;
+  for (size_t i = 0; i < iters; ++i) {
+    auto k = i % kNumKeys;
+    sum += furc_hash(keyPtrs[k], keyLens[k], m);
+  }
+  folly::doNotOptimizeAway(sum);
+}
+
+void runArray(uint32_t m, size_t iters) {
+  uint32_t results[kBatch];
+  size_t sum = 0;
+  for (size_t i = 0; i < iters; i += kBatch) {
+    auto k = i % (kNumKeys - kBatch);
+    auto n = std::min(kBatch, iters - i);
+    furc_hash_array(keyPtrs.data() + k, keyLens.data() + k, n, m, results);
+    sum += results[0];
+  }
+  folly::doNotOptimizeAway(sum);
+}
+
+}  // anonymous namespace
+
+#define FURC_BENCHMARKS(m)                        \
+  BENCHMARK(furc_hash_##m, iters) {               \
+    runScalar(m, iters);                          \
+  }                                               \
+  BENCHMARK_RELATIVE(furc_hash_array_##m, iters) { \
+    runArray(m, iters);                           \
+  }                                               \
+  BENCHMARK_DRAW_LINE();
+
+FURC_BENCHMARKS(1)
+FURC_BENCHMARKS(10)
+FURC_BENCHMARKS(100)
+FURC_BENCHMARKS(1000)
+FURC_BENCHMARKS(2000)
+FURC_BENCHMARKS(10000)
+FURC_BENCHMARKS(131071)
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  prepareKeys();
+  folly::runBenchmarks();
+  return 0;
+}
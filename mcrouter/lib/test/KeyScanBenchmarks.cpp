@@ -0,0 +1,152 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <cctype>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+#include <folly/Range.h>
+
+#include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/lib/mc/msg.h"
+#include "mcrouter/lib/mc/protocol.h"
+
+/**
+ * mc_key_scan() vs the byte loop validation plus find() based parsing it
+ * replaced (key check, then /region/cluster/ prefix, then "|#|"), over keys
+ * shaped like production traffic:
+ *   50%  "<service>:<id>" of 16-40 bytes,
+ *   30%  with a /region/cluster/ prefix, 40-80 bytes,
+ *   15%  with a "|#|" hash stop, 40-100 bytes,
+ *    5%  long keys, 100-250 bytes.
+ * Times are per key.
+ */
+
+using namespace facebook::memcache;
+
+namespace {
+
+const size_t kNumKeys = 4096;
+
+std::vector<std::string> keys;
+
+std::string randomKey(std::mt19937& gen) {
+  auto len = [&gen](size_t from, size_t to) {
+    return std::uniform_int_distribution<size_t>(from, to)(gen);
+  };
+  auto filler = [&gen](size_t n) {
+    std::string s;
+    for (size_t i = 0; i < n; ++i) {
+      s.push_back('a' + gen() % 26);
+    }
+    return s;
+  };
+
+  auto kind = gen() % 100;
+  if (kind < 50) {
+    return "tao:" + filler(len(12, 36));
+  } else if (kind < 80) {
+    return "/region" + folly::to<std::string>(gen() % 10) + "/cluster/" +
+      filler(len(24, 64));
+  } else if (kind < 95) {
+    return "tao:" + filler(len(20, 60)) + "|#|" + filler(len(13, 33));
+  }
+  return "tao:" + filler(len(96, 246));
+}
+
+void prepareKeys() {
+  std::mt19937 gen(42);
+  for (size_t i = 0; i < kNumKeys; ++i) {
+    keys.push_back(randomKey(gen));
+  }
+}
+
+mc_req_err_t byteLoopCheck(folly::StringPiece key) {
+  if (key.empty()) {
+    return mc_req_err_no_key;
+  }
+  if (key.size() > MC_KEY_MAX_LEN) {
+    return mc_req_err_key_too_long;
+  }
+  for (auto c : key) {
+    if (iscntrl(c) || isspace(c)) {
+      return mc_req_err_space_or_ctrl;
+    }
+  }
+  return mc_req_err_valid;
+}
+
+size_t findParse(folly::StringPiece key) {
+  size_t prefixLen = 0;
+  if (!key.empty() && key[0] == '/') {
+    size_t pos = 1;
+    for (int i = 0; i < 2; ++i) {
+      pos = key.find('/', pos);
+      if (pos == std::string::npos) {
+        break;
+      }
+      ++pos;
+    }
+    if (pos != std::string::npos) {
+      prefixLen = pos;
+    }
+  }
+  auto stop = key.subpiece(prefixLen).find("|#|");
+  return prefixLen + (stop == std::string::npos ? 0 : stop);
+}
+
+}  // anonymous namespace
+
+BENCHMARK(byte_loop_check, iters) {
+  size_t sum = 0;
+  for (size_t i = 0; i < iters; ++i) {
+    sum += byteLoopCheck(keys[i % kNumKeys]);
+  }
+  folly::doNotOptimizeAway(sum);
+}
+
+BENCHMARK_RELATIVE(mc_key_scan_check, iters) {
+  size_t sum = 0;
+  for (size_t i = 0; i < iters; ++i) {
+    sum += mc_key_scan(to<nstring_t>(keys[i % kNumKeys])).err;
+  }
+  folly::doNotOptimizeAway(sum);
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(byte_loop_check_and_find_parse, iters) {
+  size_t sum = 0;
+  for (size_t i = 0; i < iters; ++i) {
+    const auto& key = keys[i % kNumKeys];
+    sum += byteLoopCheck(key) + findParse(key);
+  }
+  folly::doNotOptimizeAway(sum);
+}
+
+BENCHMARK_RELATIVE(mc_key_scan_all, iters) {
+  size_t sum = 0;
+  for (size_t i = 0; i < iters; ++i) {
+    auto scan = mc_key_scan(to<nstring_t>(keys[i % kNumKeys]));
+    sum += scan.err + scan.routing_prefix_len + scan.hash_stop;
+  }
+  folly::doNotOptimizeAway(sum);
+}
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  prepareKeys();
+  folly::runBenchmarks();
+  return 0;
+}
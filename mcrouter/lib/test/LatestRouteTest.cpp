@@ -7,11 +7,14 @@
  *  of patent rights can be found in the PATENTS file in the same directory.
  *
  */
+#include <chrono>
 #include <memory>
+#include <thread>
 #include <vector>
 
 #include <gtest/gtest.h>
 
+#include <folly/dynamic.h>
 #include <folly/Hash.h>
 
 #include "mcrouter/lib/fbi/cpp/globals.h"
@@ -64,3 +67,55 @@ TEST(latestRouteTest, one) {
   auto reply = rh.routeSimple(McRequest("key"), McOperation<mc_op_get>());
   EXPECT_EQ(reply.result(), mc_res_tko);
 }
+
+TEST(latestRouteTest, latencyAware) {
+  vector<std::shared_ptr<TestHandle>> test_handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "b")),
+  };
+
+  auto json = folly::dynamic::object
+    ("failover_count", 2)
+    ("latency_aware", true)
+    ("latency_reorder_requests", 1);
+  LatestRoute<TestRouteHandleIf> rh(json, get_route_handles(test_handles));
+
+  auto get = [&rh]() {
+    auto reply = rh.route(McRequest("key"), McOperation<mc_op_get>(),
+                          nullptr);
+    return toString(reply.value());
+  };
+
+  /* Whichever target gets the first request is slow */
+  test_handles[0]->pause();
+  test_handles[1]->pause();
+  TestFiberManager fm;
+  fm.runAll({
+    [&]() { get(); },
+    [&]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      test_handles[0]->unpause();
+      test_handles[1]->unpause();
+    }
+  });
+  test_handles[0]->isPaused = false;
+  test_handles[1]->isPaused = false;
+  size_t slow = test_handles[0]->saw_keys.empty() ? 1 : 0;
+  size_t fast = 1 - slow;
+  EXPECT_EQ(1, test_handles[slow]->saw_keys.size());
+
+  /* The fast one gets measured on failover */
+  test_handles[slow]->setTko();
+  EXPECT_EQ(std::string(1, 'a' + fast), get());
+  test_handles[slow]->unsetTko();
+
+  /* The slow one is now only used if the fast one fails */
+  for (size_t i = 0; i < 5; ++i) {
+    EXPECT_EQ(std::string(1, 'a' + fast), get());
+  }
+  EXPECT_EQ(test_handles[slow]->rh, rh.targetsInOrder().back());
+  EXPECT_GT(rh.latency(0), 0);
+  EXPECT_GT(rh.latency(1), 0);
+  test_handles[fast]->setTko();
+  EXPECT_EQ(std::string(1, 'a' + slow), get());
+}
@@ -0,0 +1,86 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <folly/io/async/EventBase.h>
+
+#include "mcrouter/lib/MessageQueue.h"
+
+using namespace facebook::memcache;
+
+TEST(MessageQueue, singleThread) {
+  folly::EventBase evb;
+  std::vector<int> received;
+  MessageQueue<int> queue(16, [&received](int&& v) {
+    received.push_back(v);
+  });
+  queue.attachEventBase(evb.getLibeventBase(), -1);
+
+  for (int i = 0; i < 10; ++i) {
+    queue.blockingWrite(i);
+  }
+  EXPECT_EQ(10, queue.size());
+
+  /* All messages are delivered by one wakeup */
+  evb.loopOnce();
+  ASSERT_EQ(10, received.size());
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(i, received[i]);
+  }
+  EXPECT_EQ(0, queue.size());
+}
+
+TEST(MessageQueue, multipleProducers) {
+  const int kThreads = 4;
+  const int kPerThread = 10000;
+
+  folly::EventBase evb;
+  int64_t sum = 0;
+  int count = 0;
+  MessageQueue<int> queue(64, [&sum, &count](int&& v) {
+    sum += v;
+    ++count;
+  });
+  queue.attachEventBase(evb.getLibeventBase(), -1);
+
+  std::vector<std::thread> producers;
+  for (int t = 0; t < kThreads; ++t) {
+    producers.emplace_back([&queue]() {
+      for (int i = 1; i <= kPerThread; ++i) {
+        queue.blockingWrite(i);
+      }
+    });
+  }
+
+  while (count < kThreads * kPerThread) {
+    evb.loopOnce();
+  }
+  for (auto& t : producers) {
+    t.join();
+  }
+
+  EXPECT_EQ(kThreads * kPerThread, count);
+  EXPECT_EQ(kThreads * (int64_t)kPerThread * (kPerThread + 1) / 2, sum);
+}
+
+TEST(MessageQueue, sweepOnDestruction) {
+  folly::EventBase evb;
+  int count = 0;
+  {
+    MessageQueue<int> queue(16, [&count](int&&) { ++count; });
+    queue.attachEventBase(evb.getLibeventBase(), -1);
+    queue.blockingWrite(1);
+    queue.blockingWrite(2);
+  }
+  EXPECT_EQ(2, count);
+}
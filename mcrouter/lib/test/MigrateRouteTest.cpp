@@ -7,9 +7,11 @@
  *  of patent rights can be found in the PATENTS file in the same directory.
  *
  */
+#include <algorithm>
 #include <ctime>
 #include <functional>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include <gtest/gtest.h>
@@ -191,3 +193,61 @@ TEST(migrateRouteTest, migrate) {
     }
   });
 }
+
+TEST(migrateRouteTest, ramp) {
+  auto start_time = time(nullptr);
+  auto interval = 50;
+  auto ramp = 100;
+
+  /* Halfway through the ramp */
+  auto tp_func =
+    [start_time](const McRequest& req) {
+      return start_time + 50;
+    };
+  typedef decltype(tp_func) TimeProviderFunc;
+
+  auto from = make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a"),
+                                      UpdateRouteTestData(mc_res_stored),
+                                      DeleteRouteTestData(mc_res_deleted));
+  auto to = make_shared<TestHandle>(GetRouteTestData(mc_res_notfound, ""),
+                                    UpdateRouteTestData(mc_res_stored),
+                                    DeleteRouteTestData(mc_res_notfound));
+  auto route_handles = get_route_handles(
+    vector<std::shared_ptr<TestHandle>>{from, to});
+
+  TestFiberManager fm;
+  size_t numMigrated = 0;
+  fm.run([&]() {
+    TestRouteHandle<MigrateRoute<TestRouteHandleIf, TimeProviderFunc>> rh(
+      route_handles[0], route_handles[1], start_time, interval, tp_func,
+      ramp, 1);
+
+    for (int i = 0; i < 100; ++i) {
+      McRequest req("key" + std::to_string(i));
+      bool migrated = req.routingKeyHash() < (1ULL << 31);
+      numMigrated += migrated;
+
+      auto possibleGet = rh.couldRouteToSimple(req, McOperation<mc_op_get>());
+      EXPECT_EQ(migrated ? 2 : 1, possibleGet.size());
+      auto possibleDel = rh.couldRouteToSimple(req,
+                                               McOperation<mc_op_delete>());
+      EXPECT_EQ(2, possibleDel.size());
+
+      from->saw_keys.clear();
+      to->saw_keys.clear();
+      auto reply = rh.routeSimple(req, McOperation<mc_op_get>());
+      /* Migrated keys miss in to, and are read from from */
+      EXPECT_EQ("a", toString(reply.value()));
+      EXPECT_EQ(vector<string>{req.fullKey().str()}, from->saw_keys);
+      EXPECT_EQ(migrated, !to->saw_keys.empty());
+    }
+    EXPECT_LT(20, numMigrated);
+    EXPECT_GT(80, numMigrated);
+  });
+  fm.run([&]() {
+    /* Misses of migrated keys were filled */
+    auto adds = std::count(to->sawOperations.begin(),
+                           to->sawOperations.end(), mc_op_add);
+    EXPECT_EQ(numMigrated, static_cast<size_t>(adds));
+  });
+}
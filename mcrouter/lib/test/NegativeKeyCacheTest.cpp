@@ -0,0 +1,112 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/routes/L1L2CacheRoute.h"
+#include "mcrouter/lib/routes/NegativeKeyCache.h"
+#include "mcrouter/lib/test/RouteHandleTestUtil.h"
+#include "mcrouter/lib/test/TestRouteHandle.h"
+
+using namespace facebook::memcache;
+
+using std::make_shared;
+using std::vector;
+
+using TestHandle = TestHandleImpl<TestRouteHandleIf>;
+
+TEST(NegativeKeyCache, ttl) {
+  NegativeKeyCache cache(16, std::chrono::milliseconds(100));
+  auto now = NegativeKeyCache::Clock::now();
+  EXPECT_FALSE(cache.contains("a", now));
+
+  cache.insert("a", now);
+  EXPECT_TRUE(cache.contains("a", now));
+  EXPECT_TRUE(cache.contains("a", now + std::chrono::milliseconds(99)));
+  EXPECT_FALSE(cache.contains("b", now));
+
+  EXPECT_FALSE(cache.contains("a", now + std::chrono::milliseconds(100)));
+  /* Expired entries are dropped */
+  EXPECT_FALSE(cache.contains("a", now));
+}
+
+TEST(NegativeKeyCache, erase) {
+  NegativeKeyCache cache(16, std::chrono::seconds(10));
+  cache.insert("a");
+  cache.insert("b");
+  cache.erase("a");
+  EXPECT_FALSE(cache.contains("a"));
+  EXPECT_TRUE(cache.contains("b"));
+}
+
+TEST(NegativeKeyCache, full) {
+  NegativeKeyCache cache(1, std::chrono::seconds(10));
+  EXPECT_EQ(size_t{NegativeKeyCache::kWays}, cache.capacity());
+
+  auto now = NegativeKeyCache::Clock::now();
+  for (size_t i = 0; i < 100; ++i) {
+    cache.insert("key" + std::to_string(i),
+                 now + std::chrono::milliseconds(i));
+  }
+  /* The most recent ones are kept */
+  size_t found = 0;
+  for (size_t i = 0; i < 100; ++i) {
+    found += cache.contains("key" + std::to_string(i), now);
+  }
+  EXPECT_EQ(size_t{NegativeKeyCache::kWays}, found);
+  EXPECT_TRUE(cache.contains("key99", now));
+}
+
+TEST(NegativeKeyCache, l1l2CacheRoute) {
+  vector<std::shared_ptr<TestHandle>> l1{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_notfound, ""),
+                            UpdateRouteTestData(mc_res_stored),
+                            DeleteRouteTestData(mc_res_deleted))
+  };
+  vector<std::shared_ptr<TestHandle>> l2{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_notfound, ""))
+  };
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    TestRouteHandle<L1L2CacheRoute<TestRouteHandleIf>> rh(
+      l1[0]->rh, l2[0]->rh, /* upgradingL1Exptime */ 0,
+      /* ncacheExptime */ 0, /* ncacheUpdatePeriod */ 0,
+      /* hotMissRetries */ 0, std::chrono::milliseconds(0),
+      /* localNcacheSize */ 16, std::chrono::seconds(10));
+
+    auto reply = rh.routeSimple(McRequest("key"), McOperation<mc_op_get>());
+    EXPECT_TRUE(reply.isMiss());
+    EXPECT_EQ(1, l1[0]->saw_keys.size());
+    EXPECT_EQ(1, l2[0]->saw_keys.size());
+
+    /* Cached by this route, L1 isn't asked */
+    reply = rh.routeSimple(McRequest("key"), McOperation<mc_op_get>());
+    EXPECT_TRUE(reply.isMiss());
+    EXPECT_EQ(1, l1[0]->saw_keys.size());
+    EXPECT_EQ(1, l2[0]->saw_keys.size());
+
+    /* A set forgets it */
+    McRequest setReq("key");
+    setReq.setValue(folly::IOBuf(folly::IOBuf::COPY_BUFFER, "value"));
+    rh.routeSimple(setReq, McOperation<mc_op_set>());
+    EXPECT_EQ(2, l1[0]->saw_keys.size());
+
+    rh.routeSimple(McRequest("key"), McOperation<mc_op_get>());
+    EXPECT_EQ(3, l1[0]->saw_keys.size());
+    EXPECT_EQ(2, l2[0]->saw_keys.size());
+  });
+}
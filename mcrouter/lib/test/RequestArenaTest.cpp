@@ -0,0 +1,92 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/RequestArena.h"
+
+using namespace facebook::memcache;
+
+namespace {
+
+struct ArenaContext {
+  InlineArena<256> arena_;
+
+  Arena& arena() {
+    return arena_;
+  }
+};
+
+struct PlainContext {
+};
+
+}  // anonymous namespace
+
+TEST(RequestArena, inlineFirst) {
+  InlineArena<256> arena;
+  auto p = arena.allocate(100);
+  auto q = arena.allocate(100);
+  EXPECT_NE(p, q);
+  EXPECT_EQ(200, arena.bytesUsed());
+  EXPECT_EQ(0, arena.bytesMalloced());
+
+  /* Doesn't fit inline anymore */
+  arena.allocate(100);
+  EXPECT_EQ(size_t{Arena::kMinBlockSize}, arena.bytesMalloced());
+
+  /* Larger than a block gets a block of its own */
+  arena.allocate(3 * Arena::kMinBlockSize);
+  EXPECT_LT(3 * Arena::kMinBlockSize, arena.bytesMalloced());
+}
+
+TEST(RequestArena, alignment) {
+  Arena arena;
+  arena.allocate(1, 1);
+  for (size_t align : {2, 8, 16, 64}) {
+    auto p = reinterpret_cast<uintptr_t>(arena.allocate(1, align));
+    EXPECT_EQ(0, p % align);
+  }
+}
+
+TEST(RequestArena, vector) {
+  InlineArena<256> arena;
+  auto v = makeArenaVector<std::string>(&arena, 2);
+  for (int i = 0; i < 1000; ++i) {
+    v.push_back(std::to_string(i));
+  }
+  EXPECT_EQ("999", v.back());
+  EXPECT_LT(1000 * sizeof(std::string), arena.bytesUsed());
+
+  /* Moves keep the arena */
+  auto moved = std::move(v);
+  EXPECT_EQ(&arena, moved.get_allocator().arena());
+  EXPECT_EQ(1000, moved.size());
+}
+
+TEST(RequestArena, noArena) {
+  auto v = makeArenaVector<int>(nullptr, 10);
+  v.assign(100, 42);
+  EXPECT_EQ(nullptr, v.get_allocator().arena());
+  EXPECT_EQ(42, v[99]);
+}
+
+TEST(RequestArena, requestArena) {
+  auto ctx = std::make_shared<ArenaContext>();
+  EXPECT_EQ(&ctx->arena_, requestArena(ctx));
+
+  auto plain = std::make_shared<PlainContext>();
+  EXPECT_EQ(nullptr, requestArena(plain));
+
+  std::shared_ptr<ArenaContext> none;
+  EXPECT_EQ(nullptr, requestArena(none));
+}
@@ -17,9 +17,12 @@
 #include <folly/io/IOBuf.h>
 
 #include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/lib/mc/msg.h"
+#include "mcrouter/lib/mc/protocol.h"
 #include "mcrouter/lib/McMsgRef.h"
 #include "mcrouter/lib/McOperation.h"
 #include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/network/UmbrellaProtocol.h"
 #include "mcrouter/lib/test/RouteHandleTestUtil.h"
 
 using namespace facebook::memcache;
@@ -448,6 +451,153 @@ TEST(requestReply, mutableRequest) {
   EXPECT_TRUE(mc_msg_num_outstanding() == 0);
 }
 
+TEST(requestReply, requestMsgOnDemand) {
+  mc_msg_track_num_outstanding(1);
+
+  {
+    McRequest req("key");
+    req.setNumber(10);
+    /* No mc_msg_t until one is asked for */
+    EXPECT_EQ(0, mc_msg_num_outstanding());
+
+    auto msg = req.dependentMsg(mc_op_flushall);
+    EXPECT_EQ(10, msg->number);
+    EXPECT_TRUE(to<string>(msg->key) == "key");
+
+    auto copy = req.clone();
+    EXPECT_EQ(10, copy.number());
+  }
+
+  EXPECT_TRUE(mc_msg_num_outstanding() == 0);
+}
+
+TEST(requestReply, inlineKey) {
+  McRequest req("/region/cluster/key|#|etc");
+  auto moved = std::move(req);
+  EXPECT_EQ("/region/cluster/key|#|etc", moved.fullKey());
+  EXPECT_EQ("/region/cluster/", moved.routingPrefix());
+  EXPECT_EQ("key", moved.routingKey());
+  EXPECT_EQ("key|#|etc", moved.keyWithoutRoute());
+
+  moved.stripRoutingPrefix();
+  auto copy = moved.clone();
+  McRequest assigned("other");
+  assigned = std::move(moved);
+  for (auto r : {&copy, &assigned}) {
+    EXPECT_EQ("key|#|etc", r->fullKey());
+    EXPECT_EQ("", r->routingPrefix());
+    EXPECT_EQ("key", r->routingKey());
+    EXPECT_EQ(getMemcacheKeyHashValue("key"), r->routingKeyHash());
+  }
+
+  /* Setting a key from a piece of the current one */
+  copy.setKey(copy.routingKey());
+  EXPECT_EQ("key", copy.fullKey());
+
+  string longKey(McRequest::kMaxInlineKeySize + 1, 'a');
+  McRequest longReq(longKey);
+  auto longCopy = longReq.clone();
+  EXPECT_EQ(longKey, longCopy.fullKey());
+}
+
+TEST(requestReply, routingKeyHashes) {
+  McRequest req("/region/cluster/key|#|etc");
+  EXPECT_EQ(getMemcacheKeyHashValue("key"), req.routingKeyHash());
+  EXPECT_EQ(crc32_hash("key", 3), req.routingKeyCrc32());
+
+  auto copy = req.clone();
+  EXPECT_EQ(req.routingKeyHash(), copy.routingKeyHash());
+  EXPECT_EQ(req.routingKeyCrc32(), copy.routingKeyCrc32());
+
+  /* A new key invalidates the hashes */
+  copy.setKey("other");
+  EXPECT_EQ(getMemcacheKeyHashValue("other"), copy.routingKeyHash());
+  EXPECT_EQ(crc32_hash("other", 5), copy.routingKeyCrc32());
+}
+
+TEST(requestReply, keyScan) {
+  /* Boundaries on both sides of 16 byte blocks */
+  for (size_t pad = 0; pad < 40; ++pad) {
+    string filler(pad, 'a');
+    auto key = "/reg" + filler + "/cl|#|/" + filler + "key|#|" + filler;
+    McRequest req(key);
+    EXPECT_EQ(mc_req_err_valid, req.keyError());
+    EXPECT_EQ("/reg" + filler + "/cl|#|/", req.routingPrefix());
+    EXPECT_EQ(filler + "key", req.routingKey());
+
+    auto scan = mc_key_scan(to<nstring_t>(key));
+    EXPECT_EQ(req.routingPrefix().size(), scan.routing_prefix_len);
+    EXPECT_EQ(scan.routing_prefix_len + req.routingKey().size(),
+              scan.hash_stop);
+
+    for (auto bad : {' ', '\n', '\x7f', '\0'}) {
+      auto badKey = filler + bad + filler;
+      EXPECT_EQ(mc_req_err_space_or_ctrl,
+                mc_key_scan(to<nstring_t>(badKey)).err);
+    }
+  }
+
+  /* Not a full prefix, the hash stop counts from the start */
+  McRequest noPrefix("/region|#|key");
+  EXPECT_EQ("", noPrefix.routingPrefix());
+  EXPECT_EQ("/region", noPrefix.routingKey());
+
+  EXPECT_EQ(mc_req_err_valid, McRequest("k\x80\xff").keyError());
+  EXPECT_EQ(mc_req_err_no_key, McRequest("").keyError());
+  EXPECT_EQ(mc_req_err_key_too_long,
+            McRequest(string(MC_KEY_MAX_LEN + 1, 'a')).keyError());
+  EXPECT_EQ(mc_req_err_valid,
+            McRequest(string(MC_KEY_MAX_LEN, 'a')).keyError());
+
+  McRequest modified("key");
+  modified.setKeyFromParts({"key", " suffix"});
+  EXPECT_EQ(mc_req_err_space_or_ctrl, modified.keyError());
+}
+
+TEST(requestReply, coalesceValue) {
+  auto buf = folly::IOBuf::copyBuffer("chained ");
+  buf->prependChain(folly::IOBuf::copyBuffer("value"));
+
+  McRequest req("key");
+  req.setValue(std::move(*buf));
+  EXPECT_TRUE(req.value().isChained());
+
+  req.coalesceValue();
+  EXPECT_FALSE(req.value().isChained());
+  EXPECT_EQ("chained value", toString(req.value()));
+
+  /* Copies share the coalesced value */
+  auto copy = req.clone();
+  EXPECT_EQ(req.value().data(), copy.value().data());
+}
+
+TEST(requestReply, umbrellaReplyFromMsg) {
+  mc_msg_track_num_outstanding(1);
+
+  {
+    mc_msg_t msg;
+    mc_msg_init_not_refcounted(&msg);
+    msg.result = mc_res_found;
+    msg.flags = 5;
+    msg.cas = 7;
+    auto reply = umbrellaReplyFromMsg(msg);
+    EXPECT_EQ(0, mc_msg_num_outstanding());
+    EXPECT_EQ(mc_res_found, reply.result());
+    EXPECT_EQ(5, reply.flags());
+    EXPECT_EQ(7, reply.cas());
+
+    /* Fields only stored in mc_msg_t need a copy */
+    mc_msg_init_not_refcounted(&msg);
+    msg.result = mc_res_found;
+    msg.exptime = 3;
+    auto metaReply = umbrellaReplyFromMsg(msg);
+    EXPECT_EQ(1, mc_msg_num_outstanding());
+    EXPECT_EQ(3, metaReply.exptime());
+  }
+
+  EXPECT_TRUE(mc_msg_num_outstanding() == 0);
+}
+
 TEST(requestReply, RequestMoveNoExcept) {
 
   McRequest req_a("dummy");
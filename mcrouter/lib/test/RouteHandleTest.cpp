@@ -228,6 +228,43 @@ TEST(routeHandleTest, allMajorityTie) {
   }
 }
 
+TEST(routeHandleTest, allMajorityMixed) {
+  TestFiberManager fm;
+
+  vector<std::shared_ptr<TestHandle>> test_handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_notfound, "a")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_notfound, "b")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_notfound, "c")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "d")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_remote_error, "e")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "f"))
+  };
+
+  TestRouteHandle<AllMajorityRoute<TestRouteHandleIf>> rh(
+    get_route_handles(test_handles));
+
+  test_handles[5]->pause();
+
+  fm.runAll(
+    {
+      [&]() {
+        auto reply = rh.routeSimple(McRequest("key"),
+                                    McOperation<mc_op_get>());
+
+        /* 3 of 6 is not a majority, but the last reply can't change
+           the outcome, so we don't wait for "f" */
+        EXPECT_TRUE(reply.result() == mc_res_notfound);
+        EXPECT_TRUE(test_handles[5]->saw_keys == vector<string>{});
+
+        test_handles[5]->unpause();
+      }
+    });
+
+  for (auto& h : test_handles) {
+    EXPECT_TRUE(h->saw_keys == vector<string>{"key"});
+  }
+}
+
 TEST(routeHandleTest, allMajorityEmpty) {
   TestFiberManager fm;
 
@@ -363,3 +400,41 @@ TEST(routeHandleTest, hashSalt) {
       EXPECT_TRUE(toString(reply.value()) == "a");
     });
 }
+
+TEST(routeHandleTest, hashBatch) {
+  vector<std::shared_ptr<TestHandle>> test_handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "b")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "c")),
+  };
+
+  TestFiberManager fm;
+
+  TestRouteHandle<HashRoute<TestRouteHandleIf, HashFunc>> rh(
+    get_route_handles(test_handles),
+    /* salt= */ "",
+    HashFunc(test_handles.size()));
+
+  fm.run([&]() {
+      vector<McRequest> reqs;
+      for (const char* key : {"0", "1", "3", "4", "6"}) {
+        reqs.emplace_back(key);
+      }
+      vector<const McRequest*> batch;
+      for (const auto& req : reqs) {
+        batch.push_back(&req);
+      }
+      auto replies = rh.routeBatch(batch, McOperation<mc_op_get>(), nullptr);
+      ASSERT_EQ(5, replies.size());
+      /* Replies are in the order of requests */
+      vector<string> values;
+      for (const auto& reply : replies) {
+        values.push_back(toString(reply.value()));
+      }
+      EXPECT_EQ((vector<string>{"a", "b", "a", "b", "a"}), values);
+    });
+
+  EXPECT_EQ((vector<string>{"0", "3", "6"}), test_handles[0]->saw_keys);
+  EXPECT_EQ((vector<string>{"1", "4"}), test_handles[1]->saw_keys);
+  EXPECT_TRUE(test_handles[2]->saw_keys.empty());
+}
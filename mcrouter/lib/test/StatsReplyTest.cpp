@@ -0,0 +1,38 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/StatsReply.h"
+
+using facebook::memcache::McReply;
+using facebook::memcache::StatsReply;
+
+TEST(StatsReply, empty) {
+  StatsReply stats;
+  auto reply = stats.getMcReply();
+  EXPECT_EQ(mc_res_ok, reply.result());
+  EXPECT_EQ("END\r\n", reply.valueRangeSlow().str());
+}
+
+TEST(StatsReply, addStat) {
+  StatsReply stats(64);
+  stats.addStat("version", "1.0");
+  stats.addStat("uptime", 10);
+  stats.addStat("empty", "");
+  stats.addStat("", "noname");
+  auto reply = stats.getMcReply();
+  EXPECT_EQ(mc_res_ok, reply.result());
+  EXPECT_EQ("STAT version 1.0\r\n"
+            "STAT uptime 10\r\n"
+            "STAT empty\r\n"
+            "STAT noname\r\n"
+            "END\r\n", reply.valueRangeSlow().str());
+}
@@ -28,8 +28,23 @@ class TestContext {
     return senderId_;
   }
 
+  void setDeadlineExceeded(bool exceeded) {
+    deadlineExceeded_ = exceeded;
+  }
+
+  bool deadlineExceeded() const {
+    return deadlineExceeded_;
+  }
+
+  void onRetryDenied() {
+    ++retriesDenied;
+  }
+
+  size_t retriesDenied{0};
+
  private:
   size_t senderId_{0};
+  bool deadlineExceeded_{false};
 };
 
 class TestRouteHandleIf : public RouteHandleIf<TestRouteHandleIf,
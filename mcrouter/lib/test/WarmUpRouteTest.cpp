@@ -7,12 +7,15 @@
  *  of patent rights can be found in the PATENTS file in the same directory.
  *
  */
+#include <chrono>
 #include <functional>
 #include <memory>
 #include <vector>
 
 #include <gtest/gtest.h>
 
+#include <folly/experimental/fibers/Baton.h>
+
 #include "mcrouter/lib/McReply.h"
 #include "mcrouter/lib/McRequest.h"
 #include "mcrouter/lib/routes/WarmUpRoute.h"
@@ -27,6 +30,16 @@ using std::vector;
 
 using TestHandle = TestHandleImpl<TestRouteHandleIf>;
 
+namespace {
+
+/* Lets the filling fiber run */
+void waitForFills() {
+  folly::fibers::Baton baton;
+  baton.timed_wait(std::chrono::milliseconds(50));
+}
+
+}  // anonymous namespace
+
 TEST(warmUpRouteTest, warmUp) {
   vector<std::shared_ptr<TestHandle>> test_handles{
     make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a"),
@@ -88,6 +101,75 @@ TEST(warmUpRouteTest, warmUp) {
     EXPECT_TRUE(vector<string>{"key_del"} != test_handles[0]->saw_keys);
     EXPECT_TRUE(vector<string>{"key_del"} == test_handles[2]->saw_keys);
   });
+}
+
+TEST(warmUpRouteTest, fillQueueDedup) {
+  auto warm = make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a"));
+  auto cold = make_shared<TestHandle>(GetRouteTestData(mc_res_notfound, ""),
+                                      UpdateRouteTestData(mc_res_stored),
+                                      DeleteRouteTestData());
+  auto route_handles = get_route_handles(
+    vector<std::shared_ptr<TestHandle>>{warm, cold});
+  auto fillQueue = make_shared<WarmUpFillQueue>(WarmUpFillQueue::Options());
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    TestRouteHandle<WarmUpRoute<TestRouteHandleIf>> rh(
+      route_handles[0], route_handles[1], 1, fillQueue);
 
+    for (int i = 0; i < 3; ++i) {
+      auto reply = rh.routeSimple(McRequest("key"), McOperation<mc_op_get>());
+      EXPECT_EQ("a", toString(reply.value()));
+    }
+    waitForFills();
+    /* Filled recently */
+    rh.routeSimple(McRequest("key"), McOperation<mc_op_get>());
+    waitForFills();
+  });
+
+  EXPECT_EQ((vector<mc_op_t>{ mc_op_get, mc_op_get, mc_op_get, mc_op_add,
+                              mc_op_get }), cold->sawOperations);
+  EXPECT_EQ(1, fillQueue->stats().sent);
+  EXPECT_EQ(3, fillQueue->stats().deduplicated);
+  EXPECT_EQ(0, fillQueue->queued());
+}
+
+TEST(warmUpRouteTest, fillQueueRateLimit) {
+  auto warm = make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a"));
+  auto cold = make_shared<TestHandle>(GetRouteTestData(mc_res_notfound, ""),
+                                      UpdateRouteTestData(mc_res_stored),
+                                      DeleteRouteTestData());
+  auto route_handles = get_route_handles(
+    vector<std::shared_ptr<TestHandle>>{warm, cold});
+  WarmUpFillQueue::Options opts;
+  opts.rate = 100;
+  opts.burst = 1;
+  opts.maxQueued = 2;
+  auto fillQueue = make_shared<WarmUpFillQueue>(std::move(opts));
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    TestRouteHandle<WarmUpRoute<TestRouteHandleIf>> rh(
+      route_handles[0], route_handles[1], 1, fillQueue);
+
+    rh.routeSimple(McRequest("key1"), McOperation<mc_op_get>());
+    rh.routeSimple(McRequest("key2"), McOperation<mc_op_get>());
+    /* key2 is hotter, so it's filled first */
+    rh.routeSimple(McRequest("key2"), McOperation<mc_op_get>());
+    /* Queue is full */
+    rh.routeSimple(McRequest("key3"), McOperation<mc_op_get>());
+    EXPECT_EQ(2, fillQueue->queued());
+    waitForFills();
+  });
 
+  vector<string> filled;
+  for (size_t i = 0; i < cold->sawOperations.size(); ++i) {
+    if (cold->sawOperations[i] == mc_op_add) {
+      filled.push_back(cold->saw_keys[i]);
+    }
+  }
+  EXPECT_EQ((vector<string>{"key2", "key1"}), filled);
+  EXPECT_EQ(2, fillQueue->stats().sent);
+  EXPECT_EQ(1, fillQueue->stats().deduplicated);
+  EXPECT_EQ(1, fillQueue->stats().dropped);
 }
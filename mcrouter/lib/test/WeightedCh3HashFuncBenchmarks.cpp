@@ -0,0 +1,87 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+
+#include "mcrouter/lib/Ch3HashFunc.h"
+#include "mcrouter/lib/WeightedCh3HashFunc.h"
+
+using facebook::memcache::Ch3HashFunc;
+using facebook::memcache::WeightedCh3HashFunc;
+
+namespace {
+
+const size_t kNumServers = 500;
+const size_t kNumKeys = 1024;
+
+std::vector<std::string> keys;
+
+void prepareKeys() {
+  for (size_t i = 0; i < kNumKeys; ++i) {
+    keys.push_back("tao:assoc:" + folly::to<std::string>(i * 7919));
+  }
+}
+
+template <class HashFunc>
+void runHash(const HashFunc& func, size_t iters) {
+  size_t sum = 0;
+  for (size_t i = 0; i < iters; ++i) {
+    sum += func(keys[i % kNumKeys]);
+  }
+  folly::doNotOptimizeAway(sum);
+}
+
+/* Every 10th server is weighted down to w, the rest have full weight */
+std::vector<double> weightedDown(double w) {
+  std::vector<double> weights(kNumServers, 1.0);
+  for (size_t i = 0; i < kNumServers; i += 10) {
+    weights[i] = w;
+  }
+  return weights;
+}
+
+}  // anonymous namespace
+
+BENCHMARK(Ch3, iters) {
+  static Ch3HashFunc func(kNumServers);
+  runHash(func, iters);
+}
+
+BENCHMARK_RELATIVE(WeightedCh3_AllOnes, iters) {
+  static WeightedCh3HashFunc func(std::vector<double>(kNumServers, 1.0));
+  runHash(func, iters);
+}
+
+BENCHMARK_RELATIVE(WeightedCh3_HalfWeightTenth, iters) {
+  static WeightedCh3HashFunc func(weightedDown(0.5));
+  runHash(func, iters);
+}
+
+BENCHMARK_RELATIVE(WeightedCh3_ZeroWeightTenth, iters) {
+  static WeightedCh3HashFunc func(weightedDown(0.0));
+  runHash(func, iters);
+}
+
+BENCHMARK_RELATIVE(WeightedCh3_AllHalf, iters) {
+  static WeightedCh3HashFunc func(std::vector<double>(kNumServers, 0.5));
+  runHash(func, iters);
+}
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  prepareKeys();
+  folly::runBenchmarks();
+  return 0;
+}
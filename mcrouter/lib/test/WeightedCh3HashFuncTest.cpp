@@ -8,6 +8,8 @@
  *
  */
 #include <algorithm>
+#include <memory>
+#include <stdexcept>
 #include <vector>
 
 #include <gtest/gtest.h>
@@ -114,3 +116,52 @@ TEST(WeightedCh3HashFunc, randomWeights) {
     {1016, 1252, 288, 2354, 661, 195, 247, 122, 1668, 2197}) ==
     wch3_counts);
 }
+
+/* Copies share weights and route keys the same way */
+TEST(WeightedCh3HashFunc, copy) {
+  WeightedCh3HashFunc func({1.0, 0.5, 0.0});
+  auto copy = func;
+
+  EXPECT_EQ(&func.weights(), &copy.weights());
+  for (size_t i = 0; i < 1000; ++i) {
+    auto key = folly::to<std::string>(i);
+    EXPECT_EQ(func(key), copy(key));
+  }
+}
+
+/* New weights take effect for all copies, invalid ones are rejected */
+TEST(WeightedCh3HashFunc, setWeights) {
+  WeightedCh3HashFunc func({1.0, 1.0, 1.0});
+  auto copy = func;
+  WeightedCh3HashFunc expected({1.0, 0.0, 1.0});
+
+  func.setWeights({1.0, 0.0, 1.0});
+  EXPECT_EQ(std::vector<double>({1.0, 0.0, 1.0}), copy.weights());
+  for (size_t i = 0; i < 1000; ++i) {
+    auto key = folly::to<std::string>(i);
+    EXPECT_EQ(expected(key), copy(key));
+    EXPECT_NE(1, copy(key));
+  }
+
+  EXPECT_THROW(func.setWeights({1.0, 1.0}), std::logic_error);
+  EXPECT_THROW(func.setWeights({1.0, 2.0, 1.0}), std::logic_error);
+  EXPECT_EQ(std::vector<double>({1.0, 0.0, 1.0}), func.weights());
+
+  auto setWeights = copy.weightsSetter();
+  setWeights({0.5, 0.5, 0.5});
+  EXPECT_EQ(std::vector<double>({0.5, 0.5, 0.5}), func.weights());
+}
+
+/* Attached objects live as long as the last copy */
+TEST(WeightedCh3HashFunc, attach) {
+  auto obj = std::make_shared<int>(0);
+  std::weak_ptr<int> weakObj = obj;
+  WeightedCh3HashFunc func({1.0});
+  func.attach(std::move(obj));
+  auto copy = std::make_shared<WeightedCh3HashFunc>(func);
+
+  func = WeightedCh3HashFunc({0.5});
+  EXPECT_FALSE(weakObj.expired());
+  copy.reset();
+  EXPECT_TRUE(weakObj.expired());
+}
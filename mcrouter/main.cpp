@@ -15,14 +15,18 @@
 #include <signal.h>
 #include <stdlib.h>
 #include <string.h>
+#include <netinet/in.h>
 #include <sys/fcntl.h>
 #include <sys/file.h>
 #include <sys/resource.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <syslog.h>
 #include <time.h>
+#include <unistd.h>
 
 #include <algorithm>
 #include <memory>
@@ -42,6 +46,7 @@
 #include "mcrouter/async.h"
 #include "mcrouter/config.h"
 #include "mcrouter/flavor.h"
+#include "mcrouter/lib/fbi/cpp/util.h"
 #include "mcrouter/lib/fbi/error.h"
 #include "mcrouter/lib/fbi/fb_cpu_util.h"
 #include "mcrouter/ManagedModeUtil.h"
@@ -50,6 +55,7 @@
 #include "mcrouter/options.h"
 #include "mcrouter/proxy.h"
 #include "mcrouter/server.h"
+#include "mcrouter/ServerTakeover.h"
 #include "mcrouter/standalone_options.h"
 #include "mcrouter/stats.h"
 
@@ -355,6 +361,8 @@ static int validate_options() {
     return 0;
   }
   if (standaloneOpts.ports.empty() &&
+      standaloneOpts.unix_sockets.empty() &&
+      standaloneOpts.shm_channels.empty() &&
       standaloneOpts.listen_sock_fd < 0) {
     LOG(ERROR) << "invalid ports";
     return 0;
@@ -402,6 +410,68 @@ static void raise_fdlimit() {
   }
 }
 
+/** Listening sockets on all addresses for ports, exits on failure.
+    Bound before forking managed children, so that a standby child
+    can start accepting right away with the active child's sockets. */
+static std::vector<int> bind_ports(const std::vector<uint16_t>& ports) {
+  std::vector<int> fds;
+  for (auto port : ports) {
+    int fd = socket(AF_INET6, SOCK_STREAM, 0);
+    if (fd < 0) {
+      PLOG(ERROR) << "Can not create listening socket";
+      exit(EXIT_STATUS_TRANSIENT_ERROR);
+    }
+    int on = 1;
+    int off = 0;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    /* IPv4 too */
+    setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+
+    struct sockaddr_in6 addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_any;
+    addr.sin6_port = htons(port);
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) ||
+        listen(fd, SOMAXCONN)) {
+      PLOG(ERROR) << "Can not listen on port " << port;
+      exit(EXIT_STATUS_TRANSIENT_ERROR);
+    }
+    fds.push_back(fd);
+  }
+  return fds;
+}
+
+/** Same as bind_ports() for unix domain socket paths */
+static std::vector<int> bind_unix_sockets(
+    const std::vector<std::string>& paths) {
+  std::vector<int> fds;
+  for (const auto& path : paths) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+      LOG(ERROR) << "Invalid unix socket path '" << path << "'";
+      exit(EXIT_STATUS_TRANSIENT_ERROR);
+    }
+    memcpy(addr.sun_path, path.data(), path.size());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+      PLOG(ERROR) << "Can not create listening socket";
+      exit(EXIT_STATUS_TRANSIENT_ERROR);
+    }
+    unlink(path.c_str());
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) ||
+        listen(fd, SOMAXCONN)) {
+      PLOG(ERROR) << "Can not listen on unix socket " << path;
+      exit(EXIT_STATUS_TRANSIENT_ERROR);
+    }
+    fds.push_back(fd);
+  }
+  return fds;
+}
+
 static void error_flush_cb(const fbi_err_t *err) {
   fbi_dbg_log("mcrouter", err->source, "", err->lineno,
               fbi_errtype_to_string(err->type), 0, 0, "%s",
@@ -433,6 +503,8 @@ void notify_command_line(int argc, char ** argv) {
 
 void on_assert_fail(const char *msg) {
   logFailure(failure::Category::kBrokenLogic, msg);
+  /* We're about to abort */
+  failure::flush();
 }
 
 int main(int argc, char **argv) {
@@ -555,9 +627,29 @@ int main(int argc, char **argv) {
   }
 
   // Managed mode
+  TakeoverState prebound;
   if (standaloneOpts.managed && !validate_configs) {
-    spawnManagedChild();
-    LOG(INFO) << "forked (" << getpid() << ")";
+    bool standby = standaloneOpts.managed_standby;
+    if (standby && standaloneOpts.listen_sock_fd < 0) {
+      prebound.sockets = bind_ports(standaloneOpts.ports);
+      auto unixFds = bind_unix_sockets(standaloneOpts.unix_sockets);
+      prebound.sockets.insert(prebound.sockets.end(),
+                              unixFds.begin(), unixFds.end());
+      prebound.sslSockets = bind_ports(standaloneOpts.ssl_ports);
+    }
+    spawnManagedChild(standby);
+    LOG(INFO) << "forked (" << getpid() << ")"
+              << (isStandbyChild() ? " as standby" : "");
+    opts.standby = isStandbyChild();
+  }
+
+  /* After fork()ing, the logging thread wouldn't survive it. Validation
+     needs throwLogicError to throw synchronously. */
+  if (!validate_configs) {
+    failure::Options failureOpts;
+    failureOpts.queueSize = standaloneOpts.failure_log_queue_size;
+    failureOpts.maxPerSecond = standaloneOpts.failure_log_max_per_second;
+    failure::setOptions(failureOpts);
   }
 
   raise_fdlimit();
@@ -581,6 +673,32 @@ int main(int argc, char **argv) {
    */
   mc_msg_use_atomic_refcounts(0);
 
+  /* Before the config is loaded, so that it can come from the snapshot
+     handed over */
+  TakeoverState takeover;
+  int takeoverFd = -1;
+  if (!standaloneOpts.takeover_socket.empty() && !validate_configs &&
+      !isStandbyChild()) {
+    try {
+      takeoverFd = receiveTakeover(standaloneOpts.takeover_socket, takeover);
+    } catch (const std::exception& e) {
+      LOG(ERROR) << "CRITICAL: Failed to take over: " << e.what();
+      exit(EXIT_STATUS_TRANSIENT_ERROR);
+    }
+    if (takeoverFd >= 0) {
+      LOG(INFO) << "Taking over " << takeover.sockets.size() << " and "
+                << takeover.sslSockets.size() << " SSL listening sockets, "
+                << takeover.tkos.size() << " TKO destinations";
+      if (!opts.config_snapshot_file.empty() &&
+          !takeover.configSnapshot.empty() &&
+          !atomicallyWriteFileToDisk(takeover.configSnapshot,
+                                     opts.config_snapshot_file)) {
+        LOG(WARNING) << "Can not write config snapshot to "
+                     << opts.config_snapshot_file;
+      }
+    }
+  }
+
   auto router = McrouterInstance::init("standalone", opts);
   if (router == nullptr) {
     LOG(ERROR) << "CRITICAL: Failed to initialize mcrouter!";
@@ -593,5 +711,17 @@ int main(int argc, char **argv) {
   set_standalone_args(commandArgs);
   router->addStartupOpts(standaloneOpts.toDict());
 
-  runServer(standaloneOpts, *router);
+  if (isStandbyChild()) {
+    /* Config is loaded, the rest is quick */
+    waitUntilActive();
+    router->leaveStandby();
+  }
+
+  if (takeoverFd >= 0) {
+    runServer(standaloneOpts, *router, &takeover, takeoverFd);
+  } else if (!prebound.sockets.empty() || !prebound.sslSockets.empty()) {
+    runServer(standaloneOpts, *router, &prebound);
+  } else {
+    runServer(standaloneOpts, *router);
+  }
 }
@@ -107,6 +107,10 @@ McrouterOptions defaultTestOptions();
 
 std::vector<std::string> defaultTestCommandLineArgs();
 
+/**
+ * Called for each TKO event of proxy's destinations, from a housekeeping
+ * thread unless opts.tko_log_interval_ms is 0 (see TkoLogQueue).
+ */
 void logTkoEvent(proxy_t* proxy, const TkoLog& tkoLog);
 
 void initFailureLogger();
@@ -40,6 +40,50 @@ mcrouter_option_toggle(
   "new-ascii-parser", no_short,
   "Enables a new parser for ASCII protocol inside of AsyncMcClient")
 
+mcrouter_option_toggle(
+  ascii_reply_fast_path, false,
+  "ascii-reply-fast-path", no_short,
+  "Parse complete get/gets replies without going through the ASCII state"
+  " machine. Has effect only with --new-ascii-parser")
+
+mcrouter_option_toggle(
+  umbrella_batching, false,
+  "umbrella-batching", no_short,
+  "Send umbrella requests written together as one batch frame. All umbrella"
+  " destinations must support batch frames.")
+
+mcrouter_option_integer(
+  size_t, write_cork_max_delay_us, 0,
+  "write-cork-max-delay-us", no_short,
+  "If non-zero, hold destination writes for up to this many microseconds"
+  " to send more requests per write. The hold adapts to load, it's dropped"
+  " while it doesn't gather more requests.")
+
+mcrouter_option_integer(
+  size_t, write_cork_max_requests, 32,
+  "write-cork-max-requests", no_short,
+  "Stop holding a write once this many requests are pending (0: no limit)."
+  " See --write-cork-max-delay-us")
+
+mcrouter_option_integer(
+  size_t, write_cork_max_bytes, 64 * 1024,
+  "write-cork-max-bytes", no_short,
+  "Stop holding a write once this many request bytes are pending"
+  " (0: no limit). See --write-cork-max-delay-us")
+
+mcrouter_option_integer(
+  size_t, replies_per_read, 0,
+  "replies-per-read", no_short,
+  "Adjusts client read buffer size to read this many replies per read,"
+  " within 256 bytes and --max-read-buffer-size. 0 to always use"
+  " --max-read-buffer-size.")
+
+mcrouter_option_integer(
+  size_t, max_read_buffer_size, 4096,
+  "max-read-buffer-size", no_short,
+  "Largest client read buffer size. Larger buffers need fewer reads for"
+  " big values and pipelined replies.")
+
 mcrouter_option_string(
   service_name, "unknown",
   no_long, no_short,
@@ -61,6 +105,12 @@ mcrouter_option_integer(
   no_long, no_short,
   "")
 
+mcrouter_option_toggle(
+  standby, false,
+  no_long, no_short,
+  "Router of a standby process: stats are not logged nor served until"
+  " McrouterInstance::leaveStandby()")
+
 mcrouter_option_toggle(
   asynclog_disable, false,
   "asynclog-disable", no_short,
@@ -81,11 +131,71 @@ mcrouter_option_toggle(
   no_long, no_short,
   "Rollout logging AsynclogRoute::name to spool for asynclog_version2")
 
+mcrouter_option_toggle(
+  use_asynclog_binary, false,
+  "use-asynclog-binary", no_short,
+  "Write the asynclog in the compressed binary format (see AsynclogFormat.h)"
+  " instead of JSON lines. Spool files get a .bin suffix.")
+
+mcrouter_option_integer(
+  size_t, asynclog_max_batch_size, 1024,
+  "asynclog-max-batch-size", no_short,
+  "Maximum number of asynclog entries written with one writev() call")
+
+mcrouter_option_integer(
+  int, asynclog_fsync_interval_ms, 0,
+  "asynclog-fsync-interval-ms", no_short,
+  "If positive, fdatasync() the asynclog file after a write if this much"
+  " time passed since the last sync.")
+
 mcrouter_option_integer(
   size_t, num_proxies, 1,
   "num-proxies", no_short,
   "adjust how many proxy threads to run")
 
+mcrouter_option_integer(
+  unsigned int, proxy_stall_threshold_ms, 0,
+  "proxy-stall-threshold-ms", no_short,
+  "If non-zero, a watchdog thread logs proxy threads whose event loop didn't"
+  " run for this many ms, with a stack dump to stderr (sent with SIGURG)."
+  " Should be well above 10ms, the loop lag measurement interval.")
+
+mcrouter_option_integer(
+  int, proxy_busy_poll_us, 0,
+  "proxy-busy-poll-us", no_short,
+  "If positive, a proxy thread spins on its request queue and event loop"
+  " while it has work, and for this many microseconds after, before waiting"
+  " in epoll again. Destination sockets get SO_BUSY_POLL with the same"
+  " value. Burns a core per proxy, best with proxy-thread-cpus.")
+
+mcrouter_option_toggle(
+  destination_kernel_timestamps, false,
+  "destination-kernel-timestamps", no_short,
+  "Have the kernel timestamp requests as it sends them to destinations"
+  " (SO_TIMESTAMPING, TCP without SSL only), and split reply latencies into"
+  " proxy/kernel queueing, network and server, and reply processing time"
+  " per destination.")
+
+mcrouter_option_other(
+  std::vector<uint16_t>, proxy_thread_cpus, ,
+  "proxy-thread-cpus", no_short,
+  "CPUs to pin proxy threads to (comma separated), proxy i is pinned to the"
+  " (i mod N)-th CPU in the list, so that its memory is allocated on that"
+  " CPU's NUMA node. In standalone mode proxies run on server threads, which"
+  " are pinned to these CPUs unless server-thread-cpus is set.")
+
+mcrouter_option_integer(
+  size_t, client_queue_size, 1024,
+  "client-queue-size", no_short,
+  "Maximum number of requests and control messages queued up for a single"
+  " proxy thread. Clients block in send() while the queue is full.")
+
+mcrouter_option_toggle(
+  assign_clients_least_queued, false,
+  "assign-clients-least-queued", no_short,
+  "Assign a new client to the less busy of two consecutive proxies"
+  " (by message queue size) instead of strictly round robin.")
+
 mcrouter_option_toggle(
   use_priorities, true,
   "disable-priorities", no_short,
@@ -104,11 +214,36 @@ mcrouter_option_integer(
   "If 0, big value route handle is not part of route handle tree,"
   "else used as threshold for splitting big values internally")
 
+mcrouter_option_integer(
+  size_t, big_value_max_inflight_chunks, 16,
+  "big-value-max-inflight-chunks", no_short,
+  "Maximum number of chunk sets of one big value sent at a time,"
+  " the next chunk is sent as soon as one completes. 0 means no limit.")
+
+mcrouter_option_toggle(
+  big_value_content_chunking, false,
+  "big-value-content-chunking", no_short,
+  "Split big values at content-defined boundaries into chunks keyed by"
+  " content hash. Updates fetch the previous index first and don't"
+  " rewrite the chunks it already has.")
+
 mcrouter_option_integer(
   size_t, fibers_max_pool_size, 1000,
   "fibers-max-pool-size", no_short,
   "Maximum number of preallocated free fibers to keep around")
 
+mcrouter_option_integer(
+  size_t, fibers_pool_prefill, 0,
+  "fibers-pool-prefill", no_short,
+  "Number of fibers to allocate on proxy startup, so that request bursts"
+  " don't have to allocate fresh stacks (capped by fibers-max-pool-size)")
+
+mcrouter_option_integer(
+  size_t, fibers_prefault_stack_size, 16 * 1024,
+  "fibers-prefault-stack-size", no_short,
+  "Number of bytes of each prefilled fiber stack to touch on startup"
+  " (capped by half of fibers-stack-size). 0 disables prefaulting.")
+
 #ifdef FOLLY_SANITIZE_ADDRESS
 /* ASAN needs a lot of extra stack space.
    16x is a conservative estimate, 8x also worked with tests
@@ -127,6 +262,20 @@ mcrouter_option_integer(
 
 #undef DEFAULT_STACK_SIZE
 
+mcrouter_option_string(
+  huge_page_buffers, "",
+  "huge-page-buffers", no_short,
+  "If set, network read and write buffers are allocated from 2MB huge pages:"
+  " 'transparent' (madvise), or 'explicit' (MAP_HUGETLB, from"
+  " /proc/sys/vm/nr_hugepages, transparent once none is left)."
+  " Process wide, the first mcrouter instance's setting wins.")
+
+mcrouter_option_integer(
+  size_t, huge_page_buffers_max_mb, 256,
+  "huge-page-buffers-max-mb", no_short,
+  "Most memory huge-page-buffers may take, buffers are allocated as usual"
+  " beyond that. It is never given back to the system.")
+
 mcrouter_option_integer(
   size_t, fibers_record_stack_size_every, 100000,
   "fibers-record-stack-size-every", no_short,
@@ -150,6 +299,19 @@ mcrouter_option_integer(
   "How long to sleep for after an update occured"
   " (a hack to avoid partial writes).")
 
+mcrouter_option_integer(
+  size_t, housekeeping_threads, 2,
+  "housekeeping-threads", no_short,
+  "Number of threads running the timer driven background tasks (stat"
+  " windows, stats logging, file observers), shared by all mcrouter"
+  " instances of the process: the first instance's value is used.")
+
+mcrouter_option_string(
+  housekeeping_cpus, "",
+  "housekeeping-cpus", no_short,
+  "CPUs to pin the housekeeping threads to, e.g. \"0-1,8\", to keep them"
+  " off the CPUs of the proxy threads. Empty means no pinning.")
+
 
 mcrouter_option_group("Network")
 
@@ -179,6 +341,66 @@ mcrouter_option_integer(
   "tcp-rto-min", no_short,
   "adjust the minimum TCP retransmit timeout (ms) to memcached")
 
+mcrouter_option_integer(
+  size_t, connections_per_destination, 1,
+  "connections-per-destination", no_short,
+  "Number of connections each proxy thread opens to every destination."
+  " Requests are spread over them, see connection-round-robin.")
+
+mcrouter_option_toggle(
+  supersede_pending_updates, false,
+  "supersede-pending-updates", no_short,
+  "A set (delete) of a key replaces a set (delete) of the same key that"
+  " wasn't written to the destination yet, both get the reply of the later"
+  " one. Requests with other operations for the key keep both.")
+
+mcrouter_option_toggle(
+  destination_priority_lanes, false,
+  "destination-priority-lanes", no_short,
+  "Requests nobody waits for (sent by AllAsyncRoute, ShadowRoute and cache"
+  " fills of WarmUpRoute and L1L2CacheRoute) are sent to a destination only"
+  " once it has no other pending requests.")
+
+mcrouter_option_integer(
+  size_t, large_request_lane_min_bytes, 0,
+  "large-request-lane-min-bytes", no_short,
+  "If positive, each proxy opens one more connection to every ascii"
+  " destination, used only by requests expected to carry at least this many"
+  " bytes: updates with values this large, and requests for keys whose"
+  " latest value was. Small replies then don't queue behind large ones."
+  " 0 disables the lane.")
+
+mcrouter_option_integer(
+  size_t, large_key_hints, 1024,
+  "large-key-hints", no_short,
+  "With large-request-lane-min-bytes, number of keys with large values"
+  " each destination remembers (direct mapped by key hash)")
+
+mcrouter_option_integer(
+  size_t, shared_connection_max_qps, 0,
+  "shared-connection-max-qps", no_short,
+  "If positive, a proxy sends requests to a destination it routes fewer than"
+  " this many requests per second to through the connection of one owner"
+  " proxy, instead of opening its own. 0 disables sharing.")
+
+mcrouter_option_toggle(
+  preconnect_destinations, false,
+  "preconnect-destinations", no_short,
+  "Connect to destinations when they're added by a config load, instead of"
+  " on the first request routed to them")
+
+mcrouter_option_integer(
+  size_t, preconnect_batch_size, 100,
+  "preconnect-batch-size", no_short,
+  "With preconnect-destinations, each proxy starts connecting to at most"
+  " this many destinations every 10ms")
+
+mcrouter_option_toggle(
+  connection_round_robin, false,
+  "connection-round-robin", no_short,
+  "If connections-per-destination > 1, pick connections in round robin order"
+  " instead of the one with the fewest inflight requests")
+
 mcrouter_option_integer(
   uint64_t, target_max_inflight_requests, 0,
   "target-max-inflight-requests", no_short,
@@ -193,6 +415,32 @@ mcrouter_option_integer(
   " per target per thread.  Requests that would exceed this limit are dropped"
   " immediately.")
 
+mcrouter_option_integer(
+  size_t, target_reconnect_backoff_initial_ms, 0,
+  "target-reconnect-backoff-initial-ms", no_short,
+  "If nonzero, after a failed connect to a target, requests to it fail"
+  " right away instead of reconnecting for a random time between half and"
+  " all of the backoff. The backoff starts at this value and doubles with"
+  " every failed connect. 0 to reconnect right away.")
+
+mcrouter_option_integer(
+  size_t, target_reconnect_backoff_max_ms, 1000,
+  "target-reconnect-backoff-max-ms", no_short,
+  "Largest reconnect backoff, see --target-reconnect-backoff-initial-ms")
+
+mcrouter_option_integer(
+  size_t, proxy_max_concurrent_connects, 0,
+  "proxy-max-concurrent-connects", no_short,
+  "Maximum connects in progress per proxy thread, further connects wait for"
+  " one of them to finish (0 means no limit)")
+
+mcrouter_option_integer(
+  uint64_t, target_saturated_pending_requests, 0,
+  "target-saturated-pending-requests", no_short,
+  "If nonzero, requests to a target with this many requests waiting to be"
+  " sent (per thread) are refused right away with a busy reply, so failover"
+  " routes try another target instead of queueing. 0 to disable.")
+
 mcrouter_option_integer(
   size_t, target_max_shadow_requests, 1000,
   "target-max-shadow-requests", no_short,
@@ -200,6 +448,28 @@ mcrouter_option_integer(
   " per target per thread.  Requests that would exceed this limit are dropped"
   " immediately.")
 
+mcrouter_option_integer(
+  size_t, proxy_max_shadow_requests, 0,
+  "proxy-max-shadow-requests", no_short,
+  "Hard limit on the number of shadow requests in flight per thread (0 means"
+  " no limit).  Requests over the limit are not shadowed, before any copy"
+  " of the request or fiber is created for them.")
+
+mcrouter_option_integer(
+  size_t, proxy_shadow_shed_waiting_requests, 0,
+  "proxy-shadow-shed-waiting-requests", no_short,
+  "If non-zero, once more requests than this are queued by"
+  " proxy-max-inflight-requests, the fraction of requests that are shadowed"
+  " is scaled down proportionally (e.g. halved at twice as many queued"
+  " requests).")
+
+mcrouter_option_integer(
+  size_t, proxy_shadow_shed_queue_delay_us, 0,
+  "proxy-shadow-shed-queue-delay-us", no_short,
+  "If non-zero, once the oldest request queued by proxy-max-inflight-requests"
+  " has waited longer than this, the fraction of requests that are shadowed"
+  " is scaled down proportionally to its wait.")
+
 mcrouter_option_toggle(
   no_network, false, "no-network", no_short,
   "Debug only. Return random generated replies, do not use network.")
@@ -220,6 +490,51 @@ mcrouter_option_integer(
   "proxy. Further requests will be rejected with an error immediately. 0 means "
   "disabled.")
 
+mcrouter_option_integer(
+  size_t, proxy_max_throttled_request_age_ms, 0,
+  "proxy-max-throttled-request-age-ms", no_short,
+  "Only active if proxy-max-inflight-requests is non-zero. Requests that were"
+  " queued for longer than this are failed without being routed."
+  " 0 means disabled.")
+
+mcrouter_option_integer(
+  size_t, proxy_steal_threshold, 0,
+  "proxy-steal-threshold", no_short,
+  "Only active if proxy-max-inflight-requests is non-zero. While more than"
+  " this many requests are queued in a proxy, they are handed over to the"
+  " least loaded other proxy if it has fewer than this many requests routing"
+  " and queued. That proxy routes them with its own destinations, replies"
+  " go back through the original proxy. 0 means disabled.")
+
+mcrouter_option_string(
+  proxy_priority_routing_prefixes, "",
+  "proxy-priority-routing-prefixes", no_short,
+  "Only active if proxy-max-inflight-requests is non-zero. Comma separated"
+  " list of routing prefixes (ex. /oregon/prn1c16/) whose queued requests are"
+  " routed before all others.")
+
+mcrouter_option_string(
+  proxy_tenant_quotas, "",
+  "proxy-tenant-quotas", no_short,
+  "Comma separated list of prefix:weight:max_inflight:max_queued, giving"
+  " each routing prefix (ex. /oregon/batch/) its own queue and per proxy"
+  " limits on requests routing (max_inflight) and queued (max_queued),"
+  " 0 meaning no limit. Queued requests are routed in proportion to the"
+  " weights; other routing prefixes share one queue of weight 1."
+  " Priority routing prefixes still go first.")
+
+mcrouter_option_toggle(
+  proxy_adaptive_inflight_limit, false,
+  "proxy-adaptive-inflight-limit", no_short,
+  "Only active if proxy-max-inflight-requests is non-zero. Adapt the limit"
+  " on inflight requests to observed request latencies, between"
+  " proxy-min-inflight-requests and proxy-max-inflight-requests.")
+
+mcrouter_option_integer(
+  size_t, proxy_min_inflight_requests, 16,
+  "proxy-min-inflight-requests", no_short,
+  "Lower bound (and initial value) of the adaptive inflight requests limit.")
+
 mcrouter_option_string(
   pem_cert_path, "",
   "pem-cert-path", no_short,
@@ -235,6 +550,11 @@ mcrouter_option_string(
   "pem-ca-path", no_short,
   "Path of pem-style CA cert for ssl")
 
+mcrouter_option_toggle(
+  ssl_session_resumption, true,
+  "ssl-session-resumption", no_short,
+  "Resume TLS sessions when reconnecting to ssl destinations")
+
 mcrouter_option_toggle(
   destination_rate_limiting, false,
   "destination-rate-limiting", no_short,
@@ -250,6 +570,19 @@ mcrouter_option_integer(
   "default-qos-class", no_short,
   "Default qos class to use if qos is enabled and not specified.")
 
+mcrouter_option_integer(
+  uint32_t, dns_cache_ttl_ms, 300000,
+  "dns-cache-ttl-ms", no_short,
+  "Server hostnames of a new config are resolved ahead of the config swap"
+  " and cached for connects; this is how long a resolution is fresh."
+  " They're also refreshed this often. 0 disables the cache: hostnames are"
+  " resolved on connect.")
+
+mcrouter_option_integer(
+  size_t, dns_resolve_threads, 16,
+  "dns-resolve-threads", no_short,
+  "Number of hostnames resolved in parallel ahead of a config swap.")
+
 
 mcrouter_option_group("Routing configuration")
 
@@ -273,11 +606,52 @@ mcrouter_option_string(
   "config-str", no_short,
   "Configuration string provided as a command line argument")
 
+mcrouter_option_string(
+  config_snapshot_file, "",
+  "config-snapshot-file", no_short,
+  "If set, the preprocessed config is saved to this file (in binary form)"
+  " and loaded from it instead of being preprocessed again, as long as"
+  " the config and all files it imports are unchanged.")
+
 mcrouter_option(
   facebook::memcache::mcrouter::RoutingPrefix, default_route, "/././",
   "route-prefix", 'R',
   "default routing prefix (ex. /oregon/prn1c16/)", routing_prefix)
 
+mcrouter_option_toggle(
+  lazy_routes, false,
+  "lazy-routes", no_short,
+  "Build the routes of a routing prefix in a proxy on the first request"
+  " to it. The config is still built in full (and validated) for one"
+  " proxy on every reload.")
+
+mcrouter_option_toggle(
+  lazy_routes_warmup, false,
+  "lazy-routes-warmup", no_short,
+  "With lazy-routes, build all routes of a new config in the background,"
+  " a few per event loop iteration of each proxy.")
+
+mcrouter_option_toggle(
+  inline_routes, false,
+  "inline-routes", no_short,
+  "Replace FailoverRoute -> HashRoute -> destinations and HashRoute ->"
+  " destinations subtrees of routing prefixes with routes that call all"
+  " levels directly instead of through virtual calls.")
+
+mcrouter_option_integer(
+  size_t, config_build_threads, 0,
+  "config-build-threads", no_short,
+  "On reload, build the configs of all proxies but the first on up to this"
+  " many threads in parallel. 0 means one thread per hardware thread.")
+
+mcrouter_option_toggle(
+  staged_config_swap, false,
+  "staged-config-swap", no_short,
+  "On reload, build and swap the config of one proxy at a time (after the"
+  " first one validated the config), so that old configs can be released"
+  " while the rest are built. Lowers peak memory, but a failure after the"
+  " first proxy leaves some proxies on the new config.")
+
 mcrouter_option_toggle(
   miss_on_get_errors, true,
   "disable-miss-on-get-errors", no_short,
@@ -329,6 +703,110 @@ mcrouter_option_integer(
   "The maximum number of machines we can mark TKO if they don't have a hard"
   " failure.")
 
+mcrouter_option_integer(
+  size_t, tko_log_interval_ms, 1000,
+  "tko-log-interval-ms", no_short,
+  "TKO events are queued by proxies and logged off their threads every this"
+  " many ms, with one summary line per pool and event. 0 logs each event"
+  " right away from the proxy thread.")
+
+mcrouter_option_integer(
+  size_t, latency_outlier_factor, 0,
+  "latency-outlier-factor", no_short,
+  "Mark a destination soft TKO if its recent average latency is more than"
+  " this many times the median of the other destinations in its pool."
+  " It's unmarked by a successful probe like other soft TKOs. 0 disables.")
+
+mcrouter_option_integer(
+  size_t, latency_outlier_max_percent, 10,
+  "latency-outlier-max-percent", no_short,
+  "With latency-outlier-factor, never mark more than this percentage of"
+  " a pool TKO (counting destinations already TKO for any reason).")
+
+mcrouter_option_integer(
+  int, latency_outlier_check_interval_ms, 1000,
+  "latency-outlier-check-interval", no_short,
+  "With latency-outlier-factor, each proxy compares the latencies within"
+  " pools this often (in ms).")
+
+mcrouter_option_integer(
+  size_t, hot_keys_sample_period, 100,
+  "hot-keys-sample-period", no_short,
+  "Track the most requested keys from one in this many requests, see"
+  " __mcrouter__.hot_keys. 0 disables tracking.")
+
+mcrouter_option_integer(
+  size_t, request_phases_sample_period, 1000,
+  "request-phases-sample-period", no_short,
+  "Time the phases (queueing, routing, destination queueing and round trip)"
+  " of one in this many requests, see __mcrouter__.request_phases."
+  " 0 disables timing.")
+
+mcrouter_option_integer(
+  size_t, route_cpu_sample_period, 0,
+  "route-cpu-sample-period", no_short,
+  "Attribute the CPU cycles spent routing one in this many requests to the"
+  " routes of the config, see __mcrouter__.route_cpu. 0 disables profiling.")
+
+mcrouter_option_integer(
+  int64_t, slow_request_threshold_us, 0,
+  "slow-request-threshold-us", no_short,
+  "Keep the last requests to destinations that took at least this long"
+  " (see slow-request-log-size) in __mcrouter__.slow_requests. They are"
+  " also written to the stats root on SIGUSR1. 0 disables recording.")
+
+mcrouter_option_integer(
+  size_t, slow_request_log_size, 128,
+  "slow-request-log-size", no_short,
+  "Number of slow requests kept per proxy, see slow-request-threshold-us.")
+
+mcrouter_option_string(
+  traffic_capture_file, "",
+  "traffic-capture-file", no_short,
+  "If set (with traffic-capture-sample-period), proxies write sampled"
+  " requests (op, key hash, value size, routing prefix and time) into this"
+  " ring file, see TrafficCapture.h. Replay it with mcrouter_traffic_replay.")
+
+mcrouter_option_integer(
+  size_t, traffic_capture_sample_period, 0,
+  "traffic-capture-sample-period", no_short,
+  "Capture one in this many requests into traffic-capture-file."
+  " 0 disables capture.")
+
+mcrouter_option_integer(
+  size_t, traffic_capture_max_mb, 64,
+  "traffic-capture-max-mb", no_short,
+  "Size of traffic-capture-file, it keeps the latest requests.")
+
+mcrouter_option_toggle(
+  traffic_capture_keys, false,
+  "traffic-capture-keys", no_short,
+  "Capture full keys, not only their hashes.")
+
+mcrouter_option_integer(
+  size_t, hot_keys_top_k, 32,
+  "hot-keys-top-k", no_short,
+  "Number of the most requested keys tracked per proxy and reported.")
+
+mcrouter_option_integer(
+  size_t, top_clients_sample_period, 100,
+  "top-clients-sample-period", no_short,
+  "Account one in this many requests to their client connection and sender"
+  " to find the costliest clients, see __mcrouter__.top_clients."
+  " 0 disables tracking.")
+
+mcrouter_option_integer(
+  size_t, top_clients_top_k, 32,
+  "top-clients-top-k", no_short,
+  "Number of the costliest connections and senders tracked per proxy and"
+  " reported.")
+
+mcrouter_option_integer(
+  size_t, top_clients_request_cost, 1024,
+  "top-clients-request-cost", no_short,
+  "Cost of a request in __mcrouter__.top_clients on top of its bytes in and"
+  " out, i.e. how many bytes of copying it takes to parse and route one.")
+
 mcrouter_option_integer(
   size_t, latency_window_size, 16,
   "latency-window-size", no_short,
@@ -337,6 +815,13 @@ mcrouter_option_integer(
 
 mcrouter_option_group("Timeouts")
 
+mcrouter_option_integer(
+  unsigned int, request_deadline_ms, 0,
+  "request-deadline-ms", no_short,
+  "If positive, requests have this long from when they are received until"
+  " they should be replied to: destination timeouts are clamped to the time"
+  " left, and failover is skipped once it is over.")
+
 mcrouter_option_integer(
   unsigned int, server_timeout_ms, 1000,
   "server-timeout", 't',
@@ -377,7 +862,35 @@ mcrouter_option_toggle(
   same_connection_any_timeout, false,
   "same-connection-any-timeout", no_short,
   "If enabled - same connection to a destination may be used for requests "
-  "with different timeouts.")
+  "with different timeouts. Connections, batching and TKO state of"
+  " a destination are shared by all pools using it then.")
+
+mcrouter_option_integer(
+  unsigned int, adaptive_timeout_p99_percent, 0,
+  "adaptive-timeout-p99-percent", no_short,
+  "If non-zero, the timeout of each destination adapts to its own latency:"
+  " it is this percentage of the p99 latency of its recent replies (e.g."
+  " 300 for 3x p99), between adaptive-timeout-min-ms and"
+  " adaptive-timeout-max-ms. Until a destination has seen"
+  " adaptive-timeout-window replies, the configured timeout is used.")
+
+mcrouter_option_integer(
+  unsigned int, adaptive_timeout_min_ms, 10,
+  "adaptive-timeout-min-ms", no_short,
+  "With adaptive-timeout-p99-percent, lower bound of adaptive timeouts.")
+
+mcrouter_option_integer(
+  unsigned int, adaptive_timeout_max_ms, 0,
+  "adaptive-timeout-max-ms", no_short,
+  "With adaptive-timeout-p99-percent, upper bound of adaptive timeouts."
+  " 0 means the configured timeout of the destination's pool, so timeouts"
+  " only get shorter.")
+
+mcrouter_option_integer(
+  size_t, adaptive_timeout_window, 1000,
+  "adaptive-timeout-window", no_short,
+  "With adaptive-timeout-p99-percent, number of recent replies the p99"
+  " latency of a destination is computed from.")
 
 
 mcrouter_option_group("Logging")
@@ -392,6 +905,26 @@ mcrouter_option_integer(
   "stats-logging-interval", no_short,
   "Time in ms between stats reports, or 0 for no logging")
 
+mcrouter_option_integer(
+  int, metrics_port, 0,
+  "metrics-port", no_short,
+  "If non-zero, serve stats in the OpenMetrics text format over HTTP on this"
+  " port, from a separate thread")
+
+mcrouter_option_integer(
+  unsigned int, metrics_render_interval_ms, 1000,
+  "metrics-render-interval-ms", no_short,
+  "Time in ms between renders of the metrics served on metrics-port;"
+  " scrapes in between get the last render")
+
+mcrouter_option_string(
+  debug_tap_socket, "",
+  "debug-tap-socket", no_short,
+  "If set, serve a live tap of request/reply pairs on this unix socket,"
+  " from a separate thread. A client sends a filter line, see DebugTap.h;"
+  " proxies are only tapped while a client is connected. The socket is"
+  " created with mode 0600, only the user mcrouter runs as may connect.")
+
 mcrouter_option_integer(
   unsigned int, logging_rtt_outlier_threshold_us, 0,
   "logging-rtt-outlier-threshold-us", no_short,
@@ -94,6 +94,7 @@ std::string toString(const boost::any& value) {
             tryToString<bool>(value, res) ||
             tryToString<std::string>(value, res) ||
             tryToString<vector<uint16_t>>(value, res) ||
+            tryToString<vector<std::string>>(value, res) ||
             tryToString<mcrouter::RoutingPrefix>(value, res);
   if (!ok) {
     throw std::logic_error("Unsupported option type: " +
@@ -122,6 +123,7 @@ void fromString(const std::string& str, const boost::any& value) {
             tryFromString<bool>(str, value) ||
             tryFromString<std::string>(str, value) ||
             tryFromString<vector<uint16_t>>(str, value) ||
+            tryFromString<vector<std::string>>(str, value) ||
             tryFromString<mcrouter::RoutingPrefix>(str, value);
 
   if (!ok) {
@@ -9,25 +9,35 @@
  */
 #include "proxy.h"
 
+#include <alloca.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <chrono>
+#include <limits>
+#include <memory>
+#include <vector>
 
 #include <boost/regex.hpp>
 
+#include <glog/logging.h>
+
 #include <folly/DynamicConverter.h>
 #include <folly/FileUtil.h>
 #include <folly/Format.h>
 #include <folly/Memory.h>
 #include <folly/Random.h>
 #include <folly/Range.h>
+#include <folly/String.h>
 #include <folly/ThreadName.h>
 #include <folly/File.h>
+#include <folly/experimental/fibers/Baton.h>
 #include <folly/experimental/fibers/EventBaseLoopController.h>
+#include <folly/io/async/AsyncTimeout.h>
 
 #include "mcrouter/async.h"
 #include "mcrouter/config-impl.h"
@@ -60,17 +70,31 @@ namespace facebook { namespace memcache { namespace mcrouter {
 
 namespace {
 
+/* See opts.preconnect_batch_size */
+const std::chrono::milliseconds kPreconnectInterval{10};
 
-}  // anonymous namespace
+/* Pass a weight 1 queue advances by per request, see popWaitingRequest() */
+const uint64_t kTenantStride = 1 << 20;
 
-static asox_queue_callbacks_t const proxy_request_queue_cb =  {
-  /* Note that we want to drain the queue on cleanup,
-     so we register both regular and sweep callbacks */
-  McrouterClient::requestReady,
-  McrouterClient::requestReady,
-};
+/* Retry period of stolen replies the receiving proxy had no room for */
+const uint32_t kStolenReplyRetryMs = 1;
 
-namespace {
+/**
+ * Copy of reply that shares no mc_msg_t with it: refcounts of messages
+ * may not be atomic (see mc_msg_use_atomic_refcounts()), so no message
+ * can be referenced from two proxy threads.
+ */
+McReply copyReply(const McReply& reply) {
+  auto copy = reply.hasValue()
+    ? McReply(reply.result(), reply.valueRangeSlow())
+    : McReply(reply.result());
+  copy.setFlags(reply.flags());
+  copy.setLeaseToken(reply.leaseToken());
+  copy.setCas(reply.cas());
+  copy.setDelta(reply.delta());
+  copy.setAppSpecificErrorCode(reply.appSpecificErrorCode());
+  return copy;
+}
 
 folly::fibers::FiberManager::Options getFiberManagerOptions(
     const McrouterOptions& opts) {
@@ -81,8 +105,90 @@ folly::fibers::FiberManager::Options getFiberManagerOptions(
   return fmOpts;
 }
 
+/**
+ * Routes ctx's request through its ProxyRoute.
+ */
+McReply routeRequest(const ProxyRequestContext::Ptr& ctx) {
+  auto& origReq = ctx->origReq();
+  try {
+    auto& proute = ctx->proxyRoute();
+    auto reply = proute.dispatchMcMsg(origReq.clone(), ctx);
+    return ProxyMcReply::moveToMcReply(std::move(reply));
+  } catch (const std::exception& e) {
+    std::string err = "error routing "
+      + to<std::string>(origReq->key) + ": " +
+      e.what();
+    return McReply(mc_res_local_error, err);
+  }
+}
+
+FOLLY_NOINLINE void touchStack(size_t bytes) {
+  auto stack = static_cast<volatile char*>(alloca(bytes));
+  for (size_t i = 0; i < bytes; i += 4096) {
+    stack[i] = 0;
+  }
+}
+
+/* [start, end) packed into one word, see ShadowSettings::shouldShadow() */
+uint64_t packIndexRange(size_t start, size_t end) {
+  const size_t m = std::numeric_limits<uint32_t>::max();
+  return (static_cast<uint64_t>(std::min(start, m)) << 32) | std::min(end, m);
 }
 
+uint64_t packKeyHashRange(double startFraction, double endFraction) {
+  const uint32_t m = std::numeric_limits<uint32_t>::max();
+  uint32_t keyStart = std::max(0.0, startFraction) * m;
+  uint32_t keyEnd = std::min(1.0, endFraction) * m;
+  return (static_cast<uint64_t>(keyStart) << 32) | keyEnd;
+}
+
+uint64_t parseIndexRange(const folly::dynamic& valIndex) {
+  checkLogic(valIndex.isArray(), "index_range_rv is not an array");
+  checkLogic(valIndex.size() == 2, "Size of index_range_rv is not 2");
+  checkLogic(valIndex[0].isInt(), "start_index is not an int");
+  checkLogic(valIndex[1].isInt(), "end_index is not an int");
+  size_t startIndex = valIndex[0].asInt();
+  size_t endIndex = valIndex[1].asInt();
+  checkLogic(startIndex <= endIndex, "start_index > end_index");
+  return packIndexRange(startIndex, endIndex);
+}
+
+uint64_t parseKeyFractionRange(const folly::dynamic& valFraction) {
+  checkLogic(valFraction.isArray(), "key_fraction_range_rv is not an array");
+  checkLogic(valFraction.size() == 2,
+             "Size of key_fraction_range_rv is not 2");
+  checkLogic(valFraction[0].isNumber(), "start_key_fraction is not a number");
+  checkLogic(valFraction[1].isNumber(), "end_key_fraction is not a number");
+  double startKeyFraction = valFraction[0].asDouble();
+  double endKeyFraction = valFraction[1].asDouble();
+  checkLogic(startKeyFraction >= 0.0 && startKeyFraction <= 1.0 &&
+             endKeyFraction >= 0.0 && endKeyFraction <= 1.0 &&
+             startKeyFraction <= endKeyFraction,
+             "Invalid values for start_key_fraction and/or "
+             "end_key_fraction");
+  return packKeyHashRange(startKeyFraction, endKeyFraction);
+}
+
+}
+
+/* Runs proxy_t::sendStolenReplies() again, see stolenRepliesToSend_ */
+class proxy_t::StolenReplyRetry : public folly::AsyncTimeout {
+ public:
+  explicit StolenReplyRetry(proxy_t& proxy)
+      : folly::AsyncTimeout(proxy.eventBase),
+        proxy_(proxy) {
+  }
+
+  void timeoutExpired() noexcept override {
+    proxy_.sendStolenReplies();
+  }
+
+ private:
+  proxy_t& proxy_;
+};
+
+constexpr size_t proxy_t::kStolenRequestsClosed;
+
 proxy_t::proxy_t(McrouterInstance* router_,
                  folly::EventBase* eventBase_,
                  const McrouterOptions& opts_)
@@ -90,12 +196,42 @@ proxy_t::proxy_t(McrouterInstance* router_,
       opts(opts_),
       eventBase(eventBase_),
       destinationMap(folly::make_unique<ProxyDestinationMap>(this)),
-      durationUs(kExponentialFactor),
+      durationUs(kLatencyWindow),
+      hotKeys(opts_.hot_keys_top_k, opts_.hot_keys_sample_period),
+      topSenders(opts_.top_clients_top_k, opts_.top_clients_sample_period,
+                 opts_.top_clients_request_cost),
+      topConnections(opts_.top_clients_top_k,
+                     opts_.top_clients_sample_period,
+                     opts_.top_clients_request_cost),
+      slowRequests(opts_.slow_request_threshold_us,
+                   opts_.slow_request_log_size),
+      inflightLimiter(opts_.proxy_adaptive_inflight_limit &&
+                      opts_.proxy_max_inflight_requests > 0
+                      ? folly::make_unique<ConcurrencyLimiter>(
+                          std::max<size_t>(
+                            1,
+                            std::min(opts_.proxy_min_inflight_requests,
+                                     opts_.proxy_max_inflight_requests)),
+                          opts_.proxy_max_inflight_requests)
+                      : nullptr),
+      connectThrottle(std::make_shared<ConnectThrottle>(
+                        opts_.proxy_max_concurrent_connects)),
       randomGenerator(folly::randomNumberSeed()),
       fiberManager(folly::make_unique<folly::fibers::EventBaseLoopController>(),
                    getFiberManagerOptions(opts_)) {
+  folly::split(',', opts.proxy_priority_routing_prefixes,
+               priorityRoutingPrefixes_, /* ignoreEmpty= */ true);
+  initTenants();
+
+  if (router && router->trafficCaptureFile()) {
+    trafficCapture = folly::make_unique<TrafficCaptureWriter>(
+      router->trafficCaptureFile(), opts.traffic_capture_sample_period,
+      opts.traffic_capture_keys);
+  }
+
   memset(stats, 0, sizeof(stats));
   memset(stats_bin, 0, sizeof(stats_bin));
+  memset(stats_last_value, 0, sizeof(stats_last_value));
   memset(stats_num_within_window, 0, sizeof(stats_num_within_window));
 
   static uint64_t next_magic = 0x12345678900000LL;
@@ -122,25 +258,80 @@ void proxy_t::onEventBaseAttached() {
 
   init_proxy_event_priorities(this);
 
+  probeTimer.reset(new folly::HHWheelTimer(eventBase));
+
   std::chrono::milliseconds connectionResetInterval{
     opts.reset_inactive_connection_interval
   };
   if (connectionResetInterval.count() > 0) {
     destinationMap->setResetTimer(connectionResetInterval);
   }
+  if (opts.preconnect_destinations) {
+    destinationMap->setPreconnectTimer(kPreconnectInterval);
+  }
+  if (opts.latency_outlier_factor > 0 &&
+      opts.latency_outlier_check_interval_ms > 0) {
+    destinationMap->setLatencyOutlierTimer(std::chrono::milliseconds{
+      opts.latency_outlier_check_interval_ms
+    });
+  }
 
   int priority = get_event_priority(opts, SERVER_REQUEST);
-  request_queue = asox_queue_init(eventBase->getLibeventBase(), priority,
-                                  1, 0, 0, &proxy_request_queue_cb,
-                                  ASOX_QUEUE_INTRA_PROCESS, this);
+  /* Note that the queue is drained on destruction, so the remaining
+     messages are swept through requestReady as well */
+  messageQueue = folly::make_unique<MessageQueue<ProxyMessage>>(
+    opts.client_queue_size,
+    [this] (ProxyMessage&& message) {
+      loopMonitor.queueWaitUs.record(
+        std::max<int64_t>(0, nowUs() - message.enqueuedUs));
+      McrouterClient::requestReady(*this, std::move(message));
+    });
+  messageQueue->attachEventBase(eventBase->getLibeventBase(), priority);
+  stolenReplyRetry_ = folly::make_unique<StolenReplyRetry>(*this);
+  /* Siblings may hand requests over to us from now on */
+  stolenRequestsIn_.fetch_and(~kStolenRequestsClosed);
 
   statsContainer = folly::make_unique<ProxyStatsContainer>(this);
 
+  loopMonitor.start();
+
+  prefillFibersPool();
+
   if (router != nullptr) {
     router->startupLock().notify();
   }
 }
 
+void proxy_t::prefillFibersPool() {
+  auto n = std::min(opts.fibers_pool_prefill, opts.fibers_max_pool_size);
+  if (n == 0) {
+    return;
+  }
+  auto prefault = opts.fibers_prefault_stack_size;
+  if (opts.fibers_stack_size != 0) {
+    prefault = std::min(prefault, opts.fibers_stack_size / 2);
+  }
+
+  /* A finished fiber goes back to the pool and is reused by the next task,
+     so every task but the last waits until all of them are running;
+     that way n distinct fibers are allocated. */
+  auto batons = std::make_shared<std::vector<folly::fibers::Baton>>(n - 1);
+  for (size_t i = 0; i < n; ++i) {
+    fiberManager.addTask([batons, i, prefault]() {
+      if (prefault > 0) {
+        touchStack(prefault);
+      }
+      if (i < batons->size()) {
+        (*batons)[i].wait();
+      } else {
+        for (auto& baton : *batons) {
+          baton.post();
+        }
+      }
+    });
+  }
+}
+
 std::shared_ptr<ProxyConfigIf> proxy_t::getConfig() const {
   std::lock_guard<SFRReadLock> lg(
     const_cast<SFRLock&>(configLock_).readLock());
@@ -165,18 +356,39 @@ std::shared_ptr<ProxyConfigIf> proxy_t::swapConfig(
   return old;
 }
 
+const std::shared_ptr<ProxyConfigIf>& proxy_t::getConfigForProxyThread() {
+  if (!proxyThreadConfig_) {
+    /* Initial config didn't come with a message, pick it up once */
+    proxyThreadConfig_ = getConfig();
+  }
+  return proxyThreadConfig_;
+}
+
+void proxy_t::onConfigSwapped() {
+  proxyThreadConfig_ = getConfig();
+  routeCpu.onConfigSwapped();
+}
+
 /** drain and delete proxy object */
 proxy_t::~proxy_t() {
   destinationMap.reset();
 
   being_destroyed = true;
-  if (request_queue) {
-    asox_queue_del(request_queue);
-  }
+  messageQueue.reset();
 
   magic = 0xdeadbeefdeadbeefLL;
 }
 
+void proxy_t::sendMessage(request_entry_type_t type, void* data) {
+  CHECK(messageQueue.get() != nullptr);
+  messageQueue->blockingWrite(type, data);
+}
+
+bool proxy_t::trySendMessage(request_entry_type_t type, void* data) {
+  CHECK(messageQueue.get() != nullptr);
+  return messageQueue->write(type, data);
+}
+
 void proxy_t::routeHandlesProcessRequest(
   std::unique_ptr<ProxyRequestContext> upreq) {
 
@@ -186,7 +398,8 @@ void proxy_t::routeHandlesProcessRequest(
     return;
   }
 
-  auto preq = ProxyRequestContext::process(std::move(upreq), getConfig());
+  auto preq = ProxyRequestContext::process(std::move(upreq),
+                                           getConfigForProxyThread());
   if (preq->origReq()->op == mc_op_get_service_info) {
     auto orig = preq->origReq().clone();
     const auto& config = preq->proxyConfig();
@@ -197,6 +410,13 @@ void proxy_t::routeHandlesProcessRequest(
     return;
   }
 
+  if (preq->proxyRoute().completesInline(preq->origReq())) {
+    /* Nothing to wait for, don't pay for a fiber */
+    stat_incr(stats, proxy_reqs_inline_stat, 1);
+    preq->sendReply(routeRequest(preq));
+    return;
+  }
+
   auto func_ctx = preq;
 
 #ifdef __clang__
@@ -204,19 +424,10 @@ void proxy_t::routeHandlesProcessRequest(
 #pragma clang diagnostic ignored "-Wc++1y-extensions"
 #endif
   fiberManager.addTaskFinally(
-    [ctx = func_ctx]() {
-      auto& origReq = ctx->origReq();
-      try {
-        auto& proute = ctx->proxyRoute();
-        auto reply = proute.dispatchMcMsg(origReq.clone(),
-                                          std::move(ctx));
-        return ProxyMcReply::moveToMcReply(std::move(reply));
-      } catch (const std::exception& e) {
-        std::string err = "error routing "
-          + to<std::string>(origReq->key) + ": " +
-          e.what();
-        return McReply(mc_res_local_error, err);
-      }
+    [ctx = func_ctx, addedUs = nowUs()]() {
+      ctx->proxy().loopMonitor.fiberWaitUs.record(
+        std::max<int64_t>(0, nowUs() - addedUs));
+      return routeRequest(ctx);
     },
     [ctx = std::move(preq)](folly::Try<McReply>&& reply) {
       ctx->sendReply(std::move(*reply));
@@ -227,10 +438,31 @@ void proxy_t::routeHandlesProcessRequest(
 #endif
 }
 
+/**
+ * A request handed over to a sibling proxy, see proxy_steal_threshold.
+ * Goes to the sibling with req set and comes back with reply set.
+ */
+struct StolenRequest {
+  /* Only touched by the proxy thread that received it */
+  std::unique_ptr<ProxyRequestContext> orig;
+  /* Copy of orig's request, owned by the sibling */
+  McMsgRef req;
+  folly::Optional<McReply> reply;
+
+  explicit StolenRequest(std::unique_ptr<ProxyRequestContext> r)
+      : orig(std::move(r)),
+        req(MutableMcMsgRef(mc_msg_dup(orig->origReq().get()))) {
+  }
+};
+
 void proxy_t::processRequest(std::unique_ptr<ProxyRequestContext> preq) {
   assert(!preq->processing_);
   preq->processing_ = true;
   ++numRequestsProcessing_;
+  if (preq->tenant_ >= 0) {
+    ++tenants_[preq->tenant_]->inflight;
+  }
+  publishLoad();
   stat_incr(stats, proxy_reqs_processing_stat, 1);
 
   switch (preq->origReq()->op) {
@@ -277,6 +509,10 @@ void proxy_t::processRequest(std::unique_ptr<ProxyRequestContext> preq) {
       stat_incr(stats, cmd_delete_stat, 1);
       stat_incr(stats, cmd_delete_count_stat, 1);
       break;
+    case mc_op_touch:
+      stat_incr(stats, cmd_touch_stat, 1);
+      stat_incr(stats, cmd_touch_count_stat, 1);
+      break;
     case mc_op_lease_set:
       stat_incr(stats, cmd_lease_set_stat, 1);
       stat_incr(stats, cmd_lease_set_count_stat, 1);
@@ -291,6 +527,13 @@ void proxy_t::processRequest(std::unique_ptr<ProxyRequestContext> preq) {
       break;
   }
 
+  if (preq->origReq()->key.len > 0) {
+    hotKeys.record(to<folly::StringPiece>(preq->origReq()->key));
+  }
+  if (trafficCapture) {
+    trafficCapture->maybeRecord(*preq->origReq());
+  }
+
   routeHandlesProcessRequest(std::move(preq));
 
   stat_incr(stats, request_sent_stat, 1);
@@ -298,22 +541,238 @@ void proxy_t::processRequest(std::unique_ptr<ProxyRequestContext> preq) {
 }
 
 void proxy_t::dispatchRequest(std::unique_ptr<ProxyRequestContext> preq) {
+  preq->tenant_ = tenantOf(*preq);
   if (rateLimited(*preq)) {
     if (opts.proxy_max_throttled_requests > 0 &&
-        waitingRequests_.size() >= opts.proxy_max_throttled_requests) {
+        numWaitingRequests() >= opts.proxy_max_throttled_requests) {
       preq->sendReply(McReply(mc_res_local_error, "Max throttled exceeded"));
       return;
     }
-    auto w = folly::make_unique<WaitingRequest>(std::move(preq));
-    waitingRequests_.pushBack(std::move(w));
-    stat_incr(stats, proxy_reqs_waiting_stat, 1);
+    if (enqueueWaitingRequest(std::move(preq))) {
+      stat_incr(stats, proxy_reqs_waiting_stat, 1);
+      handOverWaitingRequests();
+    }
   } else {
     processRequest(std::move(preq));
   }
 }
 
+bool proxy_t::enqueueWaitingRequest(
+    std::unique_ptr<ProxyRequestContext> preq) {
+  /* A queue that was empty starts at the current pass, so that it doesn't
+     get ahead by the time it was idle */
+  if (preq->tenant_ >= 0) {
+    auto& tenant = *tenants_[preq->tenant_];
+    if (tenant.maxQueued > 0 &&
+        tenant.waitingRequests.size() >= tenant.maxQueued) {
+      stat_incr(stats, proxy_tenant_reqs_rejected_stat, 1);
+      preq->sendReply(McReply(mc_res_local_error,
+                              "Tenant max queued exceeded"));
+      return false;
+    }
+    if (tenant.waitingRequests.empty()) {
+      tenant.pass = std::max(tenant.pass, currentPass_);
+    }
+    tenant.waitingRequests.pushBack(
+      folly::make_unique<WaitingRequest>(std::move(preq)));
+    ++numTenantWaitingRequests_;
+    return true;
+  }
+
+  bool highPri = isHighPriority(*preq);
+  auto w = folly::make_unique<WaitingRequest>(std::move(preq));
+  if (highPri) {
+    highPriWaitingRequests_.pushBack(std::move(w));
+  } else {
+    if (waitingRequests_.empty()) {
+      defaultPass_ = std::max(defaultPass_, currentPass_);
+    }
+    waitingRequests_.pushBack(std::move(w));
+  }
+  return true;
+}
+
+std::unique_ptr<proxy_t::WaitingRequest> proxy_t::popWaitingRequest() {
+  if (!highPriWaitingRequests_.empty()) {
+    return highPriWaitingRequests_.popFront();
+  }
+
+  Tenant* next = nullptr;
+  for (auto& tenant : tenants_) {
+    if (!tenant->waitingRequests.empty() &&
+        (tenant->maxInflight == 0 || tenant->inflight < tenant->maxInflight) &&
+        (next == nullptr || tenant->pass < next->pass)) {
+      next = tenant.get();
+    }
+  }
+  if (!waitingRequests_.empty() &&
+      (next == nullptr || defaultPass_ <= next->pass)) {
+    currentPass_ = defaultPass_;
+    defaultPass_ += kTenantStride;
+    return waitingRequests_.popFront();
+  }
+  if (next == nullptr) {
+    return nullptr;
+  }
+  currentPass_ = next->pass;
+  next->pass += kTenantStride / next->weight;
+  --numTenantWaitingRequests_;
+  return next->waitingRequests.popFront();
+}
+
+void proxy_t::handOverWaitingRequests() {
+  auto threshold = opts.proxy_steal_threshold;
+  if (threshold == 0 || router == nullptr || !acceptsStolenRequests()) {
+    return;
+  }
+
+  while (waitingRequests_.size() > threshold) {
+    proxy_t* sibling = nullptr;
+    for (size_t i = 0; i < opts.num_proxies; ++i) {
+      auto p = router->getProxy(i);
+      if (p != nullptr && p != this && p->acceptsStolenRequests() &&
+          (sibling == nullptr || p->load() < sibling->load())) {
+        sibling = p;
+      }
+    }
+    if (sibling == nullptr || sibling->load() >= threshold ||
+        !sibling->reserveStolenRequest()) {
+      break;
+    }
+
+    auto& w = waitingRequests_.front();
+    auto stolen = new StolenRequest(std::move(w.request));
+    /* So that we (and others) see it before the sibling updates its load */
+    sibling->load_.fetch_add(1, std::memory_order_relaxed);
+    if (!sibling->trySendMessage(request_type_stolen_request, stolen)) {
+      /* Its queue is full, so it's busy anyway: the request is routed here
+         (waiting on it could deadlock two proxies handing over to each
+         other). The sibling has messages to process, so it can't be left
+         waiting on the reservation we give back. */
+      sibling->load_.fetch_sub(1, std::memory_order_relaxed);
+      sibling->stolenRequestsIn_.fetch_sub(1);
+      w.request = std::move(stolen->orig);
+      delete stolen;
+      break;
+    }
+    waitingRequests_.popFront();
+    ++stolenRequestsOut_;
+    stat_decr(stats, proxy_reqs_waiting_stat, 1);
+  }
+  publishLoad();
+}
+
+bool proxy_t::reserveStolenRequest() {
+  auto current = stolenRequestsIn_.load();
+  do {
+    if (current & kStolenRequestsClosed) {
+      return false;
+    }
+  } while (!stolenRequestsIn_.compare_exchange_weak(current, current + 1));
+  return true;
+}
+
+bool proxy_t::finishStolenRequests() {
+  auto in = stolenRequestsIn_.fetch_or(kStolenRequestsClosed) &
+    ~kStolenRequestsClosed;
+  return in > 0 || stolenRequestsOut_ > 0;
+}
+
+void proxy_t::routeStolenRequest(StolenRequest* stolen) {
+  /* Siblings only hand requests over while we accept them, and we keep
+     running until all of them are replied to (see finishStolenRequests()),
+     so none is left for the sweep of the queue on destruction. */
+  DCHECK(!being_destroyed);
+
+  stat_incr(stats, proxy_reqs_stolen_stat, 1);
+  auto preq = ProxyRequestContext::create(
+    *this, std::move(stolen->req), &proxy_t::sendStolenReply, stolen,
+    nullptr);
+  processRequest(std::move(preq));
+}
+
+void proxy_t::sendStolenReply(ProxyRequestContext& preq) {
+  auto stolen = static_cast<StolenRequest*>(preq.context_);
+  stolen->reply.emplace(copyReply(preq.reply_.value()));
+  auto& proxy = preq.proxy();
+  proxy.stolenRepliesToSend_.push_back(stolen);
+  proxy.sendStolenReplies();
+}
+
+void proxy_t::sendStolenReplies() {
+  size_t sent = 0;
+  while (sent < stolenRepliesToSend_.size()) {
+    auto stolen = stolenRepliesToSend_[sent];
+    if (!stolen->orig->proxy().trySendMessage(request_type_stolen_reply,
+                                              stolen)) {
+      break;
+    }
+    ++sent;
+  }
+  stolenRepliesToSend_.erase(stolenRepliesToSend_.begin(),
+                             stolenRepliesToSend_.begin() + sent);
+  /* Not touched by us anymore: the proxy that received them may go */
+  stolenRequestsIn_.fetch_sub(sent);
+
+  if (!stolenRepliesToSend_.empty() && !stolenReplyRetry_->isScheduled()) {
+    stolenReplyRetry_->scheduleTimeout(kStolenReplyRetryMs);
+  }
+}
+
+void proxy_t::onStolenReply(StolenRequest* stolen) {
+  std::unique_ptr<StolenRequest> guard(stolen);
+  --stolenRequestsOut_;
+  guard->orig->sendReply(std::move(guard->reply.value()));
+}
+
+size_t proxy_t::maxInflightRequests() const {
+  return inflightLimiter ? inflightLimiter->limit()
+                         : opts.proxy_max_inflight_requests;
+}
+
+bool proxy_t::atInflightLimit() const {
+  return opts.proxy_max_inflight_requests > 0 &&
+         numRequestsProcessing_ >= maxInflightRequests();
+}
+
+double proxy_t::shadowFraction() const {
+  auto depth = numWaitingRequests();
+  if (depth == 0) {
+    return 1.0;
+  }
+  double fraction = 1.0;
+  auto maxDepth = opts.proxy_shadow_shed_waiting_requests;
+  if (maxDepth > 0 && depth > maxDepth) {
+    fraction = static_cast<double>(maxDepth) / depth;
+  }
+  auto maxDelayUs = static_cast<int64_t>(opts.proxy_shadow_shed_queue_delay_us);
+  if (maxDelayUs > 0) {
+    int64_t oldestUs = std::numeric_limits<int64_t>::max();
+    if (!waitingRequests_.empty()) {
+      oldestUs = waitingRequests_.front().enqueuedTimeUs;
+    }
+    if (!highPriWaitingRequests_.empty()) {
+      oldestUs = std::min(oldestUs,
+                          highPriWaitingRequests_.front().enqueuedTimeUs);
+    }
+    auto delayUs = nowUs() - oldestUs;
+    if (delayUs > maxDelayUs) {
+      fraction = std::min(fraction,
+                          static_cast<double>(maxDelayUs) / delayUs);
+    }
+  }
+  return fraction;
+}
+
+void proxy_t::onRequestLatency(int64_t latencyUs) {
+  durationUs.insertSample(latencyUs);
+  if (inflightLimiter) {
+    inflightLimiter->onSample(latencyUs, numRequestsProcessing_);
+  }
+}
+
 bool proxy_t::rateLimited(const ProxyRequestContext& preq) const {
-  if (!opts.proxy_max_inflight_requests) {
+  if (!opts.proxy_max_inflight_requests && preq.tenant_ < 0) {
     return false;
   }
 
@@ -324,8 +783,15 @@ bool proxy_t::rateLimited(const ProxyRequestContext& preq) const {
     return false;
   }
 
-  if (waitingRequests_.empty() &&
-      numRequestsProcessing_ < opts.proxy_max_inflight_requests) {
+  if (preq.tenant_ >= 0) {
+    const auto& tenant = *tenants_[preq.tenant_];
+    if (!tenant.waitingRequests.empty() ||
+        (tenant.maxInflight > 0 && tenant.inflight >= tenant.maxInflight)) {
+      return true;
+    }
+  }
+
+  if (numWaitingRequests() == 0 && !atInflightLimit()) {
     return false;
   }
 
@@ -333,16 +799,117 @@ bool proxy_t::rateLimited(const ProxyRequestContext& preq) const {
 }
 
 proxy_t::WaitingRequest::WaitingRequest(std::unique_ptr<ProxyRequestContext> r)
-    : request(std::move(r)) {}
+    : request(std::move(r)),
+      enqueuedTimeUs(nowUs()),
+      proxy(request->proxy()),
+      bytes(sizeof(WaitingRequest) + sizeof(ProxyRequestContext) +
+            request->origReq()->key.len + request->origReq()->value.len) {
+  proxy.waitingRequestBytes_.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+proxy_t::WaitingRequest::~WaitingRequest() {
+  proxy.waitingRequestBytes_.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+void proxy_t::initTenants() {
+  std::vector<folly::StringPiece> entries;
+  folly::split(',', opts.proxy_tenant_quotas, entries,
+               /* ignoreEmpty= */ true);
+  for (auto entry : entries) {
+    auto tenant = folly::make_unique<Tenant>();
+    folly::StringPiece prefix;
+    size_t weight = 0;
+    bool valid = false;
+    try {
+      valid = folly::split(':', entry, prefix, weight, tenant->maxInflight,
+                           tenant->maxQueued) &&
+        !prefix.empty() && weight > 0 && weight <= kTenantStride;
+    } catch (const std::exception&) {
+      /* Not a number */
+    }
+    if (!valid) {
+      LOG(ERROR) << "Invalid proxy-tenant-quotas entry: " << entry;
+      continue;
+    }
+    tenant->routingPrefix = prefix.str();
+    tenant->weight = weight;
+    tenants_.push_back(std::move(tenant));
+  }
+}
+
+folly::StringPiece proxy_t::routingPrefixOf(
+    const ProxyRequestContext& preq) const {
+  /* Same parsing as McRequest: "/region/cluster/" */
+  auto key = to<folly::StringPiece>(preq.origReq()->key);
+  if (!key.empty() && key[0] == '/') {
+    auto pos = key.find('/', 1);
+    if (pos != std::string::npos) {
+      pos = key.find('/', pos + 1);
+      if (pos != std::string::npos) {
+        return key.subpiece(0, pos + 1);
+      }
+    }
+  }
+  return opts.default_route;
+}
+
+bool proxy_t::isHighPriority(const ProxyRequestContext& preq) const {
+  if (priorityRoutingPrefixes_.empty()) {
+    return false;
+  }
+  auto prefix = routingPrefixOf(preq);
+  for (const auto& p : priorityRoutingPrefixes_) {
+    if (prefix == p) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int proxy_t::tenantOf(const ProxyRequestContext& preq) const {
+  if (tenants_.empty()) {
+    return -1;
+  }
+  auto prefix = routingPrefixOf(preq);
+  for (size_t i = 0; i < tenants_.size(); ++i) {
+    if (prefix == tenants_[i]->routingPrefix) {
+      return i;
+    }
+  }
+  return -1;
+}
 
 void proxy_t::pump() {
-  while (numRequestsProcessing_ < opts.proxy_max_inflight_requests &&
-         !waitingRequests_.empty()) {
-    auto w = waitingRequests_.popFront();
+  if (numWaitingRequests() == 0) {
+    return;
+  }
+  auto now = nowUs();
+  int64_t maxAgeUs = opts.proxy_max_throttled_request_age_ms * 1000;
+  while (!atInflightLimit() && numWaitingRequests() > 0) {
+    auto w = popWaitingRequest();
+    if (!w) {
+      /* Only tenants at their max_inflight have requests waiting */
+      break;
+    }
     stat_decr(stats, proxy_reqs_waiting_stat, 1);
+    auto waitedUs = now - w->enqueuedTimeUs;
+    waitingUs.insertSample(waitedUs);
+    if (w->request->phasesSampled()) {
+      w->request->endPhase(RequestPhase::THROTTLE_QUEUE);
+    }
+
+    /* The client has likely given up on this request already,
+       don't waste destinations' capacity on it. */
+    if (maxAgeUs > 0 && waitedUs > maxAgeUs) {
+      stat_incr(stats, proxy_reqs_shed_stat, 1);
+      w->request->sendReply(
+        McReply(mc_res_local_error, "Throttled request expired"));
+      continue;
+    }
 
     processRequest(std::move(w->request));
   }
+  handOverWaitingRequests();
 }
 
 /** allocate a new reply with piggybacking copy of str and the appropriate
@@ -407,117 +974,60 @@ ShadowSettings::Data::Data(const folly::dynamic& json) {
 
 ShadowSettings::ShadowSettings(const folly::dynamic& json,
                                McrouterInstance* router)
-    : data_(std::make_shared<Data>(json)) {
-
-  if (router) {
-    registerOnUpdateCallback(router);
-  }
+    : ShadowSettings(std::make_shared<Data>(json), router) {
 }
 
 ShadowSettings::ShadowSettings(std::shared_ptr<Data> data,
                                McrouterInstance* router)
-    : data_(std::move(data)) {
-
-  if (router) {
-    registerOnUpdateCallback(router);
-  }
-}
-
-ShadowSettings::~ShadowSettings() {
-  /* We must unregister from updates before starting to destruct other
-     members, like variable name strings */
-  handle_.reset();
+    : data_(data),
+      indexRange_(packIndexRange(data->start_index, data->end_index),
+                  router ? &router->rtVarsData() : nullptr,
+                  data->index_range_rv,
+                  parseIndexRange),
+      keyHashRange_(packKeyHashRange(data->start_key_fraction,
+                                     data->end_key_fraction),
+                    router ? &router->rtVarsData() : nullptr,
+                    data->key_fraction_range_rv,
+                    parseKeyFractionRange) {
 }
 
 std::shared_ptr<const ShadowSettings::Data> ShadowSettings::getData() {
   return data_.get();
 }
 
-void ShadowSettings::registerOnUpdateCallback(McrouterInstance* router) {
-  handle_ = router->rtVarsData().subscribeAndCall(
-    [this](std::shared_ptr<const RuntimeVarsData> oldVars,
-           std::shared_ptr<const RuntimeVarsData> newVars) {
-      if (!newVars) {
-        return;
-      }
-      auto dataCopy = std::make_shared<Data>(*this->getData());
-      size_t start_index_temp = 0, end_index_temp = 0;
-      double start_key_fraction_temp = 0, end_key_fraction_temp = 0;
-      bool updateRange = false, updateKeyFraction = false;
-      if (!dataCopy->index_range_rv.empty()) {
-        auto valIndex =
-            newVars->getVariableByName(dataCopy->index_range_rv);
-        if (valIndex != nullptr) {
-          checkLogic(valIndex.isArray(), "index_range_rv is not an array");
-
-          checkLogic(valIndex.size() == 2, "Size of index_range_rv is not 2");
-
-          checkLogic(valIndex[0].isInt(), "start_index is not an int");
-          checkLogic(valIndex[1].isInt(), "end_index is not an int");
-          start_index_temp = valIndex[0].asInt();
-          end_index_temp = valIndex[1].asInt();
-          checkLogic(start_index_temp <= end_index_temp,
-                     "start_index > end_index");
-          updateRange = true;
-        }
-      }
-      if (!dataCopy->key_fraction_range_rv.empty()) {
-        auto valFraction =
-            newVars->getVariableByName(dataCopy->key_fraction_range_rv);
-        if (valFraction != nullptr) {
-          checkLogic(valFraction.isArray(),
-                     "key_fraction_range_rv is not an array");
-          checkLogic(valFraction.size() == 2,
-                     "Size of key_fraction_range_rv is not 2");
-          checkLogic(valFraction[0].isNumber(),
-                     "start_key_fraction is not a number");
-          checkLogic(valFraction[1].isNumber(),
-                     "end_key_fraction is not a number");
-          start_key_fraction_temp = valFraction[0].asDouble();
-          end_key_fraction_temp = valFraction[1].asDouble();
-
-          checkLogic(start_key_fraction_temp >= 0.0 &&
-                     start_key_fraction_temp <= 1.0 &&
-                     end_key_fraction_temp >= 0.0 &&
-                     end_key_fraction_temp <= 1.0 &&
-                     start_key_fraction_temp <= end_key_fraction_temp,
-                     "Invalid values for start_key_fraction and/or "
-                     "end_key_fraction");
-
-          updateKeyFraction = true;
-        }
-      }
-
-      if (updateRange) {
-        dataCopy->start_index = start_index_temp;
-        dataCopy->end_index = end_index_temp;
-      }
-      if (updateKeyFraction) {
-        dataCopy->start_key_fraction = start_key_fraction_temp;
-        dataCopy->end_key_fraction = end_key_fraction_temp;
-      }
+bool ShadowSettings::matchKeyHash(uint32_t routingKeyHash,
+                                  uint32_t keyStart,
+                                  uint32_t keyEnd) {
+  const uint32_t m = std::numeric_limits<uint32_t>::max();
+  /* Same as match_routing_key_hash() */
+  auto keyHash = routingKeyHash % (m - 1);
+  return keyHash >= keyStart && keyHash < keyEnd;
+}
 
-      this->data_.set(std::move(dataCopy));
-    });
+void ShadowSettings::setData(std::shared_ptr<const Data> data) {
+  indexRange_.set(packIndexRange(data->start_index, data->end_index));
+  keyHashRange_.set(packKeyHashRange(data->start_key_fraction,
+                                     data->end_key_fraction));
+  data_.set(std::move(data));
 }
 
 void proxy_config_swap(proxy_t* proxy,
                        std::shared_ptr<ProxyConfig> config) {
   /* Update the number of server stat for this proxy. */
   stat_set_uint64(proxy->stats, num_servers_stat, config->getClients().size());
+  stat_set_uint64(proxy->stats, config_routes_deduplicated_stat,
+                  config->dedupedRoutes());
+
+  if (proxy->opts.lazy_routes_warmup && proxy->eventBase != nullptr) {
+    config->warmUpLazyRoutes(*proxy->eventBase);
+  }
 
   auto oldConfig = proxy->swapConfig(std::move(config));
   stat_set_uint64(proxy->stats, config_last_success_stat, time(nullptr));
 
   if (oldConfig) {
     auto configReq = new old_config_req_t(std::move(oldConfig));
-    asox_queue_entry_t oldConfigEntry;
-    oldConfigEntry.data = configReq;
-    oldConfigEntry.nbytes = sizeof(*configReq);
-    oldConfigEntry.priority = 0;
-    oldConfigEntry.type = request_type_old_config;
-    oldConfigEntry.time_enqueued = time(nullptr);
-    asox_queue_enqueue(proxy->request_queue, &oldConfigEntry);
+    proxy->sendMessage(request_type_old_config, configReq);
   }
 }
 
@@ -17,26 +17,44 @@
 #include <sys/resource.h>
 #include <sys/types.h>
 
+#include <atomic>
 #include <memory>
 #include <random>
 #include <string>
+#include <vector>
 
+#include <folly/detail/CacheLocality.h>
 #include <folly/Range.h>
 #include <folly/experimental/fibers/FiberManager.h>
+#include <folly/io/async/HHWheelTimer.h>
 
+#include "mcrouter/async.h"
+#include "mcrouter/ConcurrencyLimiter.h"
 #include "mcrouter/config.h"
-#include "mcrouter/ExponentialSmoothData.h"
-#include "mcrouter/lib/fbi/asox_queue.h"
+#include "mcrouter/DebugTap.h"
+#include "mcrouter/DecayingHistogram.h"
+#include "mcrouter/HotKeyTracker.h"
+#include "mcrouter/LatencyHistogram.h"
 #include "mcrouter/lib/fbi/cpp/AtomicSharedPtr.h"
 #include "mcrouter/lib/mc/msg.h"
 #include "mcrouter/lib/mc/protocol.h"
 #include "mcrouter/lib/McMsgRef.h"
 #include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/MessageQueue.h"
 #include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/network/ConnectThrottle.h"
 #include "mcrouter/lib/network/UniqueIntrusiveList.h"
-#include "mcrouter/Observable.h"
 #include "mcrouter/options.h"
+#include "mcrouter/PoolStats.h"
+#include "mcrouter/ProxyLoopMonitor.h"
+#include "mcrouter/RequestPhaseStats.h"
+#include "mcrouter/RouteCpuProfiler.h"
+#include "mcrouter/RuntimeVar.h"
+#include "mcrouter/SizeStats.h"
+#include "mcrouter/SlowRequestLog.h"
 #include "mcrouter/stats.h"
+#include "mcrouter/TopClientTracker.h"
+#include "mcrouter/TrafficCapture.h"
 
 // make sure MOVING_AVERAGE_WINDOW_SIZE_IN_SECOND can be exactly divided by
 // MOVING_AVERAGE_BIN_SIZE_IN_SECOND
@@ -68,12 +86,8 @@ class ProxyClientCommon;
 class ProxyDestination;
 class ProxyDestinationMap;
 class ProxyRequestContext;
-class RuntimeVarsData;
 class ShardSplitter;
 
-typedef Observable<std::shared_ptr<const RuntimeVarsData>>
-  ObservableRuntimeVars;
-
 struct ShadowSettings {
   struct Data {
     size_t start_index{0};
@@ -90,14 +104,71 @@ struct ShadowSettings {
 
   ShadowSettings(const folly::dynamic& json, McrouterInstance* router);
   ShadowSettings(std::shared_ptr<Data> data, McrouterInstance* router);
-  ~ShadowSettings();
 
+  /**
+   * Settings as configured or last set with setData(); ranges set through
+   * runtime vars are only reflected in shouldShadow().
+   */
   std::shared_ptr<const Data> getData();
 
+  /**
+   * Replaces settings, shouldShadow() picks up the new ranges.
+   */
+  void setData(std::shared_ptr<const Data> data);
+
+  /**
+   * Lock-free check of both ranges for the hot path: doesn't copy
+   * the Data pointer and only looks at the key hash if normalIndex
+   * is within index range.
+   */
+  template <class Request>
+  bool shouldShadow(size_t normalIndex, const Request& req) const {
+    auto indexRange = indexRange_.get();
+    if (normalIndex < (indexRange >> 32) ||
+        normalIndex >= (indexRange & 0xffffffff)) {
+      return false;
+    }
+    auto keyRange = keyHashRange_.get();
+    return matchKeyHash(req.routingKeyHash(), keyRange >> 32,
+                        keyRange & 0xffffffff);
+  }
+
  private:
   AtomicSharedPtr<Data> data_;
-  ObservableRuntimeVars::CallbackHandle handle_;
-  void registerOnUpdateCallback(McrouterInstance* router);
+  /* Ranges from data_, updated from index_range_rv and
+     key_fraction_range_rv. Each is packed into one word as [start, end),
+     key fractions as a key hash range. */
+  RuntimeVar<uint64_t> indexRange_;
+  RuntimeVar<uint64_t> keyHashRange_;
+
+  static bool matchKeyHash(uint32_t routingKeyHash, uint32_t keyStart,
+                           uint32_t keyEnd);
+};
+
+enum request_entry_type_t {
+  request_type_request,
+  request_type_disconnect,
+  request_type_old_config,
+  request_type_router_shutdown,
+  request_type_stolen_request,
+  request_type_stolen_reply,
+};
+
+struct StolenRequest;
+
+/**
+ * A message sent to a proxy thread through proxy_t::messageQueue.
+ * The meaning of data depends on type.
+ */
+struct ProxyMessage {
+  request_entry_type_t type{request_type_request};
+  void* data{nullptr};
+  /* For ProxyLoopMonitor::queueWaitUs */
+  int64_t enqueuedUs{0};
+
+  ProxyMessage() = default;
+  ProxyMessage(request_entry_type_t t, void* d) noexcept
+      : type(t), data(d), enqueuedUs(nowUs()) {}
 };
 
 struct proxy_t {
@@ -107,53 +178,176 @@ struct proxy_t {
   /** Note: will go away once the router pointer above is guaranteed to exist */
   const McrouterOptions opts;
 
-  asox_queue_t request_queue{0};
+  std::unique_ptr<MessageQueue<ProxyMessage>> messageQueue;
   folly::EventBase* eventBase{nullptr};
 
+  /**
+   * Timer wheel for TKO probes of all destinations of this proxy
+   * (thousands of them may be probed at once when a rack goes down).
+   * Must outlive destinations.
+   */
+  folly::HHWheelTimer::UniquePtr probeTimer;
+
   std::unique_ptr<ProxyDestinationMap> destinationMap;
 
   // async spool related
   std::shared_ptr<folly::File> async_fd{nullptr};
   time_t async_spool_time{0};
+  AsynclogBatch async_batch;
+
+  /**
+   * Only written by the proxy thread (except for the few *_safe counters),
+   * so the hot path never takes a lock. Other threads only read these.
+   * Kept on separate cache lines from the rate window below, which is
+   * written by the stat updater thread.
+   */
+  stat_t FOLLY_ALIGN_TO_AVOID_FALSE_SHARING stats[num_stats];
+
+  /** Samples tracked by durationUs and waitingUs */
+  static constexpr size_t kLatencyWindow{64};
+  DecayingHistogram durationUs{kLatencyWindow};
+
+  /**
+   * Request latencies through ProxyRoute, keyed by routing prefix.
+   * Written by the proxy thread only.
+   */
+  LatencyHistogramMap routeLatencies;
+
+  /**
+   * Event loop lag and queueing latencies of this proxy's thread.
+   */
+  ProxyLoopMonitor loopMonitor{*this};
+
+  /**
+   * Replies, refusals and latencies of requests to each pool,
+   * indexed by ClientPool::statsId(). Written by the proxy thread only.
+   */
+  PoolStats poolStats;
+
+  /**
+   * Key and value sizes of requests to destinations by operation.
+   * Written by the proxy thread only.
+   */
+  OpSizeStats opSizes;
+
+  /**
+   * CPU cost of routes for sampled requests, see RouteCpuProfiler.
+   * Written by the proxy thread only.
+   */
+  RouteCpuProfiler routeCpu{opts.fibers_stack_size};
+
+  /**
+   * Most requested keys, sampled in processRequest.
+   * Written by the proxy thread only.
+   */
+  HotKeyTracker hotKeys;
+
+  /**
+   * Costliest senders (McrouterClients) and client connections, sampled
+   * in ProxyRequestContext::sendReply() and by the server respectively.
+   * Written by the proxy thread only.
+   */
+  TopClientTracker topSenders;
+  TopClientTracker topConnections;
+
+  /**
+   * Phase latencies of sampled requests, see RequestPhaseStats.
+   * Written by the proxy thread only.
+   */
+  RequestPhaseStats requestPhases;
+
+  /**
+   * Last requests slower than opts.slow_request_threshold_us.
+   * Written by the proxy thread only.
+   */
+  SlowRequestLog slowRequests;
+
+  /**
+   * Shadow requests sent by ShadowRoute that didn't complete yet,
+   * limited by opts.proxy_max_shadow_requests.
+   * Written by the proxy thread only.
+   */
+  size_t numShadowRequests{0};
+
+  /**
+   * Fraction of shadow requests ShadowRoute should still send, in (0, 1].
+   * Scaled down proportionally once the throttled requests or the wait of
+   * the oldest of them exceed opts.proxy_shadow_shed_waiting_requests or
+   * opts.proxy_shadow_shed_queue_delay_us. Proxy thread only.
+   */
+  double shadowFraction() const;
+
+  /**
+   * Samples requests into the traffic capture file.
+   * nullptr unless opts.traffic_capture_file is set.
+   */
+  std::unique_ptr<TrafficCaptureWriter> trafficCapture;
 
-  std::mutex stats_lock;
-  stat_t stats[num_stats];
+  /**
+   * Replies tapped for the debug tap client, see DebugTapServer.
+   * Inactive unless a client is connected to opts.debug_tap_socket.
+   */
+  DebugTapRing debugTap;
 
-  static constexpr double kExponentialFactor{1.0 / 64.0};
-  ExponentialSmoothData durationUs{kExponentialFactor};
+  /**
+   * Adapts the inflight requests limit to observed latencies.
+   * nullptr unless proxy_adaptive_inflight_limit is set.
+   */
+  std::unique_ptr<ConcurrencyLimiter> inflightLimiter;
 
-  // we are wasting some memory here to get faster mapping from stat name to
-  // stats_bin[] and stats_num_within_window[] entry. i.e., the stats_bin[]
-  // and stats_num_within_window[] entry for non-rate stat are not in use.
+  /**
+   * Shared by the connections of all destinations of this proxy: limits
+   * connects in progress to opts.proxy_max_concurrent_connects and keeps
+   * connect stats.
+   */
+  std::shared_ptr<ConnectThrottle> connectThrottle;
+
+  /** Time spent by requests in the rate limiting queue */
+  DecayingHistogram waitingUs{kLatencyWindow};
 
   // we maintain some information for calculating average rate in the past
-  // MOVING_AVERAGE_WINDOW_SIZE_IN_SECOND seconds for every rate stat.
+  // MOVING_AVERAGE_WINDOW_SIZE_IN_SECOND seconds for every rate stat,
+  // indexed by rate_stat_name_t (see stats_rate_index()).
 
   /*
-   * stats_bin[stat_name] is a circular array associated with stat "stat_name",
-   * where each element (stats_bin[stat_name][idx]) is the count of "stat_name"
-   * in the "idx"th time bin. The updater thread updates these circular arrays
-   * once every MOVING_AVERAGE_WINDOW_SIZE_IN_SECOND second by setting the
-   * oldest time bin to stats[stat_name], and then reset stats[stat_name] to 0.
-   */
-  uint64_t stats_bin[num_stats][MOVING_AVERAGE_WINDOW_SIZE_IN_SECOND /
-                                MOVING_AVERAGE_BIN_SIZE_IN_SECOND];
+   * stats_bin[rate_stat] is a circular array associated with a rate stat,
+   * where each element (stats_bin[rate_stat][idx]) is the count of the stat
+   * in the "idx"th time bin. The updater thread updates these circular
+   * arrays once every MOVING_AVERAGE_BIN_SIZE_IN_SECOND second by setting
+   * the oldest time bin to the growth of the stat since the previous
+   * update (saturated to 32 bits). stats[] itself is never modified by
+   * the updater.
+   */
+  uint32_t FOLLY_ALIGN_TO_AVOID_FALSE_SHARING
+    stats_bin[num_rate_stats][MOVING_AVERAGE_WINDOW_SIZE_IN_SECOND /
+                              MOVING_AVERAGE_BIN_SIZE_IN_SECOND];
+
   /*
-   * stats_num_within_window[stat_name] contains the count of stat "stat_name"
-   * in the past MOVING_AVERAGE_WINDOW_SIZE_IN_SECOND seconds. this array is
-   * also updated by the updater thread once every
-   * MOVING_AVERAGE_WINDOW_SIZE_IN_SECOND seconds
+   * Value of the rate stat as of the last update of stats_bin.
    */
-  uint64_t stats_num_within_window[num_stats];
+  uint64_t stats_last_value[num_rate_stats];
+  /*
+   * stats_num_within_window[rate_stat][window] contains the count of
+   * the stat in the bins of rate_window_t window, kept up to date
+   * incrementally by the updater thread.
+   */
+  uint64_t stats_num_within_window[num_rate_stats][num_rate_windows];
 
   /*
    * the number of bins currently used, which is initially set to 0, and is
-   * increased by 1 every MOVING_AVERAGE_WINDOW_SIZE_IN_SECOND seconds.
+   * increased by 1 every MOVING_AVERAGE_BIN_SIZE_IN_SECOND seconds.
    * num_bins_used is at most MOVING_AVERAGE_WINDOW_SIZE_IN_SECOND /
    * MOVING_AVERAGE_BIN_SIZE_IN_SECOND
    */
   int num_bins_used{0};
 
+  /*
+   * Sequence counter guarding stats_bin, stats_num_within_window and
+   * num_bins_used: odd while the updater thread is modifying them.
+   * Readers use stats_window_read() and retry instead of locking.
+   */
+  std::atomic<uint64_t> stats_window_seq{0};
+
   std::mt19937 randomGenerator;
 
   /**
@@ -191,6 +385,34 @@ struct proxy_t {
   std::shared_ptr<ProxyConfigIf> swapConfig(
     std::shared_ptr<ProxyConfigIf> newConfig);
 
+  /**
+   * Config for the request path. Must be called from the proxy thread.
+   *
+   * Doesn't take the config lock: the proxy thread keeps its own copy
+   * of the config pointer, refreshed in onConfigSwapped(). An old config
+   * is thus reclaimed only after the proxy thread processed the message
+   * proxy_config_swap() sends, and all requests holding it completed.
+   */
+  const std::shared_ptr<ProxyConfigIf>& getConfigForProxyThread();
+
+  /**
+   * Called on the proxy thread when it gets the old config after a swap.
+   */
+  void onConfigSwapped();
+
+  /**
+   * Thread-safe: enqueue a message for this proxy's thread.
+   * Blocks if the message queue is full, so it must not be called from
+   * a proxy thread (see trySendMessage()).
+   */
+  void sendMessage(request_entry_type_t type, void* data);
+
+  /**
+   * Thread-safe: same as sendMessage(), but fails instead of blocking.
+   * @return  false if the message queue is full; data is not taken then.
+   */
+  bool trySendMessage(request_entry_type_t type, void* data);
+
   /** Queue up and route the new incoming request */
   void dispatchRequest(std::unique_ptr<ProxyRequestContext> preq);
 
@@ -200,11 +422,66 @@ struct proxy_t {
    */
   void attachEventBase(folly::EventBase* eventBase);
 
+  /** Adds a latency sample to durationUs and inflightLimiter */
+  void onRequestLatency(int64_t latencyUs);
+
+  /**
+   * Requests routing and waiting in this proxy, published for siblings
+   * choosing where to hand over requests (opts.proxy_steal_threshold).
+   * Thread safe, approximate.
+   */
+  size_t load() const {
+    return load_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Requests routing and waiting in this proxy, exact but proxy thread only
+   * (see load()).
+   */
+  size_t queueDepth() const {
+    return numRequestsProcessing_ + numWaitingRequests();
+  }
+
+  /**
+   * Estimated bytes of requests throttled in this proxy (request contexts,
+   * keys and values). Thread safe.
+   */
+  size_t waitingRequestBytes() const {
+    return waitingRequestBytes_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Routes a request handed over by the overloaded sibling proxy that
+   * received it, and sends the reply back to that proxy.
+   * Takes ownership of stolen.
+   */
+  void routeStolenRequest(StolenRequest* stolen);
+
+  /**
+   * Replies to a request of this proxy that a sibling routed.
+   * Takes ownership of stolen.
+   */
+  void onStolenReply(StolenRequest* stolen);
+
+  /**
+   * Called by the thread running this proxy once it stops looping for
+   * new work: siblings can't hand requests over to us anymore, and we
+   * don't hand ours over.
+   *
+   * Keep running the event base while this returns true: some requests
+   * handed over to us or by us are not replied to yet. A sibling must
+   * not be destroyed until it's done too, see McrouterInstance::tearDown.
+   */
+  bool finishStolenRequests();
+
  private:
   /** Read/write lock for config pointer */
   SFRLock configLock_;
   std::shared_ptr<ProxyConfigIf> config_;
 
+  /** Copy of config_ for the proxy thread only, see getConfigForProxyThread */
+  std::shared_ptr<ProxyConfigIf> proxyThreadConfig_;
+
   pthread_t awriterThreadHandle_{0};
   void* awriterThreadStack_{nullptr};
 
@@ -227,6 +504,12 @@ struct proxy_t {
   /** Number of requests processing */
   size_t numRequestsProcessing_{0};
 
+  /** Current limit on numRequestsProcessing_, 0 means no limit */
+  size_t maxInflightRequests() const;
+
+  /** True if opts.proxy_max_inflight_requests is set and reached */
+  bool atInflightLimit() const;
+
   /**
    * We use this wrapper instead of putting 'hook' inside ProxyRequestContext
    * directly due to an include cycle:
@@ -238,21 +521,152 @@ struct proxy_t {
     using Queue = UniqueIntrusiveList<WaitingRequest,
                                       &WaitingRequest::hook>;
     std::unique_ptr<ProxyRequestContext> request;
+    int64_t enqueuedTimeUs;
+    /* Accounted in proxy.waitingRequestBytes_ */
+    proxy_t& proxy;
+    size_t bytes;
     explicit WaitingRequest(std::unique_ptr<ProxyRequestContext> r);
+    ~WaitingRequest();
   };
 
-  /** Queue of requests we didn't start processing yet */
+  /**
+   * Queues of requests we didn't start processing yet.
+   * Requests for opts.proxy_priority_routing_prefixes go to the high
+   * priority queue, which is always drained first.
+   */
   WaitingRequest::Queue waitingRequests_;
+  WaitingRequest::Queue highPriWaitingRequests_;
+  /* Estimated bytes held by both queues, see waitingRequestBytes() */
+  std::atomic<size_t> waitingRequestBytes_{0};
+
+  /** Parsed opts.proxy_priority_routing_prefixes */
+  std::vector<std::string> priorityRoutingPrefixes_;
+
+  /**
+   * Routing prefix of opts.proxy_tenant_quotas, with its own queue of
+   * waiting requests and limits.
+   */
+  struct Tenant {
+    std::string routingPrefix;
+    size_t weight{1};
+    /* 0 means no limit */
+    size_t maxInflight{0};
+    size_t maxQueued{0};
+    /* Requests of this tenant we started processing */
+    size_t inflight{0};
+    /* Stride scheduling pass: the queue with the lowest goes next */
+    uint64_t pass{0};
+    WaitingRequest::Queue waitingRequests;
+  };
+
+  std::vector<std::unique_ptr<Tenant>> tenants_;
+  size_t numTenantWaitingRequests_{0};
+  /* Stride scheduling pass of waitingRequests_ (weight 1), and the pass
+     of the last queue scheduled */
+  uint64_t defaultPass_{0};
+  uint64_t currentPass_{0};
+
+  /** Parses opts.proxy_tenant_quotas, skipping invalid entries */
+  void initTenants();
+
+  /** "/region/cluster/" of the request, or opts.default_route */
+  folly::StringPiece routingPrefixOf(const ProxyRequestContext& preq) const;
+
+  bool isHighPriority(const ProxyRequestContext& preq) const;
+
+  /** @return index in tenants_ of the request's tenant, -1 if none */
+  int tenantOf(const ProxyRequestContext& preq) const;
+
+  size_t numWaitingRequests() const {
+    return waitingRequests_.size() + highPriWaitingRequests_.size() +
+      numTenantWaitingRequests_;
+  }
 
   /** If true, we can't start processing this request right now */
   bool rateLimited(const ProxyRequestContext& preq) const;
 
+  /**
+   * Queues a rate limited request: in its tenant's queue if it has one,
+   * else in the high priority or the default queue.
+   * @return false if the queue is full and the request was failed
+   */
+  bool enqueueWaitingRequest(std::unique_ptr<ProxyRequestContext> preq);
+
+  /**
+   * Next request to route: high priority ones first, then from the
+   * tenants' queues and the default one by weight. Tenants with
+   * max_inflight requests processing are skipped.
+   * @return nullptr if only such tenants have requests waiting
+   */
+  std::unique_ptr<WaitingRequest> popWaitingRequest();
+
   /** Will let through requests from the above queue if we have capacity */
   void pump();
 
+  /** See load(); only updated if opts.proxy_steal_threshold is set */
+  std::atomic<size_t> FOLLY_ALIGN_TO_AVOID_FALSE_SHARING load_{0};
+
+  void publishLoad() {
+    if (opts.proxy_steal_threshold > 0) {
+      load_.store(numRequestsProcessing_ + numWaitingRequests(),
+                  std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * While more than opts.proxy_steal_threshold requests are waiting,
+   * hands the oldest ones over to the least loaded sibling proxy, as long
+   * as it has less than opts.proxy_steal_threshold requests itself.
+   * High priority requests are always routed here.
+   */
+  void handOverWaitingRequests();
+
+  /** enqueueReply of requests routed for a sibling */
+  static void sendStolenReply(ProxyRequestContext& preq);
+
+  /**
+   * Requests siblings handed over to us whose reply wasn't sent yet,
+   * and kStolenRequestsClosed once we stopped accepting new ones.
+   * Siblings only add to it with reserveStolenRequest().
+   */
+  static constexpr size_t kStolenRequestsClosed =
+    size_t(1) << (sizeof(size_t) * 8 - 1);
+  std::atomic<size_t> stolenRequestsIn_{kStolenRequestsClosed};
+
+  /* Requests we handed over to siblings and didn't get a reply for */
+  size_t stolenRequestsOut_{0};
+
+  /**
+   * Replies of stolen requests that didn't fit in the queue of the proxy
+   * that received them, retried from stolenReplyRetry_: proxies never
+   * block on each other's queues.
+   */
+  std::vector<StolenRequest*> stolenRepliesToSend_;
+  class StolenReplyRetry;
+  std::unique_ptr<StolenReplyRetry> stolenReplyRetry_;
+
+  bool acceptsStolenRequests() const {
+    return !(stolenRequestsIn_.load() & kStolenRequestsClosed);
+  }
+
+  /**
+   * Called by a sibling before it hands a request over to us.
+   * @return  false if we don't accept stolen requests (anymore).
+   */
+  bool reserveStolenRequest();
+
+  /** Sends as many of stolenRepliesToSend_ as fit, schedules a retry */
+  void sendStolenReplies();
+
   /** Called once after a valid eventBase has been provided */
   void onEventBaseAttached();
 
+  /**
+   * Allocates opts.fibers_pool_prefill fibers and touches the first pages
+   * of their stacks, so that they are ready in the FiberManager's pool.
+   */
+  void prefillFibersPool();
+
   friend class ProxyRequestContext;
 };
 
@@ -264,13 +678,6 @@ struct old_config_req_t {
   std::shared_ptr<ProxyConfigIf> config_;
 };
 
-enum request_entry_type_t {
-  request_type_request,
-  request_type_disconnect,
-  request_type_old_config,
-  request_type_router_shutdown,
-};
-
 void proxy_config_swap(proxy_t* proxy,
                        std::shared_ptr<ProxyConfig> config);
 
@@ -11,6 +11,7 @@
 
 #include "mcrouter/async.h"
 #include "mcrouter/awriter.h"
+#include "mcrouter/ClientPool.h"
 #include "mcrouter/config-impl.h"
 #include "mcrouter/lib/McOperationTraits.h"
 #include "mcrouter/lib/Operation.h"
@@ -29,7 +30,7 @@ namespace facebook { namespace memcache { namespace mcrouter {
  */
 class AsynclogRoute {
  public:
-  using ContextPtr = std::shared_ptr<ProxyRequestContext>;
+  using ContextPtr = ProxyRequestContext::Ptr;
 
   std::string routeName() const { return "asynclog:" + asynclogName_; }
 
@@ -58,7 +59,7 @@ class AsynclogRoute {
     if (!dest) {
       return reply;
     }
-    folly::StringPiece key = dest->keep_routing_prefix ?
+    folly::StringPiece key = dest->pool.keepRoutingPrefix() ?
       req.fullKey() :
       req.keyWithoutRoute();
     folly::StringPiece asynclogName = asynclogName_;
@@ -67,8 +68,8 @@ class AsynclogRoute {
     folly::fibers::Baton b;
     auto res = proxy->router->asyncWriter().run(
       [&b, proxy, &dest, key, asynclogName] () {
-        asynclog_delete(proxy, dest, key, asynclogName);
-        b.post();
+        asynclog_delete(proxy, dest, key, asynclogName,
+                        [&b](bool) { b.post(); });
       }
     );
     if (!res) {
@@ -9,7 +9,12 @@
  */
 #pragma once
 
+#include <algorithm>
+#include <functional>
+#include <unordered_set>
+
 #include <folly/io/IOBuf.h>
+#include <folly/Optional.h>
 #include <folly/experimental/fibers/FiberManager.h>
 #include <folly/experimental/fibers/WhenN.h>
 
@@ -27,6 +32,8 @@ template <class Operation, class Request>
 typename ReplyType<Operation, Request>::type BigValueRoute::route(
     const Request& req, Operation, const ContextPtr& ctx,
     typename GetLike<Operation>::Type) const {
+  /* The value is assembled from chunks, none of them is the reply */
+  ctx->disableReplyStream();
   auto initialReply = ch_->route(req, Operation(), ctx);
   if (!initialReply.isHit() ||
       !(initialReply.flags() & MC_MSG_FLAG_BIG_VALUE)) {
@@ -40,20 +47,15 @@ typename ReplyType<Operation, Request>::type BigValueRoute::route(
     return Reply(DefaultReply, Operation());
   }
 
-  auto reqs = chunkGetRequests(req, chunks_info, Operation());
-  std::vector<std::function<Reply()>> fs;
-  fs.reserve(reqs.size());
-
-  auto& target = *ch_;
+  auto reqs = chunkGetRequests(req, chunks_info, Operation(),
+                               requestArena(ctx));
+  std::vector<const Request*> batch;
+  batch.reserve(reqs.size());
   for (const auto& req_b : reqs) {
-    fs.push_back(
-      [&target, &req_b, &ctx]() {
-        return target.route(req_b, ChunkGetOP(), ctx);
-      }
-    );
+    batch.push_back(&req_b);
   }
 
-  auto replies = folly::fibers::whenAll(fs.begin(), fs.end());
+  auto replies = ch_->routeBatch(batch, ChunkGetOP(), ctx);
   return mergeChunkGetReplies(
     replies.begin(), replies.end(), std::move(initialReply));
 }
@@ -68,20 +70,12 @@ typename ReplyType<Operation, Request>::type BigValueRoute::route(
     return ch_->route(req, Operation(), ctx);
   }
 
-  auto reqs_info_pair = chunkUpdateRequests(req, Operation());
-  std::vector<std::function<Reply()>> fs;
-  fs.reserve(reqs_info_pair.first.size());
-
-  auto& target = *ch_;
-  for (const auto& req_b : reqs_info_pair.first) {
-    fs.push_back(
-      [&target, &req_b, &ctx]() {
-        return target.route(req_b, ChunkUpdateOP(), ctx);
-      }
-    );
-  }
-
-  auto replies = folly::fibers::whenAll(fs.begin(), fs.end());
+  auto arena = requestArena(ctx);
+  auto touch = makeArenaVector<bool>(arena);
+  auto reqs_info_pair = options_.contentChunking_ ?
+    contentChunkUpdateRequests(req, Operation(), ctx, touch) :
+    chunkUpdateRequests(req, Operation(), arena);
+  auto replies = routeChunkUpdates(reqs_info_pair.first, touch, ctx);
 
   // reply for all chunk update requests
   auto reducedReply = Reply::reduce(replies.begin(), replies.end());
@@ -104,17 +98,66 @@ typename ReplyType<Operation, Request>::type BigValueRoute::route(
   return ch_->route(req, Operation(), ctx);
 }
 
+template <class Request>
+ArenaVector<typename ReplyType<BigValueRoute::ChunkUpdateOP, Request>::type>
+BigValueRoute::routeChunkUpdates(const ArenaVector<Request>& reqs,
+                                 const ArenaVector<bool>& touch,
+                                 const ContextPtr& ctx) const {
+  typedef typename ReplyType<ChunkUpdateOP, Request>::type Reply;
+
+  size_t numWorkers = reqs.size();
+  if (options_.maxInflightChunks_ != 0) {
+    numWorkers = std::min(numWorkers, options_.maxInflightChunks_);
+  }
+
+  // Each worker sends the next unsent chunk as soon as its previous one
+  // completes, so at most numWorkers chunks are in flight.
+  auto arena = requestArena(ctx);
+  auto results = makeArenaVector<folly::Optional<Reply>>(arena);
+  results.resize(reqs.size());
+  size_t next = 0;
+  auto& target = *ch_;
+  auto fs = makeArenaVector<std::function<void()>>(arena, numWorkers);
+  for (size_t i = 0; i < numWorkers; ++i) {
+    fs.push_back(
+      [&target, &reqs, &touch, &ctx, &results, &next]() {
+        while (next < reqs.size()) {
+          auto id = next++;
+          if (!touch.empty() && touch[id]) {
+            // Stored by a previous version, unless it's gone since
+            Request touch_req(reqs[id].fullKey());
+            touch_req.setExptime(reqs[id].exptime());
+            auto reply = target.route(touch_req, ChunkTouchOP(), ctx);
+            if (reply.result() == mc_res_touched) {
+              results[id] = Reply(mc_res_stored);
+              continue;
+            }
+          }
+          results[id] = target.route(reqs[id], ChunkUpdateOP(), ctx);
+        }
+      }
+    );
+  }
+  folly::fibers::forEach(fs.begin(), fs.end(), [] (size_t id) {});
+
+  auto replies = makeArenaVector<Reply>(arena, results.size());
+  for (auto& result : results) {
+    replies.push_back(std::move(result.value()));
+  }
+  return replies;
+}
+
 template <class Operation, class Request>
-std::pair<std::vector<Request>,
+std::pair<ArenaVector<Request>,
   typename BigValueRoute::ChunksInfo>
-BigValueRoute::chunkUpdateRequests(const Request& req, Operation) const {
+BigValueRoute::chunkUpdateRequests(const Request& req, Operation,
+                                   Arena* arena) const {
   int num_chunks =
     (req.value().length() + options_.threshold_ - 1) / options_.threshold_;
   ChunksInfo info(num_chunks);
 
   // Type for Request and ChunkUpdateRequest is same for now.
-  std::vector<Request> big_set_reqs;
-  big_set_reqs.reserve(num_chunks);
+  auto big_set_reqs = makeArenaVector<Request>(arena, num_chunks);
 
   auto base_key = req.fullKey();
   size_t i_pos = 0;
@@ -134,16 +177,68 @@ BigValueRoute::chunkUpdateRequests(const Request& req, Operation) const {
   return std::make_pair(std::move(big_set_reqs), info);
 }
 
+template <class Operation, class Request>
+std::pair<ArenaVector<Request>,
+  typename BigValueRoute::ChunksInfo>
+BigValueRoute::contentChunkUpdateRequests(const Request& req, Operation,
+                                          const ContextPtr& ctx,
+                                          ArenaVector<bool>& touch) const {
+  auto base_key = req.fullKey();
+  auto chunks = contentChunks(req.value());
+
+  // Chunks listed by the index of the previous value
+  std::unordered_set<uint64_t> previous;
+  auto prev_reply = ch_->route(Request(base_key), ChunkGetOP(), ctx);
+  if (prev_reply.isHit() && (prev_reply.flags() & MC_MSG_FLAG_BIG_VALUE)) {
+    auto buf = prev_reply.value().clone();
+    ChunksInfo prev_info(coalesceAndGetRange(buf));
+    if (prev_info.valid()) {
+      previous.insert(prev_info.chunkHashes().begin(),
+                      prev_info.chunkHashes().end());
+    }
+  }
+
+  std::vector<uint64_t> hashes;
+  hashes.reserve(chunks.size());
+  // A chunk repeated within the value is only stored once
+  std::unordered_set<uint64_t> seen;
+  auto big_set_reqs = makeArenaVector<Request>(requestArena(ctx),
+                                               chunks.size());
+  for (const auto& chunk : chunks) {
+    hashes.push_back(chunk.hash);
+    if (!seen.insert(chunk.hash).second) {
+      continue;
+    }
+    folly::IOBuf chunk_value;
+    req.value().cloneInto(chunk_value);
+    chunk_value.trimStart(chunk.offset);
+    chunk_value.trimEnd(chunk_value.length() - chunk.length);
+    Request req_big(createContentChunkKey(base_key, chunk.hash));
+    req_big.setValue(std::move(chunk_value));
+    req_big.setExptime(req.exptime());
+    big_set_reqs.push_back(std::move(req_big));
+    touch.push_back(previous.count(chunk.hash) != 0);
+  }
+
+  return std::make_pair(std::move(big_set_reqs),
+                        ChunksInfo(std::move(hashes)));
+}
+
 template<class Operation, class Request>
-std::vector<Request>
+ArenaVector<Request>
 BigValueRoute::chunkGetRequests(const Request& req,
                                 const ChunksInfo& info,
-                                Operation) const {
+                                Operation, Arena* arena) const {
   // Type for Request and ChunkGetRequest is same for now.
-  std::vector<Request> big_get_reqs;
-  big_get_reqs.reserve(info.numChunks());
+  auto big_get_reqs = makeArenaVector<Request>(arena, info.numChunks());
 
   auto base_key = req.fullKey();
+  if (!info.chunkHashes().empty()) {
+    for (auto hash : info.chunkHashes()) {
+      big_get_reqs.emplace_back(createContentChunkKey(base_key, hash));
+    }
+    return big_get_reqs;
+  }
   for (int i = 0; i < info.numChunks(); i++) {
     // override key with chunk keys
     big_get_reqs.emplace_back(createChunkKey(base_key, i, info.randSuffix()));
@@ -163,13 +258,20 @@ Reply BigValueRoute::mergeChunkGetReplies(
       return Reply(reduced_reply_it->result());
   }
 
-  std::vector<std::unique_ptr<folly::IOBuf>> data_vec;
+  // Chain the chunk buffers, the value is never copied
+  folly::IOBuf value;
+  bool first = true;
   while (begin != end) {
-    data_vec.push_back(begin->value().clone());
+    if (first) {
+      begin->value().cloneInto(value);
+      first = false;
+    } else {
+      value.prependChain(begin->value().clone());
+    }
     ++begin;
   }
 
-  initial_reply.setValue(concatAll(data_vec.begin(), data_vec.end()));
+  initial_reply.setValue(std::move(value));
   initial_reply.setResult(reduced_reply_it->result());
   return std::move(initial_reply);
 }
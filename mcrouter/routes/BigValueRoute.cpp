@@ -9,12 +9,71 @@
  */
 #include "BigValueRoute.h"
 
+#include <algorithm>
+#include <string>
+
+#include <folly/Conv.h>
+#include <folly/SpookyHashV2.h>
+#include <folly/String.h>
+
 namespace facebook { namespace memcache { namespace mcrouter {
 
+namespace {
+
+/* Random values of the gear rolling hash, one per byte value */
+struct GearTable {
+  uint64_t values[256];
+
+  GearTable() {
+    // splitmix64 with a fixed seed: chunk boundaries (and so chunk keys)
+    // must be the same in every process
+    uint64_t x = 0;
+    for (auto& v : values) {
+      x += 0x9e3779b97f4a7c15ULL;
+      uint64_t z = x;
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+      v = z ^ (z >> 31);
+    }
+  }
+};
+
+const GearTable& gearTable() {
+  static const GearTable table;
+  return table;
+}
+
+bool parseHex(folly::StringPiece sp, uint64_t& value) {
+  if (sp.empty() || sp.size() > 16) {
+    return false;
+  }
+  value = 0;
+  for (auto c : sp) {
+    uint64_t digit;
+    if (c >= '0' && c <= '9') {
+      digit = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      digit = c - 'a' + 10;
+    } else {
+      return false;
+    }
+    value = (value << 4) | digit;
+  }
+  return true;
+}
+
+}  // anonymous namespace
+
 BigValueRoute::ChunksInfo::ChunksInfo(
     folly::StringPiece reply_value)
   : infoVersion_(1),
+    numChunks_(0),
+    randSuffix_(0),
     valid_(true) {
+  if (reply_value.startsWith("2-")) {
+    parseChunkHashes(reply_value);
+    return;
+  }
   // Verify that reply_value is of the form version-numchunks-randSuffix,
   // where version, numchunks and randsuffix should be numeric
   int version, chars_read;
@@ -30,7 +89,57 @@ BigValueRoute::ChunksInfo::ChunksInfo(uint32_t num_chunks)
     randSuffix_(rand()),
     valid_(true) {}
 
+BigValueRoute::ChunksInfo::ChunksInfo(std::vector<uint64_t> chunk_hashes)
+  : infoVersion_(2),
+    numChunks_(chunk_hashes.size()),
+    randSuffix_(0),
+    chunkHashes_(std::move(chunk_hashes)),
+    valid_(true) {}
+
+void BigValueRoute::ChunksInfo::parseChunkHashes(
+    folly::StringPiece reply_value) {
+  // 2-numchunks-hash,hash,... with hashes in hex
+  infoVersion_ = 2;
+  folly::StringPiece version, num_chunks, hashes;
+  if (!folly::split('-', reply_value, version, num_chunks, hashes)) {
+    valid_ = false;
+    return;
+  }
+  try {
+    numChunks_ = folly::to<uint32_t>(num_chunks);
+  } catch (const std::range_error& e) {
+    valid_ = false;
+    return;
+  }
+  std::vector<folly::StringPiece> parts;
+  folly::split(',', hashes, parts);
+  if (parts.size() != numChunks_) {
+    valid_ = false;
+    return;
+  }
+  chunkHashes_.reserve(parts.size());
+  for (auto part : parts) {
+    uint64_t hash;
+    if (!parseHex(part, hash)) {
+      valid_ = false;
+      chunkHashes_.clear();
+      return;
+    }
+    chunkHashes_.push_back(hash);
+  }
+}
+
 folly::IOBuf BigValueRoute::ChunksInfo::toStringType() const {
+  if (infoVersion_ == 2) {
+    std::string info = folly::format("{}-{}-", infoVersion_, numChunks_).str();
+    for (size_t i = 0; i < chunkHashes_.size(); ++i) {
+      if (i > 0) {
+        info.push_back(',');
+      }
+      folly::format(&info, "{:x}", chunkHashes_[i]);
+    }
+    return folly::IOBuf(folly::IOBuf::COPY_BUFFER, info);
+  }
   return folly::IOBuf(
     folly::IOBuf::COPY_BUFFER,
     folly::format("{}-{}-{}", infoVersion_, numChunks_, randSuffix_).str()
@@ -45,6 +154,10 @@ uint32_t BigValueRoute::ChunksInfo::randSuffix() const {
   return randSuffix_;
 }
 
+const std::vector<uint64_t>& BigValueRoute::ChunksInfo::chunkHashes() const {
+  return chunkHashes_;
+}
+
 bool BigValueRoute::ChunksInfo::valid() const {
   return valid_;
 }
@@ -67,6 +180,65 @@ folly::IOBuf BigValueRoute::createChunkKey(
   );
 }
 
+folly::IOBuf BigValueRoute::createContentChunkKey(
+    folly::StringPiece base_key,
+    uint64_t hash) const {
+
+  return folly::IOBuf(
+    folly::IOBuf::COPY_BUFFER,
+    folly::format("{}|#|{:016x}", base_key, hash).str()
+  );
+}
+
+std::vector<BigValueRoute::ContentChunk>
+BigValueRoute::contentChunks(const folly::IOBuf& value) const {
+  const size_t maxSize = std::max<size_t>(options_.threshold_, 1);
+  const size_t minSize = std::max<size_t>(maxSize / 4, 1);
+  // Expect a boundary every ~minSize bytes past the minimum: cut where
+  // the top log2(minSize) bits of the rolling hash are clear
+  size_t bits = 0;
+  while ((size_t(2) << bits) <= minSize) {
+    ++bits;
+  }
+  const uint64_t mask = bits == 0 ? 0 : ~uint64_t(0) << (64 - bits);
+  const auto& gear = gearTable().values;
+
+  std::vector<ContentChunk> chunks;
+  chunks.reserve(value.computeChainDataLength() / minSize + 1);
+  folly::hash::SpookyHashV2 hasher;
+  hasher.Init(0, 0);
+  size_t offset = 0;
+  size_t length = 0;
+  uint64_t rolling = 0;
+  auto finishChunk = [&]() {
+    uint64_t hash1, hash2;
+    hasher.Final(&hash1, &hash2);
+    chunks.push_back(ContentChunk{offset, length, hash1});
+    offset += length;
+    length = 0;
+    rolling = 0;
+    hasher.Init(0, 0);
+  };
+
+  for (auto range : value) {
+    auto pieceStart = range.begin();
+    for (auto p = range.begin(); p != range.end(); ++p) {
+      rolling = (rolling << 1) + gear[*p];
+      ++length;
+      if (length >= maxSize || (length >= minSize && (rolling & mask) == 0)) {
+        hasher.Update(pieceStart, p + 1 - pieceStart);
+        pieceStart = p + 1;
+        finishChunk();
+      }
+    }
+    hasher.Update(pieceStart, range.end() - pieceStart);
+  }
+  if (length > 0) {
+    finishChunk();
+  }
+  return chunks;
+}
+
 McrouterRouteHandlePtr makeBigValueRoute(McrouterRouteHandlePtr rh,
                                          BigValueRouteOptions options) {
   return std::make_shared<McrouterRouteHandle<BigValueRoute>>(
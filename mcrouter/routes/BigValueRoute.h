@@ -15,6 +15,7 @@
 
 #include "mcrouter/lib/McOperation.h"
 #include "mcrouter/lib/OperationTraits.h"
+#include "mcrouter/lib/RequestArena.h"
 #include "mcrouter/ProxyRequestContext.h"
 #include "mcrouter/routes/BigValueRouteIf.h"
 #include "mcrouter/routes/McrouterRouteHandle.h"
@@ -43,11 +44,19 @@ namespace facebook { namespace memcache { namespace mcrouter {
  * to child route handle and return reply. Else, return worse of the
  * replies for chunk updates
  *
+ * With contentChunking_, values are split where a rolling hash of the
+ * content says so (between threshold/4 and threshold bytes per chunk), so
+ * that an edit only changes the chunks around it. Chunk keys are derived
+ * from the chunk content hash and the index lists the hashes. An update
+ * first fetches the previous index: chunks it already lists are only
+ * touched with the new exptime (and set if they are gone), the others
+ * are set.
+ *
  * Default behavior for other type of operations
  */
 class BigValueRoute {
  public:
-  using ContextPtr = std::shared_ptr<ProxyRequestContext>;
+  using ContextPtr = ProxyRequestContext::Ptr;
 
   static std::string routeName() { return "big-value"; }
 
@@ -81,30 +90,67 @@ class BigValueRoute {
    public:
     explicit ChunksInfo(folly::StringPiece reply_value);
     explicit ChunksInfo(uint32_t num_chunks);
+    /* Content-defined chunks (version 2) */
+    explicit ChunksInfo(std::vector<uint64_t> chunk_hashes);
 
     folly::IOBuf toStringType() const;
     uint32_t numChunks() const;
     uint32_t randSuffix() const;
+    /* Content hashes of the chunks in order, empty unless version 2 */
+    const std::vector<uint64_t>& chunkHashes() const;
     bool valid() const;
 
    private:
-    const uint32_t infoVersion_;
+    uint32_t infoVersion_;
     uint32_t numChunks_;
     uint32_t randSuffix_;
+    std::vector<uint64_t> chunkHashes_;
     bool valid_;
+
+    void parseChunkHashes(folly::StringPiece reply_value);
+  };
+
+  struct ContentChunk {
+    size_t offset;
+    size_t length;
+    uint64_t hash;
   };
 
   typedef McOperation<mc_op_get> ChunkGetOP;
   typedef McOperation<mc_op_set> ChunkUpdateOP;
+  typedef McOperation<mc_op_touch> ChunkTouchOP;
 
+  /* Chunk requests and replies are allocated from the request's arena */
   template <class Operation, class Request>
-  std::pair<std::vector<Request>, ChunksInfo>
-  chunkUpdateRequests(const Request& req, Operation) const;
+  std::pair<ArenaVector<Request>, ChunksInfo>
+  chunkUpdateRequests(const Request& req, Operation, Arena* arena) const;
 
+  /**
+   * Content-defined chunk updates of req, one per distinct chunk.
+   * touch[i] is set for chunks listed by the index of the previous value.
+   */
   template <class Operation, class Request>
-  std::vector<Request> chunkGetRequests(const Request& req,
+  std::pair<ArenaVector<Request>, ChunksInfo>
+  contentChunkUpdateRequests(const Request& req, Operation,
+                             const ContextPtr& ctx,
+                             ArenaVector<bool>& touch) const;
+
+  /**
+   * Sends chunk updates to the child, at most maxInflightChunks_ at a time.
+   * Chunks with touch[i] set are touched first and only set if the touch
+   * doesn't find them.
+   * @return replies in the order of reqs.
+   */
+  template <class Request>
+  ArenaVector<typename ReplyType<ChunkUpdateOP, Request>::type>
+  routeChunkUpdates(const ArenaVector<Request>& reqs,
+                    const ArenaVector<bool>& touch,
+                    const ContextPtr& ctx) const;
+
+  template <class Operation, class Request>
+  ArenaVector<Request> chunkGetRequests(const Request& req,
                                         const ChunksInfo& info,
-                                        Operation) const;
+                                        Operation, Arena* arena) const;
 
   template <typename InputIterator, class Reply>
   Reply mergeChunkGetReplies(
@@ -112,6 +158,17 @@ class BigValueRoute {
 
   folly::IOBuf createChunkKey(
     folly::StringPiece key, uint32_t index, uint64_t suffix) const;
+
+  folly::IOBuf createContentChunkKey(
+    folly::StringPiece key, uint64_t hash) const;
+
+  /**
+   * Splits value at content-defined boundaries (gear rolling hash over
+   * the last 64 bytes), chunks are threshold/4 to threshold bytes long.
+   * Boundaries depend only on the bytes around them, and are the same
+   * in every process.
+   */
+  std::vector<ContentChunk> contentChunks(const folly::IOBuf& value) const;
 };
 
 }}} // facebook::memcache::mcrouter
@@ -12,10 +12,19 @@
 namespace facebook { namespace memcache { namespace mcrouter {
 
 struct BigValueRouteOptions {
-  explicit BigValueRouteOptions(size_t threshold) :
-    threshold_(threshold) {
+  explicit BigValueRouteOptions(size_t threshold,
+                                size_t maxInflightChunks = 0,
+                                bool contentChunking = false) :
+    threshold_(threshold),
+    maxInflightChunks_(maxInflightChunks),
+    contentChunking_(contentChunking) {
   }
   const size_t threshold_;
+  /* Chunk updates in flight for one request, 0 means no limit */
+  const size_t maxInflightChunks_;
+  /* Split values at content-defined boundaries into chunks keyed by
+     content hash, chunks of the previous version are not rewritten */
+  const bool contentChunking_;
 };
 
 }}}  // facebook::memcache::mcrouter
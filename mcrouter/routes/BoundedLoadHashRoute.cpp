@@ -0,0 +1,83 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "BoundedLoadHashRoute.h"
+
+#include <cmath>
+
+#include <folly/dynamic.h>
+
+#include "mcrouter/lib/fbi/cpp/util.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+template <class HashFunc>
+BoundedLoadHashRoute<HashFunc>::BoundedLoadHashRoute(
+    const folly::dynamic& json,
+    std::vector<McrouterRouteHandlePtr> children,
+    HashFunc hashFunc)
+    : hashRoute_(json, std::move(children), std::move(hashFunc)),
+      inflight_(hashRoute_.children().size()) {
+
+  auto jepsilon = json.get_ptr("bounded_load_epsilon");
+  checkLogic(jepsilon && jepsilon->isNumber(),
+             "HashRoute: bounded_load_epsilon is not a number");
+  epsilon_ = jepsilon->asDouble();
+  checkLogic(epsilon_ > 0, "HashRoute: bounded_load_epsilon should be > 0");
+}
+
+template <class HashFunc>
+size_t BoundedLoadHashRoute<HashFunc>::pickBounded(size_t hashed) const {
+  auto n = inflight_.size();
+  /* Children in flight total, including the new request, is always below
+     bound * n, so some child is under the bound */
+  auto bound = static_cast<size_t>(
+    std::ceil((1 + epsilon_) * (totalInflight_ + 1) / n));
+  auto i = hashed;
+  while (inflight_[i] >= bound) {
+    i = i + 1 == n ? 0 : i + 1;
+  }
+  return i;
+}
+
+template class BoundedLoadHashRoute<Ch3HashFunc>;
+template class BoundedLoadHashRoute<Crc32HashFunc>;
+template class BoundedLoadHashRoute<WeightedCh3HashFunc>;
+
+McrouterRouteHandlePtr makeBoundedLoadHashRoute(
+  const folly::dynamic& json,
+  std::vector<McrouterRouteHandlePtr> children,
+  Ch3HashFunc hashFunc) {
+
+  return std::make_shared<
+    McrouterRouteHandle<BoundedLoadHashRoute<Ch3HashFunc>>>(
+      json, std::move(children), std::move(hashFunc));
+}
+
+McrouterRouteHandlePtr makeBoundedLoadHashRoute(
+  const folly::dynamic& json,
+  std::vector<McrouterRouteHandlePtr> children,
+  Crc32HashFunc hashFunc) {
+
+  return std::make_shared<
+    McrouterRouteHandle<BoundedLoadHashRoute<Crc32HashFunc>>>(
+      json, std::move(children), std::move(hashFunc));
+}
+
+McrouterRouteHandlePtr makeBoundedLoadHashRoute(
+  const folly::dynamic& json,
+  std::vector<McrouterRouteHandlePtr> children,
+  const WeightedCh3HashFunc& hashFunc) {
+
+  return std::make_shared<
+    McrouterRouteHandle<BoundedLoadHashRoute<WeightedCh3HashFunc>>>(
+      json, std::move(children), hashFunc);
+}
+
+}}}  // facebook::memcache::mcrouter
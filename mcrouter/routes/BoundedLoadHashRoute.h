@@ -0,0 +1,149 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <folly/ScopeGuard.h>
+
+#include "mcrouter/lib/Ch3HashFunc.h"
+#include "mcrouter/lib/Crc32HashFunc.h"
+#include "mcrouter/lib/Operation.h"
+#include "mcrouter/lib/OperationTraits.h"
+#include "mcrouter/lib/routes/HashRoute.h"
+#include "mcrouter/lib/WeightedCh3HashFunc.h"
+#include "mcrouter/proxy.h"
+#include "mcrouter/ProxyRequestContext.h"
+#include "mcrouter/routes/McrouterRouteHandle.h"
+
+namespace folly {
+class dynamic;
+}
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * HashRoute with bounded loads ("Consistent Hashing with Bounded Loads",
+ * Mirrokni et al.): a get is only sent to the child its key hashes to if
+ * that child has fewer than ceil((1 + epsilon) * average) requests in
+ * flight, otherwise it goes to the next child (by index, wrapping around)
+ * that is under the bound. The same key is spilled the same way as long
+ * as loads don't change, so a hot shard's keys land on its neighbours
+ * instead of being spread over the pool.
+ *
+ * Only gets are moved, other operations always go to the hashed child
+ * (their load is counted too). Meant for read-through caches, where a
+ * spilled get at worst misses and fills the neighbour.
+ *
+ * Load is the number of requests this route has in flight to each child,
+ * i.e. of this proxy only, so no locking is needed.
+ *
+ * Config (HashRoute, or "hash" of a PoolRoute):
+ *   bounded_load_epsilon: double > 0, how far above the average a child
+ *                         may go before gets spill over
+ */
+template <class HashFunc>
+class BoundedLoadHashRoute {
+ public:
+  using ContextPtr = ProxyRequestContext::Ptr;
+
+  static std::string routeName() {
+    return "bounded-load-hash:" + HashFunc::type();
+  }
+
+  BoundedLoadHashRoute(const folly::dynamic& json,
+                       std::vector<McrouterRouteHandlePtr> children,
+                       HashFunc hashFunc);
+
+  template <class Operation, class Request>
+  std::vector<McrouterRouteHandlePtr> couldRouteTo(
+    const Request& req, Operation, const ContextPtr& ctx) const {
+
+    return hashRoute_.couldRouteTo(req, Operation(), ctx);
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation, const ContextPtr& ctx,
+    typename GetLike<Operation>::Type = 0) {
+
+    if (hashRoute_.children().empty()) {
+      return hashRoute_.route(req, Operation(), ctx);
+    }
+    auto hashed = hashRoute_.childIndex(req);
+    auto i = pickBounded(hashed);
+    if (i != hashed && ctx) {
+      stat_incr(ctx->proxy().stats, hash_bounded_load_spills_stat, 1);
+    }
+    return routeTo(i, req, Operation(), ctx);
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation, const ContextPtr& ctx,
+    OtherThanT(Operation, GetLike<>) = 0) {
+
+    if (hashRoute_.children().empty()) {
+      return hashRoute_.route(req, Operation(), ctx);
+    }
+    return routeTo(hashRoute_.childIndex(req), req, Operation(), ctx);
+  }
+
+  /**
+   * Number of requests currently in flight to the i-th child.
+   */
+  size_t inflight(size_t i) const {
+    return inflight_[i];
+  }
+
+ private:
+  HashRoute<McrouterRouteHandleIf, HashFunc> hashRoute_;
+  double epsilon_{0};
+  std::vector<size_t> inflight_;
+  size_t totalInflight_{0};
+
+  /**
+   * @return  first child from hashed on that is under the bound, counting
+   *          the request about to be sent.
+   */
+  size_t pickBounded(size_t hashed) const;
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type routeTo(
+    size_t i, const Request& req, Operation, const ContextPtr& ctx) {
+
+    ++inflight_[i];
+    ++totalInflight_;
+    auto inflightGuard = folly::makeGuard([this, i]() {
+      --inflight_[i];
+      --totalInflight_;
+    });
+    return hashRoute_.children()[i]->route(req, Operation(), ctx);
+  }
+};
+
+McrouterRouteHandlePtr makeBoundedLoadHashRoute(
+  const folly::dynamic& json,
+  std::vector<McrouterRouteHandlePtr> children,
+  Ch3HashFunc hashFunc);
+
+McrouterRouteHandlePtr makeBoundedLoadHashRoute(
+  const folly::dynamic& json,
+  std::vector<McrouterRouteHandlePtr> children,
+  Crc32HashFunc hashFunc);
+
+McrouterRouteHandlePtr makeBoundedLoadHashRoute(
+  const folly::dynamic& json,
+  std::vector<McrouterRouteHandlePtr> children,
+  const WeightedCh3HashFunc& hashFunc);
+
+}}}  // facebook::memcache::mcrouter
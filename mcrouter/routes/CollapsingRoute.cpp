@@ -0,0 +1,41 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "CollapsingRoute.h"
+
+#include <folly/dynamic.h>
+
+#include "mcrouter/lib/fbi/cpp/util.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+CollapsingRoute::CollapsingRoute(
+    RouteHandleFactory<McrouterRouteHandleIf>& factory,
+    const folly::dynamic& json) {
+
+  checkLogic(json.isObject(), "CollapsingRoute should be an object");
+  auto jtarget = json.get_ptr("target");
+  checkLogic(jtarget, "CollapsingRoute: no target");
+  target_ = factory.create(*jtarget);
+}
+
+McrouterRouteHandlePtr makeCollapsingRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json) {
+
+  return std::make_shared<McrouterRouteHandle<CollapsingRoute>>(
+    factory, json);
+}
+
+McrouterRouteHandlePtr makeCollapsingRoute(McrouterRouteHandlePtr target) {
+  return std::make_shared<McrouterRouteHandle<CollapsingRoute>>(
+    std::move(target));
+}
+
+}}}  // facebook::memcache::mcrouter
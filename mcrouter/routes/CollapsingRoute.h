@@ -0,0 +1,174 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/experimental/fibers/Baton.h>
+
+#include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/Operation.h"
+#include "mcrouter/lib/Reply.h"
+#include "mcrouter/routes/McrouterRouteHandle.h"
+
+namespace folly {
+class dynamic;
+}
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Collapses concurrent gets for the same key: while a get for a key is
+ * in flight, other gets for that key wait for it and get a copy of its
+ * reply instead of being sent to target.
+ *
+ * Lease-gets are collapsed the same way, but only hits are shared: a
+ * lease token must go to a single client, so on a miss the waiting
+ * lease-gets are sent to target on their own.
+ *
+ * Other operations go straight to target. Since route handles are per
+ * proxy, only requests on the same proxy are collapsed.
+ *
+ * Config:
+ *   target: route
+ */
+class CollapsingRoute {
+ public:
+  using ContextPtr = ProxyRequestContext::Ptr;
+
+  static std::string routeName() { return "collapsing"; }
+
+  template <class Operation, class Request>
+  std::vector<McrouterRouteHandlePtr> couldRouteTo(
+    const Request& req, Operation, const ContextPtr& ctx) const {
+
+    return {target_};
+  }
+
+  CollapsingRoute(RouteHandleFactory<McrouterRouteHandleIf>& factory,
+                  const folly::dynamic& json);
+
+  explicit CollapsingRoute(McrouterRouteHandlePtr target)
+      : target_(std::move(target)) {
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation, const ContextPtr& ctx,
+    typename GetLike<Operation>::Type = 0) {
+
+    using Reply = typename ReplyType<Operation, Request>::type;
+    constexpr bool isGet =
+      std::is_same<Operation, McOperation<mc_op_get>>::value;
+    constexpr bool isLeaseGet =
+      std::is_same<Operation, McOperation<mc_op_lease_get>>::value;
+
+    if (!isGet && !isLeaseGet) {
+      return target_->route(req, Operation(), ctx);
+    }
+
+    auto& inflightMap = isGet ? inflightGets_ : inflightLeaseGets_;
+    auto key = req.fullKey().str();
+    auto it = inflightMap.find(key);
+    if (it != inflightMap.end()) {
+      /* Someone already asked for this key, wait for its reply */
+      auto inflight = std::static_pointer_cast<Inflight<Reply>>(it->second);
+      folly::fibers::Baton baton;
+      inflight->waiters.push_back(&baton);
+      baton.wait();
+      if (isGet || inflight->reply.isHit()) {
+        ++collapsed_;
+        return copyReply(inflight->reply);
+      }
+      return target_->route(req, Operation(), ctx);
+    }
+
+    auto inflight = std::make_shared<Inflight<Reply>>();
+    inflightMap.emplace(key, inflight);
+    try {
+      auto reply = target_->route(req, Operation(), ctx);
+      finish(inflightMap, key, *inflight, reply);
+      return reply;
+    } catch (...) {
+      finish(inflightMap, key, *inflight, Reply(mc_res_local_error));
+      throw;
+    }
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation, const ContextPtr& ctx,
+    OtherThanT(Operation, GetLike<>) = 0) {
+
+    return target_->route(req, Operation(), ctx);
+  }
+
+  /**
+   * Number of requests that got a copy of another request's reply.
+   */
+  uint64_t collapsed() const {
+    return collapsed_;
+  }
+
+ private:
+  template <class Reply>
+  struct Inflight {
+    std::vector<folly::fibers::Baton*> waiters;
+    Reply reply;
+  };
+
+  using InflightMap = std::unordered_map<std::string, std::shared_ptr<void>>;
+
+  McrouterRouteHandlePtr target_;
+  /* Full key -> Inflight<Reply> of the request being routed */
+  InflightMap inflightGets_;
+  InflightMap inflightLeaseGets_;
+  uint64_t collapsed_{0};
+
+  template <class Reply>
+  static Reply copyReply(const Reply& reply) {
+    Reply copy(reply.result());
+    if (reply.hasValue()) {
+      folly::IOBuf value;
+      reply.value().cloneInto(value);
+      copy.setValue(std::move(value));
+    }
+    copy.setFlags(reply.flags());
+    copy.setLeaseToken(reply.leaseToken());
+    copy.setAppSpecificErrorCode(reply.appSpecificErrorCode());
+    return copy;
+  }
+
+  template <class Reply>
+  static void finish(InflightMap& inflightMap, const std::string& key,
+                     Inflight<Reply>& inflight, const Reply& reply) {
+    inflightMap.erase(key);
+    if (inflight.waiters.empty()) {
+      return;
+    }
+    inflight.reply = copyReply(reply);
+    for (auto baton : inflight.waiters) {
+      baton->post();
+    }
+    inflight.waiters.clear();
+  }
+};
+
+McrouterRouteHandlePtr makeCollapsingRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json);
+
+McrouterRouteHandlePtr makeCollapsingRoute(McrouterRouteHandlePtr target);
+
+}}}  // facebook::memcache::mcrouter
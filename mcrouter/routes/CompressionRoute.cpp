@@ -0,0 +1,126 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "CompressionRoute.h"
+
+#include <folly/dynamic.h>
+
+#include "mcrouter/lib/fbi/cpp/util.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+folly::io::CodecType parseCodecType(const folly::dynamic& json) {
+  checkLogic(json.isObject(), "CompressionRoute should be an object");
+  auto jcodec = json.get_ptr("codec");
+  if (!jcodec) {
+    return folly::io::CodecType::LZ4_VARINT_SIZE;
+  }
+  checkLogic(jcodec->isString(), "CompressionRoute: codec is not a string");
+  auto codec = jcodec->stringPiece();
+  if (codec == "zlib") {
+    return folly::io::CodecType::ZLIB;
+  } else if (codec == "snappy") {
+    return folly::io::CodecType::SNAPPY;
+  }
+  checkLogic(codec == "lz4", "CompressionRoute: unknown codec {}", codec);
+  /* stores the uncompressed size, so values can be uncompressed alone */
+  return folly::io::CodecType::LZ4_VARINT_SIZE;
+}
+
+size_t parseThreshold(const folly::dynamic& json) {
+  checkLogic(json.isObject(), "CompressionRoute should be an object");
+  auto jthreshold = json.get_ptr("threshold");
+  if (!jthreshold) {
+    return 1024;
+  }
+  checkLogic(jthreshold->isInt() && jthreshold->getInt() >= 0,
+             "CompressionRoute: threshold is not a non-negative int");
+  return jthreshold->getInt();
+}
+
+}  // anonymous namespace
+
+constexpr uint64_t CompressionRoute::kClientCompressedFlags;
+
+CompressionRoute::CompressionRoute(McrouterRouteHandlePtr target,
+                                   size_t threshold,
+                                   folly::io::CodecType codecType)
+    : target_(std::move(target)),
+      threshold_(threshold),
+      codecType_(codecType) {
+  /* Fail on config load rather than on the first request */
+  getCodec(codecType_);
+}
+
+CompressionRoute::CompressionRoute(
+    RouteHandleFactory<McrouterRouteHandleIf>& factory,
+    const folly::dynamic& json)
+    : CompressionRoute(nullptr, parseThreshold(json), parseCodecType(json)) {
+
+  auto jtarget = json.get_ptr("target");
+  checkLogic(jtarget, "CompressionRoute: no target");
+  target_ = factory.create(*jtarget);
+}
+
+folly::io::Codec* CompressionRoute::getCodec(folly::io::CodecType type) {
+  auto& codec = codecs_[static_cast<int>(type)];
+  if (!codec) {
+    codec = folly::io::getCodec(type);
+  }
+  return codec.get();
+}
+
+folly::Optional<folly::IOBuf> CompressionRoute::compress(
+    const folly::IOBuf& value) {
+  std::unique_ptr<folly::IOBuf> compressed;
+  try {
+    compressed = getCodec(codecType_)->compress(&value);
+  } catch (const std::exception& e) {
+    return folly::none;
+  }
+
+  auto length = compressed->computeChainDataLength();
+  if (length + 1 >= value.computeChainDataLength()) {
+    return folly::none;
+  }
+
+  auto header = folly::IOBuf::create(1);
+  *header->writableData() = static_cast<uint8_t>(codecType_);
+  header->append(1);
+  header->prependChain(std::move(compressed));
+  return std::move(*header);
+}
+
+folly::Optional<folly::IOBuf> CompressionRoute::uncompress(
+    const folly::IOBuf& value) {
+  auto data = value.clone();
+  data->coalesce();
+  if (data->length() < 1) {
+    return folly::none;
+  }
+  auto type = static_cast<folly::io::CodecType>(data->data()[0]);
+  data->trimStart(1);
+  try {
+    return std::move(*getCodec(type)->uncompress(data.get()));
+  } catch (const std::exception& e) {
+    return folly::none;
+  }
+}
+
+McrouterRouteHandlePtr makeCompressionRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json) {
+
+  return std::make_shared<McrouterRouteHandle<CompressionRoute>>(
+    factory, json);
+}
+
+}}}  // facebook::memcache::mcrouter
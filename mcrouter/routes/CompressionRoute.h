@@ -0,0 +1,158 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/io/Compression.h>
+#include <folly/io/IOBuf.h>
+#include <folly/Optional.h>
+
+#include "mcrouter/lib/config/RouteHandleFactory.h"
+#include "mcrouter/lib/mc/msg.h"
+#include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/Operation.h"
+#include "mcrouter/lib/OperationTraits.h"
+#include "mcrouter/lib/Reply.h"
+#include "mcrouter/routes/McrouterRouteHandle.h"
+
+namespace folly {
+class dynamic;
+}
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Compresses values of update-like requests above threshold bytes before
+ * sending them to target, and uncompresses them in replies to get-like
+ * requests.
+ *
+ * Compressed values are marked with MC_MSG_FLAG_MCROUTER_COMPRESSED and
+ * start with one byte of codec type, so values written with another codec
+ * can still be read after a config change. The flag is removed from
+ * replies. Values are only stored compressed if that makes them smaller.
+ *
+ * Values already compressed by the client (any of the client compression
+ * flags), appends and prepends are passed through: appending to
+ * a compressed value would corrupt it, so don't mix those with
+ * compressed keys.
+ *
+ * Config:
+ *   target: route
+ *   threshold: int, default 1024
+ *   codec: "lz4" (default), "zlib", "snappy"
+ */
+class CompressionRoute {
+ public:
+  using ContextPtr = ProxyRequestContext::Ptr;
+
+  static std::string routeName() { return "compression"; }
+
+  template <class Operation, class Request>
+  std::vector<McrouterRouteHandlePtr> couldRouteTo(
+    const Request& req, Operation, const ContextPtr& ctx) const {
+
+    return {target_};
+  }
+
+  CompressionRoute(RouteHandleFactory<McrouterRouteHandleIf>& factory,
+                   const folly::dynamic& json);
+
+  CompressionRoute(McrouterRouteHandlePtr target,
+                   size_t threshold,
+                   folly::io::CodecType codecType);
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation, const ContextPtr& ctx,
+    typename GetLike<Operation>::Type = 0) {
+
+    using Reply = typename ReplyType<Operation, Request>::type;
+
+    /* Hits may be replaced by their uncompressed value */
+    ctx->disableReplyStream();
+    auto reply = target_->route(req, Operation(), ctx);
+    if (!reply.isHit() || !(reply.flags() & MC_MSG_FLAG_MCROUTER_COMPRESSED)) {
+      return reply;
+    }
+
+    auto value = uncompress(reply.value());
+    if (!value.hasValue()) {
+      return Reply(mc_res_local_error, "CompressionRoute: corrupted value");
+    }
+    reply.setValue(std::move(value.value()));
+    reply.setFlags(reply.flags() & ~MC_MSG_FLAG_MCROUTER_COMPRESSED);
+    return reply;
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation, const ContextPtr& ctx,
+    typename UpdateLike<Operation>::Type = 0) {
+
+    if (std::is_same<Operation, McOperation<mc_op_append>>::value ||
+        std::is_same<Operation, McOperation<mc_op_prepend>>::value ||
+        (req.flags() & kClientCompressedFlags) ||
+        req.value().computeChainDataLength() < threshold_) {
+      return target_->route(req, Operation(), ctx);
+    }
+
+    auto value = compress(req.value());
+    if (!value.hasValue()) {
+      return target_->route(req, Operation(), ctx);
+    }
+    auto compressedReq = req.clone();
+    compressedReq.setValue(std::move(value.value()));
+    compressedReq.setFlags(req.flags() | MC_MSG_FLAG_MCROUTER_COMPRESSED);
+    return target_->route(compressedReq, Operation(), ctx);
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation, const ContextPtr& ctx,
+    OtherThanT(Operation, GetLike<>, UpdateLike<>) = 0) {
+
+    return target_->route(req, Operation(), ctx);
+  }
+
+ private:
+  static constexpr uint64_t kClientCompressedFlags =
+    MC_MSG_FLAG_COMPRESSED | MC_MSG_FLAG_NZLIB_COMPRESSED |
+    MC_MSG_FLAG_QUICKLZ_COMPRESSED | MC_MSG_FLAG_SNAPPY_COMPRESSED;
+
+  McrouterRouteHandlePtr target_;
+  size_t threshold_{1024};
+  folly::io::CodecType codecType_;
+  /* Codecs are reused across requests, keyed by codec type */
+  std::unordered_map<int, std::unique_ptr<folly::io::Codec>> codecs_;
+
+  folly::io::Codec* getCodec(folly::io::CodecType type);
+
+  /**
+   * @return compressed value prefixed with the codec type, or none if
+   *         it's not smaller than value.
+   */
+  folly::Optional<folly::IOBuf> compress(const folly::IOBuf& value);
+
+  /**
+   * @return uncompressed value, or none if it's corrupted.
+   */
+  folly::Optional<folly::IOBuf> uncompress(const folly::IOBuf& value);
+};
+
+McrouterRouteHandlePtr makeCompressionRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json);
+
+}}}  // facebook::memcache::mcrouter
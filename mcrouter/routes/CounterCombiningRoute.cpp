@@ -0,0 +1,36 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "CounterCombiningRoute.h"
+
+#include <folly/dynamic.h>
+
+#include "mcrouter/lib/fbi/cpp/util.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+CounterCombiningRoute::CounterCombiningRoute(
+    RouteHandleFactory<McrouterRouteHandleIf>& factory,
+    const folly::dynamic& json) {
+
+  checkLogic(json.isObject(), "CounterCombiningRoute should be an object");
+  auto jtarget = json.get_ptr("target");
+  checkLogic(jtarget, "CounterCombiningRoute: no target");
+  target_ = factory.create(*jtarget);
+}
+
+McrouterRouteHandlePtr makeCounterCombiningRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json) {
+
+  return std::make_shared<McrouterRouteHandle<CounterCombiningRoute>>(
+    factory, json);
+}
+
+}}}  // facebook::memcache::mcrouter
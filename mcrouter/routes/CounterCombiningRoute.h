@@ -0,0 +1,236 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <limits>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/experimental/fibers/Baton.h>
+
+#include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/Operation.h"
+#include "mcrouter/lib/OperationTraits.h"
+#include "mcrouter/lib/Reply.h"
+#include "mcrouter/routes/McrouterRouteHandle.h"
+
+namespace folly {
+class dynamic;
+}
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Combines concurrent incrs (and, separately, decrs) of the same key:
+ * while one is in flight to target, the following ones are queued up
+ * and sent as a single request with the sum of their deltas once it
+ * replies. Each caller gets the value it would have seen if the requests
+ * had been applied one by one in arrival order.
+ *
+ * Requests of a key that has nothing in flight are sent right away, so
+ * combining only kicks in (and only adds latency) for contended keys.
+ *
+ * A combined decr that brings the counter to 0 can't tell at which
+ * request it did, so all its callers get 0. Other results (misses,
+ * errors) are given to every caller. Other operations go straight to
+ * target. Since route handles are per proxy, only requests on the same
+ * proxy are combined.
+ *
+ * Config:
+ *   target: route
+ */
+class CounterCombiningRoute {
+ public:
+  using ContextPtr = ProxyRequestContext::Ptr;
+
+  static std::string routeName() { return "counter-combining"; }
+
+  template <class Operation, class Request>
+  std::vector<McrouterRouteHandlePtr> couldRouteTo(
+    const Request& req, Operation, const ContextPtr& ctx) const {
+
+    return {target_};
+  }
+
+  CounterCombiningRoute(RouteHandleFactory<McrouterRouteHandleIf>& factory,
+                        const folly::dynamic& json);
+
+  explicit CounterCombiningRoute(McrouterRouteHandlePtr target)
+      : target_(std::move(target)) {
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation, const ContextPtr& ctx,
+    typename ArithmeticLike<Operation>::Type = 0) {
+
+    using Reply = typename ReplyType<Operation, Request>::type;
+    constexpr bool isIncr =
+      std::is_same<Operation, McOperation<mc_op_incr>>::value;
+
+    auto& inflightMap = isIncr ? inflightIncrs_ : inflightDecrs_;
+    auto key = req.fullKey().str();
+    auto it = inflightMap.find(key);
+    if (it == inflightMap.end()) {
+      /* Nothing in flight, no one to combine with */
+      inflightMap.emplace(key, nullptr);
+      return send(inflightMap, key, req, Operation(), ctx, nullptr);
+    }
+
+    if (!it->second) {
+      /* Start the next batch, we send it once the one in flight replies */
+      auto batch = std::make_shared<Batch<Reply>>();
+      batch->delta = req.delta();
+      it->second = batch;
+      batch->turn.wait();
+      return send(inflightMap, key, req, Operation(), ctx, batch.get());
+    }
+
+    auto batch = std::static_pointer_cast<Batch<Reply>>(it->second);
+    if (!isIncr &&
+        batch->delta > std::numeric_limits<uint64_t>::max() - req.delta()) {
+      /* The sum would wrap around, decrs don't */
+      return target_->route(req, Operation(), ctx);
+    }
+    typename Batch<Reply>::Waiter waiter;
+    batch->delta += req.delta();
+    waiter.delta = batch->delta;
+    batch->waiters.push_back(&waiter);
+    waiter.baton.wait();
+    ++combined_;
+    return std::move(waiter.reply);
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation, const ContextPtr& ctx,
+    OtherThanT(Operation, ArithmeticLike<>) = 0) {
+
+    return target_->route(req, Operation(), ctx);
+  }
+
+  /**
+   * Number of requests that were sent as part of another one.
+   */
+  uint64_t combined() const {
+    return combined_;
+  }
+
+ private:
+  /* Requests waiting for the one in flight of their key */
+  template <class Reply>
+  struct Batch {
+    struct Waiter {
+      /* Deltas of the batch up to and including this request */
+      uint64_t delta{0};
+      folly::fibers::Baton baton;
+      Reply reply;
+    };
+
+    /* Sum of the deltas of the first request and of waiters */
+    uint64_t delta{0};
+    /* Posted for the first request once the previous batch replied */
+    folly::fibers::Baton turn;
+    std::vector<Waiter*> waiters;
+  };
+
+  /* Full key -> Batch<Reply> of the next requests to send, or nullptr if
+     there are none yet, as long as a request for the key is in flight */
+  using InflightMap = std::unordered_map<std::string, std::shared_ptr<void>>;
+
+  McrouterRouteHandlePtr target_;
+  InflightMap inflightIncrs_;
+  InflightMap inflightDecrs_;
+  uint64_t combined_{0};
+
+  /**
+   * Sends req with the delta of batch (if any), then hands over the key
+   * to the next batch and replies to the waiters of this one.
+   */
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type send(
+    InflightMap& inflightMap, const std::string& key, const Request& req,
+    Operation, const ContextPtr& ctx,
+    Batch<typename ReplyType<Operation, Request>::type>* batch) {
+
+    using Reply = typename ReplyType<Operation, Request>::type;
+    constexpr bool isIncr =
+      std::is_same<Operation, McOperation<mc_op_incr>>::value;
+
+    auto total = batch ? batch->delta : req.delta();
+    Reply reply(mc_res_local_error);
+    try {
+      if (batch && !batch->waiters.empty()) {
+        auto combinedReq = req.clone();
+        combinedReq.setDelta(total);
+        reply = target_->route(combinedReq, Operation(), ctx);
+      } else {
+        reply = target_->route(req, Operation(), ctx);
+      }
+    } catch (...) {
+      finish(inflightMap, key, batch, reply, total, isIncr);
+      throw;
+    }
+    finish(inflightMap, key, batch, reply, total, isIncr);
+    return resultFor(reply, total, req.delta(), isIncr);
+  }
+
+  template <class Reply>
+  void finish(InflightMap& inflightMap, const std::string& key,
+              Batch<Reply>* batch, const Reply& reply, uint64_t total,
+              bool isIncr) {
+    auto it = inflightMap.find(key);
+    if (it->second) {
+      /* The next batch's first request takes over the key */
+      auto next = std::static_pointer_cast<Batch<Reply>>(it->second);
+      it->second = nullptr;
+      next->turn.post();
+    } else {
+      inflightMap.erase(it);
+    }
+    if (batch) {
+      for (auto waiter : batch->waiters) {
+        waiter->reply = resultFor(reply, total, waiter->delta, isIncr);
+        waiter->baton.post();
+      }
+    }
+  }
+
+  /**
+   * Reply of a request applied after delta of the total deltas of its
+   * batch (its own included), given the reply of the combined request.
+   */
+  template <class Reply>
+  static Reply resultFor(const Reply& reply, uint64_t total, uint64_t delta,
+                         bool isIncr) {
+    Reply result(reply.result());
+    result.setAppSpecificErrorCode(reply.appSpecificErrorCode());
+    if (reply.result() != mc_res_stored && reply.result() != mc_res_found) {
+      result.setDelta(reply.delta());
+      return result;
+    }
+    if (isIncr) {
+      /* Unsigned arithmetic wraps around just like the counter */
+      result.setDelta(reply.delta() - total + delta);
+    } else {
+      result.setDelta(reply.delta() == 0 ? 0 : reply.delta() + total - delta);
+    }
+    return result;
+  }
+};
+
+McrouterRouteHandlePtr makeCounterCombiningRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json);
+
+}}}  // facebook::memcache::mcrouter
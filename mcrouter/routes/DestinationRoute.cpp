@@ -19,7 +19,7 @@ std::string DestinationRoute::routeName() const {
     client_->indexInPool,
     client_->useSsl,
     client_->ap.toString(),
-    client_->server_timeout.count());
+    client_->pool.serverTimeout().count());
 }
 
 McrouterRouteHandlePtr makeDestinationRoute(
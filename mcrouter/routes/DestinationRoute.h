@@ -32,21 +32,13 @@
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
-struct DestinationRequestCtx {
-  int64_t startTime{0};
-  int64_t endTime{0};
-
-  DestinationRequestCtx() : startTime(nowUs()) {
-  }
-};
-
 /**
  * Routes a request to a single ProxyClient.
  * This is the lowest level in Mcrouter's RouteHandle tree.
  */
 class DestinationRoute {
  public:
-  using ContextPtr = std::shared_ptr<ProxyRequestContext>;
+  using ContextPtr = ProxyRequestContext::Ptr;
 
   std::string routeName() const;
 
@@ -75,7 +67,7 @@ class DestinationRoute {
     if (!destination_->may_send()) {
       ProxyMcReply reply(TkoReply);
       reply.setDestination(client_);
-      ctx->onRequestRefused(req, reply);
+      ctx->onRequestRefused(*client_, req, reply, McOperation<Op>());
       return reply;
     }
 
@@ -85,12 +77,31 @@ class DestinationRoute {
     }
 
     auto proxy = &ctx->proxy();
+    if (destination_->saturated()) {
+      /* A failover error: routes with alternatives try those right away,
+         instead of having this one wait in the queue */
+      stat_incr(proxy->stats, destination_saturated_requests_stat, 1);
+      ProxyMcReply reply(mc_res_busy);
+      reply.setDestination(client_);
+      ctx->onRequestRefused(*client_, req, reply, McOperation<Op>());
+      return reply;
+    }
+    auto timeout = ctx->timeoutBeforeDeadline(
+      destination_->requestTimeout(client_->pool.serverTimeout()));
+    if (ctx->deadlineUs() != 0 && timeout.count() == 0) {
+      stat_incr(proxy->stats, deadline_exceeded_requests_stat, 1);
+      ProxyMcReply reply(mc_res_timeout);
+      reply.setDestination(client_);
+      ctx->onRequestRefused(*client_, req, reply, McOperation<Op>());
+      return reply;
+    }
+
     if (req.getRequestClass() == RequestClass::SHADOW) {
       if (proxy->opts.target_max_shadow_requests > 0 &&
           pendingShadowReqs_ >= proxy->opts.target_max_shadow_requests) {
         ProxyMcReply reply(ErrorReply);
         reply.setDestination(client_);
-        ctx->onRequestRefused(req, reply);
+        ctx->onRequestRefused(*client_, req, reply, McOperation<Op>());
         return reply;
       }
       auto& mutableCounter = const_cast<size_t&>(pendingShadowReqs_);
@@ -107,17 +118,35 @@ class DestinationRoute {
     auto& destination = destination_;
 
     DestinationRequestCtx dctx;
-    auto newReq = McRequest::cloneFrom(req, !client_->keep_routing_prefix);
-
-    auto reply = ProxyMcReply(
-      destination->send(newReq, McOperation<Op>(), dctx,
-                        client_->server_timeout));
+    dctx.traceWrite = ctx->phasesSampled();
+    if (Op == mc_op_get && req.getRequestClass() != RequestClass::SHADOW) {
+      dctx.replyStream = ctx->replyStream();
+    }
+    auto newReq = McRequest::cloneFrom(req, !client_->pool.keepRoutingPrefix());
+
+    auto reply = [&]() {
+      /* Waiting for the reply is not this route's cost */
+      RouteCpuWait cpuWait(ctx->routeCpu());
+      return ProxyMcReply(
+        destination->send(newReq, McOperation<Op>(), dctx, timeout));
+    }();
     ctx->onReplyReceived(*client_,
                          req,
                          reply,
                          dctx.startTime,
                          dctx.endTime,
                          McOperation<Op>());
+    if (UNLIKELY(dctx.endTime - dctx.startTime >=
+                 proxy->slowRequests.thresholdUs())) {
+      recordSlowRequest(ctx, *client_, req, reply, McOperation<Op>::mc_op,
+                        dctx);
+    }
+    if (dctx.writtenTime != 0) {
+      ctx->recordPhase(RequestPhase::DESTINATION_QUEUE,
+                       dctx.writtenTime - dctx.startTime);
+      ctx->recordPhase(RequestPhase::DESTINATION_RTT,
+                       dctx.endTime - dctx.writtenTime);
+    }
 
     // For AsynclogRoute
     if (reply.isFailoverError()) {
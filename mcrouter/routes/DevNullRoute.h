@@ -21,10 +21,12 @@ namespace facebook { namespace memcache { namespace mcrouter {
  */
 class DevNullRoute {
  public:
-  using ContextPtr = std::shared_ptr<ProxyRequestContext>;
+  using ContextPtr = ProxyRequestContext::Ptr;
 
   static std::string routeName() { return "devnull"; }
 
+  static bool completesInline() { return true; }
+
   template <class Operation, class Request>
   std::vector<McrouterRouteHandlePtr> couldRouteTo(
     const Request& req, Operation, const ContextPtr& ctx) const {
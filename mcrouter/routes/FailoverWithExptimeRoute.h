@@ -29,7 +29,7 @@ namespace facebook { namespace memcache { namespace mcrouter {
 
 class FailoverWithExptimeRoute {
  public:
-  using ContextPtr = std::shared_ptr<ProxyRequestContext>;
+  using ContextPtr = ProxyRequestContext::Ptr;
 
   static std::string routeName() { return "failover-exptime"; }
 
@@ -75,7 +75,7 @@ class FailoverWithExptimeRoute {
     if (!reply.isFailoverError() ||
         !(GetLike<Operation>::value || UpdateLike<Operation>::value ||
           DeleteLike<Operation>::value) ||
-        ctx->failoverDisabled()) {
+        ctx->failoverDisabled() || ctx->deadlineExceeded()) {
       return reply;
     }
 
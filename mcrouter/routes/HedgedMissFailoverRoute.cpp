@@ -0,0 +1,106 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "HedgedMissFailoverRoute.h"
+
+#include <folly/dynamic.h>
+
+#include "mcrouter/lib/fbi/cpp/util.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+constexpr uint32_t MissRateTracker::kMaxSamples;
+constexpr uint32_t MissRateTracker::kMinSamples;
+
+void MissRateTracker::record(folly::StringPiece key, bool miss) {
+  auto it = keys_.find(key.str());
+  if (it == keys_.end()) {
+    if (!miss || maxKeys_ == 0) {
+      return;
+    }
+    if (keys_.size() >= maxKeys_) {
+      keys_.clear();
+    }
+    it = keys_.emplace(key.str(), Counts()).first;
+  }
+  auto& counts = it->second;
+  ++counts.requests;
+  if (miss) {
+    ++counts.misses;
+  }
+  if (counts.requests >= kMaxSamples) {
+    counts.requests /= 2;
+    counts.misses /= 2;
+  }
+}
+
+bool MissRateTracker::missesOften(folly::StringPiece key,
+                                  double ratio) const {
+  auto it = keys_.find(key.str());
+  if (it == keys_.end() || it->second.requests < kMinSamples) {
+    return false;
+  }
+  return it->second.misses >= ratio * it->second.requests;
+}
+
+HedgedMissFailoverRoute::HedgedMissFailoverRoute(
+    std::vector<McrouterRouteHandlePtr> children,
+    std::chrono::milliseconds hedgeDelay,
+    double highMissRatio,
+    size_t maxTrackedKeys)
+    : children_(std::move(children)),
+      hedgeDelay_(hedgeDelay),
+      highMissRatio_(highMissRatio),
+      missTracker_(std::make_shared<MissRateTracker>(maxTrackedKeys)) {
+}
+
+HedgedMissFailoverRoute::HedgedMissFailoverRoute(
+    RouteHandleFactory<McrouterRouteHandleIf>& factory,
+    const folly::dynamic& json) {
+
+  size_t maxTrackedKeys = 10000;
+  if (!json.isObject()) {
+    children_ = factory.createList(json);
+  } else {
+    if (auto jchildren = json.get_ptr("children")) {
+      children_ = factory.createList(*jchildren);
+    }
+    if (auto jdelay = json.get_ptr("hedge_delay_ms")) {
+      checkLogic(jdelay->isInt() && jdelay->getInt() >= 0,
+                 "HedgedMissFailoverRoute: hedge_delay_ms is not "
+                 "a non-negative int");
+      hedgeDelay_ = std::chrono::milliseconds(jdelay->getInt());
+    }
+    if (auto jratio = json.get_ptr("high_miss_ratio")) {
+      checkLogic(jratio->isNumber(),
+                 "HedgedMissFailoverRoute: high_miss_ratio is not a number");
+      highMissRatio_ = jratio->asDouble();
+      checkLogic(highMissRatio_ >= 0 && highMissRatio_ <= 1,
+                 "HedgedMissFailoverRoute: high_miss_ratio should be "
+                 "in [0, 1]");
+    }
+    if (auto jkeys = json.get_ptr("max_tracked_keys")) {
+      checkLogic(jkeys->isInt() && jkeys->getInt() >= 0,
+                 "HedgedMissFailoverRoute: max_tracked_keys is not "
+                 "a non-negative int");
+      maxTrackedKeys = jkeys->getInt();
+    }
+  }
+  missTracker_ = std::make_shared<MissRateTracker>(maxTrackedKeys);
+}
+
+McrouterRouteHandlePtr makeHedgedMissFailoverRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json) {
+
+  return std::make_shared<McrouterRouteHandle<HedgedMissFailoverRoute>>(
+    factory, json);
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,264 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <folly/experimental/fibers/AddTasks.h>
+#include <folly/experimental/fibers/Baton.h>
+#include <folly/Optional.h>
+#include <folly/Range.h>
+
+#include "mcrouter/lib/config/RouteHandleFactory.h"
+#include "mcrouter/lib/Operation.h"
+#include "mcrouter/lib/OperationTraits.h"
+#include "mcrouter/lib/Reply.h"
+#include "mcrouter/lib/routes/NullRoute.h"
+#include "mcrouter/routes/McrouterRouteHandle.h"
+
+namespace folly {
+class dynamic;
+}
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Keys that recently missed on the first child of a
+ * HedgedMissFailoverRoute, with their recent miss rate.
+ */
+class MissRateTracker {
+ public:
+  /* Counts are halved once a key has this many samples */
+  static constexpr uint32_t kMaxSamples = 16;
+  /* Miss rate isn't trusted before a key has this many samples */
+  static constexpr uint32_t kMinSamples = 4;
+
+  explicit MissRateTracker(size_t maxKeys)
+      : maxKeys_(maxKeys) {
+  }
+
+  /**
+   * Records the first child's reply for key. Only keys that missed
+   * at least once are tracked; when maxKeys are tracked, all are dropped.
+   */
+  void record(folly::StringPiece key, bool miss);
+
+  /**
+   * @return  true if key is tracked and missed on the first child for at
+   *          least `ratio` of its recent requests.
+   */
+  bool missesOften(folly::StringPiece key, double ratio) const;
+
+  size_t size() const {
+    return keys_.size();
+  }
+
+ private:
+  struct Counts {
+    uint32_t requests{0};
+    uint32_t misses{0};
+  };
+
+  size_t maxKeys_;
+  std::unordered_map<std::string, Counts> keys_;
+};
+
+/**
+ * For get-like requests, tries children in order until the first hit,
+ * like MissFailoverRoute. But instead of waiting for a miss, the request
+ * is also sent to the next child once hedge_delay_ms passed without a hit,
+ * or right away for keys that recently missed on the first child for at
+ * least high_miss_ratio of their requests. The first hit is returned,
+ * other requests complete asynchronously. If no child hits, the reply of
+ * the last child is returned.
+ *
+ * Deletes are sent sequentially like in MissFailoverRoute, other
+ * operations only to the first child.
+ *
+ * Config:
+ *   children: list of routes
+ *   hedge_delay_ms: int, default 10
+ *   high_miss_ratio: double in [0, 1], default 0.8; 0 disables
+ *   max_tracked_keys: int, default 10000
+ */
+class HedgedMissFailoverRoute {
+ public:
+  using ContextPtr = ProxyRequestContext::Ptr;
+
+  static std::string routeName() { return "hedged-miss-failover"; }
+
+  template <class Operation, class Request>
+  std::vector<McrouterRouteHandlePtr> couldRouteTo(
+    const Request& req, Operation, const ContextPtr& ctx) const {
+
+    return children_;
+  }
+
+  HedgedMissFailoverRoute(RouteHandleFactory<McrouterRouteHandleIf>& factory,
+                          const folly::dynamic& json);
+
+  HedgedMissFailoverRoute(std::vector<McrouterRouteHandlePtr> children,
+                          std::chrono::milliseconds hedgeDelay,
+                          double highMissRatio,
+                          size_t maxTrackedKeys);
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation, const ContextPtr& ctx,
+    typename GetLike<Operation>::Type = 0) {
+
+    using Reply = typename ReplyType<Operation, Request>::type;
+
+    if (children_.empty()) {
+      return NullRoute<McrouterRouteHandleIf>::route(req, Operation(), ctx);
+    }
+    if (children_.size() == 1) {
+      return children_[0]->route(req, Operation(), ctx);
+    }
+
+    auto state = std::make_shared<HedgeState<Reply>>();
+    auto reqCopy = std::make_shared<Request>(req.clone());
+    auto tracker = missTracker_;
+
+    size_t next = 0;
+    auto launch = [&]() {
+      auto rh = children_[next];
+      auto index = next;
+      ++next;
+      ++state->outstanding;
+      folly::fibers::addTask([state, reqCopy, rh, ctx, index, tracker]() {
+        auto reply = rh->route(*reqCopy, Operation(), ctx);
+        if (index == 0 && !reply.isFailoverError()) {
+          tracker->record(reqCopy->fullKey(), !reply.isHit());
+        }
+        if (state->done) {
+          return;
+        }
+        state->replies.emplace_back(index, std::move(reply));
+        if (state->waiting) {
+          state->waiting = false;
+          state->baton.post();
+        }
+      });
+    };
+
+    launch();
+    if (highMissRatio_ > 0 &&
+        missTracker_->missesOften(req.fullKey(), highMissRatio_)) {
+      launch();
+    }
+
+    folly::Optional<Reply> lastReply;
+    size_t lastIndex = 0;
+    while (true) {
+      if (state->replies.empty()) {
+        state->waiting = true;
+        if (next < children_.size()) {
+          if (!state->baton.timed_wait(hedgeDelay_)) {
+            /* No hit in time, ask the next child too */
+            state->waiting = false;
+            state->baton.reset();
+            launch();
+            continue;
+          }
+        } else {
+          state->baton.wait();
+        }
+        state->baton.reset();
+      }
+
+      auto indexReply = std::move(state->replies.front());
+      state->replies.pop_front();
+      --state->outstanding;
+      if (indexReply.second.isHit()) {
+        state->done = true;
+        return std::move(indexReply.second);
+      }
+      if (!lastReply || indexReply.first >= lastIndex) {
+        lastIndex = indexReply.first;
+        lastReply = std::move(indexReply.second);
+      }
+      if (state->outstanding == 0) {
+        if (next == children_.size()) {
+          state->done = true;
+          return std::move(lastReply.value());
+        }
+        /* Everything sent so far missed, try the next one right away */
+        launch();
+      }
+    }
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation, const ContextPtr& ctx,
+    typename DeleteLike<Operation>::Type = 0) {
+
+    if (children_.empty()) {
+      return NullRoute<McrouterRouteHandleIf>::route(req, Operation(), ctx);
+    }
+    for (size_t i = 0; i + 1 < children_.size(); ++i) {
+      auto reply = children_[i]->route(req, Operation(), ctx);
+      if (reply.isHit()) {
+        return reply;
+      }
+    }
+    return children_.back()->route(req, Operation(), ctx);
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation, const ContextPtr& ctx,
+    OtherThanT(Operation, GetLike<>, DeleteLike<>) = 0) {
+
+    if (children_.empty()) {
+      return NullRoute<McrouterRouteHandleIf>::route(req, Operation(), ctx);
+    }
+    return children_[0]->route(req, Operation(), ctx);
+  }
+
+  const MissRateTracker& missTracker() const {
+    return *missTracker_;
+  }
+
+ private:
+  template <class Reply>
+  struct HedgeState {
+    /* (child index, reply) not yet looked at by the routing fiber */
+    std::deque<std::pair<size_t, Reply>> replies;
+    folly::fibers::Baton baton;
+    /* Number of sent requests we didn't look at reply for */
+    size_t outstanding{0};
+    /* True iff the routing fiber waits on baton */
+    bool waiting{false};
+    /* True once the reply is chosen, later replies are dropped */
+    bool done{false};
+  };
+
+  std::vector<McrouterRouteHandlePtr> children_;
+  std::chrono::milliseconds hedgeDelay_{10};
+  double highMissRatio_{0.8};
+
+  /* Shared with the requests in flight, so it can outlive the route */
+  std::shared_ptr<MissRateTracker> missTracker_;
+};
+
+McrouterRouteHandlePtr makeHedgedMissFailoverRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json);
+
+}}}  // facebook::memcache::mcrouter
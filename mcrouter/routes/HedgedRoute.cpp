@@ -0,0 +1,102 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "HedgedRoute.h"
+
+#include <algorithm>
+
+#include <folly/dynamic.h>
+
+#include "mcrouter/lib/fbi/cpp/util.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+constexpr size_t HedgedRoute::kWindowSize;
+constexpr size_t HedgedRoute::kMinSamples;
+
+HedgedRoute::HedgedRoute(
+    std::vector<McrouterRouteHandlePtr> children,
+    double percentile,
+    std::chrono::milliseconds initialDelay,
+    std::chrono::milliseconds minDelay,
+    size_t maxHedges)
+    : children_(std::move(children)),
+      percentile_(percentile),
+      initialDelay_(initialDelay),
+      minDelay_(minDelay),
+      maxHedges_(maxHedges),
+      latency_(std::make_shared<LatencyHistogram>()) {
+}
+
+HedgedRoute::HedgedRoute(
+    RouteHandleFactory<McrouterRouteHandleIf>& factory,
+    const folly::dynamic& json)
+    : latency_(std::make_shared<LatencyHistogram>()) {
+
+  if (!json.isObject()) {
+    children_ = factory.createList(json);
+    return;
+  }
+
+  if (auto jchildren = json.get_ptr("children")) {
+    children_ = factory.createList(*jchildren);
+  }
+  if (auto jpercentile = json.get_ptr("percentile")) {
+    checkLogic(jpercentile->isNumber(),
+               "HedgedRoute: percentile is not a number");
+    percentile_ = jpercentile->asDouble();
+    checkLogic(percentile_ >= 0 && percentile_ <= 100,
+               "HedgedRoute: percentile should be in [0, 100]");
+  }
+  if (auto jdelay = json.get_ptr("initial_delay_ms")) {
+    checkLogic(jdelay->isInt() && jdelay->getInt() >= 0,
+               "HedgedRoute: initial_delay_ms is not a non-negative int");
+    initialDelay_ = std::chrono::milliseconds(jdelay->getInt());
+  }
+  if (auto jdelay = json.get_ptr("min_delay_ms")) {
+    checkLogic(jdelay->isInt() && jdelay->getInt() >= 0,
+               "HedgedRoute: min_delay_ms is not a non-negative int");
+    minDelay_ = std::chrono::milliseconds(jdelay->getInt());
+  }
+  if (auto jhedges = json.get_ptr("max_hedges")) {
+    checkLogic(jhedges->isInt() && jhedges->getInt() >= 0,
+               "HedgedRoute: max_hedges is not a non-negative int");
+    maxHedges_ = jhedges->getInt();
+  }
+}
+
+std::chrono::milliseconds HedgedRoute::hedgeDelay() {
+  if (latency_->count() >= kWindowSize) {
+    windowDelay_ = delayFromHistogram();
+    hasWindowDelay_ = true;
+    latency_ = std::make_shared<LatencyHistogram>();
+  }
+  if (hasWindowDelay_) {
+    return windowDelay_;
+  }
+  if (latency_->count() >= kMinSamples) {
+    return delayFromHistogram();
+  }
+  return initialDelay_;
+}
+
+std::chrono::milliseconds HedgedRoute::delayFromHistogram() const {
+  auto us = latency_->percentile(percentile_);
+  std::chrono::milliseconds delay((us + 999) / 1000);
+  return std::max(minDelay_, delay);
+}
+
+McrouterRouteHandlePtr makeHedgedRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json) {
+
+  return std::make_shared<McrouterRouteHandle<HedgedRoute>>(factory, json);
+}
+
+}}}  // facebook::memcache::mcrouter
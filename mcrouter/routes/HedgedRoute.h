@@ -0,0 +1,214 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <folly/experimental/fibers/AddTasks.h>
+#include <folly/experimental/fibers/Baton.h>
+
+#include "mcrouter/LatencyHistogram.h"
+#include "mcrouter/lib/config/RouteHandleFactory.h"
+#include "mcrouter/lib/Operation.h"
+#include "mcrouter/lib/Reply.h"
+#include "mcrouter/lib/routes/NullRoute.h"
+#include "mcrouter/routes/McrouterRouteHandle.h"
+
+namespace folly {
+class dynamic;
+}
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Sends get-like requests to the first child. If it doesn't reply within
+ * the hedging delay, the request is also sent to the next child, up to
+ * max_hedges extra children. The first non-error reply is returned,
+ * other requests complete asynchronously. On an error reply the next child
+ * is tried right away (like FailoverRoute); if all children fail, the last
+ * error is returned.
+ *
+ * The hedging delay is the given percentile of the first child's latency,
+ * so roughly (100 - percentile)% of requests are hedged. Until enough
+ * samples are collected, initial_delay_ms is used.
+ *
+ * Other operations are only sent to the first child.
+ *
+ * Config:
+ *   children: list of routes, the first one is the primary
+ *   percentile: double, default 95
+ *   initial_delay_ms: int, default 10
+ *   min_delay_ms: int, default 1
+ *   max_hedges: int, default 1
+ */
+class HedgedRoute {
+ public:
+  using ContextPtr = ProxyRequestContext::Ptr;
+
+  /* Delay is recomputed from this many latest samples */
+  static constexpr size_t kWindowSize = 10000;
+  /* Percentile is not used before there are this many samples */
+  static constexpr size_t kMinSamples = 100;
+
+  static std::string routeName() { return "hedged"; }
+
+  template <class Operation, class Request>
+  std::vector<McrouterRouteHandlePtr> couldRouteTo(
+    const Request& req, Operation, const ContextPtr& ctx) const {
+
+    return children_;
+  }
+
+  HedgedRoute(RouteHandleFactory<McrouterRouteHandleIf>& factory,
+              const folly::dynamic& json);
+
+  HedgedRoute(std::vector<McrouterRouteHandlePtr> children,
+              double percentile,
+              std::chrono::milliseconds initialDelay,
+              std::chrono::milliseconds minDelay,
+              size_t maxHedges);
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation, const ContextPtr& ctx,
+    typename GetLike<Operation>::Type = 0) {
+
+    using Reply = typename ReplyType<Operation, Request>::type;
+
+    if (children_.empty()) {
+      return NullRoute<McrouterRouteHandleIf>::route(req, Operation(), ctx);
+    }
+    if (children_.size() == 1) {
+      return children_[0]->route(req, Operation(), ctx);
+    }
+
+    auto state = std::make_shared<HedgeState<Reply>>();
+    auto reqCopy = std::make_shared<Request>(req.clone());
+    auto start = std::chrono::steady_clock::now();
+    auto primaryLatency = latency_;
+
+    size_t next = 0;
+    size_t hedges = 0;
+    auto launch = [&]() {
+      auto rh = children_[next];
+      bool isPrimary = next == 0;
+      ++next;
+      ++state->outstanding;
+      folly::fibers::addTask(
+        [state, reqCopy, rh, ctx, isPrimary, start, primaryLatency]() {
+          auto reply = rh->route(*reqCopy, Operation(), ctx);
+          if (isPrimary) {
+            primaryLatency->record(
+              std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count());
+          }
+          if (state->done) {
+            return;
+          }
+          state->replies.push_back(std::move(reply));
+          if (state->waiting) {
+            state->waiting = false;
+            state->baton.post();
+          }
+        });
+    };
+
+    launch();
+    while (true) {
+      if (state->replies.empty()) {
+        state->waiting = true;
+        if (next < children_.size() && hedges < maxHedges_) {
+          if (!state->baton.timed_wait(hedgeDelay())) {
+            /* Timed out, add a backup request and keep waiting */
+            state->waiting = false;
+            state->baton.reset();
+            ++hedges;
+            launch();
+            continue;
+          }
+        } else {
+          state->baton.wait();
+        }
+        state->baton.reset();
+      }
+
+      auto reply = std::move(state->replies.front());
+      state->replies.pop_front();
+      --state->outstanding;
+      if (!reply.isFailoverError()) {
+        state->done = true;
+        return reply;
+      }
+      if (state->outstanding == 0) {
+        if (next == children_.size()) {
+          state->done = true;
+          return reply;
+        }
+        /* Everything sent so far failed, fail over right away */
+        launch();
+      }
+    }
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation, const ContextPtr& ctx,
+    OtherThanT(Operation, GetLike<>) = 0) {
+
+    if (children_.empty()) {
+      return NullRoute<McrouterRouteHandleIf>::route(req, Operation(), ctx);
+    }
+    return children_[0]->route(req, Operation(), ctx);
+  }
+
+  /**
+   * Current hedging delay.
+   */
+  std::chrono::milliseconds hedgeDelay();
+
+ private:
+  template <class Reply>
+  struct HedgeState {
+    /* Replies not yet looked at by the routing fiber */
+    std::deque<Reply> replies;
+    folly::fibers::Baton baton;
+    /* Number of sent requests we didn't look at reply for */
+    size_t outstanding{0};
+    /* True iff the routing fiber waits on baton */
+    bool waiting{false};
+    /* True once the reply is chosen, later replies are dropped */
+    bool done{false};
+  };
+
+  std::vector<McrouterRouteHandlePtr> children_;
+  double percentile_{95.0};
+  std::chrono::milliseconds initialDelay_{10};
+  std::chrono::milliseconds minDelay_{1};
+  size_t maxHedges_{1};
+
+  /* Latencies of the first child in the current window. Shared with
+     the requests in flight, so it can outlive the route. */
+  std::shared_ptr<LatencyHistogram> latency_;
+  /* Delay computed from the last full window */
+  std::chrono::milliseconds windowDelay_{0};
+  bool hasWindowDelay_{false};
+
+  std::chrono::milliseconds delayFromHistogram() const;
+};
+
+McrouterRouteHandlePtr makeHedgedRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json);
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,151 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "HotKeyCacheRoute.h"
+
+#include <folly/dynamic.h>
+
+#include "mcrouter/lib/fbi/cpp/util.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+/* Sketch width; with the default window keeps the overestimate
+   well below the default hot_threshold */
+const size_t kSketchWidth = 4096;
+
+int64_t parsePositiveInt(const folly::dynamic& json, const char* name,
+                         int64_t defaultValue) {
+  checkLogic(json.isObject(), "HotKeyCacheRoute should be an object");
+  auto jvalue = json.get_ptr(name);
+  if (!jvalue) {
+    return defaultValue;
+  }
+  checkLogic(jvalue->isInt() && jvalue->getInt() > 0,
+             "HotKeyCacheRoute: {} is not a positive int", name);
+  return jvalue->getInt();
+}
+
+}  // anonymous namespace
+
+constexpr size_t HotKeyCacheRoute::kNumInvalidationStamps;
+
+HotKeyCacheRoute::HotKeyCacheRoute(
+    McrouterRouteHandlePtr target,
+    std::chrono::milliseconds ttl,
+    size_t maxKeys,
+    uint32_t hotThreshold,
+    uint64_t window)
+    : target_(std::move(target)),
+      ttl_(ttl),
+      maxKeys_(maxKeys),
+      hotThreshold_(hotThreshold),
+      sketch_(kSketchWidth, window),
+      invalidationStamps_(kNumInvalidationStamps, 0) {
+}
+
+HotKeyCacheRoute::HotKeyCacheRoute(
+    RouteHandleFactory<McrouterRouteHandleIf>& factory,
+    const folly::dynamic& json)
+    : HotKeyCacheRoute(
+        nullptr,
+        std::chrono::milliseconds(parsePositiveInt(json, "ttl_ms", 100)),
+        parsePositiveInt(json, "max_keys", 1000),
+        parsePositiveInt(json, "hot_threshold", 1000),
+        parsePositiveInt(json, "window", 100000)) {
+
+  auto jtarget = json.get_ptr("target");
+  checkLogic(jtarget, "HotKeyCacheRoute: no target");
+  target_ = factory.create(*jtarget);
+}
+
+const HotKeyCacheRoute::Entry* HotKeyCacheRoute::lookup(
+    folly::StringPiece key) {
+  if (index_.empty()) {
+    return nullptr;
+  }
+  auto it = index_.find(key.str());
+  if (it == index_.end()) {
+    return nullptr;
+  }
+  auto& entry = entries_[it->second];
+  if (entry.expires <= std::chrono::steady_clock::now()) {
+    erase(it->second);
+    return nullptr;
+  }
+  entry.referenced = true;
+  return &entry;
+}
+
+void HotKeyCacheRoute::insert(folly::StringPiece key,
+                              const folly::IOBuf& value,
+                              uint64_t flags) {
+  auto keyStr = key.str();
+  size_t slot;
+  auto it = index_.find(keyStr);
+  if (it != index_.end()) {
+    slot = it->second;
+  } else {
+    if (!freeSlots_.empty()) {
+      slot = freeSlots_.back();
+      freeSlots_.pop_back();
+    } else if (entries_.size() < maxKeys_) {
+      slot = entries_.size();
+      entries_.emplace_back();
+    } else {
+      /* CLOCK: evict the first entry not referenced since the last pass */
+      while (entries_[clockHand_].referenced) {
+        entries_[clockHand_].referenced = false;
+        clockHand_ = (clockHand_ + 1) % entries_.size();
+      }
+      slot = clockHand_;
+      clockHand_ = (clockHand_ + 1) % entries_.size();
+      index_.erase(entries_[slot].key);
+    }
+    index_.emplace(keyStr, slot);
+  }
+
+  auto& entry = entries_[slot];
+  entry.key = std::move(keyStr);
+  value.cloneInto(entry.value);
+  entry.flags = flags;
+  entry.expires = std::chrono::steady_clock::now() + ttl_;
+  entry.referenced = false;
+}
+
+void HotKeyCacheRoute::invalidate(folly::StringPiece key, uint32_t hash) {
+  ++invalidationStamps_[hash % kNumInvalidationStamps];
+  if (index_.empty()) {
+    return;
+  }
+  auto it = index_.find(key.str());
+  if (it != index_.end()) {
+    erase(it->second);
+  }
+}
+
+void HotKeyCacheRoute::erase(size_t slot) {
+  auto& entry = entries_[slot];
+  index_.erase(entry.key);
+  entry.key.clear();
+  entry.value = folly::IOBuf();
+  entry.referenced = false;
+  freeSlots_.push_back(slot);
+}
+
+McrouterRouteHandlePtr makeHotKeyCacheRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json) {
+
+  return std::make_shared<McrouterRouteHandle<HotKeyCacheRoute>>(
+    factory, json);
+}
+
+}}}  // facebook::memcache::mcrouter
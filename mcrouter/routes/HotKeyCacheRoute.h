@@ -0,0 +1,176 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/io/IOBuf.h>
+#include <folly/Range.h>
+
+#include "mcrouter/lib/config/RouteHandleFactory.h"
+#include "mcrouter/lib/CountMinSketch.h"
+#include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/Operation.h"
+#include "mcrouter/lib/Reply.h"
+#include "mcrouter/routes/McrouterRouteHandle.h"
+
+namespace folly {
+class dynamic;
+}
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * In-process cache in front of target for a few very hot keys.
+ *
+ * Routing keys are counted in a CountMinSketch; found replies to plain gets
+ * are cached for ttl_ms, but only for keys requested at least
+ * hot_threshold times in the last window requests. At most max_keys
+ * replies are cached, evicted in CLOCK order.
+ *
+ * Every other operation going through this route invalidates the key.
+ * Since route handles are per proxy, the cache is too: updates that go
+ * through other proxies (or other mcrouters) are only seen after ttl_ms.
+ *
+ * Config:
+ *   target: route
+ *   ttl_ms: int, default 100
+ *   max_keys: int, default 1000
+ *   hot_threshold: int, default 1000
+ *   window: int, default 100000
+ */
+class HotKeyCacheRoute {
+ public:
+  using ContextPtr = ProxyRequestContext::Ptr;
+
+  static std::string routeName() { return "hot-key-cache"; }
+
+  template <class Operation, class Request>
+  std::vector<McrouterRouteHandlePtr> couldRouteTo(
+    const Request& req, Operation, const ContextPtr& ctx) const {
+
+    return {target_};
+  }
+
+  HotKeyCacheRoute(RouteHandleFactory<McrouterRouteHandleIf>& factory,
+                   const folly::dynamic& json);
+
+  HotKeyCacheRoute(McrouterRouteHandlePtr target,
+                   std::chrono::milliseconds ttl,
+                   size_t maxKeys,
+                   uint32_t hotThreshold,
+                   uint64_t window);
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation, const ContextPtr& ctx,
+    typename GetLike<Operation>::Type = 0) {
+
+    using Reply = typename ReplyType<Operation, Request>::type;
+
+    /* gets, lease-gets etc. return per request data, never cache those */
+    if (!std::is_same<Operation, McOperation<mc_op_get>>::value) {
+      return target_->route(req, Operation(), ctx);
+    }
+
+    auto key = req.fullKey();
+    if (auto entry = lookup(key)) {
+      Reply reply(mc_res_found);
+      folly::IOBuf value;
+      entry->value.cloneInto(value);
+      reply.setValue(std::move(value));
+      reply.setFlags(entry->flags);
+      return reply;
+    }
+
+    auto hash = req.routingKeyHash();
+    bool hot = sketch_.increment(hash) >= hotThreshold_;
+    auto stamp = invalidationStamp(hash);
+
+    auto reply = target_->route(req, Operation(), ctx);
+    /* Don't cache if the key could have changed while we were waiting */
+    if (hot && reply.result() == mc_res_found &&
+        stamp == invalidationStamp(hash)) {
+      insert(key, reply.value(), reply.flags());
+    }
+    return reply;
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation, const ContextPtr& ctx,
+    OtherThanT(Operation, GetLike<>) = 0) {
+
+    invalidate(req.fullKey(), req.routingKeyHash());
+    return target_->route(req, Operation(), ctx);
+  }
+
+  size_t cachedKeys() const {
+    return index_.size();
+  }
+
+ private:
+  struct Entry {
+    std::string key;
+    folly::IOBuf value;
+    uint64_t flags{0};
+    std::chrono::steady_clock::time_point expires;
+    /* CLOCK reference bit */
+    bool referenced{false};
+  };
+
+  static constexpr size_t kNumInvalidationStamps = 1024;
+
+  McrouterRouteHandlePtr target_;
+  std::chrono::milliseconds ttl_{100};
+  size_t maxKeys_{1000};
+  uint32_t hotThreshold_{1000};
+
+  CountMinSketch sketch_;
+
+  std::vector<Entry> entries_;
+  std::unordered_map<std::string, size_t> index_;
+  std::vector<size_t> freeSlots_;
+  size_t clockHand_{0};
+
+  /**
+   * Bumped for every invalidation of a key with a matching hash,
+   * so that a get racing with an update doesn't cache the old value.
+   */
+  std::vector<uint64_t> invalidationStamps_;
+
+  /**
+   * @return cached entry for the key, nullptr if there's none
+   *         or it expired.
+   */
+  const Entry* lookup(folly::StringPiece key);
+
+  void insert(folly::StringPiece key, const folly::IOBuf& value,
+              uint64_t flags);
+
+  void invalidate(folly::StringPiece key, uint32_t hash);
+
+  void erase(size_t slot);
+
+  uint64_t invalidationStamp(uint32_t hash) const {
+    return invalidationStamps_[hash % kNumInvalidationStamps];
+  }
+};
+
+McrouterRouteHandlePtr makeHotKeyCacheRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json);
+
+}}}  // facebook::memcache::mcrouter
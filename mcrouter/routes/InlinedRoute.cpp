@@ -0,0 +1,31 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "InlinedRoute.h"
+
+#include "mcrouter/lib/Ch3HashFunc.h"
+#include "mcrouter/lib/Crc32HashFunc.h"
+#include "mcrouter/lib/WeightedCh3HashFunc.h"
+#include "mcrouter/routes/DestinationRoute.h"
+#include "mcrouter/routes/ShardHashFunc.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+McrouterRouteHandlePtr makeInlinedRoute(McrouterRouteHandlePtr rh) {
+  McrouterRouteHandlePtr inlined;
+  if ((inlined = tryInlineRoute<DestinationRoute, Ch3HashFunc>(rh)) ||
+      (inlined = tryInlineRoute<DestinationRoute, WeightedCh3HashFunc>(rh)) ||
+      (inlined = tryInlineRoute<DestinationRoute, Crc32HashFunc>(rh)) ||
+      (inlined = tryInlineRoute<DestinationRoute, ConstShardHashFunc>(rh))) {
+    return inlined;
+  }
+  return rh;
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,213 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mcrouter/lib/Operation.h"
+#include "mcrouter/lib/routes/FailoverRoute.h"
+#include "mcrouter/lib/routes/HashRoute.h"
+#include "mcrouter/routes/McrouterRouteHandle.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Non-virtual stand-in for McrouterRouteHandleIf, used as RouteHandleIf of
+ * route templates from lib/routes: route() calls the wrapped Route
+ * directly, so it can be inlined into the parent route.
+ */
+template <class Route>
+class InlineRouteHandle {
+ public:
+  using ContextPtr = McrouterRouteHandleIf::ContextPtr;
+
+  /**
+   * @param rh  handle wrapping route, kept alive by this object.
+   */
+  InlineRouteHandle(McrouterRouteHandlePtr rh, Route& route)
+    : rh_(std::move(rh)),
+      route_(route) {
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type
+  route(const Request& req, Operation, const ContextPtr& ctx) const {
+    return route_.route(req, Operation(), ctx);
+  }
+
+  /* Batches are routed through the original handle */
+  template <class Operation, class Request>
+  std::vector<typename ReplyType<Operation, Request>::type> routeBatch(
+    const std::vector<const Request*>& reqs, Operation,
+    const ContextPtr& ctx) const {
+
+    return rh_->routeBatch(reqs, Operation(), ctx);
+  }
+
+ private:
+  const McrouterRouteHandlePtr rh_;
+  Route& route_;
+};
+
+/**
+ * Route composed from lib/routes templates with InlineRouteHandle
+ * children, replacing the McrouterRouteHandle subtree it was built from
+ * (see makeInlinedRoute()). Only route() and routeBatch() go through
+ * Route, everything else is answered by the original subtree.
+ */
+template <class Route>
+class InlinedRoute {
+ public:
+  using ContextPtr = McrouterRouteHandleIf::ContextPtr;
+
+  std::string routeName() const {
+    return original_->routeName();
+  }
+
+  template <class... Args>
+  explicit InlinedRoute(McrouterRouteHandlePtr original, Args&&... args)
+    : original_(std::move(original)),
+      route_(std::forward<Args>(args)...) {
+  }
+
+  template <class Operation, class Request>
+  std::vector<McrouterRouteHandlePtr> couldRouteTo(
+    const Request& req, Operation, const ContextPtr& ctx) const {
+
+    return original_->couldRouteTo(req, Operation(), ctx);
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type
+  route(const Request& req, Operation, const ContextPtr& ctx) const {
+    return route_.route(req, Operation(), ctx);
+  }
+
+  template <class Operation, class Request>
+  std::vector<typename ReplyType<Operation, Request>::type> routeBatch(
+    const std::vector<const Request*>& reqs, Operation,
+    const ContextPtr& ctx) const {
+
+    return route_.routeBatch(reqs, Operation(), ctx);
+  }
+
+ private:
+  const McrouterRouteHandlePtr original_;
+  const Route route_;
+};
+
+/* HashRoute -> Leaf */
+template <class Leaf, class HashFunc>
+using InlinedHashRoute =
+  InlinedRoute<HashRoute<InlineRouteHandle<Leaf>, HashFunc>>;
+
+/* FailoverRoute -> HashRoute -> Leaf */
+template <class Leaf, class HashFunc>
+using InlinedFailoverHashRoute =
+  InlinedRoute<FailoverRoute<
+    InlineRouteHandle<InlinedHashRoute<Leaf, HashFunc>>>>;
+
+namespace detail {
+
+/**
+ * @return  route wrapped by rh if it's of type Route, nullptr otherwise
+ */
+template <class Route>
+Route* getRouteImpl(const McrouterRouteHandlePtr& rh) {
+  auto impl = dynamic_cast<McrouterRouteHandle<Route>*>(rh.get());
+  return impl ? &impl->routeImpl() : nullptr;
+}
+
+}  // detail
+
+/**
+ * @return  InlinedHashRoute in place of rh, if rh is a HashRoute with
+ *          HashFunc over Leaf routes only; nullptr otherwise.
+ */
+template <class Leaf, class HashFunc>
+std::shared_ptr<McrouterRouteHandle<InlinedHashRoute<Leaf, HashFunc>>>
+makeInlinedHashRoute(const McrouterRouteHandlePtr& rh) {
+  auto hash = detail::getRouteImpl<
+    HashRoute<McrouterRouteHandleIf, HashFunc>>(rh);
+  if (!hash || hash->children().empty()) {
+    return nullptr;
+  }
+
+  std::vector<std::shared_ptr<InlineRouteHandle<Leaf>>> children;
+  for (const auto& child : hash->children()) {
+    auto leaf = detail::getRouteImpl<Leaf>(child);
+    if (!leaf) {
+      return nullptr;
+    }
+    children.push_back(
+      std::make_shared<InlineRouteHandle<Leaf>>(child, *leaf));
+  }
+
+  return std::make_shared<
+    McrouterRouteHandle<InlinedHashRoute<Leaf, HashFunc>>>(
+      rh, std::move(children), hash->salt(), hash->hashFunc());
+}
+
+/**
+ * @return  InlinedFailoverHashRoute in place of rh, if rh is a FailoverRoute
+ *          over routes accepted by makeInlinedHashRoute() only;
+ *          nullptr otherwise.
+ */
+template <class Leaf, class HashFunc>
+std::shared_ptr<McrouterRouteHandle<InlinedFailoverHashRoute<Leaf, HashFunc>>>
+makeInlinedFailoverHashRoute(const McrouterRouteHandlePtr& rh) {
+  auto failover = detail::getRouteImpl<
+    FailoverRoute<McrouterRouteHandleIf>>(rh);
+  if (!failover || failover->children().empty()) {
+    return nullptr;
+  }
+
+  using Child = InlinedHashRoute<Leaf, HashFunc>;
+  std::vector<std::shared_ptr<InlineRouteHandle<Child>>> children;
+  for (const auto& child : failover->children()) {
+    auto hash = makeInlinedHashRoute<Leaf, HashFunc>(child);
+    if (!hash) {
+      return nullptr;
+    }
+    children.push_back(
+      std::make_shared<InlineRouteHandle<Child>>(hash, hash->routeImpl()));
+  }
+
+  return std::make_shared<
+    McrouterRouteHandle<InlinedFailoverHashRoute<Leaf, HashFunc>>>(
+      rh, std::move(children));
+}
+
+/**
+ * @return  inlined route in place of rh if it's a FailoverRoute -> HashRoute
+ *          -> Leaf or HashRoute -> Leaf tree, nullptr otherwise.
+ */
+template <class Leaf, class HashFunc>
+McrouterRouteHandlePtr tryInlineRoute(const McrouterRouteHandlePtr& rh) {
+  if (auto failover = makeInlinedFailoverHashRoute<Leaf, HashFunc>(rh)) {
+    return failover;
+  }
+  return makeInlinedHashRoute<Leaf, HashFunc>(rh);
+}
+
+/**
+ * Replaces the common FailoverRoute -> HashRoute -> DestinationRoute and
+ * HashRoute -> DestinationRoute trees (with any of the standard hash
+ * functions) with a route calling all levels without virtual dispatch
+ * (opts.inline_routes).
+ *
+ * @return  inlined route, or rh itself if the tree has another shape.
+ */
+McrouterRouteHandlePtr makeInlinedRoute(McrouterRouteHandlePtr rh);
+
+}}}  // facebook::memcache::mcrouter
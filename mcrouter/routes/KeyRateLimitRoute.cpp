@@ -0,0 +1,158 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "KeyRateLimitRoute.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <folly/dynamic.h>
+
+#include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/routes/HotKeyCacheRoute.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+/* Same as HotKeyCacheRoute: enough for a few thousand hot keys per period */
+const size_t kSketchWidth = 4096;
+
+int64_t parsePositiveInt(const folly::dynamic& json, const char* name,
+                         int64_t defaultValue) {
+  auto jvalue = json.get_ptr(name);
+  if (!jvalue) {
+    return defaultValue;
+  }
+  checkLogic(jvalue->isInt() && jvalue->getInt() > 0,
+             "KeyRateLimitRoute: {} is not a positive int", name);
+  return jvalue->getInt();
+}
+
+KeyRateLimitRoute::Options parseOptions(const folly::dynamic& json) {
+  checkLogic(json.isObject(), "KeyRateLimitRoute should be an object");
+  KeyRateLimitRoute::Options opts;
+
+  auto jrate = json.get_ptr("max_rate");
+  checkLogic(jrate && jrate->isNumber() && jrate->asDouble() > 0,
+             "KeyRateLimitRoute: max_rate is not a positive number");
+  opts.maxRate = jrate->asDouble();
+  opts.period = std::chrono::milliseconds(
+    parsePositiveInt(json, "period_ms", 1000));
+
+  if (auto jby = json.get_ptr("by")) {
+    checkLogic(jby->isString(), "KeyRateLimitRoute: by is not a string");
+    auto by = jby->stringPiece();
+    checkLogic(by == "key" || by == "prefix",
+               "KeyRateLimitRoute: unknown by '{}'", by);
+    if (by == "prefix") {
+      opts.prefixDelimiter = ":";
+      if (auto jdelim = json.get_ptr("prefix_delimiter")) {
+        checkLogic(jdelim->isString() && !jdelim->empty(),
+                   "KeyRateLimitRoute: prefix_delimiter is not a "
+                   "non-empty string");
+        opts.prefixDelimiter = jdelim->stringPiece().str();
+      }
+    }
+  }
+
+  if (auto jaction = json.get_ptr("action")) {
+    checkLogic(jaction->isString(),
+               "KeyRateLimitRoute: action is not a string");
+    auto action = jaction->stringPiece();
+    if (action == "reject") {
+      opts.action = KeyRateLimitRoute::Action::REJECT;
+    } else if (action == "delay") {
+      opts.action = KeyRateLimitRoute::Action::DELAY;
+    } else if (action == "cache") {
+      opts.action = KeyRateLimitRoute::Action::CACHE;
+    } else {
+      checkLogic(false, "KeyRateLimitRoute: unknown action '{}'", action);
+    }
+  }
+  opts.delay = std::chrono::milliseconds(
+    parsePositiveInt(json, "delay_ms", 10));
+  opts.cacheTtl = std::chrono::milliseconds(
+    parsePositiveInt(json, "cache_ttl_ms", 100));
+  opts.cacheMaxKeys = parsePositiveInt(json, "cache_max_keys", 1000);
+  return opts;
+}
+
+}  // anonymous namespace
+
+KeyRateLimitRoute::KeyRateLimitRoute(McrouterRouteHandlePtr target,
+                                     Options opts)
+    : target_(std::move(target)),
+      opts_(std::move(opts)),
+      threshold_(std::max(1.0, std::ceil(
+        2 * opts_.maxRate * opts_.period.count() / 1000.0))),
+      /* Aged by time in maybeAge(), not by the number of requests */
+      sketch_(kSketchWidth, std::numeric_limits<uint64_t>::max()),
+      nextAging_(std::chrono::steady_clock::now() + opts_.period) {
+  initCache();
+}
+
+KeyRateLimitRoute::KeyRateLimitRoute(
+    RouteHandleFactory<McrouterRouteHandleIf>& factory,
+    const folly::dynamic& json)
+    : KeyRateLimitRoute(nullptr, parseOptions(json)) {
+
+  auto jtarget = json.get_ptr("target");
+  checkLogic(jtarget, "KeyRateLimitRoute: no target");
+  target_ = factory.create(*jtarget);
+  initCache();
+}
+
+void KeyRateLimitRoute::initCache() {
+  if (opts_.action != Action::CACHE || !target_) {
+    return;
+  }
+  /* Only keys over the limit get there, so they're all hot */
+  cacheRoute_ = std::make_shared<McrouterRouteHandle<HotKeyCacheRoute>>(
+    target_, opts_.cacheTtl, opts_.cacheMaxKeys,
+    /* hotThreshold= */ 1, /* window= */ 100000);
+}
+
+uint32_t KeyRateLimitRoute::prefixHash(folly::StringPiece routingKey,
+                                       uint32_t keyHash) const {
+  auto pos = routingKey.find(opts_.prefixDelimiter);
+  if (pos == std::string::npos) {
+    return keyHash;
+  }
+  return getMemcacheKeyHashValue(
+    routingKey.subpiece(0, pos + opts_.prefixDelimiter.size()));
+}
+
+void KeyRateLimitRoute::maybeAge() {
+  auto now = std::chrono::steady_clock::now();
+  if (now < nextAging_) {
+    return;
+  }
+  /* Halve once for every period that passed */
+  auto periods = (now - nextAging_) / opts_.period + 1;
+  if (periods >= 32) {
+    sketch_.clear();
+  } else {
+    for (int64_t i = 0; i < periods; ++i) {
+      sketch_.age();
+    }
+  }
+  nextAging_ += periods * opts_.period;
+}
+
+McrouterRouteHandlePtr makeKeyRateLimitRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json) {
+
+  return std::make_shared<McrouterRouteHandle<KeyRateLimitRoute>>(
+    factory, json);
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,168 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <folly/experimental/fibers/Baton.h>
+#include <folly/Range.h>
+
+#include "mcrouter/lib/config/RouteHandleFactory.h"
+#include "mcrouter/lib/CountMinSketch.h"
+#include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/Operation.h"
+#include "mcrouter/lib/Reply.h"
+#include "mcrouter/routes/McrouterRouteHandle.h"
+
+namespace folly {
+class dynamic;
+}
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Rate limits single keys (or key prefixes), so that a client hammering
+ * one key can't saturate the shard it lives on.
+ *
+ * Requests are counted per routing key hash in a CountMinSketch, whose
+ * counters are halved every period_ms. A key is over the limit while its
+ * count is above 2 * max_rate * period_ms / 1000, which is about where
+ * the count of a key requested max_rate times a second stays. Since the
+ * sketch only overestimates, a cold key that collides with hot ones may
+ * be limited too, never the other way around.
+ *
+ * Requests over the limit are
+ *   "reject": answered with the default reply, like RateLimitRoute does;
+ *   "delay": sent to target after delay_ms;
+ *   "cache": plain gets are sent through a HotKeyCacheRoute in front of
+ *            target, which caches their replies for cache_ttl_ms. Other
+ *            operations are rejected.
+ *
+ * Config:
+ *   target: route
+ *   max_rate: number, requests per second per key
+ *   period_ms: int, default 1000
+ *   by: "key" (default) or "prefix", the routing key up to and including
+ *       the first prefix_delimiter (default ":"). Keys without one are
+ *       counted by themselves.
+ *   action: "reject" (default), "delay" or "cache"
+ *   delay_ms: int, default 10
+ *   cache_ttl_ms: int, default 100
+ *   cache_max_keys: int, default 1000
+ */
+class KeyRateLimitRoute {
+ public:
+  using ContextPtr = ProxyRequestContext::Ptr;
+
+  enum class Action {
+    REJECT,
+    DELAY,
+    CACHE,
+  };
+
+  struct Options {
+    double maxRate{0.0};
+    std::chrono::milliseconds period{1000};
+    /* Empty to count whole routing keys */
+    std::string prefixDelimiter;
+    Action action{Action::REJECT};
+    std::chrono::milliseconds delay{10};
+    std::chrono::milliseconds cacheTtl{100};
+    size_t cacheMaxKeys{1000};
+  };
+
+  static std::string routeName() { return "key-rate-limit"; }
+
+  template <class Operation, class Request>
+  std::vector<McrouterRouteHandlePtr> couldRouteTo(
+    const Request& req, Operation, const ContextPtr& ctx) const {
+
+    return {target_};
+  }
+
+  KeyRateLimitRoute(RouteHandleFactory<McrouterRouteHandleIf>& factory,
+                    const folly::dynamic& json);
+
+  KeyRateLimitRoute(McrouterRouteHandlePtr target, Options opts);
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type
+  route(const Request& req, Operation, const ContextPtr& ctx) {
+    using Reply = typename ReplyType<Operation, Request>::type;
+
+    /* Updates go through the cache to invalidate what it has */
+    auto& target = cacheRoute_ && !std::is_same<
+      Operation, McOperation<mc_op_get>>::value ? cacheRoute_ : target_;
+
+    if (LIKELY(!overLimit(req))) {
+      return target->route(req, Operation(), ctx);
+    }
+
+    ++numLimited_;
+    switch (opts_.action) {
+      case Action::DELAY: {
+        folly::fibers::Baton baton;
+        baton.timed_wait(opts_.delay);
+        return target->route(req, Operation(), ctx);
+      }
+      case Action::CACHE:
+        if (std::is_same<Operation, McOperation<mc_op_get>>::value) {
+          return cacheRoute_->route(req, Operation(), ctx);
+        }
+        break;
+      case Action::REJECT:
+        break;
+    }
+    return Reply(DefaultReply, Operation());
+  }
+
+  /**
+   * Requests that were over the limit.
+   */
+  uint64_t numLimited() const {
+    return numLimited_;
+  }
+
+ private:
+  McrouterRouteHandlePtr target_;
+  /* HotKeyCacheRoute in front of target_ for Action::CACHE */
+  McrouterRouteHandlePtr cacheRoute_;
+  Options opts_;
+  uint32_t threshold_;
+
+  CountMinSketch sketch_;
+  std::chrono::steady_clock::time_point nextAging_;
+  uint64_t numLimited_{0};
+
+  template <class Request>
+  bool overLimit(const Request& req) {
+    auto hash = opts_.prefixDelimiter.empty()
+      ? req.routingKeyHash()
+      : prefixHash(req.routingKey(), req.routingKeyHash());
+    maybeAge();
+    return sketch_.increment(hash) > threshold_;
+  }
+
+  uint32_t prefixHash(folly::StringPiece routingKey, uint32_t keyHash) const;
+
+  void maybeAge();
+
+  void initCache();
+};
+
+McrouterRouteHandlePtr makeKeyRateLimitRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json);
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,157 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "LazyRoute.h"
+
+#include <algorithm>
+
+#include <folly/experimental/fibers/FiberManager.h>
+#include <folly/io/async/EventBase.h>
+
+#include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/McrouterLogFailure.h"
+#include "mcrouter/PoolFactory.h"
+#include "mcrouter/proxy.h"
+#include "mcrouter/routes/InlinedRoute.h"
+#include "mcrouter/routes/McRouteHandleBuilder.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+McrouterRouteHandlePtr makeErrorRoute(const char* name,
+                                      const std::string& valueToSet);
+
+namespace {
+
+template <class Func>
+void foreachString(const folly::dynamic& json, Func&& f) {
+  if (json.isString()) {
+    f(json.stringPiece());
+  } else if (json.isArray()) {
+    for (const auto& it : json) {
+      foreachString(it, f);
+    }
+  } else if (json.isObject()) {
+    for (const auto& it : json.items()) {
+      foreachString(it.second, f);
+    }
+  }
+}
+
+void foreachName(const folly::dynamic& json,
+                 const std::function<void(folly::StringPiece)>& f) {
+  if (json.isArray()) {
+    for (const auto& it : json) {
+      foreachName(it, f);
+    }
+  } else if (json.isObject()) {
+    auto name = json.get_ptr("name");
+    if (name && name->isString() && json.count("type")) {
+      f(name->stringPiece());
+    }
+    for (const auto& it : json.items()) {
+      foreachName(it.second, f);
+    }
+  }
+}
+
+}  // anonymous namespace
+
+LazyRouteFactory::LazyRouteFactory(proxy_t* proxy,
+                                   std::shared_ptr<PoolFactory> poolFactory,
+                                   std::shared_ptr<const folly::dynamic> json)
+  : poolFactory_(std::move(poolFactory)),
+    json_(std::move(json)),
+    provider_(proxy, *proxy->destinationMap, *poolFactory_),
+    factory_(provider_),
+    inlineRoutes_(proxy->opts.inline_routes) {
+}
+
+void LazyRouteFactory::createNamedHandles(
+    const folly::dynamic& namedHandles) {
+  for (const auto& it : namedHandles) {
+    factory_.create(it);
+  }
+}
+
+McrouterRouteHandlePtr LazyRouteFactory::create(const folly::dynamic& json) {
+  auto index = entries_.size();
+  Entry entry;
+  entry.json = &json;
+  foreachString(json, [this, &entry](folly::StringPiece str) {
+    auto it = names_.find(str.str());
+    if (it != names_.end()) {
+      entry.deps.push_back(it->second);
+    }
+  });
+  std::sort(entry.deps.begin(), entry.deps.end());
+  entry.deps.erase(std::unique(entry.deps.begin(), entry.deps.end()),
+                   entry.deps.end());
+  foreachName(json, [this, index](folly::StringPiece name) {
+    names_.emplace(name.str(), index);
+  });
+  entries_.push_back(std::move(entry));
+
+  return makeMcrouterRouteHandle<LazyRoute>(shared_from_this(), index);
+}
+
+McrouterRouteHandlePtr LazyRouteFactory::get(size_t index) {
+  assert(index < entries_.size());
+  if (entries_[index].route) {
+    return entries_[index].route;
+  }
+  /* Deep route trees shouldn't be built on the fiber stack */
+  return folly::fibers::runInMainContext([this, index]() {
+    for (auto dep : entries_[index].deps) {
+      if (dep != index) {
+        get(dep);
+      }
+    }
+    auto& entry = entries_[index];
+    try {
+      entry.route = factory_.create(*entry.json);
+      if (inlineRoutes_) {
+        entry.route = makeInlinedRoute(std::move(entry.route));
+      }
+    } catch (const std::exception& e) {
+      logFailure(memcache::failure::Category::kInvalidConfig,
+                 "Failed to build route: {}", e.what());
+      entry.route = makeErrorRoute("lazy", e.what());
+    }
+    ++numBuilt_;
+    return entry.route;
+  });
+}
+
+McrouterRouteHandlePtr
+LazyRouteFactory::getAsyncLogRoute(const std::string& name) const {
+  /* Only this factory's provider knows asynclog routes built so far */
+  return provider_.getAsyncLogRoute(name);
+}
+
+void LazyRouteFactory::warmUp(folly::EventBase& evb) {
+  auto self = shared_from_this();
+  evb.runInEventBaseThread([self, &evb]() {
+    self->warmUpFrom(evb, 0);
+  });
+}
+
+void LazyRouteFactory::warmUpFrom(folly::EventBase& evb, size_t index) {
+  auto end = std::min(index + kWarmUpBatchSize, entries_.size());
+  for (; index < end; ++index) {
+    get(index);
+  }
+  if (index < entries_.size()) {
+    auto self = shared_from_this();
+    evb.runInLoop([self, &evb, index]() {
+      self->warmUpFrom(evb, index);
+    });
+  }
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,160 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/dynamic.h>
+
+#include "mcrouter/lib/config/RouteHandleFactory.h"
+#include "mcrouter/lib/Operation.h"
+#include "mcrouter/routes/McRouteHandleProvider.h"
+#include "mcrouter/routes/McrouterRouteHandle.h"
+
+namespace folly {
+class EventBase;
+}
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+class PoolFactory;
+class proxy_t;
+
+/**
+ * Builds route subtrees of one proxy's config on first use
+ * (opts.lazy_routes) instead of when the config is loaded.
+ *
+ * Subtrees are built in the proxy thread by their LazyRoute, with a
+ * factory that lives as long as the config. Before a subtree is built, all
+ * subtrees that came before it in the config and define a named handle it
+ * refers to are built, so named handles resolve as if the whole config was
+ * built in order.
+ *
+ * The config must have been built and validated eagerly with the same
+ * PoolFactory first (see ProxyConfigBuilder), so that it only serves
+ * already parsed pools here.
+ */
+class LazyRouteFactory :
+  public std::enable_shared_from_this<LazyRouteFactory> {
+ public:
+  /**
+   * @param json  config, the json of every subtree is referenced from it.
+   */
+  LazyRouteFactory(proxy_t* proxy,
+                   std::shared_ptr<PoolFactory> poolFactory,
+                   std::shared_ptr<const folly::dynamic> json);
+
+  /**
+   * Builds named_handles of the config now.
+   */
+  void createNamedHandles(const folly::dynamic& namedHandles);
+
+  /**
+   * @param json  subtree of the config passed to constructor
+   * @return  route that builds the subtree on its first request
+   */
+  McrouterRouteHandlePtr create(const folly::dynamic& json);
+
+  /**
+   * Builds the subtree (and the ones it depends on) if needed.
+   * Proxy thread only.
+   */
+  McrouterRouteHandlePtr get(size_t index);
+
+  /**
+   * @return  asynclog route of a pool, if it was built already
+   */
+  McrouterRouteHandlePtr getAsyncLogRoute(const std::string& name) const;
+
+  /**
+   * Builds all subtrees in the proxy thread, a few per event loop
+   * iteration. Keeps the factory alive until done.
+   */
+  void warmUp(folly::EventBase& evb);
+
+  size_t numRoutes() const {
+    return entries_.size();
+  }
+
+  size_t numBuiltRoutes() const {
+    return numBuilt_;
+  }
+
+ private:
+  struct Entry {
+    const folly::dynamic* json;
+    // earlier entries defining named handles this one refers to
+    std::vector<size_t> deps;
+    McrouterRouteHandlePtr route;
+  };
+
+  static constexpr size_t kWarmUpBatchSize = 16;
+
+  std::shared_ptr<PoolFactory> poolFactory_;
+  std::shared_ptr<const folly::dynamic> json_;
+  McRouteHandleProvider provider_;
+  RouteHandleFactory<McrouterRouteHandleIf> factory_;
+  const bool inlineRoutes_;
+  std::vector<Entry> entries_;
+  // named handle => first entry defining it
+  std::unordered_map<std::string, size_t> names_;
+  size_t numBuilt_{0};
+
+  void warmUpFrom(folly::EventBase& evb, size_t index);
+};
+
+/**
+ * Forwards requests to the subtree built by LazyRouteFactory on the first
+ * request.
+ */
+class LazyRoute {
+ public:
+  using ContextPtr = ProxyRequestContext::Ptr;
+
+  static std::string routeName() { return "lazy"; }
+
+  LazyRoute(std::shared_ptr<LazyRouteFactory> factory, size_t index)
+    : factory_(std::move(factory)),
+      index_(index) {
+  }
+
+  template <class Operation, class Request>
+  std::vector<McrouterRouteHandlePtr>
+  couldRouteTo(const Request& req, Operation, const ContextPtr& ctx) const {
+    return { target() };
+  }
+
+  bool completesInline() const {
+    return target()->completesInline();
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type
+  route(const Request& req, Operation, const ContextPtr& ctx) const {
+    return target()->route(req, Operation(), ctx);
+  }
+
+ private:
+  const std::shared_ptr<LazyRouteFactory> factory_;
+  const size_t index_;
+  mutable McrouterRouteHandlePtr target_;
+
+  const McrouterRouteHandlePtr& target() const {
+    if (!target_) {
+      target_ = factory_->get(index_);
+    }
+    return target_;
+  }
+};
+
+}}}  // facebook::memcache::mcrouter
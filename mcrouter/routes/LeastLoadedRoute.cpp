@@ -0,0 +1,80 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "LeastLoadedRoute.h"
+
+#include <folly/dynamic.h>
+
+#include "mcrouter/lib/fbi/cpp/util.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+std::vector<McrouterRouteHandlePtr> parseChildren(
+    RouteHandleFactory<McrouterRouteHandleIf>& factory,
+    const folly::dynamic& json) {
+
+  if (!json.isObject()) {
+    return factory.createList(json);
+  }
+  auto jchildren = json.get_ptr("children");
+  checkLogic(jchildren, "LeastLoadedRoute: no children");
+  return factory.createList(*jchildren);
+}
+
+}  // anonymous namespace
+
+constexpr size_t LeastLoadedRoute::kLatencyWindow;
+
+LeastLoadedRoute::LeastLoadedRoute(std::vector<McrouterRouteHandlePtr> children)
+    : children_(std::move(children)),
+      loads_(children_.size()),
+      gen_(std::ranlux24_base(
+            std::chrono::system_clock::now().time_since_epoch().count())) {
+
+  checkLogic(!children_.empty(), "LeastLoadedRoute children is empty");
+}
+
+LeastLoadedRoute::LeastLoadedRoute(
+    RouteHandleFactory<McrouterRouteHandleIf>& factory,
+    const folly::dynamic& json)
+    : LeastLoadedRoute(parseChildren(factory, json)) {
+}
+
+size_t LeastLoadedRoute::pick() {
+  auto n = children_.size();
+  if (n == 1) {
+    return 0;
+  }
+
+  /* Two distinct random children */
+  size_t first = gen_() % n;
+  size_t second = gen_() % (n - 1);
+  if (second >= first) {
+    ++second;
+  }
+
+  const auto& a = loads_[first];
+  const auto& b = loads_[second];
+  if (a.inflight != b.inflight) {
+    return a.inflight < b.inflight ? first : second;
+  }
+  return b.latencyUs.value() < a.latencyUs.value() ? second : first;
+}
+
+McrouterRouteHandlePtr makeLeastLoadedRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json) {
+
+  return std::make_shared<McrouterRouteHandle<LeastLoadedRoute>>(
+    factory, json);
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,111 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <folly/ScopeGuard.h>
+
+#include "mcrouter/DecayingHistogram.h"
+#include "mcrouter/lib/config/RouteHandleFactory.h"
+#include "mcrouter/lib/Operation.h"
+#include "mcrouter/lib/Reply.h"
+#include "mcrouter/routes/McrouterRouteHandle.h"
+
+namespace folly {
+class dynamic;
+}
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Sends the request to the less loaded of two randomly chosen children
+ * ("power of two choices"). Load is the number of requests this route
+ * has in flight to the child; ties are broken by the smoothed latency
+ * of the child's successful replies.
+ *
+ * Load is tracked by the route itself, so children can be any routes
+ * (e.g. replicas of one pool), and since every proxy has its own route
+ * tree no locking is needed.
+ *
+ * Config:
+ *   children: list of routes, should be replicas of the same data
+ */
+class LeastLoadedRoute {
+ public:
+  using ContextPtr = ProxyRequestContext::Ptr;
+
+  static std::string routeName() { return "least-loaded"; }
+
+  template <class Operation, class Request>
+  std::vector<McrouterRouteHandlePtr> couldRouteTo(
+    const Request& req, Operation, const ContextPtr& ctx) const {
+
+    return children_;
+  }
+
+  LeastLoadedRoute(RouteHandleFactory<McrouterRouteHandleIf>& factory,
+                   const folly::dynamic& json);
+
+  explicit LeastLoadedRoute(std::vector<McrouterRouteHandlePtr> children);
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation, const ContextPtr& ctx) {
+
+    auto i = pick();
+    auto& load = loads_[i];
+    ++load.inflight;
+    auto inflightGuard = folly::makeGuard([&load]() { --load.inflight; });
+
+    auto start = std::chrono::steady_clock::now();
+    auto reply = children_[i]->route(req, Operation(), ctx);
+    if (!reply.isError()) {
+      load.latencyUs.insertSample(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start).count());
+    }
+    return reply;
+  }
+
+  /**
+   * Number of requests currently in flight to the i-th child.
+   */
+  size_t inflight(size_t i) const {
+    return loads_[i].inflight;
+  }
+
+ private:
+  struct ChildLoad {
+    size_t inflight{0};
+    DecayingHistogram latencyUs{kLatencyWindow};
+  };
+
+  static constexpr size_t kLatencyWindow{64};
+
+  std::vector<McrouterRouteHandlePtr> children_;
+  std::vector<ChildLoad> loads_;
+  std::ranlux24_base gen_;
+
+  /**
+   * @return index of the child to send the next request to.
+   */
+  size_t pick();
+};
+
+McrouterRouteHandlePtr makeLeastLoadedRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json);
+
+}}}  // facebook::memcache::mcrouter
@@ -9,24 +9,152 @@
  */
 #include "McImportResolver.h"
 
+#include <algorithm>
+#include <atomic>
+#include <system_error>
+#include <thread>
+
+#include <folly/json.h>
+
 #include "mcrouter/ConfigApi.h"
 #include "mcrouter/lib/config/ImportResolverIf.h"
+#include "mcrouter/lib/fbi/cpp/util.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
-McImportResolver::McImportResolver(ConfigApi* configApi)
-  : configApi_(configApi) {
+std::shared_ptr<const folly::dynamic>
+McImportCache::get(const std::string& path,
+                   const std::string& contents,
+                   const std::string& md5) {
+  {
+    std::lock_guard<std::mutex> lg(lock_);
+    auto it = entries_.find(path);
+    if (it != entries_.end() && it->second.md5 == md5) {
+      return it->second.json;
+    }
+  }
+
+  // parse without holding the lock, prefetch parses files in parallel
+  auto json = std::make_shared<const folly::dynamic>(
+    parseJsonString(folly::json::stripComments(contents)));
+
+  std::lock_guard<std::mutex> lg(lock_);
+  auto& entry = entries_[path];
+  entry.md5 = md5;
+  entry.json = json;
+  return json;
+}
+
+void McImportCache::retain(
+    const std::unordered_map<std::string, std::string>& imports) {
+  std::lock_guard<std::mutex> lg(lock_);
+  for (auto it = entries_.begin(); it != entries_.end(); ) {
+    if (imports.count(it->first)) {
+      ++it;
+    } else {
+      it = entries_.erase(it);
+    }
+  }
+}
+
+McImportResolver::McImportResolver(ConfigApi* configApi,
+                                   McImportCache* cache)
+  : configApi_(configApi),
+    cache_(cache) {
   if (configApi_ == nullptr) {
     throw std::runtime_error("ConfigApi is null");
   }
 }
 
+McImportResolver::File McImportResolver::load(const std::string& path) {
+  File file;
+  if (!configApi_->get(ConfigType::ConfigImport, path, file.contents)) {
+    throw std::runtime_error("Can not read " + path);
+  }
+  file.md5 = Md5Hash(file.contents);
+  return file;
+}
+
 std::string McImportResolver::import(folly::StringPiece path) {
-  std::string ret;
-  if (!configApi_->get(ConfigType::ConfigImport, path.str(), ret)) {
-    throw std::runtime_error("Can not read " + path.str());
+  auto pathStr = path.str();
+  File file;
+  auto it = prefetched_.find(pathStr);
+  if (it != prefetched_.end()) {
+    file = std::move(it->second);
+    prefetched_.erase(it);
+  } else {
+    file = load(pathStr);
+  }
+  imports_[pathStr] = file.md5;
+  return std::move(file.contents);
+}
+
+folly::dynamic McImportResolver::importJson(folly::StringPiece path) {
+  auto pathStr = path.str();
+  auto it = prefetched_.find(pathStr);
+  if (it != prefetched_.end() && it->second.json) {
+    auto json = std::move(it->second.json);
+    imports_[pathStr] = std::move(it->second.md5);
+    prefetched_.erase(it);
+    return *json;
+  }
+  if (!cache_) {
+    return ImportResolverIf::importJson(path);
+  }
+  auto contents = import(path);
+  return *cache_->get(pathStr, contents, imports_[pathStr]);
+}
+
+void McImportResolver::prefetch(const std::vector<std::string>& paths) {
+  std::vector<std::string> toLoad;
+  for (const auto& path : paths) {
+    if (!imports_.count(path) && !prefetched_.count(path) &&
+        std::find(toLoad.begin(), toLoad.end(), path) == toLoad.end()) {
+      toLoad.push_back(path);
+    }
+  }
+  if (toLoad.empty()) {
+    return;
+  }
+
+  std::vector<File> files(toLoad.size());
+  std::vector<char> loaded(toLoad.size(), false);
+  std::atomic<size_t> next{0};
+  auto loadFiles = [&]() {
+    for (size_t i = next++; i < toLoad.size(); i = next++) {
+      try {
+        files[i] = load(toLoad[i]);
+        if (cache_) {
+          files[i].json =
+            cache_->get(toLoad[i], files[i].contents, files[i].md5);
+        }
+        loaded[i] = true;
+      } catch (const std::exception&) {
+        // import() will throw the error if the file is actually imported
+      }
+    }
+  };
+
+  size_t numThreads = std::min<size_t>(
+    toLoad.size(), std::max(std::thread::hardware_concurrency(), 1U));
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < numThreads; ++i) {
+    try {
+      threads.emplace_back(loadFiles);
+    } catch (const std::system_error&) {
+      break;
+    }
+  }
+  loadFiles();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  for (size_t i = 0; i < toLoad.size(); ++i) {
+    if (loaded[i]) {
+      prefetched_.emplace(std::move(toLoad[i]), std::move(files[i]));
+    }
   }
-  return ret;
 }
 
 }}} // facebook::memcache::mcrouter
@@ -9,8 +9,13 @@
  */
 #pragma once
 
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
+#include <folly/dynamic.h>
 #include <folly/Range.h>
 
 #include "mcrouter/lib/config/ImportResolverIf.h"
@@ -19,20 +24,84 @@ namespace facebook { namespace memcache { namespace mcrouter {
 
 class ConfigApi;
 
+/**
+ * Parsed contents of imported files, kept across configs so that only
+ * files that changed are parsed again on reload. Thread safe.
+ */
+class McImportCache {
+ public:
+  /**
+   * @return  parsed contents of the file at path, parsed now unless
+   *          contents with the same md5 were parsed for path before.
+   */
+  std::shared_ptr<const folly::dynamic> get(const std::string& path,
+                                            const std::string& contents,
+                                            const std::string& md5);
+
+  /**
+   * Forgets files that are not in imports (path => md5).
+   */
+  void retain(const std::unordered_map<std::string, std::string>& imports);
+
+ private:
+  struct Entry {
+    std::string md5;
+    std::shared_ptr<const folly::dynamic> json;
+  };
+
+  std::mutex lock_;
+  std::unordered_map<std::string, Entry> entries_;
+};
+
 /**
  * ImportResolverIf implementation. Can load config files for
  * @import macro from configerator/file
  */
 class McImportResolver : public ImportResolverIf {
  public:
-  explicit McImportResolver(ConfigApi* configApi);
+  /**
+   * @param cache  if not null, parsed imports are taken from and saved to it.
+   */
+  explicit McImportResolver(ConfigApi* configApi,
+                            McImportCache* cache = nullptr);
 
   /**
    * @throws std::runtime_error if can not load file
    */
-  std::string import(folly::StringPiece path);
+  std::string import(folly::StringPiece path) override;
+
+  /**
+   * @throws std::runtime_error if can not load file
+   */
+  folly::dynamic importJson(folly::StringPiece path) override;
+
+  /**
+   * Loads (and parses, with cache) paths that were not imported yet,
+   * on up to one thread per hardware thread.
+   */
+  void prefetch(const std::vector<std::string>& paths) override;
+
+  /**
+   * @return path => md5 of contents, for every file imported so far.
+   */
+  const std::unordered_map<std::string, std::string>& imports() const {
+    return imports_;
+  }
  private:
+  struct File {
+    std::string contents;
+    std::string md5;
+    // set if prefetched with cache
+    std::shared_ptr<const folly::dynamic> json;
+  };
+
   ConfigApi* configApi_;
+  McImportCache* cache_;
+  std::unordered_map<std::string, std::string> imports_;
+  // loaded by prefetch(), but not imported yet
+  std::unordered_map<std::string, File> prefetched_;
+
+  File load(const std::string& path);
 };
 
 }}} // facebook::memcache::mcrouter
@@ -9,20 +9,32 @@
  */
 #include "McRouteHandleProvider.h"
 
+#include <glog/logging.h>
+
+#include <folly/Conv.h>
+#include <folly/json.h>
 #include <folly/Range.h>
 
 #include "mcrouter/ClientPool.h"
 #include "mcrouter/config.h"
+#include "mcrouter/ConfigObjectCache.h"
+#include "mcrouter/lib/Ch3HashFunc.h"
+#include "mcrouter/lib/Crc32HashFunc.h"
 #include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/lib/routes/HashRoute.h"
+#include "mcrouter/lib/WeightedCh3HashFunc.h"
+#include "mcrouter/McrouterInstance.h"
 #include "mcrouter/PoolFactory.h"
 #include "mcrouter/proxy.h"
 #include "mcrouter/ProxyClientCommon.h"
 #include "mcrouter/ProxyDestinationMap.h"
+#include "mcrouter/routes/BoundedLoadHashRoute.h"
 #include "mcrouter/routes/ExtraRouteHandleProviderIf.h"
 #include "mcrouter/routes/RateLimiter.h"
 #include "mcrouter/routes/ShadowRouteIf.h"
 #include "mcrouter/routes/ShardHashFunc.h"
 #include "mcrouter/routes/ShardSplitter.h"
+#include "mcrouter/RuntimeVarsData.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
@@ -33,16 +45,50 @@ McrouterRouteHandlePtr makeDestinationRoute(
   std::shared_ptr<const ProxyClientCommon> client,
   std::shared_ptr<ProxyDestination> destination);
 
+McrouterRouteHandlePtr makeCollapsingRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json);
+
+McrouterRouteHandlePtr makeCollapsingRoute(McrouterRouteHandlePtr target);
+
+McrouterRouteHandlePtr makeCompressionRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json);
+
+McrouterRouteHandlePtr makeCounterCombiningRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json);
+
 McrouterRouteHandlePtr makeDevNullRoute(const char* name);
 
 McrouterRouteHandlePtr makeFailoverWithExptimeRoute(
   RouteHandleFactory<McrouterRouteHandleIf>& factory,
   const folly::dynamic& json);
 
+McrouterRouteHandlePtr makeHedgedMissFailoverRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json);
+
+McrouterRouteHandlePtr makeHedgedRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json);
+
+McrouterRouteHandlePtr makeHotKeyCacheRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json);
+
+McrouterRouteHandlePtr makeKeyRateLimitRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json);
+
 McrouterRouteHandlePtr makeL1L2CacheRoute(
   RouteHandleFactory<McrouterRouteHandleIf>& factory,
   const folly::dynamic& json);
 
+McrouterRouteHandlePtr makeLeastLoadedRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json);
+
 McrouterRouteHandlePtr makeMigrateRoute(
   RouteHandleFactory<McrouterRouteHandleIf>& factory,
   const folly::dynamic& json);
@@ -63,22 +109,76 @@ McrouterRouteHandlePtr makeOutstandingLimitRoute(
   McrouterRouteHandlePtr normalRoute,
   size_t maxOutstanding);
 
-McrouterRouteHandlePtr makeShardSplitRoute(McrouterRouteHandlePtr rh,
-                                           ShardSplitter);
+McrouterRouteHandlePtr makeShardSplitRoute(
+  McrouterRouteHandlePtr rh,
+  std::shared_ptr<const ShardSplitter> shardSplitter);
+
+McrouterRouteHandlePtr makeSizeSelectorRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json);
 
 McrouterRouteHandlePtr makeWarmUpRoute(
   RouteHandleFactory<McrouterRouteHandleIf>& factory,
   const folly::dynamic& json);
 
+McrouterRouteHandlePtr makeWriteBehindRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json);
+
+namespace {
+
+/**
+ * Replaces weights of func (and of its copies in all proxies) whenever
+ * runtime variable name changes, for as long as func is alive. The value
+ * is a list with a weight for every server, invalid values are ignored.
+ */
+void bindWeights(const WeightedCh3HashFunc& func,
+                 ObservableRuntimeVars& vars,
+                 const std::string& name) {
+  auto setWeights = func.weightsSetter();
+  auto handle = vars.subscribeAndCall(
+    [setWeights, name](std::shared_ptr<const RuntimeVarsData> oldVars,
+                       std::shared_ptr<const RuntimeVarsData> newVars) {
+      if (!newVars) {
+        return;
+      }
+      auto json = newVars->getVariableByName(name);
+      if (json.isNull()) {
+        return;
+      }
+      try {
+        checkLogic(json.isArray(), "weights is not array");
+        std::vector<double> weights;
+        for (const auto& weight : json) {
+          checkLogic(weight.isNumber(), "weight is not number");
+          weights.push_back(weight.asDouble());
+        }
+        setWeights(std::move(weights));
+      } catch (const std::exception& e) {
+        LOG(ERROR) << "Invalid value of runtime variable " << name << ": "
+                   << e.what();
+      }
+    });
+  /* Unsubscribing waits for callbacks in progress, so none runs once func
+     is gone */
+  func.attach(std::shared_ptr<void>(std::move(handle)));
+}
+
+}  // anonymous namespace
+
 McRouteHandleProvider::McRouteHandleProvider(
   proxy_t* proxy,
   ProxyDestinationMap& destinationMap,
-  PoolFactory& poolFactory)
+  PoolFactory& poolFactory,
+  const PoolDestinations* previousPools,
+  ConfigObjectCache* objectCache)
     : RouteHandleProvider<McrouterRouteHandleIf>(),
       proxy_(proxy),
       destinationMap_(destinationMap),
       poolFactory_(poolFactory),
-      extraProvider_(createExtraRouteHandleProvider()) {
+      extraProvider_(createExtraRouteHandleProvider()),
+      previousPools_(previousPools),
+      objectCache_(objectCache) {
 }
 
 McRouteHandleProvider::~McRouteHandleProvider() {
@@ -95,6 +195,15 @@ McRouteHandleProvider::makePool(const folly::dynamic& json) {
     return seenIt->second;
   }
 
+  if (previousPools_) {
+    // Same ClientPool object means the pool didn't change
+    auto prevIt = previousPools_->find(pool->getName());
+    if (prevIt != previousPools_->end() && prevIt->second.first == pool) {
+      pools_.emplace(pool->getName(), prevIt->second);
+      return prevIt->second;
+    }
+  }
+
   std::vector<McrouterRouteHandlePtr> destinations;
   for (const auto& client : pool->getClients()) {
     auto pdstn = destinationMap_.fetch(*client);
@@ -102,7 +211,10 @@ McRouteHandleProvider::makePool(const folly::dynamic& json) {
     destinations.push_back(std::move(route));
   }
 
-  return std::make_pair(std::move(pool), std::move(destinations));
+  auto name = pool->getName();
+  auto result = std::make_pair(std::move(pool), std::move(destinations));
+  pools_.emplace(std::move(name), result);
+  return result;
 }
 
 McrouterRouteHandlePtr
@@ -144,6 +256,15 @@ McrouterRouteHandlePtr McRouteHandleProvider::makePoolRoute(
         }
       }
     }
+    if (auto jcollapse = json.get_ptr("collapse_gets")) {
+      checkLogic(jcollapse->isBool(),
+                 "PoolRoute {}: collapse_gets is not bool", pool->getName());
+      if (jcollapse->asBool()) {
+        for (auto& destination: destinations) {
+          destination = makeCollapsingRoute(std::move(destination));
+        }
+      }
+    }
   }
 
   if (json.isObject() && json.count("shadows")) {
@@ -174,6 +295,9 @@ McrouterRouteHandlePtr McRouteHandleProvider::makePoolRoute(
     jhashWithWeights = folly::dynamic::object
       ("hash_func", WeightedCh3HashFunc::type())
       ("weights", *pool->getWeights());
+    if (!pool->getWeightsRuntimeVar().empty()) {
+      jhashWithWeights["weights_runtime_var"] = pool->getWeightsRuntimeVar();
+    }
   }
 
   if (json.isObject()) {
@@ -194,12 +318,42 @@ McrouterRouteHandlePtr McRouteHandleProvider::makePoolRoute(
   if (json.isObject()) {
     if (proxy_->opts.destination_rate_limiting) {
       if (auto jrates = json.get_ptr("rates")) {
-        route = makeRateLimitRoute(std::move(route), RateLimiter(*jrates));
+        route = makeRateLimitRoute(
+          std::move(route),
+          RateLimiter(*jrates, objectCache_, pool->getName()));
       }
     }
 
-    if (auto jsplits = json.get_ptr("shard_splits")) {
-      route = makeShardSplitRoute(std::move(route), ShardSplitter(*jsplits));
+    auto jsplits = json.get_ptr("shard_splits");
+    if (auto jdynamic = json.get_ptr("shard_splits_dynamic")) {
+      // Splits change with runtime vars and traffic of all proxies, so keep
+      // one splitter per pool for all of them.
+      folly::dynamic jstatic = jsplits ? *jsplits : folly::dynamic::object();
+      auto router = proxy_->router;
+      auto create = [&jstatic, jdynamic, router] {
+        return std::make_shared<ShardSplitter>(
+          jstatic, *jdynamic, router ? &router->rtVarsData() : nullptr);
+      };
+      std::shared_ptr<const ShardSplitter> splitter;
+      if (objectCache_) {
+        splitter = objectCache_->getOrCreateShared<ShardSplitter>(
+          folly::to<std::string>(pool->getName(), ':', folly::toJson(jstatic),
+                                 ':', folly::toJson(*jdynamic)),
+          create);
+      } else {
+        splitter = create();
+      }
+      route = makeShardSplitRoute(std::move(route), std::move(splitter));
+    } else if (jsplits) {
+      std::shared_ptr<const ShardSplitter> splitter;
+      if (objectCache_) {
+        splitter = objectCache_->getOrCreate<ShardSplitter>(
+          folly::to<std::string>(folly::toJson(*jsplits)),
+          [jsplits] { return std::make_shared<ShardSplitter>(*jsplits); });
+      } else {
+        splitter = std::make_shared<ShardSplitter>(*jsplits);
+      }
+      route = makeShardSplitRoute(std::move(route), std::move(splitter));
     }
   }
 
@@ -251,14 +405,34 @@ std::vector<McrouterRouteHandlePtr> McRouteHandleProvider::create(
     // PrefixPolicyRoute is deprecated, but must be preserved for backwards
     // compatibility.
     return { makeOperationSelectorRoute(factory, json) };
+  } else if (type == "CollapsingRoute") {
+    return { makeCollapsingRoute(factory, json) };
+  } else if (type == "CompressionRoute") {
+    return { makeCompressionRoute(factory, json) };
+  } else if (type == "CounterCombiningRoute") {
+    return { makeCounterCombiningRoute(factory, json) };
   } else if (type == "DevNullRoute") {
     return { makeDevNullRoute("devnull") };
   } else if (type == "FailoverWithExptimeRoute") {
     return { makeFailoverWithExptimeRoute(factory, json) };
+  } else if (type == "HedgedMissFailoverRoute") {
+    return { makeHedgedMissFailoverRoute(factory, json) };
+  } else if (type == "HedgedRoute") {
+    return { makeHedgedRoute(factory, json) };
+  } else if (type == "HotKeyCacheRoute") {
+    return { makeHotKeyCacheRoute(factory, json) };
+  } else if (type == "KeyRateLimitRoute") {
+    return { makeKeyRateLimitRoute(factory, json) };
+  } else if (type == "LeastLoadedRoute") {
+    return { makeLeastLoadedRoute(factory, json) };
   } else if (type == "L1L2CacheRoute") {
     return { makeL1L2CacheRoute(factory, json) };
+  } else if (type == "SizeSelectorRoute") {
+    return { makeSizeSelectorRoute(factory, json) };
   } else if (type == "WarmUpRoute") {
     return { makeWarmUpRoute(factory, json) };
+  } else if (type == "WriteBehindRoute") {
+    return { makeWriteBehindRoute(factory, json) };
   } else if (type == "MigrateRoute") {
     return { makeMigrateRoute(factory, json) };
   } else if (type == "ModifyKeyRoute") {
@@ -281,17 +455,73 @@ std::vector<McrouterRouteHandlePtr> McRouteHandleProvider::create(
   return ret;
 }
 
+bool McRouteHandleProvider::isShareable(folly::StringPiece type) const {
+  return type != "CollapsingRoute" &&
+         type != "CounterCombiningRoute" &&
+         type != "HotKeyCacheRoute" &&
+         type != "KeyRateLimitRoute" &&
+         type != "LeastLoadedRoute" &&
+         type != "PoolRoute" &&
+         type != "SizeSelectorRoute";
+}
+
 McrouterRouteHandlePtr McRouteHandleProvider::createHash(
     folly::StringPiece funcType,
     const folly::dynamic& json,
     std::vector<McrouterRouteHandlePtr> children) {
 
+  bool boundedLoad = json.isObject() && json.count("bounded_load_epsilon");
+  if (boundedLoad) {
+    auto n = children.size();
+    if (funcType == Ch3HashFunc::type()) {
+      return makeBoundedLoadHashRoute(json, std::move(children),
+                                      Ch3HashFunc(n));
+    }
+    if (funcType == Crc32HashFunc::type()) {
+      return makeBoundedLoadHashRoute(json, std::move(children),
+                                      Crc32HashFunc(n));
+    }
+    checkLogic(funcType == WeightedCh3HashFunc::type(),
+               "bounded_load_epsilon is not supported by hash function {}",
+               funcType);
+  }
+
   if (funcType == ConstShardHashFunc::type()) {
     return makeRouteHandle<McrouterRouteHandleIf, HashRoute,
                            ConstShardHashFunc>(
       json, std::move(children));
   }
 
+  if (funcType == WeightedCh3HashFunc::type()) {
+    auto n = children.size();
+    std::string weightsVar;
+    if (auto jvar = json.get_ptr("weights_runtime_var")) {
+      checkLogic(jvar->isString(),
+                 "WeightedCh3HashFunc: weights_runtime_var is not string");
+      weightsVar = jvar->stringPiece().str();
+    }
+    auto router = proxy_->router;
+    auto create = [&json, n, &weightsVar, router]
+        () -> std::shared_ptr<const WeightedCh3HashFunc> {
+      auto func = std::make_shared<const WeightedCh3HashFunc>(json, n);
+      if (!weightsVar.empty() && router != nullptr) {
+        bindWeights(*func, router->rtVarsData(), weightsVar);
+      }
+      return func;
+    };
+    // Weights may be large, keep one copy for all proxies.
+    auto func = objectCache_
+      ? objectCache_->getOrCreate<WeightedCh3HashFunc>(
+          folly::to<std::string>(n, ':', folly::toJson(json)), create)
+      : create();
+    if (boundedLoad) {
+      return makeBoundedLoadHashRoute(json, std::move(children), *func);
+    }
+    return makeRouteHandle<McrouterRouteHandleIf, HashRoute,
+                           WeightedCh3HashFunc>(
+      json, std::move(children), *func);
+  }
+
   auto ret = RouteHandleProvider<McrouterRouteHandleIf>::createHash(
     funcType, json, std::move(children));
   checkLogic(ret != nullptr, "Unknown hash function: {}", funcType);
@@ -24,6 +24,7 @@ class dynamic;
 namespace facebook { namespace memcache { namespace mcrouter {
 
 class ClientPool;
+class ConfigObjectCache;
 class ExtraRouteHandleProviderIf;
 class PoolFactory;
 class ProxyClientCommon;
@@ -37,14 +38,35 @@ class proxy_t;
 class McRouteHandleProvider :
   public RouteHandleProvider<McrouterRouteHandleIf> {
  public:
+  // pool name => { ClientPool, destinations }
+  using PoolDestinations = std::unordered_map<std::string,
+    std::pair<std::shared_ptr<ClientPool>,
+              std::vector<McrouterRouteHandlePtr>>>;
+
+  /**
+   * @param previousPools  pools of the config being replaced. Destinations
+   *                       for pools that PoolFactory took from the previous
+   *                       config are reused from here.
+   * @param objectCache  immutable objects (hash functions, shard splits)
+   *                     shared with providers of other proxies. Objects are
+   *                     built per provider if nullptr.
+   */
   McRouteHandleProvider(proxy_t* proxy,
                         ProxyDestinationMap& destinationMap,
-                        PoolFactory& poolFactory);
+                        PoolFactory& poolFactory,
+                        const PoolDestinations* previousPools = nullptr,
+                        ConfigObjectCache* objectCache = nullptr);
 
   std::vector<McrouterRouteHandlePtr>
   create(RouteHandleFactory<McrouterRouteHandleIf>& factory,
          folly::StringPiece type, const folly::dynamic& json) override;
 
+  /**
+   * Routes keeping per-instance state (caches, load, rate limits of pools)
+   * are not shared by identical subtrees.
+   */
+  bool isShareable(folly::StringPiece type) const override;
+
   McrouterRouteHandlePtr
   createHash(folly::StringPiece funcType,
              const folly::dynamic& json,
@@ -55,6 +77,18 @@ class McRouteHandleProvider :
     return std::move(asyncLogRoutes_);
   }
 
+  /**
+   * @return  asynclog route created for a pool so far, nullptr if none
+   */
+  McrouterRouteHandlePtr getAsyncLogRoute(const std::string& name) const {
+    auto it = asyncLogRoutes_.find(name);
+    return it == asyncLogRoutes_.end() ? nullptr : it->second;
+  }
+
+  PoolDestinations releasePools() {
+    return std::move(pools_);
+  }
+
   ~McRouteHandleProvider();
 
  private:
@@ -62,10 +96,9 @@ class McRouteHandleProvider :
   ProxyDestinationMap& destinationMap_;
   PoolFactory& poolFactory_;
   std::unique_ptr<ExtraRouteHandleProviderIf> extraProvider_;
-  // pool name => { ClientPool, destinations }
-  std::unordered_map<std::string,
-    std::pair<std::shared_ptr<ClientPool>,
-              std::vector<McrouterRouteHandlePtr>>> pools_;
+  PoolDestinations pools_;
+  const PoolDestinations* previousPools_;
+  ConfigObjectCache* objectCache_;
 
   // poolName -> AsynclogRoute
   std::unordered_map<std::string, McrouterRouteHandlePtr> asyncLogRoutes_;
@@ -14,6 +14,7 @@
 #include "mcrouter/lib/McOperation.h"
 #include "mcrouter/lib/McReply.h"
 #include "mcrouter/lib/RouteHandleIf.h"
+#include "mcrouter/MemoryUsage.h"
 #include "mcrouter/ProxyMcReply.h"
 #include "mcrouter/ProxyMcRequest.h"
 #include "mcrouter/ProxyRequestContext.h"
@@ -39,6 +40,11 @@ class McrouterRouteHandle :
                   List<ProxyMcRequest>,
                   McOpList>(
                     std::forward<Args>(args)...) {
+    routeHandleMemory().add(sizeof(*this));
+  }
+
+  ~McrouterRouteHandle() {
+    routeHandleMemory().remove(sizeof(*this));
   }
 };
 
@@ -10,6 +10,7 @@
 #pragma once
 
 #include <cctype>
+#include <initializer_list>
 #include <memory>
 #include <string>
 #include <vector>
@@ -46,13 +47,26 @@ namespace facebook { namespace memcache { namespace mcrouter {
  */
 class ModifyKeyRoute {
  public:
-  using ContextPtr = std::shared_ptr<ProxyRequestContext>;
+  using ContextPtr = ProxyRequestContext::Ptr;
 
   static std::string routeName() { return "modify-key"; }
 
   ModifyKeyRoute(RouteHandleFactory<McrouterRouteHandleIf>& factory,
                  const folly::dynamic& json);
 
+  /**
+   * @param routingPrefix  valid routing prefix or "" to strip it,
+   *                       none to keep the request's one
+   * @param keyPrefix  valid key prefix, may be empty
+   */
+  ModifyKeyRoute(McrouterRouteHandlePtr target,
+                 folly::Optional<std::string> routingPrefix,
+                 std::string keyPrefix)
+    : target_(std::move(target)),
+      routingPrefix_(std::move(routingPrefix)),
+      keyPrefix_(std::move(keyPrefix)) {
+  }
+
   template <class Operation, class Request>
   std::vector<McrouterRouteHandlePtr>
   couldRouteTo(const Request& req, Operation, const ContextPtr& ctx) const {
@@ -67,11 +81,11 @@ class ModifyKeyRoute {
       : req.routingPrefix();
 
     if (!req.keyWithoutRoute().startsWith(keyPrefix_)) {
-      auto key = folly::to<std::string>(rp, keyPrefix_, req.keyWithoutRoute());
-      return routeReqWithKey(req, key, Operation(), ctx);
+      return routeReqWithKey(req, {rp, keyPrefix_, req.keyWithoutRoute()},
+                             Operation(), ctx);
     } else if (routingPrefix_.hasValue() && rp != req.routingPrefix()) {
-      auto key = folly::to<std::string>(rp, req.keyWithoutRoute());
-      return routeReqWithKey(req, key, Operation(), ctx);
+      return routeReqWithKey(req, {rp, req.keyWithoutRoute()},
+                             Operation(), ctx);
     }
     return target_->route(req, Operation(), ctx);
   }
@@ -83,17 +97,19 @@ class ModifyKeyRoute {
 
   template <class Operation, class Request>
   typename ReplyType<Operation, Request>::type
-  routeReqWithKey(const Request& req, folly::StringPiece key, Operation,
-                  const ContextPtr& ctx) const {
+  routeReqWithKey(const Request& req,
+                  std::initializer_list<folly::StringPiece> keyParts,
+                  Operation, const ContextPtr& ctx) const {
     typedef typename ReplyType<Operation, Request>::type Reply;
 
-    auto err = mc_client_req_key_check(to<nstring_t>(key));
+    auto cloneReq = req.clone();
+    cloneReq.setKeyFromParts(keyParts);
+
+    auto err = cloneReq.keyError();
     if (err != mc_req_err_valid) {
       return Reply(ErrorReply, "ModifyKeyRoute: invalid key: " +
           std::string(mc_req_err_to_string(err)));
     }
-    auto cloneReq = req.clone();
-    cloneReq.setKey(key);
     return target_->route(cloneReq, Operation(), ctx);
   }
 };
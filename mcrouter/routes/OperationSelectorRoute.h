@@ -24,7 +24,7 @@ namespace facebook { namespace memcache { namespace mcrouter {
 /* RouteHandle that can send to a different target based on McOperation id */
 class OperationSelectorRoute {
  public:
-  using ContextPtr = std::shared_ptr<ProxyRequestContext>;
+  using ContextPtr = ProxyRequestContext::Ptr;
 
   static std::string routeName() { return "operation-selector"; }
 
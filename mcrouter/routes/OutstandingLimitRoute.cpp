@@ -9,8 +9,65 @@
  */
 #include "mcrouter/routes/OutstandingLimitRoute.h"
 
+#include <algorithm>
+#include <tuple>
+#include <utility>
+
 namespace facebook { namespace memcache { namespace mcrouter {
 
+constexpr size_t OutstandingLimitRoute::kMaxIdleSenders;
+
+void OutstandingLimitRoute::block(Waiter& waiter, SenderQueue& ownQueue,
+                                  uint64_t senderId, uint32_t weight) {
+  auto queue = &ownQueue;
+  if (senderId) {
+    auto it = senders_.find(senderId);
+    if (it == senders_.end()) {
+      it = senders_.emplace(std::piecewise_construct,
+                            std::forward_as_tuple(senderId),
+                            std::forward_as_tuple(senderId)).first;
+    }
+    queue = &it->second;
+  }
+
+  queue->weight = std::max<uint32_t>(weight, 1);
+  if (queue->waiters.empty()) {
+    if (queue->idleHook.is_linked()) {
+      idle_.erase(idle_.iterator_to(*queue));
+      --numIdle_;
+    }
+    queue->deficit = queue->weight;
+    active_.push_back(*queue);
+  }
+  queue->waiters.push_back(waiter);
+}
+
+void OutstandingLimitRoute::releaseNext() {
+  auto& queue = active_.front();
+  assert(!queue.waiters.empty());
+  auto& waiter = queue.waiters.front();
+  queue.waiters.pop_front();
+
+  if (--queue.deficit == 0 || queue.waiters.empty()) {
+    active_.pop_front();
+    if (!queue.waiters.empty()) {
+      queue.deficit = queue.weight;
+      active_.push_back(queue);
+    } else if (queue.senderId) {
+      idle_.push_back(queue);
+      if (++numIdle_ > kMaxIdleSenders) {
+        auto& oldest = idle_.front();
+        idle_.pop_front();
+        --numIdle_;
+        senders_.erase(oldest.senderId);
+      }
+    }
+  }
+
+  /* The waiter (and its queue, if it's its own) may be gone after this */
+  waiter.baton.post();
+}
+
 McrouterRouteHandlePtr makeOutstandingLimitRoute(
   McrouterRouteHandlePtr normalRoute,
   size_t maxOutstanding) {
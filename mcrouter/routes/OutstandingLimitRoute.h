@@ -9,10 +9,11 @@
  */
 #pragma once
 
-#include <list>
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
+#include <folly/IntrusiveList.h>
 #include <folly/ScopeGuard.h>
 #include <folly/experimental/fibers/Baton.h>
 
@@ -25,12 +26,20 @@ namespace facebook { namespace memcache { namespace mcrouter {
 
 /*
  * No more than N requests will be allowed to be concurrently processed by child
- * route. All blocked requests will be sent one request per sender id in
- * round-robin fashion to guarantee fairness.
+ * route. Blocked requests are released by deficit round robin over sender ids:
+ * in each round a sender gets as many requests through as its weight
+ * (ProxyRequestContext::senderWeight()). Requests without a sender id are
+ * each a sender of their own.
+ *
+ * Blocked requests wait on their own fiber stacks. Queues of senders that
+ * went idle are kept for reuse (up to kMaxIdleSenders of them), so blocking
+ * is O(1) and doesn't allocate for senders that were seen recently.
  */
 class OutstandingLimitRoute {
  public:
-  using ContextPtr = std::shared_ptr<ProxyRequestContext>;
+  using ContextPtr = ProxyRequestContext::Ptr;
+
+  static constexpr size_t kMaxIdleSenders = 1024;
 
   static std::string routeName() { return "outstanding-limit"; }
 
@@ -49,42 +58,19 @@ class OutstandingLimitRoute {
   typename ReplyType<Operation, Request>::type
   route(const Request& req, Operation, const ContextPtr& ctx) {
     if (outstanding_ == maxOutstanding_) {
-      auto senderId = ctx->senderId();
-      auto& entry = [&]() -> QueueEntry& {
-        auto entry_it = senderIdToEntry_.find(senderId);
-        if (entry_it != senderIdToEntry_.end()) {
-          return *entry_it->second;
-        }
-        blockedRequests_.push_back(folly::make_unique<QueueEntry>(senderId));
-        if (senderId) {
-          senderIdToEntry_[senderId] = blockedRequests_.back().get();
-        }
-        return *blockedRequests_.back();
-      }();
-
-      folly::fibers::Baton baton;
-      entry.batons.push_back(&baton);
-      baton.wait();
+      Waiter waiter;
+      /* Used if there's no sender id */
+      SenderQueue ownQueue(0);
+      block(waiter, ownQueue, ctx->senderId(), ctx->senderWeight());
+      waiter.baton.wait();
     } else {
       outstanding_++;
       assert(outstanding_ <= maxOutstanding_);
     }
 
     SCOPE_EXIT {
-      if (!blockedRequests_.empty()) {
-        auto entry = std::move(blockedRequests_.front());
-        blockedRequests_.pop_front();
-
-        assert(!entry->batons.empty());
-
-        entry->batons.front()->post();
-        entry->batons.pop_front();
-
-        if (!entry->batons.empty()) {
-          blockedRequests_.push_back(std::move(entry));
-        } else {
-          senderIdToEntry_.erase(entry->senderId);
-        }
+      if (!active_.empty()) {
+        releaseNext();
       } else {
         outstanding_--;
       }
@@ -94,22 +80,44 @@ class OutstandingLimitRoute {
   }
 
  private:
+  struct Waiter {
+    folly::fibers::Baton baton;
+    folly::IntrusiveListHook hook;
+  };
+
+  struct SenderQueue {
+    explicit SenderQueue(uint64_t senderId_) : senderId(senderId_) {
+    }
+    SenderQueue(const SenderQueue&) = delete;
+    SenderQueue& operator=(const SenderQueue&) = delete;
+
+    const uint64_t senderId;
+    uint32_t weight{1};
+    /* Requests left in the current round */
+    uint32_t deficit{0};
+    folly::IntrusiveListHook activeHook;
+    folly::IntrusiveListHook idleHook;
+    folly::IntrusiveList<Waiter, &Waiter::hook> waiters;
+  };
+
   const McrouterRouteHandlePtr target_;
   const size_t maxOutstanding_;
   size_t outstanding_{0};
 
-  struct QueueEntry {
-    QueueEntry(QueueEntry&&) = delete;
-    QueueEntry& operator=(QueueEntry&&) = delete;
+  /* Senders with blocked requests, in round robin order */
+  folly::IntrusiveList<SenderQueue, &SenderQueue::activeHook> active_;
+  /* Senders without blocked requests, least recently active first */
+  folly::IntrusiveList<SenderQueue, &SenderQueue::idleHook> idle_;
+  size_t numIdle_{0};
+  std::unordered_map<uint64_t, SenderQueue> senders_;
 
-    explicit QueueEntry(size_t senderId_) : senderId(senderId_) {
-    }
-    size_t senderId;
-    std::list<folly::fibers::Baton*> batons;
-  };
+  void block(Waiter& waiter, SenderQueue& ownQueue, uint64_t senderId,
+             uint32_t weight);
 
-  std::list<std::unique_ptr<QueueEntry>> blockedRequests_;
-  std::unordered_map<size_t, QueueEntry*> senderIdToEntry_;
+  /**
+   * Passes the slot of a finished request on to the next blocked one.
+   */
+  void releaseNext();
 };
 
 }}}  // facebook::memcache::mcrouter
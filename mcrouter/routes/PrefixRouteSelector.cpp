@@ -16,42 +16,61 @@
 
 #include "mcrouter/lib/config/RouteHandleFactory.h"
 #include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/MemoryUsage.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
 PrefixRouteSelector::PrefixRouteSelector(
     RouteHandleFactory<McrouterRouteHandleIf>& factory,
-    const folly::dynamic& json) {
+    const folly::dynamic& json)
+  : PrefixRouteSelector(json, [&factory](const folly::dynamic& route) {
+      return factory.create(route);
+    }) {
+}
+
+PrefixRouteSelector::PrefixRouteSelector(
+    const folly::dynamic& json,
+    const std::function<std::shared_ptr<McrouterRouteHandleIf>(
+      const folly::dynamic&)>& createRoute) {
   // if json is not PrefixRouteSelector, just treat it as RouteHandle
   // for wildcard.
   // NOTE: "route" is deprecated and will go away soon
   if (!json.isObject() || !json.count("type") || !json["type"].isString() ||
       (json["type"].asString() != "route" &&
        json["type"].asString() != "PrefixSelectorRoute")) {
-    wildcard = factory.create(json);
+    wildcard = createRoute(json);
     return;
   }
 
   if (json.count("policies")) {
     const auto& jpolicies = json["policies"];
     checkLogic(jpolicies.isObject(), "route policies should be object");
-    std::map<std::string, folly::dynamic> items;
+    std::map<std::string, const folly::dynamic*> items;
     for (const auto& it : jpolicies.items()) {
       checkLogic(it.first.isString(), "route key should be string");
       auto key = it.first.asString().toStdString();
-      items.insert(std::make_pair(key, it.second));
+      items.insert(std::make_pair(key, &it.second));
     }
     // order is important
     for (const auto& it : items) {
-      policies.emplace(it.first, factory.create(it.second));
+      policies.emplace(it.first, createRoute(*it.second));
     }
   }
 
   if (json.count("wildcard")) {
-    wildcard = factory.create(json["wildcard"]);
+    wildcard = createRoute(json["wildcard"]);
   }
 
   checkLogic(json.count("wildcard") || json.count("policies"), "Empty route");
+
+  memoryUsage_ = policies.memoryUsage();
+  routingTableMemory().add(memoryUsage_);
+}
+
+PrefixRouteSelector::~PrefixRouteSelector() {
+  if (memoryUsage_ != 0) {
+    routingTableMemory().remove(memoryUsage_);
+  }
 }
 
 }}}  // facebook::memcache::mcrouter
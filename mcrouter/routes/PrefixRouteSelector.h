@@ -9,6 +9,7 @@
  */
 #pragma once
 
+#include <functional>
 #include <memory>
 
 #include "mcrouter/lib/fbi/cpp/Trie.h"
@@ -40,6 +41,24 @@ class PrefixRouteSelector {
 
   PrefixRouteSelector(RouteHandleFactory<McrouterRouteHandleIf>& factory,
                       const folly::dynamic& json);
+
+  /**
+   * @param createRoute  creates the RouteHandle of wildcard and of each
+   *                     policy from its json
+   */
+  PrefixRouteSelector(
+    const folly::dynamic& json,
+    const std::function<std::shared_ptr<McrouterRouteHandleIf>(
+      const folly::dynamic&)>& createRoute);
+
+  ~PrefixRouteSelector();
+
+ private:
+  /* policies built from json, accounted in routingTableMemory() */
+  size_t memoryUsage_{0};
+
+  PrefixRouteSelector(const PrefixRouteSelector&) = delete;
+  PrefixRouteSelector& operator=(const PrefixRouteSelector&) = delete;
 };
 
 }}}  // facebook::memcache::mcrouter
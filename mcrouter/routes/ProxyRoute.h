@@ -41,7 +41,7 @@ class ProxyRoute {
  private:
   ProxyMcReply dispatchMcMsgHelper(
     McMsgRef&& msg,
-    std::shared_ptr<ProxyRequestContext> ctx,
+    ProxyRequestContext::Ptr ctx,
     McOpList::Item<0>) const {
 
     throw std::runtime_error("dispatch for requested op not implemented");
@@ -50,7 +50,7 @@ class ProxyRoute {
   template <int op_id>
   ProxyMcReply dispatchMcMsgHelper(
     McMsgRef&& msg,
-    const std::shared_ptr<ProxyRequestContext>& ctx,
+    const ProxyRequestContext::Ptr& ctx,
     McOpList::Item<op_id>) const {
 
     if (msg->op == McOpList::Item<op_id>::op::mc_op) {
@@ -67,17 +67,34 @@ class ProxyRoute {
 
   ProxyRoute(proxy_t* proxy, const RouteSelectorMap& routeSelectors)
       : proxy_(proxy) {
-    root_ = std::make_shared<McrouterRouteHandle<RootRoute>>(
+    auto root = std::make_shared<McrouterRouteHandle<RootRoute>>(
       proxy_, routeSelectors);
+    rootRoute_ = &root->routeImpl();
+    root_ = std::move(root);
     if (proxy_->opts.big_value_split_threshold != 0) {
-      BigValueRouteOptions options(proxy_->opts.big_value_split_threshold);
+      BigValueRouteOptions options(
+        proxy_->opts.big_value_split_threshold,
+        proxy_->opts.big_value_max_inflight_chunks,
+        proxy_->opts.big_value_content_chunking);
       root_ = makeBigValueRoute(std::move(root_), std::move(options));
+      /* Big values are split into several requests */
+      rootRoute_ = nullptr;
     }
   }
 
+  /**
+   * @return  true if msg's route completes without waiting on anything
+   *          (see McrouterRouteHandleIf::completesInline()), so that it
+   *          can be dispatched outside of a fiber.
+   */
+  bool completesInline(const McMsgRef& msg) const {
+    return rootRoute_ != nullptr && msg->op != mc_op_flushall &&
+      rootRoute_->completesInline(to<folly::StringPiece>(msg->key));
+  }
+
   ProxyMcReply dispatchMcMsg(
     McMsgRef&& msg,
-    const std::shared_ptr<ProxyRequestContext>& ctx) const {
+    const ProxyRequestContext::Ptr& ctx) const {
 
     return dispatchMcMsgHelper(std::move(msg), ctx, McOpList::LastItem());
   }
@@ -85,7 +102,7 @@ class ProxyRoute {
   template <class Operation, class Request>
   std::vector<McrouterRouteHandlePtr> couldRouteTo(
     const Request& req, Operation,
-    const std::shared_ptr<ProxyRequestContext>& ctx) const {
+    const ProxyRequestContext::Ptr& ctx) const {
 
     return { root_ };
   }
@@ -93,14 +110,24 @@ class ProxyRoute {
   template <class Operation, class Request>
   typename ReplyType<Operation, Request>::type route(
     const Request& req, Operation,
-    const std::shared_ptr<ProxyRequestContext>& ctx) const {
-    return root_->route(req, Operation(), ctx);
+    const ProxyRequestContext::Ptr& ctx) const {
+    if (ctx->recording()) {
+      return root_->route(req, Operation(), ctx);
+    }
+    auto startTimeUs = nowUs();
+    auto reply = root_->route(req, Operation(), ctx);
+    folly::StringPiece prefix = req.routingPrefix();
+    if (prefix.empty()) {
+      prefix = proxy_->opts.default_route;
+    }
+    proxy_->routeLatencies.record(prefix, nowUs() - startTimeUs);
+    return reply;
   }
 
   template <class Request>
   typename ReplyType<McOperation<mc_op_flushall>, Request>::type route(
     const Request& req, McOperation<mc_op_flushall> op,
-    const std::shared_ptr<ProxyRequestContext>& ctx) const {
+    const ProxyRequestContext::Ptr& ctx) const {
 
     // route to all clients in the config
     std::vector<McrouterRouteHandlePtr> rh;
@@ -116,6 +143,8 @@ class ProxyRoute {
  private:
   proxy_t* proxy_;
   McrouterRouteHandlePtr root_;
+  /* RootRoute wrapped by root_, nullptr if root_ is another route */
+  const RootRoute* rootRoute_{nullptr};
 };
 
 }}}  // facebook::memcache::mcrouter
@@ -26,7 +26,7 @@ namespace facebook { namespace memcache { namespace mcrouter {
  */
 class RateLimitRoute {
  public:
-  using ContextPtr = std::shared_ptr<ProxyRequestContext>;
+  using ContextPtr = ProxyRequestContext::Ptr;
 
   static std::string routeName() { return "rate-limit"; }
 
@@ -9,10 +9,14 @@
  */
 #include "RateLimiter.h"
 
+#include <algorithm>
 #include <string>
 
+#include <folly/Conv.h>
 #include <folly/dynamic.h>
+#include <folly/json.h>
 
+#include "mcrouter/ConfigObjectCache.h"
 #include "mcrouter/lib/fbi/cpp/util.h"
 
 using folly::dynamic;
@@ -41,28 +45,57 @@ double asPositiveDoubleDefault(const dynamic& obj, const string& keyName,
 
 }  // namespace
 
-RateLimiter::RateLimiter(const folly::dynamic& json) {
-  checkLogic(json.isObject(), "RateLimiter settings json is not an object");
+constexpr double RateLimiter::kMaxSharedBatch;
 
-  auto now = TokenBucket::defaultClockNow();
+RateLimiter::RateLimiter(const folly::dynamic& json,
+                         ConfigObjectCache* objectCache,
+                         const std::string& name) {
+  checkLogic(json.isObject(), "RateLimiter settings json is not an object");
 
-  if (json.count("gets_rate")) {
-    double rate = asPositiveDouble(json, "gets_rate");
-    double burst = asPositiveDoubleDefault(json, "gets_burst", rate);
-    getsTb_ = TokenBucket(rate, burst, now);
+  if (json.count("shared")) {
+    checkLogic(json["shared"].isBool(), "shared is not a bool");
+    if (!json["shared"].asBool()) {
+      objectCache = nullptr;
+    }
+  } else {
+    objectCache = nullptr;
   }
 
-  if (json.count("sets_rate")) {
-    double rate = asPositiveDouble(json, "sets_rate");
-    double burst = asPositiveDoubleDefault(json, "sets_burst", rate);
-    setsTb_ = TokenBucket(rate, burst, now);
-  }
+  getsTb_ = makeBucket(json, "gets", objectCache, name);
+  setsTb_ = makeBucket(json, "sets", objectCache, name);
+  deletesTb_ = makeBucket(json, "deletes", objectCache, name);
+}
 
-  if (json.count("deletes_rate")) {
-    double rate = asPositiveDouble(json, "deletes_rate");
-    double burst = asPositiveDoubleDefault(json, "deletes_burst", rate);
-    deletesTb_ = TokenBucket(rate, burst, now);
+folly::Optional<RateLimiter::Bucket> RateLimiter::makeBucket(
+    const folly::dynamic& json,
+    const std::string& type,
+    ConfigObjectCache* objectCache,
+    const std::string& name) {
+  auto rateKey = type + "_rate";
+  if (!json.count(rateKey)) {
+    return folly::none;
   }
+  double rate = asPositiveDouble(json, rateKey);
+  double burst = asPositiveDoubleDefault(json, type + "_burst", rate);
+  if (objectCache == nullptr) {
+    return Bucket(rate, burst, TokenBucket::defaultClockNow());
+  }
+
+  double batch = asPositiveDoubleDefault(
+    json, "shared_batch", std::max(1.0, std::min(rate / 100, kMaxSharedBatch)));
+  batch = std::min(batch, burst);
+
+  auto key = folly::to<std::string>(name, ":", type, ":",
+                                    folly::toJson(json));
+  auto shared = objectCache->getOrCreateShared<DynamicAtomicTokenBucket>(
+    key,
+    [rate, burst] {
+      auto bucket = std::make_shared<DynamicAtomicTokenBucket>();
+      /* Starts out empty, like TokenBucket */
+      bucket->consumeOrDrain(burst, rate, burst);
+      return bucket;
+    });
+  return Bucket(std::move(shared), rate, burst, batch);
 }
 
 }}}  // facebook::memcache::mcrouter
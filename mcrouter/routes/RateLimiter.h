@@ -9,8 +9,12 @@
  */
 #pragma once
 
+#include <memory>
+#include <string>
+
 #include <folly/Optional.h>
 
+#include "mcrouter/AtomicTokenBucket.h"
 #include "mcrouter/lib/McOperationTraits.h"
 #include "mcrouter/TokenBucket.h"
 
@@ -20,6 +24,8 @@ class dynamic;
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
+class ConfigObjectCache;
+
 /**
  * This is a container for TokenBucket rate limiters for different
  * operation types.
@@ -39,25 +45,40 @@ class RateLimiter {
    *              performed for that operation.
    *              If some *_burst key is missing, burst is set
    *              equal to rate.
+   *
+   *              With "shared": true, the limits are for all proxies
+   *              together instead of each proxy: the rate limiters of all
+   *              proxies built with the same objectCache and name take
+   *              tokens from the same DynamicAtomicTokenBucket, up to
+   *              "shared_batch" tokens at a time (1% of the rate by
+   *              default, at most the burst and kMaxSharedBatch).
+   *              Without objectCache the limits stay per proxy.
+   *
+   * @param name  identifies the route among the routes of a config,
+   *              e.g. pool name.
    */
-  explicit RateLimiter(const folly::dynamic& json);
+  explicit RateLimiter(const folly::dynamic& json,
+                       ConfigObjectCache* objectCache = nullptr,
+                       const std::string& name = "");
+
+  static constexpr double kMaxSharedBatch = 16.0;
 
   template <class Operation>
   bool canPassThrough(Operation, typename GetLike<Operation>::Type = 0) {
     return LIKELY(
-      !getsTb_ || getsTb_->consume(1.0, TokenBucket::defaultClockNow()));
+      !getsTb_ || getsTb_->consume(TokenBucket::defaultClockNow()));
   }
 
   template <class Operation>
   bool canPassThrough(Operation, typename UpdateLike<Operation>::Type = 0) {
     return LIKELY(
-      !setsTb_ || setsTb_->consume(1.0, TokenBucket::defaultClockNow()));
+      !setsTb_ || setsTb_->consume(TokenBucket::defaultClockNow()));
   }
 
   template <class Operation>
   bool canPassThrough(Operation, typename DeleteLike<Operation>::Type = 0) {
     return LIKELY(
-      !deletesTb_ || deletesTb_->consume(1.0, TokenBucket::defaultClockNow()));
+      !deletesTb_ || deletesTb_->consume(TokenBucket::defaultClockNow()));
   }
 
   template <class Operation>
@@ -69,9 +90,56 @@ class RateLimiter {
   }
 
  private:
-  folly::Optional<TokenBucket> getsTb_;
-  folly::Optional<TokenBucket> setsTb_;
-  folly::Optional<TokenBucket> deletesTb_;
+  /**
+   * Either a TokenBucket of this rate limiter, or a shared bucket that
+   * tokens are taken from in batches.
+   */
+  class Bucket {
+   public:
+    Bucket(double rate, double burst, double now)
+      : local_(TokenBucket(rate, burst, now)) {
+    }
+
+    Bucket(std::shared_ptr<DynamicAtomicTokenBucket> shared,
+           double rate, double burst, double batch)
+      : shared_(std::move(shared)),
+        rate_(rate),
+        burst_(burst),
+        batch_(batch) {
+    }
+
+    bool consume(double now) {
+      if (local_) {
+        return local_->consume(1.0, now);
+      }
+      if (cached_ < 1.0) {
+        cached_ += shared_->consumeOrDrain(batch_, rate_, burst_, now);
+        if (cached_ < 1.0) {
+          return false;
+        }
+      }
+      cached_ -= 1.0;
+      return true;
+    }
+
+   private:
+    folly::Optional<TokenBucket> local_;
+    std::shared_ptr<DynamicAtomicTokenBucket> shared_;
+    double rate_{0.0};
+    double burst_{0.0};
+    double batch_{0.0};
+    /* Tokens taken from shared_ and not consumed yet */
+    double cached_{0.0};
+  };
+
+  folly::Optional<Bucket> getsTb_;
+  folly::Optional<Bucket> setsTb_;
+  folly::Optional<Bucket> deletesTb_;
+
+  static folly::Optional<Bucket> makeBucket(const folly::dynamic& json,
+                                            const std::string& type,
+                                            ConfigObjectCache* objectCache,
+                                            const std::string& name);
 };
 
 }}}  // facebook::memcache::mcrouter
@@ -38,7 +38,7 @@ class RootRoute {
   template <class Operation, class Request>
   std::vector<McrouterRouteHandlePtr> couldRouteTo(
     const Request& req, Operation,
-    const std::shared_ptr<ProxyRequestContext>& ctx) const {
+    const ProxyRequestContext::Ptr& ctx) const {
 
     const auto* rhPtr =
       rhMap_.getTargetsForKeyFast(req.routingPrefix(), req.routingKey());
@@ -48,10 +48,22 @@ class RootRoute {
     return *rhPtr;
   }
 
+  /**
+   * @return  true if a request with this key is routed to a single
+   *          route that completesInline() (or to none, i.e. an error).
+   */
+  bool completesInline(folly::StringPiece key) const {
+    auto keys = McRequestBase::splitRoutingKey(key);
+    const auto* rhPtr = rhMap_.getTargetsForKeyFast(keys.first, keys.second);
+    return rhPtr != nullptr &&
+      (rhPtr->empty() ||
+       (rhPtr->size() == 1 && (*rhPtr)[0]->completesInline()));
+  }
+
   template <class Operation, class Request>
   typename ReplyType<Operation, Request>::type route(
     const Request& req, Operation,
-    const std::shared_ptr<ProxyRequestContext>& ctx) const {
+    const ProxyRequestContext::Ptr& ctx) const {
 
     typedef typename ReplyType<Operation, Request>::type Reply;
 
@@ -86,7 +98,7 @@ class RootRoute {
   typename ReplyType<Operation, Request>::type routeImpl(
     const std::vector<McrouterRouteHandlePtr>& rh,
     const Request& req, Operation,
-    const std::shared_ptr<ProxyRequestContext>& ctx,
+    const ProxyRequestContext::Ptr& ctx,
     typename GetLike<Operation>::Type = 0) const {
 
     auto reply = doRoute(rh, req, Operation(), ctx);
@@ -106,7 +118,7 @@ class RootRoute {
   typename ReplyType<Operation, Request>::type routeImpl(
     const std::vector<McrouterRouteHandlePtr>& rh,
     const Request& req, Operation,
-    const std::shared_ptr<ProxyRequestContext>& ctx,
+    const ProxyRequestContext::Ptr& ctx,
     typename ArithmeticLike<Operation>::Type = 0)
     const {
 
@@ -121,7 +133,7 @@ class RootRoute {
   typename ReplyType<Operation, Request>::type routeImpl(
     const std::vector<McrouterRouteHandlePtr>& rh,
     const Request& req, Operation,
-    const std::shared_ptr<ProxyRequestContext>& ctx,
+    const ProxyRequestContext::Ptr& ctx,
     OtherThanT(Operation, GetLike<>, ArithmeticLike<>) = 0)
     const {
 
@@ -132,7 +144,7 @@ class RootRoute {
   typename ReplyType<Operation, Request>::type doRoute(
     const std::vector<McrouterRouteHandlePtr>& rh,
     const Request& req, Operation,
-    const std::shared_ptr<ProxyRequestContext>& ctx) const {
+    const ProxyRequestContext::Ptr& ctx) const {
 
     if (rh.empty()) {
       return ErrorRoute<McrouterRouteHandleIf>().route(req, Operation(), ctx);
@@ -98,15 +98,20 @@ RouteHandleMap::RouteHandleMap(
   // create corresponding RoutePolicyMaps
   UniqueVectorMap uniqueVectors;
   allRoutes_ = makePolicyMap(uniqueVectors, allRoutes);
+  std::unordered_map<std::string, std::shared_ptr<RoutePolicyMap>> policies;
   for (const auto& it : byRegion) {
-    byRegion_.emplace(it.first, makePolicyMap(uniqueVectors, it.second));
+    policies.emplace(it.first, makePolicyMap(uniqueVectors, it.second));
   }
+  byRegion_ = FlatStringMap<std::shared_ptr<RoutePolicyMap>>(policies);
+  policies.clear();
   for (const auto& it : byRoute) {
-    byRoute_.emplace(it.first, makePolicyMap(uniqueVectors, it.second));
+    policies.emplace(it.first, makePolicyMap(uniqueVectors, it.second));
   }
+  byRoute_ = FlatStringMap<std::shared_ptr<RoutePolicyMap>>(policies);
 
-  assert(byRoute_.find(defaultRoute_) != byRoute_.end());
-  defaultRouteMap_ = byRoute_[defaultRoute_];
+  auto defaultIt = byRoute_.find(defaultRoute_);
+  assert(defaultIt != byRoute_.end());
+  defaultRouteMap_ = defaultIt->second;
 }
 
 void RouteHandleMap::foreachRoutePolicy(folly::StringPiece prefix,
@@ -178,6 +183,29 @@ RouteHandleMap::getTargetsForKeySlow(folly::StringPiece prefix,
   return result;
 }
 
+const RouteHandleMap::CachedPrefix*
+RouteHandleMap::findCachedPrefix(folly::StringPiece prefix) const {
+  for (size_t i = 0; i < numCachedPrefixes_; ++i) {
+    if (prefixCache_[i].prefix == prefix) {
+      return &prefixCache_[i];
+    }
+  }
+  return nullptr;
+}
+
+void RouteHandleMap::cachePrefix(folly::StringPiece prefix,
+                                 const RoutePolicyMap* policyMap) const {
+  size_t i;
+  if (numCachedPrefixes_ < kPrefixCacheSize) {
+    i = numCachedPrefixes_++;
+  } else {
+    i = nextCachedPrefix_;
+    nextCachedPrefix_ = (nextCachedPrefix_ + 1) % kPrefixCacheSize;
+  }
+  prefixCache_[i].prefix.assign(prefix.data(), prefix.size());
+  prefixCache_[i].policyMap = policyMap;
+}
+
 const std::vector<McrouterRouteHandlePtr>*
 RouteHandleMap::getTargetsForKeyFast(folly::StringPiece prefix,
                                      folly::StringPiece key) const {
@@ -188,22 +216,34 @@ RouteHandleMap::getTargetsForKeyFast(folly::StringPiece prefix,
   } else if (prefix == "/*/*/") {
     // route to all routes
     result = &allRoutes_->getTargetsForKey(key);
+  } else if (auto cached = findCachedPrefix(prefix)) {
+    result = cached->policyMap == nullptr
+      ? &emptyV_
+      : &cached->policyMap->getTargetsForKey(key);
   } else {
     auto starPos = prefix.find("*");
+    const RoutePolicyMap* policyMap = nullptr;
     if (starPos == std::string::npos) {
       // no stars at all
       auto it = byRoute_.find(prefix);
-      result = it == byRoute_.end()
-        ? &emptyV_
-        : &it->second->getTargetsForKey(key);
+      if (it != byRoute_.end()) {
+        policyMap = it->second.get();
+      }
     } else if (prefix.endsWith("/*/") && starPos == prefix.size() - 2) {
       // route to all clusters of some region (/region/*/)
       auto region = prefix.subpiece(1, prefix.size() - 4);
       auto it = byRegion_.find(region);
-      result = it == byRegion_.end()
-        ? &emptyV_
-        : &it->second->getTargetsForKey(key);
+      if (it != byRegion_.end()) {
+        policyMap = it->second.get();
+      }
+    } else {
+      // arbitrary wildcards, see getTargetsForKeySlow()
+      return nullptr;
     }
+    cachePrefix(prefix, policyMap);
+    result = policyMap == nullptr
+      ? &emptyV_
+      : &policyMap->getTargetsForKey(key);
   }
   if (sendInvalidRouteToDefault_ && result != nullptr && result->empty()) {
     return &defaultRouteMap_->getTargetsForKey(key);
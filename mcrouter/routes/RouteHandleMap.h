@@ -9,15 +9,16 @@
  */
 #pragma once
 
+#include <array>
 #include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
-#include <folly/experimental/StringKeyedUnorderedMap.h>
 #include <folly/Range.h>
 
 #include "mcrouter/config.h"
+#include "mcrouter/lib/fbi/cpp/FlatStringMap.h"
 #include "mcrouter/routes/McrouterRouteHandle.h"
 #include "mcrouter/routes/RouteSelectorMap.h"
 
@@ -27,9 +28,16 @@ class RoutePolicyMap;
 class RoutingPrefix;
 
 /* A bridge between proxy_* config structures and corresponding route handles.
-   It is initialized by RouteHandleMapBuilder. */
+   It is initialized by RouteHandleMapBuilder.
+
+   Remembers the last few routing prefixes it resolved: clients mostly send
+   a single prefix, so most requests skip the wildcard parsing and map
+   lookups. The map is part of a proxy's config, so the cache goes away
+   with the config and needs no invalidation. Proxy thread only. */
 class RouteHandleMap {
  public:
+  static constexpr size_t kPrefixCacheSize = 4;
+
   RouteHandleMap(const RouteSelectorMap& routeSelectors,
                  const RoutingPrefix& defaultRoute,
                  bool sendInvalidRouteToDefault);
@@ -59,8 +67,23 @@ class RouteHandleMap {
   std::shared_ptr<RoutePolicyMap> defaultRouteMap_;
 
   std::shared_ptr<RoutePolicyMap> allRoutes_;
-  folly::StringKeyedUnorderedMap<std::shared_ptr<RoutePolicyMap>> byRegion_;
-  folly::StringKeyedUnorderedMap<std::shared_ptr<RoutePolicyMap>> byRoute_;
+  /* Looked up on every request, so flat */
+  FlatStringMap<std::shared_ptr<RoutePolicyMap>> byRegion_;
+  FlatStringMap<std::shared_ptr<RoutePolicyMap>> byRoute_;
+
+  struct CachedPrefix {
+    std::string prefix;
+    /* nullptr if the prefix matches no route */
+    const RoutePolicyMap* policyMap{nullptr};
+  };
+  mutable std::array<CachedPrefix, kPrefixCacheSize> prefixCache_;
+  mutable size_t numCachedPrefixes_{0};
+  /* Replaced next once the cache is full, round robin */
+  mutable size_t nextCachedPrefix_{0};
+
+  const CachedPrefix* findCachedPrefix(folly::StringPiece prefix) const;
+  void cachePrefix(folly::StringPiece prefix,
+                   const RoutePolicyMap* policyMap) const;
 
   void foreachRoutePolicy(folly::StringPiece prefix,
     std::function<void(const std::shared_ptr<RoutePolicyMap>&)> f) const;
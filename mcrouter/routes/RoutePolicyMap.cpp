@@ -13,6 +13,8 @@
 #include <unordered_set>
 #include <utility>
 
+#include "mcrouter/lib/fbi/cpp/Trie.h"
+#include "mcrouter/MemoryUsage.h"
 #include "mcrouter/routes/PrefixRouteSelector.h"
 
 using std::pair;
@@ -65,18 +67,26 @@ RoutePolicyMap::RoutePolicyMap(
     }
   }
 
-  ut_.emplace("", std::move(wildcards));
+  Trie<vector<McrouterRouteHandlePtr>> ut;
+  ut.emplace("", std::move(wildcards));
   // we iterate over keys in lexicographic order, so all prefixes of key will go
   // before key itself
   for (auto& it : t) {
-    auto existing = ut_.findPrefix(it.first);
+    auto existing = ut.findPrefix(it.first);
     // at least empty string should be there
-    assert(existing != ut_.end());
-    ut_.emplace(it.first, overrideItems(existing->second, it.second));
+    assert(existing != ut.end());
+    ut.emplace(it.first, overrideItems(existing->second, it.second));
   }
-  for (auto& it : ut_) {
+  for (auto& it : ut) {
     it.second = orderedUnique(it.second);
   }
+  ut_ = FlatTrie<vector<McrouterRouteHandlePtr>>(ut);
+  memoryUsage_ = ut_.memoryUsage();
+  routingTableMemory().add(memoryUsage_);
+}
+
+RoutePolicyMap::~RoutePolicyMap() {
+  routingTableMemory().remove(memoryUsage_);
 }
 
 const vector<McrouterRouteHandlePtr>&
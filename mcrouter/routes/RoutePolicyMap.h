@@ -14,7 +14,7 @@
 
 #include <folly/Range.h>
 
-#include "mcrouter/lib/fbi/cpp/Trie.h"
+#include "mcrouter/lib/fbi/cpp/FlatTrie.h"
 #include "mcrouter/routes/McrouterRouteHandle.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
@@ -49,6 +49,8 @@ class RoutePolicyMap {
   explicit RoutePolicyMap(
     const std::vector<std::shared_ptr<PrefixRouteSelector>>& clusters);
 
+  ~RoutePolicyMap();
+
   /**
    * @return vector of route handles that a request with given key should be
    *         forwarded to.
@@ -63,8 +65,14 @@ class RoutePolicyMap {
    * 1) targets for empty string are wildcards.
    * 2) targets for string of length n+1 S[0..n] are targets for S[0..n-1] with
    *    OperationSelectorRoutes for key prefix == S[0..n] overridden.
+   * It is queried on every request, so it is flattened once built.
    */
-  Trie<std::vector<McrouterRouteHandlePtr>> ut_;
+  FlatTrie<std::vector<McrouterRouteHandlePtr>> ut_;
+  /* Accounted in routingTableMemory() */
+  size_t memoryUsage_{0};
+
+  RoutePolicyMap(const RoutePolicyMap&) = delete;
+  RoutePolicyMap& operator=(const RoutePolicyMap&) = delete;
 };
 
 }}}  // facebook::memcache::mcrouter
@@ -10,6 +10,7 @@
 #pragma once
 
 #include <memory>
+#include <random>
 #include <utility>
 #include <vector>
 
@@ -18,7 +19,7 @@
 
 #include "mcrouter/lib/Operation.h"
 #include "mcrouter/proxy.h"
-#include "mcrouter/route.h"
+#include "mcrouter/ProxyRequestContext.h"
 #include "mcrouter/routes/McrouterRouteHandle.h"
 #include "mcrouter/routes/ShadowRouteIf.h"
 
@@ -37,7 +38,7 @@ namespace facebook { namespace memcache { namespace mcrouter {
 template <class ShadowPolicy>
 class ShadowRoute {
  public:
-  using ContextPtr = std::shared_ptr<ProxyRequestContext>;
+  using ContextPtr = ProxyRequestContext::Ptr;
 
   static std::string routeName() { return "shadow"; }
 
@@ -67,24 +68,35 @@ class ShadowRoute {
     const Request& req, Operation, const ContextPtr& ctx) const {
 
     std::shared_ptr<Request> adjustedReq;
+    /* One copy of the request shared by all shadow fibers,
+       the value IOBuf itself is shared with req */
+    std::shared_ptr<Request> shadowReq;
     folly::Optional<typename ReplyType<Operation, Request>::type> normalReply;
-    for (auto iter: shadowData_) {
-      if (shouldShadow(req, iter.second.get())) {
-        if (!adjustedReq) {
-          adjustedReq = std::make_shared<Request>(
-            shadowPolicy_.updateRequestForShadowing(req, Operation()));
-        }
-        if (!normalReply && shadowPolicy_.shouldDelayShadow(req, Operation())) {
-          normalReply = normal_->route(*adjustedReq, Operation(), ctx);
-        }
-        auto shadow = iter.first;
-        folly::fibers::addTask(
-          [shadow, adjustedReq, ctx] () {
-            Request shadowReq(adjustedReq->clone());
-            shadowReq.setRequestClass(RequestClass::SHADOW);
-            shadow->route(shadowReq, Operation(), ctx);
-          });
+    for (auto& iter : shadowData_) {
+      if (!iter.second->shouldShadow(normalIndex_, req) ||
+          !reserveShadowRequest(ctx)) {
+        continue;
       }
+      if (!adjustedReq) {
+        adjustedReq = std::make_shared<Request>(
+          shadowPolicy_.updateRequestForShadowing(req, Operation()));
+      }
+      if (!normalReply && shadowPolicy_.shouldDelayShadow(req, Operation())) {
+        normalReply = normal_->route(*adjustedReq, Operation(), ctx);
+      }
+      if (!shadowReq) {
+        shadowReq = std::make_shared<Request>(adjustedReq->clone());
+        shadowReq->setRequestClass(RequestClass::SHADOW);
+        shadowReq->setPriority(RequestPriority::LOW);
+      }
+      auto shadow = iter.first;
+      folly::fibers::addTask(
+        [shadow, shadowReq, ctx] () {
+          shadow->route(*shadowReq, Operation(), ctx);
+          if (ctx) {
+            --ctx->proxy().numShadowRequests;
+          }
+        });
     }
 
     if (normalReply) {
@@ -100,24 +112,32 @@ class ShadowRoute {
   const size_t normalIndex_;
   ShadowPolicy shadowPolicy_;
 
-  template <class Request>
-  bool shouldShadow(const Request& req, ShadowSettings* settings) const {
-    auto data = settings->getData();
-
-    if (normalIndex_ < data->start_index ||
-        normalIndex_ >= data->end_index) {
+  /**
+   * Counts one more shadow request for the proxy. Proxy state is only
+   * touched from its own thread, so no locking is needed.
+   *
+   * @return false if proxy_max_shadow_requests are already in flight,
+   *   or if the request is sampled out by proxy_t::shadowFraction().
+   */
+  static bool reserveShadowRequest(const ContextPtr& ctx) {
+    if (!ctx) {
+      return true;
+    }
+    auto& proxy = ctx->proxy();
+    if (proxy.opts.proxy_max_shadow_requests > 0 &&
+        proxy.numShadowRequests >= proxy.opts.proxy_max_shadow_requests) {
+      stat_incr(proxy.stats, shadow_requests_over_limit_stat, 1);
       return false;
     }
-
-    assert(data->start_key_fraction >= 0.0 &&
-           data->start_key_fraction <= 1.0 &&
-           data->end_key_fraction >= 0.0 &&
-           data->end_key_fraction <= 1.0 &&
-           data->start_key_fraction <= data->end_key_fraction);
-
-    return match_routing_key_hash(req.routingKeyHash(),
-      data->start_key_fraction,
-      data->end_key_fraction);
+    auto fraction = proxy.shadowFraction();
+    if (fraction < 1.0 &&
+        std::uniform_real_distribution<double>(0.0, 1.0)(
+          proxy.randomGenerator) >= fraction) {
+      stat_incr(proxy.stats, shadow_requests_shed_stat, 1);
+      return false;
+    }
+    ++proxy.numShadowRequests;
+    return true;
   }
 };
 
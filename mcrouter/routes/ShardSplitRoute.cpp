@@ -13,7 +13,7 @@ namespace facebook { namespace memcache { namespace mcrouter {
 
 McrouterRouteHandlePtr makeShardSplitRoute(
   McrouterRouteHandlePtr rh,
-  ShardSplitter shardSplitter) {
+  std::shared_ptr<const ShardSplitter> shardSplitter) {
 
   return std::make_shared<McrouterRouteHandle<ShardSplitRoute>>(
     std::move(rh), std::move(shardSplitter));
@@ -24,6 +24,7 @@
 #include "mcrouter/lib/OperationTraits.h"
 #include "mcrouter/ProxyRequestContext.h"
 #include "mcrouter/routes/McrouterRouteHandle.h"
+#include "mcrouter/routes/ShardHashFunc.h"
 #include "mcrouter/routes/ShardSplitter.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
@@ -44,31 +45,37 @@ std::string createSplitKey(folly::StringPiece fullKey,
                            folly::StringPiece shard);
 
 /**
- * Splits given request according to shard splits provided by ShardSplitter
+ * Splits given request according to shard splits provided by ShardSplitter,
+ * which may change without a config reload.
  */
 class ShardSplitRoute {
  public:
-  using ContextPtr = std::shared_ptr<ProxyRequestContext>;
+  using ContextPtr = ProxyRequestContext::Ptr;
 
   static std::string routeName() { return "shard-split"; }
 
-  ShardSplitRoute(McrouterRouteHandlePtr rh, ShardSplitter shardSplitter)
+  ShardSplitRoute(McrouterRouteHandlePtr rh,
+                  std::shared_ptr<const ShardSplitter> shardSplitter)
     : rh_(std::move(rh)),
-      shardSplitter_(std::move(shardSplitter)) {
+      shardSplitter_(std::move(shardSplitter)),
+      sampleGetsPeriod_(shardSplitter_->sampleGetsPeriod()),
+      splitsVersion_(shardSplitter_->version()),
+      splits_(shardSplitter_->splits()),
+      untilSample_(sampleGetsPeriod_) {
   }
 
   template <class Operation, class Request>
   std::vector<McrouterRouteHandlePtr> couldRouteTo(
     const Request& req, Operation, const ContextPtr& ctx) const {
 
-    ctx->recordShardSplitter(shardSplitter_);
+    ctx->recordShardSplitter(*shardSplitter_);
 
     if (!GetLike<Operation>::value && !DeleteLike<Operation>::value) {
       return rh_->couldRouteTo(req, Operation(), ctx);
     }
 
     folly::StringPiece shard;
-    auto cnt = shardSplitter_.getShardSplitCnt(req.routingKey(), shard);
+    auto cnt = shardSplitter_->getShardSplitCnt(req.routingKey(), shard);
     if (cnt == 1) {
       return rh_->couldRouteTo(req, Operation(), ctx);
     }
@@ -97,12 +104,26 @@ class ShardSplitRoute {
 
     // Gets are routed to one of the splits.
     folly::StringPiece shard;
-    auto cnt = shardSplitter_.getShardSplitCnt(req.routingKey(), shard);
-    size_t i = globals::hostid() % cnt;
-    if (i == 0) {
+    ShardSplitter::Split split;
+    if (!findSplit(req.routingKey(), shard, split)) {
       return rh_->route(req, Operation(), ctx);
     }
-    return rh_->route(splitReq(req, i - 1, shard), Operation(), ctx);
+    if (sampleGetsPeriod_ != 0 && --untilSample_ == 0) {
+      untilSample_ = sampleGetsPeriod_;
+      shardSplitter_->sampleGet(shard);
+    }
+
+    size_t i = globals::hostid() % split.count;
+    auto reply = routeToSplit(req, i, shard, Operation(), ctx);
+    // While the split count ramps, read through to the old split.
+    if (split.oldCount != split.count && reply.isMiss() &&
+        split.ramping(nowUs())) {
+      size_t oldI = globals::hostid() % split.oldCount;
+      if (oldI != i) {
+        return routeToSplit(req, oldI, shard, Operation(), ctx);
+      }
+    }
+    return reply;
   }
 
   template <class Operation, class Request>
@@ -116,17 +137,33 @@ class ShardSplitRoute {
       return rh_->route(req, Operation(), ctx);
     }
 
-    // Deletes are broadcast to all splits.
+    // Deletes are broadcast to all splits, the other splits get one batch.
     folly::StringPiece shard;
-    auto cnt = shardSplitter_.getShardSplitCnt(req.routingKey(), shard);
-    for (size_t i = 0; i < cnt - 1; ++i) {
+    ShardSplitter::Split split;
+    findSplit(req.routingKey(), shard, split);
+    auto cnt = split.count;
+    // Splits that were just merged back may still be read through to.
+    if (split.oldCount > cnt && split.ramping(nowUs())) {
+      cnt = split.oldCount;
+    }
+    if (cnt > 1) {
+      std::vector<Request> splitReqs;
+      splitReqs.reserve(cnt - 1);
+      for (size_t i = 0; i < cnt - 1; ++i) {
+        splitReqs.push_back(splitReq(req, i, shard));
+      }
 #ifdef __clang__
 #pragma clang diagnostic push // ignore generalized lambda capture warning
 #pragma clang diagnostic ignored "-Wc++1y-extensions"
 #endif
       folly::fibers::addTask(
-        [r = rh_, req_ = splitReq(req, i, shard), ctx]() {
-          r->route(req_, Operation(), ctx);
+        [r = rh_, reqs = std::move(splitReqs), ctx]() {
+          std::vector<const Request*> batch;
+          batch.reserve(reqs.size());
+          for (const auto& splitReq : reqs) {
+            batch.push_back(&splitReq);
+          }
+          r->routeBatch(batch, Operation(), ctx);
         });
 #ifdef __clang__
 #pragma clang diagnostic pop
@@ -137,15 +174,59 @@ class ShardSplitRoute {
 
  private:
   McrouterRouteHandlePtr rh_;
-  const ShardSplitter shardSplitter_;
+  const std::shared_ptr<const ShardSplitter> shardSplitter_;
+  const uint32_t sampleGetsPeriod_;
+
+  // Routes are used by a single proxy thread, they keep the splitter's
+  // current splits to avoid locking on every request. The version is read
+  // first: splits may be newer than it, never older
+  mutable uint64_t splitsVersion_;
+  mutable std::shared_ptr<const ShardSplitter::Splits> splits_;
+  mutable uint32_t untilSample_;
+
+  /**
+   * @return false if the key has no shard id, else stores it in shard and
+   *         the shard's current splits in split.
+   */
+  bool findSplit(folly::StringPiece routingKey, folly::StringPiece& shard,
+                 ShardSplitter::Split& split) const {
+    if (!getShardId(routingKey, shard)) {
+      return false;
+    }
+    auto version = shardSplitter_->version();
+    if (version != splitsVersion_) {
+      splits_ = shardSplitter_->splits();
+      splitsVersion_ = version;
+    }
+    auto it = splits_->find(shard);
+    if (it != splits_->end()) {
+      split = it->second;
+    }
+    return true;
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type routeToSplit(
+    const Request& req, size_t i, folly::StringPiece shard, Operation,
+    const ContextPtr& ctx) const {
+    if (i == 0) {
+      return rh_->route(req, Operation(), ctx);
+    }
+    return rh_->route(splitReq(req, i - 1, shard), Operation(), ctx);
+  }
 
   // from request with key 'prefix:shard:suffix' creates a copy of
   // request with key 'prefix:shardXY:suffix'
   template <class Request>
   Request splitReq(const Request& req, size_t offset,
                    folly::StringPiece shard) const {
+    auto fullKey = req.fullKey();
+    const char suffix[] = {char('a' + (offset % 26)),
+                           char('a' + (offset / 26))};
     auto reqCopy = req.clone();
-    reqCopy.setKey(createSplitKey(req.fullKey(), offset, shard));
+    reqCopy.setKeyFromParts({folly::StringPiece(fullKey.begin(), shard.end()),
+                             folly::StringPiece(suffix, sizeof(suffix)),
+                             folly::StringPiece(shard.end(), fullKey.end())});
     return reqCopy;
   }
 };
@@ -9,17 +9,28 @@
  */
 #include "ShardSplitter.h"
 
+#include <algorithm>
+#include <cmath>
+
 #include <folly/dynamic.h>
 
+#include "mcrouter/lib/fbi/cpp/util.h"
 #include "mcrouter/routes/ShardHashFunc.h"
+#include "mcrouter/RuntimeVarsData.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
+namespace {
+
 constexpr size_t kMaxSplits = 26 * 26;
+/* Auto mode counts gets of at most this many shards per interval */
+constexpr size_t kMaxSampledShards = 10000;
 
-ShardSplitter::ShardSplitter(const folly::dynamic& json) {
+folly::StringKeyedUnorderedMap<size_t> parseSplits(
+    const folly::dynamic& json) {
+  folly::StringKeyedUnorderedMap<size_t> shardSplits;
   if (!json.isObject()) {
-    return;
+    return shardSplits;
   }
 
   for (const auto& it : json.items()) {
@@ -36,9 +47,86 @@ ShardSplitter::ShardSplitter(const folly::dynamic& json) {
     } else if (static_cast<size_t>(splitCnt) > kMaxSplits) {
       LOG(ERROR) << "ShardSplitter: shard_splits value > " << kMaxSplits
                  << " '" << it.first.asString() << "': " << splitCnt;
-      shardSplits_.emplace(it.first.c_str(), kMaxSplits);
+      shardSplits.emplace(it.first.c_str(), kMaxSplits);
     } else {
-      shardSplits_.emplace(it.first.c_str(), splitCnt);
+      shardSplits.emplace(it.first.c_str(), splitCnt);
+    }
+  }
+  return shardSplits;
+}
+
+void setSplit(folly::StringKeyedUnorderedMap<size_t>& splits,
+              folly::StringPiece shard, size_t count) {
+  auto it = splits.find(shard);
+  if (it == splits.end()) {
+    splits.emplace(shard, count);
+  } else {
+    it->second = count;
+  }
+}
+
+}  // anonymous namespace
+
+ShardSplitter::ShardSplitter(const folly::dynamic& json)
+    : shardSplits_(parseSplits(json)) {
+  update(0);
+}
+
+ShardSplitter::ShardSplitter(const folly::dynamic& json,
+                             const folly::dynamic& jdynamic,
+                             ObservableRuntimeVars* vars)
+    : shardSplits_(parseSplits(json)) {
+  checkLogic(jdynamic.isObject(), "shard_splits_dynamic is not an object");
+  if (auto jramp = jdynamic.get_ptr("ramp_ms")) {
+    checkLogic(jramp->isInt() && jramp->getInt() >= 0,
+               "shard_splits_dynamic: ramp_ms is not a non-negative int");
+    rampUs_ = jramp->getInt() * 1000;
+  }
+  if (auto jauto = jdynamic.get_ptr("auto")) {
+    checkLogic(jauto->isObject(), "shard_splits_dynamic: auto is not object");
+    auto get = [jauto](folly::StringPiece name, int64_t defaultValue) {
+      auto jval = jauto->get_ptr(name);
+      if (jval == nullptr) {
+        return defaultValue;
+      }
+      checkLogic(jval->isInt() && jval->getInt() > 0,
+                 "shard_splits_dynamic: auto.{} is not a positive int", name);
+      return jval->getInt();
+    };
+    auto jtarget = jauto->get_ptr("target_qps");
+    checkLogic(jtarget && jtarget->isNumber() && jtarget->asDouble() > 0,
+               "shard_splits_dynamic: auto.target_qps is not a positive "
+               "number");
+    autoSplit_.targetQps = jtarget->asDouble();
+    autoSplit_.maxSplits = std::min<size_t>(get("max_splits", 16), kMaxSplits);
+    autoSplit_.intervalUs = get("interval_ms", 10000) * 1000;
+    autoSplit_.samplePeriod = get("sample_period", 100);
+  }
+
+  update(0);
+
+  if (auto jvar = jdynamic.get_ptr("runtime_var")) {
+    checkLogic(jvar->isString(),
+               "shard_splits_dynamic: runtime_var is not string");
+    auto name = jvar->stringPiece().str();
+    if (vars != nullptr && !name.empty()) {
+      handle_ = vars->subscribeAndCall(
+        [this, name](std::shared_ptr<const RuntimeVarsData> oldVars,
+                     std::shared_ptr<const RuntimeVarsData> newVars) {
+          if (!newVars) {
+            return;
+          }
+          auto json = newVars->getVariableByName(name);
+          if (json.isNull()) {
+            return;
+          }
+          if (!json.isObject()) {
+            LOG(ERROR) << "Invalid value of runtime variable " << name
+                       << ": shard splits are not an object";
+            return;
+          }
+          setOverrides(json);
+        });
     }
   }
 }
@@ -49,12 +137,147 @@ size_t ShardSplitter::getShardSplitCnt(folly::StringPiece routingKey,
     return 1;
   }
 
-  auto splitIt = shardSplits_.find(shard);
-  if (splitIt == shardSplits_.end()) {
+  auto current = splits();
+  auto splitIt = current->find(shard);
+  if (splitIt == current->end()) {
     return 1;
   }
-  return splitIt->second;
+  return splitIt->second.count;
+}
+
+std::shared_ptr<const ShardSplitter::Splits> ShardSplitter::splits() const {
+  std::lock_guard<std::mutex> lg(lock_);
+  return splits_;
+}
+
+void ShardSplitter::sampleGet(folly::StringPiece shard) const {
+  if (autoSplit_.samplePeriod == 0) {
+    return;
+  }
+  auto now = nowUs();
+  std::lock_guard<std::mutex> lg(lock_);
+  auto it = sampled_.find(shard);
+  if (it != sampled_.end()) {
+    ++it->second;
+  } else if (sampled_.size() < kMaxSampledShards) {
+    sampled_.emplace(shard, 1);
+  }
+
+  if (lastEvalUs_ == 0) {
+    lastEvalUs_ = now;
+  } else if (now - lastEvalUs_ >= autoSplit_.intervalUs) {
+    evaluate(now);
+  }
 }
 
+void ShardSplitter::setOverrides(const folly::dynamic& json) {
+  auto overrides = parseSplits(json);
+  std::lock_guard<std::mutex> lg(lock_);
+  overrides_ = std::move(overrides);
+  update(nowUs());
+}
+
+void ShardSplitter::evaluate(int64_t now) const {
+  double seconds = (now - lastEvalUs_) / 1000000.0;
+  folly::StringKeyedUnorderedMap<size_t> autoSplits;
+  for (const auto& it : sampled_) {
+    auto qps = it.second * autoSplit_.samplePeriod / seconds;
+    size_t wanted = std::ceil(qps / autoSplit_.targetQps);
+    wanted = std::min(std::max<size_t>(wanted, 1), autoSplit_.maxSplits);
+
+    /* Grow right away, shrink by halves once half of the splits would
+       do, so that a shard close to the threshold doesn't flap */
+    auto prevIt = autoSplits_.find(it.first);
+    size_t prev = prevIt == autoSplits_.end() ? 1 : prevIt->second;
+    auto count = prev;
+    if (wanted >= prev) {
+      count = wanted;
+    } else if (wanted <= prev / 2) {
+      count = prev / 2;
+    }
+    if (count > 1) {
+      autoSplits.emplace(it.first, count);
+    }
+  }
+  /* Shards without sampled gets are merged back (halving), if they had
+     auto splits */
+  for (const auto& it : autoSplits_) {
+    if (sampled_.find(it.first) == sampled_.end() && it.second / 2 > 1) {
+      autoSplits.emplace(it.first, it.second / 2);
+    }
+  }
+
+  sampled_.clear();
+  lastEvalUs_ = now;
+  autoSplits_ = std::move(autoSplits);
+  update(now);
+}
+
+void ShardSplitter::update(int64_t now) const {
+  folly::StringKeyedUnorderedMap<size_t> counts = shardSplits_;
+  for (const auto& it : overrides_) {
+    setSplit(counts, it.first, it.second);
+  }
+  for (const auto& it : autoSplits_) {
+    auto countIt = counts.find(it.first);
+    if (countIt == counts.end()) {
+      counts.emplace(it.first, it.second);
+    } else {
+      countIt->second = std::max(countIt->second, it.second);
+    }
+  }
+
+  folly::StringKeyedUnorderedMap<Split> splits;
+  bool changed = !splits_;
+  for (const auto& it : counts) {
+    if (it.second <= 1) {
+      continue;
+    }
+    Split split;
+    split.count = split.oldCount = it.second;
+    if (splits_) {
+      auto prevIt = splits_->find(it.first);
+      auto prevCount = prevIt == splits_->end() ? 1 : prevIt->second.count;
+      if (prevCount != it.second) {
+        changed = true;
+        if (rampUs_ > 0) {
+          split.oldCount = prevCount;
+          split.rampEndUs = now + rampUs_;
+        }
+      } else if (prevIt != splits_->end() &&
+                 prevIt->second.ramping(now)) {
+        split = prevIt->second;
+      }
+    }
+    splits.emplace(it.first, split);
+  }
+  /* Shards that are not split anymore, and ones still ramping down */
+  if (splits_) {
+    for (const auto& it : *splits_) {
+      if (splits.find(it.first) != splits.end()) {
+        continue;
+      }
+      if (it.second.count > 1) {
+        changed = true;
+        if (rampUs_ > 0) {
+          Split split;
+          split.oldCount = it.second.count;
+          split.rampEndUs = now + rampUs_;
+          splits.emplace(it.first, split);
+        }
+      } else if (it.second.ramping(now)) {
+        splits.emplace(it.first, it.second);
+      } else {
+        /* Done ramping down */
+        changed = true;
+      }
+    }
+  }
+
+  if (changed) {
+    splits_ = std::make_shared<const Splits>(splits);
+    version_.fetch_add(1, std::memory_order_release);
+  }
+}
 
 }}}  // facebook::memcache::mcrouter
@@ -9,10 +9,17 @@
  */
 #pragma once
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+
 #include <folly/experimental/StringKeyedUnorderedMap.h>
 #include <folly/Range.h>
 
 #include "mcrouter/config.h"
+#include "mcrouter/lib/fbi/cpp/FlatStringMap.h"
+#include "mcrouter/RuntimeVar.h"
 
 namespace folly {
 class dynamic;
@@ -20,24 +27,131 @@ class dynamic;
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
+/**
+ * Number of splits of every shard, from config ("shard_splits").
+ *
+ * Splits may also change without a config reload
+ * ("shard_splits_dynamic" in PoolRoute):
+ *   "runtime_var": runtime variable with an object of shard => splits,
+ *     overriding the config (1 removes a split);
+ *   "auto": {"target_qps": ..., "max_splits": ..., "interval_ms": ...,
+ *            "sample_period": ...}: shards are split so that every split
+ *     gets at most target_qps gets, as seen by this mcrouter (every proxy
+ *     samples one in sample_period gets, counts are evaluated every
+ *     interval_ms). A shard is only merged back once half of its splits
+ *     would do; config and runtime splits are a minimum;
+ *   "ramp_ms": for this long after a shard's split count changed, gets
+ *     that miss in the shard's new split are retried in its old one and
+ *     deletes go to the old splits too, so that the hit rate holds while
+ *     new splits fill up.
+ * Every mcrouter decides on its own, from its own traffic: hosts may use
+ * different splits for a while, as they do during a config rollout.
+ */
 class ShardSplitter {
  public:
+  struct Split {
+    size_t count{1};
+    /* Split count before the last change, used until rampEndUs */
+    size_t oldCount{1};
+    /* As in nowUs(), 0 if not ramping */
+    int64_t rampEndUs{0};
+
+    bool ramping(int64_t now) const {
+      return rampEndUs != 0 && now < rampEndUs;
+    }
+  };
+  /* Looked up on every split request, so flat */
+  using Splits = FlatStringMap<Split>;
+
+  /**
+   * Static splits.
+   *
+   * @param json  shard id => number of splits
+   */
   explicit ShardSplitter(const folly::dynamic& json);
 
+  /**
+   * @param json  shard id => number of splits
+   * @param jdynamic  "shard_splits_dynamic", see above
+   * @param vars  runtime vars to read jdynamic.runtime_var from
+   */
+  ShardSplitter(const folly::dynamic& json, const folly::dynamic& jdynamic,
+                ObservableRuntimeVars* vars);
+
   /**
    * Returns number of shard splits for this key. If this number
    * is greater than one, stores shardId part of the key in shardId.
+   * Thread safe, prefer splits() on hot paths.
    *
    * @return 1 if key shouldn't be split; number of splits (> 1) otherwise.
    */
   size_t getShardSplitCnt(folly::StringPiece key,
                           folly::StringPiece& shardId) const;
 
+  /**
+   * Splits from config.
+   */
   const folly::StringKeyedUnorderedMap<size_t>& getShardSplits() const {
     return shardSplits_;
   }
+
+  /**
+   * Current splits of all shards that are split or ramping. Immutable,
+   * replaced whenever version() changes. Thread safe.
+   */
+  std::shared_ptr<const Splits> splits() const;
+
+  uint64_t version() const {
+    return version_.load(std::memory_order_acquire);
+  }
+
+  /**
+   * One in sampleGetsPeriod() routed gets should be passed to sampleGet(),
+   * 0 if splits don't depend on traffic.
+   */
+  uint32_t sampleGetsPeriod() const {
+    return autoSplit_.samplePeriod;
+  }
+
+  /**
+   * Counts a sampled get of shard, may update splits. Thread safe.
+   */
+  void sampleGet(folly::StringPiece shard) const;
+
  private:
-  folly::StringKeyedUnorderedMap<size_t> shardSplits_;
+  struct AutoSplit {
+    double targetQps{0};
+    size_t maxSplits{0};
+    int64_t intervalUs{0};
+    uint32_t samplePeriod{0};
+  };
+
+  const folly::StringKeyedUnorderedMap<size_t> shardSplits_;
+  AutoSplit autoSplit_;
+  int64_t rampUs_{0};
+
+  /* Mutable state is changed by sampled gets (const) too */
+  mutable std::mutex lock_;
+  mutable std::shared_ptr<const Splits> splits_;
+  mutable std::atomic<uint64_t> version_{0};
+  /* From runtime vars */
+  folly::StringKeyedUnorderedMap<size_t> overrides_;
+  /* Auto mode: decided splits and gets sampled since lastEvalUs_ */
+  mutable folly::StringKeyedUnorderedMap<size_t> autoSplits_;
+  mutable folly::StringKeyedUnorderedMap<uint64_t> sampled_;
+  mutable int64_t lastEvalUs_{0};
+
+  /* Last member, so that we unsubscribe before anything else is destroyed */
+  ObservableRuntimeVars::CallbackHandle handle_;
+
+  void setOverrides(const folly::dynamic& json);
+  /* The following are called with lock_ held */
+  void evaluate(int64_t now) const;
+  /* Publishes splits from config, overrides and auto splits */
+  void update(int64_t now) const;
+
+  ShardSplitter(const ShardSplitter&) = delete;
+  ShardSplitter& operator=(const ShardSplitter&) = delete;
 };
 
 }}}  // facebook::memcache::mcrouter
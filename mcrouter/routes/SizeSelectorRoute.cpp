@@ -0,0 +1,89 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "SizeSelectorRoute.h"
+
+#include <algorithm>
+
+#include <folly/dynamic.h>
+
+#include "mcrouter/lib/fbi/cpp/util.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+constexpr uint8_t SizeSelectorRoute::kNoHint;
+
+SizeSelectorRoute::SizeSelectorRoute(
+    std::vector<McrouterRouteHandlePtr> targets,
+    std::vector<size_t> maxSizes,
+    size_t hintCacheSize)
+    : targets_(std::move(targets)),
+      maxSizes_(std::move(maxSizes)),
+      hints_(std::max<size_t>(hintCacheSize, 1)) {
+  checkLogic(!targets_.empty(), "SizeSelectorRoute: no bands");
+  checkLogic(targets_.size() < kNoHint, "SizeSelectorRoute: too many bands");
+  checkLogic(maxSizes_.size() + 1 >= targets_.size(),
+             "SizeSelectorRoute: band without max_size");
+  checkLogic(std::is_sorted(maxSizes_.begin(), maxSizes_.end()),
+             "SizeSelectorRoute: max_size of bands is not ascending");
+  /* The last band takes everything larger */
+  maxSizes_.resize(targets_.size() - 1);
+}
+
+SizeSelectorRoute::SizeSelectorRoute(
+    RouteHandleFactory<McrouterRouteHandleIf>& factory,
+    const folly::dynamic& json)
+    : hints_(65536) {
+  checkLogic(json.isObject(), "SizeSelectorRoute should be an object");
+  auto jbands = json.get_ptr("bands");
+  checkLogic(jbands && jbands->isArray() && !jbands->empty(),
+             "SizeSelectorRoute: bands is not a non-empty array");
+  checkLogic(jbands->size() < kNoHint, "SizeSelectorRoute: too many bands");
+
+  for (const auto& jband : *jbands) {
+    checkLogic(jband.isObject(), "SizeSelectorRoute: band is not an object");
+    auto jtarget = jband.get_ptr("target");
+    checkLogic(jtarget, "SizeSelectorRoute: band has no target");
+    targets_.push_back(factory.create(*jtarget));
+
+    if (auto jmax = jband.get_ptr("max_size")) {
+      checkLogic(jmax->isInt() && jmax->getInt() >= 0,
+                 "SizeSelectorRoute: max_size is not a non-negative int");
+      maxSizes_.push_back(jmax->getInt());
+    } else {
+      checkLogic(targets_.size() == jbands->size(),
+                 "SizeSelectorRoute: only the last band may have no "
+                 "max_size");
+    }
+  }
+  checkLogic(std::is_sorted(maxSizes_.begin(), maxSizes_.end()),
+             "SizeSelectorRoute: max_size of bands is not ascending");
+  maxSizes_.resize(targets_.size() - 1);
+
+  if (auto jsize = json.get_ptr("hint_cache_size")) {
+    checkLogic(jsize->isInt() && jsize->getInt() > 0,
+               "SizeSelectorRoute: hint_cache_size is not a positive int");
+    hints_.resize(jsize->getInt());
+  }
+}
+
+size_t SizeSelectorRoute::band(size_t valueSize) const {
+  return std::lower_bound(maxSizes_.begin(), maxSizes_.end(), valueSize) -
+         maxSizes_.begin();
+}
+
+McrouterRouteHandlePtr makeSizeSelectorRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json) {
+
+  return std::make_shared<McrouterRouteHandle<SizeSelectorRoute>>(
+    factory, json);
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,158 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <folly/experimental/fibers/FiberManager.h>
+
+#include "mcrouter/lib/config/RouteHandleFactory.h"
+#include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/Operation.h"
+#include "mcrouter/lib/OperationTraits.h"
+#include "mcrouter/lib/Reply.h"
+#include "mcrouter/routes/McrouterRouteHandle.h"
+
+namespace folly {
+class dynamic;
+}
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Sends updates to one of several targets (e.g. pools with slabs tuned for
+ * the size) by value size: to the first band whose max_size is at least the
+ * value size, or to the last band if the value is larger than all of them.
+ *
+ * The band of every key updated through this route is remembered in a
+ * direct mapped hint cache indexed by the routing key hash, so that other
+ * requests for the key go to that band only. Requests for keys without a
+ * hint try the bands in order until the first hit, and the band that hit
+ * becomes the hint. An update that moves a key to another band deletes it
+ * from the band it was in, asynchronously.
+ *
+ * Hints are per proxy and may be evicted by other keys, so requests for
+ * keys updated elsewhere cost more, they don't go to the wrong band.
+ *
+ * Config:
+ *   bands: list of {"max_size": int, "target": route}, ascending max_size
+ *   hint_cache_size: int, default 65536
+ */
+class SizeSelectorRoute {
+ public:
+  using ContextPtr = ProxyRequestContext::Ptr;
+
+  static std::string routeName() { return "size-selector"; }
+
+  template <class Operation, class Request>
+  std::vector<McrouterRouteHandlePtr> couldRouteTo(
+    const Request& req, Operation, const ContextPtr& ctx,
+    typename UpdateLike<Operation>::Type = 0) const {
+
+    return {targets_[band(req.value().computeChainDataLength())]};
+  }
+
+  template <class Operation, class Request>
+  std::vector<McrouterRouteHandlePtr> couldRouteTo(
+    const Request& req, Operation, const ContextPtr& ctx,
+    OtherThanT(Operation, UpdateLike<>) = 0) const {
+
+    return targets_;
+  }
+
+  SizeSelectorRoute(RouteHandleFactory<McrouterRouteHandleIf>& factory,
+                    const folly::dynamic& json);
+
+  /**
+   * @param maxSizes  max value size of each band but the last,
+   *                  one per target, ascending.
+   */
+  SizeSelectorRoute(std::vector<McrouterRouteHandlePtr> targets,
+                    std::vector<size_t> maxSizes,
+                    size_t hintCacheSize);
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation, const ContextPtr& ctx,
+    typename UpdateLike<Operation>::Type = 0) {
+
+    auto hash = req.routingKeyHash();
+    auto newBand = band(req.value().computeChainDataLength());
+    auto oldBand = hint(hash);
+    setHint(hash, newBand);
+    if (oldBand != kNoHint && oldBand != newBand) {
+      /* Don't leave the old value to be found once the hint is gone */
+      auto rh = targets_[oldBand];
+      auto deleteReq = std::make_shared<Request>(req.fullKey());
+      folly::fibers::addTask([rh, deleteReq, ctx]() {
+        rh->route(*deleteReq, McOperation<mc_op_delete>(), ctx);
+      });
+    }
+    return targets_[newBand]->route(req, Operation(), ctx);
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation, const ContextPtr& ctx,
+    OtherThanT(Operation, UpdateLike<>) = 0) {
+
+    auto hash = req.routingKeyHash();
+    auto hinted = hint(hash);
+    if (hinted != kNoHint) {
+      return targets_[hinted]->route(req, Operation(), ctx);
+    }
+
+    for (size_t i = 0; i + 1 < targets_.size(); ++i) {
+      auto reply = targets_[i]->route(req, Operation(), ctx);
+      if (reply.isHit()) {
+        setHint(hash, i);
+        return reply;
+      }
+    }
+    auto reply = targets_.back()->route(req, Operation(), ctx);
+    if (reply.isHit()) {
+      setHint(hash, targets_.size() - 1);
+    }
+    return reply;
+  }
+
+ private:
+  static constexpr uint8_t kNoHint = 0xff;
+
+  struct Hint {
+    uint32_t hash{0};
+    uint8_t band{kNoHint};
+  };
+
+  std::vector<McrouterRouteHandlePtr> targets_;
+  std::vector<size_t> maxSizes_;
+  std::vector<Hint> hints_;
+
+  size_t band(size_t valueSize) const;
+
+  uint8_t hint(uint32_t hash) const {
+    const auto& h = hints_[hash % hints_.size()];
+    return h.hash == hash ? h.band : kNoHint;
+  }
+
+  void setHint(uint32_t hash, size_t band) {
+    auto& h = hints_[hash % hints_.size()];
+    h.hash = hash;
+    h.band = band;
+  }
+};
+
+McrouterRouteHandlePtr makeSizeSelectorRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json);
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,120 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "WriteBehindRoute.h"
+
+#include <folly/dynamic.h>
+#include <folly/experimental/fibers/FiberManager.h>
+#include <folly/experimental/fibers/WhenN.h>
+
+#include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/proxy.h"
+#include "mcrouter/ProxyRequestContext.h"
+#include "mcrouter/stats.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+size_t parseSize(const folly::dynamic& json, const char* name,
+                 size_t defaultValue) {
+  auto jvalue = json.get_ptr(name);
+  if (!jvalue) {
+    return defaultValue;
+  }
+  checkLogic(jvalue->isInt() && jvalue->getInt() > 0,
+             "WriteBehindRoute: {} is not a positive int", name);
+  return jvalue->getInt();
+}
+
+}  // anonymous namespace
+
+WriteBehindRoute::WriteBehindRoute(McrouterRouteHandlePtr target,
+                                   size_t batchSize,
+                                   std::chrono::milliseconds flushInterval,
+                                   size_t maxBuffered)
+    : target_(std::move(target)),
+      batchSize_(batchSize),
+      flushInterval_(flushInterval),
+      maxBuffered_(maxBuffered),
+      state_(std::make_shared<State>()) {
+}
+
+WriteBehindRoute::WriteBehindRoute(
+    RouteHandleFactory<McrouterRouteHandleIf>& factory,
+    const folly::dynamic& json)
+    : state_(std::make_shared<State>()) {
+
+  checkLogic(json.isObject(), "WriteBehindRoute should be an object");
+  auto jtarget = json.get_ptr("target");
+  checkLogic(jtarget, "WriteBehindRoute: no target");
+  target_ = factory.create(*jtarget);
+  batchSize_ = parseSize(json, "batch_size", batchSize_);
+  flushInterval_ = std::chrono::milliseconds(
+    parseSize(json, "flush_interval_ms", flushInterval_.count()));
+  maxBuffered_ = parseSize(json, "max_buffered", maxBuffered_);
+}
+
+void WriteBehindRoute::enqueue(std::string key, std::function<void()> send,
+                               const ContextPtr& ctx) {
+  auto& state = *state_;
+  auto it = state.index.find(key);
+  if (it != state.index.end()) {
+    state.buffer[it->second] = std::move(send);
+    if (ctx) {
+      stat_incr(ctx->proxy().stats, write_behind_coalesced_stat, 1);
+    }
+    return;
+  }
+  if (state.buffer.size() >= maxBuffered_) {
+    if (ctx) {
+      stat_incr(ctx->proxy().stats, write_behind_dropped_stat, 1);
+    }
+    return;
+  }
+
+  state.index.emplace(std::move(key), state.buffer.size());
+  state.buffer.push_back(std::move(send));
+
+  if (!state.flushScheduled) {
+    state.flushScheduled = true;
+    auto statePtr = state_;
+    auto interval = flushInterval_;
+    folly::fibers::addTask([statePtr, interval]() {
+      statePtr->baton.timed_wait(interval);
+      flush(*statePtr);
+    });
+  }
+  if (state.buffer.size() >= batchSize_ && !state.flushRequested) {
+    state.flushRequested = true;
+    state.baton.post();
+  }
+}
+
+void WriteBehindRoute::flush(State& state) {
+  std::vector<std::function<void()>> batch;
+  batch.swap(state.buffer);
+  state.index.clear();
+  state.baton.reset();
+  state.flushScheduled = false;
+  state.flushRequested = false;
+
+  /* Send the whole batch at once, so it's pipelined on the connections */
+  folly::fibers::forEach(batch.begin(), batch.end(), [] (size_t id) {});
+}
+
+McrouterRouteHandlePtr makeWriteBehindRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json) {
+
+  return std::make_shared<McrouterRouteHandle<WriteBehindRoute>>(
+    factory, json);
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,136 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/experimental/fibers/Baton.h>
+
+#include "mcrouter/lib/config/RouteHandleFactory.h"
+#include "mcrouter/lib/Operation.h"
+#include "mcrouter/lib/OperationTraits.h"
+#include "mcrouter/lib/Reply.h"
+#include "mcrouter/lib/routes/NullRoute.h"
+#include "mcrouter/routes/McrouterRouteHandle.h"
+
+namespace folly {
+class dynamic;
+}
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Asynchronously sends update-like and delete-like requests to target,
+ * replying right away like AllAsyncRoute.
+ *
+ * Instead of one fiber per request, requests are buffered and flushed
+ * together by one fiber, once batch_size requests are buffered or
+ * flush_interval_ms after the first one, whichever is earlier. A request
+ * for a key that is already buffered replaces the buffered one (the latest
+ * write wins), and requests for new keys are dropped while max_buffered
+ * requests are buffered. Both are counted in write_behind_coalesced and
+ * write_behind_dropped stats.
+ *
+ * Other operations go to target directly, they don't see buffered writes.
+ *
+ * Config:
+ *   target: route
+ *   batch_size: int, default 100
+ *   flush_interval_ms: int, default 10
+ *   max_buffered: int, default 10000
+ */
+class WriteBehindRoute {
+ public:
+  using ContextPtr = ProxyRequestContext::Ptr;
+
+  static std::string routeName() { return "write-behind"; }
+
+  template <class Operation, class Request>
+  std::vector<McrouterRouteHandlePtr> couldRouteTo(
+    const Request& req, Operation, const ContextPtr& ctx) const {
+
+    return {target_};
+  }
+
+  WriteBehindRoute(RouteHandleFactory<McrouterRouteHandleIf>& factory,
+                   const folly::dynamic& json);
+
+  WriteBehindRoute(McrouterRouteHandlePtr target,
+                   size_t batchSize,
+                   std::chrono::milliseconds flushInterval,
+                   size_t maxBuffered);
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation, const ContextPtr& ctx,
+    typename std::enable_if<
+      UpdateLike<Operation>::value || DeleteLike<Operation>::value
+    >::type* = 0) {
+
+    auto target = target_;
+    auto reqCopy = std::make_shared<Request>(req.clone());
+    enqueue(req.fullKey().str(),
+            [target, reqCopy, ctx]() {
+              target->route(*reqCopy, Operation(), ctx);
+            },
+            ctx);
+    return NullRoute<McrouterRouteHandleIf>::route(req, Operation(), ctx);
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation, const ContextPtr& ctx,
+    OtherThanT(Operation, UpdateLike<>, DeleteLike<>) = 0) {
+
+    return target_->route(req, Operation(), ctx);
+  }
+
+  /**
+   * Number of requests waiting to be flushed.
+   */
+  size_t buffered() const {
+    return state_->buffer.size();
+  }
+
+ private:
+  /* Shared with the flushing fiber, which may outlive the route */
+  struct State {
+    std::vector<std::function<void()>> buffer;
+    /* Key -> index into buffer */
+    std::unordered_map<std::string, size_t> index;
+    folly::fibers::Baton baton;
+    /* True while the flushing fiber waits on baton */
+    bool flushScheduled{false};
+    /* True once baton was posted for the current buffer */
+    bool flushRequested{false};
+  };
+
+  McrouterRouteHandlePtr target_;
+  size_t batchSize_{100};
+  std::chrono::milliseconds flushInterval_{10};
+  size_t maxBuffered_{10000};
+  std::shared_ptr<State> state_;
+
+  void enqueue(std::string key, std::function<void()> send,
+               const ContextPtr& ctx);
+
+  static void flush(State& state);
+};
+
+McrouterRouteHandlePtr makeWriteBehindRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json);
+
+}}}  // facebook::memcache::mcrouter
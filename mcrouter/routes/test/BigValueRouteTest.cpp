@@ -8,6 +8,7 @@
  *
  */
 #include <memory>
+#include <random>
 #include <vector>
 
 #include <gtest/gtest.h>
@@ -41,7 +42,7 @@ TEST(BigValueRouteTest, smallvalue) {
   };
   auto route_handles = get_route_handles(test_handles);
   TestFiberManager fm;
-  std::shared_ptr<ProxyRequestContext> ctx;
+  ProxyRequestContext::Ptr ctx;
 
   fm.runAll({
     [&]() {
@@ -90,7 +91,7 @@ TEST(BigValueRouteTest, bigvalue) {
   auto route_handles = get_route_handles(test_handles);
 
   TestFiberManager fm;
-  std::shared_ptr<ProxyRequestContext> ctx;
+  ProxyRequestContext::Ptr ctx;
 
   fm.runAll({
     [&]() {
@@ -217,3 +218,135 @@ TEST(BigValueRouteTest, bigvalue) {
     }
   });
 }
+
+TEST(BigValueRouteTest, inflightChunks) {
+  // at most maxInflightChunks chunk sets are sent at a time
+  int num_chunks = 10;
+  auto handle = make_shared<TestHandle>(UpdateRouteTestData(mc_res_stored));
+  auto route_handles = get_route_handles(vector<std::shared_ptr<TestHandle>>{
+    handle});
+  BigValueRouteOptions windowOpts(threshold, /* maxInflightChunks= */ 2);
+  McrouterRouteHandle<BigValueRoute> rh(route_handles[0], windowOpts);
+
+  TestFiberManager fm;
+  ProxyRequestContext::Ptr ctx;
+
+  handle->pause();
+  fm.runAll({
+    [&]() {
+      auto msg_set = createMcMsgRef("key_set",
+                                    std::string(threshold * num_chunks, 'v'));
+      msg_set->op = mc_op_set;
+      ProxyMcRequest req_set(std::move(msg_set));
+
+      auto f_set = rh.route(req_set, McOperation<mc_op_set>(), ctx);
+      EXPECT_TRUE(f_set.isStored());
+    },
+    [&]() {
+      // the first two chunks are waiting, the others were not sent yet
+      EXPECT_EQ(2, handle->promises_.size());
+      EXPECT_TRUE(handle->saw_keys.empty());
+      handle->unpause();
+    }
+  });
+
+  // all chunks in order, then the original key
+  ASSERT_EQ(num_chunks + 1, handle->saw_keys.size());
+  for (int i = 0; i < num_chunks; i++) {
+    auto chunk_key_prefix = folly::format("key_set|#|{}:", i).str();
+    EXPECT_EQ(chunk_key_prefix,
+              handle->saw_keys[i].substr(0, chunk_key_prefix.length()));
+  }
+  EXPECT_EQ("key_set", handle->saw_keys[num_chunks]);
+}
+
+namespace {
+
+std::string randomValue(size_t size) {
+  std::mt19937 gen(12345);
+  std::string value(size, '\0');
+  for (auto& c : value) {
+    c = 'a' + gen() % 26;
+  }
+  return value;
+}
+
+}  // anonymous namespace
+
+TEST(BigValueRouteTest, contentChunking) {
+  BigValueRouteOptions contentOpts(threshold, /* maxInflightChunks= */ 0,
+                                   /* contentChunking= */ true);
+  auto value = randomValue(threshold * 20);
+  // same value with a few bytes changed in the middle
+  auto edited = value;
+  edited.replace(edited.size() / 2, 4, "EDIT");
+
+  // no previous value
+  auto first = make_shared<TestHandle>(GetRouteTestData(mc_res_notfound, ""),
+                                       UpdateRouteTestData(mc_res_stored),
+                                       DeleteRouteTestData(mc_res_deleted));
+  TestFiberManager fm;
+  ProxyRequestContext::Ptr ctx;
+  fm.run([&]() {
+    McrouterRouteHandle<BigValueRoute> rh(first->rh, contentOpts);
+    auto msg_set = createMcMsgRef("key_set", value);
+    msg_set->op = mc_op_set;
+    ProxyMcRequest req_set(std::move(msg_set));
+    auto f_set = rh.route(req_set, McOperation<mc_op_set>(), ctx);
+    EXPECT_TRUE(f_set.isStored());
+  });
+
+  // previous index, then all chunks, then the new index
+  auto& keys = first->saw_keys;
+  ASSERT_LT(3, keys.size());
+  EXPECT_EQ("key_set", keys.front());
+  EXPECT_EQ(mc_op_get, first->sawOperations.front());
+  EXPECT_EQ("key_set", keys.back());
+  std::string chunked;
+  for (size_t i = 1; i + 1 < keys.size(); ++i) {
+    EXPECT_EQ("key_set|#|", keys[i].substr(0, 10));
+    EXPECT_EQ(mc_op_set, first->sawOperations[i]);
+    EXPECT_GE(static_cast<size_t>(threshold),
+              first->sawValues[i - 1].size());
+    chunked += first->sawValues[i - 1];
+  }
+  EXPECT_EQ(value, chunked);
+  auto index = first->sawValues.back();
+  EXPECT_EQ("2-", index.substr(0, 2));
+  size_t numChunks = keys.size() - 2;
+
+  // the previous version's chunks are only touched
+  auto second = make_shared<TestHandle>(
+    GetRouteTestData(mc_res_found, index, MC_MSG_FLAG_BIG_VALUE),
+    UpdateRouteTestData(mc_res_stored),
+    DeleteRouteTestData(mc_res_deleted));
+  fm.run([&]() {
+    McrouterRouteHandle<BigValueRoute> rh(second->rh, contentOpts);
+    auto msg_set = createMcMsgRef("key_set", edited);
+    msg_set->op = mc_op_set;
+    ProxyMcRequest req_set(std::move(msg_set));
+    auto f_set = rh.route(req_set, McOperation<mc_op_set>(), ctx);
+    EXPECT_TRUE(f_set.isStored());
+  });
+
+  // touches miss in the test handle, so a touched chunk is set right after
+  auto& ops = second->sawOperations;
+  size_t touched = 0;
+  for (size_t i = 1; i + 1 < ops.size(); ++i) {
+    if (ops[i] == mc_op_touch) {
+      ++touched;
+      EXPECT_EQ(mc_op_set, ops[i + 1]);
+      EXPECT_EQ(second->saw_keys[i], second->saw_keys[i + 1]);
+    }
+  }
+  // all the chunks but the ones around the edit are shared
+  EXPECT_LT(numChunks / 2, touched);
+  EXPECT_GT(numChunks, touched);
+
+  chunked.clear();
+  for (size_t i = 0; i + 1 < second->sawValues.size(); ++i) {
+    chunked += second->sawValues[i];
+  }
+  EXPECT_EQ(edited, chunked);
+  EXPECT_EQ("key_set", second->saw_keys.back());
+}
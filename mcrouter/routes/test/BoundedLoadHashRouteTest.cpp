@@ -0,0 +1,136 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <folly/dynamic.h>
+#include <folly/Memory.h>
+
+#include "mcrouter/lib/test/RouteHandleTestUtil.h"
+#include "mcrouter/McrouterInstance.h"
+#include "mcrouter/ProxyMcRequest.h"
+#include "mcrouter/routes/BoundedLoadHashRoute.h"
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+using std::make_shared;
+using std::string;
+using std::vector;
+
+using TestHandle = TestHandleImpl<McrouterRouteHandleIf>;
+using TestRoute = BoundedLoadHashRoute<Ch3HashFunc>;
+
+namespace {
+
+ProxyRequestContext::Ptr getContext(const std::string& persistenceId) {
+  McrouterOptions opts = defaultTestOptions();
+  opts.config_str = "{ \"route\": \"NullRoute\" }";
+  auto router = McrouterInstance::init(persistenceId, opts);
+  return ProxyRequestContext::createRecording(*router->getProxy(0), nullptr);
+}
+
+vector<std::shared_ptr<TestHandle>> makeHandles() {
+  vector<std::shared_ptr<TestHandle>> handles;
+  for (auto value : {"a", "b"}) {
+    handles.push_back(make_shared<TestHandle>(
+      GetRouteTestData(mc_res_found, value),
+      UpdateRouteTestData(mc_res_stored),
+      DeleteRouteTestData(mc_res_deleted)));
+  }
+  return handles;
+}
+
+std::unique_ptr<TestRoute> makeRoute(
+    const vector<std::shared_ptr<TestHandle>>& handles) {
+  auto json = folly::dynamic::object("bounded_load_epsilon", 0.1);
+  return folly::make_unique<TestRoute>(
+    json, get_route_handles(handles), Ch3HashFunc(handles.size()));
+}
+
+template <class Operation>
+std::function<void()> send(TestRoute& rh, const ProxyRequestContext::Ptr& ctx,
+                           Operation) {
+  return [&rh, &ctx]() {
+    rh.route(ProxyMcRequest("key"), Operation(), ctx);
+  };
+}
+
+}  // anonymous namespace
+
+TEST(BoundedLoadHashRouteTest, spillsGets) {
+  auto handles = makeHandles();
+  auto rh = makeRoute(handles);
+  auto ctx = getContext("test_bounded_load_hash_get");
+
+  handles[0]->pause();
+  handles[1]->pause();
+  TestFiberManager fm;
+  McOperation<mc_op_get> get;
+  fm.runAll({
+    /* With epsilon 0.1 and two children, the bound is 1, 2, 2 for the
+       1st, 2nd, 3rd request: the 3rd one goes to the other child */
+    send(*rh, ctx, get),
+    send(*rh, ctx, get),
+    send(*rh, ctx, get),
+    [&]() {
+      EXPECT_EQ(3, rh->inflight(0) + rh->inflight(1));
+      EXPECT_EQ(2, std::max(rh->inflight(0), rh->inflight(1)));
+      handles[0]->unpause();
+      handles[1]->unpause();
+    }
+  });
+
+  EXPECT_EQ(3, handles[0]->saw_keys.size() + handles[1]->saw_keys.size());
+  EXPECT_EQ(1, std::min(handles[0]->saw_keys.size(),
+                        handles[1]->saw_keys.size()));
+  EXPECT_EQ(0, rh->inflight(0));
+  EXPECT_EQ(0, rh->inflight(1));
+  EXPECT_EQ(1, stat_get_uint64(ctx->proxy().stats,
+                               hash_bounded_load_spills_stat));
+}
+
+TEST(BoundedLoadHashRouteTest, updatesNeverSpill) {
+  auto handles = makeHandles();
+  auto rh = makeRoute(handles);
+  auto ctx = getContext("test_bounded_load_hash_set");
+
+  handles[0]->pause();
+  handles[1]->pause();
+  TestFiberManager fm;
+  McOperation<mc_op_set> set;
+  fm.runAll({
+    send(*rh, ctx, set),
+    send(*rh, ctx, set),
+    send(*rh, ctx, set),
+    [&]() {
+      EXPECT_EQ(3, std::max(rh->inflight(0), rh->inflight(1)));
+      handles[0]->unpause();
+      handles[1]->unpause();
+    }
+  });
+
+  EXPECT_EQ(3, std::max(handles[0]->saw_keys.size(),
+                        handles[1]->saw_keys.size()));
+  EXPECT_EQ(0, stat_get_uint64(ctx->proxy().stats,
+                               hash_bounded_load_spills_stat));
+}
+
+TEST(BoundedLoadHashRouteTest, invalidEpsilon) {
+  auto handles = makeHandles();
+  auto json = folly::dynamic::object("bounded_load_epsilon", 0);
+  EXPECT_ANY_THROW(TestRoute(json, get_route_handles(handles),
+                             Ch3HashFunc(handles.size())));
+}
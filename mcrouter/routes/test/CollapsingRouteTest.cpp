@@ -0,0 +1,132 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <folly/Memory.h>
+
+#include "mcrouter/lib/test/RouteHandleTestUtil.h"
+#include "mcrouter/routes/CollapsingRoute.h"
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+using std::make_shared;
+using std::string;
+using std::vector;
+
+using TestHandle = TestHandleImpl<McrouterRouteHandleIf>;
+
+namespace {
+
+std::unique_ptr<CollapsingRoute> makeRoute(
+    const std::shared_ptr<TestHandle>& handle) {
+  return folly::make_unique<CollapsingRoute>(
+    get_route_handles(vector<std::shared_ptr<TestHandle>>{handle})[0]);
+}
+
+template <class Operation>
+std::function<void()> sendAndCheck(CollapsingRoute& rh,
+                                   const std::string& key, Operation,
+                                   mc_res_t expected) {
+  return [&rh, key, expected]() {
+    ProxyRequestContext::Ptr ctx;
+    auto reply = rh.route(ProxyMcRequest(key), Operation(), ctx);
+    EXPECT_EQ(expected, reply.result());
+  };
+}
+
+}  // anonymous namespace
+
+TEST(CollapsingRouteTest, collapseGets) {
+  auto handle = make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a"));
+  auto rh = makeRoute(handle);
+
+  handle->pause();
+  TestFiberManager fm;
+  fm.runAll({
+    sendAndCheck(*rh, "key", McOperation<mc_op_get>(), mc_res_found),
+    [&]() {
+      ProxyRequestContext::Ptr ctx;
+      auto reply = rh->route(ProxyMcRequest("key"), McOperation<mc_op_get>(),
+                             ctx);
+      EXPECT_EQ(mc_res_found, reply.result());
+      EXPECT_EQ("a", toString(reply.value()));
+    },
+    sendAndCheck(*rh, "other", McOperation<mc_op_get>(), mc_res_found),
+    [&]() { handle->unpause(); }
+  });
+
+  /* The second get for "key" waited for the first one */
+  EXPECT_EQ((vector<string>{"key", "other"}), handle->saw_keys);
+  EXPECT_EQ(1, rh->collapsed());
+
+  /* Nothing is in flight anymore, the next get goes to target */
+  fm.run(sendAndCheck(*rh, "key", McOperation<mc_op_get>(), mc_res_found));
+  EXPECT_EQ(3, handle->saw_keys.size());
+  EXPECT_EQ(1, rh->collapsed());
+}
+
+TEST(CollapsingRouteTest, leaseGetHit) {
+  auto handle = make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a"));
+  auto rh = makeRoute(handle);
+
+  handle->pause();
+  TestFiberManager fm;
+  fm.runAll({
+    sendAndCheck(*rh, "key", McOperation<mc_op_lease_get>(), mc_res_found),
+    sendAndCheck(*rh, "key", McOperation<mc_op_lease_get>(), mc_res_found),
+    [&]() { handle->unpause(); }
+  });
+
+  EXPECT_EQ(vector<string>{"key"}, handle->saw_keys);
+  EXPECT_EQ(1, rh->collapsed());
+}
+
+TEST(CollapsingRouteTest, leaseGetMiss) {
+  auto handle = make_shared<TestHandle>(GetRouteTestData(mc_res_notfound, ""));
+  auto rh = makeRoute(handle);
+
+  handle->pause();
+  TestFiberManager fm;
+  fm.runAll({
+    sendAndCheck(*rh, "key", McOperation<mc_op_lease_get>(), mc_res_notfound),
+    sendAndCheck(*rh, "key", McOperation<mc_op_lease_get>(), mc_res_notfound),
+    [&]() { handle->unpause(); }
+  });
+
+  /* Lease tokens are not shared, the waiting lease-get was sent on its own */
+  EXPECT_EQ((vector<string>{"key", "key"}), handle->saw_keys);
+  EXPECT_EQ(0, rh->collapsed());
+}
+
+TEST(CollapsingRouteTest, otherOperations) {
+  auto handle = make_shared<TestHandle>(
+    GetRouteTestData(mc_res_found, "a"),
+    UpdateRouteTestData(mc_res_stored),
+    DeleteRouteTestData(mc_res_deleted));
+  auto rh = makeRoute(handle);
+
+  handle->pause();
+  TestFiberManager fm;
+  fm.runAll({
+    sendAndCheck(*rh, "key", McOperation<mc_op_gets>(), mc_res_found),
+    sendAndCheck(*rh, "key", McOperation<mc_op_gets>(), mc_res_found),
+    sendAndCheck(*rh, "key", McOperation<mc_op_delete>(), mc_res_deleted),
+    [&]() { handle->unpause(); }
+  });
+
+  EXPECT_EQ(3, handle->saw_keys.size());
+  EXPECT_EQ(0, rh->collapsed());
+}
@@ -0,0 +1,113 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <folly/Memory.h>
+
+#include "mcrouter/lib/test/RouteHandleTestUtil.h"
+#include "mcrouter/routes/CompressionRoute.h"
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+using std::make_shared;
+using std::string;
+using std::vector;
+
+using TestHandle = TestHandleImpl<McrouterRouteHandleIf>;
+
+namespace {
+
+const size_t kThreshold = 100;
+
+std::unique_ptr<CompressionRoute> makeRoute(
+    const std::shared_ptr<TestHandle>& handle) {
+  return folly::make_unique<CompressionRoute>(
+    get_route_handles(vector<std::shared_ptr<TestHandle>>{handle})[0],
+    kThreshold,
+    folly::io::CodecType::LZ4_VARINT_SIZE);
+}
+
+template <class Operation>
+ProxyMcReply send(CompressionRoute& rh, const std::string& key,
+                  const std::string& value, Operation) {
+  ProxyRequestContext::Ptr ctx;
+  auto msg = createMcMsgRef(key, value);
+  msg->op = Operation::mc_op;
+  return rh.route(ProxyMcRequest(std::move(msg)), Operation(), ctx);
+}
+
+}  // anonymous namespace
+
+TEST(CompressionRouteTest, smallValue) {
+  auto handle = make_shared<TestHandle>(UpdateRouteTestData(mc_res_stored));
+  auto rh = makeRoute(handle);
+
+  string value(kThreshold - 1, 'a');
+  auto reply = send(*rh, "key", value, McOperation<mc_op_set>());
+  EXPECT_EQ(mc_res_stored, reply.result());
+  EXPECT_EQ(vector<string>{value}, handle->sawValues);
+}
+
+TEST(CompressionRouteTest, roundTrip) {
+  auto setHandle = make_shared<TestHandle>(UpdateRouteTestData(mc_res_stored));
+  auto setRoute = makeRoute(setHandle);
+
+  string value;
+  for (int i = 0; i < 100; ++i) {
+    value += "{\"field\": \"value\"},";
+  }
+  auto reply = send(*setRoute, "key", value, McOperation<mc_op_set>());
+  EXPECT_EQ(mc_res_stored, reply.result());
+  ASSERT_EQ(1, setHandle->sawValues.size());
+  auto stored = setHandle->sawValues[0];
+  EXPECT_LT(stored.size(), value.size() / 3);
+
+  /* A get for the compressed value returns the original one */
+  auto getHandle = make_shared<TestHandle>(GetRouteTestData(
+    mc_res_found, stored, MC_MSG_FLAG_MCROUTER_COMPRESSED | 0x1));
+  auto getRoute = makeRoute(getHandle);
+  auto getReply = send(*getRoute, "key", "", McOperation<mc_op_get>());
+  EXPECT_EQ(mc_res_found, getReply.result());
+  EXPECT_EQ(value, toString(getReply.value()));
+  /* Our flag is removed, others are kept */
+  EXPECT_EQ(0x1, getReply.flags());
+}
+
+TEST(CompressionRouteTest, uncompressedGet) {
+  auto handle = make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a"));
+  auto rh = makeRoute(handle);
+
+  auto reply = send(*rh, "key", "", McOperation<mc_op_get>());
+  EXPECT_EQ(mc_res_found, reply.result());
+  EXPECT_EQ("a", toString(reply.value()));
+}
+
+TEST(CompressionRouteTest, corruptedValue) {
+  auto handle = make_shared<TestHandle>(GetRouteTestData(
+    mc_res_found, "\xff garbage", MC_MSG_FLAG_MCROUTER_COMPRESSED));
+  auto rh = makeRoute(handle);
+
+  auto reply = send(*rh, "key", "", McOperation<mc_op_get>());
+  EXPECT_EQ(mc_res_local_error, reply.result());
+}
+
+TEST(CompressionRouteTest, appendNotCompressed) {
+  auto handle = make_shared<TestHandle>(UpdateRouteTestData(mc_res_stored));
+  auto rh = makeRoute(handle);
+
+  string value(10 * kThreshold, 'a');
+  send(*rh, "key", value, McOperation<mc_op_append>());
+  EXPECT_EQ(vector<string>{value}, handle->sawValues);
+}
@@ -0,0 +1,185 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <folly/experimental/fibers/Baton.h>
+#include <folly/Memory.h>
+
+#include "mcrouter/lib/test/RouteHandleTestUtil.h"
+#include "mcrouter/ProxyMcRequest.h"
+#include "mcrouter/routes/CounterCombiningRoute.h"
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+using std::vector;
+
+namespace {
+
+struct CounterState {
+  uint64_t value{0};
+  vector<uint64_t> sawDeltas;
+  bool paused{false};
+  vector<folly::fibers::Baton*> waiting;
+
+  void unpause() {
+    paused = false;
+    for (auto baton : waiting) {
+      baton->post();
+    }
+    waiting.clear();
+  }
+};
+
+/* Memcached-like counter of a single key */
+class CounterRoute {
+ public:
+  using ContextPtr = ProxyRequestContext::Ptr;
+
+  static std::string routeName() { return "counter"; }
+
+  template <class Operation, class Request>
+  std::vector<McrouterRouteHandlePtr> couldRouteTo(
+    const Request& req, Operation, const ContextPtr& ctx) const {
+
+    return {};
+  }
+
+  explicit CounterRoute(std::shared_ptr<CounterState> state)
+      : state_(std::move(state)) {
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation, const ContextPtr& ctx) {
+
+    using Reply = typename ReplyType<Operation, Request>::type;
+    if (state_->paused) {
+      folly::fibers::Baton baton;
+      state_->waiting.push_back(&baton);
+      baton.wait();
+    }
+    if (!ArithmeticLike<Operation>::value) {
+      return Reply(mc_res_notfound);
+    }
+    auto delta = req.delta();
+    state_->sawDeltas.push_back(delta);
+    auto& value = state_->value;
+    if (std::is_same<Operation, McOperation<mc_op_incr>>::value) {
+      value += delta;
+    } else {
+      value = delta > value ? 0 : value - delta;
+    }
+    Reply reply(mc_res_stored);
+    reply.setDelta(value);
+    return reply;
+  }
+
+ private:
+  std::shared_ptr<CounterState> state_;
+};
+
+std::unique_ptr<CounterCombiningRoute> makeRoute(
+    std::shared_ptr<CounterState> state) {
+  return folly::make_unique<CounterCombiningRoute>(
+    std::make_shared<McrouterRouteHandle<CounterRoute>>(std::move(state)));
+}
+
+template <class Operation>
+std::function<void()> sendAndCheck(CounterCombiningRoute& rh, Operation,
+                                   uint64_t delta, uint64_t expected) {
+  return [&rh, delta, expected]() {
+    ProxyRequestContext::Ptr ctx;
+    ProxyMcRequest req("counter");
+    req.setDelta(delta);
+    auto reply = rh.route(req, Operation(), ctx);
+    EXPECT_EQ(mc_res_stored, reply.result());
+    EXPECT_EQ(expected, reply.delta());
+  };
+}
+
+}  // anonymous namespace
+
+TEST(CounterCombiningRouteTest, combineIncrs) {
+  auto state = std::make_shared<CounterState>();
+  state->value = 10;
+  auto rh = makeRoute(state);
+  McOperation<mc_op_incr> incr;
+
+  state->paused = true;
+  TestFiberManager fm;
+  fm.runAll({
+    /* Sent right away, the following ones wait for it */
+    sendAndCheck(*rh, incr, 1, 11),
+    sendAndCheck(*rh, incr, 2, 13),
+    sendAndCheck(*rh, incr, 3, 16),
+    sendAndCheck(*rh, incr, 4, 20),
+    [&]() { state->unpause(); }
+  });
+
+  EXPECT_EQ((vector<uint64_t>{1, 9}), state->sawDeltas);
+  EXPECT_EQ(20, state->value);
+  EXPECT_EQ(2, rh->combined());
+
+  /* Nothing is in flight anymore, the next incr goes alone */
+  fm.run(sendAndCheck(*rh, incr, 5, 25));
+  EXPECT_EQ((vector<uint64_t>{1, 9, 5}), state->sawDeltas);
+}
+
+TEST(CounterCombiningRouteTest, combineDecrs) {
+  auto state = std::make_shared<CounterState>();
+  state->value = 5;
+  auto rh = makeRoute(state);
+  McOperation<mc_op_decr> decr;
+
+  state->paused = true;
+  TestFiberManager fm;
+  fm.runAll({
+    sendAndCheck(*rh, decr, 1, 4),
+    sendAndCheck(*rh, decr, 1, 3),
+    sendAndCheck(*rh, decr, 2, 1),
+    [&]() { state->unpause(); }
+  });
+  EXPECT_EQ((vector<uint64_t>{1, 3}), state->sawDeltas);
+
+  /* Reaching 0 in a combined decr gives 0 to all */
+  state->paused = true;
+  fm.runAll({
+    sendAndCheck(*rh, decr, 0, 1),
+    sendAndCheck(*rh, decr, 5, 0),
+    sendAndCheck(*rh, decr, 1, 0),
+    [&]() { state->unpause(); }
+  });
+  EXPECT_EQ((vector<uint64_t>{1, 3, 0, 6}), state->sawDeltas);
+  EXPECT_EQ(0, state->value);
+}
+
+TEST(CounterCombiningRouteTest, incrsAndDecrsApart) {
+  auto state = std::make_shared<CounterState>();
+  state->value = 10;
+  auto rh = makeRoute(state);
+
+  state->paused = true;
+  TestFiberManager fm;
+  fm.runAll({
+    sendAndCheck(*rh, McOperation<mc_op_incr>(), 1, 11),
+    /* Not combined with the incr, sent right away */
+    sendAndCheck(*rh, McOperation<mc_op_decr>(), 2, 9),
+    [&]() { state->unpause(); }
+  });
+  EXPECT_EQ((vector<uint64_t>{1, 2}), state->sawDeltas);
+  EXPECT_EQ(0, rh->combined());
+}
@@ -29,7 +29,7 @@ using TestHandle = TestHandleImpl<McrouterRouteHandleIf>;
 
 namespace {
 
-std::shared_ptr<ProxyRequestContext> getContext() {
+ProxyRequestContext::Ptr getContext() {
   McrouterOptions opts = defaultTestOptions();
   opts.config_str = "{ \"route\": \"NullRoute\" }";
   auto router = McrouterInstance::init("test_failover_with_exptime", opts);
@@ -0,0 +1,171 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/test/RouteHandleTestUtil.h"
+#include "mcrouter/routes/HedgedMissFailoverRoute.h"
+#include "mcrouter/routes/McrouterRouteHandle.h"
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+using std::make_shared;
+using std::string;
+using std::vector;
+
+using TestHandle = TestHandleImpl<McrouterRouteHandleIf>;
+
+namespace {
+
+std::shared_ptr<McrouterRouteHandle<HedgedMissFailoverRoute>> makeRoute(
+    const vector<std::shared_ptr<TestHandle>>& handles,
+    std::chrono::milliseconds delay,
+    double highMissRatio = 0.8) {
+  return make_shared<McrouterRouteHandle<HedgedMissFailoverRoute>>(
+    get_route_handles(handles),
+    delay,
+    highMissRatio,
+    /* maxTrackedKeys= */ 100);
+}
+
+}  // anonymous namespace
+
+TEST(HedgedMissFailoverRouteTest, firstHits) {
+  vector<std::shared_ptr<TestHandle>> handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "b")),
+  };
+  auto rh = makeRoute(handles, std::chrono::milliseconds(1000));
+  ProxyRequestContext::Ptr ctx;
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    auto reply = rh->route(ProxyMcRequest("key"), McOperation<mc_op_get>(),
+                           ctx);
+    EXPECT_EQ(mc_res_found, reply.result());
+    EXPECT_EQ("a", toString(reply.value()));
+  });
+  EXPECT_EQ(vector<string>{"key"}, handles[0]->saw_keys);
+  EXPECT_TRUE(handles[1]->saw_keys.empty());
+}
+
+TEST(HedgedMissFailoverRouteTest, missFailsOver) {
+  vector<std::shared_ptr<TestHandle>> handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_notfound, "a")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_notfound, "b")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "c")),
+  };
+  auto rh = makeRoute(handles, std::chrono::milliseconds(1000));
+  ProxyRequestContext::Ptr ctx;
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    auto start = std::chrono::steady_clock::now();
+    auto reply = rh->route(ProxyMcRequest("key"), McOperation<mc_op_get>(),
+                           ctx);
+    /* Misses fail over without waiting for the hedging delay */
+    EXPECT_GT(std::chrono::milliseconds(500),
+              std::chrono::steady_clock::now() - start);
+    EXPECT_EQ(mc_res_found, reply.result());
+    EXPECT_EQ("c", toString(reply.value()));
+  });
+}
+
+TEST(HedgedMissFailoverRouteTest, allMiss) {
+  vector<std::shared_ptr<TestHandle>> handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_notfound, "a")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_notfound, "b")),
+  };
+  auto rh = makeRoute(handles, std::chrono::milliseconds(1000));
+  ProxyRequestContext::Ptr ctx;
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    auto reply = rh->route(ProxyMcRequest("key"), McOperation<mc_op_get>(),
+                           ctx);
+    EXPECT_EQ(mc_res_notfound, reply.result());
+    EXPECT_EQ("b", toString(reply.value()));
+  });
+}
+
+TEST(HedgedMissFailoverRouteTest, slowFirst) {
+  vector<std::shared_ptr<TestHandle>> handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "b")),
+  };
+  auto rh = makeRoute(handles, std::chrono::milliseconds(1));
+  ProxyRequestContext::Ptr ctx;
+
+  handles[0]->pause();
+  TestFiberManager fm;
+  fm.run([&]() {
+    auto reply = rh->route(ProxyMcRequest("key"), McOperation<mc_op_get>(),
+                           ctx);
+    /* Next child was asked after the delay */
+    EXPECT_EQ(mc_res_found, reply.result());
+    EXPECT_EQ("b", toString(reply.value()));
+
+    handles[0]->unpause();
+  });
+  EXPECT_EQ(vector<string>{"key"}, handles[0]->saw_keys);
+}
+
+TEST(HedgedMissFailoverRouteTest, highMissRate) {
+  vector<std::shared_ptr<TestHandle>> handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_notfound, "a")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "b")),
+  };
+  auto rh = makeRoute(handles, std::chrono::milliseconds(1000));
+  ProxyRequestContext::Ptr ctx;
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    for (size_t i = 0; i < MissRateTracker::kMinSamples; ++i) {
+      rh->route(ProxyMcRequest("key"), McOperation<mc_op_get>(), ctx);
+    }
+  });
+  EXPECT_TRUE(rh->missTracker().missesOften("key", 0.8));
+  EXPECT_FALSE(rh->missTracker().missesOften("other", 0.8));
+
+  handles[0]->pause();
+  fm.run([&]() {
+    auto reply = rh->route(ProxyMcRequest("key"), McOperation<mc_op_get>(),
+                           ctx);
+    /* Both children were asked right away */
+    EXPECT_EQ(mc_res_found, reply.result());
+    EXPECT_EQ("b", toString(reply.value()));
+
+    handles[0]->unpause();
+  });
+}
+
+TEST(HedgedMissFailoverRouteTest, missRateTracker) {
+  MissRateTracker tracker(2);
+  tracker.record("hit", false);
+  EXPECT_EQ(0, tracker.size());
+
+  for (size_t i = 0; i < MissRateTracker::kMinSamples; ++i) {
+    tracker.record("a", i % 2 == 0);
+  }
+  EXPECT_TRUE(tracker.missesOften("a", 0.5));
+  EXPECT_FALSE(tracker.missesOften("a", 0.8));
+
+  tracker.record("b", true);
+  EXPECT_EQ(2, tracker.size());
+  /* Full, tracked keys are dropped */
+  tracker.record("c", true);
+  EXPECT_EQ(1, tracker.size());
+  EXPECT_FALSE(tracker.missesOften("a", 0.5));
+}
@@ -0,0 +1,142 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/test/RouteHandleTestUtil.h"
+#include "mcrouter/routes/HedgedRoute.h"
+#include "mcrouter/routes/McrouterRouteHandle.h"
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+using std::make_shared;
+using std::string;
+using std::vector;
+
+using TestHandle = TestHandleImpl<McrouterRouteHandleIf>;
+
+namespace {
+
+std::shared_ptr<McrouterRouteHandle<HedgedRoute>> makeRoute(
+    const vector<std::shared_ptr<TestHandle>>& handles,
+    std::chrono::milliseconds delay) {
+  return make_shared<McrouterRouteHandle<HedgedRoute>>(
+    get_route_handles(handles),
+    /* percentile= */ 95.0,
+    /* initialDelay= */ delay,
+    /* minDelay= */ std::chrono::milliseconds(1),
+    /* maxHedges= */ 1);
+}
+
+}  // anonymous namespace
+
+TEST(HedgedRouteTest, primaryReplies) {
+  vector<std::shared_ptr<TestHandle>> handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "b")),
+  };
+  auto rh = makeRoute(handles, std::chrono::milliseconds(1000));
+  ProxyRequestContext::Ptr ctx;
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    auto reply = rh->route(ProxyMcRequest("key"), McOperation<mc_op_get>(),
+                           ctx);
+    EXPECT_EQ(mc_res_found, reply.result());
+    EXPECT_EQ("a", toString(reply.value()));
+  });
+  EXPECT_EQ(vector<string>{"key"}, handles[0]->saw_keys);
+  EXPECT_TRUE(handles[1]->saw_keys.empty());
+}
+
+TEST(HedgedRouteTest, slowPrimary) {
+  vector<std::shared_ptr<TestHandle>> handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "b")),
+  };
+  auto rh = makeRoute(handles, std::chrono::milliseconds(1));
+  ProxyRequestContext::Ptr ctx;
+
+  handles[0]->pause();
+  TestFiberManager fm;
+  fm.run([&]() {
+    auto reply = rh->route(ProxyMcRequest("key"), McOperation<mc_op_get>(),
+                           ctx);
+    /* Backup request was sent after the delay */
+    EXPECT_EQ(mc_res_found, reply.result());
+    EXPECT_EQ("b", toString(reply.value()));
+    EXPECT_TRUE(handles[0]->saw_keys.empty());
+    EXPECT_EQ(vector<string>{"key"}, handles[1]->saw_keys);
+
+    handles[0]->unpause();
+  });
+  /* Slow request completes in the background */
+  EXPECT_EQ(vector<string>{"key"}, handles[0]->saw_keys);
+}
+
+TEST(HedgedRouteTest, primaryError) {
+  vector<std::shared_ptr<TestHandle>> handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_timeout, "a")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "b")),
+  };
+  auto rh = makeRoute(handles, std::chrono::milliseconds(1000));
+  ProxyRequestContext::Ptr ctx;
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    auto start = std::chrono::steady_clock::now();
+    auto reply = rh->route(ProxyMcRequest("key"), McOperation<mc_op_get>(),
+                           ctx);
+    /* Failed over without waiting for the hedging delay */
+    EXPECT_GT(std::chrono::milliseconds(500),
+              std::chrono::steady_clock::now() - start);
+    EXPECT_EQ(mc_res_found, reply.result());
+    EXPECT_EQ("b", toString(reply.value()));
+  });
+}
+
+TEST(HedgedRouteTest, allErrors) {
+  vector<std::shared_ptr<TestHandle>> handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_timeout, "a")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_remote_error, "b")),
+  };
+  auto rh = makeRoute(handles, std::chrono::milliseconds(1000));
+  ProxyRequestContext::Ptr ctx;
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    auto reply = rh->route(ProxyMcRequest("key"), McOperation<mc_op_get>(),
+                           ctx);
+    EXPECT_EQ(mc_res_remote_error, reply.result());
+  });
+}
+
+TEST(HedgedRouteTest, updatesNotHedged) {
+  vector<std::shared_ptr<TestHandle>> handles{
+    make_shared<TestHandle>(UpdateRouteTestData(mc_res_stored)),
+    make_shared<TestHandle>(UpdateRouteTestData(mc_res_stored)),
+  };
+  auto rh = makeRoute(handles, std::chrono::milliseconds(1));
+  ProxyRequestContext::Ptr ctx;
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    auto reply = rh->route(ProxyMcRequest("key"), McOperation<mc_op_set>(),
+                           ctx);
+    EXPECT_EQ(mc_res_stored, reply.result());
+  });
+  EXPECT_EQ(vector<string>{"key"}, handles[0]->saw_keys);
+  EXPECT_TRUE(handles[1]->saw_keys.empty());
+}
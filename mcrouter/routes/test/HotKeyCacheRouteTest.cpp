@@ -0,0 +1,130 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <folly/Memory.h>
+
+#include "mcrouter/lib/test/RouteHandleTestUtil.h"
+#include "mcrouter/routes/HotKeyCacheRoute.h"
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+using std::make_shared;
+using std::string;
+using std::vector;
+
+using TestHandle = TestHandleImpl<McrouterRouteHandleIf>;
+
+namespace {
+
+std::unique_ptr<HotKeyCacheRoute> makeRoute(
+    const std::shared_ptr<TestHandle>& handle,
+    std::chrono::milliseconds ttl,
+    size_t maxKeys = 10) {
+  return folly::make_unique<HotKeyCacheRoute>(
+    get_route_handles(vector<std::shared_ptr<TestHandle>>{handle})[0],
+    ttl,
+    maxKeys,
+    /* hotThreshold= */ 3,
+    /* window= */ 1000);
+}
+
+template <class Operation>
+ProxyMcReply send(HotKeyCacheRoute& rh,
+                  const std::string& key, Operation) {
+  ProxyRequestContext::Ptr ctx;
+  return rh.route(ProxyMcRequest(key), Operation(), ctx);
+}
+
+}  // anonymous namespace
+
+TEST(HotKeyCacheRouteTest, cachesHotKeys) {
+  auto handle = make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a"));
+  auto rh = makeRoute(handle, std::chrono::milliseconds(10000));
+
+  for (size_t i = 0; i < 5; ++i) {
+    auto reply = send(*rh, "key", McOperation<mc_op_get>());
+    EXPECT_EQ(mc_res_found, reply.result());
+    EXPECT_EQ("a", toString(reply.value()));
+  }
+  /* The third request made the key hot, the rest were served from cache */
+  EXPECT_EQ(3, handle->saw_keys.size());
+  EXPECT_EQ(1, rh->cachedKeys());
+
+  /* Cold keys are not cached */
+  send(*rh, "other", McOperation<mc_op_get>());
+  EXPECT_EQ(4, handle->saw_keys.size());
+  EXPECT_EQ(1, rh->cachedKeys());
+}
+
+TEST(HotKeyCacheRouteTest, onlyPlainGets) {
+  auto handle = make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a"));
+  auto rh = makeRoute(handle, std::chrono::milliseconds(10000));
+
+  for (size_t i = 0; i < 5; ++i) {
+    send(*rh, "key", McOperation<mc_op_gets>());
+  }
+  EXPECT_EQ(5, handle->saw_keys.size());
+  EXPECT_EQ(0, rh->cachedKeys());
+}
+
+TEST(HotKeyCacheRouteTest, invalidate) {
+  auto handle = make_shared<TestHandle>(
+    GetRouteTestData(mc_res_found, "a"),
+    UpdateRouteTestData(mc_res_stored),
+    DeleteRouteTestData(mc_res_deleted));
+  auto rh = makeRoute(handle, std::chrono::milliseconds(10000));
+
+  for (size_t i = 0; i < 3; ++i) {
+    send(*rh, "key", McOperation<mc_op_get>());
+  }
+  EXPECT_EQ(1, rh->cachedKeys());
+
+  send(*rh, "key", McOperation<mc_op_set>());
+  EXPECT_EQ(0, rh->cachedKeys());
+  send(*rh, "key", McOperation<mc_op_get>());
+  EXPECT_EQ(1, rh->cachedKeys());
+
+  send(*rh, "key", McOperation<mc_op_delete>());
+  EXPECT_EQ(0, rh->cachedKeys());
+}
+
+TEST(HotKeyCacheRouteTest, expire) {
+  auto handle = make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a"));
+  auto rh = makeRoute(handle, std::chrono::milliseconds(1));
+
+  for (size_t i = 0; i < 3; ++i) {
+    send(*rh, "key", McOperation<mc_op_get>());
+  }
+  EXPECT_EQ(1, rh->cachedKeys());
+
+  usleep(2000);
+  send(*rh, "key", McOperation<mc_op_get>());
+  EXPECT_EQ(4, handle->saw_keys.size());
+}
+
+TEST(HotKeyCacheRouteTest, evict) {
+  auto handle = make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a"));
+  auto rh = makeRoute(handle, std::chrono::milliseconds(10000),
+                      /* maxKeys= */ 2);
+
+  for (const char* key : {"a", "b", "c"}) {
+    for (size_t i = 0; i < 3; ++i) {
+      send(*rh, key, McOperation<mc_op_get>());
+    }
+  }
+  EXPECT_EQ(2, rh->cachedKeys());
+}
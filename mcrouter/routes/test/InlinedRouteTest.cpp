@@ -0,0 +1,120 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/Ch3HashFunc.h"
+#include "mcrouter/lib/Crc32HashFunc.h"
+#include "mcrouter/lib/routes/ErrorRoute.h"
+#include "mcrouter/lib/test/RouteHandleTestUtil.h"
+#include "mcrouter/routes/InlinedRoute.h"
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+using std::make_shared;
+using std::vector;
+
+using TestHandle = TestHandleImpl<McrouterRouteHandleIf>;
+using TestLeaf = RecordingRoute<McrouterRouteHandleIf>;
+
+namespace {
+
+McrouterRouteHandlePtr makeHash(
+    const vector<std::shared_ptr<TestHandle>>& handles) {
+  return std::make_shared<McrouterRouteHandle<
+    HashRoute<McrouterRouteHandleIf, Crc32HashFunc>>>(
+      get_route_handles(handles), "", Crc32HashFunc(handles.size()));
+}
+
+}  // anonymous namespace
+
+TEST(InlinedRouteTest, failoverHash) {
+  vector<std::shared_ptr<TestHandle>> primary{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_timeout, "a")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_timeout, "b")),
+  };
+  vector<std::shared_ptr<TestHandle>> failover{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "c")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "c")),
+  };
+  auto original = std::make_shared<McrouterRouteHandle<
+    FailoverRoute<McrouterRouteHandleIf>>>(
+      vector<McrouterRouteHandlePtr>{ makeHash(primary), makeHash(failover) });
+
+  auto rh = tryInlineRoute<TestLeaf, Crc32HashFunc>(original);
+  ASSERT_TRUE(rh != nullptr);
+  EXPECT_TRUE(rh != original);
+  EXPECT_EQ(original->routeName(), rh->routeName());
+
+  TestFiberManager fm;
+  fm.run([&rh]() {
+    ProxyRequestContext::Ptr ctx;
+    auto reply = rh->route(ProxyMcRequest("key"), McOperation<mc_op_get>(),
+                           ctx);
+    EXPECT_EQ(mc_res_found, reply.result());
+    EXPECT_EQ("c", toString(reply.value()));
+  });
+
+  EXPECT_EQ(1, primary[0]->saw_keys.size() + primary[1]->saw_keys.size());
+  EXPECT_EQ(1, failover[0]->saw_keys.size() + failover[1]->saw_keys.size());
+}
+
+TEST(InlinedRouteTest, hash) {
+  vector<std::shared_ptr<TestHandle>> handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "b")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "c")),
+  };
+  auto original = makeHash(handles);
+  auto rh = tryInlineRoute<TestLeaf, Crc32HashFunc>(original);
+  ASSERT_TRUE(rh != nullptr);
+
+  TestFiberManager fm;
+  fm.run([&original, &rh]() {
+    ProxyRequestContext::Ptr ctx;
+    for (auto key : { "key1", "key2", "key3", "key4" }) {
+      auto expected = original->route(ProxyMcRequest(key),
+                                      McOperation<mc_op_get>(), ctx);
+      auto reply = rh->route(ProxyMcRequest(key), McOperation<mc_op_get>(),
+                             ctx);
+      EXPECT_EQ(toString(expected.value()), toString(reply.value()));
+    }
+  });
+}
+
+TEST(InlinedRouteTest, otherShapes) {
+  vector<std::shared_ptr<TestHandle>> handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a")),
+  };
+  /* Hash functions must match */
+  EXPECT_TRUE((tryInlineRoute<TestLeaf, Ch3HashFunc>(makeHash(handles))
+               == nullptr));
+
+  /* All children of FailoverRoute must be inlined */
+  auto failover = std::make_shared<McrouterRouteHandle<
+    FailoverRoute<McrouterRouteHandleIf>>>(
+      vector<McrouterRouteHandlePtr>{
+        makeHash(handles),
+        std::make_shared<McrouterRouteHandle<
+          ErrorRoute<McrouterRouteHandleIf>>>()
+      });
+  EXPECT_TRUE((tryInlineRoute<TestLeaf, Crc32HashFunc>(failover) == nullptr));
+
+  /* Leaves must be of the given type */
+  auto nested = std::make_shared<McrouterRouteHandle<
+    HashRoute<McrouterRouteHandleIf, Crc32HashFunc>>>(
+      vector<McrouterRouteHandlePtr>{ makeHash(handles) }, "",
+      Crc32HashFunc(1));
+  EXPECT_TRUE((tryInlineRoute<TestLeaf, Crc32HashFunc>(nested) == nullptr));
+}
@@ -0,0 +1,92 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <folly/Memory.h>
+
+#include "mcrouter/lib/test/RouteHandleTestUtil.h"
+#include "mcrouter/routes/KeyRateLimitRoute.h"
+#include "mcrouter/routes/McrouterRouteHandle.h"
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+using std::make_shared;
+using std::string;
+using std::vector;
+
+using TestHandle = TestHandleImpl<McrouterRouteHandleIf>;
+
+namespace {
+
+std::unique_ptr<KeyRateLimitRoute> makeRoute(
+    const std::shared_ptr<TestHandle>& handle,
+    KeyRateLimitRoute::Options opts) {
+  /* One request per second, so the count limit is 2 */
+  opts.maxRate = 1.0;
+  opts.period = std::chrono::milliseconds(1000);
+  return folly::make_unique<KeyRateLimitRoute>(
+    get_route_handles(vector<std::shared_ptr<TestHandle>>{handle})[0],
+    std::move(opts));
+}
+
+ProxyMcReply get(KeyRateLimitRoute& rh, const std::string& key) {
+  ProxyRequestContext::Ptr ctx;
+  return rh.route(ProxyMcRequest(key), McOperation<mc_op_get>(), ctx);
+}
+
+}  // anonymous namespace
+
+TEST(KeyRateLimitRouteTest, reject) {
+  auto handle = make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a"));
+  auto rh = makeRoute(handle, KeyRateLimitRoute::Options());
+
+  EXPECT_EQ(mc_res_found, get(*rh, "key").result());
+  EXPECT_EQ(mc_res_found, get(*rh, "key").result());
+  EXPECT_EQ(mc_res_notfound, get(*rh, "key").result());
+  EXPECT_EQ(1, rh->numLimited());
+
+  /* Other keys have limits of their own */
+  EXPECT_EQ(mc_res_found, get(*rh, "other").result());
+  EXPECT_EQ(3, handle->saw_keys.size());
+}
+
+TEST(KeyRateLimitRouteTest, prefix) {
+  auto handle = make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a"));
+  KeyRateLimitRoute::Options opts;
+  opts.prefixDelimiter = ":";
+  auto rh = makeRoute(handle, std::move(opts));
+
+  EXPECT_EQ(mc_res_found, get(*rh, "foo:1").result());
+  EXPECT_EQ(mc_res_found, get(*rh, "foo:2").result());
+  EXPECT_EQ(mc_res_notfound, get(*rh, "foo:3").result());
+  EXPECT_EQ(mc_res_found, get(*rh, "bar:1").result());
+}
+
+TEST(KeyRateLimitRouteTest, cache) {
+  auto handle = make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a"));
+  KeyRateLimitRoute::Options opts;
+  opts.action = KeyRateLimitRoute::Action::CACHE;
+  opts.cacheTtl = std::chrono::milliseconds(10000);
+  auto rh = makeRoute(handle, std::move(opts));
+
+  for (size_t i = 0; i < 5; ++i) {
+    auto reply = get(*rh, "key");
+    EXPECT_EQ(mc_res_found, reply.result());
+    EXPECT_EQ("a", toString(reply.value()));
+  }
+  /* The first request over the limit filled the cache */
+  EXPECT_EQ(3, handle->saw_keys.size());
+  EXPECT_EQ(3, rh->numLimited());
+}
@@ -0,0 +1,82 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <folly/Memory.h>
+
+#include "mcrouter/lib/test/RouteHandleTestUtil.h"
+#include "mcrouter/routes/LeastLoadedRoute.h"
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+using std::make_shared;
+using std::string;
+using std::vector;
+
+using TestHandle = TestHandleImpl<McrouterRouteHandleIf>;
+
+namespace {
+
+std::function<void()> sendGet(LeastLoadedRoute& rh, const std::string& key) {
+  return [&rh, key]() {
+    ProxyRequestContext::Ptr ctx;
+    auto reply = rh.route(ProxyMcRequest(key), McOperation<mc_op_get>(), ctx);
+    EXPECT_EQ(mc_res_found, reply.result());
+  };
+}
+
+}  // anonymous namespace
+
+TEST(LeastLoadedRouteTest, avoidsBusyChild) {
+  vector<std::shared_ptr<TestHandle>> handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "b")),
+  };
+  LeastLoadedRoute rh(get_route_handles(handles));
+
+  handles[0]->pause();
+  handles[1]->pause();
+  TestFiberManager fm;
+  fm.runAll({
+    sendGet(rh, "key1"),
+    /* With two children, both are always sampled: the idle one wins */
+    sendGet(rh, "key2"),
+    [&]() {
+      EXPECT_EQ(1, rh.inflight(0));
+      EXPECT_EQ(1, rh.inflight(1));
+      handles[0]->unpause();
+      handles[1]->unpause();
+    }
+  });
+
+  EXPECT_EQ(1, handles[0]->saw_keys.size());
+  EXPECT_EQ(1, handles[1]->saw_keys.size());
+  EXPECT_EQ(0, rh.inflight(0));
+  EXPECT_EQ(0, rh.inflight(1));
+}
+
+TEST(LeastLoadedRouteTest, singleChild) {
+  vector<std::shared_ptr<TestHandle>> handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a")),
+  };
+  LeastLoadedRoute rh(get_route_handles(handles));
+
+  TestFiberManager fm;
+  fm.run(sendGet(rh, "key1"));
+  fm.run(sendGet(rh, "key2"));
+
+  EXPECT_EQ((vector<string>{"key1", "key2"}), handles[0]->saw_keys);
+}
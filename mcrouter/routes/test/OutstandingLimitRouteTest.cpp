@@ -29,13 +29,14 @@ std::string makeKey(uint64_t id) {
   return folly::sformat("test-key:{}", id);
 }
 
-std::shared_ptr<ProxyRequestContext> getContext(uint64_t senderId) {
+ProxyRequestContext::Ptr getContext(uint64_t senderId, uint32_t weight) {
   McrouterOptions opts = defaultTestOptions();
   opts.config_str = "{ \"route\": \"NullRoute\" }";
   auto router = McrouterInstance::init("test_oustanding_limit", opts);
   auto ctx = ProxyRequestContext::createRecording(*router->getProxy(0),
                                                   nullptr);
   ctx->setSenderIdForTest(senderId);
+  ctx->setSenderWeightForTest(weight);
   return ctx;
 }
 
@@ -45,8 +46,9 @@ void sendRequest(folly::fibers::FiberManager& fm,
                  McrouterRouteHandleIf& rh,
                  size_t id,
                  uint64_t senderId,
-                 std::vector<std::string>& replyOrder) {
-  auto context = getContext(senderId);
+                 std::vector<std::string>& replyOrder,
+                 uint32_t weight = 1) {
+  auto context = getContext(senderId, weight);
 
   fm.addTask([&rh, id, context, &replyOrder]() {
       ProxyMcRequest request(makeKey(id));
@@ -111,3 +113,48 @@ TEST(oustandingLimitRouteTest, basic) {
   EXPECT_EQ(makeKey(13), replyOrder[12]);
   EXPECT_EQ(makeKey(7), replyOrder[13]);
 }
+
+TEST(oustandingLimitRouteTest, weights) {
+  auto normalHandle = std::make_shared<TestHandle>(
+    GetRouteTestData(mc_res_found, "a"));
+
+  McrouterRouteHandle<OutstandingLimitRoute> rh(
+    normalHandle->rh,
+    1);
+
+  normalHandle->pause();
+
+  std::vector<std::string> replyOrder;
+
+  TestFiberManager testfm;
+  auto& fm = testfm.getFiberManager();
+
+  sendRequest(fm, rh, 1, 1, replyOrder, 2);
+  sendRequest(fm, rh, 2, 1, replyOrder, 2);
+  sendRequest(fm, rh, 3, 1, replyOrder, 2);
+  sendRequest(fm, rh, 4, 1, replyOrder, 2);
+  sendRequest(fm, rh, 5, 1, replyOrder, 2);
+  sendRequest(fm, rh, 6, 2, replyOrder);
+  sendRequest(fm, rh, 7, 2, replyOrder);
+  sendRequest(fm, rh, 8, 2, replyOrder);
+
+  auto& loopController =
+    dynamic_cast<folly::fibers::SimpleLoopController&>(fm.loopController());
+  loopController.loop([&]() {
+      fm.addTask([&]() {
+          normalHandle->unpause();
+        });
+      loopController.stop();
+    });
+
+  /* Sender 1 gets two requests through per round, sender 2 one */
+  ASSERT_EQ(8, replyOrder.size());
+  EXPECT_EQ(makeKey(1), replyOrder[0]);
+  EXPECT_EQ(makeKey(2), replyOrder[1]);
+  EXPECT_EQ(makeKey(3), replyOrder[2]);
+  EXPECT_EQ(makeKey(6), replyOrder[3]);
+  EXPECT_EQ(makeKey(4), replyOrder[4]);
+  EXPECT_EQ(makeKey(5), replyOrder[5]);
+  EXPECT_EQ(makeKey(7), replyOrder[6]);
+  EXPECT_EQ(makeKey(8), replyOrder[7]);
+}
@@ -15,6 +15,7 @@
 
 #include <folly/json.h>
 
+#include "mcrouter/ConfigObjectCache.h"
 #include "mcrouter/lib/test/RouteHandleTestUtil.h"
 #include "mcrouter/routes/McrouterRouteHandle.h"
 #include "mcrouter/routes/RateLimitRoute.h"
@@ -50,7 +51,7 @@ void test(Data data, Operation,
   McrouterRouteHandle<RateLimitRoute> rh(
     normalRh,
     RateLimiter(json));
-  std::shared_ptr<ProxyRequestContext> ctx;
+  ProxyRequestContext::Ptr ctx;
 
   if (burst) {
     usleep(1001000);
@@ -98,3 +99,18 @@ TEST(rateLimitRouteTest, getsBasic) { testGets(); }
 TEST(rateLimitRouteTest, getsBurst) { testGets(true); }
 TEST(rateLimitRouteTest, deletesBasic) { testDeletes(); }
 TEST(rateLimitRouteTest, deletesBurst) { testDeletes(true); }
+
+TEST(rateLimitRouteTest, shared) {
+  auto json = parseJsonString("{\"gets_rate\": 2.0, \"shared\": true}");
+  ConfigObjectCache cache;
+  /* Rate limiters of two proxies */
+  RateLimiter first(json, &cache, "pool");
+  RateLimiter second(json, &cache, "pool");
+  RateLimiter otherPool(json, &cache, "other");
+
+  usleep(501000);
+  EXPECT_TRUE(first.canPassThrough(McOperation<mc_op_get>()));
+  EXPECT_FALSE(second.canPassThrough(McOperation<mc_op_get>()));
+  EXPECT_FALSE(first.canPassThrough(McOperation<mc_op_get>()));
+  EXPECT_TRUE(otherPool.canPassThrough(McOperation<mc_op_get>()));
+}
@@ -0,0 +1,554 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+#include <folly/experimental/fibers/Baton.h>
+#include <folly/experimental/fibers/FiberManager.h>
+#include <folly/experimental/fibers/SimpleLoopController.h>
+#include <folly/io/IOBuf.h>
+#include <folly/Memory.h>
+
+#include "mcrouter/lib/Ch3HashFunc.h"
+#include "mcrouter/lib/Crc32HashFunc.h"
+#include "mcrouter/lib/routes/AllSyncRoute.h"
+#include "mcrouter/lib/routes/FailoverRoute.h"
+#include "mcrouter/lib/routes/HashRoute.h"
+#include "mcrouter/lib/routes/NullRoute.h"
+#include "mcrouter/lib/test/RouteHandleTestUtil.h"
+#include "mcrouter/lib/WeightedCh3HashFunc.h"
+#include "mcrouter/proxy.h"
+#include "mcrouter/ProxyMcRequest.h"
+#include "mcrouter/routes/BigValueRoute.h"
+#include "mcrouter/routes/DefaultShadowPolicy.h"
+#include "mcrouter/routes/InlinedRoute.h"
+#include "mcrouter/routes/McrouterRouteHandle.h"
+#include "mcrouter/routes/ModifyKeyRoute.h"
+#include "mcrouter/routes/PrefixRouteSelector.h"
+#include "mcrouter/routes/RouteHandleMap.h"
+#include "mcrouter/routes/ShadowRoute.h"
+#include "mcrouter/routes/ShardHashFunc.h"
+
+/**
+ * Per-request cost of routes, without any network: every route ends in
+ * NullRoute leaves, which reply right away.
+ *
+ * Each iteration builds a request for one of kNumKeys keys and routes it,
+ * so compare against NullRoute (request + leaf only) for the overhead
+ * of a route. Requests are routed in fibers, kBatch per fiber manager
+ * loop, so background fibers (shadow requests) also run in the
+ * measured time.
+ *
+ * After the timings, allocations/op is printed for each benchmark.
+ * Allocations are counted in operator new, buffers allocated with malloc
+ * directly (e.g. IOBuf data) are not counted.
+ *
+ * Suspended_* benchmarks measure the fiber execution model under high
+ * concurrency instead: kConcurrency requests are started at once and all
+ * of them park in their leaf (like a DestinationRoute waiting for a reply)
+ * before any is resumed. Their fiber stack memory per request is printed
+ * after the allocations.
+ */
+
+namespace {
+
+std::atomic<uint64_t> gAllocs{0};
+
+}  // anonymous namespace
+
+void* operator new(size_t size) {
+  gAllocs.fetch_add(1, std::memory_order_relaxed);
+  if (auto p = malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete[](void* p) noexcept {
+  free(p);
+}
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+namespace {
+
+const size_t kNumKeys = 1024;
+const size_t kNumChildren = 8;
+const size_t kBatch = 100;
+const size_t kBigValueThreshold = 1024;
+const size_t kConcurrency = 10000;
+/* Default of opts.fibers_stack_size */
+const size_t kStackSize = 24 * 1024;
+
+std::vector<std::string> keys;
+
+void prepareKeys() {
+  for (size_t i = 0; i < kNumKeys; ++i) {
+    keys.push_back("tao:assoc:" + folly::to<std::string>(i * 7919));
+  }
+}
+
+McrouterRouteHandlePtr makeLeaf() {
+  return std::make_shared<
+    McrouterRouteHandle<NullRoute<McrouterRouteHandleIf>>>();
+}
+
+std::vector<McrouterRouteHandlePtr> makeLeaves(size_t n) {
+  std::vector<McrouterRouteHandlePtr> leaves;
+  for (size_t i = 0; i < n; ++i) {
+    leaves.push_back(makeLeaf());
+  }
+  return leaves;
+}
+
+template <class Operation>
+void runRoute(McrouterRouteHandleIf& rh, Operation, size_t iters,
+              const folly::IOBuf* value = nullptr) {
+  folly::BenchmarkSuspender braces;
+  TestFiberManager fm;
+  ProxyRequestContext::Ptr ctx;
+
+  braces.dismiss();
+  for (size_t done = 0; done < iters; done += kBatch) {
+    auto n = std::min(kBatch, iters - done);
+    fm.run([&rh, &ctx, value, done, n]() {
+      for (size_t i = done; i < done + n; ++i) {
+        ProxyMcRequest req(keys[i % kNumKeys]);
+        if (value) {
+          folly::IOBuf v;
+          value->cloneInto(v);
+          req.setValue(std::move(v));
+        }
+        auto reply = rh.route(req, Operation(), ctx);
+        folly::doNotOptimizeAway(reply.result());
+      }
+    });
+  }
+  braces.rehire();
+
+  /* Lets the remaining background fibers finish */
+  fm.run([]() {});
+}
+
+/* Batons of the requests parked in ParkingRoute leaves */
+std::vector<folly::fibers::Baton*> parked;
+
+/**
+ * Leaf blocking its fiber until the benchmark resumes it, stands in for
+ * DestinationRoute waiting on the network.
+ */
+class ParkingRoute {
+ public:
+  static std::string routeName() {
+    return "parking";
+  }
+
+  template <class Operation, class Request>
+  std::vector<McrouterRouteHandlePtr> couldRouteTo(
+    const Request& req, Operation,
+    const McrouterRouteHandleIf::ContextPtr& ctx) const {
+
+    return {};
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation,
+    const McrouterRouteHandleIf::ContextPtr& ctx) const {
+
+    folly::fibers::Baton baton;
+    parked.push_back(&baton);
+    baton.wait();
+    return typename ReplyType<Operation, Request>::type(DefaultReply,
+                                                        Operation());
+  }
+};
+
+struct SuspendedStats {
+  size_t fibersAllocated{0};
+  size_t stackHighWatermark{0};
+};
+
+/**
+ * Routes iters requests through rh, kConcurrency of them suspended at a
+ * time.
+ */
+template <class Operation>
+SuspendedStats runSuspended(McrouterRouteHandleIf& rh, Operation,
+                            size_t iters) {
+  folly::BenchmarkSuspender braces;
+  folly::fibers::FiberManager::Options fmOpts;
+  fmOpts.stackSize = kStackSize;
+  fmOpts.recordStackEvery = 1;
+  folly::fibers::FiberManager fm(
+    folly::make_unique<folly::fibers::SimpleLoopController>(), fmOpts);
+  auto& loopController =
+    dynamic_cast<folly::fibers::SimpleLoopController&>(fm.loopController());
+  ProxyRequestContext::Ptr ctx;
+  SuspendedStats stats;
+
+  braces.dismiss();
+  for (size_t done = 0; done < iters; done += kConcurrency) {
+    auto n = std::min(kConcurrency, iters - done);
+    size_t replied = 0;
+    for (size_t i = done; i < done + n; ++i) {
+      fm.addTask([&rh, &ctx, &replied, i]() {
+        ProxyMcRequest req(keys[i % kNumKeys]);
+        auto reply = rh.route(req, Operation(), ctx);
+        folly::doNotOptimizeAway(reply.result());
+        ++replied;
+      });
+    }
+    loopController.loop([&]() {
+      if (replied == n) {
+        loopController.stop();
+      } else if (!parked.empty()) {
+        /* Called between fiber manager loops: whatever hasn't replied
+           yet is parked */
+        stats.fibersAllocated =
+          std::max(stats.fibersAllocated, fm.fibersAllocated());
+        for (auto baton : parked) {
+          baton->post();
+        }
+        parked.clear();
+      }
+    });
+  }
+  braces.rehire();
+
+  stats.stackHighWatermark = fm.stackHighWatermark();
+  return stats;
+}
+
+template <class HashFunc>
+McrouterRouteHandlePtr makeHashRoute(HashFunc func) {
+  return std::make_shared<McrouterRouteHandle<
+    HashRoute<McrouterRouteHandleIf, HashFunc>>>(
+      makeLeaves(kNumChildren), "", std::move(func));
+}
+
+void benchNull(size_t iters) {
+  static auto rh = makeLeaf();
+  runRoute(*rh, McOperation<mc_op_get>(), iters);
+}
+
+void benchHashCh3(size_t iters) {
+  static auto rh = makeHashRoute(Ch3HashFunc(kNumChildren));
+  runRoute(*rh, McOperation<mc_op_get>(), iters);
+}
+
+void benchHashCrc32(size_t iters) {
+  static auto rh = makeHashRoute(Crc32HashFunc(kNumChildren));
+  runRoute(*rh, McOperation<mc_op_get>(), iters);
+}
+
+void benchHashWeightedCh3(size_t iters) {
+  static auto rh = makeHashRoute(
+    WeightedCh3HashFunc(std::vector<double>(kNumChildren, 0.5)));
+  runRoute(*rh, McOperation<mc_op_get>(), iters);
+}
+
+void benchHashConstShard(size_t iters) {
+  static auto rh = makeHashRoute(ConstShardHashFunc(kNumChildren));
+  runRoute(*rh, McOperation<mc_op_get>(), iters);
+}
+
+void benchFailover(size_t iters) {
+  static auto rh = std::make_shared<McrouterRouteHandle<
+    FailoverRoute<McrouterRouteHandleIf>>>(makeLeaves(3));
+  runRoute(*rh, McOperation<mc_op_get>(), iters);
+}
+
+McrouterRouteHandlePtr makeFailoverHashRoute() {
+  std::vector<McrouterRouteHandlePtr> children;
+  for (size_t i = 0; i < 3; ++i) {
+    children.push_back(makeHashRoute(Ch3HashFunc(kNumChildren)));
+  }
+  return std::make_shared<McrouterRouteHandle<
+    FailoverRoute<McrouterRouteHandleIf>>>(std::move(children));
+}
+
+void benchFailoverHash(size_t iters) {
+  static auto rh = makeFailoverHashRoute();
+  runRoute(*rh, McOperation<mc_op_get>(), iters);
+}
+
+void benchFailoverHashInlined(size_t iters) {
+  static auto rh = tryInlineRoute<NullRoute<McrouterRouteHandleIf>,
+                                  Ch3HashFunc>(makeFailoverHashRoute());
+  runRoute(*rh, McOperation<mc_op_get>(), iters);
+}
+
+void benchAllSync(size_t iters) {
+  static auto rh = std::make_shared<McrouterRouteHandle<
+    AllSyncRoute<McrouterRouteHandleIf>>>(makeLeaves(3));
+  runRoute(*rh, McOperation<mc_op_delete>(), iters);
+}
+
+void benchShadow(size_t iters) {
+  static auto rh = []() {
+    auto data = std::make_shared<ShadowSettings::Data>();
+    data->end_index = 1;
+    data->end_key_fraction = 1.0;
+    McrouterShadowData shadowData = {
+      {makeLeaf(), std::make_shared<ShadowSettings>(data, nullptr)},
+    };
+    return std::make_shared<McrouterRouteHandle<
+      ShadowRoute<DefaultShadowPolicy>>>(
+        makeLeaf(), std::move(shadowData), 0, DefaultShadowPolicy());
+  }();
+  runRoute(*rh, McOperation<mc_op_get>(), iters);
+}
+
+void benchModifyKey(size_t iters) {
+  static auto rh = std::make_shared<McrouterRouteHandle<ModifyKeyRoute>>(
+    makeLeaf(), folly::none, "foo:");
+  runRoute(*rh, McOperation<mc_op_get>(), iters);
+}
+
+void benchBigValueGet(size_t iters) {
+  static auto rh = std::make_shared<McrouterRouteHandle<BigValueRoute>>(
+    makeLeaf(), BigValueRouteOptions(kBigValueThreshold));
+  runRoute(*rh, McOperation<mc_op_get>(), iters);
+}
+
+void benchBigValueSet(size_t iters) {
+  static auto rh = std::make_shared<McrouterRouteHandle<BigValueRoute>>(
+    makeLeaf(), BigValueRouteOptions(kBigValueThreshold));
+  static auto value = []() {
+    auto buf = folly::IOBuf::create(4 * kBigValueThreshold);
+    memset(buf->writableTail(), 'a', buf->tailroom());
+    buf->append(buf->tailroom());
+    return buf;
+  }();
+  runRoute(*rh, McOperation<mc_op_set>(), iters, value.get());
+}
+
+void benchRouteHandleMap(size_t iters) {
+  static RoutingPrefix defaultRoute("/a/b/");
+  static auto map = []() {
+    auto selector = std::make_shared<PrefixRouteSelector>();
+    selector->wildcard = makeLeaf();
+    selector->policies.emplace("tao:", makeLeaf());
+    RouteSelectorMap selectors;
+    selectors.emplace("/a/b/", std::move(selector));
+    return std::make_shared<RouteHandleMap>(selectors, defaultRoute, false);
+  }();
+
+  size_t sum = 0;
+  for (size_t i = 0; i < iters; ++i) {
+    auto targets = map->getTargetsForKeyFast("/a/b/", keys[i % kNumKeys]);
+    sum += targets ? targets->size() : 0;
+  }
+  folly::doNotOptimizeAway(sum);
+}
+
+std::vector<McrouterRouteHandlePtr> makeParkingLeaves(size_t n) {
+  std::vector<McrouterRouteHandlePtr> leaves;
+  for (size_t i = 0; i < n; ++i) {
+    leaves.push_back(std::make_shared<McrouterRouteHandle<ParkingRoute>>());
+  }
+  return leaves;
+}
+
+McrouterRouteHandlePtr makeParkingHashRoute() {
+  return std::make_shared<McrouterRouteHandle<
+    HashRoute<McrouterRouteHandleIf, Ch3HashFunc>>>(
+      makeParkingLeaves(kNumChildren), "", Ch3HashFunc(kNumChildren));
+}
+
+SuspendedStats benchSuspendedLeaf(size_t iters) {
+  static auto rh = std::make_shared<McrouterRouteHandle<ParkingRoute>>();
+  return runSuspended(*rh, McOperation<mc_op_get>(), iters);
+}
+
+SuspendedStats benchSuspendedHash(size_t iters) {
+  static auto rh = makeParkingHashRoute();
+  return runSuspended(*rh, McOperation<mc_op_get>(), iters);
+}
+
+SuspendedStats benchSuspendedFailoverHash(size_t iters) {
+  static auto rh = []() {
+    std::vector<McrouterRouteHandlePtr> children;
+    for (size_t i = 0; i < 3; ++i) {
+      children.push_back(makeParkingHashRoute());
+    }
+    return std::make_shared<McrouterRouteHandle<
+      FailoverRoute<McrouterRouteHandleIf>>>(std::move(children));
+  }();
+  return runSuspended(*rh, McOperation<mc_op_get>(), iters);
+}
+
+SuspendedStats benchSuspendedAllSync(size_t iters) {
+  static auto rh = std::make_shared<McrouterRouteHandle<
+    AllSyncRoute<McrouterRouteHandleIf>>>(makeParkingLeaves(3));
+  return runSuspended(*rh, McOperation<mc_op_delete>(), iters);
+}
+
+struct BenchCase {
+  const char* name;
+  void (*run)(size_t);
+};
+
+const BenchCase kCases[] = {
+  {"NullRoute", benchNull},
+  {"HashRoute_Ch3", benchHashCh3},
+  {"HashRoute_Crc32", benchHashCrc32},
+  {"HashRoute_WeightedCh3", benchHashWeightedCh3},
+  {"HashRoute_ConstShard", benchHashConstShard},
+  {"FailoverRoute", benchFailover},
+  {"FailoverHashRoute", benchFailoverHash},
+  {"FailoverHashRoute_inlined", benchFailoverHashInlined},
+  {"AllSyncRoute", benchAllSync},
+  {"ShadowRoute", benchShadow},
+  {"ModifyKeyRoute", benchModifyKey},
+  {"BigValueRoute_get", benchBigValueGet},
+  {"BigValueRoute_set", benchBigValueSet},
+  {"RouteHandleMap_fast", benchRouteHandleMap},
+};
+
+void printAllocations() {
+  const size_t kIters = 10000;
+  printf("%-40s %14s\n", "allocations", "allocs/op");
+  for (const auto& c : kCases) {
+    /* The first run builds the route */
+    c.run(kBatch);
+    auto before = gAllocs.load(std::memory_order_relaxed);
+    c.run(kIters);
+    auto allocs = gAllocs.load(std::memory_order_relaxed) - before;
+    printf("%-40s %14.2f\n", c.name, static_cast<double>(allocs) / kIters);
+  }
+}
+
+struct SuspendedBenchCase {
+  const char* name;
+  SuspendedStats (*run)(size_t);
+};
+
+const SuspendedBenchCase kSuspendedCases[] = {
+  {"Suspended_Leaf", benchSuspendedLeaf},
+  {"Suspended_HashRoute", benchSuspendedHash},
+  {"Suspended_FailoverHashRoute", benchSuspendedFailoverHash},
+  {"Suspended_AllSyncRoute", benchSuspendedAllSync},
+};
+
+void printSuspendedMemory() {
+  printf("%-40s %14s %14s %14s\n", "suspended requests", "fibers/req",
+         "stack KiB/req", "stack used");
+  for (const auto& c : kSuspendedCases) {
+    auto stats = c.run(kConcurrency);
+    auto fibers = static_cast<double>(stats.fibersAllocated) / kConcurrency;
+    printf("%-40s %14.2f %14.2f %14zu\n", c.name, fibers,
+           fibers * kStackSize / 1024, stats.stackHighWatermark);
+  }
+}
+
+}  // anonymous namespace
+
+BENCHMARK(NullRoute, iters) {
+  benchNull(iters);
+}
+
+BENCHMARK(HashRoute_Ch3, iters) {
+  benchHashCh3(iters);
+}
+
+BENCHMARK(HashRoute_Crc32, iters) {
+  benchHashCrc32(iters);
+}
+
+BENCHMARK(HashRoute_WeightedCh3, iters) {
+  benchHashWeightedCh3(iters);
+}
+
+BENCHMARK(HashRoute_ConstShard, iters) {
+  benchHashConstShard(iters);
+}
+
+BENCHMARK(FailoverRoute, iters) {
+  benchFailover(iters);
+}
+
+BENCHMARK(FailoverHashRoute, iters) {
+  benchFailoverHash(iters);
+}
+
+BENCHMARK_RELATIVE(FailoverHashRoute_inlined, iters) {
+  benchFailoverHashInlined(iters);
+}
+
+BENCHMARK(AllSyncRoute, iters) {
+  benchAllSync(iters);
+}
+
+BENCHMARK(ShadowRoute, iters) {
+  benchShadow(iters);
+}
+
+BENCHMARK(ModifyKeyRoute, iters) {
+  benchModifyKey(iters);
+}
+
+BENCHMARK(BigValueRoute_get, iters) {
+  benchBigValueGet(iters);
+}
+
+BENCHMARK(BigValueRoute_set, iters) {
+  benchBigValueSet(iters);
+}
+
+BENCHMARK(RouteHandleMap_fast, iters) {
+  benchRouteHandleMap(iters);
+}
+
+BENCHMARK(Suspended_Leaf, iters) {
+  benchSuspendedLeaf(iters);
+}
+
+BENCHMARK(Suspended_HashRoute, iters) {
+  benchSuspendedHash(iters);
+}
+
+BENCHMARK(Suspended_FailoverHashRoute, iters) {
+  benchSuspendedFailoverHash(iters);
+}
+
+BENCHMARK(Suspended_AllSyncRoute, iters) {
+  benchSuspendedAllSync(iters);
+}
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  prepareKeys();
+  folly::runBenchmarks();
+  printAllocations();
+  printSuspendedMemory();
+  return 0;
+}
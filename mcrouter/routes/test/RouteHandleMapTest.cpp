@@ -0,0 +1,101 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/test/RouteHandleTestUtil.h"
+#include "mcrouter/routes/PrefixRouteSelector.h"
+#include "mcrouter/routes/RouteHandleMap.h"
+#include "mcrouter/routes/RouteSelectorMap.h"
+#include "mcrouter/RoutingPrefix.h"
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+using std::make_shared;
+using std::vector;
+
+using TestHandle = TestHandleImpl<McrouterRouteHandleIf>;
+
+namespace {
+
+std::shared_ptr<PrefixRouteSelector> makeSelector(
+    std::shared_ptr<TestHandle> handle) {
+  auto selector = make_shared<PrefixRouteSelector>();
+  selector->wildcard = handle->rh;
+  return selector;
+}
+
+}  // anonymous namespace
+
+TEST(RouteHandleMapTest, cachedPrefixes) {
+  vector<std::shared_ptr<TestHandle>> handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "ab")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "ac")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "de")),
+  };
+  RouteSelectorMap selectors;
+  selectors.emplace("/a/b/", makeSelector(handles[0]));
+  selectors.emplace("/a/c/", makeSelector(handles[1]));
+  selectors.emplace("/d/e/", makeSelector(handles[2]));
+  RoutingPrefix defaultRoute("/a/b/");
+  RouteHandleMap map(selectors, defaultRoute, false);
+
+  /* Same answers when resolved and when cached */
+  for (int i = 0; i < 2; ++i) {
+    auto targets = map.getTargetsForKeyFast("/a/c/", "key");
+    ASSERT_NE(nullptr, targets);
+    ASSERT_EQ(1, targets->size());
+    EXPECT_EQ(handles[1]->rh, (*targets)[0]);
+
+    targets = map.getTargetsForKeyFast("/d/*/", "key");
+    ASSERT_NE(nullptr, targets);
+    ASSERT_EQ(1, targets->size());
+    EXPECT_EQ(handles[2]->rh, (*targets)[0]);
+
+    targets = map.getTargetsForKeyFast("/x/y/", "key");
+    ASSERT_NE(nullptr, targets);
+    EXPECT_TRUE(targets->empty());
+
+    EXPECT_EQ(nullptr, map.getTargetsForKeyFast("/a*/b/", "key"));
+  }
+
+  /* More prefixes than the cache holds */
+  for (size_t i = 0; i < RouteHandleMap::kPrefixCacheSize * 2; ++i) {
+    auto targets = map.getTargetsForKeyFast(
+      "/z" + std::to_string(i) + "/b/", "key");
+    ASSERT_NE(nullptr, targets);
+    EXPECT_TRUE(targets->empty());
+  }
+  auto targets = map.getTargetsForKeyFast("/a/c/", "key");
+  ASSERT_NE(nullptr, targets);
+  ASSERT_EQ(1, targets->size());
+  EXPECT_EQ(handles[1]->rh, (*targets)[0]);
+}
+
+TEST(RouteHandleMapTest, cachedInvalidRouteToDefault) {
+  vector<std::shared_ptr<TestHandle>> handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "ab")),
+  };
+  RouteSelectorMap selectors;
+  selectors.emplace("/a/b/", makeSelector(handles[0]));
+  RoutingPrefix defaultRoute("/a/b/");
+  RouteHandleMap map(selectors, defaultRoute, true);
+
+  for (int i = 0; i < 2; ++i) {
+    auto targets = map.getTargetsForKeyFast("/x/y/", "key");
+    ASSERT_NE(nullptr, targets);
+    ASSERT_EQ(1, targets->size());
+    EXPECT_EQ(handles[0]->rh, (*targets)[0]);
+  }
+}
@@ -31,10 +31,13 @@ using TestHandle = TestHandleImpl<McrouterRouteHandleIf>;
 
 namespace {
 
-std::shared_ptr<ProxyRequestContext> getContext() {
+ProxyRequestContext::Ptr getContext(
+    const std::string& persistenceId = "test_shadow",
+    size_t maxShadowRequests = 0) {
   McrouterOptions opts = defaultTestOptions();
   opts.config_str = "{ \"route\": \"NullRoute\" }";
-  auto router = McrouterInstance::init("test_shadow", opts);
+  opts.proxy_max_shadow_requests = maxShadowRequests;
+  auto router = McrouterInstance::init(persistenceId, opts);
   return ProxyRequestContext::createRecording(*router->getProxy(0), nullptr);
 }
 
@@ -59,6 +62,8 @@ TEST(shadowRouteTest, defaultPolicy) {
     make_shared<ShadowSettings>(data, nullptr),
   };
 
+  auto settings0 = settings[0].get();
+  auto settings1 = settings[1].get();
   auto shadowRhs = get_route_handles(shadowHandles);
   McrouterShadowData shadowData = {
     {std::move(shadowRhs[0]), std::move(settings[0])},
@@ -87,6 +92,8 @@ TEST(shadowRouteTest, defaultPolicy) {
   EXPECT_TRUE(shadowHandles[1]->saw_keys.empty());
   data->end_index = 1;
   data->end_key_fraction = 1.0;
+  settings0->setData(data);
+  settings1->setData(data);
 
   fm.runAll(
     {
@@ -102,3 +109,48 @@ TEST(shadowRouteTest, defaultPolicy) {
   EXPECT_TRUE(shadowHandles[0]->saw_keys == vector<string>{"key"});
   EXPECT_TRUE(shadowHandles[1]->saw_keys == vector<string>{"key"});
 }
+
+TEST(shadowRouteTest, maxShadowRequests) {
+  vector<std::shared_ptr<TestHandle>> normalHandle{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a")),
+  };
+  auto normalRh = get_route_handles(normalHandle)[0];
+
+  vector<std::shared_ptr<TestHandle>> shadowHandles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "b")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "c")),
+  };
+
+  TestFiberManager fm;
+
+  auto data = make_shared<ShadowSettings::Data>();
+  data->end_index = 1;
+  data->end_key_fraction = 1.0;
+  auto shadowRhs = get_route_handles(shadowHandles);
+  McrouterShadowData shadowData = {
+    {std::move(shadowRhs[0]), make_shared<ShadowSettings>(data, nullptr)},
+    {std::move(shadowRhs[1]), make_shared<ShadowSettings>(data, nullptr)},
+  };
+
+  McrouterRouteHandle<ShadowRoute<DefaultShadowPolicy>> rh(
+    normalRh,
+    std::move(shadowData),
+    0,
+    DefaultShadowPolicy());
+
+  auto ctx = getContext("test_shadow_max", 1);
+  fm.run([&] () {
+    auto reply = rh.route(ProxyMcRequest("key"), McOperation<mc_op_get>(),
+                          ctx);
+    EXPECT_EQ(mc_res_found, reply.result());
+  });
+
+  /* Only one shadow request fits into the limit */
+  EXPECT_EQ(vector<string>{"key"}, shadowHandles[0]->saw_keys);
+  EXPECT_TRUE(shadowHandles[1]->saw_keys.empty());
+  EXPECT_EQ(0, ctx->proxy().numShadowRequests);
+  EXPECT_EQ(1, stat_get_uint64(ctx->proxy().stats,
+                               shadow_requests_over_limit_stat));
+  EXPECT_EQ(0, stat_get_uint64(ctx->proxy().stats,
+                               shadow_requests_shed_stat));
+}
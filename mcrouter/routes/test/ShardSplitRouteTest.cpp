@@ -0,0 +1,191 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <folly/dynamic.h>
+#include <folly/experimental/fibers/Baton.h>
+#include <folly/Format.h>
+
+#include "mcrouter/lib/test/RouteHandleTestUtil.h"
+#include "mcrouter/routes/ShardSplitRoute.h"
+#include "mcrouter/RuntimeVarsData.h"
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+using std::make_shared;
+using std::string;
+using std::vector;
+
+using TestHandle = TestHandleImpl<McrouterRouteHandleIf>;
+
+namespace {
+
+ShardSplitRoute makeRoute(const std::shared_ptr<TestHandle>& handle,
+                          size_t splits) {
+  folly::dynamic json = folly::dynamic::object("123", static_cast<int>(splits));
+  return ShardSplitRoute(
+    get_route_handles(vector<std::shared_ptr<TestHandle>>{handle})[0],
+    std::make_shared<ShardSplitter>(json));
+}
+
+}  // anonymous namespace
+
+TEST(ShardSplitRouteTest, deleteAllSplits) {
+  auto handle = make_shared<TestHandle>(DeleteRouteTestData(mc_res_deleted));
+  auto rh = makeRoute(handle, 3);
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    ProxyRequestContext::Ptr ctx;
+    auto reply = rh.route(ProxyMcRequest("a:123:b"),
+                          McOperation<mc_op_delete>(), ctx);
+    EXPECT_EQ(mc_res_deleted, reply.result());
+    /* Lets the fiber with the other splits run */
+    folly::fibers::Baton baton;
+    baton.timed_wait(std::chrono::milliseconds(50));
+  });
+
+  auto keys = handle->saw_keys;
+  std::sort(keys.begin(), keys.end());
+  EXPECT_EQ((vector<string>{"a:123:b", "a:123aa:b", "a:123ba:b"}), keys);
+}
+
+TEST(ShardSplitRouteTest, longKey) {
+  auto handle = make_shared<TestHandle>(DeleteRouteTestData(mc_res_deleted));
+  auto rh = makeRoute(handle, 2);
+
+  /* Longer than McRequestBase::kMaxInlineKeySize */
+  auto key = "a:123:" + string(100, 'x');
+  TestFiberManager fm;
+  fm.run([&]() {
+    ProxyRequestContext::Ptr ctx;
+    rh.route(ProxyMcRequest(key), McOperation<mc_op_delete>(), ctx);
+    folly::fibers::Baton baton;
+    baton.timed_wait(std::chrono::milliseconds(50));
+  });
+
+  auto keys = handle->saw_keys;
+  std::sort(keys.begin(), keys.end());
+  EXPECT_EQ((vector<string>{key, "a:123aa:" + string(100, 'x')}), keys);
+}
+
+TEST(ShardSplitRouteTest, notSplit) {
+  auto handle = make_shared<TestHandle>(
+    UpdateRouteTestData(mc_res_stored),
+    DeleteRouteTestData(mc_res_deleted));
+  auto rh = makeRoute(handle, 3);
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    ProxyRequestContext::Ptr ctx;
+    /* Other shard */
+    rh.route(ProxyMcRequest("a:456:b"), McOperation<mc_op_delete>(), ctx);
+    /* Sets only go to the primary split */
+    rh.route(ProxyMcRequest("a:123:b"), McOperation<mc_op_set>(), ctx);
+  });
+
+  EXPECT_EQ((vector<string>{"a:456:b", "a:123:b"}), handle->saw_keys);
+}
+
+TEST(ShardSplitRouteTest, runtimeSplits) {
+  ObservableRuntimeVars vars;
+  auto jdynamic = folly::dynamic::object("runtime_var", "splits");
+  ShardSplitter splitter(folly::dynamic::object("123", 2), jdynamic, &vars);
+
+  folly::StringPiece shard;
+  EXPECT_EQ(2, splitter.getShardSplitCnt("a:123:b", shard));
+  auto version = splitter.version();
+
+  vars.set(std::make_shared<const RuntimeVarsData>(
+    "{\"splits\": {\"123\": 3, \"456\": 2}}"));
+  EXPECT_EQ(3, splitter.getShardSplitCnt("a:123:b", shard));
+  EXPECT_EQ(2, splitter.getShardSplitCnt("a:456:b", shard));
+  EXPECT_NE(version, splitter.version());
+
+  /* Invalid values keep the previous splits, 1 removes a split */
+  vars.set(std::make_shared<const RuntimeVarsData>("{\"splits\": [1]}"));
+  EXPECT_EQ(3, splitter.getShardSplitCnt("a:123:b", shard));
+  vars.set(std::make_shared<const RuntimeVarsData>(
+    "{\"splits\": {\"123\": 1}}"));
+  EXPECT_EQ(1, splitter.getShardSplitCnt("a:123:b", shard));
+  EXPECT_EQ(1, splitter.getShardSplitCnt("a:456:b", shard));
+}
+
+TEST(ShardSplitRouteTest, rampReadThrough) {
+  /* A split count this host doesn't read the primary split with */
+  size_t splits = 2;
+  while (globals::hostid() % splits == 0) {
+    ++splits;
+  }
+  ObservableRuntimeVars vars;
+  auto jdynamic = folly::dynamic::object
+    ("runtime_var", "splits")
+    ("ramp_ms", 10000);
+  auto splitter = std::make_shared<ShardSplitter>(
+    folly::dynamic::object(), jdynamic, &vars);
+  auto handle = make_shared<TestHandle>(
+    GetRouteTestData(mc_res_notfound, ""));
+  ShardSplitRoute rh(
+    get_route_handles(vector<std::shared_ptr<TestHandle>>{handle})[0],
+    splitter);
+
+  vars.set(std::make_shared<const RuntimeVarsData>(folly::format(
+    "{{\"splits\": {{\"123\": {}}}}}", splits).str()));
+  TestFiberManager fm;
+  fm.run([&]() {
+    ProxyRequestContext::Ptr ctx;
+    auto reply = rh.route(ProxyMcRequest("a:123:b"),
+                          McOperation<mc_op_get>(), ctx);
+    EXPECT_EQ(mc_res_notfound, reply.result());
+  });
+
+  /* Missed in the new split, read through to the old (primary) one */
+  ASSERT_EQ(2, handle->saw_keys.size());
+  EXPECT_NE("a:123:b", handle->saw_keys[0]);
+  EXPECT_EQ("a:123:b", handle->saw_keys[1]);
+}
+
+TEST(ShardSplitRouteTest, autoSplits) {
+  auto jdynamic = folly::dynamic::object
+    ("auto", folly::dynamic::object
+      ("target_qps", 1)
+      ("max_splits", 4)
+      ("interval_ms", 1)
+      ("sample_period", 1));
+  ShardSplitter splitter(folly::dynamic::object(), jdynamic, nullptr);
+  EXPECT_EQ(1, splitter.sampleGetsPeriod());
+
+  /* Starts the first interval */
+  splitter.sampleGet("other");
+  /* Samples a get once the interval is over, splits are evaluated */
+  auto evaluate = [&splitter](folly::StringPiece shard) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    splitter.sampleGet(shard);
+  };
+
+  folly::StringPiece shard;
+  evaluate("123");
+  /* Way above target_qps, capped by max_splits */
+  EXPECT_EQ(4, splitter.getShardSplitCnt("a:123:b", shard));
+
+  /* Without gets, merged back by halves */
+  evaluate("456");
+  EXPECT_EQ(2, splitter.getShardSplitCnt("a:123:b", shard));
+  evaluate("456");
+  EXPECT_EQ(1, splitter.getShardSplitCnt("a:123:b", shard));
+}
@@ -0,0 +1,120 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <folly/io/IOBuf.h>
+#include <folly/Memory.h>
+
+#include "mcrouter/lib/test/RouteHandleTestUtil.h"
+#include "mcrouter/routes/McrouterRouteHandle.h"
+#include "mcrouter/routes/SizeSelectorRoute.h"
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+using std::make_shared;
+using std::string;
+using std::vector;
+
+using TestHandle = TestHandleImpl<McrouterRouteHandleIf>;
+
+namespace {
+
+std::vector<std::shared_ptr<TestHandle>> makeHandles() {
+  return {
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "small"),
+                            UpdateRouteTestData(mc_res_stored),
+                            DeleteRouteTestData(mc_res_deleted)),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "large"),
+                            UpdateRouteTestData(mc_res_stored),
+                            DeleteRouteTestData(mc_res_deleted)),
+  };
+}
+
+std::unique_ptr<SizeSelectorRoute> makeRoute(
+    const std::vector<std::shared_ptr<TestHandle>>& handles) {
+  return folly::make_unique<SizeSelectorRoute>(
+    get_route_handles(handles),
+    std::vector<size_t>{10},
+    /* hintCacheSize= */ 1024);
+}
+
+ProxyMcReply set(SizeSelectorRoute& rh, const std::string& key,
+                 size_t valueSize) {
+  ProxyMcRequest req(key);
+  req.setValue(folly::IOBuf(folly::IOBuf::COPY_BUFFER,
+                            std::string(valueSize, 'x')));
+  ProxyRequestContext::Ptr ctx;
+  return rh.route(req, McOperation<mc_op_set>(), ctx);
+}
+
+ProxyMcReply get(SizeSelectorRoute& rh, const std::string& key) {
+  ProxyRequestContext::Ptr ctx;
+  return rh.route(ProxyMcRequest(key), McOperation<mc_op_get>(), ctx);
+}
+
+}  // anonymous namespace
+
+TEST(SizeSelectorRouteTest, updatesBySize) {
+  auto handles = makeHandles();
+  auto rh = makeRoute(handles);
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    set(*rh, "a", 10);
+    set(*rh, "b", 11);
+  });
+  EXPECT_EQ(vector<string>{"a"}, handles[0]->saw_keys);
+  EXPECT_EQ(vector<string>{"b"}, handles[1]->saw_keys);
+
+  /* Gets follow the hints */
+  fm.run([&]() {
+    EXPECT_EQ("small", toString(get(*rh, "a").value()));
+    EXPECT_EQ("large", toString(get(*rh, "b").value()));
+  });
+  EXPECT_EQ(2, handles[0]->saw_keys.size());
+  EXPECT_EQ(2, handles[1]->saw_keys.size());
+}
+
+TEST(SizeSelectorRouteTest, noHint) {
+  auto handles = makeHandles();
+  handles[0] = make_shared<TestHandle>(GetRouteTestData(mc_res_notfound, ""));
+  auto rh = makeRoute(handles);
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    /* Tries the bands in order, the hit is remembered */
+    EXPECT_EQ("large", toString(get(*rh, "key").value()));
+    EXPECT_EQ("large", toString(get(*rh, "key").value()));
+  });
+  EXPECT_EQ(1, handles[0]->saw_keys.size());
+  EXPECT_EQ(2, handles[1]->saw_keys.size());
+}
+
+TEST(SizeSelectorRouteTest, moveBand) {
+  auto handles = makeHandles();
+  auto rh = makeRoute(handles);
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    set(*rh, "key", 1);
+    set(*rh, "key", 100);
+  });
+  /* Let the asynchronous delete finish */
+  fm.run([]() {});
+  /* The small value is deleted */
+  EXPECT_EQ((vector<mc_op_t>{mc_op_set, mc_op_delete}),
+            handles[0]->sawOperations);
+  EXPECT_EQ(vector<mc_op_t>{mc_op_set}, handles[1]->sawOperations);
+}
@@ -0,0 +1,126 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <folly/Memory.h>
+#include <folly/experimental/fibers/Baton.h>
+
+#include "mcrouter/lib/test/RouteHandleTestUtil.h"
+#include "mcrouter/routes/WriteBehindRoute.h"
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+using std::make_shared;
+using std::string;
+using std::vector;
+
+using TestHandle = TestHandleImpl<McrouterRouteHandleIf>;
+
+namespace {
+
+std::unique_ptr<WriteBehindRoute> makeRoute(
+    const std::shared_ptr<TestHandle>& handle,
+    size_t batchSize,
+    std::chrono::milliseconds flushInterval,
+    size_t maxBuffered) {
+  return folly::make_unique<WriteBehindRoute>(
+    get_route_handles(vector<std::shared_ptr<TestHandle>>{handle})[0],
+    batchSize,
+    flushInterval,
+    maxBuffered);
+}
+
+template <class Operation>
+void send(WriteBehindRoute& rh, const std::string& key,
+          const std::string& value, Operation) {
+  ProxyRequestContext::Ptr ctx;
+  auto msg = createMcMsgRef(key, value);
+  msg->op = Operation::mc_op;
+  rh.route(ProxyMcRequest(std::move(msg)), Operation(), ctx);
+}
+
+/* Lets the flushing fiber run */
+void waitForFlush() {
+  folly::fibers::Baton baton;
+  baton.timed_wait(std::chrono::milliseconds(50));
+}
+
+}  // anonymous namespace
+
+TEST(WriteBehindRouteTest, flushOnBatchSize) {
+  auto handle = make_shared<TestHandle>(UpdateRouteTestData(mc_res_stored));
+  auto rh = makeRoute(handle, 2, std::chrono::milliseconds(10000), 100);
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    send(*rh, "key1", "a", McOperation<mc_op_set>());
+    /* Replaces the buffered set */
+    send(*rh, "key1", "b", McOperation<mc_op_set>());
+    EXPECT_EQ(1, rh->buffered());
+    EXPECT_TRUE(handle->saw_keys.empty());
+
+    send(*rh, "key2", "c", McOperation<mc_op_set>());
+    waitForFlush();
+  });
+
+  EXPECT_EQ((vector<string>{"key1", "key2"}), handle->saw_keys);
+  EXPECT_EQ((vector<string>{"b", "c"}), handle->sawValues);
+  EXPECT_EQ(0, rh->buffered());
+}
+
+TEST(WriteBehindRouteTest, flushOnTimer) {
+  auto handle = make_shared<TestHandle>(DeleteRouteTestData(mc_res_deleted));
+  auto rh = makeRoute(handle, 100, std::chrono::milliseconds(1), 100);
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    send(*rh, "key1", "", McOperation<mc_op_delete>());
+    waitForFlush();
+  });
+
+  EXPECT_EQ(vector<string>{"key1"}, handle->saw_keys);
+}
+
+TEST(WriteBehindRouteTest, dropWhenFull) {
+  auto handle = make_shared<TestHandle>(UpdateRouteTestData(mc_res_stored));
+  auto rh = makeRoute(handle, 100, std::chrono::milliseconds(1), 1);
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    send(*rh, "key1", "a", McOperation<mc_op_set>());
+    send(*rh, "key2", "b", McOperation<mc_op_set>());
+    /* Buffered keys can still be replaced */
+    send(*rh, "key1", "c", McOperation<mc_op_set>());
+    waitForFlush();
+  });
+
+  EXPECT_EQ(vector<string>{"key1"}, handle->saw_keys);
+  EXPECT_EQ(vector<string>{"c"}, handle->sawValues);
+}
+
+TEST(WriteBehindRouteTest, getsGoDirectly) {
+  auto handle = make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a"));
+  auto rh = makeRoute(handle, 100, std::chrono::milliseconds(1), 100);
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    ProxyRequestContext::Ptr ctx;
+    auto reply = rh->route(ProxyMcRequest("key"), McOperation<mc_op_get>(),
+                           ctx);
+    EXPECT_EQ(mc_res_found, reply.result());
+    EXPECT_EQ(0, rh->buffered());
+  });
+}
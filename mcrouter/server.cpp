@@ -11,66 +11,201 @@
 
 #include <signal.h>
 
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+#include <folly/FileUtil.h>
+#include <folly/Memory.h>
+
 #include "mcrouter/config.h"
 #include "mcrouter/lib/network/AsyncMcServer.h"
 #include "mcrouter/lib/network/AsyncMcServerWorker.h"
+#include "mcrouter/lib/network/McServerReplyStream.h"
 #include "mcrouter/ManagedModeUtil.h"
 #include "mcrouter/McrouterClient.h"
 #include "mcrouter/McrouterLogFailure.h"
 #include "mcrouter/proxy.h"
+#include "mcrouter/ProxyDestinationMap.h"
 #include "mcrouter/ProxyThread.h"
+#include "mcrouter/ServerCredits.h"
+#include "mcrouter/ServerTakeover.h"
+#include "mcrouter/SlowRequestLog.h"
 #include "mcrouter/standalone_options.h"
+#include "mcrouter/TopClientTracker.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
 namespace {
 
+/**
+ * SIGUSR1 writes slow requests to the stats root with the next stats
+ * (see opts.slow_request_threshold_us).
+ */
+void installSlowRequestsDumpHandler() {
+  struct sigaction act;
+  memset(&act, 0, sizeof(struct sigaction));
+  act.sa_handler = [] (int) {
+    SlowRequestLog::requestDump();
+  };
+  act.sa_flags = SA_RESTART;
+  CHECK(!sigaction(SIGUSR1, &act, nullptr));
+}
+
+/**
+ * Pauses or resumes the worker's reads as the proxy's credits run out
+ * or are granted again
+ */
+void updateCredits(ServerCredits& credits,
+                   const proxy_t& proxy,
+                   AsyncMcServerWorker& worker) {
+  if (!credits.update(proxy.queueDepth())) {
+    return;
+  }
+  if (credits.exhausted()) {
+    worker.pauseReads();
+  } else {
+    worker.resumeReads();
+  }
+}
+
+/**
+ * A request sampled for the proxy's topConnections, accounted once
+ * its reply is known
+ */
+class ConnectionSample {
+ public:
+  ConnectionSample(TopClientTracker& tracker,
+                   McServerRequestContext& ctx,
+                   const McRequest& req)
+      : tracker_(tracker),
+        client_(ctx.session().peerName()),
+        bytesIn_(req.fullKey().size() + req.value().computeChainDataLength()) {
+  }
+
+  void onReply(const McReply& reply) {
+    tracker_.add(client_, bytesIn_, reply.value().computeChainDataLength());
+  }
+
+ private:
+  TopClientTracker& tracker_;
+  std::string client_;
+  uint64_t bytesIn_;
+};
+
+/**
+ * Sends the routed reply back to the server connection
+ */
+class ServerReply {
+ public:
+  ServerReply(McServerRequestContext&& ctx,
+              std::unique_ptr<ConnectionSample> sample)
+      : ctx_(std::move(ctx)),
+        sample_(std::move(sample)) {
+  }
+
+  void operator()(McReply&& reply) {
+    if (sample_) {
+      sample_->onReply(reply);
+    }
+    McServerRequestContext::reply(std::move(ctx_), std::move(reply));
+  }
+
+ private:
+  McServerRequestContext ctx_;
+  std::unique_ptr<ConnectionSample> sample_;
+};
+
+/**
+ * Sends the routed reply of a get back to the server connection,
+ * its hit may already be partially written (see McServerReplyStream)
+ */
+class StreamedServerReply {
+ public:
+  StreamedServerReply(std::shared_ptr<McServerReplyStream> stream,
+                      std::unique_ptr<ConnectionSample> sample)
+      : stream_(std::move(stream)),
+        sample_(std::move(sample)) {
+  }
+
+  void operator()(McReply&& reply) {
+    if (sample_) {
+      sample_->onReply(reply);
+    }
+    stream_->reply(std::move(reply));
+  }
+
+ private:
+  std::shared_ptr<McServerReplyStream> stream_;
+  std::unique_ptr<ConnectionSample> sample_;
+};
+
 /**
  * Server callback for standalone Mcrouter
  */
 class ServerOnRequest {
  public:
-  explicit ServerOnRequest(McrouterClient* client)
-      : client_(client) {
+  ServerOnRequest(McrouterClient* client,
+                  size_t streamValueBytes,
+                  ServerCredits* credits,
+                  proxy_t* proxy,
+                  AsyncMcServerWorker* worker)
+      : client_(client),
+        streamValueBytes_(streamValueBytes),
+        credits_(credits),
+        proxy_(proxy),
+        worker_(worker) {
   }
 
   template <int M>
   void onRequest(McServerRequestContext&& ctx,
                  McRequest&& req,
                  McOperation<M>) {
-    mcrouter_msg_t router_msg;
-
-    auto op = mc_op_t(M);
-    /* TODO: nasty C/C++ interface stuff.  We should hand off the McRequest
-       directly here.  For now, hand off the dependentMsg() since we can assume
-       req will stay alive. */
-    auto p = folly::make_unique<McServerRequestContext>(std::move(ctx));
-    router_msg.context = p.get();
-    router_msg.saved_request = std::move(req);
-    auto msg = router_msg.saved_request->dependentMsg(op);
-    router_msg.req = const_cast<mc_msg_t*>(msg.get());
-    /* mcrouter_send will incref req, it's ok to destroy msg after this call */
-    client_->send(&router_msg, 1);
-    p.release();
+    /* req is handed off as is, and the reply is written straight from
+       the callback */
+    auto sample = sampleConnection(ctx, req);
+    client_->send(std::move(req), mc_op_t(M),
+                  ServerReply(std::move(ctx), std::move(sample)));
+    updateCredits(*credits_, *proxy_, *worker_);
+  }
+
+  void onRequest(McServerRequestContext&& ctx,
+                 McRequest&& req,
+                 McOperation<mc_op_get>) {
+    auto sample = sampleConnection(ctx, req);
+    if (streamValueBytes_ == 0) {
+      client_->send(std::move(req), mc_op_get,
+                    ServerReply(std::move(ctx), std::move(sample)));
+    } else {
+      auto stream = std::make_shared<McServerReplyStream>(std::move(ctx),
+                                                          streamValueBytes_);
+      client_->send(std::move(req), mc_op_get,
+                    StreamedServerReply(stream, std::move(sample)), stream);
+    }
+    updateCredits(*credits_, *proxy_, *worker_);
   }
 
  private:
   McrouterClient* client_;
-};
+  size_t streamValueBytes_;
+  ServerCredits* credits_;
+  proxy_t* proxy_;
+  AsyncMcServerWorker* worker_;
 
-void router_on_reply(mcrouter_msg_t* msg,
-                     void* context) {
-  std::unique_ptr<McServerRequestContext> p(
-    reinterpret_cast<McServerRequestContext*>(msg->context));
-
-  assert(p.get());
-  McServerRequestContext::reply(std::move(*p),
-                                std::move(msg->reply));
-  msg->context = nullptr;
-}
+  /* All connections of this worker share client_, so they are told apart
+     here rather than by senderId */
+  std::unique_ptr<ConnectionSample> sampleConnection(
+      McServerRequestContext& ctx, const McRequest& req) {
+    if (!proxy_->topConnections.sampleNext()) {
+      return nullptr;
+    }
+    return folly::make_unique<ConnectionSample>(proxy_->topConnections,
+                                                ctx, req);
+  }
+};
 
 mcrouter_client_callbacks_t const server_callbacks = {
-  router_on_reply,  // on_reply callback
+  nullptr,
   nullptr,
   nullptr
 };
@@ -80,18 +215,32 @@ void serverLoop(
   size_t threadId,
   folly::EventBase& evb,
   AsyncMcServerWorker& worker,
-  bool managedMode) {
+  bool managedMode,
+  size_t streamValueBytes,
+  size_t proxyCredits,
+  bool pinned,
+  const std::unordered_map<std::string, bool>& inheritedTkos) {
 
   auto routerClient = router.createClient(
     server_callbacks,
     &worker,
     0);
+  /* The proxy runs on this server thread: requests are routed inline on
+     its FiberManager and replies are written from the same thread, so
+     there are no queue hops between the server and the proxy. */
   auto proxy = router.getProxy(threadId);
   proxy->attachEventBase(&evb);
+  if (pinned) {
+    stat_set_uint64(proxy->stats, proxy_threads_pinned_stat, 1);
+  }
   // Manually override proxy assignment
   routerClient->setProxy(proxy);
+  proxy->destinationMap->markInheritedTkos(inheritedTkos);
 
-  worker.setOnRequest(ServerOnRequest(routerClient.get()));
+  /* Granted by the proxy to this worker, see server-proxy-credits */
+  ServerCredits credits(proxyCredits);
+  worker.setOnRequest(ServerOnRequest(routerClient.get(), streamValueBytes,
+                                      &credits, proxy, &worker));
   worker.setOnConnectionAccepted([proxy] () {
       stat_incr(proxy->stats, successful_client_connections_stat, 1);
       stat_incr(proxy->stats, num_clients_stat, 1);
@@ -111,20 +260,59 @@ void serverLoop(
   /* TODO(libevent): the only reason this is not simply evb.loop() is
      because we need to call asox stuff on every loop iteration.
      We can clean this up once we convert everything to EventBase */
+  auto busyPollUs = router.opts().proxy_busy_poll_us;
   while (worker.isAlive() ||
          worker.writesPending() ||
-         proxy->fiberManager.hasTasks()) {
+         proxy->fiberManager.hasTasks() ||
+         proxy->finishStolenRequests()) {
+    if (busyPollUs > 0 && worker.isAlive()) {
+      proxyBusyPoll(*proxy, evb, std::chrono::microseconds(busyPollUs));
+    }
     mcrouterLoopOnce(&evb);
+    updateCredits(credits, *proxy, worker);
+
+    const auto& memory = worker.memoryTracker();
+    stat_set_uint64(proxy->stats, server_buffered_bytes_stat, memory.bytes());
+    stat_set_uint64(proxy->stats, server_memory_paused_clients_stat,
+                    memory.pausedSessions());
+    stat_set_uint64(proxy->stats, server_memory_pauses_stat,
+                    memory.numPauses());
+    stat_set_uint64(proxy->stats, server_credit_paused_threads_stat,
+                    worker.readsPaused() ? 1 : 0);
+    stat_set_uint64(proxy->stats, server_credit_pauses_stat,
+                    worker.numReadPauses());
+    const auto& admission = worker.admission();
+    stat_set_uint64(proxy->stats, server_rejected_connections_stat,
+                    admission.numRejected());
+    stat_set_uint64(proxy->stats, server_deferred_connections_stat,
+                    admission.numDeferred());
+    stat_set_uint64(proxy->stats, server_pending_connections_stat,
+                    admission.deferred());
+    const auto& writes = worker.writeStats();
+    stat_set_uint64(proxy->stats, server_streamed_replies_stat,
+                    writes.numStreamedReplies);
+    stat_set_uint64(proxy->stats, server_broken_reply_streams_stat,
+                    writes.numBrokenStreams);
   }
 }
 
 }  // namespace
 
 void runServer(const McrouterStandaloneOptions& standaloneOpts,
-               McrouterInstance& router) {
+               McrouterInstance& router,
+               const TakeoverState* takeover,
+               int takeoverFd) {
   AsyncMcServer::Options opts;
 
-  if (standaloneOpts.listen_sock_fd >= 0) {
+  std::unordered_map<std::string, bool> inheritedTkos;
+  if (takeover != nullptr) {
+    opts.existingSockets = takeover->sockets;
+    opts.existingSslSockets = takeover->sslSockets;
+    opts.pemCertPath = router.opts().pem_cert_path;
+    opts.pemKeyPath = router.opts().pem_key_path;
+    opts.pemCaPath = router.opts().pem_ca_path;
+    inheritedTkos = takeover->tkos;
+  } else if (standaloneOpts.listen_sock_fd >= 0) {
     opts.existingSocketFd = standaloneOpts.listen_sock_fd;
   } else {
     opts.ports = standaloneOpts.ports;
@@ -132,9 +320,23 @@ void runServer(const McrouterStandaloneOptions& standaloneOpts,
     opts.pemCertPath = router.opts().pem_cert_path;
     opts.pemKeyPath = router.opts().pem_key_path;
     opts.pemCaPath = router.opts().pem_ca_path;
+    opts.reusePort = standaloneOpts.reuse_port;
   }
+  if (takeover == nullptr) {
+    opts.unixSockets = standaloneOpts.unix_sockets;
+  }
+  opts.shmChannels = standaloneOpts.shm_channels;
+  /* Proxies run on server threads, so their CPUs are the proxies' CPUs */
+  const auto& cpus = standaloneOpts.server_thread_cpus.empty()
+    ? router.opts().proxy_thread_cpus
+    : standaloneOpts.server_thread_cpus;
+  opts.threadCpus.assign(cpus.begin(), cpus.end());
+
+  opts.listenBacklog = standaloneOpts.listen_backlog;
+  opts.tcpDeferAcceptSecs = standaloneOpts.tcp_defer_accept_secs;
 
   opts.numThreads = router.opts().num_proxies;
+  opts.numHandshakeThreads = standaloneOpts.server_handshake_threads;
 
   opts.worker.versionString = MCROUTER_PACKAGE_STRING;
   opts.worker.maxInFlight = standaloneOpts.max_client_outstanding_reqs;
@@ -145,21 +347,66 @@ void runServer(const McrouterStandaloneOptions& standaloneOpts,
      We can make this an option if this needs to be adjusted. */
   opts.worker.maxReadsPerEvent = 1;
   opts.worker.requestsPerRead = standaloneOpts.requests_per_read;
+  opts.worker.useNewAsciiParser = standaloneOpts.new_ascii_request_parser;
+  opts.worker.writeFlushDelay =
+    std::chrono::microseconds(standaloneOpts.write_flush_delay_us);
+  opts.worker.writeFlushBytes = standaloneOpts.write_flush_bytes;
+  opts.worker.memoryHighWatermark = standaloneOpts.max_thread_buffered_bytes;
+  opts.worker.processMemoryHighWatermark =
+    standaloneOpts.max_global_buffered_bytes;
+  opts.worker.maxConnections = standaloneOpts.max_conns_per_thread;
+  opts.worker.maxAcceptsPerSecond = standaloneOpts.max_accepts_per_sec;
+  opts.worker.maxDeferredAccepts = standaloneOpts.max_deferred_accepts;
 
   try {
     LOG(INFO) << "Spawning AsyncMcServer";
 
     AsyncMcServer server(opts);
+    bool pinned = !opts.threadCpus.empty();
     server.spawn(
-      [&router, &standaloneOpts] (size_t threadId,
-                                  folly::EventBase& evb,
-                                  AsyncMcServerWorker& worker) {
-        serverLoop(router, threadId, evb, worker, standaloneOpts.managed);
+      [&router, &standaloneOpts, &inheritedTkos, pinned] (
+          size_t threadId,
+          folly::EventBase& evb,
+          AsyncMcServerWorker& worker) {
+        serverLoop(router, threadId, evb, worker, standaloneOpts.managed,
+                   standaloneOpts.stream_get_value_bytes,
+                   standaloneOpts.server_proxy_credits, pinned,
+                   inheritedTkos);
       }
     );
 
+    if (takeoverFd >= 0 && !ackTakeover(takeoverFd)) {
+      LOG(WARNING) << "mcrouter we took over from exited before draining";
+    }
+    std::unique_ptr<TakeoverListener> takeoverListener;
+    if (!standaloneOpts.takeover_socket.empty()) {
+      const auto& snapshotFile = router.opts().config_snapshot_file;
+      takeoverListener = folly::make_unique<TakeoverListener>(
+        standaloneOpts.takeover_socket,
+        [&server, &router, snapshotFile] () {
+          TakeoverState state;
+          server.listeningSockets(state.sockets, state.sslSockets);
+          state.tkos = router.tkoTrackerMap().getTkoServers();
+          if (!snapshotFile.empty() &&
+              !folly::readFile(snapshotFile.c_str(), state.configSnapshot)) {
+            state.configSnapshot.clear();
+          }
+          return state;
+        },
+        [&server] () {
+          LOG(INFO) << "Draining after takeover";
+          server.shutdown();
+        });
+      takeoverListener->start();
+    }
+
     server.installShutdownHandler({SIGINT, SIGTERM});
+    if (router.opts().slow_request_threshold_us > 0) {
+      installSlowRequestsDumpHandler();
+    }
     server.join();
+    /* Uses the server and the router */
+    takeoverListener.reset();
 
     LOG(INFO) << "Shutting down";
 
@@ -13,9 +13,18 @@ namespace facebook { namespace memcache { namespace mcrouter {
 
 class McrouterInstance;
 class McrouterStandaloneOptions;
+struct TakeoverState;
 
+/**
+ * @param takeover    state received from the mcrouter we're taking over
+ *                    from (see receiveTakeover()), nullptr if none.
+ * @param takeoverFd  connection it was received on, acknowledged once
+ *                    we serve.
+ */
 void runServer(const McrouterStandaloneOptions& standaloneOpts,
-               McrouterInstance& router);
+               McrouterInstance& router,
+               const TakeoverState* takeover = nullptr,
+               int takeoverFd = -1);
 
 }  // facebook::memcache::mcrouter
 
@@ -10,6 +10,7 @@
 #pragma once
 
 #include <sys/resource.h>
+#include <sys/socket.h>
 
 #include "mcrouter/lib/fbi/debug.h"
 #include "mcrouter/options.h"
@@ -43,11 +43,79 @@ mcrouter_option_other(
   "ssl-port", no_short,
   "SSL Port(s) to listen on (comma separated)")
 
+mcrouter_option_other(
+  std::vector<std::string>, unix_sockets, ,
+  "unix-socket", no_short,
+  "Unix domain socket path(s) to listen on (comma separated), in addition"
+  " to ports. Not supported with reuse-port")
+
+mcrouter_option_other(
+  std::vector<std::string>, shm_channels, ,
+  "shm-channel", no_short,
+  "Shared memory channel file(s) to create (comma separated, e.g. under"
+  " /dev/shm), each serving one local client process over the umbrella"
+  " protocol without sockets")
+
 mcrouter_option_integer(
   int, listen_sock_fd, -1,
   "listen-sock-fd", no_short,
   "Listen socket to take over")
 
+mcrouter_option_string(
+  takeover_socket, "",
+  "takeover-socket", no_short,
+  "Unix socket path to take over a running mcrouter through: its listening"
+  " sockets, TKO state and config snapshot are handed over (ports are not"
+  " bound then), and it drains and exits once we serve. We then wait for"
+  " the next mcrouter on the same path. Not supported with reuse-port")
+
+mcrouter_option_toggle(
+  reuse_port, false,
+  "reuse-port", no_short,
+  "Every server thread listens on all ports with SO_REUSEPORT and accepts"
+  " its own connections. Ignored with listen-sock-fd")
+
+mcrouter_option_other(
+  std::vector<uint16_t>, server_thread_cpus, ,
+  "server-thread-cpus", no_short,
+  "CPUs to pin server threads to (comma separated), thread i is pinned"
+  " to the (i mod N)-th CPU in the list")
+
+mcrouter_option_integer(
+  size_t, server_handshake_threads, 0,
+  "server-handshake-threads", no_short,
+  "If positive, TLS handshakes of client connections run on this many"
+  " dedicated threads instead of the server threads")
+
+mcrouter_option_integer(
+  size_t, max_conns_per_thread, 0,
+  "max-conns-per-thread", no_short,
+  "If positive, server threads close new client connections while they"
+  " already serve this many")
+
+mcrouter_option_integer(
+  size_t, max_accepts_per_sec, 0,
+  "max-accepts-per-sec", no_short,
+  "If positive, each server thread starts at most this many new client"
+  " connections per second, later ones wait (see max-deferred-accepts)")
+
+mcrouter_option_integer(
+  size_t, max_deferred_accepts, 1024,
+  "max-deferred-accepts", no_short,
+  "Connections a server thread keeps waiting to be started because of"
+  " max-accepts-per-sec, further ones are closed")
+
+mcrouter_option_integer(
+  int, listen_backlog, SOMAXCONN,
+  "listen-backlog", no_short,
+  "Backlog of the listening sockets. The kernel caps it at somaxconn")
+
+mcrouter_option_integer(
+  int, tcp_defer_accept_secs, 0,
+  "tcp-defer-accept-secs", no_short,
+  "If positive, TCP connections are accepted only once the client sent"
+  " data, or after this many seconds (TCP_DEFER_ACCEPT)")
+
 mcrouter_option_toggle(
   background, false,
   "background", 'b',
@@ -58,6 +126,13 @@ mcrouter_option_toggle(
   "managed-mode", 'm',
   "Managed mode (auto restart on crash)")
 
+mcrouter_option_toggle(
+  managed_standby, false,
+  "managed-standby", no_short,
+  "In managed mode, keep a second child with its config loaded, which"
+  " starts serving as soon as the active child dies. Ports are bound by the"
+  " parent process then, so that children don't have to bind them")
+
 mcrouter_option_integer(
   rlim_t, fdlimit, DEFAULT_FDLIMIT,
   "connection-limit", 'n',
@@ -79,6 +154,67 @@ mcrouter_option_integer(
   "Adjusts server buffer size to process this many requests per read."
   " Smaller values may improve latency.")
 
+mcrouter_option_toggle(
+  new_ascii_request_parser, false,
+  "new-ascii-request-parser", no_short,
+  "Parse ASCII requests from clients with the new parser, which builds"
+  " requests directly instead of going through the legacy mc_parser")
+
+mcrouter_option_integer(
+  size_t, write_flush_delay_us, 0,
+  "write-flush-delay-us", no_short,
+  "Accumulate replies to a client for up to this many microseconds before"
+  " writing them out in one writev() (0 to write at the end of every event"
+  " loop iteration)")
+
+mcrouter_option_integer(
+  size_t, write_flush_bytes, 0,
+  "write-flush-bytes", no_short,
+  "Write out accumulated replies to a client as soon as they take this"
+  " many bytes (0 to disable)")
+
+mcrouter_option_integer(
+  size_t, max_thread_buffered_bytes, 0,
+  "max-thread-buffered-bytes", no_short,
+  "Once client request values and replies buffered by a server thread"
+  " take more than this many bytes, stop reading from the clients"
+  " buffering the most until below 3/4 of it (0 to disable)")
+
+mcrouter_option_integer(
+  size_t, max_global_buffered_bytes, 0,
+  "max-global-buffered-bytes", no_short,
+  "Same as max-thread-buffered-bytes, for the bytes buffered by all"
+  " server threads (0 to disable)")
+
+mcrouter_option_integer(
+  size_t, server_proxy_credits, 0,
+  "server-proxy-credits", no_short,
+  "Once this many requests are routing or waiting in the proxy of a server"
+  " thread (including ones handed over by other proxies), stop reading"
+  " from all clients of the thread until half of them completed"
+  " (0 to disable)")
+
+mcrouter_option_integer(
+  size_t, stream_get_value_bytes, 0,
+  "stream-get-value-bytes", no_short,
+  "Start writing single key get hits of at least this many bytes to ASCII"
+  " clients while they're still being read from the destination (requires"
+  " --new-ascii-parser and ASCII destinations). A client whose streamed hit"
+  " fails midway gets disconnected (0 to disable)")
+
+mcrouter_option_integer(
+  size_t, failure_log_queue_size, 4096,
+  "failure-log-queue-size", no_short,
+  "Failures are logged by a background thread, from a queue of up to this"
+  " many; proxy threads drop failures while it's full (0 to log"
+  " synchronously)")
+
+mcrouter_option_integer(
+  size_t, failure_log_max_per_second, 100,
+  "failure-log-max-per-second", no_short,
+  "Log at most this many failures per second per category, count the"
+  " others (0 for no limit)")
+
 #ifdef ADDITIONAL_STANDALONE_OPTIONS_FILE
 #include ADDITIONAL_STANDALONE_OPTIONS_FILE
 #endif
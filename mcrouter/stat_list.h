@@ -23,18 +23,80 @@
   STUI(num_servers_down, 0, 1)
   STUI(num_servers_closed, 0, 1)
   STUI(num_clients, 0, 1)
+  /* Proxies whose thread is pinned to a CPU (proxy-thread-cpus) */
+  STUI(proxy_threads_pinned, 0, 1)
+  /* Client request and reply bytes buffered by server threads */
+  STUI(server_buffered_bytes, 0, 1)
+  /* Client connections with reads paused because of buffered bytes */
+  STUI(server_memory_paused_clients, 0, 1)
+  /* Times a client connection was paused because of buffered bytes */
+  STUI(server_memory_pauses, 0, 1)
+  /* Server threads with reads paused because their proxy is out of credits
+     (server-proxy-credits) */
+  STUI(server_credit_paused_threads, 0, 1)
+  /* Times reads of a server thread were paused because of credits */
+  STUI(server_credit_pauses, 0, 1)
+  /* Client connections closed on accept (max-conns-per-thread, or too many
+     waiting to be started) */
+  STUI(server_rejected_connections, 0, 1)
+  /* Client connections started late because of max-accepts-per-sec */
+  STUI(server_deferred_connections, 0, 1)
+  /* Client connections waiting to be started */
+  STUI(server_pending_connections, 0, 1)
+  /* Get hits written to clients while being read from destinations */
+  STUI(server_streamed_replies, 0, 1)
+  /* Streamed hits that failed midway, disconnecting the client */
+  STUI(server_broken_reply_streams, 0, 1)
+  /* Anonymous route subtrees sharing the routes of an identical subtree */
+  STUI(config_routes_deduplicated, 0, 1)
 #undef GROUP
 #define GROUP ods_stats | mcproxy_stats
   /* Total reqs in mc client yet to be sent to memcache. */
   STUI(mcc_txbuf_reqs, 0, 1)
+  /* Part of mcc_txbuf_reqs of low priority, see --destination-priority-lanes */
+  STUI(mcc_txbuf_low_priority_reqs, 0, 1)
   /* Total reqs waiting for reply from memcache. */
   STUI(mcc_waiting_replies, 0, 1)
   STAT(destination_batch_size, stat_double, 0, .dbl = 0.0)
+  /* Average microseconds writes were held, see --write-cork-max-delay-us */
+  STAT(destination_write_cork_us, stat_double, 0, .dbl = 0.0)
+  /* Destination connects that succeeded and failed, and their average
+     duration */
+  STUI(destination_connects, 0, 1)
+  STUI(destination_connect_failures, 0, 1)
+  STAT(destination_connect_latency_us, stat_double, 0, .dbl = 0.0)
+  /* Connects that had to wait, see --proxy-max-concurrent-connects */
+  STUI(destination_connects_delayed, 0, 1)
   STUI(asynclog_requests, 0, 1)
+  /* Requests queued to the asynclog writer and not written yet */
+  STUI(asynclog_queue_depth, 0, 1)
+  /* Average number of asynclog entries written at once */
+  STAT(asynclog_batch_size, stat_double, 0, .dbl = 0.0)
+  /* Write-behind requests replaced by a later one for the same key */
+  STUI(write_behind_coalesced, 0, 1)
+  /* Write-behind requests dropped because the buffer was full */
+  STUI(write_behind_dropped, 0, 1)
+  /* WarmUpRoute cold fills of keys filled less than fill.dedup_ms ago,
+     and ones dropped because fill.max_queued were waiting */
+  STUI(warmup_fills_deduplicated, 0, 1)
+  STUI(warmup_fills_dropped, 0, 1)
   /* Proxy requests we started routing */
   STUI(proxy_reqs_processing, 0, 1)
   /* Proxy requests queued up and not routed yet */
   STUI(proxy_reqs_waiting, 0, 1)
+  /* Current limit on proxy_reqs_processing (adaptive or static), 0 if none */
+  STUI(proxy_inflight_limit, 0, 0)
+  /* Average time requests spend queued up, in microseconds */
+  STAT(proxy_reqs_wait_time_us, stat_double, 0, .dbl = 0.0)
+  /* Queued requests failed because they waited for too long */
+  STUI(proxy_reqs_shed, 0, 1)
+  /* Requests failed because their tenant had max_queued requests queued,
+     see --proxy-tenant-quotas */
+  STUI(proxy_tenant_reqs_rejected, 0, 1)
+  /* Requests routed for an overloaded sibling proxy */
+  STUI(proxy_reqs_stolen, 0, 1)
+  /* Requests routed without a fiber, see ProxyRoute::completesInline() */
+  STUI(proxy_reqs_inline, 0, 1)
 //  STUI(bytes_read, 0)
 //  STUI(bytes_written, 0)
 //  STUI(get_hits, 0)
@@ -47,12 +109,33 @@
   STAT(ps_system_time_sec, stat_double, 0, .dbl = 0.0)
   STUI(ps_vsize, 0, 0)
   STUI(ps_rss, 0, 0)
+  /* Estimated bytes held by mcrouter's major owners, see MemoryUsage
+     and __mcrouter__.memory */
+  STUI(memory_total_bytes, 0, 0)
+  STUI(memory_route_handles_bytes, 0, 0)
+  STUI(memory_routing_tables_bytes, 0, 0)
+  STUI(memory_destinations_bytes, 0, 0)
+  STUI(memory_client_buffers_bytes, 0, 0)
+  STUI(memory_server_buffers_bytes, 0, 0)
+  STUI(memory_fiber_stacks_bytes, 0, 0)
+  STUI(memory_asynclog_queue_bytes, 0, 0)
+  STUI(memory_waiting_requests_bytes, 0, 0)
+  /* Network buffers in huge pages, see --huge-page-buffers */
+  STUI(huge_page_buffers_mapped_bytes, 0, 0)
+  STUI(huge_page_buffers_explicit_bytes, 0, 0)
+  STUI(huge_page_buffers_used_bytes, 0, 0)
+  STUI(huge_page_buffers_explicit_failures, 0, 0)
   STUI(fibers_allocated, 0, 0)
   STUI(fibers_pool_size, 0, 0)
   STUI(fibers_stack_high_watermark, 0, 0)
+  /* ProxyRequestContexts allocated with malloc / recycled from the pool */
+  STUI(request_contexts_allocated, 0, 0)
+  STUI(request_contexts_reused, 0, 0)
 //  STUI(failed_client_connections, 0)
   STUI(successful_client_connections, 0, 1)
   STAT(duration_us, stat_double, 0, .dbl = 0.0)
+  /* Worst p99 of recent request durations across proxies */
+  STUI(duration_p99_us, 0, 0)
 #undef GROUP
 #define GROUP ods_stats | detailed_stats | count_stats
   STUI(rate_limited_log_count, 0, 1)
@@ -137,6 +220,7 @@
   STUI(cmd_other_count, 0, 1)
   STUI(cmd_replace_count, 0, 1)
   STUI(cmd_stats_count, 0, 1)
+  STUI(cmd_touch_count, 0, 1)
 #undef GROUP
 #define GROUP ods_stats | detailed_stats | cmd_all_stats | cmd_in_stats | \
   rate_stats
@@ -149,6 +233,7 @@
   STUIR(cmd_other, 0, 1)
   STUIR(cmd_replace, 0, 1)
   STUIR(cmd_stats, 0, 1)
+  STUIR(cmd_touch, 0, 1)
 #undef GROUP
 #define GROUP cmd_all_stats | cmd_out_stats | count_stats
   STUI(cmd_cas_out_count, 0, 1)
@@ -264,8 +349,32 @@
   STUI(config_last_attempt, 0, 0)
   STUI(config_last_success, 0, 0)
   STUI(config_failures, 0, 0)
+  STUI(config_build_time_us, 0, 0)
+  STUI(config_build_cpu_time_us, 0, 0)
+  STUI(config_reload_peak_rss, 0, 0)
+  /* Hostname resolutions of the process, see lib/network/HostResolver.h */
+  STUI(dns_resolutions, 0, 0)
+  STUI(dns_resolution_failures, 0, 0)
+  STUI(dns_prefetch_time_us, 0, 0)
+  STUI(dns_cache_misses, 0, 0)
   STUI(start_time, 0, 0)
   STUI(dev_null_requests, 0, 1)
+  STUI(deadline_exceeded_requests, 0, 1)
+  /* Requests refused by saturated destinations, see
+     --target-saturated-pending-requests */
+  STUI(destination_saturated_requests, 0, 1)
+  STUI(retry_budget_denied, 0, 1)
+  /* Proxy event loops stalled for more than --proxy-stall-threshold-ms */
+  STUI(proxy_stalls, 0, 1)
+  /* Shadow requests not sent: over --proxy-max-shadow-requests, or shed
+     because the proxy is loaded (--proxy-shadow-shed-*) */
+  STUI(shadow_requests_over_limit, 0, 1)
+  STUI(shadow_requests_shed, 0, 1)
+  /* Gets sent past their hash's child, which was over its bound, see
+     routes/BoundedLoadHashRoute.h */
+  STUI(hash_bounded_load_spills, 0, 1)
+  /* TKO events not logged because the TkoLogQueue was full */
+  STUI(tko_events_dropped, 0, 1)
 #undef GROUP
 #define GROUP count_stats
   STUI(request_sent_count, 0, 1)
@@ -278,6 +387,8 @@
   STUIR(request_error, 0, 1)
   STUIR(request_success, 0, 1)
   STUIR(request_replied, 0, 1)
+  /* Batched WarmUpRoute cold fills sent (with "fill") */
+  STUIR(warmup_fills, 0, 1)
 #undef GROUP
 #define GROUP ods_stats | count_stats
   STUI(result_error_count, 0, 1)
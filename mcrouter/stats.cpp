@@ -16,20 +16,43 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include <folly/Conv.h>
 #include <folly/json.h>
+#include <folly/Memory.h>
 #include <folly/Range.h>
 
+#include "mcrouter/awriter.h"
 #include "mcrouter/config.h"
+#include "mcrouter/HotKeyTracker.h"
 #include "mcrouter/lib/fbi/cpp/util.h"
 #include "mcrouter/lib/fbi/timer.h"
 #include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/network/HostResolver.h"
+#include "mcrouter/lib/network/HugePageArena.h"
 #include "mcrouter/lib/StatsReply.h"
 #include "mcrouter/McrouterInstance.h"
+#include "mcrouter/MemoryUsage.h"
+#include "mcrouter/PoolStats.h"
 #include "mcrouter/proxy.h"
 #include "mcrouter/ProxyDestination.h"
 #include "mcrouter/ProxyDestinationMap.h"
+#include "mcrouter/ProxyRequestContext.h"
 #include "mcrouter/ProxyThread.h"
+#include "mcrouter/RequestPhaseStats.h"
+#include "mcrouter/RouteCpuProfiler.h"
+#include "mcrouter/SizeStats.h"
+#include "mcrouter/SlowRequestLog.h"
+#include "mcrouter/TopClientTracker.h"
 
 /**                             .__
  * __  _  _______ _______  ____ |__| ____    ____
@@ -72,12 +95,17 @@ struct ServerStat {
   size_t cntLatencies{0};
   size_t pendingRequestsCount{0};
   size_t inflightRequestsCount{0};
+  // Longest adaptive timeout among proxies, 0 if none
+  int64_t adaptiveTimeoutMs{0};
 
   std::string toString() const {
     double avgLatency = cntLatencies == 0 ? 0 : sumLatencies / cntLatencies;
     auto res = folly::format("avg_latency_us:{:.3f}", avgLatency).str();
     folly::format(" pending_reqs:{}", pendingRequestsCount).appendTo(res);
     folly::format(" inflight_reqs:{}", inflightRequestsCount).appendTo(res);
+    if (adaptiveTimeoutMs != 0) {
+      folly::format(" adaptive_timeout_ms:{}", adaptiveTimeoutMs).appendTo(res);
+    }
     if (isHardTko) {
       folly::format(" hard_tko; ").appendTo(res);
     } else if (isSoftTko) {
@@ -109,6 +137,8 @@ struct ServerStat {
 struct AggregatedDestinationStats {
   // Number of requests pending to be sent over network.
   uint64_t pendingRequests{0};
+  // Part of pendingRequests of low priority.
+  uint64_t pendingLowPriorityRequests{0};
   // Number of requests been sent over network or already waiting for reply.
   uint64_t inflightRequests{0};
   // Average batches size in form of (num_request, num_batches).
@@ -116,28 +146,75 @@ struct AggregatedDestinationStats {
   // destination maintains its own window).
   // See AsyncMcClient::getBatchingStat() for more details.
   std::pair<uint64_t, uint64_t> batches{0, 0};
+  // Time writes were held in form of (microseconds, num_batches), over the
+  // same window as batches.
+  // See AsyncMcClient::getWriteCorkStat() for more details.
+  std::pair<uint64_t, uint64_t> writeCork{0, 0};
 };
 
-int get_num_bins_used(const McrouterInstance* router) {
-  if (router->opts().num_proxies > 0) {
-    const proxy_t* anyProxy = router->getProxy(0);
-    if (anyProxy) {
-      return anyProxy->num_bins_used;
+/**
+ * State of one destination merged across proxies, see destinations().
+ */
+struct DestinationSnapshot {
+  std::string poolName;
+  size_t states[(size_t)ProxyDestination::State::kNumStates] = {0};
+  bool isHardTko{false};
+  bool isSoftTko{false};
+  double sumLatencies{0.0};
+  size_t cntLatencies{0};
+  size_t pendingRequestsCount{0};
+  size_t pendingLowPriorityRequestsCount{0};
+  size_t inflightRequestsCount{0};
+  std::pair<uint64_t, uint64_t> batches{0, 0};
+  std::pair<uint64_t, uint64_t> writeCork{0, 0};
+  LatencyHistogram latency;
+  std::unique_ptr<ProxyDestination::Stats::Phases> phases;
+
+  folly::dynamic toDynamic() const {
+    folly::dynamic statesObj = folly::dynamic::object;
+    for (size_t i = 0; i < (size_t)ProxyDestination::State::kNumStates; ++i) {
+      if (states[i] > 0) {
+        auto state = clientStateToStr(static_cast<ProxyDestination::State>(i));
+        statesObj[state] = static_cast<int64_t>(states[i]);
+      }
+    }
+    folly::dynamic result = folly::dynamic::object
+      ("pool", poolName)
+      ("states", std::move(statesObj))
+      ("tko", isHardTko ? "hard" : isSoftTko ? "soft" : "none")
+      ("pending_reqs", static_cast<int64_t>(pendingRequestsCount))
+      ("pending_low_priority_reqs",
+       static_cast<int64_t>(pendingLowPriorityRequestsCount))
+      ("inflight_reqs", static_cast<int64_t>(inflightRequestsCount))
+      ("avg_batch_size", batches.second == 0 ? 0.0 :
+                         batches.first / (double)batches.second)
+      ("avg_write_cork_us", writeCork.second == 0 ? 0.0 :
+                            writeCork.first / (double)writeCork.second)
+      ("avg_latency_us", cntLatencies == 0 ? 0.0 :
+                         sumLatencies / cntLatencies)
+      ("latency", latency.toDynamic());
+    if (phases) {
+      result["latency_phases"] = folly::dynamic::object
+        ("queue", phases->queue.toDynamic())
+        ("wire", phases->wire.toDynamic())
+        ("processing", phases->processing.toDynamic());
     }
+    return result;
   }
-  return 0;
-}
+};
 
 double stats_rate_value(proxy_t* proxy, int idx) {
   const stat_t* stat = &proxy->stats[idx];
   double rate = 0;
 
-  if (proxy->num_bins_used != 0) {
-    if (stat->aggregate) {
-      rate = stats_aggregate_rate_value(proxy->router, idx);
-    } else {
-      rate = (double)proxy->stats_num_within_window[idx] /
-        (proxy->num_bins_used * MOVING_AVERAGE_BIN_SIZE_IN_SECOND);
+  if (stat->aggregate) {
+    rate = stats_aggregate_rate_value(proxy->router, idx);
+  } else {
+    int num_bins_used = 0;
+    auto num = stats_window_read(proxy, idx, &num_bins_used);
+    if (num_bins_used != 0) {
+      rate = (double)num /
+        (num_bins_used * MOVING_AVERAGE_BIN_SIZE_IN_SECOND);
     }
   }
 
@@ -156,15 +233,121 @@ struct proc_stat_data_t {
   unsigned long rss;
 };
 
-double stats_aggregate_rate_value(const McrouterInstance* router, int idx) {
+namespace {
+
+constexpr int kNumBins = MOVING_AVERAGE_WINDOW_SIZE_IN_SECOND /
+                         MOVING_AVERAGE_BIN_SIZE_IN_SECOND;
+
+/* Length of each rate_window_t, in bins */
+constexpr int kWindowBins[num_rate_windows] = {
+  std::min(kNumBins, std::max(1, 1 / MOVING_AVERAGE_BIN_SIZE_IN_SECOND)),
+  std::min(kNumBins, std::max(1, 10 / MOVING_AVERAGE_BIN_SIZE_IN_SECOND)),
+  std::min(kNumBins, std::max(1, 60 / MOVING_AVERAGE_BIN_SIZE_IN_SECOND)),
+  kNumBins,
+};
+
+#define STAT(name,...) -1,
+#define STUI STAT
+#define STUIR(name,...) name##_rate_idx,
+#define STSI STAT
+#define STSS STAT
+const int kRateIndex[num_stats] = {
+  #include "stat_list.h"
+};
+#undef STAT
+#undef STUI
+#undef STUIR
+#undef STSI
+#undef STSS
+
+#define STAT(name,...)
+#define STUI STAT
+#define STUIR(name,...) name##_stat,
+#define STSI STAT
+#define STSS STAT
+const stat_name_t kRateStats[num_rate_stats] = {
+  #include "stat_list.h"
+};
+#undef STAT
+#undef STUI
+#undef STUIR
+#undef STSI
+#undef STSS
+
+}  // anonymous namespace
+
+int stats_rate_index(int idx) {
+  return kRateIndex[idx];
+}
+
+uint64_t stats_window_read(const proxy_t* proxy, int idx,
+                           int* num_bins_used, rate_window_t window) {
+  auto rateIdx = stats_rate_index(idx);
+  assert(rateIdx >= 0);
+  uint64_t seq;
+  uint64_t num;
+  int bins;
+  do {
+    seq = proxy->stats_window_seq.load(std::memory_order_acquire);
+    num = __atomic_load_n(&proxy->stats_num_within_window[rateIdx][window],
+                          __ATOMIC_RELAXED);
+    bins = __atomic_load_n(&proxy->num_bins_used, __ATOMIC_RELAXED);
+    std::atomic_thread_fence(std::memory_order_acquire);
+  } while ((seq & 1) ||
+           seq != proxy->stats_window_seq.load(std::memory_order_relaxed));
+
+  if (num_bins_used != nullptr) {
+    *num_bins_used = std::min(bins, kWindowBins[window]);
+  }
+  return num;
+}
+
+void stats_window_update(proxy_t* proxy, int binIdx) {
+  proxy->stats_window_seq.fetch_add(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  if (proxy->num_bins_used < kNumBins) {
+    ++proxy->num_bins_used;
+  }
+
+  for (int j = 0; j < num_rate_stats; ++j) {
+    auto value = __atomic_load_n(&proxy->stats[kRateStats[j]].data.uint64,
+                                 __ATOMIC_RELAXED);
+    uint64_t delta = value - proxy->stats_last_value[j];
+    uint32_t binValue = std::min<uint64_t>(
+      delta, std::numeric_limits<uint32_t>::max());
+    auto& bins = proxy->stats_bin[j];
+    auto& sums = proxy->stats_num_within_window[j];
+    /* Every window drops its oldest bin before the new one is stored
+       (for the full window, that's the bin being replaced) */
+    for (int w = 0; w < num_rate_windows; ++w) {
+      sums[w] += binValue;
+      sums[w] -= bins[(binIdx + kNumBins - kWindowBins[w]) % kNumBins];
+    }
+    bins[binIdx] = binValue;
+    proxy->stats_last_value[j] = value;
+  }
+
+  proxy->stats_window_seq.fetch_add(1, std::memory_order_release);
+}
+
+double stats_aggregate_rate_value(const McrouterInstance* router, int idx,
+                                  rate_window_t window) {
   double rate = 0;
-  int num_bins_used = get_num_bins_used(router);
+  /* All proxies are rolled together, so any of them has the right
+     number of bins */
+  int num_bins_used = 0;
+  uint64_t num = 0;
 
-  if (num_bins_used != 0) {
-    uint64_t num = 0;
-    for (size_t i = 0; i < router->opts().num_proxies; ++i) {
-      num += router->getProxy(i)->stats_num_within_window[idx];
+  for (size_t i = 0; i < router->opts().num_proxies; ++i) {
+    int bins = 0;
+    num += stats_window_read(router->getProxy(i), idx, &bins, window);
+    if (i == 0) {
+      num_bins_used = bins;
     }
+  }
+
+  if (num_bins_used != 0) {
     rate = (double)num / (num_bins_used * MOVING_AVERAGE_BIN_SIZE_IN_SECOND);
   }
 
@@ -173,35 +356,49 @@ double stats_aggregate_rate_value(const McrouterInstance* router, int idx) {
 
 
 
-static std::string rate_stat_to_str(proxy_t * proxy, int idx) {
-  return folly::stringPrintf("%g", stats_rate_value(proxy, idx));
+/* Adds "%g" formatted value to reply, without a temporary string */
+static void add_double_stat(StatsReply& reply, folly::StringPiece name,
+                            double value) {
+  char buf[32];
+  int len = snprintf(buf, sizeof(buf), "%g", value);
+  reply.addStat(name, folly::StringPiece(buf, std::min<size_t>(
+    len > 0 ? len : 0, sizeof(buf) - 1)));
 }
 
 /**
- * Write a stat into a buffer.
- *
- * @param stat_t* stat the stat to write
- * @param char* buf the already allocated buffer to write into
- * @param void* ptr the ptr to the structure that has the stat to be written
+ * Add a stat to a stats reply.
  *
- * @eturn the length of the string written, excluding terminator
+ * @param StatsReply& reply the reply to add the stat to
+ * @param proxy_t* proxy the proxy rate stats are computed for
+ * @param int idx index of the stat
+ * @param stat_t* stat the stat to add
  */
-static std::string stat_to_str(const stat_t* stat, void *ptr) {
+static void add_stat(StatsReply& reply, proxy_t* proxy, int idx,
+                     const stat_t* stat) {
+  if (stat->group & rate_stats) {
+    add_double_stat(reply, stat->name, stats_rate_value(proxy, idx));
+    return;
+  }
   switch (stat->type) {
     case stat_string_fn:
-      return stat->data.string_fn(ptr);
+      reply.addStat(stat->name, stat->data.string_fn(nullptr));
+      break;
     case stat_string:
-      return stat->data.string;
+      reply.addStat(stat->name, folly::StringPiece(stat->data.string));
+      break;
     case stat_uint64:
-      return folly::to<std::string>(stat->data.uint64);
+      reply.addStat(stat->name, stat->data.uint64);
+      break;
     case stat_int64:
-      return folly::to<std::string>(stat->data.int64);
+      reply.addStat(stat->name, stat->data.int64);
+      break;
     case stat_double:
-      return folly::stringPrintf("%g", stat->data.dbl);
+      add_double_stat(reply, stat->name, stat->data.dbl);
+      break;
     default:
       LOG(ERROR) << "unknown stat type " << stat->type << " (" <<
                     stat->name << ")";
-      return "";
+      reply.addStat(stat->name, folly::StringPiece());
   }
 }
 
@@ -319,22 +516,42 @@ void prepare_stats(McrouterInstance* router, stat_t* stats) {
 
   AggregatedDestinationStats destStats;
   uint64_t config_last_success = 0;
+  uint64_t asynclogBatches = 0;
+  uint64_t asynclogEntries = 0;
+  uint64_t connects = 0;
+  uint64_t connectFailures = 0;
+  uint64_t connectLatencyUs = 0;
+  uint64_t connectsDelayed = 0;
   for (size_t i = 0; i < router->opts().num_proxies; ++i) {
     auto proxy = router->getProxy(i);
+    asynclogBatches += proxy->async_batch.numBatches.load();
+    asynclogEntries += proxy->async_batch.numEntries.load();
+    const auto& connectStats = proxy->connectThrottle->stats();
+    connects += connectStats.connects.load();
+    connectFailures += connectStats.failures.load();
+    connectLatencyUs += connectStats.latencyUs.load();
+    connectsDelayed += connectStats.delayed.load();
     config_last_success = std::max(config_last_success,
       proxy->stats[config_last_success_stat].data.uint64);
     proxy->destinationMap->foreachDestinationSynced(
       [&destStats](const ProxyDestination& destination) {
         destStats.pendingRequests += destination.getPendingRequestCount();
+        destStats.pendingLowPriorityRequests +=
+          destination.getPendingRequestCount(RequestPriority::LOW);
         destStats.inflightRequests += destination.getInflightRequestCount();
         auto batch = destination.getBatchingStat();
         destStats.batches.first += batch.first;
         destStats.batches.second += batch.second;
+        auto cork = destination.getWriteCorkStat();
+        destStats.writeCork.first += cork.first;
+        destStats.writeCork.second += cork.second;
       }
     );
   }
 
   stat_set_uint64(stats, mcc_txbuf_reqs_stat, destStats.pendingRequests);
+  stat_set_uint64(stats, mcc_txbuf_low_priority_reqs_stat,
+                  destStats.pendingLowPriorityRequests);
   stat_set_uint64(stats, mcc_waiting_replies_stat, destStats.inflightRequests);
 
   double avgBatchSize = 0;
@@ -342,6 +559,21 @@ void prepare_stats(McrouterInstance* router, stat_t* stats) {
     avgBatchSize = destStats.batches.first / (double)destStats.batches.second;
   }
   stats[destination_batch_size_stat].data.dbl = avgBatchSize;
+  stats[destination_write_cork_us_stat].data.dbl =
+    destStats.writeCork.second == 0 ? 0 :
+    destStats.writeCork.first / (double)destStats.writeCork.second;
+
+  stat_set_uint64(stats, destination_connects_stat, connects);
+  stat_set_uint64(stats, destination_connect_failures_stat, connectFailures);
+  stats[destination_connect_latency_us_stat].data.dbl =
+    connects + connectFailures == 0 ? 0 :
+    connectLatencyUs / (double)(connects + connectFailures);
+  stat_set_uint64(stats, destination_connects_delayed_stat, connectsDelayed);
+
+  stat_set_uint64(stats, asynclog_queue_depth_stat,
+                  router->asyncWriter().queueSize());
+  stats[asynclog_batch_size_stat].data.dbl = asynclogBatches == 0 ? 0 :
+    asynclogEntries / (double)asynclogBatches;
 
   stats[commandargs_stat].data.string = gStandaloneArgs;
 
@@ -356,6 +588,19 @@ void prepare_stats(McrouterInstance* router, stat_t* stats) {
   stats[config_last_success_stat].data.uint64 = config_last_success;
   stats[config_last_attempt_stat].data.uint64 = router->lastConfigAttempt();
   stats[config_failures_stat].data.uint64 = router->configFailures();
+  stats[config_build_time_us_stat].data.uint64 =
+    router->lastConfigBuildTimeUs();
+  stats[config_build_cpu_time_us_stat].data.uint64 =
+    router->lastConfigBuildCpuTimeUs();
+  stats[config_reload_peak_rss_stat].data.uint64 =
+    router->lastConfigReloadPeakRss();
+
+  const auto& dnsStats = HostResolver::instance().stats();
+  stat_set_uint64(stats, dns_resolutions_stat, dnsStats.resolutions);
+  stat_set_uint64(stats, dns_resolution_failures_stat, dnsStats.failures);
+  stat_set_uint64(stats, dns_prefetch_time_us_stat,
+                  dnsStats.lastPrefetchTimeUs);
+  stat_set_uint64(stats, dns_cache_misses_stat, dnsStats.misses);
 
   stats[child_pid_stat].data.int64 = getpid();
   stats[parent_pid_stat].data.int64 = getppid();
@@ -377,9 +622,37 @@ void prepare_stats(McrouterInstance* router, stat_t* stats) {
   stats[ps_rss_stat].data.uint64 = ps_data.rss;
   stats[ps_vsize_stat].data.uint64 = ps_data.vsize;
 
+  auto memory = MemoryUsage::collect(*router);
+  stats[memory_total_bytes_stat].data.uint64 = memory.totalBytes();
+  stats[memory_route_handles_bytes_stat].data.uint64 =
+    memory.routeHandles.bytes;
+  stats[memory_routing_tables_bytes_stat].data.uint64 =
+    memory.routingTables.bytes;
+  stats[memory_destinations_bytes_stat].data.uint64 =
+    memory.destinations.bytes;
+  stats[memory_client_buffers_bytes_stat].data.uint64 =
+    memory.clientBuffers.bytes;
+  stats[memory_server_buffers_bytes_stat].data.uint64 =
+    memory.serverBuffers.bytes;
+  stats[memory_fiber_stacks_bytes_stat].data.uint64 =
+    memory.fiberStacks.bytes;
+  stats[memory_asynclog_queue_bytes_stat].data.uint64 =
+    memory.asynclogQueue.bytes;
+  stats[memory_waiting_requests_bytes_stat].data.uint64 =
+    memory.waitingRequests.bytes;
+  auto hugePages = HugePageArena::stats();
+  stats[huge_page_buffers_mapped_bytes_stat].data.uint64 =
+    hugePages.mappedBytes;
+  stats[huge_page_buffers_explicit_bytes_stat].data.uint64 =
+    hugePages.explicitBytes;
+  stats[huge_page_buffers_used_bytes_stat].data.uint64 = hugePages.usedBytes;
+  stats[huge_page_buffers_explicit_failures_stat].data.uint64 =
+    hugePages.explicitFailures;
+
   stats[fibers_allocated_stat].data.uint64 = 0;
   stats[fibers_pool_size_stat].data.uint64 = 0;
   stats[fibers_stack_high_watermark_stat].data.uint64 = 0;
+  stats[duration_p99_us_stat].data.uint64 = 0;
   for (size_t i = 0; i < router->opts().num_proxies; ++i) {
     auto pr = router->getProxy(i);
     stats[fibers_allocated_stat].data.uint64 +=
@@ -390,10 +663,23 @@ void prepare_stats(McrouterInstance* router, stat_t* stats) {
       std::max(stats[fibers_stack_high_watermark_stat].data.uint64,
                pr->fiberManager.stackHighWatermark());
     stats[duration_us_stat].data.dbl += pr->durationUs.value();
+    stats[duration_p99_us_stat].data.uint64 =
+      std::max(stats[duration_p99_us_stat].data.uint64,
+               pr->durationUs.percentile(99));
+    stats[proxy_inflight_limit_stat].data.uint64 +=
+      pr->inflightLimiter ? pr->inflightLimiter->limit()
+                          : router->opts().proxy_max_inflight_requests;
+    stats[proxy_reqs_wait_time_us_stat].data.dbl += pr->waitingUs.value();
   }
   if (router->opts().num_proxies > 0) {
     stats[duration_us_stat].data.dbl /= router->opts().num_proxies;
+    stats[proxy_reqs_wait_time_us_stat].data.dbl /=
+      router->opts().num_proxies;
   }
+
+  auto contextPoolStats = ProxyRequestContext::poolStats();
+  stats[request_contexts_allocated_stat].data.uint64 = contextPoolStats.first;
+  stats[request_contexts_reused_stat].data.uint64 = contextPoolStats.second;
 #ifndef FBCODE_OPT_BUILD
   stats[mc_msg_num_outstanding_stat].data.uint64 =
     mc_msg_num_outstanding();
@@ -483,9 +769,8 @@ static stat_group_t stat_parse_group_str(folly::StringPiece str) {
  * @param proxy_t proxy
  */
 McReply stats_reply(proxy_t* proxy, folly::StringPiece group_str) {
-  std::lock_guard<std::mutex> guard(proxy->stats_lock);
-
-  StatsReply reply;
+  /* Most stats lines are short, this avoids regrowing the buffer */
+  StatsReply reply(num_stats * 48);
 
   if (group_str == "version") {
     reply.addStat("mcrouter-version", MCROUTER_PACKAGE_STRING);
@@ -504,11 +789,7 @@ McReply stats_reply(proxy_t* proxy, folly::StringPiece group_str) {
   for (unsigned int ii = 0; ii < num_stats; ii++) {
     stat_t* stat = &stats[ii];
     if (stat->group & groups) {
-      if (stat->group & rate_stats) {
-        reply.addStat(stat->name, rate_stat_to_str(proxy, ii));
-      } else {
-        reply.addStat(stat->name, stat_to_str(stat, nullptr));
-      }
+      add_stat(reply, proxy, ii, stat);
     }
   }
 
@@ -532,6 +813,8 @@ McReply stats_reply(proxy_t* proxy, folly::StringPiece group_str) {
           }
           stat.pendingRequestsCount += pdstn.getPendingRequestCount();
           stat.inflightRequestsCount += pdstn.getInflightRequestCount();
+          stat.adaptiveTimeoutMs = std::max<int64_t>(
+            stat.adaptiveTimeoutMs, pdstn.adaptiveTimeout().count());
         }
       );
     }
@@ -552,6 +835,274 @@ McReply stats_reply(proxy_t* proxy, folly::StringPiece group_str) {
   return reply.getMcReply();
 }
 
+folly::dynamic latency_histograms(McrouterInstance* router) {
+  std::map<std::string, LatencyHistogram> routes;
+  std::map<std::string, LatencyHistogram> pools;
+  std::map<std::string, LatencyHistogram> servers;
+  std::map<std::string, LatencyHistogram> proxyLoop;
+  std::map<std::string, LatencyHistogram> destinationPhases;
+  for (size_t i = 0; i < router->opts().num_proxies; ++i) {
+    auto proxy = router->getProxy(i);
+    proxyLoop["loop_lag"].merge(proxy->loopMonitor.loopLagUs);
+    proxyLoop["queue_wait"].merge(proxy->loopMonitor.queueWaitUs);
+    proxyLoop["fiber_wait"].merge(proxy->loopMonitor.fiberWaitUs);
+    proxy->routeLatencies.foreachSynced(
+      [&routes](const std::string& name, const LatencyHistogram& histogram) {
+        routes[name].merge(histogram);
+      }
+    );
+    proxy->destinationMap->foreachDestinationSynced(
+      [&pools, &servers, &destinationPhases](const ProxyDestination& pdstn) {
+        if (const auto& phases = pdstn.stats().phases) {
+          destinationPhases["queue"].merge(phases->queue);
+          destinationPhases["wire"].merge(phases->wire);
+          destinationPhases["processing"].merge(phases->processing);
+        }
+        const auto& histogram = pdstn.stats().latency;
+        if (histogram.count() == 0) {
+          return;
+        }
+        pools[pdstn.poolName()].merge(histogram);
+        servers[pdstn.pdstnKey].merge(histogram);
+      }
+    );
+  }
+
+  auto toDynamic = [](const std::map<std::string, LatencyHistogram>& m) {
+    folly::dynamic result = folly::dynamic::object;
+    for (const auto& it : m) {
+      result[it.first] = it.second.toDynamic();
+    }
+    return result;
+  };
+  return folly::dynamic::object
+    ("routes", toDynamic(routes))
+    ("pools", toDynamic(pools))
+    ("servers", toDynamic(servers))
+    ("proxy_loop", toDynamic(proxyLoop))
+    ("destination_phases", toDynamic(destinationPhases));
+}
+
+folly::dynamic destinations(McrouterInstance* router,
+                            folly::StringPiece poolName) {
+  /* Only copy counters under the destination maps' locks,
+     building the result can take a while with many destinations */
+  std::map<std::string, DestinationSnapshot> snapshots;
+  for (size_t i = 0; i < router->opts().num_proxies; ++i) {
+    router->getProxy(i)->destinationMap->foreachDestinationSynced(
+      [&snapshots, poolName](const ProxyDestination& pdstn) {
+        if (!poolName.empty() && pdstn.poolName() != poolName) {
+          return;
+        }
+        auto& snapshot = snapshots[pdstn.pdstnKey];
+        if (snapshot.poolName.empty()) {
+          snapshot.poolName = pdstn.poolName();
+        }
+        ++snapshot.states[(size_t)pdstn.stats().state];
+        snapshot.isHardTko = pdstn.tracker->isHardTko();
+        snapshot.isSoftTko = pdstn.tracker->isSoftTko();
+        if (pdstn.stats().avgLatency.hasValue()) {
+          snapshot.sumLatencies += pdstn.stats().avgLatency.value();
+          ++snapshot.cntLatencies;
+        }
+        snapshot.pendingRequestsCount += pdstn.getPendingRequestCount();
+        snapshot.pendingLowPriorityRequestsCount +=
+          pdstn.getPendingRequestCount(RequestPriority::LOW);
+        snapshot.inflightRequestsCount += pdstn.getInflightRequestCount();
+        auto batch = pdstn.getBatchingStat();
+        snapshot.batches.first += batch.first;
+        snapshot.batches.second += batch.second;
+        auto cork = pdstn.getWriteCorkStat();
+        snapshot.writeCork.first += cork.first;
+        snapshot.writeCork.second += cork.second;
+        snapshot.latency.merge(pdstn.stats().latency);
+        if (const auto& phases = pdstn.stats().phases) {
+          if (!snapshot.phases) {
+            snapshot.phases =
+              folly::make_unique<ProxyDestination::Stats::Phases>();
+          }
+          snapshot.phases->queue.merge(phases->queue);
+          snapshot.phases->wire.merge(phases->wire);
+          snapshot.phases->processing.merge(phases->processing);
+        }
+      }
+    );
+  }
+
+  folly::dynamic result = folly::dynamic::object;
+  for (const auto& it : snapshots) {
+    result[it.first] = it.second.toDynamic();
+  }
+  return result;
+}
+
+folly::dynamic preconnect_status(McrouterInstance* router) {
+  size_t states[(size_t)ProxyDestination::State::kNumStates] = {0};
+  for (size_t i = 0; i < router->opts().num_proxies; ++i) {
+    router->getProxy(i)->destinationMap->foreachDestinationSynced(
+      [&states](const ProxyDestination& pdstn) {
+        ++states[(size_t)pdstn.stats().state];
+      }
+    );
+  }
+
+  size_t total = 0;
+  for (auto count : states) {
+    total += count;
+  }
+  return folly::dynamic::object
+    ("total", (int64_t)total)
+    ("connecting", (int64_t)states[(size_t)ProxyDestination::State::kNew])
+    ("up", (int64_t)states[(size_t)ProxyDestination::State::kUp])
+    ("down", (int64_t)states[(size_t)ProxyDestination::State::kDown]);
+}
+
+folly::dynamic pool_stats(McrouterInstance* router) {
+  struct PoolSnapshot {
+    uint64_t replies{0};
+    uint64_t refused{0};
+    uint64_t results[mc_nres] = {0};
+    LatencyHistogram latency;
+    SizeHistograms sizes;
+  };
+  std::map<std::string, PoolSnapshot> pools;
+  /* Names are looked up once per id, not once per proxy */
+  std::vector<PoolSnapshot*> byId(PoolStats::kMaxPools, nullptr);
+  for (size_t i = 0; i < router->opts().num_proxies; ++i) {
+    router->getProxy(i)->poolStats.foreach(
+      [&pools, &byId](uint32_t id, const PoolStatsEntry& entry) {
+        if (byId[id] == nullptr) {
+          byId[id] = &pools[PoolStats::nameOf(id)];
+        }
+        auto& snapshot = *byId[id];
+        snapshot.replies += entry.replies.load(std::memory_order_relaxed);
+        snapshot.refused += entry.refused.load(std::memory_order_relaxed);
+        for (int j = 0; j < mc_nres; ++j) {
+          snapshot.results[j] +=
+            entry.results[j].load(std::memory_order_relaxed);
+        }
+        snapshot.latency.merge(entry.latency);
+        snapshot.sizes.merge(entry.sizes);
+      }
+    );
+  }
+
+  folly::dynamic result = folly::dynamic::object;
+  for (const auto& it : pools) {
+    const auto& snapshot = it.second;
+    folly::dynamic results = folly::dynamic::object;
+    for (int j = 0; j < mc_nres; ++j) {
+      if (snapshot.results[j] > 0) {
+        results[mc_res_to_string(static_cast<mc_res_t>(j))] =
+          static_cast<int64_t>(snapshot.results[j]);
+      }
+    }
+    result[it.first] = folly::dynamic::object
+      ("replies", static_cast<int64_t>(snapshot.replies))
+      ("refused", static_cast<int64_t>(snapshot.refused))
+      ("results", std::move(results))
+      ("latency", snapshot.latency.toDynamic())
+      ("key_size", snapshot.sizes.keySize.toDynamic())
+      ("value_size", snapshot.sizes.valueSize.toDynamic());
+  }
+  return result;
+}
+
+folly::dynamic op_sizes(McrouterInstance* router) {
+  std::map<std::string, SizeHistograms> ops;
+  for (size_t i = 0; i < router->opts().num_proxies; ++i) {
+    router->getProxy(i)->opSizes.foreach(
+      [&ops](mc_op_t op, const SizeHistograms& sizes) {
+        ops[mc_op_to_string(op)].merge(sizes);
+      }
+    );
+  }
+
+  folly::dynamic result = folly::dynamic::object;
+  for (const auto& it : ops) {
+    result[it.first] = it.second.toDynamic();
+  }
+  return result;
+}
+
+folly::dynamic route_cpu(McrouterInstance* router) {
+  std::map<std::string, std::pair<uint64_t, uint64_t>> nodes;
+  for (size_t i = 0; i < router->opts().num_proxies; ++i) {
+    router->getProxy(i)->routeCpu.foreach(
+      [&nodes](const RouteCpuNode& node) {
+        auto& totals = nodes[node.path];
+        totals.first += node.calls.load(std::memory_order_relaxed);
+        totals.second += node.selfCycles.load(std::memory_order_relaxed);
+      }
+    );
+  }
+
+  folly::dynamic result = folly::dynamic::object;
+  for (const auto& it : nodes) {
+    auto calls = it.second.first;
+    auto cycles = it.second.second;
+    result[it.first] = folly::dynamic::object
+      ("calls", static_cast<int64_t>(calls))
+      ("self_cycles", static_cast<int64_t>(cycles))
+      ("avg_self_cycles", static_cast<int64_t>(calls ? cycles / calls : 0));
+  }
+  return result;
+}
+
+folly::dynamic hot_keys(McrouterInstance* router) {
+  std::vector<std::vector<HotKeyTracker::Entry>> tops;
+  for (size_t i = 0; i < router->opts().num_proxies; ++i) {
+    tops.push_back(router->getProxy(i)->hotKeys.top());
+  }
+  return HotKeyTracker::toDynamic(
+    HotKeyTracker::merge(tops, router->opts().hot_keys_top_k));
+}
+
+folly::dynamic top_clients(McrouterInstance* router) {
+  std::vector<std::vector<TopClientTracker::Entry>> connections;
+  std::vector<std::vector<TopClientTracker::Entry>> senders;
+  for (size_t i = 0; i < router->opts().num_proxies; ++i) {
+    connections.push_back(router->getProxy(i)->topConnections.top());
+    senders.push_back(router->getProxy(i)->topSenders.top());
+  }
+  auto topK = router->opts().top_clients_top_k;
+  return folly::dynamic::object
+    ("connections", TopClientTracker::toDynamic(
+                      TopClientTracker::merge(connections, topK)))
+    ("senders", TopClientTracker::toDynamic(
+                  TopClientTracker::merge(senders, topK)));
+}
+
+folly::dynamic request_phases(McrouterInstance* router) {
+  RequestPhaseStats phases;
+  for (size_t i = 0; i < router->opts().num_proxies; ++i) {
+    phases.merge(router->getProxy(i)->requestPhases);
+  }
+  return phases.toDynamic();
+}
+
+folly::dynamic slow_requests(McrouterInstance* router) {
+  std::vector<std::pair<size_t, SlowRequestLog::Entry>> entries;
+  for (size_t i = 0; i < router->opts().num_proxies; ++i) {
+    for (auto& entry : router->getProxy(i)->slowRequests.entries()) {
+      entries.emplace_back(i, std::move(entry));
+    }
+  }
+  std::stable_sort(entries.begin(), entries.end(),
+                   [](const std::pair<size_t, SlowRequestLog::Entry>& a,
+                      const std::pair<size_t, SlowRequestLog::Entry>& b) {
+                     return a.second.timeUs < b.second.timeUs;
+                   });
+
+  folly::dynamic result = {};
+  for (const auto& it : entries) {
+    auto entry = it.second.toDynamic();
+    entry["proxy"] = static_cast<int64_t>(it.first);
+    result.push_back(std::move(entry));
+  }
+  return result;
+}
+
 void set_standalone_args(folly::StringPiece args) {
   assert(gStandaloneArgs == nullptr);
   gStandaloneArgs = new char[args.size() + 1];
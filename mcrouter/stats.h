@@ -12,6 +12,7 @@
 #include <string>
 #include <unordered_map>
 
+#include <folly/dynamic.h>
 #include <folly/Range.h>
 
 namespace facebook { namespace memcache {
@@ -36,6 +37,36 @@ enum stat_name_t {
 #undef STSI
 #undef STSS
 
+// Rate stats (STUIR, group rate_stats) are also numbered on their own,
+// so that per-proxy moving windows are only kept for them.
+#define STAT(name,...)
+#define STUI STAT
+#define STUIR(name,...) name##_rate_idx,
+#define STSI STAT
+#define STSS STAT
+enum rate_stat_name_t {
+  #include "stat_list.h"
+  num_rate_stats,
+};
+#undef STAT
+#undef STUI
+#undef STUIR
+#undef STSI
+#undef STSS
+
+/**
+ * Moving windows over which rates are computed. Each is the last
+ * N bins of MOVING_AVERAGE_BIN_SIZE_IN_SECOND, the full window being
+ * MOVING_AVERAGE_WINDOW_SIZE_IN_SECOND (what "stats" reports).
+ */
+enum rate_window_t {
+  rate_window_1s,
+  rate_window_10s,
+  rate_window_60s,
+  rate_window_full,
+  num_rate_windows,
+};
+
 // Forward declarations
 class McrouterInstance;
 struct proxy_t;
@@ -100,7 +131,33 @@ void stat_decr_safe(stat_t*, stat_name_t);
  * Current aggregation of rate of stats[idx] (which must be an aggregated
  * rate stat), units will be per second.
  */
-double stats_aggregate_rate_value(const McrouterInstance* router, int idx);
+double stats_aggregate_rate_value(const McrouterInstance* router, int idx,
+                                  rate_window_t window = rate_window_full);
+
+/**
+ * @return  rate_stat_name_t of stats[idx], -1 if it's not a rate stat
+ */
+int stats_rate_index(int idx);
+
+/**
+ * Lock-free consistent read of the moving window of proxy->stats[idx]
+ * (which must be a rate stat). Never blocks the stat updater or
+ * the proxy thread.
+ *
+ * @param num_bins_used  If not nullptr, set to the number of bins
+ *   covered by the returned count.
+ * @return  Count of the stat within the window.
+ */
+uint64_t stats_window_read(const proxy_t* proxy, int idx,
+                           int* num_bins_used,
+                           rate_window_t window = rate_window_full);
+
+/**
+ * Stat updater thread only: closes the current bin of every rate stat of
+ * proxy, storing it at binIdx (the oldest bin), and updates the sums of
+ * every window incrementally.
+ */
+void stats_window_update(proxy_t* proxy, int binIdx);
 
 void stat_set_uint64(stat_t*, stat_name_t, uint64_t);
 uint64_t stat_get_uint64(stat_t*, stat_name_t);
@@ -108,6 +165,107 @@ uint64_t stat_get_config_age(const stat_t* stats, uint64_t now);
 McReply stats_reply(proxy_t*, folly::StringPiece);
 void prepare_stats(McrouterInstance* router, stat_t* stats);
 
+/**
+ * Latency histograms (in microseconds) merged across all proxies:
+ *   {"routes": {<routing prefix>: {...}},
+ *    "pools": {<pool name>: {...}},
+ *    "servers": {<destination key>: {...}},
+ *    "proxy_loop": {"loop_lag": {...}, "queue_wait": {...},
+ *                   "fiber_wait": {...}}}
+ * where each histogram is LatencyHistogram::toDynamic().
+ * Route latencies are end to end, pool and server latencies are
+ * measured per request sent to a destination. Proxy loop ones are
+ * described in ProxyLoopMonitor.
+ */
+folly::dynamic latency_histograms(McrouterInstance* router);
+
+/**
+ * Per destination state merged across all proxies:
+ *   {<destination key>: {"pool": ..., "states": {<state>: <proxies>, ...},
+ *                        "tko": "none"|"soft"|"hard",
+ *                        "pending_reqs": ..., "inflight_reqs": ...,
+ *                        "avg_batch_size": ..., "avg_latency_us": ...,
+ *                        "latency": LatencyHistogram::toDynamic()}}
+ *
+ * @param poolName  if not empty, only destinations of this pool
+ */
+folly::dynamic destinations(McrouterInstance* router,
+                            folly::StringPiece poolName = "");
+
+/**
+ * Connection readiness of destinations across all proxies:
+ *   {"total": ..., "connecting": ..., "up": ..., "down": ...}
+ * counting (destination, proxy) pairs. "connecting" ones never finished
+ * connecting: with opts.preconnect_destinations, the router is ready
+ * once it reaches 0.
+ */
+folly::dynamic preconnect_status(McrouterInstance* router);
+
+/**
+ * Per pool request stats merged across all proxies, see PoolStats:
+ *   {<pool name>: {"replies": ..., "refused": ...,
+ *                  "results": {<result>: <count>, ...},
+ *                  "latency": LatencyHistogram::toDynamic(),
+ *                  "key_size": ..., "value_size": ...}}
+ * Counters are totals since startup, latencies and sizes (in bytes, same
+ * format as latency) are of replies received.
+ */
+folly::dynamic pool_stats(McrouterInstance* router);
+
+/**
+ * Key and value sizes of requests to destinations by operation, merged
+ * across all proxies:
+ *   {<op name>: SizeHistograms::toDynamic()}
+ * Totals since startup, see SizeHistograms.
+ */
+folly::dynamic op_sizes(McrouterInstance* router);
+
+/**
+ * CPU cost of routes for requests sampled with
+ * opts.route_cpu_sample_period, merged across all proxies:
+ *   {<route path>: {"calls": ..., "self_cycles": ...,
+ *                   "avg_self_cycles": ...}}
+ * where paths are the route names from the root of the route tree and
+ * self cycles exclude the route's children and waits, see RouteCpuProfiler.
+ */
+folly::dynamic route_cpu(McrouterInstance* router);
+
+/**
+ * Most requested keys merged across all proxies, at most hot_keys_top_k:
+ *   [{"key": <full key>, "count": <estimated requests>, "error": ...}, ...]
+ * ordered by count. Counts are estimated from sampled requests and decay
+ * over time, see HotKeyTracker.
+ */
+folly::dynamic hot_keys(McrouterInstance* router);
+
+/**
+ * Costliest clients merged across all proxies, at most top_clients_top_k
+ * of each kind:
+ *   {"connections": [{"client": <peer address>, "requests": ...,
+ *                     "bytes_in": ..., "bytes_out": ..., "cost": ...,
+ *                     "error": ...}, ...],
+ *    "senders": [{"client": <sender id>, ...}, ...]}
+ * ordered by cost. Connections are only known to the standalone server.
+ * Totals are estimated from sampled requests and decay over time,
+ * see TopClientTracker.
+ */
+folly::dynamic top_clients(McrouterInstance* router);
+
+/**
+ * Phase latency histograms of sampled requests merged across all proxies:
+ *   {<phase name>: {...}, ...}
+ * see RequestPhaseStats for the phases and
+ * opts.request_phases_sample_period for sampling.
+ */
+folly::dynamic request_phases(McrouterInstance* router);
+
+/**
+ * Slow requests recorded by all proxies, see SlowRequestLog:
+ *   [{"proxy": <index>, "time_us": ..., "duration_us": ..., ...}, ...]
+ * ordered by time.
+ */
+folly::dynamic slow_requests(McrouterInstance* router);
+
 void set_standalone_args(folly::StringPiece args);
 
 }}} // facebook::memcache::mcrouter
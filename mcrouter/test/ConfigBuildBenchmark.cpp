@@ -0,0 +1,396 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <folly/Conv.h>
+#include <folly/dynamic.h>
+#include <folly/FileUtil.h>
+#include <folly/json.h>
+
+#include "mcrouter/config.h"
+#include "mcrouter/lib/config/ConfigPreprocessor.h"
+#include "mcrouter/lib/fbi/cpp/globals.h"
+#include "mcrouter/McrouterInstance.h"
+#include "mcrouter/MemoryUsage.h"
+#include "mcrouter/options.h"
+#include "mcrouter/ProxyConfig.h"
+#include "mcrouter/ProxyConfigBuilder.h"
+#include "mcrouter/routes/McImportResolver.h"
+
+/**
+ * Config build scalability benchmark.
+ *
+ * Generates a config shaped like large production ones (or reads one
+ * with -f): num_servers servers split into num_pools pools, every pool's
+ * server list and routes expanded from nested macros, one routing prefix
+ * per region and cluster, each a PrefixSelectorRoute over the pools of
+ * its cluster, every split_every-th pool with shard_splits for num_splits
+ * shards.
+ *
+ * Then, for an McrouterInstance with num_proxies proxies, measures:
+ *   preprocessing the config alone (ConfigPreprocessor);
+ *   startup: ProxyConfigBuilder construction (preprocessing and pools)
+ *     and buildConfig() for every proxy, with all configs kept alive;
+ *   reload (-R times): the same, with the previous configs alive and
+ *     passed to the builder, as McrouterInstance::configure() does.
+ * For every buildConfig() it reports wall time, growth of RSS and of
+ * route handle and routing table bytes (see MemoryUsage), and at the end
+ * the peak RSS of the process and __mcrouter__.memory.
+ *
+ * Builds run on the main thread one after another, so times are for
+ * a single build thread: compare with opts.config_build_threads = 1.
+ * Servers are not connected to, destinations are only created.
+ *
+ * Prints one JSON object, so runs can be compared by a script.
+ */
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+namespace {
+
+struct BenchOptions {
+  size_t numServers{100000};
+  size_t numPools{2000};
+  size_t numRegions{20};
+  size_t numClusters{20};
+  /* Every splitEvery-th pool has shard splits, none if 0 */
+  size_t splitEvery{10};
+  size_t numSplits{64};
+  size_t numProxies{4};
+  size_t numReloads{1};
+  /* Config to benchmark instead of a generated one */
+  std::string configFile;
+  /* File to write the generated config to, nothing is measured */
+  std::string outputFile;
+};
+
+using Clock = std::chrono::steady_clock;
+
+double msSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+    .count();
+}
+
+/**
+ * @return  resident set size of this process in bytes, 0 on error.
+ */
+int64_t currentRss() {
+  FILE* statm = fopen("/proc/self/statm", "r");
+  if (statm == nullptr) {
+    return 0;
+  }
+  unsigned long size;
+  unsigned long residentPages;
+  int count = fscanf(statm, "%lu %lu", &size, &residentPages);
+  fclose(statm);
+  if (count != 2) {
+    return 0;
+  }
+  return static_cast<int64_t>(residentPages) * sysconf(_SC_PAGESIZE);
+}
+
+int64_t peakRss() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return static_cast<int64_t>(usage.ru_maxrss) * 1024;
+}
+
+int64_t routeBytes() {
+  return static_cast<int64_t>(
+    routeHandleMemory().bytes() + routingTableMemory().bytes());
+}
+
+folly::dynamic makeMacros() {
+  return folly::dynamic::object
+    ("server", folly::dynamic::object
+      ("type", "macroDef")
+      ("params", { "host", "port" })
+      ("result", "%host%:%port%"))
+    ("servers", folly::dynamic::object
+      ("type", "macroDef")
+      ("params", { "host", "count" })
+      ("result", folly::dynamic::object
+        ("type", "transform")
+        ("dictionary", "@range(@int(1),@int(%count%))")
+        ("itemTransform",
+         "@server(%host%,@str(@add(@int(11000),%item%)))")))
+    ("pool", folly::dynamic::object
+      ("type", "macroDef")
+      ("params", { "host", "count" })
+      ("result", folly::dynamic::object
+        ("servers", "@servers(%host%,%count%)")
+        ("protocol", "ascii")
+        ("keep_routing_prefix", false)))
+    ("poolRoute", folly::dynamic::object
+      ("type", "macroDef")
+      ("params", { "pool" })
+      ("result", folly::dynamic::object
+        ("type", "PoolRoute")
+        ("pool", "%pool%")))
+    ("policy", folly::dynamic::object
+      ("type", "macroDef")
+      ("params", { "route" })
+      ("result", folly::dynamic::object
+        ("type", "OperationSelectorRoute")
+        ("default_policy", "%route%")
+        ("operation_policies", folly::dynamic::object
+          ("delete", folly::dynamic::object
+            ("type", "AllSyncRoute")
+            ("children", { "%route%" })))));
+}
+
+std::string makeConfig(const BenchOptions& opts) {
+  auto numPrefixes = opts.numRegions * opts.numClusters;
+  auto pools = folly::dynamic::object;
+  std::vector<folly::dynamic> clusterPolicies;
+  for (size_t i = 0; i < numPrefixes; ++i) {
+    clusterPolicies.push_back(folly::dynamic::object);
+  }
+  std::vector<std::string> clusterWildcards(numPrefixes);
+  for (size_t i = 0; i < opts.numPools; ++i) {
+    auto name = folly::to<std::string>("pool", i);
+    auto numServers = opts.numServers / opts.numPools +
+      (i < opts.numServers % opts.numPools ? 1 : 0);
+    auto host = folly::to<std::string>(
+      "10.", (i >> 16) & 0xff, ".", (i >> 8) & 0xff, ".", i & 0xff);
+    pools[name] = folly::to<std::string>("@pool(", host, ",", numServers, ")");
+
+    folly::dynamic policy = folly::to<std::string>(
+      "@policy(@poolRoute(", name, "))");
+    if (opts.splitEvery != 0 && i % opts.splitEvery == 0) {
+      auto splits = folly::dynamic::object;
+      for (size_t shard = 1; shard <= opts.numSplits; ++shard) {
+        splits[folly::to<std::string>(shard)] = 2 + shard % 3;
+      }
+      policy = folly::dynamic::object
+        ("type", "policy")
+        ("route", folly::dynamic::object
+          ("type", "PoolRoute")
+          ("pool", name)
+          ("shard_splits", std::move(splits)));
+    }
+
+    auto cluster = i % numPrefixes;
+    clusterPolicies[cluster][folly::to<std::string>(name, ":")] =
+      std::move(policy);
+    if (clusterWildcards[cluster].empty()) {
+      clusterWildcards[cluster] = name;
+    }
+  }
+
+  folly::dynamic routes = {};
+  for (size_t i = 0; i < numPrefixes; ++i) {
+    auto alias = folly::to<std::string>(
+      "/region", i / opts.numClusters, "/cluster", i % opts.numClusters, "/");
+    auto wildcard = clusterWildcards[i].empty()
+      ? folly::dynamic("NullRoute")
+      : folly::dynamic(folly::to<std::string>(
+          "@policy(@poolRoute(", clusterWildcards[i], "))"));
+    routes.push_back(folly::dynamic::object
+      ("aliases", { alias })
+      ("route", folly::dynamic::object
+        ("type", "PrefixSelectorRoute")
+        ("policies", std::move(clusterPolicies[i]))
+        ("wildcard", std::move(wildcard))));
+  }
+
+  return folly::toPrettyJson(folly::dynamic::object
+    ("macros", makeMacros())
+    ("pools", pools)
+    ("routes", routes)).toStdString();
+}
+
+/**
+ * Builds configs for all proxies of router, with previous (if not empty)
+ * alive as the configs being replaced.
+ */
+folly::dynamic buildAll(McrouterInstance& router,
+                        const std::string& config,
+                        std::vector<std::shared_ptr<ProxyConfig>>& configs) {
+  const auto& opts = router.opts();
+  auto rssStart = currentRss();
+  auto start = Clock::now();
+  ProxyConfigBuilder builder(opts, &router.configApi(), config,
+                             configs.empty() ? nullptr : configs[0].get());
+  auto builderMs = msSince(start);
+
+  std::vector<std::shared_ptr<ProxyConfig>> newConfigs;
+  folly::dynamic buildMs = {};
+  folly::dynamic rssGrowth = {};
+  folly::dynamic routeGrowth = {};
+  for (size_t i = 0; i < opts.num_proxies; ++i) {
+    auto rss = currentRss();
+    auto bytes = routeBytes();
+    auto buildStart = Clock::now();
+    newConfigs.push_back(builder.buildConfig(router.getProxy(i)));
+    buildMs.push_back(msSince(buildStart));
+    rssGrowth.push_back(currentRss() - rss);
+    routeGrowth.push_back(routeBytes() - bytes);
+  }
+  auto totalMs = msSince(start);
+  auto rssEnd = currentRss();
+  configs = std::move(newConfigs);
+
+  return folly::dynamic::object
+    ("total_ms", totalMs)
+    ("builder_ms", builderMs)
+    ("build_ms", buildMs)
+    ("rss_growth_bytes", rssEnd - rssStart)
+    ("build_rss_growth_bytes", rssGrowth)
+    ("build_route_bytes", routeGrowth);
+}
+
+folly::dynamic runBenchmark(const BenchOptions& opts) {
+  std::string config;
+  if (!opts.configFile.empty()) {
+    if (!folly::readFile(opts.configFile.c_str(), config)) {
+      throw std::runtime_error("Can't read " + opts.configFile);
+    }
+  } else {
+    config = makeConfig(opts);
+  }
+
+  auto routerOpts = defaultTestOptions();
+  routerOpts.config_str = "{\"route\": \"NullRoute\"}";
+  routerOpts.num_proxies = opts.numProxies;
+  routerOpts.asynclog_disable = true;
+  auto router = McrouterInstance::init("config_build_benchmark", routerOpts);
+  if (router == nullptr) {
+    throw std::runtime_error("Can't start mcrouter");
+  }
+  auto baseRss = currentRss();
+
+  std::unordered_map<std::string, folly::dynamic> globalParams{
+    { "default-route", routerOpts.default_route.str() },
+    { "default-region", routerOpts.default_route.getRegion().str() },
+    { "default-cluster", routerOpts.default_route.getCluster().str() },
+    { "hostid", globals::hostid() },
+  };
+  McImportResolver importResolver(&router->configApi());
+  auto start = Clock::now();
+  auto json = ConfigPreprocessor::getConfigWithoutMacros(
+    config, importResolver, std::move(globalParams));
+  auto preprocessMs = msSince(start);
+  json = nullptr;
+
+  std::vector<std::shared_ptr<ProxyConfig>> configs;
+  auto startup = buildAll(*router, config, configs);
+  folly::dynamic reloads = {};
+  for (size_t i = 0; i < opts.numReloads; ++i) {
+    reloads.push_back(buildAll(*router, config, configs));
+  }
+
+  auto result = folly::dynamic::object
+    ("config_bytes", static_cast<int64_t>(config.size()))
+    ("num_proxies", static_cast<int64_t>(opts.numProxies))
+    ("preprocess_ms", preprocessMs)
+    ("startup", std::move(startup))
+    ("reloads", std::move(reloads))
+    ("configs_rss_bytes", currentRss() - baseRss)
+    ("peak_rss_bytes", peakRss())
+    ("memory", MemoryUsage::collect(*router).toDynamic());
+  configs.clear();
+  McrouterInstance::freeAllMcrouters();
+  return result;
+}
+
+void usage(char** argv) {
+  std::cerr <<
+    "Arguments:\n"
+    "  -s <n>     number of servers (100000)\n"
+    "  -n <n>     number of pools (2000)\n"
+    "  -r <n>     number of regions (20)\n"
+    "  -c <n>     number of clusters per region (20)\n"
+    "  -S <n>     every n-th pool has shard splits, 0 is none (10)\n"
+    "  -k <n>     number of split shards of such pools (64)\n"
+    "  -p <n>     number of proxies (4)\n"
+    "  -R <n>     number of reloads (1)\n"
+    "  -f <file>  config to use instead of a generated one\n"
+    "  -w <file>  write the generated config to file and exit\n"
+    "Usage:\n"
+    "  $ " << argv[0] << " -s 100000 -n 5000 -p 8\n";
+  exit(1);
+}
+
+}  // anonymous namespace
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+
+  BenchOptions opts;
+  int c;
+  while ((c = getopt(argc, argv, "s:n:r:c:S:k:p:R:f:w:h")) >= 0) {
+    switch (c) {
+      case 's':
+        opts.numServers = std::max(1, folly::to<int>(optarg));
+        break;
+      case 'n':
+        opts.numPools = std::max(1, folly::to<int>(optarg));
+        break;
+      case 'r':
+        opts.numRegions = std::max(1, folly::to<int>(optarg));
+        break;
+      case 'c':
+        opts.numClusters = std::max(1, folly::to<int>(optarg));
+        break;
+      case 'S':
+        opts.splitEvery = folly::to<size_t>(optarg);
+        break;
+      case 'k':
+        opts.numSplits = std::max(1, folly::to<int>(optarg));
+        break;
+      case 'p':
+        opts.numProxies = std::max(1, folly::to<int>(optarg));
+        break;
+      case 'R':
+        opts.numReloads = folly::to<size_t>(optarg);
+        break;
+      case 'f':
+        opts.configFile = optarg;
+        break;
+      case 'w':
+        opts.outputFile = optarg;
+        break;
+      default:
+        usage(argv);
+    }
+  }
+  if (optind != argc) {
+    usage(argv);
+  }
+
+  try {
+    if (!opts.outputFile.empty()) {
+      if (!folly::writeFile(makeConfig(opts), opts.outputFile.c_str())) {
+        throw std::runtime_error("Can't write " + opts.outputFile);
+      }
+      return 0;
+    }
+    std::cout << folly::toPrettyJson(runBenchmark(opts)) << std::endl;
+  } catch (const std::exception& e) {
+    LOG(ERROR) << e.what();
+    return 1;
+  }
+  return 0;
+}
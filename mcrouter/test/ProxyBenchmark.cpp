@@ -0,0 +1,550 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <folly/Conv.h>
+#include <folly/dynamic.h>
+#include <folly/Exception.h>
+#include <folly/FileUtil.h>
+#include <folly/io/IOBuf.h>
+#include <folly/json.h>
+#include <folly/Memory.h>
+
+#include "mcrouter/config.h"
+#include "mcrouter/LatencyHistogram.h"
+#include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/network/AsyncMcServer.h"
+#include "mcrouter/lib/network/AsyncMcServerWorker.h"
+#include "mcrouter/lib/network/test/MockMcBehavior.h"
+#include "mcrouter/lib/network/test/MockMcOnRequest.h"
+#include "mcrouter/lib/network/test/StripedMockMc.h"
+#include "mcrouter/McrouterClient.h"
+#include "mcrouter/McrouterInstance.h"
+#include "mcrouter/options.h"
+
+/**
+ * End-to-end throughput/latency benchmark of the proxy.
+ *
+ * Starts num_servers in-process MockMcOnRequest servers on loopback
+ * and an McrouterInstance in front of them, then drives it from
+ * num_clients threads, one McrouterClient each, for duration ms:
+ *
+ *   closed loop (default): every client keeps concurrency requests
+ *     in flight, latency is measured from send;
+ *   open loop (-r): every client sends rate requests/s on a fixed
+ *     schedule no matter how fast replies come back, latency is measured
+ *     from the scheduled send time, so queueing delay is not hidden.
+ *
+ * Keys are picked from num_keys keys, uniformly or from a Zipf
+ * distribution (-z exponent), get_ratio of requests are gets, the rest
+ * are sets of value_size bytes. All keys are set once before measuring.
+ *
+ * Prints one JSON object with throughput, latency percentiles (us) and
+ * CPU time per request, so runs can be compared by a script. CPU time is
+ * for the whole process: mock servers and load generators are included,
+ * compare runs with the same options.
+ */
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+namespace {
+
+struct BenchOptions {
+  size_t numServers{1};
+  size_t serverThreads{1};
+  /* Latency added by the mock servers */
+  MockMcBehavior serverBehavior;
+  size_t numProxies{1};
+  size_t numClients{1};
+  size_t concurrency{16};
+  /* Requests per second per client, open loop if positive */
+  double rate{0};
+  std::chrono::milliseconds duration{5000};
+  size_t numKeys{10000};
+  size_t keySize{16};
+  size_t valueSize{100};
+  double getRatio{0.9};
+  /* Zipf exponent of key popularity, uniform if 0 */
+  double zipf{0};
+  std::string protocol{"ascii"};
+  /* Config file with @SERVERS@ in place of the list of mock servers */
+  std::string configFile;
+};
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * Mock memcached listening on an ephemeral loopback port, its threads
+ * share one store.
+ */
+class MockServer {
+ public:
+  MockServer(size_t numThreads, const MockMcBehavior& behavior) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    folly::checkUnixError(fd, "socket failed");
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    folly::checkUnixError(
+      bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)),
+      "bind failed");
+    socklen_t len = sizeof(addr);
+    folly::checkUnixError(
+      getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len),
+      "getsockname failed");
+    port_ = ntohs(addr.sin_port);
+
+    AsyncMcServer::Options opts;
+    opts.existingSocketFd = fd;
+    opts.numThreads = numThreads;
+    opts.worker.versionString = "MockMcServer-1.0";
+    server_ = folly::make_unique<AsyncMcServer>(opts);
+    auto mc = std::make_shared<StripedMockMc>(4 * numThreads);
+    server_->spawn([mc, behavior](size_t threadId, folly::EventBase& evb,
+                                  AsyncMcServerWorker& worker) {
+      worker.setOnRequest(MockMcOnRequest(mc, behavior, evb));
+      evb.loop();
+    });
+  }
+
+  ~MockServer() {
+    server_->shutdown();
+    server_->join();
+  }
+
+  uint16_t port() const {
+    return port_;
+  }
+
+ private:
+  std::unique_ptr<AsyncMcServer> server_;
+  uint16_t port_{0};
+};
+
+std::string makeConfig(const BenchOptions& opts,
+                       const std::vector<std::unique_ptr<MockServer>>& servers) {
+  folly::dynamic jservers = {};
+  for (const auto& server : servers) {
+    jservers.push_back(folly::to<std::string>("127.0.0.1:", server->port()));
+  }
+
+  if (!opts.configFile.empty()) {
+    std::string config;
+    if (!folly::readFile(opts.configFile.c_str(), config)) {
+      throw std::runtime_error("Can't read " + opts.configFile);
+    }
+    auto serversJson = folly::to<std::string>(folly::toJson(jservers));
+    const std::string kPlaceholder = "@SERVERS@";
+    size_t pos;
+    while ((pos = config.find(kPlaceholder)) != std::string::npos) {
+      config.replace(pos, kPlaceholder.size(), serversJson);
+    }
+    return config;
+  }
+
+  folly::dynamic config = folly::dynamic::object
+    ("pools", folly::dynamic::object
+      ("A", folly::dynamic::object
+        ("servers", jservers)
+        ("protocol", opts.protocol)))
+    ("route", "PoolRoute|A");
+  return folly::to<std::string>(folly::toJson(config));
+}
+
+/**
+ * Picks key indexes, uniformly or with Zipf popularity.
+ */
+class KeyPicker {
+ public:
+  KeyPicker(size_t numKeys, double zipf) : uniform_(0, numKeys - 1) {
+    if (zipf > 0) {
+      cdf_.reserve(numKeys);
+      double sum = 0;
+      for (size_t i = 0; i < numKeys; ++i) {
+        sum += 1 / std::pow(i + 1, zipf);
+        cdf_.push_back(sum);
+      }
+      for (auto& p : cdf_) {
+        p /= sum;
+      }
+    }
+  }
+
+  template <class Rng>
+  size_t pick(Rng& rng) {
+    if (cdf_.empty()) {
+      return uniform_(rng);
+    }
+    auto it = std::lower_bound(cdf_.begin(), cdf_.end(), real_(rng));
+    return std::min<size_t>(it - cdf_.begin(), cdf_.size() - 1);
+  }
+
+ private:
+  std::vector<double> cdf_;
+  std::uniform_int_distribution<size_t> uniform_;
+  std::uniform_real_distribution<double> real_{0, 1};
+};
+
+class LoadThread;
+
+struct ReplyCallback {
+  LoadThread* thread;
+  Clock::time_point start;
+
+  void operator()(McReply&& reply);
+};
+
+/**
+ * One load generating thread with its own client.
+ */
+class LoadThread {
+ public:
+  LoadThread(McrouterInstance& router,
+             const BenchOptions& opts,
+             const std::vector<std::string>& keys,
+             const folly::IOBuf& value,
+             size_t seed)
+      : opts_(opts),
+        keys_(keys),
+        value_(value),
+        client_(router.createClient(
+          (mcrouter_client_callbacks_t){nullptr, nullptr, nullptr},
+          nullptr,
+          0)),
+        rng_(seed),
+        keyPicker_(keys.size(), opts.zipf) {
+  }
+
+  /**
+   * Sets keys [begin, end), concurrency at a time.
+   */
+  void prefill(size_t begin, size_t end) {
+    for (auto i = begin; i < end; ++i) {
+      acquireSlot();
+      send(keys_[i], mc_op_set, Clock::now(), /* record */ false);
+    }
+    waitForReplies();
+  }
+
+  void runClosedLoop(Clock::time_point end) {
+    while (Clock::now() < end) {
+      acquireSlot();
+      sendRandom(Clock::now());
+    }
+    waitForReplies();
+  }
+
+  void runOpenLoop(Clock::time_point end) {
+    auto start = Clock::now();
+    std::chrono::duration<double> interval(1 / opts_.rate);
+    for (size_t i = 0; ; ++i) {
+      auto scheduled = start +
+        std::chrono::duration_cast<Clock::duration>(interval * i);
+      if (scheduled >= end) {
+        break;
+      }
+      std::this_thread::sleep_until(scheduled);
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++outstanding_;
+      }
+      sendRandom(scheduled);
+    }
+    waitForReplies();
+  }
+
+  void onReply(Clock::time_point start, const McReply& reply, bool record) {
+    if (record) {
+      auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+        Clock::now() - start);
+      latencies_.record(latency.count());
+      if (reply.isError()) {
+        ++errors_;
+      }
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    --outstanding_;
+    cv_.notify_one();
+  }
+
+  const LatencyHistogram& latencies() const {
+    return latencies_;
+  }
+
+  uint64_t errors() const {
+    return errors_;
+  }
+
+ private:
+  const BenchOptions& opts_;
+  const std::vector<std::string>& keys_;
+  const folly::IOBuf& value_;
+  McrouterClient::Pointer client_;
+  std::mt19937_64 rng_;
+  KeyPicker keyPicker_;
+  std::uniform_real_distribution<double> opPicker_{0, 1};
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  size_t outstanding_{0};
+
+  LatencyHistogram latencies_;
+  std::atomic<uint64_t> errors_{0};
+
+  void acquireSlot() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this]() { return outstanding_ < opts_.concurrency; });
+    ++outstanding_;
+  }
+
+  void waitForReplies() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this]() { return outstanding_ == 0; });
+  }
+
+  void sendRandom(Clock::time_point start) {
+    auto& key = keys_[keyPicker_.pick(rng_)];
+    auto op = opPicker_(rng_) < opts_.getRatio ? mc_op_get : mc_op_set;
+    send(key, op, start, /* record */ true);
+  }
+
+  void send(const std::string& key, mc_op_t op, Clock::time_point start,
+            bool record) {
+    McRequest req(key);
+    if (op == mc_op_set) {
+      folly::IOBuf value;
+      value_.cloneInto(value);
+      req.setValue(std::move(value));
+    }
+    if (record) {
+      client_->send(std::move(req), op, ReplyCallback{this, start});
+    } else {
+      client_->send(std::move(req), op, [this](McReply&& reply) {
+        onReply(Clock::time_point(), reply, false);
+      });
+    }
+  }
+};
+
+void ReplyCallback::operator()(McReply&& reply) {
+  thread->onReply(start, reply, true);
+}
+
+std::chrono::microseconds cpuTime() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return std::chrono::seconds(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+    std::chrono::microseconds(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+}
+
+folly::dynamic runBenchmark(const BenchOptions& opts) {
+  std::vector<std::unique_ptr<MockServer>> servers;
+  for (size_t i = 0; i < opts.numServers; ++i) {
+    servers.push_back(folly::make_unique<MockServer>(opts.serverThreads,
+                                                     opts.serverBehavior));
+  }
+
+  auto routerOpts = defaultTestOptions();
+  routerOpts.config_str = makeConfig(opts, servers);
+  routerOpts.num_proxies = opts.numProxies;
+  routerOpts.asynclog_disable = true;
+  auto router = McrouterInstance::init("proxy_benchmark", routerOpts);
+  if (router == nullptr) {
+    throw std::runtime_error("Can't start mcrouter");
+  }
+
+  std::vector<std::string> keys;
+  keys.reserve(opts.numKeys);
+  for (size_t i = 0; i < opts.numKeys; ++i) {
+    auto key = folly::to<std::string>("bench:", i, ":");
+    key.resize(std::max(opts.keySize, key.size()), 'x');
+    keys.push_back(std::move(key));
+  }
+  folly::IOBuf value(folly::IOBuf::CREATE, opts.valueSize);
+  memset(value.writableTail(), 'v', opts.valueSize);
+  value.append(opts.valueSize);
+
+  std::vector<std::unique_ptr<LoadThread>> loaders;
+  for (size_t i = 0; i < opts.numClients; ++i) {
+    loaders.push_back(
+      folly::make_unique<LoadThread>(*router, opts, keys, value, i));
+  }
+
+  auto runAll = [&loaders](std::function<void(LoadThread&, size_t)> f) {
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < loaders.size(); ++i) {
+      threads.emplace_back([&f, &loaders, i]() { f(*loaders[i], i); });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  };
+
+  auto perLoader = (keys.size() + loaders.size() - 1) / loaders.size();
+  runAll([&keys, perLoader](LoadThread& loader, size_t i) {
+    auto begin = std::min(keys.size(), i * perLoader);
+    loader.prefill(begin, std::min(keys.size(), begin + perLoader));
+  });
+
+  auto cpuStart = cpuTime();
+  auto start = Clock::now();
+  auto end = start + opts.duration;
+  runAll([&opts, end](LoadThread& loader, size_t i) {
+    if (opts.rate > 0) {
+      loader.runOpenLoop(end);
+    } else {
+      loader.runClosedLoop(end);
+    }
+  });
+  auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  auto cpu = cpuTime() - cpuStart;
+
+  LatencyHistogram latencies;
+  uint64_t errors = 0;
+  for (const auto& loader : loaders) {
+    latencies.merge(loader->latencies());
+    errors += loader->errors();
+  }
+  loaders.clear();
+  McrouterInstance::freeAllMcrouters();
+
+  auto requests = latencies.count();
+  return folly::dynamic::object
+    ("mode", opts.rate > 0 ? "open" : "closed")
+    ("requests", static_cast<int64_t>(requests))
+    ("errors", static_cast<int64_t>(errors))
+    ("seconds", elapsed)
+    ("qps", requests / elapsed)
+    ("latency_us", latencies.toDynamic())
+    ("cpu_us_per_request",
+     requests ? static_cast<double>(cpu.count()) / requests : 0.0);
+}
+
+void usage(char** argv) {
+  std::cerr <<
+    "Arguments:\n"
+    "  -s <n>         number of mock servers (1)\n"
+    "  -t <n>         number of threads per mock server (1)\n"
+    "  -l <latency>   latency added by mock servers, [<dist>:]<mean us>,\n"
+    "                 dist is constant, uniform or exponential (0)\n"
+    "  -p <n>         number of proxy threads (1)\n"
+    "  -c <n>         number of client threads (1)\n"
+    "  -n <n>         closed loop: requests in flight per client (16)\n"
+    "  -r <rate>      open loop: requests per second per client\n"
+    "  -d <ms>        duration (5000)\n"
+    "  -k <n>         number of keys (10000)\n"
+    "  -K <bytes>     key size (16)\n"
+    "  -v <bytes>     value size (100)\n"
+    "  -g <ratio>     fraction of gets, the rest are sets (0.9)\n"
+    "  -z <s>         Zipf exponent of key popularity, 0 is uniform (0)\n"
+    "  -P <protocol>  ascii or umbrella (ascii)\n"
+    "  -f <file>      config to use, @SERVERS@ is replaced with\n"
+    "                 the list of mock servers\n"
+    "Usage:\n"
+    "  $ " << argv[0] << " -p 4 -c 4 -n 32 -z 0.99\n";
+  exit(1);
+}
+
+}  // anonymous namespace
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+
+  BenchOptions opts;
+  int c;
+  while ((c = getopt(argc, argv, "s:t:l:p:c:n:r:d:k:K:v:g:z:P:f:h")) >= 0) {
+    switch (c) {
+      case 's':
+        opts.numServers = std::max(1, folly::to<int>(optarg));
+        break;
+      case 't':
+        opts.serverThreads = std::max(1, folly::to<int>(optarg));
+        break;
+      case 'l':
+        opts.serverBehavior.parseLatency(optarg);
+        break;
+      case 'p':
+        opts.numProxies = std::max(1, folly::to<int>(optarg));
+        break;
+      case 'c':
+        opts.numClients = std::max(1, folly::to<int>(optarg));
+        break;
+      case 'n':
+        opts.concurrency = std::max(1, folly::to<int>(optarg));
+        break;
+      case 'r':
+        opts.rate = folly::to<double>(optarg);
+        break;
+      case 'd':
+        opts.duration = std::chrono::milliseconds(folly::to<int>(optarg));
+        break;
+      case 'k':
+        opts.numKeys = std::max(1, folly::to<int>(optarg));
+        break;
+      case 'K':
+        opts.keySize = folly::to<size_t>(optarg);
+        break;
+      case 'v':
+        opts.valueSize = folly::to<size_t>(optarg);
+        break;
+      case 'g':
+        opts.getRatio = folly::to<double>(optarg);
+        break;
+      case 'z':
+        opts.zipf = folly::to<double>(optarg);
+        break;
+      case 'P':
+        opts.protocol = optarg;
+        break;
+      case 'f':
+        opts.configFile = optarg;
+        break;
+      default:
+        usage(argv);
+    }
+  }
+  if (opts.rate < 0 || opts.zipf < 0 || optind != argc) {
+    usage(argv);
+  }
+
+  try {
+    std::cout << folly::toPrettyJson(runBenchmark(opts)) << std::endl;
+  } catch (const std::exception& e) {
+    LOG(ERROR) << e.what();
+    return 1;
+  }
+  return 0;
+}
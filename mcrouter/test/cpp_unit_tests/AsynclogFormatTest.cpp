@@ -0,0 +1,84 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <stdexcept>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/AsynclogFormat.h"
+
+using namespace facebook::memcache::mcrouter;
+
+namespace {
+
+AsynclogRecord makeRecord(const std::string& key) {
+  AsynclogRecord record;
+  record.timestampMs = 1289416829836;
+  record.host = "10.0.0.1";
+  record.port = 11302;
+  record.pool = "pool";
+  record.key = key;
+  return record;
+}
+
+std::string makeBlock(size_t numRecords, const std::string& keyPrefix) {
+  std::string records;
+  for (size_t i = 0; i < numRecords; ++i) {
+    appendAsynclogRecord(makeRecord(keyPrefix + std::to_string(i)), records);
+  }
+  return encodeAsynclogBlock(records);
+}
+
+}  // anonymous namespace
+
+TEST(AsynclogFormat, roundTrip) {
+  auto data = makeBlock(100, "a") + makeBlock(1, "b");
+
+  AsynclogBinaryReader reader(data);
+  AsynclogRecord record;
+  for (size_t i = 0; i < 100; ++i) {
+    ASSERT_TRUE(reader.next(record));
+    EXPECT_EQ("a" + std::to_string(i), record.key);
+    EXPECT_EQ("10.0.0.1", record.host);
+    EXPECT_EQ(11302, record.port);
+    EXPECT_EQ("pool", record.pool);
+    EXPECT_EQ(1289416829836, record.timestampMs);
+    EXPECT_EQ(AsynclogOp::Delete, record.op);
+  }
+  ASSERT_TRUE(reader.next(record));
+  EXPECT_EQ("b0", record.key);
+  EXPECT_FALSE(reader.next(record));
+}
+
+TEST(AsynclogFormat, compresses) {
+  std::string records;
+  for (size_t i = 0; i < 1000; ++i) {
+    appendAsynclogRecord(makeRecord("key:" + std::to_string(i)), records);
+  }
+  EXPECT_LT(encodeAsynclogBlock(records).size(), records.size() / 2);
+}
+
+TEST(AsynclogFormat, corrupted) {
+  auto data = makeBlock(10, "a");
+  data[data.size() - 1] ^= 0xff;
+
+  AsynclogBinaryReader reader(data);
+  AsynclogRecord record;
+  EXPECT_THROW(reader.next(record), std::runtime_error);
+}
+
+TEST(AsynclogFormat, truncated) {
+  auto data = makeBlock(10, "a");
+  data.resize(data.size() - 1);
+
+  AsynclogBinaryReader reader(data);
+  AsynclogRecord record;
+  EXPECT_THROW(reader.next(record), std::runtime_error);
+}
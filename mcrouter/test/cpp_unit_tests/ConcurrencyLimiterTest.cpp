@@ -0,0 +1,75 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+
+#include "mcrouter/ConcurrencyLimiter.h"
+
+using facebook::memcache::mcrouter::ConcurrencyLimiter;
+
+namespace {
+
+void runWindows(ConcurrencyLimiter& limiter, size_t windows,
+                uint64_t latencyUs, size_t inflight) {
+  for (size_t i = 0; i < windows * ConcurrencyLimiter::kWindowSize; ++i) {
+    limiter.onSample(latencyUs, inflight);
+  }
+}
+
+}  // anonymous namespace
+
+TEST(ConcurrencyLimiter, startsAtMin) {
+  ConcurrencyLimiter limiter(10, 1000);
+  EXPECT_EQ(10, limiter.limit());
+  EXPECT_EQ(0.0, limiter.noLoadLatencyUs());
+}
+
+TEST(ConcurrencyLimiter, growsWhileLatencyIsFlat) {
+  ConcurrencyLimiter limiter(10, 1000);
+  size_t prev = limiter.limit();
+  for (size_t i = 0; i < 50; ++i) {
+    runWindows(limiter, 1, 100, limiter.limit());
+    EXPECT_GE(limiter.limit(), prev);
+    prev = limiter.limit();
+  }
+  EXPECT_GT(limiter.limit(), 10);
+  EXPECT_EQ(100.0, limiter.noLoadLatencyUs());
+
+  runWindows(limiter, 2000, 100, 1000);
+  EXPECT_EQ(1000, limiter.limit());
+}
+
+TEST(ConcurrencyLimiter, shrinksWhenLatencyGrows) {
+  ConcurrencyLimiter limiter(10, 1000);
+  runWindows(limiter, 100, 100, 1000);
+  auto grown = limiter.limit();
+  EXPECT_GT(grown, 100);
+
+  runWindows(limiter, 20, 400, 1000);
+  EXPECT_LT(limiter.limit(), grown / 2);
+  EXPECT_GE(limiter.limit(), 10);
+
+  runWindows(limiter, 200, 1000, 1000);
+  EXPECT_EQ(10, limiter.limit());
+}
+
+TEST(ConcurrencyLimiter, doesNotGrowWhenIdle) {
+  ConcurrencyLimiter limiter(10, 1000);
+  runWindows(limiter, 500, 100, 20);
+  EXPECT_LE(limiter.limit(), 40);
+}
+
+TEST(ConcurrencyLimiter, relearnsNoLoadLatency) {
+  ConcurrencyLimiter limiter(10, 1000);
+  runWindows(limiter, 1, 100, 10);
+  EXPECT_EQ(100.0, limiter.noLoadLatencyUs());
+  // permanent latency change, picked up after a reset period
+  runWindows(limiter, ConcurrencyLimiter::kNoLoadResetWindows, 300, 10);
+  EXPECT_EQ(300.0, limiter.noLoadLatencyUs());
+}
@@ -0,0 +1,78 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include <folly/dynamic.h>
+
+#include "mcrouter/ConfigSnapshot.h"
+
+using facebook::memcache::mcrouter::dynamicFromBinary;
+using facebook::memcache::mcrouter::dynamicToBinary;
+
+namespace {
+
+folly::dynamic roundTrip(const folly::dynamic& json) {
+  auto binary = dynamicToBinary(json);
+  return dynamicFromBinary(folly::ByteRange(folly::StringPiece(binary)));
+}
+
+}  // anonymous namespace
+
+TEST(ConfigSnapshot, scalars) {
+  EXPECT_TRUE(roundTrip(nullptr).isNull());
+  EXPECT_TRUE(roundTrip(true).getBool());
+  EXPECT_FALSE(roundTrip(false).getBool());
+  EXPECT_EQ(-5, roundTrip(-5).getInt());
+  EXPECT_EQ(std::numeric_limits<int64_t>::max(),
+            roundTrip(std::numeric_limits<int64_t>::max()).getInt());
+  EXPECT_TRUE(roundTrip(1.0).isDouble());
+  EXPECT_EQ(0.25, roundTrip(0.25).getDouble());
+  EXPECT_EQ("", roundTrip("").getString());
+  EXPECT_EQ(std::string(1000, 'x'),
+            roundTrip(std::string(1000, 'x')).getString());
+}
+
+TEST(ConfigSnapshot, nested) {
+  folly::dynamic json = folly::dynamic::object
+    ("pools", folly::dynamic::object
+      ("A", folly::dynamic::object
+        ("servers", { "localhost:1", "localhost:2" })
+        ("weights", { 0.5, 1 })))
+    ("route", "PoolRoute|A")
+    ("empty", folly::dynamic::object)
+    ("list", {});
+
+  EXPECT_TRUE(json == roundTrip(json));
+}
+
+TEST(ConfigSnapshot, invalid) {
+  auto binary = dynamicToBinary(
+    folly::dynamic::object("key", { "a", "b", "c" }));
+
+  // every truncation is detected
+  for (size_t i = 0; i < binary.size(); ++i) {
+    auto data = folly::ByteRange(folly::StringPiece(binary.data(), i));
+    EXPECT_THROW(dynamicFromBinary(data), std::runtime_error);
+  }
+
+  auto trailing = binary + "x";
+  EXPECT_THROW(dynamicFromBinary(
+                 folly::ByteRange(folly::StringPiece(trailing))),
+               std::runtime_error);
+
+  std::string unknownTag("\xff", 1);
+  EXPECT_THROW(dynamicFromBinary(
+                 folly::ByteRange(folly::StringPiece(unknownTag))),
+               std::runtime_error);
+}
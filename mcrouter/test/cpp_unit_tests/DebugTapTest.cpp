@@ -0,0 +1,114 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/DebugTap.h"
+
+using namespace facebook::memcache::mcrouter;
+
+namespace {
+
+void push(DebugTapRing& ring, const std::string& key) {
+  ring.push(mc_op_get, key, mc_res_found, "127.0.0.1:11211", 10, 100, 150);
+}
+
+}  // anonymous namespace
+
+TEST(DebugTap, parseFilter) {
+  auto filter = DebugTapFilter::parse(
+    "key_prefix=/a/b/foo destination=pool sample=10\n");
+  EXPECT_EQ("/a/b/foo", filter.keyPrefix);
+  EXPECT_EQ("pool", filter.destination);
+  EXPECT_EQ(10, filter.samplePeriod);
+
+  EXPECT_TRUE(filter.matchesKey("/a/b/foobar"));
+  EXPECT_FALSE(filter.matchesKey("/a/b/bar"));
+  EXPECT_TRUE(filter.matchesDestination("pool", "127.0.0.1:11211"));
+  EXPECT_FALSE(filter.matchesDestination("pool2", "127.0.0.1:11211"));
+
+  auto all = DebugTapFilter::parse("");
+  EXPECT_TRUE(all.matchesKey("anything"));
+  EXPECT_TRUE(all.matchesDestination("pool2", "127.0.0.1:11211"));
+  EXPECT_EQ(1, all.samplePeriod);
+
+  auto host = DebugTapFilter::parse("destination=127.0.0.1");
+  EXPECT_TRUE(host.matchesDestination("pool2", "127.0.0.1:11211"));
+
+  EXPECT_THROW(DebugTapFilter::parse("foo=bar"), std::invalid_argument);
+  EXPECT_THROW(DebugTapFilter::parse("sample=0"), std::invalid_argument);
+  EXPECT_THROW(DebugTapFilter::parse("key_prefix"), std::invalid_argument);
+}
+
+TEST(DebugTap, ring) {
+  DebugTapRing ring;
+  EXPECT_FALSE(ring.active());
+  EXPECT_EQ(nullptr, ring.filter());
+
+  ring.attach(std::make_shared<DebugTapFilter>(DebugTapFilter::parse("")));
+  EXPECT_TRUE(ring.active());
+  ASSERT_NE(nullptr, ring.filter());
+
+  push(ring, "key1");
+  push(ring, std::string(300, 'k'));
+
+  DebugTapEntry entry;
+  ASSERT_TRUE(ring.pop(entry));
+  EXPECT_EQ(mc_op_get, entry.op);
+  EXPECT_EQ(mc_res_found, entry.result);
+  EXPECT_EQ("key1", entry.keyPiece());
+  EXPECT_EQ("127.0.0.1:11211", entry.destinationPiece());
+  EXPECT_EQ(10, entry.valueSize);
+  EXPECT_EQ(150, entry.timeUs);
+  EXPECT_EQ(50, entry.latencyUs);
+  ASSERT_TRUE(ring.pop(entry));
+  EXPECT_EQ(DebugTapEntry::kMaxKeySize, entry.keyPiece().size());
+  EXPECT_FALSE(ring.pop(entry));
+
+  ring.detach();
+  EXPECT_FALSE(ring.active());
+  EXPECT_EQ(nullptr, ring.filter());
+}
+
+TEST(DebugTap, ringFull) {
+  DebugTapRing ring;
+  ring.attach(std::make_shared<DebugTapFilter>());
+  for (size_t i = 0; i < DebugTapRing::kNumEntries + 5; ++i) {
+    push(ring, "key" + std::to_string(i));
+  }
+  EXPECT_EQ(5, ring.dropped());
+
+  DebugTapEntry entry;
+  size_t popped = 0;
+  while (ring.pop(entry)) {
+    EXPECT_EQ("key" + std::to_string(popped), entry.keyPiece());
+    ++popped;
+  }
+  EXPECT_EQ(DebugTapRing::kNumEntries, popped);
+
+  /* A new client doesn't see what the previous one left */
+  push(ring, "old");
+  ring.attach(std::make_shared<DebugTapFilter>());
+  EXPECT_FALSE(ring.pop(entry));
+}
+
+TEST(DebugTap, sample) {
+  DebugTapRing ring;
+  size_t sampled = 0;
+  for (size_t i = 0; i < 30; ++i) {
+    if (ring.sample(10)) {
+      ++sampled;
+    }
+  }
+  EXPECT_EQ(3, sampled);
+}
@@ -0,0 +1,72 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+
+#include "mcrouter/DecayingHistogram.h"
+#include "mcrouter/LatencyHistogram.h"
+
+using facebook::memcache::mcrouter::DecayingHistogram;
+using facebook::memcache::mcrouter::LatencyHistogram;
+
+TEST(DecayingHistogram, empty) {
+  DecayingHistogram h(64);
+  EXPECT_FALSE(h.hasValue());
+  EXPECT_EQ(0.0, h.value());
+  EXPECT_EQ(0, h.percentile(99));
+}
+
+TEST(DecayingHistogram, firstSample) {
+  DecayingHistogram h(64);
+  h.insertSample(100);
+  EXPECT_TRUE(h.hasValue());
+  EXPECT_DOUBLE_EQ(100.0, h.value());
+  EXPECT_EQ(LatencyHistogram::bucketUpperBound(
+              LatencyHistogram::bucketIndex(100)),
+            h.percentile(50));
+}
+
+TEST(DecayingHistogram, percentiles) {
+  DecayingHistogram h(1000);
+  for (int v = 1; v <= 1000; ++v) {
+    h.insertSample(v);
+  }
+  EXPECT_DOUBLE_EQ(500.5, h.value());
+  auto p99 = h.percentile(99);
+  EXPECT_LE(990, p99);
+  EXPECT_LE(p99, 990 + 990 / LatencyHistogram::kSubBuckets);
+  EXPECT_EQ(1, h.percentile(0));
+}
+
+TEST(DecayingHistogram, spike) {
+  DecayingHistogram h(100);
+  for (int i = 0; i < 1000; ++i) {
+    h.insertSample(100);
+  }
+  EXPECT_GE(200, h.percentile(99));
+  // a few slow samples are in p99 right away
+  for (int i = 0; i < 10; ++i) {
+    h.insertSample(10000);
+  }
+  EXPECT_LE(10000, h.percentile(99));
+  EXPECT_GE(2000.0, h.value());
+}
+
+TEST(DecayingHistogram, decay) {
+  DecayingHistogram h(100);
+  for (int i = 0; i < 150; ++i) {
+    h.insertSample(10000);
+  }
+  for (int i = 0; i < 1000; ++i) {
+    h.insertSample(100);
+  }
+  // old samples faded out
+  EXPECT_GE(200, h.percentile(99.9));
+  EXPECT_GE(200.0, h.value());
+}
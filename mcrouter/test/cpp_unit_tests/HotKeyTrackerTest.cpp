@@ -0,0 +1,106 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <folly/Conv.h>
+
+#include "mcrouter/HotKeyTracker.h"
+
+using facebook::memcache::mcrouter::HotKeyTracker;
+
+TEST(HotKeyTracker, disabled) {
+  HotKeyTracker tracker(8, 0);
+  EXPECT_FALSE(tracker.enabled());
+  for (int i = 0; i < 1000; ++i) {
+    tracker.record("key");
+  }
+  EXPECT_TRUE(tracker.top().empty());
+}
+
+TEST(HotKeyTracker, sampling) {
+  HotKeyTracker tracker(8, 10);
+  EXPECT_TRUE(tracker.enabled());
+  for (int i = 0; i < 9; ++i) {
+    tracker.record("key");
+  }
+  EXPECT_TRUE(tracker.top().empty());
+
+  tracker.record("key");
+  auto top = tracker.top();
+  ASSERT_EQ(1, top.size());
+  EXPECT_EQ("key", top[0].key);
+  // counts are scaled by the sample period
+  EXPECT_EQ(10, top[0].count);
+  EXPECT_EQ(0, top[0].error);
+}
+
+TEST(HotKeyTracker, heavyHitters) {
+  HotKeyTracker tracker(8, 1);
+  // Two hot keys among many keys seen once
+  for (int i = 0; i < 1000; ++i) {
+    tracker.record("hot1");
+    if (i % 2 == 0) {
+      tracker.record("hot2");
+    }
+    tracker.record(folly::to<std::string>("cold", i));
+  }
+
+  auto top = tracker.top();
+  ASSERT_EQ(8, top.size());
+  EXPECT_EQ("hot1", top[0].key);
+  EXPECT_EQ("hot2", top[1].key);
+  for (const auto& entry : top) {
+    EXPECT_LE(entry.error, entry.count);
+  }
+  // never below the real count
+  EXPECT_GE(top[0].count, 1000);
+  EXPECT_GE(top[1].count, 500);
+}
+
+TEST(HotKeyTracker, decay) {
+  HotKeyTracker tracker(4, 1);
+  for (uint64_t i = 0; i < HotKeyTracker::kDecaySamples - 1; ++i) {
+    tracker.record("old");
+  }
+  auto top = tracker.top();
+  ASSERT_EQ(1, top.size());
+  EXPECT_EQ(HotKeyTracker::kDecaySamples - 1, top[0].count);
+
+  // The next sample halves all counts
+  tracker.record("new");
+  top = tracker.top();
+  ASSERT_EQ(2, top.size());
+  EXPECT_EQ("old", top[0].key);
+  EXPECT_EQ((HotKeyTracker::kDecaySamples - 1) / 2, top[0].count);
+  EXPECT_EQ("new", top[1].key);
+  EXPECT_EQ(1, top[1].count);
+}
+
+TEST(HotKeyTracker, merge) {
+  HotKeyTracker a(4, 1);
+  HotKeyTracker b(4, 1);
+  for (int i = 0; i < 10; ++i) {
+    a.record("x");
+    b.record("y");
+    b.record("y");
+  }
+  a.record("y");
+  a.record("z");
+
+  auto merged = HotKeyTracker::merge({a.top(), b.top()}, 2);
+  ASSERT_EQ(2, merged.size());
+  EXPECT_EQ("y", merged[0].key);
+  EXPECT_EQ(21, merged[0].count);
+  EXPECT_EQ("x", merged[1].key);
+  EXPECT_EQ(10, merged[1].count);
+}
@@ -0,0 +1,138 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/HousekeepingExecutor.h"
+
+using facebook::memcache::mcrouter::HousekeepingExecutor;
+
+namespace {
+
+void waitFor(const std::atomic<int>& counter, int value) {
+  for (int i = 0; i < 1000 && counter < value; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+}  // anonymous namespace
+
+TEST(HousekeepingExecutor, periodic) {
+  HousekeepingExecutor::Options opts;
+  HousekeepingExecutor executor(opts);
+  EXPECT_EQ(2, executor.numThreads());
+
+  std::atomic<int> fast{0}, slow{0};
+  auto fastId = executor.schedule(std::chrono::milliseconds(1),
+                                  [&fast]() { ++fast; });
+  auto slowId = executor.schedule(std::chrono::milliseconds(1000),
+                                  [&slow]() { ++slow; });
+  waitFor(fast, 5);
+  EXPECT_LE(5, fast);
+  EXPECT_EQ(0, slow);
+
+  executor.cancel(fastId);
+  executor.cancel(slowId);
+  int cancelled = fast;
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  EXPECT_EQ(cancelled, fast);
+}
+
+TEST(HousekeepingExecutor, once) {
+  HousekeepingExecutor::Options opts;
+  HousekeepingExecutor executor(opts);
+  std::atomic<int> runs{0};
+  executor.schedule(std::chrono::milliseconds(0), [&runs]() { ++runs; },
+                    std::chrono::milliseconds(1));
+  waitFor(runs, 1);
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  EXPECT_EQ(1, runs);
+}
+
+TEST(HousekeepingExecutor, cancelWaits) {
+  HousekeepingExecutor::Options opts;
+  HousekeepingExecutor executor(opts);
+  std::atomic<int> started{0};
+  std::atomic<bool> finished{false};
+  auto id = executor.schedule(
+    std::chrono::milliseconds(1),
+    [&started, &finished]() {
+      ++started;
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      finished = true;
+    },
+    std::chrono::milliseconds(0));
+  waitFor(started, 1);
+  executor.cancel(id);
+  EXPECT_TRUE(finished);
+  EXPECT_EQ(1, started);
+}
+
+TEST(HousekeepingExecutor, cancelFromTask) {
+  HousekeepingExecutor::Options opts;
+  HousekeepingExecutor executor(opts);
+  std::atomic<int> runs{0};
+  HousekeepingExecutor::TaskId id;
+  std::atomic<bool> scheduled{false};
+  id = executor.schedule(
+    std::chrono::milliseconds(1),
+    [&]() {
+      while (!scheduled) {
+        std::this_thread::yield();
+      }
+      ++runs;
+      executor.cancel(id);
+    });
+  scheduled = true;
+  waitFor(runs, 1);
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  EXPECT_EQ(1, runs);
+}
+
+TEST(HousekeepingExecutor, throwingTaskStops) {
+  HousekeepingExecutor::Options opts;
+  HousekeepingExecutor executor(opts);
+  std::atomic<int> runs{0};
+  executor.schedule(std::chrono::milliseconds(1), [&runs]() {
+    ++runs;
+    throw std::runtime_error("test");
+  });
+  waitFor(runs, 1);
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  EXPECT_EQ(1, runs);
+}
+
+TEST(HousekeepingExecutor, shared) {
+  HousekeepingExecutor::Options opts;
+  opts.numThreads = 1;
+  auto executor = HousekeepingExecutor::get(opts);
+  EXPECT_EQ(1, executor->numThreads());
+
+  /* The first caller's options are used */
+  opts.numThreads = 3;
+  EXPECT_EQ(executor, HousekeepingExecutor::get(opts));
+}
+
+TEST(HousekeepingExecutor, parseCpuList) {
+  EXPECT_EQ(std::vector<int>({0, 1, 2, 3, 8}),
+            HousekeepingExecutor::parseCpuList("0-3,8"));
+  EXPECT_EQ(std::vector<int>({5}), HousekeepingExecutor::parseCpuList(" 5 "));
+  EXPECT_THROW(HousekeepingExecutor::parseCpuList("3-1"),
+               std::invalid_argument);
+  EXPECT_THROW(HousekeepingExecutor::parseCpuList("a"),
+               std::invalid_argument);
+  EXPECT_THROW(HousekeepingExecutor::parseCpuList("-1"),
+               std::invalid_argument);
+}
@@ -0,0 +1,312 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <gflags/gflags.h>
+
+#include <folly/Conv.h>
+#include <folly/experimental/fibers/Baton.h>
+#include <folly/experimental/fibers/FiberManager.h>
+#include <folly/io/async/EventBase.h>
+
+#include "mcrouter/config.h"
+#include "mcrouter/lib/McMsgRef.h"
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/network/McClientRequestContext.h"
+#include "mcrouter/McrouterClient.h"
+#include "mcrouter/McrouterInstance.h"
+#include "mcrouter/MemoryUsage.h"
+#include "mcrouter/proxy.h"
+#include "mcrouter/ProxyRequestContext.h"
+
+/**
+ * Cost of concurrency in a proxy: memory per inflight request and time of
+ * the fiber operations every request goes through.
+ *
+ * The inflight benchmark routes --inflight gets through a real proxy_t to
+ * a destination that never replies (a listening socket that never
+ * accepts), waits until they are all queued or written out to it, and
+ * prints the RSS growth per request next to what the MemoryUsage owners
+ * and object sizes account for. Fiber stacks are reserved in full but only
+ * the touched pages count in RSS; McClientRequestContext lives on the
+ * fiber stack of its request. Replies come back (as errors) once the
+ * destination's socket is closed.
+ *
+ * The fiber benchmark times create + run + destroy of an empty task, and a
+ * switch (one fiber suspending and another resuming, through Batons) in
+ * the proxy's own fiberManager, on its thread.
+ *
+ * Run with --fibers_stack_size and --fibers_max_pool_size to compare
+ * fiber settings.
+ */
+
+DEFINE_uint64(inflight, 10000, "Concurrent requests of the inflight benchmark");
+DEFINE_uint64(fiber_iters, 100000, "Iterations of each fiber benchmark");
+DEFINE_uint64(fibers_stack_size, 0,
+              "opts.fibers_stack_size of the proxy, 0 for the default");
+DEFINE_uint64(fibers_max_pool_size, 0,
+              "opts.fibers_max_pool_size of the proxy, 0 for the default");
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+namespace {
+
+uint64_t currentRss() {
+  FILE* statm = fopen("/proc/self/statm", "r");
+  if (statm == nullptr) {
+    return 0;
+  }
+  unsigned long size;
+  unsigned long residentPages;
+  int count = fscanf(statm, "%lu %lu", &size, &residentPages);
+  fclose(statm);
+  if (count != 2) {
+    return 0;
+  }
+  return static_cast<uint64_t>(residentPages) * sysconf(_SC_PAGESIZE);
+}
+
+/**
+ * Listens on a local port and never accepts: connections complete in the
+ * backlog and requests written to them are never read.
+ */
+class StalledServer {
+ public:
+  StalledServer() {
+    fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd_ < 0) {
+      throw std::runtime_error("socket() failed");
+    }
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t len = sizeof(addr);
+    if (::bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        ::listen(fd_, 1024) != 0 ||
+        ::getsockname(fd_, reinterpret_cast<sockaddr*>(&addr), &len) != 0) {
+      ::close(fd_);
+      throw std::runtime_error("bind()/listen() failed");
+    }
+    port_ = ntohs(addr.sin_port);
+  }
+
+  ~StalledServer() {
+    close();
+  }
+
+  uint16_t port() const {
+    return port_;
+  }
+
+  /* Resets the connections waiting in the backlog */
+  void close() {
+    if (fd_ >= 0) {
+      ::close(fd_);
+      fd_ = -1;
+    }
+  }
+
+ private:
+  int fd_{-1};
+  uint16_t port_{0};
+};
+
+struct Sample {
+  uint64_t rss{0};
+  MemoryUsage usage;
+};
+
+Sample takeSample(McrouterInstance& router) {
+  Sample s;
+  s.rss = currentRss();
+  s.usage = MemoryUsage::collect(router);
+  return s;
+}
+
+double perRequest(size_t before, size_t after, size_t n) {
+  return (static_cast<double>(after) - static_cast<double>(before)) / n;
+}
+
+/**
+ * Polls check() on the proxy thread until it returns true.
+ * @return  false if it didn't within timeout.
+ */
+template <class Check>
+bool waitFor(folly::EventBase& evb, Check check,
+             std::chrono::milliseconds timeout) {
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (true) {
+    bool done = false;
+    evb.runInEventBaseThreadAndWait([&]() { done = check(); });
+    if (done) {
+      return true;
+    }
+    if (std::chrono::steady_clock::now() > deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+}
+
+void runInflight(McrouterInstance& router, StalledServer& server) {
+  const size_t n = FLAGS_inflight;
+  auto proxy = router.getProxy(0);
+  auto& evb = *proxy->eventBase;
+  auto client = router.createClient({nullptr, nullptr, nullptr}, nullptr, 0);
+  std::atomic<size_t> replied{0};
+
+  /* Warm up: connect, and let the proxy allocate what it keeps anyway */
+  evb.runInEventBaseThreadAndWait([&]() {
+    auto msg = createMcMsgRef("warmup");
+    msg->op = mc_op_get;
+    client->sendInline(std::move(msg),
+                       [&replied](const McMsgRef&, McReply&&) { ++replied; });
+  });
+  waitFor(evb, [&]() { return proxy->queueDepth() == 1; },
+          std::chrono::seconds(5));
+
+  auto before = takeSample(router);
+  evb.runInEventBaseThreadAndWait([&]() {
+    for (size_t i = 0; i < n; ++i) {
+      auto msg = createMcMsgRef("key:" + folly::to<std::string>(i));
+      msg->op = mc_op_get;
+      client->sendInline(
+        std::move(msg),
+        [&replied](const McMsgRef&, McReply&&) { ++replied; });
+    }
+  });
+  /* Everything queued or written out by the destination client */
+  bool settled = waitFor(evb, [&]() {
+      auto usage = MemoryUsage::collect(router);
+      return proxy->queueDepth() == n + 1 &&
+             usage.clientBuffers.objects == n + 1;
+    }, std::chrono::seconds(30));
+  if (!settled) {
+    printf("inflight requests didn't settle, results are approximate\n");
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  auto after = takeSample(router);
+
+  auto rss = perRequest(before.rss, after.rss, n);
+  auto stacks = perRequest(before.usage.fiberStacks.bytes,
+                           after.usage.fiberStacks.bytes, n);
+  auto fibers = perRequest(before.usage.fiberStacks.objects,
+                           after.usage.fiberStacks.objects, n);
+  auto buffers = perRequest(before.usage.clientBuffers.bytes,
+                            after.usage.clientBuffers.bytes, n);
+  auto waiting = perRequest(before.usage.waitingRequests.bytes,
+                            after.usage.waitingRequests.bytes, n);
+
+  printf("%-40s %14zu\n", "inflight requests", n);
+  printf("%-40s %14.2f\n", "RSS bytes/req", rss);
+  printf("%-40s %14.2f\n", "fibers/req", fibers);
+  printf("%-40s %14.2f\n", "fiber stack bytes/req (reserved)", stacks);
+  printf("%-40s %14zu\n", "sizeof(ProxyRequestContext)",
+         sizeof(ProxyRequestContext));
+  printf("%-40s %14zu\n", "sizeof(McClientRequestContext) (on stack)",
+         sizeof(McClientRequestContext<McOperation<mc_op_get>, McRequest>));
+  printf("%-40s %14.2f\n", "client buffer bytes/req", buffers);
+  printf("%-40s %14.2f\n", "throttled request bytes/req", waiting);
+
+  server.close();
+  if (!waitFor(evb, [&]() { return replied == n + 1; },
+               std::chrono::seconds(30))) {
+    printf("%zu requests didn't get a reply\n", n + 1 - replied);
+  }
+}
+
+void runFibers(proxy_t& proxy) {
+  const size_t iters = FLAGS_fiber_iters;
+  auto& fm = proxy.fiberManager;
+  double createNs = 0;
+  double switchNs = 0;
+
+  proxy.eventBase->runInEventBaseThreadAndWait([&]() {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iters; ++i) {
+      fm.addTask([]() {});
+      fm.loopUntilNoReady();
+    }
+    auto end = std::chrono::steady_clock::now();
+    createNs = std::chrono::duration<double, std::nano>(end - start).count() /
+      iters;
+
+    /* Two fibers handing control to each other */
+    folly::fibers::Baton ping;
+    folly::fibers::Baton pong;
+    fm.addTask([&]() {
+      for (size_t i = 0; i < iters; ++i) {
+        pong.post();
+        ping.wait();
+        ping.reset();
+      }
+    });
+    fm.addTask([&]() {
+      for (size_t i = 0; i < iters; ++i) {
+        pong.wait();
+        pong.reset();
+        ping.post();
+      }
+    });
+    start = std::chrono::steady_clock::now();
+    fm.loopUntilNoReady();
+    end = std::chrono::steady_clock::now();
+    switchNs = std::chrono::duration<double, std::nano>(end - start).count() /
+      (2 * iters);
+  });
+
+  printf("%-40s %14s\n", "proxy fiber manager", "ns/op");
+  printf("%-40s %14.2f\n", "create + run + destroy", createNs);
+  printf("%-40s %14.2f\n", "switch", switchNs);
+}
+
+}  // anonymous namespace
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  StalledServer server;
+  auto opts = defaultTestOptions();
+  opts.config_str = folly::to<std::string>(
+    R"({"pools": {"A": {"servers": ["127.0.0.1:)", server.port(),
+    R"("]}}, "route": "PoolRoute|A"})");
+  /* Nothing should time out while we measure */
+  opts.server_timeout_ms = 600000;
+  opts.proxy_max_inflight_requests = 0;
+  if (FLAGS_fibers_stack_size > 0) {
+    opts.fibers_stack_size = FLAGS_fibers_stack_size;
+  }
+  if (FLAGS_fibers_max_pool_size > 0) {
+    opts.fibers_max_pool_size = FLAGS_fibers_max_pool_size;
+  }
+
+  auto router = McrouterInstance::init("inflight_benchmark", opts);
+  if (router == nullptr) {
+    fprintf(stderr, "Couldn't start mcrouter\n");
+    return 1;
+  }
+  runFibers(*router->getProxy(0));
+  runInflight(*router, server);
+  McrouterInstance::freeAllMcrouters();
+  return 0;
+}
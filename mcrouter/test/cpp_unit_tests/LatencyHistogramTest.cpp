@@ -0,0 +1,155 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/LatencyHistogram.h"
+
+using facebook::memcache::mcrouter::LatencyHistogram;
+using facebook::memcache::mcrouter::LatencyHistogramMap;
+
+TEST(LatencyHistogram, empty) {
+  LatencyHistogram h;
+  EXPECT_EQ(0, h.count());
+  EXPECT_EQ(0, h.max());
+  EXPECT_EQ(0.0, h.mean());
+  EXPECT_EQ(0, h.percentile(50));
+  EXPECT_EQ(0, h.percentile(99.9));
+}
+
+TEST(LatencyHistogram, buckets) {
+  uint64_t prevBound = 0;
+  for (uint64_t v = 0; v < (1 << 16); ++v) {
+    auto idx = LatencyHistogram::bucketIndex(v);
+    ASSERT_LT(idx, LatencyHistogram::kNumBuckets);
+    auto bound = LatencyHistogram::bucketUpperBound(idx);
+    // v is inside its bucket and buckets are increasing
+    EXPECT_LE(v, bound);
+    EXPECT_LE(prevBound, bound);
+    prevBound = bound;
+    // relative error is bounded
+    EXPECT_LE(bound - v, v / LatencyHistogram::kSubBuckets);
+  }
+  EXPECT_EQ(LatencyHistogram::kNumBuckets - 1,
+            LatencyHistogram::bucketIndex(LatencyHistogram::kMaxValue));
+  EXPECT_EQ(LatencyHistogram::kNumBuckets - 1,
+            LatencyHistogram::bucketIndex(-1));
+  EXPECT_EQ(LatencyHistogram::kMaxValue,
+            LatencyHistogram::bucketUpperBound(LatencyHistogram::kNumBuckets -
+                                               1));
+}
+
+TEST(LatencyHistogram, percentiles) {
+  LatencyHistogram h;
+  for (uint64_t v = 1; v <= 10000; ++v) {
+    h.record(v);
+  }
+  EXPECT_EQ(10000, h.count());
+  EXPECT_EQ(10000, h.max());
+  EXPECT_DOUBLE_EQ(5000.5, h.mean());
+
+  auto checkPercentile = [&h](double p, uint64_t expected) {
+    auto value = h.percentile(p);
+    EXPECT_LE(expected, value) << p;
+    EXPECT_LE(value, expected + expected / LatencyHistogram::kSubBuckets) << p;
+  };
+  checkPercentile(50, 5000);
+  checkPercentile(90, 9000);
+  checkPercentile(99, 9900);
+  checkPercentile(99.9, 9990);
+  EXPECT_EQ(10000, h.percentile(100));
+  EXPECT_EQ(1, h.percentile(0));
+}
+
+TEST(LatencyHistogram, merge) {
+  LatencyHistogram a;
+  LatencyHistogram b;
+  LatencyHistogram merged;
+  for (uint64_t v = 0; v < 1000; ++v) {
+    a.record(v);
+    b.record(v * 100);
+  }
+  merged.merge(a);
+  merged.merge(b);
+  EXPECT_EQ(2000, merged.count());
+  EXPECT_EQ(99900, merged.max());
+  EXPECT_DOUBLE_EQ((a.mean() + b.mean()) / 2, merged.mean());
+  // all of a and the smallest values of b
+  EXPECT_EQ(LatencyHistogram::bucketUpperBound(
+              LatencyHistogram::bucketIndex(999)),
+            merged.percentile(50));
+
+  auto d = merged.toDynamic();
+  EXPECT_EQ(2000, d["count"].asInt());
+  EXPECT_EQ(99900, d["max"].asInt());
+  EXPECT_EQ(merged.percentile(99), d["p99"].asInt());
+}
+
+TEST(LatencyHistogram, concurrentRecord) {
+  const int kThreads = 4;
+  const int kPerThread = 10000;
+  LatencyHistogram h;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&h]() {
+      for (int i = 0; i < kPerThread; ++i) {
+        h.record(i);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  EXPECT_EQ(kThreads * kPerThread, h.count());
+  EXPECT_EQ(kPerThread - 1, h.max());
+}
+
+TEST(LatencyHistogramMap, record) {
+  LatencyHistogramMap m;
+  m.record("/a/a/", 10);
+  m.record("/a/a/", 20);
+  m.record("/b/b/", 30);
+  m.record("/a/a/", 40);
+
+  std::map<std::string, uint64_t> counts;
+  m.foreachSynced([&counts](const std::string& name,
+                            const LatencyHistogram& h) {
+    counts[name] = h.count();
+  });
+  EXPECT_EQ(2, counts.size());
+  EXPECT_EQ(3, counts["/a/a/"]);
+  EXPECT_EQ(1, counts["/b/b/"]);
+}
+
+TEST(LatencyHistogramMap, maxNames) {
+  LatencyHistogramMap m;
+  const size_t kNames = LatencyHistogramMap::kMaxNames + 10;
+  for (size_t i = 0; i < kNames; ++i) {
+    m.record("/a/" + std::to_string(i) + "/", i);
+  }
+
+  size_t names = 0;
+  uint64_t total = 0;
+  uint64_t other = 0;
+  m.foreachSynced([&](const std::string& name, const LatencyHistogram& h) {
+    ++names;
+    total += h.count();
+    if (name == LatencyHistogramMap::kOtherName) {
+      other = h.count();
+    }
+  });
+  EXPECT_EQ(LatencyHistogramMap::kMaxNames + 1, names);
+  EXPECT_EQ(kNames, total);
+  EXPECT_EQ(10, other);
+}
@@ -0,0 +1,122 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <chrono>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/fbi/cpp/LogFailure.h"
+
+using namespace facebook::memcache;
+
+namespace {
+
+struct Logged {
+  std::string category;
+  std::string msg;
+  std::thread::id thread;
+};
+
+std::mutex loggedLock;
+std::vector<Logged> logged;
+
+void installHandler() {
+  failure::setHandler(std::make_pair<std::string, failure::HandlerFunc>(
+    "LogFailureTest",
+    [](folly::StringPiece service,
+       folly::StringPiece category,
+       folly::StringPiece msg,
+       const std::map<std::string, std::string>& contexts) {
+      if (service != "LogFailureTest") {
+        return;
+      }
+      std::lock_guard<std::mutex> lock(loggedLock);
+      logged.push_back({category.str(), msg.str(),
+                        std::this_thread::get_id()});
+    }));
+  std::lock_guard<std::mutex> lock(loggedLock);
+  logged.clear();
+}
+
+std::vector<Logged> getLogged() {
+  std::lock_guard<std::mutex> lock(loggedLock);
+  return logged;
+}
+
+}  // anonymous namespace
+
+TEST(LogFailure, rateLimit) {
+  installHandler();
+  failure::Options opts;
+  opts.maxPerSecond = 3;
+  failure::setOptions(opts);
+
+  /* All within one second */
+  time_t start;
+  do {
+    start = time(nullptr);
+    installHandler();
+    for (int i = 0; i < 10; ++i) {
+      failure::log("LogFailureTest", "cat-a", "failure {}", i);
+    }
+    failure::log("LogFailureTest", "cat-b", "other category");
+  } while (time(nullptr) != start);
+
+  auto before = failure::getStats();
+  auto seen = getLogged();
+  ASSERT_EQ(4, seen.size());
+  EXPECT_EQ("failure 0", seen[0].msg);
+  EXPECT_EQ("failure 2", seen[2].msg);
+  EXPECT_EQ("cat-b", seen[3].category);
+
+  while (time(nullptr) == start) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  failure::log("LogFailureTest", "cat-a", "next second");
+  seen = getLogged();
+  ASSERT_EQ(5, seen.size());
+  EXPECT_EQ("next second (7 similar failures suppressed)", seen[4].msg);
+  EXPECT_EQ(before.logged + 1, failure::getStats().logged);
+
+  failure::setOptions(failure::Options());
+}
+
+TEST(LogFailure, queued) {
+  installHandler();
+  failure::Options opts;
+  opts.queueSize = 16;
+  failure::setOptions(opts);
+
+  for (int i = 0; i < 5; ++i) {
+    failure::log("LogFailureTest", "cat-a", "failure {}", i);
+  }
+  failure::flush();
+
+  auto seen = getLogged();
+  ASSERT_EQ(5, seen.size());
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_EQ("failure " + std::to_string(i), seen[i].msg);
+    /* Handled by the logging thread */
+    EXPECT_NE(std::this_thread::get_id(), seen[i].thread);
+  }
+
+  /* Back to synchronous, the queue is drained first */
+  failure::log("LogFailureTest", "cat-a", "last queued");
+  failure::setOptions(failure::Options());
+  failure::log("LogFailureTest", "cat-a", "synchronous");
+  seen = getLogged();
+  ASSERT_EQ(7, seen.size());
+  EXPECT_EQ("last queued", seen[5].msg);
+  EXPECT_EQ(std::this_thread::get_id(), seen[6].thread);
+}
@@ -0,0 +1,81 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <map>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/PoolStats.h"
+
+using namespace facebook::memcache::mcrouter;
+
+TEST(PoolStats, ids) {
+  auto a = PoolStats::idFor("PoolStatsTest.a");
+  auto b = PoolStats::idFor("PoolStatsTest.b");
+  EXPECT_NE(a, b);
+  EXPECT_EQ(a, PoolStats::idFor("PoolStatsTest.a"));
+  EXPECT_EQ("PoolStatsTest.a", PoolStats::nameOf(a));
+  EXPECT_EQ("PoolStatsTest.b", PoolStats::nameOf(b));
+  EXPECT_EQ(PoolStats::kOtherName, PoolStats::nameOf(PoolStats::kMaxPools));
+}
+
+TEST(PoolStats, counters) {
+  auto a = PoolStats::idFor("PoolStatsTest.a");
+  auto b = PoolStats::idFor("PoolStatsTest.b");
+
+  PoolStats stats;
+  stats.onReply(a, mc_res_found, 100, 10, 1000);
+  stats.onReply(a, mc_res_notfound, 300, 20, 0);
+  stats.onRefused(a, mc_res_tko);
+  stats.onRefused(b, mc_res_busy);
+
+  std::map<uint32_t, const PoolStatsEntry*> entries;
+  stats.foreach([&entries](uint32_t id, const PoolStatsEntry& entry) {
+    entries[id] = &entry;
+  });
+  ASSERT_EQ(2, entries.size());
+
+  const auto& entryA = *entries[a];
+  EXPECT_EQ(2, entryA.replies.load());
+  EXPECT_EQ(1, entryA.refused.load());
+  EXPECT_EQ(1, entryA.results[mc_res_found].load());
+  EXPECT_EQ(1, entryA.results[mc_res_notfound].load());
+  EXPECT_EQ(1, entryA.results[mc_res_tko].load());
+  EXPECT_EQ(2, entryA.latency.count());
+  EXPECT_EQ(300, entryA.latency.max());
+  EXPECT_EQ(2, entryA.sizes.keySize.count());
+  EXPECT_EQ(20, entryA.sizes.keySize.max());
+  EXPECT_EQ(1000, entryA.sizes.valueSize.max());
+
+  const auto& entryB = *entries[b];
+  EXPECT_EQ(0, entryB.replies.load());
+  EXPECT_EQ(1, entryB.refused.load());
+  EXPECT_EQ(0, entryB.latency.count());
+  EXPECT_EQ(0, entryB.sizes.keySize.count());
+}
+
+TEST(OpSizeStats, byOperation) {
+  OpSizeStats stats;
+  stats.record(mc_op_get, 10, 100);
+  stats.record(mc_op_get, 30, 5000);
+  stats.record(mc_op_set, 20, 200);
+
+  std::map<mc_op_t, const SizeHistograms*> entries;
+  stats.foreach([&entries](mc_op_t op, const SizeHistograms& sizes) {
+    entries[op] = &sizes;
+  });
+  ASSERT_EQ(2, entries.size());
+
+  const auto& get = *entries[mc_op_get];
+  EXPECT_EQ(2, get.keySize.count());
+  EXPECT_EQ(30, get.keySize.max());
+  EXPECT_EQ(5000, get.valueSize.max());
+  EXPECT_EQ(1, entries[mc_op_set]->valueSize.count());
+}
@@ -0,0 +1,179 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/config.h"
+#include "mcrouter/proxy.h"
+#include "mcrouter/stats.h"
+#include "mcrouter/test/cpp_unit_tests/ProxyTestHarness.h"
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+using facebook::memcache::test::ProxyTestHarness;
+
+namespace {
+
+McrouterOptions stealOptions() {
+  auto opts = defaultTestOptions();
+  opts.num_proxies = 2;
+  opts.proxy_max_inflight_requests = 1;
+  opts.proxy_steal_threshold = 1;
+  return opts;
+}
+
+uint64_t numStolen(proxy_t& proxy) {
+  return stat_get_uint64(proxy.stats, proxy_reqs_stolen_stat);
+}
+
+size_t numRepliesTo(const ProxyTestHarness& harness, const std::string& key) {
+  const auto& replies = harness.replies();
+  return std::count_if(replies.begin(), replies.end(),
+                       [&key](const ProxyTestHarness::Reply& reply) {
+                         return reply.key == key;
+                       });
+}
+
+/**
+ * "a" routes on proxy 0, "b" and "c" wait there: "b" goes over the
+ * threshold and is handed over to proxy 1 (unless it can't be).
+ */
+void sendThree(ProxyTestHarness& harness) {
+  harness.send(0, "a");
+  harness.send(0, "b");
+  harness.send(0, "c");
+}
+
+}  // anonymous namespace
+
+TEST(ProxySteal, handOver) {
+  ProxyTestHarness harness(stealOptions());
+  auto& proxy0 = harness.proxy(0);
+  auto& proxy1 = harness.proxy(1);
+
+  sendThree(harness);
+  ASSERT_TRUE(harness.loopUntil([&]() { return numStolen(proxy1) == 1; }));
+  EXPECT_EQ(0, numStolen(proxy0));
+  /* "a" routing, "c" waiting */
+  EXPECT_EQ(2, proxy0.queueDepth());
+  EXPECT_EQ(1, proxy1.queueDepth());
+
+  harness.releaseDestination();
+  ASSERT_TRUE(harness.loopUntil([&]() {
+    return harness.replies().size() == 3;
+  }));
+  auto keys = harness.replyKeys();
+  std::sort(keys.begin(), keys.end());
+  EXPECT_EQ(std::vector<std::string>({"a", "b", "c"}), keys);
+  /* Including the one proxy 1 routed */
+  for (const auto& reply : harness.replies()) {
+    EXPECT_EQ(&proxy0, reply.proxy);
+  }
+}
+
+TEST(ProxySteal, siblingQueueFull) {
+  auto opts = stealOptions();
+  opts.client_queue_size = 1;
+  ProxyTestHarness harness(opts);
+  auto& proxy0 = harness.proxy(0);
+  auto& proxy1 = harness.proxy(1);
+
+  /* Nothing in proxy 1's queue fits until it runs */
+  ASSERT_TRUE(proxy1.trySendMessage(request_type_router_shutdown, nullptr));
+  EXPECT_FALSE(proxy1.trySendMessage(request_type_router_shutdown, nullptr));
+
+  /* Kept here instead of blocking on proxy 1 */
+  sendThree(harness);
+  EXPECT_EQ(3, proxy0.queueDepth());
+
+  harness.loopFor(std::chrono::milliseconds(50));
+  EXPECT_EQ(0, numStolen(proxy1));
+  EXPECT_EQ(3, proxy0.queueDepth());
+
+  /* Proxy 1's queue was drained, the next request over the threshold
+     hands "b" over */
+  harness.send(0, "d");
+  ASSERT_TRUE(harness.loopUntil([&]() { return numStolen(proxy1) == 1; }));
+  EXPECT_EQ(3, proxy0.queueDepth());
+
+  harness.releaseDestination();
+  ASSERT_TRUE(harness.loopUntil([&]() {
+    return harness.replies().size() == 4;
+  }));
+  EXPECT_EQ(1, numRepliesTo(harness, "b"));
+}
+
+TEST(ProxySteal, replyQueueFull) {
+  auto opts = stealOptions();
+  opts.client_queue_size = 1;
+  ProxyTestHarness harness(opts);
+  auto& proxy0 = harness.proxy(0);
+  auto& proxy1 = harness.proxy(1);
+
+  sendThree(harness);
+  ASSERT_TRUE(harness.loopUntil([&]() { return numStolen(proxy1) == 1; }));
+
+  /* Proxy 0 doesn't run, its queue stays full */
+  ASSERT_TRUE(proxy0.trySendMessage(request_type_router_shutdown, nullptr));
+  harness.releaseDestination();
+  while (proxy1.queueDepth() > 0) {
+    harness.eventBase(1).loopOnce(EVLOOP_NONBLOCK);
+  }
+  /* Proxy 1 routed "b" without blocking on proxy 0 */
+  for (int i = 0; i < 100; ++i) {
+    harness.eventBase(1).loopOnce(EVLOOP_NONBLOCK);
+  }
+  EXPECT_TRUE(harness.replies().empty());
+
+  /* Retried once proxy 0 made room */
+  ASSERT_TRUE(harness.loopUntil([&]() {
+    return harness.replies().size() == 3;
+  }));
+  EXPECT_EQ(1, numRepliesTo(harness, "b"));
+  EXPECT_FALSE(proxy0.finishStolenRequests());
+  EXPECT_FALSE(proxy1.finishStolenRequests());
+}
+
+TEST(ProxySteal, shutdownWithStolenRequests) {
+  ProxyTestHarness harness(stealOptions());
+  auto& proxy0 = harness.proxy(0);
+  auto& proxy1 = harness.proxy(1);
+
+  sendThree(harness);
+  ASSERT_TRUE(harness.loopUntil([&]() { return numStolen(proxy1) == 1; }));
+
+  /* Proxy 1 still routes "b" and has to send its reply */
+  EXPECT_TRUE(proxy1.finishStolenRequests());
+
+  /* ... but takes no new requests: "c" and "d" stay on proxy 0 */
+  harness.send(0, "d");
+  harness.loopFor(std::chrono::milliseconds(50));
+  EXPECT_EQ(1, numStolen(proxy1));
+  EXPECT_EQ(3, proxy0.queueDepth());
+
+  /* Waits for the reply of "b" */
+  EXPECT_TRUE(proxy0.finishStolenRequests());
+
+  harness.releaseDestination();
+  ASSERT_TRUE(harness.loopUntil([&]() {
+    return !proxy0.finishStolenRequests() && !proxy1.finishStolenRequests();
+  }));
+  EXPECT_EQ(1, numRepliesTo(harness, "b"));
+
+  /* Proxies are destroyed with the harness, with nothing in flight
+     between them */
+  ASSERT_TRUE(harness.loopUntil([&]() {
+    return harness.replies().size() == 4;
+  }));
+}
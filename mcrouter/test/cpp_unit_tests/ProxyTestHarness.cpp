@@ -0,0 +1,153 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "ProxyTestHarness.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <thread>
+
+#include <glog/logging.h>
+
+#include <folly/Format.h>
+#include <folly/Memory.h>
+
+#include "mcrouter/config.h"
+#include "mcrouter/lib/McMsgRef.h"
+#include "mcrouter/McrouterInstance.h"
+#include "mcrouter/proxy.h"
+#include "mcrouter/ProxyRequestContext.h"
+
+namespace facebook { namespace memcache { namespace test {
+
+using mcrouter::McrouterInstance;
+using mcrouter::ProxyRequestContext;
+using mcrouter::proxy_t;
+
+namespace {
+
+/* Listens on a local port and never accepts */
+int listenLocal(uint16_t& port) {
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  PCHECK(fd >= 0);
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(addr);
+  PCHECK(::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+  PCHECK(::listen(fd, SOMAXCONN) == 0);
+  PCHECK(::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) == 0);
+  port = ntohs(addr.sin_port);
+  return fd;
+}
+
+}  // anonymous namespace
+
+ProxyTestHarness::ProxyTestHarness(McrouterOptions opts,
+                                   std::chrono::milliseconds serverTimeout) {
+  if (opts.config_str.empty()) {
+    uint16_t port;
+    listenFd_ = listenLocal(port);
+    opts.config_str = folly::sformat(
+      R"({{"pools": {{"stalled": {{"servers": ["127.0.0.1:{}"]}}}},)"
+      R"( "route": "PoolRoute|stalled"}})", port);
+    opts.server_timeout_ms = serverTimeout.count();
+  }
+  opts.enable_failure_logging = false;
+  opts.stats_logging_interval = 0;
+
+  router_ = McrouterInstance::LegacyPrivateAccessor::create(
+    opts, /* spawnProxyThreads= */ false);
+  CHECK(router_ != nullptr);
+  for (size_t i = 0; i < opts.num_proxies; ++i) {
+    eventBases_.push_back(folly::make_unique<folly::EventBase>());
+    router_->getProxy(i)->attachEventBase(eventBases_.back().get());
+  }
+}
+
+ProxyTestHarness::~ProxyTestHarness() {
+  releaseDestination();
+  auto done = [this]() {
+    bool busy = replies_.size() < pending_.size();
+    for (size_t i = 0; i < eventBases_.size(); ++i) {
+      /* Same as the loop of a proxy thread that is shutting down */
+      busy |= proxy(i).fiberManager.hasTasks();
+      busy |= proxy(i).finishStolenRequests();
+    }
+    return !busy;
+  };
+  CHECK(loopUntil(done)) << "requests still inflight";
+  McrouterInstance::LegacyPrivateAccessor::tearDown(*router_);
+}
+
+proxy_t& ProxyTestHarness::proxy(size_t i) {
+  return *router_->getProxy(i);
+}
+
+void ProxyTestHarness::send(size_t i, folly::StringPiece key, mc_op_t op) {
+  pending_.push_back(
+    folly::make_unique<Pending>(Pending{*this, key.str()}));
+  auto msg = createMcMsgRef(key);
+  msg->op = op;
+  auto preq = ProxyRequestContext::create(
+    proxy(i), std::move(msg), &ProxyTestHarness::onReply,
+    pending_.back().get());
+  proxy(i).dispatchRequest(std::move(preq));
+}
+
+void ProxyTestHarness::onReply(ProxyRequestContext& preq) {
+  auto pending = static_cast<Pending*>(
+    ProxyRequestContext::LegacyPrivateAccessor::context(preq));
+  auto& reply = ProxyRequestContext::LegacyPrivateAccessor::reply(preq);
+  pending->harness.replies_.push_back(
+    Reply{pending->key, reply.result(), &preq.proxy()});
+}
+
+void ProxyTestHarness::loopOnce() {
+  for (auto& evb : eventBases_) {
+    evb->loopOnce(EVLOOP_NONBLOCK);
+  }
+}
+
+bool ProxyTestHarness::loopUntil(std::function<bool()> done,
+                                 std::chrono::milliseconds timeout) {
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (!done()) {
+    if (std::chrono::steady_clock::now() >= deadline) {
+      return false;
+    }
+    loopOnce();
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  return true;
+}
+
+void ProxyTestHarness::loopFor(std::chrono::milliseconds duration) {
+  loopUntil([]() { return false; }, duration);
+}
+
+void ProxyTestHarness::releaseDestination() {
+  if (listenFd_ >= 0) {
+    ::close(listenFd_);
+    listenFd_ = -1;
+  }
+}
+
+std::vector<std::string> ProxyTestHarness::replyKeys() const {
+  std::vector<std::string> keys;
+  for (const auto& reply : replies_) {
+    keys.push_back(reply.key);
+  }
+  return keys;
+}
+
+}}}  // facebook::memcache::test
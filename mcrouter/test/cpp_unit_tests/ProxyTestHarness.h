@@ -0,0 +1,122 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <folly/io/async/EventBase.h>
+#include <folly/Range.h>
+
+#include "mcrouter/lib/mc/msg.h"
+#include "mcrouter/options.h"
+
+namespace facebook { namespace memcache {
+
+namespace mcrouter {
+class McrouterInstance;
+class ProxyRequestContext;
+class proxy_t;
+}  // mcrouter
+
+namespace test {
+
+/**
+ * Runs the proxies of a router on event bases looped by the test thread,
+ * one non-blocking iteration at a time, so that tests can see requests
+ * waiting, being handed over and replied to in a deterministic order.
+ *
+ * Unless opts.config_str is set, everything is routed to a destination
+ * that accepts connections but never reads from them: requests sent to it
+ * stay inflight until releaseDestination() (or their timeout), and later
+ * ones fail right away.
+ */
+class ProxyTestHarness {
+ public:
+  struct Reply {
+    std::string key;
+    mc_res_t result;
+    /* Proxy that delivered the reply */
+    mcrouter::proxy_t* proxy;
+  };
+
+  /**
+   * @param serverTimeout  of requests to the default destination, long
+   *                       enough by default that only releaseDestination()
+   *                       ends them.
+   */
+  explicit ProxyTestHarness(McrouterOptions opts,
+                            std::chrono::milliseconds serverTimeout =
+                              std::chrono::milliseconds(60000));
+
+  /* Fails what is still inflight and destroys the router */
+  ~ProxyTestHarness();
+
+  mcrouter::proxy_t& proxy(size_t i);
+
+  mcrouter::McrouterInstance& router() {
+    return *router_;
+  }
+
+  /**
+   * Dispatches a request for key on proxy i, as if a client of the proxy
+   * sent it. Its reply is added to replies() once delivered.
+   */
+  void send(size_t i, folly::StringPiece key, mc_op_t op = mc_op_get);
+
+  /* Event base of proxy i, to run it alone */
+  folly::EventBase& eventBase(size_t i) {
+    return *eventBases_[i];
+  }
+
+  /* Runs one non-blocking iteration of each proxy's event base */
+  void loopOnce();
+
+  /**
+   * Loops until done() returns true.
+   * @return  false if it didn't within timeout.
+   */
+  bool loopUntil(std::function<bool()> done,
+                 std::chrono::milliseconds timeout =
+                   std::chrono::milliseconds(5000));
+
+  /* Loops for a while, for what should not happen */
+  void loopFor(std::chrono::milliseconds duration);
+
+  /* Closes the destination: its requests fail, new ones too */
+  void releaseDestination();
+
+  /* Replies in the order they were delivered */
+  const std::vector<Reply>& replies() const {
+    return replies_;
+  }
+
+  /* Keys of replies(), in order */
+  std::vector<std::string> replyKeys() const;
+
+ private:
+  struct Pending {
+    ProxyTestHarness& harness;
+    std::string key;
+  };
+
+  int listenFd_{-1};
+  std::vector<std::unique_ptr<folly::EventBase>> eventBases_;
+  mcrouter::McrouterInstance* router_{nullptr};
+  std::vector<std::unique_ptr<Pending>> pending_;
+  std::vector<Reply> replies_;
+
+  static void onReply(mcrouter::ProxyRequestContext& preq);
+};
+
+}}}  // facebook::memcache::test
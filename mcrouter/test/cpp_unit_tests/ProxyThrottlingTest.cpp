@@ -0,0 +1,209 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/config.h"
+#include "mcrouter/proxy.h"
+#include "mcrouter/stats.h"
+#include "mcrouter/test/cpp_unit_tests/ProxyTestHarness.h"
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+using facebook::memcache::test::ProxyTestHarness;
+
+namespace {
+
+/* One request routed at a time, keys of any routing prefix routed */
+McrouterOptions throttledOptions(size_t maxInflight = 1) {
+  auto opts = defaultTestOptions();
+  opts.num_proxies = 1;
+  opts.proxy_max_inflight_requests = maxInflight;
+  opts.send_invalid_route_to_default = true;
+  return opts;
+}
+
+uint64_t stat(proxy_t& proxy, stat_name_t name) {
+  return stat_get_uint64(proxy.stats, name);
+}
+
+/* Replied locally, right away: lets a pump() through */
+void sendLocal(ProxyTestHarness& harness) {
+  harness.send(0, "version", mc_op_stats);
+}
+
+size_t position(const std::vector<std::string>& keys,
+                const std::string& key) {
+  return std::find(keys.begin(), keys.end(), key) - keys.begin();
+}
+
+}  // anonymous namespace
+
+TEST(ProxyThrottling, tenantWeights) {
+  auto opts = throttledOptions();
+  opts.proxy_tenant_quotas = "/a/x/:3:0:0,/b/x/:1:0:0";
+  ProxyTestHarness harness(opts);
+
+  /* Routes, the others wait behind it */
+  harness.send(0, "plug");
+  for (int i = 1; i <= 4; ++i) {
+    harness.send(0, "/a/x/" + std::to_string(i));
+    harness.send(0, "/b/x/" + std::to_string(i));
+  }
+  EXPECT_EQ(9, harness.proxy(0).queueDepth());
+
+  /* Each request fails once routed, replies come in routing order */
+  harness.releaseDestination();
+  ASSERT_TRUE(harness.loopUntil([&]() {
+    return harness.replies().size() == 9;
+  }));
+  EXPECT_EQ(std::vector<std::string>({
+              "plug",
+              "/a/x/1", "/b/x/1", "/a/x/2", "/a/x/3",
+              "/a/x/4", "/b/x/2", "/b/x/3", "/b/x/4"}),
+            harness.replyKeys());
+}
+
+TEST(ProxyThrottling, idleTenantDoesNotGetAhead) {
+  auto opts = throttledOptions();
+  opts.proxy_tenant_quotas = "/b/x/:1:0:0,/a/x/:1:0:0";
+  /* Requests end one after another as they time out */
+  ProxyTestHarness harness(opts, std::chrono::milliseconds(50));
+
+  for (int i = 1; i <= 6; ++i) {
+    harness.send(0, "/b/x/" + std::to_string(i));
+  }
+  ASSERT_TRUE(harness.loopUntil([&]() {
+    return harness.replies().size() >= 3;
+  }));
+
+  /* a was idle while b's pass advanced: it starts from the current pass
+     and shares with b instead of going first until it catches up */
+  for (int i = 1; i <= 3; ++i) {
+    harness.send(0, "/a/x/" + std::to_string(i));
+  }
+  ASSERT_TRUE(harness.loopUntil([&]() {
+    return harness.replies().size() == 9;
+  }));
+  auto keys = harness.replyKeys();
+  EXPECT_LT(position(keys, "/b/x/5"), position(keys, "/a/x/3"));
+  EXPECT_LT(position(keys, "/a/x/1"), position(keys, "/b/x/6"));
+}
+
+TEST(ProxyThrottling, tenantMaxInflight) {
+  auto opts = throttledOptions(3);
+  opts.proxy_tenant_quotas = "/a/x/:1:1:0,/b/x/:1:0:0";
+  ProxyTestHarness harness(opts);
+  auto& proxy = harness.proxy(0);
+
+  harness.send(0, "/a/x/1");
+  harness.send(0, "/a/x/2");
+  harness.send(0, "/a/x/3");
+  harness.send(0, "/b/x/1");
+  harness.send(0, "/b/x/2");
+  /* a is at its max_inflight, the others wait behind its queue */
+  EXPECT_EQ(1, stat(proxy, proxy_reqs_processing_stat));
+  EXPECT_EQ(4, stat(proxy, proxy_reqs_waiting_stat));
+
+  /* b's queue drains while a's can't */
+  sendLocal(harness);
+  EXPECT_EQ(3, stat(proxy, proxy_reqs_processing_stat));
+  EXPECT_EQ(2, stat(proxy, proxy_reqs_waiting_stat));
+
+  /* a's next requests are routed as its inflight ones finish */
+  harness.releaseDestination();
+  ASSERT_TRUE(harness.loopUntil([&]() {
+    return harness.replies().size() == 6;
+  }));
+  EXPECT_EQ(0, proxy.queueDepth());
+}
+
+TEST(ProxyThrottling, tenantMaxQueued) {
+  auto opts = throttledOptions();
+  opts.proxy_tenant_quotas = "/a/x/:1:0:2";
+  ProxyTestHarness harness(opts);
+  auto& proxy = harness.proxy(0);
+
+  harness.send(0, "plug");
+  harness.send(0, "/a/x/1");
+  harness.send(0, "/a/x/2");
+  /* Failed right away */
+  harness.send(0, "/a/x/3");
+  ASSERT_EQ(1, harness.replies().size());
+  EXPECT_EQ("/a/x/3", harness.replies()[0].key);
+  EXPECT_EQ(mc_res_local_error, harness.replies()[0].result);
+  EXPECT_EQ(1, stat(proxy, proxy_tenant_reqs_rejected_stat));
+  EXPECT_EQ(3, proxy.queueDepth());
+
+  /* Other routing prefixes aren't limited by it */
+  harness.send(0, "other");
+  EXPECT_EQ(4, proxy.queueDepth());
+
+  harness.releaseDestination();
+  ASSERT_TRUE(harness.loopUntil([&]() {
+    return harness.replies().size() == 5;
+  }));
+  EXPECT_EQ(1, stat(proxy, proxy_tenant_reqs_rejected_stat));
+}
+
+TEST(ProxyThrottling, highPriorityFirst) {
+  auto opts = throttledOptions();
+  opts.proxy_priority_routing_prefixes = "/p/x/,/q/x/";
+  ProxyTestHarness harness(opts);
+
+  harness.send(0, "plug");
+  harness.send(0, "n1");
+  harness.send(0, "/p/x/1");
+  harness.send(0, "n2");
+  harness.send(0, "/q/x/1");
+  harness.send(0, "/p/x/2");
+
+  harness.releaseDestination();
+  ASSERT_TRUE(harness.loopUntil([&]() {
+    return harness.replies().size() == 6;
+  }));
+  /* Queued before the others, still in order among themselves */
+  EXPECT_EQ(std::vector<std::string>({
+              "plug", "/p/x/1", "/q/x/1", "/p/x/2", "n1", "n2"}),
+            harness.replyKeys());
+  EXPECT_EQ(0, stat(harness.proxy(0), proxy_reqs_shed_stat));
+}
+
+TEST(ProxyThrottling, shedOldRequests) {
+  auto opts = throttledOptions();
+  opts.proxy_max_throttled_request_age_ms = 20;
+  ProxyTestHarness harness(opts);
+  auto& proxy = harness.proxy(0);
+
+  harness.send(0, "plug");
+  harness.send(0, "old1");
+  harness.send(0, "old2");
+  harness.loopFor(std::chrono::milliseconds(50));
+  harness.send(0, "new");
+  EXPECT_EQ(3, stat(proxy, proxy_reqs_waiting_stat));
+  EXPECT_EQ(0, stat(proxy, proxy_reqs_shed_stat));
+
+  /* Once plug is done, the old ones are failed instead of routed */
+  harness.releaseDestination();
+  ASSERT_TRUE(harness.loopUntil([&]() {
+    return harness.replies().size() == 4;
+  }));
+  EXPECT_EQ(std::vector<std::string>({"plug", "old1", "old2", "new"}),
+            harness.replyKeys());
+  EXPECT_EQ(mc_res_local_error, harness.replies()[1].result);
+  EXPECT_EQ(mc_res_local_error, harness.replies()[2].result);
+  EXPECT_EQ(2, stat(proxy, proxy_reqs_shed_stat));
+  EXPECT_EQ(0, stat(proxy, proxy_reqs_waiting_stat));
+}
@@ -0,0 +1,58 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+
+#include "mcrouter/RequestPhaseStats.h"
+
+using facebook::memcache::mcrouter::RequestPhase;
+using facebook::memcache::mcrouter::RequestPhaseStats;
+
+TEST(RequestPhaseStats, record) {
+  RequestPhaseStats stats;
+  stats.record(RequestPhase::ROUTE, 100);
+  stats.record(RequestPhase::ROUTE, 200);
+  stats.record(RequestPhase::DESTINATION_RTT, -5);
+
+  EXPECT_EQ(2, stats.histogram(RequestPhase::ROUTE).count());
+  EXPECT_EQ(200, stats.histogram(RequestPhase::ROUTE).max());
+  EXPECT_EQ(0, stats.histogram(RequestPhase::PROXY_QUEUE).count());
+  /* Negative durations are recorded as 0 */
+  EXPECT_EQ(1, stats.histogram(RequestPhase::DESTINATION_RTT).count());
+  EXPECT_EQ(0, stats.histogram(RequestPhase::DESTINATION_RTT).max());
+}
+
+TEST(RequestPhaseStats, merge) {
+  RequestPhaseStats a;
+  RequestPhaseStats b;
+  a.record(RequestPhase::PROXY_QUEUE, 10);
+  b.record(RequestPhase::PROXY_QUEUE, 20);
+  b.record(RequestPhase::THROTTLE_QUEUE, 30);
+
+  RequestPhaseStats merged;
+  merged.merge(a);
+  merged.merge(b);
+  EXPECT_EQ(2, merged.histogram(RequestPhase::PROXY_QUEUE).count());
+  EXPECT_EQ(20, merged.histogram(RequestPhase::PROXY_QUEUE).max());
+  EXPECT_EQ(1, merged.histogram(RequestPhase::THROTTLE_QUEUE).count());
+}
+
+TEST(RequestPhaseStats, toDynamic) {
+  RequestPhaseStats stats;
+  stats.record(RequestPhase::DESTINATION_QUEUE, 7);
+
+  auto result = stats.toDynamic();
+  EXPECT_EQ(RequestPhaseStats::kNumPhases, result.size());
+  for (size_t i = 0; i < RequestPhaseStats::kNumPhases; ++i) {
+    auto name = RequestPhaseStats::phaseName(static_cast<RequestPhase>(i));
+    ASSERT_EQ(1, result.count(name)) << name;
+  }
+  EXPECT_EQ(1, result["destination_queue"]["count"].asInt());
+  EXPECT_EQ(0, result["route"]["count"].asInt());
+}
@@ -0,0 +1,115 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <map>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/RouteCpuProfiler.h"
+
+using namespace facebook::memcache::mcrouter;
+
+namespace {
+
+struct TestHandle {
+  std::string name;
+
+  std::string routeName() const {
+    return name;
+  }
+};
+
+const size_t kStackSize = 1024;
+
+/* Fake frame addresses, fibers' stacks are kStackSize * 16 apart */
+const void* frameOn(size_t fiber, size_t depth) {
+  static char stacks[kStackSize * 16 * 4];
+  return &stacks[fiber * kStackSize * 16 + depth * 64];
+}
+
+std::map<std::string, uint64_t> calls(const RouteCpuProfiler& profiler) {
+  std::map<std::string, uint64_t> result;
+  profiler.foreach([&result](const RouteCpuNode& node) {
+    result[node.path] = node.calls.load();
+  });
+  return result;
+}
+
+}  // anonymous namespace
+
+TEST(RouteCpuProfiler, nested) {
+  TestHandle root{"root"};
+  TestHandle child{"child"};
+  int request;
+
+  RouteCpuProfiler profiler(kStackSize);
+  for (int i = 0; i < 2; ++i) {
+    auto r = profiler.enter(root, &request, frameOn(0, 0));
+    auto c = profiler.enter(child, &request, frameOn(0, 1));
+    profiler.exit(c);
+    profiler.exit(r);
+  }
+
+  auto result = calls(profiler);
+  ASSERT_EQ(2, result.size());
+  EXPECT_EQ(2, result["root"]);
+  EXPECT_EQ(2, result["root/child"]);
+}
+
+TEST(RouteCpuProfiler, fanOut) {
+  TestHandle root{"root"};
+  TestHandle a{"a"};
+  TestHandle b{"b"};
+  TestHandle leaf{"leaf"};
+  int request;
+
+  RouteCpuProfiler profiler(kStackSize);
+  auto r = profiler.enter(root, &request, frameOn(0, 0));
+  /* root waits for two fibers, the first one waits for a reply */
+  auto fa = profiler.enter(a, &request, frameOn(1, 0));
+  auto la = profiler.enter(leaf, &request, frameOn(1, 1));
+  auto wait = profiler.pause();
+  auto fb = profiler.enter(b, &request, frameOn(2, 0));
+  profiler.exit(fb);
+  profiler.resume(wait);
+  profiler.exit(la);
+  profiler.exit(fa);
+  profiler.exit(r);
+
+  auto result = calls(profiler);
+  ASSERT_EQ(4, result.size());
+  EXPECT_EQ(1, result["root"]);
+  EXPECT_EQ(1, result["root/a"]);
+  EXPECT_EQ(1, result["root/a/leaf"]);
+  EXPECT_EQ(1, result["root/b"]);
+}
+
+TEST(RouteCpuProfiler, requests) {
+  TestHandle root{"root"};
+  TestHandle child{"child"};
+  int request1;
+  int request2;
+
+  RouteCpuProfiler profiler(kStackSize);
+  auto r1 = profiler.enter(root, &request1, frameOn(0, 0));
+  auto c1 = profiler.enter(child, &request1, frameOn(0, 1));
+  auto wait = profiler.pause();
+  /* Another request's root is not a child of request1's frames */
+  auto r2 = profiler.enter(root, &request2, frameOn(1, 0));
+  profiler.exit(r2);
+  profiler.resume(wait);
+  profiler.exit(c1);
+  profiler.exit(r1);
+
+  auto result = calls(profiler);
+  ASSERT_EQ(2, result.size());
+  EXPECT_EQ(2, result["root"]);
+  EXPECT_EQ(1, result["root/child"]);
+}
@@ -0,0 +1,48 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+
+#include "mcrouter/ServerCredits.h"
+
+using facebook::memcache::mcrouter::ServerCredits;
+
+TEST(ServerCredits, unlimited) {
+  ServerCredits credits(0);
+  EXPECT_FALSE(credits.update(1000000));
+  EXPECT_FALSE(credits.exhausted());
+}
+
+TEST(ServerCredits, exhaustAndRegrant) {
+  ServerCredits credits(10);
+  EXPECT_FALSE(credits.update(9));
+  EXPECT_FALSE(credits.exhausted());
+
+  EXPECT_TRUE(credits.update(10));
+  EXPECT_TRUE(credits.exhausted());
+  EXPECT_FALSE(credits.update(12));
+
+  /* Granted again only once the proxy drained to half */
+  EXPECT_FALSE(credits.update(9));
+  EXPECT_FALSE(credits.update(6));
+  EXPECT_TRUE(credits.exhausted());
+  EXPECT_TRUE(credits.update(5));
+  EXPECT_FALSE(credits.exhausted());
+
+  EXPECT_FALSE(credits.update(0));
+  EXPECT_TRUE(credits.update(10));
+}
+
+TEST(ServerCredits, single) {
+  ServerCredits credits(1);
+  EXPECT_TRUE(credits.update(1));
+  EXPECT_FALSE(credits.update(1));
+  EXPECT_TRUE(credits.update(0));
+  EXPECT_FALSE(credits.exhausted());
+}
@@ -0,0 +1,188 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <chrono>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/config.h"
+#include "mcrouter/McrouterInstance.h"
+#include "mcrouter/proxy.h"
+#include "mcrouter/ProxyConfig.h"
+#include "mcrouter/ProxyConfigBuilder.h"
+#include "mcrouter/ProxyDestination.h"
+#include "mcrouter/ProxyDestinationMap.h"
+#include "mcrouter/test/cpp_unit_tests/ProxyTestHarness.h"
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+using facebook::memcache::test::ProxyTestHarness;
+
+namespace {
+
+McrouterOptions sharedOptions(size_t maxQps) {
+  auto opts = defaultTestOptions();
+  opts.num_proxies = 2;
+  opts.shared_connection_max_qps = maxQps;
+  return opts;
+}
+
+/* The only destination of the harness' config */
+uint32_t destinationId(proxy_t& proxy) {
+  uint32_t id = 0;
+  proxy.destinationMap->foreachDestinationSynced(
+    [&id](const ProxyDestination& destination) {
+      id = destination.destinationId;
+    });
+  return id;
+}
+
+/* Requests sent through the connections of proxy's destinations */
+size_t outstanding(proxy_t& proxy) {
+  size_t count = 0;
+  proxy.destinationMap->foreachDestinationSynced(
+    [&count](const ProxyDestination& destination) {
+      count += destination.getPendingRequestCount() +
+               destination.getInflightRequestCount();
+    });
+  return count;
+}
+
+/* Replies proxy's destinations got, whichever connection they came from */
+uint64_t numReplies(proxy_t& proxy) {
+  uint64_t count = 0;
+  proxy.destinationMap->foreachDestinationSynced(
+    [&count](const ProxyDestination& destination) {
+      for (auto n : destination.stats().results) {
+        count += n;
+      }
+    });
+  return count;
+}
+
+/* Index of the proxy owning the shared connection */
+size_t ownerIndex(ProxyTestHarness& harness) {
+  return destinationId(harness.proxy(0)) % 2;
+}
+
+}  // anonymous namespace
+
+TEST(SharedConnection, ownerSends) {
+  ProxyTestHarness harness(sharedOptions(1000));
+  auto ownerId = ownerIndex(harness);
+  auto& owner = harness.proxy(ownerId);
+  auto& other = harness.proxy(1 - ownerId);
+
+  harness.send(0, "a");
+  harness.send(1, "b");
+  ASSERT_TRUE(harness.loopUntil([&]() { return outstanding(owner) == 2; }));
+  EXPECT_EQ(0, outstanding(other));
+
+  harness.releaseDestination();
+  ASSERT_TRUE(harness.loopUntil([&]() {
+    return harness.replies().size() == 2;
+  }));
+  /* Each proxy replied to its own client */
+  for (const auto& reply : harness.replies()) {
+    EXPECT_EQ(reply.key == "a" ? &harness.proxy(0) : &harness.proxy(1),
+              reply.proxy);
+  }
+  /* The caller records the reply too */
+  EXPECT_EQ(1, numReplies(other));
+  EXPECT_EQ(2, numReplies(owner));
+}
+
+TEST(SharedConnection, disabled) {
+  ProxyTestHarness harness(sharedOptions(0));
+  harness.send(0, "a");
+  harness.send(1, "b");
+  ASSERT_TRUE(harness.loopUntil([&]() {
+    return outstanding(harness.proxy(0)) == 1 &&
+           outstanding(harness.proxy(1)) == 1;
+  }));
+}
+
+TEST(SharedConnection, hotDestinationSendsLocally) {
+  /* 1 qps: several requests in one window make the destination hot */
+  ProxyTestHarness harness(sharedOptions(1));
+  auto ownerId = ownerIndex(harness);
+  auto& owner = harness.proxy(ownerId);
+  auto& other = harness.proxy(1 - ownerId);
+
+  for (const char* key : {"a", "b", "c"}) {
+    harness.send(1 - ownerId, key);
+  }
+  ASSERT_TRUE(harness.loopUntil([&]() { return outstanding(owner) == 3; }));
+  EXPECT_EQ(0, outstanding(other));
+
+  /* The window ends with 3 requests in it: hot */
+  harness.loopFor(std::chrono::milliseconds(1100));
+  harness.send(1 - ownerId, "d");
+  ASSERT_TRUE(harness.loopUntil([&]() { return outstanding(other) == 1; }));
+  EXPECT_EQ(3, outstanding(owner));
+
+  /* ... and with only "d" in the next one: cold again */
+  harness.loopFor(std::chrono::milliseconds(1100));
+  harness.send(1 - ownerId, "e");
+  ASSERT_TRUE(harness.loopUntil([&]() { return outstanding(owner) == 4; }));
+  EXPECT_EQ(1, outstanding(other));
+}
+
+TEST(SharedConnection, ownerWithoutDestination) {
+  ProxyTestHarness harness(sharedOptions(1000));
+  auto ownerId = ownerIndex(harness);
+  auto& owner = harness.proxy(ownerId);
+  auto& other = harness.proxy(1 - ownerId);
+  auto id = destinationId(owner);
+
+  /* The owner moved on to a config without the destination */
+  {
+    ProxyConfigBuilder builder(
+      owner.opts, &harness.router().configApi(),
+      R"({"pools": {"other": {"servers": ["127.0.0.1:1"]}},)"
+      R"( "route": "PoolRoute|other"})");
+    auto oldConfig = owner.swapConfig(builder.buildConfig(&owner));
+  }
+  ASSERT_EQ(nullptr, owner.destinationMap->find(id));
+
+  harness.send(1 - ownerId, "a");
+  ASSERT_TRUE(harness.loopUntil([&]() { return outstanding(other) == 1; }));
+  EXPECT_EQ(0, outstanding(owner));
+}
+
+TEST(SharedConnection, stalledOwner) {
+  ProxyTestHarness harness(sharedOptions(1000),
+                           std::chrono::milliseconds(100));
+  auto ownerId = ownerIndex(harness);
+  auto& owner = harness.proxy(ownerId);
+  auto& other = harness.proxy(1 - ownerId);
+
+  /* Only the caller runs: it gives up after twice the timeout */
+  harness.send(1 - ownerId, "a");
+  auto start = std::chrono::steady_clock::now();
+  while (harness.replies().empty() &&
+         std::chrono::steady_clock::now() - start <
+           std::chrono::seconds(5)) {
+    harness.eventBase(1 - ownerId).loopOnce(EVLOOP_NONBLOCK);
+  }
+  ASSERT_EQ(1, harness.replies().size());
+  EXPECT_EQ(mc_res_timeout, harness.replies()[0].result);
+  EXPECT_GE(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(200));
+
+  /* Once the owner catches up, it doesn't send the request anymore */
+  ASSERT_TRUE(harness.loopUntil([&]() {
+    return !owner.fiberManager.hasTasks();
+  }));
+  harness.loopFor(std::chrono::milliseconds(50));
+  EXPECT_EQ(0, outstanding(owner));
+  EXPECT_EQ(0, numReplies(owner));
+  EXPECT_EQ(0, outstanding(other));
+}
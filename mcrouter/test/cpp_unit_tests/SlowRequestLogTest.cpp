@@ -0,0 +1,65 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <limits>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/SlowRequestLog.h"
+
+using facebook::memcache::mcrouter::SlowRequestLog;
+
+TEST(SlowRequestLog, disabled) {
+  SlowRequestLog log(0, 16);
+  EXPECT_EQ(std::numeric_limits<int64_t>::max(), log.thresholdUs());
+  SlowRequestLog noEntries(100, 0);
+  EXPECT_EQ(std::numeric_limits<int64_t>::max(), noEntries.thresholdUs());
+  noEntries.record(SlowRequestLog::Entry());
+  EXPECT_TRUE(noEntries.entries().empty());
+}
+
+TEST(SlowRequestLog, ring) {
+  SlowRequestLog log(100, 4);
+  EXPECT_EQ(100, log.thresholdUs());
+  EXPECT_TRUE(log.entries().empty());
+
+  for (int i = 0; i < 10; ++i) {
+    SlowRequestLog::Entry entry;
+    entry.timeUs = i;
+    entry.durationUs = 100 + i;
+    entry.op = mc_op_get;
+    entry.result = mc_res_timeout;
+    log.record(entry);
+  }
+
+  // only the last 4, oldest first
+  auto entries = log.entries();
+  ASSERT_EQ(4, entries.size());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    EXPECT_EQ(6 + i, entries[i].timeUs);
+    EXPECT_EQ(106 + i, entries[i].durationUs);
+  }
+
+  auto d = entries.back().toDynamic();
+  EXPECT_EQ("get", d["op"].asString());
+  EXPECT_EQ("mc_res_timeout", d["result"].asString());
+  EXPECT_EQ(-1, d["queue_us"].asInt());
+}
+
+TEST(SlowRequestLog, truncate) {
+  SlowRequestLog::Entry entry;
+  entry.setDestination("127.0.0.1:5000:TCP:ascii");
+  EXPECT_EQ("127.0.0.1:5000:TCP:ascii", std::string(entry.destination));
+
+  std::string route(SlowRequestLog::kMaxRouteLength * 2, 'a');
+  entry.setRoute(route);
+  EXPECT_EQ(SlowRequestLog::kMaxRouteLength - 1,
+            std::string(entry.route).size());
+}
@@ -0,0 +1,63 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <memory>
+
+#include <gtest/gtest.h>
+
+#include <folly/Memory.h>
+
+#include "mcrouter/lib/network/AccessPoint.h"
+#include "mcrouter/TkoLog.h"
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+namespace {
+
+std::unique_ptr<TkoLog> makeLog(const TkoCounters& counters,
+                                const char* pool, TkoLogEvent event) {
+  auto log = folly::make_unique<TkoLog>(AccessPoint("127.0.0.1", 11211),
+                                        counters);
+  log->event = event;
+  log->poolName = pool;
+  log->result = mc_res_connect_error;
+  return log;
+}
+
+}  // anonymous namespace
+
+TEST(TkoLogQueue, flush) {
+  TkoCounters counters;
+  TkoLogQueue queue(8);
+  EXPECT_EQ(0, queue.flush());
+
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_TRUE(queue.push(nullptr,
+                           makeLog(counters, "A", TkoLogEvent::MarkHardTko)));
+  }
+  EXPECT_TRUE(queue.push(nullptr,
+                         makeLog(counters, "B", TkoLogEvent::UnMarkTko)));
+  EXPECT_EQ(4, queue.flush());
+  EXPECT_EQ(0, queue.flush());
+}
+
+TEST(TkoLogQueue, full) {
+  TkoCounters counters;
+  TkoLogQueue queue(2);
+  EXPECT_TRUE(queue.push(nullptr,
+                         makeLog(counters, "A", TkoLogEvent::MarkSoftTko)));
+  EXPECT_TRUE(queue.push(nullptr,
+                         makeLog(counters, "A", TkoLogEvent::MarkSoftTko)));
+  EXPECT_FALSE(queue.push(nullptr,
+                          makeLog(counters, "A", TkoLogEvent::MarkSoftTko)));
+  EXPECT_EQ(2, queue.flush());
+  EXPECT_TRUE(queue.push(nullptr,
+                         makeLog(counters, "A", TkoLogEvent::MarkSoftTko)));
+}
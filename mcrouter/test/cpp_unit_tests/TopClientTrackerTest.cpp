@@ -0,0 +1,115 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <folly/Conv.h>
+
+#include "mcrouter/TopClientTracker.h"
+
+using facebook::memcache::mcrouter::TopClientTracker;
+
+namespace {
+
+void record(TopClientTracker& tracker, const std::string& client,
+            uint64_t bytesIn, uint64_t bytesOut) {
+  if (tracker.sampleNext()) {
+    tracker.add(client, bytesIn, bytesOut);
+  }
+}
+
+}  // anonymous namespace
+
+TEST(TopClientTracker, disabled) {
+  TopClientTracker tracker(8, 0, 100);
+  EXPECT_FALSE(tracker.enabled());
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_FALSE(tracker.sampleNext());
+  }
+  EXPECT_TRUE(tracker.top().empty());
+}
+
+TEST(TopClientTracker, sampling) {
+  TopClientTracker tracker(8, 10, 100);
+  EXPECT_TRUE(tracker.enabled());
+  for (int i = 0; i < 9; ++i) {
+    record(tracker, "a", 10, 20);
+  }
+  EXPECT_TRUE(tracker.top().empty());
+
+  record(tracker, "a", 10, 20);
+  auto top = tracker.top();
+  ASSERT_EQ(1, top.size());
+  EXPECT_EQ("a", top[0].client);
+  // totals are scaled by the sample period
+  EXPECT_EQ(10, top[0].requests);
+  EXPECT_EQ(100, top[0].bytesIn);
+  EXPECT_EQ(200, top[0].bytesOut);
+  EXPECT_EQ(1300, top[0].cost);
+  EXPECT_EQ(0, top[0].error);
+}
+
+TEST(TopClientTracker, rankedByCost) {
+  TopClientTracker tracker(8, 1, 100);
+  // Fewer but much larger requests cost more
+  for (int i = 0; i < 100; ++i) {
+    record(tracker, "small", 10, 10);
+    if (i % 10 == 0) {
+      record(tracker, "large", 10, 10000);
+    }
+  }
+
+  auto top = tracker.top();
+  ASSERT_EQ(2, top.size());
+  EXPECT_EQ("large", top[0].client);
+  EXPECT_EQ(10, top[0].requests);
+  EXPECT_EQ(10 * (100 + 10 + 10000), top[0].cost);
+  EXPECT_EQ("small", top[1].client);
+  EXPECT_EQ(100, top[1].requests);
+}
+
+TEST(TopClientTracker, heavyHitters) {
+  TopClientTracker tracker(4, 1, 1);
+  for (int i = 0; i < 1000; ++i) {
+    record(tracker, "hot", 0, 9);
+    record(tracker, folly::to<std::string>("cold", i), 0, 9);
+  }
+
+  auto top = tracker.top();
+  ASSERT_EQ(4, top.size());
+  EXPECT_EQ("hot", top[0].client);
+  EXPECT_EQ(1000, top[0].requests);
+  // never below the real cost
+  EXPECT_GE(top[0].cost, 10000);
+  for (const auto& entry : top) {
+    EXPECT_LE(entry.error, entry.cost);
+  }
+}
+
+TEST(TopClientTracker, merge) {
+  TopClientTracker a(4, 1, 0);
+  TopClientTracker b(4, 1, 0);
+  record(a, "x", 50, 50);
+  record(a, "y", 10, 0);
+  record(b, "y", 10, 80);
+  record(b, "z", 1, 0);
+
+  auto merged = TopClientTracker::merge({a.top(), b.top()}, 2);
+  ASSERT_EQ(2, merged.size());
+  EXPECT_EQ("x", merged[0].client);
+  EXPECT_EQ(100, merged[0].cost);
+  EXPECT_EQ("y", merged[1].client);
+  EXPECT_EQ(2, merged[1].requests);
+  EXPECT_EQ(20, merged[1].bytesIn);
+  EXPECT_EQ(80, merged[1].bytesOut);
+  EXPECT_EQ(100, merged[1].cost);
+}
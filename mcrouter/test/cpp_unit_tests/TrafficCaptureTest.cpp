@@ -0,0 +1,114 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <memory>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include <folly/experimental/TestUtil.h>
+#include <folly/FileUtil.h>
+
+#include "mcrouter/lib/McMsgRef.h"
+#include "mcrouter/TrafficCapture.h"
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+using folly::test::TemporaryFile;
+
+namespace {
+
+const size_t kBlockSize = 1024;
+
+CaptureRecord makeRecord(const std::string& key, uint64_t timeUs) {
+  CaptureRecord record;
+  record.op = mc_op_set;
+  record.timeUs = timeUs;
+  record.valueSize = 100;
+  record.keyHash = 42;
+  record.routingPrefix = "/a/b/";
+  record.key = key;
+  return record;
+}
+
+std::string makeBlock(uint64_t seq, uint64_t startUs,
+                      const std::string& key) {
+  std::string records;
+  appendCaptureRecord(makeRecord(key + "0", startUs), startUs, records);
+  appendCaptureRecord(makeRecord(key + "1", startUs + 10), startUs, records);
+  return encodeCaptureBlock(seq, startUs, records, kBlockSize);
+}
+
+}  // anonymous namespace
+
+TEST(TrafficCapture, roundTrip) {
+  auto data = makeBlock(0, 1000, "a");
+  EXPECT_EQ(kBlockSize, data.size());
+
+  TrafficCaptureReader reader(data, kBlockSize);
+  CaptureRecord record;
+  ASSERT_TRUE(reader.next(record));
+  EXPECT_EQ(mc_op_set, record.op);
+  EXPECT_EQ(1000, record.timeUs);
+  EXPECT_EQ(100, record.valueSize);
+  EXPECT_EQ(42, record.keyHash);
+  EXPECT_EQ("/a/b/", record.routingPrefix);
+  EXPECT_EQ("a0", record.key);
+  ASSERT_TRUE(reader.next(record));
+  EXPECT_EQ("a1", record.key);
+  EXPECT_EQ(1010, record.timeUs);
+  EXPECT_FALSE(reader.next(record));
+}
+
+TEST(TrafficCapture, ringOrder) {
+  /* The ring wrapped: slot 0 has the newest block, slot 2 was never
+     written and slot 3 is corrupted */
+  auto corrupted = makeBlock(4, 4000, "d");
+  corrupted[kBlockSize - 1] ^= 1;
+  corrupted[captureBlockHeaderSize()] ^= 1;
+  auto data = makeBlock(3, 3000, "c") + makeBlock(2, 2000, "b") +
+              std::string(kBlockSize, '\0') + corrupted;
+
+  TrafficCaptureReader reader(data, kBlockSize);
+  CaptureRecord record;
+  for (auto key : {"b0", "b1", "c0", "c1"}) {
+    ASSERT_TRUE(reader.next(record));
+    EXPECT_EQ(key, record.key);
+  }
+  EXPECT_FALSE(reader.next(record));
+}
+
+TEST(TrafficCapture, writer) {
+  TemporaryFile f("traffic_capture_test");
+  auto file = std::make_shared<TrafficCaptureFile>(f.path().string(),
+                                                   2 * kCaptureBlockSize);
+  {
+    TrafficCaptureWriter writer(file, /* samplePeriod= */ 2,
+                                /* withKeys= */ true);
+    for (size_t i = 0; i < 10; ++i) {
+      auto msg = createMcMsgRef("/a/b/key" + std::to_string(i), "value");
+      msg->op = mc_op_set;
+      writer.maybeRecord(*msg);
+    }
+  }
+
+  std::string data;
+  ASSERT_TRUE(folly::readFile(f.path().c_str(), data));
+  TrafficCaptureReader reader(data);
+  CaptureRecord record;
+  for (size_t i = 1; i < 10; i += 2) {
+    ASSERT_TRUE(reader.next(record));
+    EXPECT_EQ(mc_op_set, record.op);
+    EXPECT_EQ("/a/b/key" + std::to_string(i), record.key);
+    EXPECT_EQ("/a/b/", record.routingPrefix);
+    EXPECT_EQ(5, record.valueSize);
+  }
+  EXPECT_FALSE(reader.next(record));
+}
@@ -85,3 +85,33 @@ TEST(ConfigApi, file_change) {
 
   api.stopObserving(getpid());
 }
+
+TEST(ConfigApi, same_contents) {
+  TemporaryFile config("config_api_test");
+  std::string path(config.path().string());
+  EXPECT_TRUE(folly::writeFile(std::string("a"), path.data()));
+
+  McrouterOptions opts;
+  opts.config_file = path;
+  ConfigApi api(opts);
+  api.startObserving();
+
+  std::atomic<int> changes(0);
+  auto handle = api.subscribe([&changes]() { ++changes; });
+
+  api.trackConfigSources();
+  std::string buf;
+  EXPECT_TRUE(api.getConfigFile(buf));
+  api.subscribeToTrackedSources();
+
+  // rewriting the file with the same contents doesn't cause a reload
+  EXPECT_TRUE(folly::writeFile(std::string("a"), path.data()));
+  sleep(4);
+  EXPECT_EQ(changes, 0);
+
+  EXPECT_TRUE(folly::writeFile(std::string("b"), path.data()));
+  sleep(4);
+  EXPECT_EQ(changes, 1);
+
+  api.stopObserving(getpid());
+}
@@ -88,3 +88,42 @@ TEST(McRouteHandleProvider, pool_route) {
   EXPECT_TRUE(rh != nullptr);
   EXPECT_EQ(rh->routeName(), "asynclog:mock");
 }
+
+TEST(McRouteHandleProvider, reuse_unchanged_pools) {
+  McrouterOptions opts = defaultTestOptions();
+  opts.config_file = kMemcacheConfig;
+  auto router = McrouterInstance::init("test_reuse_pools", opts);
+  auto proxy = router->getProxy(0);
+
+  auto config = parseJsonString(R"({
+    "pools": {
+      "A": { "servers": [ "localhost:12345", "localhost:12346" ] },
+      "B": { "servers": [ "localhost:12347" ] }
+    }
+  })");
+  PoolFactory oldPf(config, router->configApi(), opts);
+  McRouteHandleProvider oldProvider(proxy, *proxy->destinationMap, oldPf);
+  RouteHandleFactory<McrouterRouteHandleIf> oldFactory(oldProvider);
+  oldFactory.create(parseJsonString(R"("PoolRoute|A")"));
+  oldFactory.create(parseJsonString(R"("PoolRoute|B")"));
+  auto oldPools = oldProvider.releasePools();
+  ASSERT_EQ(2, oldPools.size());
+
+  config["pools"]["B"]["servers"].push_back("localhost:12348");
+  PoolFactory pf(config, router->configApi(), opts, &oldPf);
+  EXPECT_EQ(1, pf.reusedPools());
+  EXPECT_EQ(4, pf.clients().size());
+  EXPECT_EQ(oldPools["A"].first, pf.parsePool(folly::dynamic("A")));
+  EXPECT_NE(oldPools["B"].first, pf.parsePool(folly::dynamic("B")));
+
+  McRouteHandleProvider provider(proxy, *proxy->destinationMap, pf,
+                                 &oldPools);
+  RouteHandleFactory<McrouterRouteHandleIf> factory(provider);
+  factory.create(parseJsonString(R"("PoolRoute|A")"));
+  factory.create(parseJsonString(R"("PoolRoute|B")"));
+  auto pools = provider.releasePools();
+  ASSERT_EQ(2, pools.size());
+  EXPECT_EQ(oldPools["A"].second, pools["A"].second);
+  EXPECT_EQ(2, pools["B"].second.size());
+  EXPECT_NE(oldPools["B"].second[0], pools["B"].second[0]);
+}
@@ -27,6 +27,7 @@
 #include <folly/experimental/Singleton.h>
 #include <folly/FileUtil.h>
 #include <folly/io/async/EventBase.h>
+#include <folly/Memory.h>
 
 #include "mcrouter/config.h"
 #include "mcrouter/McrouterClient.h"
@@ -43,6 +44,7 @@ using namespace std;
 using facebook::memcache::createMcMsgRef;
 using facebook::memcache::McMsgRef;
 using facebook::memcache::McReply;
+using facebook::memcache::McRequest;
 using facebook::memcache::McrouterOptions;
 
 const std::string kAlreadyRepliedConfig =
@@ -172,6 +174,81 @@ TEST(mcrouter, disconnect_callback) {
   EXPECT_EQ(0, sem_wait(&sem_disconnect));
 }
 
+TEST(mcrouter, send_inline) {
+  sem_t sem_reply;
+  sem_init(&sem_reply, 0, 0);
+
+  auto opts = defaultTestOptions();
+  opts.config_file = kMemcacheConfig;
+  opts.default_route = MEMCACHE_ROUTE;
+  auto router = McrouterInstance::init("test_send_inline", opts);
+  EXPECT_FALSE(router == nullptr);
+
+  auto client = router->createClient(
+    (mcrouter_client_callbacks_t){nullptr, nullptr, nullptr},
+    nullptr,
+    0);
+
+  /* Rejected by the precheck, so no memcached is needed */
+  auto msg = createMcMsgRef("test_key_inline");
+  msg->op = mc_op_shutdown;
+  McReply reply(mc_res_unknown);
+  router->getProxy(0)->eventBase->runInEventBaseThread([&]() {
+    client->sendInline(
+      McMsgRef::cloneRef(msg.get()),
+      [&reply, &sem_reply](const McMsgRef& req, McReply&& r) {
+        EXPECT_EQ(mc_op_shutdown, req->op);
+        reply = std::move(r);
+        sem_post(&sem_reply);
+      });
+  });
+  EXPECT_EQ(0, sem_wait(&sem_reply));
+  EXPECT_EQ(mc_res_bad_command, reply.result());
+  EXPECT_EQ(1, client->peekStats()["nreq"]);
+}
+
+namespace {
+
+struct MoveOnlyReplyCallback {
+  MoveOnlyReplyCallback(McReply& reply, sem_t& sem)
+      : reply_(reply), sem_(sem), owned_(folly::make_unique<int>(0)) {
+  }
+
+  void operator()(McReply&& reply) {
+    reply_ = std::move(reply);
+    sem_post(&sem_);
+  }
+
+ private:
+  McReply& reply_;
+  sem_t& sem_;
+  std::unique_ptr<int> owned_;
+};
+
+}  // anonymous namespace
+
+TEST(mcrouter, send_typed) {
+  sem_t sem_reply;
+  sem_init(&sem_reply, 0, 0);
+
+  auto opts = defaultTestOptions();
+  opts.config_file = kMemcacheConfig;
+  opts.default_route = MEMCACHE_ROUTE;
+  auto router = McrouterInstance::init("test_send_typed", opts);
+  EXPECT_FALSE(router == nullptr);
+
+  auto client = router->createClient(
+    (mcrouter_client_callbacks_t){nullptr, nullptr, nullptr},
+    nullptr,
+    0);
+
+  McReply reply(mc_res_unknown);
+  client->send(McRequest("test_key_typed"), mc_op_shutdown,
+               MoveOnlyReplyCallback(reply, sem_reply));
+  EXPECT_EQ(0, sem_wait(&sem_reply));
+  EXPECT_EQ(mc_res_bad_command, reply.result());
+}
+
 TEST(mcrouter, fork) {
   const char persistence_id[] = "fork";
   auto opts = defaultTestOptions();
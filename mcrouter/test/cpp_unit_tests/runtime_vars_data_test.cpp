@@ -7,6 +7,7 @@
  *  of patent rights can be found in the PATENTS file in the same directory.
  *
  */
+#include <stdexcept>
 #include <string>
 
 #include <gtest/gtest.h>
@@ -14,6 +15,7 @@
 #include <folly/json.h>
 
 #include "mcrouter/Observable.h"
+#include "mcrouter/RuntimeVar.h"
 #include "mcrouter/RuntimeVarsData.h"
 
 using namespace facebook::memcache::mcrouter;
@@ -62,3 +64,29 @@ TEST(runtime_vars_data, register_callback) {
   obj.set(std::make_shared<const RuntimeVarsData>(newJson));
   EXPECT_EQ(counter, 2);
 }
+
+TEST(runtime_vars_data, runtime_var) {
+  ObservableRuntimeVars vars;
+  auto parse = [](const folly::dynamic& json) {
+    if (!json.isNumber()) {
+      throw std::runtime_error("not a number");
+    }
+    return json.asDouble();
+  };
+  RuntimeVar<double> var(0.5, &vars, "fraction", parse);
+  EXPECT_EQ(0.5, var.get());
+
+  vars.set(std::make_shared<const RuntimeVarsData>("{\"fraction\": 0.25}"));
+  EXPECT_EQ(0.25, var.get());
+
+  /* Missing and invalid values keep the previous one */
+  vars.set(std::make_shared<const RuntimeVarsData>("{\"other\": 1}"));
+  EXPECT_EQ(0.25, var.get());
+  vars.set(std::make_shared<const RuntimeVarsData>("{\"fraction\": \"a\"}"));
+  EXPECT_EQ(0.25, var.get());
+
+  var.set(1.0);
+  EXPECT_EQ(1.0, var.get());
+  vars.set(std::make_shared<const RuntimeVarsData>("{\"fraction\": 0}"));
+  EXPECT_EQ(0.0, var.get());
+}
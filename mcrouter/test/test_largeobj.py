@@ -10,6 +10,7 @@ from __future__ import division
 from __future__ import print_function
 from __future__ import unicode_literals
 
+from mcrouter.test.MCProcess import Memcached
 from mcrouter.test.McrouterTestCase import McrouterTestCase
 from mcrouter.test.mock_servers import StoreServer
 
@@ -28,3 +29,32 @@ class TestLargeObj(McrouterTestCase):
         string_x = 'x' * self.value_size
         resp = self.mcrouter.set('test_largeobj', string_x)
         self.assertTrue(resp)
+
+class TestLargeObjNewRequestParser(TestLargeObj):
+    extra_args = ['--new-ascii-request-parser']
+
+class TestLargeObjStreamed(McrouterTestCase):
+    config = './mcrouter/test/test_largeobj.json'
+    extra_args = ['--new-ascii-parser', '--stream-get-value-bytes', '65536']
+    value_size = 1024 * 512
+
+    def setUp(self):
+        self.add_server(Memcached())
+        self.mcrouter = self.add_mcrouter(
+            self.config,
+            extra_args=self.extra_args)
+
+    def test_largeobj_streamed(self):
+        string_y = 'y' * self.value_size
+        self.assertTrue(self.mcrouter.set('test_largeobj', string_y))
+        self.assertEqual(self.mcrouter.get('test_largeobj'), string_y)
+        # Too big for a single read from memcached, so written while read
+        stats = self.mcrouter.stats()
+        self.assertEqual(int(stats['server_streamed_replies']), 1)
+        self.assertEqual(int(stats['server_broken_reply_streams']), 0)
+
+        # Small values are written once read
+        self.assertTrue(self.mcrouter.set('small', 'value'))
+        self.assertEqual(self.mcrouter.get('small'), 'value')
+        stats = self.mcrouter.stats()
+        self.assertEqual(int(stats['server_streamed_replies']), 1)
@@ -45,6 +45,17 @@ class TestDevNull(McrouterTestCase):
         self.assertEqual(mcr.delete("null:key2"), None)
         self.assertEqual(int(mcr.stats('ods')['dev_null_requests']), 2)
 
+    def test_dev_null_inline(self):
+        mcr = self.get_mcrouter()
+
+        mcr.set("good:key", "should_be_set")
+        self.assertEqual(int(mcr.stats()['proxy_reqs_inline']), 0)
+
+        # DevNullRoute replies without a fiber
+        mcr.set("null:key", "should_not_be_set")
+        self.assertEqual(mcr.get("null:key"), None)
+        self.assertEqual(int(mcr.stats()['proxy_reqs_inline']), 2)
+
 class TestMigratedPools(McrouterTestCase):
     config = './mcrouter/test/test_migrated_pools.json'
     extra_args = []
@@ -215,6 +226,21 @@ class TestDuplicateServersDiffTimeouts(McrouterTestCase):
         key = 'localhost:' + str(self.port_map[12345]) + ':TCP:ascii-2000'
         self.assertTrue(key in stats)
 
+class TestDuplicateServersDiffTimeoutsSameConnection(
+        TestDuplicateServersDiffTimeouts):
+    extra_args = ['--same-connection-any-timeout']
+
+    def test_duplicate_servers_difftimeouts(self):
+        mcr = self.get_mcrouter()
+
+        stats = mcr.stats('servers')
+        # Pools with different timeouts share the connection
+        self.assertEqual(1, len(stats))
+        key = 'localhost:' + str(self.port_map[12345]) + ':TCP:ascii'
+        self.assertTrue(key in stats)
+        self.assertTrue(mcr.set('key', 'value'))
+        self.assertEqual('value', mcr.get('key'))
+
 class TestSamePoolFailover(McrouterTestCase):
     config = './mcrouter/test/test_same_pool_failover.json'
     extra_args = []
@@ -11,6 +11,7 @@ from __future__ import print_function
 from __future__ import unicode_literals
 
 from threading import Thread
+import socket
 import time
 
 from mcrouter.test.MCProcess import McrouterClient, Memcached
@@ -59,6 +60,62 @@ class TestMcrouterBasic(McrouterTestCase):
         self.assertFalse(mcr.set(invalid_key, 'value'))
         self.assertEqual(mcr.get(invalid_key), "SERVER_ERROR local error")
 
+    def test_proxy_thread_cpus(self):
+        mcr = self.get_mcrouter(['--num-proxies=2', '--proxy-thread-cpus=0'])
+
+        self.assertTrue(mcr.set('key', 'value'))
+        self.assertEqual(mcr.get('key'), 'value')
+        self.assertEqual(mcr.stats()['proxy_threads_pinned'], '2')
+
+    def test_proxy_busy_poll(self):
+        mcr = self.get_mcrouter(['--num-proxies=2',
+                                 '--proxy-busy-poll-us=100'])
+
+        for i in range(10):
+            self.assertTrue(mcr.set('key' + str(i), 'value'))
+            self.assertEqual(mcr.get('key' + str(i)), 'value')
+
+    def test_config_build_threads(self):
+        mcr = self.get_mcrouter(['--num-proxies=4',
+                                 '--config-build-threads=2'])
+
+        for i in range(10):
+            self.assertTrue(mcr.set('key' + str(i), 'value'))
+            self.assertEqual(mcr.get('key' + str(i)), 'value')
+        self.assertGreater(int(mcr.stats()['config_build_time_us']), 0)
+
+    def test_staged_config_swap(self):
+        mcr = self.get_mcrouter(['--num-proxies=4', '--staged-config-swap'])
+
+        for i in range(10):
+            self.assertTrue(mcr.set('key' + str(i), 'value'))
+            self.assertEqual(mcr.get('key' + str(i)), 'value')
+        self.assertGreater(int(mcr.stats()['config_reload_peak_rss']), 0)
+
+    def test_metrics_port(self):
+        sock = socket.socket(socket.AF_INET6, socket.SOCK_STREAM)
+        sock.bind(('::', 0))
+        port = sock.getsockname()[1]
+        sock.close()
+        mcr = self.get_mcrouter(['--metrics-port=' + str(port),
+                                 '--metrics-render-interval-ms=100'])
+
+        self.assertTrue(mcr.set('key', 'value'))
+        time.sleep(0.5)
+        conn = socket.create_connection(('localhost', port))
+        conn.sendall(b'GET /metrics HTTP/1.0\r\n\r\n')
+        response = b''
+        while True:
+            data = conn.recv(4096)
+            if not data:
+                break
+            response += data
+        conn.close()
+
+        self.assertTrue(response.startswith(b'HTTP/1.0 200 OK'))
+        self.assertIn(b'mcrouter_cmd_set_total 1\n', response)
+        self.assertTrue(response.endswith(b'# EOF\n'))
+
     def test_stats_deadlock(self):
         mcr = self.get_mcrouter(['--proxy-threads=8'])
 
@@ -102,6 +159,9 @@ class TestMcrouterBasic(McrouterTestCase):
         time.sleep(2)
         self.assertFalse(mcr.is_alive())
 
+class TestMcrouterBasicNewRequestParser(TestMcrouterBasic):
+    extra_args = ['--new-ascii-request-parser']
+
 class TestMcrouterInvalidRoute(McrouterTestCase):
     config = './mcrouter/test/mcrouter_test_basic_1_1_1.json'
     extra_args = ['--send-invalid-route-to-default']
@@ -452,6 +512,27 @@ class TestMcrouterBasicL1L2(McrouterTestCase):
         while self.l1.get("key2") != "value2":
             self.assertEqual(mcr.get("key2"), "value2")
 
+    def test_l1_l2_lease_get(self):
+        """
+        Tests that the lease holder fills l1 from l2 with a lease-set
+        """
+        mcr = self.get_mcrouter(self.config)
+
+        self.l2.set("key1", "value1")
+        self.assertEqual(mcr.leaseGet("key1")["value"], "value1")
+
+        # l1 is filled asynchronously
+        while self.l1.get("key1") != "value1":
+            time.sleep(0.1)
+        self.assertEqual(mcr.leaseGet("key1")["value"], "value1")
+
+        # a miss in both gives the l1 lease token to the client
+        res = mcr.leaseGet("key2")
+        self.assertGreater(res["token"], 1)
+        res["value"] = "value2"
+        self.assertTrue(mcr.leaseSet("key2", res))
+        self.assertEqual(self.l1.get("key2"), "value2")
+
     def test_l1_l2_get_l1_down(self):
         """
         Tests that gets using l1/l2 caching is working when l1 is down
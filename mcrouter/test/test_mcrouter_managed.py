@@ -95,3 +95,28 @@ class TestMcrouterManagedMode(McrouterTestCase):
         self.mcrouter.shutdown()
         time.sleep(2)
         self.assertFalse(self.mcrouter.is_alive())
+
+class TestMcrouterManagedStandby(TestMcrouterManagedMode):
+    extra_args = ['-m', '--managed-standby']
+
+    def test_standby_takes_over(self):
+        pid = self.get_child_pid()
+        self.assertTrue(pid > 0)
+        self.assertTrue(self.killChildProcess(signal.SIGKILL))
+
+        # The standby child is already configured, it serves right away
+        self.mcrouter.disconnect()
+        start = time.time()
+        self.mcrouter.ensure_connected()
+        new_pid = self.get_child_pid()
+        self.assertTrue(new_pid > 0)
+        self.assertNotEqual(pid, new_pid)
+        self.assertTrue(time.time() - start < 1)
+        self.assertTrue(self.mcrouter.is_alive())
+
+        # And a new standby is ready for the next crash
+        time.sleep(1)
+        self.assertTrue(self.killChildProcess(signal.SIGKILL))
+        self.mcrouter.disconnect()
+        self.mcrouter.ensure_connected()
+        self.assertNotEqual(new_pid, self.get_child_pid())
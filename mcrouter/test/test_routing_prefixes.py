@@ -57,6 +57,13 @@ class TestMcrouterRoutingPrefixUmbrella(TestMcrouterRoutingPrefixAscii):
 class TestMcrouterRoutingPrefixOldNaming(TestMcrouterRoutingPrefixAscii):
     config = './mcrouter/test/routing_prefix_test_old_naming.json'
 
+class TestMcrouterRoutingPrefixLazyRoutes(TestMcrouterRoutingPrefixAscii):
+    extra_args = ['--lazy-routes', '--num-proxies', '4']
+
+class TestMcrouterRoutingPrefixLazyRoutesWarmup(TestMcrouterRoutingPrefixAscii):
+    extra_args = ['--lazy-routes', '--lazy-routes-warmup',
+                  '--num-proxies', '4']
+
 class TestCustomRoutingPrefixes(McrouterTestCase):
     config = './mcrouter/test/routing_prefix_test_custom.json'
     extra_args = []
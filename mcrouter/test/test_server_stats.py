@@ -11,6 +11,7 @@ from __future__ import print_function
 from __future__ import unicode_literals
 
 from mcrouter.test.McrouterTestCase import McrouterTestCase
+from mcrouter.test.MCProcess import Memcached
 from mcrouter.test.mock_servers import SleepServer
 
 class TestServerStatsOutstandingRequests(McrouterTestCase):
@@ -41,3 +42,31 @@ class TestServerStatsOutstandingRequests(McrouterTestCase):
             self.assertEqual('inflight_reqs', inflight_reqs[0])
             self.assertEqual(1, num_outstanding_reqs)
         self.assertEqual(1, num_stats)
+
+class TestServerStatsAdaptiveTimeout(McrouterTestCase):
+    config = './mcrouter/test/test_server_stats_adaptive.json'
+    extra_args = ['--server-timeout', '5000',
+                  '--adaptive-timeout-p99-percent', '300',
+                  '--adaptive-timeout-min-ms', '200',
+                  '--adaptive-timeout-window', '16',
+                  '--num-proxies', '1']
+
+    def setUp(self):
+        self.add_server(Memcached())
+        self.mcrouter = self.add_mcrouter(
+            self.config, extra_args=self.extra_args
+        )
+
+    def test_server_stats(self):
+        stats = self.mcrouter.stats('servers')
+        for stat_value in stats.values():
+            self.assertNotIn('adaptive_timeout_ms', stat_value)
+
+        for i in range(32):
+            self.mcrouter.get('key:{}'.format(i))
+        stats = self.mcrouter.stats('servers')
+        self.assertEqual(1, len(stats))
+        for stat_value in stats.values():
+            # A local memcached is fast: the timeout drops to the minimum
+            self.assertEqual('adaptive_timeout_ms:200',
+                             stat_value.split(' ')[3])
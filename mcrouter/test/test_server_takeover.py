@@ -0,0 +1,61 @@
+# Copyright (c) 2015, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree. An additional grant
+# of patent rights can be found in the PATENTS file in the same directory.
+
+from __future__ import absolute_import
+from __future__ import division
+from __future__ import print_function
+from __future__ import unicode_literals
+
+import os
+import shutil
+import tempfile
+import time
+
+from mcrouter.test.MCProcess import Mcrouter, Memcached
+from mcrouter.test.McrouterTestCase import McrouterTestCase
+
+class TestServerTakeover(McrouterTestCase):
+    config = './mcrouter/test/mcrouter_test_basic_1_1_1.json'
+
+    def setUp(self):
+        self.add_server(Memcached())
+        self.takeover_dir = tempfile.mkdtemp()
+        self.extra_args = [
+            '--takeover-socket',
+            os.path.join(self.takeover_dir, 'takeover.sock')]
+
+    def tearDown(self):
+        McrouterTestCase.tearDown(self)
+        shutil.rmtree(self.takeover_dir)
+
+    def wait_for_exit(self, mcrouter, timeout=10):
+        deadline = time.time() + timeout
+        while mcrouter.is_alive() and time.time() < deadline:
+            time.sleep(0.1)
+        return not mcrouter.is_alive()
+
+    def test_takeover(self):
+        old = self.add_mcrouter(self.config, extra_args=self.extra_args)
+        self.assertTrue(old.set('key', 'value'))
+
+        # Same port: it's not bound, the listening socket is handed over
+        new = Mcrouter(old.config, port=old.getport(),
+                       extra_args=self.extra_args)
+        self.open_mcrouters.append(new)
+        self.assertTrue(self.wait_for_exit(old))
+
+        new.ensure_connected()
+        self.assertEqual(new.get('key'), 'value')
+
+        # And the new one can be taken over in turn
+        newer = Mcrouter(old.config, port=old.getport(),
+                         extra_args=self.extra_args)
+        self.open_mcrouters.append(newer)
+        self.assertTrue(self.wait_for_exit(new))
+
+        newer.ensure_connected()
+        self.assertEqual(newer.get('key'), 'value')
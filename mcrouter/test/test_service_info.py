@@ -10,6 +10,9 @@ from __future__ import division
 from __future__ import print_function
 from __future__ import unicode_literals
 
+import json
+import time
+
 from mcrouter.test.MCProcess import Memcached
 from mcrouter.test.McrouterTestCase import McrouterTestCase
 
@@ -38,3 +41,92 @@ class TestServiceInfo(McrouterTestCase):
         hostid = mcrouter.get("__mcrouter__.hostid")
         self.assertEqual(str(int(hostid)), hostid)
         self.assertEqual(hostid, mcrouter.get("__mcrouter__.hostid"))
+
+    def test_pool_stats(self):
+        self.add_server(Memcached())
+        self.add_server(Memcached())
+        mcrouter = self.get_mcrouter()
+        self.assertTrue(mcrouter.set('key', 'value'))
+        stats = json.loads(mcrouter.get("__mcrouter__.pool_stats"))
+        for pool in ['A', 'B']:
+            self.assertEqual(stats[pool]['replies'], 1)
+            self.assertEqual(stats[pool]['results']['mc_res_stored'], 1)
+            self.assertEqual(stats[pool]['latency']['count'], 1)
+        pool = json.loads(mcrouter.get("__mcrouter__.pool_stats(A)"))
+        self.assertEqual(pool['replies'], 1)
+
+    def test_memory(self):
+        self.add_server(Memcached())
+        self.add_server(Memcached())
+        mcrouter = self.get_mcrouter()
+        self.assertTrue(mcrouter.set('key', 'value'))
+        memory = json.loads(mcrouter.get("__mcrouter__.memory"))
+        self.assertGreater(memory['route_handles']['objects'], 0)
+        self.assertGreater(memory['destinations']['objects'], 0)
+        self.assertGreater(memory['fiber_stacks']['bytes'], 0)
+        owners = sum(owner['bytes'] for name, owner in memory.items()
+                     if name != 'total_bytes')
+        self.assertEqual(memory['total_bytes'], owners)
+        stats = mcrouter.stats()
+        self.assertIn('memory_total_bytes', stats)
+
+    def test_proxy_loop_histograms(self):
+        self.add_server(Memcached())
+        self.add_server(Memcached())
+        mcrouter = self.get_mcrouter()
+        self.assertTrue(mcrouter.set('key', 'value'))
+        loop = json.loads(mcrouter.get("__mcrouter__.histograms(proxy_loop)"))
+        for name in ['loop_lag', 'queue_wait', 'fiber_wait']:
+            self.assertIn(name, loop)
+        self.assertGreater(loop['queue_wait']['count'], 0)
+        self.assertGreater(loop['fiber_wait']['count'], 0)
+
+class TestServiceInfoPreconnect(McrouterTestCase):
+    config = './mcrouter/test/test_service_info.json'
+    extra_args = ['--preconnect-destinations']
+
+    def test_preconnect(self):
+        self.add_server(Memcached())
+        self.add_server(Memcached())
+        mcrouter = self.add_mcrouter(self.config, extra_args=self.extra_args)
+        # No request is routed to the destinations, they connect on their own
+        for _ in range(50):
+            status = json.loads(mcrouter.get("__mcrouter__.preconnect"))
+            if status['connecting'] == 0:
+                break
+            time.sleep(0.1)
+        self.assertEqual(status['connecting'], 0)
+        self.assertEqual(status['up'], status['total'])
+        self.assertGreater(status['total'], 0)
+
+class TestServiceInfoSlowRequests(McrouterTestCase):
+    config = './mcrouter/test/test_service_info.json'
+    extra_args = ['--slow-request-threshold-us=1']
+
+    def test_slow_requests(self):
+        self.add_server(Memcached())
+        self.add_server(Memcached())
+        mcrouter = self.add_mcrouter(self.config, extra_args=self.extra_args)
+        self.assertTrue(mcrouter.set('key', 'value'))
+        slow = json.loads(mcrouter.get("__mcrouter__.slow_requests"))
+        self.assertGreater(len(slow), 0)
+        self.assertEqual(slow[-1]['op'], 'set')
+        self.assertTrue(slow[-1]['destination'].startswith('127.0.0.1:'))
+        self.assertGreaterEqual(slow[-1]['duration_us'], 1)
+        self.assertIn('host|', slow[-1]['route'])
+
+class TestServiceInfoRouteCpu(McrouterTestCase):
+    config = './mcrouter/test/test_service_info.json'
+    extra_args = ['--route-cpu-sample-period=1']
+
+    def test_route_cpu(self):
+        self.add_server(Memcached())
+        self.add_server(Memcached())
+        mcrouter = self.add_mcrouter(self.config, extra_args=self.extra_args)
+        self.assertTrue(mcrouter.set('key', 'value'))
+        routes = json.loads(mcrouter.get("__mcrouter__.route_cpu"))
+        self.assertGreater(len(routes), 0)
+        for path, node in routes.items():
+            self.assertGreater(node['calls'], 0)
+        leaves = [path for path in routes if 'host|' in path]
+        self.assertEqual(len(leaves), 2)
@@ -0,0 +1,57 @@
+# Copyright (c) 2015, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree. An additional grant
+# of patent rights can be found in the PATENTS file in the same directory.
+
+from __future__ import absolute_import
+from __future__ import division
+from __future__ import print_function
+from __future__ import unicode_literals
+
+import os
+import shutil
+import socket
+import tempfile
+
+from mcrouter.test.MCProcess import Mcrouter, Memcached
+from mcrouter.test.McrouterTestCase import McrouterTestCase
+
+class TestUnixSocket(McrouterTestCase):
+    config = './mcrouter/test/mcrouter_test_basic_1_1_1.json'
+    unix_config = './mcrouter/test/test_unix_socket.json'
+
+    def setUp(self):
+        self.add_server(Memcached())
+        self.socket_dir = tempfile.mkdtemp()
+        self.socket_path = os.path.join(self.socket_dir, 'mcrouter.sock')
+        self.inner = self.add_mcrouter(
+            self.config,
+            extra_args=['--unix-socket', self.socket_path])
+
+    def tearDown(self):
+        McrouterTestCase.tearDown(self)
+        shutil.rmtree(self.socket_dir)
+
+    def test_listener(self):
+        self.assertTrue(self.inner.set('key', 'value'))
+
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        sock.connect(self.socket_path)
+        fd = sock.makefile()
+        sock.send('get key\r\n')
+        self.assertEqual(fd.readline().strip(), 'VALUE key 0 5')
+        self.assertEqual(fd.readline().strip(), 'value')
+        self.assertEqual(fd.readline().strip(), 'END')
+        sock.close()
+
+    def test_destination(self):
+        # No ports in the config to substitute
+        outer = Mcrouter(self.unix_config,
+                         replace_map={'UNIX_SOCKET_PATH': self.socket_path})
+        self.open_mcrouters.append(outer)
+        outer.ensure_connected()
+        self.assertTrue(outer.set('key', 'value'))
+        self.assertEqual(self.inner.get('key'), 'value')
+        self.assertEqual(outer.get('key'), 'value')
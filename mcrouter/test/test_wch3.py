@@ -32,7 +32,7 @@ class EchoServer(MockServer):
 
 class TestWCH3(McrouterTestCase):
     config = './mcrouter/test/test_wch3.json'
-    extra_args = []
+    extra_args = ['--runtime-vars-file=mcrouter/test/runtime_vars_file.json']
 
     def setUp(self):
         for i in range(8):
@@ -57,8 +57,11 @@ class TestWCH3(McrouterTestCase):
             resp = int(self.mcrouter.get(key))
             respB = int(self.mcrouter.get('/test/B/' + key))
             respC = int(self.mcrouter.get('/test/C/' + key))
+            respD = int(self.mcrouter.get('/test/D/' + key))
             self.assertEqual(resp, respB)
             self.assertEqual(resp, respC)
+            # weights of D come from runtime vars
+            self.assertEqual(resp, respD)
             request_counts[resp] += 1
             self.assertTrue(resp in valid_ports)
             self.assertTrue(resp not in invalid_ports)
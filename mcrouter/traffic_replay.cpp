@@ -0,0 +1,338 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <folly/Conv.h>
+#include <folly/FileUtil.h>
+#include <folly/Memory.h>
+#include <folly/experimental/fibers/Baton.h>
+#include <folly/experimental/fibers/EventBaseLoopController.h>
+#include <folly/experimental/fibers/FiberManager.h>
+#include <folly/io/IOBuf.h>
+#include <folly/io/async/EventBase.h>
+
+#include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/network/AsyncMcClient.h"
+#include "mcrouter/mcrouter_config.h"
+#include "mcrouter/TrafficCapture.h"
+
+/**
+ * Replays traffic capture files (traffic_capture_file) against a memcache
+ * server, usually a test mcrouter, at speed times the captured rate.
+ *
+ * Requests are sent at the captured times (merged over all files and
+ * proxies), so replays of the same files are the same load. Gets, updates
+ * and deletes are replayed as get, set (with a value of the captured size)
+ * and delete, other operations are skipped. Keys that were captured as
+ * hashes only are replayed as <routing prefix>replay:<hash>.
+ *
+ * Captures sampled one in N requests need speed N for the original rate.
+ * Each thread has up to max_outstanding requests in flight, requests that
+ * are due while it's at the limit wait and are counted as late.
+ */
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+namespace {
+
+struct ReplayOptions {
+  std::string host;
+  uint16_t port{0};
+  size_t numThreads{1};
+  double speed{1.0};
+  size_t maxOutstanding{1000};
+  std::chrono::milliseconds timeout{1000};
+  bool stripRoutingPrefix{false};
+};
+
+/* Replayed requests more than this late are counted as late */
+const int64_t kLateUs = 10000;
+
+std::atomic<uint64_t> gResults[mc_nres];
+std::atomic<uint64_t> gSkipped{0};
+std::atomic<uint64_t> gLate{0};
+
+/* Values of set requests are prefixes of this */
+std::string gValue;
+
+class ReplayThread {
+ public:
+  ReplayThread(const ReplayOptions& opts,
+               std::vector<const CaptureRecord*> records,
+               uint64_t firstUs, int64_t startUs)
+      : opts_(opts),
+        records_(std::move(records)),
+        firstUs_(firstUs),
+        startUs_(startUs),
+        fm_(folly::make_unique<folly::fibers::EventBaseLoopController>()) {
+    dynamic_cast<folly::fibers::EventBaseLoopController&>(
+      fm_.loopController()).attachEventBase(eventBase_);
+  }
+
+  void run() {
+    if (records_.empty()) {
+      return;
+    }
+    ConnectionOptions options(opts_.host, opts_.port, mc_ascii_protocol);
+    options.writeTimeout = opts_.timeout;
+    client_ = folly::make_unique<AsyncMcClient>(eventBase_,
+                                                std::move(options));
+    fm_.addTask([this]() {
+      for (auto record : records_) {
+        waitUntilDue(*record);
+        while (outstanding_ >= opts_.maxOutstanding) {
+          slotFreed_.reset();
+          slotFreed_.wait();
+        }
+        ++outstanding_;
+        fm_.addTask([this, record]() {
+          replay(*record);
+          slotFreed_.post();
+          if (--outstanding_ == 0 && done_) {
+            eventBase_.terminateLoopSoon();
+          }
+        });
+      }
+      done_ = true;
+      if (outstanding_ == 0) {
+        eventBase_.terminateLoopSoon();
+      }
+    });
+    eventBase_.loopForever();
+  }
+
+  const std::vector<int64_t>& latenciesUs() const {
+    return latenciesUs_;
+  }
+
+ private:
+  const ReplayOptions& opts_;
+  std::vector<const CaptureRecord*> records_;
+  const uint64_t firstUs_;
+  const int64_t startUs_;
+  folly::EventBase eventBase_;
+  folly::fibers::FiberManager fm_;
+  std::unique_ptr<AsyncMcClient> client_;
+  size_t outstanding_{0};
+  /* Posted when a request completes, for the fiber sending them */
+  folly::fibers::Baton slotFreed_;
+  bool done_{false};
+  std::vector<int64_t> latenciesUs_;
+
+  void waitUntilDue(const CaptureRecord& record) {
+    auto dueUs = startUs_ +
+      static_cast<int64_t>((record.timeUs - firstUs_) / opts_.speed);
+    auto delayUs = dueUs - nowUs();
+    if (delayUs >= 1000) {
+      folly::fibers::Baton baton;
+      baton.timed_wait(std::chrono::milliseconds(delayUs / 1000));
+    } else if (delayUs < -kLateUs) {
+      ++gLate;
+    }
+  }
+
+  std::string key(const CaptureRecord& record) const {
+    std::string key;
+    if (!record.key.empty()) {
+      key = record.key;
+      if (opts_.stripRoutingPrefix) {
+        key.erase(0, McRequest::splitRoutingKey(key).first.size());
+      }
+    } else {
+      key = folly::to<std::string>(
+        opts_.stripRoutingPrefix ? "" : record.routingPrefix,
+        "replay:", record.keyHash);
+    }
+    return key;
+  }
+
+  template <int Op>
+  mc_res_t send(McRequest& req, McOperation<Op>) {
+    return client_->sendSync(req, McOperation<Op>(), opts_.timeout).result();
+  }
+
+  void replay(const CaptureRecord& record) {
+    McRequest req(key(record));
+    auto sentUs = nowUs();
+    mc_res_t result;
+    switch (record.op) {
+      case mc_op_get:
+      case mc_op_gets:
+      case mc_op_lease_get:
+      case mc_op_metaget:
+        result = send(req, McOperation<mc_op_get>());
+        break;
+      case mc_op_set:
+      case mc_op_add:
+      case mc_op_replace:
+      case mc_op_append:
+      case mc_op_prepend:
+      case mc_op_cas:
+      case mc_op_lease_set:
+        req.setValue(folly::IOBuf::wrapBufferAsValue(
+          gValue.data(), std::min<size_t>(record.valueSize, gValue.size())));
+        result = send(req, McOperation<mc_op_set>());
+        break;
+      case mc_op_delete:
+        result = send(req, McOperation<mc_op_delete>());
+        break;
+      default:
+        ++gSkipped;
+        return;
+    }
+    latenciesUs_.push_back(nowUs() - sentUs);
+    ++gResults[result];
+  }
+};
+
+void usage(char** argv) {
+  fprintf(stderr,
+          "Usage: %s [-t threads] [-s speed] [-o max_outstanding_per_thread] "
+          "[-T timeout_ms] [-n] host:port file...\n"
+          "  -n  strip routing prefixes from keys\n",
+          argv[0]);
+  exit(1);
+}
+
+int64_t percentile(const std::vector<int64_t>& sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  return sorted[std::min(sorted.size() - 1,
+                         static_cast<size_t>(p * sorted.size()))];
+}
+
+}  // anonymous namespace
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+
+  ReplayOptions opts;
+  int c;
+  while ((c = getopt(argc, argv, "t:s:o:T:nh")) >= 0) {
+    switch (c) {
+      case 't':
+        opts.numThreads = std::max(1, folly::to<int>(optarg));
+        break;
+      case 's':
+        opts.speed = folly::to<double>(optarg);
+        break;
+      case 'o':
+        opts.maxOutstanding = std::max(1, folly::to<int>(optarg));
+        break;
+      case 'T':
+        opts.timeout = std::chrono::milliseconds(folly::to<int>(optarg));
+        break;
+      case 'n':
+        opts.stripRoutingPrefix = true;
+        break;
+      default:
+        usage(argv);
+    }
+  }
+  if (optind + 2 > argc || opts.speed <= 0) {
+    usage(argv);
+  }
+  folly::StringPiece target(argv[optind]);
+  auto colon = target.rfind(':');
+  if (colon == std::string::npos) {
+    usage(argv);
+  }
+  opts.host = target.subpiece(0, colon).str();
+  opts.port = folly::to<uint16_t>(target.subpiece(colon + 1));
+
+  std::vector<CaptureRecord> records;
+  for (int i = optind + 1; i < argc; ++i) {
+    std::string data;
+    if (!folly::readFile(argv[i], data)) {
+      LOG(ERROR) << "Can't read " << argv[i];
+      return 1;
+    }
+    try {
+      TrafficCaptureReader reader(data);
+      CaptureRecord record;
+      while (reader.next(record)) {
+        records.push_back(record);
+      }
+    } catch (const std::exception& e) {
+      /* Keep the records read so far, the rest of the file is lost */
+      LOG(ERROR) << "Error reading " << argv[i] << ": " << e.what();
+    }
+  }
+  if (records.empty()) {
+    LOG(ERROR) << "No requests to replay";
+    return 1;
+  }
+
+  /* Blocks of different proxies overlap, replay in captured time order */
+  std::stable_sort(records.begin(), records.end(),
+                   [](const CaptureRecord& a, const CaptureRecord& b) {
+                     return a.timeUs < b.timeUs;
+                   });
+  size_t maxValueSize = 0;
+  for (const auto& record : records) {
+    maxValueSize = std::max<size_t>(maxValueSize, record.valueSize);
+  }
+  gValue.assign(maxValueSize, 'x');
+
+  /* Requests for one key go through the same thread, in order */
+  std::vector<std::vector<const CaptureRecord*>> perThread(opts.numThreads);
+  for (const auto& record : records) {
+    perThread[record.keyHash % opts.numThreads].push_back(&record);
+  }
+
+  auto firstUs = records.front().timeUs;
+  auto startUs = nowUs();
+  std::vector<std::unique_ptr<ReplayThread>> replayThreads;
+  std::vector<std::thread> threads;
+  for (auto& threadRecords : perThread) {
+    replayThreads.push_back(folly::make_unique<ReplayThread>(
+      opts, std::move(threadRecords), firstUs, startUs));
+    auto replayThread = replayThreads.back().get();
+    threads.emplace_back([replayThread]() { replayThread->run(); });
+  }
+  std::vector<int64_t> latenciesUs;
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i].join();
+    const auto& threadLatencies = replayThreads[i]->latenciesUs();
+    latenciesUs.insert(latenciesUs.end(), threadLatencies.begin(),
+                       threadLatencies.end());
+  }
+  auto elapsedUs = std::max<int64_t>(1, nowUs() - startUs);
+  std::sort(latenciesUs.begin(), latenciesUs.end());
+
+  LOG(INFO) << "Replayed " << latenciesUs.size() << " of " << records.size()
+            << " requests in " << elapsedUs / 1000 << "ms ("
+            << latenciesUs.size() * 1000000 / elapsedUs << " per second): "
+            << gSkipped.load() << " skipped, " << gLate.load()
+            << " late (target too slow or max outstanding too low)";
+  LOG(INFO) << "Latency us: p50 " << percentile(latenciesUs, 0.5)
+            << ", p99 " << percentile(latenciesUs, 0.99)
+            << ", p999 " << percentile(latenciesUs, 0.999);
+  for (int i = 0; i < mc_nres; ++i) {
+    if (gResults[i].load() > 0) {
+      LOG(INFO) << mc_res_to_string(static_cast<mc_res_t>(i)) << ": "
+                << gResults[i].load();
+    }
+  }
+  return 0;
+}